@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace cartographer {
+namespace common {
+
+#if CARTOGRAPHER_COUNT_ALLOCATIONS
+
+namespace {
+
+// Plain integers, so that accessing them never allocates.
+thread_local int64 thread_num_allocations = 0;
+thread_local int64 thread_num_allocated_bytes = 0;
+
+}  // namespace
+
+// Used by the replacements of the global operator new below.
+void* CountedAllocate(const std::size_t size) noexcept {
+  ++thread_num_allocations;
+  thread_num_allocated_bytes += size;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+AllocationCount GetThreadAllocationCount() {
+  return AllocationCount{thread_num_allocations, thread_num_allocated_bytes};
+}
+
+#else
+
+AllocationCount GetThreadAllocationCount() { return AllocationCount{0, 0}; }
+
+#endif
+
+}  // namespace common
+}  // namespace cartographer
+
+#if CARTOGRAPHER_COUNT_ALLOCATIONS
+
+void* operator new(const std::size_t size) {
+  void* const pointer = ::cartographer::common::CountedAllocate(size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void* operator new[](const std::size_t size) {
+  void* const pointer = ::cartographer::common::CountedAllocate(size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept {
+  return ::cartographer::common::CountedAllocate(size);
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept {
+  return ::cartographer::common::CountedAllocate(size);
+}
+
+void operator delete(void* const pointer) noexcept { std::free(pointer); }
+
+void operator delete[](void* const pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* const pointer, const std::nothrow_t&) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void* const pointer, const std::nothrow_t&) noexcept {
+  std::free(pointer);
+}
+
+#endif
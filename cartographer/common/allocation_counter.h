@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_ALLOCATION_COUNTER_H_
+#define CARTOGRAPHER_COMMON_ALLOCATION_COUNTER_H_
+
+#include "cartographer/common/config.h"
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace common {
+
+// Whether allocations are counted. If enabled by the CMake option
+// CARTOGRAPHER_COUNT_ALLOCATIONS, the global operator new is replaced by one
+// which counts the allocations of each thread. Otherwise, all counts are zero.
+constexpr bool kAllocationCountingEnabled = CARTOGRAPHER_COUNT_ALLOCATIONS;
+
+struct AllocationCount {
+  int64 num_allocations;
+  int64 num_allocated_bytes;
+};
+
+// Returns the number of heap allocations made by the calling thread so far.
+AllocationCount GetThreadAllocationCount();
+
+// Counts the heap allocations made by the calling thread during its lifetime,
+// e.g. to check that a code path does not allocate.
+class ScopedAllocationCounter {
+ public:
+  ScopedAllocationCounter() : start_(GetThreadAllocationCount()) {}
+
+  ScopedAllocationCounter(const ScopedAllocationCounter&) = delete;
+  ScopedAllocationCounter& operator=(const ScopedAllocationCounter&) = delete;
+
+  // Returns the allocations made since construction.
+  AllocationCount Get() const {
+    const AllocationCount now = GetThreadAllocationCount();
+    return AllocationCount{
+        now.num_allocations - start_.num_allocations,
+        now.num_allocated_bytes - start_.num_allocated_bytes};
+  }
+
+ private:
+  const AllocationCount start_;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_ALLOCATION_COUNTER_H_
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/allocation_counter.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/allocation_counter_test_helpers.h"
+#include "cartographer/common/trace.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(AllocationCounterTest, CountsAllocations) {
+  const ScopedAllocationCounter allocation_counter;
+  std::unique_ptr<std::vector<int>> values(new std::vector<int>(100));
+  const AllocationCount allocation_count = allocation_counter.Get();
+  if (!kAllocationCountingEnabled) {
+    EXPECT_EQ(0, allocation_count.num_allocations);
+    return;
+  }
+  EXPECT_EQ(2, allocation_count.num_allocations);
+  EXPECT_EQ(sizeof(std::vector<int>) + 100 * sizeof(int),
+            allocation_count.num_allocated_bytes);
+}
+
+TEST(AllocationCounterTest, RecordsAllocationsOfSpans) {
+  std::vector<int> values;
+  {
+    ScopedTraceSpan span("RecordsAllocationsOfSpans");
+    values.resize(10);
+  }
+  int num_spans = 0;
+  for (const TraceSpan& span : GetTraceSpans()) {
+    if (std::strcmp(span.name, "RecordsAllocationsOfSpans") == 0) {
+      ++num_spans;
+      EXPECT_EQ(kAllocationCountingEnabled ? 1 : 0, span.num_allocations);
+    }
+  }
+  EXPECT_EQ(1, num_spans);
+}
+
+TEST(AllocationCounterTest, ReusedBufferDoesNotAllocate) {
+  std::vector<int> values;
+  ExpectNoAllocationsInSteadyState([&values]() {
+    values.clear();
+    for (int i = 0; i != 100; ++i) {
+      values.push_back(i);
+    }
+  });
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
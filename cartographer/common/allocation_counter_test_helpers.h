@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_ALLOCATION_COUNTER_TEST_HELPERS_H_
+#define CARTOGRAPHER_COMMON_ALLOCATION_COUNTER_TEST_HELPERS_H_
+
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "cartographer/common/allocation_counter.h"
+#include "cartographer/common/trace.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+
+// Runs 'function' twice and expects the second run to make no heap
+// allocations, i.e. that 'function' does not allocate once the buffers it
+// reuses have grown. Without allocation counting, this only runs 'function'.
+inline void ExpectNoAllocationsInSteadyState(
+    const std::function<void()>& function) {
+  function();
+  const ScopedAllocationCounter allocation_counter;
+  function();
+  const AllocationCount allocation_count = allocation_counter.Get();
+  EXPECT_EQ(0, allocation_count.num_allocations)
+      << allocation_count.num_allocated_bytes << " bytes allocated.";
+}
+
+// Expects that the 'spans' named 'name' made no heap allocations, e.g. the
+// spans recorded while a scan is processed in a steady state. Without
+// allocation counting, this always succeeds.
+inline void ExpectNoAllocationsInSpans(const std::vector<TraceSpan>& spans,
+                                       const char* const name) {
+  for (const TraceSpan& span : spans) {
+    if (std::strcmp(span.name, name) == 0) {
+      EXPECT_EQ(0, span.num_allocations)
+          << name << " allocated " << span.num_allocated_bytes << " bytes.";
+    }
+  }
+}
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_ALLOCATION_COUNTER_TEST_HELPERS_H_
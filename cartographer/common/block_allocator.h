@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_BLOCK_ALLOCATOR_H_
+#define CARTOGRAPHER_COMMON_BLOCK_ALLOCATOR_H_
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace common {
+
+// Constructs objects of type 'T' in blocks of contiguous memory, so that many
+// small objects need few heap allocations and objects constructed one after
+// another are close in memory. Objects cannot be freed individually: all of
+// them are destroyed together with the allocator.
+//
+// This class is not thread-safe.
+template <typename T>
+class BlockAllocator {
+ public:
+  // Each block holds as many objects as fit into this many bytes, but at least
+  // one.
+  static constexpr int kBlockSizeInBytes = 64 * 1024;
+
+  BlockAllocator() = default;
+  ~BlockAllocator() {
+    for (const Block& block : blocks_) {
+      for (int i = 0; i != block.num_objects; ++i) {
+        block.objects[i].~T();
+      }
+    }
+  }
+
+  BlockAllocator(const BlockAllocator&) = delete;
+  BlockAllocator& operator=(const BlockAllocator&) = delete;
+
+  // Returns a new object constructed from 'args'. It stays valid for the
+  // lifetime of this allocator.
+  template <typename... Args>
+  T* New(Args&&... args) {
+    if (blocks_.empty() || blocks_.back().num_objects == kNumObjectsPerBlock) {
+      blocks_.emplace_back();
+      blocks_.back().storage.reset(new Storage[kNumObjectsPerBlock]);
+      blocks_.back().objects =
+          reinterpret_cast<T*>(blocks_.back().storage.get());
+    }
+    Block& block = blocks_.back();
+    T* const object =
+        new (&block.objects[block.num_objects]) T(std::forward<Args>(args)...);
+    ++block.num_objects;
+    return object;
+  }
+
+  // Returns the number of objects constructed.
+  int64 size() const {
+    return blocks_.empty() ? 0
+                           : (blocks_.size() - 1) * kNumObjectsPerBlock +
+                                 blocks_.back().num_objects;
+  }
+
+  // Returns the number of bytes allocated for blocks, including the space not
+  // yet used in the last block and excluding memory owned by the objects.
+  int64 GetMemoryUsageInBytes() const {
+    return sizeof(*this) + blocks_.capacity() * sizeof(Block) +
+           static_cast<int64>(blocks_.size()) * kNumObjectsPerBlock *
+               sizeof(T);
+  }
+
+ private:
+  using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  static constexpr int kNumObjectsPerBlock =
+      sizeof(T) < kBlockSizeInBytes ? kBlockSizeInBytes / sizeof(T) : 1;
+
+  struct Block {
+    std::unique_ptr<Storage[]> storage;
+    T* objects = nullptr;
+    int num_objects = 0;
+  };
+
+  std::vector<Block> blocks_;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_BLOCK_ALLOCATOR_H_
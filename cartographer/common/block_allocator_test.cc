@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/block_allocator.h"
+
+#include <array>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(BlockAllocatorTest, ObjectsStayValid) {
+  BlockAllocator<std::array<int, 1000>> allocator;
+  std::vector<std::array<int, 1000>*> objects;
+  for (int i = 0; i != 100; ++i) {
+    objects.push_back(allocator.New());
+    objects.back()->fill(i);
+  }
+  EXPECT_EQ(100, allocator.size());
+  for (int i = 0; i != 100; ++i) {
+    EXPECT_EQ(i, objects[i]->front());
+    EXPECT_EQ(i, objects[i]->back());
+  }
+  EXPECT_LE(100 * sizeof(std::array<int, 1000>),
+            allocator.GetMemoryUsageInBytes());
+}
+
+TEST(BlockAllocatorTest, DestroysObjects) {
+  int num_destroyed = 0;
+  struct Counter {
+    explicit Counter(int* num_destroyed) : num_destroyed(num_destroyed) {}
+    ~Counter() { ++*num_destroyed; }
+    int* num_destroyed;
+  };
+  {
+    BlockAllocator<Counter> allocator;
+    for (int i = 0; i != 100000; ++i) {
+      EXPECT_EQ(&num_destroyed, allocator.New(&num_destroyed)->num_destroyed);
+    }
+    EXPECT_EQ(0, num_destroyed);
+  }
+  EXPECT_EQ(100000, num_destroyed);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -48,29 +48,35 @@ class BlockingQueue {
   // Pushes a value onto the queue. Blocks if the queue is full.
   void Push(T t) {
     MutexLocker lock(&mutex_);
-    lock.Await([this]() REQUIRES(mutex_) { return QueueNotFullCondition(); });
+    lock.Await(&not_full_,
+               [this]() REQUIRES(mutex_) { return QueueNotFullCondition(); });
     deque_.push_back(std::move(t));
+    not_empty_.Signal();
   }
 
   // Like push, but returns false if 'timeout' is reached.
   bool PushWithTimeout(T t, const common::Duration timeout) {
     MutexLocker lock(&mutex_);
     if (!lock.AwaitWithTimeout(
+            &not_full_,
             [this]() REQUIRES(mutex_) { return QueueNotFullCondition(); },
             timeout)) {
       return false;
     }
     deque_.push_back(std::move(t));
+    not_empty_.Signal();
     return true;
   }
 
   // Pops the next value from the queue. Blocks until a value is available.
   T Pop() {
     MutexLocker lock(&mutex_);
-    lock.Await([this]() REQUIRES(mutex_) { return QueueNotEmptyCondition(); });
+    lock.Await(&not_empty_,
+               [this]() REQUIRES(mutex_) { return QueueNotEmptyCondition(); });
 
     T t = std::move(deque_.front());
     deque_.pop_front();
+    not_full_.Signal();
     return t;
   }
 
@@ -78,12 +84,14 @@ class BlockingQueue {
   T PopWithTimeout(const common::Duration timeout) {
     MutexLocker lock(&mutex_);
     if (!lock.AwaitWithTimeout(
+            &not_empty_,
             [this]() REQUIRES(mutex_) { return QueueNotEmptyCondition(); },
             timeout)) {
       return nullptr;
     }
     T t = std::move(deque_.front());
     deque_.pop_front();
+    not_full_.Signal();
     return t;
   }
 
@@ -115,6 +123,10 @@ class BlockingQueue {
   }
 
   Mutex mutex_;
+  // Only the waiters for the state that changed are woken up, so that a
+  // producer is never woken by another producer and vice versa.
+  Mutex::Condition not_empty_;
+  Mutex::Condition not_full_;
   const size_t queue_size_ GUARDED_BY(mutex_);
   std::deque<T> deque_ GUARDED_BY(mutex_);
 };
@@ -27,8 +27,22 @@ proto::CeresSolverOptions CreateCeresSolverOptionsProto(
   proto.set_max_num_iterations(
       parameter_dictionary->GetNonNegativeInt("max_num_iterations"));
   proto.set_num_threads(parameter_dictionary->GetNonNegativeInt("num_threads"));
+  if (parameter_dictionary->HasKey("linear_solver_type")) {
+    proto.set_linear_solver_type(
+        parameter_dictionary->GetString("linear_solver_type"));
+  }
+  if (parameter_dictionary->HasKey("preconditioner_type")) {
+    proto.set_preconditioner_type(
+        parameter_dictionary->GetString("preconditioner_type"));
+  }
+  if (parameter_dictionary->HasKey("sparse_linear_algebra_library_type")) {
+    proto.set_sparse_linear_algebra_library_type(
+        parameter_dictionary->GetString("sparse_linear_algebra_library_type"));
+  }
   CHECK_GT(proto.max_num_iterations(), 0);
   CHECK_GT(proto.num_threads(), 0);
+  // Fail early on misspelled names instead of on the first optimization.
+  CreateCeresSolverOptions(proto);
   return proto;
 }
 
@@ -37,7 +51,25 @@ ceres::Solver::Options CreateCeresSolverOptions(
   ceres::Solver::Options options;
   options.use_nonmonotonic_steps = proto.use_nonmonotonic_steps();
   options.max_num_iterations = proto.max_num_iterations();
+  // Also used for evaluating residuals and Jacobians in parallel.
   options.num_threads = proto.num_threads();
+  if (!proto.linear_solver_type().empty()) {
+    CHECK(ceres::StringToLinearSolverType(proto.linear_solver_type(),
+                                          &options.linear_solver_type))
+        << "Unknown linear solver type: " << proto.linear_solver_type();
+  }
+  if (!proto.preconditioner_type().empty()) {
+    CHECK(ceres::StringToPreconditionerType(proto.preconditioner_type(),
+                                            &options.preconditioner_type))
+        << "Unknown preconditioner type: " << proto.preconditioner_type();
+  }
+  if (!proto.sparse_linear_algebra_library_type().empty()) {
+    CHECK(ceres::StringToSparseLinearAlgebraLibraryType(
+        proto.sparse_linear_algebra_library_type(),
+        &options.sparse_linear_algebra_library_type))
+        << "Unknown sparse linear algebra library type: "
+        << proto.sparse_linear_algebra_library_type();
+  }
   return options;
 }
 
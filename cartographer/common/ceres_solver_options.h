@@ -17,6 +17,9 @@
 #ifndef CARTOGRAPHER_COMMON_CERES_SOLVER_OPTIONS_H_
 #define CARTOGRAPHER_COMMON_CERES_SOLVER_OPTIONS_H_
 
+#include <functional>
+#include <utility>
+
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/proto/ceres_solver_options.pb.h"
 #include "ceres/ceres.h"
@@ -30,6 +33,30 @@ proto::CeresSolverOptions CreateCeresSolverOptionsProto(
 ceres::Solver::Options CreateCeresSolverOptions(
     const proto::CeresSolverOptions& proto);
 
+// Ends a solve early once 'should_terminate' returns true, which is checked
+// after every iteration from 'min_num_iterations' on, so that solves which are
+// ended early over and over still make progress. Ceres reports success and
+// keeps the parameters of the last iteration, so the partial result can be
+// used.
+class TerminationCallback : public ceres::IterationCallback {
+ public:
+  TerminationCallback(int min_num_iterations,
+                      std::function<bool()> should_terminate)
+      : min_num_iterations_(min_num_iterations),
+        should_terminate_(std::move(should_terminate)) {}
+
+  ceres::CallbackReturnType operator()(
+      const ceres::IterationSummary& summary) override {
+    return summary.iteration >= min_num_iterations_ && should_terminate_()
+               ? ceres::SOLVER_TERMINATE_SUCCESSFULLY
+               : ceres::SOLVER_CONTINUE;
+  }
+
+ private:
+  const int min_num_iterations_;
+  const std::function<bool()> should_terminate_;
+};
+
 }  // namespace common
 }  // namespace cartographer
 
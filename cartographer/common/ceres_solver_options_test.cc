@@ -0,0 +1,55 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/ceres_solver_options.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(TerminationCallbackTest, TerminatesAfterMinNumIterations) {
+  int num_calls = 0;
+  TerminationCallback termination_callback(3, [&num_calls]() {
+    ++num_calls;
+    return true;
+  });
+  ceres::IterationSummary summary;
+  for (summary.iteration = 0; summary.iteration != 3; ++summary.iteration) {
+    EXPECT_EQ(ceres::SOLVER_CONTINUE, termination_callback(summary));
+  }
+  EXPECT_EQ(0, num_calls);
+  EXPECT_EQ(ceres::SOLVER_TERMINATE_SUCCESSFULLY,
+            termination_callback(summary));
+  EXPECT_EQ(1, num_calls);
+}
+
+TEST(TerminationCallbackTest, ContinuesUnlessRequested) {
+  bool should_terminate = false;
+  TerminationCallback termination_callback(
+      0, [&should_terminate]() { return should_terminate; });
+  ceres::IterationSummary summary;
+  summary.iteration = 5;
+  EXPECT_EQ(ceres::SOLVER_CONTINUE, termination_callback(summary));
+  should_terminate = true;
+  EXPECT_EQ(ceres::SOLVER_TERMINATE_SUCCESSFULLY,
+            termination_callback(summary));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
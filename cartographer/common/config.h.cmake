@@ -17,6 +17,12 @@
 #ifndef CARTOGRAPHER_COMMON_CONFIG_H_
 #define CARTOGRAPHER_COMMON_CONFIG_H_
 
+// Whether CARTOGRAPHER_TRACE_SPAN() records spans, see trace.h.
+#cmakedefine01 CARTOGRAPHER_ENABLE_TRACING
+
+// Whether heap allocations are counted, see allocation_counter.h.
+#cmakedefine01 CARTOGRAPHER_COUNT_ALLOCATIONS
+
 namespace cartographer {
 namespace common {
 
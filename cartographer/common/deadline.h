@@ -0,0 +1,73 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_DEADLINE_H_
+#define CARTOGRAPHER_COMMON_DEADLINE_H_
+
+#include <atomic>
+#include <chrono>
+
+#include "cartographer/common/time.h"
+
+namespace cartographer {
+namespace common {
+
+// A point in time after which anytime computations, e.g. branch-and-bound
+// searches, stop and return the best result found so far. Afterwards,
+// 'expired()' tells whether a computation was cut short.
+//
+// This class is thread-safe.
+class Deadline {
+ public:
+  explicit Deadline(const std::chrono::steady_clock::time_point time_point)
+      : time_point_(time_point) {}
+
+  // A deadline 'duration' from now.
+  explicit Deadline(const Duration duration)
+      : Deadline(
+            std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                duration)) {}
+
+  Deadline(const Deadline&) = delete;
+  Deadline& operator=(const Deadline&) = delete;
+
+  // Returns true if the deadline has passed. Computations calling this are
+  // expected to stop once it returns true, which is remembered.
+  bool CheckExpired() {
+    if (expired_.load(std::memory_order_relaxed)) {
+      return true;
+    }
+    if (std::chrono::steady_clock::now() < time_point_) {
+      return false;
+    }
+    expired_.store(true, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Returns whether CheckExpired() returned true, i.e. whether a computation
+  // using this deadline did not run to completion.
+  bool expired() const { return expired_.load(std::memory_order_relaxed); }
+
+ private:
+  const std::chrono::steady_clock::time_point time_point_;
+  std::atomic<bool> expired_{false};
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_DEADLINE_H_
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/deadline.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(DeadlineTest, FutureDeadlineDoesNotExpire) {
+  Deadline deadline(FromSeconds(3600.));
+  EXPECT_FALSE(deadline.CheckExpired());
+  EXPECT_FALSE(deadline.expired());
+}
+
+TEST(DeadlineTest, PastDeadlineExpires) {
+  Deadline deadline(std::chrono::steady_clock::now() -
+                    std::chrono::seconds(1));
+  EXPECT_FALSE(deadline.expired());
+  EXPECT_TRUE(deadline.CheckExpired());
+  EXPECT_TRUE(deadline.expired());
+  EXPECT_TRUE(deadline.CheckExpired());
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -30,13 +30,20 @@ FixedRatioSampler::~FixedRatioSampler() {}
 
 bool FixedRatioSampler::Pulse() {
   ++num_pulses_;
-  if (static_cast<double>(num_samples_) / num_pulses_ < ratio_) {
+  num_expected_samples_ += ratio_;
+  if (num_samples_ < num_expected_samples_) {
     ++num_samples_;
     return true;
   }
   return false;
 }
 
+void FixedRatioSampler::SetRatio(const double ratio) {
+  CHECK_GT(ratio, 0.);
+  CHECK_LE(ratio, 1.);
+  ratio_ = ratio;
+}
+
 string FixedRatioSampler::DebugString() {
   return std::to_string(num_samples_) + " (" +
          std::to_string(100. * num_samples_ / num_pulses_) + "%)";
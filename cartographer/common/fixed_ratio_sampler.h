@@ -37,16 +37,24 @@ class FixedRatioSampler {
   // Returns true if this pulse should result in an sample.
   bool Pulse();
 
+  // Changes the ratio for future pulses. Past pulses keep counting with the
+  // ratio they were pulsed at, so changing it causes neither a burst of
+  // samples nor a pause.
+  void SetRatio(double ratio);
+
   // Returns a debug string describing the current ratio of samples to pulses.
   string DebugString();
 
  private:
   // Sampling occurs if the proportion of samples to pulses drops below this
   // number.
-  const double ratio_;
+  double ratio_;
 
   int64 num_pulses_ = 0;
   int64 num_samples_ = 0;
+  // Sum of the ratios at each pulse. Sampling occurs if 'num_samples_' drops
+  // below it.
+  double num_expected_samples_ = 0.;
 };
 
 }  // namespace common
@@ -51,6 +51,24 @@ TEST(FixedRatioSamplerTest, FirstPulseIsTrue) {
   }
 }
 
+TEST(FixedRatioSamplerTest, SetRatio) {
+  FixedRatioSampler fixed_ratio_sampler(0.5);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i % 2 == 0, fixed_ratio_sampler.Pulse());
+  }
+  // Neither the samples missing at the higher ratio are caught up on, nor are
+  // the surplus samples at the lower ratio waited for.
+  fixed_ratio_sampler.SetRatio(0.25);
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(i % 4 == 0, fixed_ratio_sampler.Pulse());
+  }
+  fixed_ratio_sampler.SetRatio(1.);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(fixed_ratio_sampler.Pulse());
+  }
+  EXPECT_DEATH(fixed_ratio_sampler.SetRatio(0.), "ratio");
+}
+
 }  // namespace
 }  // namespace common
 }  // namespace cartographer
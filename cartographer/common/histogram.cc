@@ -17,7 +17,7 @@
 #include "cartographer/common/histogram.h"
 
 #include <algorithm>
-#include <numeric>
+#include <cmath>
 #include <string>
 
 #include "cartographer/common/port.h"
@@ -26,53 +26,153 @@
 namespace cartographer {
 namespace common {
 
-void Histogram::Add(const float value) { values_.push_back(value); }
+namespace {
+
+constexpr int kNumBuckets =
+    1 + (Histogram::kMaxExponent - Histogram::kMinExponent) *
+            Histogram::kNumSubBuckets;
+
+// Bucket 0 holds all values below 2^kMinExponent. Bucket 1 + i * kNumSubBuckets
+// + j holds the values in the j-th sub-bucket of [2^(kMinExponent + i),
+// 2^(kMinExponent + i + 1)).
+int GetBucketIndex(const float value) {
+  // Also true for NaN.
+  if (!(value >= std::ldexp(1.f, Histogram::kMinExponent))) {
+    return 0;
+  }
+  int exponent;
+  // The 'mantissa' is in [0.5, 1).
+  const float mantissa = std::frexp(value, &exponent);
+  if (exponent > Histogram::kMaxExponent) {
+    return kNumBuckets - 1;
+  }
+  const int sub_bucket =
+      std::min(Histogram::kNumSubBuckets - 1,
+               static_cast<int>((2.f * mantissa - 1.f) *
+                                Histogram::kNumSubBuckets));
+  return 1 +
+         (exponent - 1 - Histogram::kMinExponent) * Histogram::kNumSubBuckets +
+         sub_bucket;
+}
+
+}  // namespace
+
+constexpr int Histogram::kNumSubBuckets;
+constexpr int Histogram::kMinExponent;
+constexpr int Histogram::kMaxExponent;
+
+Histogram::Histogram() : bucket_counts_(kNumBuckets, 0) {}
+
+void Histogram::Add(const float value) {
+  ++bucket_counts_[GetBucketIndex(value)];
+  if (count_ == 0) {
+    min_ = value;
+    max_ = value;
+  } else {
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+  ++count_;
+  sum_ += value;
+}
+
+void Histogram::Merge(const Histogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  for (int i = 0; i != kNumBuckets; ++i) {
+    bucket_counts_[i] += other.bucket_counts_[i];
+  }
+  if (count_ == 0) {
+    min_ = other.min_;
+    max_ = other.max_;
+  } else {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+float Histogram::Percentile(const float percentile) const {
+  CHECK_GE(percentile, 0.f);
+  CHECK_LE(percentile, 100.f);
+  if (count_ == 0) {
+    return 0.f;
+  }
+  if (percentile == 0.f) {
+    return min_;
+  }
+  if (percentile == 100.f) {
+    return max_;
+  }
+  const int64 rank = std::max(
+      int64{1}, static_cast<int64>(std::ceil(percentile / 100.f * count_)));
+  int64 total_count = 0;
+  for (int i = 0; i != kNumBuckets; ++i) {
+    total_count += bucket_counts_[i];
+    if (total_count >= rank) {
+      return GetBucketValue(i);
+    }
+  }
+  return max_;
+}
+
+float Histogram::GetBucketValue(const int index) const {
+  float value = 0.f;
+  if (index != 0) {
+    const int exponent = kMinExponent + (index - 1) / kNumSubBuckets;
+    const int sub_bucket = (index - 1) % kNumSubBuckets;
+    value = std::ldexp(1.f + (sub_bucket + 0.5f) / kNumSubBuckets, exponent);
+  }
+  return std::min(max_, std::max(min_, value));
+}
 
 string Histogram::ToString(const int buckets) const {
   CHECK_GE(buckets, 1);
-  if (values_.empty()) {
+  if (count_ == 0) {
     return "Count: 0";
   }
-  const float min = *std::min_element(values_.begin(), values_.end());
-  const float max = *std::max_element(values_.begin(), values_.end());
-  const float mean =
-      std::accumulate(values_.begin(), values_.end(), 0.f) / values_.size();
-  string result = "Count: " + std::to_string(values_.size()) +
-                  "  Min: " + std::to_string(min) +
-                  "  Max: " + std::to_string(max) +
+  const float mean = sum_ / count_;
+  string result = "Count: " + std::to_string(count_) +
+                  "  Min: " + std::to_string(min_) +
+                  "  Max: " + std::to_string(max_) +
                   "  Mean: " + std::to_string(mean);
-  if (min == max) {
+  if (min_ == max_) {
     return result;
   }
-  CHECK_LT(min, max);
-  float lower_bound = min;
-  int total_count = 0;
+  CHECK_LT(min_, max_);
+  std::vector<int64> counts(buckets, 0);
+  for (int i = 0; i != kNumBuckets; ++i) {
+    if (bucket_counts_[i] == 0) {
+      continue;
+    }
+    const int bucket = std::min(
+        buckets - 1, static_cast<int>((GetBucketValue(i) - min_) /
+                                      (max_ - min_) * buckets));
+    counts[bucket] += bucket_counts_[i];
+  }
+  float lower_bound = min_;
+  int64 total_count = 0;
   for (int i = 0; i != buckets; ++i) {
     const float upper_bound =
         (i + 1 == buckets)
-            ? max
-            : (max * (i + 1) / buckets + min * (buckets - i - 1) / buckets);
-    int count = 0;
-    for (const float value : values_) {
-      if (lower_bound <= value &&
-          (i + 1 == buckets ? value <= upper_bound : value < upper_bound)) {
-        ++count;
-      }
-    }
+            ? max_
+            : (max_ * (i + 1) / buckets + min_ * (buckets - i - 1) / buckets);
+    const int64 count = counts[i];
     total_count += count;
     result += "\n[" + std::to_string(lower_bound) + ", " +
               std::to_string(upper_bound) + ((i + 1 == buckets) ? "]" : ")");
     constexpr int kMaxBarChars = 20;
-    const int bar =
-        (count * kMaxBarChars + values_.size() / 2) / values_.size();
+    const int bar = (count * kMaxBarChars + count_ / 2) / count_;
     result += "\t";
     for (int i = 0; i != kMaxBarChars; ++i) {
       result += (i < (kMaxBarChars - bar)) ? " " : "#";
     }
     result += "\tCount: " + std::to_string(count) + " (" +
-              std::to_string(count * 1e2f / values_.size()) + "%)";
+              std::to_string(count * 1e2f / count_) + "%)";
     result += "\tTotal: " + std::to_string(total_count) + " (" +
-              std::to_string(total_count * 1e2f / values_.size()) + "%)";
+              std::to_string(total_count * 1e2f / count_) + "%)";
     lower_bound = upper_bound;
   }
   return result;
@@ -25,13 +25,50 @@
 namespace cartographer {
 namespace common {
 
+// Log-linear histogram using constant memory. Each power of two is split into
+// 'kNumSubBuckets' buckets of equal width, so values are kept with a relative
+// error of at most 1 / 'kNumSubBuckets'. Values below 2^'kMinExponent',
+// including zero and negative values, share one bucket, values of
+// 2^'kMaxExponent' and above the last one. The count, minimum, maximum and
+// mean are exact.
+//
+// Adding a value is O(1). Histograms filled independently, e.g. one per
+// thread, can be combined with Merge().
 class Histogram {
  public:
+  static constexpr int kNumSubBuckets = 16;
+  static constexpr int kMinExponent = -24;
+  static constexpr int kMaxExponent = 32;
+
+  Histogram();
+
   void Add(float value);
+
+  // Adds all values added to 'other' to this histogram.
+  void Merge(const Histogram& other);
+
+  int64 count() const { return count_; }
+
+  // Returns an estimate of the value below which 'percentile' percent of the
+  // values lie, clamped to the range of the values. The 0th and 100th
+  // percentile are the exact minimum and maximum. Returns 0 if empty.
+  float Percentile(float percentile) const;
+
+  // Returns the distribution over 'buckets' buckets of equal width between the
+  // minimum and maximum value. The values of each bucket of the log-linear
+  // histogram are attributed to the one containing its center.
   string ToString(int buckets) const;
 
  private:
-  std::vector<float> values_;
+  // Returns the center of the bucket with 'index', clamped to the range of the
+  // values.
+  float GetBucketValue(int index) const;
+
+  std::vector<int64> bucket_counts_;
+  int64 count_ = 0;
+  double sum_ = 0.;
+  float min_ = 0.f;
+  float max_ = 0.f;
 };
 
 }  // namespace common
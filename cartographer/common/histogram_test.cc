@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(HistogramTest, Empty) {
+  Histogram histogram;
+  EXPECT_EQ(0, histogram.count());
+  EXPECT_EQ(0.f, histogram.Percentile(50.f));
+  EXPECT_EQ("Count: 0", histogram.ToString(10));
+}
+
+TEST(HistogramTest, PercentilesHaveBoundedRelativeError) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(1e-3f, 10.f);
+  std::vector<float> values;
+  Histogram histogram;
+  for (int i = 0; i != 10000; ++i) {
+    values.push_back(distribution(prng));
+    histogram.Add(values.back());
+  }
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(values.size(), histogram.count());
+  EXPECT_EQ(values.front(), histogram.Percentile(0.f));
+  EXPECT_EQ(values.back(), histogram.Percentile(100.f));
+  for (const float percentile : {1.f, 10.f, 50.f, 90.f, 99.f}) {
+    const float expected = values[std::ceil(percentile / 100.f *
+                                            values.size()) - 1];
+    EXPECT_NEAR(expected, histogram.Percentile(percentile),
+                expected / Histogram::kNumSubBuckets);
+  }
+}
+
+TEST(HistogramTest, MergeEqualsAddingAllValues) {
+  Histogram histogram;
+  Histogram first_shard;
+  Histogram second_shard;
+  for (int i = 0; i != 100; ++i) {
+    const float value = 0.01f * i;
+    histogram.Add(value);
+    (i % 2 == 0 ? first_shard : second_shard).Add(value);
+  }
+  Histogram merged;
+  merged.Merge(first_shard);
+  merged.Merge(second_shard);
+  merged.Merge(Histogram());
+  EXPECT_EQ(histogram.count(), merged.count());
+  EXPECT_EQ(histogram.ToString(10), merged.ToString(10));
+  EXPECT_EQ(histogram.Percentile(75.f), merged.Percentile(75.f));
+}
+
+TEST(HistogramTest, ValuesOutOfRange) {
+  Histogram histogram;
+  histogram.Add(-1.f);
+  histogram.Add(0.f);
+  histogram.Add(1e20f);
+  EXPECT_EQ(-1.f, histogram.Percentile(0.f));
+  EXPECT_EQ(0.f, histogram.Percentile(50.f));
+  EXPECT_EQ(1e20f, histogram.Percentile(100.f));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
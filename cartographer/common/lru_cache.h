@@ -0,0 +1,135 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_LRU_CACHE_H_
+#define CARTOGRAPHER_COMMON_LRU_CACHE_H_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+// Holds values by key up to a total size in bytes. When inserting exceeds the
+// budget, the least recently used values are evicted. Values are shared, so
+// evicted values stay valid for users still holding them.
+//
+// This class is not thread-safe.
+template <typename KeyType, typename ValueType>
+class LruCache {
+ public:
+  struct Statistics {
+    int64 num_hits = 0;
+    int64 num_misses = 0;
+    int64 num_evictions = 0;
+
+    string ToString() const {
+      std::ostringstream out;
+      out << num_hits << " hits, " << num_misses << " misses, "
+          << num_evictions << " evictions";
+      return out.str();
+    }
+  };
+
+  // A 'max_size_in_bytes' of 0 disables eviction.
+  explicit LruCache(const int64 max_size_in_bytes)
+      : max_size_in_bytes_(max_size_in_bytes) {
+    CHECK_GE(max_size_in_bytes_, 0);
+  }
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // Returns the value for 'key' and marks it as most recently used, or nullptr
+  // if there is none.
+  std::shared_ptr<const ValueType> Get(const KeyType& key) {
+    const auto it = entries_by_key_.find(key);
+    if (it == entries_by_key_.end()) {
+      ++statistics_.num_misses;
+      return nullptr;
+    }
+    ++statistics_.num_hits;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->value;
+  }
+
+  // Returns true if there is a value for 'key', without marking it as used.
+  bool Contains(const KeyType& key) const {
+    return entries_by_key_.count(key) != 0;
+  }
+
+  // Inserts or replaces the 'value' for 'key' as the most recently used value,
+  // then evicts other values until the budget is met.
+  void Insert(const KeyType& key, std::shared_ptr<const ValueType> value,
+              const int64 size_in_bytes) {
+    CHECK(value != nullptr);
+    CHECK_GE(size_in_bytes, 0);
+    Erase(key);
+    entries_.push_front({key, std::move(value), size_in_bytes});
+    entries_by_key_[key] = entries_.begin();
+    size_in_bytes_ += size_in_bytes;
+    while (max_size_in_bytes_ != 0 && size_in_bytes_ > max_size_in_bytes_ &&
+           entries_.size() > 1) {
+      ++statistics_.num_evictions;
+      Erase(entries_.back().key);
+    }
+  }
+
+  void Erase(const KeyType& key) {
+    const auto it = entries_by_key_.find(key);
+    if (it == entries_by_key_.end()) {
+      return;
+    }
+    size_in_bytes_ -= it->second->size_in_bytes;
+    entries_.erase(it->second);
+    entries_by_key_.erase(it);
+  }
+
+  int size() const { return entries_.size(); }
+  // Returns true if inserting more values evicts others.
+  bool full() const {
+    return max_size_in_bytes_ != 0 && size_in_bytes_ >= max_size_in_bytes_;
+  }
+  int64 size_in_bytes() const { return size_in_bytes_; }
+  const Statistics& statistics() const { return statistics_; }
+
+ private:
+  struct Entry {
+    KeyType key;
+    std::shared_ptr<const ValueType> value;
+    int64 size_in_bytes;
+  };
+
+  const int64 max_size_in_bytes_;
+  int64 size_in_bytes_ = 0;
+
+  // Ordered from most to least recently used.
+  std::list<Entry> entries_;
+  std::map<KeyType, typename std::list<Entry>::iterator> entries_by_key_;
+
+  Statistics statistics_;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_LRU_CACHE_H_
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/lru_cache.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+  LruCache<int, int> cache(30);
+  const auto value = std::make_shared<int>(30);
+  cache.Insert(1, std::make_shared<int>(10), 10);
+  cache.Insert(2, std::make_shared<int>(20), 10);
+  cache.Insert(3, value, 10);
+  EXPECT_EQ(3, cache.size());
+  EXPECT_EQ(30, cache.size_in_bytes());
+  ASSERT_NE(nullptr, cache.Get(2));
+  EXPECT_EQ(10, *cache.Get(1));
+  // Evicts 3 and 2, the least recently used values.
+  cache.Insert(4, std::make_shared<int>(40), 20);
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(30, cache.size_in_bytes());
+  EXPECT_NE(nullptr, cache.Get(1));
+  EXPECT_EQ(nullptr, cache.Get(2));
+  EXPECT_EQ(nullptr, cache.Get(3));
+  EXPECT_NE(nullptr, cache.Get(4));
+  // Evicted values stay valid.
+  EXPECT_EQ(30, *value);
+  EXPECT_EQ(4, cache.statistics().num_hits);
+  EXPECT_EQ(2, cache.statistics().num_misses);
+  EXPECT_EQ(2, cache.statistics().num_evictions);
+}
+
+TEST(LruCacheTest, KeepsValueExceedingBudget) {
+  LruCache<int, int> cache(10);
+  cache.Insert(1, std::make_shared<int>(10), 5);
+  cache.Insert(2, std::make_shared<int>(20), 100);
+  EXPECT_EQ(1, cache.size());
+  EXPECT_NE(nullptr, cache.Get(2));
+}
+
+TEST(LruCacheTest, UnlimitedAndErase) {
+  LruCache<int, int> cache(0);
+  for (int i = 0; i != 100; ++i) {
+    cache.Insert(i, std::make_shared<int>(i), 1000);
+  }
+  EXPECT_EQ(100, cache.size());
+  cache.Insert(5, std::make_shared<int>(50), 10);
+  EXPECT_EQ(50, *cache.Get(5));
+  EXPECT_EQ(99 * 1000 + 10, cache.size_in_bytes());
+  cache.Erase(5);
+  cache.Erase(1000);
+  EXPECT_EQ(nullptr, cache.Get(5));
+  EXPECT_EQ(99 * 1000, cache.size_in_bytes());
+  EXPECT_EQ(0, cache.statistics().num_evictions);
+  EXPECT_FALSE(cache.full());
+}
+
+TEST(LruCacheTest, ContainsAndFull) {
+  LruCache<int, int> cache(20);
+  cache.Insert(1, std::make_shared<int>(10), 10);
+  EXPECT_FALSE(cache.full());
+  cache.Insert(2, std::make_shared<int>(20), 10);
+  EXPECT_TRUE(cache.full());
+  EXPECT_TRUE(cache.Contains(1));
+  EXPECT_FALSE(cache.Contains(3));
+  // Contains() does not count as a use, so 1 is still evicted first.
+  cache.Insert(3, std::make_shared<int>(30), 10);
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_TRUE(cache.Contains(2));
+  EXPECT_EQ(0, cache.statistics().num_hits);
+  EXPECT_EQ(0, cache.statistics().num_misses);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -59,6 +59,29 @@ namespace common {
 // implementation.
 class CAPABILITY("mutex") Mutex {
  public:
+  // A condition to wait for with Locker::Await(). Waiters for a plain
+  // predicate are woken whenever the mutex is released, while waiters for a
+  // 'Condition' are only woken by Signal() or SignalAll(). These have to be
+  // called with the mutex held after changing the state the waiters check.
+  class Condition {
+   public:
+    Condition() = default;
+
+    Condition(const Condition&) = delete;
+    Condition& operator=(const Condition&) = delete;
+
+    // Wakes one waiter, e.g. when a single item became available.
+    void Signal() { condition_.notify_one(); }
+
+    // Wakes all waiters.
+    void SignalAll() { condition_.notify_all(); }
+
+   private:
+    friend class Mutex;
+
+    std::condition_variable condition_;
+  };
+
   // A RAII class that acquires a mutex in its constructor, and
   // releases it in its destructor. It also implements waiting functionality on
   // conditions that get checked whenever the mutex is released.
@@ -82,6 +105,19 @@ class CAPABILITY("mutex") Mutex {
       return mutex_->condition_.wait_for(lock_, timeout, predicate);
     }
 
+    // Same as above, but only rechecks 'predicate' when 'condition' is
+    // signaled instead of whenever the mutex is released.
+    template <typename Predicate>
+    void Await(Condition* condition, Predicate predicate) REQUIRES(this) {
+      condition->condition_.wait(lock_, predicate);
+    }
+
+    template <typename Predicate>
+    bool AwaitWithTimeout(Condition* condition, Predicate predicate,
+                          common::Duration timeout) REQUIRES(this) {
+      return condition->condition_.wait_for(lock_, timeout, predicate);
+    }
+
    private:
     Mutex* mutex_;
     std::unique_lock<std::mutex> lock_;
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/mutex.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(MutexTest, AwaitConditionIsWokenBySignal) {
+  Mutex mutex;
+  Mutex::Condition condition;
+  int num_items = 0;
+  int num_taken = 0;
+  constexpr int kNumThreads = 4;
+  std::vector<std::thread> threads;
+  for (int i = 0; i != kNumThreads; ++i) {
+    threads.emplace_back([&]() {
+      MutexLocker locker(&mutex);
+      locker.Await(&condition, [&num_items]() { return num_items > 0; });
+      --num_items;
+      ++num_taken;
+    });
+  }
+  for (int i = 0; i != kNumThreads; ++i) {
+    MutexLocker locker(&mutex);
+    ++num_items;
+    condition.Signal();
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, num_items);
+  EXPECT_EQ(kNumThreads, num_taken);
+}
+
+TEST(MutexTest, AwaitConditionWithTimeout) {
+  Mutex mutex;
+  Mutex::Condition condition;
+  bool done = false;
+  MutexLocker locker(&mutex);
+  EXPECT_FALSE(locker.AwaitWithTimeout(
+      &condition, [&done]() { return done; }, common::FromSeconds(1e-3)));
+  std::thread thread([&]() {
+    MutexLocker locker(&mutex);
+    done = true;
+    condition.SignalAll();
+  });
+  EXPECT_TRUE(locker.AwaitWithTimeout(&condition, [&done]() { return done; },
+                                      common::FromSeconds(100.)));
+  thread.join();
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
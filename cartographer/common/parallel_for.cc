@@ -0,0 +1,52 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/parallel_for.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+void ParallelFor(
+    int num_threads, const size_t size,
+    const std::function<void(size_t begin, size_t end)>& function) {
+  CHECK_GE(num_threads, 0);
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const size_t num_ranges =
+      std::max<size_t>(1, std::min<size_t>(num_threads, size));
+  const auto range_begin = [size, num_ranges](const size_t range_index) {
+    return size * range_index / num_ranges;
+  };
+  std::vector<std::thread> threads;
+  for (size_t range_index = 1; range_index < num_ranges; ++range_index) {
+    threads.emplace_back(function, range_begin(range_index),
+                         range_begin(range_index + 1));
+  }
+  function(range_begin(0), range_begin(1));
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_PARALLEL_FOR_H_
+#define CARTOGRAPHER_COMMON_PARALLEL_FOR_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace cartographer {
+namespace common {
+
+// Splits [0, 'size') into up to 'num_threads' consecutive ranges of about the
+// same size and calls 'function' with the 'begin' and 'end' of each range, one
+// range per thread. The calling thread handles the first range. Returns once
+// all calls have returned. If 'num_threads' is 0, the number of hardware
+// threads is used.
+void ParallelFor(int num_threads, size_t size,
+                 const std::function<void(size_t begin, size_t end)>& function);
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_PARALLEL_FOR_H_
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/parallel_for.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(ParallelForTest, CoversEveryIndexOnce) {
+  for (const int num_threads : {0, 1, 3, 8}) {
+    for (const size_t size : {0, 1, 2, 7, 100}) {
+      std::vector<int> num_calls(size, 0);
+      ParallelFor(num_threads, size,
+                  [&num_calls](const size_t begin, const size_t end) {
+                    for (size_t i = begin; i != end; ++i) {
+                      ++num_calls[i];
+                    }
+                  });
+      for (size_t i = 0; i != size; ++i) {
+        EXPECT_EQ(1, num_calls[i]) << num_threads << " " << size << " " << i;
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_POOL_ALLOCATED_H_
+#define CARTOGRAPHER_COMMON_POOL_ALLOCATED_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+
+namespace cartographer {
+namespace common {
+
+// Base class which makes 'new' and 'delete' of the class 'T' deriving from it
+// reuse the memory of deleted objects, so that objects which are created and
+// destroyed at a high rate do not need heap allocations in the steady state.
+// At most 'kMaxNumFreeObjects' are kept for reuse. Derived classes of 'T' of a
+// different size use the global allocator.
+//
+// This class is thread-safe.
+template <typename T>
+class PoolAllocated {
+ public:
+  static constexpr int kMaxNumFreeObjects = 1024;
+
+  static void* operator new(const std::size_t size) {
+    if (size == sizeof(T)) {
+      Pool* const pool = GetPool();
+      MutexLocker locker(&pool->mutex);
+      if (!pool->free_objects.empty()) {
+        void* const object = pool->free_objects.back();
+        pool->free_objects.pop_back();
+        return object;
+      }
+    }
+    return ::operator new(size);
+  }
+
+  static void operator delete(void* const object, const std::size_t size) {
+    if (object == nullptr) {
+      return;
+    }
+    if (size == sizeof(T)) {
+      Pool* const pool = GetPool();
+      MutexLocker locker(&pool->mutex);
+      if (static_cast<int>(pool->free_objects.size()) < kMaxNumFreeObjects) {
+        pool->free_objects.push_back(object);
+        return;
+      }
+    }
+    ::operator delete(object);
+  }
+
+ private:
+  struct Pool {
+    Pool() { free_objects.reserve(kMaxNumFreeObjects); }
+
+    Mutex mutex;
+    std::vector<void*> free_objects GUARDED_BY(mutex);
+  };
+
+  // The pool is never destroyed, so that objects can be deleted during
+  // static destruction.
+  static Pool* GetPool() {
+    static Pool* const pool = new Pool;
+    return pool;
+  }
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_POOL_ALLOCATED_H_
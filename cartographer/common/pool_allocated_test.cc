@@ -0,0 +1,47 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/pool_allocated.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+struct PooledValue : public PoolAllocated<PooledValue> {
+  explicit PooledValue(const int value) : value(value) {}
+
+  int value;
+};
+
+TEST(PoolAllocatedTest, ReusesMemoryOfDeletedObjects) {
+  std::unique_ptr<PooledValue> first(new PooledValue(1));
+  std::unique_ptr<PooledValue> second(new PooledValue(2));
+  const PooledValue* const first_address = first.get();
+  EXPECT_NE(first_address, second.get());
+  first.reset();
+  std::unique_ptr<PooledValue> third(new PooledValue(3));
+  EXPECT_EQ(first_address, third.get());
+  EXPECT_EQ(2, second->value);
+  EXPECT_EQ(3, third->value);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
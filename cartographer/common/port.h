@@ -57,12 +57,18 @@ inline void FastGzipString(const string& uncompressed, string* compressed) {
                           uncompressed.size());
 }
 
-inline void FastGunzipString(const string& compressed, string* decompressed) {
+// Decompresses the 'size' bytes at 'compressed', e.g. in a memory-mapped file,
+// without copying them into a string first.
+inline void FastGunzipString(const char* const compressed, const size_t size,
+                             string* decompressed) {
   boost::iostreams::filtering_ostream out;
   out.push(boost::iostreams::gzip_decompressor());
   out.push(boost::iostreams::back_inserter(*decompressed));
-  boost::iostreams::write(out, reinterpret_cast<const char*>(compressed.data()),
-                          compressed.size());
+  boost::iostreams::write(out, compressed, size);
+}
+
+inline void FastGunzipString(const string& compressed, string* decompressed) {
+  FastGunzipString(compressed.data(), compressed.size(), decompressed);
 }
 
 }  // namespace common
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_RADIX_SORT_H_
+#define CARTOGRAPHER_COMMON_RADIX_SORT_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace cartographer {
+namespace common {
+
+// Stable LSD radix sort of 'entries' by the bits ['begin_bit', 'end_bit') of
+// the 64-bit unsigned key returned by 'get_key'. 'scratch' is used as a
+// buffer, so that its memory can be reused across calls.
+template <typename Entry, typename GetKey>
+void RadixSort(const int begin_bit, const int end_bit, GetKey get_key,
+               std::vector<Entry>* const entries,
+               std::vector<Entry>* const scratch) {
+  constexpr int kRadixBits = 11;
+  constexpr int kNumBuckets = 1 << kRadixBits;
+  scratch->resize(entries->size());
+  for (int shift = begin_bit; shift < end_bit; shift += kRadixBits) {
+    size_t offsets[kNumBuckets] = {};
+    for (const Entry& entry : *entries) {
+      ++offsets[(get_key(entry) >> shift) & (kNumBuckets - 1)];
+    }
+    size_t sum = 0;
+    for (size_t& offset : offsets) {
+      const size_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+    for (const Entry& entry : *entries) {
+      (*scratch)[offsets[(get_key(entry) >> shift) & (kNumBuckets - 1)]++] =
+          entry;
+    }
+    entries->swap(*scratch);
+  }
+}
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_RADIX_SORT_H_
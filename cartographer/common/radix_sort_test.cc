@@ -0,0 +1,53 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/radix_sort.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+
+#include "cartographer/common/port.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(RadixSortTest, SortsStablyByKeyBits) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<uint64> distribution(0, (uint64{1} << 40) - 1);
+  std::vector<std::pair<uint64, int>> entries;
+  for (int i = 0; i != 10000; ++i) {
+    // Only the bits [8, 40) are sorted by, and there are many duplicates.
+    entries.emplace_back(distribution(prng) & 0xff000fffffull, i);
+  }
+  std::vector<std::pair<uint64, int>> expected = entries;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const std::pair<uint64, int>& lhs,
+                      const std::pair<uint64, int>& rhs) {
+                     return (lhs.first >> 8) < (rhs.first >> 8);
+                   });
+  std::vector<std::pair<uint64, int>> scratch;
+  RadixSort(8, 40,
+            [](const std::pair<uint64, int>& entry) { return entry.first; },
+            &entries, &scratch);
+  EXPECT_EQ(expected, entries);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_SEQLOCK_H_
+#define CARTOGRAPHER_COMMON_SEQLOCK_H_
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace common {
+
+// Publishes a value from one writer thread, calling Store(), to any number of
+// reader threads, calling Load(). The writer never waits for readers; readers
+// retry while a Store() is in progress. 'T' is copied bytewise, so it must not
+// own resources, e.g. a struct of plain values and fixed-size Eigen types.
+template <typename T>
+class SeqLock {
+ public:
+  SeqLock() : SeqLock(T()) {}
+  explicit SeqLock(const T& value) : sequence_(0) { Store(value); }
+
+  SeqLock(const SeqLock&) = delete;
+  SeqLock& operator=(const SeqLock&) = delete;
+
+  // Must not be called concurrently with itself.
+  void Store(const T& value) {
+    uint64 words[kNumWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    // An odd sequence number marks a Store() in progress.
+    const uint64 sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i != kNumWords; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Returns the value of the most recently completed Store().
+  T Load() const {
+    uint64 words[kNumWords];
+    for (;;) {
+      const uint64 sequence = sequence_.load(std::memory_order_acquire);
+      if (sequence % 2 == 0) {
+        for (int i = 0; i != kNumWords; ++i) {
+          words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == sequence) {
+          break;
+        }
+      }
+      std::this_thread::yield();
+    }
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    std::memcpy(&storage, words, sizeof(T));
+    return *reinterpret_cast<const T*>(&storage);
+  }
+
+ private:
+  static_assert(std::is_trivially_destructible<T>::value,
+                "SeqLock values must not own resources.");
+
+  static constexpr int kNumWords =
+      (sizeof(T) + sizeof(uint64) - 1) / sizeof(uint64);
+
+  std::atomic<uint64> sequence_;
+  std::array<std::atomic<uint64>, kNumWords> words_;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_SEQLOCK_H_
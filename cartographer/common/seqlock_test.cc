@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/seqlock.h"
+
+#include <thread>
+#include <vector>
+
+#include "Eigen/Core"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+struct Value {
+  int64 sequence;
+  Eigen::Vector3d vector;
+  double negated_sequence;
+};
+
+Value MakeValue(const int64 sequence) {
+  return Value{sequence, Eigen::Vector3d::Constant(sequence),
+               -static_cast<double>(sequence)};
+}
+
+TEST(SeqLockTest, LoadReturnsLastStore) {
+  SeqLock<Value> seqlock(MakeValue(1));
+  EXPECT_EQ(1, seqlock.Load().sequence);
+  for (int i = 2; i != 10; ++i) {
+    seqlock.Store(MakeValue(i));
+    const Value value = seqlock.Load();
+    EXPECT_EQ(i, value.sequence);
+    EXPECT_EQ(Eigen::Vector3d::Constant(i), value.vector);
+    EXPECT_EQ(-i, value.negated_sequence);
+  }
+}
+
+TEST(SeqLockTest, ReadersNeverSeePartialStores) {
+  constexpr int kNumStores = 100000;
+  constexpr int kNumReaders = 3;
+  SeqLock<Value> seqlock(MakeValue(0));
+  std::vector<std::thread> readers;
+  for (int i = 0; i != kNumReaders; ++i) {
+    readers.emplace_back([&seqlock]() {
+      int64 last_sequence = 0;
+      while (last_sequence != kNumStores) {
+        const Value value = seqlock.Load();
+        ASSERT_GE(value.sequence, last_sequence);
+        ASSERT_EQ(Eigen::Vector3d::Constant(value.sequence), value.vector);
+        ASSERT_EQ(-value.sequence, value.negated_sequence);
+        last_sequence = value.sequence;
+      }
+    });
+  }
+  for (int i = 1; i <= kNumStores; ++i) {
+    seqlock.Store(MakeValue(i));
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
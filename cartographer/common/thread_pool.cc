@@ -16,17 +16,179 @@
 
 #include "cartographer/common/thread_pool.h"
 
+#include <errno.h>
+#include <sched.h>
 #include <unistd.h>
 #include <algorithm>
 #include <chrono>
 #include <numeric>
+#include <utility>
 
 #include "glog/logging.h"
 
 namespace cartographer {
 namespace common {
 
-ThreadPool::ThreadPool(int num_threads) {
+string ThreadPoolStatistics::ToString() const {
+  constexpr int kNumBuckets = 10;
+  string result = "Queue length: " + queue_length.ToString(kNumBuckets);
+  for (const auto& entry : work_items_by_label) {
+    result += "\n" + entry.first + " (" +
+              std::to_string(entry.second.num_work_items) + " work items)" +
+              "\nWait time (s): " +
+              entry.second.wait_time.ToString(kNumBuckets) +
+              "\nRun time (s): " + entry.second.run_time.ToString(kNumBuckets);
+  }
+  return result;
+}
+
+void ThreadPoolStatistics::Merge(const ThreadPoolStatistics& other) {
+  queue_length.Merge(other.queue_length);
+  for (const auto& entry : other.work_items_by_label) {
+    WorkItemStatistics& work_item_statistics = work_items_by_label[entry.first];
+    work_item_statistics.num_work_items += entry.second.num_work_items;
+    work_item_statistics.wait_time.Merge(entry.second.wait_time);
+    work_item_statistics.run_time.Merge(entry.second.run_time);
+  }
+}
+
+ThreadPoolInterface::ThreadPoolInterface() : num_scheduled_work_items_(0) {}
+
+void ThreadPoolInterface::Schedule(const std::function<void()>& work_item,
+                                   const WorkItemPriority priority,
+                                   const string& label) {
+  const int queue_length = num_scheduled_work_items_++;
+  if (queue_length_metric_ != nullptr) {
+    queue_length_metric_->Increment();
+  }
+  const auto schedule_time = std::chrono::steady_clock::now();
+  ScheduleWorkItem(
+      [this, work_item, label, queue_length, schedule_time]() {
+        --num_scheduled_work_items_;
+        if (queue_length_metric_ != nullptr) {
+          queue_length_metric_->Decrement();
+        }
+        const auto start_time = std::chrono::steady_clock::now();
+        work_item();
+        const auto end_time = std::chrono::steady_clock::now();
+        RecordWorkItem(
+            label, queue_length,
+            std::chrono::duration<double>(start_time - schedule_time).count(),
+            std::chrono::duration<double>(end_time - start_time).count());
+      },
+      priority);
+}
+
+void ThreadPoolInterface::Schedule(
+    const std::function<void()>& work_item, const WorkItemPriority priority,
+    const string& label, const CancellationToken& cancellation_token) {
+  Schedule(
+      [work_item, cancellation_token]() {
+        if (!cancellation_token.cancelled()) {
+          work_item();
+        }
+      },
+      priority, label);
+}
+
+ThreadPoolStatistics ThreadPoolInterface::PollStatistics() {
+  MutexLocker locker(&statistics_mutex_);
+  ThreadPoolStatistics statistics;
+  std::swap(statistics, statistics_);
+  return statistics;
+}
+
+void ThreadPoolInterface::RegisterMetrics(const string& pool_name,
+                                          metrics::Registry* const registry) {
+  CHECK_EQ(num_scheduled_work_items_.load(), 0);
+  pool_name_ = pool_name;
+  metrics_registry_ = registry;
+  queue_length_metric_ = registry->GetGauge(
+      "cartographer_thread_pool_queue_length",
+      "Number of work items scheduled but not yet started.",
+      {{"pool", pool_name_}});
+}
+
+void ThreadPoolInterface::RecordWorkItem(const string& label,
+                                         const int queue_length,
+                                         const double wait_time,
+                                         const double run_time) {
+  MutexLocker locker(&statistics_mutex_);
+  statistics_.queue_length.Add(queue_length);
+  ThreadPoolStatistics::WorkItemStatistics& work_item_statistics =
+      statistics_.work_items_by_label[label];
+  ++work_item_statistics.num_work_items;
+  work_item_statistics.wait_time.Add(wait_time);
+  work_item_statistics.run_time.Add(run_time);
+
+  if (metrics_registry_ != nullptr) {
+    auto it = work_item_metrics_by_label_.find(label);
+    if (it == work_item_metrics_by_label_.end()) {
+      const metrics::Labels labels = {{"pool", pool_name_}, {"label", label}};
+      const auto bucket_boundaries =
+          metrics::Histogram::ScaledPowersOf(2., 1e-4, 100.);
+      it = work_item_metrics_by_label_
+               .emplace(label,
+                        WorkItemMetrics{
+                            metrics_registry_->GetCounter(
+                                "cartographer_thread_pool_work_items_total",
+                                "Number of work items run.", labels),
+                            metrics_registry_->GetHistogram(
+                                "cartographer_thread_pool_wait_time_seconds",
+                                "Time between scheduling and starting a "
+                                "work item.",
+                                labels, bucket_boundaries),
+                            metrics_registry_->GetHistogram(
+                                "cartographer_thread_pool_run_time_seconds",
+                                "Time it took to run a work item.", labels,
+                                bucket_boundaries)})
+               .first;
+    }
+    it->second.wait_time->Observe(wait_time);
+    it->second.run_time->Observe(run_time);
+    it->second.num_work_items->Increment();
+  }
+}
+
+void ConfigureBackgroundThread(const std::vector<int>& cpus,
+                               const int nice_level) {
+#ifdef __linux__
+  // This changes the per-thread nice level of the current thread on Linux.
+  // Since -1 is also a valid result, 'errno' tells whether it failed.
+  errno = 0;
+  PCHECK(nice(nice_level) != -1 || errno == 0);
+  if (!cpus.empty()) {
+    // Linux places memory on the NUMA node of the CPU which first touches it,
+    // so restricting background threads to the CPUs of one node also keeps
+    // the grids they build local to that node.
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const int cpu : cpus) {
+      CHECK_GE(cpu, 0);
+      CHECK_LT(cpu, CPU_SETSIZE);
+      CPU_SET(cpu, &cpu_set);
+    }
+    PCHECK(sched_setaffinity(0 /* calling thread */, sizeof(cpu_set),
+                             &cpu_set) == 0);
+  }
+#else
+  LOG_IF(WARNING, nice_level != kDefaultBackgroundNiceLevel)
+      << "Changing the nice level of background threads is only supported on "
+         "Linux.";
+  LOG_IF(WARNING, !cpus.empty())
+      << "Restricting background threads to CPUs is only supported on Linux.";
+#endif
+}
+
+ThreadPool::ThreadPool(int num_threads)
+    : ThreadPool(num_threads, std::vector<int>()) {}
+
+ThreadPool::ThreadPool(int num_threads, const std::vector<int>& cpus)
+    : ThreadPool(num_threads, cpus, kDefaultBackgroundNiceLevel) {}
+
+ThreadPool::ThreadPool(int num_threads, const std::vector<int>& cpus,
+                       const int nice_level)
+    : cpus_(cpus), nice_level_(nice_level) {
   MutexLocker locker(&mutex_);
   for (int i = 0; i != num_threads; ++i) {
     pool_.emplace_back([this]() { ThreadPool::DoWork(); });
@@ -38,37 +200,49 @@ ThreadPool::~ThreadPool() {
     MutexLocker locker(&mutex_);
     CHECK(running_);
     running_ = false;
-    CHECK_EQ(work_queue_.size(), 0);
+    for (const auto& work_queue : work_queues_) {
+      CHECK_EQ(work_queue.size(), 0);
+    }
+    work_available_.SignalAll();
   }
   for (std::thread& thread : pool_) {
     thread.join();
   }
 }
 
-void ThreadPool::Schedule(const std::function<void()>& work_item) {
+void ThreadPool::ScheduleWorkItem(const std::function<void()>& work_item,
+                                  const WorkItemPriority priority) {
   MutexLocker locker(&mutex_);
   CHECK(running_);
-  work_queue_.push_back(work_item);
+  work_queues_[static_cast<int>(priority)].push_back(work_item);
+  work_available_.Signal();
+}
+
+size_t ThreadPool::NumWorkItems() const {
+  size_t num_work_items = 0;
+  for (const auto& work_queue : work_queues_) {
+    num_work_items += work_queue.size();
+  }
+  return num_work_items;
 }
 
 void ThreadPool::DoWork() {
-#ifdef __linux__
-  // This changes the per-thread nice level of the current thread on Linux. We
-  // do this so that the background work done by the thread pool is not taking
-  // away CPU resources from more important foreground threads.
-  CHECK_NE(nice(10), -1);
-#endif
+  ConfigureBackgroundThread(cpus_, nice_level_);
   for (;;) {
     std::function<void()> work_item;
     {
       MutexLocker locker(&mutex_);
-      locker.Await([this]() REQUIRES(mutex_) {
-        return !work_queue_.empty() || !running_;
+      locker.Await(&work_available_, [this]() REQUIRES(mutex_) {
+        return NumWorkItems() != 0 || !running_;
       });
-      if (!work_queue_.empty()) {
-        work_item = work_queue_.front();
-        work_queue_.pop_front();
-      } else if (!running_) {
+      for (auto& work_queue : work_queues_) {
+        if (!work_queue.empty()) {
+          work_item = work_queue.front();
+          work_queue.pop_front();
+          break;
+        }
+      }
+      if (!work_item && !running_) {
         return;
       }
     }
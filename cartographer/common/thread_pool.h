@@ -17,38 +17,203 @@
 #ifndef CARTOGRAPHER_COMMON_THREAD_POOL_H_
 #define CARTOGRAPHER_COMMON_THREAD_POOL_H_
 
+#include <array>
+#include <atomic>
 #include <deque>
 #include <functional>
+#include <map>
+#include <memory>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "cartographer/common/histogram.h"
 #include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "cartographer/metrics/metrics.h"
 
 namespace cartographer {
 namespace common {
 
+// Priority classes of work items. Pending work items of a higher priority
+// class are started before those of a lower one, work items of the same class
+// are started in the order they were scheduled.
+enum class WorkItemPriority {
+  // E.g. bookkeeping which unblocks the next optimization.
+  kHigh = 0,
+  // E.g. scan matching in a local search window.
+  kNormal = 1,
+  // E.g. scan matching against the full submap for global localization.
+  kLow = 2,
+  // E.g. precomputations for scan matching.
+  kLowest = 3,
+};
+constexpr int kNumWorkItemPriorities = 4;
+
+// Allows to drop work items which became obsolete before they were started.
+// Copies share their state, so any copy can be used to cancel.
+class CancellationToken {
+ public:
+  CancellationToken()
+      : cancelled_(std::make_shared<std::atomic<bool>>(false)) {}
+
+  void Cancel() { *cancelled_ = true; }
+  bool cancelled() const { return *cancelled_; }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+// Statistics about the work items run by a thread pool.
+struct ThreadPoolStatistics {
+  struct WorkItemStatistics {
+    int64 num_work_items = 0;
+    // Time in seconds between scheduling and starting a work item.
+    Histogram wait_time;
+    // Time in seconds it took to run a work item.
+    Histogram run_time;
+  };
+
+  string ToString() const;
+
+  // Adds the statistics of 'other', e.g. of another thread pool.
+  void Merge(const ThreadPoolStatistics& other);
+
+  // Number of work items scheduled but not yet started, sampled whenever a new
+  // work item is scheduled.
+  Histogram queue_length;
+  std::map<string, WorkItemStatistics> work_items_by_label;
+};
+
+// Interface of all thread pools that background work can be scheduled on.
+class ThreadPoolInterface {
+ public:
+  ThreadPoolInterface();
+  virtual ~ThreadPoolInterface() {}
+
+  ThreadPoolInterface(const ThreadPoolInterface&) = delete;
+  ThreadPoolInterface& operator=(const ThreadPoolInterface&) = delete;
+
+  // Adds a new work item which will be executed by a background thread
+  // eventually. Does not block. The 'label' names the kind of work for the
+  // statistics.
+  void Schedule(const std::function<void()>& work_item,
+                WorkItemPriority priority, const string& label);
+
+  void Schedule(const std::function<void()>& work_item,
+                WorkItemPriority priority) {
+    Schedule(work_item, priority, "unlabeled");
+  }
+
+  void Schedule(const std::function<void()>& work_item) {
+    Schedule(work_item, WorkItemPriority::kNormal);
+  }
+
+  // Like Schedule(), but 'work_item' is not run if 'cancellation_token' has
+  // been cancelled by the time a background thread picks it up.
+  void Schedule(const std::function<void()>& work_item,
+                WorkItemPriority priority, const string& label,
+                const CancellationToken& cancellation_token);
+
+  // Returns the statistics collected since the previous call.
+  ThreadPoolStatistics PollStatistics() EXCLUDES(statistics_mutex_);
+
+  // Additionally exports the queue length and the statistics of each label to
+  // 'registry', labeled with 'pool_name' to tell apart the metrics of several
+  // pools. Must be called before the first work item is scheduled.
+  void RegisterMetrics(const string& pool_name, metrics::Registry* registry);
+
+ protected:
+  // Implemented by the thread pools to queue 'work_item'.
+  virtual void ScheduleWorkItem(const std::function<void()>& work_item,
+                                WorkItemPriority priority) = 0;
+
+ private:
+  void RecordWorkItem(const string& label, int queue_length, double wait_time,
+                      double run_time) EXCLUDES(statistics_mutex_);
+
+  struct WorkItemMetrics {
+    metrics::Counter* num_work_items;
+    metrics::Histogram* wait_time;
+    metrics::Histogram* run_time;
+  };
+
+  std::atomic<int> num_scheduled_work_items_;
+  Mutex statistics_mutex_;
+  ThreadPoolStatistics statistics_ GUARDED_BY(statistics_mutex_);
+
+  string pool_name_;
+  metrics::Registry* metrics_registry_ = nullptr;
+  metrics::Gauge* queue_length_metric_ = nullptr;
+  std::map<string, WorkItemMetrics> work_item_metrics_by_label_
+      GUARDED_BY(statistics_mutex_);
+};
+
+// Increment of the nice level of background threads unless configured
+// otherwise.
+constexpr int kDefaultBackgroundNiceLevel = 10;
+
+// Lowers the priority of the calling thread by adding 'nice_level' to its nice
+// level, so that background work does not take away CPU resources from more
+// important foreground threads. If 'cpus' is non-empty, the calling thread is
+// also restricted to run on these CPUs only. Called by the threads of the
+// thread pools before their first work item.
+void ConfigureBackgroundThread(const std::vector<int>& cpus, int nice_level);
+
 // A fixed number of threads working on a work queue of work items. Adding a
 // new work item does not block, and will be executed by a background thread
 // eventually. The queue must be empty before calling the destructor. The thread
 // pool will then wait for the currently executing work items to finish and then
 // destroy the threads.
-class ThreadPool {
+class ThreadPool : public ThreadPoolInterface {
  public:
   explicit ThreadPool(int num_threads);
-  ~ThreadPool();
+  // The threads only run on 'cpus', see ConfigureBackgroundThread().
+  ThreadPool(int num_threads, const std::vector<int>& cpus);
+  // Same as above, but with 'nice_level' instead of
+  // 'kDefaultBackgroundNiceLevel'.
+  ThreadPool(int num_threads, const std::vector<int>& cpus, int nice_level);
+  ~ThreadPool() override;
 
-  ThreadPool(const ThreadPool&) = delete;
-  ThreadPool& operator=(const ThreadPool&) = delete;
-
-  void Schedule(const std::function<void()>& work_item);
+ protected:
+  void ScheduleWorkItem(const std::function<void()>& work_item,
+                        WorkItemPriority priority) override;
 
  private:
   void DoWork();
+  size_t NumWorkItems() const REQUIRES(mutex_);
 
+  const std::vector<int> cpus_;
+  const int nice_level_;
   Mutex mutex_;
+  // Signaled for each scheduled work item, so that releasing 'mutex_' only
+  // wakes up as many idle threads as there is work for.
+  Mutex::Condition work_available_;
   bool running_ GUARDED_BY(mutex_) = true;
   std::vector<std::thread> pool_ GUARDED_BY(mutex_);
-  std::deque<std::function<void()>> work_queue_ GUARDED_BY(mutex_);
+  // One work queue per priority class.
+  std::array<std::deque<std::function<void()>>, kNumWorkItemPriorities>
+      work_queues_ GUARDED_BY(mutex_);
+};
+
+// The thread pools to schedule each class of background work on, so that one
+// class cannot starve the others. Several classes may share a pool.
+struct WorkloadThreadPools {
+  // All classes of work share 'thread_pool'.
+  explicit WorkloadThreadPools(ThreadPoolInterface* const thread_pool)
+      : matcher_construction(thread_pool),
+        constraints(thread_pool),
+        io(thread_pool) {}
+
+  // Construction of scan matchers for submaps, e.g. precomputation grids.
+  ThreadPoolInterface* matcher_construction;
+  // Scan matching for constraints and the bookkeeping of the pose graph.
+  ThreadPoolInterface* constraints;
+  // Decoding and encoding of serialized maps.
+  ThreadPoolInterface* io;
+  // Optimizations run one at a time on a dedicated thread of each pose graph,
+  // so only their nice level is configurable.
+  int optimization_nice_level = kDefaultBackgroundNiceLevel;
 };
 
 }  // namespace common
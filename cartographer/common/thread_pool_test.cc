@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/thread_pool.h"
+
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(ThreadPoolTest, RunsHigherPriorityWorkItemsFirst) {
+  Mutex mutex;
+  bool blocked = true;
+  std::vector<int> order;
+  ThreadPool thread_pool(1);
+  // Keeps the only thread busy until all other work items are queued.
+  thread_pool.Schedule([&mutex, &blocked]() {
+    MutexLocker locker(&mutex);
+    locker.Await([&blocked]() { return !blocked; });
+  });
+  const auto append = [&mutex, &order](const int value) {
+    return [&mutex, &order, value]() {
+      MutexLocker locker(&mutex);
+      order.push_back(value);
+    };
+  };
+  thread_pool.Schedule(append(3), WorkItemPriority::kLowest);
+  thread_pool.Schedule(append(1), WorkItemPriority::kNormal);
+  thread_pool.Schedule(append(0), WorkItemPriority::kHigh);
+  thread_pool.Schedule(append(2), WorkItemPriority::kLow);
+  {
+    // Releasing the lock wakes up the blocked work item.
+    MutexLocker locker(&mutex);
+    blocked = false;
+  }
+  MutexLocker locker(&mutex);
+  locker.Await([&order]() { return order.size() == 4; });
+  EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), order);
+}
+
+TEST(ThreadPoolTest, SkipsCancelledWorkItems) {
+  Mutex mutex;
+  bool blocked = true;
+  int num_done = 0;
+  ThreadPool thread_pool(1);
+  thread_pool.Schedule([&mutex, &blocked]() {
+    MutexLocker locker(&mutex);
+    locker.Await([&blocked]() { return !blocked; });
+  });
+  CancellationToken cancellation_token;
+  const auto increment = [&mutex, &num_done]() {
+    MutexLocker locker(&mutex);
+    ++num_done;
+  };
+  thread_pool.Schedule(increment, WorkItemPriority::kNormal, "cancelled",
+                       cancellation_token);
+  thread_pool.Schedule(increment, WorkItemPriority::kLow);
+  cancellation_token.Cancel();
+  {
+    MutexLocker locker(&mutex);
+    blocked = false;
+  }
+  MutexLocker locker(&mutex);
+  // The cancelled work item runs before the other one, so once the other one
+  // is done, the cancelled one has been skipped.
+  locker.Await([&num_done]() { return num_done == 1; });
+  EXPECT_EQ(1, num_done);
+}
+
+TEST(ThreadPoolTest, CollectsStatisticsByLabel) {
+  Mutex mutex;
+  int num_done = 0;
+  ThreadPool thread_pool(2);
+  const auto increment = [&mutex, &num_done]() {
+    MutexLocker locker(&mutex);
+    ++num_done;
+  };
+  thread_pool.Schedule(increment, WorkItemPriority::kNormal, "a");
+  thread_pool.Schedule(increment, WorkItemPriority::kNormal, "b");
+  thread_pool.Schedule(increment, WorkItemPriority::kNormal, "a");
+  {
+    MutexLocker locker(&mutex);
+    locker.Await([&num_done]() { return num_done == 3; });
+  }
+  // The statistics are recorded after a work item returns, so the last one
+  // might not be recorded yet.
+  int64 num_recorded = 0;
+  while (num_recorded != 3) {
+    const ThreadPoolStatistics statistics = thread_pool.PollStatistics();
+    for (const auto& entry : statistics.work_items_by_label) {
+      EXPECT_TRUE(entry.first == "a" || entry.first == "b");
+      num_recorded += entry.second.num_work_items;
+    }
+  }
+  EXPECT_TRUE(thread_pool.PollStatistics().work_items_by_label.empty());
+}
+
+TEST(ThreadPoolTest, ExportsMetricsByLabel) {
+  metrics::Registry registry;
+  ThreadPool thread_pool(2);
+  thread_pool.RegisterMetrics("test", &registry);
+  const metrics::Counter* const num_work_items =
+      registry.GetCounter("cartographer_thread_pool_work_items_total", "",
+                          {{"pool", "test"}, {"label", "a"}});
+  thread_pool.Schedule([]() {}, WorkItemPriority::kNormal, "a");
+  thread_pool.Schedule([]() {}, WorkItemPriority::kNormal, "a");
+  // The metrics are recorded after a work item returns.
+  while (num_work_items->Value() != 2.) {
+  }
+  const metrics::Histogram* const run_time = registry.GetHistogram(
+      "cartographer_thread_pool_run_time_seconds", "",
+      {{"pool", "test"}, {"label", "a"}},
+      metrics::Histogram::ScaledPowersOf(2., 1e-4, 100.));
+  EXPECT_EQ(2, run_time->Count());
+  EXPECT_EQ(0., registry
+                    .GetGauge("cartographer_thread_pool_queue_length", "",
+                              {{"pool", "test"}})
+                    ->Value());
+}
+
+#ifdef __linux__
+TEST(ThreadPoolTest, RunsWorkItemsOnGivenCpus) {
+  Mutex mutex;
+  bool done = false;
+  bool on_cpu_0_only = false;
+  ThreadPool thread_pool(1, {0});
+  thread_pool.Schedule([&mutex, &done, &on_cpu_0_only]() {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    const bool success =
+        sched_getaffinity(0 /* calling thread */, sizeof(cpu_set), &cpu_set) ==
+        0;
+    MutexLocker locker(&mutex);
+    on_cpu_0_only =
+        success && CPU_COUNT(&cpu_set) == 1 && CPU_ISSET(0, &cpu_set);
+    done = true;
+  });
+  MutexLocker locker(&mutex);
+  locker.Await([&done]() { return done; });
+  EXPECT_TRUE(on_cpu_0_only);
+}
+
+TEST(ThreadPoolTest, RunsWorkItemsAtGivenNiceLevel) {
+  Mutex mutex;
+  bool done = false;
+  int nice_level = 0;
+  // Threads start at the nice level of the thread creating them.
+  const int expected_nice_level = std::min(nice(0) + 5, 19);
+  ThreadPool thread_pool(1, {}, 5);
+  thread_pool.Schedule([&mutex, &done, &nice_level]() {
+    const int current_nice_level = nice(0);
+    MutexLocker locker(&mutex);
+    nice_level = current_nice_level;
+    done = true;
+  });
+  MutexLocker locker(&mutex);
+  locker.Await([&done]() { return done; });
+  EXPECT_EQ(expected_nice_level, nice_level);
+}
+#endif
+
+TEST(ThreadPoolStatisticsTest, Merge) {
+  ThreadPoolStatistics statistics;
+  statistics.queue_length.Add(1.f);
+  ++statistics.work_items_by_label["a"].num_work_items;
+  ThreadPoolStatistics other;
+  other.queue_length.Add(2.f);
+  ++other.work_items_by_label["a"].num_work_items;
+  other.work_items_by_label["a"].run_time.Add(3.f);
+  ++other.work_items_by_label["b"].num_work_items;
+  statistics.Merge(other);
+  EXPECT_EQ(2, statistics.queue_length.count());
+  ASSERT_EQ(2, statistics.work_items_by_label.size());
+  EXPECT_EQ(2, statistics.work_items_by_label["a"].num_work_items);
+  EXPECT_EQ(1, statistics.work_items_by_label["a"].run_time.count());
+  EXPECT_EQ(1, statistics.work_items_by_label["b"].num_work_items);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
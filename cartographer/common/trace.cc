@@ -0,0 +1,196 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+#include "cartographer/common/mutex.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+int64 GetNowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Ring buffer of the spans of one thread. Only this thread writes, any thread
+// may read concurrently.
+class ThreadTraceBuffer {
+ public:
+  explicit ThreadTraceBuffer(const int thread_index)
+      : thread_index_(thread_index), slots_(kNumTraceSpansPerThread) {}
+
+  ThreadTraceBuffer(const ThreadTraceBuffer&) = delete;
+  ThreadTraceBuffer& operator=(const ThreadTraceBuffer&) = delete;
+
+  void Add(const char* const name, const int64 start_nanoseconds,
+           const int64 duration_nanoseconds,
+           const AllocationCount& allocation_count) {
+    const uint64 index = num_spans_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[index % kNumTraceSpansPerThread];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start_nanoseconds.store(start_nanoseconds, std::memory_order_relaxed);
+    slot.duration_nanoseconds.store(duration_nanoseconds,
+                                    std::memory_order_relaxed);
+    slot.num_allocations.store(allocation_count.num_allocations,
+                               std::memory_order_relaxed);
+    slot.num_allocated_bytes.store(allocation_count.num_allocated_bytes,
+                                   std::memory_order_relaxed);
+    num_spans_.store(index + 1, std::memory_order_release);
+  }
+
+  void AppendSpans(std::vector<TraceSpan>* const spans) const {
+    const uint64 end = num_spans_.load(std::memory_order_acquire);
+    const uint64 begin =
+        end > kNumTraceSpansPerThread ? end - kNumTraceSpansPerThread : 0;
+    const size_t first = spans->size();
+    for (uint64 index = begin; index != end; ++index) {
+      const Slot& slot = slots_[index % kNumTraceSpansPerThread];
+      spans->push_back(
+          TraceSpan{slot.name.load(std::memory_order_relaxed), thread_index_,
+                    slot.start_nanoseconds.load(std::memory_order_relaxed),
+                    slot.duration_nanoseconds.load(std::memory_order_relaxed),
+                    slot.num_allocations.load(std::memory_order_relaxed),
+                    slot.num_allocated_bytes.load(std::memory_order_relaxed)});
+    }
+    // Drops the spans the writer may have overwritten while they were copied,
+    // including the one it may be writing right now.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64 new_end = num_spans_.load(std::memory_order_relaxed);
+    if (new_end + 1 > begin + kNumTraceSpansPerThread) {
+      const uint64 num_overwritten = std::min<uint64>(
+          new_end + 1 - begin - kNumTraceSpansPerThread, end - begin);
+      spans->erase(spans->begin() + first,
+                   spans->begin() + first + num_overwritten);
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64> start_nanoseconds{0};
+    std::atomic<int64> duration_nanoseconds{0};
+    std::atomic<int64> num_allocations{0};
+    std::atomic<int64> num_allocated_bytes{0};
+  };
+
+  const int thread_index_;
+  std::vector<Slot> slots_;
+  std::atomic<uint64> num_spans_{0};
+};
+
+// The buffers of all threads which recorded spans. Buffers are shared with
+// their threads, so that they outlive threads which exit.
+struct ThreadTraceBuffers {
+  Mutex mutex;
+  std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers GUARDED_BY(mutex);
+};
+
+ThreadTraceBuffers* GetThreadTraceBuffers() {
+  // Never destroyed, so that threads can still record spans during exit.
+  static ThreadTraceBuffers* const thread_trace_buffers =
+      new ThreadTraceBuffers;
+  return thread_trace_buffers;
+}
+
+ThreadTraceBuffer* GetThreadTraceBuffer() {
+  thread_local std::shared_ptr<ThreadTraceBuffer> thread_trace_buffer;
+  if (thread_trace_buffer == nullptr) {
+    ThreadTraceBuffers* const thread_trace_buffers = GetThreadTraceBuffers();
+    MutexLocker locker(&thread_trace_buffers->mutex);
+    thread_trace_buffer = std::make_shared<ThreadTraceBuffer>(
+        thread_trace_buffers->buffers.size());
+    thread_trace_buffers->buffers.push_back(thread_trace_buffer);
+  }
+  return thread_trace_buffer.get();
+}
+
+}  // namespace
+
+ScopedTraceSpan::ScopedTraceSpan(const char* const name)
+    : name_(name),
+      start_nanoseconds_(GetNowNanoseconds()),
+      start_allocation_count_(GetThreadAllocationCount()) {}
+
+ScopedTraceSpan::~ScopedTraceSpan() {
+  // Read first, so that creating the buffer of this thread is not counted.
+  const AllocationCount allocation_count = GetThreadAllocationCount();
+  GetThreadTraceBuffer()->Add(
+      name_, start_nanoseconds_, GetNowNanoseconds() - start_nanoseconds_,
+      AllocationCount{allocation_count.num_allocations -
+                          start_allocation_count_.num_allocations,
+                      allocation_count.num_allocated_bytes -
+                          start_allocation_count_.num_allocated_bytes});
+}
+
+std::vector<TraceSpan> GetTraceSpans() {
+  std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+  {
+    ThreadTraceBuffers* const thread_trace_buffers = GetThreadTraceBuffers();
+    MutexLocker locker(&thread_trace_buffers->mutex);
+    buffers = thread_trace_buffers->buffers;
+  }
+  std::vector<TraceSpan> spans;
+  for (const auto& buffer : buffers) {
+    buffer->AppendSpans(&spans);
+  }
+  std::stable_sort(spans.begin(), spans.end(),
+                   [](const TraceSpan& lhs, const TraceSpan& rhs) {
+                     return lhs.start_nanoseconds < rhs.start_nanoseconds;
+                   });
+  return spans;
+}
+
+string ToChromeTraceJson(const std::vector<TraceSpan>& spans) {
+  std::ostringstream json;
+  json << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  for (size_t i = 0; i != spans.size(); ++i) {
+    const TraceSpan& span = spans[i];
+    if (i != 0) {
+      json << ",";
+    }
+    json << "\n{\"name\":\"";
+    for (const char* c = span.name; *c != '\0'; ++c) {
+      if (*c == '"' || *c == '\\') {
+        json << '\\';
+      }
+      json << *c;
+    }
+    // Times are in microseconds.
+    json << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << span.thread_index
+         << ",\"ts\":" << 1e-3 * span.start_nanoseconds
+         << ",\"dur\":" << 1e-3 * span.duration_nanoseconds;
+    if (span.num_allocations != 0) {
+      json << ",\"args\":{\"allocations\":" << span.num_allocations
+           << ",\"allocated_bytes\":" << span.num_allocated_bytes << "}";
+    }
+    json << "}";
+  }
+  json << "\n]}\n";
+  return json.str();
+}
+
+}  // namespace common
+}  // namespace cartographer
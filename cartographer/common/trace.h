@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_TRACE_H_
+#define CARTOGRAPHER_COMMON_TRACE_H_
+
+#include <string>
+#include <vector>
+
+#include "cartographer/common/allocation_counter.h"
+#include "cartographer/common/config.h"
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace common {
+
+// Number of spans kept per thread. Older spans are overwritten.
+constexpr int kNumTraceSpansPerThread = 1 << 16;
+
+// A span of time spent in a named part of the code.
+struct TraceSpan {
+  // Has static storage duration, e.g. a string literal.
+  const char* name;
+  // Threads are numbered in the order they recorded their first span.
+  int thread_index;
+  // Relative to an arbitrary but fixed point in time.
+  int64 start_nanoseconds;
+  int64 duration_nanoseconds;
+  // Heap allocations made by the thread during the span, including the ones of
+  // nested spans. Only counted if 'kAllocationCountingEnabled', otherwise 0.
+  int64 num_allocations;
+  int64 num_allocated_bytes;
+};
+
+// Records the time from its construction to its destruction as a span. Each
+// thread writes into its own ring buffer without locking, so this is cheap
+// enough for every scan. Use CARTOGRAPHER_TRACE_SPAN() instead of this class
+// directly, so that tracing can be compiled out.
+class ScopedTraceSpan {
+ public:
+  // 'name' must have static storage duration, e.g. a string literal.
+  explicit ScopedTraceSpan(const char* name);
+  ~ScopedTraceSpan();
+
+  ScopedTraceSpan(const ScopedTraceSpan&) = delete;
+  ScopedTraceSpan& operator=(const ScopedTraceSpan&) = delete;
+
+ private:
+  const char* const name_;
+  const int64 start_nanoseconds_;
+  const AllocationCount start_allocation_count_;
+};
+
+// Returns the spans of all threads which have not been overwritten yet,
+// ordered by start time. May be called while spans are being recorded.
+std::vector<TraceSpan> GetTraceSpans();
+
+// Returns 'spans' in the JSON trace event format, which can be opened with
+// chrome://tracing or Perfetto. Allocations are shown as arguments of the spans
+// which have any.
+string ToChromeTraceJson(const std::vector<TraceSpan>& spans);
+
+}  // namespace common
+}  // namespace cartographer
+
+// Traces the rest of the enclosing scope as a span named 'name', if tracing is
+// enabled by the CMake option CARTOGRAPHER_ENABLE_TRACING. Otherwise, this
+// compiles to nothing.
+#if CARTOGRAPHER_ENABLE_TRACING
+#define CARTOGRAPHER_TRACE_CONCAT_IMPL(a, b) a##b
+#define CARTOGRAPHER_TRACE_CONCAT(a, b) CARTOGRAPHER_TRACE_CONCAT_IMPL(a, b)
+#define CARTOGRAPHER_TRACE_SPAN(name)                               \
+  ::cartographer::common::ScopedTraceSpan CARTOGRAPHER_TRACE_CONCAT( \
+      trace_span_, __LINE__)(name)
+#else
+#define CARTOGRAPHER_TRACE_SPAN(name) static_cast<void>(0)
+#endif
+
+#endif  // CARTOGRAPHER_COMMON_TRACE_H_
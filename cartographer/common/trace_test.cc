@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/trace.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+// Returns the spans named 'name'. Other tests may have recorded other spans.
+std::vector<TraceSpan> GetTraceSpansNamed(const char* const name) {
+  std::vector<TraceSpan> result;
+  for (const TraceSpan& span : GetTraceSpans()) {
+    if (std::strcmp(span.name, name) == 0) {
+      result.push_back(span);
+    }
+  }
+  return result;
+}
+
+TEST(TraceTest, RecordsNestedSpans) {
+  {
+    ScopedTraceSpan outer("RecordsNestedSpans.outer");
+    ScopedTraceSpan inner("RecordsNestedSpans.inner");
+  }
+  const auto outer_spans = GetTraceSpansNamed("RecordsNestedSpans.outer");
+  const auto inner_spans = GetTraceSpansNamed("RecordsNestedSpans.inner");
+  ASSERT_EQ(1, outer_spans.size());
+  ASSERT_EQ(1, inner_spans.size());
+  EXPECT_EQ(outer_spans[0].thread_index, inner_spans[0].thread_index);
+  EXPECT_LE(outer_spans[0].start_nanoseconds, inner_spans[0].start_nanoseconds);
+  EXPECT_GE(outer_spans[0].start_nanoseconds +
+                outer_spans[0].duration_nanoseconds,
+            inner_spans[0].start_nanoseconds +
+                inner_spans[0].duration_nanoseconds);
+}
+
+TEST(TraceTest, KeepsSpansOfExitedThreads) {
+  std::thread thread(
+      []() { ScopedTraceSpan span("KeepsSpansOfExitedThreads"); });
+  thread.join();
+  { ScopedTraceSpan span("KeepsSpansOfExitedThreads"); }
+  const auto spans = GetTraceSpansNamed("KeepsSpansOfExitedThreads");
+  ASSERT_EQ(2, spans.size());
+  EXPECT_NE(spans[0].thread_index, spans[1].thread_index);
+}
+
+TEST(TraceTest, KeepsMostRecentSpans) {
+  std::thread thread([]() {
+    for (int i = 0; i != kNumTraceSpansPerThread; ++i) {
+      ScopedTraceSpan span("KeepsMostRecentSpans.old");
+    }
+    for (int i = 0; i != 10; ++i) {
+      ScopedTraceSpan span("KeepsMostRecentSpans.new");
+    }
+  });
+  thread.join();
+  // The oldest slot is dropped as well, since a reader cannot tell whether it
+  // is being overwritten.
+  EXPECT_EQ(kNumTraceSpansPerThread - 11,
+            GetTraceSpansNamed("KeepsMostRecentSpans.old").size());
+  EXPECT_EQ(10, GetTraceSpansNamed("KeepsMostRecentSpans.new").size());
+}
+
+TEST(TraceTest, ReadsWhileRecording) {
+  std::thread thread([]() {
+    for (int i = 0; i != 4 * kNumTraceSpansPerThread; ++i) {
+      ScopedTraceSpan span("ReadsWhileRecording");
+    }
+  });
+  for (int i = 0; i != 10; ++i) {
+    for (const TraceSpan& span : GetTraceSpans()) {
+      ASSERT_NE(nullptr, span.name);
+      EXPECT_GE(span.duration_nanoseconds, 0);
+    }
+  }
+  thread.join();
+}
+
+TEST(TraceTest, ToChromeTraceJson) {
+  const std::vector<TraceSpan> spans = {{"first", 0, 1000, 2500},
+                                        {"sec\"ond", 1, 2000, 500}};
+  EXPECT_EQ(
+      "{\"traceEvents\":[\n"
+      "{\"name\":\"first\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":1.000,"
+      "\"dur\":2.500},\n"
+      "{\"name\":\"sec\\\"ond\",\"ph\":\"X\",\"pid\":0,\"tid\":1,"
+      "\"ts\":2.000,\"dur\":0.500}\n"
+      "]}\n",
+      ToChromeTraceJson(spans));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/work_stealing_thread_pool.h"
+
+#include "cartographer/common/make_unique.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+namespace {
+
+// The pool and the index of the worker running on the current thread, if the
+// current thread is a worker.
+thread_local const WorkStealingThreadPool* current_pool = nullptr;
+thread_local int current_worker_index = -1;
+
+}  // namespace
+
+WorkStealingThreadPool::WorkStealingThreadPool(const int num_threads)
+    : WorkStealingThreadPool(num_threads, std::vector<int>()) {}
+
+WorkStealingThreadPool::WorkStealingThreadPool(const int num_threads,
+                                               const std::vector<int>& cpus)
+    : WorkStealingThreadPool(num_threads, cpus, kDefaultBackgroundNiceLevel) {}
+
+WorkStealingThreadPool::WorkStealingThreadPool(const int num_threads,
+                                               const std::vector<int>& cpus,
+                                               const int nice_level)
+    : cpus_(cpus),
+      nice_level_(nice_level),
+      next_worker_queue_(0),
+      num_idle_workers_(0) {
+  CHECK_GT(num_threads, 0);
+  for (auto& num_pending_work_items : num_pending_work_items_) {
+    num_pending_work_items = 0;
+  }
+  for (int i = 0; i != num_threads; ++i) {
+    worker_queues_.push_back(common::make_unique<WorkerQueue>());
+  }
+  for (int i = 0; i != num_threads; ++i) {
+    pool_.emplace_back([this, i]() { WorkStealingThreadPool::DoWork(i); });
+  }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+  for (auto& worker_queue : worker_queues_) {
+    MutexLocker locker(&worker_queue->mutex);
+    for (const auto& work_queue : worker_queue->work_queues) {
+      CHECK_EQ(work_queue.size(), 0);
+    }
+  }
+  {
+    MutexLocker locker(&idle_mutex_);
+    CHECK(running_);
+    running_ = false;
+    work_available_.SignalAll();
+  }
+  for (std::thread& thread : pool_) {
+    thread.join();
+  }
+}
+
+void WorkStealingThreadPool::ScheduleWorkItem(
+    const std::function<void()>& work_item, const WorkItemPriority priority) {
+  const int worker_index =
+      current_pool == this
+          ? current_worker_index
+          : static_cast<int>(next_worker_queue_++ % worker_queues_.size());
+  {
+    WorkerQueue* const worker_queue = worker_queues_[worker_index].get();
+    MutexLocker locker(&worker_queue->mutex);
+    worker_queue->work_queues[static_cast<int>(priority)].push_back(work_item);
+  }
+  ++num_pending_work_items_[static_cast<int>(priority)];
+  // Idle workers register themselves before checking for pending work, so
+  // if we see none, none can miss this work item.
+  if (num_idle_workers_ > 0) {
+    MutexLocker locker(&idle_mutex_);
+    work_available_.Signal();
+  }
+}
+
+bool WorkStealingThreadPool::TryTakeWorkItem(
+    const int worker_index, std::function<void()>* const work_item) {
+  const int num_queues = worker_queues_.size();
+  for (int priority = 0; priority != kNumWorkItemPriorities; ++priority) {
+    if (num_pending_work_items_[priority] <= 0) {
+      continue;
+    }
+    for (int i = 0; i != num_queues; ++i) {
+      WorkerQueue* const worker_queue =
+          worker_queues_[(worker_index + i) % num_queues].get();
+      MutexLocker locker(&worker_queue->mutex);
+      auto& work_queue = worker_queue->work_queues[priority];
+      if (!work_queue.empty()) {
+        *work_item = work_queue.front();
+        work_queue.pop_front();
+        --num_pending_work_items_[priority];
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool WorkStealingThreadPool::HasPendingWorkItems() const {
+  for (const auto& num_pending_work_items : num_pending_work_items_) {
+    if (num_pending_work_items > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadPool::DoWork(const int worker_index) {
+  ConfigureBackgroundThread(cpus_, nice_level_);
+  current_pool = this;
+  current_worker_index = worker_index;
+  for (;;) {
+    std::function<void()> work_item;
+    if (TryTakeWorkItem(worker_index, &work_item)) {
+      CHECK(work_item);
+      work_item();
+      continue;
+    }
+    MutexLocker locker(&idle_mutex_);
+    ++num_idle_workers_;
+    locker.Await(&work_available_, [this]() REQUIRES(idle_mutex_) {
+      return HasPendingWorkItems() || !running_;
+    });
+    --num_idle_workers_;
+    if (!HasPendingWorkItems() && !running_) {
+      return;
+    }
+  }
+}
+
+}  // namespace common
+}  // namespace cartographer
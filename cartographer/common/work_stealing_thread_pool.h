@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_WORK_STEALING_THREAD_POOL_H_
+#define CARTOGRAPHER_COMMON_WORK_STEALING_THREAD_POOL_H_
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/thread_pool.h"
+
+namespace cartographer {
+namespace common {
+
+// A fixed number of threads, each owning a work queue. Work items scheduled
+// from a worker thread go to its own queue, other work items are distributed
+// round-robin. Idle workers steal from the other queues, so that bursts of
+// small work items do not contend on a single lock. Work items of a higher
+// priority class are taken from any queue before those of a lower one. As for
+// 'ThreadPool', all queues must be empty before calling the destructor.
+class WorkStealingThreadPool : public ThreadPoolInterface {
+ public:
+  explicit WorkStealingThreadPool(int num_threads);
+  // The threads only run on 'cpus', see ConfigureBackgroundThread().
+  WorkStealingThreadPool(int num_threads, const std::vector<int>& cpus);
+  // Same as above, but with 'nice_level' instead of
+  // 'kDefaultBackgroundNiceLevel'.
+  WorkStealingThreadPool(int num_threads, const std::vector<int>& cpus,
+                         int nice_level);
+  ~WorkStealingThreadPool() override;
+
+ protected:
+  void ScheduleWorkItem(const std::function<void()>& work_item,
+                        WorkItemPriority priority) override;
+
+ private:
+  struct WorkerQueue {
+    Mutex mutex;
+    // One work queue per priority class.
+    std::array<std::deque<std::function<void()>>, kNumWorkItemPriorities>
+        work_queues GUARDED_BY(mutex);
+  };
+
+  void DoWork(int worker_index);
+
+  // Tries to take a work item of the highest pending priority class, first
+  // from the worker's own queue, then from the other queues. Returns false if
+  // all queues were empty.
+  bool TryTakeWorkItem(int worker_index, std::function<void()>* work_item);
+
+  bool HasPendingWorkItems() const;
+
+  const std::vector<int> cpus_;
+  const int nice_level_;
+  std::vector<std::unique_ptr<WorkerQueue>> worker_queues_;
+  std::vector<std::thread> pool_;
+
+  // Number of work items in all 'worker_queues_' by priority class.
+  std::array<std::atomic<int>, kNumWorkItemPriorities> num_pending_work_items_;
+  // Used to distribute work items scheduled from outside the pool.
+  std::atomic<unsigned int> next_worker_queue_;
+  // Number of workers waiting for work on 'idle_mutex_'.
+  std::atomic<int> num_idle_workers_;
+
+  Mutex idle_mutex_;
+  // Signaled once per work item, so that only one idle worker wakes up for it.
+  Mutex::Condition work_available_;
+  bool running_ GUARDED_BY(idle_mutex_) = true;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_WORK_STEALING_THREAD_POOL_H_
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/work_stealing_thread_pool.h"
+
+#include "cartographer/common/mutex.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(WorkStealingThreadPoolTest, RunsAllWorkItems) {
+  constexpr int kNumWorkItems = 1000;
+  Mutex mutex;
+  int num_done = 0;
+  WorkStealingThreadPool thread_pool(4);
+  for (int i = 0; i != kNumWorkItems; ++i) {
+    thread_pool.Schedule([&mutex, &num_done]() {
+      MutexLocker locker(&mutex);
+      ++num_done;
+    });
+  }
+  MutexLocker locker(&mutex);
+  locker.Await([&num_done]() { return num_done == kNumWorkItems; });
+  EXPECT_EQ(kNumWorkItems, num_done);
+}
+
+TEST(WorkStealingThreadPoolTest, RunsWorkItemsScheduledByWorkers) {
+  constexpr int kNumChildren = 100;
+  Mutex mutex;
+  int num_done = 0;
+  WorkStealingThreadPool thread_pool(3);
+  thread_pool.Schedule([&thread_pool, &mutex, &num_done]() {
+    // All children are pushed onto this worker's queue and have to be stolen
+    // by the other workers.
+    for (int i = 0; i != kNumChildren; ++i) {
+      thread_pool.Schedule([&mutex, &num_done]() {
+        MutexLocker locker(&mutex);
+        ++num_done;
+      });
+    }
+  });
+  MutexLocker locker(&mutex);
+  locker.Await([&num_done]() { return num_done == kNumChildren; });
+  EXPECT_EQ(kNumChildren, num_done);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -17,7 +17,9 @@
 #include <cmath>
 #include <fstream>
 #include <string>
+#include <vector>
 
+#include "cartographer/common/parallel_for.h"
 #include "cartographer/common/port.h"
 #include "cartographer/ground_truth/proto/relations.pb.h"
 #include "cartographer/io/proto_stream.h"
@@ -40,23 +42,31 @@ DEFINE_double(outlier_threshold_meters, 0.15,
 DEFINE_double(outlier_threshold_radians, 0.02,
               "Distance in radians beyond which constraints are considered "
               "outliers.");
+DEFINE_int32(num_threads, 0,
+             "Number of threads to generate relations on. 0 means the number "
+             "of hardware threads.");
 
 namespace cartographer {
 namespace ground_truth {
 namespace {
 
+// Returns the distance covered from the first node to each node. Being a
+// prefix sum, the distance covered between any two nodes is the difference of
+// their entries, so checking 'min_covered_distance' takes constant time.
 std::vector<double> ComputeCoveredDistance(
     const mapping::proto::Trajectory& trajectory) {
   std::vector<double> covered_distance;
   covered_distance.push_back(0.);
   CHECK_GT(trajectory.node_size(), 0)
       << "Trajectory does not contain any nodes.";
+  // The norm of the relative translation does not depend on the rotations.
   for (int i = 1; i < trajectory.node_size(); ++i) {
-    const auto last_pose = transform::ToRigid3(trajectory.node(i - 1).pose());
-    const auto this_pose = transform::ToRigid3(trajectory.node(i).pose());
-    covered_distance.push_back(
-        covered_distance.back() +
-        (last_pose.inverse() * this_pose).translation().norm());
+    const Eigen::Vector3d last_translation =
+        transform::ToEigen(trajectory.node(i - 1).pose().translation());
+    const Eigen::Vector3d this_translation =
+        transform::ToEigen(trajectory.node(i).pose().translation());
+    covered_distance.push_back(covered_distance.back() +
+                               (this_translation - last_translation).norm());
   }
   return covered_distance;
 }
@@ -88,10 +98,74 @@ std::vector<int> ComputeSubmapRepresentativeNode(
   return submap_to_node_index;
 }
 
+enum class RelationResult { kIgnored, kOutlier, kRelation };
+
+// Computes the relation for a loop closure 'constraint' into 'relation'.
+RelationResult ComputeRelation(
+    const mapping::proto::Trajectory& trajectory,
+    const mapping::proto::SparsePoseGraph::Constraint& constraint,
+    const std::vector<double>& covered_distance,
+    const std::vector<int>& submap_to_node_index,
+    const double min_covered_distance, const double outlier_threshold_meters,
+    const double outlier_threshold_radians, proto::Relation* const relation) {
+  // We're only interested in loop closure constraints.
+  if (constraint.tag() ==
+      mapping::proto::SparsePoseGraph::Constraint::INTRA_SUBMAP) {
+    return RelationResult::kIgnored;
+  }
+
+  // For some submaps at the very end, we have not chosen a representative
+  // node, but those should not be part of loop closure anyway.
+  CHECK_EQ(constraint.submap_id().trajectory_id(), 0);
+  CHECK_EQ(constraint.node_id().trajectory_id(), 0);
+  if (constraint.submap_id().submap_index() >=
+      static_cast<int>(submap_to_node_index.size())) {
+    return RelationResult::kIgnored;
+  }
+  const int matched_node = constraint.node_id().node_index();
+  const int representative_node =
+      submap_to_node_index.at(constraint.submap_id().submap_index());
+
+  // Covered distance between the two should not be too small.
+  if (std::abs(covered_distance.at(matched_node) -
+               covered_distance.at(representative_node)) <
+      min_covered_distance) {
+    return RelationResult::kIgnored;
+  }
+
+  // Compute the transform between the nodes according to the solution and
+  // the constraint.
+  const transform::Rigid3d solution_pose1 =
+      transform::ToRigid3(trajectory.node(representative_node).pose());
+  const transform::Rigid3d solution_pose2 =
+      transform::ToRigid3(trajectory.node(matched_node).pose());
+  const transform::Rigid3d solution = solution_pose1.inverse() * solution_pose2;
+
+  const transform::Rigid3d submap_solution = transform::ToRigid3(
+      trajectory.submap(constraint.submap_id().submap_index()).pose());
+  const transform::Rigid3d submap_solution_to_node_solution =
+      solution_pose1.inverse() * submap_solution;
+  const transform::Rigid3d node_to_submap_constraint =
+      transform::ToRigid3(constraint.relative_pose());
+  const transform::Rigid3d expected =
+      submap_solution_to_node_solution * node_to_submap_constraint;
+
+  const transform::Rigid3d error = solution * expected.inverse();
+
+  if (error.translation().norm() > outlier_threshold_meters ||
+      transform::GetAngle(error) > outlier_threshold_radians) {
+    return RelationResult::kOutlier;
+  }
+  relation->set_timestamp1(trajectory.node(representative_node).timestamp());
+  relation->set_timestamp2(trajectory.node(matched_node).timestamp());
+  *relation->mutable_expected() = transform::ToProto(expected);
+  return RelationResult::kRelation;
+}
+
 proto::GroundTruth GenerateGroundTruth(
     const mapping::proto::SparsePoseGraph& pose_graph,
     const double min_covered_distance, const double outlier_threshold_meters,
-    const double outlier_threshold_radians) {
+    const double outlier_threshold_radians, const int num_threads) {
   const mapping::proto::Trajectory& trajectory = pose_graph.trajectory(0);
   const std::vector<double> covered_distance =
       ComputeCoveredDistance(trajectory);
@@ -99,64 +173,32 @@ proto::GroundTruth GenerateGroundTruth(
   const std::vector<int> submap_to_node_index =
       ComputeSubmapRepresentativeNode(pose_graph);
 
+  // Only existing loop closure constraints are candidates, so this is linear in
+  // the number of constraints and does not need a spatial index over the
+  // nodes. Constraints are independent of each other, so their relations are
+  // computed in parallel, but added in the order of the constraints.
+  const int num_constraints = pose_graph.constraint_size();
+  std::vector<RelationResult> results(num_constraints);
+  std::vector<proto::Relation> relations(num_constraints);
+  common::ParallelFor(
+      num_threads, num_constraints, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i != end; ++i) {
+          results[i] = ComputeRelation(
+              trajectory, pose_graph.constraint(i), covered_distance,
+              submap_to_node_index, min_covered_distance,
+              outlier_threshold_meters, outlier_threshold_radians,
+              &relations[i]);
+        }
+      });
+
   int num_outliers = 0;
   proto::GroundTruth ground_truth;
-  for (const auto& constraint : pose_graph.constraint()) {
-    // We're only interested in loop closure constraints.
-    if (constraint.tag() ==
-        mapping::proto::SparsePoseGraph::Constraint::INTRA_SUBMAP) {
-      continue;
-    }
-
-    // For some submaps at the very end, we have not chosen a representative
-    // node, but those should not be part of loop closure anyway.
-    CHECK_EQ(constraint.submap_id().trajectory_id(), 0);
-    CHECK_EQ(constraint.node_id().trajectory_id(), 0);
-    if (constraint.submap_id().submap_index() >=
-        static_cast<int>(submap_to_node_index.size())) {
-      continue;
-    }
-    const int matched_node = constraint.node_id().node_index();
-    const int representative_node =
-        submap_to_node_index.at(constraint.submap_id().submap_index());
-
-    // Covered distance between the two should not be too small.
-    if (std::abs(covered_distance.at(matched_node) -
-                 covered_distance.at(representative_node)) <
-        min_covered_distance) {
-      continue;
-    }
-
-    // Compute the transform between the nodes according to the solution and
-    // the constraint.
-    const transform::Rigid3d solution_pose1 =
-        transform::ToRigid3(trajectory.node(representative_node).pose());
-    const transform::Rigid3d solution_pose2 =
-        transform::ToRigid3(trajectory.node(matched_node).pose());
-    const transform::Rigid3d solution =
-        solution_pose1.inverse() * solution_pose2;
-
-    const transform::Rigid3d submap_solution = transform::ToRigid3(
-        trajectory.submap(constraint.submap_id().submap_index()).pose());
-    const transform::Rigid3d submap_solution_to_node_solution =
-        solution_pose1.inverse() * submap_solution;
-    const transform::Rigid3d node_to_submap_constraint =
-        transform::ToRigid3(constraint.relative_pose());
-    const transform::Rigid3d expected =
-        submap_solution_to_node_solution * node_to_submap_constraint;
-
-    const transform::Rigid3d error = solution * expected.inverse();
-
-    if (error.translation().norm() > outlier_threshold_meters ||
-        transform::GetAngle(error) > outlier_threshold_radians) {
+  for (int i = 0; i != num_constraints; ++i) {
+    if (results[i] == RelationResult::kOutlier) {
       ++num_outliers;
-      continue;
+    } else if (results[i] == RelationResult::kRelation) {
+      ground_truth.add_relation()->Swap(&relations[i]);
     }
-    auto* const new_relation = ground_truth.add_relation();
-    new_relation->set_timestamp1(
-        trajectory.node(representative_node).timestamp());
-    new_relation->set_timestamp2(trajectory.node(matched_node).timestamp());
-    *new_relation->mutable_expected() = transform::ToProto(expected);
   }
   LOG(INFO) << "Generated " << ground_truth.relation_size()
             << " relations and ignored " << num_outliers << " outliers.";
@@ -166,7 +208,7 @@ proto::GroundTruth GenerateGroundTruth(
 void Run(const string& pose_graph_filename, const string& output_filename,
          const double min_covered_distance,
          const double outlier_threshold_meters,
-         const double outlier_threshold_radians) {
+         const double outlier_threshold_radians, const int num_threads) {
   LOG(INFO) << "Reading pose graph from '" << pose_graph_filename << "'...";
   mapping::proto::SparsePoseGraph pose_graph;
   {
@@ -178,7 +220,8 @@ void Run(const string& pose_graph_filename, const string& output_filename,
   LOG(INFO) << "Autogenerating ground truth relations...";
   const proto::GroundTruth ground_truth =
       GenerateGroundTruth(pose_graph, min_covered_distance,
-                          outlier_threshold_meters, outlier_threshold_radians);
+                          outlier_threshold_meters, outlier_threshold_radians,
+                          num_threads);
   LOG(INFO) << "Writing " << ground_truth.relation_size() << " relations to '"
             << output_filename << "'.";
   {
@@ -219,5 +262,5 @@ int main(int argc, char** argv) {
   ::cartographer::ground_truth::Run(
       FLAGS_pose_graph_filename, FLAGS_output_filename,
       FLAGS_min_covered_distance, FLAGS_outlier_threshold_meters,
-      FLAGS_outlier_threshold_radians);
+      FLAGS_outlier_threshold_radians, FLAGS_num_threads);
 }
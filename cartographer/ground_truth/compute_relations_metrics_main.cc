@@ -21,9 +21,11 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "cartographer/common/math.h"
+#include "cartographer/common/parallel_for.h"
 #include "cartographer/common/port.h"
 #include "cartographer/ground_truth/proto/relations.pb.h"
 #include "cartographer/ground_truth/relations_text_file.h"
@@ -35,14 +37,17 @@
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
-DEFINE_string(
-    pose_graph_filename, "",
-    "Proto stream file containing the pose graph used to assess quality.");
+DEFINE_string(pose_graph_filename, "",
+              "Comma-separated list of proto stream files containing the pose "
+              "graphs used to assess quality. Each is evaluated separately.");
 DEFINE_string(relations_filename, "",
               "Relations file containing the ground truth.");
 DEFINE_bool(read_text_file_with_unix_timestamps, false,
             "Enable support for the relations text files as in the paper. "
             "Default is to read from a GroundTruth proto file.");
+DEFINE_int32(num_threads, 0,
+             "Number of pose graphs to evaluate in parallel. 0 means the "
+             "number of hardware threads.");
 
 namespace cartographer {
 namespace ground_truth {
@@ -67,50 +72,109 @@ Error ComputeError(const transform::Rigid3d& pose1,
                common::Pow2(transform::GetAngle(error))};
 }
 
-string MeanAndStdDevString(const std::vector<double>& values) {
-  CHECK_GE(values.size(), 2);
-  const double mean =
-      std::accumulate(values.begin(), values.end(), 0.) / values.size();
-  double sum_of_squared_differences = 0.;
-  for (const double value : values) {
-    sum_of_squared_differences += common::Pow2(value - mean);
+// Accumulates the mean and variance of a stream of values with Welford's
+// algorithm, so that the values need not be kept.
+class RunningStatistics {
+ public:
+  void Add(const double value) {
+    ++count_;
+    const double delta = value - mean_;
+    mean_ += delta / count_;
+    sum_of_squared_differences_ += delta * (value - mean_);
   }
-  const double standard_deviation =
-      std::sqrt(sum_of_squared_differences / (values.size() - 1));
+
+  size_t count() const { return count_; }
+  double mean() const { return mean_; }
+  double standard_deviation() const {
+    return std::sqrt(sum_of_squared_differences_ / (count_ - 1));
+  }
+
+ private:
+  size_t count_ = 0;
+  double mean_ = 0.;
+  double sum_of_squared_differences_ = 0.;
+};
+
+string MeanAndStdDevString(const RunningStatistics& statistics) {
+  CHECK_GE(statistics.count(), 2);
   std::ostringstream out;
-  out << std::fixed << std::setprecision(5) << mean << " +/- "
-      << standard_deviation;
+  out << std::fixed << std::setprecision(5) << statistics.mean() << " +/- "
+      << statistics.standard_deviation();
   return string(out.str());
 }
 
-string StatisticsString(const std::vector<Error>& errors) {
-  std::vector<double> translational_errors;
-  std::vector<double> squared_translational_errors;
-  std::vector<double> rotational_errors_degrees;
-  std::vector<double> squared_rotational_errors_degrees;
-  for (const Error& error : errors) {
-    translational_errors.push_back(std::sqrt(error.translational_squared));
-    squared_translational_errors.push_back(error.translational_squared);
-    rotational_errors_degrees.push_back(
-        common::RadToDeg(std::sqrt(error.rotational_squared)));
-    squared_rotational_errors_degrees.push_back(
-        common::Pow2(rotational_errors_degrees.back()));
+class ErrorStatistics {
+ public:
+  void Add(const Error& error) {
+    translational_errors_.Add(std::sqrt(error.translational_squared));
+    squared_translational_errors_.Add(error.translational_squared);
+    const double rotational_error_degrees =
+        common::RadToDeg(std::sqrt(error.rotational_squared));
+    rotational_errors_degrees_.Add(rotational_error_degrees);
+    squared_rotational_errors_degrees_.Add(
+        common::Pow2(rotational_error_degrees));
+  }
+
+  string ToString() const {
+    return "Abs translational error " +
+           MeanAndStdDevString(translational_errors_) +
+           " m\n"
+           "Sqr translational error " +
+           MeanAndStdDevString(squared_translational_errors_) +
+           " m^2\n"
+           "Abs rotational error " +
+           MeanAndStdDevString(rotational_errors_degrees_) +
+           " deg\n"
+           "Sqr rotational error " +
+           MeanAndStdDevString(squared_rotational_errors_degrees_) +
+           " deg^2\n";
   }
-  return "Abs translational error " +
-         MeanAndStdDevString(translational_errors) +
-         " m\n"
-         "Sqr translational error " +
-         MeanAndStdDevString(squared_translational_errors) +
-         " m^2\n"
-         "Abs rotational error " +
-         MeanAndStdDevString(rotational_errors_degrees) +
-         " deg\n"
-         "Sqr rotational error " +
-         MeanAndStdDevString(squared_rotational_errors_degrees) + " deg^2\n";
+
+ private:
+  RunningStatistics translational_errors_;
+  RunningStatistics squared_translational_errors_;
+  RunningStatistics rotational_errors_degrees_;
+  RunningStatistics squared_rotational_errors_degrees_;
+};
+
+// The timestamps of all relations, sorted and without duplicates, so that the
+// poses of each pose graph are looked up in a single pass.
+struct RelationTimes {
+  std::vector<common::Time> sorted_times;
+  // Indices into 'sorted_times' of 'timestamp1' and 'timestamp2' of each
+  // relation.
+  std::vector<std::pair<size_t, size_t>> relation_time_indices;
+};
+
+RelationTimes ComputeRelationTimes(const proto::GroundTruth& ground_truth) {
+  RelationTimes result;
+  for (const auto& relation : ground_truth.relation()) {
+    result.sorted_times.push_back(common::FromUniversal(relation.timestamp1()));
+    result.sorted_times.push_back(common::FromUniversal(relation.timestamp2()));
+  }
+  std::sort(result.sorted_times.begin(), result.sorted_times.end());
+  result.sorted_times.erase(
+      std::unique(result.sorted_times.begin(), result.sorted_times.end()),
+      result.sorted_times.end());
+  const auto index_of = [&result](const int64 timestamp) {
+    return static_cast<size_t>(
+        std::lower_bound(result.sorted_times.begin(),
+                         result.sorted_times.end(),
+                         common::FromUniversal(timestamp)) -
+        result.sorted_times.begin());
+  };
+  for (const auto& relation : ground_truth.relation()) {
+    result.relation_time_indices.emplace_back(index_of(relation.timestamp1()),
+                                              index_of(relation.timestamp2()));
+  }
+  return result;
 }
 
-void Run(const string& pose_graph_filename, const string& relations_filename,
-         const bool read_text_file_with_unix_timestamps) {
+// Returns the statistics of the errors of 'pose_graph_filename' with respect to
+// the relations in 'ground_truth'.
+string ComputeStatistics(const string& pose_graph_filename,
+                         const proto::GroundTruth& ground_truth,
+                         const RelationTimes& relation_times) {
   LOG(INFO) << "Reading pose graph from '" << pose_graph_filename << "'...";
   mapping::proto::SparsePoseGraph pose_graph;
   {
@@ -119,9 +183,23 @@ void Run(const string& pose_graph_filename, const string& relations_filename,
     CHECK_EQ(pose_graph.trajectory_size(), 1)
         << "Only pose graphs containing a single trajectory are supported.";
   }
-  const transform::TransformInterpolationBuffer transform_interpolation_buffer(
-      pose_graph.trajectory(0));
+  const std::vector<transform::Rigid3d> poses =
+      transform::TransformInterpolationBuffer(pose_graph.trajectory(0))
+          .Lookup(relation_times.sorted_times);
 
+  ErrorStatistics error_statistics;
+  for (int i = 0; i != ground_truth.relation_size(); ++i) {
+    const auto& time_indices = relation_times.relation_time_indices[i];
+    error_statistics.Add(
+        ComputeError(poses[time_indices.first], poses[time_indices.second],
+                     transform::ToRigid3(ground_truth.relation(i).expected())));
+  }
+  return error_statistics.ToString();
+}
+
+void Run(const string& pose_graph_filenames, const string& relations_filename,
+         const bool read_text_file_with_unix_timestamps,
+         const int num_threads) {
   proto::GroundTruth ground_truth;
   if (read_text_file_with_unix_timestamps) {
     LOG(INFO) << "Reading relations from '" << relations_filename << "'...";
@@ -132,19 +210,31 @@ void Run(const string& pose_graph_filename, const string& relations_filename,
                                       std::ios::binary);
     CHECK(ground_truth.ParseFromIstream(&ground_truth_stream));
   }
+  const RelationTimes relation_times = ComputeRelationTimes(ground_truth);
 
-  std::vector<Error> errors;
-  for (const auto& relation : ground_truth.relation()) {
-    const auto pose1 = transform_interpolation_buffer.Lookup(
-        common::FromUniversal(relation.timestamp1()));
-    const auto pose2 = transform_interpolation_buffer.Lookup(
-        common::FromUniversal(relation.timestamp2()));
-    const transform::Rigid3d expected =
-        transform::ToRigid3(relation.expected());
-    errors.push_back(ComputeError(pose1, pose2, expected));
+  std::vector<string> filenames;
+  {
+    std::istringstream stream(pose_graph_filenames);
+    string filename;
+    while (std::getline(stream, filename, ',')) {
+      filenames.push_back(filename);
+    }
   }
 
-  LOG(INFO) << "Result:\n" << StatisticsString(errors);
+  // The pose graphs are only read by the thread evaluating them, so they are
+  // evaluated in parallel.
+  std::vector<string> results(filenames.size());
+  common::ParallelFor(
+      num_threads, filenames.size(), [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i != end; ++i) {
+          results[i] =
+              ComputeStatistics(filenames[i], ground_truth, relation_times);
+        }
+      });
+
+  for (size_t i = 0; i != filenames.size(); ++i) {
+    LOG(INFO) << "Result for '" << filenames[i] << "':\n" << results[i];
+  }
 }
 
 }  // namespace
@@ -168,5 +258,6 @@ int main(int argc, char** argv) {
   }
   ::cartographer::ground_truth::Run(FLAGS_pose_graph_filename,
                                     FLAGS_relations_filename,
-                                    FLAGS_read_text_file_with_unix_timestamps);
+                                    FLAGS_read_text_file_with_unix_timestamps,
+                                    FLAGS_num_threads);
 }
@@ -40,14 +40,13 @@ ColoringPointsProcessor::FromDictionary(
 ColoringPointsProcessor::ColoringPointsProcessor(const FloatColor& color,
                                                  const string& frame_id,
                                                  PointsProcessor* const next)
-    : color_(color), frame_id_(frame_id), next_(next) {}
+    : color_(color),
+      frame_id_handle_(InternFrameId(frame_id)),
+      next_(next) {}
 
 void ColoringPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
-  if (batch->frame_id == frame_id_) {
-    batch->colors.clear();
-    for (size_t i = 0; i < batch->points.size(); ++i) {
-      batch->colors.push_back(color_);
-    }
+  if (GetFrameIdHandle(batch.get()) == frame_id_handle_) {
+    batch->colors.assign(batch->points.size(), color_);
   }
   next_->Process(std::move(batch));
 }
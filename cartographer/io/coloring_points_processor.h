@@ -47,7 +47,7 @@ class ColoringPointsProcessor : public PointsProcessor {
 
  private:
   const FloatColor color_;
-  const string frame_id_;
+  const FrameIdHandle frame_id_handle_;
   PointsProcessor* const next_;
 };
 
@@ -24,6 +24,19 @@
 namespace cartographer {
 namespace io {
 
+namespace {
+
+std::unordered_set<FrameIdHandle> InternFrameIds(
+    const std::unordered_set<string>& frame_ids) {
+  std::unordered_set<FrameIdHandle> handles;
+  for (const string& frame_id : frame_ids) {
+    handles.insert(InternFrameId(frame_id));
+  }
+  return handles;
+}
+
+}  // namespace
+
 std::unique_ptr<FrameIdFilteringPointsProcessor>
 FrameIdFilteringPointsProcessor::FromDictionary(
     common::LuaParameterDictionary* dictionary, PointsProcessor* next) {
@@ -44,8 +57,8 @@ FrameIdFilteringPointsProcessor::FromDictionary(
 FrameIdFilteringPointsProcessor::FrameIdFilteringPointsProcessor(
     const std::unordered_set<string>& keep_frame_ids,
     const std::unordered_set<string>& drop_frame_ids, PointsProcessor* next)
-    : keep_frame_ids_(keep_frame_ids),
-      drop_frame_ids_(drop_frame_ids),
+    : keep_frame_ids_(InternFrameIds(keep_frame_ids)),
+      drop_frame_ids_(InternFrameIds(drop_frame_ids)),
       next_(next) {
   CHECK_NE(keep_frame_ids.empty(), drop_frame_ids.empty())
       << "You have to specify exactly one of the `keep_frames` property or the "
@@ -54,8 +67,9 @@ FrameIdFilteringPointsProcessor::FrameIdFilteringPointsProcessor(
 
 void FrameIdFilteringPointsProcessor::Process(
     std::unique_ptr<PointsBatch> batch) {
-  if ((!keep_frame_ids_.empty() && keep_frame_ids_.count(batch->frame_id)) ||
-      (!drop_frame_ids_.empty() && !drop_frame_ids_.count(batch->frame_id))) {
+  const FrameIdHandle frame_id_handle = GetFrameIdHandle(batch.get());
+  if ((!keep_frame_ids_.empty() && keep_frame_ids_.count(frame_id_handle)) ||
+      (!drop_frame_ids_.empty() && !drop_frame_ids_.count(frame_id_handle))) {
     next_->Process(std::move(batch));
   }
 }
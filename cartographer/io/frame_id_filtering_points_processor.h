@@ -20,6 +20,7 @@
 #include <unordered_set>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/io/points_batch.h"
 #include "cartographer/io/points_processor.h"
 
 namespace cartographer {
@@ -47,8 +48,9 @@ class FrameIdFilteringPointsProcessor : public PointsProcessor {
   FlushResult Flush() override;
 
  private:
-  const std::unordered_set<string> keep_frame_ids_;
-  const std::unordered_set<string> drop_frame_ids_;
+  // Handles of the frame IDs to keep or drop.
+  const std::unordered_set<FrameIdHandle> keep_frame_ids_;
+  const std::unordered_set<FrameIdHandle> drop_frame_ids_;
   PointsProcessor* const next_;
 };
 
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_IO_GRID_TILES_H_
+#define CARTOGRAPHER_IO_GRID_TILES_H_
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/math.h"
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace io {
+
+// Splits the x-y plane into square tiles with edge length 'tile_size' and keeps
+// a separate grid for each tile that range data was inserted into recently, so
+// that only the grids around the trajectory have to be kept in memory.
+//
+// Once the origin of the inserted range data is more than
+// 'finished_tile_distance' away from a tile that the latest range data did not
+// touch, the tile is finished: its grid is passed to 'finish_tile' and freed.
+// 'finished_tile_distance' should thus be larger than the range of the sensor.
+// If range data touches a finished tile again, a new grid is started for the
+// tile and later finished as its next part.
+//
+// The grid of a tile contains all range data touching the tile and hence also
+// cells outside of it, which 'finish_tile' should crop to the 'tile_box'.
+template <typename GridType>
+class GridTiles {
+ public:
+  using CreateGridFunction = std::function<std::unique_ptr<GridType>()>;
+  using FinishTileFunction = std::function<void(
+      const Eigen::Array2i& tile_index, int part,
+      const Eigen::AlignedBox2f& tile_box, GridType* grid)>;
+
+  GridTiles(const double tile_size, const double finished_tile_distance,
+            CreateGridFunction create_grid, FinishTileFunction finish_tile)
+      : tile_size_(tile_size),
+        finished_tile_distance_(finished_tile_distance),
+        create_grid_(std::move(create_grid)),
+        finish_tile_(std::move(finish_tile)) {
+    CHECK_GT(tile_size_, 0.);
+  }
+
+  GridTiles(const GridTiles&) = delete;
+  GridTiles& operator=(const GridTiles&) = delete;
+
+  // Calls 'insert' with the grid of each tile touched by the range data from
+  // 'origin' to 'points'. Then finishes the tiles 'origin' moved away from.
+  void Insert(const Eigen::Vector3f& origin,
+              const std::vector<Eigen::Vector3f>& points,
+              const std::function<void(GridType*)>& insert) {
+    Eigen::AlignedBox2f bounding_box(origin.head<2>());
+    for (const Eigen::Vector3f& point : points) {
+      bounding_box.extend(point.head<2>());
+    }
+    const Eigen::Array2i min_tile_index = GetTileIndex(bounding_box.min());
+    const Eigen::Array2i max_tile_index = GetTileIndex(bounding_box.max());
+    for (int x = min_tile_index.x(); x <= max_tile_index.x(); ++x) {
+      for (int y = min_tile_index.y(); y <= max_tile_index.y(); ++y) {
+        Tile& tile = tiles_[std::make_pair(x, y)];
+        if (tile.grid == nullptr) {
+          tile.grid = create_grid_();
+        }
+        tile.last_insertion = num_insertions_;
+        insert(tile.grid.get());
+      }
+    }
+    for (auto it = tiles_.begin(); it != tiles_.end();) {
+      if (it->second.last_insertion != num_insertions_ &&
+          GetTileBox(it->first).exteriorDistance(origin.head<2>()) >
+              finished_tile_distance_) {
+        it = FinishTile(it);
+      } else {
+        ++it;
+      }
+    }
+    ++num_insertions_;
+  }
+
+  // Finishes all remaining tiles.
+  void FinishAll() {
+    for (auto it = tiles_.begin(); it != tiles_.end();) {
+      it = FinishTile(it);
+    }
+  }
+
+  // Returns the number of tiles currently kept in memory.
+  int num_tiles() const { return tiles_.size(); }
+
+ private:
+  using TileKey = std::pair<int, int>;
+
+  struct Tile {
+    std::unique_ptr<GridType> grid;
+    int64 last_insertion = 0;
+  };
+
+  Eigen::Array2i GetTileIndex(const Eigen::Vector2f& point) const {
+    return Eigen::Array2i(
+        common::RoundToInt(std::floor(point.x() / tile_size_)),
+        common::RoundToInt(std::floor(point.y() / tile_size_)));
+  }
+
+  Eigen::AlignedBox2f GetTileBox(const TileKey& key) const {
+    const Eigen::Vector2f min = Eigen::Vector2f(key.first, key.second) *
+                                static_cast<float>(tile_size_);
+    return Eigen::AlignedBox2f(
+        min, min + Eigen::Vector2f::Constant(static_cast<float>(tile_size_)));
+  }
+
+  typename std::map<TileKey, Tile>::iterator FinishTile(
+      typename std::map<TileKey, Tile>::iterator it) {
+    int& part = num_parts_finished_[it->first];
+    finish_tile_(Eigen::Array2i(it->first.first, it->first.second), part,
+                 GetTileBox(it->first), it->second.grid.get());
+    ++part;
+    return tiles_.erase(it);
+  }
+
+  const double tile_size_;
+  const double finished_tile_distance_;
+  const CreateGridFunction create_grid_;
+  const FinishTileFunction finish_tile_;
+  int64 num_insertions_ = 0;
+  std::map<TileKey, Tile> tiles_;
+  std::map<TileKey, int> num_parts_finished_;
+};
+
+}  // namespace io
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_IO_GRID_TILES_H_
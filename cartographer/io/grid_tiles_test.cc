@@ -0,0 +1,100 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/io/grid_tiles.h"
+
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace io {
+namespace {
+
+struct FinishedTile {
+  Eigen::Array2i tile_index;
+  int part;
+  Eigen::AlignedBox2f tile_box;
+  int num_insertions;
+};
+
+class GridTilesTest : public ::testing::Test {
+ protected:
+  GridTilesTest()
+      : grid_tiles_(
+            10. /* tile_size */, 15. /* finished_tile_distance */,
+            []() { return common::make_unique<int>(0); },
+            [this](const Eigen::Array2i& tile_index, const int part,
+                   const Eigen::AlignedBox2f& tile_box, int* const grid) {
+              finished_tiles_.push_back(
+                  FinishedTile{tile_index, part, tile_box, *grid});
+            }) {}
+
+  void Insert(const Eigen::Vector3f& origin,
+              const std::vector<Eigen::Vector3f>& points) {
+    grid_tiles_.Insert(origin, points, [](int* grid) { ++*grid; });
+  }
+
+  std::vector<FinishedTile> finished_tiles_;
+  GridTiles<int> grid_tiles_;
+};
+
+TEST_F(GridTilesTest, InsertsIntoTouchedTiles) {
+  Insert(Eigen::Vector3f(1.f, 1.f, 0.f), {Eigen::Vector3f(12.f, 3.f, 5.f),
+                                          Eigen::Vector3f(-3.f, 2.f, -1.f)});
+  EXPECT_EQ(3, grid_tiles_.num_tiles());
+  Insert(Eigen::Vector3f(1.f, 1.f, 0.f), {Eigen::Vector3f(2.f, 3.f, 5.f)});
+  EXPECT_TRUE(finished_tiles_.empty());
+  grid_tiles_.FinishAll();
+  EXPECT_EQ(0, grid_tiles_.num_tiles());
+  ASSERT_EQ(3, finished_tiles_.size());
+  EXPECT_EQ(-1, finished_tiles_[0].tile_index.x());
+  EXPECT_EQ(1, finished_tiles_[0].num_insertions);
+  EXPECT_EQ(0, finished_tiles_[1].tile_index.x());
+  EXPECT_EQ(2, finished_tiles_[1].num_insertions);
+  EXPECT_EQ(1, finished_tiles_[2].tile_index.x());
+  EXPECT_EQ(1, finished_tiles_[2].num_insertions);
+  for (const FinishedTile& finished_tile : finished_tiles_) {
+    EXPECT_EQ(0, finished_tile.tile_index.y());
+    EXPECT_EQ(0, finished_tile.part);
+    EXPECT_EQ(10.f * finished_tile.tile_index.x(),
+              finished_tile.tile_box.min().x());
+    EXPECT_EQ(10.f, finished_tile.tile_box.sizes().x());
+  }
+}
+
+TEST_F(GridTilesTest, FinishesTilesLeftBehind) {
+  for (float x = 0.f; x < 100.f; x += 1.f) {
+    Insert(Eigen::Vector3f(x, 5.f, 0.f), {Eigen::Vector3f(x + 1.f, 5.f, 0.f)});
+    EXPECT_LE(grid_tiles_.num_tiles(), 3);
+  }
+  ASSERT_EQ(8, finished_tiles_.size());
+  for (int i = 0; i != 8; ++i) {
+    EXPECT_EQ(i, finished_tiles_[i].tile_index.x());
+    EXPECT_EQ(0, finished_tiles_[i].part);
+  }
+  // Returning to a finished tile starts its next part.
+  Insert(Eigen::Vector3f(5.f, 5.f, 0.f), {Eigen::Vector3f(6.f, 5.f, 0.f)});
+  grid_tiles_.FinishAll();
+  EXPECT_EQ(0, finished_tiles_.back().tile_index.x());
+  EXPECT_EQ(1, finished_tiles_.back().part);
+  EXPECT_EQ(1, finished_tiles_.back().num_insertions);
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace cartographer
@@ -15,6 +15,35 @@
 
 namespace cartographer {
 namespace io {
+namespace {
+
+void WriteHybridGrid(const mapping_3d::HybridGrid& hybrid_grid,
+                     FileWriter* const file_writer) {
+  const mapping_3d::proto::HybridGrid hybrid_grid_proto =
+      hybrid_grid.ToProto();
+  string serialized;
+  hybrid_grid_proto.SerializeToString(&serialized);
+  file_writer->Write(serialized.data(), serialized.size());
+  CHECK(file_writer->Close());
+}
+
+// Returns the cells of 'hybrid_grid' with centers inside 'box'.
+mapping_3d::HybridGrid CropHybridGrid(const mapping_3d::HybridGrid& hybrid_grid,
+                                      const Eigen::AlignedBox2f& box) {
+  mapping_3d::HybridGrid result(hybrid_grid.resolution());
+  for (const auto it : hybrid_grid) {
+    const Eigen::Vector2f center =
+        hybrid_grid.GetCenterOfCell(it.first).head<2>();
+    // Half-open, so that each cell belongs to exactly one tile.
+    if ((center.array() >= box.min().array()).all() &&
+        (center.array() < box.max().array()).all()) {
+      *result.mutable_value(it.first) = it.second;
+    }
+  }
+  return result;
+}
+
+}  // namespace
 
 HybridGridPointsProcessor::HybridGridPointsProcessor(
     const double voxel_size,
@@ -26,31 +55,77 @@ HybridGridPointsProcessor::HybridGridPointsProcessor(
       hybrid_grid_(voxel_size),
       file_writer_(std::move(file_writer)) {}
 
+HybridGridPointsProcessor::HybridGridPointsProcessor(
+    const double voxel_size,
+    const mapping_3d::proto::RangeDataInserterOptions&
+        range_data_inserter_options,
+    const double tile_size, const double finished_tile_distance,
+    const FileWriterFactory& file_writer_factory, const string& filename,
+    PointsProcessor* const next)
+    : next_(next),
+      range_data_inserter_(range_data_inserter_options),
+      hybrid_grid_(voxel_size),
+      grid_tiles_(common::make_unique<GridTiles<mapping_3d::HybridGrid>>(
+          tile_size, finished_tile_distance,
+          [voxel_size]() {
+            return common::make_unique<mapping_3d::HybridGrid>(voxel_size);
+          },
+          [file_writer_factory, filename](const Eigen::Array2i& tile_index,
+                                          const int part,
+                                          const Eigen::AlignedBox2f& tile_box,
+                                          mapping_3d::HybridGrid* const grid) {
+            string tile_filename = filename + "_" +
+                                   std::to_string(tile_index.x()) + "_" +
+                                   std::to_string(tile_index.y());
+            if (part > 0) {
+              tile_filename += "_" + std::to_string(part);
+            }
+            WriteHybridGrid(CropHybridGrid(*grid, tile_box),
+                            file_writer_factory(tile_filename).get());
+          })) {}
+
 std::unique_ptr<HybridGridPointsProcessor>
 HybridGridPointsProcessor::FromDictionary(
     const FileWriterFactory& file_writer_factory,
     common::LuaParameterDictionary* const dictionary,
     PointsProcessor* const next) {
-  return common::make_unique<HybridGridPointsProcessor>(
-      dictionary->GetDouble("voxel_size"),
+  const auto range_data_inserter_options =
       mapping_3d::CreateRangeDataInserterOptions(
-          dictionary->GetDictionary("range_data_inserter").get()),
+          dictionary->GetDictionary("range_data_inserter").get());
+  if (dictionary->HasKey("tile_size")) {
+    const double tile_size = dictionary->GetDouble("tile_size");
+    return common::make_unique<HybridGridPointsProcessor>(
+        dictionary->GetDouble("voxel_size"), range_data_inserter_options,
+        tile_size,
+        dictionary->HasKey("finished_tile_distance")
+            ? dictionary->GetDouble("finished_tile_distance")
+            : tile_size,
+        file_writer_factory, dictionary->GetString("filename"), next);
+  }
+  return common::make_unique<HybridGridPointsProcessor>(
+      dictionary->GetDouble("voxel_size"), range_data_inserter_options,
       file_writer_factory(dictionary->GetString("filename")), next);
 }
 
 void HybridGridPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
-  range_data_inserter_.Insert({batch->origin, batch->points, {}},
-                              &hybrid_grid_);
+  const sensor::RangeData range_data{batch->origin, batch->points, {}};
+  if (grid_tiles_ != nullptr) {
+    grid_tiles_->Insert(batch->origin, batch->points,
+                        [this, &range_data](mapping_3d::HybridGrid* grid) {
+                          range_data_inserter_.Insert(range_data, grid);
+                        });
+  } else {
+    range_data_inserter_.Insert(range_data, &hybrid_grid_);
+  }
   next_->Process(std::move(batch));
 }
 
 PointsProcessor::FlushResult HybridGridPointsProcessor::Flush() {
-  const mapping_3d::proto::HybridGrid hybrid_grid_proto =
-      hybrid_grid_.ToProto();
-  string serialized;
-  hybrid_grid_proto.SerializeToString(&serialized);
-  file_writer_->Write(serialized.data(), serialized.size());
-  CHECK(file_writer_->Close());
+  if (grid_tiles_ != nullptr) {
+    grid_tiles_->FinishAll();
+  } else {
+    WriteHybridGrid(hybrid_grid_, file_writer_.get());
+  }
 
   switch (next_->Flush()) {
     case FlushResult::kRestartStream:
@@ -7,6 +7,7 @@
 #include <string>
 
 #include "cartographer/io/file_writer.h"
+#include "cartographer/io/grid_tiles.h"
 #include "cartographer/io/points_batch.h"
 #include "cartographer/io/points_processor.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
@@ -19,6 +20,10 @@ namespace io {
 // Creates a hybrid grid of the points with voxels being 'voxel_size'
 // big. 'range_data_inserter' options are used to configure the range
 // data ray tracing through the hybrid grid.
+//
+// If 'tile_size' is configured, one hybrid grid per tile is written to
+// '<filename>_<x>_<y>' instead, as soon as the trajectory moved away from the
+// tile, see 'GridTiles'. This bounds memory use for large maps.
 class HybridGridPointsProcessor : public PointsProcessor {
  public:
   constexpr static const char* kConfigurationFileActionName =
@@ -28,6 +33,14 @@ class HybridGridPointsProcessor : public PointsProcessor {
                                 range_data_inserter_options,
                             std::unique_ptr<FileWriter> file_writer,
                             PointsProcessor* next);
+  // Writes tiles with edge length 'tile_size' to files created by
+  // 'file_writer_factory' named after 'filename'.
+  HybridGridPointsProcessor(double voxel_size,
+                            const mapping_3d::proto::RangeDataInserterOptions&
+                                range_data_inserter_options,
+                            double tile_size, double finished_tile_distance,
+                            const FileWriterFactory& file_writer_factory,
+                            const string& filename, PointsProcessor* next);
   HybridGridPointsProcessor(const HybridGridPointsProcessor&) = delete;
   HybridGridPointsProcessor& operator=(const HybridGridPointsProcessor&) =
       delete;
@@ -47,6 +60,8 @@ class HybridGridPointsProcessor : public PointsProcessor {
   mapping_3d::RangeDataInserter range_data_inserter_;
   mapping_3d::HybridGrid hybrid_grid_;
   std::unique_ptr<FileWriter> file_writer_;
+  // Only used when writing tiles, in which case 'hybrid_grid_' stays empty.
+  std::unique_ptr<GridTiles<mapping_3d::HybridGrid>> grid_tiles_;
 };
 
 }  // namespace io
@@ -1,7 +1,10 @@
 #include "cartographer/io/image.h"
 
+#include <algorithm>
 #include <memory>
+#include <string>
 
+#include "cartographer/common/parallel_for.h"
 #include "cartographer/io/file_writer.h"
 #include "glog/logging.h"
 
@@ -82,5 +85,44 @@ UniqueCairoSurfacePtr Image::GetCairoSurface() {
       height_, stride_));
 }
 
+Image Image::Crop(const int x, const int y, const int width,
+                  const int height) const {
+  CHECK_GE(x, 0);
+  CHECK_GE(y, 0);
+  CHECK_LT(x, width_);
+  CHECK_LT(y, height_);
+  Image cropped(std::min(width, width_ - x), std::min(height, height_ - y));
+  for (int row = 0; row != cropped.height_; ++row) {
+    const auto source_begin = pixels_.begin() + (y + row) * stride_ / 4 + x;
+    std::copy(source_begin, source_begin + cropped.width_,
+              cropped.pixels_.begin() + row * cropped.stride_ / 4);
+  }
+  return cropped;
+}
+
+void WritePngTiles(const Image& image, const int tile_size,
+                   const string& filename,
+                   const FileWriterFactory& file_writer_factory,
+                   const int num_threads) {
+  CHECK_GT(tile_size, 0);
+  const int num_columns = (image.width() + tile_size - 1) / tile_size;
+  const int num_rows = (image.height() + tile_size - 1) / tile_size;
+  common::ParallelFor(
+      num_threads, num_columns * num_rows,
+      [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i != end; ++i) {
+          const int column = i % num_columns;
+          const int row = i / num_columns;
+          Image tile = image.Crop(column * tile_size, row * tile_size,
+                                  tile_size, tile_size);
+          const std::unique_ptr<FileWriter> file_writer =
+              file_writer_factory(filename + "_" + std::to_string(column) +
+                                  "_" + std::to_string(row) + ".png");
+          tile.WritePng(file_writer.get());
+          CHECK(file_writer->Close());
+        }
+      });
+}
+
 }  // namespace io
 }  // namespace cartographer
@@ -2,6 +2,7 @@
 #define CARTOGRAPHER_IO_IMAGE_H_
 
 #include <cstdint>
+#include <string>
 #include <vector>
 
 #include "cairo/cairo.h"
@@ -41,6 +42,13 @@ class Image {
   // to this surface is alive.
   UniqueCairoSurfacePtr GetCairoSurface();
 
+  // Returns the part of this image of at most 'width' x 'height' pixels whose
+  // top left corner is at ('x', 'y').
+  Image Crop(int x, int y, int width, int height) const;
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
  private:
   int width_;
   int height_;
@@ -48,6 +56,14 @@ class Image {
   std::vector<uint32> pixels_;
 };
 
+// Writes 'image' as a set of PNGs of at most 'tile_size' x 'tile_size' pixels
+// named '<filename>_<column>_<row>.png', which downstream tools can stream
+// instead of decoding one very large PNG. The tiles are cropped and encoded on
+// up to 'num_threads' threads in parallel, all hardware threads if 0.
+void WritePngTiles(const Image& image, int tile_size, const string& filename,
+                   const FileWriterFactory& file_writer_factory,
+                   int num_threads);
+
 }  // namespace io
 }  // namespace cartographer
 
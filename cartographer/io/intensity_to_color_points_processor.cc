@@ -41,19 +41,29 @@ IntensityToColorPointsProcessor::IntensityToColorPointsProcessor(
     const string& frame_id, PointsProcessor* const next)
     : min_intensity_(min_intensity),
       max_intensity_(max_intensity),
-      frame_id_(frame_id),
+      filter_by_frame_id_(!frame_id.empty()),
+      frame_id_handle_(InternFrameId(frame_id)),
       next_(next) {}
 
 void IntensityToColorPointsProcessor::Process(
     std::unique_ptr<PointsBatch> batch) {
   if (!batch->intensities.empty() &&
-      (frame_id_.empty() || batch->frame_id == frame_id_)) {
-    batch->colors.clear();
-    for (const float intensity : batch->intensities) {
-      const float gray = cartographer::common::Clamp(
-          (intensity - min_intensity_) / (max_intensity_ - min_intensity_), 0.f,
-          1.f);
-      batch->colors.push_back({{gray, gray, gray}});
+      (!filter_by_frame_id_ ||
+       GetFrameIdHandle(batch.get()) == frame_id_handle_)) {
+    // A plain loop over preallocated colors without bounds checks or
+    // reallocations, which the compiler can vectorize.
+    const size_t num_points = batch->intensities.size();
+    batch->colors.resize(num_points);
+    const float* const intensities = batch->intensities.data();
+    float* const colors = batch->colors.data()->data();
+    const float min_intensity = min_intensity_;
+    const float intensity_range = max_intensity_ - min_intensity_;
+    for (size_t i = 0; i < num_points; ++i) {
+      const float gray = common::Clamp(
+          (intensities[i] - min_intensity) / intensity_range, 0.f, 1.f);
+      colors[3 * i] = gray;
+      colors[3 * i + 1] = gray;
+      colors[3 * i + 2] = gray;
     }
   }
   next_->Process(std::move(batch));
@@ -54,7 +54,9 @@ class IntensityToColorPointsProcessor : public PointsProcessor {
  private:
   const float min_intensity_;
   const float max_intensity_;
-  const string frame_id_;
+  // Whether only points of the sensor with 'frame_id_handle_' are colored.
+  const bool filter_by_frame_id_;
+  const FrameIdHandle frame_id_handle_;
   PointsProcessor* const next_;
 };
 
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/io/mapped_blob_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace io {
+
+namespace {
+
+// First eight bytes to identify our mapped blob file format.
+const uint64 kMagic = 0x3ad6a6e3b10bf11e;
+
+void WriteSizeAsLittleEndian(uint64 size, std::ostream* out) {
+  for (int i = 0; i != 8; ++i) {
+    out->put(size & 0xff);
+    size >>= 8;
+  }
+}
+
+uint64 ReadSizeAsLittleEndian(const char* const data) {
+  uint64 size = 0;
+  for (int i = 0; i != 8; ++i) {
+    size |= static_cast<uint64>(static_cast<unsigned char>(data[i])) << (8 * i);
+  }
+  return size;
+}
+
+size_t GetPaddingSize(const size_t size) {
+  return (MappedBlobFile::kAlignment - size % MappedBlobFile::kAlignment) %
+         MappedBlobFile::kAlignment;
+}
+
+}  // namespace
+
+constexpr int MappedBlobFile::kAlignment;
+
+MappedBlobFileWriter::MappedBlobFileWriter(const string& filename)
+    : out_(filename, std::ios::out | std::ios::binary) {
+  WriteSizeAsLittleEndian(kMagic, &out_);
+}
+
+MappedBlobFileWriter::~MappedBlobFileWriter() {}
+
+void MappedBlobFileWriter::Write(const string& blob) {
+  WriteSizeAsLittleEndian(blob.size(), &out_);
+  out_.write(blob.data(), blob.size());
+  for (size_t i = 0; i != GetPaddingSize(blob.size()); ++i) {
+    out_.put('\0');
+  }
+}
+
+bool MappedBlobFileWriter::Close() {
+  out_.close();
+  return !out_.fail();
+}
+
+MappedBlobFile::MappedBlobFile(const string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  PCHECK(fd != -1) << "Could not open " << filename;
+  struct stat file_stat;
+  PCHECK(fstat(fd, &file_stat) == 0) << filename;
+  size_ = file_stat.st_size;
+  CHECK_GE(size_, sizeof(kMagic)) << filename;
+  void* const data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  PCHECK(data != MAP_FAILED) << "Could not map " << filename;
+  // The mapping stays valid after closing the file descriptor.
+  close(fd);
+  data_ = static_cast<const char*>(data);
+  CHECK_EQ(ReadSizeAsLittleEndian(data_), kMagic)
+      << filename << " is not a mapped blob file.";
+  size_t offset = sizeof(kMagic);
+  while (offset != size_) {
+    CHECK_LE(offset + sizeof(uint64), size_) << filename << " is truncated.";
+    const size_t blob_size = ReadSizeAsLittleEndian(data_ + offset);
+    offset += sizeof(uint64);
+    CHECK_LE(offset + blob_size, size_) << filename << " is truncated.";
+    blobs_.push_back(Blob{data_ + offset, blob_size});
+    offset += blob_size + GetPaddingSize(blob_size);
+    CHECK_LE(offset, size_) << filename << " is truncated.";
+  }
+}
+
+MappedBlobFile::MappedBlobFile(std::vector<string> blobs)
+    : owned_blobs_(std::move(blobs)) {
+  for (const string& blob : owned_blobs_) {
+    CHECK_EQ(reinterpret_cast<uintptr_t>(blob.data()) % kAlignment, 0);
+    blobs_.push_back(Blob{blob.data(), blob.size()});
+  }
+}
+
+MappedBlobFile::~MappedBlobFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+}  // namespace io
+}  // namespace cartographer
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_IO_MAPPED_BLOB_FILE_H_
+#define CARTOGRAPHER_IO_MAPPED_BLOB_FILE_H_
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace io {
+
+// Writes a sequence of uncompressed binary blobs to a file which can be
+// memory-mapped by 'MappedBlobFile'. Each blob starts at an offset which is a
+// multiple of 'MappedBlobFile::kAlignment'. The format is not intended to be
+// compatible with any other format used outside of Cartographer.
+class MappedBlobFileWriter {
+ public:
+  explicit MappedBlobFileWriter(const string& filename);
+  ~MappedBlobFileWriter();
+
+  MappedBlobFileWriter(const MappedBlobFileWriter&) = delete;
+  MappedBlobFileWriter& operator=(const MappedBlobFileWriter&) = delete;
+
+  void Write(const string& blob);
+
+  // This should be called to check whether writing was successful.
+  bool Close();
+
+ private:
+  std::ofstream out_;
+};
+
+// A read-only memory mapping of a file written by 'MappedBlobFileWriter'. The
+// pages are only read when accessed, and are shared with other processes
+// mapping the same file.
+class MappedBlobFile {
+ public:
+  // Alignment in bytes of the start of each blob.
+  static constexpr int kAlignment = 8;
+
+  struct Blob {
+    const char* data;
+    size_t size;
+  };
+
+  // Maps the 'filename', which has to be in the format written by
+  // 'MappedBlobFileWriter'.
+  explicit MappedBlobFile(const string& filename);
+  // Holds the 'blobs' in memory instead, e.g. if they were read from a proto
+  // stream.
+  explicit MappedBlobFile(std::vector<string> blobs);
+  ~MappedBlobFile();
+
+  MappedBlobFile(const MappedBlobFile&) = delete;
+  MappedBlobFile& operator=(const MappedBlobFile&) = delete;
+
+  int num_blobs() const { return blobs_.size(); }
+
+  // Returns the blob at 'index' in the order they were written. The data stays
+  // valid for the lifetime of this object.
+  Blob blob(const int index) const { return blobs_.at(index); }
+
+ private:
+  // The mapped file, or nullptr if the blobs are held in 'owned_blobs_'.
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  std::vector<string> owned_blobs_;
+  std::vector<Blob> blobs_;
+};
+
+// Appends the bytes of the plain 'value' to the 'blob' in native byte order.
+// Blobs are meant to be read back on the machine which wrote them.
+template <typename T>
+void AppendToBlob(const T& value, string* const blob) {
+  blob->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Reads consecutive values appended by 'AppendToBlob()' from a 'blob'.
+class BlobReader {
+ public:
+  explicit BlobReader(const MappedBlobFile::Blob& blob) : blob_(blob) {}
+
+  // Returns a pointer to the next 'size' bytes which stays valid as long as
+  // the blob does.
+  const char* ReadBytes(const size_t size) {
+    CHECK_LE(offset_ + size, blob_.size) << "Blob is truncated.";
+    const char* const bytes = blob_.data + offset_;
+    offset_ += size;
+    return bytes;
+  }
+
+  template <typename T>
+  T Read() {
+    T value;
+    std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  bool Done() const { return offset_ == blob_.size; }
+
+ private:
+  const MappedBlobFile::Blob blob_;
+  size_t offset_ = 0;
+};
+
+}  // namespace io
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_IO_MAPPED_BLOB_FILE_H_
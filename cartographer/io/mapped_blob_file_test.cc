@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/io/mapped_blob_file.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace io {
+namespace {
+
+class MappedBlobFileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const string tmpdir = P_tmpdir;
+    test_directory_ = tmpdir + "/mapped_blob_file_test_XXXXXX";
+    ASSERT_NE(mkdtemp(&test_directory_[0]), nullptr) << strerror(errno);
+  }
+
+  void TearDown() override { remove(test_directory_.c_str()); }
+
+  string test_directory_;
+};
+
+TEST_F(MappedBlobFileTest, WriteAndReadBack) {
+  const string test_file = test_directory_ + "/test.blobs";
+  {
+    MappedBlobFileWriter writer(test_file);
+    for (int i = 0; i != 10; ++i) {
+      writer.Write(string(i, 'a' + i));
+    }
+    ASSERT_TRUE(writer.Close());
+  }
+  {
+    MappedBlobFile mapped_blob_file(test_file);
+    ASSERT_EQ(10, mapped_blob_file.num_blobs());
+    for (int i = 0; i != 10; ++i) {
+      const MappedBlobFile::Blob blob = mapped_blob_file.blob(i);
+      EXPECT_EQ(string(i, 'a' + i), string(blob.data, blob.size));
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(blob.data) %
+                       MappedBlobFile::kAlignment);
+    }
+  }
+  remove(test_file.c_str());
+}
+
+TEST(MappedBlobFileInMemoryTest, HoldsBlobs) {
+  std::vector<string> blobs;
+  for (int i = 0; i != 10; ++i) {
+    blobs.push_back(string(i * 10, 'a' + i));
+  }
+  const MappedBlobFile mapped_blob_file(blobs);
+  ASSERT_EQ(10, mapped_blob_file.num_blobs());
+  for (int i = 0; i != 10; ++i) {
+    const MappedBlobFile::Blob blob = mapped_blob_file.blob(i);
+    EXPECT_EQ(blobs[i], string(blob.data, blob.size));
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(blob.data) %
+                     MappedBlobFile::kAlignment);
+  }
+}
+
+TEST_F(MappedBlobFileTest, ReadsAppendedValues) {
+  string serialized;
+  AppendToBlob(int32{-42}, &serialized);
+  AppendToBlob(uint8{7}, &serialized);
+  AppendToBlob(2.5f, &serialized);
+  BlobReader reader(MappedBlobFile::Blob{serialized.data(), serialized.size()});
+  EXPECT_EQ(-42, reader.Read<int32>());
+  EXPECT_EQ(7, reader.Read<uint8>());
+  EXPECT_FALSE(reader.Done());
+  EXPECT_EQ(2.5f, reader.Read<float>());
+  EXPECT_TRUE(reader.Done());
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace cartographer
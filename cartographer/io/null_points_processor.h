@@ -25,11 +25,22 @@ namespace io {
 // A points processor that just drops all points. The end of a pipeline usually.
 class NullPointsProcessor : public PointsProcessor {
  public:
-  NullPointsProcessor() {}
+  NullPointsProcessor()
+      : NullPointsProcessor(nullptr /* points_batch_pool */) {}
+  // Returns the dropped batches to 'points_batch_pool' unless it is nullptr.
+  explicit NullPointsProcessor(PointsBatchPool* const points_batch_pool)
+      : points_batch_pool_(points_batch_pool) {}
   ~NullPointsProcessor() override {}
 
-  void Process(std::unique_ptr<PointsBatch> points_batch) override {}
+  void Process(std::unique_ptr<PointsBatch> points_batch) override {
+    if (points_batch_pool_ != nullptr) {
+      points_batch_pool_->Release(std::move(points_batch));
+    }
+  }
   FlushResult Flush() override { return FlushResult::kFinished; }
+
+ private:
+  PointsBatchPool* const points_batch_pool_;
 };
 
 }  // namespace io
@@ -16,8 +16,11 @@
 
 #include "cartographer/io/outlier_removing_points_processor.h"
 
+#include <cmath>
+
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/math.h"
 #include "glog/logging.h"
 
 namespace cartographer {
@@ -28,65 +31,116 @@ OutlierRemovingPointsProcessor::FromDictionary(
     common::LuaParameterDictionary* const dictionary,
     PointsProcessor* const next) {
   return common::make_unique<OutlierRemovingPointsProcessor>(
-      dictionary->GetDouble("voxel_size"), next);
+      dictionary->GetDouble("voxel_size"),
+      dictionary->HasKey("tile_size") ? dictionary->GetDouble("tile_size")
+                                      : 0.,
+      next);
 }
 
 OutlierRemovingPointsProcessor::OutlierRemovingPointsProcessor(
     const double voxel_size, PointsProcessor* next)
+    : OutlierRemovingPointsProcessor(voxel_size, 0. /* tile_size */, next) {}
+
+OutlierRemovingPointsProcessor::OutlierRemovingPointsProcessor(
+    const double voxel_size, const double tile_size, PointsProcessor* next)
     : voxel_size_(voxel_size),
+      tile_size_(tile_size),
       next_(next),
-      state_(State::kPhase1),
-      voxels_(voxel_size_) {
+      finding_tiles_(tile_size_ > 0.) {
+  CHECK_GE(tile_size_, 0.);
+  if (finding_tiles_) {
+    LOG(INFO) << "Finding tiles...";
+    return;
+  }
+  // Without tiles, all points are in the same tile.
+  tiles_.push_back(Tile(0, 0));
+  phase_one_tile_voxels_ = CreateTileVoxelsForPhaseOne();
   LOG(INFO) << "Marking hits...";
 }
 
 void OutlierRemovingPointsProcessor::Process(
     std::unique_ptr<PointsBatch> batch) {
-  switch (state_) {
-    case State::kPhase1:
-      ProcessInPhaseOne(*batch);
-      break;
-
-    case State::kPhase2:
-      ProcessInPhaseTwo(*batch);
-      break;
-
-    case State::kPhase3:
-      ProcessInPhaseThree(std::move(batch));
-      break;
+  if (finding_tiles_) {
+    FindTiles(*batch);
+    return;
+  }
+  if (phase_one_tile_voxels_ != nullptr) {
+    ProcessInPhaseOne(*batch, phase_one_tile_voxels_.get());
+  }
+  if (phase_two_tile_voxels_ != nullptr) {
+    ProcessInPhaseTwo(*batch, phase_two_tile_voxels_.get());
+  }
+  if (phase_three_tile_voxels_ != nullptr) {
+    ProcessInPhaseThree(std::move(batch), *phase_three_tile_voxels_);
   }
 }
 
 PointsProcessor::FlushResult OutlierRemovingPointsProcessor::Flush() {
-  switch (state_) {
-    case State::kPhase1:
-      LOG(INFO) << "Counting rays...";
-      state_ = State::kPhase2;
-      return FlushResult::kRestartStream;
-
-    case State::kPhase2:
-      LOG(INFO) << "Filtering outliers...";
-      state_ = State::kPhase3;
-      return FlushResult::kRestartStream;
-
-    case State::kPhase3:
-      CHECK(next_->Flush() == FlushResult::kFinished)
-          << "Voxel filtering and outlier removal must be configured to occur "
-             "after any stages that require multiple passes.";
-      return FlushResult::kFinished;
+  if (finding_tiles_) {
+    finding_tiles_ = false;
+    tiles_.assign(tiles_found_.begin(), tiles_found_.end());
+    tiles_found_.clear();
+    LOG(INFO) << "Filtering " << tiles_.size() << " tiles...";
+    phase_one_tile_voxels_ = CreateTileVoxelsForPhaseOne();
+    return FlushResult::kRestartStream;
+  }
+  ++pass_;
+  if (pass_ == static_cast<int>(tiles_.size()) + 2 || tiles_.empty()) {
+    CHECK(next_->Flush() == FlushResult::kFinished)
+        << "Voxel filtering and outlier removal must be configured to occur "
+           "after any stages that require multiple passes.";
+    return FlushResult::kFinished;
+  }
+  if (tiles_.size() == 1) {
+    LOG(INFO) << (pass_ == 1 ? "Counting rays..." : "Filtering outliers...");
+  } else {
+    LOG(INFO) << "Outlier removal pass " << pass_ + 1 << " of "
+              << tiles_.size() + 2 << "...";
+  }
+  phase_three_tile_voxels_ = std::move(phase_two_tile_voxels_);
+  phase_two_tile_voxels_ = std::move(phase_one_tile_voxels_);
+  phase_one_tile_voxels_ = CreateTileVoxelsForPhaseOne();
+  return FlushResult::kRestartStream;
+}
+
+OutlierRemovingPointsProcessor::Tile OutlierRemovingPointsProcessor::GetTile(
+    const Eigen::Vector3f& point) const {
+  if (tile_size_ == 0.) {
+    return Tile(0, 0);
   }
-  LOG(FATAL);
+  return Tile(common::RoundToInt(std::floor(point.x() / tile_size_)),
+              common::RoundToInt(std::floor(point.y() / tile_size_)));
+}
+
+void OutlierRemovingPointsProcessor::FindTiles(const PointsBatch& batch) {
+  for (const Eigen::Vector3f& point : batch.points) {
+    tiles_found_.insert(GetTile(point));
+  }
+}
+
+std::unique_ptr<OutlierRemovingPointsProcessor::TileVoxels>
+OutlierRemovingPointsProcessor::CreateTileVoxelsForPhaseOne() const {
+  if (pass_ >= static_cast<int>(tiles_.size())) {
+    return nullptr;
+  }
+  return common::make_unique<TileVoxels>(TileVoxels{
+      tiles_[pass_], mapping_3d::HybridGridBase<VoxelData>(voxel_size_)});
 }
 
 void OutlierRemovingPointsProcessor::ProcessInPhaseOne(
-    const PointsBatch& batch) {
+    const PointsBatch& batch, TileVoxels* const tile_voxels) {
+  auto& voxels = tile_voxels->voxels;
   for (size_t i = 0; i < batch.points.size(); ++i) {
-    ++voxels_.mutable_value(voxels_.GetCellIndex(batch.points[i]))->hits;
+    if (GetTile(batch.points[i]) != tile_voxels->tile) {
+      continue;
+    }
+    ++voxels.mutable_value(voxels.GetCellIndex(batch.points[i]))->hits;
   }
 }
 
 void OutlierRemovingPointsProcessor::ProcessInPhaseTwo(
-    const PointsBatch& batch) {
+    const PointsBatch& batch, TileVoxels* const tile_voxels) {
+  auto& voxels = tile_voxels->voxels;
   // TODO(whess): This samples every 'voxel_size' distance and could be improved
   // by better ray casting, and also by marking the hits of the current range
   // data to be excluded.
@@ -94,26 +148,40 @@ void OutlierRemovingPointsProcessor::ProcessInPhaseTwo(
     const Eigen::Vector3f delta = batch.points[i] - batch.origin;
     const float length = delta.norm();
     for (float x = 0; x < length; x += voxel_size_) {
-      const auto index =
-          voxels_.GetCellIndex(batch.origin + (x / length) * delta);
-      if (voxels_.value(index).hits > 0) {
-        ++voxels_.mutable_value(index)->rays;
+      const Eigen::Vector3f sample = batch.origin + (x / length) * delta;
+      if (GetTile(sample) != tile_voxels->tile) {
+        continue;
+      }
+      const auto index = voxels.GetCellIndex(sample);
+      if (voxels.value(index).hits > 0) {
+        ++voxels.mutable_value(index)->rays;
       }
     }
   }
 }
 
 void OutlierRemovingPointsProcessor::ProcessInPhaseThree(
-    std::unique_ptr<PointsBatch> batch) {
+    std::unique_ptr<PointsBatch> batch, const TileVoxels& tile_voxels) {
   constexpr double kMissPerHitLimit = 3;
   std::vector<int> to_remove;
   for (size_t i = 0; i < batch->points.size(); ++i) {
-    const auto voxel = voxels_.value(voxels_.GetCellIndex(batch->points[i]));
+    // Points of other tiles are passed on when their tile is in phase three.
+    if (GetTile(batch->points[i]) != tile_voxels.tile) {
+      to_remove.push_back(i);
+      continue;
+    }
+    const auto voxel =
+        tile_voxels.voxels.value(tile_voxels.voxels.GetCellIndex(
+            batch->points[i]));
     if (!(voxel.rays < kMissPerHitLimit * voxel.hits)) {
       to_remove.push_back(i);
     }
   }
   RemovePoints(to_remove, batch.get());
+  if (tiles_.size() > 1 && batch->points.empty()) {
+    // Avoids passing on each batch once per tile.
+    return;
+  }
   next_->Process(std::move(batch));
 }
 
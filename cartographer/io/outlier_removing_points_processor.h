@@ -17,6 +17,11 @@
 #ifndef CARTOGRAPHER_IO_OUTLIER_REMOVING_POINTS_PROCESSOR_H_
 #define CARTOGRAPHER_IO_OUTLIER_REMOVING_POINTS_PROCESSOR_H_
 
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/io/points_processor.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
@@ -26,12 +31,20 @@ namespace io {
 
 // Voxel filters the data and only passes on points that we believe are on
 // non-moving objects.
+//
+// If 'tile_size' is positive, space is split into square tiles of that size in
+// the xy-plane which are filtered one after another, so that only the voxels
+// of at most three tiles are kept in memory. This needs one pass over the data
+// to find the tiles and two more than there are tiles to filter them, instead
+// of three passes for all of space at once.
 class OutlierRemovingPointsProcessor : public PointsProcessor {
  public:
   constexpr static const char* kConfigurationFileActionName =
       "voxel_filter_and_remove_moving_objects";
 
   OutlierRemovingPointsProcessor(double voxel_size, PointsProcessor* next);
+  OutlierRemovingPointsProcessor(double voxel_size, double tile_size,
+                                 PointsProcessor* next);
 
   static std::unique_ptr<OutlierRemovingPointsProcessor> FromDictionary(
       common::LuaParameterDictionary* dictionary, PointsProcessor* next);
@@ -52,33 +65,53 @@ class OutlierRemovingPointsProcessor : public PointsProcessor {
   // all voxels containing any hits, then we compute the rays passing through
   // each of these voxels, and finally we output all hits in voxels that are
   // considered obstructed.
+  //
+  // Tiles go through these phases one after another, staggered by one pass:
+  // in each pass, one tile is in each phase.
   struct VoxelData {
     int hits = 0;
     int rays = 0;
   };
-  enum class State {
-    kPhase1,
-    kPhase2,
-    kPhase3,
+  using Tile = std::pair<int, int>;
+  struct TileVoxels {
+    Tile tile;
+    mapping_3d::HybridGridBase<VoxelData> voxels;
   };
 
+  Tile GetTile(const Eigen::Vector3f& point) const;
+
+  // Finds all tiles containing hits. Only used if 'tile_size_' is positive.
+  void FindTiles(const PointsBatch& batch);
+
   // First phase counts the number of hits per voxel.
-  void ProcessInPhaseOne(const PointsBatch& batch);
+  void ProcessInPhaseOne(const PointsBatch& batch, TileVoxels* tile_voxels);
 
   // Second phase counts how many rays pass through each voxel. This is only
   // done for voxels that contain hits. This is to reduce memory consumption by
   // not adding data to free voxels.
-  void ProcessInPhaseTwo(const PointsBatch& batch);
+  void ProcessInPhaseTwo(const PointsBatch& batch, TileVoxels* tile_voxels);
 
   // Third phase produces the output containing all inliers. We consider each
   // hit an inlier if it is inside a voxel that has a sufficiently high
   // hit-to-ray ratio.
-  void ProcessInPhaseThree(std::unique_ptr<PointsBatch> batch);
+  void ProcessInPhaseThree(std::unique_ptr<PointsBatch> batch,
+                           const TileVoxels& tile_voxels);
+
+  // Creates the voxels of the tile entering phase one in the current pass, if
+  // any.
+  std::unique_ptr<TileVoxels> CreateTileVoxelsForPhaseOne() const;
 
   const double voxel_size_;
+  const double tile_size_;
   PointsProcessor* const next_;
-  State state_;
-  mapping_3d::HybridGridBase<VoxelData> voxels_;
+  bool finding_tiles_;
+  std::set<Tile> tiles_found_;
+  std::vector<Tile> tiles_;
+  // Number of passes done after the tiles were found.
+  int pass_ = 0;
+  std::unique_ptr<TileVoxels> phase_one_tile_voxels_;
+  std::unique_ptr<TileVoxels> phase_two_tile_voxels_;
+  std::unique_ptr<TileVoxels> phase_three_tile_voxels_;
 };
 
 }  // namespace io
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/io/parallel_points_processor.h"
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace io {
+
+namespace {
+
+// Sequence number of the batch being processed on this thread. Runs may be
+// nested, so each ProcessInSequence() restores the previous value.
+thread_local int64 current_sequence_number = -1;
+
+}  // namespace
+
+ReorderingPointsProcessor::ReorderingPointsProcessor(
+    PointsProcessor* const next)
+    : next_(next) {}
+
+void ReorderingPointsProcessor::ProcessInSequence(
+    const int64 sequence_number, const std::function<void()>& process) {
+  const int64 outer_sequence_number = current_sequence_number;
+  current_sequence_number = sequence_number;
+  process();
+  current_sequence_number = outer_sequence_number;
+
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK_GE(sequence_number, next_sequence_number_);
+    CHECK(is_complete_.emplace(sequence_number, true).second);
+    if (is_passing_on_) {
+      // The thread passing on batches will pick these up.
+      return;
+    }
+    is_passing_on_ = true;
+  }
+  for (;;) {
+    std::vector<std::unique_ptr<PointsBatch>> batches;
+    {
+      common::MutexLocker locker(&mutex_);
+      if (is_complete_.count(next_sequence_number_) == 0) {
+        is_passing_on_ = false;
+        return;
+      }
+      is_complete_.erase(next_sequence_number_);
+      const auto it = pending_batches_.find(next_sequence_number_);
+      if (it != pending_batches_.end()) {
+        batches = std::move(it->second);
+        pending_batches_.erase(it);
+      }
+      ++next_sequence_number_;
+    }
+    for (auto& batch : batches) {
+      next_->Process(std::move(batch));
+    }
+  }
+}
+
+void ReorderingPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
+  CHECK_GE(current_sequence_number, 0)
+      << "Batch did not come from a ParallelPointsProcessor.";
+  common::MutexLocker locker(&mutex_);
+  pending_batches_[current_sequence_number].push_back(std::move(batch));
+}
+
+PointsProcessor::FlushResult ReorderingPointsProcessor::Flush() {
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK(pending_batches_.empty());
+    CHECK(!is_passing_on_);
+  }
+  return next_->Flush();
+}
+
+ParallelPointsProcessor::ParallelPointsProcessor(
+    const int max_batches_in_flight,
+    common::ThreadPoolInterface* const thread_pool,
+    ReorderingPointsProcessor* const reordering, PointsProcessor* const next)
+    : max_batches_in_flight_(max_batches_in_flight),
+      thread_pool_(thread_pool),
+      reordering_(reordering),
+      next_(next) {
+  CHECK_GE(max_batches_in_flight_, 1);
+}
+
+ParallelPointsProcessor::~ParallelPointsProcessor() { WaitUntilIdle(); }
+
+void ParallelPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
+  const int64 sequence_number = next_sequence_number_++;
+  bool schedule;
+  {
+    common::MutexLocker locker(&mutex_);
+    schedule = num_batches_in_flight_ < max_batches_in_flight_;
+    if (schedule) {
+      ++num_batches_in_flight_;
+    }
+  }
+  if (!schedule) {
+    reordering_->ProcessInSequence(sequence_number, [this, &batch]() {
+      next_->Process(std::move(batch));
+    });
+    return;
+  }
+  // 'std::function' must be copyable, so the batch is passed as a raw pointer.
+  PointsBatch* const batch_ptr = batch.release();
+  thread_pool_->Schedule(
+      [this, sequence_number, batch_ptr]() {
+        reordering_->ProcessInSequence(sequence_number, [this, batch_ptr]() {
+          next_->Process(std::unique_ptr<PointsBatch>(batch_ptr));
+        });
+        common::MutexLocker locker(&mutex_);
+        --num_batches_in_flight_;
+      },
+      common::WorkItemPriority::kNormal, "parallel_points_processor");
+}
+
+PointsProcessor::FlushResult ParallelPointsProcessor::Flush() {
+  WaitUntilIdle();
+  return next_->Flush();
+}
+
+void ParallelPointsProcessor::WaitUntilIdle() {
+  common::MutexLocker locker(&mutex_);
+  locker.Await([this]() REQUIRES(mutex_) {
+    return num_batches_in_flight_ == 0;
+  });
+}
+
+}  // namespace io
+}  // namespace cartographer
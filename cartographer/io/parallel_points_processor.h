@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_IO_PARALLEL_POINTS_PROCESSOR_H_
+#define CARTOGRAPHER_IO_PARALLEL_POINTS_PROCESSOR_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/io/points_processor.h"
+
+namespace cartographer {
+namespace io {
+
+// Ends a run of stateless PointsProcessors started by a
+// ParallelPointsProcessor. Batches arrive from several threads and out of
+// order, and are passed on to 'next' one at a time in the order in which they
+// entered the ParallelPointsProcessor.
+class ReorderingPointsProcessor : public PointsProcessor {
+ public:
+  explicit ReorderingPointsProcessor(PointsProcessor* next);
+  ~ReorderingPointsProcessor() override {}
+
+  ReorderingPointsProcessor(const ReorderingPointsProcessor&) = delete;
+  ReorderingPointsProcessor& operator=(const ReorderingPointsProcessor&) =
+      delete;
+
+  // Calls 'process', attributing all batches it passes to Process() on this
+  // thread to 'sequence_number'. Afterwards, passes on all batches whose
+  // predecessors are complete. Sequence numbers start at 0 and each must be
+  // used exactly once.
+  void ProcessInSequence(int64 sequence_number,
+                         const std::function<void()>& process);
+
+  void Process(std::unique_ptr<PointsBatch> batch) override;
+  FlushResult Flush() override;
+
+ private:
+  common::Mutex mutex_;
+  // Batches by sequence number which are waiting for their predecessors.
+  std::map<int64, std::vector<std::unique_ptr<PointsBatch>>> pending_batches_
+      GUARDED_BY(mutex_);
+  std::map<int64, bool> is_complete_ GUARDED_BY(mutex_);
+  int64 next_sequence_number_ GUARDED_BY(mutex_) = 0;
+  // True while a thread is passing batches on to 'next_'.
+  bool is_passing_on_ GUARDED_BY(mutex_) = false;
+  PointsProcessor* const next_;
+};
+
+// Starts a run of stateless PointsProcessors, i.e. processors which keep no
+// state between batches and pass them on from whichever thread called their
+// Process(). Each batch is handed to 'next', the first processor of the run, on
+// a 'thread_pool', so that several batches are processed concurrently. The run
+// has to end in 'reordering', which restores the order of the batches.
+//
+// At most 'max_batches_in_flight' batches are scheduled at a time. Beyond
+// that, batches are processed on the thread calling Process(), which keeps
+// memory bounded and never waits for the 'thread_pool'.
+class ParallelPointsProcessor : public PointsProcessor {
+ public:
+  ParallelPointsProcessor(int max_batches_in_flight,
+                          common::ThreadPoolInterface* thread_pool,
+                          ReorderingPointsProcessor* reordering,
+                          PointsProcessor* next);
+  ~ParallelPointsProcessor() override;
+
+  ParallelPointsProcessor(const ParallelPointsProcessor&) = delete;
+  ParallelPointsProcessor& operator=(const ParallelPointsProcessor&) = delete;
+
+  // Must not be called concurrently with itself or Flush().
+  void Process(std::unique_ptr<PointsBatch> batch) override;
+  // Waits for all scheduled batches, then flushes the run.
+  FlushResult Flush() override;
+
+ private:
+  void WaitUntilIdle();
+
+  const int max_batches_in_flight_;
+  common::ThreadPoolInterface* const thread_pool_;
+  ReorderingPointsProcessor* const reordering_;
+  PointsProcessor* const next_;
+  int64 next_sequence_number_ = 0;
+
+  common::Mutex mutex_;
+  int num_batches_in_flight_ GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace io
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_IO_PARALLEL_POINTS_PROCESSOR_H_
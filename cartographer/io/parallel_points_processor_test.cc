@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/io/parallel_points_processor.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/io/min_max_range_filtering_points_processor.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace io {
+namespace {
+
+// Records the trajectory IDs of the batches it receives.
+class RecordingPointsProcessor : public PointsProcessor {
+ public:
+  void Process(std::unique_ptr<PointsBatch> batch) override {
+    trajectory_ids.push_back(batch->trajectory_id);
+  }
+  FlushResult Flush() override { return FlushResult::kFinished; }
+
+  std::vector<int> trajectory_ids;
+};
+
+// Drops every third batch and passes on the others after a delay that varies,
+// so that batches finish out of order.
+class SlowDroppingPointsProcessor : public PointsProcessor {
+ public:
+  explicit SlowDroppingPointsProcessor(PointsProcessor* next) : next_(next) {}
+
+  void Process(std::unique_ptr<PointsBatch> batch) override {
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(100 * (7 - batch->trajectory_id % 7)));
+    if (batch->trajectory_id % 3 != 0) {
+      next_->Process(std::move(batch));
+    }
+  }
+  FlushResult Flush() override { return next_->Flush(); }
+
+ private:
+  PointsProcessor* const next_;
+};
+
+TEST(ParallelPointsProcessorTest, KeepsOrder) {
+  constexpr int kNumBatches = 200;
+  common::ThreadPool thread_pool(4);
+  RecordingPointsProcessor recording;
+  ReorderingPointsProcessor reordering(&recording);
+  MinMaxRangeFiteringPointsProcessor range_filter(0., 10., &reordering);
+  SlowDroppingPointsProcessor dropping(&range_filter);
+  ParallelPointsProcessor parallel(8 /* max_batches_in_flight */,
+                                   &thread_pool, &reordering, &dropping);
+  std::vector<int> expected_trajectory_ids;
+  for (int i = 0; i != kNumBatches; ++i) {
+    auto batch = common::make_unique<PointsBatch>();
+    batch->trajectory_id = i;
+    batch->points = {Eigen::Vector3f(1.f, 2.f, 3.f),
+                     Eigen::Vector3f(20.f, 0.f, 0.f)};
+    parallel.Process(std::move(batch));
+    if (i % 3 != 0) {
+      expected_trajectory_ids.push_back(i);
+    }
+  }
+  EXPECT_EQ(PointsProcessor::FlushResult::kFinished, parallel.Flush());
+  EXPECT_EQ(expected_trajectory_ids, recording.trajectory_ids);
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace cartographer
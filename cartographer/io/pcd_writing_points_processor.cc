@@ -56,23 +56,21 @@ void WriteBinaryPcdHeader(const bool has_color, const int64 num_points,
   file_writer->WriteHeader(out.data(), out.size());
 }
 
-void WriteBinaryPcdPointCoordinate(const Eigen::Vector3f& point,
-                                   FileWriter* const file_writer) {
-  char buffer[12];
-  memcpy(buffer, &point[0], sizeof(float));
-  memcpy(buffer + 4, &point[1], sizeof(float));
-  memcpy(buffer + 8, &point[2], sizeof(float));
-  CHECK(file_writer->Write(buffer, 12));
+// Points are encoded into a buffer which is written to the file in large
+// chunks once it holds at least this many bytes.
+constexpr size_t kWriteBufferSizeInBytes = 1 << 20;
+
+void AppendBinaryPcdPointCoordinate(const Eigen::Vector3f& point,
+                                    string* const buffer) {
+  buffer->append(reinterpret_cast<const char*>(point.data()),
+                 3 * sizeof(float));
 }
 
-void WriteBinaryPcdPointColor(const Uint8Color& color,
-                              FileWriter* const file_writer) {
-  char buffer[4];
-  buffer[0] = color[2];
-  buffer[1] = color[1];
-  buffer[2] = color[0];
-  buffer[3] = 0;
-  CHECK(file_writer->Write(buffer, 4));
+void AppendBinaryPcdPointColor(const Uint8Color& color, string* const buffer) {
+  const char bgr0[4] = {static_cast<char>(color[2]),
+                        static_cast<char>(color[1]),
+                        static_cast<char>(color[0]), 0};
+  buffer->append(bgr0, sizeof(bgr0));
 }
 
 }  // namespace
@@ -94,6 +92,7 @@ PcdWritingPointsProcessor::PcdWritingPointsProcessor(
       file_writer_(std::move(file_writer)) {}
 
 PointsProcessor::FlushResult PcdWritingPointsProcessor::Flush() {
+  WriteBuffer();
   WriteBinaryPcdHeader(has_colors_, num_points_, file_writer_.get());
   CHECK(file_writer_->Close());
 
@@ -118,16 +117,29 @@ void PcdWritingPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
     has_colors_ = !batch->colors.empty();
     WriteBinaryPcdHeader(has_colors_, 0, file_writer_.get());
   }
+  const size_t point_size_in_bytes =
+      3 * sizeof(float) + (batch->colors.empty() ? 0 : 4);
+  buffer_.reserve(buffer_.size() + batch->points.size() * point_size_in_bytes);
   for (size_t i = 0; i < batch->points.size(); ++i) {
-    WriteBinaryPcdPointCoordinate(batch->points[i], file_writer_.get());
+    AppendBinaryPcdPointCoordinate(batch->points[i], &buffer_);
     if (!batch->colors.empty()) {
-      WriteBinaryPcdPointColor(ToUint8Color(batch->colors[i]),
-                               file_writer_.get());
+      AppendBinaryPcdPointColor(ToUint8Color(batch->colors[i]), &buffer_);
     }
-    ++num_points_;
+  }
+  num_points_ += batch->points.size();
+  if (buffer_.size() >= kWriteBufferSizeInBytes) {
+    WriteBuffer();
   }
   next_->Process(std::move(batch));
 }
 
+void PcdWritingPointsProcessor::WriteBuffer() {
+  if (buffer_.empty()) {
+    return;
+  }
+  CHECK(file_writer_->Write(buffer_.data(), buffer_.size()));
+  buffer_.clear();
+}
+
 }  // namespace io
 }  // namespace cartographer
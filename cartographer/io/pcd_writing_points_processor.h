@@ -23,7 +23,8 @@
 namespace cartographer {
 namespace io {
 
-// Streams a PCD file to disk. The header is written in 'Flush'.
+// Streams a PCD file to disk. Points are buffered and written in large chunks.
+// The header is written in 'Flush'.
 class PcdWritingPointsProcessor : public PointsProcessor {
  public:
   constexpr static const char* kConfigurationFileActionName = "write_pcd";
@@ -44,11 +45,15 @@ class PcdWritingPointsProcessor : public PointsProcessor {
   FlushResult Flush() override;
 
  private:
+  // Writes the encoded points in 'buffer_' to the file and clears it.
+  void WriteBuffer();
+
   PointsProcessor* const next_;
 
   int64 num_points_;
   bool has_colors_;
   std::unique_ptr<FileWriter> file_writer_;
+  string buffer_;
 };
 
 }  // namespace io
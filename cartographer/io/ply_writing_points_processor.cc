@@ -52,19 +52,18 @@ void WriteBinaryPlyHeader(const bool has_color, const int64 num_points,
   CHECK(file_writer->WriteHeader(out.data(), out.size()));
 }
 
-void WriteBinaryPlyPointCoordinate(const Eigen::Vector3f& point,
-                                   FileWriter* const file_writer) {
-  char buffer[12];
-  memcpy(buffer, &point[0], sizeof(float));
-  memcpy(buffer + 4, &point[1], sizeof(float));
-  memcpy(buffer + 8, &point[2], sizeof(float));
-  CHECK(file_writer->Write(buffer, 12));
+// Points are encoded into a buffer which is written to the file in large
+// chunks once it holds at least this many bytes.
+constexpr size_t kWriteBufferSizeInBytes = 1 << 20;
+
+void AppendBinaryPlyPointCoordinate(const Eigen::Vector3f& point,
+                                    string* const buffer) {
+  buffer->append(reinterpret_cast<const char*>(point.data()),
+                 3 * sizeof(float));
 }
 
-void WriteBinaryPlyPointColor(const Uint8Color& color,
-                              FileWriter* const file_writer) {
-  CHECK(file_writer->Write(reinterpret_cast<const char*>(color.data()),
-                           color.size()));
+void AppendBinaryPlyPointColor(const Uint8Color& color, string* const buffer) {
+  buffer->append(reinterpret_cast<const char*>(color.data()), color.size());
 }
 
 }  // namespace
@@ -86,6 +85,7 @@ PlyWritingPointsProcessor::PlyWritingPointsProcessor(
       file_(std::move(file_writer)) {}
 
 PointsProcessor::FlushResult PlyWritingPointsProcessor::Flush() {
+  WriteBuffer();
   WriteBinaryPlyHeader(has_colors_, num_points_, file_.get());
   CHECK(file_->Close()) << "Closing PLY file_writer failed.";
 
@@ -117,15 +117,29 @@ void PlyWritingPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
         << batch->frame_id;
   }
 
+  const size_t point_size_in_bytes =
+      3 * sizeof(float) + (has_colors_ ? sizeof(Uint8Color) : 0);
+  buffer_.reserve(buffer_.size() + batch->points.size() * point_size_in_bytes);
   for (size_t i = 0; i < batch->points.size(); ++i) {
-    WriteBinaryPlyPointCoordinate(batch->points[i], file_.get());
+    AppendBinaryPlyPointCoordinate(batch->points[i], &buffer_);
     if (has_colors_) {
-      WriteBinaryPlyPointColor(ToUint8Color(batch->colors[i]), file_.get());
+      AppendBinaryPlyPointColor(ToUint8Color(batch->colors[i]), &buffer_);
     }
-    ++num_points_;
+  }
+  num_points_ += batch->points.size();
+  if (buffer_.size() >= kWriteBufferSizeInBytes) {
+    WriteBuffer();
   }
   next_->Process(std::move(batch));
 }
 
+void PlyWritingPointsProcessor::WriteBuffer() {
+  if (buffer_.empty()) {
+    return;
+  }
+  CHECK(file_->Write(buffer_.data(), buffer_.size()));
+  buffer_.clear();
+}
+
 }  // namespace io
 }  // namespace cartographer
@@ -21,7 +21,8 @@
 namespace cartographer {
 namespace io {
 
-// Streams a PLY file to disk. The header is written in 'Flush'.
+// Streams a PLY file to disk. Points are buffered and written in large chunks.
+// The header is written in 'Flush'.
 class PlyWritingPointsProcessor : public PointsProcessor {
  public:
   constexpr static const char* kConfigurationFileActionName = "write_ply";
@@ -42,11 +43,15 @@ class PlyWritingPointsProcessor : public PointsProcessor {
   FlushResult Flush() override;
 
  private:
+  // Writes the encoded points in 'buffer_' to the file and clears it.
+  void WriteBuffer();
+
   PointsProcessor* const next_;
 
   int64 num_points_;
   bool has_colors_;
   std::unique_ptr<FileWriter> file_;
+  string buffer_;
 };
 
 }  // namespace io
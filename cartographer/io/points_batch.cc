@@ -16,20 +16,102 @@
 
 #include "cartographer/io/points_batch.h"
 
+#include <algorithm>
+#include <unordered_map>
+
+#include "cartographer/common/make_unique.h"
+#include "glog/logging.h"
+
 namespace cartographer {
 namespace io {
 
-void RemovePoints(std::vector<int> to_remove, PointsBatch* batch) {
-  std::sort(to_remove.begin(), to_remove.end(), std::greater<int>());
-  for (const int index : to_remove) {
-    batch->points.erase(batch->points.begin() + index);
-    if (!batch->colors.empty()) {
-      batch->colors.erase(batch->colors.begin() + index);
+namespace {
+
+// Removes the ascending indices in 'to_remove' from 'values' by moving each
+// kept value once.
+template <typename T>
+void RemoveSortedIndices(const std::vector<int>& to_remove,
+                         std::vector<T>* const values) {
+  if (values->empty() || to_remove.empty()) {
+    return;
+  }
+  size_t num_kept = to_remove.front();
+  auto to_remove_it = to_remove.begin();
+  for (size_t index = to_remove.front(); index != values->size(); ++index) {
+    if (to_remove_it != to_remove.end() &&
+        static_cast<size_t>(*to_remove_it) == index) {
+      // Duplicate indices are removed only once.
+      while (to_remove_it != to_remove.end() &&
+             static_cast<size_t>(*to_remove_it) == index) {
+        ++to_remove_it;
+      }
+      continue;
     }
-    if (!batch->intensities.empty()) {
-      batch->intensities.erase(batch->intensities.begin() + index);
+    (*values)[num_kept] = std::move((*values)[index]);
+    ++num_kept;
+  }
+  values->resize(num_kept);
+}
+
+}  // namespace
+
+FrameIdHandle InternFrameId(const string& frame_id) {
+  // Never destroyed, so that batches can be processed during static
+  // destruction.
+  static auto* const mutex = new common::Mutex;
+  static auto* const handles = new std::unordered_map<string, FrameIdHandle>;
+  common::MutexLocker locker(mutex);
+  return handles->emplace(frame_id, handles->size()).first->second;
+}
+
+void RemovePoints(std::vector<int> to_remove, PointsBatch* batch) {
+  // Filters collect the indices in ascending order already.
+  if (!std::is_sorted(to_remove.begin(), to_remove.end())) {
+    std::sort(to_remove.begin(), to_remove.end());
+  }
+  RemoveSortedIndices(to_remove, &batch->points);
+  RemoveSortedIndices(to_remove, &batch->colors);
+  RemoveSortedIndices(to_remove, &batch->intensities);
+}
+
+FrameIdHandle GetFrameIdHandle(PointsBatch* const batch) {
+  if (batch->frame_id_handle == kUnknownFrameIdHandle) {
+    batch->frame_id_handle = InternFrameId(batch->frame_id);
+  }
+  return batch->frame_id_handle;
+}
+
+PointsBatchPool::PointsBatchPool(const int max_free_batches)
+    : max_free_batches_(max_free_batches) {
+  CHECK_GE(max_free_batches_, 0);
+}
+
+std::unique_ptr<PointsBatch> PointsBatchPool::Acquire() {
+  {
+    common::MutexLocker locker(&mutex_);
+    if (!free_batches_.empty()) {
+      std::unique_ptr<PointsBatch> batch = std::move(free_batches_.back());
+      free_batches_.pop_back();
+      return batch;
     }
   }
+  return common::make_unique<PointsBatch>();
+}
+
+void PointsBatchPool::Release(std::unique_ptr<PointsBatch> batch) {
+  // Resets the batch outside of the lock. 'clear()' keeps the capacity.
+  batch->start_time = common::Time();
+  batch->origin = Eigen::Vector3f::Zero();
+  batch->frame_id.clear();
+  batch->frame_id_handle = kUnknownFrameIdHandle;
+  batch->trajectory_id = 0;
+  batch->points.clear();
+  batch->intensities.clear();
+  batch->colors.clear();
+  common::MutexLocker locker(&mutex_);
+  if (static_cast<int>(free_batches_.size()) < max_free_batches_) {
+    free_batches_.push_back(std::move(batch));
+  }
 }
 
 }  // namespace io
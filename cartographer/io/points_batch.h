@@ -19,20 +19,34 @@
 
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/io/color.h"
 
 namespace cartographer {
 namespace io {
 
+// A small integer standing for a frame ID, so that processors can compare
+// frame IDs without comparing strings.
+using FrameIdHandle = int;
+constexpr FrameIdHandle kUnknownFrameIdHandle = -1;
+
+// Returns the handle of 'frame_id', which is the same for equal frame IDs for
+// the lifetime of the program. This function is thread-safe.
+FrameIdHandle InternFrameId(const string& frame_id);
+
 // A number of points, captured around the same 'time' and by a
 // sensor at the same 'origin'.
 struct PointsBatch {
   PointsBatch() {
     origin = Eigen::Vector3f::Zero();
+    frame_id_handle = kUnknownFrameIdHandle;
     trajectory_id = 0;
   }
 
@@ -47,6 +61,11 @@ struct PointsBatch {
   // is unknown.
   string frame_id;
 
+  // Handle of 'frame_id' or kUnknownFrameIdHandle if it was not interned yet.
+  // Processors use GetFrameIdHandle() instead, so 'frame_id' must not change
+  // once the batch was passed to a processor.
+  FrameIdHandle frame_id_handle;
+
   // Trajectory ID that produced this point.
   int trajectory_id;
 
@@ -64,9 +83,39 @@ struct PointsBatch {
   std::vector<FloatColor> colors;
 };
 
-// Removes the indices in 'to_remove' from 'batch'.
+// Removes the indices in 'to_remove' from 'batch'. Compacts the remaining
+// points in a single pass, i.e. in time linear in the size of 'batch'.
 void RemovePoints(std::vector<int> to_remove, PointsBatch* batch);
 
+// Returns the handle of the 'frame_id' of 'batch', interning it only the first
+// time it is needed in a pipeline.
+FrameIdHandle GetFrameIdHandle(PointsBatch* batch);
+
+// A free list of PointsBatches. Batches which reached the end of a pipeline
+// are returned here and handed out again with their vectors cleared but their
+// memory still allocated, so that steady state processing does not allocate.
+//
+// This class is thread-safe.
+class PointsBatchPool {
+ public:
+  // Keeps at most 'max_free_batches' returned batches.
+  explicit PointsBatchPool(int max_free_batches);
+
+  PointsBatchPool(const PointsBatchPool&) = delete;
+  PointsBatchPool& operator=(const PointsBatchPool&) = delete;
+
+  // Returns an empty batch, reusing a returned one if available.
+  std::unique_ptr<PointsBatch> Acquire();
+
+  // Returns 'batch' to the pool, or frees it if the pool is full.
+  void Release(std::unique_ptr<PointsBatch> batch);
+
+ private:
+  const int max_free_batches_;
+  common::Mutex mutex_;
+  std::vector<std::unique_ptr<PointsBatch>> free_batches_ GUARDED_BY(mutex_);
+};
+
 }  // namespace io
 }  // namespace cartographer
 
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/io/points_batch.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace io {
+namespace {
+
+TEST(PointsBatchTest, RemovePoints) {
+  PointsBatch batch;
+  for (int i = 0; i != 6; ++i) {
+    batch.points.push_back(Eigen::Vector3f::Constant(i));
+    batch.intensities.push_back(i);
+  }
+  RemovePoints({0, 2, 2, 5}, &batch);
+  ASSERT_EQ(3, batch.points.size());
+  EXPECT_TRUE(batch.colors.empty());
+  EXPECT_EQ(std::vector<float>({1.f, 3.f, 4.f}), batch.intensities);
+  EXPECT_EQ(Eigen::Vector3f::Constant(1.f), batch.points[0]);
+  EXPECT_EQ(Eigen::Vector3f::Constant(3.f), batch.points[1]);
+  EXPECT_EQ(Eigen::Vector3f::Constant(4.f), batch.points[2]);
+}
+
+TEST(PointsBatchTest, FrameIdHandles) {
+  EXPECT_EQ(InternFrameId("laser"), InternFrameId("laser"));
+  EXPECT_NE(InternFrameId("laser"), InternFrameId("camera"));
+  PointsBatch batch;
+  batch.frame_id = "laser";
+  EXPECT_EQ(kUnknownFrameIdHandle, batch.frame_id_handle);
+  EXPECT_EQ(InternFrameId("laser"), GetFrameIdHandle(&batch));
+  EXPECT_EQ(InternFrameId("laser"), batch.frame_id_handle);
+}
+
+TEST(PointsBatchPoolTest, ReusesReleasedBatches) {
+  PointsBatchPool pool(1 /* max_free_batches */);
+  std::unique_ptr<PointsBatch> batch = pool.Acquire();
+  batch->frame_id = "laser";
+  GetFrameIdHandle(batch.get());
+  batch->points.resize(100);
+  const PointsBatch* const batch_ptr = batch.get();
+  pool.Release(std::move(batch));
+  batch = pool.Acquire();
+  EXPECT_EQ(batch_ptr, batch.get());
+  EXPECT_TRUE(batch->frame_id.empty());
+  EXPECT_EQ(kUnknownFrameIdHandle, batch->frame_id_handle);
+  EXPECT_TRUE(batch->points.empty());
+  EXPECT_GE(batch->points.capacity(), 100);
+  EXPECT_NE(batch_ptr, pool.Acquire().get());
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace cartographer
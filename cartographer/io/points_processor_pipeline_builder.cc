@@ -26,6 +26,7 @@
 #include "cartographer/io/min_max_range_filtering_points_processor.h"
 #include "cartographer/io/null_points_processor.h"
 #include "cartographer/io/outlier_removing_points_processor.h"
+#include "cartographer/io/parallel_points_processor.h"
 #include "cartographer/io/pcd_writing_points_processor.h"
 #include "cartographer/io/ply_writing_points_processor.h"
 #include "cartographer/io/probability_grid_points_processor.h"
@@ -47,6 +48,17 @@ void RegisterPlainPointsProcessor(
       });
 }
 
+template <typename PointsProcessorType>
+void RegisterStatelessPointsProcessor(
+    PointsProcessorPipelineBuilder* const builder) {
+  builder->RegisterStateless(
+      PointsProcessorType::kConfigurationFileActionName,
+      [](common::LuaParameterDictionary* const dictionary,
+         PointsProcessor* const next) -> std::unique_ptr<PointsProcessor> {
+        return PointsProcessorType::FromDictionary(dictionary, next);
+      });
+}
+
 template <typename PointsProcessorType>
 void RegisterFileWritingPointsProcessor(
     const FileWriterFactory& file_writer_factory,
@@ -82,11 +94,12 @@ void RegisterBuiltInPointsProcessors(
     PointsProcessorPipelineBuilder* builder) {
   RegisterPlainPointsProcessor<CountingPointsProcessor>(builder);
   RegisterPlainPointsProcessor<FixedRatioSamplingPointsProcessor>(builder);
-  RegisterPlainPointsProcessor<FrameIdFilteringPointsProcessor>(builder);
-  RegisterPlainPointsProcessor<MinMaxRangeFiteringPointsProcessor>(builder);
+  RegisterStatelessPointsProcessor<FrameIdFilteringPointsProcessor>(builder);
+  RegisterStatelessPointsProcessor<MinMaxRangeFiteringPointsProcessor>(
+      builder);
   RegisterPlainPointsProcessor<OutlierRemovingPointsProcessor>(builder);
-  RegisterPlainPointsProcessor<ColoringPointsProcessor>(builder);
-  RegisterPlainPointsProcessor<IntensityToColorPointsProcessor>(builder);
+  RegisterStatelessPointsProcessor<ColoringPointsProcessor>(builder);
+  RegisterStatelessPointsProcessor<IntensityToColorPointsProcessor>(builder);
   RegisterFileWritingPointsProcessor<PcdWritingPointsProcessor>(
       file_writer_factory, builder);
   RegisterFileWritingPointsProcessor<PlyWritingPointsProcessor>(
@@ -109,20 +122,56 @@ void PointsProcessorPipelineBuilder::Register(const std::string& name,
   factories_[name] = std::move(factory);
 }
 
+void PointsProcessorPipelineBuilder::RegisterStateless(
+    const std::string& name, FactoryFunction factory) {
+  Register(name, std::move(factory));
+  stateless_actions_.insert(name);
+}
+
 PointsProcessorPipelineBuilder::PointsProcessorPipelineBuilder() {}
 
 std::vector<std::unique_ptr<PointsProcessor>>
 PointsProcessorPipelineBuilder::CreatePipeline(
     common::LuaParameterDictionary* const dictionary) const {
+  return CreatePipeline(dictionary, nullptr /* thread_pool */,
+                        1 /* max_batches_in_flight */);
+}
+
+std::vector<std::unique_ptr<PointsProcessor>>
+PointsProcessorPipelineBuilder::CreatePipeline(
+    common::LuaParameterDictionary* const dictionary,
+    common::ThreadPoolInterface* const thread_pool,
+    const int max_batches_in_flight) const {
   std::vector<std::unique_ptr<PointsProcessor>> pipeline;
   // The last consumer in the pipeline must exist, so that the one created after
   // it (and being before it in the pipeline) has a valid 'next' to point to.
   // The last consumer will just drop all points.
-  pipeline.emplace_back(common::make_unique<NullPointsProcessor>());
+  pipeline.emplace_back(
+      common::make_unique<NullPointsProcessor>(points_batch_pool_));
 
   std::vector<std::unique_ptr<common::LuaParameterDictionary>> configurations =
       dictionary->GetArrayValuesAsDictionaries();
 
+  // The end of the run of stateless processors currently being constructed,
+  // if any.
+  ReorderingPointsProcessor* reordering = nullptr;
+  const auto start_run_if_needed = [&]() {
+    if (reordering == nullptr) {
+      auto reordering_processor =
+          common::make_unique<ReorderingPointsProcessor>(pipeline.back().get());
+      reordering = reordering_processor.get();
+      pipeline.push_back(std::move(reordering_processor));
+    }
+  };
+  const auto finish_run_if_needed = [&]() {
+    if (reordering != nullptr) {
+      pipeline.push_back(common::make_unique<ParallelPointsProcessor>(
+          max_batches_in_flight, thread_pool, reordering,
+          pipeline.back().get()));
+      reordering = nullptr;
+    }
+  };
+
   // We construct the pipeline starting at the back.
   for (auto it = configurations.rbegin(); it != configurations.rend(); it++) {
     const string action = (*it)->GetString("action");
@@ -130,8 +179,14 @@ PointsProcessorPipelineBuilder::CreatePipeline(
     CHECK(factory_it != factories_.end())
         << "Unknown action '" << action
         << "'. Did you register the correspoinding PointsProcessor?";
+    if (thread_pool != nullptr && stateless_actions_.count(action) != 0) {
+      start_run_if_needed();
+    } else {
+      finish_run_if_needed();
+    }
     pipeline.push_back(factory_it->second(it->get(), pipeline.back().get()));
   }
+  finish_run_if_needed();
   return pipeline;
 }
 
@@ -19,10 +19,13 @@
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/io/file_writer.h"
+#include "cartographer/io/points_batch.h"
 #include "cartographer/io/points_processor.h"
 #include "cartographer/mapping/proto/trajectory.pb.h"
 
@@ -51,11 +54,33 @@ class PointsProcessorPipelineBuilder {
   // be created using 'factory'.
   void Register(const std::string& name, FactoryFunction factory);
 
+  // Same as Register(), but for a PointsProcessor which keeps no state between
+  // batches and whose Process() may be called from several threads at once.
+  void RegisterStateless(const std::string& name, FactoryFunction factory);
+
+  // Pipelines created afterwards return the batches reaching their end to
+  // 'points_batch_pool', which has to outlive them. By default, batches are
+  // freed.
+  void set_points_batch_pool(PointsBatchPool* const points_batch_pool) {
+    points_batch_pool_ = points_batch_pool;
+  }
+
   std::vector<std::unique_ptr<PointsProcessor>> CreatePipeline(
       common::LuaParameterDictionary* dictionary) const;
 
+  // Same as above, but each run of consecutive stateless PointsProcessors
+  // processes up to 'max_batches_in_flight' batches concurrently on
+  // 'thread_pool'. All other PointsProcessors still receive the batches one at
+  // a time and in order.
+  std::vector<std::unique_ptr<PointsProcessor>> CreatePipeline(
+      common::LuaParameterDictionary* dictionary,
+      common::ThreadPoolInterface* thread_pool,
+      int max_batches_in_flight) const;
+
  private:
   std::unordered_map<std::string, FactoryFunction> factories_;
+  std::unordered_set<std::string> stateless_actions_;
+  PointsBatchPool* points_batch_pool_ = nullptr;
 };
 
 // Register all 'PointsProcessor' that ship with Cartographer with this
@@ -1,5 +1,9 @@
 #include "cartographer/io/probability_grid_points_processor.h"
 
+#include <cmath>
+#include <string>
+#include <vector>
+
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/make_unique.h"
@@ -12,36 +16,40 @@ namespace cartographer {
 namespace io {
 namespace {
 
+// Writes the cells of 'probability_grid' in the region starting at 'offset'
+// with size 'cell_limits' as an image.
 void WriteGrid(
     const mapping_2d::ProbabilityGrid& probability_grid,
+    const Eigen::Array2i& offset, const mapping_2d::CellLimits& cell_limits,
     const ProbabilityGridPointsProcessor::DrawTrajectories& draw_trajectories,
     const std::vector<mapping::proto::Trajectory>& trajectories,
     FileWriter* const file_writer) {
-  Eigen::Array2i offset;
-  mapping_2d::CellLimits cell_limits;
-  probability_grid.ComputeCroppedLimits(&offset, &cell_limits);
   if (cell_limits.num_x_cells == 0 || cell_limits.num_y_cells == 0) {
     LOG(WARNING) << "Not writing output: empty probability grid";
     return;
   }
-  const auto compute_color_value = [&probability_grid](
-                                       const Eigen::Array2i& index) {
-    if (probability_grid.IsKnown(index)) {
-      const float probability = 1.f - probability_grid.GetProbability(index);
-      return static_cast<uint8>(
-          255 * ((probability - mapping::kMinProbability) /
-                 (mapping::kMaxProbability - mapping::kMinProbability)));
-    } else {
-      constexpr uint8 kUnknownValue = 128;
-      return kUnknownValue;
-    }
-  };
   Image image(cell_limits.num_x_cells, cell_limits.num_y_cells);
-  for (const auto& xy_index :
-       cartographer::mapping_2d::XYIndexRangeIterator(cell_limits)) {
-    const auto index = xy_index + offset;
-    uint8 value = compute_color_value(index);
-    image.SetPixel(xy_index.x(), xy_index.y(), {{value, value, value}});
+  // Cells are converted a row at a time.
+  std::vector<uint16> values(cell_limits.num_x_cells);
+  std::vector<float> probabilities(cell_limits.num_x_cells);
+  for (int y = 0; y != cell_limits.num_y_cells; ++y) {
+    probability_grid.GetCellValues(offset + Eigen::Array2i(0, y),
+                                   cell_limits.num_x_cells, values.data());
+    mapping::ValuesToProbabilities(values.data(), cell_limits.num_x_cells,
+                                   probabilities.data());
+    for (int x = 0; x != cell_limits.num_x_cells; ++x) {
+      uint8 value;
+      if (values[x] != mapping::kUnknownProbabilityValue) {
+        const float probability = 1.f - probabilities[x];
+        value = static_cast<uint8>(
+            255 * ((probability - mapping::kMinProbability) /
+                   (mapping::kMaxProbability - mapping::kMinProbability)));
+      } else {
+        constexpr uint8 kUnknownValue = 128;
+        value = kUnknownValue;
+      }
+      image.SetPixel(x, y, {{value, value, value}});
+    }
   }
 
   if (draw_trajectories ==
@@ -71,6 +79,49 @@ mapping_2d::ProbabilityGrid CreateProbabilityGrid(const double resolution) {
                              kInitialProbabilityGridSize)));
 }
 
+// Writes the known cells of 'probability_grid' with centers inside 'box'.
+void WriteGridTile(
+    const mapping_2d::ProbabilityGrid& probability_grid,
+    const Eigen::AlignedBox2f& box,
+    const ProbabilityGridPointsProcessor::DrawTrajectories& draw_trajectories,
+    const std::vector<mapping::proto::Trajectory>& trajectories,
+    FileWriter* const file_writer) {
+  // Cell indices grow with decreasing coordinates and the first index is
+  // along y. Cells centered on the lower borders of the tile belong to it,
+  // those on the upper borders do not.
+  const mapping_2d::MapLimits& limits = probability_grid.limits();
+  const auto first_index = [&limits](const double max, const double border) {
+    return common::RoundToInt(
+               std::floor((max - border) / limits.resolution() - 0.5)) +
+           1;
+  };
+  const auto last_index = [&limits](const double max, const double border) {
+    return common::RoundToInt(
+        std::floor((max - border) / limits.resolution() - 0.5));
+  };
+  const Eigen::Array2i tile_min(first_index(limits.max().y(), box.max().y()),
+                                first_index(limits.max().x(), box.max().x()));
+  const Eigen::Array2i tile_max(last_index(limits.max().y(), box.min().y()),
+                                last_index(limits.max().x(), box.min().x()));
+  Eigen::Array2i offset;
+  mapping_2d::CellLimits cell_limits;
+  probability_grid.ComputeCroppedLimits(&offset, &cell_limits);
+  const Eigen::Array2i min = offset.max(tile_min);
+  const Eigen::Array2i known_max =
+      offset +
+      Eigen::Array2i(cell_limits.num_x_cells - 1, cell_limits.num_y_cells - 1);
+  const Eigen::Array2i max = known_max.min(tile_max);
+  if ((max < min).any()) {
+    LOG(WARNING) << "Not writing output: empty probability grid tile";
+    CHECK(file_writer->Close());
+    return;
+  }
+  WriteGrid(probability_grid, min,
+            mapping_2d::CellLimits(max.x() - min.x() + 1,
+                                   max.y() - min.y() + 1),
+            draw_trajectories, trajectories, file_writer);
+}
+
 }  // namespace
 
 ProbabilityGridPointsProcessor::ProbabilityGridPointsProcessor(
@@ -88,6 +139,40 @@ ProbabilityGridPointsProcessor::ProbabilityGridPointsProcessor(
       range_data_inserter_(range_data_inserter_options),
       probability_grid_(CreateProbabilityGrid(resolution)) {}
 
+ProbabilityGridPointsProcessor::ProbabilityGridPointsProcessor(
+    const double resolution,
+    const mapping_2d::proto::RangeDataInserterOptions&
+        range_data_inserter_options,
+    const DrawTrajectories& draw_trajectories, const double tile_size,
+    const double finished_tile_distance,
+    const FileWriterFactory& file_writer_factory, const string& filename,
+    const std::vector<mapping::proto::Trajectory>& trajectories,
+    PointsProcessor* const next)
+    : draw_trajectories_(draw_trajectories),
+      trajectories_(trajectories),
+      next_(next),
+      range_data_inserter_(range_data_inserter_options),
+      probability_grid_(CreateProbabilityGrid(resolution)),
+      grid_tiles_(common::make_unique<GridTiles<mapping_2d::ProbabilityGrid>>(
+          tile_size, finished_tile_distance,
+          [resolution]() {
+            return common::make_unique<mapping_2d::ProbabilityGrid>(
+                CreateProbabilityGrid(resolution));
+          },
+          [this, file_writer_factory, filename](
+              const Eigen::Array2i& tile_index, const int part,
+              const Eigen::AlignedBox2f& tile_box,
+              mapping_2d::ProbabilityGrid* const grid) {
+            string tile_filename = filename + "_" +
+                                   std::to_string(tile_index.x()) + "_" +
+                                   std::to_string(tile_index.y());
+            if (part > 0) {
+              tile_filename += "_" + std::to_string(part);
+            }
+            WriteGridTile(*grid, tile_box, draw_trajectories_, trajectories_,
+                          file_writer_factory(tile_filename + ".png").get());
+          })) {}
+
 std::unique_ptr<ProbabilityGridPointsProcessor>
 ProbabilityGridPointsProcessor::FromDictionary(
     const std::vector<mapping::proto::Trajectory>& trajectories,
@@ -98,10 +183,22 @@ ProbabilityGridPointsProcessor::FromDictionary(
                                   dictionary->GetBool("draw_trajectories"))
                                      ? DrawTrajectories::kYes
                                      : DrawTrajectories::kNo;
-  return common::make_unique<ProbabilityGridPointsProcessor>(
-      dictionary->GetDouble("resolution"),
+  const auto range_data_inserter_options =
       mapping_2d::CreateRangeDataInserterOptions(
-          dictionary->GetDictionary("range_data_inserter").get()),
+          dictionary->GetDictionary("range_data_inserter").get());
+  if (dictionary->HasKey("tile_size")) {
+    const double tile_size = dictionary->GetDouble("tile_size");
+    return common::make_unique<ProbabilityGridPointsProcessor>(
+        dictionary->GetDouble("resolution"), range_data_inserter_options,
+        draw_trajectories, tile_size,
+        dictionary->HasKey("finished_tile_distance")
+            ? dictionary->GetDouble("finished_tile_distance")
+            : tile_size,
+        file_writer_factory, dictionary->GetString("filename"), trajectories,
+        next);
+  }
+  return common::make_unique<ProbabilityGridPointsProcessor>(
+      dictionary->GetDouble("resolution"), range_data_inserter_options,
       draw_trajectories,
       file_writer_factory(dictionary->GetString("filename") + ".png"),
       trajectories, next);
@@ -109,14 +206,28 @@ ProbabilityGridPointsProcessor::FromDictionary(
 
 void ProbabilityGridPointsProcessor::Process(
     std::unique_ptr<PointsBatch> batch) {
-  range_data_inserter_.Insert({batch->origin, batch->points, {}},
-                              &probability_grid_);
+  const sensor::RangeData range_data{batch->origin, batch->points, {}};
+  if (grid_tiles_ != nullptr) {
+    grid_tiles_->Insert(batch->origin, batch->points,
+                        [this, &range_data](mapping_2d::ProbabilityGrid* grid) {
+                          range_data_inserter_.Insert(range_data, grid);
+                        });
+  } else {
+    range_data_inserter_.Insert(range_data, &probability_grid_);
+  }
   next_->Process(std::move(batch));
 }
 
 PointsProcessor::FlushResult ProbabilityGridPointsProcessor::Flush() {
-  WriteGrid(probability_grid_, draw_trajectories_, trajectories_,
-            file_writer_.get());
+  if (grid_tiles_ != nullptr) {
+    grid_tiles_->FinishAll();
+  } else {
+    Eigen::Array2i offset;
+    mapping_2d::CellLimits cell_limits;
+    probability_grid_.ComputeCroppedLimits(&offset, &cell_limits);
+    WriteGrid(probability_grid_, offset, cell_limits, draw_trajectories_,
+              trajectories_, file_writer_.get());
+  }
   switch (next_->Flush()) {
     case FlushResult::kRestartStream:
       LOG(FATAL) << "ProbabilityGrid generation must be configured to occur "
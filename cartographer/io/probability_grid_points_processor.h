@@ -5,6 +5,7 @@
 #include <string>
 
 #include "cartographer/io/file_writer.h"
+#include "cartographer/io/grid_tiles.h"
 #include "cartographer/io/points_batch.h"
 #include "cartographer/io/points_processor.h"
 #include "cartographer/mapping/proto/trajectory.pb.h"
@@ -19,6 +20,10 @@ namespace io {
 // projected into the x-y plane the z component of the data is ignored.
 // 'range_data_inserter' options are used to configure the range data ray
 // tracing through the probability grid.
+//
+// If 'tile_size' is configured, one image per tile is written to
+// '<filename>_<x>_<y>.png' instead, as soon as the trajectory moved away from
+// the tile, see 'GridTiles'. This bounds memory use for large maps.
 class ProbabilityGridPointsProcessor : public PointsProcessor {
  public:
   constexpr static const char* kConfigurationFileActionName =
@@ -32,6 +37,17 @@ class ProbabilityGridPointsProcessor : public PointsProcessor {
       std::unique_ptr<FileWriter> file_writer,
       const std::vector<mapping::proto::Trajectory>& trajectorios,
       PointsProcessor* next);
+  // Writes tiles with edge length 'tile_size' to files created by
+  // 'file_writer_factory' named after 'filename'.
+  ProbabilityGridPointsProcessor(
+      double resolution,
+      const mapping_2d::proto::RangeDataInserterOptions&
+          range_data_inserter_options,
+      const DrawTrajectories& draw_trajectories, double tile_size,
+      double finished_tile_distance,
+      const FileWriterFactory& file_writer_factory, const string& filename,
+      const std::vector<mapping::proto::Trajectory>& trajectories,
+      PointsProcessor* next);
   ProbabilityGridPointsProcessor(const ProbabilityGridPointsProcessor&) =
       delete;
   ProbabilityGridPointsProcessor& operator=(
@@ -54,6 +70,9 @@ class ProbabilityGridPointsProcessor : public PointsProcessor {
   PointsProcessor* const next_;
   mapping_2d::RangeDataInserter range_data_inserter_;
   mapping_2d::ProbabilityGrid probability_grid_;
+  // Only used when writing tiles, in which case 'probability_grid_' stays
+  // empty.
+  std::unique_ptr<GridTiles<mapping_2d::ProbabilityGrid>> grid_tiles_;
 };
 
 }  // namespace io
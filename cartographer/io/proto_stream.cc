@@ -16,13 +16,29 @@
 
 #include "cartographer/io/proto_stream.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace cartographer {
 namespace io {
 
 namespace {
 
-// First eight bytes to identify our proto stream format.
-const uint64 kMagic = 0x7b1d1f7b5bf501db;
+// First eight bytes to identify our proto stream format. Files of the first
+// version have neither an index nor a footer. Files of the third version are
+// like the second one, but the magic is followed by eight bytes identifying
+// the compression, while the others always use gzip. Files using gzip are
+// written in the second version, so that older readers can still read them.
+const uint64 kMagicVersion1 = 0x7b1d1f7b5bf501db;
+const uint64 kMagicVersion2 = 0x7b1d1f7b5bf501dc;
+const uint64 kMagicVersion3 = 0x7b1d1f7b5bf501dd;
+
+// Last eight bytes of a complete file of the second version. They are
+// preceded by the offset of the index or 0 if there is none.
+const uint64 kFooterMagic = 0x2c4efda0316bd75b;
+constexpr int kFooterSize = 16;
 
 void WriteSizeAsLittleEndian(uint64 size, std::ostream* out) {
   for (int i = 0; i != 8; ++i) {
@@ -31,60 +47,167 @@ void WriteSizeAsLittleEndian(uint64 size, std::ostream* out) {
   }
 }
 
-bool ReadSizeAsLittleEndian(std::istream* in, uint64* size) {
-  *size = 0;
+// Reads the eight bytes at 'offset' of the 'size' bytes at 'data'. Returns
+// false if they are out of bounds.
+bool ReadSizeAsLittleEndian(const char* const data, const uint64 size,
+                            const uint64 offset, uint64* const value) {
+  if (offset > size || size - offset < sizeof(uint64)) {
+    return false;
+  }
+  *value = 0;
   for (int i = 0; i != 8; ++i) {
-    *size >>= 8;
-    *size += static_cast<uint64>(in->get()) << 56;
+    *value |= static_cast<uint64>(static_cast<unsigned char>(data[offset + i]))
+              << (8 * i);
   }
-  return !in->fail();
+  return true;
 }
 
 }  // namespace
 
 ProtoStreamWriter::ProtoStreamWriter(const string& filename)
-    : out_(filename, std::ios::out | std::ios::binary) {
-  WriteSizeAsLittleEndian(kMagic, &out_);
+    : ProtoStreamWriter(filename, Compression::kGzip) {}
+
+ProtoStreamWriter::ProtoStreamWriter(const string& filename,
+                                     const Compression compression)
+    : compression_(compression),
+      out_(filename, std::ios::out | std::ios::binary) {
+  if (compression_ == Compression::kGzip) {
+    WriteSizeAsLittleEndian(kMagicVersion2, &out_);
+  } else {
+    WriteSizeAsLittleEndian(kMagicVersion3, &out_);
+    WriteSizeAsLittleEndian(static_cast<uint64>(compression_), &out_);
+  }
 }
 
 ProtoStreamWriter::~ProtoStreamWriter() {}
 
-void ProtoStreamWriter::Write(const string& uncompressed_data) {
+string ProtoStreamWriter::Compress(string uncompressed_data) const {
+  if (compression_ == Compression::kNone) {
+    return uncompressed_data;
+  }
   string compressed_data;
   common::FastGzipString(uncompressed_data, &compressed_data);
+  return compressed_data;
+}
+
+uint64 ProtoStreamWriter::WriteCompressedProto(const string& compressed_data) {
+  CHECK_EQ(index_offset_, 0) << "No messages may follow the index.";
+  const uint64 offset = static_cast<uint64>(out_.tellp());
   WriteSizeAsLittleEndian(compressed_data.size(), &out_);
   out_.write(compressed_data.data(), compressed_data.size());
+  return offset;
+}
+
+bool ProtoStreamWriter::Flush() {
+  out_.flush();
+  return !out_.fail();
 }
 
 bool ProtoStreamWriter::Close() {
+  WriteSizeAsLittleEndian(index_offset_, &out_);
+  WriteSizeAsLittleEndian(kFooterMagic, &out_);
   out_.close();
   return !out_.fail();
 }
 
-ProtoStreamReader::ProtoStreamReader(const string& filename)
-    : in_(filename, std::ios::in | std::ios::binary) {
+ProtoStreamReader::ProtoStreamReader(const string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd == -1 || fstat(fd, &file_stat) != 0) {
+    if (fd != -1) {
+      close(fd);
+    }
+    return;
+  }
+  size_ = file_stat.st_size;
+  if (size_ != 0) {
+    void* const data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      PLOG(ERROR) << "Could not map " << filename;
+      size_ = 0;
+    } else {
+      // Messages are mostly read in order, so reading ahead pays off.
+      madvise(data, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+    }
+  }
+  // The mapping stays valid after closing the file descriptor.
+  close(fd);
+
   uint64 magic;
-  if (!ReadSizeAsLittleEndian(&in_, &magic) || magic != kMagic) {
-    in_.setstate(std::ios::failbit);
+  if (!ReadSizeAsLittleEndian(data_, size_, offset_, &magic) ||
+      (magic != kMagicVersion1 && magic != kMagicVersion2 &&
+       magic != kMagicVersion3)) {
+    return;
+  }
+  offset_ = sizeof(magic);
+  if (magic == kMagicVersion3) {
+    uint64 compression;
+    if (!ReadSizeAsLittleEndian(data_, size_, offset_, &compression) ||
+        compression >
+            static_cast<uint64>(ProtoStreamWriter::Compression::kNone)) {
+      LOG(ERROR) << "Unknown compression in " << filename;
+      return;
+    }
+    compression_ = static_cast<ProtoStreamWriter::Compression>(compression);
+    offset_ += sizeof(compression);
+  }
+  end_offset_ = size_;
+  if (magic != kMagicVersion1 && end_offset_ >= offset_ + kFooterSize) {
+    uint64 index_offset;
+    uint64 footer_magic;
+    if (ReadSizeAsLittleEndian(data_, size_, end_offset_ - kFooterSize,
+                               &index_offset) &&
+        ReadSizeAsLittleEndian(data_, size_, end_offset_ - sizeof(uint64),
+                               &footer_magic) &&
+        footer_magic == kFooterMagic) {
+      index_offset_ = index_offset;
+      end_offset_ = has_index() ? index_offset_ : end_offset_ - kFooterSize;
+    }
+    // Files without a footer were not closed properly, in which case all
+    // complete messages can still be read in order.
+  }
+  valid_ = true;
+}
+
+ProtoStreamReader::~ProtoStreamReader() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
   }
 }
 
-ProtoStreamReader::~ProtoStreamReader() {}
+bool ProtoStreamReader::Seek(const uint64 offset) {
+  failed_ = false;
+  offset_ = offset;
+  return valid_ && offset_ <= size_;
+}
 
-bool ProtoStreamReader::Read(string* decompressed_data) {
-  uint64 compressed_size;
-  if (!ReadSizeAsLittleEndian(&in_, &compressed_size)) {
+bool ProtoStreamReader::ReadCompressedProto(string* const compressed_data) {
+  const char* data;
+  uint64 size;
+  if (offset_ >= end_offset_ || !ReadRecord(&data, &size)) {
     return false;
   }
-  string compressed_data(compressed_size, '\0');
-  if (!in_.read(&compressed_data.front(), compressed_size)) {
+  compressed_data->assign(data, size);
+  return true;
+}
+
+bool ProtoStreamReader::ReadRecord(const char** const compressed_data,
+                                   uint64* const compressed_size) {
+  if (!valid_ ||
+      !ReadSizeAsLittleEndian(data_, size_, offset_, compressed_size) ||
+      *compressed_size > size_ - offset_ - sizeof(uint64)) {
+    failed_ = true;
     return false;
   }
-  common::FastGunzipString(compressed_data, decompressed_data);
+  *compressed_data = data_ + offset_ + sizeof(uint64);
+  offset_ += sizeof(uint64) + *compressed_size;
   return true;
 }
 
-bool ProtoStreamReader::eof() const { return in_.eof(); }
+bool ProtoStreamReader::eof() const {
+  return valid_ && !failed_ && offset_ == end_offset_;
+}
 
 }  // namespace io
 }  // namespace cartographer
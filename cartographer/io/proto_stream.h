@@ -18,8 +18,11 @@
 #define CARTOGRAPHER_IO_PROTO_STREAM_H_
 
 #include <fstream>
+#include <limits>
+#include <utility>
 
 #include "cartographer/common/port.h"
+#include "glog/logging.h"
 
 namespace cartographer {
 namespace io {
@@ -28,34 +31,78 @@ namespace io {
 // file. The format is not intended to be compatible with any other format used
 // outside of Cartographer.
 //
+// Files end with an optional index message and a footer pointing to it, so
+// that readers can access single messages without reading the whole file.
+//
 // TODO(whess): Compress the file instead of individual messages for better
 // compression performance? Should we use LZ4?
 class ProtoStreamWriter {
  public:
+  // How messages are compressed. It is recorded in the file header.
+  enum class Compression {
+    kGzip = 0,
+    // Much faster to write and read, at the cost of larger files. Useful e.g.
+    // for frequent checkpoints.
+    kNone = 1,
+  };
+
   ProtoStreamWriter(const string& filename);
+  ProtoStreamWriter(const string& filename, Compression compression);
   ~ProtoStreamWriter();
 
   ProtoStreamWriter(const ProtoStreamWriter&) = delete;
   ProtoStreamWriter& operator=(const ProtoStreamWriter&) = delete;
 
-  // Serializes, compressed and writes the 'proto' to the file.
+  // Serializes, compressed and writes the 'proto' to the file. Returns the
+  // offset at which ProtoStreamReader::ReadProtoAt() reads it back.
   template <typename MessageType>
-  void WriteProto(const MessageType& proto) {
+  uint64 WriteProto(const MessageType& proto) {
+    return WriteCompressedProto(CompressProto(proto));
+  }
+
+  // Serializes and compresses the 'proto' like WriteProto(), but leaves
+  // writing it to WriteCompressedProto(). This is thread-safe, so messages can
+  // be compressed on other threads and then written in order.
+  template <typename MessageType>
+  string CompressProto(const MessageType& proto) const {
     string uncompressed_data;
     proto.SerializeToString(&uncompressed_data);
-    Write(uncompressed_data);
+    return Compress(std::move(uncompressed_data));
   }
 
-  // This should be called to check whether writing was successful.
+  // Writes a message returned by CompressProto(). Returns the offset like
+  // WriteProto().
+  uint64 WriteCompressedProto(const string& compressed_data);
+
+  // Writes the 'index', e.g. of offsets returned by WriteProto(), so that
+  // ProtoStreamReader::ReadIndex() finds it without reading the other
+  // messages. May be called once, after all other messages have been written.
+  template <typename MessageType>
+  void WriteIndex(const MessageType& index) {
+    CHECK_EQ(index_offset_, 0) << "The index has already been written.";
+    index_offset_ = WriteProto(index);
+  }
+
+  // Hands the messages written so far to the operating system, so that they
+  // can be read back even if the process crashes before Close(). Returns false
+  // if writing failed.
+  bool Flush();
+
+  // This should be called to check whether writing was successful. Writes the
+  // footer.
   bool Close();
 
  private:
-  void Write(const string& uncompressed_data);
+  string Compress(string uncompressed_data) const;
 
+  const Compression compression_;
   std::ofstream out_;
+  uint64 index_offset_ = 0;
 };
 
-// A reader of the format produced by ProtoStreamWriter.
+// A reader of the format produced by ProtoStreamWriter. The file is
+// memory-mapped, so that messages are decompressed and parsed straight from
+// the mapping without first being copied.
 class ProtoStreamReader {
  public:
   ProtoStreamReader(const string& filename);
@@ -64,19 +111,88 @@ class ProtoStreamReader {
   ProtoStreamReader(const ProtoStreamReader&) = delete;
   ProtoStreamReader& operator=(const ProtoStreamReader&) = delete;
 
+  // Reads the next message. Returns false once all messages have been read,
+  // never returning the index.
   template <typename MessageType>
   bool ReadProto(MessageType* proto) {
-    string decompressed_data;
-    return Read(&decompressed_data) &&
-           proto->ParseFromString(decompressed_data);
+    const char* compressed_data;
+    uint64 compressed_size;
+    return offset_ < end_offset_ &&
+           ReadRecord(&compressed_data, &compressed_size) &&
+           ParseCompressedProto(compressed_data, compressed_size, proto);
   }
 
+  // Same as ReadProto(), but leaves decompressing and parsing the message to
+  // ParseCompressedProto(), which may run on other threads.
+  bool ReadCompressedProto(string* compressed_data);
+
+  // This is thread-safe.
+  template <typename MessageType>
+  bool ParseCompressedProto(const string& compressed_data,
+                            MessageType* proto) const {
+    return ParseCompressedProto(compressed_data.data(), compressed_data.size(),
+                                proto);
+  }
+
+  // Reads the message at 'offset' returned by ProtoStreamWriter::WriteProto().
+  // ReadProto() continues with the message after it.
+  template <typename MessageType>
+  bool ReadProtoAt(const uint64 offset, MessageType* proto) {
+    return Seek(offset) && ReadProto(proto);
+  }
+
+  // Returns true if the file contains an index written by
+  // ProtoStreamWriter::WriteIndex().
+  bool has_index() const { return index_offset_ != 0; }
+
+  // Reads the index. ReadProto() afterwards returns false.
+  template <typename MessageType>
+  bool ReadIndex(MessageType* index) {
+    const char* compressed_data;
+    uint64 compressed_size;
+    return has_index() && Seek(index_offset_) &&
+           ReadRecord(&compressed_data, &compressed_size) &&
+           ParseCompressedProto(compressed_data, compressed_size, index);
+  }
+
+  // Returns true if all messages have been read.
   bool eof() const;
 
  private:
-  bool Read(string* decompressed_data);
+  template <typename MessageType>
+  bool ParseCompressedProto(const char* const compressed_data,
+                            const uint64 compressed_size,
+                            MessageType* proto) const {
+    if (compression_ == ProtoStreamWriter::Compression::kNone) {
+      return compressed_size <= std::numeric_limits<int>::max() &&
+             proto->ParseFromArray(compressed_data, compressed_size);
+    }
+    string decompressed_data;
+    common::FastGunzipString(compressed_data, compressed_size,
+                             &decompressed_data);
+    return proto->ParseFromString(decompressed_data);
+  }
 
-  std::ifstream in_;
+  bool Seek(uint64 offset);
+
+  // Points 'compressed_data' to the next record in the mapping, which stays
+  // valid for the lifetime of this reader.
+  bool ReadRecord(const char** compressed_data, uint64* compressed_size);
+
+  // The mapped file, or nullptr if it could not be mapped or is empty.
+  const char* data_ = nullptr;
+  uint64 size_ = 0;
+  // Whether the file has a valid header, and whether reading a record failed
+  // since the last Seek().
+  bool valid_ = false;
+  bool failed_ = false;
+  ProtoStreamWriter::Compression compression_ =
+      ProtoStreamWriter::Compression::kGzip;
+  uint64 offset_ = 0;
+  // Offset after the last message, which is where the index starts if there
+  // is one.
+  uint64 end_offset_ = 0;
+  uint64 index_offset_ = 0;
 };
 
 }  // namespace io
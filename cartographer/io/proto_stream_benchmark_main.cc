@@ -0,0 +1,120 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures writing and reading a proto stream of compressed point clouds,
+// with and without compression, as done for serialized states.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/io/proto_stream.h"
+#include "cartographer/sensor/compressed_point_cloud.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/sensor/proto/sensor.pb.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_messages, 1000, "Number of messages to write and read.");
+DEFINE_int32(num_points, 10000, "Number of points per message.");
+DEFINE_string(filename, "/tmp/cartographer_proto_stream_benchmark.pbstream",
+              "File to write the proto stream to. It is removed afterwards.");
+
+namespace cartographer {
+namespace io {
+namespace {
+
+// Returns point clouds of random points, where each point cloud is close to
+// the previous one as for consecutive range data.
+std::vector<sensor::proto::CompressedPointCloud> GenerateMessages(
+    const int num_messages, const int num_points) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> distribution(-20.f, 20.f);
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != num_points; ++i) {
+    point_cloud.emplace_back(distribution(rng), distribution(rng),
+                             0.1f * distribution(rng));
+  }
+  std::vector<sensor::proto::CompressedPointCloud> messages;
+  for (int i = 0; i != num_messages; ++i) {
+    for (Eigen::Vector3f& point : point_cloud) {
+      point.x() += 0.01f;
+    }
+    messages.push_back(sensor::CompressedPointCloud(point_cloud).ToProto());
+  }
+  return messages;
+}
+
+void Run() {
+  const std::vector<sensor::proto::CompressedPointCloud> messages =
+      GenerateMessages(FLAGS_num_messages, FLAGS_num_points);
+  for (const auto compression : {ProtoStreamWriter::Compression::kGzip,
+                                 ProtoStreamWriter::Compression::kNone}) {
+    const string name =
+        compression == ProtoStreamWriter::Compression::kGzip ? "gzip" : "none";
+    const auto write_start = std::chrono::steady_clock::now();
+    {
+      ProtoStreamWriter writer(FLAGS_filename, compression);
+      for (const auto& message : messages) {
+        writer.WriteProto(message);
+      }
+      CHECK(writer.Close());
+    }
+    const double write_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      write_start)
+            .count();
+
+    const auto read_start = std::chrono::steady_clock::now();
+    int num_messages_read = 0;
+    {
+      ProtoStreamReader reader(FLAGS_filename);
+      sensor::proto::CompressedPointCloud message;
+      while (reader.ReadProto(&message)) {
+        ++num_messages_read;
+      }
+    }
+    const double read_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      read_start)
+            .count();
+    CHECK_EQ(num_messages_read, FLAGS_num_messages);
+    LOG(INFO) << "Compression " << name << ": writing "
+              << 1e6 * write_seconds / FLAGS_num_messages
+              << " us per message, reading "
+              << 1e6 * read_seconds / FLAGS_num_messages << " us per message.";
+  }
+  std::remove(FLAGS_filename.c_str());
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks writing and reading proto streams.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::io::Run();
+  return EXIT_SUCCESS;
+}
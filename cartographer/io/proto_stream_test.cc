@@ -21,7 +21,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fstream>
+#include <iterator>
+#include <vector>
+
 #include "cartographer/common/port.h"
+#include "cartographer/mapping/proto/serialization.pb.h"
 #include "cartographer/mapping/proto/trajectory.pb.h"
 #include "gtest/gtest.h"
 
@@ -67,6 +72,204 @@ TEST_F(ProtoStreamTest, WriteAndReadBack) {
   remove(test_file.c_str());
 }
 
+TEST_F(ProtoStreamTest, WriteAndReadBackUncompressed) {
+  const string test_file = test_directory_ + "/test_trajectory.pbstream";
+  uint64 last_offset;
+  {
+    ProtoStreamWriter writer(test_file, ProtoStreamWriter::Compression::kNone);
+    mapping::proto::SerializedDataIndex index;
+    for (int i = 0; i != 10; ++i) {
+      mapping::proto::Trajectory trajectory;
+      trajectory.add_node()->set_timestamp(i);
+      last_offset = writer.WriteProto(trajectory);
+      index.add_node()->set_offset(last_offset);
+    }
+    writer.WriteIndex(index);
+    ASSERT_TRUE(writer.Close());
+  }
+  {
+    ProtoStreamReader reader(test_file);
+    for (int i = 0; i != 10; ++i) {
+      mapping::proto::Trajectory trajectory;
+      ASSERT_TRUE(reader.ReadProto(&trajectory));
+      ASSERT_EQ(1, trajectory.node_size());
+      EXPECT_EQ(i, trajectory.node(0).timestamp());
+    }
+    mapping::proto::Trajectory trajectory;
+    EXPECT_FALSE(reader.ReadProto(&trajectory));
+    EXPECT_TRUE(reader.eof());
+
+    mapping::proto::SerializedDataIndex index;
+    ASSERT_TRUE(reader.ReadIndex(&index));
+    ASSERT_EQ(10, index.node_size());
+    ASSERT_TRUE(reader.ReadProtoAt(last_offset, &trajectory));
+    EXPECT_EQ(9, trajectory.node(0).timestamp());
+  }
+  remove(test_file.c_str());
+}
+
+TEST_F(ProtoStreamTest, WritesCompressedMessagesInOrder) {
+  const string test_file = test_directory_ + "/test_trajectory.pbstream";
+  for (const auto compression : {ProtoStreamWriter::Compression::kGzip,
+                                 ProtoStreamWriter::Compression::kNone}) {
+    {
+      ProtoStreamWriter writer(test_file, compression);
+      // Compressed out of order, as on a thread pool.
+      std::vector<string> compressed(10);
+      for (int i = 9; i >= 0; --i) {
+        mapping::proto::Trajectory trajectory;
+        trajectory.add_node()->set_timestamp(i);
+        compressed[i] = writer.CompressProto(trajectory);
+      }
+      for (int i = 0; i != 10; ++i) {
+        if (i % 2 == 0) {
+          writer.WriteCompressedProto(compressed[i]);
+        } else {
+          mapping::proto::Trajectory trajectory;
+          trajectory.add_node()->set_timestamp(i);
+          writer.WriteProto(trajectory);
+        }
+      }
+      ASSERT_TRUE(writer.Close());
+    }
+    ProtoStreamReader reader(test_file);
+    for (int i = 0; i != 10; ++i) {
+      mapping::proto::Trajectory trajectory;
+      ASSERT_TRUE(reader.ReadProto(&trajectory));
+      EXPECT_EQ(i, trajectory.node(0).timestamp());
+    }
+    EXPECT_TRUE(reader.eof());
+  }
+  remove(test_file.c_str());
+}
+
+TEST_F(ProtoStreamTest, ReadsSingleMessagesThroughTheIndex) {
+  const string test_file = test_directory_ + "/test_trajectory.pbstream";
+  std::vector<uint64> offsets;
+  {
+    ProtoStreamWriter writer(test_file);
+    mapping::proto::SerializedDataIndex index;
+    for (int i = 0; i != 10; ++i) {
+      mapping::proto::Trajectory trajectory;
+      trajectory.add_node()->set_timestamp(i);
+      offsets.push_back(writer.WriteProto(trajectory));
+      index.add_node()->set_offset(offsets.back());
+    }
+    writer.WriteIndex(index);
+    ASSERT_TRUE(writer.Close());
+  }
+  {
+    ProtoStreamReader reader(test_file);
+    ASSERT_TRUE(reader.has_index());
+    for (int i = 0; i != 10; ++i) {
+      mapping::proto::Trajectory trajectory;
+      ASSERT_TRUE(reader.ReadProto(&trajectory));
+      EXPECT_EQ(i, trajectory.node(0).timestamp());
+    }
+    mapping::proto::Trajectory trajectory;
+    EXPECT_FALSE(reader.ReadProto(&trajectory));
+    EXPECT_TRUE(reader.eof());
+
+    mapping::proto::SerializedDataIndex index;
+    ASSERT_TRUE(reader.ReadIndex(&index));
+    ASSERT_EQ(10, index.node_size());
+    for (int i = 9; i >= 0; i -= 3) {
+      EXPECT_EQ(offsets[i], index.node(i).offset());
+      ASSERT_TRUE(reader.ReadProtoAt(index.node(i).offset(), &trajectory));
+      EXPECT_EQ(i, trajectory.node(0).timestamp());
+    }
+    // Reading continues after the message last read.
+    ASSERT_TRUE(reader.ReadProto(&trajectory));
+    EXPECT_EQ(1, trajectory.node(0).timestamp());
+  }
+  remove(test_file.c_str());
+}
+
+TEST_F(ProtoStreamTest, ReadsFilesWithoutFooter) {
+  const string test_file = test_directory_ + "/test_trajectory.pbstream";
+  {
+    // The writer is destroyed without being closed.
+    ProtoStreamWriter writer(test_file);
+    for (int i = 0; i != 3; ++i) {
+      mapping::proto::Trajectory trajectory;
+      trajectory.add_node()->set_timestamp(i);
+      writer.WriteProto(trajectory);
+    }
+  }
+  ProtoStreamReader reader(test_file);
+  EXPECT_FALSE(reader.has_index());
+  mapping::proto::Trajectory trajectory;
+  for (int i = 0; i != 3; ++i) {
+    ASSERT_TRUE(reader.ReadProto(&trajectory));
+    EXPECT_EQ(i, trajectory.node(0).timestamp());
+  }
+  EXPECT_FALSE(reader.ReadProto(&trajectory));
+  EXPECT_TRUE(reader.eof());
+  remove(test_file.c_str());
+}
+
+TEST_F(ProtoStreamTest, ReadsFirstVersion) {
+  const string test_file = test_directory_ + "/test_trajectory.pbstream";
+  {
+    // Writes the magic number and a single message in little endian.
+    std::ofstream out(test_file, std::ios::out | std::ios::binary);
+    const auto write_size = [&out](uint64 size) {
+      for (int i = 0; i != 8; ++i) {
+        out.put(size & 0xff);
+        size >>= 8;
+      }
+    };
+    write_size(0x7b1d1f7b5bf501db);
+    mapping::proto::Trajectory trajectory;
+    trajectory.add_node()->set_timestamp(42);
+    string uncompressed_data;
+    trajectory.SerializeToString(&uncompressed_data);
+    string compressed_data;
+    common::FastGzipString(uncompressed_data, &compressed_data);
+    write_size(compressed_data.size());
+    out.write(compressed_data.data(), compressed_data.size());
+  }
+  ProtoStreamReader reader(test_file);
+  EXPECT_FALSE(reader.has_index());
+  mapping::proto::Trajectory trajectory;
+  ASSERT_TRUE(reader.ReadProto(&trajectory));
+  EXPECT_EQ(42, trajectory.node(0).timestamp());
+  EXPECT_FALSE(reader.ReadProto(&trajectory));
+  EXPECT_TRUE(reader.eof());
+  remove(test_file.c_str());
+}
+
+TEST_F(ProtoStreamTest, StopsAtTruncatedMessages) {
+  const string test_file = test_directory_ + "/test_trajectory.pbstream";
+  {
+    ProtoStreamWriter writer(test_file,
+                             ProtoStreamWriter::Compression::kNone);
+    mapping::proto::Trajectory trajectory;
+    trajectory.add_node()->set_timestamp(42);
+    writer.WriteProto(trajectory);
+    writer.WriteProto(trajectory);
+  }
+  {
+    // Drops the last byte of the second message.
+    std::ifstream in(test_file, std::ios::in | std::ios::binary);
+    const string data((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    std::ofstream out(test_file, std::ios::out | std::ios::binary);
+    out.write(data.data(), data.size() - 1);
+  }
+  ProtoStreamReader reader(test_file);
+  mapping::proto::Trajectory trajectory;
+  ASSERT_TRUE(reader.ReadProto(&trajectory));
+  EXPECT_EQ(42, trajectory.node(0).timestamp());
+  EXPECT_FALSE(reader.ReadProto(&trajectory));
+  EXPECT_FALSE(reader.eof());
+  remove(test_file.c_str());
+
+  ProtoStreamReader missing_file_reader(test_file);
+  EXPECT_FALSE(missing_file_reader.ReadProto(&trajectory));
+  EXPECT_FALSE(missing_file_reader.eof());
+}
+
 }  // namespace
 }  // namespace io
 }  // namespace cartographer
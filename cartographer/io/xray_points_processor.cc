@@ -23,6 +23,7 @@
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
+#include "cartographer/common/parallel_for.h"
 #include "cartographer/io/draw_trajectories.h"
 #include "cartographer/io/image.h"
 #include "cartographer/mapping/detect_floors.h"
@@ -61,25 +62,31 @@ Image IntoImage(const PixelDataMatrix& mat) {
     }
   }
 
-  for (int y = 0; y < mat.rows(); ++y) {
-    for (int x = 0; x < mat.cols(); ++x) {
-      const PixelData& cell = mat(y, x);
-      if (cell.num_occupied_cells_in_column == 0.) {
-        image.SetPixel(x, y, {{255, 255, 255}});
-        continue;
-      }
+  // Rows are independent, so they are colored in parallel.
+  common::ParallelFor(
+      0 /* num_threads */, mat.rows(),
+      [&mat, &image, max](const size_t begin, const size_t end) {
+        for (int y = begin; y < static_cast<int>(end); ++y) {
+          for (int x = 0; x < mat.cols(); ++x) {
+            const PixelData& cell = mat(y, x);
+            if (cell.num_occupied_cells_in_column == 0.) {
+              image.SetPixel(x, y, {{255, 255, 255}});
+              continue;
+            }
 
-      // We use a logarithmic weighting for how saturated a pixel will be. The
-      // basic idea here was that walls (full height) are fully saturated, but
-      // details like chairs and tables are still well visible.
-      const float saturation =
-          std::log(cell.num_occupied_cells_in_column) / max;
-      const FloatColor color = {{Mix(1.f, cell.mean_r, saturation),
-                                 Mix(1.f, cell.mean_g, saturation),
-                                 Mix(1.f, cell.mean_b, saturation)}};
-      image.SetPixel(x, y, ToUint8Color(color));
-    }
-  }
+            // We use a logarithmic weighting for how saturated a pixel will
+            // be. The basic idea here was that walls (full height) are fully
+            // saturated, but details like chairs and tables are still well
+            // visible.
+            const float saturation =
+                std::log(cell.num_occupied_cells_in_column) / max;
+            const FloatColor color = {{Mix(1.f, cell.mean_r, saturation),
+                                       Mix(1.f, cell.mean_g, saturation),
+                                       Mix(1.f, cell.mean_b, saturation)}};
+            image.SetPixel(x, y, ToUint8Color(color));
+          }
+        }
+      });
   return image;
 }
 
@@ -101,16 +108,29 @@ XRayPointsProcessor::XRayPointsProcessor(
     const DrawTrajectories& draw_trajectories, const string& output_filename,
     const std::vector<mapping::proto::Trajectory>& trajectories,
     FileWriterFactory file_writer_factory, PointsProcessor* const next)
+    : XRayPointsProcessor({View{voxel_size, transform, output_filename,
+                                0 /* tile_size_pixels */}},
+                          floors, draw_trajectories, trajectories,
+                          file_writer_factory, next) {}
+
+XRayPointsProcessor::XRayPointsProcessor(
+    const std::vector<View>& views, const std::vector<mapping::Floor>& floors,
+    const DrawTrajectories& draw_trajectories,
+    const std::vector<mapping::proto::Trajectory>& trajectories,
+    FileWriterFactory file_writer_factory, PointsProcessor* const next)
     : draw_trajectories_(draw_trajectories),
       trajectories_(trajectories),
       file_writer_factory_(file_writer_factory),
       next_(next),
       floors_(floors),
-      output_filename_(output_filename),
-      transform_(transform) {
-  for (size_t i = 0; i < (floors_.empty() ? 1 : floors.size()); ++i) {
-    aggregations_.emplace_back(
-        Aggregation{mapping_3d::HybridGridBase<bool>(voxel_size), {}});
+      view_data_(views.size()) {
+  CHECK(!views.empty());
+  for (size_t i = 0; i != views.size(); ++i) {
+    view_data_[i].view = views[i];
+    for (size_t j = 0; j < (floors_.empty() ? 1 : floors_.size()); ++j) {
+      view_data_[i].aggregations.emplace_back(Aggregation{
+          mapping_3d::HybridGridBase<bool>(views[i].voxel_size), {}});
+    }
   }
 }
 
@@ -132,32 +152,65 @@ std::unique_ptr<XRayPointsProcessor> XRayPointsProcessor::FromDictionary(
     floors = mapping::DetectFloors(trajectories.at(0));
   }
 
+  // Each entry of 'views' has its own 'transform' and 'filename', and may
+  // override the 'voxel_size' and 'tile_size_pixels'. Without 'views', there
+  // is a single view.
+  const auto view_from_dictionary =
+      [dictionary](common::LuaParameterDictionary* const view_dictionary) {
+        const auto get_tile_size_pixels =
+            [](common::LuaParameterDictionary* const dictionary) {
+              return dictionary->HasKey("tile_size_pixels")
+                         ? dictionary->GetNonNegativeInt("tile_size_pixels")
+                         : 0;
+            };
+        return View{
+            view_dictionary->HasKey("voxel_size")
+                ? view_dictionary->GetDouble("voxel_size")
+                : dictionary->GetDouble("voxel_size"),
+            transform::FromDictionary(
+                view_dictionary->GetDictionary("transform").get())
+                .cast<float>(),
+            view_dictionary->GetString("filename"),
+            view_dictionary->HasKey("tile_size_pixels")
+                ? get_tile_size_pixels(view_dictionary)
+                : get_tile_size_pixels(dictionary)};
+      };
+  std::vector<View> views;
+  if (dictionary->HasKey("views")) {
+    for (const auto& view_dictionary :
+         dictionary->GetDictionary("views")->GetArrayValuesAsDictionaries()) {
+      views.push_back(view_from_dictionary(view_dictionary.get()));
+    }
+  } else {
+    views.push_back(view_from_dictionary(dictionary));
+  }
+
   return common::make_unique<XRayPointsProcessor>(
-      dictionary->GetDouble("voxel_size"),
-      transform::FromDictionary(dictionary->GetDictionary("transform").get())
-          .cast<float>(),
-      floors, draw_trajectories, dictionary->GetString("filename"),
-      trajectories, file_writer_factory, next);
+      views, floors, draw_trajectories, trajectories, file_writer_factory,
+      next);
 }
 
-void XRayPointsProcessor::WriteVoxels(const Aggregation& aggregation,
-                                      FileWriter* const file_writer) {
-  if (bounding_box_.isEmpty()) {
+void XRayPointsProcessor::WriteVoxels(const ViewData& view_data,
+                                      const Aggregation& aggregation,
+                                      const string& filename) {
+  const Eigen::AlignedBox3i& bounding_box = view_data.bounding_box;
+  if (bounding_box.isEmpty()) {
     LOG(WARNING) << "Not writing output: bounding box is empty.";
     return;
   }
 
   // Returns the (x, y) pixel of the given 'index'.
-  const auto voxel_index_to_pixel = [this](const Eigen::Array3i& index) {
+  const auto voxel_index_to_pixel = [&bounding_box](
+                                        const Eigen::Array3i& index) {
     // We flip the y axis, since matrices rows are counted from the top.
-    return Eigen::Array2i(bounding_box_.max()[1] - index[1],
-                          bounding_box_.max()[2] - index[2]);
+    return Eigen::Array2i(bounding_box.max()[1] - index[1],
+                          bounding_box.max()[2] - index[2]);
   };
 
   // Hybrid grid uses X: forward, Y: left, Z: up.
   // For the screen we are using. X: right, Y: up
-  const int xsize = bounding_box_.sizes()[1] + 1;
-  const int ysize = bounding_box_.sizes()[2] + 1;
+  const int xsize = bounding_box.sizes()[1] + 1;
+  const int ysize = bounding_box.sizes()[2] + 1;
   PixelDataMatrix pixel_data_matrix = PixelDataMatrix(ysize, xsize);
   for (mapping_3d::HybridGridBase<bool>::Iterator it(aggregation.voxels);
        !it.Done(); it.Next()) {
@@ -174,31 +227,41 @@ void XRayPointsProcessor::WriteVoxels(const Aggregation& aggregation,
 
   Image image = IntoImage(pixel_data_matrix);
   if (draw_trajectories_ == DrawTrajectories::kYes) {
+    const transform::Rigid3f& transform = view_data.view.transform;
     for (size_t i = 0; i < trajectories_.size(); ++i) {
       DrawTrajectory(
           trajectories_[i], GetColor(i),
           [&voxel_index_to_pixel, &aggregation,
-           this](const transform::Rigid3d& pose) -> Eigen::Array2i {
+           &transform](const transform::Rigid3d& pose) -> Eigen::Array2i {
             return voxel_index_to_pixel(aggregation.voxels.GetCellIndex(
-                (transform_ * pose.cast<float>()).translation()));
+                (transform * pose.cast<float>()).translation()));
           },
           image.GetCairoSurface().get());
     }
   }
 
-  image.WritePng(file_writer);
+  if (view_data.view.tile_size_pixels > 0) {
+    WritePngTiles(image, view_data.view.tile_size_pixels, filename,
+                  file_writer_factory_, 0 /* num_threads */);
+    return;
+  }
+  const std::unique_ptr<FileWriter> file_writer =
+      file_writer_factory_(filename + ".png");
+  image.WritePng(file_writer.get());
   CHECK(file_writer->Close());
 }
 
 void XRayPointsProcessor::Insert(const PointsBatch& batch,
-                                 Aggregation* const aggregation) {
+                                 const transform::Rigid3f& transform,
+                                 Aggregation* const aggregation,
+                                 Eigen::AlignedBox3i* const bounding_box) {
   constexpr FloatColor kDefaultColor = {{0.f, 0.f, 0.f}};
   for (size_t i = 0; i < batch.points.size(); ++i) {
-    const Eigen::Vector3f camera_point = transform_ * batch.points[i];
+    const Eigen::Vector3f camera_point = transform * batch.points[i];
     const Eigen::Array3i cell_index =
         aggregation->voxels.GetCellIndex(camera_point);
     *aggregation->voxels.mutable_value(cell_index) = true;
-    bounding_box_.extend(cell_index.matrix());
+    bounding_box->extend(cell_index.matrix());
     ColumnData& column_data =
         aggregation->column_data[std::make_pair(cell_index[1], cell_index[2])];
     const auto& color =
@@ -211,31 +274,38 @@ void XRayPointsProcessor::Insert(const PointsBatch& batch,
 }
 
 void XRayPointsProcessor::Process(std::unique_ptr<PointsBatch> batch) {
+  // The floors containing the batch are the same for all views.
+  std::vector<int> aggregation_indices;
   if (floors_.empty()) {
-    CHECK_EQ(aggregations_.size(), 1);
-    Insert(*batch, &aggregations_[0]);
+    aggregation_indices.push_back(0);
   } else {
     for (size_t i = 0; i < floors_.size(); ++i) {
-      if (!ContainedIn(batch->start_time, floors_[i].timespans)) {
-        continue;
+      if (ContainedIn(batch->start_time, floors_[i].timespans)) {
+        aggregation_indices.push_back(i);
       }
-      Insert(*batch, &aggregations_[i]);
+    }
+  }
+  for (ViewData& view_data : view_data_) {
+    for (const int aggregation_index : aggregation_indices) {
+      Insert(*batch, view_data.view.transform,
+             &view_data.aggregations[aggregation_index],
+             &view_data.bounding_box);
     }
   }
   next_->Process(std::move(batch));
 }
 
 PointsProcessor::FlushResult XRayPointsProcessor::Flush() {
-  if (floors_.empty()) {
-    CHECK_EQ(aggregations_.size(), 1);
-    WriteVoxels(aggregations_[0],
-                file_writer_factory_(output_filename_ + ".png").get());
-  } else {
-    for (size_t i = 0; i < floors_.size(); ++i) {
-      WriteVoxels(
-          aggregations_[i],
-          file_writer_factory_(output_filename_ + std::to_string(i) + ".png")
-              .get());
+  for (const ViewData& view_data : view_data_) {
+    const string& output_filename = view_data.view.output_filename;
+    if (floors_.empty()) {
+      CHECK_EQ(view_data.aggregations.size(), 1);
+      WriteVoxels(view_data, view_data.aggregations[0], output_filename);
+    } else {
+      for (size_t i = 0; i < floors_.size(); ++i) {
+        WriteVoxels(view_data, view_data.aggregations[i],
+                    output_filename + std::to_string(i));
+      }
     }
   }
 
@@ -18,6 +18,7 @@
 #define CARTOGRAPHER_IO_XRAY_POINTS_PROCESSOR_H_
 
 #include <map>
+#include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
@@ -32,11 +33,24 @@ namespace cartographer {
 namespace io {
 
 // Creates X-ray cuts through the points with pixels being 'voxel_size' big.
+// Several views, e.g. different projections or resolutions, can be created in
+// a single pass over the points.
 class XRayPointsProcessor : public PointsProcessor {
  public:
   constexpr static const char* kConfigurationFileActionName =
       "write_xray_image";
   enum class DrawTrajectories { kNo, kYes };
+
+  // A projection of the points written to 'output_filename', or to one file
+  // per floor if floors are separated. If 'tile_size_pixels' is positive,
+  // each image is written as PNG tiles of that size, see WritePngTiles().
+  struct View {
+    double voxel_size;
+    transform::Rigid3f transform;
+    string output_filename;
+    int tile_size_pixels;
+  };
+
   XRayPointsProcessor(
       double voxel_size, const transform::Rigid3f& transform,
       const std::vector<mapping::Floor>& floors,
@@ -44,6 +58,12 @@ class XRayPointsProcessor : public PointsProcessor {
       const std::vector<mapping::proto::Trajectory>& trajectories,
       FileWriterFactory file_writer_factory, PointsProcessor* next);
 
+  XRayPointsProcessor(
+      const std::vector<View>& views, const std::vector<mapping::Floor>& floors,
+      const DrawTrajectories& draw_trajectories,
+      const std::vector<mapping::proto::Trajectory>& trajectories,
+      FileWriterFactory file_writer_factory, PointsProcessor* next);
+
   static std::unique_ptr<XRayPointsProcessor> FromDictionary(
       const std::vector<mapping::proto::Trajectory>& trajectories,
       FileWriterFactory file_writer_factory,
@@ -54,7 +74,10 @@ class XRayPointsProcessor : public PointsProcessor {
   void Process(std::unique_ptr<PointsBatch> batch) override;
   FlushResult Flush() override;
 
-  Eigen::AlignedBox3i bounding_box() const { return bounding_box_; }
+  // Returns the bounding box of the first view.
+  Eigen::AlignedBox3i bounding_box() const {
+    return view_data_.front().bounding_box;
+  }
 
  private:
   struct ColumnData {
@@ -69,9 +92,21 @@ class XRayPointsProcessor : public PointsProcessor {
     std::map<std::pair<int, int>, ColumnData> column_data;
   };
 
-  void WriteVoxels(const Aggregation& aggregation,
-                   FileWriter* const file_writer);
-  void Insert(const PointsBatch& batch, Aggregation* aggregation);
+  // Cannot be copied, so 'view_data_' is sized once and never grows.
+  struct ViewData {
+    View view;
+    // Only has one entry if we do not separate into floors.
+    std::vector<Aggregation> aggregations;
+    // Bounding box containing all cells with data in all 'aggregations'.
+    Eigen::AlignedBox3i bounding_box;
+  };
+
+  // Writes the image of 'aggregation' to 'filename' with the extension ".png",
+  // or as PNG tiles named after 'filename'.
+  void WriteVoxels(const ViewData& view_data, const Aggregation& aggregation,
+                   const string& filename);
+  void Insert(const PointsBatch& batch, const transform::Rigid3f& transform,
+              Aggregation* aggregation, Eigen::AlignedBox3i* bounding_box);
 
   const DrawTrajectories draw_trajectories_;
   const std::vector<mapping::proto::Trajectory> trajectories_;
@@ -81,14 +116,7 @@ class XRayPointsProcessor : public PointsProcessor {
   // If empty, we do not separate into floors.
   std::vector<mapping::Floor> floors_;
 
-  const string output_filename_;
-  const transform::Rigid3f transform_;
-
-  // Only has one entry if we do not separate into floors.
-  std::vector<Aggregation> aggregations_;
-
-  // Bounding box containing all cells with data in all 'aggregations_'.
-  Eigen::AlignedBox3i bounding_box_;
+  std::vector<ViewData> view_data_;
 };
 
 }  // namespace io
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays the nodes of a serialized state through a MapBuilder as fast as
+// possible and reports the throughput, the background work and the memory
+// used. It is meant to compare configurations on the same recorded data.
+//
+// The range data of each node is added in the tracking frame, with synthetic
+// IMU data derived from the local node poses if the configuration needs it.
+// Since nodes are what remains after the motion filter, this exercises local
+// and global SLAM at the rate at which nodes are created.
+//
+// With -num_chunks greater than 1, each trajectory is split into overlapping
+// chunks of equal duration which are mapped as separate trajectories on one
+// thread each, so that local SLAM runs in parallel. The chunks are tied
+// together by SparsePoseGraph::LinkOverlappingTrajectories().
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/configuration_file_resolver.h"
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
+#include "cartographer/io/proto_stream.h"
+#include "cartographer/mapping/map_builder.h"
+#include "cartographer/mapping/proto/serialization.pb.h"
+#include "cartographer/mapping/proto/sparse_pose_graph.pb.h"
+#include "cartographer/mapping/trajectory_builder.h"
+#include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_string(configuration_directory, "",
+              "First directory in which configuration files are searched, "
+              "second is always the Cartographer installation to allow "
+              "including files from there.");
+DEFINE_string(configuration_basename, "",
+              "Basename, i.e. not containing any directory prefix, of the "
+              "configuration file. It has to return a table with the entries "
+              "'map_builder' and 'trajectory_builder'.");
+DEFINE_string(pose_graph_filename, "",
+              "Proto stream file written by MapBuilder::SerializeState() "
+              "whose nodes are replayed.");
+DEFINE_int32(num_chunks, 1,
+             "Number of overlapping chunks each trajectory is split into and "
+             "mapped in parallel.");
+DEFINE_double(chunk_overlap_seconds, 10.,
+              "Duration by which each chunk extends into the next one.");
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr char kRangeSensorId[] = "range";
+constexpr char kImuSensorId[] = "imu";
+constexpr double kGravity = 9.81;
+
+// Returns the node data of each trajectory in the proto stream, ordered by
+// node index.
+std::map<int, std::map<int, proto::TrajectoryNodeData>> ReadNodeData(
+    const string& filename) {
+  io::ProtoStreamReader reader(filename);
+  proto::SparsePoseGraph pose_graph;
+  CHECK(reader.ReadProto(&pose_graph)) << "Failed to read " << filename;
+  std::map<int, std::map<int, proto::TrajectoryNodeData>> node_data;
+  proto::SerializedData serialized_data;
+  while (reader.ReadProto(&serialized_data)) {
+    if (serialized_data.has_node()) {
+      const proto::Node& node = serialized_data.node();
+      node_data[node.node_id().trajectory_id()][node.node_id().node_index()] =
+          node.node_data();
+    }
+  }
+  return node_data;
+}
+
+// Returns the peak resident set size of this process in KiB, or -1 if it is
+// unknown.
+int64 GetPeakResidentSetSizeInKiB() {
+  std::ifstream status("/proc/self/status");
+  string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::stoll(line.substr(6));
+    }
+  }
+  return -1;
+}
+
+// Adds the range data of 'nodes' to 'trajectory_builder'. If 'add_imu_data'
+// is true, IMU data is added at the time of each node, whose angular velocity
+// leads to the orientation of the next node.
+void AddNodes(const std::vector<TrajectoryNode::Data>& nodes,
+              const bool use_trajectory_builder_2d, const bool add_imu_data,
+              TrajectoryBuilder* const trajectory_builder) {
+  for (size_t i = 0; i != nodes.size(); ++i) {
+    const TrajectoryNode::Data& node = nodes[i];
+    const Eigen::Quaterniond& rotation = node.initial_pose.rotation();
+    if (add_imu_data) {
+      Eigen::Vector3d angular_velocity = Eigen::Vector3d::Zero();
+      if (i + 1 != nodes.size()) {
+        const double delta_t =
+            common::ToSeconds(nodes[i + 1].time - node.time);
+        if (delta_t > 0.) {
+          angular_velocity =
+              transform::RotationQuaternionToAngleAxisVector(
+                  rotation.inverse() *
+                  nodes[i + 1].initial_pose.rotation()) /
+              delta_t;
+        }
+      }
+      trajectory_builder->AddImuData(
+          kImuSensorId, node.time,
+          rotation.inverse() * Eigen::Vector3d(0., 0., kGravity),
+          angular_velocity);
+    }
+    // In 2D, nodes keep their returns in the gravity aligned frame.
+    trajectory_builder->AddRangefinderData(
+        kRangeSensorId, node.time, Eigen::Vector3f::Zero(),
+        use_trajectory_builder_2d
+            ? sensor::TransformPointCloud(
+                  node.filtered_gravity_aligned_point_cloud,
+                  transform::Rigid3f::Rotation(
+                      node.gravity_alignment.inverse().cast<float>()))
+            : node.high_resolution_point_cloud);
+  }
+}
+
+// Splits the time-ordered 'nodes' into 'num_chunks' chunks of equal duration,
+// each of which also contains the nodes up to 'overlap' after its end. Empty
+// chunks are dropped.
+std::vector<std::vector<TrajectoryNode::Data>> SplitIntoChunks(
+    const std::vector<TrajectoryNode::Data>& nodes, const int num_chunks,
+    const common::Duration overlap) {
+  CHECK_GE(num_chunks, 1);
+  if (num_chunks == 1 || nodes.empty()) {
+    return {nodes};
+  }
+  const common::Time start_time = nodes.front().time;
+  const common::Duration chunk_duration =
+      (nodes.back().time - start_time) / num_chunks;
+  std::vector<std::vector<TrajectoryNode::Data>> chunks;
+  for (int i = 0; i != num_chunks; ++i) {
+    const common::Time chunk_start_time = start_time + i * chunk_duration;
+    const common::Time chunk_end_time =
+        i + 1 == num_chunks ? nodes.back().time
+                            : chunk_start_time + chunk_duration + overlap;
+    std::vector<TrajectoryNode::Data> chunk;
+    for (const TrajectoryNode::Data& node : nodes) {
+      if (node.time >= chunk_start_time && node.time <= chunk_end_time) {
+        chunk.push_back(node);
+      }
+    }
+    if (!chunk.empty()) {
+      chunks.push_back(std::move(chunk));
+    }
+  }
+  return chunks;
+}
+
+void Run() {
+  CHECK(!FLAGS_configuration_basename.empty())
+      << "-configuration_basename is missing.";
+  CHECK(!FLAGS_pose_graph_filename.empty())
+      << "-pose_graph_filename is missing.";
+  auto file_resolver = common::make_unique<common::ConfigurationFileResolver>(
+      std::vector<string>{FLAGS_configuration_directory});
+  const string code =
+      file_resolver->GetFileContentOrDie(FLAGS_configuration_basename);
+  common::LuaParameterDictionary lua_parameter_dictionary(
+      code, std::move(file_resolver));
+  const proto::MapBuilderOptions map_builder_options =
+      CreateMapBuilderOptions(
+          lua_parameter_dictionary.GetDictionary("map_builder").get());
+  const proto::TrajectoryBuilderOptions trajectory_builder_options =
+      CreateTrajectoryBuilderOptions(
+          lua_parameter_dictionary.GetDictionary("trajectory_builder").get());
+  const bool use_trajectory_builder_2d =
+      map_builder_options.use_trajectory_builder_2d();
+  const bool add_imu_data =
+      !use_trajectory_builder_2d ||
+      trajectory_builder_options.trajectory_builder_2d_options()
+          .use_imu_data();
+  std::unordered_set<string> expected_sensor_ids = {kRangeSensorId};
+  if (add_imu_data) {
+    expected_sensor_ids.insert(kImuSensorId);
+  }
+
+  // Chunks are added on separate threads, which the collation of sensor data
+  // would serialize.
+  proto::TrajectoryBuilderOptions chunk_trajectory_builder_options =
+      trajectory_builder_options;
+  if (FLAGS_num_chunks > 1) {
+    chunk_trajectory_builder_options.set_presorted_sensor_data(true);
+  }
+
+  const auto node_data = ReadNodeData(FLAGS_pose_graph_filename);
+  MapBuilder map_builder(map_builder_options);
+  int64 num_nodes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& trajectory : node_data) {
+    std::vector<TrajectoryNode::Data> nodes;
+    for (const auto& entry : trajectory.second) {
+      nodes.push_back(FromProto(entry.second));
+    }
+    num_nodes += nodes.size();
+    const std::vector<std::vector<TrajectoryNode::Data>> chunks =
+        SplitIntoChunks(nodes, FLAGS_num_chunks,
+                        common::FromSeconds(FLAGS_chunk_overlap_seconds));
+    std::vector<int> trajectory_ids;
+    for (size_t i = 0; i != chunks.size(); ++i) {
+      trajectory_ids.push_back(map_builder.AddTrajectoryBuilder(
+          expected_sensor_ids, chunk_trajectory_builder_options));
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != chunks.size(); ++i) {
+      TrajectoryBuilder* const trajectory_builder =
+          map_builder.GetTrajectoryBuilder(trajectory_ids[i]);
+      threads.emplace_back([&chunks, i, use_trajectory_builder_2d,
+                            add_imu_data, trajectory_builder]() {
+        AddNodes(chunks[i], use_trajectory_builder_2d, add_imu_data,
+                 trajectory_builder);
+      });
+    }
+    for (size_t i = 0; i != chunks.size(); ++i) {
+      threads[i].join();
+      map_builder.FinishTrajectory(trajectory_ids[i]);
+      if (i != 0) {
+        map_builder.sparse_pose_graph()->LinkOverlappingTrajectories(
+            trajectory_ids[i], trajectory_ids[i - 1]);
+      }
+    }
+  }
+  const double replay_seconds = std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count();
+  map_builder.sparse_pose_graph()->RunFinalOptimization();
+  const double total_seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+
+  LOG(INFO) << "Replayed " << num_nodes << " nodes of " << node_data.size()
+            << " trajectories in " << replay_seconds << " s: "
+            << num_nodes / replay_seconds << " scans per second.";
+  LOG(INFO) << "Including the final optimization: " << total_seconds
+            << " s, " << num_nodes / total_seconds << " scans per second.";
+  LOG(INFO) << "Background work:\n"
+            << map_builder.PollThreadPoolStatistics().ToString();
+  LOG(INFO) << "Peak resident set size: "
+            << GetPeakResidentSetSizeInKiB() / 1024 << " MiB.";
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks offline SLAM by replaying the nodes of a serialized state "
+      "through a MapBuilder.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping::Run();
+  return EXIT_SUCCESS;
+}
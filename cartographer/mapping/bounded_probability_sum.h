@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_BOUNDED_PROBABILITY_SUM_H_
+#define CARTOGRAPHER_MAPPING_BOUNDED_PROBABILITY_SUM_H_
+
+#include <algorithm>
+
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Points are scored in chunks of this size by ComputeBoundedProbabilitySum().
+constexpr int kNumPointsPerScoringChunk = 64;
+
+// Returns the sum of the probabilities of 'num_points' points looked up by
+// 'grid_accessor', which is a compile-time policy providing
+//
+//   float SumProbabilities(int begin, int end) const;
+//
+// for the points with indices in [begin, end). Lookups of the accessor are
+// inlined into the scoring loop of the scan matchers, so a new grid type only
+// needs an accessor and no virtual or std::function call is made per point.
+//
+// Returns early with a partial sum once the sum is known not to exceed
+// 'min_probability_sum'.
+template <typename GridAccessor>
+float ComputeBoundedProbabilitySum(const GridAccessor& grid_accessor,
+                                   const int num_points,
+                                   const float min_probability_sum) {
+  float probability_sum = 0.f;
+  for (int begin = 0; begin < num_points; begin += kNumPointsPerScoringChunk) {
+    const int end = std::min(begin + kNumPointsPerScoringChunk, num_points);
+    probability_sum += grid_accessor.SumProbabilities(begin, end);
+    if (probability_sum + (num_points - end) * kMaxProbability <=
+        min_probability_sum) {
+      break;
+    }
+  }
+  return probability_sum;
+}
+
+// Grid accessor for ComputeBoundedProbabilitySum() which looks up the
+// 'point_cloud' transformed by 'pose' in a 3D 'grid' providing GetCellIndex()
+// and GetProbability().
+template <typename GridType>
+class TransformedPointCloudAccessor {
+ public:
+  TransformedPointCloudAccessor(const GridType& grid,
+                                const sensor::PointCloud& point_cloud,
+                                const transform::Rigid3f& pose)
+      : grid_(grid), point_cloud_(point_cloud), pose_(pose) {}
+
+  float SumProbabilities(const int begin, const int end) const {
+    float probability_sum = 0.f;
+    for (int i = begin; i != end; ++i) {
+      probability_sum +=
+          grid_.GetProbability(grid_.GetCellIndex(pose_ * point_cloud_[i]));
+    }
+    return probability_sum;
+  }
+
+ private:
+  const GridType& grid_;
+  const sensor::PointCloud& point_cloud_;
+  const transform::Rigid3f pose_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_BOUNDED_PROBABILITY_SUM_H_
@@ -32,27 +32,81 @@ CollatedTrajectoryBuilder::CollatedTrajectoryBuilder(
     sensor::Collator* const sensor_collator, const int trajectory_id,
     const std::unordered_set<string>& expected_sensor_ids,
     std::unique_ptr<GlobalTrajectoryBuilderInterface>
-        wrapped_trajectory_builder)
+        wrapped_trajectory_builder,
+    const bool presorted_sensor_data)
     : sensor_collator_(sensor_collator),
       trajectory_id_(trajectory_id),
+      presorted_sensor_data_(presorted_sensor_data),
       wrapped_trajectory_builder_(std::move(wrapped_trajectory_builder)),
       last_logging_time_(std::chrono::steady_clock::now()) {
-  sensor_collator_->AddTrajectory(
-      trajectory_id, expected_sensor_ids,
+  const sensor::Collator::Callback callback =
       [this](const string& sensor_id, std::unique_ptr<sensor::Data> data) {
         HandleCollatedSensorData(sensor_id, std::move(data));
-      });
+      };
+  if (presorted_sensor_data) {
+    sensor_collator_->AddPresortedTrajectory(trajectory_id,
+                                             expected_sensor_ids, callback);
+  } else {
+    sensor_collator_->AddTrajectory(trajectory_id, expected_sensor_ids,
+                                    callback);
+  }
+  for (const string& sensor_id : expected_sensor_ids) {
+    sensor_handles_[sensor_id] =
+        sensor_collator_->GetSensorHandle(trajectory_id, sensor_id);
+  }
 }
 
 CollatedTrajectoryBuilder::~CollatedTrajectoryBuilder() {}
 
+void CollatedTrajectoryBuilder::RegisterMetrics(
+    metrics::Registry* const registry) {
+  for (const auto& entry : sensor_handles_) {
+    const metrics::Labels labels = {
+        {"trajectory_id", std::to_string(trajectory_id_)},
+        {"sensor_id", entry.first}};
+    sensor_metrics_[entry.first] = SensorMetrics{
+        registry->GetCounter("cartographer_sensor_data_total",
+                             "Number of collated sensor data.", labels),
+        registry->GetHistogram(
+            "cartographer_sensor_data_processing_seconds",
+            "Time it took to process a collated sensor data.", labels,
+            metrics::Histogram::ScaledPowersOf(2., 1e-5, 10.))};
+  }
+  wrapped_trajectory_builder_->RegisterMetrics(registry);
+}
+
 const PoseEstimate& CollatedTrajectoryBuilder::pose_estimate() const {
   return wrapped_trajectory_builder_->pose_estimate();
 }
 
+bool CollatedTrajectoryBuilder::ExtrapolateGlobalPose(
+    const common::Time time, transform::Rigid3d* const pose) const {
+  return wrapped_trajectory_builder_->ExtrapolateGlobalPose(time, pose);
+}
+
+common::Duration CollatedTrajectoryBuilder::GetDeadReckoningGap() const {
+  return wrapped_trajectory_builder_->GetDeadReckoningGap();
+}
+
 void CollatedTrajectoryBuilder::AddSensorData(
     const string& sensor_id, std::unique_ptr<sensor::Data> data) {
-  sensor_collator_->AddSensorData(trajectory_id_, sensor_id, std::move(data));
+  const auto it = sensor_handles_.find(sensor_id);
+  if (it == sensor_handles_.end()) {
+    // The collator ignores data of unexpected sensors with a warning.
+    sensor_collator_->AddSensorData(trajectory_id_, sensor_id,
+                                    std::move(data));
+    return;
+  }
+  if (!presorted_sensor_data_) {
+    // Presorted data is dispatched right away, so this would only repeat it.
+    data->AddUncollatedToTrajectoryBuilder(wrapped_trajectory_builder_.get());
+  }
+  sensor_collator_->AddSensorData(it->second, std::move(data));
+}
+
+void CollatedTrajectoryBuilder::UpdateRuntimeOptions(
+    const proto::TrajectoryBuilderRuntimeOptions& runtime_options) {
+  wrapped_trajectory_builder_->UpdateRuntimeOptions(runtime_options);
 }
 
 void CollatedTrajectoryBuilder::HandleCollatedSensorData(
@@ -76,7 +130,18 @@ void CollatedTrajectoryBuilder::HandleCollatedSensorData(
     last_logging_time_ = std::chrono::steady_clock::now();
   }
 
+  const auto metrics_it = sensor_metrics_.find(sensor_id);
+  if (metrics_it == sensor_metrics_.end()) {
+    data->AddToTrajectoryBuilder(wrapped_trajectory_builder_.get());
+    return;
+  }
+  const auto start_time = std::chrono::steady_clock::now();
   data->AddToTrajectoryBuilder(wrapped_trajectory_builder_.get());
+  metrics_it->second.processing_time->Observe(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time)
+          .count());
+  metrics_it->second.num_data->Increment();
 }
 
 }  // namespace mapping
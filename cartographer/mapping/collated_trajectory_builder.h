@@ -21,6 +21,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "cartographer/common/port.h"
@@ -28,6 +29,7 @@
 #include "cartographer/mapping/global_trajectory_builder_interface.h"
 #include "cartographer/mapping/submaps.h"
 #include "cartographer/mapping/trajectory_builder.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/sensor/collator.h"
 #include "cartographer/sensor/data.h"
 
@@ -36,35 +38,59 @@ namespace mapping {
 
 // Handles collating sensor data using a sensor::Collator, then passing it on to
 // a mapping::GlobalTrajectoryBuilderInterface which is common for 2D and 3D.
+// If 'presorted_sensor_data' is true, the sensor data has to be added in time
+// order and is not queued, see sensor::Collator::AddPresortedTrajectory().
 class CollatedTrajectoryBuilder : public TrajectoryBuilder {
  public:
   CollatedTrajectoryBuilder(
       sensor::Collator* sensor_collator, int trajectory_id,
       const std::unordered_set<string>& expected_sensor_ids,
       std::unique_ptr<GlobalTrajectoryBuilderInterface>
-          wrapped_trajectory_builder);
+          wrapped_trajectory_builder,
+      bool presorted_sensor_data);
   ~CollatedTrajectoryBuilder() override;
 
   CollatedTrajectoryBuilder(const CollatedTrajectoryBuilder&) = delete;
   CollatedTrajectoryBuilder& operator=(const CollatedTrajectoryBuilder&) =
       delete;
 
+  // Exports the number of sensor data of each expected sensor and the time it
+  // took to process them, which includes local scan matching, and the metrics
+  // of local SLAM to 'registry'. Must be called before the first sensor data is added.
+  void RegisterMetrics(metrics::Registry* registry);
+
   const PoseEstimate& pose_estimate() const override;
+  bool ExtrapolateGlobalPose(common::Time time,
+                             transform::Rigid3d* pose) const override;
+  common::Duration GetDeadReckoningGap() const override;
 
   void AddSensorData(const string& sensor_id,
                      std::unique_ptr<sensor::Data> data) override;
 
+  void UpdateRuntimeOptions(
+      const proto::TrajectoryBuilderRuntimeOptions& runtime_options) override;
+
  private:
+  struct SensorMetrics {
+    metrics::Counter* num_data;
+    metrics::Histogram* processing_time;
+  };
+
   void HandleCollatedSensorData(const string& sensor_id,
                                 std::unique_ptr<sensor::Data> data);
 
   sensor::Collator* const sensor_collator_;
   const int trajectory_id_;
+  const bool presorted_sensor_data_;
+  // Handles of the expected sensors in the 'sensor_collator_'.
+  std::unordered_map<string, int> sensor_handles_;
   std::unique_ptr<GlobalTrajectoryBuilderInterface> wrapped_trajectory_builder_;
 
   // Time at which we last logged the rates of incoming sensor data.
   std::chrono::steady_clock::time_point last_logging_time_;
   std::map<string, common::RateTimer<>> rate_timers_;
+  // Set by RegisterMetrics().
+  std::unordered_map<string, SensorMetrics> sensor_metrics_;
 };
 
 }  // namespace mapping
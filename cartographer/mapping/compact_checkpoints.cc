@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/compact_checkpoints.h"
+
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/proto/serialization.pb.h"
+#include "cartographer/mapping/proto/sparse_pose_graph.pb.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+namespace {
+
+// Index of the checkpoint and offset of a message in it.
+using Location = std::pair<int, uint64>;
+
+// Copies the SerializedData at 'location' to the 'writer' and returns its new
+// offset.
+uint64 CopySerializedData(
+    const std::vector<std::unique_ptr<io::ProtoStreamReader>>& readers,
+    const Location& location, io::ProtoStreamWriter* const writer) {
+  proto::SerializedData proto;
+  CHECK(readers.at(location.first)->ReadProtoAt(location.second, &proto));
+  return writer->WriteProto(proto);
+}
+
+}  // namespace
+
+void CompactCheckpoints(const std::vector<string>& checkpoint_filenames,
+                        io::ProtoStreamWriter* const writer) {
+  CHECK(!checkpoint_filenames.empty());
+  std::vector<std::unique_ptr<io::ProtoStreamReader>> readers;
+  std::map<SubmapId, Location> submap_locations;
+  std::map<NodeId, Location> node_locations;
+  proto::SerializedDataIndex index;
+  for (const string& checkpoint_filename : checkpoint_filenames) {
+    readers.push_back(
+        common::make_unique<io::ProtoStreamReader>(checkpoint_filename));
+    CHECK(readers.back()->ReadIndex(&index))
+        << "Could not read the index of " << checkpoint_filename;
+    const int checkpoint_index = readers.size() - 1;
+    for (const auto& entry : index.submap()) {
+      submap_locations[SubmapId{entry.submap_id().trajectory_id(),
+                                entry.submap_id().submap_index()}] =
+          Location(checkpoint_index, entry.offset());
+    }
+    for (const auto& entry : index.node()) {
+      node_locations[NodeId{entry.node_id().trajectory_id(),
+                            entry.node_id().node_index()}] =
+          Location(checkpoint_index, entry.offset());
+    }
+  }
+
+  // 'index' is the one of the last checkpoint now.
+  proto::SparsePoseGraph sparse_pose_graph;
+  CHECK(readers.back()->ReadProtoAt(index.sparse_pose_graph_offset(),
+                                    &sparse_pose_graph));
+  proto::SerializedDataIndex compacted_index;
+  compacted_index.set_sparse_pose_graph_offset(
+      writer->WriteProto(sparse_pose_graph));
+  for (const auto& submap_location : submap_locations) {
+    auto* const entry = compacted_index.add_submap();
+    entry->mutable_submap_id()->set_trajectory_id(
+        submap_location.first.trajectory_id);
+    entry->mutable_submap_id()->set_submap_index(
+        submap_location.first.submap_index);
+    entry->set_offset(
+        CopySerializedData(readers, submap_location.second, writer));
+  }
+  for (const auto& node_location : node_locations) {
+    auto* const entry = compacted_index.add_node();
+    entry->mutable_node_id()->set_trajectory_id(
+        node_location.first.trajectory_id);
+    entry->mutable_node_id()->set_node_index(node_location.first.node_index);
+    entry->set_offset(
+        CopySerializedData(readers, node_location.second, writer));
+  }
+  writer->WriteIndex(compacted_index);
+}
+
+}  // namespace mapping
+}  // namespace cartographer
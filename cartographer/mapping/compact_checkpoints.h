@@ -0,0 +1,39 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_COMPACT_CHECKPOINTS_H_
+#define CARTOGRAPHER_MAPPING_COMPACT_CHECKPOINTS_H_
+
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "cartographer/io/proto_stream.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Merges the proto streams 'checkpoint_filenames' written by
+// MapBuilder::SerializeStateIncrementally(), in the order they were written,
+// into a single proto stream in the format of MapBuilder::SerializeState().
+// The pose graph of the last checkpoint is used, and later versions of a
+// submap replace earlier ones.
+void CompactCheckpoints(const std::vector<string>& checkpoint_filenames,
+                        io::ProtoStreamWriter* writer);
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_COMPACT_CHECKPOINTS_H_
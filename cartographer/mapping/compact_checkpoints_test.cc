@@ -0,0 +1,139 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/compact_checkpoints.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cartographer/mapping/proto/serialization.pb.h"
+#include "cartographer/mapping/proto/sparse_pose_graph.pb.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+class CompactCheckpointsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const string tmpdir = P_tmpdir;
+    test_directory_ = tmpdir + "/compact_checkpoints_test_XXXXXX";
+    ASSERT_NE(mkdtemp(&test_directory_[0]), nullptr) << strerror(errno);
+  }
+
+  void TearDown() override { remove(test_directory_.c_str()); }
+
+  // Writes a checkpoint of a single trajectory with 'num_submaps' submaps,
+  // containing the submaps from 'first_submap_index' on and the nodes from
+  // 'first_node_index' to 'end_node_index'. Submaps store 'num_range_data'.
+  string WriteCheckpoint(const string& name, const int num_submaps,
+                         const int first_submap_index,
+                         const int first_node_index, const int end_node_index,
+                         const int num_range_data) {
+    const string filename = test_directory_ + "/" + name;
+    io::ProtoStreamWriter writer(filename);
+    proto::SerializedDataIndex index;
+    proto::SparsePoseGraph sparse_pose_graph;
+    auto* const trajectory = sparse_pose_graph.add_trajectory();
+    for (int i = 0; i != num_submaps; ++i) {
+      trajectory->add_submap();
+    }
+    for (int i = 0; i != end_node_index; ++i) {
+      trajectory->add_node()->set_timestamp(i);
+    }
+    index.set_sparse_pose_graph_offset(writer.WriteProto(sparse_pose_graph));
+    for (int i = first_submap_index; i != num_submaps; ++i) {
+      proto::SerializedData proto;
+      proto.mutable_submap()->mutable_submap_id()->set_submap_index(i);
+      proto.mutable_submap()->mutable_submap_2d()->set_num_range_data(
+          num_range_data);
+      auto* const entry = index.add_submap();
+      *entry->mutable_submap_id() = proto.submap().submap_id();
+      entry->set_offset(writer.WriteProto(proto));
+    }
+    for (int i = first_node_index; i != end_node_index; ++i) {
+      proto::SerializedData proto;
+      proto.mutable_node()->mutable_node_id()->set_node_index(i);
+      proto.mutable_node()->mutable_node_data()->set_timestamp(i);
+      auto* const entry = index.add_node();
+      *entry->mutable_node_id() = proto.node().node_id();
+      entry->set_offset(writer.WriteProto(proto));
+    }
+    writer.WriteIndex(index);
+    EXPECT_TRUE(writer.Close());
+    return filename;
+  }
+
+  string test_directory_;
+};
+
+TEST_F(CompactCheckpointsTest, MergesCheckpoints) {
+  const std::vector<string> checkpoint_filenames = {
+      WriteCheckpoint("0.pbstream", 2, 0, 0, 3, 10),
+      WriteCheckpoint("1.pbstream", 3, 1, 3, 5, 20),
+      WriteCheckpoint("2.pbstream", 3, 2, 5, 6, 30)};
+  const string compacted_filename = test_directory_ + "/compacted.pbstream";
+  {
+    io::ProtoStreamWriter writer(compacted_filename);
+    CompactCheckpoints(checkpoint_filenames, &writer);
+    ASSERT_TRUE(writer.Close());
+  }
+
+  io::ProtoStreamReader reader(compacted_filename);
+  proto::SparsePoseGraph sparse_pose_graph;
+  ASSERT_TRUE(reader.ReadProto(&sparse_pose_graph));
+  ASSERT_EQ(1, sparse_pose_graph.trajectory_size());
+  EXPECT_EQ(3, sparse_pose_graph.trajectory(0).submap_size());
+  EXPECT_EQ(6, sparse_pose_graph.trajectory(0).node_size());
+  const int expected_num_range_data[] = {10, 20, 30};
+  for (int i = 0; i != 3; ++i) {
+    proto::SerializedData proto;
+    ASSERT_TRUE(reader.ReadProto(&proto));
+    ASSERT_TRUE(proto.has_submap());
+    EXPECT_EQ(i, proto.submap().submap_id().submap_index());
+    EXPECT_EQ(expected_num_range_data[i],
+              proto.submap().submap_2d().num_range_data());
+  }
+  for (int i = 0; i != 6; ++i) {
+    proto::SerializedData proto;
+    ASSERT_TRUE(reader.ReadProto(&proto));
+    ASSERT_TRUE(proto.has_node());
+    EXPECT_EQ(i, proto.node().node_id().node_index());
+    EXPECT_EQ(i, proto.node().node_data().timestamp());
+  }
+  proto::SerializedData proto;
+  EXPECT_FALSE(reader.ReadProto(&proto));
+  EXPECT_TRUE(reader.eof());
+
+  proto::SerializedDataIndex index;
+  ASSERT_TRUE(reader.ReadIndex(&index));
+  EXPECT_EQ(3, index.submap_size());
+  ASSERT_EQ(6, index.node_size());
+  ASSERT_TRUE(reader.ReadProtoAt(index.node(4).offset(), &proto));
+  EXPECT_EQ(4, proto.node().node_data().timestamp());
+
+  for (const string& filename : checkpoint_filenames) {
+    remove(filename.c_str());
+  }
+  remove(compacted_filename.c_str());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/configuration_cache.h"
+
+#include "cartographer/io/proto_stream.h"
+
+namespace cartographer {
+namespace mapping {
+
+bool WriteConfigurationCache(
+    const string& filename,
+    const proto::ConfigurationCache& configuration_cache) {
+  io::ProtoStreamWriter writer(filename,
+                               io::ProtoStreamWriter::Compression::kNone);
+  writer.WriteProto(configuration_cache);
+  return writer.Close();
+}
+
+bool ReadConfigurationCache(
+    const string& filename, const string& configuration_key,
+    proto::ConfigurationCache* const configuration_cache) {
+  io::ProtoStreamReader reader(filename);
+  proto::ConfigurationCache proto;
+  if (!reader.ReadProto(&proto) ||
+      proto.configuration_key() != configuration_key) {
+    return false;
+  }
+  configuration_cache->Swap(&proto);
+  return true;
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_CONFIGURATION_CACHE_H_
+#define CARTOGRAPHER_MAPPING_CONFIGURATION_CACHE_H_
+
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/proto/configuration_cache.pb.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Writes 'configuration_cache' to 'filename' as an uncompressed proto stream.
+// Processes started later can read the options from it instead of evaluating
+// the Lua configuration, and trajectories can be added with the cached
+// TrajectoryBuilderOptions directly. Returns false if writing failed.
+bool WriteConfigurationCache(
+    const string& filename,
+    const proto::ConfigurationCache& configuration_cache);
+
+// Reads the options written by WriteConfigurationCache(). Returns false if
+// 'filename' cannot be read or was written for a different
+// 'configuration_key', in which case the options have to be built from the
+// configuration again.
+bool ReadConfigurationCache(const string& filename,
+                            const string& configuration_key,
+                            proto::ConfigurationCache* configuration_cache);
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_CONFIGURATION_CACHE_H_
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/configuration_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+class ConfigurationCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const string tmpdir = P_tmpdir;
+    test_directory_ = tmpdir + "/configuration_cache_test_XXXXXX";
+    ASSERT_NE(mkdtemp(&test_directory_[0]), nullptr) << strerror(errno);
+  }
+
+  void TearDown() override { remove(test_directory_.c_str()); }
+
+  string test_directory_;
+};
+
+TEST_F(ConfigurationCacheTest, WriteAndReadBack) {
+  const string filename = test_directory_ + "/configuration.cache";
+  proto::ConfigurationCache expected;
+  expected.set_configuration_key("return { num_threads = 4 }");
+  expected.mutable_map_builder_options()->set_num_background_threads(4);
+  expected.mutable_trajectory_builder_options()
+      ->mutable_trajectory_builder_2d_options()
+      ->set_max_range(30.f);
+  ASSERT_TRUE(WriteConfigurationCache(filename, expected));
+
+  proto::ConfigurationCache actual;
+  ASSERT_TRUE(
+      ReadConfigurationCache(filename, expected.configuration_key(), &actual));
+  EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+  EXPECT_EQ(remove(filename.c_str()), 0) << strerror(errno);
+}
+
+TEST_F(ConfigurationCacheTest, RejectsOtherConfiguration) {
+  const string filename = test_directory_ + "/configuration.cache";
+  proto::ConfigurationCache configuration_cache;
+  configuration_cache.set_configuration_key("return {}");
+  ASSERT_TRUE(WriteConfigurationCache(filename, configuration_cache));
+
+  proto::ConfigurationCache actual;
+  EXPECT_FALSE(ReadConfigurationCache(filename, "return { a = 1 }", &actual));
+  EXPECT_FALSE(actual.has_configuration_key());
+  EXPECT_FALSE(ReadConfigurationCache(test_directory_ + "/missing.cache",
+                                      "return {}", &actual));
+  EXPECT_EQ(remove(filename.c_str()), 0) << strerror(errno);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -17,7 +17,7 @@
 #include "cartographer/mapping/connected_components.h"
 
 #include <algorithm>
-#include <unordered_set>
+#include <unordered_map>
 
 #include "cartographer/mapping/proto/connected_components.pb.h"
 #include "glog/logging.h"
@@ -25,29 +25,55 @@
 namespace cartographer {
 namespace mapping {
 
+bool ConnectedComponents::Snapshot::TransitivelyConnected(
+    const int trajectory_id_a, const int trajectory_id_b) const {
+  if (trajectory_id_a == trajectory_id_b) {
+    return true;
+  }
+  const auto it_a = component_index.find(trajectory_id_a);
+  const auto it_b = component_index.find(trajectory_id_b);
+  if (it_a == component_index.end() || it_b == component_index.end()) {
+    return false;
+  }
+  return it_a->second == it_b->second;
+}
+
 ConnectedComponents::ConnectedComponents()
-    : lock_(), forest_(), connection_map_() {}
+    : lock_(),
+      forest_(),
+      connection_map_(),
+      snapshot_(std::make_shared<Snapshot>(Snapshot{0, {}, {}})) {}
 
 void ConnectedComponents::Add(const int trajectory_id) {
   common::MutexLocker locker(&lock_);
-  forest_.emplace(trajectory_id, trajectory_id);
+  if (forest_.emplace(trajectory_id, trajectory_id).second) {
+    PublishSnapshot();
+  }
 }
 
 void ConnectedComponents::Connect(const int trajectory_id_a,
                                   const int trajectory_id_b) {
   common::MutexLocker locker(&lock_);
-  Union(trajectory_id_a, trajectory_id_b);
+  const size_t num_trajectories = forest_.size();
+  if (Union(trajectory_id_a, trajectory_id_b) ||
+      forest_.size() != num_trajectories) {
+    PublishSnapshot();
+  }
   auto sorted_pair = std::minmax(trajectory_id_a, trajectory_id_b);
   ++connection_map_[sorted_pair];
 }
 
-void ConnectedComponents::Union(const int trajectory_id_a,
+bool ConnectedComponents::Union(const int trajectory_id_a,
                                 const int trajectory_id_b) {
   forest_.emplace(trajectory_id_a, trajectory_id_a);
   forest_.emplace(trajectory_id_b, trajectory_id_b);
   const int representative_a = FindSet(trajectory_id_a);
   const int representative_b = FindSet(trajectory_id_b);
+  if (representative_a == representative_b) {
+    return false;
+  }
   forest_[representative_a] = representative_b;
+  return true;
 }
 
 int ConnectedComponents::FindSet(const int trajectory_id) {
@@ -59,47 +85,48 @@ int ConnectedComponents::FindSet(const int trajectory_id) {
   return it->second;
 }
 
-bool ConnectedComponents::TransitivelyConnected(const int trajectory_id_a,
-                                                const int trajectory_id_b) {
-  if (trajectory_id_a == trajectory_id_b) {
-    return true;
+void ConnectedComponents::PublishSnapshot() {
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->version = std::atomic_load(&snapshot_)->version + 1;
+  // Map from representative to index of its component. Since 'forest_' is
+  // sorted, so are the components, and they are ordered by their smallest ID.
+  std::unordered_map<int, int> representative_to_index;
+  for (const auto& entry : forest_) {
+    const auto insertion_result = representative_to_index.emplace(
+        FindSet(entry.first), snapshot->components.size());
+    if (insertion_result.second) {
+      snapshot->components.emplace_back();
+    }
+    const int index = insertion_result.first->second;
+    snapshot->components[index].push_back(entry.first);
+    snapshot->component_index.emplace(entry.first, index);
   }
+  std::atomic_store(&snapshot_,
+                    std::shared_ptr<const Snapshot>(std::move(snapshot)));
+}
 
-  common::MutexLocker locker(&lock_);
+std::shared_ptr<const ConnectedComponents::Snapshot>
+ConnectedComponents::GetSnapshot() const {
+  return std::atomic_load(&snapshot_);
+}
 
-  if (forest_.count(trajectory_id_a) == 0 ||
-      forest_.count(trajectory_id_b) == 0) {
-    return false;
-  }
-  return FindSet(trajectory_id_a) == FindSet(trajectory_id_b);
+bool ConnectedComponents::TransitivelyConnected(const int trajectory_id_a,
+                                                const int trajectory_id_b) {
+  return GetSnapshot()->TransitivelyConnected(trajectory_id_a,
+                                              trajectory_id_b);
 }
 
 std::vector<std::vector<int>> ConnectedComponents::Components() {
-  // Map from cluster exemplar -> growing cluster.
-  std::unordered_map<int, std::vector<int>> map;
-  common::MutexLocker locker(&lock_);
-  for (const auto& trajectory_id_entry : forest_) {
-    map[FindSet(trajectory_id_entry.first)].push_back(
-        trajectory_id_entry.first);
-  }
-
-  std::vector<std::vector<int>> result;
-  result.reserve(map.size());
-  for (auto& pair : map) {
-    result.emplace_back(std::move(pair.second));
-  }
-  return result;
+  return GetSnapshot()->components;
 }
 
 std::vector<int> ConnectedComponents::GetComponent(const int trajectory_id) {
-  const int set_id = FindSet(trajectory_id);
-  std::vector<int> trajectory_ids;
-  for (const auto& entry : forest_) {
-    if (FindSet(entry.first) == set_id) {
-      trajectory_ids.push_back(entry.first);
-    }
+  const auto snapshot = GetSnapshot();
+  const auto it = snapshot->component_index.find(trajectory_id);
+  if (it == snapshot->component_index.end()) {
+    return {trajectory_id};
   }
-  return trajectory_ids;
+  return snapshot->components[it->second];
 }
 
 int ConnectedComponents::ConnectionCount(const int trajectory_id_a,
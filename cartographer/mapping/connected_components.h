@@ -18,9 +18,12 @@
 #define CARTOGRAPHER_MAPPING_CONNECTED_COMPONENTS_H_
 
 #include <map>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
 #include "cartographer/mapping/proto/connected_components.pb.h"
 #include "cartographer/mapping/submaps.h"
 
@@ -32,9 +35,24 @@ namespace mapping {
 // Connectivity includes both the count ("How many times have I _directly_
 // connected trajectories i and j?") and the transitive connectivity.
 //
-// This class is thread-safe.
+// This class is thread-safe. Queries of the transitive connectivity are
+// answered from an immutable snapshot which is republished whenever the
+// components change, so they do not wait for 'lock_'.
 class ConnectedComponents {
  public:
+  // Immutable grouping of the tracked trajectories into components.
+  struct Snapshot {
+    // Incremented whenever the components change.
+    int64 version;
+    // The trajectory IDs, grouped by connectivity. Each component is sorted.
+    std::vector<std::vector<int>> components;
+    // Maps each tracked trajectory ID to its index in 'components'.
+    std::map<int, int> component_index;
+
+    // Same as ConnectedComponents::TransitivelyConnected().
+    bool TransitivelyConnected(int trajectory_id_a, int trajectory_id_b) const;
+  };
+
   ConnectedComponents();
 
   ConnectedComponents(const ConnectedComponents&) = delete;
@@ -64,13 +82,19 @@ class ConnectedComponents {
   std::vector<std::vector<int>> Components() EXCLUDES(lock_);
 
   // The list of trajectory IDs that belong to the same connected component as
-  // 'trajectory_id'.
+  // 'trajectory_id'. If it is not being tracked, only 'trajectory_id' itself.
   std::vector<int> GetComponent(int trajectory_id) EXCLUDES(lock_);
 
+  // Returns the latest snapshot of the components. Does not wait for 'lock_'.
+  std::shared_ptr<const Snapshot> GetSnapshot() const;
+
  private:
   // Find the representative and compresses the path to it.
   int FindSet(int trajectory_id) REQUIRES(lock_);
-  void Union(int trajectory_id_a, int trajectory_id_b) REQUIRES(lock_);
+  // Returns true if this joined two components.
+  bool Union(int trajectory_id_a, int trajectory_id_b) REQUIRES(lock_);
+  // Publishes a new snapshot computed from 'forest_'.
+  void PublishSnapshot() REQUIRES(lock_);
 
   common::Mutex lock_;
   // Tracks transitive connectivity using a disjoint set forest, i.e. each
@@ -78,6 +102,9 @@ class ConnectedComponents {
   std::map<int, int> forest_ GUARDED_BY(lock_);
   // Tracks the number of direct connections between a pair of trajectories.
   std::map<std::pair<int, int>, int> connection_map_ GUARDED_BY(lock_);
+  // Only written under 'lock_', but accessed through std::atomic_load() and
+  // std::atomic_store(), so that readers do not have to take 'lock_'.
+  std::shared_ptr<const Snapshot> snapshot_;
 };
 
 // Returns a proto encoding connected components.
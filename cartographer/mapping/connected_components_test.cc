@@ -112,6 +112,35 @@ TEST(ConnectedComponentsTest, ReflexiveConnectivity) {
   EXPECT_EQ(0, connected_components.ConnectionCount(0, 0));
 }
 
+TEST(ConnectedComponentsTest, Snapshot) {
+  ConnectedComponents connected_components;
+  EXPECT_EQ(0, connected_components.GetSnapshot()->version);
+  connected_components.Add(3);
+  connected_components.Connect(0, 1);
+  connected_components.Connect(8, 9);
+  connected_components.Connect(1, 8);
+  const auto snapshot = connected_components.GetSnapshot();
+  EXPECT_EQ(4, snapshot->version);
+  EXPECT_EQ((std::vector<std::vector<int>>{{0, 1, 8, 9}, {3}}),
+            snapshot->components);
+  EXPECT_TRUE(snapshot->TransitivelyConnected(9, 0));
+  EXPECT_FALSE(snapshot->TransitivelyConnected(0, 3));
+  EXPECT_FALSE(snapshot->TransitivelyConnected(0, 5));
+
+  // Connections within a component and known trajectories do not change the
+  // components, so no new snapshot is published.
+  connected_components.Connect(0, 9);
+  connected_components.Add(3);
+  EXPECT_EQ(snapshot, connected_components.GetSnapshot());
+
+  // Earlier snapshots are immutable.
+  connected_components.Connect(3, 5);
+  EXPECT_EQ(4, snapshot->version);
+  EXPECT_FALSE(snapshot->TransitivelyConnected(3, 5));
+  EXPECT_EQ(5, connected_components.GetSnapshot()->version);
+  EXPECT_TRUE(connected_components.TransitivelyConnected(3, 5));
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/dead_reckoning.h"
+
+#include <algorithm>
+
+#include "cartographer/transform/transform.h"
+#include "cartographer/transform/transform_interpolation_buffer.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+namespace {
+
+// Gaps longer than this are logged as stalled sensor data.
+constexpr double kStalledGapSeconds = 1.;
+
+// While stalled, samples older than this before the newest one are dropped,
+// except those around the anchor, to bound the memory of long stalls.
+constexpr double kMaxDeadReckoningHorizonSeconds = 10.;
+
+// Returns the rotation by 'angular_velocity' during 'duration'.
+Eigen::Quaterniond RotationDuring(const Eigen::Vector3d& angular_velocity,
+                                  const common::Duration duration) {
+  return transform::AngleAxisVectorToRotationQuaternion(
+      Eigen::Vector3d(common::ToSeconds(duration) * angular_velocity));
+}
+
+}  // namespace
+
+DeadReckoning::DeadReckoning(const int trajectory_id)
+    : trajectory_id_(trajectory_id) {}
+
+void DeadReckoning::SetAnchor(
+    const PoseExtrapolator::ExtrapolationState& state) {
+  common::MutexLocker locker(&mutex_);
+  has_anchor_ = true;
+  anchor_ = state;
+  while (imu_data_.size() >= 2 && imu_data_[1].time <= anchor_.time) {
+    imu_data_.pop_front();
+  }
+  while (odometry_data_.size() >= 2 &&
+         odometry_data_[1].time <= anchor_.time) {
+    odometry_data_.pop_front();
+  }
+  Publish();
+}
+
+void DeadReckoning::AddImuData(const sensor::ImuData& imu_data) {
+  common::MutexLocker locker(&mutex_);
+  if (!imu_data_.empty() && imu_data.time < imu_data_.back().time) {
+    return;
+  }
+  Eigen::Quaterniond orientation = Eigen::Quaterniond::Identity();
+  if (!imu_data_.empty()) {
+    const ImuSample& newest = imu_data_.back();
+    orientation = (newest.orientation *
+                   RotationDuring(newest.angular_velocity,
+                                  imu_data.time - newest.time))
+                      .normalized();
+  }
+  imu_data_.push_back(
+      ImuSample{imu_data.time, imu_data.angular_velocity, orientation});
+  TrimData();
+  Publish();
+}
+
+void DeadReckoning::AddOdometryData(
+    const sensor::OdometryData& odometry_data) {
+  common::MutexLocker locker(&mutex_);
+  if (!odometry_data_.empty() &&
+      odometry_data.time < odometry_data_.back().time) {
+    return;
+  }
+  odometry_data_.push_back(odometry_data);
+  TrimData();
+  Publish();
+}
+
+void DeadReckoning::TrimData() {
+  if (!has_anchor_) {
+    // The orientations are integrated when samples are added, and only the
+    // newest odometry can bracket the first anchor.
+    while (imu_data_.size() > 1) {
+      imu_data_.pop_front();
+    }
+    while (odometry_data_.size() > 2) {
+      odometry_data_.pop_front();
+    }
+    return;
+  }
+  // Only the oldest and the newest samples are used to extrapolate, the ones
+  // in between are kept for moving the anchor. Those beyond the horizon are
+  // dropped, and an anchor among them is extrapolated from the sample before.
+  const common::Duration horizon =
+      common::FromSeconds(kMaxDeadReckoningHorizonSeconds);
+  while (imu_data_.size() > 2 &&
+         imu_data_[1].time < imu_data_.back().time - horizon) {
+    imu_data_.erase(imu_data_.begin() + 1);
+  }
+  while (odometry_data_.size() > 4 &&
+         odometry_data_[2].time < odometry_data_.back().time - horizon) {
+    odometry_data_.erase(odometry_data_.begin() + 2);
+  }
+}
+
+Eigen::Quaterniond DeadReckoning::RotationSinceAnchor(
+    const common::Time time, Eigen::Vector3d* const angular_velocity) const {
+  const ImuSample& oldest = imu_data_.front();
+  const ImuSample& newest = imu_data_.back();
+  // Before the oldest sample, the anchor keeps its own angular velocity.
+  const Eigen::Quaterniond anchor_orientation =
+      oldest.time <= anchor_.time
+          ? oldest.orientation *
+                RotationDuring(oldest.angular_velocity,
+                               anchor_.time - oldest.time)
+          : oldest.orientation *
+                RotationDuring(anchor_.angular_velocity,
+                               oldest.time - anchor_.time)
+                    .inverse();
+  *angular_velocity = newest.angular_velocity;
+  return anchor_orientation.inverse() * newest.orientation *
+         RotationDuring(newest.angular_velocity, time - newest.time);
+}
+
+bool DeadReckoning::OdometrySinceAnchor(
+    const common::Time time, transform::Rigid3d* const motion,
+    Eigen::Vector3d* const linear_velocity,
+    Eigen::Vector3d* const angular_velocity) const {
+  if (odometry_data_.size() < 2 ||
+      odometry_data_.front().time > anchor_.time ||
+      odometry_data_.back().time <= anchor_.time) {
+    return false;
+  }
+  // After trimming, the first two poses bracket the anchor time.
+  const transform::Rigid3d anchor_odometry = transform::InterpolateTransform(
+      odometry_data_[0].time, odometry_data_[0].pose, odometry_data_[1].time,
+      odometry_data_[1].pose, anchor_.time);
+  const sensor::OdometryData& newest = odometry_data_.back();
+  const sensor::OdometryData& previous =
+      odometry_data_[odometry_data_.size() - 2];
+  const double delta_t = common::ToSeconds(newest.time - previous.time);
+  if (delta_t > 0.) {
+    // In the tracking frame at the anchor and at the newest pose.
+    *linear_velocity = anchor_odometry.rotation().inverse() *
+                       (newest.pose.translation() -
+                        previous.pose.translation()) /
+                       delta_t;
+    *angular_velocity =
+        transform::RotationQuaternionToAngleAxisVector(
+            previous.pose.rotation().inverse() * newest.pose.rotation()) /
+        delta_t;
+  } else {
+    linear_velocity->setZero();
+    angular_velocity->setZero();
+  }
+  const common::Duration extrapolation = time - newest.time;
+  const transform::Rigid3d newest_motion =
+      anchor_odometry.inverse() * newest.pose;
+  *motion = transform::Rigid3d(
+      newest_motion.translation() +
+          common::ToSeconds(extrapolation) * *linear_velocity,
+      newest_motion.rotation() *
+          RotationDuring(*angular_velocity, extrapolation));
+  return true;
+}
+
+void DeadReckoning::Publish() {
+  Extrapolation extrapolation;
+  if (!has_anchor_) {
+    extrapolation_.Store(extrapolation);
+    return;
+  }
+  common::Time time = anchor_.time;
+  if (!imu_data_.empty()) {
+    time = std::max(time, imu_data_.back().time);
+  }
+  if (!odometry_data_.empty()) {
+    time = std::max(time, odometry_data_.back().time);
+  }
+  // Without newer data, this continues the velocities of the anchor.
+  transform::Rigid3d pose = PoseExtrapolator::ExtrapolatePose(anchor_, time);
+  Eigen::Vector3d linear_velocity = anchor_.linear_velocity;
+  Eigen::Vector3d angular_velocity = anchor_.angular_velocity;
+  transform::Rigid3d odometry_motion;
+  Eigen::Vector3d odometry_linear_velocity;
+  if (OdometrySinceAnchor(time, &odometry_motion, &odometry_linear_velocity,
+                          &angular_velocity)) {
+    pose = anchor_.pose * odometry_motion;
+    linear_velocity = anchor_.pose.rotation() * odometry_linear_velocity;
+  }
+  if (!imu_data_.empty() && imu_data_.back().time > anchor_.time) {
+    pose = transform::Rigid3d(
+        pose.translation(),
+        anchor_.pose.rotation() * RotationSinceAnchor(time, &angular_velocity));
+  }
+  extrapolation.valid = true;
+  extrapolation.state = PoseExtrapolator::ExtrapolationState{
+      time, pose, linear_velocity, angular_velocity};
+  extrapolation.gap = time - anchor_.time;
+  extrapolation_.Store(extrapolation);
+
+  if (extrapolation.gap > common::FromSeconds(kStalledGapSeconds)) {
+    if (!stalled_) {
+      LOG(WARNING) << "Sensor data of trajectory " << trajectory_id_
+                   << " is stalled, dead reckoning from IMU and odometry.";
+      stalled_ = true;
+    }
+    max_gap_ = std::max(max_gap_, extrapolation.gap);
+  } else if (stalled_) {
+    LOG(INFO) << "Trajectory " << trajectory_id_ << " resynchronized after "
+              << common::ToSeconds(max_gap_) << " s of dead reckoning.";
+    stalled_ = false;
+    max_gap_ = common::Duration::zero();
+  }
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_DEAD_RECKONING_H_
+#define CARTOGRAPHER_MAPPING_DEAD_RECKONING_H_
+
+#include <deque>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/seqlock.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/pose_extrapolator.h"
+#include "cartographer/sensor/imu_data.h"
+#include "cartographer/sensor/odometry_data.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Extrapolates the newest state of local SLAM, the anchor, with the IMU and
+// odometry data added before it is collated. While range data is stalled, the
+// collator holds back all sensor data of the trajectory, so local SLAM would
+// only extrapolate its last velocities.
+//
+// Rotation is integrated from IMU angular velocities, or follows the odometry
+// without IMU data. Translation follows the odometry, or continues with the
+// linear velocity of the anchor without odometry data. Each IMU sample keeps
+// its orientation relative to the first one added, and odometry poses are
+// relative by themselves, so that moving the anchor when local SLAM catches
+// up only looks at the samples around it instead of replaying all data added
+// since.
+//
+// SetAnchor() and the Add*() methods may be called from different threads,
+// GetExtrapolation() from any thread without waiting for them.
+class DeadReckoning {
+ public:
+  struct Extrapolation {
+    // False until the first anchor is set.
+    bool valid = false;
+    // At the time of the newest data, ready for
+    // PoseExtrapolator::ExtrapolatePose().
+    PoseExtrapolator::ExtrapolationState state;
+    // How far 'state' is ahead of the anchor, i.e. the dead reckoned time.
+    common::Duration gap = common::Duration::zero();
+  };
+
+  // 'trajectory_id' is only used for logging.
+  explicit DeadReckoning(int trajectory_id);
+
+  DeadReckoning(const DeadReckoning&) = delete;
+  DeadReckoning& operator=(const DeadReckoning&) = delete;
+
+  // Moves the anchor to the newest 'state' of local SLAM and drops the data it
+  // already covers.
+  void SetAnchor(const PoseExtrapolator::ExtrapolationState& state)
+      EXCLUDES(mutex_);
+
+  // Data older than the newest added data is ignored.
+  void AddImuData(const sensor::ImuData& imu_data) EXCLUDES(mutex_);
+  void AddOdometryData(const sensor::OdometryData& odometry_data)
+      EXCLUDES(mutex_);
+
+  Extrapolation GetExtrapolation() const { return extrapolation_.Load(); }
+
+ private:
+  struct ImuSample {
+    common::Time time;
+    Eigen::Vector3d angular_velocity;
+    // Relative to the first sample added.
+    Eigen::Quaterniond orientation;
+  };
+
+  // Returns the rotation of the tracking frame from the anchor to 'time'.
+  Eigen::Quaterniond RotationSinceAnchor(common::Time time,
+                                         Eigen::Vector3d* angular_velocity)
+      const REQUIRES(mutex_);
+  // Returns false if the odometry data does not bracket the anchor time.
+  bool OdometrySinceAnchor(common::Time time, transform::Rigid3d* motion,
+                           Eigen::Vector3d* linear_velocity,
+                           Eigen::Vector3d* angular_velocity) const
+      REQUIRES(mutex_);
+  // Bounds the data kept before the first anchor and while stalled.
+  void TrimData() REQUIRES(mutex_);
+  void Publish() REQUIRES(mutex_);
+
+  const int trajectory_id_;
+  mutable common::Mutex mutex_;
+  bool has_anchor_ GUARDED_BY(mutex_) = false;
+  PoseExtrapolator::ExtrapolationState anchor_ GUARDED_BY(mutex_);
+  // Only the newest of the samples up to the anchor time is kept, see also
+  // TrimData().
+  std::deque<ImuSample> imu_data_ GUARDED_BY(mutex_);
+  std::deque<sensor::OdometryData> odometry_data_ GUARDED_BY(mutex_);
+  // Whether the 'gap' was last logged as stalled.
+  bool stalled_ GUARDED_BY(mutex_) = false;
+  common::Duration max_gap_ GUARDED_BY(mutex_) = common::Duration::zero();
+
+  // Stored while holding 'mutex_'.
+  common::SeqLock<Extrapolation> extrapolation_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_DEAD_RECKONING_H_
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/dead_reckoning.h"
+
+#include <cmath>
+
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "cartographer/transform/transform.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr double kPrecision = 1e-6;
+
+common::Time TimeAt(const double seconds) {
+  return common::FromUniversal(1000) + common::FromSeconds(seconds);
+}
+
+PoseExtrapolator::ExtrapolationState CreateState(
+    const double seconds, const transform::Rigid3d& pose) {
+  return PoseExtrapolator::ExtrapolationState{
+      TimeAt(seconds), pose, Eigen::Vector3d(0.5, 0., 0.),
+      Eigen::Vector3d(0., 0., 0.1)};
+}
+
+TEST(DeadReckoningTest, InvalidBeforeAnchor) {
+  DeadReckoning dead_reckoning(0);
+  dead_reckoning.AddImuData(sensor::ImuData{
+      TimeAt(0.), Eigen::Vector3d::UnitZ(), Eigen::Vector3d::Zero()});
+  EXPECT_FALSE(dead_reckoning.GetExtrapolation().valid);
+}
+
+TEST(DeadReckoningTest, MatchesAnchorWithoutNewerData) {
+  DeadReckoning dead_reckoning(0);
+  dead_reckoning.AddImuData(sensor::ImuData{
+      TimeAt(0.), Eigen::Vector3d::UnitZ(), Eigen::Vector3d::UnitX()});
+  const PoseExtrapolator::ExtrapolationState anchor =
+      CreateState(1., transform::Rigid3d::Translation({1., 2., 3.}));
+  dead_reckoning.SetAnchor(anchor);
+  const DeadReckoning::Extrapolation extrapolation =
+      dead_reckoning.GetExtrapolation();
+  ASSERT_TRUE(extrapolation.valid);
+  EXPECT_EQ(anchor.time, extrapolation.state.time);
+  EXPECT_EQ(common::Duration::zero(), extrapolation.gap);
+  EXPECT_THAT(
+      PoseExtrapolator::ExtrapolatePose(extrapolation.state, TimeAt(2.)),
+      transform::IsNearly(PoseExtrapolator::ExtrapolatePose(anchor, TimeAt(2.)),
+                          kPrecision));
+}
+
+TEST(DeadReckoningTest, IntegratesImuAndFollowsOdometry) {
+  DeadReckoning dead_reckoning(0);
+  const transform::Rigid3d odometry_to_tracking =
+      transform::Rigid3d::Rotation(
+          Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()));
+  // Drives at 1 m/s along x of the tracking frame, turning at 0.5 rad/s
+  // according to the IMU while the odometry does not turn.
+  for (int i = 0; i <= 200; ++i) {
+    const double seconds = 0.01 * i;
+    dead_reckoning.AddImuData(
+        sensor::ImuData{TimeAt(seconds), Eigen::Vector3d::UnitZ(),
+                        Eigen::Vector3d(0., 0., 0.5)});
+    dead_reckoning.AddOdometryData(sensor::OdometryData{
+        TimeAt(seconds),
+        odometry_to_tracking *
+            transform::Rigid3d::Translation({seconds, 0., 0.})});
+    if (i == 0) {
+      dead_reckoning.SetAnchor(CreateState(
+          0.005, transform::Rigid3d::Translation({1., 2., 0.})));
+    }
+  }
+  const DeadReckoning::Extrapolation extrapolation =
+      dead_reckoning.GetExtrapolation();
+  ASSERT_TRUE(extrapolation.valid);
+  EXPECT_EQ(TimeAt(2.), extrapolation.state.time);
+  EXPECT_NEAR(1.995, common::ToSeconds(extrapolation.gap), kPrecision);
+  EXPECT_THAT(
+      extrapolation.state.pose,
+      transform::IsNearly(
+          transform::Rigid3d(Eigen::Vector3d(2.995, 2., 0.),
+                             Eigen::Quaterniond(Eigen::AngleAxisd(
+                                 0.5 * 1.995, Eigen::Vector3d::UnitZ()))),
+          kPrecision));
+  EXPECT_TRUE(extrapolation.state.linear_velocity.isApprox(
+      Eigen::Vector3d(1., 0., 0.), kPrecision));
+  EXPECT_TRUE(extrapolation.state.angular_velocity.isApprox(
+      Eigen::Vector3d(0., 0., 0.5), kPrecision));
+}
+
+TEST(DeadReckoningTest, ResynchronizesToNewerAnchor) {
+  DeadReckoning dead_reckoning(0);
+  dead_reckoning.SetAnchor(CreateState(0., transform::Rigid3d::Identity()));
+  for (int i = 0; i <= 100; ++i) {
+    const double seconds = 0.01 * i;
+    dead_reckoning.AddOdometryData(sensor::OdometryData{
+        TimeAt(seconds), transform::Rigid3d::Translation({seconds, 0., 0.})});
+  }
+  EXPECT_NEAR(1., common::ToSeconds(dead_reckoning.GetExtrapolation().gap),
+              kPrecision);
+  // Local SLAM catches up to 0.905 s, where it found a different pose.
+  const transform::Rigid3d pose(
+      Eigen::Vector3d(5., 0., 0.),
+      Eigen::Quaterniond(
+          Eigen::AngleAxisd(M_PI / 2., Eigen::Vector3d::UnitZ())));
+  dead_reckoning.SetAnchor(CreateState(0.905, pose));
+  const DeadReckoning::Extrapolation extrapolation =
+      dead_reckoning.GetExtrapolation();
+  EXPECT_NEAR(0.095, common::ToSeconds(extrapolation.gap), kPrecision);
+  EXPECT_THAT(extrapolation.state.pose,
+              transform::IsNearly(
+                  pose * transform::Rigid3d::Translation({0.095, 0., 0.}),
+                  kPrecision));
+  EXPECT_TRUE(extrapolation.state.linear_velocity.isApprox(
+      Eigen::Vector3d(0., 1., 0.), kPrecision));
+}
+
+TEST(DeadReckoningTest, UsesNewestDataAddedBeforeAnchor) {
+  DeadReckoning dead_reckoning(0);
+  for (int i = 0; i <= 1000; ++i) {
+    const double seconds = 0.01 * i;
+    dead_reckoning.AddOdometryData(sensor::OdometryData{
+        TimeAt(seconds), transform::Rigid3d::Translation({seconds, 0., 0.})});
+  }
+  dead_reckoning.SetAnchor(CreateState(9.995, transform::Rigid3d::Identity()));
+  const DeadReckoning::Extrapolation extrapolation =
+      dead_reckoning.GetExtrapolation();
+  ASSERT_TRUE(extrapolation.valid);
+  EXPECT_NEAR(0.005, common::ToSeconds(extrapolation.gap), kPrecision);
+  EXPECT_THAT(
+      extrapolation.state.pose,
+      transform::IsNearly(transform::Rigid3d::Translation({0.005, 0., 0.}),
+                          kPrecision));
+}
+
+TEST(DeadReckoningTest, FollowsOdometryBeyondHorizon) {
+  DeadReckoning dead_reckoning(0);
+  dead_reckoning.SetAnchor(CreateState(0., transform::Rigid3d::Identity()));
+  for (int i = 0; i <= 3000; ++i) {
+    const double seconds = 0.01 * i;
+    dead_reckoning.AddOdometryData(sensor::OdometryData{
+        TimeAt(seconds), transform::Rigid3d::Translation({seconds, 0., 0.})});
+  }
+  EXPECT_NEAR(30., common::ToSeconds(dead_reckoning.GetExtrapolation().gap),
+              kPrecision);
+  EXPECT_THAT(
+      dead_reckoning.GetExtrapolation().state.pose,
+      transform::IsNearly(transform::Rigid3d::Translation({30., 0., 0.}),
+                          kPrecision));
+  // Local SLAM catches up to an anchor within the horizon.
+  const transform::Rigid3d pose = transform::Rigid3d::Translation({5., 0., 0.});
+  dead_reckoning.SetAnchor(CreateState(29.905, pose));
+  const DeadReckoning::Extrapolation extrapolation =
+      dead_reckoning.GetExtrapolation();
+  EXPECT_NEAR(0.095, common::ToSeconds(extrapolation.gap), kPrecision);
+  EXPECT_THAT(extrapolation.state.pose,
+              transform::IsNearly(
+                  pose * transform::Rigid3d::Translation({0.095, 0., 0.}),
+                  kPrecision));
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
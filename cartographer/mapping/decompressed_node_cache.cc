@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/decompressed_node_cache.h"
+
+#include "Eigen/Core"
+
+namespace cartographer {
+namespace mapping {
+
+namespace {
+
+int64 GetPointCloudsSizeInBytes(const TrajectoryNode::Data& constant_data) {
+  return sizeof(Eigen::Vector3f) *
+         (constant_data.filtered_gravity_aligned_point_cloud.size() +
+          constant_data.high_resolution_point_cloud.size() +
+          constant_data.low_resolution_point_cloud.size());
+}
+
+}  // namespace
+
+DecompressedNodeCache::DecompressedNodeCache(const int64 max_size_in_bytes)
+    : decompressed_nodes_(max_size_in_bytes) {}
+
+std::shared_ptr<const TrajectoryNode::Data> DecompressedNodeCache::Get(
+    const NodeId& node_id, const TrajectoryNode::Data* const constant_data) {
+  CHECK(constant_data != nullptr);
+  if (constant_data->compressed_point_clouds == nullptr) {
+    return std::shared_ptr<const TrajectoryNode::Data>(
+        std::shared_ptr<const TrajectoryNode::Data>(), constant_data);
+  }
+  {
+    common::MutexLocker locker(&mutex_);
+    auto decompressed_data = decompressed_nodes_.Get(node_id);
+    if (decompressed_data != nullptr) {
+      return decompressed_data;
+    }
+  }
+  // Decompress without holding the lock. If another thread decompresses the
+  // same node concurrently, the later insertion replaces the earlier one.
+  auto decompressed_data = std::make_shared<const TrajectoryNode::Data>(
+      DecompressPointClouds(*constant_data));
+  common::MutexLocker locker(&mutex_);
+  decompressed_nodes_.Insert(node_id, decompressed_data,
+                             GetPointCloudsSizeInBytes(*decompressed_data));
+  return decompressed_data;
+}
+
+}  // namespace mapping
+}  // namespace cartographer
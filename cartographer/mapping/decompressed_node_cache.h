@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_DECOMPRESSED_NODE_CACHE_H_
+#define CARTOGRAPHER_MAPPING_DECOMPRESSED_NODE_CACHE_H_
+
+#include <memory>
+
+#include "cartographer/common/lru_cache.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/trajectory_node.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Keeps the decompressed data of the nodes most recently matched against, so
+// that nodes with compressed point clouds are not decompressed again for every
+// submap they are matched with.
+//
+// This class is thread-safe.
+class DecompressedNodeCache {
+ public:
+  // A 'max_size_in_bytes' of 0 disables eviction.
+  explicit DecompressedNodeCache(int64 max_size_in_bytes);
+
+  DecompressedNodeCache(const DecompressedNodeCache&) = delete;
+  DecompressedNodeCache& operator=(const DecompressedNodeCache&) = delete;
+
+  // Returns the 'constant_data' of 'node_id' with decompressed point clouds.
+  // If they are not compressed, the returned pointer does not own
+  // 'constant_data', which must then stay valid as long as it is used.
+  std::shared_ptr<const TrajectoryNode::Data> Get(
+      const NodeId& node_id, const TrajectoryNode::Data* constant_data)
+      EXCLUDES(mutex_);
+
+ private:
+  common::Mutex mutex_;
+  common::LruCache<NodeId, TrajectoryNode::Data> decompressed_nodes_
+      GUARDED_BY(mutex_);
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_DECOMPRESSED_NODE_CACHE_H_
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/decompressed_node_cache.h"
+
+#include "cartographer/common/time.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Returns data with four points, whose coordinates are not changed by
+// compression.
+TrajectoryNode::Data CreateConstantData(const float x) {
+  return TrajectoryNode::Data{
+      common::FromUniversal(0),
+      Eigen::Quaterniond::Identity(),
+      sensor::CompressedPointCloud({{x, 0.f, 0.f}, {x, 1.f, 0.f}})
+          .Decompress(),
+      sensor::CompressedPointCloud({{x, 2.f, 0.f}}).Decompress(),
+      sensor::CompressedPointCloud({{x, 3.f, 0.f}}).Decompress(),
+      Eigen::VectorXf::Zero(2),
+      transform::Rigid3d::Identity()};
+}
+
+TEST(DecompressedNodeCacheTest, ReturnsUncompressedDataItself) {
+  DecompressedNodeCache cache(0 /* max_size_in_bytes */);
+  const TrajectoryNode::Data constant_data = CreateConstantData(1.f);
+  EXPECT_EQ(&constant_data, cache.Get(NodeId{0, 0}, &constant_data).get());
+}
+
+TEST(DecompressedNodeCacheTest, DecompressesOncePerNode) {
+  DecompressedNodeCache cache(0 /* max_size_in_bytes */);
+  const TrajectoryNode::Data constant_data =
+      CompressPointClouds(CreateConstantData(1.f));
+  const auto decompressed_data = cache.Get(NodeId{0, 0}, &constant_data);
+  EXPECT_EQ(nullptr, decompressed_data->compressed_point_clouds);
+  EXPECT_EQ(CreateConstantData(1.f).filtered_gravity_aligned_point_cloud,
+            decompressed_data->filtered_gravity_aligned_point_cloud);
+  EXPECT_EQ(CreateConstantData(1.f).high_resolution_point_cloud,
+            decompressed_data->high_resolution_point_cloud);
+  EXPECT_EQ(CreateConstantData(1.f).low_resolution_point_cloud,
+            decompressed_data->low_resolution_point_cloud);
+  EXPECT_EQ(decompressed_data, cache.Get(NodeId{0, 0}, &constant_data));
+}
+
+TEST(DecompressedNodeCacheTest, EvictsLeastRecentlyUsedNodes) {
+  // Room for the points of one node.
+  DecompressedNodeCache cache(4 * sizeof(Eigen::Vector3f));
+  const TrajectoryNode::Data first =
+      CompressPointClouds(CreateConstantData(1.f));
+  const TrajectoryNode::Data second =
+      CompressPointClouds(CreateConstantData(2.f));
+  const auto first_decompressed = cache.Get(NodeId{0, 0}, &first);
+  const auto second_decompressed = cache.Get(NodeId{0, 1}, &second);
+  EXPECT_EQ(second_decompressed, cache.Get(NodeId{0, 1}, &second));
+  // Evicted data stays valid, but is decompressed again when needed.
+  EXPECT_NE(first_decompressed, cache.Get(NodeId{0, 0}, &first));
+  EXPECT_EQ(CreateConstantData(1.f).high_resolution_point_cloud,
+            first_decompressed->high_resolution_point_cloud);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
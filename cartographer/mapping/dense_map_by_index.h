@@ -0,0 +1,217 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_DENSE_MAP_BY_INDEX_H_
+#define CARTOGRAPHER_MAPPING_DENSE_MAP_BY_INDEX_H_
+
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Like std::map<int, DataType> for the indices of nodes or submaps of one
+// trajectory, which are appended as 0, 1, 2, ... and later trimmed in any
+// order. Data is stored contiguously in chunks of 'kChunkSize' elements and
+// trimmed elements leave a tombstone, so the address of an element does not
+// change until it is trimmed. Chunks are freed once all their elements are
+// trimmed.
+template <typename DataType>
+class DenseMapByIndex {
+ private:
+  static constexpr int kChunkSize = 256;
+
+  struct Chunk {
+    Chunk() { data.reserve(kChunkSize); }
+    Chunk(const Chunk& other)
+        : trimmed(other.trimmed), num_trimmed(other.num_trimmed) {
+      data.reserve(kChunkSize);
+      data.insert(data.end(), other.data.begin(), other.data.end());
+    }
+
+    // Never reallocates, since at most 'kChunkSize' elements are appended.
+    std::vector<DataType> data;
+    std::vector<bool> trimmed;
+    int num_trimmed = 0;
+  };
+
+  template <typename ValueType>
+  struct IndexDataReference {
+    int first;
+    ValueType& second;
+  };
+
+  template <typename MapType, typename ValueType>
+  class Iterator
+      : public std::iterator<std::forward_iterator_tag,
+                             IndexDataReference<ValueType>> {
+   public:
+    // Allows 'iterator->first' and 'iterator->second'.
+    class Pointer {
+     public:
+      explicit Pointer(const IndexDataReference<ValueType>& reference)
+          : reference_(reference) {}
+      const IndexDataReference<ValueType>* operator->() const {
+        return &reference_;
+      }
+
+     private:
+      const IndexDataReference<ValueType> reference_;
+    };
+
+    Iterator(MapType* const map, const int index) : map_(map), index_(index) {
+      AdvanceToValidIndex();
+    }
+
+    IndexDataReference<ValueType> operator*() const {
+      return IndexDataReference<ValueType>{index_, map_->Get(index_)};
+    }
+    Pointer operator->() const { return Pointer(**this); }
+
+    Iterator& operator++() {
+      ++index_;
+      AdvanceToValidIndex();
+      return *this;
+    }
+
+    bool operator==(const Iterator& it) const { return index_ == it.index_; }
+    bool operator!=(const Iterator& it) const { return !operator==(it); }
+
+   private:
+    void AdvanceToValidIndex() {
+      while (index_ < map_->num_indices_ && !map_->Contains(index_)) {
+        const auto& chunk = map_->chunks_[index_ / kChunkSize];
+        // Freed chunks are skipped as a whole.
+        index_ = chunk == nullptr ? (index_ / kChunkSize + 1) * kChunkSize
+                                  : index_ + 1;
+      }
+      if (index_ > map_->num_indices_) {
+        index_ = map_->num_indices_;
+      }
+    }
+
+    MapType* map_;
+    int index_;
+  };
+
+ public:
+  using iterator = Iterator<DenseMapByIndex, DataType>;
+  using const_iterator = Iterator<const DenseMapByIndex, const DataType>;
+
+  DenseMapByIndex() = default;
+  DenseMapByIndex(DenseMapByIndex&&) = default;
+  DenseMapByIndex& operator=(DenseMapByIndex&&) = default;
+
+  DenseMapByIndex(const DenseMapByIndex& other)
+      : num_indices_(other.num_indices_), size_(other.size_) {
+    for (const auto& chunk : other.chunks_) {
+      chunks_.push_back(chunk == nullptr ? nullptr
+                                         : common::make_unique<Chunk>(*chunk));
+    }
+  }
+
+  DenseMapByIndex& operator=(const DenseMapByIndex& other) {
+    DenseMapByIndex copy(other);
+    *this = std::move(copy);
+    return *this;
+  }
+
+  // Appends 'data' with the next index, which is returned. Indices of trimmed
+  // elements are not reused.
+  int Append(DataType data) {
+    if (num_indices_ % kChunkSize == 0) {
+      chunks_.push_back(common::make_unique<Chunk>());
+    }
+    Chunk& chunk = *chunks_.back();
+    chunk.data.push_back(std::move(data));
+    chunk.trimmed.push_back(false);
+    ++size_;
+    return num_indices_++;
+  }
+
+  // Removes the data for 'index' which must exist.
+  void Trim(const int index) {
+    CHECK(Contains(index)) << index;
+    auto& chunk = chunks_[index / kChunkSize];
+    chunk->trimmed[index % kChunkSize] = true;
+    --size_;
+    if (++chunk->num_trimmed == kChunkSize) {
+      chunk.reset();
+    }
+  }
+
+  bool Contains(const int index) const {
+    if (index < 0 || index >= num_indices_) {
+      return false;
+    }
+    const auto& chunk = chunks_[index / kChunkSize];
+    return chunk != nullptr && !chunk->trimmed[index % kChunkSize];
+  }
+
+  const DataType& at(const int index) const {
+    CHECK(Contains(index)) << index;
+    return Get(index);
+  }
+  DataType& at(const int index) {
+    CHECK(Contains(index)) << index;
+    return Get(index);
+  }
+
+  // Returns the number of elements which were not trimmed.
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // Returns the index the next element is appended with.
+  int num_indices() const { return num_indices_; }
+  // Returns the highest index of an element, which must exist.
+  int last_index() const {
+    CHECK(!empty());
+    int index = num_indices_ - 1;
+    while (!Contains(index)) {
+      --index;
+    }
+    return index;
+  }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, num_indices_); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, num_indices_); }
+
+ private:
+  const DataType& Get(const int index) const {
+    return chunks_[index / kChunkSize]->data[index % kChunkSize];
+  }
+  DataType& Get(const int index) {
+    return chunks_[index / kChunkSize]->data[index % kChunkSize];
+  }
+
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+  int num_indices_ = 0;
+  int size_ = 0;
+};
+
+template <typename DataType>
+constexpr int DenseMapByIndex<DataType>::kChunkSize;
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_DENSE_MAP_BY_INDEX_H_
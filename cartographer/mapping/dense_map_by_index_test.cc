@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/dense_map_by_index.h"
+
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+std::vector<std::pair<int, int>> ToVector(const DenseMapByIndex<int>& map) {
+  std::vector<std::pair<int, int>> result;
+  for (const auto& index_data : map) {
+    result.emplace_back(index_data.first, index_data.second);
+  }
+  return result;
+}
+
+TEST(DenseMapByIndexTest, AppendAndTrim) {
+  DenseMapByIndex<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0, map.Append(10));
+  EXPECT_EQ(1, map.Append(11));
+  EXPECT_EQ(2, map.Append(12));
+  EXPECT_EQ(3, map.size());
+  EXPECT_EQ(2, map.last_index());
+  map.Trim(1);
+  EXPECT_FALSE(map.Contains(1));
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ((std::vector<std::pair<int, int>>{{0, 10}, {2, 12}}),
+            ToVector(map));
+  map.Trim(2);
+  EXPECT_EQ(0, map.last_index());
+  // Indices of trimmed elements are not reused.
+  EXPECT_EQ(3, map.Append(13));
+  EXPECT_EQ(10, map.begin()->second);
+  map.at(3) = 23;
+  EXPECT_EQ((std::vector<std::pair<int, int>>{{0, 10}, {3, 23}}),
+            ToVector(map));
+}
+
+TEST(DenseMapByIndexTest, AddressesAreStable) {
+  DenseMapByIndex<int> map;
+  map.Append(0);
+  const int* const first = &map.at(0);
+  for (int i = 1; i != 10000; ++i) {
+    map.Append(i);
+  }
+  EXPECT_EQ(first, &map.at(0));
+
+  // Trimming all elements of the first chunks frees them, and iteration skips
+  // over them.
+  for (int i = 0; i != 9000; ++i) {
+    map.Trim(i);
+  }
+  EXPECT_EQ(1000, map.size());
+  EXPECT_EQ(9000, map.begin()->first);
+  int expected_index = 9000;
+  for (const auto& index_data : map) {
+    EXPECT_EQ(expected_index, index_data.first);
+    EXPECT_EQ(expected_index, index_data.second);
+    ++expected_index;
+  }
+  EXPECT_EQ(10000, expected_index);
+
+  const DenseMapByIndex<int> copy = map;
+  EXPECT_EQ(ToVector(map), ToVector(copy));
+  map.Trim(9999);
+  EXPECT_EQ(9998, map.last_index());
+  EXPECT_EQ(9999, copy.last_index());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -17,7 +17,8 @@
 #include "cartographer/mapping/detect_floors.h"
 
 #include <algorithm>
-#include <fstream>
+#include <cmath>
+#include <map>
 #include <vector>
 
 #include "Eigen/Core"
@@ -39,18 +40,6 @@ constexpr double kMaxShortSpanLengthMeters = 25.;
 constexpr double kLevelHeightMeters = 2.5;
 constexpr double kMinLevelSeparationMeters = 1.;
 
-// Indices into 'trajectory.node', so that 'start_index' <= i < 'end_index'.
-struct Span {
-  int start_index;
-  int end_index;
-  std::vector<double> z_values;
-
-  bool operator<(const Span& other) const {
-    return std::forward_as_tuple(start_index, end_index) <
-           std::forward_as_tuple(other.start_index, other.end_index);
-  }
-};
-
 // Union-find implementation for classifying spans into levels.
 int LevelFind(const int i, const Levels& levels) {
   auto it = levels.find(i);
@@ -67,81 +56,101 @@ void LevelUnion(int i, int j, Levels* levels) {
   (*levels)[repr_i] = repr_j;
 }
 
-void InsertSorted(const double val, std::vector<double>* vals) {
-  vals->insert(std::upper_bound(vals->begin(), vals->end(), val), val);
+// Returns the median of 'values', i.e. the value at index 'size() / 2' if
+// 'values' were sorted.
+double Median(std::vector<double> values) {
+  CHECK(!values.empty());
+  const auto median = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), median, values.end());
+  return *median;
 }
 
-double Median(const std::vector<double>& sorted) {
-  CHECK(!sorted.empty());
-  return sorted.at(sorted.size() / 2);
-}
+}  // namespace
 
-// Cut the trajectory at jumps in z. A new span is started when the current
-// node's z differes by more than kLevelHeightMeters from the median z values.
-std::vector<Span> SliceByAltitudeChange(const proto::Trajectory& trajectory) {
+std::vector<Floor> DetectFloors(const proto::Trajectory& trajectory) {
   CHECK_GT(trajectory.node_size(), 0);
-
-  std::vector<Span> spans;
-  spans.push_back(Span{0, 0, {trajectory.node(0).pose().translation().z()}});
-  for (int i = 1; i < trajectory.node_size(); ++i) {
-    const auto& node = trajectory.node(i);
-    const double z = node.pose().translation().z();
-    if (std::abs(Median(spans.back().z_values) - z) > kLevelHeightMeters) {
-      spans.push_back(Span{i, i, {}});
-    }
-    InsertSorted(z, &spans.back().z_values);
-    spans.back().end_index = i + 1;
+  FloorDetector floor_detector;
+  for (const auto& node : trajectory.node()) {
+    floor_detector.AddNode(common::FromUniversal(node.timestamp()),
+                           transform::ToEigen(node.pose().translation()));
   }
-  return spans;
+  return floor_detector.GetFloors();
 }
 
-// Returns the length of 'span' in meters.
-double SpanLength(const proto::Trajectory& trajectory, const Span& span) {
-  double length = 0;
-  for (int i = span.start_index + 1; i < span.end_index; ++i) {
-    const auto a =
-        transform::ToEigen(trajectory.node(i - 1).pose().translation());
-    const auto b = transform::ToEigen(trajectory.node(i).pose().translation());
-    length += (a - b).head<2>().norm();
+void FloorDetector::Span::AddZValue(const double z) {
+  z_values.push_back(z);
+  if (!upper_z_values.empty() && z >= upper_z_values.top()) {
+    upper_z_values.push(z);
+  } else {
+    lower_z_values.push(z);
+  }
+  const size_t num_lower = z_values.size() / 2;
+  while (lower_z_values.size() > num_lower) {
+    upper_z_values.push(lower_z_values.top());
+    lower_z_values.pop();
+  }
+  while (lower_z_values.size() < num_lower) {
+    lower_z_values.push(upper_z_values.top());
+    upper_z_values.pop();
   }
-  return length;
 }
 
-// True if 'span' is considered to be short, i.e. not interesting on its own,
-// but should be folded into the levels before and after entering it.
-bool IsShort(const proto::Trajectory& trajectory, const Span& span) {
-  return SpanLength(trajectory, span) < kMaxShortSpanLengthMeters;
+double FloorDetector::Span::Median() const {
+  CHECK(!upper_z_values.empty());
+  return upper_z_values.top();
 }
 
-// Merges all 'spans' that have similar median z value into the same level.
-void GroupSegmentsByAltitude(const proto::Trajectory& trajectory,
-                             const std::vector<Span>& spans, Levels* levels) {
-  for (size_t i = 0; i < spans.size(); ++i) {
-    for (size_t j = i + 1; j < spans.size(); ++j) {
-      if (std::abs(Median(spans[i].z_values) - Median(spans[j].z_values)) <
+// Cuts the trajectory at jumps in z. A new span is started when the current
+// node's z differs by more than kLevelHeightMeters from the median z values.
+void FloorDetector::AddNode(const common::Time time,
+                            const Eigen::Vector3d& translation) {
+  if (spans_.empty() ||
+      std::abs(spans_.back().Median() - translation.z()) >
+          kLevelHeightMeters) {
+    spans_.emplace_back();
+    spans_.back().start_time = time;
+  } else {
+    spans_.back().length +=
+        (translation - last_translation_).head<2>().norm();
+  }
+  spans_.back().end_time = time;
+  spans_.back().AddZValue(translation.z());
+  last_translation_ = translation;
+}
+
+std::vector<Floor> FloorDetector::GetFloors() const {
+  CHECK(!spans_.empty());
+  // Short spans are not interesting on their own, but are folded into the
+  // levels before and after entering them.
+  const auto is_short = [](const Span& span) {
+    return span.length < kMaxShortSpanLengthMeters;
+  };
+
+  // Merge all spans that have similar median z value into the same level.
+  Levels levels;
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    levels[i] = i;
+  }
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    for (size_t j = i + 1; j < spans_.size(); ++j) {
+      if (std::abs(spans_[i].Median() - spans_[j].Median()) <
           kMinLevelSeparationMeters) {
-        LevelUnion(i, j, levels);
+        LevelUnion(i, j, &levels);
       }
     }
   }
-}
-
-std::vector<Floor> FindFloors(const proto::Trajectory& trajectory,
-                              const std::vector<Span>& spans,
-                              const Levels& levels) {
-  std::map<int, std::vector<Span>> level_spans;
 
-  // Initialize the levels to start out with only long spans.
-  for (size_t i = 0; i < spans.size(); ++i) {
-    const Span& span = spans[i];
-    if (!IsShort(trajectory, span)) {
-      level_spans[LevelFind(i, levels)].push_back(span);
+  // Indices into 'spans_' by level, initialized to start out with only long
+  // spans.
+  std::map<int, std::vector<size_t>> level_spans;
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    if (!is_short(spans_[i])) {
+      level_spans[LevelFind(i, levels)].push_back(i);
     }
   }
 
-  for (size_t i = 0; i < spans.size(); ++i) {
-    const Span& span = spans[i];
-    if (!IsShort(trajectory, span)) {
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    if (!is_short(spans_[i])) {
       continue;
     }
 
@@ -149,19 +158,19 @@ std::vector<Floor> FindFloors(const proto::Trajectory& trajectory,
     // into it.
     int level = LevelFind(i, levels);
     if (!level_spans[level].empty()) {
-      level_spans[level].push_back(span);
+      level_spans[level].push_back(i);
       continue;
     }
 
     // Otherwise, add this short piece to the level before and after it. It is
     // likely some intermediate level on stairs.
     size_t index = i - 1;
-    if (index < spans.size()) {
-      level_spans[LevelFind(index, levels)].push_back(span);
+    if (index < spans_.size()) {
+      level_spans[LevelFind(index, levels)].push_back(i);
     }
     index = i + 1;
-    if (index < spans.size()) {
-      level_spans[LevelFind(index, levels)].push_back(span);
+    if (index < spans_.size()) {
+      level_spans[LevelFind(index, levels)].push_back(i);
     }
   }
 
@@ -175,36 +184,20 @@ std::vector<Floor> FindFloors(const proto::Trajectory& trajectory,
     std::vector<double> z_values;
     std::sort(level.second.begin(), level.second.end());
     floors.emplace_back();
-    for (const auto& span : level.second) {
-      if (!IsShort(trajectory, span)) {
+    for (const size_t span_index : level.second) {
+      const Span& span = spans_[span_index];
+      if (!is_short(span)) {
         // To figure out the median height of this floor, we only care for the
         // long pieces that are guaranteed to be in the structure. This is a
         // heuristic to leave out intermediate (short) levels.
         z_values.insert(z_values.end(), span.z_values.begin(),
                         span.z_values.end());
       }
-      floors.back().timespans.push_back(Timespan{
-          common::FromUniversal(trajectory.node(span.start_index).timestamp()),
-          common::FromUniversal(
-              trajectory.node(span.end_index - 1).timestamp())});
+      floors.back().timespans.push_back(
+          Timespan{span.start_time, span.end_time});
     }
-    std::sort(z_values.begin(), z_values.end());
-    floors.back().z = Median(z_values);
-  }
-  return floors;
-}
-
-}  // namespace
-
-std::vector<Floor> DetectFloors(const proto::Trajectory& trajectory) {
-  const std::vector<Span> spans = SliceByAltitudeChange(trajectory);
-  Levels levels;
-  for (size_t i = 0; i < spans.size(); ++i) {
-    levels[i] = i;
+    floors.back().z = Median(std::move(z_values));
   }
-  GroupSegmentsByAltitude(trajectory, spans, &levels);
-
-  std::vector<Floor> floors = FindFloors(trajectory, spans, levels);
   std::sort(floors.begin(), floors.end(),
             [](const Floor& a, const Floor& b) { return a.z < b.z; });
   return floors;
@@ -17,9 +17,13 @@
 #ifndef CARTOGRAPHER_MAPPING_DETECT_FLOORS_H_
 #define CARTOGRAPHER_MAPPING_DETECT_FLOORS_H_
 
-#include "cartographer/mapping/proto/trajectory.pb.h"
+#include <functional>
+#include <queue>
+#include <vector>
 
+#include "Eigen/Core"
 #include "cartographer/common/time.h"
+#include "cartographer/mapping/proto/trajectory.pb.h"
 
 namespace cartographer {
 namespace mapping {
@@ -45,6 +49,45 @@ struct Floor {
 // the stairs.
 std::vector<Floor> DetectFloors(const proto::Trajectory& trajectory);
 
+// Same heuristic as DetectFloors(), but updated as nodes are added, e.g. while
+// a trajectory is being built. Adding a node takes logarithmic time in the
+// number of nodes at its height, and only GetFloors() looks at all nodes.
+class FloorDetector {
+ public:
+  FloorDetector() = default;
+
+  FloorDetector(const FloorDetector&) = delete;
+  FloorDetector& operator=(const FloorDetector&) = delete;
+
+  // Nodes have to be added in time order.
+  void AddNode(common::Time time, const Eigen::Vector3d& translation);
+
+  // Returns the floors detected so far, sorted by their z-values. At least one
+  // node has to be added first.
+  std::vector<Floor> GetFloors() const;
+
+ private:
+  // A run of consecutive nodes at about the same height.
+  struct Span {
+    void AddZValue(double z);
+    double Median() const;
+
+    common::Time start_time;
+    common::Time end_time;
+    // Length of the span in the xy-plane in meters.
+    double length = 0.;
+    std::vector<double> z_values;
+    // The lower half and the rest of 'z_values', so that the median is the
+    // smallest value of 'upper_z_values'.
+    std::priority_queue<double> lower_z_values;
+    std::priority_queue<double, std::vector<double>, std::greater<double>>
+        upper_z_values;
+  };
+
+  std::vector<Span> spans_;
+  Eigen::Vector3d last_translation_;
+};
+
 }  // namespace mapping
 }  // namespace cartographer
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/detect_floors.h"
+
+#include <vector>
+
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Walks 60 m on the ground floor, takes the stairs up by 3 m, walks 60 m on
+// the first floor and returns to walk another 40 m on the ground floor.
+proto::Trajectory CreateTwoFloorTrajectory() {
+  std::vector<double> z_values;
+  for (int i = 0; i != 60; ++i) {
+    z_values.push_back(0.);
+  }
+  for (int i = 1; i != 4; ++i) {
+    z_values.push_back(i);
+  }
+  for (int i = 0; i != 60; ++i) {
+    z_values.push_back(3.);
+  }
+  for (int i = 2; i != -1; --i) {
+    z_values.push_back(i);
+  }
+  for (int i = 0; i != 40; ++i) {
+    z_values.push_back(0.);
+  }
+  proto::Trajectory trajectory;
+  for (size_t i = 0; i != z_values.size(); ++i) {
+    auto* const node = trajectory.add_node();
+    node->set_timestamp(common::ToUniversal(common::FromUniversal(i)));
+    *node->mutable_pose() = transform::ToProto(
+        transform::Rigid3d::Translation(Eigen::Vector3d(i, 0., z_values[i])));
+  }
+  return trajectory;
+}
+
+TEST(DetectFloorsTest, DetectsTwoFloors) {
+  const proto::Trajectory trajectory = CreateTwoFloorTrajectory();
+  const std::vector<Floor> floors = DetectFloors(trajectory);
+  ASSERT_EQ(2, floors.size());
+  EXPECT_NEAR(0., floors[0].z, 1e-9);
+  EXPECT_NEAR(3., floors[1].z, 1e-9);
+  EXPECT_EQ(2, floors[0].timespans.size());
+  EXPECT_EQ(common::FromUniversal(trajectory.node(0).timestamp()),
+            floors[0].timespans.front().start);
+  EXPECT_EQ(common::FromUniversal(
+                trajectory.node(trajectory.node_size() - 1).timestamp()),
+            floors[0].timespans.back().end);
+}
+
+TEST(DetectFloorsTest, IncrementalDetectionMatchesDetectFloors) {
+  const proto::Trajectory trajectory = CreateTwoFloorTrajectory();
+  FloorDetector floor_detector;
+  proto::Trajectory partial_trajectory;
+  for (const auto& node : trajectory.node()) {
+    floor_detector.AddNode(common::FromUniversal(node.timestamp()),
+                           transform::ToEigen(node.pose().translation()));
+    *partial_trajectory.add_node() = node;
+    if (partial_trajectory.node_size() < 60) {
+      // Until the first long span, there are no floors to find.
+      continue;
+    }
+    const std::vector<Floor> expected = DetectFloors(partial_trajectory);
+    const std::vector<Floor> actual = floor_detector.GetFloors();
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i != expected.size(); ++i) {
+      EXPECT_EQ(expected[i].z, actual[i].z);
+      ASSERT_EQ(expected[i].timespans.size(), actual[i].timespans.size());
+      for (size_t j = 0; j != expected[i].timespans.size(); ++j) {
+        EXPECT_EQ(expected[i].timespans[j].start,
+                  actual[i].timespans[j].start);
+        EXPECT_EQ(expected[i].timespans[j].end, actual[i].timespans[j].end);
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
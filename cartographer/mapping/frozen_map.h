@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_FROZEN_MAP_H_
+#define CARTOGRAPHER_MAPPING_FROZEN_MAP_H_
+
+#include <memory>
+#include <vector>
+
+#include "cartographer/io/mapped_blob_file.h"
+#include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/mapping_3d/submaps.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+
+// A map loaded once by MapBuilder::LoadFrozenMap(), to be added as a frozen
+// trajectory to the pose graphs of other MapBuilders with AddFrozenMap(), e.g.
+// of several robots localizing against the same map in one process. The
+// submaps, nodes and precomputed grids are immutable and shared by all pose
+// graphs, not copied.
+struct FrozenMap {
+  struct Submap {
+    transform::Rigid3d pose;
+    // Exactly one of these is set.
+    std::shared_ptr<const mapping_2d::Submap> submap_2d;
+    std::shared_ptr<const mapping_3d::Submap> submap_3d;
+  };
+
+  struct Node {
+    transform::Rigid3d pose;
+    std::shared_ptr<const TrajectoryNode::Data> constant_data;
+  };
+
+  // In the order of their submap indices.
+  std::vector<Submap> submaps;
+  std::vector<Node> nodes;
+
+  // The grids precomputed for matching against 'submaps', or nullptr if they
+  // are computed by each pose graph. Since they are memory-mapped, processes
+  // on the same host mapping the same file share their pages.
+  std::shared_ptr<const io::MappedBlobFile> precomputed_grids;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_FROZEN_MAP_H_
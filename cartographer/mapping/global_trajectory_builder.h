@@ -17,7 +17,14 @@
 #ifndef CARTOGRAPHER_MAPPING_GLOBAL_TRAJECTORY_BUILDER_H_
 #define CARTOGRAPHER_MAPPING_GLOBAL_TRAJECTORY_BUILDER_H_
 
+#include <utility>
+#include <vector>
+
+#include "cartographer/mapping/dead_reckoning.h"
 #include "cartographer/mapping/global_trajectory_builder_interface.h"
+#include "cartographer/mapping/pose_extrapolator.h"
+#include "cartographer/mapping/session_journal.h"
+#include "cartographer/mapping/sparse_pose_graph.h"
 
 namespace cartographer {
 namespace mapping {
@@ -27,42 +34,87 @@ template <typename LocalTrajectoryBuilder,
 class GlobalTrajectoryBuilder
     : public mapping::GlobalTrajectoryBuilderInterface {
  public:
+  // Nodes are also added to the 'journal' while it is active.
   GlobalTrajectoryBuilder(const LocalTrajectoryBuilderOptions& options,
                           const int trajectory_id,
-                          SparsePoseGraph* const sparse_pose_graph)
+                          SparsePoseGraph* const sparse_pose_graph,
+                          SessionJournal* const journal)
       : trajectory_id_(trajectory_id),
         sparse_pose_graph_(sparse_pose_graph),
-        local_trajectory_builder_(options) {}
+        journal_(journal),
+        local_trajectory_builder_(options),
+        dead_reckoning_(trajectory_id) {}
   ~GlobalTrajectoryBuilder() override {}
 
   GlobalTrajectoryBuilder(const GlobalTrajectoryBuilder&) = delete;
   GlobalTrajectoryBuilder& operator=(const GlobalTrajectoryBuilder&) = delete;
 
+  void RegisterMetrics(metrics::Registry* const registry) override {
+    local_trajectory_builder_.RegisterMetrics(trajectory_id_, registry);
+  }
+
   const mapping::PoseEstimate& pose_estimate() const override {
     return local_trajectory_builder_.pose_estimate();
   }
 
+  bool ExtrapolateGlobalPose(const common::Time time,
+                             transform::Rigid3d* const pose) const override {
+    const DeadReckoning::Extrapolation extrapolation =
+        dead_reckoning_.GetExtrapolation();
+    if (!extrapolation.valid) {
+      return false;
+    }
+    // The snapshot is loaded without locking the 'sparse_pose_graph_'.
+    const std::shared_ptr<const SparsePoseGraphSnapshot> snapshot =
+        sparse_pose_graph_->GetSnapshot();
+    const transform::Rigid3d local_to_global =
+        trajectory_id_ <
+                static_cast<int>(snapshot->local_to_global_transforms.size())
+            ? snapshot->local_to_global_transforms[trajectory_id_]
+            : transform::Rigid3d::Identity();
+    *pose = local_to_global *
+            PoseExtrapolator::ExtrapolatePose(extrapolation.state, time);
+    return true;
+  }
+
+  common::Duration GetDeadReckoningGap() const override {
+    return dead_reckoning_.GetExtrapolation().gap;
+  }
+
   void AddRangefinderData(const common::Time time,
                           const Eigen::Vector3f& origin,
-                          const sensor::PointCloud& ranges) override {
+                          const sensor::PointCloudView ranges) override {
     std::unique_ptr<typename LocalTrajectoryBuilder::InsertionResult>
-        insertion_result = local_trajectory_builder_.AddRangeData(
-            time, sensor::RangeData{origin, ranges, {}});
-    if (insertion_result == nullptr) {
-      return;
+        insertion_result =
+            local_trajectory_builder_.AddRangeData(time, origin, ranges);
+    if (insertion_result != nullptr) {
+      // The optimization uses the samples up to the time of the scan.
+      FlushBufferedSensorData();
+      journal_->AddNode(trajectory_id_, *insertion_result->constant_data,
+                        insertion_result->insertion_submaps);
+      sparse_pose_graph_->AddScan(std::move(insertion_result->constant_data),
+                                  trajectory_id_,
+                                  insertion_result->insertion_submaps);
     }
-    sparse_pose_graph_->AddScan(insertion_result->constant_data, trajectory_id_,
-                                insertion_result->insertion_submaps);
+    PublishExtrapolation();
   }
 
   void AddSensorData(const sensor::ImuData& imu_data) override {
     local_trajectory_builder_.AddImuData(imu_data);
-    sparse_pose_graph_->AddImuData(trajectory_id_, imu_data);
+    buffered_imu_data_.push_back(imu_data);
+    if (buffered_imu_data_.size() >= kMaxNumBufferedSamples) {
+      FlushBufferedSensorData();
+    }
+    PublishExtrapolation();
   }
 
   void AddSensorData(const sensor::OdometryData& odometry_data) override {
     local_trajectory_builder_.AddOdometerData(odometry_data);
-    sparse_pose_graph_->AddOdometerData(trajectory_id_, odometry_data);
+    buffered_odometry_data_.push_back(odometry_data);
+    if (buffered_odometry_data_.size() >= kMaxNumBufferedSamples) {
+      FlushBufferedSensorData();
+    }
+    PublishExtrapolation();
   }
 
   void AddSensorData(
@@ -70,10 +122,56 @@ class GlobalTrajectoryBuilder
     sparse_pose_graph_->AddFixedFramePoseData(trajectory_id_, fixed_frame_pose);
   }
 
+  void AddUncollatedSensorData(const sensor::ImuData& imu_data) override {
+    dead_reckoning_.AddImuData(imu_data);
+  }
+
+  void AddUncollatedSensorData(
+      const sensor::OdometryData& odometry_data) override {
+    dead_reckoning_.AddOdometryData(odometry_data);
+  }
+
+  void UpdateRuntimeOptions(
+      const proto::TrajectoryBuilderRuntimeOptions& runtime_options) override {
+    local_trajectory_builder_.UpdateRuntimeOptions(runtime_options);
+  }
+
  private:
+  using SparsePoseGraphSnapshot = mapping::SparsePoseGraph::Snapshot;
+
+  // IMU and odometry samples are passed to the 'sparse_pose_graph_' in batches
+  // of at most this size, or when a scan is added.
+  static constexpr size_t kMaxNumBufferedSamples = 20;
+
+  void FlushBufferedSensorData() {
+    if (!buffered_imu_data_.empty()) {
+      sparse_pose_graph_->AddImuData(trajectory_id_,
+                                     std::move(buffered_imu_data_));
+      buffered_imu_data_.clear();
+    }
+    if (!buffered_odometry_data_.empty()) {
+      sparse_pose_graph_->AddOdometerData(trajectory_id_,
+                                          std::move(buffered_odometry_data_));
+      buffered_odometry_data_.clear();
+    }
+  }
+
+  // Called after each collated sensor data. ExtrapolateGlobalPose() must not
+  // touch the 'local_trajectory_builder_' itself.
+  void PublishExtrapolation() {
+    PoseExtrapolator::ExtrapolationState state;
+    if (local_trajectory_builder_.GetExtrapolationState(&state)) {
+      dead_reckoning_.SetAnchor(state);
+    }
+  }
+
   const int trajectory_id_;
   SparsePoseGraph* const sparse_pose_graph_;
+  SessionJournal* const journal_;
   LocalTrajectoryBuilder local_trajectory_builder_;
+  std::vector<sensor::ImuData> buffered_imu_data_;
+  std::vector<sensor::OdometryData> buffered_odometry_data_;
+  DeadReckoning dead_reckoning_;
 };
 
 }  // namespace mapping
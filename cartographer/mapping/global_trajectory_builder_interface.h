@@ -24,7 +24,9 @@
 
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/pose_estimate.h"
+#include "cartographer/mapping/proto/runtime_options.pb.h"
 #include "cartographer/mapping/submaps.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/sensor/fixed_frame_pose_data.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
@@ -49,15 +51,37 @@ class GlobalTrajectoryBuilderInterface {
   GlobalTrajectoryBuilderInterface& operator=(
       const GlobalTrajectoryBuilderInterface&) = delete;
 
+  // Exports the metrics of local SLAM to 'registry'.
+  virtual void RegisterMetrics(metrics::Registry* registry) = 0;
+
   virtual const PoseEstimate& pose_estimate() const = 0;
 
+  // See TrajectoryBuilder::ExtrapolateGlobalPose().
+  virtual bool ExtrapolateGlobalPose(common::Time time,
+                                     transform::Rigid3d* pose) const = 0;
+
+  // See TrajectoryBuilder::GetDeadReckoningGap().
+  virtual common::Duration GetDeadReckoningGap() const = 0;
+
+  // The 'ranges' are only read during the call.
   virtual void AddRangefinderData(common::Time time,
                                   const Eigen::Vector3f& origin,
-                                  const sensor::PointCloud& ranges) = 0;
+                                  sensor::PointCloudView ranges) = 0;
   virtual void AddSensorData(const sensor::ImuData& imu_data) = 0;
   virtual void AddSensorData(const sensor::OdometryData& odometry_data) = 0;
   virtual void AddSensorData(
       const sensor::FixedFramePoseData& fixed_frame_pose) = 0;
+
+  // Called with IMU and odometry data on the thread adding it, before it is
+  // collated, so that ExtrapolateGlobalPose() keeps up while other sensors are
+  // stalled. Must not wait for the processing of collated sensor data.
+  virtual void AddUncollatedSensorData(const sensor::ImuData& imu_data) = 0;
+  virtual void AddUncollatedSensorData(
+      const sensor::OdometryData& odometry_data) = 0;
+
+  // See TrajectoryBuilder::UpdateRuntimeOptions().
+  virtual void UpdateRuntimeOptions(
+      const proto::TrajectoryBuilderRuntimeOptions& runtime_options) = 0;
 };
 
 }  // namespace mapping
@@ -100,7 +100,7 @@ class NestedVectorsById {
   }
 
   // TODO(whess): Remove once no longer needed.
-  const std::vector<std::vector<ValueType>> data() const { return data_; }
+  const std::vector<std::vector<ValueType>>& data() const { return data_; }
 
  private:
   static int GetIndex(const NodeId& id) { return id.node_index; }
@@ -225,6 +225,15 @@ class MapById {
     return trajectories_.at(id.trajectory_id).data_.at(GetIndex(id));
   }
 
+  // Returns the number of elements of 'trajectory_id', or 0 if there is no
+  // such trajectory.
+  int SizeOfTrajectoryOrZero(const int trajectory_id) const {
+    const auto it = trajectories_.find(trajectory_id);
+    return it == trajectories_.end()
+               ? 0
+               : static_cast<int>(it->second.data_.size());
+  }
+
   ConstIterator begin() const { return ConstIterator(*this); }
   ConstIterator end() const { return ConstIterator::EndIterator(*this); }
 
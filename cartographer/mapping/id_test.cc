@@ -34,6 +34,19 @@ TEST(IdTest, EmptyMapById) {
   EXPECT_TRUE(map_by_id.empty());
 }
 
+TEST(IdTest, MapByIdSizeOfTrajectoryOrZero) {
+  MapById<SubmapId, int> map_by_id;
+  EXPECT_EQ(0, map_by_id.SizeOfTrajectoryOrZero(0));
+  map_by_id.Append(0, 0);
+  const SubmapId id = map_by_id.Append(0, 1);
+  map_by_id.Append(3, 2);
+  EXPECT_EQ(2, map_by_id.SizeOfTrajectoryOrZero(0));
+  EXPECT_EQ(0, map_by_id.SizeOfTrajectoryOrZero(1));
+  EXPECT_EQ(1, map_by_id.SizeOfTrajectoryOrZero(3));
+  map_by_id.Trim(id);
+  EXPECT_EQ(1, map_by_id.SizeOfTrajectoryOrZero(0));
+}
+
 TEST(IdTest, MapByIdIterator) {
   MapById<NodeId, int> map_by_id;
   map_by_id.Append(7, 2);
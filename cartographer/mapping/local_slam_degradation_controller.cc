@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/local_slam_degradation_controller.h"
+
+#include <algorithm>
+#include <string>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+constexpr int LocalSlamDegradationController::kMaxLevel;
+
+proto::LocalSlamDegradationOptions CreateLocalSlamDegradationOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::LocalSlamDegradationOptions options;
+  options.set_time_budget_seconds(
+      parameter_dictionary->GetDouble("time_budget_seconds"));
+  options.set_step_up_budget_fraction(
+      parameter_dictionary->GetDouble("step_up_budget_fraction"));
+  options.set_num_range_data_to_step_up(
+      parameter_dictionary->GetNonNegativeInt("num_range_data_to_step_up"));
+  options.set_max_level(parameter_dictionary->GetNonNegativeInt("max_level"));
+  options.set_min_num_points_factor(
+      parameter_dictionary->GetDouble("min_num_points_factor"));
+  options.set_max_num_ceres_iterations(
+      parameter_dictionary->GetNonNegativeInt("max_num_ceres_iterations"));
+  CHECK_GE(options.time_budget_seconds(), 0.);
+  CHECK_GT(options.step_up_budget_fraction(), 0.);
+  CHECK_LT(options.step_up_budget_fraction(), 1.);
+  CHECK_LE(options.max_level(), LocalSlamDegradationController::kMaxLevel);
+  CHECK_GT(options.min_num_points_factor(), 0.f);
+  CHECK_LE(options.min_num_points_factor(), 1.f);
+  CHECK_GT(options.max_num_ceres_iterations(), 0);
+  return options;
+}
+
+LocalSlamDegradationController::LocalSlamDegradationController(
+    const proto::LocalSlamDegradationOptions& options)
+    : options_(options) {}
+
+void LocalSlamDegradationController::RegisterMetrics(
+    const int trajectory_id, metrics::Registry* const registry) {
+  level_metric_ = registry->GetGauge(
+      "cartographer_local_slam_degradation_level",
+      "Level by which local SLAM is degraded to keep up, 0 if it is not.",
+      {{"trajectory_id", std::to_string(trajectory_id)}});
+  level_metric_->Set(level_);
+}
+
+void LocalSlamDegradationController::Update(const double seconds) {
+  if (options_.time_budget_seconds() == 0.) {
+    return;
+  }
+  if (seconds > options_.time_budget_seconds()) {
+    num_range_data_below_budget_ = 0;
+    if (level_ < options_.max_level()) {
+      SetLevel(level_ + 1);
+    }
+    return;
+  }
+  if (level_ == 0 || seconds > options_.step_up_budget_fraction() *
+                                   options_.time_budget_seconds()) {
+    num_range_data_below_budget_ = 0;
+    return;
+  }
+  if (++num_range_data_below_budget_ >= options_.num_range_data_to_step_up()) {
+    num_range_data_below_budget_ = 0;
+    SetLevel(level_ - 1);
+  }
+}
+
+void LocalSlamDegradationController::SetLevel(const int level) {
+  if (level > level_) {
+    LOG(WARNING) << "Local SLAM exceeds its time budget, degrading to level "
+                 << level << ".";
+  } else {
+    LOG(INFO) << "Local SLAM is within its time budget, stepping up to level "
+              << level << ".";
+  }
+  level_ = level;
+  if (level_metric_ != nullptr) {
+    level_metric_->Set(level_);
+  }
+}
+
+sensor::proto::AdaptiveVoxelFilterOptions
+LocalSlamDegradationController::AdjustAdaptiveVoxelFilterOptions(
+    const sensor::proto::AdaptiveVoxelFilterOptions& options) const {
+  sensor::proto::AdaptiveVoxelFilterOptions adjusted_options = options;
+  if (level_ >= 1) {
+    adjusted_options.set_min_num_points(options.min_num_points() *
+                                        options_.min_num_points_factor());
+  }
+  return adjusted_options;
+}
+
+int LocalSlamDegradationController::AdjustMaxNumCeresIterations(
+    const int max_num_iterations) const {
+  if (level_ >= 2) {
+    return std::min(max_num_iterations, options_.max_num_ceres_iterations());
+  }
+  return max_num_iterations;
+}
+
+bool LocalSlamDegradationController::ShouldInsert() {
+  if (level_ < kMaxLevel || skipped_last_insertion_) {
+    skipped_last_insertion_ = false;
+    return true;
+  }
+  skipped_last_insertion_ = true;
+  return false;
+}
+
+}  // namespace mapping
+}  // namespace cartographer
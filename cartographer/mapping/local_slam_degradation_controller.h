@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_LOCAL_SLAM_DEGRADATION_CONTROLLER_H_
+#define CARTOGRAPHER_MAPPING_LOCAL_SLAM_DEGRADATION_CONTROLLER_H_
+
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/mapping/proto/local_slam_degradation_options.pb.h"
+#include "cartographer/metrics/metrics.h"
+#include "cartographer/sensor/proto/adaptive_voxel_filter_options.pb.h"
+
+namespace cartographer {
+namespace mapping {
+
+proto::LocalSlamDegradationOptions CreateLocalSlamDegradationOptions(
+    common::LuaParameterDictionary* parameter_dictionary);
+
+// Decides how much to degrade the quality of local SLAM, depending on how long
+// it took to process the last range data, see LocalSlamDegradationOptions.
+//
+// This class is not thread-safe.
+class LocalSlamDegradationController {
+ public:
+  static constexpr int kMaxLevel = 4;
+
+  explicit LocalSlamDegradationController(
+      const proto::LocalSlamDegradationOptions& options);
+
+  LocalSlamDegradationController(const LocalSlamDegradationController&) =
+      delete;
+  LocalSlamDegradationController& operator=(
+      const LocalSlamDegradationController&) = delete;
+
+  // Exports the current level of the trajectory with 'trajectory_id' to
+  // 'registry'.
+  void RegisterMetrics(int trajectory_id, metrics::Registry* registry);
+
+  // Updates the level from the time it took to process one range data.
+  void Update(double seconds);
+
+  // Returns the level between 0 (full quality) and 'kMaxLevel'.
+  int level() const { return level_; }
+
+  // Returns the 'options' of an adaptive voxel filter for scan matching
+  // adjusted for the current level.
+  sensor::proto::AdaptiveVoxelFilterOptions AdjustAdaptiveVoxelFilterOptions(
+      const sensor::proto::AdaptiveVoxelFilterOptions& options) const;
+
+  // Returns the configured 'max_num_iterations' of the Ceres scan matcher
+  // adjusted for the current level.
+  int AdjustMaxNumCeresIterations(int max_num_iterations) const;
+
+  bool skip_online_correlative_scan_matching() const { return level_ >= 3; }
+
+  // Returns whether the next range data is to be inserted into the submaps.
+  // At the highest level, this is false for every other range data.
+  bool ShouldInsert();
+
+ private:
+  void SetLevel(int level);
+
+  const proto::LocalSlamDegradationOptions options_;
+  int level_ = 0;
+  int num_range_data_below_budget_ = 0;
+  bool skipped_last_insertion_ = false;
+  // Set by RegisterMetrics().
+  metrics::Gauge* level_metric_ = nullptr;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_LOCAL_SLAM_DEGRADATION_CONTROLLER_H_
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/local_slam_degradation_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+proto::LocalSlamDegradationOptions CreateOptions() {
+  proto::LocalSlamDegradationOptions options;
+  options.set_time_budget_seconds(0.1);
+  options.set_step_up_budget_fraction(0.5);
+  options.set_num_range_data_to_step_up(3);
+  options.set_max_level(4);
+  options.set_min_num_points_factor(0.5f);
+  options.set_max_num_ceres_iterations(5);
+  return options;
+}
+
+TEST(LocalSlamDegradationControllerTest, StepsDownAndUp) {
+  LocalSlamDegradationController controller(CreateOptions());
+  sensor::proto::AdaptiveVoxelFilterOptions voxel_filter_options;
+  voxel_filter_options.set_min_num_points(200.f);
+  controller.Update(0.09);
+  EXPECT_EQ(0, controller.level());
+  EXPECT_EQ(200.f, controller.AdjustAdaptiveVoxelFilterOptions(
+                                 voxel_filter_options)
+                       .min_num_points());
+  EXPECT_EQ(20, controller.AdjustMaxNumCeresIterations(20));
+  EXPECT_FALSE(controller.skip_online_correlative_scan_matching());
+  EXPECT_TRUE(controller.ShouldInsert());
+  EXPECT_TRUE(controller.ShouldInsert());
+
+  for (int i = 0; i != 10; ++i) {
+    controller.Update(0.2);
+  }
+  EXPECT_EQ(4, controller.level());
+  EXPECT_EQ(100.f, controller.AdjustAdaptiveVoxelFilterOptions(
+                                 voxel_filter_options)
+                       .min_num_points());
+  EXPECT_EQ(5, controller.AdjustMaxNumCeresIterations(20));
+  EXPECT_TRUE(controller.skip_online_correlative_scan_matching());
+  EXPECT_FALSE(controller.ShouldInsert());
+  EXPECT_TRUE(controller.ShouldInsert());
+  EXPECT_FALSE(controller.ShouldInsert());
+
+  // Within the budget, but not below the step up fraction.
+  for (int i = 0; i != 10; ++i) {
+    controller.Update(0.07);
+  }
+  EXPECT_EQ(4, controller.level());
+  controller.Update(0.01);
+  controller.Update(0.01);
+  EXPECT_EQ(4, controller.level());
+  controller.Update(0.01);
+  EXPECT_EQ(3, controller.level());
+  EXPECT_TRUE(controller.ShouldInsert());
+  EXPECT_TRUE(controller.ShouldInsert());
+  for (int i = 0; i != 9; ++i) {
+    controller.Update(0.01);
+  }
+  EXPECT_EQ(0, controller.level());
+}
+
+TEST(LocalSlamDegradationControllerTest, RespectsMaxLevel) {
+  proto::LocalSlamDegradationOptions options = CreateOptions();
+  options.set_max_level(2);
+  LocalSlamDegradationController controller(options);
+  for (int i = 0; i != 10; ++i) {
+    controller.Update(1.);
+  }
+  EXPECT_EQ(2, controller.level());
+  EXPECT_FALSE(controller.skip_online_correlative_scan_matching());
+}
+
+TEST(LocalSlamDegradationControllerTest, Disabled) {
+  proto::LocalSlamDegradationOptions options = CreateOptions();
+  options.set_time_budget_seconds(0.);
+  LocalSlamDegradationController controller(options);
+  controller.Update(1000.);
+  EXPECT_EQ(0, controller.level());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
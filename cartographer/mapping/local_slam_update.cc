@@ -0,0 +1,120 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/local_slam_update.h"
+
+#include "cartographer/transform/transform.h"
+
+namespace cartographer {
+namespace mapping {
+
+namespace {
+
+bool IsSameTransform(const transform::Rigid3d& lhs,
+                     const transform::Rigid3d& rhs) {
+  return lhs.translation() == rhs.translation() &&
+         lhs.rotation().coeffs() == rhs.rotation().coeffs();
+}
+
+}  // namespace
+
+proto::Submap ToSubmapUpdateProto(const Submap& submap,
+                                  const SubmapId& submap_id,
+                                  const bool include_grids) {
+  proto::Submap proto;
+  submap.ToProto(&proto);
+  proto.mutable_submap_id()->set_trajectory_id(submap_id.trajectory_id);
+  proto.mutable_submap_id()->set_submap_index(submap_id.submap_index);
+  if (include_grids) {
+    return proto;
+  }
+  if (proto.has_submap_2d()) {
+    auto* const probability_grid =
+        proto.mutable_submap_2d()->mutable_probability_grid();
+    probability_grid->clear_cells();
+    probability_grid->clear_known_cells();
+    probability_grid->clear_min_x();
+    probability_grid->clear_min_y();
+    probability_grid->clear_max_x();
+    probability_grid->clear_max_y();
+  }
+  if (proto.has_submap_3d()) {
+    for (auto* const hybrid_grid :
+         {proto.mutable_submap_3d()->mutable_high_resolution_hybrid_grid(),
+          proto.mutable_submap_3d()->mutable_low_resolution_hybrid_grid()}) {
+      const float resolution = hybrid_grid->resolution();
+      hybrid_grid->Clear();
+      hybrid_grid->set_resolution(resolution);
+    }
+  }
+  return proto;
+}
+
+template <>
+std::shared_ptr<mapping_2d::Submap> CreateSubmapFromUpdate(
+    const proto::Submap& proto) {
+  CHECK(proto.has_submap_2d());
+  const auto& probability_grid = proto.submap_2d().probability_grid();
+  const bool load_probability_grid =
+      probability_grid.has_known_cells() || probability_grid.cells_size() > 0;
+  return std::make_shared<mapping_2d::Submap>(proto.submap_2d(),
+                                              load_probability_grid);
+}
+
+template <>
+std::shared_ptr<mapping_3d::Submap> CreateSubmapFromUpdate(
+    const proto::Submap& proto) {
+  CHECK(proto.has_submap_3d());
+  return std::make_shared<mapping_3d::Submap>(proto.submap_3d());
+}
+
+proto::GlobalPoseUpdate GlobalPoseUpdateWriter::ComputeUpdate(
+    const std::vector<transform::Rigid3d>& local_to_global_transforms) {
+  proto::GlobalPoseUpdate update;
+  for (size_t trajectory_id = 0;
+       trajectory_id != local_to_global_transforms.size(); ++trajectory_id) {
+    const transform::Rigid3d& local_to_global =
+        local_to_global_transforms[trajectory_id];
+    if (trajectory_id < sent_transforms_.size() &&
+        IsSameTransform(sent_transforms_[trajectory_id], local_to_global)) {
+      continue;
+    }
+    auto* const transform = update.add_transform();
+    transform->set_trajectory_id(trajectory_id);
+    *transform->mutable_local_to_global() = transform::ToProto(local_to_global);
+  }
+  sent_transforms_ = local_to_global_transforms;
+  return update;
+}
+
+void GlobalPoseUpdateReader::AddUpdate(const proto::GlobalPoseUpdate& update) {
+  for (const auto& transform : update.transform()) {
+    local_to_global_transforms_[transform.trajectory_id()] =
+        transform::ToRigid3(transform.local_to_global());
+  }
+}
+
+transform::Rigid3d GlobalPoseUpdateReader::GetLocalToGlobalTransform(
+    const int trajectory_id) const {
+  const auto it = local_to_global_transforms_.find(trajectory_id);
+  if (it == local_to_global_transforms_.end()) {
+    return transform::Rigid3d::Identity();
+  }
+  return it->second;
+}
+
+}  // namespace mapping
+}  // namespace cartographer
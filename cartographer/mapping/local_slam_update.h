@@ -0,0 +1,253 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_LOCAL_SLAM_UPDATE_H_
+#define CARTOGRAPHER_MAPPING_LOCAL_SLAM_UPDATE_H_
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/proto/local_slam_update.pb.h"
+#include "cartographer/mapping/submaps.h"
+#include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/mapping_3d/submaps.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "glog/logging.h"
+
+// Wire format for running local SLAM on clients and the sparse pose graph on a
+// server. Clients stream their nodes and submaps as LocalSlamUpdateBatches.
+// The server streams back the local to global transforms as GlobalPoseUpdates.
+// The transport is up to the user of these classes.
+
+namespace cartographer {
+namespace mapping {
+
+// Returns 'submap' with ID 'submap_id' as a proto. Unless 'include_grids' is
+// true, the grids only keep their limits or resolution but no cells.
+proto::Submap ToSubmapUpdateProto(const Submap& submap,
+                                  const SubmapId& submap_id,
+                                  bool include_grids);
+
+// Creates the server side copy of a submap from the first update about it.
+template <typename SubmapType>
+std::shared_ptr<SubmapType> CreateSubmapFromUpdate(const proto::Submap& proto);
+template <>
+std::shared_ptr<mapping_2d::Submap> CreateSubmapFromUpdate(
+    const proto::Submap& proto);
+template <>
+std::shared_ptr<mapping_3d::Submap> CreateSubmapFromUpdate(
+    const proto::Submap& proto);
+
+// Client side: collects the local SLAM results of one trajectory into
+// batches. Each submap is sent with its grids only once, when it is finished.
+//
+// This class is not thread-safe.
+template <typename SubmapType>
+class LocalSlamUpdateWriter {
+ public:
+  LocalSlamUpdateWriter(const int trajectory_id, const int max_nodes_per_batch)
+      : trajectory_id_(trajectory_id),
+        max_nodes_per_batch_(max_nodes_per_batch) {
+    CHECK_GT(max_nodes_per_batch, 0);
+    batch_.set_trajectory_id(trajectory_id);
+  }
+
+  LocalSlamUpdateWriter(const LocalSlamUpdateWriter&) = delete;
+  LocalSlamUpdateWriter& operator=(const LocalSlamUpdateWriter&) = delete;
+
+  // Adds a node which local SLAM inserted into 'insertion_submaps'.
+  void AddNode(
+      const TrajectoryNode::Data& constant_data,
+      const std::vector<std::shared_ptr<const SubmapType>>& insertion_submaps) {
+    CHECK(!insertion_submaps.empty());
+    auto* const node = batch_.add_node();
+    for (size_t i = 0; i != insertion_submaps.size(); ++i) {
+      const int submap_index = AddSubmap(insertion_submaps[i], node);
+      if (i == 0) {
+        node->set_insertion_submap_index(submap_index);
+      } else {
+        CHECK_EQ(submap_index, node->insertion_submap_index() + i);
+      }
+    }
+    node->set_num_insertion_submaps(insertion_submaps.size());
+    *node->mutable_node_data() = ToProto(constant_data);
+    node->set_timestamp_delta(node->node_data().timestamp() - last_timestamp_);
+    last_timestamp_ = node->node_data().timestamp();
+    node->mutable_node_data()->clear_timestamp();
+  }
+
+  // Returns true once the current batch should be sent.
+  bool IsBatchFull() const {
+    return batch_.node_size() >= max_nodes_per_batch_;
+  }
+
+  // Returns the current batch, which may be empty, and starts a new one.
+  proto::LocalSlamUpdateBatch TakeBatch() {
+    proto::LocalSlamUpdateBatch batch;
+    batch.Swap(&batch_);
+    batch.set_sequence_number(next_sequence_number_++);
+    batch_.set_trajectory_id(trajectory_id_);
+    return batch;
+  }
+
+ private:
+  struct TrackedSubmap {
+    std::shared_ptr<const SubmapType> submap;
+    int submap_index;
+  };
+
+  // Returns the index of 'submap' and adds it to 'node' if it is new or
+  // finished.
+  int AddSubmap(const std::shared_ptr<const SubmapType>& submap,
+                proto::LocalSlamUpdateBatch::InsertedNode* const node) {
+    auto it = std::find_if(tracked_submaps_.begin(), tracked_submaps_.end(),
+                           [&submap](const TrackedSubmap& tracked_submap) {
+                             return tracked_submap.submap == submap;
+                           });
+    const bool is_new = it == tracked_submaps_.end();
+    if (is_new) {
+      tracked_submaps_.push_back(TrackedSubmap{submap, next_submap_index_++});
+      it = std::prev(tracked_submaps_.end());
+    }
+    const int submap_index = it->submap_index;
+    const bool finished = submap->finished();
+    if (is_new || finished) {
+      *node->add_submap() = ToSubmapUpdateProto(
+          *submap, SubmapId{trajectory_id_, submap_index}, finished);
+    }
+    if (finished) {
+      // Finished submaps are never inserted into again.
+      tracked_submaps_.erase(it);
+    }
+    return submap_index;
+  }
+
+  const int trajectory_id_;
+  const int max_nodes_per_batch_;
+  proto::LocalSlamUpdateBatch batch_;
+  int64 next_sequence_number_ = 0;
+  int64 last_timestamp_ = 0;
+  int next_submap_index_ = 0;
+  // Submaps which were sent but are not yet finished.
+  std::vector<TrackedSubmap> tracked_submaps_;
+};
+
+// Server side: adds the nodes and submaps received from clients to
+// 'sparse_pose_graph' in the order they were added to the writers.
+//
+// This class is not thread-safe.
+template <typename SubmapType, typename SparsePoseGraphType>
+class LocalSlamUpdateReader {
+ public:
+  explicit LocalSlamUpdateReader(SparsePoseGraphType* const sparse_pose_graph)
+      : sparse_pose_graph_(sparse_pose_graph) {}
+
+  LocalSlamUpdateReader(const LocalSlamUpdateReader&) = delete;
+  LocalSlamUpdateReader& operator=(const LocalSlamUpdateReader&) = delete;
+
+  // Batches of each trajectory have to be added in order and without gaps.
+  void AddBatch(const proto::LocalSlamUpdateBatch& batch) {
+    const int trajectory_id = batch.trajectory_id();
+    Trajectory& trajectory = trajectories_[trajectory_id];
+    CHECK_EQ(batch.sequence_number(), trajectory.next_sequence_number)
+        << "Batches of trajectory " << trajectory_id << " were lost.";
+    ++trajectory.next_sequence_number;
+    for (const auto& node : batch.node()) {
+      for (const proto::Submap& submap_proto : node.submap()) {
+        CHECK_EQ(submap_proto.submap_id().trajectory_id(), trajectory_id);
+        const int submap_index = submap_proto.submap_id().submap_index();
+        const auto it = trajectory.submaps.find(submap_index);
+        if (it == trajectory.submaps.end()) {
+          trajectory.submaps.emplace(
+              submap_index, CreateSubmapFromUpdate<SubmapType>(submap_proto));
+        } else {
+          it->second->UpdateFromProto(submap_proto);
+        }
+      }
+      std::vector<std::shared_ptr<const SubmapType>> insertion_submaps;
+      for (int i = 0; i != node.num_insertion_submaps(); ++i) {
+        insertion_submaps.push_back(
+            trajectory.submaps.at(node.insertion_submap_index() + i));
+      }
+      proto::TrajectoryNodeData node_data = node.node_data();
+      trajectory.last_timestamp += node.timestamp_delta();
+      node_data.set_timestamp(trajectory.last_timestamp);
+      sparse_pose_graph_->AddScan(
+          std::make_shared<const TrajectoryNode::Data>(FromProto(node_data)),
+          trajectory_id, insertion_submaps);
+      // Finished submaps are never inserted into again, so only the sparse
+      // pose graph keeps them.
+      for (auto it = trajectory.submaps.begin();
+           it != trajectory.submaps.end();) {
+        if (it->second->finished()) {
+          it = trajectory.submaps.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+ private:
+  struct Trajectory {
+    int64 next_sequence_number = 0;
+    int64 last_timestamp = 0;
+    // Submaps which are not finished yet, by submap index.
+    std::map<int, std::shared_ptr<SubmapType>> submaps;
+  };
+
+  SparsePoseGraphType* const sparse_pose_graph_;
+  std::map<int, Trajectory> trajectories_;
+};
+
+// Server side: sends the local to global transforms which changed.
+//
+// This class is not thread-safe.
+class GlobalPoseUpdateWriter {
+ public:
+  // Returns the update for 'local_to_global_transforms', which are indexed by
+  // trajectory ID, relative to the previous call.
+  proto::GlobalPoseUpdate ComputeUpdate(
+      const std::vector<transform::Rigid3d>& local_to_global_transforms);
+
+ private:
+  std::vector<transform::Rigid3d> sent_transforms_;
+};
+
+// Client side: keeps the local to global transforms received from the server.
+//
+// This class is not thread-safe.
+class GlobalPoseUpdateReader {
+ public:
+  void AddUpdate(const proto::GlobalPoseUpdate& update);
+
+  // Returns the identity until a transform for 'trajectory_id' was received.
+  transform::Rigid3d GetLocalToGlobalTransform(int trajectory_id) const;
+
+ private:
+  std::map<int, transform::Rigid3d> local_to_global_transforms_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_LOCAL_SLAM_UPDATE_H_
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/local_slam_update.h"
+
+#include <memory>
+#include <vector>
+
+#include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/transform/transform.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Records what the LocalSlamUpdateReader adds.
+class FakeSparsePoseGraph {
+ public:
+  struct Scan {
+    std::shared_ptr<const TrajectoryNode::Data> constant_data;
+    int trajectory_id;
+    std::vector<std::shared_ptr<const mapping_2d::Submap>> insertion_submaps;
+    bool front_submap_finished;
+  };
+
+  void AddScan(
+      std::shared_ptr<const TrajectoryNode::Data> constant_data,
+      const int trajectory_id,
+      const std::vector<std::shared_ptr<const mapping_2d::Submap>>&
+          insertion_submaps) {
+    scans.push_back(Scan{constant_data, trajectory_id, insertion_submaps,
+                         insertion_submaps.front()->finished()});
+  }
+
+  std::vector<Scan> scans;
+};
+
+mapping_2d::proto::SubmapsOptions CreateSubmapsOptions() {
+  mapping_2d::proto::SubmapsOptions options;
+  options.set_resolution(0.05);
+  options.set_num_range_data(3);
+  options.set_use_tiled_probability_grid(false);
+  options.set_use_background_insertion(false);
+  auto* const range_data_inserter_options =
+      options.mutable_range_data_inserter_options();
+  range_data_inserter_options->set_insert_free_space(true);
+  range_data_inserter_options->set_hit_probability(0.53);
+  range_data_inserter_options->set_miss_probability(0.495);
+  return options;
+}
+
+TEST(LocalSlamUpdateTest, ServerSeesSameScansAndSubmaps) {
+  constexpr int kTrajectoryId = 2;
+  constexpr int kNumScans = 20;
+  mapping_2d::ActiveSubmaps active_submaps(CreateSubmapsOptions());
+  LocalSlamUpdateWriter<mapping_2d::Submap> writer(kTrajectoryId,
+                                                   4 /* max_nodes_per_batch */);
+  FakeSparsePoseGraph sparse_pose_graph;
+  LocalSlamUpdateReader<mapping_2d::Submap, FakeSparsePoseGraph> reader(
+      &sparse_pose_graph);
+
+  std::vector<std::vector<std::shared_ptr<const mapping_2d::Submap>>>
+      client_insertion_submaps;
+  std::vector<bool> client_front_submap_finished;
+  int num_submaps_with_grids = 0;
+  for (int i = 0; i != kNumScans; ++i) {
+    std::vector<std::shared_ptr<const mapping_2d::Submap>> insertion_submaps;
+    for (const auto& submap : active_submaps.submaps()) {
+      insertion_submaps.push_back(submap);
+    }
+    active_submaps.InsertRangeData(
+        {Eigen::Vector3f::Zero(),
+         {Eigen::Vector3f(1.f, 0.1f * i, 0.f)},
+         {}});
+    TrajectoryNode::Data constant_data;
+    constant_data.time = common::FromUniversal(1000 + 10 * i);
+    constant_data.gravity_alignment = Eigen::Quaterniond::Identity();
+    constant_data.initial_pose = transform::Rigid3d::Translation(
+        Eigen::Vector3d(0.5 * i, 0., 0.));
+    writer.AddNode(constant_data, insertion_submaps);
+    client_insertion_submaps.push_back(insertion_submaps);
+    client_front_submap_finished.push_back(
+        insertion_submaps.front()->finished());
+    if (writer.IsBatchFull() || i + 1 == kNumScans) {
+      const proto::LocalSlamUpdateBatch batch = writer.TakeBatch();
+      for (const auto& node : batch.node()) {
+        for (const auto& submap : node.submap()) {
+          if (submap.submap_2d().probability_grid().has_known_cells() ||
+              submap.submap_2d().probability_grid().cells_size() > 0) {
+            ++num_submaps_with_grids;
+          }
+        }
+      }
+      reader.AddBatch(batch);
+    }
+  }
+
+  ASSERT_EQ(kNumScans, sparse_pose_graph.scans.size());
+  int num_finished_submaps = 0;
+  for (int i = 0; i != kNumScans; ++i) {
+    const auto& scan = sparse_pose_graph.scans[i];
+    const auto& expected_submaps = client_insertion_submaps[i];
+    EXPECT_EQ(kTrajectoryId, scan.trajectory_id);
+    EXPECT_EQ(common::FromUniversal(1000 + 10 * i),
+              scan.constant_data->time);
+    EXPECT_NEAR(0.5 * i, scan.constant_data->initial_pose.translation().x(),
+                1e-9);
+    ASSERT_EQ(expected_submaps.size(), scan.insertion_submaps.size());
+    EXPECT_EQ(client_front_submap_finished[i], scan.front_submap_finished);
+    if (scan.front_submap_finished) {
+      ++num_finished_submaps;
+      const auto& expected_grid = expected_submaps.front()->probability_grid();
+      const auto& actual_grid =
+          scan.insertion_submaps.front()->probability_grid();
+      EXPECT_EQ(expected_grid.ToProto().SerializeAsString(),
+                actual_grid.ToProto().SerializeAsString());
+    }
+    if (i != 0) {
+      // The server keeps reusing the same submap objects, which the sparse
+      // pose graph relies on.
+      const auto& previous_scan = sparse_pose_graph.scans[i - 1];
+      EXPECT_EQ(scan.insertion_submaps.front() ==
+                    previous_scan.insertion_submaps.back(),
+                expected_submaps.front() ==
+                    client_insertion_submaps[i - 1].back());
+    }
+  }
+  EXPECT_GT(num_finished_submaps, 0);
+  // Grids are only sent once, for finished submaps.
+  EXPECT_EQ(num_finished_submaps, num_submaps_with_grids);
+}
+
+TEST(LocalSlamUpdateTest, OnlyChangedTransformsAreSent) {
+  GlobalPoseUpdateWriter writer;
+  GlobalPoseUpdateReader reader;
+  std::vector<transform::Rigid3d> local_to_global_transforms = {
+      transform::Rigid3d::Identity(),
+      transform::Rigid3d::Translation(Eigen::Vector3d(1., 2., 3.))};
+  proto::GlobalPoseUpdate update =
+      writer.ComputeUpdate(local_to_global_transforms);
+  EXPECT_EQ(2, update.transform_size());
+  reader.AddUpdate(update);
+
+  local_to_global_transforms[1] =
+      transform::Rigid3d::Translation(Eigen::Vector3d(4., 5., 6.));
+  local_to_global_transforms.push_back(
+      transform::Rigid3d::Translation(Eigen::Vector3d(7., 8., 9.)));
+  update = writer.ComputeUpdate(local_to_global_transforms);
+  ASSERT_EQ(2, update.transform_size());
+  EXPECT_EQ(1, update.transform(0).trajectory_id());
+  EXPECT_EQ(2, update.transform(1).trajectory_id());
+  reader.AddUpdate(update);
+  EXPECT_EQ(0, writer.ComputeUpdate(local_to_global_transforms)
+                   .transform_size());
+
+  for (int trajectory_id = 0; trajectory_id != 3; ++trajectory_id) {
+    EXPECT_TRUE(
+        (reader.GetLocalToGlobalTransform(trajectory_id).translation() -
+         local_to_global_transforms[trajectory_id].translation())
+            .isZero());
+  }
+  EXPECT_TRUE(reader.GetLocalToGlobalTransform(3).translation().isZero());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -16,17 +16,27 @@
 
 #include "cartographer/mapping/map_builder.h"
 
+#include <algorithm>
 #include <cmath>
+#include <deque>
+#include <functional>
 #include <limits>
+#include <map>
 #include <memory>
+#include <set>
 #include <unordered_set>
 #include <utility>
 
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/work_stealing_thread_pool.h"
 #include "cartographer/mapping/collated_trajectory_builder.h"
 #include "cartographer/mapping/global_trajectory_builder.h"
+#include "cartographer/mapping/local_slam_update.h"
 #include "cartographer/mapping_2d/local_trajectory_builder.h"
+#include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
 #include "cartographer/mapping_3d/local_trajectory_builder.h"
+#include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
 #include "cartographer/sensor/range_data.h"
 #include "cartographer/sensor/voxel_filter.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -36,6 +46,444 @@
 namespace cartographer {
 namespace mapping {
 
+namespace {
+
+std::unique_ptr<common::ThreadPoolInterface> CreateThreadPool(
+    const proto::MapBuilderOptions& options, const int num_threads,
+    const int nice_level) {
+  const std::vector<int> cpus(options.background_thread_cpus().begin(),
+                              options.background_thread_cpus().end());
+  if (options.use_work_stealing_thread_pool()) {
+    return common::make_unique<common::WorkStealingThreadPool>(
+        num_threads, cpus, nice_level);
+  }
+  return common::make_unique<common::ThreadPool>(num_threads, cpus,
+                                                 nice_level);
+}
+
+using SubmapLoader =
+    mapping_2d::sparse_pose_graph::ConstraintBuilder::SubmapLoader;
+
+// A message of the proto stream read by LoadMap(), decompressed and
+// deserialized in the background.
+struct LoadedData {
+  bool done = false;
+  std::unique_ptr<proto::SerializedData> proto;
+  std::shared_ptr<const mapping_2d::Submap> submap_2d;
+  std::shared_ptr<const mapping_3d::Submap> submap_3d;
+  std::shared_ptr<const TrajectoryNode::Data> node_data;
+  // The grids stored with the submap, if any.
+  std::unique_ptr<string> precomputed_grids;
+};
+
+struct LoadMapState {
+  common::Mutex mutex;
+  // Messages in the order they were read.
+  std::deque<std::shared_ptr<LoadedData>> loaded_data GUARDED_BY(mutex);
+};
+
+// Returns the memory-mapped 'precomputed_grids_filename', or nullptr if it is
+// empty.
+std::shared_ptr<const io::MappedBlobFile> OpenPrecomputedGrids(
+    const string& precomputed_grids_filename) {
+  if (precomputed_grids_filename.empty()) {
+    return nullptr;
+  }
+  return std::make_shared<const io::MappedBlobFile>(precomputed_grids_filename);
+}
+
+// Builds the submap or node in 'compressed' which is the expensive part of
+// loading a map. The proto stays around for its IDs. Unless
+// 'load_submap_grids' is true, 2D submaps are built without their grids.
+void DecodeSerializedData(const io::ProtoStreamReader& reader,
+                          const string& compressed,
+                          const bool use_trajectory_builder_2d,
+                          const bool load_submap_grids,
+                          LoadedData* const loaded_data) {
+  auto proto = common::make_unique<proto::SerializedData>();
+  CHECK(reader.ParseCompressedProto(compressed, proto.get()));
+  if (proto->has_node()) {
+    loaded_data->node_data = std::make_shared<const TrajectoryNode::Data>(
+        FromProto(proto->node().node_data()));
+    proto->mutable_node()->clear_node_data();
+  }
+  if (proto->has_submap()) {
+    if (use_trajectory_builder_2d && proto->submap().has_submap_2d()) {
+      loaded_data->submap_2d = std::make_shared<const mapping_2d::Submap>(
+          proto->submap().submap_2d(), load_submap_grids);
+    }
+    if (!use_trajectory_builder_2d && proto->submap().has_submap_3d()) {
+      loaded_data->submap_3d = std::make_shared<const mapping_3d::Submap>(
+          proto->submap().submap_3d());
+    }
+    if (proto->submap().has_precomputed_grids()) {
+      loaded_data->precomputed_grids = common::make_unique<string>(
+          std::move(*proto->mutable_submap()->mutable_precomputed_grids()));
+    }
+    proto->mutable_submap()->clear_submap_2d();
+    proto->mutable_submap()->clear_submap_3d();
+    proto->mutable_submap()->clear_precomputed_grids();
+  }
+  loaded_data->proto = std::move(proto);
+}
+
+// Reads submaps of a lazily loaded map on demand.
+struct LazySubmapReader {
+  common::Mutex mutex;
+  std::unique_ptr<io::ProtoStreamReader> reader GUARDED_BY(mutex);
+  // Offsets of the submaps in the order they were added to the pose graph.
+  std::vector<uint64> submap_offsets GUARDED_BY(mutex);
+};
+
+// Returns the grids precomputed for global matching against 'submap' in the
+// format written by SerializePrecomputedGrids().
+string SerializePrecomputedGridsOfSubmap(
+    const proto::MapBuilderOptions& options, const Submap& submap) {
+  const auto& constraint_builder_options =
+      options.sparse_pose_graph_options().constraint_builder_options();
+  if (options.use_trajectory_builder_2d()) {
+    const auto* const submap_2d =
+        dynamic_cast<const mapping_2d::Submap*>(&submap);
+    CHECK(submap_2d != nullptr);
+    return mapping_2d::scan_matching::FastCorrelativeScanMatcher(
+               submap_2d->probability_grid(),
+               constraint_builder_options
+                   .fast_correlative_scan_matcher_options())
+        .SerializePrecomputationGrids();
+  }
+  const auto* const submap_3d = dynamic_cast<const mapping_3d::Submap*>(&submap);
+  CHECK(submap_3d != nullptr);
+  return mapping_3d::scan_matching::SerializePrecomputationGrids(
+      submap_3d->high_resolution_hybrid_grid(),
+      constraint_builder_options.fast_correlative_scan_matcher_options_3d());
+}
+
+// The state written by SerializeState(). Submaps and node data are immutable
+// or synchronize access themselves, so they can be written from another
+// thread while the pose graph keeps changing.
+struct SerializationSnapshot {
+  proto::SparsePoseGraph sparse_pose_graph;
+  std::vector<std::vector<SparsePoseGraph::SubmapData>> submap_data;
+  std::vector<std::vector<TrajectoryNode>> trajectory_nodes;
+  // Loaders of the submaps of lazily loaded trajectories, which are only
+  // placeholders in 'submap_data'.
+  std::map<int, SubmapLoader> submap_loaders;
+  // If set, returns the precomputed grids which are stored with each submap.
+  std::function<string(const Submap&)> serialize_precomputed_grids;
+};
+
+// Returns the function storing precomputed grids with the submaps in a
+// snapshot, or nullptr if 'serialize_precomputed_grids' is disabled.
+std::function<string(const Submap&)> GetPrecomputedGridsSerializer(
+    const proto::MapBuilderOptions& options) {
+  if (!options.serialize_precomputed_grids()) {
+    return nullptr;
+  }
+  return [options](const Submap& submap) {
+    return SerializePrecomputedGridsOfSubmap(options, submap);
+  };
+}
+
+SerializationSnapshot TakeSnapshot(
+    const proto::MapBuilderOptions& options,
+    SparsePoseGraph* const sparse_pose_graph,
+    const std::map<int, SubmapLoader>& submap_loaders) {
+  SerializationSnapshot snapshot;
+  snapshot.submap_loaders = submap_loaders;
+  snapshot.serialize_precomputed_grids = GetPrecomputedGridsSerializer(options);
+  // Data added while the snapshot is taken must be in all of its parts, or in
+  // none of them, for the stream to be loadable.
+  SparsePoseGraph::State state = sparse_pose_graph->GetState();
+  snapshot.sparse_pose_graph = SparsePoseGraph::ToProto(state);
+  snapshot.submap_data = std::move(state.submap_data);
+  snapshot.trajectory_nodes = std::move(state.trajectory_nodes);
+  return snapshot;
+}
+
+// Same as TakeSnapshot(), but only the submaps and nodes in 'region' are set.
+// The others are left empty, so that WriteSnapshot() skips them. They are
+// selected like by GetSubmapDataInRegion() and GetTrajectoryNodesInRegion(),
+// but from the same state as the serialized pose graph.
+SerializationSnapshot TakeRegionSnapshot(
+    const proto::MapBuilderOptions& options,
+    SparsePoseGraph* const sparse_pose_graph,
+    const std::map<int, SubmapLoader>& submap_loaders,
+    const Eigen::AlignedBox2d& region) {
+  SerializationSnapshot snapshot;
+  snapshot.submap_loaders = submap_loaders;
+  snapshot.serialize_precomputed_grids = GetPrecomputedGridsSerializer(options);
+  SparsePoseGraph::State state = sparse_pose_graph->GetState();
+  snapshot.sparse_pose_graph = SparsePoseGraph::ToProto(state);
+  // Entries outside of 'region' are cleared rather than erased, so that the
+  // indices stay the same.
+  snapshot.submap_data = std::move(state.submap_data);
+  for (auto& trajectory_submap_data : snapshot.submap_data) {
+    for (SparsePoseGraph::SubmapData& submap_data : trajectory_submap_data) {
+      if (submap_data.submap != nullptr &&
+          !region.contains(submap_data.pose.translation().head<2>())) {
+        submap_data = SparsePoseGraph::SubmapData();
+      }
+    }
+  }
+  snapshot.trajectory_nodes = std::move(state.trajectory_nodes);
+  for (auto& trajectory_nodes : snapshot.trajectory_nodes) {
+    for (TrajectoryNode& node : trajectory_nodes) {
+      if (!node.trimmed() &&
+          !region.contains(node.pose.translation().head<2>())) {
+        node = TrajectoryNode();
+      }
+    }
+  }
+  return snapshot;
+}
+
+// A message written by WriteSnapshot(), serialized and compressed in the
+// background.
+struct EncodedData {
+  // Set when the message is scheduled.
+  bool is_submap = false;
+  SubmapId submap_id{0, 0};
+  NodeId node_id{0, 0};
+  // Set once the message is encoded.
+  bool done = false;
+  string compressed;
+  // Whether the submap was finished when it was serialized.
+  bool finished_submap = false;
+};
+
+struct WriteSnapshotState {
+  common::Mutex mutex;
+  // Messages in the order they are written.
+  std::deque<std::shared_ptr<EncodedData>> encoded_data GUARDED_BY(mutex);
+};
+
+// Writes the 'snapshot', skipping submaps and nodes which are trimmed. If
+// 'finished_submap_ids' and 'node_ids' are not null, the finished submaps and
+// nodes in them are skipped as well, and those written are added.
+//
+// Unless there are no background threads, messages are serialized and
+// compressed on the 'thread_pool', while this thread writes them in order. Only
+// a bounded number of them is kept in memory at a time. In the background,
+// fewer messages are encoded at a lower priority so that live operation does
+// not stall.
+void WriteSnapshot(const SerializationSnapshot& snapshot,
+                   common::ThreadPoolInterface* const thread_pool,
+                   const int num_background_threads, const bool in_background,
+                   io::ProtoStreamWriter* const writer,
+                   std::set<SubmapId>* const finished_submap_ids,
+                   std::set<NodeId>* const node_ids) {
+  const size_t max_num_encoding =
+      (in_background ? 1 : 4) * std::max(1, num_background_threads);
+  const common::WorkItemPriority priority =
+      in_background ? common::WorkItemPriority::kLow
+                    : common::WorkItemPriority::kHigh;
+  proto::SerializedDataIndex index;
+  const auto state = std::make_shared<WriteSnapshotState>();
+  const auto write_encoded_data = [&](const EncodedData& encoded_data) {
+    const uint64 offset = writer->WriteCompressedProto(encoded_data.compressed);
+    // TODO(whess): Only enable optionally? Resulting pbstream files will be a
+    // lot larger now.
+    if (encoded_data.is_submap) {
+      // The proto is taken while synchronizing with insertion, so it tells
+      // whether this version is final.
+      if (finished_submap_ids != nullptr && encoded_data.finished_submap) {
+        finished_submap_ids->insert(encoded_data.submap_id);
+      }
+      auto* const submap_entry = index.add_submap();
+      submap_entry->mutable_submap_id()->set_trajectory_id(
+          encoded_data.submap_id.trajectory_id);
+      submap_entry->mutable_submap_id()->set_submap_index(
+          encoded_data.submap_id.submap_index);
+      submap_entry->set_offset(offset);
+    } else {
+      auto* const node_entry = index.add_node();
+      node_entry->mutable_node_id()->set_trajectory_id(
+          encoded_data.node_id.trajectory_id);
+      node_entry->mutable_node_id()->set_node_index(
+          encoded_data.node_id.node_index);
+      node_entry->set_offset(offset);
+    }
+  };
+  // Writes the oldest messages which are done. If 'wait' is true, waits for
+  // the oldest one first.
+  const auto write_done = [&state, &write_encoded_data](bool wait) {
+    for (;;) {
+      std::shared_ptr<EncodedData> encoded_data;
+      {
+        common::MutexLocker locker(&state->mutex);
+        if (wait && !state->encoded_data.empty()) {
+          locker.Await([&state]() REQUIRES(state->mutex) {
+            return state->encoded_data.front()->done;
+          });
+        }
+        if (state->encoded_data.empty() || !state->encoded_data.front()->done) {
+          return;
+        }
+        encoded_data = state->encoded_data.front();
+        state->encoded_data.pop_front();
+      }
+      write_encoded_data(*encoded_data);
+      wait = false;
+    }
+  };
+  // Runs 'encode' to fill in the message 'encoded_data' and writes it after
+  // all messages added before.
+  const auto add = [&](const std::shared_ptr<EncodedData>& encoded_data,
+                       const std::function<void(EncodedData*)>& encode) {
+    if (num_background_threads == 0) {
+      encode(encoded_data.get());
+      write_encoded_data(*encoded_data);
+      return;
+    }
+    size_t num_encoding;
+    {
+      common::MutexLocker locker(&state->mutex);
+      state->encoded_data.push_back(encoded_data);
+      num_encoding = state->encoded_data.size();
+    }
+    thread_pool->Schedule(
+        [state, encoded_data, encode]() {
+          EncodedData encoded;
+          encode(&encoded);
+          common::MutexLocker locker(&state->mutex);
+          encoded_data->compressed = std::move(encoded.compressed);
+          encoded_data->finished_submap = encoded.finished_submap;
+          encoded_data->done = true;
+        },
+        priority, "serialize_state");
+    write_done(num_encoding >= max_num_encoding /* wait */);
+  };
+
+  // We serialize the pose graph followed by all the data referenced in it.
+  index.set_sparse_pose_graph_offset(
+      writer->WriteProto(snapshot.sparse_pose_graph));
+  // Next we serialize all submap data.
+  {
+    const auto& submap_data = snapshot.submap_data;
+    for (int trajectory_id = 0;
+         trajectory_id != static_cast<int>(submap_data.size());
+         ++trajectory_id) {
+      for (int submap_index = 0;
+           submap_index != static_cast<int>(submap_data[trajectory_id].size());
+           ++submap_index) {
+        const SubmapId submap_id{trajectory_id, submap_index};
+        const std::shared_ptr<const Submap> submap =
+            submap_data[trajectory_id][submap_index].submap;
+        if (submap == nullptr || (finished_submap_ids != nullptr &&
+                                  finished_submap_ids->count(submap_id))) {
+          continue;
+        }
+        SubmapLoader submap_loader;
+        const auto it = snapshot.submap_loaders.find(trajectory_id);
+        if (it != snapshot.submap_loaders.end()) {
+          submap_loader = it->second;
+        }
+        const auto encoded_data = std::make_shared<EncodedData>();
+        encoded_data->is_submap = true;
+        encoded_data->submap_id = submap_id;
+        const auto& serialize_precomputed_grids =
+            snapshot.serialize_precomputed_grids;
+        add(encoded_data, [writer, submap_id, submap, submap_loader,
+                           serialize_precomputed_grids](
+                              EncodedData* const encoded) {
+          proto::SerializedData proto;
+          auto* const submap_proto = proto.mutable_submap();
+          submap_proto->mutable_submap_id()->set_trajectory_id(
+              submap_id.trajectory_id);
+          submap_proto->mutable_submap_id()->set_submap_index(
+              submap_id.submap_index);
+          std::shared_ptr<const Submap> submap_to_write = submap;
+          if (submap_loader != nullptr) {
+            submap_to_write = submap_loader(submap_id);
+          }
+          submap_to_write->ToProto(submap_proto);
+          if (serialize_precomputed_grids != nullptr) {
+            submap_proto->set_precomputed_grids(
+                serialize_precomputed_grids(*submap_to_write));
+          }
+          encoded->finished_submap = submap_proto->submap_2d().finished() ||
+                                     submap_proto->submap_3d().finished();
+          encoded->compressed = writer->CompressProto(proto);
+        });
+      }
+    }
+  }
+  // Next we serialize all node data.
+  {
+    const auto& trajectory_nodes = snapshot.trajectory_nodes;
+    for (int trajectory_id = 0;
+         trajectory_id != static_cast<int>(trajectory_nodes.size());
+         ++trajectory_id) {
+      for (int node_index = 0;
+           node_index !=
+           static_cast<int>(trajectory_nodes[trajectory_id].size());
+           ++node_index) {
+        const NodeId node_id{trajectory_id, node_index};
+        const std::shared_ptr<const TrajectoryNode::Data> constant_data =
+            trajectory_nodes[trajectory_id][node_index].constant_data;
+        if (constant_data == nullptr ||
+            (node_ids != nullptr && !node_ids->insert(node_id).second)) {
+          continue;
+        }
+        const auto encoded_data = std::make_shared<EncodedData>();
+        encoded_data->node_id = node_id;
+        add(encoded_data,
+            [writer, node_id, constant_data](EncodedData* const encoded) {
+              proto::SerializedData proto;
+              auto* const node_proto = proto.mutable_node();
+              node_proto->mutable_node_id()->set_trajectory_id(
+                  node_id.trajectory_id);
+              node_proto->mutable_node_id()->set_node_index(
+                  node_id.node_index);
+              *node_proto->mutable_node_data() = ToProto(*constant_data);
+              encoded->compressed = writer->CompressProto(proto);
+            });
+      }
+    }
+    // TODO(whess): Serialize additional sensor data: IMU, odometry.
+  }
+  for (;;) {
+    {
+      common::MutexLocker locker(&state->mutex);
+      if (state->encoded_data.empty()) {
+        break;
+      }
+    }
+    write_done(true /* wait */);
+  }
+  // The index allows to read single submaps or nodes without reading the whole
+  // proto stream.
+  writer->WriteIndex(index);
+}
+
+// Adds the batches in the journal read by 'reader' to 'sparse_pose_graph',
+// using 'get_trajectory_id' to assign trajectory IDs to the journaled ones.
+// Stops at the first incomplete batch.
+template <typename SubmapType, typename SparsePoseGraphType>
+void ReplayJournal(io::ProtoStreamReader* const reader,
+                   const std::function<int(int)>& get_trajectory_id,
+                   SparsePoseGraphType* const sparse_pose_graph) {
+  LocalSlamUpdateReader<SubmapType, SparsePoseGraphType> update_reader(
+      sparse_pose_graph);
+  proto::LocalSlamUpdateBatch batch;
+  while (reader->ReadProto(&batch)) {
+    const int trajectory_id = get_trajectory_id(batch.trajectory_id());
+    batch.set_trajectory_id(trajectory_id);
+    for (auto& node : *batch.mutable_node()) {
+      for (auto& submap : *node.mutable_submap()) {
+        submap.mutable_submap_id()->set_trajectory_id(trajectory_id);
+      }
+    }
+    update_reader.AddBatch(batch);
+  }
+  if (!reader->eof()) {
+    LOG(WARNING) << "The journal ends with an incomplete batch, which is "
+                    "skipped.";
+  }
+}
+
+}  // namespace
+
 proto::MapBuilderOptions CreateMapBuilderOptions(
     common::LuaParameterDictionary* const parameter_dictionary) {
   proto::MapBuilderOptions options;
@@ -45,57 +493,143 @@ proto::MapBuilderOptions CreateMapBuilderOptions(
       parameter_dictionary->GetBool("use_trajectory_builder_3d"));
   options.set_num_background_threads(
       parameter_dictionary->GetNonNegativeInt("num_background_threads"));
+  options.set_use_work_stealing_thread_pool(
+      parameter_dictionary->GetBool("use_work_stealing_thread_pool"));
+  options.set_dispatch_trajectories_concurrently(
+      parameter_dictionary->GetBool("dispatch_trajectories_concurrently"));
+  options.set_serialize_precomputed_grids(
+      parameter_dictionary->GetBool("serialize_precomputed_grids"));
+  for (const auto& thread_pool_dictionary :
+       parameter_dictionary->GetDictionary("thread_pools")
+           ->GetArrayValuesAsDictionaries()) {
+    proto::ThreadPoolOptions* const thread_pool_options =
+        options.add_thread_pools();
+    thread_pool_options->set_workload(
+        thread_pool_dictionary->GetString("workload"));
+    thread_pool_options->set_num_threads(
+        thread_pool_dictionary->GetNonNegativeInt("num_threads"));
+    thread_pool_options->set_nice_level(
+        thread_pool_dictionary->GetInt("nice_level"));
+  }
+  for (const double cpu :
+       parameter_dictionary->GetDictionary("background_thread_cpus")
+           ->GetArrayValuesAsDoubles()) {
+    options.add_background_thread_cpus(common::RoundToInt(cpu));
+  }
   *options.mutable_sparse_pose_graph_options() = CreateSparsePoseGraphOptions(
       parameter_dictionary->GetDictionary("sparse_pose_graph").get());
   CHECK_NE(options.use_trajectory_builder_2d(),
            options.use_trajectory_builder_3d());
+  CHECK(!options.dispatch_trajectories_concurrently() ||
+        options.num_background_threads() > 0);
+  // Scans of concurrently dispatched trajectories are added in the order
+  // their processing finishes.
+  CHECK(!options.dispatch_trajectories_concurrently() ||
+        !options.sparse_pose_graph_options().deterministic())
+      << "'dispatch_trajectories_concurrently' is not deterministic.";
   return options;
 }
 
 MapBuilder::MapBuilder(const proto::MapBuilderOptions& options)
-    : options_(options), thread_pool_(options.num_background_threads()) {
+    : options_(options),
+      thread_pool_(CreateThreadPool(options, options.num_background_threads(),
+                                    common::kDefaultBackgroundNiceLevel)),
+      thread_pools_(thread_pool_.get()),
+      num_io_threads_(options.num_background_threads()),
+      sensor_collator_(sensor::QueueCapacity(),
+                       options.dispatch_trajectories_concurrently()
+                           ? thread_pool_.get()
+                           : nullptr) {
+  thread_pool_->RegisterMetrics("default", &metrics_registry_);
+  std::set<string> configured_workloads;
+  for (const auto& thread_pool_options : options_.thread_pools()) {
+    const string& workload = thread_pool_options.workload();
+    CHECK(configured_workloads.insert(workload).second)
+        << "Thread pool for '" << workload << "' configured twice.";
+    CHECK_GT(thread_pool_options.num_threads(), 0);
+    if (workload == "optimization") {
+      CHECK_EQ(thread_pool_options.num_threads(), 1)
+          << "Optimizations run one at a time.";
+      thread_pools_.optimization_nice_level = thread_pool_options.nice_level();
+      continue;
+    }
+    workload_thread_pools_.push_back(
+        CreateThreadPool(options_, thread_pool_options.num_threads(),
+                         thread_pool_options.nice_level()));
+    common::ThreadPoolInterface* const thread_pool =
+        workload_thread_pools_.back().get();
+    thread_pool->RegisterMetrics(workload, &metrics_registry_);
+    if (workload == "matcher_construction") {
+      thread_pools_.matcher_construction = thread_pool;
+    } else if (workload == "constraints") {
+      thread_pools_.constraints = thread_pool;
+    } else if (workload == "io") {
+      thread_pools_.io = thread_pool;
+      num_io_threads_ = thread_pool_options.num_threads();
+    } else {
+      LOG(FATAL) << "Unknown workload '" << workload << "'.";
+    }
+  }
   if (options.use_trajectory_builder_2d()) {
     sparse_pose_graph_2d_ = common::make_unique<mapping_2d::SparsePoseGraph>(
-        options_.sparse_pose_graph_options(), &thread_pool_);
+        options_.sparse_pose_graph_options(), thread_pools_);
+    sparse_pose_graph_2d_->RegisterMetrics(&metrics_registry_);
     sparse_pose_graph_ = sparse_pose_graph_2d_.get();
   }
   if (options.use_trajectory_builder_3d()) {
     sparse_pose_graph_3d_ = common::make_unique<mapping_3d::SparsePoseGraph>(
-        options_.sparse_pose_graph_options(), &thread_pool_);
+        options_.sparse_pose_graph_options(), thread_pools_);
+    sparse_pose_graph_3d_->RegisterMetrics(&metrics_registry_);
     sparse_pose_graph_ = sparse_pose_graph_3d_.get();
   }
+  const proto::OverlappingSubmapsTrimmerOptions& trimmer_options =
+      options_.sparse_pose_graph_options()
+          .overlapping_submaps_trimmer_options();
+  if (trimmer_options.fresh_submaps_count() > 0) {
+    sparse_pose_graph_->AddTrimmer(
+        common::make_unique<OverlappingSubmapsTrimmer>(trimmer_options));
+  }
 }
 
-MapBuilder::~MapBuilder() {}
+MapBuilder::~MapBuilder() {
+  // Collated data may still be dispatched to the trajectory builders.
+  sensor_collator_.WaitUntilDispatched();
+  WaitForPendingMerges();
+  WaitForPendingSerializations();
+}
 
 int MapBuilder::AddTrajectoryBuilder(
     const std::unordered_set<string>& expected_sensor_ids,
     const proto::TrajectoryBuilderOptions& trajectory_options) {
   const int trajectory_id = trajectory_builders_.size();
+  std::unique_ptr<CollatedTrajectoryBuilder> trajectory_builder;
   if (options_.use_trajectory_builder_3d()) {
     CHECK(trajectory_options.has_trajectory_builder_3d_options());
-    trajectory_builders_.push_back(
-        common::make_unique<CollatedTrajectoryBuilder>(
-            &sensor_collator_, trajectory_id, expected_sensor_ids,
-            common::make_unique<mapping::GlobalTrajectoryBuilder<
-                mapping_3d::LocalTrajectoryBuilder,
-                mapping_3d::proto::LocalTrajectoryBuilderOptions,
-                mapping_3d::SparsePoseGraph>>(
-                trajectory_options.trajectory_builder_3d_options(),
-                trajectory_id, sparse_pose_graph_3d_.get())));
+    trajectory_builder = common::make_unique<CollatedTrajectoryBuilder>(
+        &sensor_collator_, trajectory_id, expected_sensor_ids,
+        common::make_unique<mapping::GlobalTrajectoryBuilder<
+            mapping_3d::LocalTrajectoryBuilder,
+            mapping_3d::proto::LocalTrajectoryBuilderOptions,
+            mapping_3d::SparsePoseGraph>>(
+            trajectory_options.trajectory_builder_3d_options(), trajectory_id,
+            sparse_pose_graph_3d_.get(), &journal_),
+        trajectory_options.presorted_sensor_data());
   } else {
     CHECK(trajectory_options.has_trajectory_builder_2d_options());
-    trajectory_builders_.push_back(
-        common::make_unique<CollatedTrajectoryBuilder>(
-            &sensor_collator_, trajectory_id, expected_sensor_ids,
-            common::make_unique<mapping::GlobalTrajectoryBuilder<
-                mapping_2d::LocalTrajectoryBuilder,
-                mapping_2d::proto::LocalTrajectoryBuilderOptions,
-                mapping_2d::SparsePoseGraph>>(
-                trajectory_options.trajectory_builder_2d_options(),
-                trajectory_id, sparse_pose_graph_2d_.get())));
+    trajectory_builder = common::make_unique<CollatedTrajectoryBuilder>(
+        &sensor_collator_, trajectory_id, expected_sensor_ids,
+        common::make_unique<mapping::GlobalTrajectoryBuilder<
+            mapping_2d::LocalTrajectoryBuilder,
+            mapping_2d::proto::LocalTrajectoryBuilderOptions,
+            mapping_2d::SparsePoseGraph>>(
+            trajectory_options.trajectory_builder_2d_options(), trajectory_id,
+            sparse_pose_graph_2d_.get(), &journal_),
+        trajectory_options.presorted_sensor_data());
   }
+  trajectory_builder->RegisterMetrics(&metrics_registry_);
+  trajectory_builders_.push_back(std::move(trajectory_builder));
   if (trajectory_options.pure_localization()) {
+    sparse_pose_graph_->SetLocalizationTrajectory(trajectory_id);
     constexpr int kSubmapsToKeep = 3;
     sparse_pose_graph_->AddTrimmer(common::make_unique<PureLocalizationTrimmer>(
         trajectory_id, kSubmapsToKeep));
@@ -140,64 +674,284 @@ string MapBuilder::SubmapToProto(const mapping::SubmapId& submap_id,
            " from trajectory " + std::to_string(submap_id.trajectory_id) +
            " but it has been trimmed.";
   }
+  const auto submap_loader = submap_loaders_.find(submap_id.trajectory_id);
+  if (submap_loader != submap_loaders_.end()) {
+    submap_loader->second(submap_id)->ToResponseProto(submap_data.pose,
+                                                      response);
+    return "";
+  }
   submap_data.submap->ToResponseProto(submap_data.pose, response);
   return "";
 }
 
 void MapBuilder::SerializeState(io::ProtoStreamWriter* const writer) {
-  // We serialize the pose graph followed by all the data referenced in it.
-  writer->WriteProto(sparse_pose_graph_->ToProto());
-  // Next we serialize all submap data.
-  {
-    const auto submap_data = sparse_pose_graph_->GetAllSubmapData();
-    for (int trajectory_id = 0;
-         trajectory_id != static_cast<int>(submap_data.size());
-         ++trajectory_id) {
-      for (int submap_index = 0;
-           submap_index != static_cast<int>(submap_data[trajectory_id].size());
-           ++submap_index) {
-        proto::SerializedData proto;
-        auto* const submap_proto = proto.mutable_submap();
-        // TODO(whess): Handle trimmed data.
-        submap_proto->mutable_submap_id()->set_trajectory_id(trajectory_id);
-        submap_proto->mutable_submap_id()->set_submap_index(submap_index);
-        submap_data[trajectory_id][submap_index].submap->ToProto(submap_proto);
-        // TODO(whess): Only enable optionally? Resulting pbstream files will be
-        // a lot larger now.
-        writer->WriteProto(proto);
-      }
+  WriteSnapshot(TakeSnapshot(options_, sparse_pose_graph_, submap_loaders_),
+                thread_pools_.io, num_io_threads_, false /* in_background */,
+                writer,
+                nullptr /* finished_submap_ids */, nullptr /* node_ids */);
+}
+
+void MapBuilder::SerializeRegion(const Eigen::AlignedBox2d& region,
+                                 io::ProtoStreamWriter* const writer) {
+  WriteSnapshot(TakeRegionSnapshot(options_, sparse_pose_graph_,
+                                   submap_loaders_, region),
+                thread_pools_.io, num_io_threads_, false /* in_background */,
+                writer,
+                nullptr /* finished_submap_ids */, nullptr /* node_ids */);
+}
+
+void MapBuilder::SerializeStateIncrementally(
+    io::ProtoStreamWriter* const writer) {
+  WriteSnapshot(TakeSnapshot(options_, sparse_pose_graph_, submap_loaders_),
+                thread_pools_.io, num_io_threads_, false /* in_background */,
+                writer,
+                &incrementally_serialized_finished_submap_ids_,
+                &incrementally_serialized_node_ids_);
+}
+
+void MapBuilder::SerializeStateInBackground(
+    std::unique_ptr<io::ProtoStreamWriter> writer,
+    const std::function<void(bool success)>& callback) {
+  // Submaps and nodes are shared, not copied, so this only briefly blocks the
+  // pose graph.
+  const auto snapshot = std::make_shared<const SerializationSnapshot>(
+      TakeSnapshot(options_, sparse_pose_graph_, submap_loaders_));
+  const auto shared_writer =
+      std::make_shared<std::unique_ptr<io::ProtoStreamWriter>>(
+          std::move(writer));
+  common::MutexLocker locker(&serialization_mutex_);
+  ++num_pending_serializations_;
+  if (serialization_thread_ == nullptr) {
+    serialization_thread_ = common::make_unique<common::ThreadPool>(1);
+  }
+  serialization_thread_->Schedule(
+      [this, snapshot, shared_writer, callback]() {
+        WriteSnapshot(*snapshot, thread_pools_.io, num_io_threads_,
+                      true /* in_background */, shared_writer->get(),
+                      nullptr /* finished_submap_ids */,
+                      nullptr /* node_ids */);
+        const bool success = (*shared_writer)->Close();
+        shared_writer->reset();
+        callback(success);
+        common::MutexLocker locker(&serialization_mutex_);
+        --num_pending_serializations_;
+      },
+      common::WorkItemPriority::kNormal, "serialize_state");
+}
+
+void MapBuilder::WaitForPendingSerializations() {
+  common::MutexLocker locker(&serialization_mutex_);
+  locker.Await([this]() REQUIRES(serialization_mutex_) {
+    return num_pending_serializations_ == 0;
+  });
+}
+
+void MapBuilder::StartJournal(std::unique_ptr<io::ProtoStreamWriter> writer,
+                              const int max_nodes_per_batch) {
+  journal_.Start(std::move(writer), max_nodes_per_batch);
+}
+
+bool MapBuilder::StopJournal() { return journal_.Stop(); }
+
+std::vector<int> MapBuilder::RecoverFromJournal(
+    io::ProtoStreamReader* const reader) {
+  std::vector<int> trajectory_ids;
+  std::map<int, int> journaled_to_trajectory_id;
+  const auto get_trajectory_id = [&](const int journaled_trajectory_id) {
+    auto it = journaled_to_trajectory_id.find(journaled_trajectory_id);
+    if (it == journaled_to_trajectory_id.end()) {
+      trajectory_ids.push_back(AddTrajectoryWithoutSensorData());
+      it = journaled_to_trajectory_id
+               .emplace(journaled_trajectory_id, trajectory_ids.back())
+               .first;
     }
+    return it->second;
+  };
+  if (options_.use_trajectory_builder_2d()) {
+    ReplayJournal<mapping_2d::Submap>(reader, get_trajectory_id,
+                                      sparse_pose_graph_2d_.get());
+  } else {
+    ReplayJournal<mapping_3d::Submap>(reader, get_trajectory_id,
+                                      sparse_pose_graph_3d_.get());
   }
-  // Next we serialize all node data.
-  {
-    const auto trajectory_nodes = sparse_pose_graph_->GetTrajectoryNodes();
-    for (int trajectory_id = 0;
-         trajectory_id != static_cast<int>(trajectory_nodes.size());
-         ++trajectory_id) {
-      for (int node_index = 0;
-           node_index !=
-           static_cast<int>(trajectory_nodes[trajectory_id].size());
-           ++node_index) {
-        proto::SerializedData proto;
-        auto* const node_proto = proto.mutable_node();
-        // TODO(whess): Handle trimmed data.
-        node_proto->mutable_node_id()->set_trajectory_id(trajectory_id);
-        node_proto->mutable_node_id()->set_node_index(node_index);
-        *node_proto->mutable_node_data() =
-            ToProto(*trajectory_nodes[trajectory_id][node_index].constant_data);
-        // TODO(whess): Only enable optionally? Resulting pbstream files will be
-        // a lot larger now.
-        writer->WriteProto(proto);
-      }
+  return trajectory_ids;
+}
+
+bool MapBuilder::SerializePrecomputedGrids(const string& filename) {
+  io::MappedBlobFileWriter writer(filename);
+  const auto submap_data = sparse_pose_graph_->GetAllSubmapData();
+  for (const auto& trajectory_submap_data : submap_data) {
+    for (const SparsePoseGraph::SubmapData& submap : trajectory_submap_data) {
+      writer.Write(SerializePrecomputedGridsOfSubmap(options_, *submap.submap));
     }
-    // TODO(whess): Serialize additional sensor data: IMU, odometry.
   }
+  return writer.Close();
 }
 
 void MapBuilder::LoadMap(io::ProtoStreamReader* const reader) {
-  proto::SparsePoseGraph pose_graph;
-  CHECK(reader->ReadProto(&pose_graph));
+  LoadMap(reader, "" /* precomputed_grids_filename */);
+}
 
+void MapBuilder::LoadMap(io::ProtoStreamReader* const reader,
+                         const string& precomputed_grids_filename) {
+  const int map_trajectory_id =
+      AddFrozenTrajectory(OpenPrecomputedGrids(precomputed_grids_filename));
+  LoadIntoFrozenTrajectory(
+      reader, map_trajectory_id, nullptr /* add_serialized_submap_id */,
+      false /* in_background */,
+      precomputed_grids_filename.empty() /* restore_precomputed_grids */,
+      nullptr /* frozen_map */);
+}
+
+std::shared_ptr<const FrozenMap> MapBuilder::LoadFrozenMap(
+    io::ProtoStreamReader* const reader,
+    const string& precomputed_grids_filename) {
+  auto frozen_map = std::make_shared<FrozenMap>();
+  frozen_map->precomputed_grids =
+      OpenPrecomputedGrids(precomputed_grids_filename);
+  const int map_trajectory_id =
+      AddFrozenTrajectory(frozen_map->precomputed_grids);
+  LoadIntoFrozenTrajectory(
+      reader, map_trajectory_id, nullptr /* add_serialized_submap_id */,
+      false /* in_background */,
+      precomputed_grids_filename.empty() /* restore_precomputed_grids */,
+      frozen_map.get());
+  return frozen_map;
+}
+
+int MapBuilder::AddFrozenMap(std::shared_ptr<const FrozenMap> frozen_map) {
+  const int map_trajectory_id =
+      AddFrozenTrajectory(frozen_map->precomputed_grids);
+  for (const FrozenMap::Node& node : frozen_map->nodes) {
+    if (options_.use_trajectory_builder_2d()) {
+      sparse_pose_graph_2d_->AddDeserializedNode(map_trajectory_id, node.pose,
+                                                 node.constant_data);
+    } else {
+      sparse_pose_graph_3d_->AddDeserializedNode(map_trajectory_id, node.pose,
+                                                 node.constant_data);
+    }
+  }
+  for (const FrozenMap::Submap& submap : frozen_map->submaps) {
+    if (options_.use_trajectory_builder_2d()) {
+      CHECK(submap.submap_2d != nullptr);
+      sparse_pose_graph_2d_->AddDeserializedSubmap(
+          map_trajectory_id, submap.pose, submap.submap_2d);
+    } else {
+      CHECK(submap.submap_3d != nullptr);
+      sparse_pose_graph_3d_->AddDeserializedSubmap(
+          map_trajectory_id, submap.pose, submap.submap_3d);
+    }
+  }
+  return map_trajectory_id;
+}
+
+void MapBuilder::LoadMapLazily(const string& filename,
+                               const string& precomputed_grids_filename) {
+  CHECK(options_.use_trajectory_builder_2d())
+      << "Lazy loading is only supported in 2D.";
+  const int map_trajectory_id =
+      AddFrozenTrajectory(OpenPrecomputedGrids(precomputed_grids_filename));
+  const auto add_serialized_submap_id =
+      AddSubmapLoader(filename, map_trajectory_id);
+  CHECK(add_serialized_submap_id != nullptr)
+      << "Lazy loading requires an index in " << filename;
+  io::ProtoStreamReader reader(filename);
+  LoadIntoFrozenTrajectory(&reader, map_trajectory_id, add_serialized_submap_id,
+                           false /* in_background */,
+                           false /* restore_precomputed_grids */,
+                           nullptr /* frozen_map */);
+}
+
+int MapBuilder::MergeMap(const string& filename,
+                         const std::function<void()>& callback) {
+  const int map_trajectory_id = AddFrozenTrajectory(
+      nullptr /* precomputed_grids */);
+  sparse_pose_graph_->SetMergedTrajectory(map_trajectory_id);
+  // Grids of 2D submaps are read on demand if the file has an index. Only the
+  // index is read here.
+  const std::function<void(const SubmapId&)> add_serialized_submap_id =
+      options_.use_trajectory_builder_2d()
+          ? AddSubmapLoader(filename, map_trajectory_id)
+          : nullptr;
+  common::MutexLocker locker(&merge_mutex_);
+  ++num_pending_merges_;
+  if (merge_thread_ == nullptr) {
+    merge_thread_ = common::make_unique<common::ThreadPool>(1);
+  }
+  merge_thread_->Schedule(
+      [this, filename, map_trajectory_id, add_serialized_submap_id,
+       callback]() {
+        io::ProtoStreamReader reader(filename);
+        LoadIntoFrozenTrajectory(&reader, map_trajectory_id,
+                                 add_serialized_submap_id,
+                                 true /* in_background */,
+                                 false /* restore_precomputed_grids */,
+                                 nullptr /* frozen_map */);
+        callback();
+        common::MutexLocker locker(&merge_mutex_);
+        --num_pending_merges_;
+      },
+      common::WorkItemPriority::kLow, "merge_map");
+  return map_trajectory_id;
+}
+
+void MapBuilder::WaitForPendingMerges() {
+  common::MutexLocker locker(&merge_mutex_);
+  locker.Await(
+      [this]() REQUIRES(merge_mutex_) { return num_pending_merges_ == 0; });
+}
+
+std::function<void(const SubmapId&)> MapBuilder::AddSubmapLoader(
+    const string& filename, const int map_trajectory_id) {
+  // A second reader of the file reads submaps on demand.
+  const auto submap_reader = std::make_shared<LazySubmapReader>();
+  proto::SerializedDataIndex index;
+  {
+    common::MutexLocker locker(&submap_reader->mutex);
+    submap_reader->reader =
+        common::make_unique<io::ProtoStreamReader>(filename);
+    if (!submap_reader->reader->ReadIndex(&index)) {
+      return nullptr;
+    }
+  }
+  const auto offsets = std::make_shared<std::map<SubmapId, uint64>>();
+  for (const auto& entry : index.submap()) {
+    (*offsets)[SubmapId{entry.submap_id().trajectory_id(),
+                        entry.submap_id().submap_index()}] = entry.offset();
+  }
+  // Registered before any submap is added, so that submaps can be read as soon
+  // as nodes are matched against them.
+  const SubmapLoader submap_loader = [submap_reader](
+                                         const SubmapId& submap_id) {
+    proto::SerializedData proto;
+    {
+      common::MutexLocker locker(&submap_reader->mutex);
+      CHECK(submap_reader->reader->ReadProtoAt(
+          submap_reader->submap_offsets.at(submap_id.submap_index), &proto));
+    }
+    return std::make_shared<const mapping_2d::Submap>(
+        proto.submap().submap_2d());
+  };
+  submap_loaders_[map_trajectory_id] = submap_loader;
+  sparse_pose_graph_2d_->SetSubmapLoader(map_trajectory_id, submap_loader);
+  return [submap_reader, offsets](const SubmapId& serialized_submap_id) {
+    common::MutexLocker locker(&submap_reader->mutex);
+    submap_reader->submap_offsets.push_back(offsets->at(serialized_submap_id));
+  };
+}
+
+int MapBuilder::AddFrozenTrajectory(
+    std::shared_ptr<const io::MappedBlobFile> precomputed_grids) {
+  const int map_trajectory_id = AddTrajectoryWithoutSensorData();
+  sparse_pose_graph_->FreezeTrajectory(map_trajectory_id);
+  if (precomputed_grids != nullptr) {
+    sparse_pose_graph_->SetPrecomputedGrids(map_trajectory_id,
+                                            std::move(precomputed_grids));
+  }
+  return map_trajectory_id;
+}
+
+int MapBuilder::AddTrajectoryWithoutSensorData() {
   // TODO(whess): Not all trajectories should be builders, i.e. support should
   // be added for trajectories without latest pose, options, etc. Appease the
   // trajectory builder for now.
@@ -208,35 +962,170 @@ void MapBuilder::LoadMap(io::ProtoStreamReader* const reader) {
   unused_options.mutable_trajectory_builder_3d_options();
 
   const std::unordered_set<string> unused_sensor_ids;
-  const int map_trajectory_id =
+  const int trajectory_id =
       AddTrajectoryBuilder(unused_sensor_ids, unused_options);
-  FinishTrajectory(map_trajectory_id);
-  sparse_pose_graph_->FreezeTrajectory(map_trajectory_id);
+  FinishTrajectory(trajectory_id);
+  return trajectory_id;
+}
 
-  for (;;) {
-    proto::SerializedData proto;
-    if (!reader->ReadProto(&proto)) {
-      break;
-    }
+void MapBuilder::LoadIntoFrozenTrajectory(
+    io::ProtoStreamReader* const reader, const int map_trajectory_id,
+    const std::function<void(const SubmapId&)>& add_serialized_submap_id,
+    const bool in_background, const bool restore_precomputed_grids,
+    FrozenMap* const frozen_map) {
+  const bool load_submap_grids = add_serialized_submap_id == nullptr;
+  // Grids stored with the submaps in the order they are added. They are only
+  // used if every submap has them, since they are looked up by submap index.
+  std::vector<string> precomputed_grids;
+  bool all_submaps_have_precomputed_grids = true;
+  proto::SparsePoseGraph pose_graph;
+  CHECK(reader->ReadProto(&pose_graph));
+
+  // Messages are read here, but decompressed and deserialized on the thread
+  // pool. Submaps and nodes are added to the pose graph in the order they were
+  // read, and only a bounded number of them is kept in memory at a time. In the
+  // background, fewer messages are decoded at a lower priority so that live
+  // operation does not stall.
+  const bool use_trajectory_builder_2d = options_.use_trajectory_builder_2d();
+  const size_t max_num_loading =
+      (in_background ? 1 : 4) * std::max(1, num_io_threads_);
+  const common::WorkItemPriority priority =
+      in_background ? common::WorkItemPriority::kLow
+                    : common::WorkItemPriority::kHigh;
+  const auto state = std::make_shared<LoadMapState>();
+  const auto add_to_sparse_pose_graph = [&](const LoadedData& loaded_data) {
+    const proto::SerializedData& proto = *loaded_data.proto;
     if (proto.has_node()) {
       const auto& pose_graph_node =
           pose_graph.trajectory(proto.node().node_id().trajectory_id())
               .node(proto.node().node_id().node_index());
       const transform::Rigid3d pose =
           transform::ToRigid3(pose_graph_node.pose());
-      sparse_pose_graph_->AddNodeFromProto(map_trajectory_id, pose,
-                                           proto.node());
+      std::shared_ptr<const TrajectoryNode::Data> node_data =
+          loaded_data.node_data;
+      if (frozen_map != nullptr) {
+        // Compressed here, so that all pose graphs share the compressed copy.
+        if (options_.sparse_pose_graph_options()
+                .compress_node_point_clouds()) {
+          node_data = std::make_shared<const TrajectoryNode::Data>(
+              CompressPointClouds(*node_data));
+        }
+        frozen_map->nodes.push_back(FrozenMap::Node{pose, node_data});
+      }
+      if (use_trajectory_builder_2d) {
+        sparse_pose_graph_2d_->AddDeserializedNode(map_trajectory_id, pose,
+                                                   node_data);
+      } else {
+        sparse_pose_graph_3d_->AddDeserializedNode(map_trajectory_id, pose,
+                                                   node_data);
+      }
     }
     if (proto.has_submap()) {
       const transform::Rigid3d submap_pose = transform::ToRigid3(
           pose_graph.trajectory(proto.submap().submap_id().trajectory_id())
               .submap(proto.submap().submap_id().submap_index())
               .pose());
-      sparse_pose_graph_->AddSubmapFromProto(map_trajectory_id, submap_pose,
-                                             proto.submap());
+      const bool has_submap = loaded_data.submap_2d != nullptr ||
+                              loaded_data.submap_3d != nullptr;
+      if (frozen_map != nullptr && has_submap) {
+        frozen_map->submaps.push_back(FrozenMap::Submap{
+            submap_pose, loaded_data.submap_2d, loaded_data.submap_3d});
+      }
+      if (restore_precomputed_grids && has_submap) {
+        if (loaded_data.precomputed_grids != nullptr) {
+          precomputed_grids.push_back(
+              std::move(*loaded_data.precomputed_grids));
+        } else {
+          all_submaps_have_precomputed_grids = false;
+        }
+      }
+      if (loaded_data.submap_2d != nullptr) {
+        if (add_serialized_submap_id != nullptr) {
+          add_serialized_submap_id(
+              SubmapId{proto.submap().submap_id().trajectory_id(),
+                       proto.submap().submap_id().submap_index()});
+        }
+        sparse_pose_graph_2d_->AddDeserializedSubmap(
+            map_trajectory_id, submap_pose, loaded_data.submap_2d);
+      }
+      if (loaded_data.submap_3d != nullptr) {
+        sparse_pose_graph_3d_->AddDeserializedSubmap(
+            map_trajectory_id, submap_pose, loaded_data.submap_3d);
+      }
+    }
+  };
+  // Adds the oldest messages which are done to the pose graph. If 'wait' is
+  // true, waits for the oldest one first.
+  const auto add_loaded_data = [&state, &add_to_sparse_pose_graph](bool wait) {
+    for (;;) {
+      std::shared_ptr<LoadedData> loaded_data;
+      {
+        common::MutexLocker locker(&state->mutex);
+        if (wait && !state->loaded_data.empty()) {
+          locker.Await([&state]() REQUIRES(state->mutex) {
+            return state->loaded_data.front()->done;
+          });
+        }
+        if (state->loaded_data.empty() || !state->loaded_data.front()->done) {
+          return;
+        }
+        loaded_data = state->loaded_data.front();
+        state->loaded_data.pop_front();
+      }
+      add_to_sparse_pose_graph(*loaded_data);
+      wait = false;
+    }
+  };
+
+  for (;;) {
+    auto compressed = std::make_shared<string>();
+    if (!reader->ReadCompressedProto(compressed.get())) {
+      break;
+    }
+    const auto loaded_data = std::make_shared<LoadedData>();
+    if (num_io_threads_ == 0) {
+      DecodeSerializedData(*reader, *compressed, use_trajectory_builder_2d,
+                           load_submap_grids, loaded_data.get());
+      add_to_sparse_pose_graph(*loaded_data);
+      continue;
+    }
+    size_t num_loading;
+    {
+      common::MutexLocker locker(&state->mutex);
+      state->loaded_data.push_back(loaded_data);
+      num_loading = state->loaded_data.size();
     }
+    thread_pools_.io->Schedule(
+        [reader, state, compressed, loaded_data, use_trajectory_builder_2d,
+         load_submap_grids]() {
+          LoadedData decoded;
+          DecodeSerializedData(*reader, *compressed, use_trajectory_builder_2d,
+                               load_submap_grids, &decoded);
+          common::MutexLocker locker(&state->mutex);
+          *loaded_data = std::move(decoded);
+          loaded_data->done = true;
+        },
+        priority, "load_map");
+    add_loaded_data(num_loading >= max_num_loading /* wait */);
+  }
+  for (;;) {
+    {
+      common::MutexLocker locker(&state->mutex);
+      if (state->loaded_data.empty()) {
+        break;
+      }
+    }
+    add_loaded_data(true /* wait */);
   }
   CHECK(reader->eof());
+  if (all_submaps_have_precomputed_grids && !precomputed_grids.empty()) {
+    const auto restored_grids =
+        std::make_shared<const io::MappedBlobFile>(std::move(precomputed_grids));
+    if (frozen_map != nullptr) {
+      frozen_map->precomputed_grids = restored_grids;
+    }
+    sparse_pose_graph_->SetPrecomputedGrids(map_trajectory_id, restored_grids);
+  }
 }
 
 int MapBuilder::num_trajectory_builders() const {
@@ -245,5 +1134,22 @@ int MapBuilder::num_trajectory_builders() const {
 
 SparsePoseGraph* MapBuilder::sparse_pose_graph() { return sparse_pose_graph_; }
 
+common::ThreadPoolStatistics MapBuilder::PollThreadPoolStatistics() {
+  common::ThreadPoolStatistics statistics = thread_pool_->PollStatistics();
+  for (const auto& workload_thread_pool : workload_thread_pools_) {
+    statistics.Merge(workload_thread_pool->PollStatistics());
+  }
+  return statistics;
+}
+
+MemoryUsage MapBuilder::GetMemoryUsage() {
+  MemoryUsage memory_usage = sparse_pose_graph_->GetMemoryUsage();
+  memory_usage.sensor_queues_in_bytes =
+      sensor_collator_.GetMemoryUsageInBytes();
+  return memory_usage;
+}
+
+metrics::Registry* MapBuilder::metrics_registry() { return &metrics_registry_; }
+
 }  // namespace mapping
 }  // namespace cartographer
@@ -17,7 +17,10 @@
 #ifndef CARTOGRAPHER_MAPPING_MAP_BUILDER_H_
 #define CARTOGRAPHER_MAPPING_MAP_BUILDER_H_
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -25,18 +28,24 @@
 
 #include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/common/port.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/io/mapped_blob_file.h"
 #include "cartographer/io/proto_stream.h"
+#include "cartographer/mapping/frozen_map.h"
 #include "cartographer/mapping/id.h"
+#include "cartographer/mapping/memory_usage.h"
 #include "cartographer/mapping/proto/map_builder_options.pb.h"
 #include "cartographer/mapping/proto/submap_visualization.pb.h"
 #include "cartographer/mapping/proto/trajectory_builder_options.pb.h"
+#include "cartographer/mapping/session_journal.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
 #include "cartographer/mapping/submaps.h"
 #include "cartographer/mapping/trajectory_builder.h"
 #include "cartographer/mapping_2d/sparse_pose_graph.h"
 #include "cartographer/mapping_3d/sparse_pose_graph.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/sensor/collator.h"
 
 namespace cartographer {
@@ -78,26 +87,197 @@ class MapBuilder {
   string SubmapToProto(const SubmapId& submap_id,
                        proto::SubmapQuery::Response* response);
 
-  // Serializes the current state to a proto stream.
+  // Serializes the current state to a proto stream, ending with a
+  // 'proto::SerializedDataIndex' of the messages written.
   void SerializeState(io::ProtoStreamWriter* writer);
 
-  // Loads submaps from a proto stream into a new frozen trajectory.
+  // Same as SerializeState(), but only writes the submaps and nodes whose
+  // global position lies in 'region' of the xy plane, e.g. to export part of a
+  // large map. The pose graph is written in full, so that the IDs stay valid.
+  void SerializeRegion(const Eigen::AlignedBox2d& region,
+                       io::ProtoStreamWriter* writer);
+
+  // Same as SerializeState(), but only takes a snapshot of the state on the
+  // calling thread. Writing and closing the 'writer' happens on a background
+  // thread, which then calls 'callback' with the result of Close().
+  void SerializeStateInBackground(
+      std::unique_ptr<io::ProtoStreamWriter> writer,
+      const std::function<void(bool success)>& callback)
+      EXCLUDES(serialization_mutex_);
+
+  // Same as SerializeState(), but only writes nodes and finished submaps which
+  // were not written by a previous call, and the unfinished submaps. The
+  // resulting proto streams can be merged into one in the format of
+  // SerializeState() using CompactCheckpoints(). This makes the cost of
+  // frequent checkpoints proportional to the new data.
+  void SerializeStateIncrementally(io::ProtoStreamWriter* writer);
+
+  // Blocks until all serializations started in the background have finished.
+  void WaitForPendingSerializations() EXCLUDES(serialization_mutex_);
+
+  // Starts journaling the nodes and submaps of all trajectories to 'writer' as
+  // local SLAM produces them, on a background thread and at most
+  // 'max_nodes_per_batch' nodes per trajectory at a time. Unlike a checkpoint,
+  // this costs little per node, so it can run all the time.
+  void StartJournal(std::unique_ptr<io::ProtoStreamWriter> writer,
+                    int max_nodes_per_batch);
+
+  // Writes the rest of the journal and closes it. Returns false if writing
+  // failed.
+  bool StopJournal();
+
+  // Adds the nodes and submaps in a journal written by StartJournal(), which
+  // may be incomplete after a crash, to the pose graph. Each journaled
+  // trajectory becomes a new finished trajectory, and constraints are computed
+  // again, but local SLAM is not. If the journal was started after a
+  // checkpoint, the checkpoint is loaded first with LoadMap(). Returns the IDs
+  // of the new trajectories in the order they appear in the journal.
+  std::vector<int> RecoverFromJournal(io::ProtoStreamReader* reader);
+
+  // Writes the grids precomputed for global matching against each submap to
+  // 'filename', in the order of the submaps in SerializeState(). Returns false
+  // if writing failed.
+  bool SerializePrecomputedGrids(const string& filename);
+
+  // Loads submaps from a proto stream into a new frozen trajectory. If it was
+  // written with 'serialize_precomputed_grids' enabled, the grids stored with
+  // the submaps are used for matching against them instead of computing them
+  // again.
   void LoadMap(io::ProtoStreamReader* reader);
 
+  // Same as above, but scan matching against the loaded submaps uses the grids
+  // written by SerializePrecomputedGrids() alongside the proto stream. They are
+  // memory-mapped instead of being computed, which substantially shortens the
+  // startup of pure localization.
+  void LoadMap(io::ProtoStreamReader* reader,
+               const string& precomputed_grids_filename);
+
+  // Same as above, but the grids of 2D submaps are not kept in memory. They
+  // are read again from 'filename', which must have an index, whenever they
+  // are needed, and only a bounded number of them is cached for scan
+  // matching. This is meant for localization in large maps.
+  void LoadMapLazily(const string& filename,
+                     const string& precomputed_grids_filename);
+
+  // Same as LoadMap(), but also returns the loaded map, so that it can be
+  // added to other MapBuilders with AddFrozenMap() without loading it again.
+  // Node point clouds are compressed before being shared if
+  // 'compress_node_point_clouds' is set.
+  std::shared_ptr<const FrozenMap> LoadFrozenMap(
+      io::ProtoStreamReader* reader, const string& precomputed_grids_filename);
+
+  // Adds the 'frozen_map' returned by LoadFrozenMap() of any MapBuilder with
+  // the same options as a new frozen trajectory and returns its ID. Its
+  // submaps, nodes and precomputed grids are shared, so that memory stays flat
+  // with the number of MapBuilders localizing against it. Without precomputed
+  // grids, each pose graph still computes the grids for matching against the
+  // submaps on its own.
+  int AddFrozenMap(std::shared_ptr<const FrozenMap> frozen_map);
+
+  // Merges the map in 'filename', e.g. a neighboring area, into a new frozen
+  // trajectory while mapping keeps running. The map has to share the frame of
+  // the existing trajectories, so that nodes are only matched against its
+  // submaps near them. Returns the ID of the trajectory right away and loads
+  // it on a background thread, which decodes a bounded number of messages at
+  // a time at low priority and calls 'callback' when done. In 2D, the grids
+  // are read on demand as in LoadMapLazily() if 'filename' has an index.
+  int MergeMap(const string& filename, const std::function<void()>& callback);
+
+  // Blocks until all maps merged in the background have been loaded.
+  void WaitForPendingMerges() EXCLUDES(merge_mutex_);
+
   int num_trajectory_builders() const;
 
   mapping::SparsePoseGraph* sparse_pose_graph();
 
+  // Returns the statistics of the background work collected since the
+  // previous call, e.g. to choose 'num_background_threads'.
+  common::ThreadPoolStatistics PollThreadPoolStatistics();
+
+  // Returns the bytes used by submaps, nodes, sensor queues and pending
+  // computations, e.g. to enforce a memory budget. Visits all submaps and
+  // nodes, so it is meant to be polled at a low rate.
+  MemoryUsage GetMemoryUsage();
+
+  // Returns the metrics of the background work, the pose graph and the sensor
+  // data, e.g. to be exported with ToPrometheusText() when scraped. Callers
+  // may add their own metrics.
+  metrics::Registry* metrics_registry();
+
  private:
+  // Adds a new frozen trajectory to load a map into and returns its ID. If not
+  // nullptr, the 'precomputed_grids' are used for matching against its
+  // submaps.
+  int AddFrozenTrajectory(
+      std::shared_ptr<const io::MappedBlobFile> precomputed_grids);
+
+  // Adds a new finished trajectory which receives no sensor data, e.g. to add
+  // nodes and submaps to, and returns its ID.
+  int AddTrajectoryWithoutSensorData();
+
+  // Loads the map from 'reader' into the frozen trajectory 'map_trajectory_id'.
+  // If 'add_serialized_submap_id' is not null, 2D submaps are loaded without
+  // their grids, and it is called with the ID each submap had in the proto
+  // stream before the submap is added. If 'in_background' is true, fewer
+  // messages are decoded at a time and at low priority. If
+  // 'restore_precomputed_grids' is true and all submaps were stored with
+  // precomputed grids, these are used for matching against the submaps once
+  // loading is done. If 'frozen_map' is not null, the loaded submaps, nodes
+  // and restored grids are also added to it.
+  void LoadIntoFrozenTrajectory(
+      io::ProtoStreamReader* reader, int map_trajectory_id,
+      const std::function<void(const SubmapId&)>& add_serialized_submap_id,
+      bool in_background, bool restore_precomputed_grids,
+      FrozenMap* frozen_map);
+
+  // Registers a loader reading the 2D submaps of 'map_trajectory_id' from
+  // 'filename' on demand. Returns the callback for LoadIntoFrozenTrajectory(),
+  // or nullptr if 'filename' has no index.
+  std::function<void(const SubmapId&)> AddSubmapLoader(const string& filename,
+                                                       int map_trajectory_id);
+
   const proto::MapBuilderOptions options_;
-  common::ThreadPool thread_pool_;
+  // Declared before everything updating metrics in it.
+  metrics::Registry metrics_registry_;
+  std::unique_ptr<common::ThreadPoolInterface> thread_pool_;
+  // Pools of their own for the classes of background work configured in the
+  // 'thread_pools' option.
+  std::vector<std::unique_ptr<common::ThreadPoolInterface>>
+      workload_thread_pools_;
+  // The pool each class of background work runs on, 'thread_pool_' unless
+  // configured otherwise.
+  common::WorkloadThreadPools thread_pools_;
+  // Number of threads of 'thread_pools_.io'.
+  int num_io_threads_;
 
   std::unique_ptr<mapping_2d::SparsePoseGraph> sparse_pose_graph_2d_;
   std::unique_ptr<mapping_3d::SparsePoseGraph> sparse_pose_graph_3d_;
   mapping::SparsePoseGraph* sparse_pose_graph_;
 
   sensor::Collator sensor_collator_;
+  // Declared before the trajectory builders adding nodes to it.
+  SessionJournal journal_;
   std::vector<std::unique_ptr<mapping::TrajectoryBuilder>> trajectory_builders_;
+
+  // Loaders of the submaps of trajectories loaded by LoadMapLazily() or
+  // MergeMap().
+  std::map<int, mapping_2d::sparse_pose_graph::ConstraintBuilder::SubmapLoader>
+      submap_loaders_;
+
+  std::set<SubmapId> incrementally_serialized_finished_submap_ids_;
+  std::set<NodeId> incrementally_serialized_node_ids_;
+
+  common::Mutex merge_mutex_;
+  int num_pending_merges_ GUARDED_BY(merge_mutex_) = 0;
+  // Created by the first MergeMap().
+  std::unique_ptr<common::ThreadPool> merge_thread_ GUARDED_BY(merge_mutex_);
+
+  common::Mutex serialization_mutex_;
+  int num_pending_serializations_ GUARDED_BY(serialization_mutex_) = 0;
+  // Created by the first SerializeStateInBackground(). Declared last so that
+  // its thread is joined before anything it uses is destroyed.
+  std::unique_ptr<common::ThreadPool> serialization_thread_
+      GUARDED_BY(serialization_mutex_);
 };
 
 }  // namespace mapping
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/map_builder.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "cartographer/common/config.h"
+#include "cartographer/common/configuration_file_resolver.h"
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/time.h"
+#include "cartographer/io/proto_stream.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr char kRangeSensorId[] = "range";
+
+std::unique_ptr<common::LuaParameterDictionary> LoadConfiguration(
+    const string& code) {
+  auto file_resolver = common::make_unique<common::ConfigurationFileResolver>(
+      std::vector<string>{string(common::kSourceDirectory) +
+                          "/configuration_files"});
+  return common::make_unique<common::LuaParameterDictionary>(
+      code, std::move(file_resolver));
+}
+
+proto::MapBuilderOptions CreateMapBuilderTestOptions(
+    const string& overrides) {
+  const auto parameter_dictionary = LoadConfiguration(
+      "include \"map_builder.lua\"\n"
+      "MAP_BUILDER.use_trajectory_builder_2d = true\n"
+      "MAP_BUILDER.num_background_threads = 2\n" +
+      overrides + "return MAP_BUILDER");
+  return CreateMapBuilderOptions(parameter_dictionary.get());
+}
+
+proto::TrajectoryBuilderOptions CreateTrajectoryBuilderTestOptions() {
+  const auto parameter_dictionary = LoadConfiguration(
+      "include \"trajectory_builder.lua\"\n"
+      "TRAJECTORY_BUILDER.trajectory_builder_2d.use_imu_data = false\n"
+      "TRAJECTORY_BUILDER.trajectory_builder_2d.submaps.num_range_data = 10\n"
+      "TRAJECTORY_BUILDER.trajectory_builder_2d.motion_filter"
+      ".max_time_seconds = 0.\n"
+      "return TRAJECTORY_BUILDER");
+  return CreateTrajectoryBuilderOptions(parameter_dictionary.get());
+}
+
+// Returns the returns of a scan taken at 'x' in a room of 10 by 6 meters whose
+// walls have a few bumps, in the frame of the scan.
+sensor::PointCloud GenerateScan(const float x) {
+  sensor::PointCloud returns;
+  for (float t = -5.f; t <= 5.f; t += 0.05f) {
+    const float bump = std::fmod(std::abs(t), 2.f) < 0.3f ? 0.2f : 0.f;
+    returns.emplace_back(t - x, 3.f - bump, 0.f);
+    returns.emplace_back(t - x, -3.f + bump, 0.f);
+  }
+  for (float t = -3.f; t <= 3.f; t += 0.05f) {
+    returns.emplace_back(-5.f - x, t, 0.f);
+    returns.emplace_back(5.f - x, t, 0.f);
+  }
+  return returns;
+}
+
+// Adds 'num_scans' scans to the trajectory, moving along x.
+void AddScans(MapBuilder* const map_builder, const int trajectory_id,
+              const int first_scan, const int num_scans) {
+  TrajectoryBuilder* const trajectory_builder =
+      map_builder->GetTrajectoryBuilder(trajectory_id);
+  for (int i = first_scan; i != first_scan + num_scans; ++i) {
+    const float x = -2.f + 0.02f * i;
+    trajectory_builder->AddRangefinderData(
+        kRangeSensorId,
+        common::FromUniversal(123) + common::FromSeconds(0.1 * i),
+        Eigen::Vector3f::Zero(), GenerateScan(x));
+  }
+}
+
+string CreateTemporaryFilename() {
+  char filename[] = P_tmpdir "/map_builder_test_XXXXXX";
+  const int fd = mkstemp(filename);
+  CHECK_NE(-1, fd);
+  close(fd);
+  return filename;
+}
+
+TEST(MapBuilderTest, SerializeStateInBackgroundWhileAddingData) {
+  MapBuilder map_builder(CreateMapBuilderTestOptions(""));
+  const int trajectory_id = map_builder.AddTrajectoryBuilder(
+      {kRangeSensorId}, CreateTrajectoryBuilderTestOptions());
+  AddScans(&map_builder, trajectory_id, 0, 30);
+  std::vector<string> filenames;
+  size_t num_successful_serializations = 0;
+  common::Mutex mutex;
+  // Snapshots are taken between the scans, while the pose graph keeps adding
+  // the previous ones in the background.
+  for (int i = 3; i != 15; ++i) {
+    AddScans(&map_builder, trajectory_id, 10 * i, 10);
+    filenames.push_back(CreateTemporaryFilename());
+    map_builder.SerializeStateInBackground(
+        common::make_unique<io::ProtoStreamWriter>(filenames.back()),
+        [&mutex, &num_successful_serializations](const bool success) {
+          common::MutexLocker locker(&mutex);
+          if (success) {
+            ++num_successful_serializations;
+          }
+        });
+  }
+  map_builder.WaitForPendingSerializations();
+  map_builder.FinishTrajectory(trajectory_id);
+  {
+    common::MutexLocker locker(&mutex);
+    EXPECT_EQ(filenames.size(), num_successful_serializations);
+  }
+
+  int max_num_loaded_submaps = 0;
+  for (const string& filename : filenames) {
+    MapBuilder loaded_map_builder(CreateMapBuilderTestOptions(""));
+    {
+      io::ProtoStreamReader reader(filename);
+      // Fails if a node or submap is missing from the serialized pose graph.
+      loaded_map_builder.LoadMap(&reader);
+    }
+    remove(filename.c_str());
+    max_num_loaded_submaps =
+        std::max(max_num_loaded_submaps,
+                 loaded_map_builder.sparse_pose_graph()->num_submaps(0));
+  }
+  EXPECT_LT(0, max_num_loaded_submaps);
+}
+
+TEST(MapBuilderTest, RunsWorkloadsOnConfiguredThreadPools) {
+  MapBuilder map_builder(CreateMapBuilderTestOptions(
+      "MAP_BUILDER.thread_pools = {\n"
+      "  { workload = \"matcher_construction\", num_threads = 1,\n"
+      "    nice_level = 0 },\n"
+      "  { workload = \"constraints\", num_threads = 2, nice_level = 0 },\n"
+      "}\n"));
+  const int trajectory_id = map_builder.AddTrajectoryBuilder(
+      {kRangeSensorId}, CreateTrajectoryBuilderTestOptions());
+  AddScans(&map_builder, trajectory_id, 0, 100);
+  map_builder.FinishTrajectory(trajectory_id);
+
+  const auto num_work_items = [&map_builder](const string& pool,
+                                             const string& label) {
+    return map_builder.metrics_registry()
+        ->GetCounter("cartographer_thread_pool_work_items_total", "",
+                     {{"pool", pool}, {"label", label}})
+        ->Value();
+  };
+  EXPECT_LT(0., num_work_items("constraints", "constraint_search_2d"));
+  EXPECT_LT(0., num_work_items("matcher_construction",
+                               "precompute_scan_matcher_2d"));
+  EXPECT_EQ(0., num_work_items("default", "constraint_search_2d"));
+  EXPECT_EQ(0., num_work_items("default", "precompute_scan_matcher_2d"));
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
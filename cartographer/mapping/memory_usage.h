@@ -0,0 +1,53 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_MEMORY_USAGE_H_
+#define CARTOGRAPHER_MAPPING_MEMORY_USAGE_H_
+
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Bytes used by the subsystems of mapping, e.g. to enforce a memory budget.
+// The values are computed from the sizes of the containers involved, so they
+// are cheap to poll but only approximate the memory allocated.
+struct MemoryUsage {
+  // Probability grids of 2D submaps, hybrid grids of 3D submaps.
+  int64 submap_grids_in_bytes = 0;
+  // Precomputation grids of the cached scan matchers of the constraint
+  // builder.
+  int64 precomputation_grids_in_bytes = 0;
+  // Point clouds of the trajectory nodes, compressed or not.
+  int64 node_point_clouds_in_bytes = 0;
+  // Sensor data and node data of the optimization problem.
+  int64 optimization_problem_in_bytes = 0;
+  // Sensor data waiting in the collator to be dispatched in time order.
+  int64 sensor_queues_in_bytes = 0;
+  // Work deferred by the pose graph while it optimizes.
+  int64 work_queues_in_bytes = 0;
+
+  int64 total_in_bytes() const {
+    return submap_grids_in_bytes + precomputation_grids_in_bytes +
+           node_point_clouds_in_bytes + optimization_problem_in_bytes +
+           sensor_queues_in_bytes + work_queues_in_bytes;
+  }
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_MEMORY_USAGE_H_
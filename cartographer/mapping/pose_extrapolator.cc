@@ -73,6 +73,7 @@ void PoseExtrapolator::AddPose(const common::Time time,
   }
   UpdateVelocitiesFromPoses();
   AdvanceImuTracker(time, imu_tracker_.get());
+  extrapolation_imu_tracker_ = nullptr;
   TrimImuData();
   TrimOdometryData();
 }
@@ -80,6 +81,10 @@ void PoseExtrapolator::AddPose(const common::Time time,
 void PoseExtrapolator::AddImuData(const sensor::ImuData& imu_data) {
   CHECK(timed_pose_queue_.empty() ||
         imu_data.time >= timed_pose_queue_.back().time);
+  if (extrapolation_imu_tracker_ != nullptr &&
+      imu_data.time < extrapolation_imu_tracker_->time()) {
+    extrapolation_imu_tracker_ = nullptr;
+  }
   imu_data_.push_back(imu_data);
   TrimImuData();
 }
@@ -128,11 +133,50 @@ transform::Rigid3d PoseExtrapolator::ExtrapolatePose(const common::Time time) {
          transform::Rigid3d::Rotation(ExtrapolateRotation(time));
 }
 
+PoseExtrapolator::ExtrapolationState
+PoseExtrapolator::GetExtrapolationState() {
+  common::Time time = timed_pose_queue_.back().time;
+  if (!imu_data_.empty()) {
+    time = std::max(time, imu_data_.back().time);
+  }
+  if (!odometry_data_.empty()) {
+    time = std::max(time, odometry_data_.back().time);
+  }
+  ImuTracker imu_tracker = AdvanceExtrapolationImuTracker(time);
+  // Later extrapolations also integrate the IMU data at 'time' itself.
+  for (auto it = imu_data_.rbegin(); it != imu_data_.rend() && it->time == time;
+       ++it) {
+    imu_tracker.AddImuLinearAccelerationObservation(it->linear_acceleration);
+    imu_tracker.AddImuAngularVelocityObservation(it->angular_velocity);
+  }
+  const TimedPose& newest_timed_pose = timed_pose_queue_.back();
+  const transform::Rigid3d pose =
+      transform::Rigid3d::Translation(ExtrapolateTranslation(time)) *
+      newest_timed_pose.pose *
+      transform::Rigid3d::Rotation(imu_tracker_->orientation().inverse() *
+                                   imu_tracker.orientation());
+  return ExtrapolationState{time, pose,
+                            odometry_data_.size() < 2
+                                ? linear_velocity_from_poses_
+                                : linear_velocity_from_odometry_,
+                            imu_tracker.angular_velocity()};
+}
+
+transform::Rigid3d PoseExtrapolator::ExtrapolatePose(
+    const ExtrapolationState& state, const common::Time time) {
+  // Beyond the newest data, the ImuTracker rotates at a constant angular
+  // velocity and the translation changes at a constant linear velocity.
+  const double delta_t = common::ToSeconds(time - state.time);
+  return transform::Rigid3d::Translation(delta_t * state.linear_velocity) *
+         state.pose *
+         transform::Rigid3d::Rotation(
+             transform::AngleAxisVectorToRotationQuaternion(
+                 Eigen::Vector3d(delta_t * state.angular_velocity)));
+}
+
 Eigen::Quaterniond PoseExtrapolator::EstimateGravityOrientation(
     const common::Time time) {
-  ImuTracker imu_tracker = *imu_tracker_;
-  AdvanceImuTracker(time, &imu_tracker);
-  return imu_tracker.orientation();
+  return AdvanceExtrapolationImuTracker(time).orientation();
 }
 
 void PoseExtrapolator::UpdateVelocitiesFromPoses() {
@@ -206,12 +250,30 @@ void PoseExtrapolator::AdvanceImuTracker(const common::Time time,
   imu_tracker->Advance(time);
 }
 
+ImuTracker PoseExtrapolator::AdvanceExtrapolationImuTracker(
+    const common::Time time) {
+  if (imu_data_.empty() || time < imu_data_.front().time) {
+    // Without IMU data, 'AdvanceImuTracker()' adds observations at 'time'
+    // which must not be integrated again later, so nothing is cached.
+    ImuTracker imu_tracker = *imu_tracker_;
+    AdvanceImuTracker(time, &imu_tracker);
+    return imu_tracker;
+  }
+  if (extrapolation_imu_tracker_ == nullptr ||
+      time < extrapolation_imu_tracker_->time()) {
+    extrapolation_imu_tracker_ = common::make_unique<ImuTracker>(*imu_tracker_);
+  }
+  // Only IMU data not before the time of 'extrapolation_imu_tracker_' is
+  // integrated, i.e. the data since the previous extrapolation.
+  AdvanceImuTracker(time, extrapolation_imu_tracker_.get());
+  return *extrapolation_imu_tracker_;
+}
+
 Eigen::Quaterniond PoseExtrapolator::ExtrapolateRotation(
     const common::Time time) {
-  ImuTracker imu_tracker = *imu_tracker_;
-  AdvanceImuTracker(time, &imu_tracker);
   const Eigen::Quaterniond last_orientation = imu_tracker_->orientation();
-  return last_orientation.inverse() * imu_tracker.orientation();
+  return last_orientation.inverse() *
+         AdvanceExtrapolationImuTracker(time).orientation();
 }
 
 Eigen::Vector3d PoseExtrapolator::ExtrapolateTranslation(common::Time time) {
@@ -34,6 +34,16 @@ namespace mapping {
 // available to improve the extrapolation.
 class PoseExtrapolator {
  public:
+  // The pose extrapolated to 'time' and the velocities to extrapolate it
+  // further without IMU or odometry data.
+  struct ExtrapolationState {
+    common::Time time;
+    transform::Rigid3d pose;
+    Eigen::Vector3d linear_velocity;
+    // In the tracking frame.
+    Eigen::Vector3d angular_velocity;
+  };
+
   explicit PoseExtrapolator(common::Duration pose_queue_duration,
                             double imu_gravity_time_constant);
 
@@ -53,6 +63,15 @@ class PoseExtrapolator {
   void AddOdometryData(const sensor::OdometryData& odometry_data);
   transform::Rigid3d ExtrapolatePose(common::Time time);
 
+  // Returns the state at the time of the newest pose, IMU or odometry data.
+  ExtrapolationState GetExtrapolationState();
+
+  // Extrapolates 'state' to 'time'. For times not before 'state.time', this
+  // matches ExtrapolatePose() of the extrapolator 'state' was taken from until
+  // further data is added to it.
+  static transform::Rigid3d ExtrapolatePose(const ExtrapolationState& state,
+                                            common::Time time);
+
   // Gravity alignment estimate.
   Eigen::Quaterniond EstimateGravityOrientation(common::Time time);
 
@@ -61,6 +80,10 @@ class PoseExtrapolator {
   void TrimImuData();
   void TrimOdometryData();
   void AdvanceImuTracker(common::Time time, ImuTracker* imu_tracker);
+  // Returns 'imu_tracker_' advanced to 'time'. Reuses the result of the
+  // previous call so that repeated extrapolation only integrates IMU data
+  // added since then.
+  ImuTracker AdvanceExtrapolationImuTracker(common::Time time);
   Eigen::Quaterniond ExtrapolateRotation(common::Time time);
   Eigen::Vector3d ExtrapolateTranslation(common::Time time);
 
@@ -76,6 +99,10 @@ class PoseExtrapolator {
   const double gravity_time_constant_;
   std::deque<sensor::ImuData> imu_data_;
   std::unique_ptr<ImuTracker> imu_tracker_;
+  // Copy of 'imu_tracker_' already advanced through the IMU data up to its
+  // time. Reset whenever 'imu_tracker_' changes or IMU data arrives out of
+  // its past.
+  std::unique_ptr<ImuTracker> extrapolation_imu_tracker_;
 
   std::deque<sensor::OdometryData> odometry_data_;
   Eigen::Vector3d linear_velocity_from_odometry_ = Eigen::Vector3d::Zero();
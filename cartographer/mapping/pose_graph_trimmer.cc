@@ -16,6 +16,11 @@
 
 #include "cartographer/mapping/pose_graph_trimmer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <utility>
+
 #include "glog/logging.h"
 
 namespace cartographer {
@@ -36,5 +41,127 @@ void PureLocalizationTrimmer::Trim(Trimmable* const pose_graph) {
   }
 }
 
+proto::OverlappingSubmapsTrimmerOptions CreateOverlappingSubmapsTrimmerOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::OverlappingSubmapsTrimmerOptions options;
+  options.set_fresh_submaps_count(
+      parameter_dictionary->GetNonNegativeInt("fresh_submaps_count"));
+  options.set_min_covered_area(
+      parameter_dictionary->GetDouble("min_covered_area"));
+  options.set_min_added_submaps_count(
+      parameter_dictionary->GetNonNegativeInt("min_added_submaps_count"));
+  options.set_coverage_cell_size(
+      parameter_dictionary->GetDouble("coverage_cell_size"));
+  CHECK_GT(options.coverage_cell_size(), 0.);
+  return options;
+}
+
+OverlappingSubmapsTrimmer::OverlappingSubmapsTrimmer(
+    const proto::OverlappingSubmapsTrimmerOptions& options)
+    : options_(options) {
+  CHECK_GT(options_.fresh_submaps_count(), 0);
+  CHECK_GT(options_.coverage_cell_size(), 0.);
+}
+
+void OverlappingSubmapsTrimmer::Trim(Trimmable* const pose_graph) {
+  const std::vector<SubmapId> submap_ids = pose_graph->GetFinishedSubmapIds();
+  if (static_cast<int>(submap_ids.size()) <
+      num_submaps_at_last_trim_ + options_.min_added_submaps_count()) {
+    return;
+  }
+  std::map<SubmapId, Eigen::AlignedBox3d> bounding_boxes;
+  for (const SubmapId& submap_id : submap_ids) {
+    const auto it = bounding_boxes_.find(submap_id);
+    bounding_boxes.emplace(submap_id,
+                           it != bounding_boxes_.end()
+                               ? it->second
+                               : pose_graph->GetSubmapBoundingBox(submap_id));
+  }
+  bounding_boxes_ = std::move(bounding_boxes);
+
+  std::vector<SubmapId> submaps_to_trim;
+  for (const std::vector<int>& component :
+       pose_graph->GetConnectedTrajectories()) {
+    const std::set<int> trajectory_ids(component.begin(), component.end());
+    std::vector<SubmapId> component_submap_ids;
+    for (const SubmapId& submap_id : submap_ids) {
+      if (trajectory_ids.count(submap_id.trajectory_id) != 0) {
+        component_submap_ids.push_back(submap_id);
+      }
+    }
+    for (const SubmapId& submap_id :
+         ComputeSubmapsToTrim(component_submap_ids, *pose_graph)) {
+      submaps_to_trim.push_back(submap_id);
+    }
+  }
+  for (const SubmapId& submap_id : submaps_to_trim) {
+    pose_graph->MarkSubmapAsTrimmed(submap_id);
+    bounding_boxes_.erase(submap_id);
+  }
+  num_submaps_at_last_trim_ = submap_ids.size() - submaps_to_trim.size();
+}
+
+std::vector<SubmapId> OverlappingSubmapsTrimmer::ComputeSubmapsToTrim(
+    const std::vector<SubmapId>& submap_ids,
+    const Trimmable& pose_graph) const {
+  const double cell_size = options_.coverage_cell_size();
+  // Number of kept submaps containing each cell, which are all newer than the
+  // submap looked at.
+  std::map<std::pair<int, int>, int> num_covering_submaps;
+  std::vector<SubmapId> submaps_to_trim;
+  for (auto it = submap_ids.rbegin(); it != submap_ids.rend(); ++it) {
+    const SubmapId& submap_id = *it;
+    const Eigen::AlignedBox3d& bounding_box = bounding_boxes_.at(submap_id);
+    if (bounding_box.isEmpty()) {
+      continue;
+    }
+    const transform::Rigid3d pose = pose_graph.GetSubmapPose(submap_id);
+    const transform::Rigid3d inverse_pose = pose.inverse();
+    Eigen::AlignedBox2d global_box;
+    for (const Eigen::Vector3d& corner :
+         {bounding_box.corner(Eigen::AlignedBox3d::BottomLeftFloor),
+          bounding_box.corner(Eigen::AlignedBox3d::BottomRightFloor),
+          bounding_box.corner(Eigen::AlignedBox3d::TopLeftFloor),
+          bounding_box.corner(Eigen::AlignedBox3d::TopRightFloor)}) {
+      global_box.extend((pose * corner).head<2>());
+    }
+    std::vector<std::pair<int, int>> cells;
+    int num_fresh_cells = 0;
+    for (int x = std::floor(global_box.min().x() / cell_size);
+         x <= std::floor(global_box.max().x() / cell_size); ++x) {
+      for (int y = std::floor(global_box.min().y() / cell_size);
+           y <= std::floor(global_box.max().y() / cell_size); ++y) {
+        const Eigen::Vector3d local_center =
+            inverse_pose * Eigen::Vector3d((x + 0.5) * cell_size,
+                                           (y + 0.5) * cell_size,
+                                           pose.translation().z());
+        if (local_center.x() < bounding_box.min().x() ||
+            local_center.x() > bounding_box.max().x() ||
+            local_center.y() < bounding_box.min().y() ||
+            local_center.y() > bounding_box.max().y()) {
+          continue;
+        }
+        cells.emplace_back(x, y);
+        if (num_covering_submaps[cells.back()] <
+            options_.fresh_submaps_count()) {
+          ++num_fresh_cells;
+        }
+      }
+    }
+    // Submaps which are not covered by newer ones at all are kept, even if
+    // they are small.
+    if (num_fresh_cells != static_cast<int>(cells.size()) &&
+        num_fresh_cells * cell_size * cell_size <
+            options_.min_covered_area()) {
+      submaps_to_trim.push_back(submap_id);
+      continue;
+    }
+    for (const auto& cell : cells) {
+      ++num_covering_submaps[cell];
+    }
+  }
+  return submaps_to_trim;
+}
+
 }  // namespace mapping
 }  // namespace cartographer
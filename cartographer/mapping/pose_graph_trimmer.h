@@ -17,7 +17,14 @@
 #ifndef CARTOGRAPHER_MAPPING_POSE_GRAPH_TRIMMER_H_
 #define CARTOGRAPHER_MAPPING_POSE_GRAPH_TRIMMER_H_
 
+#include <map>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/mapping/id.h"
+#include "cartographer/mapping/proto/overlapping_submaps_trimmer_options.pb.h"
+#include "cartographer/transform/rigid_transform.h"
 
 namespace cartographer {
 namespace mapping {
@@ -32,6 +39,21 @@ class Trimmable {
   // To be expanded as needed for lifelong mapping.
   virtual int num_submaps(int trajectory_id) const = 0;
 
+  // Returns the IDs of all finished submaps which are not trimmed, except those
+  // of localization trajectories, in increasing order.
+  virtual std::vector<SubmapId> GetFinishedSubmapIds() const = 0;
+
+  // Returns the optimized global pose of the finished 'submap_id'.
+  virtual transform::Rigid3d GetSubmapPose(const SubmapId& submap_id) const = 0;
+
+  // Returns the bounding box of the known space of the finished 'submap_id' in
+  // the submap frame, which does not change anymore.
+  virtual Eigen::AlignedBox3d GetSubmapBoundingBox(
+      const SubmapId& submap_id) const = 0;
+
+  // Returns the trajectory IDs, grouped by connectivity through constraints.
+  virtual std::vector<std::vector<int>> GetConnectedTrajectories() const = 0;
+
   // Marks 'submap_id' and corresponding intra-submap nodes as trimmed. They
   // will no longer take part in scan matching, loop closure, visualization.
   // Submaps and nodes are only marked, the numbering remains unchanged.
@@ -62,6 +84,37 @@ class PureLocalizationTrimmer : public PoseGraphTrimmer {
   int num_submaps_trimmed_ = 0;
 };
 
+proto::OverlappingSubmapsTrimmerOptions CreateOverlappingSubmapsTrimmerOptions(
+    common::LuaParameterDictionary* parameter_dictionary);
+
+// Trims the submaps which are covered by enough newer submaps for lifelong
+// mapping of the same area. Coverage is approximated by the bounding boxes of
+// the submaps rasterized onto a grid in the xy plane. Each cell counts for the
+// 'fresh_submaps_count' newest submaps of connected trajectories containing
+// it, and submaps which count for less than 'min_covered_area' are trimmed.
+// Submaps of trajectories with higher IDs are considered newer.
+class OverlappingSubmapsTrimmer : public PoseGraphTrimmer {
+ public:
+  explicit OverlappingSubmapsTrimmer(
+      const proto::OverlappingSubmapsTrimmerOptions& options);
+  ~OverlappingSubmapsTrimmer() override {}
+
+  void Trim(Trimmable* pose_graph) override;
+
+ private:
+  // Returns the submaps to trim among the 'submap_ids' of connected
+  // trajectories, which are in increasing order.
+  std::vector<SubmapId> ComputeSubmapsToTrim(
+      const std::vector<SubmapId>& submap_ids,
+      const Trimmable& pose_graph) const;
+
+  const proto::OverlappingSubmapsTrimmerOptions options_;
+  // Bounding boxes of the finished submaps, since they are costly to compute
+  // and do not change anymore.
+  std::map<SubmapId, Eigen::AlignedBox3d> bounding_boxes_;
+  int num_submaps_at_last_trim_ = 0;
+};
+
 }  // namespace mapping
 }  // namespace cartographer
 
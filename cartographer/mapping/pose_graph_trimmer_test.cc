@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping/pose_graph_trimmer.h"
 
+#include <algorithm>
+#include <map>
 #include <vector>
 
 #include "cartographer/mapping/id.h"
@@ -33,16 +35,63 @@ class FakePoseGraph : public Trimmable {
     return 17 - trimmed_submaps_.size();
   }
 
+  std::vector<SubmapId> GetFinishedSubmapIds() const override {
+    std::vector<SubmapId> submap_ids;
+    for (const auto& entry : submap_poses_) {
+      if (std::find(trimmed_submaps_.begin(), trimmed_submaps_.end(),
+                    entry.first) == trimmed_submaps_.end()) {
+        submap_ids.push_back(entry.first);
+      }
+    }
+    return submap_ids;
+  }
+
+  transform::Rigid3d GetSubmapPose(const SubmapId& submap_id) const override {
+    return submap_poses_.at(submap_id);
+  }
+
+  // All submaps cover 10 by 10 meters in front of and to the left of their
+  // origin.
+  Eigen::AlignedBox3d GetSubmapBoundingBox(
+      const SubmapId& submap_id) const override {
+    return Eigen::AlignedBox3d(Eigen::Vector3d(0., 0., -1.),
+                               Eigen::Vector3d(10., 10., 1.));
+  }
+
+  std::vector<std::vector<int>> GetConnectedTrajectories() const override {
+    return connected_trajectories_;
+  }
+
   void MarkSubmapAsTrimmed(const SubmapId& submap_id) override {
     trimmed_submaps_.push_back(submap_id);
   }
 
+  void AddSubmap(const SubmapId& submap_id, const Eigen::Vector3d& origin) {
+    submap_poses_.emplace(submap_id, transform::Rigid3d::Translation(origin));
+  }
+
+  void set_connected_trajectories(
+      const std::vector<std::vector<int>>& connected_trajectories) {
+    connected_trajectories_ = connected_trajectories;
+  }
+
   std::vector<SubmapId> trimmed_submaps() { return trimmed_submaps_; }
 
  private:
+  std::map<SubmapId, transform::Rigid3d> submap_poses_;
+  std::vector<std::vector<int>> connected_trajectories_;
   std::vector<SubmapId> trimmed_submaps_;
 };
 
+proto::OverlappingSubmapsTrimmerOptions CreateOptions() {
+  proto::OverlappingSubmapsTrimmerOptions options;
+  options.set_fresh_submaps_count(1);
+  options.set_min_covered_area(20.);
+  options.set_min_added_submaps_count(0);
+  options.set_coverage_cell_size(1.);
+  return options;
+}
+
 TEST(PureLocalizationTrimmerTest, MarksSubmapsAsExpected) {
   const int kTrajectoryId = 42;
   PureLocalizationTrimmer trimmer(kTrajectoryId, 15);
@@ -55,6 +104,49 @@ TEST(PureLocalizationTrimmerTest, MarksSubmapsAsExpected) {
   EXPECT_EQ((SubmapId{kTrajectoryId, 1}), trimmed_submaps[1]);
 }
 
+TEST(OverlappingSubmapsTrimmerTest, TrimsSubmapsCoveredByNewerOnes) {
+  FakePoseGraph fake_pose_graph;
+  fake_pose_graph.set_connected_trajectories({{0, 1}});
+  fake_pose_graph.AddSubmap(SubmapId{0, 0}, Eigen::Vector3d(0., 0., 0.));
+  fake_pose_graph.AddSubmap(SubmapId{0, 1}, Eigen::Vector3d(2., 0., 0.));
+  fake_pose_graph.AddSubmap(SubmapId{0, 2}, Eigen::Vector3d(100., 0., 0.));
+  fake_pose_graph.AddSubmap(SubmapId{1, 0}, Eigen::Vector3d(3., 0., 0.));
+  OverlappingSubmapsTrimmer trimmer(CreateOptions());
+  trimmer.Trim(&fake_pose_graph);
+  // Only 10 square meters of submap (0, 1) are not covered by submap (1, 0).
+  // Submap (0, 0) keeps 30 square meters, since trimmed submaps do not cover
+  // older ones.
+  EXPECT_EQ((std::vector<SubmapId>{{0, 1}}), fake_pose_graph.trimmed_submaps());
+
+  trimmer.Trim(&fake_pose_graph);
+  EXPECT_EQ(1, fake_pose_graph.trimmed_submaps().size());
+}
+
+TEST(OverlappingSubmapsTrimmerTest, KeepsSubmapsOfUnconnectedTrajectories) {
+  FakePoseGraph fake_pose_graph;
+  fake_pose_graph.set_connected_trajectories({{0}, {1}});
+  fake_pose_graph.AddSubmap(SubmapId{0, 0}, Eigen::Vector3d(0., 0., 0.));
+  fake_pose_graph.AddSubmap(SubmapId{1, 0}, Eigen::Vector3d(0., 0., 0.));
+  OverlappingSubmapsTrimmer trimmer(CreateOptions());
+  trimmer.Trim(&fake_pose_graph);
+  EXPECT_TRUE(fake_pose_graph.trimmed_submaps().empty());
+}
+
+TEST(OverlappingSubmapsTrimmerTest, WaitsForAddedSubmaps) {
+  FakePoseGraph fake_pose_graph;
+  fake_pose_graph.set_connected_trajectories({{0}});
+  fake_pose_graph.AddSubmap(SubmapId{0, 0}, Eigen::Vector3d(0., 0., 0.));
+  proto::OverlappingSubmapsTrimmerOptions options = CreateOptions();
+  options.set_min_added_submaps_count(2);
+  OverlappingSubmapsTrimmer trimmer(options);
+  trimmer.Trim(&fake_pose_graph);
+  fake_pose_graph.AddSubmap(SubmapId{0, 1}, Eigen::Vector3d(0., 0., 0.));
+  EXPECT_TRUE(fake_pose_graph.trimmed_submaps().empty());
+  trimmer.Trim(&fake_pose_graph);
+  EXPECT_EQ((std::vector<SubmapId>{{0, 0}}),
+            fake_pose_graph.trimmed_submaps());
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
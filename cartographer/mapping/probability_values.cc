@@ -45,11 +45,72 @@ const std::vector<float>* PrecomputeValueToProbability() {
   return result;
 }
 
+// Precomputes 'conversion' of the probabilities of all values with and
+// without the update marker.
+template <typename Conversion>
+const std::vector<uint8>* PrecomputeValueToUint8(const Conversion& conversion) {
+  std::vector<uint8>* result = new std::vector<uint8>;
+  for (int repeat = 0; repeat != 2; ++repeat) {
+    for (int value = 0; value != 32768; ++value) {
+      result->push_back(conversion(SlowValueToProbability(value)));
+    }
+  }
+  return result;
+}
+
+// The change of log-odds per step of a log-odds value.
+float LogOddsPerValue() {
+  return std::log(Odds(kMaxProbability)) /
+         (kMaxLogOddsValue - kEvenOddsLogOddsValue);
+}
+
 }  // namespace
 
 const std::vector<float>* const kValueToProbability =
     PrecomputeValueToProbability();
 
+namespace {
+
+const std::vector<uint8>* const kValueToUint8Probability =
+    PrecomputeValueToUint8([](const float probability) {
+      return common::RoundToInt((probability - kMinProbability) *
+                                (255.f / (kMaxProbability - kMinProbability)));
+    });
+
+const std::vector<uint8>* const kValueToLogOddsInteger =
+    PrecomputeValueToUint8(ProbabilityToLogOddsInteger);
+
+// Converts the 'num_values' values starting at 'values' using 'table'. The
+// lookups are independent, so that the loop is unrolled and pipelined.
+template <typename T>
+void ConvertValues(const std::vector<T>& table, const uint16* const values,
+                   const int num_values, T* const result) {
+  const T* const table_data = table.data();
+  for (int i = 0; i != num_values; ++i) {
+    result[i] = table_data[values[i]];
+  }
+}
+
+}  // namespace
+
+void ValuesToProbabilities(const uint16* const values, const int num_values,
+                           float* const probabilities) {
+  ConvertValues(*kValueToProbability, values, num_values, probabilities);
+}
+
+void ValuesToUint8Probabilities(const uint16* const values,
+                                const int num_values,
+                                uint8* const uint8_probabilities) {
+  ConvertValues(*kValueToUint8Probability, values, num_values,
+                uint8_probabilities);
+}
+
+void ValuesToLogOddsIntegers(const uint16* const values, const int num_values,
+                             uint8* const log_odds_integers) {
+  ConvertValues(*kValueToLogOddsInteger, values, num_values,
+                log_odds_integers);
+}
+
 std::vector<uint16> ComputeLookupTableToApplyOdds(const float odds) {
   std::vector<uint16> result;
   result.push_back(ProbabilityToValue(ProbabilityFromOdds(odds)) +
@@ -62,5 +123,18 @@ std::vector<uint16> ComputeLookupTableToApplyOdds(const float odds) {
   return result;
 }
 
+int ComputeLogOddsValueUpdate(const float odds) {
+  return common::RoundToInt(std::log(odds) / LogOddsPerValue());
+}
+
+float LogOddsValueToProbability(const uint16 value) {
+  DCHECK_LE(value, kMaxLogOddsValue);
+  if (value == kUnknownLogOddsValue) {
+    return kMinProbability;
+  }
+  return ClampProbability(ProbabilityFromOdds(
+      std::exp((value - kEvenOddsLogOddsValue) * LogOddsPerValue())));
+}
+
 }  // namespace mapping
 }  // namespace cartographer
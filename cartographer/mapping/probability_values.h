@@ -66,8 +66,69 @@ inline float ValueToProbability(const uint16 value) {
   return (*kValueToProbability)[value];
 }
 
+// Batch version of ValueToProbability() for the 'num_values' values starting
+// at 'values'.
+void ValuesToProbabilities(const uint16* values, int num_values,
+                           float* probabilities);
+
+// Converts the 'num_values' values starting at 'values' to 8 bits, mapping
+// [kMinProbability, kMaxProbability] linearly to [0, 255]. Unknown cells are
+// converted to 0.
+void ValuesToUint8Probabilities(const uint16* values, int num_values,
+                                uint8* uint8_probabilities);
+
+// Converts the given probability to log odds.
+inline float Logit(float probability) {
+  return std::log(probability / (1.f - probability));
+}
+
+const float kMaxLogOdds = Logit(kMaxProbability);
+const float kMinLogOdds = Logit(kMinProbability);
+
+// Converts a probability to a log odds integer. 0 means unknown, [kMinLogOdds,
+// kMaxLogOdds] is mapped to [1, 255].
+inline uint8 ProbabilityToLogOddsInteger(const float probability) {
+  const int value = common::RoundToInt((Logit(probability) - kMinLogOdds) *
+                                       254.f / (kMaxLogOdds - kMinLogOdds)) +
+                    1;
+  CHECK_LE(1, value);
+  CHECK_GE(255, value);
+  return value;
+}
+
+// Batch version of ProbabilityToLogOddsInteger(ValueToProbability(value)) for
+// the 'num_values' values starting at 'values'. Unknown cells are converted
+// like cells with kMinProbability.
+void ValuesToLogOddsIntegers(const uint16* values, int num_values,
+                             uint8* log_odds_integers);
+
 std::vector<uint16> ComputeLookupTableToApplyOdds(float odds);
 
+// Log-odds values are an alternative cell encoding in which an update is a
+// saturating addition instead of a table lookup. 0 is unknown, [1, 32767] maps
+// linearly to the log-odds of [kMinProbability, kMaxProbability] with even
+// odds at kEvenOddsLogOddsValue. Unknown cells are treated as even odds when
+// updated, so the first update yields the probability of the update itself.
+constexpr uint16 kUnknownLogOddsValue = 0;
+constexpr int kEvenOddsLogOddsValue = 16384;
+constexpr int kMaxLogOddsValue = 32767;
+
+// Returns the change of log-odds value which multiplies the odds of a cell by
+// 'odds'.
+int ComputeLogOddsValueUpdate(float odds);
+
+// Adds 'update' to the log-odds 'value', saturating at the values of
+// kMinProbability and kMaxProbability.
+inline uint16 ApplyLogOddsValueUpdate(const uint16 value, const int update) {
+  const int base =
+      value == kUnknownLogOddsValue ? kEvenOddsLogOddsValue : value;
+  return common::Clamp(base + update, 1, kMaxLogOddsValue);
+}
+
+// Converts a log-odds value to a probability in the range [kMinProbability,
+// kMaxProbability]. Unknown cells have kMinProbability.
+float LogOddsValueToProbability(uint16 value);
+
 }  // namespace mapping
 }  // namespace cartographer
 
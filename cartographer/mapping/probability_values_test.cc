@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping/probability_values.h"
 
+#include <vector>
+
 #include "gtest/gtest.h"
 
 namespace cartographer {
@@ -30,6 +32,59 @@ TEST(ProbabilityValuesTest, OddsConversions) {
   EXPECT_NEAR(ProbabilityFromOdds(Odds(0.5)), 0.5, 1e-6);
 }
 
+TEST(ProbabilityValuesTest, LogOddsValueUpdates) {
+  EXPECT_EQ(kMinProbability, LogOddsValueToProbability(kUnknownLogOddsValue));
+  const int hit_update = ComputeLogOddsValueUpdate(Odds(0.7f));
+  const int miss_update = ComputeLogOddsValueUpdate(Odds(0.4f));
+  EXPECT_GT(hit_update, 0);
+  EXPECT_LT(miss_update, 0);
+  const uint16 hit = ApplyLogOddsValueUpdate(kUnknownLogOddsValue, hit_update);
+  EXPECT_NEAR(0.7f, LogOddsValueToProbability(hit), 1e-4);
+  const uint16 hit_and_miss = ApplyLogOddsValueUpdate(hit, miss_update);
+  EXPECT_NEAR(ProbabilityFromOdds(Odds(0.7f) * Odds(0.4f)),
+              LogOddsValueToProbability(hit_and_miss), 1e-4);
+  uint16 value = kUnknownLogOddsValue;
+  for (int i = 0; i != 100; ++i) {
+    value = ApplyLogOddsValueUpdate(value, hit_update);
+  }
+  EXPECT_EQ(kMaxLogOddsValue, value);
+  EXPECT_NEAR(kMaxProbability, LogOddsValueToProbability(value), 1e-6);
+  for (int i = 0; i != 100; ++i) {
+    value = ApplyLogOddsValueUpdate(value, miss_update);
+  }
+  EXPECT_EQ(1, value);
+  EXPECT_NEAR(kMinProbability, LogOddsValueToProbability(value), 1e-6);
+}
+
+TEST(ProbabilityValuesTest, BatchConversions) {
+  // All values with and without the update marker.
+  std::vector<uint16> values;
+  for (int value = 0; value != 65536; ++value) {
+    values.push_back(value);
+  }
+  std::vector<float> probabilities(values.size());
+  std::vector<uint8> uint8_probabilities(values.size());
+  std::vector<uint8> log_odds_integers(values.size());
+  ValuesToProbabilities(values.data(), values.size(), probabilities.data());
+  ValuesToUint8Probabilities(values.data(), values.size(),
+                             uint8_probabilities.data());
+  ValuesToLogOddsIntegers(values.data(), values.size(),
+                          log_odds_integers.data());
+  for (const uint16 value : values) {
+    const float probability = ValueToProbability(value);
+    EXPECT_EQ(probability, probabilities[value]);
+    EXPECT_EQ(common::RoundToInt((probability - kMinProbability) *
+                                 (255.f / (kMaxProbability - kMinProbability))),
+              uint8_probabilities[value]);
+    EXPECT_EQ(ProbabilityToLogOddsInteger(probability),
+              log_odds_integers[value]);
+  }
+  EXPECT_EQ(0, uint8_probabilities[kUnknownProbabilityValue]);
+  EXPECT_EQ(255, uint8_probabilities[32767]);
+  EXPECT_EQ(1, log_odds_integers[1]);
+  EXPECT_EQ(255, log_odds_integers[32767]);
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_RUNTIME_OPTIONS_H_
+#define CARTOGRAPHER_MAPPING_RUNTIME_OPTIONS_H_
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/mapping/proto/runtime_options.pb.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Hands updates of runtime options from any thread to the thread using the
+// options, which picks them up when it is ready for them.
+template <typename RuntimeOptions>
+class PendingRuntimeOptions {
+ public:
+  // Adds the fields set in 'runtime_options' to the pending update, replacing
+  // earlier values of the same fields. Thread-safe.
+  void Add(const RuntimeOptions& runtime_options) EXCLUDES(mutex_) {
+    common::MutexLocker locker(&mutex_);
+    pending_.MergeFrom(runtime_options);
+    has_pending_ = true;
+  }
+
+  // Returns false if nothing was added since the previous call. Otherwise
+  // moves the pending update into 'runtime_options' and returns true.
+  bool Take(RuntimeOptions* const runtime_options) EXCLUDES(mutex_) {
+    common::MutexLocker locker(&mutex_);
+    if (!has_pending_) {
+      return false;
+    }
+    runtime_options->Clear();
+    runtime_options->Swap(&pending_);
+    has_pending_ = false;
+    return true;
+  }
+
+ private:
+  common::Mutex mutex_;
+  RuntimeOptions pending_ GUARDED_BY(mutex_);
+  bool has_pending_ GUARDED_BY(mutex_) = false;
+};
+
+// Replaces the fields of the 2D or 3D 'local_trajectory_builder_options' which
+// are set in 'runtime_options'.
+template <typename LocalTrajectoryBuilderOptions>
+void ApplyRuntimeOptions(
+    const proto::TrajectoryBuilderRuntimeOptions& runtime_options,
+    LocalTrajectoryBuilderOptions* const local_trajectory_builder_options) {
+  if (runtime_options.has_voxel_filter_size()) {
+    CHECK_GT(runtime_options.voxel_filter_size(), 0.f);
+    local_trajectory_builder_options->set_voxel_filter_size(
+        runtime_options.voxel_filter_size());
+  }
+  auto* const real_time_correlative_scan_matcher_options =
+      local_trajectory_builder_options
+          ->mutable_real_time_correlative_scan_matcher_options();
+  if (runtime_options.has_real_time_linear_search_window()) {
+    CHECK_GE(runtime_options.real_time_linear_search_window(), 0.);
+    real_time_correlative_scan_matcher_options->set_linear_search_window(
+        runtime_options.real_time_linear_search_window());
+  }
+  if (runtime_options.has_real_time_angular_search_window()) {
+    CHECK_GE(runtime_options.real_time_angular_search_window(), 0.);
+    real_time_correlative_scan_matcher_options->set_angular_search_window(
+        runtime_options.real_time_angular_search_window());
+  }
+}
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_RUNTIME_OPTIONS_H_
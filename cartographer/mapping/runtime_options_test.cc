@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/runtime_options.h"
+
+#include "cartographer/mapping_2d/proto/local_trajectory_builder_options.pb.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+TEST(RuntimeOptionsTest, PendingUpdatesAreMerged) {
+  PendingRuntimeOptions<proto::TrajectoryBuilderRuntimeOptions> pending;
+  proto::TrajectoryBuilderRuntimeOptions runtime_options;
+  EXPECT_FALSE(pending.Take(&runtime_options));
+
+  proto::TrajectoryBuilderRuntimeOptions update;
+  update.set_voxel_filter_size(0.1f);
+  update.set_real_time_linear_search_window(0.2);
+  pending.Add(update);
+  update.Clear();
+  update.set_voxel_filter_size(0.05f);
+  pending.Add(update);
+
+  ASSERT_TRUE(pending.Take(&runtime_options));
+  EXPECT_FLOAT_EQ(0.05f, runtime_options.voxel_filter_size());
+  EXPECT_DOUBLE_EQ(0.2, runtime_options.real_time_linear_search_window());
+  EXPECT_FALSE(runtime_options.has_real_time_angular_search_window());
+  EXPECT_FALSE(pending.Take(&runtime_options));
+}
+
+TEST(RuntimeOptionsTest, OnlySetFieldsAreApplied) {
+  mapping_2d::proto::LocalTrajectoryBuilderOptions options;
+  options.set_voxel_filter_size(0.025f);
+  options.mutable_real_time_correlative_scan_matcher_options()
+      ->set_linear_search_window(0.1);
+  options.mutable_real_time_correlative_scan_matcher_options()
+      ->set_angular_search_window(0.3);
+
+  proto::TrajectoryBuilderRuntimeOptions runtime_options;
+  runtime_options.set_real_time_angular_search_window(0.1);
+  ApplyRuntimeOptions(runtime_options, &options);
+  EXPECT_FLOAT_EQ(0.025f, options.voxel_filter_size());
+  EXPECT_DOUBLE_EQ(0.1, options.real_time_correlative_scan_matcher_options()
+                            .linear_search_window());
+  EXPECT_DOUBLE_EQ(0.1, options.real_time_correlative_scan_matcher_options()
+                            .angular_search_window());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,864 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Matches scans of randomly generated rooms, corridors and cluttered rooms
+// with the 2D and 3D fast correlative, real time correlative and Ceres scan
+// matchers. For each scan matcher, latency percentiles and the quality of the
+// matches are reported and compared against a baseline file, so that changes
+// to the scan matchers can be checked for both speed and correctness.
+//
+// The environments only depend on --seed, so runs with the same flags match
+// the same scans. Latencies depend on the machine, while the match quality
+// should not, so baselines may contain only some of the metrics. Metrics
+// missing from the baseline are reported, but not compared.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/range_data_inserter.h"
+#include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
+#include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/mapping_2d/scan_matching/real_time_correlative_scan_matcher.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/range_data_inserter.h"
+#include "cartographer/mapping_3d/scan_matching/ceres_scan_matcher.h"
+#include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/mapping_3d/scan_matching/real_time_correlative_scan_matcher.h"
+#include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/sensor/range_data.h"
+#include "cartographer/sensor/voxel_filter.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(seed, 42, "Seed of the random environments, poses and noise.");
+DEFINE_int32(num_environments, 6,
+             "Number of environments, cycling through rooms, corridors and "
+             "cluttered rooms.");
+DEFINE_int32(num_scans, 20,
+             "Number of range data inserted into the map of an environment.");
+DEFINE_int32(num_matches, 10, "Number of scans matched per environment.");
+DEFINE_string(matchers, "",
+              "Comma separated names of the scan matchers to run. All scan "
+              "matchers are run if empty.");
+DEFINE_double(max_translation_error, 0.1,
+              "Maximum translation error in meters of a successful match.");
+DEFINE_double(max_rotation_error, 0.05,
+              "Maximum rotation error in radians of a successful match.");
+DEFINE_string(baseline_filename, "",
+              "If non-empty, the results are compared against this baseline.");
+DEFINE_string(output_baseline_filename, "",
+              "If non-empty, the results are written to this file to be used "
+              "as a baseline.");
+DEFINE_double(max_latency_increase, 0.2,
+              "Relative increase of a latency percentile over the baseline "
+              "which is reported as a regression.");
+DEFINE_double(max_error_increase, 0.25,
+              "Relative increase of a mean error over the baseline which is "
+              "reported as a regression.");
+DEFINE_double(max_success_rate_decrease, 0.05,
+              "Absolute decrease of the success rate below the baseline which "
+              "is reported as a regression.");
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr float kMaxRange = 30.f;
+constexpr float kCeilingHeight = 3.f;
+constexpr float kSensorHeight = 1.5f;
+constexpr int kNumBeams = 720;
+constexpr int kNumRings = 16;
+constexpr float kMaxRingAngle = 15.f / 180.f * M_PI;
+constexpr int kRotationalHistogramSize = 120;
+
+struct Wall {
+  Eigen::Vector2f start;
+  Eigen::Vector2f end;
+};
+
+struct Pillar {
+  Eigen::Vector2f center;
+  float radius;
+};
+
+// Vertical walls and pillars between the floor at z = 0 and the ceiling at
+// 'kCeilingHeight'. Poses are only sampled in the free space between
+// 'min_corner' and 'max_corner', at least 'kMinClearance' from pillars.
+struct Environment {
+  string type;
+  std::vector<Wall> walls;
+  std::vector<Pillar> pillars;
+  Eigen::Vector2f min_corner;
+  Eigen::Vector2f max_corner;
+};
+
+constexpr float kMinClearance = 0.5f;
+
+void AddBox(const Eigen::Vector2f& min_corner, const Eigen::Vector2f& max_corner,
+            std::vector<Wall>* walls) {
+  const Eigen::Vector2f corners[] = {
+      min_corner, Eigen::Vector2f(max_corner.x(), min_corner.y()), max_corner,
+      Eigen::Vector2f(min_corner.x(), max_corner.y())};
+  for (int i = 0; i != 4; ++i) {
+    walls->push_back(Wall{corners[i], corners[(i + 1) % 4]});
+  }
+}
+
+// A rectangular room with a partition wall sticking out of one side, so that
+// the room is not symmetric.
+Environment GenerateRoom(std::mt19937* rng) {
+  std::uniform_real_distribution<float> size_distribution(6.f, 16.f);
+  const float half_width = 0.5f * size_distribution(*rng);
+  const float half_depth = 0.5f * size_distribution(*rng);
+  Environment environment;
+  environment.type = "room";
+  AddBox(Eigen::Vector2f(-half_width, -half_depth),
+         Eigen::Vector2f(half_width, half_depth), &environment.walls);
+  std::uniform_real_distribution<float> x_distribution(-0.5f * half_width,
+                                                       0.5f * half_width);
+  const float partition_x = x_distribution(*rng);
+  environment.walls.push_back(
+      Wall{Eigen::Vector2f(partition_x, half_depth),
+           Eigen::Vector2f(partition_x, half_depth * 0.4f)});
+  environment.pillars.push_back(
+      Pillar{Eigen::Vector2f(partition_x, half_depth * 0.4f), 0.1f});
+  environment.min_corner =
+      Eigen::Vector2f(-half_width + 1.f, -half_depth + 1.f);
+  environment.max_corner =
+      Eigen::Vector2f(half_width - 1.f, half_depth * 0.4f - 1.f);
+  return environment;
+}
+
+// A long corridor along x with door recesses at random intervals on both
+// sides, which are the only features constraining the position along x.
+Environment GenerateCorridor(std::mt19937* rng) {
+  std::uniform_real_distribution<float> length_distribution(20.f, 36.f);
+  std::uniform_real_distribution<float> width_distribution(2.f, 3.5f);
+  std::uniform_real_distribution<float> spacing_distribution(2.f, 6.f);
+  const float half_length = 0.5f * length_distribution(*rng);
+  const float half_width = 0.5f * width_distribution(*rng);
+  Environment environment;
+  environment.type = "corridor";
+  for (const float side : {-1.f, 1.f}) {
+    const float y = side * half_width;
+    const float recess_y = side * (half_width + 0.3f);
+    float x = -half_length;
+    for (;;) {
+      const float recess_start = x + spacing_distribution(*rng);
+      const float recess_end = recess_start + 1.f;
+      if (recess_end > half_length) {
+        break;
+      }
+      environment.walls.push_back(
+          Wall{Eigen::Vector2f(x, y), Eigen::Vector2f(recess_start, y)});
+      environment.walls.push_back(Wall{Eigen::Vector2f(recess_start, y),
+                                       Eigen::Vector2f(recess_start, recess_y)});
+      environment.walls.push_back(Wall{Eigen::Vector2f(recess_start, recess_y),
+                                       Eigen::Vector2f(recess_end, recess_y)});
+      environment.walls.push_back(Wall{Eigen::Vector2f(recess_end, recess_y),
+                                       Eigen::Vector2f(recess_end, y)});
+      x = recess_end;
+    }
+    environment.walls.push_back(
+        Wall{Eigen::Vector2f(x, y), Eigen::Vector2f(half_length, y)});
+  }
+  environment.walls.push_back(Wall{Eigen::Vector2f(-half_length, -half_width),
+                                   Eigen::Vector2f(-half_length, half_width)});
+  environment.walls.push_back(Wall{Eigen::Vector2f(half_length, -half_width),
+                                   Eigen::Vector2f(half_length, half_width)});
+  environment.min_corner =
+      Eigen::Vector2f(-half_length + 1.f, -half_width + kMinClearance);
+  environment.max_corner =
+      Eigen::Vector2f(half_length - 1.f, half_width - kMinClearance);
+  return environment;
+}
+
+// A room with randomly placed pillars and boxes.
+Environment GenerateClutter(std::mt19937* rng) {
+  Environment environment = GenerateRoom(rng);
+  environment.type = "clutter";
+  std::uniform_real_distribution<float> x_distribution(
+      environment.min_corner.x(), environment.max_corner.x());
+  std::uniform_real_distribution<float> y_distribution(
+      environment.min_corner.y(), environment.max_corner.y());
+  std::uniform_real_distribution<float> radius_distribution(0.05f, 0.4f);
+  std::uniform_int_distribution<int> count_distribution(4, 12);
+  for (int i = count_distribution(*rng); i != 0; --i) {
+    environment.pillars.push_back(
+        Pillar{Eigen::Vector2f(x_distribution(*rng), y_distribution(*rng)),
+               radius_distribution(*rng)});
+  }
+  for (int i = count_distribution(*rng) / 2; i != 0; --i) {
+    const Eigen::Vector2f center(x_distribution(*rng), y_distribution(*rng));
+    const Eigen::Vector2f half_size(radius_distribution(*rng) + 0.1f,
+                                    radius_distribution(*rng) + 0.1f);
+    AddBox(center - half_size, center + half_size, &environment.walls);
+    // Poses are kept out of the boxes by the clearance around this pillar.
+    environment.pillars.push_back(Pillar{center, half_size.norm()});
+  }
+  return environment;
+}
+
+// Returns the distance along 'direction' at which a ray from 'origin' hits
+// the 'environment', in multiples of the length of 'direction', or infinity.
+float CastRay(const Environment& environment, const Eigen::Vector3f& origin,
+              const Eigen::Vector3f& direction) {
+  float result = std::numeric_limits<float>::infinity();
+  if (direction.z() < 0.f) {
+    result = -origin.z() / direction.z();
+  } else if (direction.z() > 0.f) {
+    result = (kCeilingHeight - origin.z()) / direction.z();
+  }
+  const Eigen::Vector2f origin_2d = origin.head<2>();
+  const Eigen::Vector2f direction_2d = direction.head<2>();
+  for (const Wall& wall : environment.walls) {
+    // Solves origin + t * direction = start + s * (end - start).
+    const Eigen::Vector2f along_wall = wall.end - wall.start;
+    const float denominator = direction_2d.x() * along_wall.y() -
+                              direction_2d.y() * along_wall.x();
+    if (std::abs(denominator) < 1e-9f) {
+      continue;
+    }
+    const Eigen::Vector2f to_start = wall.start - origin_2d;
+    const float t = (to_start.x() * along_wall.y() -
+                     to_start.y() * along_wall.x()) /
+                    denominator;
+    const float s = (to_start.x() * direction_2d.y() -
+                     to_start.y() * direction_2d.x()) /
+                    denominator;
+    if (t > 0.f && s >= 0.f && s <= 1.f) {
+      result = std::min(result, t);
+    }
+  }
+  const float a = direction_2d.squaredNorm();
+  if (a > 0.f) {
+    for (const Pillar& pillar : environment.pillars) {
+      const Eigen::Vector2f to_origin = origin_2d - pillar.center;
+      const float b = to_origin.dot(direction_2d);
+      const float c = to_origin.squaredNorm() - pillar.radius * pillar.radius;
+      const float discriminant = b * b - a * c;
+      if (c > 0.f && b < 0.f && discriminant > 0.f) {
+        result = std::min(result, (-b - std::sqrt(discriminant)) / a);
+      }
+    }
+  }
+  return result;
+}
+
+// Returns the points a sensor at 'pose' sees in the frame of the sensor. In
+// 2D, a single horizontal ring of beams is cast, in 3D 'kNumRings'.
+sensor::PointCloud GenerateScan(const Environment& environment,
+                                const transform::Rigid3f& pose,
+                                const bool is_3d, std::mt19937* rng) {
+  std::normal_distribution<float> noise_distribution(0.f, 0.01f);
+  sensor::PointCloud point_cloud;
+  const int num_rings = is_3d ? kNumRings : 1;
+  for (int ring = 0; ring != num_rings; ++ring) {
+    const float elevation =
+        is_3d ? kMaxRingAngle * (2.f * ring / (num_rings - 1) - 1.f) : 0.f;
+    for (int i = 0; i != kNumBeams; ++i) {
+      const float angle = 2.f * M_PI * i / kNumBeams;
+      const Eigen::Vector3f direction(std::cos(elevation) * std::cos(angle),
+                                      std::cos(elevation) * std::sin(angle),
+                                      std::sin(elevation));
+      const float range =
+          CastRay(environment, pose.translation(), pose.rotation() * direction);
+      if (range < kMaxRange) {
+        point_cloud.push_back((range + noise_distribution(*rng)) * direction);
+      }
+    }
+  }
+  return point_cloud;
+}
+
+transform::Rigid3f GenerateRandomPose(const Environment& environment,
+                                      std::mt19937* rng) {
+  std::uniform_real_distribution<float> x_distribution(
+      environment.min_corner.x(), environment.max_corner.x());
+  std::uniform_real_distribution<float> y_distribution(
+      environment.min_corner.y(), environment.max_corner.y());
+  std::uniform_real_distribution<float> angle_distribution(-M_PI, M_PI);
+  for (;;) {
+    const Eigen::Vector2f position(x_distribution(*rng), y_distribution(*rng));
+    if (std::all_of(environment.pillars.begin(), environment.pillars.end(),
+                    [&position](const Pillar& pillar) {
+                      return (position - pillar.center).norm() >
+                             pillar.radius + kMinClearance;
+                    })) {
+      return transform::Rigid3f(
+          Eigen::Vector3f(position.x(), position.y(), kSensorHeight),
+          transform::AngleAxisVectorToRotationQuaternion(
+              Eigen::Vector3f(0.f, 0.f, angle_distribution(*rng))));
+    }
+  }
+}
+
+// The maps of an environment built from range data at random poses.
+struct Maps {
+  std::unique_ptr<mapping_2d::ProbabilityGrid> probability_grid;
+  std::unique_ptr<mapping_3d::HybridGrid> high_resolution_hybrid_grid;
+  std::unique_ptr<mapping_3d::HybridGrid> low_resolution_hybrid_grid;
+  std::vector<TrajectoryNode> nodes;
+};
+
+// A scan to match and the pose at which it was taken.
+struct Query {
+  transform::Rigid3d pose;
+  sensor::PointCloud point_cloud_2d;
+  TrajectoryNode::Data data_3d;
+};
+
+TrajectoryNode::Data CreateNodeData(const sensor::PointCloud& point_cloud) {
+  TrajectoryNode::Data data;
+  data.time = common::FromUniversal(0);
+  data.gravity_alignment = Eigen::Quaterniond::Identity();
+  data.high_resolution_point_cloud = sensor::VoxelFiltered(point_cloud, 0.15f);
+  data.low_resolution_point_cloud = sensor::VoxelFiltered(point_cloud, 0.5f);
+  data.rotational_scan_matcher_histogram =
+      mapping_3d::scan_matching::RotationalScanMatcher::ComputeHistogram(
+          data.high_resolution_point_cloud, kRotationalHistogramSize);
+  return data;
+}
+
+Maps BuildMaps(const Environment& environment, std::mt19937* rng) {
+  Maps maps;
+  constexpr double kResolution = 0.05;
+  const Eigen::Vector2d max =
+      environment.max_corner.cast<double>() + Eigen::Vector2d(3., 3.);
+  const Eigen::Vector2d extent =
+      max - environment.min_corner.cast<double>() + Eigen::Vector2d(3., 3.);
+  maps.probability_grid = common::make_unique<mapping_2d::ProbabilityGrid>(
+      mapping_2d::MapLimits(
+          kResolution, max,
+          mapping_2d::CellLimits(std::ceil(extent.y() / kResolution),
+                                 std::ceil(extent.x() / kResolution))));
+  maps.high_resolution_hybrid_grid =
+      common::make_unique<mapping_3d::HybridGrid>(0.1f);
+  maps.low_resolution_hybrid_grid =
+      common::make_unique<mapping_3d::HybridGrid>(0.45f);
+
+  mapping_2d::proto::RangeDataInserterOptions range_data_inserter_options_2d;
+  range_data_inserter_options_2d.set_hit_probability(0.55);
+  range_data_inserter_options_2d.set_miss_probability(0.49);
+  range_data_inserter_options_2d.set_insert_free_space(true);
+  const mapping_2d::RangeDataInserter range_data_inserter_2d(
+      range_data_inserter_options_2d);
+  mapping_3d::proto::RangeDataInserterOptions range_data_inserter_options_3d;
+  range_data_inserter_options_3d.set_hit_probability(0.55);
+  range_data_inserter_options_3d.set_miss_probability(0.49);
+  range_data_inserter_options_3d.set_num_free_space_voxels(2);
+  range_data_inserter_options_3d.set_num_threads(1);
+  const mapping_3d::RangeDataInserter range_data_inserter_3d(
+      range_data_inserter_options_3d);
+
+  for (int i = 0; i != FLAGS_num_scans; ++i) {
+    const transform::Rigid3f pose = GenerateRandomPose(environment, rng);
+    range_data_inserter_2d.Insert(
+        sensor::RangeData{
+            pose.translation(),
+            sensor::TransformPointCloud(
+                GenerateScan(environment, pose, false /* is_3d */, rng), pose),
+            {}},
+        maps.probability_grid.get());
+    maps.probability_grid->FinishUpdate();
+
+    const sensor::PointCloud point_cloud_3d =
+        GenerateScan(environment, pose, true /* is_3d */, rng);
+    const sensor::RangeData range_data_3d{
+        pose.translation(), sensor::TransformPointCloud(point_cloud_3d, pose),
+        {}};
+    range_data_inserter_3d.Insert(range_data_3d,
+                                  maps.high_resolution_hybrid_grid.get());
+    range_data_inserter_3d.Insert(range_data_3d,
+                                  maps.low_resolution_hybrid_grid.get());
+    maps.high_resolution_hybrid_grid->FinishUpdate();
+    maps.low_resolution_hybrid_grid->FinishUpdate();
+    maps.nodes.push_back(TrajectoryNode{
+        std::make_shared<const TrajectoryNode::Data>(
+            CreateNodeData(point_cloud_3d)),
+        pose.cast<double>()});
+  }
+  return maps;
+}
+
+// Matches the 'query' starting from 'initial_pose_estimate'. Returns false if
+// the scan matcher did not find a match.
+using MatchFunction =
+    std::function<bool(const Query& query,
+                       const transform::Rigid3d& initial_pose_estimate,
+                       transform::Rigid3d* pose_estimate)>;
+
+struct ScanMatcher {
+  string name;
+  // Maximum error of the initial pose estimate along each axis and in yaw,
+  // which the scan matcher is expected to correct.
+  double max_initial_translation_error;
+  double max_initial_rotation_error;
+  // Only called once per environment, so that setting up the scan matcher is
+  // not part of the measured latencies.
+  std::function<MatchFunction(const Maps& maps)> create;
+};
+
+common::proto::CeresSolverOptions CreateCeresSolverOptions() {
+  common::proto::CeresSolverOptions options;
+  options.set_use_nonmonotonic_steps(false);
+  options.set_max_num_iterations(20);
+  options.set_num_threads(1);
+  return options;
+}
+
+mapping_2d::scan_matching::proto::RealTimeCorrelativeScanMatcherOptions
+CreateRealTimeCorrelativeScanMatcherOptions(
+    const double linear_search_window, const double angular_search_window) {
+  mapping_2d::scan_matching::proto::RealTimeCorrelativeScanMatcherOptions
+      options;
+  options.set_linear_search_window(linear_search_window);
+  options.set_angular_search_window(angular_search_window);
+  options.set_translation_delta_cost_weight(1e-1);
+  options.set_rotation_delta_cost_weight(1e-1);
+  return options;
+}
+
+std::vector<ScanMatcher> CreateScanMatchers() {
+  std::vector<ScanMatcher> scan_matchers;
+  scan_matchers.push_back(ScanMatcher{
+      "2d_fast_correlative", 0.5, 0.2, [](const Maps& maps) -> MatchFunction {
+        mapping_2d::scan_matching::proto::FastCorrelativeScanMatcherOptions
+            options;
+        options.set_linear_search_window(1.);
+        options.set_angular_search_window(0.3);
+        options.set_branch_and_bound_depth(7);
+        const auto scan_matcher = std::make_shared<
+            const mapping_2d::scan_matching::FastCorrelativeScanMatcher>(
+            *maps.probability_grid, options);
+        return [scan_matcher](const Query& query,
+                              const transform::Rigid3d& initial_pose_estimate,
+                              transform::Rigid3d* pose_estimate) {
+          float score;
+          transform::Rigid2d pose_estimate_2d;
+          if (!scan_matcher->Match(transform::Project2D(initial_pose_estimate),
+                                   query.point_cloud_2d, 0.5f /* min_score */,
+                                   &score, &pose_estimate_2d)) {
+            return false;
+          }
+          *pose_estimate = transform::Embed3D(pose_estimate_2d) *
+                           transform::Rigid3d::Translation(Eigen::Vector3d(
+                               0., 0., initial_pose_estimate.translation().z()));
+          return true;
+        };
+      }});
+  scan_matchers.push_back(ScanMatcher{
+      "2d_real_time_correlative", 0.1, 0.1,
+      [](const Maps& maps) -> MatchFunction {
+        const auto scan_matcher = std::make_shared<
+            const mapping_2d::scan_matching::RealTimeCorrelativeScanMatcher>(
+            CreateRealTimeCorrelativeScanMatcherOptions(0.15, 0.15));
+        const mapping_2d::ProbabilityGrid* const probability_grid =
+            maps.probability_grid.get();
+        return [scan_matcher, probability_grid](
+                   const Query& query,
+                   const transform::Rigid3d& initial_pose_estimate,
+                   transform::Rigid3d* pose_estimate) {
+          transform::Rigid2d pose_estimate_2d;
+          scan_matcher->Match(transform::Project2D(initial_pose_estimate),
+                              query.point_cloud_2d, *probability_grid,
+                              &pose_estimate_2d);
+          *pose_estimate = transform::Embed3D(pose_estimate_2d) *
+                           transform::Rigid3d::Translation(Eigen::Vector3d(
+                               0., 0., initial_pose_estimate.translation().z()));
+          return true;
+        };
+      }});
+  scan_matchers.push_back(ScanMatcher{
+      "2d_ceres", 0.05, 0.02, [](const Maps& maps) -> MatchFunction {
+        mapping_2d::scan_matching::proto::CeresScanMatcherOptions options;
+        options.set_occupied_space_weight(1.);
+        options.set_translation_weight(10.);
+        options.set_rotation_weight(40.);
+        *options.mutable_ceres_solver_options() = CreateCeresSolverOptions();
+        const auto scan_matcher = std::make_shared<
+            const mapping_2d::scan_matching::CeresScanMatcher>(options);
+        const mapping_2d::ProbabilityGrid* const probability_grid =
+            maps.probability_grid.get();
+        return [scan_matcher, probability_grid](
+                   const Query& query,
+                   const transform::Rigid3d& initial_pose_estimate,
+                   transform::Rigid3d* pose_estimate) {
+          const transform::Rigid2d initial_pose_estimate_2d =
+              transform::Project2D(initial_pose_estimate);
+          transform::Rigid2d pose_estimate_2d;
+          ceres::Solver::Summary summary;
+          scan_matcher->Match(initial_pose_estimate_2d,
+                              initial_pose_estimate_2d, query.point_cloud_2d,
+                              *probability_grid, &pose_estimate_2d, &summary);
+          *pose_estimate = transform::Embed3D(pose_estimate_2d) *
+                           transform::Rigid3d::Translation(Eigen::Vector3d(
+                               0., 0., initial_pose_estimate.translation().z()));
+          return true;
+        };
+      }});
+  scan_matchers.push_back(ScanMatcher{
+      "3d_fast_correlative", 0.5, 0.2, [](const Maps& maps) -> MatchFunction {
+        mapping_3d::scan_matching::proto::FastCorrelativeScanMatcherOptions
+            options;
+        options.set_branch_and_bound_depth(6);
+        options.set_full_resolution_depth(3);
+        options.set_min_rotational_score(0.5);
+        options.set_min_low_resolution_score(0.3);
+        options.set_linear_xy_search_window(1.);
+        options.set_linear_z_search_window(0.5);
+        options.set_angular_search_window(0.3);
+        const auto scan_matcher = std::make_shared<
+            const mapping_3d::scan_matching::FastCorrelativeScanMatcher>(
+            *maps.high_resolution_hybrid_grid,
+            maps.low_resolution_hybrid_grid.get(), maps.nodes, options);
+        return [scan_matcher](const Query& query,
+                              const transform::Rigid3d& initial_pose_estimate,
+                              transform::Rigid3d* pose_estimate) {
+          float score;
+          float rotational_score;
+          float low_resolution_score;
+          return scan_matcher->Match(
+              initial_pose_estimate, query.data_3d, 0.5f /* min_score */,
+              &score, pose_estimate, &rotational_score, &low_resolution_score,
+              nullptr /* rejecting_stage */);
+        };
+      }});
+  scan_matchers.push_back(ScanMatcher{
+      "3d_real_time_correlative", 0.1, 0.005,
+      [](const Maps& maps) -> MatchFunction {
+        const auto scan_matcher = std::make_shared<
+            const mapping_3d::scan_matching::RealTimeCorrelativeScanMatcher>(
+            CreateRealTimeCorrelativeScanMatcherOptions(0.15, 0.01));
+        const mapping_3d::HybridGrid* const hybrid_grid =
+            maps.high_resolution_hybrid_grid.get();
+        return [scan_matcher, hybrid_grid](
+                   const Query& query,
+                   const transform::Rigid3d& initial_pose_estimate,
+                   transform::Rigid3d* pose_estimate) {
+          scan_matcher->Match(initial_pose_estimate,
+                              query.data_3d.high_resolution_point_cloud,
+                              *hybrid_grid, pose_estimate);
+          return true;
+        };
+      }});
+  scan_matchers.push_back(ScanMatcher{
+      "3d_ceres", 0.05, 0.02, [](const Maps& maps) -> MatchFunction {
+        mapping_3d::scan_matching::proto::CeresScanMatcherOptions options;
+        options.add_occupied_space_weight(1.);
+        options.add_occupied_space_weight(6.);
+        options.set_translation_weight(5.);
+        options.set_rotation_weight(4e2);
+        options.set_only_optimize_yaw(false);
+        *options.mutable_ceres_solver_options() = CreateCeresSolverOptions();
+        // Match() is not const, since the scan matcher keeps state between
+        // matches.
+        const auto scan_matcher =
+            std::make_shared<mapping_3d::scan_matching::CeresScanMatcher>(
+                options);
+        const mapping_3d::HybridGrid* const high_resolution_hybrid_grid =
+            maps.high_resolution_hybrid_grid.get();
+        const mapping_3d::HybridGrid* const low_resolution_hybrid_grid =
+            maps.low_resolution_hybrid_grid.get();
+        return [scan_matcher, high_resolution_hybrid_grid,
+                low_resolution_hybrid_grid](
+                   const Query& query,
+                   const transform::Rigid3d& initial_pose_estimate,
+                   transform::Rigid3d* pose_estimate) {
+          ceres::Solver::Summary summary;
+          scan_matcher->Match(
+              initial_pose_estimate, initial_pose_estimate,
+              {{&query.data_3d.high_resolution_point_cloud,
+                high_resolution_hybrid_grid},
+               {&query.data_3d.low_resolution_point_cloud,
+                low_resolution_hybrid_grid}},
+              pose_estimate, &summary);
+          return true;
+        };
+      }});
+  return scan_matchers;
+}
+
+struct Results {
+  std::vector<double> latencies_ms;
+  int num_successes = 0;
+  double sum_translation_errors = 0.;
+  double sum_rotation_errors = 0.;
+};
+
+// Returns the nearest-rank 'percentile' of 'sorted_values'.
+double Percentile(const std::vector<double>& sorted_values,
+                  const double percentile) {
+  CHECK(!sorted_values.empty());
+  const int rank = std::ceil(percentile / 100. * sorted_values.size());
+  return sorted_values[std::max(rank, 1) - 1];
+}
+
+// Metrics by name, for each scan matcher by name.
+using Metrics = std::map<string, std::map<string, double>>;
+
+std::map<string, double> ComputeMetrics(const Results& results) {
+  std::vector<double> latencies_ms = results.latencies_ms;
+  std::sort(latencies_ms.begin(), latencies_ms.end());
+  std::map<string, double> metrics;
+  metrics["success_rate"] =
+      static_cast<double>(results.num_successes) / latencies_ms.size();
+  if (results.num_successes > 0) {
+    metrics["mean_translation_error"] =
+        results.sum_translation_errors / results.num_successes;
+    metrics["mean_rotation_error"] =
+        results.sum_rotation_errors / results.num_successes;
+  }
+  metrics["p50_latency_ms"] = Percentile(latencies_ms, 50.);
+  metrics["p90_latency_ms"] = Percentile(latencies_ms, 90.);
+  metrics["p99_latency_ms"] = Percentile(latencies_ms, 99.);
+  return metrics;
+}
+
+// Baselines have one metric per line, as in
+//
+//   2d_fast_correlative success_rate 1
+//
+// Empty lines and lines starting with '#' are ignored.
+Metrics ReadBaseline(const string& filename) {
+  std::ifstream stream(filename);
+  CHECK(stream) << "Could not open baseline " << filename;
+  Metrics baseline;
+  string line;
+  while (std::getline(stream, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream line_stream(line);
+    string scan_matcher;
+    string metric;
+    double value;
+    CHECK(line_stream >> scan_matcher >> metric >> value)
+        << "Invalid baseline line: " << line;
+    baseline[scan_matcher][metric] = value;
+  }
+  return baseline;
+}
+
+void WriteBaseline(const Metrics& metrics, const string& filename) {
+  std::ofstream stream(filename);
+  CHECK(stream) << "Could not open " << filename << " for writing.";
+  stream << "# Written by cartographer_scan_matching_regression with "
+         << "--seed=" << FLAGS_seed
+         << " --num_environments=" << FLAGS_num_environments
+         << " --num_scans=" << FLAGS_num_scans
+         << " --num_matches=" << FLAGS_num_matches << ".\n";
+  stream << std::setprecision(6);
+  for (const auto& scan_matcher_metrics : metrics) {
+    for (const auto& metric : scan_matcher_metrics.second) {
+      stream << scan_matcher_metrics.first << " " << metric.first << " "
+             << metric.second << "\n";
+    }
+  }
+  CHECK(stream) << "Could not write " << filename;
+}
+
+// Returns true if 'value' of 'metric' is a regression from 'baseline_value'.
+bool IsRegression(const string& metric, const double baseline_value,
+                  const double value) {
+  if (metric == "success_rate") {
+    return value < baseline_value - FLAGS_max_success_rate_decrease;
+  }
+  if (metric == "mean_translation_error" || metric == "mean_rotation_error") {
+    return value > baseline_value * (1. + FLAGS_max_error_increase);
+  }
+  CHECK(metric.find("_latency_ms") != string::npos)
+      << "Unknown metric " << metric;
+  return value > baseline_value * (1. + FLAGS_max_latency_increase);
+}
+
+// Returns the number of regressions of 'metrics' from the 'baseline'.
+int CompareAgainstBaseline(const Metrics& metrics, const Metrics& baseline) {
+  int num_regressions = 0;
+  for (const auto& scan_matcher_baseline : baseline) {
+    const auto scan_matcher_metrics = metrics.find(scan_matcher_baseline.first);
+    if (scan_matcher_metrics == metrics.end()) {
+      // The scan matcher was not selected with --matchers.
+      continue;
+    }
+    for (const auto& baseline_metric : scan_matcher_baseline.second) {
+      const auto metric =
+          scan_matcher_metrics->second.find(baseline_metric.first);
+      if (metric == scan_matcher_metrics->second.end()) {
+        LOG(ERROR) << scan_matcher_baseline.first << " "
+                   << baseline_metric.first
+                   << " is in the baseline, but was not measured.";
+        ++num_regressions;
+        continue;
+      }
+      if (IsRegression(metric->first, baseline_metric.second,
+                       metric->second)) {
+        LOG(ERROR) << scan_matcher_baseline.first << " " << metric->first
+                   << " regressed from " << baseline_metric.second << " to "
+                   << metric->second << ".";
+        ++num_regressions;
+      }
+    }
+  }
+  return num_regressions;
+}
+
+bool IsSelected(const string& name) {
+  if (FLAGS_matchers.empty()) {
+    return true;
+  }
+  std::istringstream stream(FLAGS_matchers);
+  string selected_name;
+  while (std::getline(stream, selected_name, ',')) {
+    if (selected_name == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int Run() {
+  std::vector<ScanMatcher> scan_matchers = CreateScanMatchers();
+  scan_matchers.erase(
+      std::remove_if(scan_matchers.begin(), scan_matchers.end(),
+                     [](const ScanMatcher& scan_matcher) {
+                       return !IsSelected(scan_matcher.name);
+                     }),
+      scan_matchers.end());
+  CHECK(!scan_matchers.empty()) << "No scan matcher matches --matchers.";
+
+  std::mt19937 rng(FLAGS_seed);
+  const std::function<Environment(std::mt19937*)> generators[] = {
+      GenerateRoom, GenerateCorridor, GenerateClutter};
+  std::map<string, Results> results;
+  for (int i = 0; i != FLAGS_num_environments; ++i) {
+    const Environment environment = generators[i % 3](&rng);
+    const Maps maps = BuildMaps(environment, &rng);
+    std::vector<Query> queries;
+    for (int j = 0; j != FLAGS_num_matches; ++j) {
+      const transform::Rigid3f pose = GenerateRandomPose(environment, &rng);
+      queries.push_back(Query{
+          pose.cast<double>(),
+          GenerateScan(environment, pose, false /* is_3d */, &rng),
+          CreateNodeData(
+              GenerateScan(environment, pose, true /* is_3d */, &rng))});
+    }
+    for (const ScanMatcher& scan_matcher : scan_matchers) {
+      // Each scan matcher sees the same initial pose estimates regardless of
+      // which other scan matchers are selected.
+      std::mt19937 error_rng(FLAGS_seed + i);
+      std::uniform_real_distribution<double> error_distribution(-1., 1.);
+      const MatchFunction match = scan_matcher.create(maps);
+      Results& scan_matcher_results = results[scan_matcher.name];
+      for (const Query& query : queries) {
+        const transform::Rigid3d initial_pose_estimate =
+            query.pose *
+            transform::Rigid3d(
+                scan_matcher.max_initial_translation_error *
+                    Eigen::Vector3d(error_distribution(error_rng),
+                                    error_distribution(error_rng), 0.),
+                transform::AngleAxisVectorToRotationQuaternion(Eigen::Vector3d(
+                    0., 0.,
+                    scan_matcher.max_initial_rotation_error *
+                        error_distribution(error_rng))));
+        transform::Rigid3d pose_estimate;
+        const auto start = std::chrono::steady_clock::now();
+        const bool found =
+            match(query, initial_pose_estimate, &pose_estimate);
+        scan_matcher_results.latencies_ms.push_back(
+            1e3 * std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count());
+        const double translation_error =
+            (pose_estimate.translation() - query.pose.translation()).norm();
+        const double rotation_error =
+            transform::GetAngle(pose_estimate.inverse() * query.pose);
+        if (found && translation_error <= FLAGS_max_translation_error &&
+            rotation_error <= FLAGS_max_rotation_error) {
+          ++scan_matcher_results.num_successes;
+          scan_matcher_results.sum_translation_errors += translation_error;
+          scan_matcher_results.sum_rotation_errors += rotation_error;
+        }
+      }
+    }
+    LOG(INFO) << "Matched " << queries.size() << " scans in a "
+              << environment.type << ".";
+  }
+
+  Metrics metrics;
+  for (const auto& entry : results) {
+    metrics[entry.first] = ComputeMetrics(entry.second);
+    std::ostringstream summary;
+    for (const auto& metric : metrics[entry.first]) {
+      summary << " " << metric.first << "=" << metric.second;
+    }
+    LOG(INFO) << entry.first << ":" << summary.str();
+  }
+  if (!FLAGS_output_baseline_filename.empty()) {
+    WriteBaseline(metrics, FLAGS_output_baseline_filename);
+  }
+  if (FLAGS_baseline_filename.empty()) {
+    return EXIT_SUCCESS;
+  }
+  const int num_regressions =
+      CompareAgainstBaseline(metrics, ReadBaseline(FLAGS_baseline_filename));
+  if (num_regressions != 0) {
+    LOG(ERROR) << num_regressions << " regressions from the baseline "
+               << FLAGS_baseline_filename << ".";
+    return EXIT_FAILURE;
+  }
+  LOG(INFO) << "No regressions from the baseline " << FLAGS_baseline_filename
+            << ".";
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Matches scans of random synthetic environments with the 2D and 3D scan "
+      "matchers, and compares latencies and match quality against a "
+      "baseline.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  return ::cartographer::mapping::Run();
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/session_journal.h"
+
+#include <utility>
+
+#include "cartographer/common/make_unique.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+SessionJournal::~SessionJournal() {
+  if (active()) {
+    Stop();
+  }
+}
+
+void SessionJournal::Start(std::unique_ptr<io::ProtoStreamWriter> writer,
+                           const int max_nodes_per_batch) {
+  CHECK_GT(max_nodes_per_batch, 0);
+  common::MutexLocker locker(&mutex_);
+  CHECK(writer_ == nullptr) << "The journal is already active.";
+  writer_ = std::move(writer);
+  max_nodes_per_batch_ = max_nodes_per_batch;
+  if (thread_ == nullptr) {
+    thread_ = common::make_unique<common::ThreadPool>(1);
+  }
+}
+
+bool SessionJournal::Stop() {
+  common::MutexLocker locker(&mutex_);
+  CHECK(writer_ != nullptr) << "The journal is not active.";
+  for (auto& entry : writers_2d_) {
+    ScheduleWrite(entry.second->TakeBatch());
+  }
+  for (auto& entry : writers_3d_) {
+    ScheduleWrite(entry.second->TakeBatch());
+  }
+  writers_2d_.clear();
+  writers_3d_.clear();
+  locker.Await(
+      [this]() REQUIRES(mutex_) { return num_pending_writes_ == 0; });
+  const bool success = writer_->Close();
+  writer_.reset();
+  return success;
+}
+
+bool SessionJournal::active() {
+  common::MutexLocker locker(&mutex_);
+  return writer_ != nullptr;
+}
+
+void SessionJournal::AddNode(
+    const int trajectory_id, const TrajectoryNode::Data& constant_data,
+    const std::vector<std::shared_ptr<const mapping_2d::Submap>>&
+        insertion_submaps) {
+  common::MutexLocker locker(&mutex_);
+  AddNode(trajectory_id, constant_data, insertion_submaps, &writers_2d_);
+}
+
+void SessionJournal::AddNode(
+    const int trajectory_id, const TrajectoryNode::Data& constant_data,
+    const std::vector<std::shared_ptr<const mapping_3d::Submap>>&
+        insertion_submaps) {
+  common::MutexLocker locker(&mutex_);
+  AddNode(trajectory_id, constant_data, insertion_submaps, &writers_3d_);
+}
+
+template <typename SubmapType>
+void SessionJournal::AddNode(
+    const int trajectory_id, const TrajectoryNode::Data& constant_data,
+    const std::vector<std::shared_ptr<const SubmapType>>& insertion_submaps,
+    Writers<SubmapType>* const writers) {
+  if (writer_ == nullptr) {
+    return;
+  }
+  auto& writer = (*writers)[trajectory_id];
+  if (writer == nullptr) {
+    writer = common::make_unique<LocalSlamUpdateWriter<SubmapType>>(
+        trajectory_id, max_nodes_per_batch_);
+  }
+  writer->AddNode(constant_data, insertion_submaps);
+  if (writer->IsBatchFull()) {
+    ScheduleWrite(writer->TakeBatch());
+  }
+}
+
+void SessionJournal::ScheduleWrite(proto::LocalSlamUpdateBatch batch) {
+  if (batch.node_size() == 0) {
+    return;
+  }
+  const auto shared_batch =
+      std::make_shared<const proto::LocalSlamUpdateBatch>(std::move(batch));
+  io::ProtoStreamWriter* const writer = writer_.get();
+  ++num_pending_writes_;
+  thread_->Schedule(
+      [this, shared_batch, writer]() {
+        writer->WriteProto(*shared_batch);
+        if (!writer->Flush()) {
+          LOG(ERROR) << "Writing the session journal failed.";
+        }
+        common::MutexLocker locker(&mutex_);
+        --num_pending_writes_;
+      },
+      common::WorkItemPriority::kNormal, "write_session_journal");
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SESSION_JOURNAL_H_
+#define CARTOGRAPHER_MAPPING_SESSION_JOURNAL_H_
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/io/proto_stream.h"
+#include "cartographer/mapping/local_slam_update.h"
+#include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/mapping_3d/submaps.h"
+
+namespace cartographer {
+namespace mapping {
+
+// An append-only journal of the local SLAM results of all trajectories, i.e.
+// their nodes and submaps, as a proto stream of LocalSlamUpdateBatches. After
+// a crash, MapBuilder::RecoverFromJournal() adds them to a new pose graph
+// without running local SLAM again. Each submap is written with its grids
+// only once, when it is finished.
+//
+// Batches are compressed and written on a background thread, and flushed
+// after each one, so that at most one batch per trajectory is lost.
+//
+// This class is thread-safe.
+class SessionJournal {
+ public:
+  SessionJournal() = default;
+  ~SessionJournal();
+
+  SessionJournal(const SessionJournal&) = delete;
+  SessionJournal& operator=(const SessionJournal&) = delete;
+
+  // Starts writing the nodes added from now on to 'writer', at most
+  // 'max_nodes_per_batch' per trajectory at a time. Must not be active.
+  void Start(std::unique_ptr<io::ProtoStreamWriter> writer,
+             int max_nodes_per_batch) EXCLUDES(mutex_);
+
+  // Writes the partial batches and closes the writer once everything has been
+  // written. Returns the result of Close(). Must be active.
+  bool Stop() EXCLUDES(mutex_);
+
+  bool active() EXCLUDES(mutex_);
+
+  // Adds a node which local SLAM inserted into 'insertion_submaps', unless the
+  // journal is not active. Called on the thread running local SLAM, which
+  // only builds the batch.
+  void AddNode(int trajectory_id, const TrajectoryNode::Data& constant_data,
+               const std::vector<std::shared_ptr<const mapping_2d::Submap>>&
+                   insertion_submaps) EXCLUDES(mutex_);
+  void AddNode(int trajectory_id, const TrajectoryNode::Data& constant_data,
+               const std::vector<std::shared_ptr<const mapping_3d::Submap>>&
+                   insertion_submaps) EXCLUDES(mutex_);
+
+ private:
+  template <typename SubmapType>
+  using Writers =
+      std::map<int, std::unique_ptr<LocalSlamUpdateWriter<SubmapType>>>;
+
+  template <typename SubmapType>
+  void AddNode(
+      int trajectory_id, const TrajectoryNode::Data& constant_data,
+      const std::vector<std::shared_ptr<const SubmapType>>& insertion_submaps,
+      Writers<SubmapType>* writers) REQUIRES(mutex_);
+
+  // Writes the 'batch' on the background thread.
+  void ScheduleWrite(proto::LocalSlamUpdateBatch batch) REQUIRES(mutex_);
+
+  common::Mutex mutex_;
+  std::unique_ptr<io::ProtoStreamWriter> writer_ GUARDED_BY(mutex_);
+  int max_nodes_per_batch_ GUARDED_BY(mutex_) = 0;
+  // Batches of each trajectory seen since Start().
+  Writers<mapping_2d::Submap> writers_2d_ GUARDED_BY(mutex_);
+  Writers<mapping_3d::Submap> writers_3d_ GUARDED_BY(mutex_);
+  int num_pending_writes_ GUARDED_BY(mutex_) = 0;
+  // Created by the first Start(). Declared last so that its thread is joined
+  // before anything it uses is destroyed.
+  std::unique_ptr<common::ThreadPool> thread_ GUARDED_BY(mutex_);
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SESSION_JOURNAL_H_
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/session_journal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/mapping/local_slam_update.h"
+#include "cartographer/transform/transform.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Records what the LocalSlamUpdateReader adds.
+class FakeSparsePoseGraph {
+ public:
+  void AddScan(
+      std::shared_ptr<const TrajectoryNode::Data> constant_data,
+      const int trajectory_id,
+      const std::vector<std::shared_ptr<const mapping_2d::Submap>>&
+          insertion_submaps) {
+    trajectory_ids.push_back(trajectory_id);
+    times.push_back(constant_data->time);
+  }
+
+  std::vector<int> trajectory_ids;
+  std::vector<common::Time> times;
+};
+
+mapping_2d::proto::SubmapsOptions CreateSubmapsOptions() {
+  mapping_2d::proto::SubmapsOptions options;
+  options.set_resolution(0.05);
+  options.set_num_range_data(3);
+  options.set_use_tiled_probability_grid(false);
+  options.set_use_background_insertion(false);
+  auto* const range_data_inserter_options =
+      options.mutable_range_data_inserter_options();
+  range_data_inserter_options->set_insert_free_space(true);
+  range_data_inserter_options->set_hit_probability(0.53);
+  range_data_inserter_options->set_miss_probability(0.495);
+  return options;
+}
+
+class SessionJournalTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const string tmpdir = P_tmpdir;
+    test_directory_ = tmpdir + "/session_journal_test_XXXXXX";
+    ASSERT_NE(mkdtemp(&test_directory_[0]), nullptr) << strerror(errno);
+  }
+
+  void TearDown() override { remove(test_directory_.c_str()); }
+
+  string test_directory_;
+};
+
+TEST_F(SessionJournalTest, ReplaysNodesOfAllTrajectories) {
+  const string journal_file = test_directory_ + "/journal.pbstream";
+  constexpr int kNumScans = 10;
+  SessionJournal journal;
+  mapping_2d::ActiveSubmaps active_submaps(CreateSubmapsOptions());
+  const auto add_node = [&](const int trajectory_id, const int i) {
+    std::vector<std::shared_ptr<const mapping_2d::Submap>> insertion_submaps;
+    for (const auto& submap : active_submaps.submaps()) {
+      insertion_submaps.push_back(submap);
+    }
+    active_submaps.InsertRangeData(
+        {Eigen::Vector3f::Zero(), {Eigen::Vector3f(1.f, 0.1f * i, 0.f)}, {}});
+    TrajectoryNode::Data constant_data;
+    constant_data.time = common::FromUniversal(1000 + 10 * i);
+    constant_data.gravity_alignment = Eigen::Quaterniond::Identity();
+    constant_data.initial_pose = transform::Rigid3d::Identity();
+    journal.AddNode(trajectory_id, constant_data, insertion_submaps);
+  };
+
+  // Nodes are ignored while the journal is not active.
+  add_node(0, 0);
+  EXPECT_FALSE(journal.active());
+  journal.Start(common::make_unique<io::ProtoStreamWriter>(journal_file),
+                3 /* max_nodes_per_batch */);
+  EXPECT_TRUE(journal.active());
+  for (int i = 0; i != kNumScans; ++i) {
+    add_node(7, i);
+  }
+  EXPECT_TRUE(journal.Stop());
+  EXPECT_FALSE(journal.active());
+
+  io::ProtoStreamReader reader(journal_file);
+  FakeSparsePoseGraph sparse_pose_graph;
+  LocalSlamUpdateReader<mapping_2d::Submap, FakeSparsePoseGraph> update_reader(
+      &sparse_pose_graph);
+  proto::LocalSlamUpdateBatch batch;
+  while (reader.ReadProto(&batch)) {
+    update_reader.AddBatch(batch);
+  }
+  EXPECT_TRUE(reader.eof());
+  ASSERT_EQ(kNumScans, sparse_pose_graph.times.size());
+  for (int i = 0; i != kNumScans; ++i) {
+    EXPECT_EQ(7, sparse_pose_graph.trajectory_ids[i]);
+    EXPECT_EQ(common::FromUniversal(1000 + 10 * i), sparse_pose_graph.times[i]);
+  }
+  remove(journal_file.c_str());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
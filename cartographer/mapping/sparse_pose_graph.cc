@@ -16,7 +16,9 @@
 
 #include "cartographer/mapping/sparse_pose_graph.h"
 
+#include "cartographer/mapping/pose_graph_trimmer.h"
 #include "cartographer/mapping/sparse_pose_graph/constraint_builder.h"
+#include "cartographer/mapping/sparse_pose_graph/load_shedding_controller.h"
 #include "cartographer/mapping/sparse_pose_graph/optimization_problem_options.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
@@ -60,17 +62,79 @@ proto::SparsePoseGraphOptions CreateSparsePoseGraphOptions(
   options.set_global_constraint_search_after_n_seconds(
       parameter_dictionary->GetDouble(
           "global_constraint_search_after_n_seconds"));
+  *options.mutable_load_shedding_options() =
+      sparse_pose_graph::CreateLoadSheddingOptions(
+          parameter_dictionary->GetDictionary("load_shedding").get());
+  options.set_final_constraint_search_time_limit_seconds(
+      parameter_dictionary->GetDouble(
+          "final_constraint_search_time_limit_seconds"));
+  options.set_compress_node_point_clouds(
+      parameter_dictionary->GetBool("compress_node_point_clouds"));
+  options.set_optimize_with_finished_constraints(
+      parameter_dictionary->GetBool("optimize_with_finished_constraints"));
+  options.set_max_num_constraints_per_submap_pair(
+      parameter_dictionary->GetNonNegativeInt(
+          "max_num_constraints_per_submap_pair"));
+  options.set_max_work_queue_size(
+      parameter_dictionary->GetNonNegativeInt("max_work_queue_size"));
+  options.set_place_recognition_num_candidates(
+      parameter_dictionary->GetNonNegativeInt(
+          "place_recognition_num_candidates"));
+  options.set_max_num_change_log_entries(
+      parameter_dictionary->GetNonNegativeInt("max_num_change_log_entries"));
+  options.set_interrupt_optimization_work_queue_size(
+      parameter_dictionary->GetNonNegativeInt(
+          "interrupt_optimization_work_queue_size"));
+  *options.mutable_overlapping_submaps_trimmer_options() =
+      CreateOverlappingSubmapsTrimmerOptions(
+          parameter_dictionary->GetDictionary("overlapping_submaps_trimmer")
+              .get());
+  options.set_deterministic(parameter_dictionary->GetBool("deterministic"));
+  options.set_cross_trajectory_search_area_size(
+      parameter_dictionary->GetDouble("cross_trajectory_search_area_size"));
+  options.set_max_cross_trajectory_searches_per_area(
+      parameter_dictionary->GetNonNegativeInt(
+          "max_cross_trajectory_searches_per_area"));
+  options.set_cost_attribution_num_top_submaps(
+      parameter_dictionary->GetNonNegativeInt(
+          "cost_attribution_num_top_submaps"));
   return options;
 }
 
+proto::SparsePoseGraphOptions ApplyDeterministicMode(
+    const proto::SparsePoseGraphOptions& options) {
+  proto::SparsePoseGraphOptions result = options;
+  if (!options.deterministic()) {
+    return result;
+  }
+  // Which constraints have finished, and how far the pose graph is behind,
+  // depends on the timing of the background threads.
+  result.set_optimize_with_finished_constraints(false);
+  result.set_interrupt_optimization_work_queue_size(0);
+  result.mutable_load_shedding_options()->set_max_backlog_scans(0);
+  result.mutable_load_shedding_options()->set_max_backlog_seconds(0.);
+  // Searches cut short by a time limit, or whose candidates are split among
+  // tasks, may find different matches of equal score.
+  result.set_final_constraint_search_time_limit_seconds(0.);
+  auto* const constraint_builder_options =
+      result.mutable_constraint_builder_options();
+  constraint_builder_options->set_global_localization_time_limit_seconds(0.);
+  constraint_builder_options->set_global_localization_num_tasks(1);
+  return result;
+}
+
 proto::SparsePoseGraph SparsePoseGraph::ToProto() {
+  return ToProto(GetState());
+}
+
+proto::SparsePoseGraph SparsePoseGraph::ToProto(const State& state) {
   proto::SparsePoseGraph proto;
 
   std::map<NodeId, NodeId> node_id_remapping;        // Due to trimming.
   std::map<SubmapId, SubmapId> submap_id_remapping;  // Due to trimming.
 
-  const auto all_trajectory_nodes = GetTrajectoryNodes();
-  const auto all_submap_data = GetAllSubmapData();
+  const auto& all_trajectory_nodes = state.trajectory_nodes;
+  const auto& all_submap_data = state.submap_data;
   for (size_t trajectory_id = 0; trajectory_id != all_trajectory_nodes.size();
        ++trajectory_id) {
     auto* trajectory_proto = proto.add_trajectory();
@@ -107,7 +171,7 @@ proto::SparsePoseGraph SparsePoseGraph::ToProto() {
     }
   }
 
-  for (const auto& constraint : constraints()) {
+  for (const auto& constraint : state.constraints) {
     auto* const constraint_proto = proto.add_constraint();
     *constraint_proto->mutable_relative_pose() =
         transform::ToProto(constraint.pose.zbar_ij);
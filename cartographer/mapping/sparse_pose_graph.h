@@ -17,15 +17,23 @@
 #ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_H_
 #define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_H_
 
+#include <functional>
+#include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/time.h"
+#include "cartographer/io/mapped_blob_file.h"
 #include "cartographer/mapping/id.h"
+#include "cartographer/mapping/memory_usage.h"
 #include "cartographer/mapping/pose_graph_trimmer.h"
+#include "cartographer/mapping/proto/runtime_options.pb.h"
 #include "cartographer/mapping/proto/serialization.pb.h"
 #include "cartographer/mapping/proto/sparse_pose_graph.pb.h"
 #include "cartographer/mapping/proto/sparse_pose_graph_options.pb.h"
@@ -39,6 +47,12 @@ namespace mapping {
 proto::SparsePoseGraphOptions CreateSparsePoseGraphOptions(
     common::LuaParameterDictionary* const parameter_dictionary);
 
+// Returns 'options' with the features turned off whose results depend on the
+// timing of the background threads if 'deterministic' is set, and 'options'
+// unchanged otherwise.
+proto::SparsePoseGraphOptions ApplyDeterministicMode(
+    const proto::SparsePoseGraphOptions& options);
+
 class SparsePoseGraph {
  public:
   // A "constraint" as in the paper by Konolige, Kurt, et al. "Efficient sparse
@@ -68,6 +82,55 @@ class SparsePoseGraph {
     transform::Rigid3d pose;
   };
 
+  // Immutable state of the pose graph, published after every optimization.
+  struct Snapshot {
+    // Incremented with every published snapshot.
+    int64 version;
+    std::vector<std::vector<TrajectoryNode>> trajectory_nodes;
+    std::vector<std::vector<SubmapData>> submap_data;
+    // Indexed by trajectory ID, see GetLocalToGlobalTransform().
+    std::vector<transform::Rigid3d> local_to_global_transforms;
+  };
+
+  // The nodes, submaps and constraints of the pose graph at one point in
+  // time, see GetState().
+  struct State {
+    std::vector<std::vector<TrajectoryNode>> trajectory_nodes;
+    std::vector<std::vector<SubmapData>> submap_data;
+    std::vector<Constraint> constraints;
+  };
+
+  // Changes of the pose graph since a version, see GetChangesSince().
+  struct Changes {
+    // Version of the pose graph these changes lead to, to be passed to the
+    // next call of GetChangesSince().
+    int64 version;
+    // If true, the changes since the requested version were not available.
+    // Then 'nodes' and 'added_constraints' hold the full state, which replaces
+    // the state of the client.
+    bool full_state;
+    // The nodes which were added or trimmed, or whose pose changed, with their
+    // current state.
+    std::vector<std::pair<NodeId, TrajectoryNode>> nodes;
+    std::vector<Constraint> added_constraints;
+    // Identified by their submap ID, node ID and tag.
+    std::vector<Constraint> removed_constraints;
+  };
+
+  // Progress of waiting for the pending constraint computations, see
+  // SetComputationProgressCallback().
+  struct ComputationProgress {
+    // Number of scans whose computations finished since the wait started.
+    int num_finished_scans;
+    // Number of scans whose computations are still pending.
+    int num_remaining_scans;
+    // Extrapolated from the rate at which scans finished so far, or negative
+    // if none finished yet.
+    double estimated_remaining_seconds;
+  };
+  using ComputationProgressCallback =
+      std::function<void(const ComputationProgress&)>;
+
   SparsePoseGraph() {}
   virtual ~SparsePoseGraph() {}
 
@@ -77,12 +140,50 @@ class SparsePoseGraph {
   // Freezes a trajectory. Poses in this trajectory will not be optimized.
   virtual void FreezeTrajectory(int trajectory_id) = 0;
 
+  // Marks the frozen trajectory with 'trajectory_id' as a piece of the map
+  // which shares the frame of the other trajectories, e.g. a neighboring area.
+  // Nodes are only matched against its submaps near them, in a local search
+  // window.
+  virtual void SetMergedTrajectory(int trajectory_id) = 0;
+
+  // Marks the trajectory with 'trajectory_id' as localizing against the frozen
+  // trajectories without mapping. Its nodes are only matched against submaps
+  // of frozen trajectories, and its own submaps, which are trimmed soon, are
+  // never matched against, so no scan matchers are built for them. Must be
+  // called before data of 'trajectory_id' is added.
+  virtual void SetLocalizationTrajectory(int trajectory_id) = 0;
+
+  // Ties the trajectories with 'trajectory_id' and 'other_trajectory_id',
+  // which were built from overlapping pieces of the same sensor data, e.g.
+  // chunks of a recording mapped in parallel. Each node of 'trajectory_id'
+  // with the same time as a node of 'other_trajectory_id' is constrained to
+  // the submaps the latter was inserted into. Must be called after the nodes
+  // of both trajectories were added, e.g. after both were finished.
+  virtual void LinkOverlappingTrajectories(int trajectory_id,
+                                           int other_trajectory_id) = 0;
+
   // Adds a 'submap' from a proto with the given 'initial_pose' to the frozen
   // trajectory with 'trajectory_id'.
   virtual void AddSubmapFromProto(int trajectory_id,
                                   const transform::Rigid3d& initial_pose,
                                   const proto::Submap& submap) = 0;
 
+  // Uses the precomputed grids in the 'mapped_blob_file' for matching against
+  // the submaps of the frozen trajectory with 'trajectory_id'. The blob at
+  // 'submap_index' has to belong to the submap with that index.
+  virtual void SetPrecomputedGrids(
+      int trajectory_id,
+      std::shared_ptr<const io::MappedBlobFile> mapped_blob_file) = 0;
+
+  // Constructs the scan matchers for the submaps of frozen trajectories in the
+  // background, nearest to 'global_pose' first, e.g. a hint where a trajectory
+  // starts localizing after loading a map. Those within
+  // 'max_constraint_distance' are constructed with high priority, the others
+  // at the lowest priority while they fit into the scan matcher cache. Without
+  // a hint, this happens once a localization trajectory is first matched
+  // against a frozen trajectory, around the matched node.
+  virtual void WarmUpScanMatchers(const transform::Rigid3d& global_pose) = 0;
+
   // Adds a 'node' from a proto with the given 'pose' to the frozen trajectory
   // with 'trajectory_id'.
   virtual void AddNodeFromProto(int trajectory_id,
@@ -93,9 +194,23 @@ class SparsePoseGraph {
   // included in the pose graph.
   virtual void AddTrimmer(std::unique_ptr<PoseGraphTrimmer> trimmer) = 0;
 
-  // Computes optimized poses.
+  // Computes optimized poses. Returns as soon as all pending constraint
+  // computations and the optimization finished.
   virtual void RunFinalOptimization() = 0;
 
+  // Changes the fields set in 'runtime_options' while mapping. Thread-safe,
+  // the change applies to scans added from now on.
+  virtual void UpdateRuntimeOptions(
+      const proto::SparsePoseGraphRuntimeOptions& runtime_options) = 0;
+
+  // Sets the 'callback' reporting the progress whenever more scans finished
+  // while waiting for the pending constraint computations, e.g. in
+  // RunFinalOptimization(). It replaces printing the progress to stdout once
+  // per second. It is called while the pose graph's mutex is held, so it must
+  // not call into the pose graph.
+  virtual void SetComputationProgressCallback(
+      ComputationProgressCallback callback) = 0;
+
   // Gets the current trajectory clusters.
   virtual std::vector<std::vector<int>> GetConnectedTrajectories() = 0;
 
@@ -117,11 +232,57 @@ class SparsePoseGraph {
   // Returns the current optimized trajectories.
   virtual std::vector<std::vector<TrajectoryNode>> GetTrajectoryNodes() = 0;
 
+  // Same as GetAllSubmapData() and GetTrajectoryNodes(), but only returns the
+  // submaps and nodes whose global position lies in 'region' of the xy plane.
+  // For submaps, this is the position of their origin. Candidates are looked
+  // up in the spatial indices, so the cost is proportional to the region
+  // rather than to the whole map.
+  virtual std::map<SubmapId, SubmapData> GetSubmapDataInRegion(
+      const Eigen::AlignedBox2d& region) = 0;
+  virtual std::map<NodeId, TrajectoryNode> GetTrajectoryNodesInRegion(
+      const Eigen::AlignedBox2d& region) = 0;
+
+  // Sets 'pose' to the global pose of the trajectory with 'trajectory_id' at
+  // 'time', interpolated between the optimized poses of the nodes right before
+  // and after 'time'. Returns false if 'time' is outside the time span of the
+  // trajectory's nodes.
+  virtual bool LookupGlobalPose(int trajectory_id, common::Time time,
+                                transform::Rigid3d* pose) = 0;
+
+  // Same as LookupGlobalPose() for all 'times', which must be sorted in
+  // ascending order. Cheaper than looking up each time on its own.
+  virtual bool LookupGlobalPoses(int trajectory_id,
+                                 const std::vector<common::Time>& times,
+                                 std::vector<transform::Rigid3d>* poses) = 0;
+
+  // Returns the snapshot published after the latest optimization. Does not
+  // wait for the pose graph's mutex, so it can be polled frequently, e.g. for
+  // visualization. Data added since the latest optimization is missing.
+  virtual std::shared_ptr<const Snapshot> GetSnapshot() = 0;
+
+  // Returns the same as GetTrajectoryNodes(), GetAllSubmapData() and
+  // constraints(), but taken together, so that they match each other while
+  // data is added.
+  virtual State GetState() = 0;
+
   // Serializes the constraints and trajectories.
   proto::SparsePoseGraph ToProto();
+  // Same as above for the 'state' returned by GetState().
+  static proto::SparsePoseGraph ToProto(const State& state);
 
   // Returns the collection of constraints.
   virtual std::vector<Constraint> constraints() = 0;
+
+  // Returns the nodes and constraints changed since 'version', which is the
+  // 'version' of the previous result or 0 for the first call. Unlike
+  // GetTrajectoryNodes() and constraints(), this only copies what changed, so
+  // it can be polled frequently, e.g. for visualization. Optimizations change
+  // the poses of all nodes, though.
+  virtual Changes GetChangesSince(int64 version) = 0;
+
+  // Returns the memory used by the submaps, nodes and computations of the pose
+  // graph. The sensor queues are not part of it.
+  virtual MemoryUsage GetMemoryUsage() = 0;
 };
 
 }  // namespace mapping
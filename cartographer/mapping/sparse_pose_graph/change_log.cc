@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/change_log.h"
+
+#include <map>
+#include <tuple>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+namespace {
+
+std::tuple<SubmapId, NodeId, int> GetConstraintKey(
+    const ChangeLog::Constraint& constraint) {
+  return std::make_tuple(constraint.submap_id, constraint.node_id,
+                         static_cast<int>(constraint.tag));
+}
+
+}  // namespace
+
+ChangeLog::ChangeLog(const int max_num_entries)
+    : max_num_entries_(max_num_entries) {
+  CHECK_GE(max_num_entries_, 0);
+}
+
+void ChangeLog::ChangeNode(const NodeId& node_id) {
+  Entry entry;
+  entry.type = Entry::Type::kChangeNode;
+  entry.node_id = node_id;
+  Append(entry);
+}
+
+void ChangeLog::ChangeAllNodePoses() {
+  Entry entry;
+  entry.type = Entry::Type::kChangeAllNodePoses;
+  Append(entry);
+}
+
+void ChangeLog::AddConstraint(const Constraint& constraint) {
+  Entry entry;
+  entry.type = Entry::Type::kAddConstraint;
+  entry.constraint = constraint;
+  Append(entry);
+}
+
+void ChangeLog::RemoveConstraint(const Constraint& constraint) {
+  Entry entry;
+  entry.type = Entry::Type::kRemoveConstraint;
+  entry.constraint = constraint;
+  Append(entry);
+}
+
+bool ChangeLog::GetChangesSince(
+    const int64 version, bool* const all_node_poses_changed,
+    std::set<NodeId>* const changed_node_ids,
+    std::vector<Constraint>* const added_constraints,
+    std::vector<Constraint>* const removed_constraints) const {
+  const int64 first_version =
+      version_ - static_cast<int64>(entries_.size()) + 1;
+  if (version < first_version - 1 || version > version_) {
+    return false;
+  }
+  *all_node_poses_changed = false;
+  changed_node_ids->clear();
+  added_constraints->clear();
+  removed_constraints->clear();
+  // Constraints added since 'version' which were not removed again, by key.
+  std::map<std::tuple<SubmapId, NodeId, int>, std::vector<const Constraint*>>
+      added_constraints_by_key;
+  for (auto it = entries_.begin() + (version + 1 - first_version);
+       it != entries_.end(); ++it) {
+    switch (it->type) {
+      case Entry::Type::kChangeNode:
+        changed_node_ids->insert(it->node_id);
+        break;
+      case Entry::Type::kChangeAllNodePoses:
+        *all_node_poses_changed = true;
+        break;
+      case Entry::Type::kAddConstraint:
+        added_constraints_by_key[GetConstraintKey(it->constraint)].push_back(
+            &it->constraint);
+        break;
+      case Entry::Type::kRemoveConstraint: {
+        auto& added = added_constraints_by_key[GetConstraintKey(it->constraint)];
+        if (added.empty()) {
+          removed_constraints->push_back(it->constraint);
+        } else {
+          added.pop_back();
+        }
+        break;
+      }
+    }
+  }
+  for (const auto& entry : added_constraints_by_key) {
+    for (const Constraint* const constraint : entry.second) {
+      added_constraints->push_back(*constraint);
+    }
+  }
+  return true;
+}
+
+void ChangeLog::Append(const Entry& entry) {
+  ++version_;
+  if (max_num_entries_ == 0) {
+    return;
+  }
+  if (static_cast<int>(entries_.size()) == max_num_entries_) {
+    entries_.pop_front();
+  }
+  entries_.push_back(entry);
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
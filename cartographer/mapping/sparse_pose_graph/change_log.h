@@ -0,0 +1,97 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CHANGE_LOG_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CHANGE_LOG_H_
+
+#include <deque>
+#include <set>
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/sparse_pose_graph.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Records the changes of the sparse pose graph, so that clients can request
+// only what changed since the version they have seen. Every recorded change
+// increments the version. Only the most recent 'max_num_entries' changes are
+// kept, clients which fall further behind have to start over from the full
+// state.
+//
+// This class is not thread-safe.
+class ChangeLog {
+ public:
+  using Constraint = mapping::SparsePoseGraph::Constraint;
+
+  explicit ChangeLog(int max_num_entries);
+
+  ChangeLog(const ChangeLog&) = delete;
+  ChangeLog& operator=(const ChangeLog&) = delete;
+
+  int64 version() const { return version_; }
+
+  // Records that the node with 'node_id' was added or trimmed.
+  void ChangeNode(const NodeId& node_id);
+
+  // Records that the poses of all nodes changed, e.g. by an optimization.
+  void ChangeAllNodePoses();
+
+  void AddConstraint(const Constraint& constraint);
+  void RemoveConstraint(const Constraint& constraint);
+
+  // Returns false if changes since 'version' are no longer available.
+  // Otherwise, sets 'all_node_poses_changed' and fills 'changed_node_ids',
+  // 'added_constraints' and 'removed_constraints'. Constraints added and
+  // removed since 'version' are in neither. Removed constraints are identified
+  // by their submap ID, node ID and tag.
+  bool GetChangesSince(int64 version, bool* all_node_poses_changed,
+                       std::set<NodeId>* changed_node_ids,
+                       std::vector<Constraint>* added_constraints,
+                       std::vector<Constraint>* removed_constraints) const;
+
+ private:
+  struct Entry {
+    enum class Type {
+      kChangeNode,
+      kChangeAllNodePoses,
+      kAddConstraint,
+      kRemoveConstraint
+    };
+    Type type;
+    // Set for 'kChangeNode'.
+    NodeId node_id;
+    // Set for 'kAddConstraint' and 'kRemoveConstraint'.
+    Constraint constraint;
+  };
+
+  void Append(const Entry& entry);
+
+  const int max_num_entries_;
+  int64 version_ = 0;
+  // The changes leading to the versions 'version_' - 'entries_.size()' + 1 to
+  // 'version_'.
+  std::deque<Entry> entries_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CHANGE_LOG_H_
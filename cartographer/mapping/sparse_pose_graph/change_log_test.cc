@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/change_log.h"
+
+#include <set>
+#include <vector>
+
+#include "cartographer/mapping/sparse_pose_graph/constraint_store.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+using Constraint = ChangeLog::Constraint;
+
+Constraint CreateConstraint(const SubmapId& submap_id, const NodeId& node_id,
+                            const Constraint::Tag tag) {
+  return Constraint{submap_id,
+                    node_id,
+                    {transform::Rigid3d::Identity(), 1., 1.},
+                    tag};
+}
+
+class ChangeLogTest : public ::testing::Test {
+ protected:
+  bool GetChangesSince(const ChangeLog& change_log, const int64 version) {
+    return change_log.GetChangesSince(version, &all_node_poses_changed_,
+                                      &changed_node_ids_, &added_constraints_,
+                                      &removed_constraints_);
+  }
+
+  bool all_node_poses_changed_ = false;
+  std::set<NodeId> changed_node_ids_;
+  std::vector<Constraint> added_constraints_;
+  std::vector<Constraint> removed_constraints_;
+};
+
+TEST_F(ChangeLogTest, ReturnsChangesSinceVersion) {
+  ChangeLog change_log(100);
+  ConstraintStore store(&change_log);
+  EXPECT_EQ(0, change_log.version());
+  change_log.ChangeNode(NodeId{0, 0});
+  store.Add(CreateConstraint(SubmapId{0, 0}, NodeId{0, 0},
+                             Constraint::INTRA_SUBMAP));
+  const int64 version = change_log.version();
+  EXPECT_EQ(2, version);
+
+  change_log.ChangeNode(NodeId{0, 1});
+  store.Add({CreateConstraint(SubmapId{0, 0}, NodeId{0, 1},
+                              Constraint::INTRA_SUBMAP),
+             CreateConstraint(SubmapId{0, 1}, NodeId{0, 1},
+                              Constraint::INTRA_SUBMAP)});
+  store.RemoveSubmap(SubmapId{0, 0});
+  change_log.ChangeNode(NodeId{0, 0});
+  // Compacting does not change any constraints.
+  EXPECT_EQ(1, store.GetAll().size());
+  EXPECT_EQ(8, change_log.version());
+
+  ASSERT_TRUE(GetChangesSince(change_log, version));
+  EXPECT_FALSE(all_node_poses_changed_);
+  EXPECT_EQ((std::set<NodeId>{NodeId{0, 0}, NodeId{0, 1}}), changed_node_ids_);
+  // The constraint of node 1 on submap 0 was added and removed again.
+  ASSERT_EQ(1, added_constraints_.size());
+  EXPECT_EQ((SubmapId{0, 1}), added_constraints_[0].submap_id);
+  ASSERT_EQ(1, removed_constraints_.size());
+  EXPECT_EQ((NodeId{0, 0}), removed_constraints_[0].node_id);
+
+  change_log.ChangeAllNodePoses();
+  ASSERT_TRUE(GetChangesSince(change_log, 8));
+  EXPECT_TRUE(all_node_poses_changed_);
+  EXPECT_TRUE(changed_node_ids_.empty());
+  EXPECT_TRUE(added_constraints_.empty());
+  EXPECT_TRUE(removed_constraints_.empty());
+
+  ASSERT_TRUE(GetChangesSince(change_log, change_log.version()));
+  EXPECT_FALSE(all_node_poses_changed_);
+  EXPECT_FALSE(GetChangesSince(change_log, change_log.version() + 1));
+}
+
+TEST_F(ChangeLogTest, OldChangesAreDropped) {
+  ChangeLog change_log(3);
+  for (int i = 0; i != 5; ++i) {
+    change_log.ChangeNode(NodeId{0, i});
+  }
+  EXPECT_FALSE(GetChangesSince(change_log, 1));
+  ASSERT_TRUE(GetChangesSince(change_log, 2));
+  EXPECT_EQ((std::set<NodeId>{NodeId{0, 2}, NodeId{0, 3}, NodeId{0, 4}}),
+            changed_node_ids_);
+
+  ChangeLog disabled_change_log(0);
+  disabled_change_log.ChangeNode(NodeId{0, 0});
+  EXPECT_EQ(1, disabled_change_log.version());
+  EXPECT_FALSE(GetChangesSince(disabled_change_log, 0));
+  EXPECT_TRUE(GetChangesSince(disabled_change_log, 1));
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -21,6 +21,7 @@
 #include "cartographer/mapping_3d/scan_matching/ceres_scan_matcher.h"
 #include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
 #include "cartographer/sensor/voxel_filter.h"
+#include "glog/logging.h"
 
 namespace cartographer {
 namespace mapping {
@@ -35,10 +36,33 @@ proto::ConstraintBuilderOptions CreateConstraintBuilderOptions(
   options.set_min_score(parameter_dictionary->GetDouble("min_score"));
   options.set_global_localization_min_score(
       parameter_dictionary->GetDouble("global_localization_min_score"));
+  options.set_global_localization_num_tasks(
+      parameter_dictionary->GetInt("global_localization_num_tasks"));
+  CHECK_GE(options.global_localization_num_tasks(), 1);
+  options.set_global_localization_time_limit_seconds(
+      parameter_dictionary->GetDouble(
+          "global_localization_time_limit_seconds"));
   options.set_loop_closure_translation_weight(
       parameter_dictionary->GetDouble("loop_closure_translation_weight"));
   options.set_loop_closure_rotation_weight(
       parameter_dictionary->GetDouble("loop_closure_rotation_weight"));
+  options.set_scan_matcher_cache_size_mb(
+      parameter_dictionary->GetNonNegativeInt("scan_matcher_cache_size_mb"));
+  options.set_scan_matcher_precomputation_num_tasks(
+      parameter_dictionary->GetInt("scan_matcher_precomputation_num_tasks"));
+  CHECK_GE(options.scan_matcher_precomputation_num_tasks(), 1);
+  options.set_decompressed_node_cache_size_mb(
+      parameter_dictionary->GetNonNegativeInt(
+          "decompressed_node_cache_size_mb"));
+  options.set_speculative_precomputation_num_range_data(
+      parameter_dictionary->GetNonNegativeInt(
+          "speculative_precomputation_num_range_data"));
+  options.set_use_coarse_precheck(
+      parameter_dictionary->GetBool("use_coarse_precheck"));
+  options.set_refinement_batch_num_threads(
+      parameter_dictionary->GetNonNegativeInt("refinement_batch_num_threads"));
+  options.set_order_searches_by_value(
+      parameter_dictionary->GetBool("order_searches_by_value"));
   options.set_log_matches(parameter_dictionary->GetBool("log_matches"));
   *options.mutable_fast_correlative_scan_matcher_options() =
       mapping_2d::scan_matching::CreateFastCorrelativeScanMatcherOptions(
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/constraint_cost_model.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+namespace {
+
+// Run time per point assumed for searches in a local window until one was
+// observed, e.g. 1 ms for 500 points.
+constexpr double kInitialLocalSecondsPerPoint = 2e-6;
+constexpr double kInitialFullSubmapSecondsPerPoint =
+    100. * kInitialLocalSecondsPerPoint;
+
+// Weight of the newest search in the moving average of the run time.
+constexpr double kSmoothingFactor = 0.1;
+
+}  // namespace
+
+double ConstraintCostModel::PredictSeconds(const SearchType& search_type,
+                                           const int num_points) const {
+  const SearchStatistics* const statistics = FindStatistics(search_type);
+  double seconds_per_point;
+  if (statistics != nullptr) {
+    seconds_per_point = statistics->seconds_per_point;
+  } else {
+    seconds_per_point = search_type.match_full_submap
+                            ? kInitialFullSubmapSecondsPerPoint
+                            : kInitialLocalSecondsPerPoint;
+  }
+  return seconds_per_point * std::max(num_points, 1);
+}
+
+double ConstraintCostModel::PredictValuePerSecond(
+    const SearchType& search_type, const int num_points) const {
+  const SearchStatistics* const statistics = FindStatistics(search_type);
+  // Laplace's rule of succession, i.e. 1/2 for kinds of searches never seen.
+  double success_probability = 0.5;
+  if (statistics != nullptr) {
+    success_probability = (statistics->num_constraints + 1.) /
+                          (statistics->num_searches + 2.);
+  }
+  return success_probability /
+         std::max(PredictSeconds(search_type, num_points), 1e-9);
+}
+
+void ConstraintCostModel::AddSearch(const SearchType& search_type,
+                                    const int num_points, const double seconds,
+                                    const bool found_constraint) {
+  const double seconds_per_point = seconds / std::max(num_points, 1);
+  SearchStatistics& statistics = statistics_[Key(
+      search_type.match_full_submap, search_type.resolution)];
+  if (statistics.num_searches == 0) {
+    statistics.seconds_per_point = seconds_per_point;
+  } else {
+    statistics.seconds_per_point +=
+        kSmoothingFactor * (seconds_per_point - statistics.seconds_per_point);
+  }
+  ++statistics.num_searches;
+  if (found_constraint) {
+    ++statistics.num_constraints;
+  }
+}
+
+string ConstraintCostModel::ToString() const {
+  std::ostringstream out;
+  for (const auto& entry : statistics_) {
+    const SearchStatistics& statistics = entry.second;
+    out << (entry.first.first ? "Full submap" : "Local") << " searches at "
+        << entry.first.second << " m: " << statistics.num_searches
+        << " searches, " << statistics.num_constraints << " constraints, "
+        << 1e6 * statistics.seconds_per_point << " us per point.\n";
+  }
+  return out.str();
+}
+
+const ConstraintCostModel::SearchStatistics*
+ConstraintCostModel::FindStatistics(const SearchType& search_type) const {
+  const auto it = statistics_.find(
+      Key(search_type.match_full_submap, search_type.resolution));
+  return it == statistics_.end() ? nullptr : &it->second;
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
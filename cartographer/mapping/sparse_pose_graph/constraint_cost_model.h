@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CONSTRAINT_COST_MODEL_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CONSTRAINT_COST_MODEL_H_
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Predicts the run time of constraint searches and their chance to find a
+// constraint from the searches which finished so far. Searches are told apart
+// by whether they cover the full submap and by the resolution of the submap.
+// Their run time is assumed to grow linearly with the number of points
+// matched. Until a kind of search was observed, a full submap search is
+// assumed to take 100 times longer than a search in a local window.
+//
+// This class is not thread-safe.
+class ConstraintCostModel {
+ public:
+  struct SearchType {
+    bool match_full_submap;
+    double resolution;
+  };
+
+  ConstraintCostModel() = default;
+
+  ConstraintCostModel(const ConstraintCostModel&) = delete;
+  ConstraintCostModel& operator=(const ConstraintCostModel&) = delete;
+
+  // Returns the expected run time in seconds of a search of 'search_type' for
+  // 'num_points' points.
+  double PredictSeconds(const SearchType& search_type, int num_points) const;
+
+  // Returns the expected number of constraints found per second of run time
+  // of a search of 'search_type' for 'num_points' points.
+  double PredictValuePerSecond(const SearchType& search_type,
+                               int num_points) const;
+
+  // Records that a search of 'search_type' for 'num_points' points took
+  // 'seconds' and whether it found a constraint.
+  void AddSearch(const SearchType& search_type, int num_points, double seconds,
+                 bool found_constraint);
+
+  // Returns a human readable summary of the recorded searches.
+  string ToString() const;
+
+ private:
+  struct SearchStatistics {
+    int64 num_searches = 0;
+    int64 num_constraints = 0;
+    // Moving average of the run time divided by the number of points.
+    double seconds_per_point = 0.;
+  };
+
+  using Key = std::pair<bool, double>;
+
+  const SearchStatistics* FindStatistics(const SearchType& search_type) const;
+
+  std::map<Key, SearchStatistics> statistics_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CONSTRAINT_COST_MODEL_H_
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/constraint_cost_model.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+constexpr ConstraintCostModel::SearchType kLocalSearch{false, 0.05};
+constexpr ConstraintCostModel::SearchType kFullSubmapSearch{true, 0.05};
+
+TEST(ConstraintCostModelTest, FullSubmapSearchesAreExpensiveInitially) {
+  ConstraintCostModel cost_model;
+  EXPECT_NEAR(100. * cost_model.PredictSeconds(kLocalSearch, 500),
+              cost_model.PredictSeconds(kFullSubmapSearch, 500), 1e-12);
+  EXPECT_NEAR(2. * cost_model.PredictSeconds(kLocalSearch, 500),
+              cost_model.PredictSeconds(kLocalSearch, 1000), 1e-12);
+  EXPECT_GT(cost_model.PredictValuePerSecond(kLocalSearch, 500),
+            cost_model.PredictValuePerSecond(kFullSubmapSearch, 500));
+}
+
+TEST(ConstraintCostModelTest, LearnsRunTimeAndSuccessRate) {
+  ConstraintCostModel cost_model;
+  cost_model.AddSearch(kFullSubmapSearch, 100, 0.01, true);
+  EXPECT_NEAR(0.02, cost_model.PredictSeconds(kFullSubmapSearch, 200), 1e-12);
+  // Other resolutions are not affected.
+  const ConstraintCostModel::SearchType other_resolution{true, 0.1};
+  EXPECT_NEAR(100. * cost_model.PredictSeconds(kLocalSearch, 200),
+              cost_model.PredictSeconds(other_resolution, 200), 1e-12);
+  for (int i = 0; i != 100; ++i) {
+    cost_model.AddSearch(kLocalSearch, 100, 0.001, false);
+  }
+  EXPECT_NEAR(0.001, cost_model.PredictSeconds(kLocalSearch, 100), 1e-12);
+  // Searches which never succeed are worth less, even if they are cheap.
+  EXPECT_GT(cost_model.PredictValuePerSecond(kFullSubmapSearch, 100),
+            cost_model.PredictValuePerSecond(kLocalSearch, 100));
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
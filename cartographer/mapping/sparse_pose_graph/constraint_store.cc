@@ -0,0 +1,171 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/constraint_store.h"
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+ConstraintStore::ConstraintStore(ChangeLog* const change_log)
+    : change_log_(change_log) {}
+
+void ConstraintStore::Add(const Constraint& constraint) {
+  Insert(constraint);
+  if (change_log_ != nullptr) {
+    change_log_->AddConstraint(constraint);
+  }
+}
+
+void ConstraintStore::Add(const std::vector<Constraint>& constraints) {
+  for (const Constraint& constraint : constraints) {
+    Add(constraint);
+  }
+}
+
+void ConstraintStore::Insert(const Constraint& constraint) {
+  const int index = static_cast<int>(constraints_.size());
+  constraints_.push_back(constraint);
+  removed_.push_back(false);
+  indices_by_submap_[constraint.submap_id].push_back(index);
+  indices_by_node_[constraint.node_id].push_back(index);
+}
+
+const std::vector<ConstraintStore::Constraint>& ConstraintStore::GetAll() {
+  if (num_removed_ != 0) {
+    Compact();
+  }
+  return constraints_;
+}
+
+std::vector<ConstraintStore::Constraint> ConstraintStore::GetForSubmap(
+    const SubmapId& submap_id) const {
+  std::vector<Constraint> result;
+  const auto it = indices_by_submap_.find(submap_id);
+  if (it != indices_by_submap_.end()) {
+    for (const int index : it->second) {
+      if (!removed_[index]) {
+        result.push_back(constraints_[index]);
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<ConstraintStore::Constraint> ConstraintStore::GetForNode(
+    const NodeId& node_id) const {
+  std::vector<Constraint> result;
+  const auto it = indices_by_node_.find(node_id);
+  if (it != indices_by_node_.end()) {
+    for (const int index : it->second) {
+      if (!removed_[index]) {
+        result.push_back(constraints_[index]);
+      }
+    }
+  }
+  return result;
+}
+
+void ConstraintStore::RemoveSubmap(const SubmapId& submap_id) {
+  const auto it = indices_by_submap_.find(submap_id);
+  if (it == indices_by_submap_.end()) {
+    return;
+  }
+  for (const int index : it->second) {
+    Remove(index);
+  }
+  indices_by_submap_.erase(it);
+}
+
+void ConstraintStore::RemoveNode(const NodeId& node_id) {
+  const auto it = indices_by_node_.find(node_id);
+  if (it == indices_by_node_.end()) {
+    return;
+  }
+  for (const int index : it->second) {
+    Remove(index);
+  }
+  indices_by_node_.erase(it);
+}
+
+int ConstraintStore::RemoveRedundantInterSubmapConstraints(
+    const int max_num_constraints) {
+  CHECK_GT(max_num_constraints, 0);
+  std::map<std::pair<SubmapId, SubmapId>, int> num_constraints_by_pair;
+  int num_removed = 0;
+  // Newer constraints are kept, so they are visited first.
+  for (int index = static_cast<int>(constraints_.size()) - 1; index >= 0;
+       --index) {
+    const Constraint& constraint = constraints_[index];
+    if (removed_[index] || constraint.tag != Constraint::INTER_SUBMAP) {
+      continue;
+    }
+    const SubmapId* node_submap_id = nullptr;
+    for (const int node_index : indices_by_node_.at(constraint.node_id)) {
+      const Constraint& node_constraint = constraints_[node_index];
+      if (!removed_[node_index] &&
+          node_constraint.tag == Constraint::INTRA_SUBMAP &&
+          (node_submap_id == nullptr ||
+           node_constraint.submap_id < *node_submap_id)) {
+        node_submap_id = &node_constraint.submap_id;
+      }
+    }
+    if (node_submap_id == nullptr) {
+      continue;
+    }
+    if (++num_constraints_by_pair[std::make_pair(constraint.submap_id,
+                                                 *node_submap_id)] >
+        max_num_constraints) {
+      Remove(index);
+      ++num_removed;
+    }
+  }
+  return num_removed;
+}
+
+void ConstraintStore::Remove(const int index) {
+  if (!removed_[index]) {
+    removed_[index] = true;
+    ++num_removed_;
+    if (change_log_ != nullptr) {
+      change_log_->RemoveConstraint(constraints_[index]);
+    }
+  }
+}
+
+void ConstraintStore::Compact() {
+  std::vector<Constraint> constraints;
+  constraints.reserve(size());
+  for (size_t i = 0; i != constraints_.size(); ++i) {
+    if (!removed_[i]) {
+      constraints.push_back(constraints_[i]);
+    }
+  }
+  constraints_.clear();
+  removed_.clear();
+  num_removed_ = 0;
+  indices_by_submap_.clear();
+  indices_by_node_.clear();
+  for (const Constraint& constraint : constraints) {
+    Insert(constraint);
+  }
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
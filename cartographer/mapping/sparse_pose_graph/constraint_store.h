@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CONSTRAINT_STORE_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CONSTRAINT_STORE_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/sparse_pose_graph/change_log.h"
+#include "cartographer/mapping/sparse_pose_graph.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Stores the constraints of the sparse pose graph in one contiguous vector,
+// indexed by submap and by node. Removed constraints only leave a tombstone
+// behind, so that removing the constraints of a submap or node costs time
+// proportional to their number instead of to the total number of constraints.
+// Tombstones are compacted away the next time all constraints are requested.
+// Additions and removals are recorded in the 'change_log' if given.
+//
+// This class is not thread-safe.
+class ConstraintStore {
+ public:
+  using Constraint = mapping::SparsePoseGraph::Constraint;
+
+  explicit ConstraintStore(ChangeLog* change_log = nullptr);
+
+  ConstraintStore(const ConstraintStore&) = delete;
+  ConstraintStore& operator=(const ConstraintStore&) = delete;
+
+  void Add(const Constraint& constraint);
+  void Add(const std::vector<Constraint>& constraints);
+
+  // Returns all constraints that were not removed, in the order they were
+  // added. Compacts the storage if anything was removed since the last call.
+  const std::vector<Constraint>& GetAll();
+
+  // Returns the constraints involving 'submap_id' or 'node_id' respectively.
+  std::vector<Constraint> GetForSubmap(const SubmapId& submap_id) const;
+  std::vector<Constraint> GetForNode(const NodeId& node_id) const;
+
+  // Removes all constraints involving 'submap_id' or 'node_id' respectively.
+  void RemoveSubmap(const SubmapId& submap_id);
+  void RemoveNode(const NodeId& node_id);
+
+  // Removes the oldest inter-submap constraints between each submap and the
+  // nodes of another submap, so that at most 'max_num_constraints' remain per
+  // pair of submaps. The submap of a node is the first submap it has an
+  // intra-submap constraint with. Constraints of nodes without one are kept.
+  // Returns the number of removed constraints.
+  int RemoveRedundantInterSubmapConstraints(int max_num_constraints);
+
+  // Returns the number of constraints that were not removed.
+  int size() const {
+    return static_cast<int>(constraints_.size()) - num_removed_;
+  }
+
+ private:
+  // Adds the 'constraint' without recording it in the 'change_log_'.
+  void Insert(const Constraint& constraint);
+  void Remove(int index);
+  void Compact();
+
+  ChangeLog* const change_log_;
+  std::vector<Constraint> constraints_;
+  // Indexed like 'constraints_'.
+  std::vector<bool> removed_;
+  int num_removed_ = 0;
+  // Indices into 'constraints_', including removed ones which are skipped.
+  std::map<SubmapId, std::vector<int>> indices_by_submap_;
+  std::map<NodeId, std::vector<int>> indices_by_node_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CONSTRAINT_STORE_H_
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/constraint_store.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+using Constraint = ConstraintStore::Constraint;
+
+Constraint CreateConstraint(const SubmapId& submap_id, const NodeId& node_id,
+                            const Constraint::Tag tag) {
+  return Constraint{submap_id,
+                    node_id,
+                    {transform::Rigid3d::Identity(), 1., 1.},
+                    tag};
+}
+
+TEST(ConstraintStoreTest, AddAndGet) {
+  ConstraintStore store;
+  store.Add(CreateConstraint(SubmapId{0, 0}, NodeId{0, 0},
+                             Constraint::INTRA_SUBMAP));
+  store.Add({CreateConstraint(SubmapId{0, 1}, NodeId{0, 0},
+                              Constraint::INTRA_SUBMAP),
+             CreateConstraint(SubmapId{0, 0}, NodeId{1, 3},
+                              Constraint::INTER_SUBMAP)});
+  EXPECT_EQ(3, store.size());
+  ASSERT_EQ(3, store.GetAll().size());
+  EXPECT_EQ((SubmapId{0, 1}), store.GetAll()[1].submap_id);
+  EXPECT_EQ(2, store.GetForSubmap(SubmapId{0, 0}).size());
+  EXPECT_EQ(1, store.GetForSubmap(SubmapId{0, 1}).size());
+  EXPECT_EQ(0, store.GetForSubmap(SubmapId{1, 0}).size());
+  EXPECT_EQ(2, store.GetForNode(NodeId{0, 0}).size());
+  EXPECT_EQ(1, store.GetForNode(NodeId{1, 3}).size());
+}
+
+TEST(ConstraintStoreTest, RemoveAndCompact) {
+  ConstraintStore store;
+  for (int i = 0; i != 4; ++i) {
+    store.Add(CreateConstraint(SubmapId{0, i / 2}, NodeId{0, i},
+                               Constraint::INTRA_SUBMAP));
+  }
+  store.Add(CreateConstraint(SubmapId{0, 1}, NodeId{0, 0},
+                             Constraint::INTER_SUBMAP));
+  store.RemoveSubmap(SubmapId{0, 0});
+  EXPECT_EQ(3, store.size());
+  EXPECT_EQ(1, store.GetForNode(NodeId{0, 0}).size());
+  EXPECT_EQ(0, store.GetForNode(NodeId{0, 1}).size());
+  store.RemoveNode(NodeId{0, 0});
+  store.RemoveNode(NodeId{0, 0});
+  EXPECT_EQ(2, store.size());
+  EXPECT_EQ(2, store.GetForSubmap(SubmapId{0, 1}).size());
+
+  const std::vector<Constraint>& constraints = store.GetAll();
+  ASSERT_EQ(2, constraints.size());
+  EXPECT_EQ((NodeId{0, 2}), constraints[0].node_id);
+  EXPECT_EQ((NodeId{0, 3}), constraints[1].node_id);
+  EXPECT_EQ(2, store.GetForSubmap(SubmapId{0, 1}).size());
+
+  // Adding after compaction keeps the indices consistent.
+  store.Add(CreateConstraint(SubmapId{0, 1}, NodeId{0, 4},
+                             Constraint::INTRA_SUBMAP));
+  store.RemoveNode(NodeId{0, 2});
+  EXPECT_EQ(2, store.size());
+  EXPECT_EQ(2, store.GetForSubmap(SubmapId{0, 1}).size());
+  ASSERT_EQ(2, store.GetAll().size());
+  EXPECT_EQ((NodeId{0, 4}), store.GetAll()[1].node_id);
+}
+
+TEST(ConstraintStoreTest, SizeStaysLevelWhenTrimming) {
+  constexpr int kNumSubmapsToKeep = 3;
+  constexpr int kNumNodesPerSubmap = 5;
+  ConstraintStore store;
+  int node_index = 0;
+  for (int submap_index = 0; submap_index != 1000; ++submap_index) {
+    const SubmapId submap_id{0, submap_index};
+    for (int i = 0; i != kNumNodesPerSubmap; ++i, ++node_index) {
+      store.Add(CreateConstraint(submap_id, NodeId{0, node_index},
+                                 Constraint::INTRA_SUBMAP));
+      if (submap_index != 0) {
+        store.Add(CreateConstraint(SubmapId{0, submap_index - 1},
+                                   NodeId{0, node_index},
+                                   Constraint::INTER_SUBMAP));
+      }
+    }
+    if (submap_index >= kNumSubmapsToKeep) {
+      const SubmapId trimmed_submap_id{0, submap_index - kNumSubmapsToKeep};
+      for (const Constraint& constraint :
+           store.GetForSubmap(trimmed_submap_id)) {
+        if (constraint.tag == Constraint::INTRA_SUBMAP) {
+          store.RemoveNode(constraint.node_id);
+        }
+      }
+      store.RemoveSubmap(trimmed_submap_id);
+      EXPECT_EQ(0, store.GetForSubmap(trimmed_submap_id).size());
+      EXPECT_EQ((2 * kNumSubmapsToKeep - 1) * kNumNodesPerSubmap,
+                store.GetAll().size());
+    }
+  }
+}
+
+TEST(ConstraintStoreTest, RemoveRedundantInterSubmapConstraints) {
+  ConstraintStore store;
+  // Nodes 0 to 9 were inserted into submap (1, 0), nodes 10 to 13 into submap
+  // (1, 1), and all of them match submap (0, 0). Node 14 has no intra-submap
+  // constraint.
+  for (int i = 0; i != 14; ++i) {
+    store.Add(CreateConstraint(SubmapId{1, i / 10}, NodeId{1, i},
+                               Constraint::INTRA_SUBMAP));
+  }
+  for (int i = 0; i != 15; ++i) {
+    store.Add(CreateConstraint(SubmapId{0, 0}, NodeId{1, i},
+                               Constraint::INTER_SUBMAP));
+  }
+  EXPECT_EQ(29, store.size());
+  EXPECT_EQ(7 + 1, store.RemoveRedundantInterSubmapConstraints(3));
+  EXPECT_EQ(21, store.size());
+  const std::vector<Constraint> constraints =
+      store.GetForSubmap(SubmapId{0, 0});
+  ASSERT_EQ(7, constraints.size());
+  // The most recent constraints of each pair of submaps are kept.
+  EXPECT_EQ((NodeId{1, 7}), constraints[0].node_id);
+  EXPECT_EQ((NodeId{1, 9}), constraints[2].node_id);
+  EXPECT_EQ((NodeId{1, 11}), constraints[3].node_id);
+  EXPECT_EQ((NodeId{1, 14}), constraints[6].node_id);
+  EXPECT_EQ(0, store.RemoveRedundantInterSubmapConstraints(3));
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/cost_attribution.h"
+
+#include <algorithm>
+#include <string>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+namespace {
+
+const char* const kStageNames[] = {"constraint_search",
+                                   "scan_matcher_construction", "optimization"};
+
+}  // namespace
+
+CostAttribution::CostAttribution(const int num_top_submaps)
+    : num_top_submaps_(num_top_submaps) {
+  CHECK_GE(num_top_submaps_, 0);
+}
+
+void CostAttribution::RegisterMetrics(metrics::Registry* const registry) {
+  common::MutexLocker locker(&mutex_);
+  CHECK(registry_ == nullptr);
+  registry_ = registry;
+  for (int rank = 0; rank != num_top_submaps_; ++rank) {
+    const metrics::Labels labels = {{"rank", std::to_string(rank)}};
+    top_submap_metrics_.push_back(TopSubmapMetrics{
+        registry->GetGauge("cartographer_loop_closure_top_submap_seconds",
+                           "Time loop closure spent on one of the costliest "
+                           "submaps, by rank.",
+                           labels),
+        registry->GetGauge(
+            "cartographer_loop_closure_top_submap_trajectory_id",
+            "Trajectory ID of one of the costliest submaps, or -1.", labels),
+        registry->GetGauge("cartographer_loop_closure_top_submap_index",
+                           "Submap index of one of the costliest submaps, or "
+                           "-1.",
+                           labels),
+        registry->GetGauge(
+            "cartographer_loop_closure_top_submap_searches",
+            "Number of constraint searches against one of the costliest "
+            "submaps.",
+            labels),
+        registry->GetGauge(
+            "cartographer_loop_closure_top_submap_constraints",
+            "Number of constraints found in one of the costliest submaps.",
+            labels)});
+  }
+  // Costs added so far are exported as the initial values.
+  for (const auto& entry : trajectory_costs_) {
+    TrajectoryMetrics* const trajectory_metrics =
+        GetTrajectoryMetrics(entry.first);
+    for (int stage = 0; stage != kNumStages; ++stage) {
+      trajectory_metrics->seconds[stage]->Increment(
+          entry.second.seconds[stage]);
+      trajectory_metrics->num_work_items[stage]->Increment(
+          entry.second.num_work_items[stage]);
+    }
+  }
+}
+
+void CostAttribution::AddConstraintSearch(const SubmapId& submap_id,
+                                          const int node_trajectory_id,
+                                          const double seconds,
+                                          const bool found_constraint) {
+  common::MutexLocker locker(&mutex_);
+  SubmapCost& submap_cost =
+      submap_costs_.emplace(submap_id, SubmapCost{submap_id, 0., 0, 0})
+          .first->second;
+  submap_cost.seconds += seconds;
+  ++submap_cost.num_searches;
+  if (found_constraint) {
+    ++submap_cost.num_found_constraints;
+  }
+  AddTrajectoryCost(node_trajectory_id, Stage::kConstraintSearch, seconds, 1);
+}
+
+void CostAttribution::AddScanMatcherConstruction(const SubmapId& submap_id,
+                                                 const double seconds) {
+  common::MutexLocker locker(&mutex_);
+  submap_costs_.emplace(submap_id, SubmapCost{submap_id, 0., 0, 0})
+      .first->second.seconds += seconds;
+  AddTrajectoryCost(submap_id.trajectory_id, Stage::kScanMatcherConstruction,
+                    seconds, 1);
+}
+
+void CostAttribution::AddOptimization(const double seconds,
+                                      const std::vector<int64>& weights) {
+  int64 total_weight = 0;
+  for (const int64 weight : weights) {
+    total_weight += weight;
+  }
+  if (total_weight == 0) {
+    return;
+  }
+  common::MutexLocker locker(&mutex_);
+  for (size_t trajectory_id = 0; trajectory_id != weights.size();
+       ++trajectory_id) {
+    if (weights[trajectory_id] > 0) {
+      AddTrajectoryCost(
+          trajectory_id, Stage::kOptimization,
+          seconds * static_cast<double>(weights[trajectory_id]) / total_weight,
+          1);
+    }
+  }
+}
+
+void CostAttribution::RemoveSubmap(const SubmapId& submap_id) {
+  common::MutexLocker locker(&mutex_);
+  submap_costs_.erase(submap_id);
+}
+
+void CostAttribution::RemoveTrajectory(const int trajectory_id) {
+  common::MutexLocker locker(&mutex_);
+  trajectory_costs_.erase(trajectory_id);
+  trajectory_metrics_.erase(trajectory_id);
+  submap_costs_.erase(
+      submap_costs_.lower_bound(SubmapId{trajectory_id, 0}),
+      submap_costs_.lower_bound(SubmapId{trajectory_id + 1, 0}));
+}
+
+std::vector<CostAttribution::SubmapCost> CostAttribution::GetTopSubmaps()
+    const {
+  common::MutexLocker locker(&mutex_);
+  return GetTopSubmapsLocked();
+}
+
+void CostAttribution::PublishTopSubmaps() {
+  common::MutexLocker locker(&mutex_);
+  if (top_submap_metrics_.empty()) {
+    return;
+  }
+  const std::vector<SubmapCost> top_submaps = GetTopSubmapsLocked();
+  for (size_t rank = 0; rank != top_submap_metrics_.size(); ++rank) {
+    const TopSubmapMetrics& metrics = top_submap_metrics_[rank];
+    if (rank < top_submaps.size()) {
+      const SubmapCost& submap_cost = top_submaps[rank];
+      metrics.seconds->Set(submap_cost.seconds);
+      metrics.trajectory_id->Set(submap_cost.submap_id.trajectory_id);
+      metrics.submap_index->Set(submap_cost.submap_id.submap_index);
+      metrics.num_searches->Set(submap_cost.num_searches);
+      metrics.num_found_constraints->Set(submap_cost.num_found_constraints);
+    } else {
+      metrics.seconds->Set(0.);
+      metrics.trajectory_id->Set(-1.);
+      metrics.submap_index->Set(-1.);
+      metrics.num_searches->Set(0.);
+      metrics.num_found_constraints->Set(0.);
+    }
+  }
+}
+
+void CostAttribution::AddTrajectoryCost(const int trajectory_id,
+                                        const Stage stage,
+                                        const double seconds,
+                                        const int64 num_work_items) {
+  const int stage_index = static_cast<int>(stage);
+  TrajectoryCost& trajectory_cost = trajectory_costs_[trajectory_id];
+  trajectory_cost.seconds[stage_index] += seconds;
+  trajectory_cost.num_work_items[stage_index] += num_work_items;
+  if (registry_ != nullptr) {
+    TrajectoryMetrics* const trajectory_metrics =
+        GetTrajectoryMetrics(trajectory_id);
+    trajectory_metrics->seconds[stage_index]->Increment(seconds);
+    trajectory_metrics->num_work_items[stage_index]->Increment(num_work_items);
+  }
+}
+
+CostAttribution::TrajectoryMetrics* CostAttribution::GetTrajectoryMetrics(
+    const int trajectory_id) {
+  const auto it = trajectory_metrics_.find(trajectory_id);
+  if (it != trajectory_metrics_.end()) {
+    return &it->second;
+  }
+  TrajectoryMetrics& trajectory_metrics = trajectory_metrics_[trajectory_id];
+  for (int stage = 0; stage != kNumStages; ++stage) {
+    const metrics::Labels labels = {
+        {"trajectory_id", std::to_string(trajectory_id)},
+        {"stage", kStageNames[stage]}};
+    trajectory_metrics.seconds[stage] = registry_->GetCounter(
+        "cartographer_loop_closure_seconds_total",
+        "Time loop closure spent on a trajectory.", labels);
+    trajectory_metrics.num_work_items[stage] = registry_->GetCounter(
+        "cartographer_loop_closure_work_items_total",
+        "Number of constraint searches, scan matcher constructions or "
+        "optimizations attributed to a trajectory.",
+        labels);
+  }
+  return &trajectory_metrics;
+}
+
+std::vector<CostAttribution::SubmapCost> CostAttribution::GetTopSubmapsLocked()
+    const {
+  std::vector<SubmapCost> submap_costs;
+  submap_costs.reserve(submap_costs_.size());
+  for (const auto& entry : submap_costs_) {
+    submap_costs.push_back(entry.second);
+  }
+  const size_t num_top_submaps =
+      std::min(submap_costs.size(), static_cast<size_t>(num_top_submaps_));
+  std::partial_sort(
+      submap_costs.begin(), submap_costs.begin() + num_top_submaps,
+      submap_costs.end(), [](const SubmapCost& lhs, const SubmapCost& rhs) {
+        return lhs.seconds > rhs.seconds ||
+               (lhs.seconds == rhs.seconds && lhs.submap_id < rhs.submap_id);
+      });
+  submap_costs.resize(num_top_submaps);
+  return submap_costs;
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_COST_ATTRIBUTION_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_COST_ATTRIBUTION_H_
+
+#include <array>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/metrics/metrics.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Accumulates the time loop closure spends per submap and per trajectory, so
+// that pathological areas of a map can be found, e.g. a submap attracting
+// thousands of failing constraint searches, or a trajectory whose sensor data
+// inflates the optimization. Times are the elapsed seconds of the work items,
+// like the other timing metrics.
+//
+// Per-trajectory totals are exported as counters labeled by trajectory ID and
+// stage. Labeling by submap ID would create a metric per submap, so only the
+// costliest submaps are exported, as gauges labeled by their rank.
+//
+// This class is thread-safe.
+class CostAttribution {
+ public:
+  enum class Stage {
+    kConstraintSearch,
+    kScanMatcherConstruction,
+    kOptimization
+  };
+
+  struct SubmapCost {
+    SubmapId submap_id;
+    double seconds;
+    int64 num_searches;
+    int64 num_found_constraints;
+  };
+
+  explicit CostAttribution(int num_top_submaps);
+
+  CostAttribution(const CostAttribution&) = delete;
+  CostAttribution& operator=(const CostAttribution&) = delete;
+
+  // Exports the costs to 'registry', including those added before.
+  void RegisterMetrics(metrics::Registry* registry) EXCLUDES(mutex_);
+
+  // Adds a constraint search of a node of 'node_trajectory_id' against the
+  // submap with 'submap_id'. It counts for the submap and the node's
+  // trajectory.
+  void AddConstraintSearch(const SubmapId& submap_id, int node_trajectory_id,
+                           double seconds, bool found_constraint)
+      EXCLUDES(mutex_);
+
+  // Adds the construction of the scan matcher for 'submap_id', i.e. of its
+  // precomputation grids.
+  void AddScanMatcherConstruction(const SubmapId& submap_id, double seconds)
+      EXCLUDES(mutex_);
+
+  // Splits the 'seconds' of an optimization among the trajectories in
+  // proportion to 'weights', indexed by trajectory ID, e.g. the amount of
+  // their data in the optimization problem.
+  void AddOptimization(double seconds, const std::vector<int64>& weights)
+      EXCLUDES(mutex_);
+
+  // Forgets the costs of a trimmed submap, so that it is no longer ranked.
+  void RemoveSubmap(const SubmapId& submap_id) EXCLUDES(mutex_);
+
+  // Forgets the costs of a trajectory without data and of its submaps. The
+  // exported counters keep their values.
+  void RemoveTrajectory(int trajectory_id) EXCLUDES(mutex_);
+
+  // Returns the 'num_top_submaps' submaps with the most seconds, costliest
+  // first.
+  std::vector<SubmapCost> GetTopSubmaps() const EXCLUDES(mutex_);
+
+  // Updates the exported gauges of the costliest submaps. This sorts all
+  // submaps, so it is called after optimizations rather than per search.
+  void PublishTopSubmaps() EXCLUDES(mutex_);
+
+ private:
+  static constexpr int kNumStages = 3;
+
+  struct TrajectoryMetrics {
+    std::array<metrics::Counter*, kNumStages> seconds;
+    std::array<metrics::Counter*, kNumStages> num_work_items;
+  };
+
+  struct TopSubmapMetrics {
+    metrics::Gauge* seconds;
+    metrics::Gauge* trajectory_id;
+    metrics::Gauge* submap_index;
+    metrics::Gauge* num_searches;
+    metrics::Gauge* num_found_constraints;
+  };
+
+  struct TrajectoryCost {
+    std::array<double, kNumStages> seconds = {};
+    std::array<int64, kNumStages> num_work_items = {};
+  };
+
+  void AddTrajectoryCost(int trajectory_id, Stage stage, double seconds,
+                         int64 num_work_items) REQUIRES(mutex_);
+  TrajectoryMetrics* GetTrajectoryMetrics(int trajectory_id) REQUIRES(mutex_);
+  std::vector<SubmapCost> GetTopSubmapsLocked() const REQUIRES(mutex_);
+
+  const int num_top_submaps_;
+  mutable common::Mutex mutex_;
+  std::map<SubmapId, SubmapCost> submap_costs_ GUARDED_BY(mutex_);
+  std::map<int, TrajectoryCost> trajectory_costs_ GUARDED_BY(mutex_);
+
+  // Set by RegisterMetrics().
+  metrics::Registry* registry_ GUARDED_BY(mutex_) = nullptr;
+  std::map<int, TrajectoryMetrics> trajectory_metrics_ GUARDED_BY(mutex_);
+  std::vector<TopSubmapMetrics> top_submap_metrics_ GUARDED_BY(mutex_);
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_COST_ATTRIBUTION_H_
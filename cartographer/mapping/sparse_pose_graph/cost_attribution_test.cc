@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/cost_attribution.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+TEST(CostAttributionTest, RanksSubmapsByTime) {
+  CostAttribution cost_attribution(2);
+  cost_attribution.AddConstraintSearch(SubmapId{0, 0}, 0, 1., false);
+  cost_attribution.AddConstraintSearch(SubmapId{0, 1}, 1, 2., true);
+  cost_attribution.AddConstraintSearch(SubmapId{0, 1}, 0, 2., false);
+  cost_attribution.AddScanMatcherConstruction(SubmapId{1, 0}, 3.);
+  const std::vector<CostAttribution::SubmapCost> top_submaps =
+      cost_attribution.GetTopSubmaps();
+  ASSERT_EQ(2, top_submaps.size());
+  EXPECT_EQ((SubmapId{0, 1}), top_submaps[0].submap_id);
+  EXPECT_NEAR(4., top_submaps[0].seconds, 1e-9);
+  EXPECT_EQ(2, top_submaps[0].num_searches);
+  EXPECT_EQ(1, top_submaps[0].num_found_constraints);
+  EXPECT_EQ((SubmapId{1, 0}), top_submaps[1].submap_id);
+  EXPECT_EQ(0, top_submaps[1].num_searches);
+}
+
+TEST(CostAttributionTest, ForgetsRemovedSubmapsAndTrajectories) {
+  CostAttribution cost_attribution(3);
+  cost_attribution.AddConstraintSearch(SubmapId{0, 0}, 0, 3., false);
+  cost_attribution.AddConstraintSearch(SubmapId{0, 1}, 0, 2., false);
+  cost_attribution.AddConstraintSearch(SubmapId{1, 0}, 0, 1., false);
+  cost_attribution.AddConstraintSearch(SubmapId{1, 1}, 0, 0.5, false);
+  cost_attribution.RemoveSubmap(SubmapId{0, 1});
+  cost_attribution.RemoveTrajectory(1);
+  const std::vector<CostAttribution::SubmapCost> top_submaps =
+      cost_attribution.GetTopSubmaps();
+  ASSERT_EQ(1, top_submaps.size());
+  EXPECT_EQ((SubmapId{0, 0}), top_submaps[0].submap_id);
+}
+
+TEST(CostAttributionTest, ExportsCostsPerTrajectory) {
+  CostAttribution cost_attribution(1);
+  // Costs added before the registration are exported as well.
+  cost_attribution.AddConstraintSearch(SubmapId{0, 0}, 1, 0.5, true);
+  metrics::Registry registry;
+  cost_attribution.RegisterMetrics(&registry);
+  cost_attribution.AddConstraintSearch(SubmapId{0, 0}, 1, 1.5, false);
+  cost_attribution.AddOptimization(4., {1, 3});
+  cost_attribution.AddOptimization(4., {});
+  const auto get_counter = [&registry](const string& name, int trajectory_id,
+                                       const string& stage) {
+    return registry
+        .GetCounter(name, "",
+                    {{"trajectory_id", std::to_string(trajectory_id)},
+                     {"stage", stage}})
+        ->Value();
+  };
+  EXPECT_NEAR(2., get_counter("cartographer_loop_closure_seconds_total", 1,
+                              "constraint_search"),
+              1e-9);
+  EXPECT_EQ(2, get_counter("cartographer_loop_closure_work_items_total", 1,
+                           "constraint_search"));
+  EXPECT_NEAR(1., get_counter("cartographer_loop_closure_seconds_total", 0,
+                              "optimization"),
+              1e-9);
+  EXPECT_NEAR(3., get_counter("cartographer_loop_closure_seconds_total", 1,
+                              "optimization"),
+              1e-9);
+  EXPECT_EQ(1, get_counter("cartographer_loop_closure_work_items_total", 1,
+                           "optimization"));
+
+  cost_attribution.PublishTopSubmaps();
+  const metrics::Labels rank_labels = {{"rank", "0"}};
+  EXPECT_NEAR(
+      2., registry
+              .GetGauge("cartographer_loop_closure_top_submap_seconds", "",
+                        rank_labels)
+              ->Value(),
+      1e-9);
+  EXPECT_EQ(0, registry
+                   .GetGauge("cartographer_loop_closure_top_submap_index", "",
+                             rank_labels)
+                   ->Value());
+  EXPECT_EQ(2, registry
+                   .GetGauge("cartographer_loop_closure_top_submap_searches",
+                             "", rank_labels)
+                   ->Value());
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/cross_trajectory_search_budget.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+CrossTrajectorySearchBudget::CrossTrajectorySearchBudget(
+    const double area_size, const int max_searches_per_area)
+    : area_size_(area_size), max_searches_per_area_(max_searches_per_area) {
+  CHECK_GE(area_size_, 0.);
+  CHECK_GE(max_searches_per_area_, 0);
+}
+
+void CrossTrajectorySearchBudget::SetComponents(
+    const std::vector<std::vector<int>>& components) {
+  std::unordered_map<int, int> component_ids;
+  for (const std::vector<int>& component : components) {
+    if (component.empty()) {
+      continue;
+    }
+    const int component_id =
+        *std::min_element(component.begin(), component.end());
+    for (const int trajectory_id : component) {
+      if (trajectory_id != component_id) {
+        component_ids[trajectory_id] = component_id;
+      }
+    }
+  }
+  if (component_ids != component_ids_) {
+    component_ids_ = std::move(component_ids);
+    Refill();
+  }
+}
+
+void CrossTrajectorySearchBudget::Refill() { num_searches_.clear(); }
+
+bool CrossTrajectorySearchBudget::TryAcquire(
+    const int node_trajectory_id, const Eigen::Vector2d& node_position,
+    const int submap_trajectory_id, const Eigen::Vector2d& submap_position) {
+  CHECK_NE(node_trajectory_id, submap_trajectory_id);
+  if (!enabled()) {
+    return true;
+  }
+  const int node_component_id = GetComponentId(node_trajectory_id);
+  const int submap_component_id = GetComponentId(submap_trajectory_id);
+  const Eigen::Vector2d& position = node_component_id <= submap_component_id
+                                        ? node_position
+                                        : submap_position;
+  const AreaKey key(std::min(node_component_id, submap_component_id),
+                    std::max(node_component_id, submap_component_id),
+                    std::floor(position.x() / area_size_),
+                    std::floor(position.y() / area_size_));
+  int& num_searches = num_searches_[key];
+  if (num_searches >= max_searches_per_area_) {
+    ++num_rejected_searches_;
+    return false;
+  }
+  ++num_searches;
+  return true;
+}
+
+int CrossTrajectorySearchBudget::GetComponentId(const int trajectory_id) const {
+  const auto it = component_ids_.find(trajectory_id);
+  return it != component_ids_.end() ? it->second : trajectory_id;
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
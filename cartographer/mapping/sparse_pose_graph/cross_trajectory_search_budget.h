@@ -0,0 +1,97 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CROSS_TRAJECTORY_SEARCH_BUDGET_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CROSS_TRAJECTORY_SEARCH_BUDGET_H_
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Limits the constraint searches between nodes and submaps of different
+// trajectories to a budget per square area in the xy-plane. Where several
+// robots cover the same area, matching nodes of A against submaps of B and
+// nodes of B against submaps of A, or each of them against a third
+// trajectory, mostly finds redundant constraints.
+//
+// Positions are only comparable within a connected component of
+// trajectories, so the budget of an area belongs to the pair of components
+// of the node and the submap, and the area is found in the frame of the one
+// with the lower ID. Searches in either direction share it, and once
+// trajectories are connected, all of them share the budget of an area.
+//
+// Searches that found nothing must not block an area for good, e.g. when
+// robots only overlap later or a new robot is localized in an existing map,
+// so the budget is refilled after every optimization.
+//
+// This class is not thread-safe.
+class CrossTrajectorySearchBudget {
+ public:
+  // Disabled if 'area_size' is 0.
+  CrossTrajectorySearchBudget(double area_size, int max_searches_per_area);
+
+  CrossTrajectorySearchBudget(const CrossTrajectorySearchBudget&) = delete;
+  CrossTrajectorySearchBudget& operator=(const CrossTrajectorySearchBudget&) =
+      delete;
+
+  bool enabled() const { return area_size_ > 0.; }
+
+  // Sets the connected components of trajectories, e.g. from
+  // TrajectoryConnectivityState::Components(). Other trajectories are a
+  // component of their own. If the components changed, the frames in which
+  // areas were found did too, and all budgets are refilled.
+  void SetComponents(const std::vector<std::vector<int>>& components);
+
+  // Returns false if the budget of the area of a search between the node at
+  // 'node_position' and the submap at 'submap_position' is used up. Otherwise
+  // counts the search and returns true. The trajectories must differ.
+  bool TryAcquire(int node_trajectory_id, const Eigen::Vector2d& node_position,
+                  int submap_trajectory_id,
+                  const Eigen::Vector2d& submap_position);
+
+  // Refills the budget of all areas.
+  void Refill();
+
+  // Number of searches for which TryAcquire() returned false.
+  int num_rejected_searches() const { return num_rejected_searches_; }
+
+ private:
+  // Lower and higher component ID, then the cell index.
+  using AreaKey = std::tuple<int, int, int64, int64>;
+
+  int GetComponentId(int trajectory_id) const;
+
+  const double area_size_;
+  const int max_searches_per_area_;
+  // Maps trajectory IDs to the lowest trajectory ID of their component.
+  std::unordered_map<int, int> component_ids_;
+  std::map<AreaKey, int> num_searches_;
+  int num_rejected_searches_ = 0;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_CROSS_TRAJECTORY_SEARCH_BUDGET_H_
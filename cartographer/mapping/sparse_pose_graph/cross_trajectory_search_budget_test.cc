@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/cross_trajectory_search_budget.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+TEST(CrossTrajectorySearchBudgetTest, DisabledAcceptsAll) {
+  CrossTrajectorySearchBudget budget(0., 0);
+  EXPECT_FALSE(budget.enabled());
+  for (int i = 0; i != 10; ++i) {
+    EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d::Zero(), 1,
+                                  Eigen::Vector2d::Zero()));
+  }
+  EXPECT_EQ(0, budget.num_rejected_searches());
+}
+
+TEST(CrossTrajectorySearchBudgetTest, SharesBudgetOfBothDirections) {
+  CrossTrajectorySearchBudget budget(10., 2);
+  // The area is found in the frame of trajectory 0 in either direction, the
+  // positions in the frame of trajectory 1 do not matter.
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(1., 1.), 1,
+                                Eigen::Vector2d(100., 0.)));
+  EXPECT_TRUE(budget.TryAcquire(1, Eigen::Vector2d(-50., 0.), 0,
+                                Eigen::Vector2d(9., 9.)));
+  EXPECT_FALSE(budget.TryAcquire(0, Eigen::Vector2d(5., 5.), 1,
+                                 Eigen::Vector2d(0., 0.)));
+  EXPECT_EQ(1, budget.num_rejected_searches());
+  // Other areas and other pairs of trajectories have their own budget.
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(11., 5.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(-1., 5.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_TRUE(budget.TryAcquire(2, Eigen::Vector2d(0., 0.), 0,
+                                Eigen::Vector2d(5., 5.)));
+}
+
+TEST(CrossTrajectorySearchBudgetTest, SharesBudgetWithinComponents) {
+  CrossTrajectorySearchBudget budget(10., 2);
+  budget.SetComponents({{0, 1, 2}, {3}});
+  // Connected trajectories share the frame and the budget of an area.
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(1., 1.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_TRUE(budget.TryAcquire(2, Eigen::Vector2d(2., 2.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_FALSE(budget.TryAcquire(1, Eigen::Vector2d(3., 3.), 2,
+                                 Eigen::Vector2d(0., 0.)));
+  // Searches against trajectory 3 are counted in the frame of the component
+  // of trajectories 0, 1 and 2.
+  EXPECT_TRUE(budget.TryAcquire(3, Eigen::Vector2d(50., 50.), 1,
+                                Eigen::Vector2d(1., 1.)));
+  EXPECT_TRUE(budget.TryAcquire(2, Eigen::Vector2d(2., 2.), 3,
+                                Eigen::Vector2d(-50., 50.)));
+  EXPECT_FALSE(budget.TryAcquire(0, Eigen::Vector2d(3., 3.), 3,
+                                 Eigen::Vector2d(50., 50.)));
+  EXPECT_EQ(2, budget.num_rejected_searches());
+}
+
+TEST(CrossTrajectorySearchBudgetTest, RefillsBudget) {
+  CrossTrajectorySearchBudget budget(10., 1);
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(1., 1.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_FALSE(budget.TryAcquire(0, Eigen::Vector2d(2., 2.), 1,
+                                 Eigen::Vector2d(0., 0.)));
+  budget.Refill();
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(2., 2.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_FALSE(budget.TryAcquire(0, Eigen::Vector2d(3., 3.), 1,
+                                 Eigen::Vector2d(0., 0.)));
+  // Setting the same components again keeps the budget, connecting
+  // trajectories refills it.
+  budget.SetComponents({{0}, {1}});
+  EXPECT_FALSE(budget.TryAcquire(0, Eigen::Vector2d(3., 3.), 1,
+                                 Eigen::Vector2d(0., 0.)));
+  budget.SetComponents({{0, 1}, {2}});
+  EXPECT_TRUE(budget.TryAcquire(0, Eigen::Vector2d(3., 3.), 1,
+                                Eigen::Vector2d(0., 0.)));
+  EXPECT_EQ(3, budget.num_rejected_searches());
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/load_shedding_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cartographer/common/math.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+proto::LoadSheddingOptions CreateLoadSheddingOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::LoadSheddingOptions options;
+  options.set_min_backlog_scans(
+      parameter_dictionary->GetNonNegativeInt("min_backlog_scans"));
+  options.set_max_backlog_scans(
+      parameter_dictionary->GetNonNegativeInt("max_backlog_scans"));
+  options.set_min_backlog_seconds(
+      parameter_dictionary->GetDouble("min_backlog_seconds"));
+  options.set_max_backlog_seconds(
+      parameter_dictionary->GetDouble("max_backlog_seconds"));
+  options.set_min_sampling_ratio_factor(
+      parameter_dictionary->GetDouble("min_sampling_ratio_factor"));
+  options.set_skip_global_localization_at_max_load(
+      parameter_dictionary->GetBool("skip_global_localization_at_max_load"));
+  options.set_max_optimize_every_n_scans_factor(
+      parameter_dictionary->GetDouble("max_optimize_every_n_scans_factor"));
+  CHECK(options.max_backlog_scans() == 0 ||
+        options.max_backlog_scans() > options.min_backlog_scans());
+  CHECK_GE(options.min_backlog_seconds(), 0.);
+  CHECK(options.max_backlog_seconds() == 0. ||
+        options.max_backlog_seconds() > options.min_backlog_seconds());
+  CHECK_GT(options.min_sampling_ratio_factor(), 0.);
+  CHECK_LE(options.min_sampling_ratio_factor(), 1.);
+  CHECK_GE(options.max_optimize_every_n_scans_factor(), 1.);
+  return options;
+}
+
+LoadSheddingController::LoadSheddingController(
+    const proto::LoadSheddingOptions& options)
+    : options_(options) {}
+
+void LoadSheddingController::Update(const int backlog_scans) {
+  Update(backlog_scans, 0.);
+}
+
+void LoadSheddingController::Update(const int backlog_scans,
+                                    const double backlog_seconds) {
+  double load = 0.;
+  if (options_.max_backlog_scans() != 0) {
+    load = common::Clamp(
+        static_cast<double>(backlog_scans - options_.min_backlog_scans()) /
+            (options_.max_backlog_scans() - options_.min_backlog_scans()),
+        0., 1.);
+  }
+  if (options_.max_backlog_seconds() != 0.) {
+    load = std::max(
+        load, common::Clamp((backlog_seconds - options_.min_backlog_seconds()) /
+                                (options_.max_backlog_seconds() -
+                                 options_.min_backlog_seconds()),
+                            0., 1.));
+  }
+  if (load > 0. && load_ == 0.) {
+    LOG(WARNING) << "Loop closure is " << backlog_scans << " scans and "
+                 << backlog_seconds << " s of searches behind, shedding load.";
+  } else if (load == 0. && load_ > 0.) {
+    LOG(INFO) << "Loop closure caught up, stopped shedding load.";
+  }
+  load_ = load;
+}
+
+double LoadSheddingController::sampling_ratio_factor() const {
+  return 1. - load_ * (1. - options_.min_sampling_ratio_factor());
+}
+
+bool LoadSheddingController::skip_global_localization() const {
+  return options_.skip_global_localization_at_max_load() && load_ == 1.;
+}
+
+int LoadSheddingController::ScaleOptimizeEveryNScans(
+    const int optimize_every_n_scans) const {
+  return std::lround(
+      optimize_every_n_scans *
+      (1. + load_ * (options_.max_optimize_every_n_scans_factor() - 1.)));
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_LOAD_SHEDDING_CONTROLLER_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_LOAD_SHEDDING_CONTROLLER_H_
+
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/mapping/sparse_pose_graph/proto/load_shedding_options.pb.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+proto::LoadSheddingOptions CreateLoadSheddingOptions(
+    common::LuaParameterDictionary* parameter_dictionary);
+
+// Decides how much loop closure work to shed, depending on how far the sparse
+// pose graph is behind. Load shedding is reduced again as soon as the backlog
+// shrinks, and stops once it is gone.
+//
+// This class is not thread-safe.
+class LoadSheddingController {
+ public:
+  explicit LoadSheddingController(const proto::LoadSheddingOptions& options);
+
+  LoadSheddingController(const LoadSheddingController&) = delete;
+  LoadSheddingController& operator=(const LoadSheddingController&) = delete;
+
+  // Updates the load from the number of scans waiting for their constraint
+  // search.
+  void Update(int backlog_scans);
+  // Same as above, but also considers the expected run time in seconds of the
+  // constraint searches which did not finish yet.
+  void Update(int backlog_scans, double backlog_seconds);
+
+  // Returns the load between 0 (no load shedding) and 1 (maximum load
+  // shedding).
+  double load() const { return load_; }
+
+  // Returns the factor to scale sampling ratios by.
+  double sampling_ratio_factor() const;
+
+  // Returns true if global localization should not be attempted.
+  bool skip_global_localization() const;
+
+  // Returns 'optimize_every_n_scans' scaled for the current load.
+  int ScaleOptimizeEveryNScans(int optimize_every_n_scans) const;
+
+ private:
+  const proto::LoadSheddingOptions options_;
+  double load_ = 0.;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_LOAD_SHEDDING_CONTROLLER_H_
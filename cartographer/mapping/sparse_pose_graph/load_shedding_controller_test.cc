@@ -0,0 +1,94 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/load_shedding_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+proto::LoadSheddingOptions CreateOptions() {
+  proto::LoadSheddingOptions options;
+  options.set_min_backlog_scans(10);
+  options.set_max_backlog_scans(30);
+  options.set_min_sampling_ratio_factor(0.2);
+  options.set_skip_global_localization_at_max_load(true);
+  options.set_max_optimize_every_n_scans_factor(3.);
+  return options;
+}
+
+TEST(LoadSheddingControllerTest, NoLoadSheddingBelowMinBacklog) {
+  LoadSheddingController controller(CreateOptions());
+  controller.Update(10);
+  EXPECT_EQ(0., controller.load());
+  EXPECT_EQ(1., controller.sampling_ratio_factor());
+  EXPECT_FALSE(controller.skip_global_localization());
+  EXPECT_EQ(90, controller.ScaleOptimizeEveryNScans(90));
+}
+
+TEST(LoadSheddingControllerTest, InterpolatesAndRecovers) {
+  LoadSheddingController controller(CreateOptions());
+  controller.Update(20);
+  EXPECT_NEAR(0.5, controller.load(), 1e-9);
+  EXPECT_NEAR(0.6, controller.sampling_ratio_factor(), 1e-9);
+  EXPECT_FALSE(controller.skip_global_localization());
+  EXPECT_EQ(180, controller.ScaleOptimizeEveryNScans(90));
+  controller.Update(100);
+  EXPECT_EQ(1., controller.load());
+  EXPECT_NEAR(0.2, controller.sampling_ratio_factor(), 1e-9);
+  EXPECT_TRUE(controller.skip_global_localization());
+  EXPECT_EQ(270, controller.ScaleOptimizeEveryNScans(90));
+  controller.Update(0);
+  EXPECT_EQ(0., controller.load());
+  EXPECT_EQ(1., controller.sampling_ratio_factor());
+  EXPECT_FALSE(controller.skip_global_localization());
+}
+
+TEST(LoadSheddingControllerTest, BacklogSeconds) {
+  proto::LoadSheddingOptions options = CreateOptions();
+  options.set_max_backlog_scans(0);
+  options.set_min_backlog_seconds(1.);
+  options.set_max_backlog_seconds(3.);
+  LoadSheddingController controller(options);
+  controller.Update(1000, 0.5);
+  EXPECT_EQ(0., controller.load());
+  controller.Update(1000, 2.);
+  EXPECT_NEAR(0.5, controller.load(), 1e-9);
+  // With both backlogs considered, the higher load is used.
+  options.set_max_backlog_scans(30);
+  LoadSheddingController combined_controller(options);
+  combined_controller.Update(25, 2.);
+  EXPECT_NEAR(0.75, combined_controller.load(), 1e-9);
+  combined_controller.Update(15, 2.5);
+  EXPECT_NEAR(0.75, combined_controller.load(), 1e-9);
+}
+
+TEST(LoadSheddingControllerTest, Disabled) {
+  proto::LoadSheddingOptions options = CreateOptions();
+  options.set_max_backlog_scans(0);
+  LoadSheddingController controller(options);
+  controller.Update(1000);
+  EXPECT_EQ(0., controller.load());
+  EXPECT_FALSE(controller.skip_global_localization());
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
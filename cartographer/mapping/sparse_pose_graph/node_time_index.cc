@@ -0,0 +1,97 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/node_time_index.h"
+
+#include <iterator>
+
+#include "cartographer/transform/transform_interpolation_buffer.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+void NodeTimeIndex::Insert(const NodeId& node_id, const common::Time time) {
+  auto& nodes = trajectories_[node_id.trajectory_id];
+  // Nodes are usually added in time order, in which case the hint makes
+  // insertion constant time.
+  nodes.emplace_hint(nodes.end(), time, node_id.node_index);
+}
+
+void NodeTimeIndex::Remove(const NodeId& node_id, const common::Time time) {
+  auto& nodes = trajectories_.at(node_id.trajectory_id);
+  const auto range = nodes.equal_range(time);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == node_id.node_index) {
+      nodes.erase(it);
+      return;
+    }
+  }
+  LOG(FATAL) << "Node " << node_id << " is not in the index.";
+}
+
+bool NodeTimeIndex::LookupPoses(const int trajectory_id,
+                                const std::vector<common::Time>& times,
+                                const GetPoseFunction& get_pose,
+                                std::vector<transform::Rigid3d>* const poses)
+    const {
+  poses->clear();
+  if (times.empty()) {
+    return true;
+  }
+  const auto trajectory_it = trajectories_.find(trajectory_id);
+  if (trajectory_it == trajectories_.end() || trajectory_it->second.empty()) {
+    return false;
+  }
+  const auto& nodes = trajectory_it->second;
+  if (times.front() < nodes.begin()->first ||
+      times.back() > nodes.rbegin()->first) {
+    return false;
+  }
+  poses->reserve(times.size());
+  auto end = nodes.lower_bound(times.front());
+  for (size_t i = 0; i != times.size(); ++i) {
+    const common::Time time = times[i];
+    if (i != 0) {
+      CHECK_LE(times[i - 1], time) << "Lookup times are not sorted.";
+    }
+    // Same as std::lower_bound(), continuing from the previous time. Usually
+    // only a few nodes lie between consecutive times.
+    while (end->first < time) {
+      ++end;
+    }
+    const NodeId end_node_id{trajectory_id, end->second};
+    if (end->first == time) {
+      poses->push_back(get_pose(end_node_id));
+    } else {
+      const auto start = std::prev(end);
+      poses->push_back(transform::InterpolateTransform(
+          start->first, get_pose(NodeId{trajectory_id, start->second}),
+          end->first, get_pose(end_node_id), time));
+    }
+  }
+  return true;
+}
+
+int NodeTimeIndex::num_nodes(const int trajectory_id) const {
+  const auto it = trajectories_.find(trajectory_id);
+  return it == trajectories_.end() ? 0 : it->second.size();
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_NODE_TIME_INDEX_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_NODE_TIME_INDEX_H_
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Sorts the nodes of each trajectory by time, so that the nodes around a time
+// are found by binary search instead of looking at all nodes.
+class NodeTimeIndex {
+ public:
+  // Returns the pose of a node which is in the index.
+  using GetPoseFunction = std::function<transform::Rigid3d(const NodeId&)>;
+
+  // Inserts 'node_id' with its 'time'. Nodes do not need to be inserted in
+  // time order.
+  void Insert(const NodeId& node_id, common::Time time);
+
+  // Removes 'node_id' which was inserted with 'time'.
+  void Remove(const NodeId& node_id, common::Time time);
+
+  // Fills in the 'poses' of the trajectory with 'trajectory_id' at the
+  // 'times', which must be sorted in ascending order, interpolated between the
+  // poses of the nodes right before and after each time. Walks the index once
+  // for all 'times'. Returns false if a time is outside the time span of the
+  // nodes.
+  bool LookupPoses(int trajectory_id, const std::vector<common::Time>& times,
+                   const GetPoseFunction& get_pose,
+                   std::vector<transform::Rigid3d>* poses) const;
+
+  // Returns the number of nodes of 'trajectory_id' in the index.
+  int num_nodes(int trajectory_id) const;
+
+ private:
+  // Node indices by time for each trajectory.
+  std::map<int, std::multimap<common::Time, int>> trajectories_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_NODE_TIME_INDEX_H_
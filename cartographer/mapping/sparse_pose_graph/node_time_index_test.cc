@@ -0,0 +1,80 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/node_time_index.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+// Node 'i' is at 'x = 10 * i' and inserted with 'NodeTime(i)'.
+common::Time NodeTime(const int node_index) {
+  return common::FromUniversal(10 * node_index);
+}
+
+transform::Rigid3d GetPose(const NodeId& node_id) {
+  return transform::Rigid3d::Translation(
+      Eigen::Vector3d(10. * node_id.node_index, 0., 0.));
+}
+
+TEST(NodeTimeIndexTest, LookupPoses) {
+  NodeTimeIndex index;
+  // Inserted out of order.
+  for (const int node_index : {0, 2, 1, 3}) {
+    index.Insert(NodeId{0, node_index}, NodeTime(node_index));
+  }
+  EXPECT_EQ(4, index.num_nodes(0));
+  EXPECT_EQ(0, index.num_nodes(1));
+
+  std::vector<transform::Rigid3d> poses;
+  ASSERT_TRUE(index.LookupPoses(
+      0, {NodeTime(0), NodeTime(0), common::FromUniversal(15), NodeTime(3)},
+      GetPose, &poses));
+  ASSERT_EQ(4, poses.size());
+  EXPECT_NEAR(0., poses[0].translation().x(), 1e-9);
+  EXPECT_NEAR(0., poses[1].translation().x(), 1e-9);
+  EXPECT_NEAR(15., poses[2].translation().x(), 1e-9);
+  EXPECT_NEAR(30., poses[3].translation().x(), 1e-9);
+
+  EXPECT_TRUE(index.LookupPoses(0, {}, GetPose, &poses));
+  EXPECT_TRUE(poses.empty());
+  EXPECT_FALSE(index.LookupPoses(0, {NodeTime(4)}, GetPose, &poses));
+  EXPECT_FALSE(index.LookupPoses(1, {NodeTime(0)}, GetPose, &poses));
+}
+
+TEST(NodeTimeIndexTest, Remove) {
+  NodeTimeIndex index;
+  for (int node_index = 0; node_index != 4; ++node_index) {
+    index.Insert(NodeId{0, node_index}, NodeTime(node_index));
+  }
+  index.Remove(NodeId{0, 1}, NodeTime(1));
+  index.Remove(NodeId{0, 3}, NodeTime(3));
+  EXPECT_EQ(2, index.num_nodes(0));
+
+  std::vector<transform::Rigid3d> poses;
+  ASSERT_TRUE(index.LookupPoses(0, {NodeTime(1)}, GetPose, &poses));
+  ASSERT_EQ(1, poses.size());
+  EXPECT_NEAR(10., poses[0].translation().x(), 1e-9);
+  EXPECT_FALSE(index.LookupPoses(0, {NodeTime(3)}, GetPose, &poses));
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
@@ -40,6 +40,13 @@ proto::OptimizationProblemOptions CreateOptimizationProblemOptions(
       parameter_dictionary->GetDouble("fixed_frame_pose_translation_weight"));
   options.set_fixed_frame_pose_rotation_weight(
       parameter_dictionary->GetDouble("fixed_frame_pose_rotation_weight"));
+  options.set_sliding_window_num_nodes(
+      parameter_dictionary->GetNonNegativeInt("sliding_window_num_nodes"));
+  options.set_solve_connected_components_in_parallel(
+      parameter_dictionary->GetBool("solve_connected_components_in_parallel"));
+  options.set_min_num_iterations_before_interrupt(
+      parameter_dictionary->GetNonNegativeInt(
+          "min_num_iterations_before_interrupt"));
   options.set_log_solver_summary(
       parameter_dictionary->GetBool("log_solver_summary"));
   *options.mutable_ceres_solver_options() =
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/place_descriptor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cartographer/common/math.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+namespace {
+
+// Points within 2^(n / kRingsPerOctave) - 1 meters of the origin fall into ring
+// n, i.e. the rings get wider with the distance, covering up to 255 meters.
+constexpr int kRingsPerOctave = 4;
+constexpr int kNumRings = 8 * kRingsPerOctave;
+
+Eigen::VectorXf ComputeRingHistogram(
+    const sensor::PointCloud& gravity_aligned_point_cloud) {
+  Eigen::VectorXf histogram = Eigen::VectorXf::Zero(kNumRings);
+  for (const Eigen::Vector3f& point : gravity_aligned_point_cloud) {
+    const float distance = point.head<2>().norm();
+    const int ring = common::Clamp<int>(
+        static_cast<int>(kRingsPerOctave * std::log2(1.f + distance)), 0,
+        kNumRings - 1);
+    histogram[ring] += 1.f;
+  }
+  return histogram;
+}
+
+// Returns the circular autocorrelation of 'histogram' for shifts of up to half
+// its size. Rotating the point cloud shifts the rotational histogram, which
+// leaves its autocorrelation unchanged.
+Eigen::VectorXf ComputeCircularAutocorrelation(
+    const Eigen::VectorXf& histogram) {
+  const int size = histogram.size();
+  Eigen::VectorXf doubled_histogram(2 * size);
+  doubled_histogram << histogram, histogram;
+  Eigen::VectorXf result(size / 2 + 1);
+  for (int shift = 0; shift != result.size(); ++shift) {
+    result[shift] = histogram.dot(doubled_histogram.segment(shift, size));
+  }
+  return result;
+}
+
+void NormalizeIfNonZero(Eigen::VectorXf* const descriptor) {
+  const float norm = descriptor->norm();
+  if (norm > 0.f) {
+    *descriptor /= norm;
+  }
+}
+
+}  // namespace
+
+Eigen::VectorXf ComputePlaceDescriptor(
+    const TrajectoryNode::Data& constant_data) {
+  if (constant_data.compressed_point_clouds != nullptr) {
+    return ComputePlaceDescriptor(DecompressPointClouds(constant_data));
+  }
+  // In 2D, only the 'filtered_gravity_aligned_point_cloud' is set, in 3D the
+  // 'high_resolution_point_cloud' is in the tracking frame.
+  Eigen::VectorXf ring_histogram =
+      constant_data.filtered_gravity_aligned_point_cloud.empty()
+          ? ComputeRingHistogram(sensor::TransformPointCloud(
+                constant_data.high_resolution_point_cloud,
+                transform::Rigid3f::Rotation(
+                    constant_data.gravity_alignment.cast<float>())))
+          : ComputeRingHistogram(
+                constant_data.filtered_gravity_aligned_point_cloud);
+  NormalizeIfNonZero(&ring_histogram);
+  if (constant_data.rotational_scan_matcher_histogram.size() == 0) {
+    return ring_histogram;
+  }
+  Eigen::VectorXf autocorrelation = ComputeCircularAutocorrelation(
+      constant_data.rotational_scan_matcher_histogram);
+  NormalizeIfNonZero(&autocorrelation);
+  Eigen::VectorXf descriptor(ring_histogram.size() + autocorrelation.size());
+  descriptor << ring_histogram, autocorrelation;
+  NormalizeIfNonZero(&descriptor);
+  return descriptor;
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
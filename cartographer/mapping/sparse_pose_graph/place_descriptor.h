@@ -0,0 +1,41 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_PLACE_DESCRIPTOR_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_PLACE_DESCRIPTOR_H_
+
+#include "Eigen/Core"
+#include "cartographer/mapping/trajectory_node.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Returns a compact descriptor of the surroundings of a node which does not
+// depend on its yaw, so that nodes observing the same place from unrelated
+// trajectories can be found by comparing descriptors. It consists of a
+// histogram of the horizontal distances of the gravity aligned points in
+// logarithmically growing rings and, in 3D, of the circular autocorrelation of
+// the 'rotational_scan_matcher_histogram'. The descriptor has unit length
+// unless there are no points, in which case it is zero.
+Eigen::VectorXf ComputePlaceDescriptor(
+    const TrajectoryNode::Data& constant_data);
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_PLACE_DESCRIPTOR_H_
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/place_descriptor.h"
+
+#include <random>
+
+#include "cartographer/transform/rigid_transform.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+sensor::PointCloud CreateRandomPointCloud() {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-20.f, 20.f);
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 500; ++i) {
+    point_cloud.emplace_back(distribution(prng), distribution(prng), 0.f);
+  }
+  return point_cloud;
+}
+
+TEST(PlaceDescriptorTest, InvariantToYaw) {
+  TrajectoryNode::Data constant_data;
+  constant_data.gravity_alignment = Eigen::Quaterniond::Identity();
+  constant_data.filtered_gravity_aligned_point_cloud = CreateRandomPointCloud();
+  constant_data.rotational_scan_matcher_histogram.resize(8);
+  constant_data.rotational_scan_matcher_histogram << 1.f, 5.f, 0.f, 2.f, 0.f,
+      0.f, 3.f, 1.f;
+  const Eigen::VectorXf descriptor = ComputePlaceDescriptor(constant_data);
+  EXPECT_NEAR(1., descriptor.norm(), 1e-5);
+
+  // Rotating the points by 90 degrees shifts the rotational histogram, which
+  // covers 180 degrees, by half of its buckets.
+  TrajectoryNode::Data rotated_constant_data = constant_data;
+  rotated_constant_data.filtered_gravity_aligned_point_cloud =
+      sensor::TransformPointCloud(
+          constant_data.filtered_gravity_aligned_point_cloud,
+          transform::Rigid3f::Rotation(Eigen::AngleAxisf(
+              static_cast<float>(M_PI / 2.), Eigen::Vector3f::UnitZ())));
+  rotated_constant_data.rotational_scan_matcher_histogram << 0.f, 0.f, 3.f,
+      1.f, 1.f, 5.f, 0.f, 2.f;
+  const Eigen::VectorXf rotated_descriptor =
+      ComputePlaceDescriptor(rotated_constant_data);
+  ASSERT_EQ(descriptor.size(), rotated_descriptor.size());
+  EXPECT_NEAR(1., descriptor.dot(rotated_descriptor), 1e-5);
+
+  // Observing the same points from elsewhere changes the descriptor.
+  TrajectoryNode::Data translated_constant_data = constant_data;
+  translated_constant_data.filtered_gravity_aligned_point_cloud =
+      sensor::TransformPointCloud(
+          constant_data.filtered_gravity_aligned_point_cloud,
+          transform::Rigid3f::Translation(Eigen::Vector3f(15.f, 0.f, 0.f)));
+  EXPECT_LT(descriptor.dot(ComputePlaceDescriptor(translated_constant_data)),
+            0.99f);
+}
+
+TEST(PlaceDescriptorTest, NoPoints) {
+  TrajectoryNode::Data constant_data;
+  constant_data.gravity_alignment = Eigen::Quaterniond::Identity();
+  EXPECT_EQ(0.f, ComputePlaceDescriptor(constant_data).norm());
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
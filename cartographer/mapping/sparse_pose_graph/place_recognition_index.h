@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_PLACE_RECOGNITION_INDEX_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_PLACE_RECOGNITION_INDEX_H_
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Keeps place descriptors of IDs, e.g. 'NodeId', see ComputePlaceDescriptor(),
+// to find the IDs most similar to a given descriptor. Similarity is measured
+// by the cosine of the angle between descriptors. Descriptors are compact, so
+// comparing against all of them is cheap compared to a single match against a
+// full submap.
+template <typename IdType>
+class PlaceRecognitionIndex {
+ public:
+  PlaceRecognitionIndex() {}
+
+  // Inserts 'descriptor' for 'id', or replaces the one inserted before.
+  void Insert(const IdType& id, const Eigen::VectorXf& descriptor) {
+    Eigen::VectorXf& normalized_descriptor = descriptors_[id];
+    normalized_descriptor = descriptor;
+    const float norm = descriptor.norm();
+    if (norm > 0.f) {
+      normalized_descriptor /= norm;
+    }
+  }
+
+  // Removes 'id' if it was inserted.
+  void Remove(const IdType& id) { descriptors_.erase(id); }
+
+  // Returns the normalized descriptor of 'id', or nullptr if it was not
+  // inserted.
+  const Eigen::VectorXf* Find(const IdType& id) const {
+    const auto it = descriptors_.find(id);
+    return it != descriptors_.end() ? &it->second : nullptr;
+  }
+
+  // Returns up to 'num_ids' IDs for which 'predicate' is true, most similar to
+  // 'descriptor' first. IDs with descriptors of a different size or without
+  // any similarity are never returned.
+  std::vector<IdType> GetMostSimilar(
+      const Eigen::VectorXf& descriptor, const int num_ids,
+      const std::function<bool(const IdType&)>& predicate) const {
+    std::vector<std::pair<float, IdType>> negated_similarities_and_ids;
+    for (const auto& entry : descriptors_) {
+      if (entry.second.size() != descriptor.size() || !predicate(entry.first)) {
+        continue;
+      }
+      const float similarity = entry.second.dot(descriptor);
+      if (similarity > 0.f) {
+        negated_similarities_and_ids.emplace_back(-similarity, entry.first);
+      }
+    }
+    const int num_results = std::min<int>(num_ids,
+                                          negated_similarities_and_ids.size());
+    std::partial_sort(negated_similarities_and_ids.begin(),
+                      negated_similarities_and_ids.begin() + num_results,
+                      negated_similarities_and_ids.end());
+    std::vector<IdType> result;
+    result.reserve(num_results);
+    for (int i = 0; i != num_results; ++i) {
+      result.push_back(negated_similarities_and_ids[i].second);
+    }
+    return result;
+  }
+
+  int size() const { return descriptors_.size(); }
+
+  // Returns the number of bytes used by the descriptors.
+  int64 GetMemoryUsageInBytes() const {
+    int64 result = 0;
+    for (const auto& entry : descriptors_) {
+      result += sizeof(entry) + entry.second.size() * sizeof(float);
+    }
+    return result;
+  }
+
+ private:
+  std::map<IdType, Eigen::VectorXf> descriptors_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_PLACE_RECOGNITION_INDEX_H_
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/place_recognition_index.h"
+
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+bool AllIds(int) { return true; }
+
+TEST(PlaceRecognitionIndexTest, GetMostSimilar) {
+  PlaceRecognitionIndex<int> index;
+  index.Insert(0, Eigen::Vector3f(1.f, 0.f, 0.f));
+  index.Insert(1, Eigen::Vector3f(2.f, 2.f, 0.f));
+  index.Insert(2, Eigen::Vector3f(0.f, 1.f, 0.f));
+  index.Insert(3, Eigen::Vector3f(0.f, 0.f, 1.f));
+  index.Insert(4, Eigen::Vector2f(1.f, 0.f));
+  EXPECT_EQ(5, index.size());
+  EXPECT_NEAR(1., index.Find(1)->norm(), 1e-6);
+  EXPECT_EQ(nullptr, index.Find(5));
+
+  const Eigen::Vector3f descriptor(1.f, 0.2f, 0.f);
+  EXPECT_THAT(index.GetMostSimilar(descriptor, 2, AllIds), ElementsAre(0, 1));
+  // Orthogonal descriptors and those of a different size are never returned.
+  EXPECT_THAT(index.GetMostSimilar(descriptor, 10, AllIds),
+              ElementsAre(0, 1, 2));
+  EXPECT_THAT(
+      index.GetMostSimilar(descriptor, 2, [](int id) { return id != 0; }),
+      ElementsAre(1, 2));
+  EXPECT_THAT(index.GetMostSimilar(Eigen::Vector3f::Zero(), 2, AllIds),
+              IsEmpty());
+
+  index.Remove(1);
+  index.Insert(2, Eigen::Vector3f(0.f, 0.f, 1.f));
+  EXPECT_THAT(index.GetMostSimilar(descriptor, 10, AllIds), ElementsAre(0));
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
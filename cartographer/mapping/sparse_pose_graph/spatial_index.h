@@ -0,0 +1,159 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_SPATIAL_INDEX_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_SPATIAL_INDEX_H_
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Hashes IDs, e.g. 'SubmapId' or 'NodeId', by their position in the xy-plane
+// into square cells of 'cell_size'. This allows finding all IDs within
+// 'cell_size' of a position without looking at all IDs.
+template <typename IdType>
+class SpatialIndex {
+ public:
+  explicit SpatialIndex(const double cell_size) : cell_size_(cell_size) {
+    CHECK_GT(cell_size_, 0.);
+  }
+
+  // Inserts 'id' at 'position', or moves it there if it was inserted before.
+  void Insert(const IdType& id, const Eigen::Vector2d& position) {
+    const CellIndex cell_index = GetCellIndex(position);
+    const auto it = cell_indices_.find(id);
+    if (it != cell_indices_.end()) {
+      if (it->second == cell_index) {
+        return;
+      }
+      RemoveFromCell(id, it->second);
+      it->second = cell_index;
+    } else {
+      cell_indices_.emplace(id, cell_index);
+    }
+    cells_[cell_index].insert(id);
+  }
+
+  // Removes 'id' if it was inserted.
+  void Remove(const IdType& id) {
+    const auto it = cell_indices_.find(id);
+    if (it == cell_indices_.end()) {
+      return;
+    }
+    RemoveFromCell(id, it->second);
+    cell_indices_.erase(it);
+  }
+
+  // Returns the sorted IDs in the cells around 'position'. These include all
+  // IDs within 'cell_size' of 'position', but may include some further away.
+  std::vector<IdType> GetCandidates(const Eigen::Vector2d& position) const {
+    const CellIndex center = GetCellIndex(position);
+    std::vector<IdType> candidates;
+    for (int64 x = center.first - 1; x <= center.first + 1; ++x) {
+      for (int64 y = center.second - 1; y <= center.second + 1; ++y) {
+        const auto it = cells_.find(CellIndex(x, y));
+        if (it != cells_.end()) {
+          candidates.insert(candidates.end(), it->second.begin(),
+                            it->second.end());
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    return candidates;
+  }
+
+  // Returns the sorted IDs in the cells overlapping 'region' or next to it.
+  // These include all IDs within 'cell_size' of 'region', but may include some
+  // further away. The cost is proportional to the size of the 'region' or the
+  // number of occupied cells, whichever is smaller.
+  std::vector<IdType> GetCandidatesInRegion(
+      const Eigen::AlignedBox2d& region) const {
+    std::vector<IdType> candidates;
+    if (region.isEmpty()) {
+      return candidates;
+    }
+    const CellIndex min = GetCellIndex(region.min());
+    const CellIndex max = GetCellIndex(region.max());
+    const auto add_cell = [&candidates](const std::set<IdType>& ids) {
+      candidates.insert(candidates.end(), ids.begin(), ids.end());
+    };
+    const double num_region_cells =
+        static_cast<double>(max.first - min.first + 3) *
+        static_cast<double>(max.second - min.second + 3);
+    if (num_region_cells > cells_.size()) {
+      for (const auto& cell : cells_) {
+        if (cell.first.first >= min.first - 1 &&
+            cell.first.first <= max.first + 1 &&
+            cell.first.second >= min.second - 1 &&
+            cell.first.second <= max.second + 1) {
+          add_cell(cell.second);
+        }
+      }
+    } else {
+      for (int64 x = min.first - 1; x <= max.first + 1; ++x) {
+        for (int64 y = min.second - 1; y <= max.second + 1; ++y) {
+          const auto it = cells_.find(CellIndex(x, y));
+          if (it != cells_.end()) {
+            add_cell(it->second);
+          }
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    return candidates;
+  }
+
+  int size() const { return cell_indices_.size(); }
+
+ private:
+  using CellIndex = std::pair<int64, int64>;
+
+  CellIndex GetCellIndex(const Eigen::Vector2d& position) const {
+    return CellIndex(std::floor(position.x() / cell_size_),
+                     std::floor(position.y() / cell_size_));
+  }
+
+  void RemoveFromCell(const IdType& id, const CellIndex& cell_index) {
+    const auto it = cells_.find(cell_index);
+    CHECK(it != cells_.end());
+    CHECK_EQ(it->second.erase(id), 1);
+    if (it->second.empty()) {
+      cells_.erase(it);
+    }
+  }
+
+  const double cell_size_;
+  std::map<CellIndex, std::set<IdType>> cells_;
+  std::map<IdType, CellIndex> cell_indices_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_SPATIAL_INDEX_H_
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/spatial_index.h"
+
+#include <algorithm>
+#include <random>
+
+#include "cartographer/mapping/id.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(SpatialIndexTest, InsertMoveAndRemove) {
+  SpatialIndex<int> spatial_index(1.);
+  spatial_index.Insert(0, Eigen::Vector2d(0.5, 0.5));
+  spatial_index.Insert(1, Eigen::Vector2d(-0.5, 1.5));
+  spatial_index.Insert(2, Eigen::Vector2d(5., 5.));
+  EXPECT_EQ(3, spatial_index.size());
+  EXPECT_THAT(spatial_index.GetCandidates(Eigen::Vector2d(0., 0.)),
+              ElementsAre(0, 1));
+  spatial_index.Insert(2, Eigen::Vector2d(0.9, -0.9));
+  EXPECT_EQ(3, spatial_index.size());
+  EXPECT_THAT(spatial_index.GetCandidates(Eigen::Vector2d(0., 0.)),
+              ElementsAre(0, 1, 2));
+  spatial_index.Remove(0);
+  spatial_index.Remove(0);
+  EXPECT_EQ(2, spatial_index.size());
+  EXPECT_THAT(spatial_index.GetCandidates(Eigen::Vector2d(0., 0.)),
+              ElementsAre(1, 2));
+  EXPECT_TRUE(spatial_index.GetCandidates(Eigen::Vector2d(10., 0.)).empty());
+}
+
+TEST(SpatialIndexTest, CandidatesIncludeAllNearbyIds) {
+  constexpr double kCellSize = 2.5;
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(-20., 20.);
+  SpatialIndex<SubmapId> spatial_index(kCellSize);
+  std::vector<Eigen::Vector2d> positions;
+  for (int i = 0; i != 500; ++i) {
+    positions.emplace_back(distribution(prng), distribution(prng));
+    spatial_index.Insert(SubmapId{i % 3, i}, positions.back());
+  }
+  for (int i = 0; i != 100; ++i) {
+    const Eigen::Vector2d query(distribution(prng), distribution(prng));
+    const std::vector<SubmapId> candidates =
+        spatial_index.GetCandidates(query);
+    EXPECT_TRUE(std::is_sorted(candidates.begin(), candidates.end()));
+    for (int j = 0; j != static_cast<int>(positions.size()); ++j) {
+      if ((positions[j] - query).norm() <= kCellSize) {
+        EXPECT_TRUE(std::binary_search(candidates.begin(), candidates.end(),
+                                       SubmapId{j % 3, j}));
+      }
+    }
+  }
+}
+
+TEST(SpatialIndexTest, CandidatesInRegionIncludeAllIdsInRegion) {
+  constexpr double kCellSize = 2.5;
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(-20., 20.);
+  SpatialIndex<SubmapId> spatial_index(kCellSize);
+  std::vector<Eigen::Vector2d> positions;
+  for (int i = 0; i != 500; ++i) {
+    positions.emplace_back(distribution(prng), distribution(prng));
+    spatial_index.Insert(SubmapId{i % 3, i}, positions.back());
+  }
+  EXPECT_TRUE(spatial_index.GetCandidatesInRegion(Eigen::AlignedBox2d())
+                  .empty());
+  // Regions much larger than the occupied cells are covered as well.
+  for (const double max_extent : {5., 1e3}) {
+    std::uniform_real_distribution<double> extent_distribution(0., max_extent);
+    for (int i = 0; i != 50; ++i) {
+      const Eigen::Vector2d corner(distribution(prng), distribution(prng));
+      const Eigen::AlignedBox2d region(
+          corner, corner + Eigen::Vector2d(extent_distribution(prng),
+                                           extent_distribution(prng)));
+      const std::vector<SubmapId> candidates =
+          spatial_index.GetCandidatesInRegion(region);
+      EXPECT_TRUE(std::is_sorted(candidates.begin(), candidates.end()));
+      for (int j = 0; j != static_cast<int>(positions.size()); ++j) {
+        if (region.exteriorDistance(positions[j]) <= kCellSize) {
+          EXPECT_TRUE(std::binary_search(candidates.begin(), candidates.end(),
+                                         SubmapId{j % 3, j}));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
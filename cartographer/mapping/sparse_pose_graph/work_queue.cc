@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/work_queue.h"
+
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+void WorkQueue::AddTask(const std::function<void()>& task) {
+  items_.emplace_back();
+  items_.back().type = WorkItem::Type::kTask;
+  items_.back().task = task;
+  items_.back().trajectory_id = -1;
+}
+
+void WorkQueue::AddImuData(const int trajectory_id,
+                           const std::vector<sensor::ImuData>& imu_data) {
+  if (imu_data.empty()) {
+    return;
+  }
+  WorkItem* const item =
+      GetItemToAppendTo(WorkItem::Type::kImuData, trajectory_id);
+  item->imu_data.insert(item->imu_data.end(), imu_data.begin(),
+                        imu_data.end());
+}
+
+void WorkQueue::AddOdometryData(
+    const int trajectory_id,
+    const std::vector<sensor::OdometryData>& odometry_data) {
+  if (odometry_data.empty()) {
+    return;
+  }
+  WorkItem* const item =
+      GetItemToAppendTo(WorkItem::Type::kOdometryData, trajectory_id);
+  item->odometry_data.insert(item->odometry_data.end(), odometry_data.begin(),
+                             odometry_data.end());
+}
+
+int64 WorkQueue::GetMemoryUsageInBytes() const {
+  int64 memory_usage_in_bytes = sizeof(*this);
+  for (const WorkItem& item : items_) {
+    memory_usage_in_bytes +=
+        sizeof(item) + item.imu_data.capacity() * sizeof(sensor::ImuData) +
+        item.odometry_data.capacity() * sizeof(sensor::OdometryData);
+  }
+  return memory_usage_in_bytes;
+}
+
+WorkItem WorkQueue::Pop() {
+  CHECK(!items_.empty());
+  WorkItem item = std::move(items_.front());
+  items_.pop_front();
+  return item;
+}
+
+WorkItem* WorkQueue::GetItemToAppendTo(const WorkItem::Type type,
+                                       const int trajectory_id) {
+  if (items_.empty() || items_.back().type != type ||
+      items_.back().trajectory_id != trajectory_id) {
+    items_.emplace_back();
+    items_.back().type = type;
+    items_.back().trajectory_id = trajectory_id;
+  }
+  return &items_.back();
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
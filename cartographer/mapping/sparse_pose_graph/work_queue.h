@@ -0,0 +1,89 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_WORK_QUEUE_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_WORK_QUEUE_H_
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "cartographer/sensor/imu_data.h"
+#include "cartographer/sensor/odometry_data.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// An item of the WorkQueue. Sensor data is kept as data instead of a task, so
+// that consecutive samples of the same trajectory can be coalesced.
+struct WorkItem {
+  enum class Type { kTask, kImuData, kOdometryData };
+
+  Type type;
+  // Only set for 'kTask'.
+  std::function<void()> task;
+  // Only set for 'kImuData' and 'kOdometryData' respectively.
+  int trajectory_id;
+  std::vector<sensor::ImuData> imu_data;
+  std::vector<sensor::OdometryData> odometry_data;
+};
+
+// The work deferred by the sparse pose graph while it optimizes. Sensor data
+// added directly after sensor data of the same type and trajectory is appended
+// to the last item instead of adding one, so the number of items grows with
+// the number of scans and requests rather than with the sensor rates. The
+// order of all work is preserved.
+//
+// This class is not thread-safe.
+class WorkQueue {
+ public:
+  WorkQueue() = default;
+
+  WorkQueue(const WorkQueue&) = delete;
+  WorkQueue& operator=(const WorkQueue&) = delete;
+
+  void AddTask(const std::function<void()>& task);
+  // 'imu_data' and 'odometry_data' must be sorted by time.
+  void AddImuData(int trajectory_id,
+                  const std::vector<sensor::ImuData>& imu_data);
+  void AddOdometryData(int trajectory_id,
+                       const std::vector<sensor::OdometryData>& odometry_data);
+
+  bool empty() const { return items_.empty(); }
+  int size() const { return static_cast<int>(items_.size()); }
+
+  // Returns the number of bytes used by the items, not counting the captures
+  // of tasks.
+  int64 GetMemoryUsageInBytes() const;
+
+  // Removes and returns the oldest item. The queue must not be empty.
+  WorkItem Pop();
+
+ private:
+  // Returns the last item if it has the 'type' and 'trajectory_id', otherwise
+  // adds a new item of this 'type' and 'trajectory_id' and returns it.
+  WorkItem* GetItemToAppendTo(WorkItem::Type type, int trajectory_id);
+
+  std::deque<WorkItem> items_;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_WORK_QUEUE_H_
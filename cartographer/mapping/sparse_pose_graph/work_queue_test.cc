@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/work_queue.h"
+
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+sensor::ImuData CreateImuData(const double seconds) {
+  return sensor::ImuData{
+      common::FromUniversal(0) + common::FromSeconds(seconds),
+      Eigen::Vector3d::UnitZ(), Eigen::Vector3d::Zero()};
+}
+
+TEST(WorkQueueTest, CoalescesConsecutiveSensorData) {
+  WorkQueue work_queue;
+  EXPECT_TRUE(work_queue.empty());
+  work_queue.AddImuData(0, {CreateImuData(1.), CreateImuData(2.)});
+  work_queue.AddImuData(0, {CreateImuData(3.)});
+  work_queue.AddImuData(1, {CreateImuData(3.)});
+  work_queue.AddImuData(1, {});
+  EXPECT_EQ(2, work_queue.size());
+
+  WorkItem item = work_queue.Pop();
+  EXPECT_EQ(WorkItem::Type::kImuData, item.type);
+  EXPECT_EQ(0, item.trajectory_id);
+  ASSERT_EQ(3, item.imu_data.size());
+  EXPECT_EQ(CreateImuData(3.).time, item.imu_data.back().time);
+  item = work_queue.Pop();
+  EXPECT_EQ(1, item.trajectory_id);
+  EXPECT_EQ(1, item.imu_data.size());
+  EXPECT_TRUE(work_queue.empty());
+}
+
+TEST(WorkQueueTest, KeepsOrderAcrossTasks) {
+  WorkQueue work_queue;
+  int num_tasks_run = 0;
+  work_queue.AddImuData(0, {CreateImuData(1.)});
+  work_queue.AddTask([&num_tasks_run]() { ++num_tasks_run; });
+  work_queue.AddImuData(0, {CreateImuData(2.)});
+  work_queue.AddOdometryData(
+      0, {sensor::OdometryData{common::FromUniversal(0),
+                               transform::Rigid3d::Identity()}});
+  EXPECT_EQ(4, work_queue.size());
+
+  EXPECT_EQ(WorkItem::Type::kImuData, work_queue.Pop().type);
+  const WorkItem task = work_queue.Pop();
+  EXPECT_EQ(WorkItem::Type::kTask, task.type);
+  task.task();
+  EXPECT_EQ(1, num_tasks_run);
+  EXPECT_EQ(WorkItem::Type::kImuData, work_queue.Pop().type);
+  const WorkItem odometry = work_queue.Pop();
+  EXPECT_EQ(WorkItem::Type::kOdometryData, odometry.type);
+  EXPECT_EQ(1, odometry.odometry_data.size());
+  EXPECT_TRUE(work_queue.empty());
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
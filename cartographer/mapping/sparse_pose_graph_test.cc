@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+proto::SparsePoseGraphOptions CreateTimingDependentOptions() {
+  proto::SparsePoseGraphOptions options;
+  options.set_optimize_with_finished_constraints(true);
+  options.set_interrupt_optimization_work_queue_size(10);
+  options.mutable_load_shedding_options()->set_max_backlog_scans(100);
+  options.mutable_load_shedding_options()->set_max_backlog_seconds(10.);
+  options.set_final_constraint_search_time_limit_seconds(2.);
+  options.mutable_constraint_builder_options()
+      ->set_global_localization_time_limit_seconds(1.);
+  options.mutable_constraint_builder_options()
+      ->set_global_localization_num_tasks(4);
+  return options;
+}
+
+TEST(ApplyDeterministicModeTest, KeepsOptionsIfNotDeterministic) {
+  const proto::SparsePoseGraphOptions options = CreateTimingDependentOptions();
+  EXPECT_EQ(options.SerializeAsString(),
+            ApplyDeterministicMode(options).SerializeAsString());
+}
+
+TEST(ApplyDeterministicModeTest, TurnsOffTimingDependentOptions) {
+  proto::SparsePoseGraphOptions options = CreateTimingDependentOptions();
+  options.set_deterministic(true);
+  const proto::SparsePoseGraphOptions result = ApplyDeterministicMode(options);
+  EXPECT_TRUE(result.deterministic());
+  EXPECT_FALSE(result.optimize_with_finished_constraints());
+  EXPECT_EQ(0, result.interrupt_optimization_work_queue_size());
+  EXPECT_EQ(0, result.load_shedding_options().max_backlog_scans());
+  EXPECT_EQ(0., result.load_shedding_options().max_backlog_seconds());
+  EXPECT_EQ(0., result.final_constraint_search_time_limit_seconds());
+  EXPECT_EQ(0., result.constraint_builder_options()
+                    .global_localization_time_limit_seconds());
+  EXPECT_EQ(1,
+            result.constraint_builder_options().global_localization_num_tasks());
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -17,6 +17,7 @@
 #ifndef CARTOGRAPHER_MAPPING_SUBMAPS_H_
 #define CARTOGRAPHER_MAPPING_SUBMAPS_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -34,25 +35,6 @@
 namespace cartographer {
 namespace mapping {
 
-// Converts the given probability to log odds.
-inline float Logit(float probability) {
-  return std::log(probability / (1.f - probability));
-}
-
-const float kMaxLogOdds = Logit(kMaxProbability);
-const float kMinLogOdds = Logit(kMinProbability);
-
-// Converts a probability to a log odds integer. 0 means unknown, [kMinLogOdds,
-// kMaxLogOdds] is mapped to [1, 255].
-inline uint8 ProbabilityToLogOddsInteger(const float probability) {
-  const int value = common::RoundToInt((Logit(probability) - kMinLogOdds) *
-                                       254.f / (kMaxLogOdds - kMinLogOdds)) +
-                    1;
-  CHECK_LE(1, value);
-  CHECK_GE(255, value);
-  return value;
-}
-
 // An individual submap, which has a 'local_pose' in the local SLAM frame, keeps
 // track of how many range data were inserted into it, and sets the
 // 'finished_probability_grid' to be used for loop closing once the map no
@@ -67,8 +49,9 @@ class Submap {
   // Local SLAM pose of this submap.
   transform::Rigid3d local_pose() const { return local_pose_; }
 
-  // Number of RangeData inserted.
-  int num_range_data() const { return num_range_data_; }
+  // Number of RangeData inserted. May be read while range data is inserted on
+  // another thread, which it does not synchronize with.
+  int num_range_data() const { return num_range_data_.load(); }
 
   // Fills data into the 'response'.
   virtual void ToResponseProto(
@@ -82,7 +65,7 @@ class Submap {
 
  private:
   const transform::Rigid3d local_pose_;
-  int num_range_data_ = 0;
+  std::atomic<int> num_range_data_{0};
 };
 }  // namespace mapping
 }  // namespace cartographer
@@ -33,6 +33,8 @@ proto::TrajectoryBuilderOptions CreateTrajectoryBuilderOptions(
           parameter_dictionary->GetDictionary("trajectory_builder_3d").get());
   options.set_pure_localization(
       parameter_dictionary->GetBool("pure_localization"));
+  options.set_presorted_sensor_data(
+      parameter_dictionary->GetBool("presorted_sensor_data"));
   return options;
 }
 
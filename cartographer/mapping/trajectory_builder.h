@@ -20,17 +20,21 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/pose_estimate.h"
+#include "cartographer/mapping/proto/runtime_options.pb.h"
 #include "cartographer/mapping/proto/trajectory_builder_options.pb.h"
 #include "cartographer/mapping/submaps.h"
+#include "cartographer/sensor/borrowed_point_cloud.h"
 #include "cartographer/sensor/data.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/range_data.h"
+#include "cartographer/transform/rigid_transform.h"
 
 namespace cartographer {
 namespace mapping {
@@ -51,9 +55,29 @@ class TrajectoryBuilder {
 
   virtual const PoseEstimate& pose_estimate() const = 0;
 
+  // Extrapolates the pose of the tracking frame in the global map frame to
+  // 'time' from the sensor data processed so far and the IMU and odometry data
+  // added since, see GetDeadReckoningGap(). May be called from any
+  // thread at high rates: it never waits for sensor data processing or the
+  // sparse pose graph, whose latest snapshot provides the local to global
+  // transform. Returns false until the first pose is known.
+  virtual bool ExtrapolateGlobalPose(common::Time time,
+                                     transform::Rigid3d* pose) const = 0;
+
+  // Returns how far ExtrapolateGlobalPose() dead reckons from IMU and odometry
+  // data beyond the processed sensor data. This grows while other sensors,
+  // e.g. range data, are stalled and the collator holds back the rest. Like
+  // ExtrapolateGlobalPose(), it never waits.
+  virtual common::Duration GetDeadReckoningGap() const = 0;
+
   virtual void AddSensorData(const string& sensor_id,
                              std::unique_ptr<sensor::Data> data) = 0;
 
+  // Changes the fields set in 'runtime_options' while mapping. May be called
+  // from any thread; the change applies from the next range data on.
+  virtual void UpdateRuntimeOptions(
+      const proto::TrajectoryBuilderRuntimeOptions& runtime_options) = 0;
+
   void AddRangefinderData(const string& sensor_id, common::Time time,
                           const Eigen::Vector3f& origin,
                           const sensor::PointCloud& ranges) {
@@ -62,6 +86,26 @@ class TrajectoryBuilder {
                       time, origin, ranges));
   }
 
+  // Same as above, but takes over the 'ranges' without copying them.
+  void AddRangefinderData(const string& sensor_id, common::Time time,
+                          const Eigen::Vector3f& origin,
+                          sensor::PointCloud&& ranges) {
+    AddSensorData(sensor_id,
+                  common::make_unique<sensor::DispatchableRangefinderData>(
+                      time, origin, std::move(ranges)));
+  }
+
+  // Same as above, but the 'ranges' stay in the buffer of the caller until
+  // local SLAM has read them, see BorrowedPointCloud.
+  void AddRangefinderData(const string& sensor_id, common::Time time,
+                          const Eigen::Vector3f& origin,
+                          sensor::BorrowedPointCloud ranges) {
+    AddSensorData(
+        sensor_id,
+        common::make_unique<sensor::DispatchableBorrowedRangefinderData>(
+            time, origin, std::move(ranges)));
+  }
+
   void AddImuData(const string& sensor_id, common::Time time,
                   const Eigen::Vector3d& linear_acceleration,
                   const Eigen::Vector3d& angular_velocity) {
@@ -24,21 +24,103 @@
 namespace cartographer {
 namespace mapping {
 
+TrajectoryNode::Data CompressPointClouds(
+    const TrajectoryNode::Data& constant_data) {
+  if (constant_data.compressed_point_clouds != nullptr) {
+    return constant_data;
+  }
+  TrajectoryNode::Data compressed_data{
+      constant_data.time,
+      constant_data.gravity_alignment,
+      {} /* filtered_gravity_aligned_point_cloud */,
+      {} /* high_resolution_point_cloud */,
+      {} /* low_resolution_point_cloud */,
+      constant_data.rotational_scan_matcher_histogram,
+      constant_data.initial_pose};
+  compressed_data.compressed_point_clouds =
+      std::make_shared<const TrajectoryNode::CompressedPointClouds>(
+          TrajectoryNode::CompressedPointClouds{
+              sensor::CompressedPointCloud(
+                  constant_data.filtered_gravity_aligned_point_cloud),
+              sensor::CompressedPointCloud(
+                  constant_data.high_resolution_point_cloud),
+              sensor::CompressedPointCloud(
+                  constant_data.low_resolution_point_cloud)});
+  return compressed_data;
+}
+
+TrajectoryNode::Data DecompressPointClouds(
+    const TrajectoryNode::Data& constant_data) {
+  if (constant_data.compressed_point_clouds == nullptr) {
+    return constant_data;
+  }
+  const TrajectoryNode::CompressedPointClouds& compressed_point_clouds =
+      *constant_data.compressed_point_clouds;
+  return TrajectoryNode::Data{
+      constant_data.time,
+      constant_data.gravity_alignment,
+      compressed_point_clouds.filtered_gravity_aligned_point_cloud.Decompress(),
+      compressed_point_clouds.high_resolution_point_cloud.Decompress(),
+      compressed_point_clouds.low_resolution_point_cloud.Decompress(),
+      constant_data.rotational_scan_matcher_histogram,
+      constant_data.initial_pose};
+}
+
+int64 GetMemoryUsageInBytes(const TrajectoryNode::Data& constant_data) {
+  const auto point_cloud_memory_usage_in_bytes =
+      [](const sensor::PointCloud& point_cloud) {
+        return static_cast<int64>(point_cloud.capacity() *
+                                  sizeof(Eigen::Vector3f));
+      };
+  int64 memory_usage_in_bytes =
+      sizeof(constant_data) +
+      point_cloud_memory_usage_in_bytes(
+          constant_data.filtered_gravity_aligned_point_cloud) +
+      point_cloud_memory_usage_in_bytes(
+          constant_data.high_resolution_point_cloud) +
+      point_cloud_memory_usage_in_bytes(
+          constant_data.low_resolution_point_cloud) +
+      constant_data.rotational_scan_matcher_histogram.size() * sizeof(float);
+  if (constant_data.compressed_point_clouds != nullptr) {
+    const TrajectoryNode::CompressedPointClouds& compressed_point_clouds =
+        *constant_data.compressed_point_clouds;
+    memory_usage_in_bytes +=
+        compressed_point_clouds.filtered_gravity_aligned_point_cloud
+            .GetMemoryUsageInBytes() +
+        compressed_point_clouds.high_resolution_point_cloud
+            .GetMemoryUsageInBytes() +
+        compressed_point_clouds.low_resolution_point_cloud
+            .GetMemoryUsageInBytes();
+  }
+  return memory_usage_in_bytes;
+}
+
 proto::TrajectoryNodeData ToProto(const TrajectoryNode::Data& constant_data) {
   proto::TrajectoryNodeData proto;
   proto.set_timestamp(common::ToUniversal(constant_data.time));
   *proto.mutable_gravity_alignment() =
       transform::ToProto(constant_data.gravity_alignment);
-  *proto.mutable_filtered_gravity_aligned_point_cloud() =
-      sensor::CompressedPointCloud(
-          constant_data.filtered_gravity_aligned_point_cloud)
-          .ToProto();
-  *proto.mutable_high_resolution_point_cloud() =
-      sensor::CompressedPointCloud(constant_data.high_resolution_point_cloud)
-          .ToProto();
-  *proto.mutable_low_resolution_point_cloud() =
-      sensor::CompressedPointCloud(constant_data.low_resolution_point_cloud)
-          .ToProto();
+  if (constant_data.compressed_point_clouds != nullptr) {
+    const TrajectoryNode::CompressedPointClouds& compressed_point_clouds =
+        *constant_data.compressed_point_clouds;
+    *proto.mutable_filtered_gravity_aligned_point_cloud() =
+        compressed_point_clouds.filtered_gravity_aligned_point_cloud.ToProto();
+    *proto.mutable_high_resolution_point_cloud() =
+        compressed_point_clouds.high_resolution_point_cloud.ToProto();
+    *proto.mutable_low_resolution_point_cloud() =
+        compressed_point_clouds.low_resolution_point_cloud.ToProto();
+  } else {
+    *proto.mutable_filtered_gravity_aligned_point_cloud() =
+        sensor::CompressedPointCloud(
+            constant_data.filtered_gravity_aligned_point_cloud)
+            .ToProto();
+    *proto.mutable_high_resolution_point_cloud() =
+        sensor::CompressedPointCloud(constant_data.high_resolution_point_cloud)
+            .ToProto();
+    *proto.mutable_low_resolution_point_cloud() =
+        sensor::CompressedPointCloud(constant_data.low_resolution_point_cloud)
+            .ToProto();
+  }
   for (Eigen::VectorXf::Index i = 0;
        i != constant_data.rotational_scan_matcher_histogram.size(); ++i) {
     proto.add_rotational_scan_matcher_histogram(
@@ -21,8 +21,10 @@
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/proto/trajectory_node_data.pb.h"
+#include "cartographer/sensor/compressed_point_cloud.h"
 #include "cartographer/sensor/range_data.h"
 #include "cartographer/transform/rigid_transform.h"
 
@@ -30,6 +32,13 @@ namespace cartographer {
 namespace mapping {
 
 struct TrajectoryNode {
+  // The point clouds of 'Data' in compressed form.
+  struct CompressedPointClouds {
+    sensor::CompressedPointCloud filtered_gravity_aligned_point_cloud;
+    sensor::CompressedPointCloud high_resolution_point_cloud;
+    sensor::CompressedPointCloud low_resolution_point_cloud;
+  };
+
   struct Data {
     common::Time time;
 
@@ -48,6 +57,10 @@ struct TrajectoryNode {
 
     // The initial unoptimized node pose.
     transform::Rigid3d initial_pose;
+
+    // If not nullptr, the point clouds above are empty and are kept here in
+    // compressed form instead, see CompressPointClouds().
+    std::shared_ptr<const CompressedPointClouds> compressed_point_clouds;
   };
 
   common::Time time() const { return constant_data->time; }
@@ -60,6 +73,20 @@ struct TrajectoryNode {
   transform::Rigid3d pose;
 };
 
+// Returns a copy of 'constant_data' with its point clouds compressed, which
+// uses considerably less memory. Matching against it requires decompressing
+// them again with DecompressPointClouds().
+TrajectoryNode::Data CompressPointClouds(
+    const TrajectoryNode::Data& constant_data);
+
+// Returns a copy of 'constant_data' with decompressed point clouds.
+TrajectoryNode::Data DecompressPointClouds(
+    const TrajectoryNode::Data& constant_data);
+
+// Returns the number of bytes used by 'constant_data' including its point
+// clouds, compressed or not.
+int64 GetMemoryUsageInBytes(const TrajectoryNode::Data& constant_data);
+
 proto::TrajectoryNodeData ToProto(const TrajectoryNode::Data& constant_data);
 TrajectoryNode::Data FromProto(const proto::TrajectoryNodeData& proto);
 
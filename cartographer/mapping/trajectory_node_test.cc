@@ -55,6 +55,58 @@ TEST(TrajectoryNodeTest, ToAndFromProto) {
               transform::IsNearly(expected.initial_pose, 1e-9));
 }
 
+TEST(TrajectoryNodeTest, CompressAndDecompressPointClouds) {
+  const TrajectoryNode::Data expected{
+      common::FromUniversal(42),
+      Eigen::Quaterniond::Identity(),
+      sensor::CompressedPointCloud({{1.f, 2.f, 0.f}, {0.f, 0.f, 1.f}})
+          .Decompress(),
+      sensor::CompressedPointCloud({{2.f, 3.f, 4.f}}).Decompress(),
+      sensor::CompressedPointCloud({{-1.f, 2.f, 0.f}}).Decompress(),
+      Eigen::VectorXf::Unit(20, 4),
+      transform::Rigid3d::Identity()};
+  const TrajectoryNode::Data compressed = CompressPointClouds(expected);
+  ASSERT_NE(compressed.compressed_point_clouds, nullptr);
+  EXPECT_TRUE(compressed.filtered_gravity_aligned_point_cloud.empty());
+  EXPECT_TRUE(compressed.high_resolution_point_cloud.empty());
+  EXPECT_TRUE(compressed.low_resolution_point_cloud.empty());
+  EXPECT_EQ(expected.rotational_scan_matcher_histogram,
+            compressed.rotational_scan_matcher_histogram);
+  EXPECT_EQ(ToProto(expected).SerializeAsString(),
+            ToProto(compressed).SerializeAsString());
+
+  const TrajectoryNode::Data actual = DecompressPointClouds(compressed);
+  EXPECT_EQ(nullptr, actual.compressed_point_clouds);
+  EXPECT_EQ(expected.time, actual.time);
+  EXPECT_EQ(expected.filtered_gravity_aligned_point_cloud,
+            actual.filtered_gravity_aligned_point_cloud);
+  EXPECT_EQ(expected.high_resolution_point_cloud,
+            actual.high_resolution_point_cloud);
+  EXPECT_EQ(expected.low_resolution_point_cloud,
+            actual.low_resolution_point_cloud);
+}
+
+TEST(TrajectoryNodeTest, MemoryUsage) {
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 1000; ++i) {
+    point_cloud.emplace_back(0.01f * i, 0.f, 1.f);
+  }
+  const TrajectoryNode::Data uncompressed{common::FromUniversal(42),
+                                          Eigen::Quaterniond::Identity(),
+                                          point_cloud,
+                                          point_cloud,
+                                          {},
+                                          Eigen::VectorXf::Zero(120),
+                                          transform::Rigid3d::Identity()};
+  const int64 memory_usage_in_bytes = GetMemoryUsageInBytes(uncompressed);
+  EXPECT_GE(memory_usage_in_bytes,
+            2 * 1000 * sizeof(Eigen::Vector3f) + 120 * sizeof(float));
+  const TrajectoryNode::Data compressed = CompressPointClouds(uncompressed);
+  EXPECT_LT(GetMemoryUsageInBytes(compressed), memory_usage_in_bytes);
+  EXPECT_GT(GetMemoryUsageInBytes(compressed),
+            GetMemoryUsageInBytes(TrajectoryNode::Data{}));
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
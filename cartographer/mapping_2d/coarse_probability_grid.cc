@@ -0,0 +1,146 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/coarse_probability_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "cartographer/mapping_2d/xy_index.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping_2d {
+
+namespace {
+
+MapLimits ComputeCoarseLimits(const MapLimits& limits,
+                              const int downsampling_factor) {
+  const CellLimits& cell_limits = limits.cell_limits();
+  return MapLimits(
+      limits.resolution() * downsampling_factor, limits.max(),
+      CellLimits(
+          (cell_limits.num_x_cells + downsampling_factor - 1) /
+              downsampling_factor,
+          (cell_limits.num_y_cells + downsampling_factor - 1) /
+              downsampling_factor));
+}
+
+}  // namespace
+
+CoarseProbabilityGrid::CoarseProbabilityGrid(
+    const ProbabilityGrid& probability_grid, const int downsampling_factor)
+    : limits_(ComputeCoarseLimits(probability_grid.limits(),
+                                  downsampling_factor)),
+      cells_(limits_.cell_limits().num_x_cells *
+                 limits_.cell_limits().num_y_cells,
+             mapping::kUnknownProbabilityValue) {
+  CHECK_GE(downsampling_factor, 1);
+  // Only the known cells can be higher than the unknown value.
+  Eigen::Array2i offset;
+  CellLimits known_limits;
+  probability_grid.ComputeCroppedLimits(&offset, &known_limits);
+  const int num_x_cells = limits_.cell_limits().num_x_cells;
+  for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(known_limits)) {
+    const Eigen::Array2i cell_index = offset + xy_index;
+    if (!probability_grid.IsKnown(cell_index)) {
+      continue;
+    }
+    const Eigen::Array2i coarse_cell_index = cell_index / downsampling_factor;
+    uint16& value =
+        cells_[coarse_cell_index.y() * num_x_cells + coarse_cell_index.x()];
+    value = std::max(value, mapping::ProbabilityToValue(
+                                probability_grid.GetProbability(cell_index)));
+  }
+}
+
+CoarseProbabilityGrid::CoarseProbabilityGrid(const MapLimits& limits,
+                                             std::vector<uint16> cells)
+    : limits_(limits), cells_(std::move(cells)) {}
+
+float CoarseProbabilityGrid::GetMaxProbability() const {
+  return mapping::ValueToProbability(
+      *std::max_element(cells_.begin(), cells_.end()));
+}
+
+CoarseProbabilityGrid CoarseProbabilityGrid::Dilate(const int radius) const {
+  CHECK_GE(radius, 0);
+  const int num_x_cells = limits_.cell_limits().num_x_cells;
+  const int num_y_cells = limits_.cell_limits().num_y_cells;
+  // The maximum filter is separable, so rows and columns are dilated one
+  // after the other.
+  std::vector<uint16> dilated_rows(cells_.size());
+  for (int y = 0; y != num_y_cells; ++y) {
+    const uint16* const row = &cells_[y * num_x_cells];
+    for (int x = 0; x != num_x_cells; ++x) {
+      dilated_rows[y * num_x_cells + x] =
+          *std::max_element(row + std::max(0, x - radius),
+                            row + std::min(num_x_cells, x + radius + 1));
+    }
+  }
+  std::vector<uint16> dilated_cells(cells_.size());
+  for (int y = 0; y != num_y_cells; ++y) {
+    const int end_y = std::min(num_y_cells, y + radius + 1);
+    for (int x = 0; x != num_x_cells; ++x) {
+      uint16 value = mapping::kUnknownProbabilityValue;
+      for (int other_y = std::max(0, y - radius); other_y != end_y;
+           ++other_y) {
+        value = std::max(value, dilated_rows[other_y * num_x_cells + x]);
+      }
+      dilated_cells[y * num_x_cells + x] = value;
+    }
+  }
+  return CoarseProbabilityGrid(limits_, std::move(dilated_cells));
+}
+
+float CoarseProbabilityGrid::ComputeMaxScoreOverRotations(
+    const sensor::PointCloud& point_cloud, const transform::Rigid2d& pose,
+    const double angular_search_window) const {
+  if (point_cloud.empty()) {
+    return 0.f;
+  }
+  float max_range = 0.f;
+  for (const Eigen::Vector3f& point : point_cloud) {
+    max_range = std::max(max_range, point.head<2>().norm());
+  }
+  // Points at 'max_range' move by at most half a cell to the closest sample.
+  const double angular_step_size =
+      max_range > 0.f ? limits_.resolution() / max_range : M_PI;
+  const int num_angular_steps =
+      std::ceil(angular_search_window / angular_step_size);
+  const Eigen::Vector2f translation = pose.translation().cast<float>();
+  float max_score = 0.f;
+  for (int i = -num_angular_steps; i <= num_angular_steps; ++i) {
+    const Eigen::Rotation2Df rotation(
+        static_cast<float>(pose.rotation().angle() + i * angular_step_size));
+    const Eigen::Matrix2f rotation_matrix = rotation.toRotationMatrix();
+    float score = 0.f;
+    for (const Eigen::Vector3f& point : point_cloud) {
+      score += GetProbability(limits_.GetCellIndex(
+          rotation_matrix * point.head<2>() + translation));
+    }
+    max_score = std::max(max_score, score / point_cloud.size());
+  }
+  return max_score;
+}
+
+int64 CoarseProbabilityGrid::GetMemoryUsageInBytes() const {
+  return sizeof(*this) + cells_.capacity() * sizeof(uint16);
+}
+
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_COARSE_PROBABILITY_GRID_H_
+#define CARTOGRAPHER_MAPPING_2D_COARSE_PROBABILITY_GRID_H_
+
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping_2d {
+
+// A low resolution summary of a ProbabilityGrid. Each cell holds the maximum
+// probability of the cells of the probability grid it covers, so that scores
+// computed with it are upper bounds of the scores computed with the
+// probability grid. It is small enough to be kept for every finished submap.
+class CoarseProbabilityGrid {
+ public:
+  // Each cell covers 'downsampling_factor' x 'downsampling_factor' cells of
+  // the 'probability_grid', which must not be updated concurrently.
+  CoarseProbabilityGrid(const ProbabilityGrid& probability_grid,
+                        int downsampling_factor);
+
+  // The cells have the same corner as the probability grid and a resolution
+  // 'downsampling_factor' times lower.
+  const MapLimits& limits() const { return limits_; }
+
+  // Returns the probability of the cell with 'cell_index', or
+  // mapping::kMinProbability outside the limits.
+  float GetProbability(const Eigen::Array2i& cell_index) const {
+    if (limits_.Contains(cell_index)) {
+      return mapping::ValueToProbability(
+          cells_[cell_index.y() * limits_.cell_limits().num_x_cells +
+                 cell_index.x()]);
+    }
+    return mapping::kMinProbability;
+  }
+
+  // Returns the maximum probability of all cells. No point cloud can score
+  // higher anywhere in the grid.
+  float GetMaxProbability() const;
+
+  // Returns a copy in which each cell holds the maximum of the cells within
+  // 'radius' cells in x and y, so that a score computed with it bounds the
+  // scores of all translations by up to 'radius' cells.
+  CoarseProbabilityGrid Dilate(int radius) const;
+
+  // Returns the highest mean probability of the cells the 'point_cloud' falls
+  // into when placed at 'pose' with its orientation changed by up to
+  // 'angular_search_window'. Orientations are sampled so that no point moves
+  // by more than half a cell between samples, so that with a grid dilated by
+  // one more cell this bounds the score of all orientations in the window.
+  float ComputeMaxScoreOverRotations(const sensor::PointCloud& point_cloud,
+                                     const transform::Rigid2d& pose,
+                                     double angular_search_window) const;
+
+  int64 GetMemoryUsageInBytes() const;
+
+ private:
+  CoarseProbabilityGrid(const MapLimits& limits, std::vector<uint16> cells);
+
+  MapLimits limits_;
+  // Values as in ProbabilityGrid in row-major order. Since probabilities
+  // increase with the values, and unknown cells have the lowest value, the
+  // maximum value of some cells is the value of their maximum probability.
+  std::vector<uint16> cells_;
+};
+
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_COARSE_PROBABILITY_GRID_H_
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/coarse_probability_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace {
+
+TEST(CoarseProbabilityGridTest, CellsHoldMaximumOfCoveredCells) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.1, Eigen::Vector2d(1., 1.), CellLimits(10, 10)));
+  probability_grid.SetProbability(Eigen::Array2i(1, 2), 0.3f);
+  probability_grid.SetProbability(Eigen::Array2i(3, 0), 0.7f);
+  probability_grid.SetProbability(Eigen::Array2i(9, 9), 0.5f);
+  probability_grid.FinishUpdate();
+
+  const CoarseProbabilityGrid coarse_probability_grid(probability_grid, 4);
+  EXPECT_NEAR(0.4, coarse_probability_grid.limits().resolution(), 1e-9);
+  EXPECT_EQ(3, coarse_probability_grid.limits().cell_limits().num_x_cells);
+  EXPECT_EQ(3, coarse_probability_grid.limits().cell_limits().num_y_cells);
+  EXPECT_NEAR(0.7f, coarse_probability_grid.GetProbability(Eigen::Array2i(0, 0)),
+              1e-3);
+  EXPECT_NEAR(0.5f, coarse_probability_grid.GetProbability(Eigen::Array2i(2, 2)),
+              1e-3);
+  EXPECT_NEAR(mapping::kMinProbability,
+              coarse_probability_grid.GetProbability(Eigen::Array2i(1, 1)),
+              1e-3);
+  EXPECT_NEAR(mapping::kMinProbability,
+              coarse_probability_grid.GetProbability(Eigen::Array2i(-1, 0)),
+              1e-3);
+  EXPECT_NEAR(0.7f, coarse_probability_grid.GetMaxProbability(), 1e-3);
+
+  const CoarseProbabilityGrid dilated_grid = coarse_probability_grid.Dilate(1);
+  EXPECT_NEAR(0.7f, dilated_grid.GetProbability(Eigen::Array2i(1, 1)), 1e-3);
+  EXPECT_NEAR(0.5f, dilated_grid.GetProbability(Eigen::Array2i(2, 2)), 1e-3);
+  EXPECT_NEAR(mapping::kMinProbability,
+              coarse_probability_grid.Dilate(0).GetProbability(
+                  Eigen::Array2i(1, 1)),
+              1e-3);
+}
+
+TEST(CoarseProbabilityGridTest, MaxScoreOverRotationsIsUpperBound) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+  for (int y = 0; y < 200; y += 3) {
+    for (int x = 0; x < 200; x += 5) {
+      probability_grid.SetProbability(Eigen::Array2i(x, y),
+                                      probability_distribution(prng));
+    }
+  }
+  probability_grid.FinishUpdate();
+
+  std::uniform_real_distribution<float> point_distribution(-3.f, 3.f);
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 50; ++i) {
+    point_cloud.emplace_back(point_distribution(prng),
+                             point_distribution(prng), 0.f);
+  }
+
+  constexpr double kLinearSearchWindow = 0.5;
+  constexpr double kAngularSearchWindow = 0.3;
+  const CoarseProbabilityGrid coarse_probability_grid(probability_grid, 8);
+  const CoarseProbabilityGrid dilated_grid = coarse_probability_grid.Dilate(
+      std::ceil(kLinearSearchWindow /
+                coarse_probability_grid.limits().resolution()) +
+      1);
+  const transform::Rigid2d initial_pose({0.3, -0.2}, 0.1);
+  const float score_bound = dilated_grid.ComputeMaxScoreOverRotations(
+      point_cloud, initial_pose, kAngularSearchWindow);
+  std::uniform_real_distribution<double> offset_distribution(-1., 1.);
+  float max_score = 0.f;
+  for (int i = 0; i != 1000; ++i) {
+    const transform::Rigid2d pose =
+        transform::Rigid2d(
+            {kLinearSearchWindow * offset_distribution(prng),
+             kLinearSearchWindow * offset_distribution(prng)},
+            0.) *
+        initial_pose *
+        transform::Rigid2d::Rotation(kAngularSearchWindow *
+                                     offset_distribution(prng));
+    const transform::Rigid2f pose_float = pose.cast<float>();
+    float score = 0.f;
+    for (const Eigen::Vector3f& point : point_cloud) {
+      score += probability_grid.GetProbability(
+          probability_grid.limits().GetCellIndex(pose_float *
+                                                 point.head<2>()));
+    }
+    max_score = std::max(max_score, score / point_cloud.size());
+  }
+  EXPECT_LE(max_score, score_bound);
+  // Far away from the grid, all points are in unknown cells.
+  EXPECT_NEAR(mapping::kMinProbability,
+              dilated_grid.ComputeMaxScoreOverRotations(
+                  point_cloud, transform::Rigid2d::Translation({20., 0.}),
+                  kAngularSearchWindow),
+              1e-3);
+}
+
+}  // namespace
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -16,10 +16,13 @@
 
 #include "cartographer/mapping_2d/local_trajectory_builder.h"
 
+#include <chrono>
 #include <limits>
 #include <memory>
+#include <utility>
 
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/sensor/range_data.h"
 
 namespace cartographer {
@@ -31,21 +34,64 @@ LocalTrajectoryBuilder::LocalTrajectoryBuilder(
       active_submaps_(options.submaps_options()),
       motion_filter_(options_.motion_filter_options()),
       real_time_correlative_scan_matcher_(
-          options_.real_time_correlative_scan_matcher_options()),
-      ceres_scan_matcher_(options_.ceres_scan_matcher_options()) {}
+          common::make_unique<scan_matching::RealTimeCorrelativeScanMatcher>(
+              options_.real_time_correlative_scan_matcher_options())),
+      ceres_scan_matcher_(options_.ceres_scan_matcher_options()),
+      gauss_newton_scan_matcher_(
+          options_.gauss_newton_scan_matcher_options()),
+      degradation_controller_(options_.degradation_options()) {}
 
 LocalTrajectoryBuilder::~LocalTrajectoryBuilder() {}
 
+void LocalTrajectoryBuilder::UpdateRuntimeOptions(
+    const mapping::proto::TrajectoryBuilderRuntimeOptions& runtime_options) {
+  pending_runtime_options_.Add(runtime_options);
+}
+
+void LocalTrajectoryBuilder::ApplyPendingRuntimeOptions() {
+  mapping::proto::TrajectoryBuilderRuntimeOptions runtime_options;
+  if (!pending_runtime_options_.Take(&runtime_options)) {
+    return;
+  }
+  mapping::ApplyRuntimeOptions(runtime_options, &options_);
+  if (runtime_options.has_real_time_linear_search_window() ||
+      runtime_options.has_real_time_angular_search_window()) {
+    real_time_correlative_scan_matcher_ =
+        common::make_unique<scan_matching::RealTimeCorrelativeScanMatcher>(
+            options_.real_time_correlative_scan_matcher_options());
+  }
+}
+
+void LocalTrajectoryBuilder::RegisterMetrics(
+    const int trajectory_id, metrics::Registry* const registry) {
+  degradation_controller_.RegisterMetrics(trajectory_id, registry);
+}
+
 sensor::RangeData LocalTrajectoryBuilder::TransformAndFilterRangeData(
-    const transform::Rigid3f& gravity_alignment,
-    const sensor::RangeData& range_data) const {
-  const sensor::RangeData cropped = sensor::CropRangeData(
-      sensor::TransformRangeData(range_data, gravity_alignment),
-      options_.min_z(), options_.max_z());
+    const transform::Rigid3f& transform, const sensor::RangeData& range_data) {
+  // Transforming and cropping in a single pass into 'cropped_range_data_'
+  // avoids two intermediate copies of the point clouds per accumulation.
+  const auto transform_and_crop = [this, &transform](
+                                      const sensor::PointCloud& point_cloud,
+                                      sensor::PointCloud* const result) {
+    result->clear();
+    for (const Eigen::Vector3f& point : point_cloud) {
+      const Eigen::Vector3f transformed_point = transform * point;
+      if (transformed_point.z() >= options_.min_z() &&
+          transformed_point.z() <= options_.max_z()) {
+        result->push_back(transformed_point);
+      }
+    }
+  };
+  cropped_range_data_.origin = transform * range_data.origin;
+  transform_and_crop(range_data.returns, &cropped_range_data_.returns);
+  transform_and_crop(range_data.misses, &cropped_range_data_.misses);
   return sensor::RangeData{
-      cropped.origin,
-      sensor::VoxelFiltered(cropped.returns, options_.voxel_filter_size()),
-      sensor::VoxelFiltered(cropped.misses, options_.voxel_filter_size())};
+      cropped_range_data_.origin,
+      sensor::VoxelFiltered(cropped_range_data_.returns,
+                            options_.voxel_filter_size()),
+      sensor::VoxelFiltered(cropped_range_data_.misses,
+                            options_.voxel_filter_size())};
 }
 
 void LocalTrajectoryBuilder::ScanMatch(
@@ -58,16 +104,51 @@ void LocalTrajectoryBuilder::ScanMatch(
   // the Ceres scan matcher.
   transform::Rigid2d initial_ceres_pose = pose_prediction;
   sensor::AdaptiveVoxelFilter adaptive_voxel_filter(
-      options_.adaptive_voxel_filter_options());
+      degradation_controller_.AdjustAdaptiveVoxelFilterOptions(
+          options_.adaptive_voxel_filter_options()));
   const sensor::PointCloud filtered_gravity_aligned_point_cloud =
       adaptive_voxel_filter.Filter(gravity_aligned_range_data.returns);
-  if (options_.use_online_correlative_scan_matching()) {
-    real_time_correlative_scan_matcher_.Match(
+  if (options_.use_online_correlative_scan_matching() &&
+      !degradation_controller_.skip_online_correlative_scan_matching()) {
+    real_time_correlative_scan_matcher_->Match(
         pose_prediction, filtered_gravity_aligned_point_cloud,
         matching_submap->probability_grid(), &initial_ceres_pose);
   }
 
+  // Matching against the coarse grid first moves the estimate into the basin
+  // of convergence of the full resolution grid.
+  const ProbabilityGrid* const low_resolution_probability_grid =
+      matching_submap->low_resolution_probability_grid();
+  if (options_.use_gauss_newton_scan_matcher()) {
+    gauss_newton_scan_matcher_.SetMaxNumIterations(
+        degradation_controller_.AdjustMaxNumCeresIterations(
+            options_.gauss_newton_scan_matcher_options()
+                .max_num_iterations()));
+    if (low_resolution_probability_grid != nullptr) {
+      gauss_newton_scan_matcher_.Match(
+          pose_prediction, initial_ceres_pose,
+          filtered_gravity_aligned_point_cloud,
+          *low_resolution_probability_grid, &initial_ceres_pose);
+    }
+    gauss_newton_scan_matcher_.Match(
+        pose_prediction, initial_ceres_pose,
+        filtered_gravity_aligned_point_cloud,
+        matching_submap->probability_grid(), pose_observation);
+    return;
+  }
+
+  ceres_scan_matcher_.SetMaxNumIterations(
+      degradation_controller_.AdjustMaxNumCeresIterations(
+          options_.ceres_scan_matcher_options()
+              .ceres_solver_options()
+              .max_num_iterations()));
   ceres::Solver::Summary summary;
+  if (low_resolution_probability_grid != nullptr) {
+    ceres_scan_matcher_.Match(pose_prediction, initial_ceres_pose,
+                              filtered_gravity_aligned_point_cloud,
+                              *low_resolution_probability_grid,
+                              &initial_ceres_pose, &summary);
+  }
   ceres_scan_matcher_.Match(
       pose_prediction, initial_ceres_pose, filtered_gravity_aligned_point_cloud,
       matching_submap->probability_grid(), pose_observation, &summary);
@@ -76,6 +157,15 @@ void LocalTrajectoryBuilder::ScanMatch(
 std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
 LocalTrajectoryBuilder::AddRangeData(const common::Time time,
                                      const sensor::RangeData& range_data) {
+  return AddRangeData(time, range_data.origin, range_data.returns);
+}
+
+std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
+LocalTrajectoryBuilder::AddRangeData(const common::Time time,
+                                     const Eigen::Vector3f& origin,
+                                     const sensor::PointCloudView returns) {
+  CARTOGRAPHER_TRACE_SPAN("LocalTrajectoryBuilder::AddRangeData");
+  ApplyPendingRuntimeOptions();
   // Initialize extrapolator now if we do not ever use an IMU.
   if (!options_.use_imu_data()) {
     InitializeExtrapolator(time);
@@ -87,52 +177,81 @@ LocalTrajectoryBuilder::AddRangeData(const common::Time time,
     LOG(INFO) << "Extrapolator not yet initialized.";
     return nullptr;
   }
+  // The first range data of an accumulation defines its frame, so it does not
+  // need to be transformed.
+  transform::Rigid3f tracking_delta = transform::Rigid3f::Identity();
   if (num_accumulated_ == 0) {
+    accumulation_start_time_ = time;
     first_pose_estimate_ = extrapolator_->ExtrapolatePose(time).cast<float>();
-    accumulated_range_data_ =
-        sensor::RangeData{Eigen::Vector3f::Zero(), {}, {}};
+    // Clearing keeps the storage of the point clouds for the next
+    // accumulation.
+    accumulated_range_data_.origin = Eigen::Vector3f::Zero();
+    accumulated_range_data_.returns.clear();
+    accumulated_range_data_.misses.clear();
+  } else {
+    tracking_delta = first_pose_estimate_.inverse() *
+                     extrapolator_->ExtrapolatePose(time).cast<float>();
   }
-
-  const transform::Rigid3f tracking_delta =
-      first_pose_estimate_.inverse() *
-      extrapolator_->ExtrapolatePose(time).cast<float>();
-  const sensor::RangeData range_data_in_first_tracking =
-      sensor::TransformRangeData(range_data, tracking_delta);
+  const Eigen::Vector3f origin_in_first_tracking =
+      tracking_delta * origin;
   // Drop any returns below the minimum range and convert returns beyond the
   // maximum range into misses.
-  for (const Eigen::Vector3f& hit : range_data_in_first_tracking.returns) {
-    const Eigen::Vector3f delta = hit - range_data_in_first_tracking.origin;
+  for (const Eigen::Vector3f& point : returns) {
+    const Eigen::Vector3f hit = tracking_delta * point;
+    const Eigen::Vector3f delta = hit - origin_in_first_tracking;
     const float range = delta.norm();
     if (range >= options_.min_range()) {
       if (range <= options_.max_range()) {
         accumulated_range_data_.returns.push_back(hit);
       } else {
         accumulated_range_data_.misses.push_back(
-            range_data_in_first_tracking.origin +
+            origin_in_first_tracking +
             options_.missing_data_ray_length() / range * delta);
       }
     }
   }
   ++num_accumulated_;
 
-  if (num_accumulated_ >= options_.scans_per_accumulation()) {
+  if (IsAccumulationComplete(time)) {
     num_accumulated_ = 0;
-    return AddAccumulatedRangeData(
-        time, sensor::TransformRangeData(accumulated_range_data_,
-                                         tracking_delta.inverse()));
+    const auto start_time = std::chrono::steady_clock::now();
+    std::unique_ptr<InsertionResult> insertion_result = AddAccumulatedRangeData(
+        time, accumulated_range_data_, tracking_delta.inverse());
+    degradation_controller_.Update(std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() -
+                                       start_time)
+                                       .count());
+    return insertion_result;
   }
   return nullptr;
 }
 
+bool LocalTrajectoryBuilder::IsAccumulationComplete(
+    const common::Time time) const {
+  if (options_.accumulation_duration_seconds() > 0.) {
+    return common::ToSeconds(time - accumulation_start_time_) >=
+           options_.accumulation_duration_seconds();
+  }
+  return num_accumulated_ >= options_.scans_per_accumulation();
+}
+
 std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
 LocalTrajectoryBuilder::AddAccumulatedRangeData(
-    const common::Time time, const sensor::RangeData& range_data) {
+    const common::Time time, const sensor::RangeData& range_data,
+    const transform::Rigid3f& range_data_to_tracking) {
+  if (motion_filter_.IsStationary(time, extrapolator_->ExtrapolatePose(time))) {
+    // The scan is neither matched nor inserted, the last pose is kept.
+    extrapolator_->AddPose(time, last_pose_estimate_.pose);
+    last_pose_estimate_.time = time;
+    return nullptr;
+  }
+
   // Transforms 'range_data' into a frame where gravity direction is
   // approximately +z.
   const transform::Rigid3d gravity_alignment = transform::Rigid3d::Rotation(
       extrapolator_->EstimateGravityOrientation(time));
-  const sensor::RangeData gravity_aligned_range_data =
-      TransformAndFilterRangeData(gravity_alignment.cast<float>(), range_data);
+  sensor::RangeData gravity_aligned_range_data = TransformAndFilterRangeData(
+      gravity_alignment.cast<float>() * range_data_to_tracking, range_data);
   if (gravity_aligned_range_data.returns.empty()) {
     LOG(WARNING) << "Dropped empty horizontal range data.";
     return nullptr;
@@ -150,6 +269,7 @@ LocalTrajectoryBuilder::AddAccumulatedRangeData(
   const transform::Rigid3d pose_estimate =
       transform::Embed3D(pose_estimate_2d) * gravity_alignment;
   extrapolator_->AddPose(time, pose_estimate);
+  motion_filter_.AddMatchedPose(time, pose_estimate);
 
   last_pose_estimate_ = {
       time, pose_estimate,
@@ -157,31 +277,35 @@ LocalTrajectoryBuilder::AddAccumulatedRangeData(
           gravity_aligned_range_data.returns,
           transform::Embed3D(pose_estimate_2d.cast<float>()))};
 
-  if (motion_filter_.IsSimilar(time, pose_estimate)) {
+  if (motion_filter_.IsSimilar(time, pose_estimate) ||
+      !degradation_controller_.ShouldInsert()) {
     return nullptr;
   }
 
+  sensor::AdaptiveVoxelFilter adaptive_voxel_filter(
+      options_.loop_closure_adaptive_voxel_filter_options());
+  sensor::PointCloud filtered_gravity_aligned_point_cloud =
+      adaptive_voxel_filter.Filter(gravity_aligned_range_data.returns);
+
   // Querying the active submaps must be done here before calling
   // InsertRangeData() since the queried values are valid for next insertion.
   std::vector<std::shared_ptr<const Submap>> insertion_submaps;
   for (const std::shared_ptr<Submap>& submap : active_submaps_.submaps()) {
     insertion_submaps.push_back(submap);
   }
-  active_submaps_.InsertRangeData(
-      TransformRangeData(gravity_aligned_range_data,
-                         transform::Embed3D(pose_estimate_2d.cast<float>())));
-
-  sensor::AdaptiveVoxelFilter adaptive_voxel_filter(
-      options_.loop_closure_adaptive_voxel_filter_options());
-  const sensor::PointCloud filtered_gravity_aligned_point_cloud =
-      adaptive_voxel_filter.Filter(gravity_aligned_range_data.returns);
+  // The range data is not needed anymore, so it is transformed in place and
+  // handed over to the submaps without copying it.
+  sensor::TransformRangeDataInPlace(
+      transform::Embed3D(pose_estimate_2d.cast<float>()),
+      &gravity_aligned_range_data);
+  active_submaps_.InsertRangeData(std::move(gravity_aligned_range_data));
 
   return common::make_unique<InsertionResult>(InsertionResult{
       std::make_shared<const mapping::TrajectoryNode::Data>(
           mapping::TrajectoryNode::Data{
               time,
               gravity_alignment.rotation(),
-              filtered_gravity_aligned_point_cloud,
+              std::move(filtered_gravity_aligned_point_cloud),
               {},  // 'high_resolution_point_cloud' is only used in 3D.
               {},  // 'low_resolution_point_cloud' is only used in 3D.
               {},  // 'rotational_scan_matcher_histogram' is only used in 3D.
@@ -193,6 +317,15 @@ const mapping::PoseEstimate& LocalTrajectoryBuilder::pose_estimate() const {
   return last_pose_estimate_;
 }
 
+bool LocalTrajectoryBuilder::GetExtrapolationState(
+    mapping::PoseExtrapolator::ExtrapolationState* const extrapolation_state) {
+  if (extrapolator_ == nullptr) {
+    return false;
+  }
+  *extrapolation_state = extrapolator_->GetExtrapolationState();
+  return true;
+}
+
 void LocalTrajectoryBuilder::AddImuData(const sensor::ImuData& imu_data) {
   CHECK(options_.use_imu_data()) << "An unexpected IMU packet was added.";
   InitializeExtrapolator(imu_data.time);
@@ -20,13 +20,18 @@
 #include <memory>
 
 #include "cartographer/common/time.h"
+#include "cartographer/mapping/local_slam_degradation_controller.h"
 #include "cartographer/mapping/pose_estimate.h"
 #include "cartographer/mapping/pose_extrapolator.h"
+#include "cartographer/mapping/proto/runtime_options.pb.h"
+#include "cartographer/mapping/runtime_options.h"
 #include "cartographer/mapping_2d/proto/local_trajectory_builder_options.pb.h"
 #include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
+#include "cartographer/mapping_2d/scan_matching/gauss_newton_scan_matcher.h"
 #include "cartographer/mapping_2d/scan_matching/real_time_correlative_scan_matcher.h"
 #include "cartographer/mapping_2d/submaps.h"
 #include "cartographer/mapping_3d/motion_filter.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/sensor/range_data.h"
@@ -52,20 +57,41 @@ class LocalTrajectoryBuilder {
   LocalTrajectoryBuilder(const LocalTrajectoryBuilder&) = delete;
   LocalTrajectoryBuilder& operator=(const LocalTrajectoryBuilder&) = delete;
 
+  // Exports the metrics of the trajectory with 'trajectory_id' to 'registry'.
+  void RegisterMetrics(int trajectory_id, metrics::Registry* registry);
+
   const mapping::PoseEstimate& pose_estimate() const;
 
+  // Returns false until the pose extrapolator has been initialized.
+  bool GetExtrapolationState(
+      mapping::PoseExtrapolator::ExtrapolationState* extrapolation_state);
+
+  // Changes the fields set in 'runtime_options'. Thread-safe, the change is
+  // applied when the next range data is added.
+  void UpdateRuntimeOptions(
+      const mapping::proto::TrajectoryBuilderRuntimeOptions& runtime_options);
+
   // Range data must be approximately horizontal for 2D SLAM.
   std::unique_ptr<InsertionResult> AddRangeData(
       common::Time, const sensor::RangeData& range_data);
+  // Same as above for the 'returns' seen from 'origin', which are only read
+  // during the call and need not be copied into a RangeData.
+  std::unique_ptr<InsertionResult> AddRangeData(
+      common::Time time, const Eigen::Vector3f& origin,
+      sensor::PointCloudView returns);
   void AddImuData(const sensor::ImuData& imu_data);
   void AddOdometerData(const sensor::OdometryData& odometry_data);
 
  private:
+  // The 'range_data' is transformed by 'range_data_to_tracking' into the
+  // tracking frame at 'time'.
   std::unique_ptr<InsertionResult> AddAccumulatedRangeData(
-      common::Time time, const sensor::RangeData& range_data);
+      common::Time time, const sensor::RangeData& range_data,
+      const transform::Rigid3f& range_data_to_tracking);
+  // Transforms 'range_data' by 'transform', crops it to the z limits and voxel
+  // filters it.
   sensor::RangeData TransformAndFilterRangeData(
-      const transform::Rigid3f& gravity_alignment,
-      const sensor::RangeData& range_data) const;
+      const transform::Rigid3f& transform, const sensor::RangeData& range_data);
 
   // Scan matches 'gravity_aligned_range_data' and fill in the
   // 'pose_observation' with the result.
@@ -73,24 +99,40 @@ class LocalTrajectoryBuilder {
                  const sensor::RangeData& gravity_aligned_range_data,
                  transform::Rigid2d* pose_observation);
 
+  // Returns true if the accumulation is complete after adding the range data
+  // at 'time', see 'accumulation_duration_seconds'.
+  bool IsAccumulationComplete(common::Time time) const;
+
   // Lazily constructs a PoseExtrapolator.
   void InitializeExtrapolator(common::Time time);
 
-  const proto::LocalTrajectoryBuilderOptions options_;
+  // Applies the runtime options added by UpdateRuntimeOptions() since the
+  // last call.
+  void ApplyPendingRuntimeOptions();
+
+  proto::LocalTrajectoryBuilderOptions options_;
+  mapping::PendingRuntimeOptions<
+      mapping::proto::TrajectoryBuilderRuntimeOptions>
+      pending_runtime_options_;
   ActiveSubmaps active_submaps_;
 
   mapping::PoseEstimate last_pose_estimate_;
 
   mapping_3d::MotionFilter motion_filter_;
-  scan_matching::RealTimeCorrelativeScanMatcher
+  std::unique_ptr<scan_matching::RealTimeCorrelativeScanMatcher>
       real_time_correlative_scan_matcher_;
   scan_matching::CeresScanMatcher ceres_scan_matcher_;
+  scan_matching::GaussNewtonScanMatcher gauss_newton_scan_matcher_;
+  mapping::LocalSlamDegradationController degradation_controller_;
 
   std::unique_ptr<mapping::PoseExtrapolator> extrapolator_;
 
   int num_accumulated_ = 0;
+  common::Time accumulation_start_time_;
   transform::Rigid3f first_pose_estimate_ = transform::Rigid3f::Identity();
   sensor::RangeData accumulated_range_data_;
+  // Buffer reused by TransformAndFilterRangeData().
+  sensor::RangeData cropped_range_data_;
 };
 
 }  // namespace mapping_2d
@@ -16,7 +16,9 @@
 
 #include "cartographer/mapping_2d/local_trajectory_builder_options.h"
 
+#include "cartographer/mapping/local_slam_degradation_controller.h"
 #include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
+#include "cartographer/mapping_2d/scan_matching/gauss_newton_scan_matcher.h"
 #include "cartographer/mapping_2d/scan_matching/real_time_correlative_scan_matcher.h"
 #include "cartographer/mapping_2d/submaps.h"
 #include "cartographer/mapping_3d/motion_filter.h"
@@ -36,6 +38,8 @@ proto::LocalTrajectoryBuilderOptions CreateLocalTrajectoryBuilderOptions(
       parameter_dictionary->GetDouble("missing_data_ray_length"));
   options.set_scans_per_accumulation(
       parameter_dictionary->GetInt("scans_per_accumulation"));
+  options.set_accumulation_duration_seconds(
+      parameter_dictionary->GetDouble("accumulation_duration_seconds"));
   options.set_voxel_filter_size(
       parameter_dictionary->GetDouble("voxel_filter_size"));
   options.set_use_online_correlative_scan_matching(
@@ -56,9 +60,18 @@ proto::LocalTrajectoryBuilderOptions CreateLocalTrajectoryBuilderOptions(
   *options.mutable_ceres_scan_matcher_options() =
       scan_matching::CreateCeresScanMatcherOptions(
           parameter_dictionary->GetDictionary("ceres_scan_matcher").get());
+  options.set_use_gauss_newton_scan_matcher(
+      parameter_dictionary->GetBool("use_gauss_newton_scan_matcher"));
+  *options.mutable_gauss_newton_scan_matcher_options() =
+      scan_matching::CreateGaussNewtonScanMatcherOptions(
+          parameter_dictionary->GetDictionary("gauss_newton_scan_matcher")
+              .get());
   *options.mutable_motion_filter_options() =
       mapping_3d::CreateMotionFilterOptions(
           parameter_dictionary->GetDictionary("motion_filter").get());
+  *options.mutable_degradation_options() =
+      mapping::CreateLocalSlamDegradationOptions(
+          parameter_dictionary->GetDictionary("degradation").get());
   options.set_imu_gravity_time_constant(
       parameter_dictionary->GetDouble("imu_gravity_time_constant"));
   *options.mutable_submaps_options() = CreateSubmapsOptions(
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_LOG_ODDS_GRID_H_
+#define CARTOGRAPHER_MAPPING_2D_LOG_ODDS_GRID_H_
+
+#include <utility>
+#include <vector>
+
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/xy_index.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping_2d {
+
+// Represents a 2D grid of probabilities stored as clamped log-odds values.
+//
+// Compared to ProbabilityGrid, hits and misses are applied as a saturating
+// addition instead of a lookup into a 64 KiB table per update, which keeps
+// the working set of insertion small. Consumers such as the scan matchers
+// convert to a ProbabilityGrid using ToProbabilityGrid().
+class LogOddsGrid {
+ public:
+  explicit LogOddsGrid(const MapLimits& limits)
+      : limits_(limits),
+        cells_(limits_.cell_limits().num_x_cells *
+                   limits_.cell_limits().num_y_cells,
+               mapping::kUnknownLogOddsValue) {}
+
+  // Returns the limits of this LogOddsGrid.
+  const MapLimits& limits() const { return limits_; }
+
+  // Returns the index of the cell at 'cell_index' to be passed to
+  // ApplyLogOddsUpdate(). The caller guarantees that 'cell_index' is
+  // contained in the limits, which is only checked in debug builds. The index
+  // becomes invalid when GrowLimits() changes the limits.
+  int ToFlatIndexUnchecked(const Eigen::Array2i& cell_index) const {
+    DCHECK(limits_.Contains(cell_index)) << cell_index;
+    return limits_.cell_limits().num_x_cells * cell_index.y() + cell_index.x();
+  }
+
+  // Returns an upper bound for the indices returned by ToFlatIndexUnchecked().
+  int GetNumFlatIndices() const { return cells_.size(); }
+
+  // Adds 'update' as computed by ComputeLogOddsValueUpdate() to the cells at
+  // 'flat_indices'. The 'flat_indices' must be computed by
+  // ToFlatIndexUnchecked() and 'bounding_box' must contain the cell indices of
+  // all of them.
+  void ApplyLogOddsUpdate(const std::vector<int>& flat_indices,
+                          const Eigen::AlignedBox2i& bounding_box,
+                          const int update) {
+    if (flat_indices.empty()) {
+      return;
+    }
+    uint16* const cells = cells_.data();
+    for (const int flat_index : flat_indices) {
+      cells[flat_index] =
+          mapping::ApplyLogOddsValueUpdate(cells[flat_index], update);
+    }
+    known_cells_box_.extend(bounding_box);
+  }
+
+  // Returns the probability of the cell with 'cell_index'.
+  float GetProbability(const Eigen::Array2i& cell_index) const {
+    if (limits_.Contains(cell_index)) {
+      return mapping::LogOddsValueToProbability(
+          cells_[ToFlatIndexUnchecked(cell_index)]);
+    }
+    return mapping::kMinProbability;
+  }
+
+  // Returns true if the probability at the specified index is known.
+  bool IsKnown(const Eigen::Array2i& cell_index) const {
+    return limits_.Contains(cell_index) &&
+           cells_[ToFlatIndexUnchecked(cell_index)] !=
+               mapping::kUnknownLogOddsValue;
+  }
+
+  // Grows the map as necessary to include 'point'. This changes the meaning of
+  // these coordinates going forward.
+  void GrowLimits(const Eigen::Vector2f& point) {
+    while (!limits_.Contains(limits_.GetCellIndex(point))) {
+      const int x_offset = limits_.cell_limits().num_x_cells / 2;
+      const int y_offset = limits_.cell_limits().num_y_cells / 2;
+      const MapLimits new_limits(
+          limits_.resolution(),
+          limits_.max() +
+              limits_.resolution() * Eigen::Vector2d(y_offset, x_offset),
+          CellLimits(2 * limits_.cell_limits().num_x_cells,
+                     2 * limits_.cell_limits().num_y_cells));
+      const int stride = new_limits.cell_limits().num_x_cells;
+      const int offset = x_offset + stride * y_offset;
+      std::vector<uint16> new_cells(
+          stride * new_limits.cell_limits().num_y_cells,
+          mapping::kUnknownLogOddsValue);
+      for (int i = 0; i < limits_.cell_limits().num_y_cells; ++i) {
+        for (int j = 0; j < limits_.cell_limits().num_x_cells; ++j) {
+          new_cells[offset + j + i * stride] =
+              cells_[j + i * limits_.cell_limits().num_x_cells];
+        }
+      }
+      cells_ = std::move(new_cells);
+      limits_ = new_limits;
+      if (!known_cells_box_.isEmpty()) {
+        known_cells_box_.translate(Eigen::Vector2i(x_offset, y_offset));
+      }
+    }
+  }
+
+  // Returns a ProbabilityGrid with the same limits and known cells.
+  ProbabilityGrid ToProbabilityGrid() const {
+    ProbabilityGrid probability_grid(limits_);
+    if (known_cells_box_.isEmpty()) {
+      return probability_grid;
+    }
+    for (int y = known_cells_box_.min().y(); y <= known_cells_box_.max().y();
+         ++y) {
+      for (int x = known_cells_box_.min().x(); x <= known_cells_box_.max().x();
+           ++x) {
+        const Eigen::Array2i cell_index(x, y);
+        const uint16 value = cells_[ToFlatIndexUnchecked(cell_index)];
+        if (value != mapping::kUnknownLogOddsValue) {
+          probability_grid.SetProbability(
+              cell_index, mapping::LogOddsValueToProbability(value));
+        }
+      }
+    }
+    return probability_grid;
+  }
+
+  // Returns the number of bytes used for storing cells.
+  int64 GetMemoryUsageInBytes() const {
+    return sizeof(*this) + cells_.capacity() * sizeof(uint16);
+  }
+
+ private:
+  MapLimits limits_;
+  std::vector<uint16> cells_;  // Highest bit is unused.
+  Eigen::AlignedBox2i known_cells_box_;
+};
+
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_LOG_ODDS_GRID_H_
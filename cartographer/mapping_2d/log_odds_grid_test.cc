@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/log_odds_grid.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace {
+
+TEST(LogOddsGridTest, ApplyLogOddsUpdate) {
+  LogOddsGrid log_odds_grid(
+      MapLimits(1., Eigen::Vector2d(1., 1.), CellLimits(2, 2)));
+  const Eigen::Array2i cell_index(1, 0);
+  EXPECT_FALSE(log_odds_grid.IsKnown(cell_index));
+  const std::vector<int> flat_indices = {
+      log_odds_grid.ToFlatIndexUnchecked(cell_index)};
+  const Eigen::AlignedBox2i bounding_box(cell_index.matrix());
+  log_odds_grid.ApplyLogOddsUpdate(
+      flat_indices, bounding_box,
+      mapping::ComputeLogOddsValueUpdate(mapping::Odds(0.6f)));
+  EXPECT_TRUE(log_odds_grid.IsKnown(cell_index));
+  EXPECT_NEAR(0.6f, log_odds_grid.GetProbability(cell_index), 1e-4);
+  log_odds_grid.ApplyLogOddsUpdate(
+      flat_indices, bounding_box,
+      mapping::ComputeLogOddsValueUpdate(mapping::Odds(0.6f)));
+  EXPECT_NEAR(mapping::ProbabilityFromOdds(mapping::Odds(0.6f) *
+                                           mapping::Odds(0.6f)),
+              log_odds_grid.GetProbability(cell_index), 1e-4);
+  EXPECT_FALSE(log_odds_grid.IsKnown(Eigen::Array2i(0, 0)));
+}
+
+TEST(LogOddsGridTest, GrowLimitsAndConvert) {
+  LogOddsGrid log_odds_grid(
+      MapLimits(1., Eigen::Vector2d(1., 1.), CellLimits(2, 2)));
+  const Eigen::Vector2f point(0.5f, 0.5f);
+  Eigen::Array2i cell_index = log_odds_grid.limits().GetCellIndex(point);
+  log_odds_grid.ApplyLogOddsUpdate(
+      {log_odds_grid.ToFlatIndexUnchecked(cell_index)},
+      Eigen::AlignedBox2i(cell_index.matrix()),
+      mapping::ComputeLogOddsValueUpdate(mapping::Odds(0.3f)));
+
+  log_odds_grid.GrowLimits(Eigen::Vector2f(-3.f, -3.f));
+  EXPECT_EQ(8, log_odds_grid.limits().cell_limits().num_x_cells);
+  cell_index = log_odds_grid.limits().GetCellIndex(point);
+  EXPECT_NEAR(0.3f, log_odds_grid.GetProbability(cell_index), 1e-4);
+
+  const ProbabilityGrid probability_grid = log_odds_grid.ToProbabilityGrid();
+  EXPECT_EQ(8, probability_grid.limits().cell_limits().num_x_cells);
+  EXPECT_NEAR(0.3f, probability_grid.GetProbability(cell_index), 1e-4);
+  Eigen::Array2i offset;
+  CellLimits limits;
+  probability_grid.ComputeCroppedLimits(&offset, &limits);
+  EXPECT_EQ(cell_index.x(), offset.x());
+  EXPECT_EQ(cell_index.y(), offset.y());
+  EXPECT_EQ(1, limits.num_x_cells);
+  EXPECT_EQ(1, limits.num_y_cells);
+}
+
+}  // namespace
+}  // namespace mapping_2d
+}  // namespace cartographer
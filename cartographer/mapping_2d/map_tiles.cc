@@ -0,0 +1,269 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/map_tiles.h"
+
+#include <cmath>
+#include <set>
+
+#include "cartographer/common/math.h"
+#include "cartographer/transform/transform.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping_2d {
+
+MapTiles::MapTiles(const double resolution, const int tile_size_in_pixels,
+                   const int num_levels, const double max_translation_change,
+                   const double max_rotation_change)
+    : resolution_(resolution),
+      tile_size_in_pixels_(tile_size_in_pixels),
+      num_levels_(num_levels),
+      max_translation_change_(max_translation_change),
+      max_rotation_change_(max_rotation_change) {
+  CHECK_GT(resolution_, 0.);
+  CHECK_GT(tile_size_in_pixels_, 0);
+  CHECK_EQ(tile_size_in_pixels_ % 2, 0);
+  CHECK_GT(num_levels_, 0);
+}
+
+void MapTiles::SetSubmap(const mapping::SubmapId& submap_id,
+                         std::shared_ptr<const Submap> submap,
+                         const transform::Rigid3d& global_pose) {
+  CHECK(submap->finished());
+  const auto it = submaps_.find(submap_id);
+  if (it != submaps_.end()) {
+    if (it->second.submap == submap) {
+      const transform::Rigid2d change = transform::Project2D(
+          it->second.global_pose.inverse() * global_pose);
+      if (change.translation().norm() <= max_translation_change_ &&
+          std::abs(change.normalized_angle()) <= max_rotation_change_) {
+        return;
+      }
+    }
+    InvalidateTiles(it->second.box);
+    submaps_.erase(it);
+  }
+
+  const ProbabilityGrid& probability_grid = submap->probability_grid();
+  // The probability grid is in the local SLAM frame of the submap.
+  const transform::Rigid2d grid_from_map = transform::Project2D(
+      submap->local_pose() * global_pose.inverse());
+  const transform::Rigid2d map_from_grid = grid_from_map.inverse();
+  Eigen::Array2i offset;
+  CellLimits limits;
+  probability_grid.ComputeCroppedLimits(&offset, &limits);
+  const MapLimits& map_limits = probability_grid.limits();
+  // Cell indices count down from 'max', x indices along the y-axis.
+  const Eigen::Vector2d max =
+      map_limits.max() - map_limits.resolution() *
+                             Eigen::Vector2d(offset.y(), offset.x());
+  const Eigen::Vector2d min =
+      max - map_limits.resolution() *
+                Eigen::Vector2d(limits.num_y_cells, limits.num_x_cells);
+  Eigen::AlignedBox2d box;
+  for (const Eigen::Vector2d& corner :
+       {min, max, Eigen::Vector2d(min.x(), max.y()),
+        Eigen::Vector2d(max.x(), min.y())}) {
+    box.extend(map_from_grid * corner);
+  }
+  InvalidateTiles(box);
+  submaps_.emplace(submap_id, SubmapEntry{std::move(submap), global_pose,
+                                          grid_from_map, box});
+}
+
+void MapTiles::RemoveSubmap(const mapping::SubmapId& submap_id) {
+  const auto it = submaps_.find(submap_id);
+  if (it == submaps_.end()) {
+    return;
+  }
+  InvalidateTiles(it->second.box);
+  submaps_.erase(it);
+}
+
+void MapTiles::Update(
+    const std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>&
+        all_submap_data) {
+  std::set<mapping::SubmapId> submap_ids;
+  for (size_t trajectory_id = 0; trajectory_id != all_submap_data.size();
+       ++trajectory_id) {
+    const auto& trajectory_submap_data = all_submap_data[trajectory_id];
+    for (size_t submap_index = 0;
+         submap_index != trajectory_submap_data.size(); ++submap_index) {
+      const auto submap = std::dynamic_pointer_cast<const Submap>(
+          trajectory_submap_data[submap_index].submap);
+      if (submap == nullptr || !submap->finished()) {
+        continue;
+      }
+      const mapping::SubmapId submap_id{static_cast<int>(trajectory_id),
+                                        static_cast<int>(submap_index)};
+      SetSubmap(submap_id, submap, trajectory_submap_data[submap_index].pose);
+      submap_ids.insert(submap_id);
+    }
+  }
+  for (auto it = submaps_.begin(); it != submaps_.end();) {
+    if (submap_ids.count(it->first) == 0) {
+      InvalidateTiles(it->second.box);
+      it = submaps_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::vector<MapTiles::TileId> MapTiles::GetTileIds(const int level) const {
+  CHECK_GE(level, 0);
+  CHECK_LT(level, num_levels_);
+  Eigen::AlignedBox2d box;
+  for (const auto& entry : submaps_) {
+    box.extend(entry.second.box);
+  }
+  std::vector<TileId> tile_ids;
+  if (box.isEmpty()) {
+    return tile_ids;
+  }
+  const double edge_length = GetTileEdgeLength(level);
+  const Eigen::Array2i min_index =
+      (box.min() / edge_length).array().floor().cast<int>();
+  const Eigen::Array2i max_index =
+      (box.max() / edge_length).array().floor().cast<int>();
+  for (int y = min_index.y(); y <= max_index.y(); ++y) {
+    for (int x = min_index.x(); x <= max_index.x(); ++x) {
+      tile_ids.push_back(TileId{level, x, y});
+    }
+  }
+  return tile_ids;
+}
+
+const MapTiles::Tile& MapTiles::GetTile(const TileId& tile_id) {
+  CHECK_GE(tile_id.level, 0);
+  CHECK_LT(tile_id.level, num_levels_);
+  auto it = tiles_.find(tile_id);
+  if (it == tiles_.end()) {
+    it = tiles_
+             .emplace(tile_id, tile_id.level == 0
+                                   ? RenderSubmaps(tile_id)
+                                   : RenderFromLevelBelow(tile_id))
+             .first;
+  }
+  return it->second;
+}
+
+double MapTiles::GetTileEdgeLength(const int level) const {
+  return std::ldexp(resolution_ * tile_size_in_pixels_, level);
+}
+
+Eigen::AlignedBox2d MapTiles::GetTileBox(const TileId& tile_id) const {
+  const double edge_length = GetTileEdgeLength(tile_id.level);
+  const Eigen::Vector2d min =
+      edge_length * Eigen::Vector2d(tile_id.x, tile_id.y);
+  return Eigen::AlignedBox2d(min,
+                             min + Eigen::Vector2d::Constant(edge_length));
+}
+
+void MapTiles::InvalidateTiles(const Eigen::AlignedBox2d& box) {
+  for (auto it = tiles_.begin(); it != tiles_.end();) {
+    if (GetTileBox(it->first).intersects(box)) {
+      it = tiles_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+MapTiles::Tile MapTiles::RenderSubmaps(const TileId& tile_id) const {
+  const int num_pixels = tile_size_in_pixels_ * tile_size_in_pixels_;
+  // Sums of the probabilities of all submaps knowing a pixel.
+  std::vector<float> probability_sums(num_pixels, 0.f);
+  std::vector<int> num_known(num_pixels, 0);
+  const Eigen::AlignedBox2d tile_box = GetTileBox(tile_id);
+  for (const auto& entry : submaps_) {
+    const SubmapEntry& submap_entry = entry.second;
+    if (!submap_entry.box.intersects(tile_box)) {
+      continue;
+    }
+    const ProbabilityGrid& probability_grid =
+        submap_entry.submap->probability_grid();
+    for (int row = 0; row != tile_size_in_pixels_; ++row) {
+      for (int column = 0; column != tile_size_in_pixels_; ++column) {
+        const Eigen::Vector2d pixel_center(
+            tile_box.min().x() + (column + 0.5) * resolution_,
+            tile_box.max().y() - (row + 0.5) * resolution_);
+        const Eigen::Array2i cell_index =
+            probability_grid.limits().GetCellIndex(
+                (submap_entry.grid_from_map * pixel_center).cast<float>());
+        if (probability_grid.IsKnown(cell_index)) {
+          const int pixel_index = row * tile_size_in_pixels_ + column;
+          probability_sums[pixel_index] +=
+              probability_grid.GetProbability(cell_index);
+          ++num_known[pixel_index];
+        }
+      }
+    }
+  }
+  Tile tile{std::vector<uint8>(num_pixels, 0),
+            std::vector<uint8>(num_pixels, 0)};
+  for (int i = 0; i != num_pixels; ++i) {
+    if (num_known[i] > 0) {
+      tile.intensities[i] = common::RoundToInt(
+          255.f * (1.f - probability_sums[i] / num_known[i]));
+      tile.alphas[i] = 255;
+    }
+  }
+  return tile;
+}
+
+MapTiles::Tile MapTiles::RenderFromLevelBelow(const TileId& tile_id) {
+  const int num_pixels = tile_size_in_pixels_ * tile_size_in_pixels_;
+  std::vector<int> intensity_sums(num_pixels, 0);
+  std::vector<int> num_known(num_pixels, 0);
+  for (int dy = 0; dy != 2; ++dy) {
+    for (int dx = 0; dx != 2; ++dx) {
+      const Tile& child = GetTile(
+          TileId{tile_id.level - 1, 2 * tile_id.x + dx, 2 * tile_id.y + dy});
+      // Rows start at the maximum y coordinate, so the upper children fill
+      // the first half of the rows.
+      const int first_row = (1 - dy) * tile_size_in_pixels_ / 2;
+      const int first_column = dx * tile_size_in_pixels_ / 2;
+      for (int row = 0; row != tile_size_in_pixels_; ++row) {
+        for (int column = 0; column != tile_size_in_pixels_; ++column) {
+          const int child_index = row * tile_size_in_pixels_ + column;
+          if (child.alphas[child_index] == 0) {
+            continue;
+          }
+          const int pixel_index =
+              (first_row + row / 2) * tile_size_in_pixels_ + first_column +
+              column / 2;
+          intensity_sums[pixel_index] += child.intensities[child_index];
+          ++num_known[pixel_index];
+        }
+      }
+    }
+  }
+  Tile tile{std::vector<uint8>(num_pixels, 0),
+            std::vector<uint8>(num_pixels, 0)};
+  for (int i = 0; i != num_pixels; ++i) {
+    if (num_known[i] > 0) {
+      tile.intensities[i] = common::RoundToInt(
+          static_cast<float>(intensity_sums[i]) / num_known[i]);
+      tile.alphas[i] = 255;
+    }
+  }
+  return tile;
+}
+
+}  // namespace mapping_2d
+}  // namespace cartographer
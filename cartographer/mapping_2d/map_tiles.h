@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_MAP_TILES_H_
+#define CARTOGRAPHER_MAPPING_2D_MAP_TILES_H_
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/sparse_pose_graph.h"
+#include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping_2d {
+
+// Renders the probability grids of finished submaps at their global poses into
+// a quadtree of square tiles with 'tile_size_in_pixels' pixels per side, so
+// that an overview of a large map does not need the textures of all submaps.
+//
+// At level 0, pixels have an edge length of 'resolution'. Each tile of the
+// next level covers 2x2 tiles of the level below at half the resolution, up
+// to level 'num_levels' - 1. Tiles are rendered when they are first requested
+// and cached until a submap overlapping them is added, removed, or moved by
+// more than 'max_translation_change' or 'max_rotation_change'. Smaller moves
+// are ignored, so that small corrections by the optimization do not render
+// the map again.
+//
+// This class is not thread-safe.
+class MapTiles {
+ public:
+  struct TileId {
+    int level;
+    // Index of the tile along the x and y axes of the map frame, i.e. the tile
+    // covers [x, x + 1) * edge length times [y, y + 1) * edge length.
+    int x;
+    int y;
+
+    bool operator<(const TileId& other) const {
+      return std::forward_as_tuple(level, x, y) <
+             std::forward_as_tuple(other.level, other.x, other.y);
+    }
+  };
+
+  // Pixels in rows from the maximum to the minimum y coordinate, each row from
+  // the minimum to the maximum x coordinate. An 'intensity' of 255 is free and
+  // 0 occupied space. The 'alpha' is 0 where nothing is known, 255 otherwise.
+  struct Tile {
+    std::vector<uint8> intensities;
+    std::vector<uint8> alphas;
+  };
+
+  MapTiles(double resolution, int tile_size_in_pixels, int num_levels,
+           double max_translation_change, double max_rotation_change);
+
+  MapTiles(const MapTiles&) = delete;
+  MapTiles& operator=(const MapTiles&) = delete;
+
+  // Adds the finished 'submap' with 'submap_id' at 'global_pose', or moves it
+  // there if it was added before.
+  void SetSubmap(const mapping::SubmapId& submap_id,
+                 std::shared_ptr<const Submap> submap,
+                 const transform::Rigid3d& global_pose);
+  void RemoveSubmap(const mapping::SubmapId& submap_id);
+
+  // Sets all finished submaps in 'all_submap_data', which is indexed like the
+  // result of SparsePoseGraph::GetAllSubmapData(), and removes the submaps
+  // that are no longer part of it.
+  void Update(
+      const std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>&
+          all_submap_data);
+
+  // Returns the IDs of all tiles at 'level' which may overlap submaps.
+  std::vector<TileId> GetTileIds(int level) const;
+
+  // Returns the tile with 'tile_id', which is rendered if it is not cached.
+  const Tile& GetTile(const TileId& tile_id);
+
+  int num_cached_tiles() const { return tiles_.size(); }
+
+ private:
+  struct SubmapEntry {
+    std::shared_ptr<const Submap> submap;
+    transform::Rigid3d global_pose;
+    // Transforms points in the map frame into the frame of the probability
+    // grid of 'submap'.
+    transform::Rigid2d grid_from_map;
+    // Bounding box of the known cells of 'submap' in the map frame.
+    Eigen::AlignedBox2d box;
+  };
+
+  double GetTileEdgeLength(int level) const;
+  Eigen::AlignedBox2d GetTileBox(const TileId& tile_id) const;
+  // Removes all cached tiles overlapping 'box'.
+  void InvalidateTiles(const Eigen::AlignedBox2d& box);
+  Tile RenderSubmaps(const TileId& tile_id) const;
+  Tile RenderFromLevelBelow(const TileId& tile_id);
+
+  const double resolution_;
+  const int tile_size_in_pixels_;
+  const int num_levels_;
+  const double max_translation_change_;
+  const double max_rotation_change_;
+  std::map<mapping::SubmapId, SubmapEntry> submaps_;
+  std::map<TileId, Tile> tiles_;
+};
+
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_MAP_TILES_H_
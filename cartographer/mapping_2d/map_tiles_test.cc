@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/map_tiles.h"
+
+#include <memory>
+
+#include "cartographer/mapping_2d/range_data_inserter.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace {
+
+constexpr double kResolution = 0.05;
+constexpr int kTileSizeInPixels = 16;
+
+// Returns a finished submap in which the cell at (0.5, 0.5) is occupied and
+// the cells between it and the origin are free.
+std::shared_ptr<const Submap> CreateSubmap() {
+  proto::RangeDataInserterOptions options;
+  options.set_insert_free_space(true);
+  options.set_hit_probability(0.7);
+  options.set_miss_probability(0.4);
+  const RangeDataInserter range_data_inserter(options);
+  auto submap = std::make_shared<Submap>(
+      MapLimits(kResolution, Eigen::Vector2d(1., 1.), CellLimits(40, 40)),
+      Eigen::Vector2f::Zero());
+  submap->InsertRangeData(
+      sensor::RangeData{Eigen::Vector3f::Zero(),
+                        {Eigen::Vector3f(0.51f, 0.51f, 0.f)},
+                        {}},
+      range_data_inserter);
+  submap->Finish();
+  return submap;
+}
+
+// Returns the pixel index in 'tile_id' at the given map coordinates.
+int GetPixelIndex(const MapTiles::TileId& tile_id, const double x,
+                  const double y) {
+  const double pixel_size = kResolution * (1 << tile_id.level);
+  const double edge_length = pixel_size * kTileSizeInPixels;
+  const int column = std::floor((x - tile_id.x * edge_length) / pixel_size);
+  const int row =
+      std::floor(((tile_id.y + 1) * edge_length - y) / pixel_size);
+  return row * kTileSizeInPixels + column;
+}
+
+TEST(MapTilesTest, RendersSubmapsAtTheirGlobalPose) {
+  MapTiles map_tiles(kResolution, kTileSizeInPixels, 3,
+                     0.1 /* max_translation_change */,
+                     0.1 /* max_rotation_change */);
+  map_tiles.SetSubmap(mapping::SubmapId{0, 0}, CreateSubmap(),
+                      transform::Rigid3d::Translation({2., 0., 0.}));
+  // The occupied cell is at (2.5, 0.5), in the tile of 0.8 m covering [2.4,
+  // 3.2) x [0., 0.8) at level 0.
+  const MapTiles::TileId tile_id{0, 3, 0};
+  const MapTiles::Tile& tile = map_tiles.GetTile(tile_id);
+  ASSERT_EQ(kTileSizeInPixels * kTileSizeInPixels, tile.alphas.size());
+  const int occupied_index = GetPixelIndex(tile_id, 2.51, 0.51);
+  EXPECT_EQ(255, tile.alphas[occupied_index]);
+  EXPECT_LT(tile.intensities[occupied_index], 128);
+  const int free_index = GetPixelIndex(tile_id, 2.41, 0.41);
+  EXPECT_EQ(255, tile.alphas[free_index]);
+  EXPECT_GT(tile.intensities[free_index], 128);
+  EXPECT_EQ(0, tile.alphas[GetPixelIndex(tile_id, 3.1, 0.1)]);
+
+  // At level 2, the pixels are 4 times larger.
+  const MapTiles::TileId top_tile_id{2, 0, 0};
+  const MapTiles::Tile& top_tile = map_tiles.GetTile(top_tile_id);
+  EXPECT_EQ(255, top_tile.alphas[GetPixelIndex(top_tile_id, 2.51, 0.51)]);
+  EXPECT_EQ(0, top_tile.alphas[GetPixelIndex(top_tile_id, 0.1, 3.1)]);
+  // The top tile needs all 4 x 4 tiles of level 0 and 2 x 2 of level 1.
+  EXPECT_EQ(1 + 4 + 16, map_tiles.num_cached_tiles());
+}
+
+TEST(MapTilesTest, InvalidatesTilesOfMovedSubmaps) {
+  MapTiles map_tiles(kResolution, kTileSizeInPixels, 2,
+                     0.1 /* max_translation_change */,
+                     0.1 /* max_rotation_change */);
+  const auto submap = CreateSubmap();
+  map_tiles.SetSubmap(mapping::SubmapId{0, 0}, submap,
+                      transform::Rigid3d::Identity());
+  const std::vector<MapTiles::TileId> tile_ids = map_tiles.GetTileIds(0);
+  EXPECT_FALSE(tile_ids.empty());
+  for (const MapTiles::TileId& tile_id : tile_ids) {
+    map_tiles.GetTile(tile_id);
+  }
+  // A tile far away from the submap.
+  map_tiles.GetTile(MapTiles::TileId{0, 10, 10});
+  const int num_cached_tiles = map_tiles.num_cached_tiles();
+  EXPECT_EQ(tile_ids.size() + 1, num_cached_tiles);
+
+  // Small changes are ignored.
+  map_tiles.SetSubmap(mapping::SubmapId{0, 0}, submap,
+                      transform::Rigid3d::Translation({0.05, 0., 0.}));
+  EXPECT_EQ(num_cached_tiles, map_tiles.num_cached_tiles());
+
+  map_tiles.SetSubmap(mapping::SubmapId{0, 0}, submap,
+                      transform::Rigid3d::Translation({0.5, 0., 0.}));
+  EXPECT_EQ(1, map_tiles.num_cached_tiles());
+
+  map_tiles.GetTile(MapTiles::TileId{0, 1, 0});
+  EXPECT_EQ(2, map_tiles.num_cached_tiles());
+  map_tiles.Update({});
+  EXPECT_EQ(1, map_tiles.num_cached_tiles());
+  EXPECT_TRUE(map_tiles.GetTileIds(0).empty());
+}
+
+}  // namespace
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -18,7 +18,9 @@
 #define CARTOGRAPHER_MAPPING_2D_PROBABILITY_GRID_H_
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -36,48 +38,131 @@
 namespace cartographer {
 namespace mapping_2d {
 
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "The compact proto encoding copies cells as little-endian.");
+
 // Represents a 2D grid of probabilities.
+//
+// Cells are either stored densely in a single vector, or, if 'tiled' is true,
+// in square tiles which are only allocated once one of their cells is
+// changed. Tiled storage uses memory proportional to the mapped area and does
+// not copy any cells when growing the limits.
+//
+// Tiled grids can additionally be 'adaptive': their tiles are then allocated
+// with one cell per block of 2^kCoarseBits x 2^kCoarseBits cells, which all
+// cells of the block share. A tile is only refined to one value per cell once
+// an update makes one of its cells occupied, so that tiles which only ever saw
+// free space, e.g. in large open areas, use 16 times less memory. All
+// accessors resolve a cell index to the value of its block while the tile is
+// coarse, so readers like the scan matchers need not know about blocks.
+//
+// Optionally, the probabilities of all cells are additionally kept as floats
+// in a dense array with a border of unknown cells, which scan matching can
+// read without bounds checks or conversions.
 class ProbabilityGrid {
  public:
-  explicit ProbabilityGrid(const MapLimits& limits)
-      : limits_(limits),
-        cells_(limits_.cell_limits().num_x_cells *
-                   limits_.cell_limits().num_y_cells,
-               mapping::kUnknownProbabilityValue) {}
+  // Number of cells of minimum probability on each side of the probability
+  // mirror.
+  static constexpr int kMirrorPadding = 3;
+
+  explicit ProbabilityGrid(const MapLimits& limits, const bool tiled = false,
+                           const bool adaptive = false)
+      : limits_(limits), tiled_(tiled), adaptive_(adaptive) {
+    CHECK(tiled_ || !adaptive_) << "Only tiled grids can be adaptive.";
+    if (tiled_) {
+      num_x_tiles_ = GetNumTiles(limits_.cell_limits().num_x_cells);
+      tiles_.resize(num_x_tiles_ *
+                    GetNumTiles(limits_.cell_limits().num_y_cells));
+    } else {
+      cells_.assign(limits_.cell_limits().num_x_cells *
+                        limits_.cell_limits().num_y_cells,
+                    mapping::kUnknownProbabilityValue);
+    }
+  }
 
   explicit ProbabilityGrid(const proto::ProbabilityGrid& proto)
-      : limits_(proto.limits()), cells_() {
+      : limits_(proto.limits()), tiled_(false), adaptive_(false) {
     if (proto.has_min_x()) {
       known_cells_box_ =
           Eigen::AlignedBox2i(Eigen::Vector2i(proto.min_x(), proto.min_y()),
                               Eigen::Vector2i(proto.max_x(), proto.max_y()));
     }
-    cells_.reserve(proto.cells_size());
-    for (const auto cell : proto.cells()) {
-      CHECK_LE(cell, std::numeric_limits<uint16>::max());
-      cells_.push_back(cell);
+    if (proto.has_known_cells()) {
+      cells_.assign(limits_.cell_limits().num_x_cells *
+                        limits_.cell_limits().num_y_cells,
+                    mapping::kUnknownProbabilityValue);
+      if (known_cells_box_.isEmpty()) {
+        CHECK(proto.known_cells().empty());
+        return;
+      }
+      const int width = known_cells_box_.sizes().x() + 1;
+      CHECK_EQ(proto.known_cells().size(),
+               sizeof(uint16) * width * (known_cells_box_.sizes().y() + 1));
+      const char* row = proto.known_cells().data();
+      for (int y = known_cells_box_.min().y(); y <= known_cells_box_.max().y();
+           ++y) {
+        std::memcpy(&cells_[ToFlatIndex(
+                        Eigen::Array2i(known_cells_box_.min().x(), y))],
+                    row, sizeof(uint16) * width);
+        row += sizeof(uint16) * width;
+      }
+      return;
     }
+    // Legacy grids store all cells in the 'cells' field. It is range checked
+    // as a whole and copied in one pass.
+    const int32* const cells = proto.cells().data();
+    if (proto.cells_size() != 0) {
+      const auto min_max =
+          std::minmax_element(cells, cells + proto.cells_size());
+      CHECK_GE(*min_max.first, 0);
+      CHECK_LE(*min_max.second, std::numeric_limits<uint16>::max());
+    }
+    cells_.assign(cells, cells + proto.cells_size());
   }
 
   // Returns the limits of this ProbabilityGrid.
   const MapLimits& limits() const { return limits_; }
 
+  // Returns true if cells are stored in tiles.
+  bool tiled() const { return tiled_; }
+
+  // Returns true if tiles are stored coarsely until cells become occupied.
+  bool adaptive() const { return adaptive_; }
+
   // Finishes the update sequence.
-  void FinishUpdate() {
-    while (!update_indices_.empty()) {
-      DCHECK_GE(cells_[update_indices_.back()], mapping::kUpdateMarker);
-      cells_[update_indices_.back()] -= mapping::kUpdateMarker;
-      update_indices_.pop_back();
-    }
+  void FinishUpdate() { FinishUpdatesSince(0); }
+
+  // Starts keeping the probability mirror returned by probability_mirror() in
+  // sync with the cells. Must not be called during an update.
+  void EnableProbabilityMirror() {
+    CHECK(update_indices_.empty());
+    RebuildProbabilityMirror();
+  }
+
+  // Returns the probabilities of all cells as floats, or nullptr unless
+  // EnableProbabilityMirror() was called. The cell at 'cell_index' is at
+  // 'cell_index + kMirrorPadding' in the row-major array with
+  // 'probability_mirror_width()' columns. All other entries are
+  // 'kMinProbability'. Cells changed by an update are only reflected once it
+  // is finished, and the pointer is invalidated by GrowLimits().
+  const float* probability_mirror() const {
+    return probability_mirror_.empty() ? nullptr : probability_mirror_.data();
+  }
+
+  // Returns the number of columns of the probability mirror.
+  int probability_mirror_width() const {
+    return limits_.cell_limits().num_x_cells + 2 * kMirrorPadding;
   }
 
   // Sets the probability of the cell at 'cell_index' to the given
   // 'probability'. Only allowed if the cell was unknown before.
   void SetProbability(const Eigen::Array2i& cell_index,
                       const float probability) {
-    uint16& cell = cells_[ToFlatIndex(cell_index)];
-    CHECK_EQ(cell, mapping::kUnknownProbabilityValue);
-    cell = mapping::ProbabilityToValue(probability);
+    const int flat_index = ToFlatIndex(cell_index);
+    CHECK_EQ(cell(flat_index), mapping::kUnknownProbabilityValue);
+    const uint16 value = mapping::ProbabilityToValue(probability);
+    SetCellValue(flat_index, value);
+    UpdateProbabilityMirror(flat_index, value);
     known_cells_box_.extend(cell_index.matrix());
   }
 
@@ -91,22 +176,110 @@ class ProbabilityGrid {
   bool ApplyLookupTable(const Eigen::Array2i& cell_index,
                         const std::vector<uint16>& table) {
     DCHECK_EQ(table.size(), mapping::kUpdateMarker);
-    const int flat_index = ToFlatIndex(cell_index);
-    uint16& cell = cells_[flat_index];
-    if (cell >= mapping::kUpdateMarker) {
+    if (!ApplyLookupTableToFlatIndex(ToFlatIndex(cell_index), table)) {
       return false;
     }
-    update_indices_.push_back(flat_index);
-    cell = table[cell];
-    DCHECK_GE(cell, mapping::kUpdateMarker);
     known_cells_box_.extend(cell_index.matrix());
     return true;
   }
 
+  // Returns the index of the cell at 'cell_index' to be passed to the bulk
+  // version of ApplyLookupTable() below. The caller guarantees that
+  // 'cell_index' is contained in the limits, which is only checked in debug
+  // builds. The index becomes invalid when GrowLimits() changes the limits.
+  int ToFlatIndexUnchecked(const Eigen::Array2i& cell_index) const {
+    DCHECK(limits_.Contains(cell_index)) << cell_index;
+    if (tiled_) {
+      const Eigen::Array2i padded_index = cell_index + tile_padding_;
+      const int tile_index = (padded_index.y() >> kTileBits) * num_x_tiles_ +
+                             (padded_index.x() >> kTileBits);
+      return tile_index * kCellsPerTile +
+             ((padded_index.y() & (kTileSize - 1)) << kTileBits) +
+             (padded_index.x() & (kTileSize - 1));
+    }
+    return limits_.cell_limits().num_x_cells * cell_index.y() + cell_index.x();
+  }
+
+  // Same as calling ApplyLookupTable() for the cells at 'flat_indices' in
+  // order, without checking bounds for each cell. The 'flat_indices' must be
+  // computed by ToFlatIndexUnchecked() and 'bounding_box' must contain the
+  // cell indices of all of them.
+  void ApplyLookupTable(const std::vector<int>& flat_indices,
+                        const Eigen::AlignedBox2i& bounding_box,
+                        const std::vector<uint16>& table) {
+    DCHECK_EQ(table.size(), mapping::kUpdateMarker);
+    if (flat_indices.empty()) {
+      return;
+    }
+    for (const int flat_index : flat_indices) {
+      ApplyLookupTableToFlatIndex(flat_index, table);
+    }
+    known_cells_box_.extend(bounding_box);
+  }
+
+  // Same as the above followed by FinishUpdate() for these cells, but faster
+  // since the cells are only visited once. The 'flat_indices' must be distinct.
+  // Cells already updated since the last call to FinishUpdate() are ignored.
+  void ApplyLookupTableAndFinishUpdate(const std::vector<int>& flat_indices,
+                                       const Eigen::AlignedBox2i& bounding_box,
+                                       const std::vector<uint16>& table) {
+    DCHECK_EQ(table.size(), mapping::kUpdateMarker);
+    if (flat_indices.empty()) {
+      return;
+    }
+    if (adaptive_) {
+      // Distinct cells can share a coarse cell, which must only be updated
+      // once, so the update markers are needed.
+      const size_t num_pending_updates = update_indices_.size();
+      ApplyLookupTable(flat_indices, bounding_box, table);
+      FinishUpdatesSince(num_pending_updates);
+      return;
+    }
+    for (const int flat_index : flat_indices) {
+      uint16& cell = mutable_cell(flat_index);
+      if (cell < mapping::kUpdateMarker) {
+        cell = table[cell] - mapping::kUpdateMarker;
+        UpdateProbabilityMirror(flat_index, cell);
+      }
+    }
+    known_cells_box_.extend(bounding_box);
+  }
+
+  // Returns an upper bound for the indices returned by ToFlatIndexUnchecked().
+  int GetNumFlatIndices() const {
+    return tiled_ ? tiles_.size() * kCellsPerTile : cells_.size();
+  }
+
+  // Returns the cells of a grid which is not tiled in the order of
+  // ToFlatIndexUnchecked(), i.e. row by row with 'num_x_cells' cells each.
+  // Values include the update marker while an update is in progress.
+  const std::vector<uint16>& cells() const {
+    CHECK(!tiled_);
+    return cells_;
+  }
+
+  // Copies the values of the 'num_cells' cells starting at 'cell_index' in x
+  // direction to 'values', e.g. to convert a row of cells at once. All of them
+  // must be within the limits.
+  void GetCellValues(const Eigen::Array2i& cell_index, const int num_cells,
+                     uint16* const values) const {
+    CHECK(limits_.Contains(cell_index)) << cell_index;
+    CHECK(limits_.Contains(cell_index + Eigen::Array2i(num_cells - 1, 0)))
+        << cell_index;
+    if (!tiled_) {
+      std::memcpy(values, &cells_[ToFlatIndexUnchecked(cell_index)],
+                  sizeof(uint16) * num_cells);
+      return;
+    }
+    for (int i = 0; i != num_cells; ++i) {
+      values[i] = cell(ToFlatIndexUnchecked(cell_index + Eigen::Array2i(i, 0)));
+    }
+  }
+
   // Returns the probability of the cell with 'cell_index'.
   float GetProbability(const Eigen::Array2i& cell_index) const {
     if (limits_.Contains(cell_index)) {
-      return mapping::ValueToProbability(cells_[ToFlatIndex(cell_index)]);
+      return mapping::ValueToProbability(cell(ToFlatIndex(cell_index)));
     }
     return mapping::kMinProbability;
   }
@@ -114,7 +287,7 @@ class ProbabilityGrid {
   // Returns true if the probability at the specified index is known.
   bool IsKnown(const Eigen::Array2i& cell_index) const {
     return limits_.Contains(cell_index) &&
-           cells_[ToFlatIndex(cell_index)] != mapping::kUnknownProbabilityValue;
+           cell(ToFlatIndex(cell_index)) != mapping::kUnknownProbabilityValue;
   }
 
   // Fills in 'offset' and 'limits' to define a subregion of that contains all
@@ -131,12 +304,50 @@ class ProbabilityGrid {
     }
   }
 
+  // Returns a copy of this grid which only covers the limits computed by
+  // ComputeCroppedLimits(). The copy is never tiled, so that finished submaps
+  // use no more memory than their known cells need. Cells are copied row by
+  // row without converting them to probabilities. Must not be called during an
+  // update.
+  ProbabilityGrid ComputeCroppedGrid() const {
+    Eigen::Array2i offset;
+    CellLimits cropped_limits;
+    ComputeCroppedLimits(&offset, &cropped_limits);
+    const double resolution = limits_.resolution();
+    const Eigen::Vector2d max =
+        limits_.max() - resolution * Eigen::Vector2d(offset.y(), offset.x());
+    ProbabilityGrid cropped_grid(MapLimits(resolution, max, cropped_limits));
+    if (known_cells_box_.isEmpty()) {
+      return cropped_grid;
+    }
+    DCHECK(update_indices_.empty());
+    const int num_x_cells = cropped_limits.num_x_cells;
+    for (int y = 0; y != cropped_limits.num_y_cells; ++y) {
+      uint16* const row = &cropped_grid.cells_[y * num_x_cells];
+      if (tiled_) {
+        for (int x = 0; x != num_x_cells; ++x) {
+          row[x] = cell(ToFlatIndexUnchecked(offset + Eigen::Array2i(x, y)));
+        }
+      } else {
+        std::memcpy(
+            row, &cells_[ToFlatIndexUnchecked(offset + Eigen::Array2i(0, y))],
+            sizeof(uint16) * num_x_cells);
+      }
+    }
+    cropped_grid.known_cells_box_ = Eigen::AlignedBox2i(
+        Eigen::Vector2i::Zero(),
+        Eigen::Vector2i(num_x_cells - 1, cropped_limits.num_y_cells - 1));
+    return cropped_grid;
+  }
+
   // Grows the map as necessary to include 'point'. This changes the meaning of
   // these coordinates going forward. This method must be called immediately
   // after 'FinishUpdate', before any calls to 'ApplyLookupTable'.
   void GrowLimits(const Eigen::Vector2f& point) {
     CHECK(update_indices_.empty());
+    bool grown = false;
     while (!limits_.Contains(limits_.GetCellIndex(point))) {
+      grown = true;
       const int x_offset = limits_.cell_limits().num_x_cells / 2;
       const int y_offset = limits_.cell_limits().num_y_cells / 2;
       const MapLimits new_limits(
@@ -145,6 +356,14 @@ class ProbabilityGrid {
               limits_.resolution() * Eigen::Vector2d(y_offset, x_offset),
           CellLimits(2 * limits_.cell_limits().num_x_cells,
                      2 * limits_.cell_limits().num_y_cells));
+      if (tiled_) {
+        GrowTiles(new_limits, Eigen::Array2i(x_offset, y_offset));
+        limits_ = new_limits;
+        if (!known_cells_box_.isEmpty()) {
+          known_cells_box_.translate(Eigen::Vector2i(x_offset, y_offset));
+        }
+        continue;
+      }
       const int stride = new_limits.cell_limits().num_x_cells;
       const int offset = x_offset + stride * y_offset;
       const int new_size = new_limits.cell_limits().num_x_cells *
@@ -163,39 +382,349 @@ class ProbabilityGrid {
         known_cells_box_.translate(Eigen::Vector2i(x_offset, y_offset));
       }
     }
+    if (grown && !probability_mirror_.empty()) {
+      RebuildProbabilityMirror();
+    }
   }
 
+  // Only the cells inside the known cells box are written, using the compact
+  // 'known_cells' encoding.
   proto::ProbabilityGrid ToProto() const {
+    CHECK(update_indices_.empty()) << "Serializing a grid during an update is "
+                                      "not supported. Finish the update first.";
     proto::ProbabilityGrid result;
     *result.mutable_limits() = cartographer::mapping_2d::ToProto(limits_);
-    result.mutable_cells()->Reserve(cells_.size());
-    for (const auto cell : cells_) {
-      result.mutable_cells()->Add(cell);
+    string* const known_cells = result.mutable_known_cells();
+    if (known_cells_box_.isEmpty()) {
+      return result;
     }
-    CHECK(update_indices_.empty()) << "Serializing a grid during an update is "
-                                      "not supported. Finish the update first.";
-    if (!known_cells_box_.isEmpty()) {
-      result.set_max_x(known_cells_box_.max().x());
-      result.set_max_y(known_cells_box_.max().y());
-      result.set_min_x(known_cells_box_.min().x());
-      result.set_min_y(known_cells_box_.min().y());
+    result.set_max_x(known_cells_box_.max().x());
+    result.set_max_y(known_cells_box_.max().y());
+    result.set_min_x(known_cells_box_.min().x());
+    result.set_min_y(known_cells_box_.min().y());
+    const int width = known_cells_box_.sizes().x() + 1;
+    known_cells->resize(sizeof(uint16) * width *
+                        (known_cells_box_.sizes().y() + 1));
+    char* row = &(*known_cells)[0];
+    for (int y = known_cells_box_.min().y(); y <= known_cells_box_.max().y();
+         ++y) {
+      if (tiled_) {
+        for (int x = 0; x != width; ++x) {
+          const uint16 value = cell(
+              ToFlatIndex(Eigen::Array2i(known_cells_box_.min().x() + x, y)));
+          std::memcpy(row + sizeof(uint16) * x, &value, sizeof(uint16));
+        }
+      } else {
+        std::memcpy(
+            row,
+            &cells_[ToFlatIndex(Eigen::Array2i(known_cells_box_.min().x(), y))],
+            sizeof(uint16) * width);
+      }
+      row += sizeof(uint16) * width;
     }
     return result;
   }
 
+  // Returns the number of bytes used for storing cells.
+  int64 GetMemoryUsageInBytes() const {
+    int64 memory_usage_in_bytes =
+        sizeof(*this) + cells_.capacity() * sizeof(uint16) +
+        tiles_.capacity() * sizeof(Tile) +
+        update_indices_.capacity() * sizeof(int) +
+        probability_mirror_.capacity() * sizeof(float);
+    for (const Tile& tile : tiles_) {
+      memory_usage_in_bytes += tile.capacity() * sizeof(uint16);
+    }
+    return memory_usage_in_bytes;
+  }
+
  private:
-  // Converts a 'cell_index' into an index into 'cells_'.
+  // Tiles are 2^kTileBits x 2^kTileBits cells.
+  static constexpr int kTileBits = 6;
+  static constexpr int kTileSize = 1 << kTileBits;
+  static constexpr int kCellsPerTile = kTileSize * kTileSize;
+
+  // The cells of a tile in row-major order, or empty if all cells are unknown.
+  using Tile = std::vector<uint16>;
+
+  // Coarse tiles of adaptive grids have one cell per block of
+  // 2^kCoarseBits x 2^kCoarseBits cells.
+  static constexpr int kCoarseBits = 2;
+  static constexpr int kBlockSize = 1 << kCoarseBits;
+  static constexpr int kCoarseTileSize = kTileSize >> kCoarseBits;
+  static constexpr int kCellsPerCoarseTile = kCoarseTileSize * kCoarseTileSize;
+
+  static int GetNumTiles(const int num_cells) {
+    return (num_cells + kTileSize - 1) / kTileSize;
+  }
+
+  static bool IsCoarse(const Tile& tile) {
+    return tile.size() == kCellsPerCoarseTile;
+  }
+
+  // Converts an index into a tile into the index of its block in a coarse
+  // tile.
+  static int ToCoarseIndexInTile(const int index_in_tile) {
+    return ((index_in_tile >> (kTileBits + kCoarseBits))
+            << (kTileBits - kCoarseBits)) +
+           ((index_in_tile & (kTileSize - 1)) >> kCoarseBits);
+  }
+
+  // Converts a 'cell_index' into an index into 'cells_', or for tiled grids
+  // into the tile index times 'kCellsPerTile' plus the index into the tile.
   int ToFlatIndex(const Eigen::Array2i& cell_index) const {
     CHECK(limits_.Contains(cell_index)) << cell_index;
-    return limits_.cell_limits().num_x_cells * cell_index.y() + cell_index.x();
+    return ToFlatIndexUnchecked(cell_index);
+  }
+
+  // Applies 'table' to the cell at 'flat_index' unless it has already been
+  // updated. Returns true if the cell was updated.
+  bool ApplyLookupTableToFlatIndex(const int flat_index,
+                                   const std::vector<uint16>& table) {
+    if (adaptive_) {
+      const uint16 value = cell(flat_index);
+      if (value >= mapping::kUpdateMarker) {
+        return false;
+      }
+      // Pushed after refining, see RefineTile().
+      SetCellValue(flat_index, table[value]);
+      update_indices_.push_back(flat_index);
+      return true;
+    }
+    uint16& cell = mutable_cell(flat_index);
+    if (cell >= mapping::kUpdateMarker) {
+      return false;
+    }
+    update_indices_.push_back(flat_index);
+    cell = table[cell];
+    DCHECK_GE(cell, mapping::kUpdateMarker);
+    return true;
+  }
+
+  // Finishes the updates of the cells at 'update_indices_[begin]' and later.
+  void FinishUpdatesSince(const size_t begin) {
+    while (update_indices_.size() > begin) {
+      uint16& cell = mutable_cell(update_indices_.back());
+      DCHECK_GE(cell, mapping::kUpdateMarker);
+      cell -= mapping::kUpdateMarker;
+      UpdateProbabilityMirror(update_indices_.back(), cell);
+      update_indices_.pop_back();
+    }
+  }
+
+  // Writes 'value' to the cell at 'flat_index'. If the cell is in a coarse
+  // tile of an adaptive grid, the tile is refined first if 'value' is
+  // occupied, and otherwise all cells of the block take the 'value'.
+  void SetCellValue(const int flat_index, const uint16 value) {
+    if (adaptive_) {
+      Tile& tile = tiles_[flat_index / kCellsPerTile];
+      if (tile.empty() || IsCoarse(tile)) {
+        if (mapping::ValueToProbability(value) > 0.5f) {
+          RefineTile(flat_index / kCellsPerTile);
+        } else {
+          known_cells_box_.extend(GetBlockCells(flat_index));
+        }
+      }
+    }
+    mutable_cell(flat_index) = value;
+  }
+
+  // Stores the tile at 'tile_index' with one value per cell. Cells in blocks
+  // with a pending update are added to 'update_indices_', which has one of
+  // the cells of each of these blocks so far.
+  void RefineTile(const int tile_index) {
+    Tile& tile = tiles_[tile_index];
+    Tile refined_tile(kCellsPerTile, mapping::kUnknownProbabilityValue);
+    if (!tile.empty()) {
+      for (int i = 0; i != kCellsPerTile; ++i) {
+        refined_tile[i] = tile[ToCoarseIndexInTile(i)];
+      }
+    }
+    tile.swap(refined_tile);
+    const size_t num_update_indices = update_indices_.size();
+    for (size_t i = 0; i != num_update_indices; ++i) {
+      const int flat_index = update_indices_[i];
+      if (flat_index / kCellsPerTile != tile_index) {
+        continue;
+      }
+      const int index_in_tile = flat_index % kCellsPerTile;
+      const int block_start =
+          tile_index * kCellsPerTile +
+          (index_in_tile & ~(kTileSize * kBlockSize - 1)) +
+          (index_in_tile & (kTileSize - 1) & ~(kBlockSize - 1));
+      for (int y = 0; y != kBlockSize; ++y) {
+        for (int x = 0; x != kBlockSize; ++x) {
+          const int block_flat_index = block_start + (y << kTileBits) + x;
+          if (block_flat_index != flat_index) {
+            update_indices_.push_back(block_flat_index);
+          }
+        }
+      }
+    }
+  }
+
+  // Returns the box of the cells within the limits which share the block of
+  // the cell at 'flat_index'.
+  Eigen::AlignedBox2i GetBlockCells(const int flat_index) const {
+    const Eigen::Array2i padded_index = ToCellIndex(flat_index) + tile_padding_;
+    const Eigen::Array2i block_min =
+        Eigen::Array2i(padded_index.x() & ~(kBlockSize - 1),
+                       padded_index.y() & ~(kBlockSize - 1)) -
+        tile_padding_;
+    return Eigen::AlignedBox2i(
+               block_min.matrix(),
+               (block_min + Eigen::Array2i::Constant(kBlockSize - 1)).matrix())
+        .intersection(Eigen::AlignedBox2i(
+            Eigen::Vector2i::Zero(),
+            Eigen::Vector2i(limits_.cell_limits().num_x_cells - 1,
+                            limits_.cell_limits().num_y_cells - 1)));
+  }
+
+  // Inverse of ToFlatIndexUnchecked().
+  Eigen::Array2i ToCellIndex(const int flat_index) const {
+    if (tiled_) {
+      const int tile_index = flat_index / kCellsPerTile;
+      const int index_in_tile = flat_index % kCellsPerTile;
+      return Eigen::Array2i(
+                 (tile_index % num_x_tiles_) * kTileSize +
+                     (index_in_tile & (kTileSize - 1)),
+                 (tile_index / num_x_tiles_) * kTileSize +
+                     (index_in_tile >> kTileBits)) -
+             tile_padding_;
+    }
+    const int num_x_cells = limits_.cell_limits().num_x_cells;
+    return Eigen::Array2i(flat_index % num_x_cells, flat_index / num_x_cells);
+  }
+
+  int ToMirrorIndex(const Eigen::Array2i& cell_index) const {
+    return (cell_index.y() + kMirrorPadding) * probability_mirror_width() +
+           cell_index.x() + kMirrorPadding;
+  }
+
+  // Copies the finished 'value' of the cell at 'flat_index' into the
+  // probability mirror if there is one.
+  void UpdateProbabilityMirror(const int flat_index, const uint16 value) {
+    if (probability_mirror_.empty()) {
+      return;
+    }
+    const float probability = mapping::ValueToProbability(value);
+    if (adaptive_ && IsCoarse(tiles_[flat_index / kCellsPerTile])) {
+      const Eigen::AlignedBox2i cells = GetBlockCells(flat_index);
+      for (int y = cells.min().y(); y <= cells.max().y(); ++y) {
+        for (int x = cells.min().x(); x <= cells.max().x(); ++x) {
+          probability_mirror_[ToMirrorIndex(Eigen::Array2i(x, y))] =
+              probability;
+        }
+      }
+      return;
+    }
+    const Eigen::Array2i cell_index = ToCellIndex(flat_index);
+    // Refined tiles of adaptive grids can have pending updates of cells
+    // outside the limits, see RefineTile().
+    if (!adaptive_ || limits_.Contains(cell_index)) {
+      probability_mirror_[ToMirrorIndex(cell_index)] = probability;
+    }
+  }
+
+  // Recomputes the probability mirror for the current limits. Only cells in
+  // the known cells box are converted.
+  void RebuildProbabilityMirror() {
+    probability_mirror_.assign(
+        probability_mirror_width() *
+            (limits_.cell_limits().num_y_cells + 2 * kMirrorPadding),
+        mapping::kMinProbability);
+    if (known_cells_box_.isEmpty()) {
+      return;
+    }
+    const int width = known_cells_box_.sizes().x() + 1;
+    std::vector<uint16> values(width);
+    for (int y = known_cells_box_.min().y(); y <= known_cells_box_.max().y();
+         ++y) {
+      const Eigen::Array2i row_start(known_cells_box_.min().x(), y);
+      GetCellValues(row_start, width, values.data());
+      mapping::ValuesToProbabilities(
+          values.data(), width, &probability_mirror_[ToMirrorIndex(row_start)]);
+    }
+  }
+
+  uint16 cell(const int flat_index) const {
+    if (tiled_) {
+      const Tile& tile = tiles_[flat_index / kCellsPerTile];
+      if (tile.empty()) {
+        return mapping::kUnknownProbabilityValue;
+      }
+      const int index_in_tile = flat_index % kCellsPerTile;
+      return IsCoarse(tile) ? tile[ToCoarseIndexInTile(index_in_tile)]
+                            : tile[index_in_tile];
+    }
+    return cells_[flat_index];
+  }
+
+  // Returns the cell at 'flat_index', allocating its tile if necessary.
+  uint16& mutable_cell(const int flat_index) {
+    if (tiled_) {
+      Tile& tile = tiles_[flat_index / kCellsPerTile];
+      if (tile.empty()) {
+        tile.assign(adaptive_ ? kCellsPerCoarseTile : kCellsPerTile,
+                    mapping::kUnknownProbabilityValue);
+      }
+      const int index_in_tile = flat_index % kCellsPerTile;
+      return IsCoarse(tile) ? tile[ToCoarseIndexInTile(index_in_tile)]
+                            : tile[index_in_tile];
+    }
+    return cells_[flat_index];
+  }
+
+  // Moves the tiles into a table covering 'new_limits', in which the cell
+  // previously at index 'i' is at 'i + offset'. Only tiles are moved, cells
+  // are not copied.
+  void GrowTiles(const MapLimits& new_limits, const Eigen::Array2i& offset) {
+    // The padding is chosen so that cells stay at the same position within
+    // their tile, which then moves by a whole number of tiles.
+    const Eigen::Array2i new_tile_padding =
+        (tile_padding_ - offset).unaryExpr([](const int value) {
+          return ((value % kTileSize) + kTileSize) % kTileSize;
+        });
+    const Eigen::Array2i padding_change =
+        offset + new_tile_padding - tile_padding_;
+    const Eigen::Array2i tile_offset(padding_change.x() / kTileSize,
+                                     padding_change.y() / kTileSize);
+    const int new_num_x_tiles = GetNumTiles(
+        new_limits.cell_limits().num_x_cells + new_tile_padding.x());
+    const int new_num_y_tiles = GetNumTiles(
+        new_limits.cell_limits().num_y_cells + new_tile_padding.y());
+    std::vector<Tile> new_tiles(new_num_x_tiles * new_num_y_tiles);
+    const int num_y_tiles = tiles_.size() / num_x_tiles_;
+    for (int y = 0; y != num_y_tiles; ++y) {
+      for (int x = 0; x != num_x_tiles_; ++x) {
+        new_tiles[(y + tile_offset.y()) * new_num_x_tiles + x +
+                  tile_offset.x()]
+            .swap(tiles_[y * num_x_tiles_ + x]);
+      }
+    }
+    tiles_.swap(new_tiles);
+    num_x_tiles_ = new_num_x_tiles;
+    tile_padding_ = new_tile_padding;
   }
 
   MapLimits limits_;
+  bool tiled_;
+  bool adaptive_;
   std::vector<uint16> cells_;  // Highest bit is update marker.
   std::vector<int> update_indices_;
 
+  // Only used if 'tiled_' is true. Tiles are stored in row-major order with
+  // 'num_x_tiles_' tiles per row. The cell at index 'i' is in the tile at
+  // '(i + tile_padding_) / kTileSize'.
+  std::vector<Tile> tiles_;
+  int num_x_tiles_ = 0;
+  Eigen::Array2i tile_padding_ = Eigen::Array2i::Zero();
+
   // Bounding box of known cells to efficiently compute cropping limits.
   Eigen::AlignedBox2i known_cells_box_;
+
+  // Empty unless EnableProbabilityMirror() was called.
+  std::vector<float> probability_mirror_;
 };
 
 }  // namespace mapping_2d
@@ -56,6 +56,39 @@ TEST(ProbabilityGridTest, ToProto) {
   // {min, max}_{x, y}_ gracefully.
 }
 
+TEST(ProbabilityGridTest, ToProtoAndBack) {
+  for (const bool tiled : {false, true}) {
+    ProbabilityGrid probability_grid(
+        MapLimits(0.1, Eigen::Vector2d(10., 10.), CellLimits(100, 90)), tiled);
+    EXPECT_EQ(0, probability_grid.ToProto().known_cells().size());
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> x_distribution(10, 60);
+    std::uniform_int_distribution<int> y_distribution(20, 80);
+    std::uniform_real_distribution<float> probability_distribution(
+        mapping::kMinProbability, mapping::kMaxProbability);
+    for (int i = 0; i != 500; ++i) {
+      const Eigen::Array2i cell_index(x_distribution(rng),
+                                      y_distribution(rng));
+      if (!probability_grid.IsKnown(cell_index)) {
+        probability_grid.SetProbability(cell_index,
+                                        probability_distribution(rng));
+      }
+    }
+    const proto::ProbabilityGrid proto = probability_grid.ToProto();
+    EXPECT_EQ(0, proto.cells_size());
+    EXPECT_LE(proto.known_cells().size(), sizeof(uint16) * 51 * 61);
+
+    const ProbabilityGrid actual(proto);
+    EXPECT_FALSE(actual.tiled());
+    for (const Eigen::Array2i& xy_index :
+         XYIndexRangeIterator(probability_grid.limits().cell_limits())) {
+      EXPECT_EQ(probability_grid.IsKnown(xy_index), actual.IsKnown(xy_index));
+      EXPECT_EQ(probability_grid.GetProbability(xy_index),
+                actual.GetProbability(xy_index));
+    }
+  }
+}
+
 TEST(ProbabilityGridTest, ApplyOdds) {
   ProbabilityGrid probability_grid(
       MapLimits(1., Eigen::Vector2d(1., 1.), CellLimits(2, 2)));
@@ -191,6 +224,344 @@ TEST(ProbabilityGridTest, CorrectCropping) {
   EXPECT_EQ(limits.num_y_cells, 200);
 }
 
+TEST(ProbabilityGridTest, ApplyLookupTableToFlatIndices) {
+  for (const bool tiled : {false, true}) {
+    const MapLimits limits(1., Eigen::Vector2d(10., 10.), CellLimits(80, 70));
+    ProbabilityGrid grid(limits, tiled);
+    ProbabilityGrid expected_grid(limits, tiled);
+    const std::vector<uint16> table =
+        mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.7));
+    std::vector<int> flat_indices;
+    Eigen::AlignedBox2i bounding_box;
+    for (const Eigen::Array2i& cell_index :
+         {Eigen::Array2i(3, 4), Eigen::Array2i(79, 69), Eigen::Array2i(3, 4),
+          Eigen::Array2i(64, 0)}) {
+      flat_indices.push_back(grid.ToFlatIndexUnchecked(cell_index));
+      bounding_box.extend(cell_index.matrix());
+      expected_grid.ApplyLookupTable(cell_index, table);
+    }
+    grid.ApplyLookupTable(flat_indices, bounding_box, table);
+    grid.FinishUpdate();
+    expected_grid.FinishUpdate();
+    EXPECT_EQ(expected_grid.ToProto().DebugString(),
+              grid.ToProto().DebugString());
+    EXPECT_NEAR(0.7f, grid.GetProbability(Eigen::Array2i(3, 4)), 1e-3);
+  }
+}
+
+TEST(ProbabilityGridTest, GetCellValues) {
+  for (const bool tiled : {false, true}) {
+    const MapLimits limits(1., Eigen::Vector2d(10., 10.), CellLimits(80, 70));
+    ProbabilityGrid grid(limits, tiled);
+    grid.SetProbability(Eigen::Array2i(62, 5), 0.3f);
+    grid.SetProbability(Eigen::Array2i(66, 5), 0.8f);
+    // The row crosses the boundary between two tiles.
+    std::vector<uint16> values(6);
+    grid.GetCellValues(Eigen::Array2i(61, 5), values.size(), values.data());
+    for (int i = 0; i != 6; ++i) {
+      const Eigen::Array2i cell_index(61 + i, 5);
+      EXPECT_EQ(grid.IsKnown(cell_index),
+                values[i] != mapping::kUnknownProbabilityValue);
+      EXPECT_EQ(grid.GetProbability(cell_index),
+                mapping::ValueToProbability(values[i]));
+    }
+  }
+}
+
+TEST(ProbabilityGridTest, ApplyLookupTableAndFinishUpdate) {
+  const MapLimits limits(1., Eigen::Vector2d(10., 10.), CellLimits(20, 20));
+  ProbabilityGrid grid(limits);
+  const std::vector<uint16> table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.3));
+  // Cells in an unfinished update are ignored.
+  grid.ApplyLookupTable(
+      Eigen::Array2i(1, 1),
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.9)));
+  const std::vector<int> flat_indices = {
+      grid.ToFlatIndexUnchecked(Eigen::Array2i(1, 1)),
+      grid.ToFlatIndexUnchecked(Eigen::Array2i(2, 19))};
+  grid.ApplyLookupTableAndFinishUpdate(
+      flat_indices,
+      Eigen::AlignedBox2i(Eigen::Vector2i(1, 1), Eigen::Vector2i(2, 19)),
+      table);
+  EXPECT_NEAR(0.3f, grid.GetProbability(Eigen::Array2i(2, 19)), 1e-3);
+  // The update of this cell is already finished.
+  EXPECT_TRUE(grid.ApplyLookupTable(Eigen::Array2i(2, 19), table));
+  grid.FinishUpdate();
+  EXPECT_NEAR(0.9f, grid.GetProbability(Eigen::Array2i(1, 1)), 1e-3);
+  EXPECT_GT(0.3f, grid.GetProbability(Eigen::Array2i(2, 19)));
+
+  Eigen::Array2i offset;
+  CellLimits cropped_limits;
+  grid.ComputeCroppedLimits(&offset, &cropped_limits);
+  EXPECT_TRUE((offset == Eigen::Array2i(1, 1)).all());
+  EXPECT_EQ(2, cropped_limits.num_x_cells);
+  EXPECT_EQ(19, cropped_limits.num_y_cells);
+}
+
+TEST(ProbabilityGridTest, TiledGridMatchesDenseGrid) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> point_distribution(-30.f, 30.f);
+  const MapLimits limits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100));
+  ProbabilityGrid dense_grid(limits);
+  ProbabilityGrid tiled_grid(limits, true /* tiled */);
+  EXPECT_TRUE(tiled_grid.tiled());
+  const std::vector<uint16> hit_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55));
+  const std::vector<uint16> miss_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.49));
+  for (int i = 0; i != 1000; ++i) {
+    const Eigen::Vector2f point(point_distribution(rng),
+                                point_distribution(rng) / 5.f);
+    dense_grid.GrowLimits(point);
+    tiled_grid.GrowLimits(point);
+    const Eigen::Array2i cell_index = dense_grid.limits().GetCellIndex(point);
+    const std::vector<uint16>& table = i % 3 == 0 ? miss_table : hit_table;
+    EXPECT_TRUE(dense_grid.ApplyLookupTable(cell_index, table));
+    EXPECT_TRUE(tiled_grid.ApplyLookupTable(cell_index, table));
+    EXPECT_FALSE(tiled_grid.ApplyLookupTable(cell_index, table));
+    dense_grid.FinishUpdate();
+    tiled_grid.FinishUpdate();
+  }
+  EXPECT_EQ(dense_grid.ToProto().DebugString(),
+            tiled_grid.ToProto().DebugString());
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(dense_grid.limits().cell_limits())) {
+    EXPECT_EQ(dense_grid.IsKnown(xy_index), tiled_grid.IsKnown(xy_index));
+    EXPECT_EQ(dense_grid.GetProbability(xy_index),
+              tiled_grid.GetProbability(xy_index));
+  }
+  Eigen::Array2i dense_offset, tiled_offset;
+  CellLimits dense_limits, tiled_limits;
+  dense_grid.ComputeCroppedLimits(&dense_offset, &dense_limits);
+  tiled_grid.ComputeCroppedLimits(&tiled_offset, &tiled_limits);
+  EXPECT_TRUE((dense_offset == tiled_offset).all());
+  EXPECT_EQ(dense_limits.num_x_cells, tiled_limits.num_x_cells);
+  EXPECT_EQ(dense_limits.num_y_cells, tiled_limits.num_y_cells);
+}
+
+TEST(ProbabilityGridTest, ComputeCroppedGrid) {
+  for (const bool tiled : {false, true}) {
+    ProbabilityGrid probability_grid(
+        MapLimits(1., Eigen::Vector2d(10., 10.), CellLimits(20, 20)), tiled);
+    probability_grid.SetProbability(Eigen::Array2i(3, 5), 0.3f);
+    probability_grid.SetProbability(Eigen::Array2i(12, 8), 0.7f);
+    const ProbabilityGrid cropped_grid = probability_grid.ComputeCroppedGrid();
+    EXPECT_FALSE(cropped_grid.tiled());
+    EXPECT_EQ(10, cropped_grid.limits().cell_limits().num_x_cells);
+    EXPECT_EQ(4, cropped_grid.limits().cell_limits().num_y_cells);
+    EXPECT_EQ(40, cropped_grid.cells().size());
+    for (const Eigen::Array2i& xy_index :
+         XYIndexRangeIterator(cropped_grid.limits().cell_limits())) {
+      const Eigen::Array2i original_index = xy_index + Eigen::Array2i(3, 5);
+      EXPECT_EQ(probability_grid.IsKnown(original_index),
+                cropped_grid.IsKnown(xy_index));
+      EXPECT_EQ(probability_grid.GetProbability(original_index),
+                cropped_grid.GetProbability(xy_index));
+    }
+    // The cropped limits map points to the same cells as before.
+    const Eigen::Vector2f point(-2.5f, 4.5f);
+    EXPECT_TRUE((probability_grid.limits().GetCellIndex(point) -
+                     Eigen::Array2i(3, 5) ==
+                 cropped_grid.limits().GetCellIndex(point))
+                    .all());
+    Eigen::Array2i offset;
+    CellLimits limits;
+    cropped_grid.ComputeCroppedLimits(&offset, &limits);
+    EXPECT_TRUE((offset == Eigen::Array2i::Zero()).all());
+    EXPECT_EQ(10, limits.num_x_cells);
+    EXPECT_EQ(4, limits.num_y_cells);
+  }
+}
+
+TEST(ProbabilityGridTest, TiledGridMemoryTracksMappedArea) {
+  ProbabilityGrid dense_grid(
+      MapLimits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100)));
+  ProbabilityGrid tiled_grid(
+      MapLimits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100)),
+      true /* tiled */);
+  // Map a long and thin corridor along the x axis.
+  for (float x = -100.f; x <= 100.f; x += 0.05f) {
+    const Eigen::Vector2f point(x, 0.f);
+    dense_grid.GrowLimits(point);
+    tiled_grid.GrowLimits(point);
+    dense_grid.SetProbability(dense_grid.limits().GetCellIndex(point), 0.6f);
+    tiled_grid.SetProbability(tiled_grid.limits().GetCellIndex(point), 0.6f);
+  }
+  EXPECT_EQ(dense_grid.limits().cell_limits().num_x_cells,
+            tiled_grid.limits().cell_limits().num_x_cells);
+  EXPECT_LT(20 * tiled_grid.GetMemoryUsageInBytes(),
+            dense_grid.GetMemoryUsageInBytes());
+}
+
+TEST(ProbabilityGridTest, ProbabilityMirrorMatchesCells) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> point_distribution(-10.f, 10.f);
+  const std::vector<uint16> hit_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55));
+  for (const bool tiled : {false, true}) {
+    ProbabilityGrid grid(
+        MapLimits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100)),
+        tiled);
+    EXPECT_EQ(nullptr, grid.probability_mirror());
+    grid.SetProbability(Eigen::Array2i(3, 7), 0.7f);
+    grid.EnableProbabilityMirror();
+    grid.SetProbability(Eigen::Array2i(50, 2), 0.3f);
+    for (int i = 0; i != 300; ++i) {
+      const Eigen::Vector2f point(point_distribution(rng),
+                                  point_distribution(rng));
+      grid.GrowLimits(point);
+      const Eigen::Array2i cell_index = grid.limits().GetCellIndex(point);
+      if (i % 2 == 0) {
+        grid.ApplyLookupTable(cell_index, hit_table);
+        grid.FinishUpdate();
+      } else {
+        grid.ApplyLookupTableAndFinishUpdate(
+            {grid.ToFlatIndexUnchecked(cell_index)},
+            Eigen::AlignedBox2i(cell_index.matrix()), hit_table);
+      }
+    }
+    const float* const mirror = grid.probability_mirror();
+    ASSERT_NE(nullptr, mirror);
+    const CellLimits& cell_limits = grid.limits().cell_limits();
+    const int padding = ProbabilityGrid::kMirrorPadding;
+    ASSERT_EQ(cell_limits.num_x_cells + 2 * padding,
+              grid.probability_mirror_width());
+    for (int y = -padding; y != cell_limits.num_y_cells + padding; ++y) {
+      for (int x = -padding; x != cell_limits.num_x_cells + padding; ++x) {
+        EXPECT_EQ(grid.GetProbability(Eigen::Array2i(x, y)),
+                  mirror[(y + padding) * grid.probability_mirror_width() + x +
+                         padding]);
+      }
+    }
+  }
+}
+
+TEST(ProbabilityGridTest, AdaptiveGridRefinesOccupiedTiles) {
+  const MapLimits limits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100));
+  ProbabilityGrid grid(limits, true /* tiled */, true /* adaptive */);
+  EXPECT_TRUE(grid.adaptive());
+  const std::vector<uint16> hit_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55));
+  const std::vector<uint16> miss_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.49));
+
+  // Free space is stored per block of 4x4 cells.
+  EXPECT_TRUE(grid.ApplyLookupTable(Eigen::Array2i(10, 10), miss_table));
+  EXPECT_FALSE(grid.ApplyLookupTable(Eigen::Array2i(8, 9), miss_table));
+  grid.FinishUpdate();
+  for (int y = 8; y != 12; ++y) {
+    for (int x = 8; x != 12; ++x) {
+      EXPECT_NEAR(0.49f, grid.GetProbability(Eigen::Array2i(x, y)), 1e-3);
+    }
+  }
+  EXPECT_FALSE(grid.IsKnown(Eigen::Array2i(12, 10)));
+  EXPECT_FALSE(grid.IsKnown(Eigen::Array2i(10, 7)));
+
+  // An occupied cell refines its tile, so that the other cells of its block
+  // keep their probability. Blocks already updated by the same update stay
+  // updated.
+  EXPECT_TRUE(grid.ApplyLookupTable(Eigen::Array2i(12, 12), miss_table));
+  EXPECT_TRUE(grid.ApplyLookupTable(Eigen::Array2i(9, 9), hit_table));
+  EXPECT_FALSE(grid.ApplyLookupTable(Eigen::Array2i(13, 12), hit_table));
+  EXPECT_TRUE(grid.ApplyLookupTable(Eigen::Array2i(8, 8), miss_table));
+  grid.FinishUpdate();
+  EXPECT_GT(grid.GetProbability(Eigen::Array2i(9, 9)), 0.5f);
+  EXPECT_LT(grid.GetProbability(Eigen::Array2i(8, 8)), 0.489f);
+  EXPECT_NEAR(0.49f, grid.GetProbability(Eigen::Array2i(11, 11)), 1e-3);
+  EXPECT_NEAR(0.49f, grid.GetProbability(Eigen::Array2i(13, 12)), 1e-3);
+  EXPECT_NEAR(0.49f, grid.GetProbability(Eigen::Array2i(15, 15)), 1e-3);
+  EXPECT_TRUE(grid.ApplyLookupTable(Eigen::Array2i(13, 12), hit_table));
+  grid.FinishUpdate();
+  EXPECT_GT(grid.GetProbability(Eigen::Array2i(13, 12)), 0.5f);
+  EXPECT_NEAR(0.49f, grid.GetProbability(Eigen::Array2i(12, 12)), 1e-3);
+
+  // Other tiles stay coarse until they have occupied cells.
+  grid.SetProbability(Eigen::Array2i(70, 70), 0.6f);
+  EXPECT_NEAR(0.6f, grid.GetProbability(Eigen::Array2i(70, 70)), 1e-3);
+  EXPECT_FALSE(grid.IsKnown(Eigen::Array2i(71, 70)));
+
+  Eigen::Array2i offset;
+  CellLimits cropped_limits;
+  grid.ComputeCroppedLimits(&offset, &cropped_limits);
+  EXPECT_TRUE((offset == Eigen::Array2i(8, 8)).all());
+  EXPECT_EQ(63, cropped_limits.num_x_cells);
+  EXPECT_EQ(63, cropped_limits.num_y_cells);
+}
+
+TEST(ProbabilityGridTest, AdaptiveGridKeepsProbabilityMirrorInSync) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> point_distribution(-10.f, 10.f);
+  const std::vector<uint16> hit_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55));
+  const std::vector<uint16> miss_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.49));
+  ProbabilityGrid grid(
+      MapLimits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100)),
+      true /* tiled */, true /* adaptive */);
+  grid.EnableProbabilityMirror();
+  for (int i = 0; i != 2000; ++i) {
+    const Eigen::Vector2f point(point_distribution(rng),
+                                point_distribution(rng));
+    grid.GrowLimits(point);
+    const Eigen::Array2i cell_index = grid.limits().GetCellIndex(point);
+    const std::vector<uint16>& table = i % 5 == 0 ? hit_table : miss_table;
+    if (i % 2 == 0) {
+      grid.ApplyLookupTable(cell_index, table);
+      grid.FinishUpdate();
+    } else {
+      grid.ApplyLookupTableAndFinishUpdate(
+          {grid.ToFlatIndexUnchecked(cell_index)},
+          Eigen::AlignedBox2i(cell_index.matrix()), table);
+    }
+  }
+  const float* const mirror = grid.probability_mirror();
+  ASSERT_NE(nullptr, mirror);
+  const CellLimits& cell_limits = grid.limits().cell_limits();
+  const int padding = ProbabilityGrid::kMirrorPadding;
+  for (int y = -padding; y != cell_limits.num_y_cells + padding; ++y) {
+    for (int x = -padding; x != cell_limits.num_x_cells + padding; ++x) {
+      EXPECT_EQ(grid.GetProbability(Eigen::Array2i(x, y)),
+                mirror[(y + padding) * grid.probability_mirror_width() + x +
+                       padding]);
+    }
+  }
+}
+
+TEST(ProbabilityGridTest, AdaptiveGridStoresFreeSpaceCoarsely) {
+  const MapLimits limits(0.05, Eigen::Vector2d(2.5, 2.5), CellLimits(100, 100));
+  ProbabilityGrid tiled_grid(limits, true /* tiled */);
+  ProbabilityGrid adaptive_grid(limits, true /* tiled */, true /* adaptive */);
+  const std::vector<uint16> miss_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.49));
+  // Map an open area which only has free space in a single update.
+  for (const Eigen::Vector2f& corner :
+       {Eigen::Vector2f(-20.f, -20.f), Eigen::Vector2f(20.f, 20.f)}) {
+    tiled_grid.GrowLimits(corner);
+    adaptive_grid.GrowLimits(corner);
+  }
+  const Eigen::Array2i first =
+      tiled_grid.limits().GetCellIndex(Eigen::Vector2f(20.f, 20.f));
+  const Eigen::Array2i last =
+      tiled_grid.limits().GetCellIndex(Eigen::Vector2f(-20.f, -20.f));
+  for (int y = first.y(); y <= last.y(); ++y) {
+    for (int x = first.x(); x <= last.x(); ++x) {
+      tiled_grid.ApplyLookupTable(Eigen::Array2i(x, y), miss_table);
+      adaptive_grid.ApplyLookupTable(Eigen::Array2i(x, y), miss_table);
+    }
+  }
+  tiled_grid.FinishUpdate();
+  adaptive_grid.FinishUpdate();
+  EXPECT_LT(10 * adaptive_grid.GetMemoryUsageInBytes(),
+            tiled_grid.GetMemoryUsageInBytes());
+  for (int y = first.y(); y <= last.y(); ++y) {
+    for (int x = first.x(); x <= last.x(); ++x) {
+      EXPECT_EQ(tiled_grid.GetProbability(Eigen::Array2i(x, y)),
+                adaptive_grid.GetProbability(Eigen::Array2i(x, y)));
+    }
+  }
+}
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
@@ -49,6 +49,10 @@ RangeDataInserter::RangeDataInserter(
       hit_table_(mapping::ComputeLookupTableToApplyOdds(
           mapping::Odds(options.hit_probability()))),
       miss_table_(mapping::ComputeLookupTableToApplyOdds(
+          mapping::Odds(options.miss_probability()))),
+      hit_log_odds_update_(mapping::ComputeLogOddsValueUpdate(
+          mapping::Odds(options.hit_probability()))),
+      miss_log_odds_update_(mapping::ComputeLogOddsValueUpdate(
           mapping::Odds(options.miss_probability()))) {}
 
 void RangeDataInserter::Insert(const sensor::RangeData& range_data,
@@ -60,5 +64,30 @@ void RangeDataInserter::Insert(const sensor::RangeData& range_data,
   probability_grid->FinishUpdate();
 }
 
+void RangeDataInserter::Insert(const sensor::RangeData& range_data,
+                               LogOddsGrid* const log_odds_grid) const {
+  CastRays(range_data, hit_log_odds_update_, miss_log_odds_update_,
+           options_.insert_free_space(), CHECK_NOTNULL(log_odds_grid));
+}
+
+RasterizedRangeData RangeDataInserter::Rasterize(
+    const sensor::RangeData& range_data, const double resolution) const {
+  return RasterizeRangeData(range_data, resolution,
+                            options_.insert_free_space());
+}
+
+void RangeDataInserter::Insert(const sensor::RangeData& range_data,
+                               const RasterizedRangeData& rasterized_range_data,
+                               ProbabilityGrid* const probability_grid) const {
+  if (!HasAlignedCells(rasterized_range_data,
+                       CHECK_NOTNULL(probability_grid)->limits())) {
+    Insert(range_data, probability_grid);
+    return;
+  }
+  ApplyRasterizedRangeData(rasterized_range_data, hit_table_, miss_table_,
+                           probability_grid);
+  probability_grid->FinishUpdate();
+}
+
 }  // namespace mapping_2d
 }  // namespace cartographer
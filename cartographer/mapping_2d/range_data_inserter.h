@@ -22,8 +22,10 @@
 
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/port.h"
+#include "cartographer/mapping_2d/log_odds_grid.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/mapping_2d/proto/range_data_inserter_options.pb.h"
+#include "cartographer/mapping_2d/ray_casting.h"
 #include "cartographer/mapping_2d/xy_index.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/range_data.h"
@@ -45,10 +47,28 @@ class RangeDataInserter {
   void Insert(const sensor::RangeData& range_data,
               ProbabilityGrid* probability_grid) const;
 
+  // Inserts 'range_data' into 'log_odds_grid'.
+  void Insert(const sensor::RangeData& range_data,
+              LogOddsGrid* log_odds_grid) const;
+
+  // Casts the rays of 'range_data' once for insertion into any number of
+  // grids of the given 'resolution'.
+  RasterizedRangeData Rasterize(const sensor::RangeData& range_data,
+                                double resolution) const;
+
+  // Same as inserting 'range_data' into 'probability_grid', but reuses
+  // 'rasterized_range_data' computed from it by Rasterize() if the cells of
+  // 'probability_grid' are aligned with it.
+  void Insert(const sensor::RangeData& range_data,
+              const RasterizedRangeData& rasterized_range_data,
+              ProbabilityGrid* probability_grid) const;
+
  private:
   const proto::RangeDataInserterOptions options_;
   const std::vector<uint16> hit_table_;
   const std::vector<uint16> miss_table_;
+  const int hit_log_odds_update_;
+  const int miss_log_odds_update_;
 };
 
 }  // namespace mapping_2d
@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping_2d/range_data_inserter.h"
 
+#include <cmath>
 #include <memory>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
@@ -128,6 +129,82 @@ TEST_F(RangeDataInserterTest, ProbabilityProgression) {
       1e-3);
 }
 
+TEST_F(RangeDataInserterTest, LogOddsGridMatchesProbabilityGrid) {
+  LogOddsGrid log_odds_grid(probability_grid_.limits());
+  sensor::RangeData range_data;
+  range_data.returns.emplace_back(-3.5f, 0.5f, 0.f);
+  range_data.returns.emplace_back(-2.5f, 1.5f, 0.f);
+  range_data.returns.emplace_back(3.5f, 7.5f, 0.f);
+  range_data.misses.emplace_back(-6.5f, 3.5f, 0.f);
+  range_data.origin.x() = -0.5f;
+  range_data.origin.y() = 0.5f;
+  for (int i = 0; i != 5; ++i) {
+    range_data_inserter_->Insert(range_data, &probability_grid_);
+    range_data_inserter_->Insert(range_data, &log_odds_grid);
+  }
+
+  const ProbabilityGrid converted_grid = log_odds_grid.ToProbabilityGrid();
+  const MapLimits& limits = probability_grid_.limits();
+  ASSERT_EQ(limits.max(), converted_grid.limits().max());
+  ASSERT_EQ(limits.cell_limits().num_x_cells,
+            converted_grid.limits().cell_limits().num_x_cells);
+  ASSERT_EQ(limits.cell_limits().num_y_cells,
+            converted_grid.limits().cell_limits().num_y_cells);
+  int num_known_cells = 0;
+  for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(
+           limits.cell_limits())) {
+    ASSERT_EQ(probability_grid_.IsKnown(xy_index),
+              log_odds_grid.IsKnown(xy_index));
+    ASSERT_EQ(probability_grid_.IsKnown(xy_index),
+              converted_grid.IsKnown(xy_index));
+    if (probability_grid_.IsKnown(xy_index)) {
+      ++num_known_cells;
+      EXPECT_NEAR(probability_grid_.GetProbability(xy_index),
+                  log_odds_grid.GetProbability(xy_index), 1e-3);
+      EXPECT_NEAR(log_odds_grid.GetProbability(xy_index),
+                  converted_grid.GetProbability(xy_index), 1e-4);
+    }
+  }
+  EXPECT_GT(num_known_cells, 10);
+}
+
+TEST_F(RangeDataInserterTest, RasterizedRangeDataMatchesDirectInsertion) {
+  sensor::RangeData range_data;
+  range_data.returns.emplace_back(-3.2f, 0.7f, 0.f);
+  range_data.returns.emplace_back(-2.5f, 1.4f, 0.f);
+  range_data.returns.emplace_back(3.6f, 7.3f, 0.f);
+  range_data.misses.emplace_back(-6.4f, 3.5f, 0.f);
+  range_data.origin.x() = -0.4f;
+  range_data.origin.y() = 0.6f;
+  const RasterizedRangeData rasterized_range_data =
+      range_data_inserter_->Rasterize(range_data, 1.);
+  // Grids with aligned cells reuse the rasterized range data, others cast the
+  // rays again. Either way, the result is the same as direct insertion.
+  for (const MapLimits& limits :
+       {MapLimits(1., Eigen::Vector2d(1., 5.), CellLimits(5, 5)),
+        MapLimits(1., Eigen::Vector2d(-3., 2.), CellLimits(3, 4)),
+        MapLimits(1., Eigen::Vector2d(1.5, 5.25), CellLimits(5, 5))}) {
+    EXPECT_EQ(limits.max().x() == std::round(limits.max().x()),
+              HasAlignedCells(rasterized_range_data, limits));
+    ProbabilityGrid expected_grid(limits);
+    ProbabilityGrid actual_grid(limits);
+    range_data_inserter_->Insert(range_data, &expected_grid);
+    range_data_inserter_->Insert(range_data, rasterized_range_data,
+                                 &actual_grid);
+    ASSERT_EQ(expected_grid.limits().max(), actual_grid.limits().max());
+    const CellLimits& cell_limits = expected_grid.limits().cell_limits();
+    ASSERT_EQ(cell_limits.num_x_cells,
+              actual_grid.limits().cell_limits().num_x_cells);
+    ASSERT_EQ(cell_limits.num_y_cells,
+              actual_grid.limits().cell_limits().num_y_cells);
+    for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(cell_limits)) {
+      ASSERT_EQ(expected_grid.IsKnown(xy_index), actual_grid.IsKnown(xy_index));
+      EXPECT_EQ(expected_grid.GetProbability(xy_index),
+                actual_grid.GetProbability(xy_index));
+    }
+  }
+}
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
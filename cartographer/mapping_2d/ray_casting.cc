@@ -24,15 +24,72 @@ namespace {
 // Factor for subpixel accuracy of start and end point.
 constexpr int kSubpixelScale = 1000;
 
+// Collects distinct flat indices of a ProbabilityGrid in insertion order. A
+// bitmap over all flat indices is used to ignore duplicates, which are common
+// since rays of a scan overlap near the origin. The bitmap is kept by each
+// thread, and only the words set by a scan are cleared again, so that a scan
+// does not pay for zeroing the whole grid. Only one instance may exist per
+// thread at a time.
+class UniqueFlatIndices {
+ public:
+  explicit UniqueFlatIndices(const int num_flat_indices)
+      : bitmap_(ThreadBitmap()) {
+    const size_t num_words = (num_flat_indices + 63) / 64;
+    if (bitmap_.size() < num_words) {
+      bitmap_.resize(num_words, 0);
+    }
+  }
+
+  ~UniqueFlatIndices() {
+    for (const int word_index : set_word_indices_) {
+      bitmap_[word_index] = 0;
+    }
+  }
+
+  void Insert(const int flat_index) {
+    uint64& word = bitmap_[flat_index / 64];
+    const uint64 bit = uint64{1} << (flat_index % 64);
+    if ((word & bit) == 0) {
+      if (word == 0) {
+        set_word_indices_.push_back(flat_index / 64);
+      }
+      word |= bit;
+      flat_indices_.push_back(flat_index);
+    }
+  }
+
+  // Returns and clears the collected indices. Indices inserted before are
+  // still ignored by later calls to Insert().
+  std::vector<int> ReleaseFlatIndices() {
+    std::vector<int> flat_indices;
+    flat_indices.swap(flat_indices_);
+    return flat_indices;
+  }
+
+ private:
+  static std::vector<uint64>& ThreadBitmap() {
+    thread_local std::vector<uint64> bitmap;
+    return bitmap;
+  }
+
+  std::vector<uint64>& bitmap_;
+  std::vector<int> set_word_indices_;
+  std::vector<int> flat_indices_;
+};
+
 // We divide each pixel in kSubpixelScale x kSubpixelScale subpixels. 'begin'
 // and 'end' are coordinates at subpixel precision. We compute all pixels in
-// which some part of the line segment connecting 'begin' and 'end' lies.
+// which some part of the line segment connecting 'begin' and 'end' lies and
+// insert their flat indices in the 'probability_grid' into 'flat_indices'.
+// Both 'begin' and 'end' must be inside the limits of the 'probability_grid',
+// which is a ProbabilityGrid or a LogOddsGrid.
+template <typename GridType>
 void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
-             const std::vector<uint16>& miss_table,
-             ProbabilityGrid* const probability_grid) {
+             const GridType& probability_grid,
+             UniqueFlatIndices* const flat_indices) {
   // For simplicity, we order 'begin' and 'end' by their x coordinate.
   if (begin.x() > end.x()) {
-    CastRay(end, begin, miss_table, probability_grid);
+    CastRay(end, begin, probability_grid, flat_indices);
     return;
   }
 
@@ -47,7 +104,7 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
                            std::min(begin.y(), end.y()) / kSubpixelScale);
     const int end_y = std::max(begin.y(), end.y()) / kSubpixelScale;
     for (; current.y() <= end_y; ++current.y()) {
-      probability_grid->ApplyLookupTable(current, miss_table);
+      flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
     }
     return;
   }
@@ -87,11 +144,11 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
   sub_y += dy * first_pixel;
   if (dy > 0) {
     while (true) {
-      probability_grid->ApplyLookupTable(current, miss_table);
+      flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
       while (sub_y > denominator) {
         sub_y -= denominator;
         ++current.y();
-        probability_grid->ApplyLookupTable(current, miss_table);
+        flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
       }
       ++current.x();
       if (sub_y == denominator) {
@@ -106,11 +163,11 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
     }
     // Move from the pixel border on the right to 'end'.
     sub_y += dy * last_pixel;
-    probability_grid->ApplyLookupTable(current, miss_table);
+    flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
     while (sub_y > denominator) {
       sub_y -= denominator;
       ++current.y();
-      probability_grid->ApplyLookupTable(current, miss_table);
+      flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
     }
     CHECK_NE(sub_y, denominator);
     CHECK_EQ(current.y(), end.y() / kSubpixelScale);
@@ -119,11 +176,11 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
 
   // Same for lines non-ascending in y coordinates.
   while (true) {
-    probability_grid->ApplyLookupTable(current, miss_table);
+    flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
     while (sub_y < 0) {
       sub_y += denominator;
       --current.y();
-      probability_grid->ApplyLookupTable(current, miss_table);
+      flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
     }
     ++current.x();
     if (sub_y == 0) {
@@ -136,42 +193,69 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
     sub_y += dy * 2 * kSubpixelScale;
   }
   sub_y += dy * last_pixel;
-  probability_grid->ApplyLookupTable(current, miss_table);
+  flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
   while (sub_y < 0) {
     sub_y += denominator;
     --current.y();
-    probability_grid->ApplyLookupTable(current, miss_table);
+    flat_indices->Insert(probability_grid.ToFlatIndexUnchecked(current));
   }
   CHECK_NE(sub_y, 0);
   CHECK_EQ(current.y(), end.y() / kSubpixelScale);
 }
 
-void GrowAsNeeded(const sensor::RangeData& range_data,
-                  ProbabilityGrid* const probability_grid) {
+Eigen::AlignedBox2f ComputeBoundingBox(const sensor::RangeData& range_data) {
   Eigen::AlignedBox2f bounding_box(range_data.origin.head<2>());
-  constexpr float kPadding = 1e-6f;
   for (const Eigen::Vector3f& hit : range_data.returns) {
     bounding_box.extend(hit.head<2>());
   }
   for (const Eigen::Vector3f& miss : range_data.misses) {
     bounding_box.extend(miss.head<2>());
   }
+  return bounding_box;
+}
+
+template <typename GridType>
+void GrowAsNeeded(const sensor::RangeData& range_data,
+                  GridType* const probability_grid) {
+  const Eigen::AlignedBox2f bounding_box = ComputeBoundingBox(range_data);
+  constexpr float kPadding = 1e-6f;
   probability_grid->GrowLimits(bounding_box.min() -
                                kPadding * Eigen::Vector2f::Ones());
   probability_grid->GrowLimits(bounding_box.max() +
                                kPadding * Eigen::Vector2f::Ones());
 }
 
-}  // namespace
+// Flat indices of a grid without storage, row by row.
+class FlatIndexGrid {
+ public:
+  explicit FlatIndexGrid(const MapLimits& limits) : limits_(limits) {}
 
-void CastRays(const sensor::RangeData& range_data,
-              const std::vector<uint16>& hit_table,
-              const std::vector<uint16>& miss_table,
-              const bool insert_free_space,
-              ProbabilityGrid* const probability_grid) {
-  GrowAsNeeded(range_data, probability_grid);
+  int ToFlatIndexUnchecked(const Eigen::Array2i& cell_index) const {
+    DCHECK(limits_.Contains(cell_index)) << cell_index;
+    return limits_.cell_limits().num_x_cells * cell_index.y() + cell_index.x();
+  }
+
+  int GetNumFlatIndices() const {
+    return limits_.cell_limits().num_x_cells *
+           limits_.cell_limits().num_y_cells;
+  }
 
-  const MapLimits& limits = probability_grid->limits();
+ private:
+  const MapLimits limits_;
+};
+
+// Computes the distinct flat indices in 'grid' with 'limits' of the cells hit
+// by 'range_data' and, if 'insert_free_space', of the cells without hits on
+// the rays, and bounding boxes of their cell indices. All of them must be
+// inside the 'limits'.
+template <typename GridType>
+void ComputeHitsAndMisses(const sensor::RangeData& range_data,
+                          const MapLimits& limits, const GridType& grid,
+                          const bool insert_free_space,
+                          std::vector<int>* const hit_flat_indices,
+                          Eigen::AlignedBox2i* const hit_bounding_box,
+                          std::vector<int>* const miss_flat_indices,
+                          Eigen::AlignedBox2i* const miss_bounding_box) {
   const double superscaled_resolution = limits.resolution() / kSubpixelScale;
   const MapLimits superscaled_limits(
       superscaled_resolution, limits.max(),
@@ -179,28 +263,213 @@ void CastRays(const sensor::RangeData& range_data,
                  limits.cell_limits().num_y_cells * kSubpixelScale));
   const Eigen::Array2i begin =
       superscaled_limits.GetCellIndex(range_data.origin.head<2>());
+  UniqueFlatIndices flat_indices(grid.GetNumFlatIndices());
+
   // Compute and add the end points.
   std::vector<Eigen::Array2i> ends;
   ends.reserve(range_data.returns.size());
   for (const Eigen::Vector3f& hit : range_data.returns) {
     ends.push_back(superscaled_limits.GetCellIndex(hit.head<2>()));
-    probability_grid->ApplyLookupTable(ends.back() / kSubpixelScale, hit_table);
+    const Eigen::Array2i cell_index = ends.back() / kSubpixelScale;
+    flat_indices.Insert(grid.ToFlatIndexUnchecked(cell_index));
+    hit_bounding_box->extend(cell_index.matrix());
   }
+  *hit_flat_indices = flat_indices.ReleaseFlatIndices();
 
   if (!insert_free_space) {
     return;
   }
 
-  // Now add the misses.
+  // Now add the misses. Cells with hits are still in the bitmap and will not
+  // be added again.
+  *miss_bounding_box = *hit_bounding_box;
+  miss_bounding_box->extend((begin / kSubpixelScale).matrix());
   for (const Eigen::Array2i& end : ends) {
-    CastRay(begin, end, miss_table, probability_grid);
+    CastRay(begin, end, grid, &flat_indices);
   }
 
   // Finally, compute and add empty rays based on misses in the scan.
   for (const Eigen::Vector3f& missing_echo : range_data.misses) {
-    CastRay(begin, superscaled_limits.GetCellIndex(missing_echo.head<2>()),
-            miss_table, probability_grid);
+    const Eigen::Array2i end =
+        superscaled_limits.GetCellIndex(missing_echo.head<2>());
+    CastRay(begin, end, grid, &flat_indices);
+    miss_bounding_box->extend((end / kSubpixelScale).matrix());
+  }
+  *miss_flat_indices = flat_indices.ReleaseFlatIndices();
+}
+
+void ApplyUpdate(const std::vector<int>& flat_indices,
+                 const Eigen::AlignedBox2i& bounding_box,
+                 const std::vector<uint16>& table,
+                 ProbabilityGrid* const probability_grid) {
+  probability_grid->ApplyLookupTableAndFinishUpdate(flat_indices, bounding_box,
+                                                    table);
+}
+
+void ApplyUpdate(const std::vector<int>& flat_indices,
+                 const Eigen::AlignedBox2i& bounding_box, const int update,
+                 LogOddsGrid* const log_odds_grid) {
+  log_odds_grid->ApplyLogOddsUpdate(flat_indices, bounding_box, update);
+}
+
+// Implements CastRays() for both a ProbabilityGrid updated by lookup tables
+// and a LogOddsGrid updated by log-odds values.
+template <typename GridType, typename UpdateType>
+void CastRaysImpl(const sensor::RangeData& range_data,
+                  const UpdateType& hit_update, const UpdateType& miss_update,
+                  const bool insert_free_space,
+                  GridType* const probability_grid) {
+  GrowAsNeeded(range_data, probability_grid);
+
+  // All cells are inside the limits after growing, so we collect distinct flat
+  // indices without bounds checks and apply the updates in bulk.
+  std::vector<int> hit_flat_indices;
+  Eigen::AlignedBox2i hit_bounding_box;
+  std::vector<int> miss_flat_indices;
+  Eigen::AlignedBox2i miss_bounding_box;
+  ComputeHitsAndMisses(range_data, probability_grid->limits(),
+                       *probability_grid, insert_free_space, &hit_flat_indices,
+                       &hit_bounding_box, &miss_flat_indices,
+                       &miss_bounding_box);
+  ApplyUpdate(hit_flat_indices, hit_bounding_box, hit_update,
+              probability_grid);
+  ApplyUpdate(miss_flat_indices, miss_bounding_box, miss_update,
+              probability_grid);
+}
+
+// Returns the center of the cell at 'cell_index' in 'limits'.
+Eigen::Vector2f GetCellCenter(const MapLimits& limits,
+                              const Eigen::Array2i& cell_index) {
+  return (limits.max() -
+          limits.resolution() * Eigen::Vector2d(cell_index.y() + 0.5,
+                                                cell_index.x() + 0.5))
+      .cast<float>();
+}
+
+// Returns the offset to add to cell indices of 'rasterized_limits' to get the
+// cell indices of the same cells in 'limits'.
+Eigen::Array2i ComputeCellIndexOffset(const MapLimits& rasterized_limits,
+                                      const MapLimits& limits) {
+  const Eigen::Vector2d offset =
+      (limits.max() - rasterized_limits.max()) / limits.resolution();
+  return Eigen::Array2i(common::RoundToInt(offset.y()),
+                        common::RoundToInt(offset.x()));
+}
+
+// Converts 'flat_indices' of 'rasterized_limits' into flat indices of
+// 'probability_grid' given the 'offset' of cell indices.
+std::vector<int> ToGridFlatIndices(const std::vector<int>& flat_indices,
+                                   const MapLimits& rasterized_limits,
+                                   const Eigen::Array2i& offset,
+                                   const ProbabilityGrid& probability_grid) {
+  const int num_x_cells = rasterized_limits.cell_limits().num_x_cells;
+  std::vector<int> grid_flat_indices;
+  grid_flat_indices.reserve(flat_indices.size());
+  for (const int flat_index : flat_indices) {
+    grid_flat_indices.push_back(probability_grid.ToFlatIndexUnchecked(
+        Eigen::Array2i(flat_index % num_x_cells, flat_index / num_x_cells) +
+        offset));
   }
+  return grid_flat_indices;
+}
+
+// Translates 'bounding_box' by 'offset' unless it is empty.
+Eigen::AlignedBox2i TranslateBoundingBox(Eigen::AlignedBox2i bounding_box,
+                                         const Eigen::Array2i& offset) {
+  if (!bounding_box.isEmpty()) {
+    bounding_box.translate(offset.matrix());
+  }
+  return bounding_box;
+}
+
+}  // namespace
+
+void CastRays(const sensor::RangeData& range_data,
+              const std::vector<uint16>& hit_table,
+              const std::vector<uint16>& miss_table,
+              const bool insert_free_space,
+              ProbabilityGrid* const probability_grid) {
+  CastRaysImpl(range_data, hit_table, miss_table, insert_free_space,
+               probability_grid);
+}
+
+void CastRays(const sensor::RangeData& range_data, const int hit_update,
+              const int miss_update, const bool insert_free_space,
+              LogOddsGrid* const log_odds_grid) {
+  CastRaysImpl(range_data, hit_update, miss_update, insert_free_space,
+               log_odds_grid);
+}
+
+RasterizedRangeData RasterizeRangeData(const sensor::RangeData& range_data,
+                                       const double resolution,
+                                       const bool insert_free_space) {
+  // Cell boundaries are at integer multiples of 'resolution', with a padding
+  // of one cell around the bounding box.
+  const Eigen::AlignedBox2f bounding_box = ComputeBoundingBox(range_data);
+  const Eigen::Array2d max =
+      (bounding_box.max().cast<double>().array() / resolution).floor() + 2.;
+  const Eigen::Array2d min =
+      (bounding_box.min().cast<double>().array() / resolution).floor() - 1.;
+  const Eigen::Array2i num_cells =
+      (max - min).unaryExpr([](const double value) {
+        return common::RoundToInt(value);
+      });
+  RasterizedRangeData rasterized_range_data{
+      MapLimits(resolution, resolution * max.matrix(),
+                CellLimits(num_cells.y(), num_cells.x())),
+      {},
+      {},
+      Eigen::AlignedBox2i(),
+      Eigen::AlignedBox2i()};
+  const MapLimits& limits = rasterized_range_data.limits;
+  ComputeHitsAndMisses(range_data, limits, FlatIndexGrid(limits),
+                       insert_free_space,
+                       &rasterized_range_data.hit_flat_indices,
+                       &rasterized_range_data.hit_bounding_box,
+                       &rasterized_range_data.miss_flat_indices,
+                       &rasterized_range_data.miss_bounding_box);
+  return rasterized_range_data;
+}
+
+bool HasAlignedCells(const RasterizedRangeData& rasterized_range_data,
+                     const MapLimits& limits) {
+  if (limits.resolution() != rasterized_range_data.limits.resolution()) {
+    return false;
+  }
+  const Eigen::Array2d offset =
+      (limits.max() - rasterized_range_data.limits.max()).array() /
+      limits.resolution();
+  constexpr double kMaxMisalignment = 1e-3;
+  return ((offset - offset.round()).abs() < kMaxMisalignment).all();
+}
+
+void ApplyRasterizedRangeData(const RasterizedRangeData& rasterized_range_data,
+                              const std::vector<uint16>& hit_table,
+                              const std::vector<uint16>& miss_table,
+                              ProbabilityGrid* const probability_grid) {
+  const MapLimits& rasterized_limits = rasterized_range_data.limits;
+  CHECK(HasAlignedCells(rasterized_range_data, probability_grid->limits()));
+  // Growing to contain the centers of two opposite corner cells guarantees
+  // that all rasterized cells are contained.
+  probability_grid->GrowLimits(
+      GetCellCenter(rasterized_limits, Eigen::Array2i::Zero()));
+  probability_grid->GrowLimits(GetCellCenter(
+      rasterized_limits,
+      Eigen::Array2i(rasterized_limits.cell_limits().num_x_cells - 1,
+                     rasterized_limits.cell_limits().num_y_cells - 1)));
+
+  const Eigen::Array2i offset =
+      ComputeCellIndexOffset(rasterized_limits, probability_grid->limits());
+  ApplyUpdate(ToGridFlatIndices(rasterized_range_data.hit_flat_indices,
+                                rasterized_limits, offset, *probability_grid),
+              TranslateBoundingBox(rasterized_range_data.hit_bounding_box,
+                                   offset),
+              hit_table, probability_grid);
+  ApplyUpdate(ToGridFlatIndices(rasterized_range_data.miss_flat_indices,
+                                rasterized_limits, offset, *probability_grid),
+              TranslateBoundingBox(rasterized_range_data.miss_bounding_box,
+                                   offset),
+              miss_table, probability_grid);
 }
 
 }  // namespace mapping_2d
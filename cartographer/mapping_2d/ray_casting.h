@@ -19,7 +19,9 @@
 
 #include <vector>
 
+#include "Eigen/Geometry"
 #include "cartographer/common/port.h"
+#include "cartographer/mapping_2d/log_odds_grid.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/range_data.h"
@@ -35,6 +37,43 @@ void CastRays(const sensor::RangeData& range_data,
               const std::vector<uint16>& miss_table, bool insert_free_space,
               ProbabilityGrid* probability_grid);
 
+// Same as above for a 'log_odds_grid', to which 'hit_update' and
+// 'miss_update' as computed by ComputeLogOddsValueUpdate() are added.
+void CastRays(const sensor::RangeData& range_data, int hit_update,
+              int miss_update, bool insert_free_space,
+              LogOddsGrid* log_odds_grid);
+
+// The cells hit and missed by range data on a small grid whose cell
+// boundaries are at integer multiples of the resolution. Grids with the same
+// resolution and aligned cell boundaries differ from it only by an integer
+// offset of cell indices, so the rays are cast once for all of them.
+struct RasterizedRangeData {
+  MapLimits limits;
+  // Distinct flat indices into 'limits', row by row, of the cells with hits
+  // and of the cells without hits on the rays, as ordered by CastRays().
+  std::vector<int> hit_flat_indices;
+  std::vector<int> miss_flat_indices;
+  Eigen::AlignedBox2i hit_bounding_box;
+  Eigen::AlignedBox2i miss_bounding_box;
+};
+
+// Casts the rays of 'range_data' on a grid of the given 'resolution'.
+RasterizedRangeData RasterizeRangeData(const sensor::RangeData& range_data,
+                                       double resolution,
+                                       bool insert_free_space);
+
+// Returns true if 'rasterized_range_data' can be applied to a grid with
+// 'limits', i.e. the resolutions match and the cell boundaries are aligned.
+bool HasAlignedCells(const RasterizedRangeData& rasterized_range_data,
+                     const MapLimits& limits);
+
+// Same as CastRays() for the range data 'rasterized_range_data' was computed
+// from. 'probability_grid' must have aligned cells and is grown as needed.
+void ApplyRasterizedRangeData(const RasterizedRangeData& rasterized_range_data,
+                              const std::vector<uint16>& hit_table,
+                              const std::vector<uint16>& miss_table,
+                              ProbabilityGrid* probability_grid);
+
 }  // namespace mapping_2d
 }  // namespace cartographer
 
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of inserting synthetic 2D range data into a
+// ProbabilityGrid or a LogOddsGrid using CastRays().
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/log_odds_grid.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/ray_casting.h"
+#include "cartographer/sensor/range_data.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_scans, 400, "Number of range data to insert.");
+DEFINE_int32(num_beams, 1080, "Number of beams per range data.");
+DEFINE_double(resolution, 0.05, "Resolution of the probability grid.");
+DEFINE_double(max_range, 30., "Maximum range of the simulated lidar.");
+DEFINE_bool(tiled, false, "Use a tiled probability grid.");
+DEFINE_bool(log_odds, false,
+            "Use a LogOddsGrid instead of a probability grid.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace {
+
+// Generates range data of a lidar moving along the x axis through a room with
+// randomly perturbed walls. The same seed always yields the same data.
+std::vector<sensor::RangeData> GenerateRangeData(const int num_scans,
+                                                 const int num_beams,
+                                                 const float max_range) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> noise_distribution(-0.05f, 0.05f);
+  std::uniform_real_distribution<float> range_distribution(0.5f, max_range);
+  std::vector<sensor::RangeData> range_data;
+  for (int i = 0; i != num_scans; ++i) {
+    const Eigen::Vector3f origin(0.1f * i, 0.f, 0.f);
+    sensor::RangeData scan{origin, {}, {}};
+    for (int j = 0; j != num_beams; ++j) {
+      const float angle = 2.f * M_PI * j / num_beams;
+      const Eigen::Vector3f direction(std::cos(angle), std::sin(angle), 0.f);
+      // Every tenth beam has no return within range.
+      if (j % 10 == 0) {
+        scan.misses.push_back(origin + max_range * direction);
+        continue;
+      }
+      // Walls are at y = -5 and y = 5, with clutter in between.
+      const float range =
+          j % 3 == 0
+              ? range_distribution(rng)
+              : std::min(max_range,
+                         5.f / std::max(std::abs(direction.y()), 1e-3f)) +
+                    noise_distribution(rng);
+      scan.returns.push_back(origin + range * direction);
+    }
+    range_data.push_back(scan);
+  }
+  return range_data;
+}
+
+void Run() {
+  const std::vector<sensor::RangeData> range_data = GenerateRangeData(
+      FLAGS_num_scans, FLAGS_num_beams, static_cast<float>(FLAGS_max_range));
+  const std::vector<uint16> hit_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55));
+  const std::vector<uint16> miss_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.49));
+  const int hit_update =
+      mapping::ComputeLogOddsValueUpdate(mapping::Odds(0.55));
+  const int miss_update =
+      mapping::ComputeLogOddsValueUpdate(mapping::Odds(0.49));
+  const MapLimits limits(
+      FLAGS_resolution,
+      Eigen::Vector2d(50. * FLAGS_resolution, 50. * FLAGS_resolution),
+      CellLimits(100, 100));
+  ProbabilityGrid probability_grid(limits, FLAGS_tiled);
+  LogOddsGrid log_odds_grid(limits);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (const sensor::RangeData& scan : range_data) {
+    if (FLAGS_log_odds) {
+      CastRays(scan, hit_update, miss_update, true /* insert_free_space */,
+               &log_odds_grid);
+      continue;
+    }
+    CastRays(scan, hit_table, miss_table, true /* insert_free_space */,
+             &probability_grid);
+    probability_grid.FinishUpdate();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  LOG(INFO) << "Inserted " << range_data.size() << " range data with "
+            << FLAGS_num_beams << " beams in " << seconds << " s: "
+            << range_data.size() / seconds << " range data per second, "
+            << range_data.size() * FLAGS_num_beams / seconds
+            << " rays per second.";
+}
+
+}  // namespace
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks inserting synthetic range data into a 2D probability grid.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::Run();
+  return EXIT_SUCCESS;
+}
@@ -43,6 +43,9 @@ class CeresScanMatcher {
   CeresScanMatcher(const CeresScanMatcher&) = delete;
   CeresScanMatcher& operator=(const CeresScanMatcher&) = delete;
 
+  // Overrides the maximum number of solver iterations of the options.
+  void SetMaxNumIterations(int max_num_iterations);
+
   // Aligns 'point_cloud' within the 'probability_grid' given an
   // 'initial_pose_estimate' and returns a 'pose_estimate' and the solver
   // 'summary'.
@@ -53,7 +56,25 @@ class CeresScanMatcher {
              transform::Rigid2d* pose_estimate,
              ceres::Solver::Summary* summary) const;
 
+  // Same as Match() for each of the 'point_clouds' with the corresponding
+  // 'pose_estimates' as previous and initial pose, but all of them are solved
+  // in one problem whose residuals are evaluated by 'num_threads' threads. The
+  // poses are independent, so this saves the setup of one problem per point
+  // cloud, but they share the trust region and the convergence criteria.
+  void MatchBatch(const std::vector<const sensor::PointCloud*>& point_clouds,
+                  const ProbabilityGrid& probability_grid, int num_threads,
+                  std::vector<transform::Rigid2d>* pose_estimates,
+                  ceres::Solver::Summary* summary) const;
+
  private:
+  // Adds the residuals of Match() for the pose 'ceres_pose_estimate' to the
+  // 'problem'.
+  void AddResidualBlocks(const transform::Rigid2d& previous_pose,
+                         const sensor::PointCloud& point_cloud,
+                         const ProbabilityGrid& probability_grid,
+                         double* ceres_pose_estimate,
+                         ceres::Problem* problem) const;
+
   const proto::CeresScanMatcherOptions options_;
   ceres::Solver::Options ceres_solver_options_;
 };
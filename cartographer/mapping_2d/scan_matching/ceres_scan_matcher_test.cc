@@ -17,6 +17,7 @@
 #include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
 
 #include <memory>
+#include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
@@ -92,6 +93,28 @@ TEST_F(CeresScanMatcherTest, testOptimizeAlongXY) {
   TestFromInitialPose(transform::Rigid2d::Translation({-0.3, 0.3}));
 }
 
+TEST_F(CeresScanMatcherTest, testMatchBatch) {
+  const std::vector<transform::Rigid2d> initial_poses = {
+      transform::Rigid2d::Translation({-0.3, 0.5}),
+      transform::Rigid2d::Translation({-0.45, 0.3}),
+      transform::Rigid2d::Translation({-0.3, 0.3})};
+  std::vector<transform::Rigid2d> pose_estimates = initial_poses;
+  const std::vector<const sensor::PointCloud*> point_clouds(
+      initial_poses.size(), &point_cloud_);
+  ceres::Solver::Summary summary;
+  ceres_scan_matcher_->MatchBatch(point_clouds, probability_grid_,
+                                  2 /* num_threads */, &pose_estimates,
+                                  &summary);
+  for (size_t i = 0; i != initial_poses.size(); ++i) {
+    transform::Rigid2d expected_pose;
+    ceres::Solver::Summary unused_summary;
+    ceres_scan_matcher_->Match(initial_poses[i], initial_poses[i],
+                               point_cloud_, probability_grid_,
+                               &expected_pose, &unused_summary);
+    EXPECT_THAT(pose_estimates[i], transform::IsNearly(expected_pose, 1e-2));
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
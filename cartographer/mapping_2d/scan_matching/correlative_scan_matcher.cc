@@ -24,6 +24,23 @@ namespace cartographer {
 namespace mapping_2d {
 namespace scan_matching {
 
+namespace {
+
+void DiscretizeScan(const MapLimits& map_limits,
+                    const sensor::PointCloud& scan,
+                    const Eigen::Translation2f& initial_translation,
+                    DiscreteScan* const discrete_scan) {
+  discrete_scan->clear();
+  discrete_scan->reserve(scan.size());
+  for (const Eigen::Vector3f& point : scan) {
+    const Eigen::Vector2f translated_point =
+        Eigen::Affine2f(initial_translation) * point.head<2>();
+    discrete_scan->push_back(map_limits.GetCellIndex(translated_point));
+  }
+}
+
+}  // namespace
+
 SearchParameters::SearchParameters(const double linear_search_window,
                                    const double angular_search_window,
                                    const sensor::PointCloud& point_cloud,
@@ -94,36 +111,116 @@ std::vector<sensor::PointCloud> GenerateRotatedScans(
     const sensor::PointCloud& point_cloud,
     const SearchParameters& search_parameters) {
   std::vector<sensor::PointCloud> rotated_scans;
-  rotated_scans.reserve(search_parameters.num_scans);
+  GenerateRotatedScans(point_cloud, search_parameters, &rotated_scans);
+  return rotated_scans;
+}
 
+void GenerateRotatedScans(
+    const sensor::PointCloud& point_cloud,
+    const SearchParameters& search_parameters,
+    std::vector<sensor::PointCloud>* const rotated_scans) {
+  rotated_scans->resize(search_parameters.num_scans);
   double delta_theta = -search_parameters.num_angular_perturbations *
                        search_parameters.angular_perturbation_step_size;
   for (int scan_index = 0; scan_index < search_parameters.num_scans;
        ++scan_index,
            delta_theta += search_parameters.angular_perturbation_step_size) {
-    rotated_scans.push_back(sensor::TransformPointCloud(
-        point_cloud, transform::Rigid3f::Rotation(Eigen::AngleAxisf(
-                         delta_theta, Eigen::Vector3f::UnitZ()))));
+    sensor::PointCloud& rotated_scan = (*rotated_scans)[scan_index];
+    rotated_scan.assign(point_cloud.begin(), point_cloud.end());
+    sensor::TransformPointCloudInPlace(
+        transform::Rigid3f::Rotation(
+            Eigen::AngleAxisf(delta_theta, Eigen::Vector3f::UnitZ())),
+        &rotated_scan);
   }
-  return rotated_scans;
 }
 
 std::vector<DiscreteScan> DiscretizeScans(
     const MapLimits& map_limits, const std::vector<sensor::PointCloud>& scans,
     const Eigen::Translation2f& initial_translation) {
   std::vector<DiscreteScan> discrete_scans;
-  discrete_scans.reserve(scans.size());
-  for (const sensor::PointCloud& scan : scans) {
-    discrete_scans.emplace_back();
-    discrete_scans.back().reserve(scan.size());
-    for (const Eigen::Vector3f& point : scan) {
-      const Eigen::Vector2f translated_point =
-          Eigen::Affine2f(initial_translation) * point.head<2>();
-      discrete_scans.back().push_back(
-          map_limits.GetCellIndex(translated_point));
+  DiscretizeScans(map_limits, scans, initial_translation, &discrete_scans);
+  return discrete_scans;
+}
+
+std::vector<DiscreteScan> DiscretizeScans(
+    const MapLimits& map_limits,
+    const std::vector<const sensor::PointCloud*>& scans,
+    const Eigen::Translation2f& initial_translation) {
+  std::vector<DiscreteScan> discrete_scans;
+  DiscretizeScans(map_limits, scans, initial_translation, &discrete_scans);
+  return discrete_scans;
+}
+
+void DiscretizeScans(const MapLimits& map_limits,
+                     const std::vector<sensor::PointCloud>& scans,
+                     const Eigen::Translation2f& initial_translation,
+                     std::vector<DiscreteScan>* const discrete_scans) {
+  discrete_scans->resize(scans.size());
+  for (size_t i = 0; i != scans.size(); ++i) {
+    DiscretizeScan(map_limits, scans[i], initial_translation,
+                   &(*discrete_scans)[i]);
+  }
+}
+
+void DiscretizeScans(const MapLimits& map_limits,
+                     const std::vector<const sensor::PointCloud*>& scans,
+                     const Eigen::Translation2f& initial_translation,
+                     std::vector<DiscreteScan>* const discrete_scans) {
+  discrete_scans->resize(scans.size());
+  for (size_t i = 0; i != scans.size(); ++i) {
+    DiscretizeScan(map_limits, *scans[i], initial_translation,
+                   &(*discrete_scans)[i]);
+  }
+}
+
+RotatedScanCache::RotatedScanCache(const sensor::PointCloud& point_cloud,
+                                   const double resolution)
+    : point_cloud_(point_cloud),
+      resolution_(resolution),
+      angular_perturbation_step_size_(
+          SearchParameters(0. /* linear_search_window */,
+                           0. /* angular_search_window */, point_cloud,
+                           resolution)
+              .angular_perturbation_step_size) {}
+
+int RotatedScanCache::GetClosestIndex(const double angle) const {
+  return common::RoundToInt(common::NormalizeAngleDifference(angle) /
+                            angular_perturbation_step_size_);
+}
+
+std::vector<const sensor::PointCloud*> RotatedScanCache::GetRotatedScans(
+    const int center_index, const SearchParameters& search_parameters) {
+  CHECK_EQ(search_parameters.angular_perturbation_step_size,
+           angular_perturbation_step_size_);
+  std::vector<const sensor::PointCloud*> rotated_scans;
+  rotated_scans.reserve(search_parameters.num_scans);
+  const int min_index =
+      center_index - search_parameters.num_angular_perturbations;
+  for (int index = min_index; index != min_index + search_parameters.num_scans;
+       ++index) {
+    {
+      common::MutexLocker locker(&mutex_);
+      const auto it = rotated_scans_.find(index);
+      if (it != rotated_scans_.end()) {
+        rotated_scans.push_back(it->second.get());
+        continue;
+      }
     }
+    // Rotate without holding the lock, so that other threads can use the
+    // rotations computed so far. If another thread computed the same rotation
+    // meanwhile, its result is used.
+    std::unique_ptr<const sensor::PointCloud> rotated_scan(
+        new sensor::PointCloud(sensor::TransformPointCloud(
+            point_cloud_,
+            transform::Rigid3f::Rotation(Eigen::AngleAxisf(
+                index * angular_perturbation_step_size_,
+                Eigen::Vector3f::UnitZ())))));
+    common::MutexLocker locker(&mutex_);
+    rotated_scans.push_back(
+        rotated_scans_.emplace(index, std::move(rotated_scan))
+            .first->second.get());
   }
-  return discrete_scans;
+  return rotated_scans;
 }
 
 }  // namespace scan_matching
@@ -17,10 +17,13 @@
 #ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_CORRELATIVE_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_CORRELATIVE_SCAN_MATCHER_H_
 
+#include <map>
+#include <memory>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/mapping_2d/map_limits.h"
 #include "cartographer/mapping_2d/xy_index.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -64,12 +67,80 @@ std::vector<sensor::PointCloud> GenerateRotatedScans(
     const sensor::PointCloud& point_cloud,
     const SearchParameters& search_parameters);
 
+// Same as above, but replaces the contents of 'rotated_scans', reusing the
+// memory of its point clouds.
+void GenerateRotatedScans(const sensor::PointCloud& point_cloud,
+                          const SearchParameters& search_parameters,
+                          std::vector<sensor::PointCloud>* rotated_scans);
+
 // Translates and discretizes the rotated scans into a vector of integer
 // indices.
 std::vector<DiscreteScan> DiscretizeScans(
     const MapLimits& map_limits, const std::vector<sensor::PointCloud>& scans,
     const Eigen::Translation2f& initial_translation);
 
+// Same as above for scans not owned by the caller, e.g. from a
+// 'RotatedScanCache'.
+std::vector<DiscreteScan> DiscretizeScans(
+    const MapLimits& map_limits,
+    const std::vector<const sensor::PointCloud*>& scans,
+    const Eigen::Translation2f& initial_translation);
+
+// Same as the above, but replaces the contents of 'discrete_scans', reusing the
+// memory of its scans.
+void DiscretizeScans(const MapLimits& map_limits,
+                     const std::vector<sensor::PointCloud>& scans,
+                     const Eigen::Translation2f& initial_translation,
+                     std::vector<DiscreteScan>* discrete_scans);
+void DiscretizeScans(const MapLimits& map_limits,
+                     const std::vector<const sensor::PointCloud*>& scans,
+                     const Eigen::Translation2f& initial_translation,
+                     std::vector<DiscreteScan>* discrete_scans);
+
+// Rotations of a 'point_cloud' by multiples of the angular step size which
+// 'SearchParameters' use for it at 'resolution'. The rotations are computed
+// on demand and kept, so that matching the same point cloud against several
+// grids of this resolution rotates it only once per angle.
+//
+// This class is thread-safe.
+class RotatedScanCache {
+ public:
+  // The 'point_cloud' has to outlive this cache.
+  RotatedScanCache(const sensor::PointCloud& point_cloud, double resolution);
+
+  RotatedScanCache(const RotatedScanCache&) = delete;
+  RotatedScanCache& operator=(const RotatedScanCache&) = delete;
+
+  const sensor::PointCloud& point_cloud() const { return point_cloud_; }
+  double resolution() const { return resolution_; }
+  double angular_perturbation_step_size() const {
+    return angular_perturbation_step_size_;
+  }
+
+  // Returns the index of the multiple of the angular step size closest to
+  // 'angle'.
+  int GetClosestIndex(double angle) const;
+
+  // Returns 'search_parameters.num_scans' rotations like
+  // GenerateRotatedScans(), but centered on the rotation by 'center_index'
+  // times the angular step size. The 'search_parameters' have to use the same
+  // angular step size. The returned point clouds are valid as long as this
+  // cache.
+  std::vector<const sensor::PointCloud*> GetRotatedScans(
+      int center_index, const SearchParameters& search_parameters)
+      EXCLUDES(mutex_);
+
+ private:
+  const sensor::PointCloud& point_cloud_;
+  const double resolution_;
+  const double angular_perturbation_step_size_;
+
+  common::Mutex mutex_;
+  // Rotated point clouds by the multiple of the angular step size.
+  std::map<int, std::unique_ptr<const sensor::PointCloud>> rotated_scans_
+      GUARDED_BY(mutex_);
+};
+
 // A possible solution.
 struct Candidate {
   Candidate(const int init_scan_index, const int init_x_index_offset,
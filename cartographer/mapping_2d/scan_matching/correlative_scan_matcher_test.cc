@@ -96,6 +96,41 @@ TEST(DiscretizeScans, DiscretizeScans) {
   EXPECT_TRUE((Eigen::Array2i(4, 3) == discrete_scans[0][6]).all());
 }
 
+TEST(RotatedScanCache, MatchesGenerateRotatedScans) {
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-1.f, 1.f, 0.f);
+  point_cloud.emplace_back(3.f, 0.5f, 0.f);
+  RotatedScanCache rotated_scan_cache(point_cloud, 0.05);
+  const SearchParameters search_parameters(0.1, 0.05, point_cloud, 0.05);
+  EXPECT_EQ(search_parameters.angular_perturbation_step_size,
+            rotated_scan_cache.angular_perturbation_step_size());
+  const int center_index = rotated_scan_cache.GetClosestIndex(0.3);
+  EXPECT_NEAR(
+      0.3, center_index * rotated_scan_cache.angular_perturbation_step_size(),
+      rotated_scan_cache.angular_perturbation_step_size());
+  const std::vector<sensor::PointCloud> expected_scans = GenerateRotatedScans(
+      sensor::TransformPointCloud(
+          point_cloud,
+          transform::Rigid3f::Rotation(Eigen::AngleAxisf(
+              center_index *
+                  rotated_scan_cache.angular_perturbation_step_size(),
+              Eigen::Vector3f::UnitZ()))),
+      search_parameters);
+  // Asking twice returns the same, already rotated scans.
+  const std::vector<const sensor::PointCloud*> scans =
+      rotated_scan_cache.GetRotatedScans(center_index, search_parameters);
+  EXPECT_EQ(scans, rotated_scan_cache.GetRotatedScans(center_index,
+                                                      search_parameters));
+  ASSERT_EQ(expected_scans.size(), scans.size());
+  for (size_t i = 0; i != scans.size(); ++i) {
+    ASSERT_EQ(expected_scans[i].size(), scans[i]->size());
+    for (size_t j = 0; j != scans[i]->size(); ++j) {
+      EXPECT_NEAR(expected_scans[i][j].x(), (*scans[i])[j].x(), 1e-5);
+      EXPECT_NEAR(expected_scans[i][j].y(), (*scans[i])[j].y(), 1e-5);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
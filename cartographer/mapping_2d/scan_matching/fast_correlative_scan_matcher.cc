@@ -18,12 +18,19 @@
 
 #include <algorithm>
 #include <cmath>
-#include <deque>
 #include <functional>
+#include <iterator>
 #include <limits>
+#include <memory>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 #include "Eigen/Geometry"
 #include "cartographer/common/math.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/transform/transform.h"
@@ -35,44 +42,168 @@ namespace scan_matching {
 
 namespace {
 
+// State of a parallel branch-and-bound search. It is shared with the tasks, so
+// that tasks starting only after the search has finished can safely see that
+// nothing is left to do.
+struct ParallelSearchState {
+  ParallelSearchState(const int num_candidates,
+                      const Candidate& initial_best_candidate)
+      : num_candidates(num_candidates),
+        next_candidate_index(0),
+        best_score(initial_best_candidate.score),
+        best_candidate(initial_best_candidate) {}
+
+  const int num_candidates;
+  // Index of the next candidate whose subtree has to be searched.
+  std::atomic<int> next_candidate_index;
+  // Score of 'best_candidate', read by the tasks without taking 'mutex'.
+  std::atomic<float> best_score;
+
+  common::Mutex mutex;
+  Candidate best_candidate GUARDED_BY(mutex);
+  int num_candidates_searched GUARDED_BY(mutex) = 0;
+};
+
+// Number of points ahead of the current one whose cell is prefetched when
+// summing values without SIMD instructions, and number of points of the next
+// candidate whose cells are prefetched before scoring the current one.
+constexpr int kPrefetchDistance = 8;
+
+// Number of bytes 'cells_' is padded by, so that 32-bit gathers can read the
+// last cell.
+constexpr int kCellsPadding = sizeof(int32) - 1;
+
+#ifdef __x86_64__
+bool CpuSupportsAvx2() {
+  static const bool supports_avx2 = __builtin_cpu_supports("avx2");
+  return supports_avx2;
+}
+#endif
+
+// Returns in 'begin' and 'end' the range of 'i' in [0, 'num_offsets') for
+// which 0 <= 'first' + i * 'step' < 'size'. The range may be empty.
+void ComputeOffsetRangeWithinLimits(const int first, const int step,
+                                    const int num_offsets, const int size,
+                                    int* const begin, int* const end) {
+  *begin = first >= 0 ? 0 : (-first + step - 1) / step;
+  *end = first < size ? std::min(num_offsets, (size - 1 - first) / step + 1)
+                      : 0;
+}
+
 // A collection of values which can be added and later removed, and the maximum
 // of the current values in the collection can be retrieved.
-// All of it in (amortized) O(1).
+// All of it in (amortized) O(1). The candidates for the maximum are kept in a
+// ring buffer of fixed size, since at most 'capacity' values are added but not
+// yet removed at any time.
 class SlidingWindowMaximum {
  public:
-  void AddValue(const float value) {
-    while (!non_ascending_maxima_.empty() &&
-           value > non_ascending_maxima_.back()) {
-      non_ascending_maxima_.pop_back();
+  explicit SlidingWindowMaximum(const int capacity) {
+    int size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    non_ascending_maxima_.resize(size);
+    mask_ = size - 1;
+  }
+
+  void AddValue(const uint8 value) {
+    while (begin_ != end_ &&
+           value > non_ascending_maxima_[(end_ - 1) & mask_]) {
+      --end_;
     }
-    non_ascending_maxima_.push_back(value);
+    non_ascending_maxima_[end_ & mask_] = value;
+    ++end_;
   }
 
-  void RemoveValue(const float value) {
+  void RemoveValue(const uint8 value) {
     // DCHECK for performance, since this is done for every value in the
     // precomputation grid.
-    DCHECK(!non_ascending_maxima_.empty());
-    DCHECK_LE(value, non_ascending_maxima_.front());
-    if (value == non_ascending_maxima_.front()) {
-      non_ascending_maxima_.pop_front();
+    DCHECK(begin_ != end_);
+    DCHECK_LE(value, GetMaximum());
+    if (value == non_ascending_maxima_[begin_ & mask_]) {
+      ++begin_;
     }
   }
 
-  float GetMaximum() const {
+  uint8 GetMaximum() const {
     // DCHECK for performance, since this is done for every value in the
     // precomputation grid.
-    DCHECK_GT(non_ascending_maxima_.size(), 0);
-    return non_ascending_maxima_.front();
+    DCHECK(begin_ != end_);
+    return non_ascending_maxima_[begin_ & mask_];
   }
 
-  void CheckIsEmpty() const { CHECK_EQ(non_ascending_maxima_.size(), 0); }
+  void Clear() { begin_ = end_ = 0; }
 
  private:
-  // Maximum of the current sliding window at the front. Then the maximum of the
-  // remaining window that came after this values first occurence, and so on.
-  std::deque<float> non_ascending_maxima_;
+  // Maximum of the current sliding window at 'begin_'. Then the maximum of the
+  // remaining window that came after this values first occurence, and so on
+  // up to 'end_'. Both only increase and are wrapped by 'mask_'.
+  std::vector<uint8> non_ascending_maxima_;
+  unsigned int mask_;
+  unsigned int begin_ = 0;
+  unsigned int end_ = 0;
+};
+
+// Returns true if all cells of the 'inner' limits are cells of the 'outer'
+// limits, and sets 'shift' to the index in the 'outer' limits of the cell (0,
+// 0) of the 'inner' limits.
+bool ComputeShiftWithinLimits(const MapLimits& outer, const MapLimits& inner,
+                              Eigen::Array2i* const shift) {
+  if (outer.resolution() != inner.resolution()) {
+    return false;
+  }
+  // Cell indices are flipped and rotated, see MapLimits::GetCellIndex().
+  const Eigen::Vector2d cells =
+      (outer.max() - inner.max()) / outer.resolution();
+  *shift = Eigen::Array2i(common::RoundToInt(cells.y()),
+                          common::RoundToInt(cells.x()));
+  return (*shift >= 0).all() &&
+         shift->x() + inner.cell_limits().num_x_cells <=
+             outer.cell_limits().num_x_cells &&
+         shift->y() + inner.cell_limits().num_y_cells <=
+             outer.cell_limits().num_y_cells;
+}
+
+// The temporaries of matching. They are kept per thread and reused by the next
+// match on the same thread, so that matching does not allocate once they have
+// grown.
+struct Workspace {
+  sensor::PointCloud rotated_point_cloud;
+  std::vector<sensor::PointCloud> rotated_scans;
+  std::vector<DiscreteScan> discrete_scans;
+  std::vector<Candidate> lowest_resolution_candidates;
+  std::vector<int> sums;
+  // The children of the candidate being branched at each depth of the
+  // branch-and-bound search, indexed by their depth.
+  std::vector<std::vector<Candidate>> higher_resolution_candidates;
 };
 
+Workspace& GetThreadLocalWorkspace() {
+  thread_local Workspace workspace;
+  return workspace;
+}
+
+// Sorts the points of each of the 'discrete_scans' by row and then column,
+// which is the order of the cells in memory. Sums over the points do not
+// depend on their order.
+void SortPointsByCell(std::vector<DiscreteScan>* const discrete_scans) {
+  for (DiscreteScan& discrete_scan : *discrete_scans) {
+    std::sort(discrete_scan.begin(), discrete_scan.end(),
+              [](const Eigen::Array2i& lhs, const Eigen::Array2i& rhs) {
+                return lhs.y() != rhs.y() ? lhs.y() < rhs.y()
+                                          : lhs.x() < rhs.x();
+              });
+  }
+}
+
+// Returns the number of bits per cell of all but the finest precomputation
+// grid, where 0 means that they are not packed.
+int GetCoarseBitsPerCell(
+    const proto::FastCorrelativeScanMatcherOptions& options) {
+  return options.coarse_bits_per_cell() == 0 ? 8
+                                             : options.coarse_bits_per_cell();
+}
+
 }  // namespace
 
 proto::FastCorrelativeScanMatcherOptions
@@ -85,80 +216,451 @@ CreateFastCorrelativeScanMatcherOptions(
       parameter_dictionary->GetDouble("angular_search_window"));
   options.set_branch_and_bound_depth(
       parameter_dictionary->GetInt("branch_and_bound_depth"));
+  options.set_coarse_bits_per_cell(
+      parameter_dictionary->GetInt("coarse_bits_per_cell"));
+  CHECK(options.coarse_bits_per_cell() == 8 ||
+        options.coarse_bits_per_cell() == 4 ||
+        options.coarse_bits_per_cell() == 2)
+      << options.coarse_bits_per_cell();
+  options.set_sort_points_by_cell(
+      parameter_dictionary->GetBool("sort_points_by_cell"));
   return options;
 }
 
 PrecomputationGrid::PrecomputationGrid(
     const ProbabilityGrid& probability_grid, const CellLimits& limits,
-    const int width, std::vector<float>* reusable_intermediate_grid)
+    const int width, std::vector<uint8>* const reusable_intermediate_grid)
+    : PrecomputationGrid(ComputeCellValues(probability_grid, limits), limits,
+                         width, reusable_intermediate_grid) {}
+
+PrecomputationGrid::PrecomputationGrid(
+    const std::vector<uint8>& cell_values, const CellLimits& limits,
+    const int width, std::vector<uint8>* const reusable_intermediate_grid)
     : offset_(-width + 1, -width + 1),
       wide_limits_(limits.num_x_cells + width - 1,
                    limits.num_y_cells + width - 1),
-      cells_(wide_limits_.num_x_cells * wide_limits_.num_y_cells) {
+      owned_cells_(wide_limits_.num_x_cells * wide_limits_.num_y_cells +
+                   kCellsPadding),
+      cells_(owned_cells_.data()) {
   CHECK_GE(width, 1);
   CHECK_GE(limits.num_x_cells, 1);
   CHECK_GE(limits.num_y_cells, 1);
+  CHECK_EQ(cell_values.size(), limits.num_x_cells * limits.num_y_cells);
   const int stride = wide_limits_.num_x_cells;
-  // First we compute the maximum probability for each (x0, y) achieved in the
-  // span defined by x0 <= x < x0 + width.
-  std::vector<float>& intermediate = *reusable_intermediate_grid;
-  intermediate.resize(wide_limits_.num_x_cells * limits.num_y_cells);
+  // Cells outside of the 'limits' have value 0, which is the minimum. We pad
+  // the rows and columns with 'width' - 1 such cells on both sides, so that
+  // the borders need no special handling.
+  const int num_padded_x_cells = limits.num_x_cells + 2 * (width - 1);
+  const int num_padded_y_cells = limits.num_y_cells + 2 * (width - 1);
+  std::vector<uint8>& intermediate = *reusable_intermediate_grid;
+  intermediate.assign(2 * num_padded_y_cells * stride + num_padded_x_cells, 0);
+  uint8* const row_maxima = intermediate.data();
+  uint8* const suffix_maxima = row_maxima + num_padded_y_cells * stride;
+  uint8* const padded_row = suffix_maxima + num_padded_y_cells * stride;
+
+  // First we compute the maximum for each (x0, y) achieved in the span defined
+  // by x0 <= x < x0 + width.
+  SlidingWindowMaximum current_values(width);
   for (int y = 0; y != limits.num_y_cells; ++y) {
-    SlidingWindowMaximum current_values;
-    current_values.AddValue(
-        probability_grid.GetProbability(Eigen::Array2i(0, y)));
-    for (int x = -width + 1; x != 0; ++x) {
-      intermediate[x + width - 1 + y * stride] = current_values.GetMaximum();
-      if (x + width < limits.num_x_cells) {
-        current_values.AddValue(
-            probability_grid.GetProbability(Eigen::Array2i(x + width, y)));
+    std::copy_n(cell_values.data() + y * limits.num_x_cells,
+                limits.num_x_cells, padded_row + width - 1);
+    uint8* const row = row_maxima + (y + width - 1) * stride;
+    for (int x = 0; x != width - 1; ++x) {
+      current_values.AddValue(padded_row[x]);
+    }
+    for (int x = 0; x != stride; ++x) {
+      current_values.AddValue(padded_row[x + width - 1]);
+      row[x] = current_values.GetMaximum();
+      current_values.RemoveValue(padded_row[x]);
+    }
+    current_values.Clear();
+  }
+
+  // For each (x, y), we compute the maximum in the width x width region
+  // starting at each (x, y). The rows are split into blocks of 'width' rows,
+  // so that any 'width' consecutive rows are a suffix of one block followed by
+  // a prefix of the next. The maxima of all suffixes and prefixes are computed
+  // a row at a time, so that the loops over the cells of a row vectorize.
+  for (int y = num_padded_y_cells - 1; y >= 0; --y) {
+    const uint8* const row = row_maxima + y * stride;
+    uint8* const suffix = suffix_maxima + y * stride;
+    if ((y + 1) % width == 0 || y == num_padded_y_cells - 1) {
+      std::copy_n(row, stride, suffix);
+      continue;
+    }
+    const uint8* const next_suffix = suffix + stride;
+    for (int x = 0; x != stride; ++x) {
+      suffix[x] = std::max(row[x], next_suffix[x]);
+    }
+  }
+  // The prefix maxima replace the row maxima, which are no longer needed.
+  for (int y = 1; y != num_padded_y_cells; ++y) {
+    if (y % width == 0) {
+      continue;
+    }
+    uint8* const prefix = row_maxima + y * stride;
+    const uint8* const previous_prefix = prefix - stride;
+    for (int x = 0; x != stride; ++x) {
+      prefix[x] = std::max(prefix[x], previous_prefix[x]);
+    }
+  }
+  for (int y = 0; y != wide_limits_.num_y_cells; ++y) {
+    const uint8* const suffix = suffix_maxima + y * stride;
+    const uint8* const prefix = row_maxima + (y + width - 1) * stride;
+    uint8* const cells = owned_cells_.data() + y * stride;
+    for (int x = 0; x != stride; ++x) {
+      cells[x] = std::max(suffix[x], prefix[x]);
+    }
+  }
+}
+
+PrecomputationGrid::PrecomputationGrid(
+    const PrecomputationGrid& narrower_grid,
+    std::vector<uint8>* const reusable_intermediate_grid)
+    : offset_(2 * narrower_grid.offset_ - 1),
+      wide_limits_(narrower_grid.wide_limits_.num_x_cells + 1 -
+                       narrower_grid.offset_.x(),
+                   narrower_grid.wide_limits_.num_y_cells + 1 -
+                       narrower_grid.offset_.y()),
+      owned_cells_(wide_limits_.num_x_cells * wide_limits_.num_y_cells +
+                   kCellsPadding),
+      cells_(owned_cells_.data()) {
+  CHECK_EQ(narrower_grid.offset_.x(), narrower_grid.offset_.y());
+  CHECK_EQ(narrower_grid.bits_per_cell_, 8);
+  // The maximum in the 2 * width window starting at x is the maximum of the
+  // width windows starting at x and x + width, which are the cells 'width'
+  // apart in the 'narrower_grid'. Cells outside of it are 0, so near the
+  // borders only one of them is used.
+  const int width = 1 - narrower_grid.offset_.x();
+  const int narrower_stride = narrower_grid.wide_limits_.num_x_cells;
+  const int stride = wide_limits_.num_x_cells;
+  const auto max_of_rows = [width](const uint8* const row, const int size,
+                                   uint8* const result) {
+    std::copy_n(row, width, result);
+    for (int i = width; i != size; ++i) {
+      result[i] = std::max(row[i - width], row[i]);
+    }
+    std::copy_n(row + size - width, width, result + size);
+  };
+  // First we compute the maximum for each (x0, y) over x0 <= x < x0 + 2 *
+  // width.
+  std::vector<uint8>& intermediate = *reusable_intermediate_grid;
+  intermediate.resize(narrower_grid.wide_limits_.num_y_cells * stride);
+  for (int y = 0; y != narrower_grid.wide_limits_.num_y_cells; ++y) {
+    max_of_rows(narrower_grid.cells_ + y * narrower_stride, narrower_stride,
+                intermediate.data() + y * stride);
+  }
+  // Then the same for whole rows over y0 <= y < y0 + 2 * width.
+  const int num_narrower_rows = narrower_grid.wide_limits_.num_y_cells;
+  for (int y = 0; y != wide_limits_.num_y_cells; ++y) {
+    uint8* const cells = owned_cells_.data() + y * stride;
+    const uint8* const upper_row =
+        y >= width ? intermediate.data() + (y - width) * stride : nullptr;
+    const uint8* const lower_row =
+        y < num_narrower_rows ? intermediate.data() + y * stride : nullptr;
+    if (upper_row == nullptr) {
+      std::copy_n(lower_row, stride, cells);
+    } else if (lower_row == nullptr) {
+      std::copy_n(upper_row, stride, cells);
+    } else {
+      for (int x = 0; x != stride; ++x) {
+        cells[x] = std::max(upper_row[x], lower_row[x]);
+      }
+    }
+  }
+}
+
+PrecomputationGrid::PrecomputationGrid(const Eigen::Array2i& offset,
+                                       const CellLimits& wide_limits,
+                                       const int bits_per_cell,
+                                       const uint8* const cells)
+    : offset_(offset), wide_limits_(wide_limits), cells_(cells) {
+  CHECK(cells_ != nullptr);
+  SetBitsPerCell(bits_per_cell);
+}
+
+PrecomputationGrid::PrecomputationGrid(const PrecomputationGrid& grid,
+                                       const Eigen::Array2i& shift,
+                                       const CellLimits& limits)
+    : offset_(grid.offset_),
+      wide_limits_(limits.num_x_cells - offset_.x(),
+                   limits.num_y_cells - offset_.y()),
+      owned_cells_(ComputeNumCellBytes(
+          wide_limits_.num_x_cells * wide_limits_.num_y_cells,
+          grid.bits_per_cell_)),
+      cells_(owned_cells_.data()) {
+  CHECK_GE(shift.x(), 0);
+  CHECK_GE(shift.y(), 0);
+  CHECK_LE(shift.x() + wide_limits_.num_x_cells, grid.wide_limits_.num_x_cells);
+  CHECK_LE(shift.y() + wide_limits_.num_y_cells, grid.wide_limits_.num_y_cells);
+  SetBitsPerCell(grid.bits_per_cell_);
+  const int stride = wide_limits_.num_x_cells;
+  const int grid_stride = grid.wide_limits_.num_x_cells;
+  for (int y = 0; y != wide_limits_.num_y_cells; ++y) {
+    const int grid_row_index = (y + shift.y()) * grid_stride + shift.x();
+    if (bits_per_cell_ == 8) {
+      std::copy_n(grid.cells_ + grid_row_index, stride,
+                  owned_cells_.data() + y * stride);
+      continue;
+    }
+    // Packed rows do not necessarily start at the same bit, and the values
+    // are already rounded, so they are copied unchanged cell by cell.
+    for (int x = 0; x != stride; ++x) {
+      SetCell(y * stride + x, grid.GetCell(grid_row_index + x));
+    }
+  }
+}
+
+void PrecomputationGrid::Pack(const int bits_per_cell) {
+  CHECK(!owned_cells_.empty());
+  CHECK_EQ(bits_per_cell_, 8);
+  CHECK(bits_per_cell == 8 || bits_per_cell == 4 || bits_per_cell == 2)
+      << bits_per_cell;
+  if (bits_per_cell == 8) {
+    return;
+  }
+  std::vector<uint8> values;
+  values.swap(owned_cells_);
+  const int num_cells = wide_limits_.num_x_cells * wide_limits_.num_y_cells;
+  SetBitsPerCell(bits_per_cell);
+  owned_cells_.assign(ComputeNumCellBytes(num_cells, bits_per_cell), 0);
+  cells_ = owned_cells_.data();
+  for (int i = 0; i != num_cells; ++i) {
+    SetCell(i, values[i]);
+  }
+}
+
+int PrecomputationGrid::ComputeNumCellBytes(const int num_cells,
+                                            const int bits_per_cell) {
+  return (num_cells * bits_per_cell + 7) / 8 + kCellsPadding;
+}
+
+void PrecomputationGrid::SetCell(const int index, const uint8 value) {
+  DCHECK(!owned_cells_.empty());
+  const int packed_value = (value + value_scale_ - 1) / value_scale_;
+  const int shift = (index & cells_per_byte_mask_) * bits_per_cell_;
+  uint8& cell_byte = owned_cells_[index >> cells_per_byte_log2_];
+  cell_byte = (cell_byte & ~(value_mask_ << shift)) | (packed_value << shift);
+}
+
+void PrecomputationGrid::SetBitsPerCell(const int bits_per_cell) {
+  CHECK(bits_per_cell == 8 || bits_per_cell == 4 || bits_per_cell == 2)
+      << bits_per_cell;
+  bits_per_cell_ = bits_per_cell;
+  cells_per_byte_log2_ = bits_per_cell == 8 ? 0 : bits_per_cell == 4 ? 1 : 2;
+  cells_per_byte_mask_ = (1 << cells_per_byte_log2_) - 1;
+  value_mask_ = (1 << bits_per_cell) - 1;
+  value_scale_ = 255 / value_mask_;
+}
+
+int PrecomputationGrid::SumValues(
+    const std::vector<Eigen::Array2i>& xy_indices,
+    const Eigen::Array2i& xy_offset) const {
+#ifdef __x86_64__
+  if (bits_per_cell_ == 8 && CpuSupportsAvx2()) {
+    return SumValuesAvx2(xy_indices, xy_offset);
+  }
+#endif
+  return SumValuesScalar(xy_indices, xy_offset);
+}
+
+void PrecomputationGrid::PrefetchValues(
+    const std::vector<Eigen::Array2i>& xy_indices,
+    const Eigen::Array2i& xy_offset, const int num_indices) const {
+  const Eigen::Array2i local_offset = xy_offset - offset_;
+  const int end = std::min(num_indices, static_cast<int>(xy_indices.size()));
+  for (int i = 0; i < end; ++i) {
+    PrefetchCell(xy_indices[i] + local_offset);
+  }
+}
+
+int PrecomputationGrid::SumValuesScalar(
+    const std::vector<Eigen::Array2i>& xy_indices,
+    const Eigen::Array2i& xy_offset) const {
+  const Eigen::Array2i local_offset = xy_offset - offset_;
+  const size_t num_indices = xy_indices.size();
+  int sum = 0;
+  for (size_t i = 0; i != num_indices; ++i) {
+    if (i + kPrefetchDistance < num_indices) {
+      PrefetchCell(xy_indices[i + kPrefetchDistance] + local_offset);
+    }
+    sum += GetValue(xy_indices[i] + xy_offset);
+  }
+  return sum;
+}
+
+#ifdef __x86_64__
+// Processes 8 indices at a time: they are split into x and y components,
+// checked against the limits, and the cells within the limits are gathered as
+// 32-bit words of which only the lowest byte is kept.
+__attribute__((target("avx2"))) int PrecomputationGrid::SumValuesAvx2(
+    const std::vector<Eigen::Array2i>& xy_indices,
+    const Eigen::Array2i& xy_offset) const {
+  static_assert(sizeof(Eigen::Array2i) == 2 * sizeof(int32),
+                "Indices must be packed (x, y) pairs.");
+  const Eigen::Array2i local_offset = xy_offset - offset_;
+  const __m256i x_offset = _mm256_set1_epi32(local_offset.x());
+  const __m256i y_offset = _mm256_set1_epi32(local_offset.y());
+  const __m256i num_x_cells = _mm256_set1_epi32(wide_limits_.num_x_cells);
+  const __m256i num_y_cells = _mm256_set1_epi32(wide_limits_.num_y_cells);
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i lowest_byte = _mm256_set1_epi32(0xff);
+  // Moves the x components into the lower, the y components into the upper
+  // half of each lane.
+  const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const int* const cells = reinterpret_cast<const int*>(cells_);
+  __m256i sums = _mm256_setzero_si256();
+  const size_t num_vectorized = xy_indices.size() / 8 * 8;
+  for (size_t i = 0; i != num_vectorized; i += 8) {
+    const __m256i first = _mm256_permutevar8x32_epi32(
+        _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(xy_indices[i].data())),
+        deinterleave);
+    const __m256i second = _mm256_permutevar8x32_epi32(
+        _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(xy_indices[i + 4].data())),
+        deinterleave);
+    const __m256i x = _mm256_add_epi32(
+        _mm256_permute2x128_si256(first, second, 0x20), x_offset);
+    const __m256i y = _mm256_add_epi32(
+        _mm256_permute2x128_si256(first, second, 0x31), y_offset);
+    const __m256i in_limits = _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi32(x, minus_one),
+                         _mm256_cmpgt_epi32(num_x_cells, x)),
+        _mm256_and_si256(_mm256_cmpgt_epi32(y, minus_one),
+                         _mm256_cmpgt_epi32(num_y_cells, y)));
+    const __m256i cell_indices =
+        _mm256_add_epi32(x, _mm256_mullo_epi32(y, num_x_cells));
+    const __m256i values = _mm256_mask_i32gather_epi32(
+        _mm256_setzero_si256(), cells, cell_indices, in_limits, 1);
+    sums = _mm256_add_epi32(sums, _mm256_and_si256(values, lowest_byte));
+  }
+  alignas(32) int32 lane_sums[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lane_sums), sums);
+  int sum = 0;
+  for (const int32 lane_sum : lane_sums) {
+    sum += lane_sum;
+  }
+  for (size_t i = num_vectorized; i != xy_indices.size(); ++i) {
+    sum += GetValue(xy_indices[i] + xy_offset);
+  }
+  return sum;
+}
+#endif
+
+void PrecomputationGrid::AccumulateValuesOnLattice(
+    const std::vector<Eigen::Array2i>& xy_indices,
+    const Eigen::Array2i& min_offset, const int step, const int num_x_offsets,
+    const int num_y_offsets, int* const sums) const {
+  CHECK_GE(step, 1);
+  const int stride = wide_limits_.num_x_cells;
+  for (const Eigen::Array2i& xy_index : xy_indices) {
+    const Eigen::Array2i first = xy_index + min_offset - offset_;
+    int x_begin;
+    int x_end;
+    ComputeOffsetRangeWithinLimits(first.x(), step, num_x_offsets,
+                                   wide_limits_.num_x_cells, &x_begin, &x_end);
+    int y_begin;
+    int y_end;
+    ComputeOffsetRangeWithinLimits(first.y(), step, num_y_offsets,
+                                   wide_limits_.num_y_cells, &y_begin, &y_end);
+    for (int y = y_begin; y < y_end; ++y) {
+      const int row_index = (first.y() + y * step) * stride;
+      int* const row_sums = sums + y * num_x_offsets;
+      if (bits_per_cell_ != 8) {
+        for (int x = x_begin; x < x_end; ++x) {
+          row_sums[x] += GetCell(row_index + first.x() + x * step);
+        }
+        continue;
+      }
+      const uint8* const row = cells_ + row_index;
+      // Written without bounds checks, so that the compiler can vectorize it.
+      for (int x = x_begin; x < x_end; ++x) {
+        row_sums[x] += row[first.x() + x * step];
       }
     }
-    for (int x = 0; x < limits.num_x_cells - width; ++x) {
-      intermediate[x + width - 1 + y * stride] = current_values.GetMaximum();
-      current_values.RemoveValue(
-          probability_grid.GetProbability(Eigen::Array2i(x, y)));
-      current_values.AddValue(
-          probability_grid.GetProbability(Eigen::Array2i(x + width, y)));
-    }
-    for (int x = std::max(limits.num_x_cells - width, 0);
-         x != limits.num_x_cells; ++x) {
-      intermediate[x + width - 1 + y * stride] = current_values.GetMaximum();
-      current_values.RemoveValue(
-          probability_grid.GetProbability(Eigen::Array2i(x, y)));
-    }
-    current_values.CheckIsEmpty();
-  }
-  // For each (x, y), we compute the maximum probability in the width x width
-  // region starting at each (x, y) and precompute the resulting bound on the
-  // score.
-  for (int x = 0; x != wide_limits_.num_x_cells; ++x) {
-    SlidingWindowMaximum current_values;
-    current_values.AddValue(intermediate[x]);
-    for (int y = -width + 1; y != 0; ++y) {
-      cells_[x + (y + width - 1) * stride] =
-          ComputeCellValue(current_values.GetMaximum());
-      if (y + width < limits.num_y_cells) {
-        current_values.AddValue(intermediate[x + (y + width) * stride]);
+  }
+}
+
+void PrecomputationGrid::UpdateCellValues(
+    const std::vector<uint8>& cell_values,
+    std::vector<Eigen::Array2i>* const changed_xy_indices) {
+  CHECK((offset_ == 0).all()) << "Only grids of width 1 hold cell values.";
+  CHECK(!owned_cells_.empty());
+  CHECK_EQ(bits_per_cell_, 8);
+  CHECK_EQ(cell_values.size(),
+           wide_limits_.num_x_cells * wide_limits_.num_y_cells);
+  for (int y = 0; y != wide_limits_.num_y_cells; ++y) {
+    for (int x = 0; x != wide_limits_.num_x_cells; ++x) {
+      const int index = x + y * wide_limits_.num_x_cells;
+      if (owned_cells_[index] != cell_values[index]) {
+        owned_cells_[index] = cell_values[index];
+        changed_xy_indices->emplace_back(x, y);
       }
     }
-    for (int y = 0; y < limits.num_y_cells - width; ++y) {
-      cells_[x + (y + width - 1) * stride] =
-          ComputeCellValue(current_values.GetMaximum());
-      current_values.RemoveValue(intermediate[x + y * stride]);
-      current_values.AddValue(intermediate[x + (y + width) * stride]);
+  }
+}
+
+void PrecomputationGrid::UpdateFromNarrowerGrid(
+    const PrecomputationGrid& narrower_grid,
+    const std::vector<Eigen::Array2i>& changed_narrower_xy_indices,
+    std::vector<Eigen::Array2i>* const changed_xy_indices) {
+  CHECK((offset_ == 2 * narrower_grid.offset_ - 1).all());
+  CHECK(!owned_cells_.empty());
+  // As in the constructor from the 'narrower_grid', each cell is the maximum
+  // of the cells of the 'narrower_grid' at the same index and 'width' less in
+  // x, y, or both. Cells updated more than once only change the first time.
+  const int width = 1 - narrower_grid.offset_.x();
+  const CellLimits& narrower_limits = narrower_grid.wide_limits_;
+  const auto get_narrower_value = [&narrower_grid, &narrower_limits](
+                                      const int x, const int y) -> uint8 {
+    if (x < 0 || y < 0 || x >= narrower_limits.num_x_cells ||
+        y >= narrower_limits.num_y_cells) {
+      return 0;
     }
-    for (int y = std::max(limits.num_y_cells - width, 0);
-         y != limits.num_y_cells; ++y) {
-      cells_[x + (y + width - 1) * stride] =
-          ComputeCellValue(current_values.GetMaximum());
-      current_values.RemoveValue(intermediate[x + y * stride]);
+    return narrower_grid.GetCell(x + y * narrower_limits.num_x_cells);
+  };
+  for (const Eigen::Array2i& narrower_xy_index : changed_narrower_xy_indices) {
+    for (const int x_offset : {0, width}) {
+      for (const int y_offset : {0, width}) {
+        const int x = narrower_xy_index.x() + x_offset;
+        const int y = narrower_xy_index.y() + y_offset;
+        const uint8 value =
+            std::max(std::max(get_narrower_value(x - width, y - width),
+                              get_narrower_value(x, y - width)),
+                     std::max(get_narrower_value(x - width, y),
+                              get_narrower_value(x, y)));
+        const int index = x + y * wide_limits_.num_x_cells;
+        const uint8 old_value = GetCell(index);
+        SetCell(index, value);
+        if (GetCell(index) != old_value) {
+          changed_xy_indices->emplace_back(x, y);
+        }
+      }
     }
-    current_values.CheckIsEmpty();
   }
 }
 
-uint8 PrecomputationGrid::ComputeCellValue(const float probability) const {
+std::vector<uint8> PrecomputationGrid::ComputeCellValues(
+    const ProbabilityGrid& probability_grid, const CellLimits& limits) {
+  return ComputeCellValues(probability_grid, Eigen::Array2i::Zero(), limits);
+}
+
+std::vector<uint8> PrecomputationGrid::ComputeCellValues(
+    const ProbabilityGrid& probability_grid, const Eigen::Array2i& offset,
+    const CellLimits& limits) {
+  std::vector<uint8> cell_values;
+  cell_values.reserve(limits.num_x_cells * limits.num_y_cells);
+  for (int y = 0; y != limits.num_y_cells; ++y) {
+    for (int x = 0; x != limits.num_x_cells; ++x) {
+      cell_values.push_back(ComputeCellValue(
+          probability_grid.GetProbability(Eigen::Array2i(x, y) + offset)));
+    }
+  }
+  return cell_values;
+}
+
+uint8 PrecomputationGrid::ComputeCellValue(const float probability) {
   const int cell_value = common::RoundToInt(
       (probability - mapping::kMinProbability) *
       (255.f / (mapping::kMaxProbability - mapping::kMinProbability)));
@@ -172,18 +674,96 @@ class PrecomputationGridStack {
   PrecomputationGridStack(
       const ProbabilityGrid& probability_grid,
       const proto::FastCorrelativeScanMatcherOptions& options) {
+    CARTOGRAPHER_TRACE_SPAN("PrecomputationGridStack");
     CHECK_GE(options.branch_and_bound_depth(), 1);
-    const int max_width = 1 << (options.branch_and_bound_depth() - 1);
     precomputation_grids_.reserve(options.branch_and_bound_depth());
-    std::vector<float> reusable_intermediate_grid;
     const CellLimits limits = probability_grid.limits().cell_limits();
-    reusable_intermediate_grid.reserve((limits.num_x_cells + max_width - 1) *
-                                       limits.num_y_cells);
-    for (int i = 0; i != options.branch_and_bound_depth(); ++i) {
-      const int width = 1 << i;
-      precomputation_grids_.emplace_back(probability_grid, limits, width,
+    const std::vector<uint8> cell_values =
+        PrecomputationGrid::ComputeCellValues(probability_grid, limits);
+    std::vector<uint8> reusable_intermediate_grid;
+    precomputation_grids_.emplace_back(cell_values, limits, 1 /* width */,
+                                       &reusable_intermediate_grid);
+    // Each grid has twice the width of the previous one, from which it is
+    // computed.
+    for (int i = 1; i != options.branch_and_bound_depth(); ++i) {
+      precomputation_grids_.emplace_back(precomputation_grids_.back(),
                                          &reusable_intermediate_grid);
     }
+    // The coarser grids are packed once all of them are computed from the
+    // full precision values. Rounding up commutes with taking the maximum, so
+    // they are the same as if computed from the packed values.
+    for (int i = 1; i != options.branch_and_bound_depth(); ++i) {
+      precomputation_grids_[i].Pack(GetCoarseBitsPerCell(options));
+    }
+  }
+
+  // Reads the grids serialized by 'Serialize()' in place from the blob at
+  // 'blob_index', checking that they match the 'probability_grid' and
+  // 'options'.
+  PrecomputationGridStack(
+      const ProbabilityGrid& probability_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      std::shared_ptr<const io::MappedBlobFile> mapped_blob_file,
+      const int blob_index)
+      : mapped_blob_file_(std::move(mapped_blob_file)) {
+    CHECK(mapped_blob_file_ != nullptr);
+    io::BlobReader reader(mapped_blob_file_->blob(blob_index));
+    const int num_grids = reader.Read<int32>();
+    CHECK_EQ(num_grids, options.branch_and_bound_depth());
+    precomputation_grids_.reserve(num_grids);
+    const CellLimits limits = probability_grid.limits().cell_limits();
+    for (int i = 0; i != num_grids; ++i) {
+      const int width = 1 << i;
+      const int32 offset_x = reader.Read<int32>();
+      const int32 offset_y = reader.Read<int32>();
+      const int32 num_x_cells = reader.Read<int32>();
+      const int32 num_y_cells = reader.Read<int32>();
+      CHECK_EQ(offset_x, -width + 1);
+      CHECK_EQ(offset_y, -width + 1);
+      CHECK_EQ(num_x_cells, limits.num_x_cells + width - 1);
+      CHECK_EQ(num_y_cells, limits.num_y_cells + width - 1);
+      const int bits_per_cell = i == 0 ? 8 : GetCoarseBitsPerCell(options);
+      const uint8* const cells =
+          reinterpret_cast<const uint8*>(reader.ReadBytes(
+              PrecomputationGrid::ComputeNumCellBytes(
+                  num_x_cells * num_y_cells, bits_per_cell)));
+      precomputation_grids_.emplace_back(Eigen::Array2i(offset_x, offset_y),
+                                         CellLimits(num_x_cells, num_y_cells),
+                                         bits_per_cell, cells);
+    }
+    CHECK(reader.Done());
+  }
+
+  // Crops the grids of 'stack' to a probability grid with 'limits' whose cell
+  // (0, 0) is the cell 'shift' of the probability grid of 'stack'.
+  PrecomputationGridStack(const PrecomputationGridStack& stack,
+                          const Eigen::Array2i& shift,
+                          const CellLimits& limits) {
+    precomputation_grids_.reserve(stack.precomputation_grids_.size());
+    for (const PrecomputationGrid& precomputation_grid :
+         stack.precomputation_grids_) {
+      precomputation_grids_.emplace_back(precomputation_grid, shift, limits);
+    }
+  }
+
+  // Updates the grids to the 'cell_values' returned by
+  // PrecomputationGrid::ComputeCellValues() for the limits they were
+  // constructed for. Only the cells affected by changed values are
+  // recomputed.
+  void Update(const std::vector<uint8>& cell_values) {
+    CARTOGRAPHER_TRACE_SPAN("PrecomputationGridStack::Update");
+    CHECK(mapped_blob_file_ == nullptr);
+    std::vector<Eigen::Array2i> changed_xy_indices;
+    precomputation_grids_.front().UpdateCellValues(cell_values,
+                                                   &changed_xy_indices);
+    std::vector<Eigen::Array2i> changed_wider_xy_indices;
+    for (size_t i = 1; i < precomputation_grids_.size(); ++i) {
+      changed_wider_xy_indices.clear();
+      precomputation_grids_[i].UpdateFromNarrowerGrid(
+          precomputation_grids_[i - 1], changed_xy_indices,
+          &changed_wider_xy_indices);
+      changed_xy_indices.swap(changed_wider_xy_indices);
+    }
   }
 
   const PrecomputationGrid& Get(int index) {
@@ -192,7 +772,40 @@ class PrecomputationGridStack {
 
   int max_depth() const { return precomputation_grids_.size() - 1; }
 
+  int64 GetMemoryUsageInBytes() const {
+    int64 memory_usage_in_bytes = 0;
+    for (const PrecomputationGrid& precomputation_grid :
+         precomputation_grids_) {
+      memory_usage_in_bytes += precomputation_grid.GetMemoryUsageInBytes();
+    }
+    return memory_usage_in_bytes;
+  }
+
+  // Serializes the number of grids followed by the offset, limits and padded
+  // cells of each grid.
+  string Serialize() const {
+    string serialized;
+    io::AppendToBlob(static_cast<int32>(precomputation_grids_.size()),
+                     &serialized);
+    for (const PrecomputationGrid& precomputation_grid :
+         precomputation_grids_) {
+      const CellLimits& wide_limits = precomputation_grid.wide_limits();
+      io::AppendToBlob(int32{precomputation_grid.offset().x()}, &serialized);
+      io::AppendToBlob(int32{precomputation_grid.offset().y()}, &serialized);
+      io::AppendToBlob(int32{wide_limits.num_x_cells}, &serialized);
+      io::AppendToBlob(int32{wide_limits.num_y_cells}, &serialized);
+      serialized.append(
+          reinterpret_cast<const char*>(precomputation_grid.cells()),
+          PrecomputationGrid::ComputeNumCellBytes(
+              wide_limits.num_x_cells * wide_limits.num_y_cells,
+              precomputation_grid.bits_per_cell()));
+    }
+    return serialized;
+  }
+
  private:
+  // Keeps the cells of grids read from a file mapped.
+  const std::shared_ptr<const io::MappedBlobFile> mapped_blob_file_;
   std::vector<PrecomputationGrid> precomputation_grids_;
 };
 
@@ -204,8 +817,55 @@ FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
       precomputation_grid_stack_(
           new PrecomputationGridStack(probability_grid, options)) {}
 
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const ProbabilityGrid& probability_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    std::shared_ptr<const io::MappedBlobFile> mapped_blob_file,
+    const int blob_index)
+    : options_(options),
+      limits_(probability_grid.limits()),
+      precomputation_grid_stack_(new PrecomputationGridStack(
+          probability_grid, options, std::move(mapped_blob_file),
+          blob_index)) {}
+
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const ProbabilityGrid& probability_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    std::unique_ptr<FastCorrelativeScanMatcher> outdated_scan_matcher)
+    : options_(options), limits_(probability_grid.limits()) {
+  CHECK(outdated_scan_matcher != nullptr);
+  CHECK_EQ(outdated_scan_matcher->options_.branch_and_bound_depth(),
+           options_.branch_and_bound_depth());
+  Eigen::Array2i shift;
+  if (!ComputeShiftWithinLimits(outdated_scan_matcher->limits_, limits_,
+                                &shift)) {
+    precomputation_grid_stack_.reset(
+        new PrecomputationGridStack(probability_grid, options));
+    return;
+  }
+  // The grids are updated in the frame of the outdated probability grid, in
+  // which cells outside of the 'probability_grid' are unknown, and then
+  // cropped.
+  PrecomputationGridStack& outdated_stack =
+      *outdated_scan_matcher->precomputation_grid_stack_;
+  const CellLimits& outdated_limits =
+      outdated_scan_matcher->limits_.cell_limits();
+  outdated_stack.Update(PrecomputationGrid::ComputeCellValues(
+      probability_grid, -shift, outdated_limits));
+  precomputation_grid_stack_.reset(new PrecomputationGridStack(
+      outdated_stack, shift, limits_.cell_limits()));
+}
+
 FastCorrelativeScanMatcher::~FastCorrelativeScanMatcher() {}
 
+int64 FastCorrelativeScanMatcher::GetMemoryUsageInBytes() const {
+  return precomputation_grid_stack_->GetMemoryUsageInBytes();
+}
+
+string FastCorrelativeScanMatcher::SerializePrecomputationGrids() const {
+  return precomputation_grid_stack_->Serialize();
+}
+
 bool FastCorrelativeScanMatcher::Match(
     const transform::Rigid2d& initial_pose_estimate,
     const sensor::PointCloud& point_cloud, const float min_score, float* score,
@@ -213,54 +873,162 @@ bool FastCorrelativeScanMatcher::Match(
   const SearchParameters search_parameters(options_.linear_search_window(),
                                            options_.angular_search_window(),
                                            point_cloud, limits_.resolution());
-  return MatchWithSearchParameters(search_parameters, initial_pose_estimate,
-                                   point_cloud, min_score, score,
-                                   pose_estimate);
+  return MatchWithSearchParameters(
+      search_parameters, initial_pose_estimate, point_cloud,
+      nullptr /* rotated_scan_cache */, min_score, nullptr /* thread_pool */,
+      1 /* num_tasks */, nullptr /* deadline */, score, pose_estimate);
 }
 
 bool FastCorrelativeScanMatcher::MatchFullSubmap(
     const sensor::PointCloud& point_cloud, float min_score, float* score,
     transform::Rigid2d* pose_estimate) const {
+  return MatchFullSubmap(point_cloud, min_score, nullptr /* thread_pool */,
+                         1 /* num_tasks */, nullptr /* deadline */, score,
+                         pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher::MatchFullSubmap(
+    const sensor::PointCloud& point_cloud, const float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
+    common::Deadline* const deadline, float* score,
+    transform::Rigid2d* pose_estimate) const {
+  return MatchWithSearchParameters(
+      GetFullSubmapSearchParameters(point_cloud), GetFullSubmapCenter(),
+      point_cloud, nullptr /* rotated_scan_cache */, min_score, thread_pool,
+      num_tasks, deadline, score, pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher::Match(
+    const transform::Rigid2d& initial_pose_estimate,
+    RotatedScanCache* const rotated_scan_cache, const float min_score,
+    float* score, transform::Rigid2d* pose_estimate) const {
+  const sensor::PointCloud& point_cloud = rotated_scan_cache->point_cloud();
+  const SearchParameters search_parameters(options_.linear_search_window(),
+                                           options_.angular_search_window(),
+                                           point_cloud, limits_.resolution());
+  return MatchWithSearchParameters(
+      search_parameters, initial_pose_estimate, point_cloud, rotated_scan_cache,
+      min_score, nullptr /* thread_pool */, 1 /* num_tasks */,
+      nullptr /* deadline */, score, pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher::MatchFullSubmap(
+    RotatedScanCache* const rotated_scan_cache, const float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
+    common::Deadline* const deadline, float* score,
+    transform::Rigid2d* pose_estimate) const {
+  const sensor::PointCloud& point_cloud = rotated_scan_cache->point_cloud();
+  return MatchWithSearchParameters(
+      GetFullSubmapSearchParameters(point_cloud), GetFullSubmapCenter(),
+      point_cloud, rotated_scan_cache, min_score, thread_pool, num_tasks,
+      deadline, score, pose_estimate);
+}
+
+float FastCorrelativeScanMatcher::ComputeFullSubmapScoreBound(
+    const sensor::PointCloud& point_cloud) const {
+  SearchParameters search_parameters =
+      GetFullSubmapSearchParameters(point_cloud);
+  // The center used by MatchFullSubmap() has no rotation.
+  const transform::Rigid2d center = GetFullSubmapCenter();
+  Workspace& workspace = GetThreadLocalWorkspace();
+  GenerateRotatedScans(point_cloud, search_parameters,
+                       &workspace.rotated_scans);
+  DiscretizeScans(limits_, workspace.rotated_scans,
+                  Eigen::Translation2f(center.translation().x(),
+                                       center.translation().y()),
+                  &workspace.discrete_scans);
+  if (options_.sort_points_by_cell()) {
+    SortPointsByCell(&workspace.discrete_scans);
+  }
+  search_parameters.ShrinkToFit(workspace.discrete_scans,
+                                limits_.cell_limits());
+  std::vector<Candidate>& lowest_resolution_candidates =
+      workspace.lowest_resolution_candidates;
+  ComputeLowestResolutionCandidates(workspace.discrete_scans,
+                                    search_parameters,
+                                    &lowest_resolution_candidates);
+  if (lowest_resolution_candidates.empty()) {
+    return 0.f;
+  }
+  return lowest_resolution_candidates.front().score;
+}
+
+SearchParameters FastCorrelativeScanMatcher::GetFullSubmapSearchParameters(
+    const sensor::PointCloud& point_cloud) const {
   // Compute a search window around the center of the submap that includes it
   // fully.
-  const SearchParameters search_parameters(
+  return SearchParameters(
       1e6 * limits_.resolution(),  // Linear search window, 1e6 cells/direction.
       M_PI,  // Angular search window, 180 degrees in both directions.
       point_cloud, limits_.resolution());
-  const transform::Rigid2d center = transform::Rigid2d::Translation(
+}
+
+transform::Rigid2d FastCorrelativeScanMatcher::GetFullSubmapCenter() const {
+  return transform::Rigid2d::Translation(
       limits_.max() - 0.5 * limits_.resolution() *
                           Eigen::Vector2d(limits_.cell_limits().num_y_cells,
                                           limits_.cell_limits().num_x_cells));
-  return MatchWithSearchParameters(search_parameters, center, point_cloud,
-                                   min_score, score, pose_estimate);
 }
 
 bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
     SearchParameters search_parameters,
     const transform::Rigid2d& initial_pose_estimate,
-    const sensor::PointCloud& point_cloud, float min_score, float* score,
+    const sensor::PointCloud& point_cloud,
+    RotatedScanCache* const rotated_scan_cache, float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
+    common::Deadline* const deadline, float* score,
     transform::Rigid2d* pose_estimate) const {
+  CARTOGRAPHER_TRACE_SPAN("FastCorrelativeScanMatcher::Match");
   CHECK_NOTNULL(score);
   CHECK_NOTNULL(pose_estimate);
+  CHECK_GE(num_tasks, 1);
 
-  const Eigen::Rotation2Dd initial_rotation = initial_pose_estimate.rotation();
-  const sensor::PointCloud rotated_point_cloud = sensor::TransformPointCloud(
-      point_cloud,
-      transform::Rigid3f::Rotation(Eigen::AngleAxisf(
-          initial_rotation.cast<float>().angle(), Eigen::Vector3f::UnitZ())));
-  const std::vector<sensor::PointCloud> rotated_scans =
-      GenerateRotatedScans(rotated_point_cloud, search_parameters);
-  const std::vector<DiscreteScan> discrete_scans = DiscretizeScans(
-      limits_, rotated_scans,
-      Eigen::Translation2f(initial_pose_estimate.translation().x(),
-                           initial_pose_estimate.translation().y()));
+  Eigen::Rotation2Dd initial_rotation = initial_pose_estimate.rotation();
+  const Eigen::Translation2f initial_translation(
+      initial_pose_estimate.translation().x(),
+      initial_pose_estimate.translation().y());
+  Workspace& workspace = GetThreadLocalWorkspace();
+  std::vector<DiscreteScan>& discrete_scans = workspace.discrete_scans;
+  if (rotated_scan_cache != nullptr) {
+    CHECK_EQ(rotated_scan_cache->resolution(), limits_.resolution());
+    const int center_index =
+        rotated_scan_cache->GetClosestIndex(initial_rotation.angle());
+    initial_rotation = Eigen::Rotation2Dd(
+        center_index * rotated_scan_cache->angular_perturbation_step_size());
+    DiscretizeScans(
+        limits_,
+        rotated_scan_cache->GetRotatedScans(center_index, search_parameters),
+        initial_translation, &discrete_scans);
+  } else {
+    sensor::PointCloud& rotated_point_cloud = workspace.rotated_point_cloud;
+    rotated_point_cloud.assign(point_cloud.begin(), point_cloud.end());
+    sensor::TransformPointCloudInPlace(
+        transform::Rigid3f::Rotation(Eigen::AngleAxisf(
+            initial_rotation.cast<float>().angle(), Eigen::Vector3f::UnitZ())),
+        &rotated_point_cloud);
+    GenerateRotatedScans(rotated_point_cloud, search_parameters,
+                         &workspace.rotated_scans);
+    DiscretizeScans(limits_, workspace.rotated_scans, initial_translation,
+                    &discrete_scans);
+  }
+  if (options_.sort_points_by_cell()) {
+    SortPointsByCell(&discrete_scans);
+  }
   search_parameters.ShrinkToFit(discrete_scans, limits_.cell_limits());
 
-  const std::vector<Candidate> lowest_resolution_candidates =
-      ComputeLowestResolutionCandidates(discrete_scans, search_parameters);
-  const Candidate best_candidate = BranchAndBound(
-      discrete_scans, search_parameters, lowest_resolution_candidates,
-      precomputation_grid_stack_->max_depth(), min_score);
+  std::vector<Candidate>& lowest_resolution_candidates =
+      workspace.lowest_resolution_candidates;
+  ComputeLowestResolutionCandidates(discrete_scans, search_parameters,
+                                    &lowest_resolution_candidates);
+  const Candidate best_candidate =
+      thread_pool != nullptr && num_tasks > 1
+          ? ParallelBranchAndBound(discrete_scans, search_parameters,
+                                   lowest_resolution_candidates, min_score,
+                                   thread_pool, num_tasks, deadline)
+          : BranchAndBound(discrete_scans, search_parameters,
+                           lowest_resolution_candidates,
+                           precomputation_grid_stack_->max_depth(), min_score,
+                           nullptr /* shared_min_score */, deadline);
   if (best_candidate.score > min_score) {
     *score = best_candidate.score;
     *pose_estimate = transform::Rigid2d(
@@ -272,21 +1040,57 @@ bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
   return false;
 }
 
-std::vector<Candidate>
-FastCorrelativeScanMatcher::ComputeLowestResolutionCandidates(
+void FastCorrelativeScanMatcher::ComputeLowestResolutionCandidates(
     const std::vector<DiscreteScan>& discrete_scans,
-    const SearchParameters& search_parameters) const {
-  std::vector<Candidate> lowest_resolution_candidates =
-      GenerateLowestResolutionCandidates(search_parameters);
-  ScoreCandidates(
-      precomputation_grid_stack_->Get(precomputation_grid_stack_->max_depth()),
-      discrete_scans, search_parameters, &lowest_resolution_candidates);
-  return lowest_resolution_candidates;
-}
-
-std::vector<Candidate>
-FastCorrelativeScanMatcher::GenerateLowestResolutionCandidates(
-    const SearchParameters& search_parameters) const {
+    const SearchParameters& search_parameters,
+    std::vector<Candidate>* const lowest_resolution_candidates) const {
+  GenerateLowestResolutionCandidates(search_parameters,
+                                     lowest_resolution_candidates);
+  // The lowest resolution candidates of each scan form a lattice, so they are
+  // scored together. This is the bulk of the work for full submap matching.
+  const PrecomputationGrid& precomputation_grid =
+      precomputation_grid_stack_->Get(precomputation_grid_stack_->max_depth());
+  const int linear_step_size = 1 << precomputation_grid_stack_->max_depth();
+  std::vector<int>& sums = GetThreadLocalWorkspace().sums;
+  auto candidate = lowest_resolution_candidates->begin();
+  for (int scan_index = 0; scan_index != search_parameters.num_scans;
+       ++scan_index) {
+    const SearchParameters::LinearBounds& linear_bounds =
+        search_parameters.linear_bounds[scan_index];
+    const int num_x_offsets =
+        (linear_bounds.max_x - linear_bounds.min_x + linear_step_size) /
+        linear_step_size;
+    const int num_y_offsets =
+        (linear_bounds.max_y - linear_bounds.min_y + linear_step_size) /
+        linear_step_size;
+    sums.assign(num_x_offsets * num_y_offsets, 0);
+    precomputation_grid.AccumulateValuesOnLattice(
+        discrete_scans[scan_index],
+        Eigen::Array2i(linear_bounds.min_x, linear_bounds.min_y),
+        linear_step_size, num_x_offsets, num_y_offsets, sums.data());
+    const float num_points = discrete_scans[scan_index].size();
+    // Same order as in GenerateLowestResolutionCandidates().
+    for (int x = 0; x != num_x_offsets; ++x) {
+      for (int y = 0; y != num_y_offsets; ++y) {
+        DCHECK_EQ(candidate->scan_index, scan_index);
+        DCHECK_EQ(candidate->x_index_offset,
+                  linear_bounds.min_x + x * linear_step_size);
+        DCHECK_EQ(candidate->y_index_offset,
+                  linear_bounds.min_y + y * linear_step_size);
+        candidate->score = PrecomputationGrid::ToProbability(
+            sums[y * num_x_offsets + x] / num_points);
+        ++candidate;
+      }
+    }
+  }
+  CHECK(candidate == lowest_resolution_candidates->end());
+  std::sort(lowest_resolution_candidates->begin(),
+            lowest_resolution_candidates->end(), std::greater<Candidate>());
+}
+
+void FastCorrelativeScanMatcher::GenerateLowestResolutionCandidates(
+    const SearchParameters& search_parameters,
+    std::vector<Candidate>* const candidates) const {
   const int linear_step_size = 1 << precomputation_grid_stack_->max_depth();
   int num_candidates = 0;
   for (int scan_index = 0; scan_index != search_parameters.num_scans;
@@ -302,8 +1106,8 @@ FastCorrelativeScanMatcher::GenerateLowestResolutionCandidates(
     num_candidates += num_lowest_resolution_linear_x_candidates *
                       num_lowest_resolution_linear_y_candidates;
   }
-  std::vector<Candidate> candidates;
-  candidates.reserve(num_candidates);
+  candidates->clear();
+  candidates->reserve(num_candidates);
   for (int scan_index = 0; scan_index != search_parameters.num_scans;
        ++scan_index) {
     for (int x_index_offset = search_parameters.linear_bounds[scan_index].min_x;
@@ -313,13 +1117,12 @@ FastCorrelativeScanMatcher::GenerateLowestResolutionCandidates(
                search_parameters.linear_bounds[scan_index].min_y;
            y_index_offset <= search_parameters.linear_bounds[scan_index].max_y;
            y_index_offset += linear_step_size) {
-        candidates.emplace_back(scan_index, x_index_offset, y_index_offset,
-                                search_parameters);
+        candidates->emplace_back(scan_index, x_index_offset, y_index_offset,
+                                 search_parameters);
       }
     }
   }
-  CHECK_EQ(candidates.size(), num_candidates);
-  return candidates;
+  CHECK_EQ(candidates->size(), num_candidates);
 }
 
 void FastCorrelativeScanMatcher::ScoreCandidates(
@@ -327,17 +1130,22 @@ void FastCorrelativeScanMatcher::ScoreCandidates(
     const std::vector<DiscreteScan>& discrete_scans,
     const SearchParameters& search_parameters,
     std::vector<Candidate>* const candidates) const {
-  for (Candidate& candidate : *candidates) {
-    int sum = 0;
-    for (const Eigen::Array2i& xy_index :
-         discrete_scans[candidate.scan_index]) {
-      const Eigen::Array2i proposed_xy_index(
-          xy_index.x() + candidate.x_index_offset,
-          xy_index.y() + candidate.y_index_offset);
-      sum += precomputation_grid.GetValue(proposed_xy_index);
-    }
-    candidate.score = PrecomputationGrid::ToProbability(
-        sum / static_cast<float>(discrete_scans[candidate.scan_index].size()));
+  for (auto candidate = candidates->begin(); candidate != candidates->end();
+       ++candidate) {
+    const auto next_candidate = std::next(candidate);
+    if (next_candidate != candidates->end()) {
+      precomputation_grid.PrefetchValues(
+          discrete_scans[next_candidate->scan_index],
+          Eigen::Array2i(next_candidate->x_index_offset,
+                         next_candidate->y_index_offset),
+          kPrefetchDistance);
+    }
+    const int sum = precomputation_grid.SumValues(
+        discrete_scans[candidate->scan_index],
+        Eigen::Array2i(candidate->x_index_offset, candidate->y_index_offset));
+    candidate->score = PrecomputationGrid::ToProbability(
+        sum /
+        static_cast<float>(discrete_scans[candidate->scan_index].size()));
   }
   std::sort(candidates->begin(), candidates->end(), std::greater<Candidate>());
 }
@@ -346,7 +1154,8 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
     const std::vector<DiscreteScan>& discrete_scans,
     const SearchParameters& search_parameters,
     const std::vector<Candidate>& candidates, const int candidate_depth,
-    float min_score) const {
+    float min_score, const std::atomic<float>* const shared_min_score,
+    common::Deadline* const deadline) const {
   if (candidate_depth == 0) {
     // Return the best candidate.
     return *candidates.begin();
@@ -354,11 +1163,30 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
 
   Candidate best_high_resolution_candidate(0, 0, 0, search_parameters);
   best_high_resolution_candidate.score = min_score;
+  // Each depth has its own buffer, which is reused for the children of all
+  // candidates at this depth. Recursive calls have lower depths, so they do
+  // not resize the buffers and invalidate the reference.
+  std::vector<std::vector<Candidate>>& higher_resolution_candidates_by_depth =
+      GetThreadLocalWorkspace().higher_resolution_candidates;
+  if (static_cast<int>(higher_resolution_candidates_by_depth.size()) <
+      candidate_depth) {
+    higher_resolution_candidates_by_depth.resize(candidate_depth);
+  }
+  std::vector<Candidate>& higher_resolution_candidates =
+      higher_resolution_candidates_by_depth[candidate_depth - 1];
   for (const Candidate& candidate : candidates) {
+    // Candidates are searched best first, so stopping here keeps the best
+    // match found so far.
+    if (deadline != nullptr && deadline->CheckExpired()) {
+      break;
+    }
+    if (shared_min_score != nullptr) {
+      min_score = std::max(min_score, shared_min_score->load());
+    }
     if (candidate.score <= min_score) {
       break;
     }
-    std::vector<Candidate> higher_resolution_candidates;
+    higher_resolution_candidates.clear();
     const int half_width = 1 << (candidate_depth - 1);
     for (int x_offset : {0, half_width}) {
       if (candidate.x_index_offset + x_offset >
@@ -380,13 +1208,72 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
                     &higher_resolution_candidates);
     best_high_resolution_candidate = std::max(
         best_high_resolution_candidate,
-        BranchAndBound(discrete_scans, search_parameters,
-                       higher_resolution_candidates, candidate_depth - 1,
-                       best_high_resolution_candidate.score));
+        BranchAndBound(
+            discrete_scans, search_parameters, higher_resolution_candidates,
+            candidate_depth - 1,
+            std::max(best_high_resolution_candidate.score, min_score),
+            shared_min_score, deadline));
   }
   return best_high_resolution_candidate;
 }
 
+Candidate FastCorrelativeScanMatcher::ParallelBranchAndBound(
+    const std::vector<DiscreteScan>& discrete_scans,
+    const SearchParameters& search_parameters,
+    const std::vector<Candidate>& candidates, const float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
+    common::Deadline* const deadline) const {
+  Candidate initial_best_candidate(0, 0, 0, search_parameters);
+  initial_best_candidate.score = min_score;
+  const auto state = std::make_shared<ParallelSearchState>(
+      candidates.size(), initial_best_candidate);
+  // Candidates are claimed one at a time, and everything but 'state' is only
+  // accessed once a candidate has been claimed. The search does not finish
+  // before all claimed candidates have been searched, but it does not wait for
+  // the scheduled tasks to start: this may run on a worker of 'thread_pool'
+  // itself, and the tasks may not get another worker before it returns.
+  const std::function<void()> search = [this, state, &discrete_scans,
+                                        &search_parameters, &candidates,
+                                        deadline]() {
+    for (;;) {
+      const int index = state->next_candidate_index++;
+      if (index >= state->num_candidates) {
+        return;
+      }
+      const Candidate& candidate = candidates[index];
+      const float current_min_score = state->best_score.load();
+      Candidate best_candidate = candidate;
+      best_candidate.score = current_min_score;
+      // Candidates are sorted by score, so once this is false, the
+      // remaining candidates are only counted.
+      if (candidate.score > current_min_score) {
+        best_candidate = BranchAndBound(
+            discrete_scans, search_parameters, {candidate},
+            precomputation_grid_stack_->max_depth(), current_min_score,
+            &state->best_score, deadline);
+      }
+      common::MutexLocker locker(&state->mutex);
+      // Cut off branches return placeholders scoring at most 'best_score',
+      // which are rejected here.
+      if (best_candidate.score > state->best_candidate.score) {
+        state->best_candidate = best_candidate;
+        state->best_score = best_candidate.score;
+      }
+      ++state->num_candidates_searched;
+    }
+  };
+  for (int i = 1; i < num_tasks; ++i) {
+    thread_pool->Schedule(search, common::WorkItemPriority::kHigh,
+                          "parallel_branch_and_bound_2d");
+  }
+  search();
+  common::MutexLocker locker(&state->mutex);
+  locker.Await([&state]() REQUIRES(state->mutex) {
+    return state->num_candidates_searched == state->num_candidates;
+  });
+  return state->best_candidate;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_2d
 }  // namespace cartographer
@@ -25,11 +25,15 @@
 #ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/common/deadline.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/io/mapped_blob_file.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/mapping_2d/scan_matching/correlative_scan_matcher.h"
 #include "cartographer/mapping_2d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
@@ -48,9 +52,40 @@ CreateFastCorrelativeScanMatcherOptions(
 // y0 <= y < y0.
 class PrecomputationGrid {
  public:
+  // The 'reusable_intermediate_grid' is scratch space, which can be shared by
+  // grids constructed one after another to avoid reallocations.
   PrecomputationGrid(const ProbabilityGrid& probability_grid,
                      const CellLimits& limits, int width,
-                     std::vector<float>* reusable_intermediate_grid);
+                     std::vector<uint8>* reusable_intermediate_grid);
+
+  // Same as above, but from the 'cell_values' returned by ComputeCellValues()
+  // for the 'limits', so that several grids only convert probabilities once.
+  PrecomputationGrid(const std::vector<uint8>& cell_values,
+                     const CellLimits& limits, int width,
+                     std::vector<uint8>* reusable_intermediate_grid);
+
+  // Same as above with twice the width of the 'narrower_grid', which is
+  // cheaper: each cell is the maximum of 4 cells of the 'narrower_grid'.
+  PrecomputationGrid(const PrecomputationGrid& narrower_grid,
+                     std::vector<uint8>* reusable_intermediate_grid);
+
+  // Uses the precomputed 'cells', e.g. from a memory-mapped file, without
+  // copying them. The 'cells' have to be packed with 'bits_per_cell' and
+  // padded like 'cells()' and have to outlive this grid.
+  PrecomputationGrid(const Eigen::Array2i& offset,
+                     const CellLimits& wide_limits, int bits_per_cell,
+                     const uint8* cells);
+
+  // Same as constructing a grid of the same width as 'grid' for a probability
+  // grid with 'limits' whose cell (0, 0) is the cell 'shift' of the
+  // probability grid of 'grid'. All cells with nonzero values have to be
+  // within both probability grids.
+  PrecomputationGrid(const PrecomputationGrid& grid,
+                     const Eigen::Array2i& shift, const CellLimits& limits);
+
+  PrecomputationGrid(const PrecomputationGrid&) = delete;
+  PrecomputationGrid& operator=(const PrecomputationGrid&) = delete;
+  PrecomputationGrid(PrecomputationGrid&&) = default;
 
   // Returns a value between 0 and 255 to represent probabilities between
   // kMinProbability and kMaxProbability.
@@ -68,9 +103,69 @@ class PrecomputationGrid {
       return 0;
     }
     const int stride = wide_limits_.num_x_cells;
-    return cells_[local_xy_index.x() + local_xy_index.y() * stride];
+    return GetCell(local_xy_index.x() + local_xy_index.y() * stride);
   }
 
+  // Returns the sum of GetValue() over all 'xy_indices' shifted by
+  // 'xy_offset'. Uses SIMD instructions if the CPU supports them.
+  int SumValues(const std::vector<Eigen::Array2i>& xy_indices,
+                const Eigen::Array2i& xy_offset) const;
+
+  // Prefetches the cells of the first 'num_indices' of 'xy_indices' shifted by
+  // 'xy_offset', so that a following SumValues() for them does not start by
+  // waiting for memory.
+  void PrefetchValues(const std::vector<Eigen::Array2i>& xy_indices,
+                      const Eigen::Array2i& xy_offset, int num_indices) const;
+
+  // Adds SumValues() for each offset of a lattice of 'num_x_offsets' x
+  // 'num_y_offsets' offsets starting at 'min_offset' and spaced 'step' cells
+  // apart to 'sums', which is indexed by y * 'num_x_offsets' + x. All offsets
+  // are handled together point by point, so that the cells within the grid
+  // are found once per row instead of checked once per offset.
+  void AccumulateValuesOnLattice(const std::vector<Eigen::Array2i>& xy_indices,
+                                 const Eigen::Array2i& min_offset, int step,
+                                 int num_x_offsets, int num_y_offsets,
+                                 int* sums) const;
+
+  // Sets the cells of a grid of width 1 to the 'cell_values' returned by
+  // ComputeCellValues() for its limits. The indices of the cells which changed
+  // are appended to 'changed_xy_indices'.
+  void UpdateCellValues(const std::vector<uint8>& cell_values,
+                        std::vector<Eigen::Array2i>* changed_xy_indices);
+
+  // Updates a grid constructed from the 'narrower_grid' after the cells at
+  // 'changed_narrower_xy_indices' of the 'narrower_grid' changed. The indices
+  // of the cells which changed in turn are appended to 'changed_xy_indices'.
+  // Indices are relative to the 'offset()' of their grid.
+  void UpdateFromNarrowerGrid(
+      const PrecomputationGrid& narrower_grid,
+      const std::vector<Eigen::Array2i>& changed_narrower_xy_indices,
+      std::vector<Eigen::Array2i>* changed_xy_indices);
+
+  // Packs the cells with 'bits_per_cell', which has to be 8, 4 or 2, so that
+  // 1, 2 or 4 cells share a byte. Values are rounded up to the next multiple
+  // of 255 / (2^'bits_per_cell' - 1), so that the scores of candidates are
+  // still upper bounds and the branch-and-bound search stays optimal, but
+  // fewer candidates are pruned. The grid must own its cells and not be
+  // packed already. Packed grids cannot be used to construct wider grids.
+  void Pack(int bits_per_cell);
+
+  // Returns the number of bytes allocated for the cells, which is 0 for
+  // grids using cells which are not owned.
+  int64 GetMemoryUsageInBytes() const { return owned_cells_.size(); }
+
+  const Eigen::Array2i& offset() const { return offset_; }
+  const CellLimits& wide_limits() const { return wide_limits_; }
+  int bits_per_cell() const { return bits_per_cell_; }
+
+  // Returns the cells in row-major order, packed with 'bits_per_cell()' and
+  // starting at the lowest bits of each byte, followed by the padding.
+  const uint8* cells() const { return cells_; }
+
+  // Returns the number of bytes of 'cells()' for 'num_cells' cells including
+  // the padding.
+  static int ComputeNumCellBytes(int num_cells, int bits_per_cell);
+
   // Maps values from [0, 255] to [kMinProbability, kMaxProbability].
   static float ToProbability(float value) {
     return mapping::kMinProbability +
@@ -78,8 +173,56 @@ class PrecomputationGrid {
                ((mapping::kMaxProbability - mapping::kMinProbability) / 255.f);
   }
 
+  // Returns the probabilities of the cells of 'probability_grid' within
+  // 'limits' mapped to [0, 255], in row-major order.
+  static std::vector<uint8> ComputeCellValues(
+      const ProbabilityGrid& probability_grid, const CellLimits& limits);
+
+  // Same as above, but for the cells within 'limits' starting at cell
+  // 'offset', which may be outside of the 'probability_grid'.
+  static std::vector<uint8> ComputeCellValues(
+      const ProbabilityGrid& probability_grid, const Eigen::Array2i& offset,
+      const CellLimits& limits);
+
  private:
-  uint8 ComputeCellValue(float probability) const;
+  // Returns the value of the cell at 'index' into the unpacked row-major
+  // cells.
+  uint8 GetCell(const int index) const {
+    if (bits_per_cell_ == 8) {
+      return cells_[index];
+    }
+    const int shift = (index & cells_per_byte_mask_) * bits_per_cell_;
+    return ((cells_[index >> cells_per_byte_log2_] >> shift) & value_mask_) *
+           value_scale_;
+  }
+
+  // Prefetches the byte of the cell at 'local_xy_index', which is relative to
+  // 'offset_', if the cell is within the grid.
+  void PrefetchCell(const Eigen::Array2i& local_xy_index) const {
+    if (static_cast<unsigned>(local_xy_index.x()) <
+            static_cast<unsigned>(wide_limits_.num_x_cells) &&
+        static_cast<unsigned>(local_xy_index.y()) <
+            static_cast<unsigned>(wide_limits_.num_y_cells)) {
+      const int index =
+          local_xy_index.x() + local_xy_index.y() * wide_limits_.num_x_cells;
+      __builtin_prefetch(cells_ + (index >> cells_per_byte_log2_));
+    }
+  }
+
+  // Sets the cell at 'index' to 'value' rounded up as described for Pack().
+  void SetCell(int index, uint8 value);
+
+  // Sets the members describing how cells are packed.
+  void SetBitsPerCell(int bits_per_cell);
+
+  static uint8 ComputeCellValue(float probability);
+
+  int SumValuesScalar(const std::vector<Eigen::Array2i>& xy_indices,
+                      const Eigen::Array2i& xy_offset) const;
+#ifdef __x86_64__
+  int SumValuesAvx2(const std::vector<Eigen::Array2i>& xy_indices,
+                    const Eigen::Array2i& xy_offset) const;
+#endif
 
   // Offset of the precomputation grid in relation to the 'probability_grid'
   // including the additional 'width' - 1 cells.
@@ -88,8 +231,20 @@ class PrecomputationGrid {
   // Size of the precomputation grid.
   const CellLimits wide_limits_;
 
-  // Probabilites mapped to 0 to 255.
-  std::vector<uint8> cells_;
+  // Probabilites mapped to 0 to 255. Padded, so that the last cell can be read
+  // as part of a 32-bit word. Empty if the cells are not owned.
+  std::vector<uint8> owned_cells_;
+
+  // Points to the 'owned_cells_' or to cells not owned by this grid.
+  const uint8* cells_;
+
+  // How cells are packed into bytes, see Pack(). For 8 bits per cell, the
+  // value of each cell is its byte.
+  int bits_per_cell_ = 8;
+  int cells_per_byte_log2_ = 0;
+  int cells_per_byte_mask_ = 0;
+  int value_mask_ = 0xff;
+  int value_scale_ = 1;
 };
 
 class PrecomputationGridStack;
@@ -100,6 +255,29 @@ class FastCorrelativeScanMatcher {
   FastCorrelativeScanMatcher(
       const ProbabilityGrid& probability_grid,
       const proto::FastCorrelativeScanMatcherOptions& options);
+
+  // Same as above, but the precomputed grids are read from the blob at
+  // 'blob_index' of the 'mapped_blob_file', which has to be the result of
+  // 'SerializePrecomputationGrids()' with the same 'probability_grid' and
+  // 'options'. The grids are used in place, and the 'mapped_blob_file' is kept
+  // alive as long as this scan matcher.
+  FastCorrelativeScanMatcher(
+      const ProbabilityGrid& probability_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      std::shared_ptr<const io::MappedBlobFile> mapped_blob_file,
+      int blob_index);
+
+  // Same as the first constructor, but the precomputed grids are updated from
+  // those of the 'outdated_scan_matcher', which was constructed with the same
+  // 'options' for an earlier version of the 'probability_grid', e.g. before
+  // its submap was finished. Only the cells which changed since are
+  // recomputed. If the 'probability_grid' is not within the limits of the
+  // earlier version, the grids are computed from scratch.
+  FastCorrelativeScanMatcher(
+      const ProbabilityGrid& probability_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      std::unique_ptr<FastCorrelativeScanMatcher> outdated_scan_matcher);
+
   ~FastCorrelativeScanMatcher();
 
   FastCorrelativeScanMatcher(const FastCorrelativeScanMatcher&) = delete;
@@ -121,28 +299,96 @@ class FastCorrelativeScanMatcher {
   bool MatchFullSubmap(const sensor::PointCloud& point_cloud, float min_score,
                        float* score, transform::Rigid2d* pose_estimate) const;
 
+  // Same as above, but the subtrees of the lowest resolution candidates are
+  // searched by 'num_tasks' tasks, 'num_tasks' - 1 of which are scheduled on
+  // the 'thread_pool'. The calling thread takes part in the search, so this
+  // may be called from a work item of the same 'thread_pool'.
+  //
+  // If 'deadline' is not nullptr, no more candidates are expanded once it
+  // expired, and the best match found until then is returned. In this case,
+  // 'deadline->expired()' is true and the result may not be optimal.
+  bool MatchFullSubmap(const sensor::PointCloud& point_cloud, float min_score,
+                       common::ThreadPoolInterface* thread_pool, int num_tasks,
+                       common::Deadline* deadline, float* score,
+                       transform::Rigid2d* pose_estimate) const;
+
+  // Same as Match() and MatchFullSubmap() above for the point cloud of the
+  // 'rotated_scan_cache', which has to be for the resolution of this scan
+  // matcher. Its rotations are shared with other scan matchers using the same
+  // cache. The searched orientations are centered on the multiple of the
+  // angular step size closest to the initial orientation instead of the
+  // initial orientation itself.
+  bool Match(const transform::Rigid2d& initial_pose_estimate,
+             RotatedScanCache* rotated_scan_cache, float min_score,
+             float* score, transform::Rigid2d* pose_estimate) const;
+  bool MatchFullSubmap(RotatedScanCache* rotated_scan_cache, float min_score,
+                       common::ThreadPoolInterface* thread_pool, int num_tasks,
+                       common::Deadline* deadline, float* score,
+                       transform::Rigid2d* pose_estimate) const;
+
+  // Returns the score of the best lowest resolution candidate of
+  // MatchFullSubmap() for 'point_cloud'. This is an upper bound for the score
+  // MatchFullSubmap() can find, but it is computed without branch-and-bound.
+  float ComputeFullSubmapScoreBound(
+      const sensor::PointCloud& point_cloud) const;
+
+  // Returns the number of bytes used by the precomputed grids.
+  int64 GetMemoryUsageInBytes() const;
+
+  // Returns the precomputed grids as a blob to be written to a
+  // 'io::MappedBlobFileWriter'.
+  string SerializePrecomputationGrids() const;
+
  private:
   // The actual implementation of the scan matcher, called by Match() and
   // MatchFullSubmap() with appropriate 'initial_pose_estimate' and
-  // 'search_parameters'.
+  // 'search_parameters'. The rotations are taken from the
+  // 'rotated_scan_cache' if it is not nullptr. The search is parallelized if a
+  // 'thread_pool' is given and 'num_tasks' is greater than 1, and bounded by
+  // the 'deadline' if it is not nullptr.
   bool MatchWithSearchParameters(
       SearchParameters search_parameters,
       const transform::Rigid2d& initial_pose_estimate,
-      const sensor::PointCloud& point_cloud, float min_score, float* score,
+      const sensor::PointCloud& point_cloud,
+      RotatedScanCache* rotated_scan_cache, float min_score,
+      common::ThreadPoolInterface* thread_pool, int num_tasks,
+      common::Deadline* deadline, float* score,
       transform::Rigid2d* pose_estimate) const;
-  std::vector<Candidate> ComputeLowestResolutionCandidates(
+  // Returns the search parameters of MatchFullSubmap() for 'point_cloud'.
+  SearchParameters GetFullSubmapSearchParameters(
+      const sensor::PointCloud& point_cloud) const;
+  // Returns the initial pose of MatchFullSubmap(), the center of the grid.
+  transform::Rigid2d GetFullSubmapCenter() const;
+  // Replaces the contents of 'lowest_resolution_candidates' by the scored
+  // candidates of the lowest resolution, sorted by decreasing score.
+  void ComputeLowestResolutionCandidates(
       const std::vector<DiscreteScan>& discrete_scans,
-      const SearchParameters& search_parameters) const;
-  std::vector<Candidate> GenerateLowestResolutionCandidates(
-      const SearchParameters& search_parameters) const;
+      const SearchParameters& search_parameters,
+      std::vector<Candidate>* lowest_resolution_candidates) const;
+  void GenerateLowestResolutionCandidates(
+      const SearchParameters& search_parameters,
+      std::vector<Candidate>* candidates) const;
   void ScoreCandidates(const PrecomputationGrid& precomputation_grid,
                        const std::vector<DiscreteScan>& discrete_scans,
                        const SearchParameters& search_parameters,
                        std::vector<Candidate>* const candidates) const;
+  // If 'shared_min_score' is not nullptr, branches scoring not above it are
+  // cut off as well. It is raised concurrently by other searches. If the
+  // 'deadline' is not nullptr and expired, the remaining branches are cut off.
   Candidate BranchAndBound(const std::vector<DiscreteScan>& discrete_scans,
                            const SearchParameters& search_parameters,
                            const std::vector<Candidate>& candidates,
-                           int candidate_depth, float min_score) const;
+                           int candidate_depth, float min_score,
+                           const std::atomic<float>* shared_min_score,
+                           common::Deadline* deadline) const;
+  // Runs BranchAndBound() on the subtree of each of the 'candidates' in
+  // 'num_tasks' tasks, which share the best score found so far.
+  Candidate ParallelBranchAndBound(
+      const std::vector<DiscreteScan>& discrete_scans,
+      const SearchParameters& search_parameters,
+      const std::vector<Candidate>& candidates, float min_score,
+      common::ThreadPoolInterface* thread_pool, int num_tasks,
+      common::Deadline* deadline) const;
 
   const proto::FastCorrelativeScanMatcherOptions options_;
   MapLimits limits_;
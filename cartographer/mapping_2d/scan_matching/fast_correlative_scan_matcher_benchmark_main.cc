@@ -0,0 +1,264 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures Match() and MatchFullSubmap() of the 2D FastCorrelativeScanMatcher
+// on a synthetic submap, as used for loop closure. On Linux, the hardware cache
+// misses during matching are counted as well if perf events are available,
+// e.g. to compare --sort_points_by_cell against the default.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/proto/range_data_inserter_options.pb.h"
+#include "cartographer/mapping_2d/range_data_inserter.h"
+#include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/sensor/range_data.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_scans, 50, "Number of range data inserted into the submap.");
+DEFINE_int32(num_beams, 720, "Number of beams per range data.");
+DEFINE_int32(num_matches, 20, "Number of point clouds to match.");
+DEFINE_int32(branch_and_bound_depth, 7,
+             "Number of precomputation grids of the scan matcher.");
+DEFINE_double(linear_search_window, 7., "Linear search window of Match().");
+DEFINE_double(angular_search_window, M_PI / 6.,
+              "Angular search window of Match().");
+DEFINE_bool(sort_points_by_cell, false,
+            "Sort the points of discretized scans in the order of the cells.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+constexpr float kMaxRange = 30.f;
+
+// Counts the hardware cache misses of this thread between Start() and Stop().
+// Counting is not available on all systems, e.g. if perf events are
+// restricted by kernel.perf_event_paranoid.
+class CacheMissCounter {
+ public:
+  CacheMissCounter() {
+#ifdef __linux__
+    perf_event_attr attributes = {};
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    file_descriptor_ = syscall(__NR_perf_event_open, &attributes,
+                               0 /* this thread */, -1 /* any CPU */,
+                               -1 /* no group */, 0 /* flags */);
+#endif
+  }
+
+  ~CacheMissCounter() {
+#ifdef __linux__
+    if (available()) {
+      close(file_descriptor_);
+    }
+#endif
+  }
+
+  CacheMissCounter(const CacheMissCounter&) = delete;
+  CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+  bool available() const { return file_descriptor_ >= 0; }
+
+  void Start() {
+#ifdef __linux__
+    if (available()) {
+      ioctl(file_descriptor_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(file_descriptor_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  // Returns the number of cache misses since Start(), or -1 if counting is not
+  // available.
+  int64 Stop() {
+    int64 count = -1;
+#ifdef __linux__
+    if (available()) {
+      ioctl(file_descriptor_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(file_descriptor_, &count, sizeof(count)) != sizeof(count)) {
+        count = -1;
+      }
+    }
+#endif
+    return count;
+  }
+
+ private:
+  int file_descriptor_ = -1;
+};
+
+// Returns the points a lidar at 'pose' sees in a 20 m x 12 m room with a
+// pillar off its center, which makes the room asymmetric. Noise is drawn from
+// 'rng', so that the same seed always yields the same point clouds.
+sensor::PointCloud GeneratePointCloud(const transform::Rigid2f& pose,
+                                      const int num_beams, std::mt19937* rng) {
+  std::uniform_real_distribution<float> noise_distribution(-0.02f, 0.02f);
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != num_beams; ++i) {
+    const float angle = 2.f * M_PI * i / num_beams;
+    const Eigen::Vector2f direction =
+        pose.rotation() * Eigen::Vector2f(std::cos(angle), std::sin(angle));
+    const Eigen::Vector2f origin = pose.translation();
+    float range = std::min(
+        ((direction.x() > 0.f ? 10.f : -10.f) - origin.x()) /
+            (std::abs(direction.x()) < 1e-6f ? 1e-6f : direction.x()),
+        ((direction.y() > 0.f ? 6.f : -6.f) - origin.y()) /
+            (std::abs(direction.y()) < 1e-6f ? 1e-6f : direction.y()));
+    // The pillar is a circle with radius 0.5 m at (3, 2).
+    const Eigen::Vector2f to_origin = origin - Eigen::Vector2f(3.f, 2.f);
+    const float b = to_origin.dot(direction);
+    const float c = to_origin.squaredNorm() - 0.25f;
+    if (c > 0.f && b < 0.f && b * b > c) {
+      range = std::min(range, -b - std::sqrt(b * b - c));
+    }
+    range += noise_distribution(*rng);
+    if (range < kMaxRange) {
+      // Points are in the frame of the lidar.
+      point_cloud.emplace_back(range * std::cos(angle),
+                               range * std::sin(angle), 0.f);
+    }
+  }
+  return point_cloud;
+}
+
+void Run() {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> x_distribution(-8.f, 8.f);
+  std::uniform_real_distribution<float> y_distribution(-4.f, 4.f);
+  std::uniform_real_distribution<float> angle_distribution(-M_PI, M_PI);
+  const auto random_pose = [&]() {
+    return transform::Rigid2f({x_distribution(rng), y_distribution(rng)},
+                              angle_distribution(rng));
+  };
+
+  mapping_2d::proto::RangeDataInserterOptions range_data_inserter_options;
+  range_data_inserter_options.set_hit_probability(0.55);
+  range_data_inserter_options.set_miss_probability(0.49);
+  range_data_inserter_options.set_insert_free_space(true);
+  const RangeDataInserter range_data_inserter(range_data_inserter_options);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(12., 12.), CellLimits(480, 480)));
+  for (int i = 0; i != FLAGS_num_scans; ++i) {
+    const transform::Rigid3f pose = transform::Embed3D(random_pose());
+    range_data_inserter.Insert(
+        sensor::RangeData{pose.translation(),
+                          sensor::TransformPointCloud(
+                              GeneratePointCloud(transform::Project2D(pose),
+                                                 FLAGS_num_beams, &rng),
+                              pose),
+                          {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+  }
+
+  proto::FastCorrelativeScanMatcherOptions options;
+  options.set_linear_search_window(FLAGS_linear_search_window);
+  options.set_angular_search_window(FLAGS_angular_search_window);
+  options.set_branch_and_bound_depth(FLAGS_branch_and_bound_depth);
+  options.set_sort_points_by_cell(FLAGS_sort_points_by_cell);
+  const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+      probability_grid, options);
+
+  std::vector<transform::Rigid2d> poses;
+  std::vector<sensor::PointCloud> point_clouds;
+  for (int i = 0; i != FLAGS_num_matches; ++i) {
+    const transform::Rigid2f pose = random_pose();
+    poses.push_back(pose.cast<double>());
+    point_clouds.push_back(GeneratePointCloud(pose, FLAGS_num_beams, &rng));
+  }
+
+  constexpr float kMinScore = 0.5f;
+  CacheMissCounter cache_miss_counter;
+  if (!cache_miss_counter.available()) {
+    LOG(WARNING) << "Cache misses cannot be counted on this system.";
+  }
+  for (const bool full_submap : {false, true}) {
+    int num_successes = 0;
+    cache_miss_counter.Start();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i != FLAGS_num_matches; ++i) {
+      float score;
+      transform::Rigid2d pose_estimate;
+      // Match() starts 1 m and 0.1 rad away from the true pose.
+      const bool success =
+          full_submap
+              ? fast_correlative_scan_matcher.MatchFullSubmap(
+                    point_clouds[i], kMinScore, &score, &pose_estimate)
+              : fast_correlative_scan_matcher.Match(
+                    poses[i] * transform::Rigid2d({1., 0.}, 0.1),
+                    point_clouds[i], kMinScore, &score, &pose_estimate);
+      if (success && (pose_estimate.translation() - poses[i].translation())
+                             .norm() < 0.1) {
+        ++num_successes;
+      }
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    const int64 num_cache_misses = cache_miss_counter.Stop();
+    LOG(INFO) << (full_submap ? "MatchFullSubmap()" : "Match()") << ": "
+              << 1e3 * seconds / FLAGS_num_matches << " ms per match, "
+              << num_successes << " of " << FLAGS_num_matches
+              << " matches found the true pose.";
+    if (num_cache_misses >= 0) {
+      LOG(INFO) << "  " << num_cache_misses / FLAGS_num_matches
+                << " cache misses per match.";
+    }
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks matching point clouds with the 2D fast correlative scan "
+      "matcher.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::scan_matching::Run();
+  return EXIT_SUCCESS;
+}
@@ -16,15 +16,26 @@
 
 #include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <limits>
+#include <memory>
 #include <random>
 #include <string>
 
+#include "cartographer/common/deadline.h"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/io/mapped_blob_file.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/mapping_2d/range_data_inserter.h"
+#include "cartographer/mapping_2d/submaps.h"
 #include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
 #include "gtest/gtest.h"
@@ -47,7 +58,7 @@ TEST(PrecomputationGridTest, CorrectValues) {
         xy_index, PrecomputationGrid::ToProbability(distribution(prng)));
   }
 
-  std::vector<float> reusable_intermediate_grid;
+  std::vector<uint8> reusable_intermediate_grid;
   for (const int width : {1, 2, 3, 8}) {
     PrecomputationGrid precomputation_grid(
         probability_grid, probability_grid.limits().cell_limits(), width,
@@ -81,7 +92,7 @@ TEST(PrecomputationGridTest, TinyProbabilityGrid) {
         xy_index, PrecomputationGrid::ToProbability(distribution(prng)));
   }
 
-  std::vector<float> reusable_intermediate_grid;
+  std::vector<uint8> reusable_intermediate_grid;
   for (const int width : {1, 2, 3, 8, 200}) {
     PrecomputationGrid precomputation_grid(
         probability_grid, probability_grid.limits().cell_limits(), width,
@@ -104,18 +115,63 @@ TEST(PrecomputationGridTest, TinyProbabilityGrid) {
   }
 }
 
+TEST(PrecomputationGridTest, DoublingWidthMatchesDirectComputation) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (const CellLimits& limits : {CellLimits(1, 1), CellLimits(37, 23)}) {
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), limits));
+    for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(limits)) {
+      probability_grid.SetProbability(
+          xy_index, PrecomputationGrid::ToProbability(distribution(prng)));
+    }
+    std::vector<uint8> reusable_intermediate_grid;
+    std::vector<PrecomputationGrid> doubled_grids;
+    doubled_grids.reserve(8);
+    doubled_grids.emplace_back(probability_grid, limits, 1,
+                               &reusable_intermediate_grid);
+    for (int width = 2; width <= 64; width *= 2) {
+      doubled_grids.emplace_back(doubled_grids.back(),
+                                 &reusable_intermediate_grid);
+      const PrecomputationGrid& doubled_grid = doubled_grids.back();
+      const PrecomputationGrid direct_grid(probability_grid, limits, width,
+                                           &reusable_intermediate_grid);
+      EXPECT_EQ(direct_grid.offset().x(), doubled_grid.offset().x());
+      EXPECT_EQ(direct_grid.offset().y(), doubled_grid.offset().y());
+      const CellLimits& wide_limits = direct_grid.wide_limits();
+      ASSERT_EQ(wide_limits.num_x_cells,
+                doubled_grid.wide_limits().num_x_cells);
+      ASSERT_EQ(wide_limits.num_y_cells,
+                doubled_grid.wide_limits().num_y_cells);
+      for (int i = 0; i != wide_limits.num_x_cells * wide_limits.num_y_cells;
+           ++i) {
+        EXPECT_EQ(direct_grid.cells()[i], doubled_grid.cells()[i]);
+      }
+    }
+  }
+}
+
 proto::FastCorrelativeScanMatcherOptions
-CreateFastCorrelativeScanMatcherTestOptions(const int branch_and_bound_depth) {
-  auto parameter_dictionary =
-      common::MakeDictionary(R"text(
+CreateFastCorrelativeScanMatcherTestOptions(const int branch_and_bound_depth,
+                                            const int coarse_bits_per_cell) {
+  auto parameter_dictionary = common::MakeDictionary(
+      R"text(
       return {
          linear_search_window = 3.,
          angular_search_window = 1.,
          branch_and_bound_depth = )text" +
-                             std::to_string(branch_and_bound_depth) + "}");
+      std::to_string(branch_and_bound_depth) +
+      ", coarse_bits_per_cell = " + std::to_string(coarse_bits_per_cell) +
+      ", sort_points_by_cell = false}");
   return CreateFastCorrelativeScanMatcherOptions(parameter_dictionary.get());
 }
 
+proto::FastCorrelativeScanMatcherOptions
+CreateFastCorrelativeScanMatcherTestOptions(const int branch_and_bound_depth) {
+  return CreateFastCorrelativeScanMatcherTestOptions(branch_and_bound_depth,
+                                                     8);
+}
+
 mapping_2d::proto::RangeDataInserterOptions
 CreateRangeDataInserterTestOptions() {
   auto parameter_dictionary = common::MakeDictionary(R"text(
@@ -127,6 +183,136 @@ CreateRangeDataInserterTestOptions() {
   return mapping_2d::CreateRangeDataInserterOptions(parameter_dictionary.get());
 }
 
+TEST(PrecomputationGridTest, SumValuesMatchesGetValue) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> value_distribution(0, 255);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(100, 100)));
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(probability_grid.limits().cell_limits())) {
+    probability_grid.SetProbability(
+        xy_index, PrecomputationGrid::ToProbability(value_distribution(prng)));
+  }
+  std::vector<uint8> reusable_intermediate_grid;
+  PrecomputationGrid precomputation_grid(
+      probability_grid, probability_grid.limits().cell_limits(), 4,
+      &reusable_intermediate_grid);
+  // Includes indices outside of the grid, and a number of indices which is
+  // not a multiple of the SIMD width.
+  std::uniform_int_distribution<int> index_distribution(-20, 120);
+  std::vector<Eigen::Array2i> xy_indices;
+  for (int i = 0; i != 1003; ++i) {
+    xy_indices.emplace_back(index_distribution(prng),
+                            index_distribution(prng));
+  }
+  for (const Eigen::Array2i& xy_offset :
+       {Eigen::Array2i(0, 0), Eigen::Array2i(-7, 3), Eigen::Array2i(50, -50)}) {
+    int expected_sum = 0;
+    for (const Eigen::Array2i& xy_index : xy_indices) {
+      expected_sum += precomputation_grid.GetValue(xy_index + xy_offset);
+    }
+    EXPECT_EQ(expected_sum,
+              precomputation_grid.SumValues(xy_indices, xy_offset));
+  }
+}
+
+TEST(PrecomputationGridTest, AccumulateValuesOnLatticeMatchesSumValues) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> value_distribution(0, 255);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(100, 100)));
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(probability_grid.limits().cell_limits())) {
+    probability_grid.SetProbability(
+        xy_index, PrecomputationGrid::ToProbability(value_distribution(prng)));
+  }
+  std::vector<uint8> reusable_intermediate_grid;
+  PrecomputationGrid precomputation_grid(
+      probability_grid, probability_grid.limits().cell_limits(), 8,
+      &reusable_intermediate_grid);
+  std::uniform_int_distribution<int> index_distribution(-20, 120);
+  std::vector<Eigen::Array2i> xy_indices;
+  for (int i = 0; i != 101; ++i) {
+    xy_indices.emplace_back(index_distribution(prng),
+                            index_distribution(prng));
+  }
+  // The lattice reaches beyond the grid on all sides.
+  const Eigen::Array2i min_offset(-130, -125);
+  constexpr int kStep = 8;
+  constexpr int kNumXOffsets = 33;
+  constexpr int kNumYOffsets = 31;
+  std::vector<int> sums(kNumXOffsets * kNumYOffsets, 0);
+  precomputation_grid.AccumulateValuesOnLattice(
+      xy_indices, min_offset, kStep, kNumXOffsets, kNumYOffsets, sums.data());
+  for (int y = 0; y != kNumYOffsets; ++y) {
+    for (int x = 0; x != kNumXOffsets; ++x) {
+      EXPECT_EQ(precomputation_grid.SumValues(
+                    xy_indices, min_offset + kStep * Eigen::Array2i(x, y)),
+                sums[y * kNumXOffsets + x]);
+    }
+  }
+}
+
+TEST(PrecomputationGridTest, PackedValuesAreUpperBounds) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> value_distribution(0, 255);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(37, 23)));
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(probability_grid.limits().cell_limits())) {
+    probability_grid.SetProbability(
+        xy_index, PrecomputationGrid::ToProbability(value_distribution(prng)));
+  }
+  const CellLimits& limits = probability_grid.limits().cell_limits();
+  std::vector<uint8> reusable_intermediate_grid;
+  const PrecomputationGrid unpacked_grid(probability_grid, limits, 4,
+                                         &reusable_intermediate_grid);
+  std::uniform_int_distribution<int> index_distribution(-10, 50);
+  std::vector<Eigen::Array2i> xy_indices;
+  for (int i = 0; i != 101; ++i) {
+    xy_indices.emplace_back(index_distribution(prng),
+                            index_distribution(prng));
+  }
+  for (const int bits_per_cell : {4, 2}) {
+    PrecomputationGrid packed_grid(probability_grid, limits, 4,
+                                   &reusable_intermediate_grid);
+    packed_grid.Pack(bits_per_cell);
+    EXPECT_EQ(bits_per_cell, packed_grid.bits_per_cell());
+    EXPECT_LT(packed_grid.GetMemoryUsageInBytes(),
+              unpacked_grid.GetMemoryUsageInBytes() * bits_per_cell / 8 + 8);
+    const int value_scale = 255 / ((1 << bits_per_cell) - 1);
+    for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(
+             Eigen::Array2i(-5, -5), Eigen::Array2i(40, 30))) {
+      const int unpacked_value = unpacked_grid.GetValue(xy_index);
+      const int packed_value = packed_grid.GetValue(xy_index);
+      EXPECT_EQ(0, packed_value % value_scale);
+      EXPECT_LE(unpacked_value, packed_value);
+      EXPECT_GT(unpacked_value + value_scale, packed_value);
+    }
+
+    const Eigen::Array2i min_offset(-30, -25);
+    constexpr int kStep = 4;
+    constexpr int kNumXOffsets = 21;
+    constexpr int kNumYOffsets = 17;
+    std::vector<int> sums(kNumXOffsets * kNumYOffsets, 0);
+    packed_grid.AccumulateValuesOnLattice(xy_indices, min_offset, kStep,
+                                          kNumXOffsets, kNumYOffsets,
+                                          sums.data());
+    for (int y = 0; y != kNumYOffsets; ++y) {
+      for (int x = 0; x != kNumXOffsets; ++x) {
+        const Eigen::Array2i xy_offset =
+            min_offset + kStep * Eigen::Array2i(x, y);
+        int expected_sum = 0;
+        for (const Eigen::Array2i& xy_index : xy_indices) {
+          expected_sum += packed_grid.GetValue(xy_index + xy_offset);
+        }
+        EXPECT_EQ(expected_sum, packed_grid.SumValues(xy_indices, xy_offset));
+        EXPECT_EQ(expected_sum, sums[y * kNumXOffsets + x]);
+      }
+    }
+  }
+}
+
 TEST(FastCorrelativeScanMatcherTest, CorrectPose) {
   std::mt19937 prng(42);
   std::uniform_real_distribution<float> distribution(-1.f, 1.f);
@@ -174,6 +360,67 @@ TEST(FastCorrelativeScanMatcherTest, CorrectPose) {
   }
 }
 
+TEST(FastCorrelativeScanMatcherTest, SharedRotatedScanCache) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, -0.5f, 0.f);
+  point_cloud.emplace_back(0.5f, -1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.5f, 1.7f, 0.f);
+  // The same rotations are used for all grids.
+  RotatedScanCache rotated_scan_cache(point_cloud, 0.05);
+
+  for (int i = 0; i != 20; ++i) {
+    const transform::Rigid2f expected_pose(
+        {2. * distribution(prng), 2. * distribution(prng)},
+        0.5 * distribution(prng));
+
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+    range_data_inserter.Insert(
+        sensor::RangeData{
+            Eigen::Vector3f(expected_pose.translation().x(),
+                            expected_pose.translation().y(), 0.f),
+            sensor::TransformPointCloud(
+                point_cloud, transform::Embed3D(expected_pose.cast<float>())),
+            {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+
+    FastCorrelativeScanMatcher fast_correlative_scan_matcher(probability_grid,
+                                                             options);
+    transform::Rigid2d pose_estimate;
+    float score;
+    EXPECT_TRUE(fast_correlative_scan_matcher.Match(
+        transform::Rigid2d::Rotation(0.1 * distribution(prng)),
+        &rotated_scan_cache, kMinScore, &score, &pose_estimate));
+    EXPECT_LT(kMinScore, score);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
+        << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+
+    float expected_full_submap_score;
+    EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &expected_full_submap_score, &pose_estimate));
+    EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        &rotated_scan_cache, kMinScore, nullptr /* thread_pool */,
+        1 /* num_tasks */, nullptr /* deadline */, &score, &pose_estimate));
+    EXPECT_NEAR(expected_full_submap_score, score, 1e-6);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
+        << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+}
+
 TEST(FastCorrelativeScanMatcherTest, FullSubmapMatching) {
   std::mt19937 prng(42);
   std::uniform_real_distribution<float> distribution(-1.f, 1.f);
@@ -218,6 +465,8 @@ TEST(FastCorrelativeScanMatcherTest, FullSubmapMatching) {
     EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
         point_cloud, kMinScore, &score, &pose_estimate));
     EXPECT_LT(kMinScore, score);
+    EXPECT_LE(score, fast_correlative_scan_matcher.ComputeFullSubmapScoreBound(
+                         point_cloud));
     EXPECT_THAT(expected_pose,
                 transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
         << "Actual: " << transform::ToProto(pose_estimate).DebugString()
@@ -225,6 +474,443 @@ TEST(FastCorrelativeScanMatcherTest, FullSubmapMatching) {
   }
 }
 
+TEST(FastCorrelativeScanMatcherTest, PackedCoarseGridsMatchOptimally) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.25f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.25f, 1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.f, 1.8f, 0.f);
+
+  for (int i = 0; i != 10; ++i) {
+    const transform::Rigid2f expected_pose(
+        {2. * distribution(prng), 2. * distribution(prng)},
+        0.5 * distribution(prng));
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+    range_data_inserter.Insert(
+        sensor::RangeData{
+            Eigen::Vector3f(expected_pose.translation().x(),
+                            expected_pose.translation().y(), 0.f),
+            sensor::TransformPointCloud(point_cloud,
+                                        transform::Embed3D(expected_pose)),
+            {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+
+    const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        probability_grid, options);
+    transform::Rigid2d unpacked_pose_estimate;
+    float expected_score;
+    ASSERT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &expected_score, &unpacked_pose_estimate));
+    for (const int coarse_bits_per_cell : {4, 2}) {
+      const FastCorrelativeScanMatcher packed_fast_correlative_scan_matcher(
+          probability_grid, CreateFastCorrelativeScanMatcherTestOptions(
+                                6, coarse_bits_per_cell));
+      EXPECT_LT(packed_fast_correlative_scan_matcher.GetMemoryUsageInBytes(),
+                fast_correlative_scan_matcher.GetMemoryUsageInBytes());
+      transform::Rigid2d pose_estimate;
+      float score;
+      ASSERT_TRUE(packed_fast_correlative_scan_matcher.MatchFullSubmap(
+          point_cloud, kMinScore, &score, &pose_estimate));
+      // The bounds only prune fewer candidates, so the best score is the
+      // same, but candidates are visited in a different order and ties may
+      // be broken differently.
+      EXPECT_EQ(expected_score, score);
+    }
+  }
+}
+
+TEST(FastCorrelativeScanMatcherTest, SortedPointsMatchIdentically) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+  auto sorted_options = options;
+  sorted_options.set_sort_points_by_cell(true);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.25f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.25f, 1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.f, 1.8f, 0.f);
+
+  for (int i = 0; i != 10; ++i) {
+    const transform::Rigid2f expected_pose(
+        {2. * distribution(prng), 2. * distribution(prng)},
+        0.5 * distribution(prng));
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+    range_data_inserter.Insert(
+        sensor::RangeData{
+            Eigen::Vector3f(expected_pose.translation().x(),
+                            expected_pose.translation().y(), 0.f),
+            sensor::TransformPointCloud(point_cloud,
+                                        transform::Embed3D(expected_pose)),
+            {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+
+    const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        probability_grid, options);
+    const FastCorrelativeScanMatcher sorted_fast_correlative_scan_matcher(
+        probability_grid, sorted_options);
+    // The same candidates get the same scores in the same order, so even
+    // ties are broken the same way.
+    transform::Rigid2d expected_pose_estimate;
+    float expected_score;
+    ASSERT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &expected_score, &expected_pose_estimate));
+    transform::Rigid2d pose_estimate;
+    float score;
+    ASSERT_TRUE(sorted_fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &score, &pose_estimate));
+    EXPECT_EQ(expected_score, score);
+    EXPECT_EQ(expected_pose_estimate.translation(),
+              pose_estimate.translation());
+    EXPECT_EQ(expected_pose_estimate.rotation().angle(),
+              pose_estimate.rotation().angle());
+
+    const transform::Rigid2d initial_pose_estimate =
+        expected_pose.cast<double>() * transform::Rigid2d({0.1, -0.1}, 0.05);
+    ASSERT_TRUE(fast_correlative_scan_matcher.Match(
+        initial_pose_estimate, point_cloud, kMinScore, &expected_score,
+        &expected_pose_estimate));
+    ASSERT_TRUE(sorted_fast_correlative_scan_matcher.Match(
+        initial_pose_estimate, point_cloud, kMinScore, &score,
+        &pose_estimate));
+    EXPECT_EQ(expected_score, score);
+    EXPECT_EQ(expected_pose_estimate.translation(),
+              pose_estimate.translation());
+    EXPECT_EQ(expected_pose_estimate.rotation().angle(),
+              pose_estimate.rotation().angle());
+  }
+}
+
+// Blocks until all work items scheduled on 'thread_pool' so far have started,
+// so that it can be destroyed. Parallel searches may return before their
+// tasks have found that nothing is left to do.
+void WaitForScheduledWorkItems(common::ThreadPool* const thread_pool) {
+  struct Barrier {
+    common::Mutex mutex;
+    bool reached GUARDED_BY(mutex) = false;
+  };
+  const auto barrier = std::make_shared<Barrier>();
+  thread_pool->Schedule(
+      [barrier]() {
+        common::MutexLocker locker(&barrier->mutex);
+        barrier->reached = true;
+      },
+      common::WorkItemPriority::kHigh, "barrier");
+  common::MutexLocker locker(&barrier->mutex);
+  locker.Await([&barrier]() REQUIRES(barrier->mutex) {
+    return barrier->reached;
+  });
+}
+
+TEST(FastCorrelativeScanMatcherTest, ParallelFullSubmapMatching) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+  common::ThreadPool thread_pool(3);
+
+  sensor::PointCloud unperturbed_point_cloud;
+  unperturbed_point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  unperturbed_point_cloud.emplace_back(-2.25f, 0.5f, 0.f);
+  unperturbed_point_cloud.emplace_back(0.f, 0.5f, 0.f);
+  unperturbed_point_cloud.emplace_back(0.25f, 1.6f, 0.f);
+  unperturbed_point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  unperturbed_point_cloud.emplace_back(2.f, 1.8f, 0.f);
+
+  for (int i = 0; i != 20; ++i) {
+    const transform::Rigid2f perturbation(
+        {10. * distribution(prng), 10. * distribution(prng)},
+        1.6 * distribution(prng));
+    const sensor::PointCloud point_cloud = sensor::TransformPointCloud(
+        unperturbed_point_cloud, transform::Embed3D(perturbation));
+    const transform::Rigid2f expected_pose =
+        transform::Rigid2f({2. * distribution(prng), 2. * distribution(prng)},
+                           0.5 * distribution(prng)) *
+        perturbation.inverse();
+
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+    range_data_inserter.Insert(
+        sensor::RangeData{
+            transform::Embed3D(expected_pose * perturbation).translation(),
+            sensor::TransformPointCloud(point_cloud,
+                                        transform::Embed3D(expected_pose)),
+            {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+
+    FastCorrelativeScanMatcher fast_correlative_scan_matcher(probability_grid,
+                                                             options);
+    transform::Rigid2d sequential_pose_estimate;
+    float sequential_score;
+    EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &sequential_score, &sequential_pose_estimate));
+    transform::Rigid2d pose_estimate;
+    float score;
+    EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &thread_pool, 4 /* num_tasks */,
+        nullptr /* deadline */, &score, &pose_estimate));
+    // Ties may be resolved differently, but the best score is the same.
+    EXPECT_EQ(sequential_score, score);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
+        << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+  WaitForScheduledWorkItems(&thread_pool);
+}
+
+TEST(FastCorrelativeScanMatcherTest, ParallelMatchingOnOwnThreadPool) {
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+  // The search runs on the only worker, so its tasks cannot start before it
+  // has finished.
+  common::ThreadPool thread_pool(1);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.25f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.25f, 1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.f, 1.8f, 0.f);
+  const transform::Rigid2f expected_pose({1.f, -0.5f}, 0.3f);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+  range_data_inserter.Insert(
+      sensor::RangeData{
+          transform::Embed3D(expected_pose).translation(),
+          sensor::TransformPointCloud(point_cloud,
+                                      transform::Embed3D(expected_pose)),
+          {}},
+      &probability_grid);
+  probability_grid.FinishUpdate();
+  FastCorrelativeScanMatcher fast_correlative_scan_matcher(probability_grid,
+                                                           options);
+
+  struct Result {
+    common::Mutex mutex;
+    bool done GUARDED_BY(mutex) = false;
+    bool success GUARDED_BY(mutex) = false;
+    float score GUARDED_BY(mutex) = 0.f;
+    transform::Rigid2d pose_estimate GUARDED_BY(mutex);
+  };
+  Result result;
+  thread_pool.Schedule([&]() {
+    float score;
+    transform::Rigid2d pose_estimate;
+    const bool success = fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &thread_pool, 4 /* num_tasks */,
+        nullptr /* deadline */, &score, &pose_estimate);
+    common::MutexLocker locker(&result.mutex);
+    result.success = success;
+    result.score = score;
+    result.pose_estimate = pose_estimate;
+    result.done = true;
+  });
+  {
+    common::MutexLocker locker(&result.mutex);
+    locker.Await([&result]() REQUIRES(result.mutex) { return result.done; });
+    EXPECT_TRUE(result.success);
+    EXPECT_LT(kMinScore, result.score);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(result.pose_estimate.cast<float>(), 0.03f))
+        << "Actual: " << transform::ToProto(result.pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+  WaitForScheduledWorkItems(&thread_pool);
+}
+
+TEST(FastCorrelativeScanMatcherTest, FullSubmapMatchingWithDeadline) {
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, -0.5f, 0.f);
+  point_cloud.emplace_back(0.5f, -1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.5f, 1.7f, 0.f);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+  range_data_inserter.Insert(
+      sensor::RangeData{Eigen::Vector3f::Zero(), point_cloud, {}},
+      &probability_grid);
+  probability_grid.FinishUpdate();
+  FastCorrelativeScanMatcher fast_correlative_scan_matcher(probability_grid,
+                                                           options);
+
+  float expected_score;
+  transform::Rigid2d expected_pose_estimate;
+  EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+      point_cloud, kMinScore, &expected_score, &expected_pose_estimate));
+
+  common::Deadline future_deadline(common::FromSeconds(3600.));
+  float score;
+  transform::Rigid2d pose_estimate;
+  EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+      point_cloud, kMinScore, nullptr /* thread_pool */, 1 /* num_tasks */,
+      &future_deadline, &score, &pose_estimate));
+  EXPECT_FALSE(future_deadline.expired());
+  EXPECT_EQ(expected_score, score);
+
+  // An expired deadline stops the search before any candidate is expanded.
+  common::Deadline past_deadline(std::chrono::steady_clock::now());
+  EXPECT_FALSE(fast_correlative_scan_matcher.MatchFullSubmap(
+      point_cloud, kMinScore, nullptr /* thread_pool */, 1 /* num_tasks */,
+      &past_deadline, &score, &pose_estimate));
+  EXPECT_TRUE(past_deadline.expired());
+}
+
+void TestMappedPrecomputationGrids(const int coarse_bits_per_cell) {
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  const auto options =
+      CreateFastCorrelativeScanMatcherTestOptions(5, coarse_bits_per_cell);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, -0.5f, 0.f);
+  point_cloud.emplace_back(0.5f, -1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.5f, 1.7f, 0.f);
+  const transform::Rigid2f expected_pose({1.f, 0.5f}, 0.2f);
+
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+  range_data_inserter.Insert(
+      sensor::RangeData{
+          Eigen::Vector3f(expected_pose.translation().x(),
+                          expected_pose.translation().y(), 0.f),
+          sensor::TransformPointCloud(point_cloud,
+                                      transform::Embed3D(expected_pose)),
+          {}},
+      &probability_grid);
+  probability_grid.FinishUpdate();
+
+  const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+      probability_grid, options);
+  char filename[] = P_tmpdir "/fast_correlative_scan_matcher_test_XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  {
+    io::MappedBlobFileWriter writer(filename);
+    writer.Write(string("unrelated"));
+    writer.Write(fast_correlative_scan_matcher.SerializePrecomputationGrids());
+    ASSERT_TRUE(writer.Close());
+  }
+  const FastCorrelativeScanMatcher mapped_fast_correlative_scan_matcher(
+      probability_grid, options,
+      std::make_shared<const io::MappedBlobFile>(filename), 1);
+  remove(filename);
+  EXPECT_EQ(0, mapped_fast_correlative_scan_matcher.GetMemoryUsageInBytes());
+  EXPECT_EQ(
+      fast_correlative_scan_matcher.SerializePrecomputationGrids(),
+      mapped_fast_correlative_scan_matcher.SerializePrecomputationGrids());
+
+  transform::Rigid2d pose_estimate;
+  float score;
+  EXPECT_TRUE(mapped_fast_correlative_scan_matcher.MatchFullSubmap(
+      point_cloud, 0.1f, &score, &pose_estimate));
+  EXPECT_THAT(expected_pose,
+              transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
+      << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+      << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+}
+
+TEST(FastCorrelativeScanMatcherTest, MappedPrecomputationGrids) {
+  TestMappedPrecomputationGrids(8);
+}
+
+TEST(FastCorrelativeScanMatcherTest, MappedPackedPrecomputationGrids) {
+  TestMappedPrecomputationGrids(4);
+  TestMappedPrecomputationGrids(2);
+}
+
+void TestUpdatedPrecomputationGrids(const int coarse_bits_per_cell) {
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  const auto options =
+      CreateFastCorrelativeScanMatcherTestOptions(5, coarse_bits_per_cell);
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, -0.5f, 0.f);
+  point_cloud.emplace_back(0.5f, -1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.5f, 1.7f, 0.f);
+  const auto insert = [&](const transform::Rigid2f& pose,
+                          ProbabilityGrid* const probability_grid) {
+    range_data_inserter.Insert(
+        sensor::RangeData{Eigen::Vector3f(pose.translation().x(),
+                                          pose.translation().y(), 0.f),
+                          sensor::TransformPointCloud(
+                              point_cloud, transform::Embed3D(pose)),
+                          {}},
+        probability_grid);
+    probability_grid->FinishUpdate();
+  };
+
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+  insert(transform::Rigid2f({1.f, 0.5f}, 0.2f), &probability_grid);
+  auto outdated_scan_matcher = common::make_unique<FastCorrelativeScanMatcher>(
+      probability_grid, options);
+  auto unrelated_scan_matcher = common::make_unique<FastCorrelativeScanMatcher>(
+      ProbabilityGrid(
+          MapLimits(0.05, Eigen::Vector2d(1., 1.), CellLimits(20, 20))),
+      options);
+  insert(transform::Rigid2f({0.5f, -0.5f}, -0.3f), &probability_grid);
+  insert(transform::Rigid2f({1.2f, 0.7f}, 0.1f), &probability_grid);
+  const ProbabilityGrid cropped_probability_grid =
+      ComputeCroppedProbabilityGrid(probability_grid);
+
+  const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+      cropped_probability_grid, options);
+  // The cropped grid is within the outdated grid, so its grids are updated.
+  const FastCorrelativeScanMatcher updated_fast_correlative_scan_matcher(
+      cropped_probability_grid, options, std::move(outdated_scan_matcher));
+  EXPECT_EQ(
+      fast_correlative_scan_matcher.SerializePrecomputationGrids(),
+      updated_fast_correlative_scan_matcher.SerializePrecomputationGrids());
+  // Otherwise, the grids are computed from scratch.
+  const FastCorrelativeScanMatcher recomputed_fast_correlative_scan_matcher(
+      cropped_probability_grid, options, std::move(unrelated_scan_matcher));
+  EXPECT_EQ(
+      fast_correlative_scan_matcher.SerializePrecomputationGrids(),
+      recomputed_fast_correlative_scan_matcher.SerializePrecomputationGrids());
+}
+
+TEST(FastCorrelativeScanMatcherTest, UpdatedPrecomputationGrids) {
+  TestUpdatedPrecomputationGrids(8);
+}
+
+TEST(FastCorrelativeScanMatcherTest, UpdatedPackedPrecomputationGrids) {
+  TestUpdatedPrecomputationGrids(4);
+  TestUpdatedPrecomputationGrids(2);
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
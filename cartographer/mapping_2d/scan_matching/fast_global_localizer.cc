@@ -16,12 +16,73 @@
 
 #include "cartographer/mapping_2d/scan_matching/fast_global_localizer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "cartographer/common/deadline.h"
+#include "cartographer/common/mutex.h"
 #include "glog/logging.h"
 
 namespace cartographer {
 namespace mapping_2d {
 namespace scan_matching {
 
+namespace {
+
+// State of the parallel ranking of the submaps. It is shared with the tasks,
+// so that tasks starting only after the ranking has finished can safely see
+// that nothing is left to do.
+struct RankingState {
+  explicit RankingState(const int num_matchers)
+      : next_matcher_index(0), score_bounds(num_matchers) {}
+
+  std::atomic<int> next_matcher_index;
+  // Written only by the task which claimed the matcher.
+  std::vector<float> score_bounds;
+
+  common::Mutex mutex;
+  int num_matchers_ranked GUARDED_BY(mutex) = 0;
+};
+
+// Returns ComputeFullSubmapScoreBound() of all 'matchers', computed by
+// 'num_tasks' tasks.
+std::vector<float> ComputeScoreBounds(
+    const std::vector<FastCorrelativeScanMatcher*>& matchers,
+    const sensor::PointCloud& point_cloud, const int num_tasks,
+    common::ThreadPoolInterface* const thread_pool) {
+  const int num_matchers = matchers.size();
+  const auto state = std::make_shared<RankingState>(num_matchers);
+  // Matchers are claimed one at a time, and everything but 'state' is only
+  // accessed once a matcher has been claimed.
+  const std::function<void()> rank = [state, num_matchers, &matchers,
+                                      &point_cloud]() {
+    for (;;) {
+      const int index = state->next_matcher_index++;
+      if (index >= num_matchers) {
+        return;
+      }
+      state->score_bounds[index] =
+          matchers[index]->ComputeFullSubmapScoreBound(point_cloud);
+      common::MutexLocker locker(&state->mutex);
+      ++state->num_matchers_ranked;
+    }
+  };
+  for (int i = 1; i < num_tasks; ++i) {
+    thread_pool->Schedule(rank, common::WorkItemPriority::kLow,
+                          "global_localization_ranking");
+  }
+  rank();
+  common::MutexLocker locker(&state->mutex);
+  locker.Await([&state, num_matchers]() REQUIRES(state->mutex) {
+    return state->num_matchers_ranked == num_matchers;
+  });
+  return state->score_bounds;
+}
+
+}  // namespace
+
 bool PerformGlobalLocalization(
     const float cutoff,
     const cartographer::sensor::AdaptiveVoxelFilter& voxel_filter,
@@ -56,6 +117,72 @@ bool PerformGlobalLocalization(
   return success;
 }
 
+bool PerformGlobalLocalization(
+    const float cutoff,
+    const cartographer::sensor::AdaptiveVoxelFilter& voxel_filter,
+    const std::vector<
+        cartographer::mapping_2d::scan_matching::FastCorrelativeScanMatcher*>&
+        matchers,
+    const cartographer::sensor::PointCloud& point_cloud,
+    const GlobalLocalizationParameters& parameters,
+    common::ThreadPoolInterface* const thread_pool,
+    transform::Rigid2d* const best_pose_estimate, float* const best_score) {
+  CHECK(best_pose_estimate != nullptr)
+      << "Need a non-null output_pose_estimate!";
+  CHECK(best_score != nullptr) << "Need a non-null best_score!";
+  CHECK(thread_pool != nullptr);
+  CHECK_GE(parameters.num_tasks, 1);
+  common::Deadline deadline(parameters.time_budget);
+  *best_score = cutoff;
+  if (matchers.empty()) {
+    LOG(WARNING) << "Map not yet large enough to localize in!";
+    return false;
+  }
+  const sensor::PointCloud filtered_point_cloud =
+      voxel_filter.Filter(point_cloud);
+  const std::vector<float> score_bounds = ComputeScoreBounds(
+      matchers, filtered_point_cloud, parameters.num_tasks, thread_pool);
+
+  std::vector<int> ranking;
+  for (size_t i = 0; i != matchers.size(); ++i) {
+    if (score_bounds[i] > cutoff) {
+      ranking.push_back(i);
+    }
+  }
+  // Ties are broken by index to keep the result deterministic.
+  std::sort(ranking.begin(), ranking.end(),
+            [&score_bounds](const int lhs, const int rhs) {
+              if (score_bounds[lhs] != score_bounds[rhs]) {
+                return score_bounds[lhs] > score_bounds[rhs];
+              }
+              return lhs < rhs;
+            });
+  if (static_cast<int>(ranking.size()) > parameters.num_submaps_to_match) {
+    ranking.resize(parameters.num_submaps_to_match);
+  }
+
+  bool success = false;
+  for (const int index : ranking) {
+    // The remaining submaps cannot score higher than their bound.
+    if (score_bounds[index] <= *best_score ||
+        *best_score >= parameters.good_enough_score ||
+        deadline.CheckExpired()) {
+      break;
+    }
+    float score = -1;
+    transform::Rigid2d pose_estimate;
+    if (matchers[index]->MatchFullSubmap(filtered_point_cloud, *best_score,
+                                         thread_pool, parameters.num_tasks,
+                                         &deadline, &score, &pose_estimate)) {
+      CHECK_GT(score, *best_score) << "MatchFullSubmap lied!";
+      *best_score = score;
+      *best_pose_estimate = pose_estimate;
+      success = true;
+    }
+  }
+  return success;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_2d
 }  // namespace cartographer
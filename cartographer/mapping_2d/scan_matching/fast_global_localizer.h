@@ -20,6 +20,8 @@
 #include <vector>
 
 #include "Eigen/Geometry"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
 #include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
 #include "cartographer/sensor/voxel_filter.h"
 
@@ -44,6 +46,37 @@ bool PerformGlobalLocalization(
     const cartographer::sensor::PointCloud& point_cloud,
     transform::Rigid2d* best_pose_estimate, float* best_score);
 
+// Parameters of the coarse-to-fine global localization below.
+struct GlobalLocalizationParameters {
+  // Number of submaps with the highest lowest resolution scores on which the
+  // full branch-and-bound search is run.
+  int num_submaps_to_match = 10;
+  // The search stops once a score of at least 'good_enough_score' is found.
+  float good_enough_score = 1.f;
+  // No further submaps are matched once 'time_budget' has passed, and the
+  // submap being matched returns its best match found so far. The ranking is
+  // always finished.
+  common::Duration time_budget = common::FromSeconds(10.);
+  // Number of tasks used for the ranking and each full submap match, all but
+  // one of which are scheduled on the thread pool.
+  int num_tasks = 4;
+};
+
+// Same as above, but coarse-to-fine: the submaps are ranked by the score of
+// their lowest resolution candidates, computed in parallel on the
+// 'thread_pool'. This score is an upper bound for the final score, so the
+// full search only runs on the best ranked submaps whose bound is above the
+// best score found so far. The calling thread takes part in the work.
+bool PerformGlobalLocalization(
+    float cutoff, const cartographer::sensor::AdaptiveVoxelFilter& voxel_filter,
+    const std::vector<
+        cartographer::mapping_2d::scan_matching::FastCorrelativeScanMatcher*>&
+        matchers,
+    const cartographer::sensor::PointCloud& point_cloud,
+    const GlobalLocalizationParameters& parameters,
+    common::ThreadPoolInterface* thread_pool,
+    transform::Rigid2d* best_pose_estimate, float* best_score);
+
 }  // namespace scan_matching
 }  // namespace mapping_2d
 }  // namespace cartographer
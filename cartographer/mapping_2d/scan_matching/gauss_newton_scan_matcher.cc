@@ -0,0 +1,253 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/gauss_newton_scan_matcher.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen/Cholesky"
+#include "cartographer/mapping/probability_values.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+namespace {
+
+// Maximum number of times a step is halved when it does not reduce the cost.
+constexpr int kMaxNumStepHalvings = 5;
+
+// Interpolates the probabilities of a ProbabilityGrid bilinearly between the
+// centers of cells, reading from the probability mirror if there is one.
+class BilinearInterpolator {
+ public:
+  explicit BilinearInterpolator(const ProbabilityGrid& probability_grid)
+      : probability_grid_(probability_grid),
+        mirror_(probability_grid.probability_mirror()),
+        mirror_width_(probability_grid.probability_mirror_width()),
+        num_x_cells_(probability_grid.limits().cell_limits().num_x_cells),
+        num_y_cells_(probability_grid.limits().cell_limits().num_y_cells) {}
+
+  // Returns the probability at the continuous cell index ('x', 'y') and its
+  // derivatives with respect to 'x' and 'y'.
+  float Evaluate(float x, float y, float* const probability_by_x,
+                 float* const probability_by_y) const {
+    // Outside of the grid the probability is constant, so the indices can be
+    // clamped, which also keeps them in the range of an int.
+    x = std::max(-2.f, std::min(x, num_x_cells_ + 1.f));
+    y = std::max(-2.f, std::min(y, num_y_cells_ + 1.f));
+    const float floor_x = std::floor(x);
+    const float floor_y = std::floor(y);
+    float samples[4];
+    GetSamples(static_cast<int>(floor_x), static_cast<int>(floor_y), samples);
+    const float fraction_x = x - floor_x;
+    const float fraction_y = y - floor_y;
+    *probability_by_x = (1.f - fraction_y) * (samples[1] - samples[0]) +
+                        fraction_y * (samples[3] - samples[2]);
+    *probability_by_y = (1.f - fraction_x) * (samples[2] - samples[0]) +
+                        fraction_x * (samples[3] - samples[1]);
+    return (1.f - fraction_y) *
+               ((1.f - fraction_x) * samples[0] + fraction_x * samples[1]) +
+           fraction_y *
+               ((1.f - fraction_x) * samples[2] + fraction_x * samples[3]);
+  }
+
+ private:
+  // Fills 'samples' with the probabilities of the cells at ('x', 'y'),
+  // ('x' + 1, 'y'), ('x', 'y' + 1) and ('x' + 1, 'y' + 1).
+  void GetSamples(const int x, const int y, float* const samples) const {
+    if (mirror_ != nullptr) {
+      constexpr int kPadding = ProbabilityGrid::kMirrorPadding;
+      if (x >= -kPadding && x + 1 < num_x_cells_ + kPadding &&
+          y >= -kPadding && y + 1 < num_y_cells_ + kPadding) {
+        const float* const sample =
+            mirror_ + (y + kPadding) * mirror_width_ + x + kPadding;
+        samples[0] = sample[0];
+        samples[1] = sample[1];
+        samples[2] = sample[mirror_width_];
+        samples[3] = sample[mirror_width_ + 1];
+        return;
+      }
+      // With a padding of at least one cell, none of the samples is inside the
+      // grid.
+      std::fill(samples, samples + 4, mapping::kMinProbability);
+      return;
+    }
+    samples[0] = probability_grid_.GetProbability(Eigen::Array2i(x, y));
+    samples[1] = probability_grid_.GetProbability(Eigen::Array2i(x + 1, y));
+    samples[2] = probability_grid_.GetProbability(Eigen::Array2i(x, y + 1));
+    samples[3] =
+        probability_grid_.GetProbability(Eigen::Array2i(x + 1, y + 1));
+  }
+
+  const ProbabilityGrid& probability_grid_;
+  const float* const mirror_;
+  const int mirror_width_;
+  const int num_x_cells_;
+  const int num_y_cells_;
+};
+
+}  // namespace
+
+proto::GaussNewtonScanMatcherOptions CreateGaussNewtonScanMatcherOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::GaussNewtonScanMatcherOptions options;
+  options.set_occupied_space_weight(
+      parameter_dictionary->GetDouble("occupied_space_weight"));
+  options.set_translation_weight(
+      parameter_dictionary->GetDouble("translation_weight"));
+  options.set_rotation_weight(
+      parameter_dictionary->GetDouble("rotation_weight"));
+  options.set_max_num_iterations(
+      parameter_dictionary->GetNonNegativeInt("max_num_iterations"));
+  options.set_min_step(parameter_dictionary->GetDouble("min_step"));
+  CHECK_GT(options.occupied_space_weight(), 0.f);
+  CHECK_GT(options.translation_weight(), 0.f);
+  CHECK_GT(options.rotation_weight(), 0.f);
+  return options;
+}
+
+GaussNewtonScanMatcher::GaussNewtonScanMatcher(
+    const proto::GaussNewtonScanMatcherOptions& options)
+    : options_(options), max_num_iterations_(options.max_num_iterations()) {}
+
+void GaussNewtonScanMatcher::SetMaxNumIterations(
+    const int max_num_iterations) {
+  max_num_iterations_ = max_num_iterations;
+}
+
+int GaussNewtonScanMatcher::Match(
+    const transform::Rigid2d& previous_pose,
+    const transform::Rigid2d& initial_pose_estimate,
+    const sensor::PointCloud& point_cloud,
+    const ProbabilityGrid& probability_grid,
+    transform::Rigid2d* const pose_estimate) const {
+  const Eigen::Vector2f previous_translation =
+      previous_pose.translation().cast<float>();
+  const float initial_angle = initial_pose_estimate.rotation().angle();
+  Eigen::Vector3f pose(initial_pose_estimate.translation().x(),
+                       initial_pose_estimate.translation().y(), initial_angle);
+  Eigen::Matrix3f hessian;
+  Eigen::Vector3f gradient;
+  float cost = Evaluate(pose, previous_translation, initial_angle, point_cloud,
+                        probability_grid, &hessian, &gradient);
+  int num_iterations = 0;
+  while (num_iterations < max_num_iterations_) {
+    // The rotation residual keeps the Hessian positive definite.
+    Eigen::Vector3f step = hessian.ldlt().solve(-gradient);
+    if (!step.allFinite()) {
+      break;
+    }
+    // The bilinear interpolation is only piecewise smooth, so full steps can
+    // jump back and forth across the maximum of a cell.
+    Eigen::Vector3f candidate_pose;
+    Eigen::Matrix3f candidate_hessian;
+    Eigen::Vector3f candidate_gradient;
+    float candidate_cost = cost;
+    for (int i = 0; i != kMaxNumStepHalvings; ++i) {
+      candidate_pose = pose + step;
+      candidate_cost = Evaluate(candidate_pose, previous_translation,
+                                initial_angle, point_cloud, probability_grid,
+                                &candidate_hessian, &candidate_gradient);
+      if (candidate_cost < cost) {
+        break;
+      }
+      step *= 0.5f;
+    }
+    if (!(candidate_cost < cost)) {
+      break;
+    }
+    ++num_iterations;
+    pose = candidate_pose;
+    cost = candidate_cost;
+    hessian = candidate_hessian;
+    gradient = candidate_gradient;
+    if (step.head<2>().norm() < options_.min_step() &&
+        std::abs(step.z()) < options_.min_step()) {
+      break;
+    }
+  }
+  *pose_estimate = transform::Rigid2d(
+      {pose.x(), pose.y()}, static_cast<double>(pose.z()));
+  return num_iterations;
+}
+
+float GaussNewtonScanMatcher::Evaluate(
+    const Eigen::Vector3f& pose, const Eigen::Vector2f& previous_translation,
+    const float initial_angle, const sensor::PointCloud& point_cloud,
+    const ProbabilityGrid& probability_grid, Eigen::Matrix3f* const hessian,
+    Eigen::Vector3f* const gradient) const {
+  const float translation_weight_squared =
+      options_.translation_weight() * options_.translation_weight();
+  const float rotation_weight_squared =
+      options_.rotation_weight() * options_.rotation_weight();
+  const Eigen::Vector2f translation_delta =
+      pose.head<2>() - previous_translation;
+  const float rotation_delta = pose.z() - initial_angle;
+  float cost = translation_weight_squared * translation_delta.squaredNorm() +
+               rotation_weight_squared * rotation_delta * rotation_delta;
+  *hessian = Eigen::Vector3f(translation_weight_squared,
+                             translation_weight_squared,
+                             rotation_weight_squared)
+                 .asDiagonal();
+  *gradient << translation_weight_squared * translation_delta,
+      rotation_weight_squared * rotation_delta;
+  if (point_cloud.empty()) {
+    return cost;
+  }
+
+  const MapLimits& limits = probability_grid.limits();
+  const float inverse_resolution = 1.f / limits.resolution();
+  const Eigen::Vector2f max = limits.max().cast<float>();
+  const float scaling_factor =
+      options_.occupied_space_weight() /
+      std::sqrt(static_cast<float>(point_cloud.size()));
+  const float cos_theta = std::cos(pose.z());
+  const float sin_theta = std::sin(pose.z());
+  const BilinearInterpolator interpolator(probability_grid);
+  for (const Eigen::Vector3f& point : point_cloud) {
+    const Eigen::Vector2f rotated_point(
+        cos_theta * point.x() - sin_theta * point.y(),
+        sin_theta * point.x() + cos_theta * point.y());
+    const Eigen::Vector2f world = rotated_point + pose.head<2>();
+    // The x cell index decreases with increasing y in the world and the y cell
+    // index with increasing x.
+    float probability_by_x;
+    float probability_by_y;
+    const float probability = interpolator.Evaluate(
+        (max.y() - world.y()) * inverse_resolution - 0.5f,
+        (max.x() - world.x()) * inverse_resolution - 0.5f, &probability_by_x,
+        &probability_by_y);
+    const float residual = scaling_factor * (1.f - probability);
+    const float residual_by_x =
+        scaling_factor * probability_by_y * inverse_resolution;
+    const float residual_by_y =
+        scaling_factor * probability_by_x * inverse_resolution;
+    const Eigen::Vector3f jacobian(
+        residual_by_x, residual_by_y,
+        -residual_by_x * rotated_point.y() + residual_by_y * rotated_point.x());
+    cost += residual * residual;
+    hessian->noalias() += jacobian * jacobian.transpose();
+    *gradient += residual * jacobian;
+  }
+  return cost;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
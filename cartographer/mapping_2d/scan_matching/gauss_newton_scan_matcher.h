@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_GAUSS_NEWTON_SCAN_MATCHER_H_
+#define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_GAUSS_NEWTON_SCAN_MATCHER_H_
+
+#include "Eigen/Core"
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/proto/gauss_newton_scan_matcher_options.pb.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+proto::GaussNewtonScanMatcherOptions CreateGaussNewtonScanMatcherOptions(
+    common::LuaParameterDictionary* parameter_dictionary);
+
+// Aligns scans with an existing map by minimizing the same residuals as the
+// CeresScanMatcher with plain Gauss-Newton steps. Everything is computed in
+// single precision, the grid is interpolated bilinearly instead of bicubically
+// and the 3x3 normal equations are solved directly, so there is no problem to
+// set up per scan. This is meant for CPUs on which Ceres dominates the time
+// spent on local SLAM.
+//
+// Steps are halved until they reduce the cost, otherwise the iteration stops.
+class GaussNewtonScanMatcher {
+ public:
+  explicit GaussNewtonScanMatcher(
+      const proto::GaussNewtonScanMatcherOptions& options);
+
+  GaussNewtonScanMatcher(const GaussNewtonScanMatcher&) = delete;
+  GaussNewtonScanMatcher& operator=(const GaussNewtonScanMatcher&) = delete;
+
+  // Overrides the maximum number of iterations of the options.
+  void SetMaxNumIterations(int max_num_iterations);
+
+  // Aligns 'point_cloud' within the 'probability_grid' given an
+  // 'initial_pose_estimate' and returns a 'pose_estimate'. Returns the number
+  // of steps taken.
+  int Match(const transform::Rigid2d& previous_pose,
+            const transform::Rigid2d& initial_pose_estimate,
+            const sensor::PointCloud& point_cloud,
+            const ProbabilityGrid& probability_grid,
+            transform::Rigid2d* pose_estimate) const;
+
+ private:
+  // Returns the cost at 'pose' given as (x, y, theta), and the Gauss-Newton
+  // approximation of its 'hessian' and its 'gradient', both halved.
+  float Evaluate(const Eigen::Vector3f& pose,
+                 const Eigen::Vector2f& previous_translation,
+                 float initial_angle, const sensor::PointCloud& point_cloud,
+                 const ProbabilityGrid& probability_grid,
+                 Eigen::Matrix3f* hessian, Eigen::Vector3f* gradient) const;
+
+  const proto::GaussNewtonScanMatcherOptions options_;
+  int max_num_iterations_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_GAUSS_NEWTON_SCAN_MATCHER_H_
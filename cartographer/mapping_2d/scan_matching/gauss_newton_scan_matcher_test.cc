@@ -0,0 +1,118 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/gauss_newton_scan_matcher.h"
+
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+class GaussNewtonScanMatcherTest : public ::testing::Test {
+ protected:
+  GaussNewtonScanMatcherTest()
+      : probability_grid_(
+            MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200))),
+        gauss_newton_scan_matcher_(CreateOptions()) {
+    // Two walls forming a corner through the centers of cells, of which every
+    // other cell is observed.
+    for (int i = -20; i <= 20; ++i) {
+      const float t = 0.025f + 0.05f * i;
+      for (const Eigen::Vector2f& point :
+           {Eigen::Vector2f(0.975f, t), Eigen::Vector2f(t, 0.975f)}) {
+        const Eigen::Array2i cell_index =
+            probability_grid_.limits().GetCellIndex(point);
+        if (!probability_grid_.IsKnown(cell_index)) {
+          probability_grid_.SetProbability(cell_index,
+                                           mapping::kMaxProbability);
+        }
+        if (i % 2 == 0) {
+          point_cloud_.emplace_back(point.x(), point.y(), 0.f);
+        }
+      }
+    }
+  }
+
+  static proto::GaussNewtonScanMatcherOptions CreateOptions() {
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          occupied_space_weight = 1.,
+          translation_weight = 0.1,
+          rotation_weight = 0.1,
+          max_num_iterations = 20,
+          min_step = 1e-4,
+        })text");
+    return CreateGaussNewtonScanMatcherOptions(parameter_dictionary.get());
+  }
+
+  void TestFromInitialPose(const transform::Rigid2d& initial_pose) {
+    transform::Rigid2d pose;
+    const transform::Rigid2d expected_pose = transform::Rigid2d::Identity();
+    gauss_newton_scan_matcher_.Match(initial_pose, initial_pose, point_cloud_,
+                                     probability_grid_, &pose);
+    EXPECT_THAT(pose, transform::IsNearly(expected_pose, 1e-3))
+        << "Actual: " << transform::ToProto(pose).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+
+  ProbabilityGrid probability_grid_;
+  sensor::PointCloud point_cloud_;
+  GaussNewtonScanMatcher gauss_newton_scan_matcher_;
+};
+
+TEST_F(GaussNewtonScanMatcherTest, testPerfectEstimate) {
+  TestFromInitialPose(transform::Rigid2d::Identity());
+}
+
+TEST_F(GaussNewtonScanMatcherTest, testOptimizeAlongX) {
+  TestFromInitialPose(transform::Rigid2d::Translation({0.03, 0.}));
+}
+
+TEST_F(GaussNewtonScanMatcherTest, testOptimizeAlongY) {
+  TestFromInitialPose(transform::Rigid2d::Translation({0., -0.03}));
+}
+
+TEST_F(GaussNewtonScanMatcherTest, testOptimizeAlongXYAndTheta) {
+  TestFromInitialPose(transform::Rigid2d({0.02, -0.02}, 0.03));
+}
+
+TEST_F(GaussNewtonScanMatcherTest, testProbabilityMirror) {
+  probability_grid_.EnableProbabilityMirror();
+  TestFromInitialPose(transform::Rigid2d({0.02, -0.02}, 0.03));
+}
+
+TEST_F(GaussNewtonScanMatcherTest, testNoIterations) {
+  gauss_newton_scan_matcher_.SetMaxNumIterations(0);
+  const transform::Rigid2d initial_pose =
+      transform::Rigid2d::Translation({0.03, 0.});
+  transform::Rigid2d pose;
+  EXPECT_EQ(0, gauss_newton_scan_matcher_.Match(initial_pose, initial_pose,
+                                                point_cloud_,
+                                                probability_grid_, &pose));
+  EXPECT_THAT(pose, transform::IsNearly(initial_pose, 1e-6));
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
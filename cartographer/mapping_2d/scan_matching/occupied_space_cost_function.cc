@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_function.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen/Core"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+OccupiedSpaceCostFunction::OccupiedSpaceCostFunction(
+    const double scaling_factor, const sensor::PointCloud& point_cloud,
+    const ProbabilityGrid& probability_grid)
+    : scaling_factor_(scaling_factor),
+      point_cloud_(point_cloud),
+      limits_(probability_grid.limits()),
+      adapter_(probability_grid),
+      interpolator_(adapter_),
+      use_mirror_(probability_grid.probability_mirror() != nullptr),
+      mirror_adapter_(probability_grid),
+      mirror_interpolator_(mirror_adapter_) {
+  set_num_residuals(point_cloud.size());
+  mutable_parameter_block_sizes()->push_back(3);
+}
+
+bool OccupiedSpaceCostFunction::Evaluate(double const* const* parameters,
+                                         double* const residuals,
+                                         double** const jacobians) const {
+  const double* const pose = parameters[0];
+  const double cos_theta = std::cos(pose[2]);
+  const double sin_theta = std::sin(pose[2]);
+  Eigen::Matrix2d rotation;
+  rotation << cos_theta, -sin_theta, sin_theta, cos_theta;
+  const Eigen::Vector2d translation(pose[0], pose[1]);
+  double* const jacobian = jacobians == nullptr ? nullptr : jacobians[0];
+
+  for (size_t i = 0; i < point_cloud_.size(); ++i) {
+    const Eigen::Vector2d rotated_point =
+        rotation * point_cloud_[i].head<2>().cast<double>();
+    const Eigen::Vector2d world = rotated_point + translation;
+    const double row =
+        (limits_.max().x() - world.x()) / limits_.resolution() - 0.5;
+    const double column =
+        (limits_.max().y() - world.y()) / limits_.resolution() - 0.5;
+    double probability;
+    double probability_by_row;
+    double probability_by_column;
+    if (use_mirror_) {
+      if (!IsInterpolatedFromMirror(row, column)) {
+        // All samples are outside the grid, where the probability is constant.
+        residuals[i] = scaling_factor_ * (1. - mapping::kMinProbability);
+        if (jacobian != nullptr) {
+          std::fill(jacobian + 3 * i, jacobian + 3 * i + 3, 0.);
+        }
+        continue;
+      }
+      const double mirror_row = row + ProbabilityGrid::kMirrorPadding;
+      const double mirror_column = column + ProbabilityGrid::kMirrorPadding;
+      if (jacobian == nullptr) {
+        mirror_interpolator_.Evaluate(mirror_row, mirror_column, &probability);
+        residuals[i] = scaling_factor_ * (1. - probability);
+        continue;
+      }
+      mirror_interpolator_.Evaluate(mirror_row, mirror_column, &probability,
+                                    &probability_by_row,
+                                    &probability_by_column);
+    } else {
+      const double padded_row = row + GridArrayAdapter::kPadding;
+      const double padded_column = column + GridArrayAdapter::kPadding;
+      if (jacobian == nullptr) {
+        interpolator_.Evaluate(padded_row, padded_column, &probability);
+        residuals[i] = scaling_factor_ * (1. - probability);
+        continue;
+      }
+      interpolator_.Evaluate(padded_row, padded_column, &probability,
+                             &probability_by_row, &probability_by_column);
+    }
+    residuals[i] = scaling_factor_ * (1. - probability);
+    // The row and column decrease with increasing x and y, respectively.
+    const double residual_by_x =
+        scaling_factor_ * probability_by_row / limits_.resolution();
+    const double residual_by_y =
+        scaling_factor_ * probability_by_column / limits_.resolution();
+    // The derivative of the rotated point with respect to theta is the
+    // rotated point rotated by another 90 degrees.
+    jacobian[3 * i] = residual_by_x;
+    jacobian[3 * i + 1] = residual_by_y;
+    jacobian[3 * i + 2] = -residual_by_x * rotated_point.y() +
+                          residual_by_y * rotated_point.x();
+  }
+  return true;
+}
+
+bool OccupiedSpaceCostFunction::IsInterpolatedFromMirror(
+    const double row, const double column) const {
+  // The bicubic interpolation reads the samples from one before to two after
+  // the integer part of each index. Unless one of them is inside the grid,
+  // they all have the minimum probability.
+  static_assert(ProbabilityGrid::kMirrorPadding >= 3,
+                "All samples inside the grid need to be inside the mirror.");
+  const double integer_row = std::floor(row);
+  const double integer_column = std::floor(column);
+  return integer_row >= -2. &&
+         integer_row <= limits_.cell_limits().num_y_cells &&
+         integer_column >= -2. &&
+         integer_column <= limits_.cell_limits().num_x_cells;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
+#define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
+
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_functor.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "ceres/ceres.h"
+#include "ceres/cubic_interpolation.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+// Adapts the probability mirror of a ProbabilityGrid for interpolation by
+// Ceres. Rows and columns are the y and x cell indices offset by
+// 'ProbabilityGrid::kMirrorPadding'. They are not checked, so the interpolator
+// must only be evaluated where all samples are inside the mirror.
+class ProbabilityMirrorAdapter {
+ public:
+  enum { DATA_DIMENSION = 1 };
+
+  explicit ProbabilityMirrorAdapter(const ProbabilityGrid& probability_grid)
+      : mirror_(probability_grid.probability_mirror()),
+        width_(probability_grid.probability_mirror_width()) {}
+
+  void GetValue(const int row, const int column, double* const value) const {
+    *value = mirror_[row * width_ + column];
+  }
+
+ private:
+  const float* const mirror_;
+  const int width_;
+};
+
+// Computes the same residuals as the OccupiedSpaceCostFunctor, but with
+// analytic Jacobians: the whole point cloud is evaluated in one pass which
+// shares the rotation matrix between all points, and the bicubic interpolation
+// returns its derivatives directly instead of propagating Jets through it.
+//
+// If the grid has a probability mirror, the bounds are checked once per point
+// and the samples are read from the mirror, instead of converting each sample
+// of the grid separately.
+//
+// The parameter block is the pose as (x, y, theta).
+class OccupiedSpaceCostFunction : public ceres::CostFunction {
+ public:
+  OccupiedSpaceCostFunction(double scaling_factor,
+                            const sensor::PointCloud& point_cloud,
+                            const ProbabilityGrid& probability_grid);
+
+  OccupiedSpaceCostFunction(const OccupiedSpaceCostFunction&) = delete;
+  OccupiedSpaceCostFunction& operator=(const OccupiedSpaceCostFunction&) =
+      delete;
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override;
+
+ private:
+  // Returns true if all samples for interpolating at 'row' and 'column', i.e.
+  // the y and x cell indices, are inside the probability mirror. Otherwise,
+  // none of them is inside the grid.
+  bool IsInterpolatedFromMirror(double row, double column) const;
+
+  const double scaling_factor_;
+  const sensor::PointCloud& point_cloud_;
+  const MapLimits& limits_;
+  const GridArrayAdapter adapter_;
+  const ceres::BiCubicInterpolator<GridArrayAdapter> interpolator_;
+  const bool use_mirror_;
+  const ProbabilityMirrorAdapter mirror_adapter_;
+  const ceres::BiCubicInterpolator<ProbabilityMirrorAdapter>
+      mirror_interpolator_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_function.h"
+
+#include <vector>
+
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_functor.h"
+#include "ceres/ceres.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+TEST(OccupiedSpaceCostFunctionTest, MatchesAutoDiff) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(1., 1.), CellLimits(40, 40)));
+  for (int i = 0; i != 40; ++i) {
+    probability_grid.SetProbability(Eigen::Array2i(i, (7 * i) % 40),
+                                    0.1f + 0.02f * i);
+  }
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 50; ++i) {
+    point_cloud.emplace_back(-0.9f + 0.037f * i, 0.8f - 0.031f * i, 0.f);
+  }
+  constexpr double kScalingFactor = 0.7;
+  const OccupiedSpaceCostFunction cost_function(kScalingFactor, point_cloud,
+                                                probability_grid);
+  const ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor, ceres::DYNAMIC,
+                                    3>
+      auto_diff_cost_function(
+          new OccupiedSpaceCostFunctor(kScalingFactor, point_cloud,
+                                       probability_grid),
+          point_cloud.size());
+
+  const double pose[3] = {0.03, -0.02, 0.2};
+  const double* const parameters[1] = {pose};
+  std::vector<double> residuals(point_cloud.size());
+  std::vector<double> jacobian(3 * point_cloud.size());
+  double* jacobians[1] = {jacobian.data()};
+  ASSERT_TRUE(
+      cost_function.Evaluate(parameters, residuals.data(), jacobians));
+  std::vector<double> expected_residuals(point_cloud.size());
+  std::vector<double> expected_jacobian(3 * point_cloud.size());
+  double* expected_jacobians[1] = {expected_jacobian.data()};
+  ASSERT_TRUE(auto_diff_cost_function.Evaluate(
+      parameters, expected_residuals.data(), expected_jacobians));
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    EXPECT_NEAR(expected_residuals[i], residuals[i], 1e-9);
+  }
+  for (size_t i = 0; i != jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_jacobian[i], jacobian[i], 1e-6);
+  }
+
+  // Without Jacobians, only the residuals are computed.
+  std::vector<double> residuals_only(point_cloud.size());
+  ASSERT_TRUE(
+      cost_function.Evaluate(parameters, residuals_only.data(), nullptr));
+  EXPECT_EQ(residuals, residuals_only);
+}
+
+TEST(OccupiedSpaceCostFunctionTest, ProbabilityMirrorMatchesGrid) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(1., 1.), CellLimits(40, 40)));
+  for (int i = 0; i != 40; ++i) {
+    probability_grid.SetProbability(Eigen::Array2i(i, (7 * i) % 40),
+                                    0.1f + 0.02f * i);
+    probability_grid.SetProbability(Eigen::Array2i(i, 39 - (3 * i) % 40),
+                                    0.9f - 0.01f * i);
+  }
+  ProbabilityGrid mirrored_grid = probability_grid;
+  mirrored_grid.EnableProbabilityMirror();
+  // The point cloud extends beyond the grid on all sides.
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 100; ++i) {
+    point_cloud.emplace_back(-1.3f + 0.027f * i, 1.2f - 0.025f * i, 0.f);
+    point_cloud.emplace_back(1.2f - 0.024f * i, -1.25f + 0.026f * i, 0.f);
+  }
+  constexpr double kScalingFactor = 0.7;
+  const OccupiedSpaceCostFunction cost_function(kScalingFactor, point_cloud,
+                                                probability_grid);
+  const OccupiedSpaceCostFunction mirrored_cost_function(
+      kScalingFactor, point_cloud, mirrored_grid);
+
+  const double pose[3] = {0.03, -0.02, 0.2};
+  const double* const parameters[1] = {pose};
+  std::vector<double> residuals(point_cloud.size());
+  std::vector<double> jacobian(3 * point_cloud.size());
+  double* jacobians[1] = {jacobian.data()};
+  ASSERT_TRUE(
+      cost_function.Evaluate(parameters, residuals.data(), jacobians));
+  std::vector<double> mirrored_residuals(point_cloud.size());
+  std::vector<double> mirrored_jacobian(3 * point_cloud.size());
+  double* mirrored_jacobians[1] = {mirrored_jacobian.data()};
+  ASSERT_TRUE(mirrored_cost_function.Evaluate(
+      parameters, mirrored_residuals.data(), mirrored_jacobians));
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    EXPECT_NEAR(residuals[i], mirrored_residuals[i], 1e-6);
+  }
+  for (size_t i = 0; i != jacobian.size(); ++i) {
+    EXPECT_NEAR(jacobian[i], mirrored_jacobian[i], 1e-4);
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
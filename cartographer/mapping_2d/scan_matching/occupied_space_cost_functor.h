@@ -28,6 +28,41 @@ namespace cartographer {
 namespace mapping_2d {
 namespace scan_matching {
 
+// Adapts a ProbabilityGrid for interpolation by Ceres. The grid is padded by
+// 'kPadding' cells of minimum probability on each side, so that the indices
+// passed to the interpolator are never negative.
+class GridArrayAdapter {
+ public:
+  static constexpr int kPadding = INT_MAX / 4;
+  enum { DATA_DIMENSION = 1 };
+
+  explicit GridArrayAdapter(const ProbabilityGrid& probability_grid)
+      : probability_grid_(probability_grid) {}
+
+  void GetValue(const int row, const int column, double* const value) const {
+    if (row < kPadding || column < kPadding || row >= NumRows() - kPadding ||
+        column >= NumCols() - kPadding) {
+      *value = mapping::kMinProbability;
+    } else {
+      *value = static_cast<double>(probability_grid_.GetProbability(
+          Eigen::Array2i(column - kPadding, row - kPadding)));
+    }
+  }
+
+  int NumRows() const {
+    return probability_grid_.limits().cell_limits().num_y_cells +
+           2 * kPadding;
+  }
+
+  int NumCols() const {
+    return probability_grid_.limits().cell_limits().num_x_cells +
+           2 * kPadding;
+  }
+
+ private:
+  const ProbabilityGrid& probability_grid_;
+};
+
 // Computes the cost of inserting occupied space described by the point cloud
 // into the map. The cost increases with the amount of free space that would be
 // replaced by occupied space.
@@ -64,9 +99,9 @@ class OccupiedSpaceCostFunctor {
       const Eigen::Matrix<T, 3, 1> world = transform * point;
       interpolator.Evaluate(
           (limits.max().x() - world[0]) / limits.resolution() - 0.5 +
-              T(kPadding),
+              T(GridArrayAdapter::kPadding),
           (limits.max().y() - world[1]) / limits.resolution() - 0.5 +
-              T(kPadding),
+              T(GridArrayAdapter::kPadding),
           &residual[i]);
       residual[i] = scaling_factor_ * (1. - residual[i]);
     }
@@ -74,38 +109,6 @@ class OccupiedSpaceCostFunctor {
   }
 
  private:
-  static constexpr int kPadding = INT_MAX / 4;
-  class GridArrayAdapter {
-   public:
-    enum { DATA_DIMENSION = 1 };
-
-    explicit GridArrayAdapter(const ProbabilityGrid& probability_grid)
-        : probability_grid_(probability_grid) {}
-
-    void GetValue(const int row, const int column, double* const value) const {
-      if (row < kPadding || column < kPadding || row >= NumRows() - kPadding ||
-          column >= NumCols() - kPadding) {
-        *value = mapping::kMinProbability;
-      } else {
-        *value = static_cast<double>(probability_grid_.GetProbability(
-            Eigen::Array2i(column - kPadding, row - kPadding)));
-      }
-    }
-
-    int NumRows() const {
-      return probability_grid_.limits().cell_limits().num_y_cells +
-             2 * kPadding;
-    }
-
-    int NumCols() const {
-      return probability_grid_.limits().cell_limits().num_x_cells +
-             2 * kPadding;
-    }
-
-   private:
-    const ProbabilityGrid& probability_grid_;
-  };
-
   const double scaling_factor_;
   const sensor::PointCloud& point_cloud_;
   const ProbabilityGrid& probability_grid_;
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the time to build the precomputation grids of a 2D
+// FastCorrelativeScanMatcher for a synthetic submap.
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/mapping_2d/xy_index.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_cells, 1000, "Number of cells of the submap per dimension.");
+DEFINE_int32(branch_and_bound_depth, 7,
+             "Number of precomputation grids to build.");
+DEFINE_int32(num_iterations, 10, "Number of times the grids are built.");
+DEFINE_int32(coarse_bits_per_cell, 8,
+             "Number of bits per cell of all but the finest grid.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+// Returns a submap whose center part is known, with random probabilities.
+ProbabilityGrid GenerateProbabilityGrid(const int num_cells) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(0.05 * num_cells, 0.05 * num_cells),
+                CellLimits(num_cells, num_cells)));
+  for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(
+           Eigen::Array2i(num_cells / 10, num_cells / 10),
+           Eigen::Array2i(num_cells - num_cells / 10 - 1,
+                          num_cells - num_cells / 10 - 1))) {
+    probability_grid.SetProbability(xy_index, probability_distribution(rng));
+  }
+  return probability_grid;
+}
+
+void Run() {
+  const ProbabilityGrid probability_grid =
+      GenerateProbabilityGrid(FLAGS_num_cells);
+  proto::FastCorrelativeScanMatcherOptions options;
+  options.set_linear_search_window(7.);
+  options.set_angular_search_window(0.5);
+  options.set_branch_and_bound_depth(FLAGS_branch_and_bound_depth);
+  options.set_coarse_bits_per_cell(FLAGS_coarse_bits_per_cell);
+
+  const auto start = std::chrono::steady_clock::now();
+  int64 memory_usage_in_bytes = 0;
+  for (int i = 0; i != FLAGS_num_iterations; ++i) {
+    const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        probability_grid, options);
+    memory_usage_in_bytes +=
+        fast_correlative_scan_matcher.GetMemoryUsageInBytes();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  LOG(INFO) << "Built " << FLAGS_branch_and_bound_depth
+            << " precomputation grids for a " << FLAGS_num_cells << " x "
+            << FLAGS_num_cells << " submap in "
+            << 1e3 * seconds / FLAGS_num_iterations << " ms, using "
+            << memory_usage_in_bytes / FLAGS_num_iterations / (1024 * 1024)
+            << " MiB.";
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks building the precomputation grids of the 2D fast correlative "
+      "scan matcher.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::scan_matching::Run();
+  return EXIT_SUCCESS;
+}
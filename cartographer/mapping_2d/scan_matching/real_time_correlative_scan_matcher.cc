@@ -24,6 +24,8 @@
 #include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/math.h"
+#include "cartographer/mapping/bounded_probability_sum.h"
+#include "cartographer/mapping/probability_values.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/transform/transform.h"
@@ -33,6 +35,152 @@ namespace cartographer {
 namespace mapping_2d {
 namespace scan_matching {
 
+namespace {
+
+// Cell values are affine in the probability. Unknown cells have the same
+// probability as cells with value 1.
+constexpr float kProbabilityPerValue =
+    (mapping::kMaxProbability - mapping::kMinProbability) / 32766.f;
+
+// A 'DiscreteScan' prepared for scoring many translations of it.
+struct IndexedDiscreteScan {
+  Eigen::AlignedBox2i bounding_box;
+  // Indices into ProbabilityGrid::cells() of the cells of the scan, which may
+  // be out of bounds. Empty for tiled grids.
+  std::vector<int> flat_indices;
+};
+
+// Replaces the contents of 'indexed_scans' by the 'discrete_scans' prepared
+// for scoring, reusing the memory of its flat indices.
+void IndexDiscreteScans(const ProbabilityGrid& probability_grid,
+                        const std::vector<DiscreteScan>& discrete_scans,
+                        std::vector<IndexedDiscreteScan>* const indexed_scans) {
+  const int num_x_cells = probability_grid.limits().cell_limits().num_x_cells;
+  indexed_scans->resize(discrete_scans.size());
+  for (size_t i = 0; i != discrete_scans.size(); ++i) {
+    IndexedDiscreteScan& indexed_scan = (*indexed_scans)[i];
+    indexed_scan.bounding_box.setEmpty();
+    indexed_scan.flat_indices.clear();
+    for (const Eigen::Array2i& xy_index : discrete_scans[i]) {
+      indexed_scan.bounding_box.extend(xy_index.matrix());
+      if (!probability_grid.tiled()) {
+        indexed_scan.flat_indices.push_back(num_x_cells * xy_index.y() +
+                                            xy_index.x());
+      }
+    }
+  }
+}
+
+// The temporaries of Match(). They are kept per thread and reused by the next
+// call, so that matching does not allocate once they have grown.
+struct Workspace {
+  sensor::PointCloud rotated_point_cloud;
+  std::vector<sensor::PointCloud> rotated_scans;
+  std::vector<DiscreteScan> discrete_scans;
+  std::vector<Candidate> candidates;
+  std::vector<IndexedDiscreteScan> indexed_scans;
+};
+
+Workspace& GetThreadLocalWorkspace() {
+  thread_local Workspace workspace;
+  return workspace;
+}
+
+// Returns true if the cells of 'indexed_scan' translated by 'offset' can be
+// looked up by their flat indices.
+bool CanUseFlatIndices(const ProbabilityGrid& probability_grid,
+                       const IndexedDiscreteScan& indexed_scan,
+                       const Eigen::Array2i& offset) {
+  const CellLimits& cell_limits = probability_grid.limits().cell_limits();
+  return !probability_grid.tiled() && !indexed_scan.bounding_box.isEmpty() &&
+         (indexed_scan.bounding_box.min().array() + offset >= 0).all() &&
+         indexed_scan.bounding_box.max().x() + offset.x() <
+             cell_limits.num_x_cells &&
+         indexed_scan.bounding_box.max().y() + offset.y() <
+             cell_limits.num_y_cells;
+}
+
+// Grid accessor for mapping::ComputeBoundedProbabilitySum() which looks up
+// cells by their flat indices without bounds checks and sums values as
+// integers.
+class FlatIndexAccessor {
+ public:
+  FlatIndexAccessor(const ProbabilityGrid& probability_grid,
+                    const IndexedDiscreteScan& indexed_scan,
+                    const int flat_offset)
+      : cells_(probability_grid.cells()),
+        flat_indices_(indexed_scan.flat_indices),
+        flat_offset_(flat_offset) {}
+
+  float SumProbabilities(const int begin, const int end) const {
+    int value_sum = 0;
+    for (int i = begin; i != end; ++i) {
+      const int value = cells_[flat_indices_[i] + flat_offset_] &
+                        (mapping::kUpdateMarker - 1);
+      value_sum += std::max(value, 1) - 1;
+    }
+    return (end - begin) * mapping::kMinProbability +
+           value_sum * kProbabilityPerValue;
+  }
+
+ private:
+  const std::vector<uint16>& cells_;
+  const std::vector<int>& flat_indices_;
+  const int flat_offset_;
+};
+
+// Grid accessor for mapping::ComputeBoundedProbabilitySum() which looks up
+// the cells of 'discrete_scan' translated by 'offset' with bounds checks.
+class CellIndexAccessor {
+ public:
+  CellIndexAccessor(const ProbabilityGrid& probability_grid,
+                    const DiscreteScan& discrete_scan,
+                    const Eigen::Array2i& offset)
+      : probability_grid_(probability_grid),
+        discrete_scan_(discrete_scan),
+        offset_(offset) {}
+
+  float SumProbabilities(const int begin, const int end) const {
+    float probability_sum = 0.f;
+    for (int i = begin; i != end; ++i) {
+      probability_sum +=
+          probability_grid_.GetProbability(discrete_scan_[i] + offset_);
+    }
+    return probability_sum;
+  }
+
+ private:
+  const ProbabilityGrid& probability_grid_;
+  const DiscreteScan& discrete_scan_;
+  const Eigen::Array2i offset_;
+};
+
+// Returns the sum of the probabilities of the cells of 'discrete_scan'
+// translated by the offset of 'candidate'. Returns early with a partial sum
+// once the sum is known not to exceed 'min_probability_sum'.
+float ComputeProbabilitySum(const ProbabilityGrid& probability_grid,
+                            const DiscreteScan& discrete_scan,
+                            const IndexedDiscreteScan& indexed_scan,
+                            const Candidate& candidate,
+                            const float min_probability_sum) {
+  const Eigen::Array2i offset(candidate.x_index_offset,
+                              candidate.y_index_offset);
+  const int num_points = discrete_scan.size();
+  if (CanUseFlatIndices(probability_grid, indexed_scan, offset)) {
+    const int flat_offset =
+        probability_grid.limits().cell_limits().num_x_cells * offset.y() +
+        offset.x();
+    return mapping::ComputeBoundedProbabilitySum(
+        FlatIndexAccessor(probability_grid, indexed_scan, flat_offset),
+        num_points, min_probability_sum);
+  }
+  return mapping::ComputeBoundedProbabilitySum(
+      CellIndexAccessor(probability_grid, discrete_scan, offset), num_points,
+      min_probability_sum);
+}
+
+}  // namespace
+
 proto::RealTimeCorrelativeScanMatcherOptions
 CreateRealTimeCorrelativeScanMatcherOptions(
     common::LuaParameterDictionary* const parameter_dictionary) {
@@ -54,9 +202,9 @@ RealTimeCorrelativeScanMatcher::RealTimeCorrelativeScanMatcher(
     const proto::RealTimeCorrelativeScanMatcherOptions& options)
     : options_(options) {}
 
-std::vector<Candidate>
-RealTimeCorrelativeScanMatcher::GenerateExhaustiveSearchCandidates(
-    const SearchParameters& search_parameters) const {
+void RealTimeCorrelativeScanMatcher::GenerateExhaustiveSearchCandidates(
+    const SearchParameters& search_parameters,
+    std::vector<Candidate>* const candidates) const {
   int num_candidates = 0;
   for (int scan_index = 0; scan_index != search_parameters.num_scans;
        ++scan_index) {
@@ -68,8 +216,8 @@ RealTimeCorrelativeScanMatcher::GenerateExhaustiveSearchCandidates(
          search_parameters.linear_bounds[scan_index].min_y + 1);
     num_candidates += num_linear_x_candidates * num_linear_y_candidates;
   }
-  std::vector<Candidate> candidates;
-  candidates.reserve(num_candidates);
+  candidates->clear();
+  candidates->reserve(num_candidates);
   for (int scan_index = 0; scan_index != search_parameters.num_scans;
        ++scan_index) {
     for (int x_index_offset = search_parameters.linear_bounds[scan_index].min_x;
@@ -79,13 +227,12 @@ RealTimeCorrelativeScanMatcher::GenerateExhaustiveSearchCandidates(
                search_parameters.linear_bounds[scan_index].min_y;
            y_index_offset <= search_parameters.linear_bounds[scan_index].max_y;
            ++y_index_offset) {
-        candidates.emplace_back(scan_index, x_index_offset, y_index_offset,
-                                search_parameters);
+        candidates->emplace_back(scan_index, x_index_offset, y_index_offset,
+                                 search_parameters);
       }
     }
   }
-  CHECK_EQ(candidates.size(), num_candidates);
-  return candidates;
+  CHECK_EQ(candidates->size(), num_candidates);
 }
 
 double RealTimeCorrelativeScanMatcher::Match(
@@ -94,29 +241,29 @@ double RealTimeCorrelativeScanMatcher::Match(
     const ProbabilityGrid& probability_grid,
     transform::Rigid2d* pose_estimate) const {
   CHECK_NOTNULL(pose_estimate);
+  Workspace& workspace = GetThreadLocalWorkspace();
 
   const Eigen::Rotation2Dd initial_rotation = initial_pose_estimate.rotation();
-  const sensor::PointCloud rotated_point_cloud = sensor::TransformPointCloud(
-      point_cloud,
+  sensor::PointCloud& rotated_point_cloud = workspace.rotated_point_cloud;
+  rotated_point_cloud.assign(point_cloud.begin(), point_cloud.end());
+  sensor::TransformPointCloudInPlace(
       transform::Rigid3f::Rotation(Eigen::AngleAxisf(
-          initial_rotation.cast<float>().angle(), Eigen::Vector3f::UnitZ())));
+          initial_rotation.cast<float>().angle(), Eigen::Vector3f::UnitZ())),
+      &rotated_point_cloud);
   const SearchParameters search_parameters(
       options_.linear_search_window(), options_.angular_search_window(),
       rotated_point_cloud, probability_grid.limits().resolution());
 
-  const std::vector<sensor::PointCloud> rotated_scans =
-      GenerateRotatedScans(rotated_point_cloud, search_parameters);
-  const std::vector<DiscreteScan> discrete_scans = DiscretizeScans(
-      probability_grid.limits(), rotated_scans,
+  GenerateRotatedScans(rotated_point_cloud, search_parameters,
+                       &workspace.rotated_scans);
+  DiscretizeScans(
+      probability_grid.limits(), workspace.rotated_scans,
       Eigen::Translation2f(initial_pose_estimate.translation().x(),
-                           initial_pose_estimate.translation().y()));
-  std::vector<Candidate> candidates =
-      GenerateExhaustiveSearchCandidates(search_parameters);
-  ScoreCandidates(probability_grid, discrete_scans, search_parameters,
-                  &candidates);
-
-  const Candidate& best_candidate =
-      *std::max_element(candidates.begin(), candidates.end());
+                           initial_pose_estimate.translation().y()),
+      &workspace.discrete_scans);
+  GenerateExhaustiveSearchCandidates(search_parameters, &workspace.candidates);
+  const Candidate best_candidate = FindBestCandidate(
+      probability_grid, workspace.discrete_scans, &workspace.candidates);
   *pose_estimate = transform::Rigid2d(
       {initial_pose_estimate.translation().x() + best_candidate.x,
        initial_pose_estimate.translation().y() + best_candidate.y},
@@ -124,33 +271,73 @@ double RealTimeCorrelativeScanMatcher::Match(
   return best_candidate.score;
 }
 
+float RealTimeCorrelativeScanMatcher::ComputeCandidateWeight(
+    const Candidate& candidate) const {
+  return std::exp(
+      -common::Pow2(std::hypot(candidate.x, candidate.y) *
+                        options_.translation_delta_cost_weight() +
+                    std::abs(candidate.orientation) *
+                        options_.rotation_delta_cost_weight()));
+}
+
 void RealTimeCorrelativeScanMatcher::ScoreCandidates(
     const ProbabilityGrid& probability_grid,
     const std::vector<DiscreteScan>& discrete_scans,
     const SearchParameters& search_parameters,
     std::vector<Candidate>* const candidates) const {
+  std::vector<IndexedDiscreteScan> indexed_scans;
+  IndexDiscreteScans(probability_grid, discrete_scans, &indexed_scans);
   for (Candidate& candidate : *candidates) {
-    candidate.score = 0.f;
-    for (const Eigen::Array2i& xy_index :
-         discrete_scans[candidate.scan_index]) {
-      const Eigen::Array2i proposed_xy_index(
-          xy_index.x() + candidate.x_index_offset,
-          xy_index.y() + candidate.y_index_offset);
-      const float probability =
-          probability_grid.GetProbability(proposed_xy_index);
-      candidate.score += probability;
-    }
-    candidate.score /=
-        static_cast<float>(discrete_scans[candidate.scan_index].size());
-    candidate.score *=
-        std::exp(-common::Pow2(std::hypot(candidate.x, candidate.y) *
-                                   options_.translation_delta_cost_weight() +
-                               std::abs(candidate.orientation) *
-                                   options_.rotation_delta_cost_weight()));
+    const DiscreteScan& discrete_scan = discrete_scans[candidate.scan_index];
+    candidate.score =
+        ComputeProbabilitySum(probability_grid, discrete_scan,
+                              indexed_scans[candidate.scan_index], candidate,
+                              -std::numeric_limits<float>::infinity()) /
+        static_cast<float>(discrete_scan.size());
+    candidate.score *= ComputeCandidateWeight(candidate);
     CHECK_GT(candidate.score, 0.f);
   }
 }
 
+Candidate RealTimeCorrelativeScanMatcher::FindBestCandidate(
+    const ProbabilityGrid& probability_grid,
+    const std::vector<DiscreteScan>& discrete_scans,
+    std::vector<Candidate>* const candidates) const {
+  CHECK(!candidates->empty());
+  std::vector<IndexedDiscreteScan>& indexed_scans =
+      GetThreadLocalWorkspace().indexed_scans;
+  IndexDiscreteScans(probability_grid, discrete_scans, &indexed_scans);
+  // Candidates are visited by decreasing weight, i.e. increasing distance from
+  // the initial pose estimate. The weight times 'kMaxProbability' bounds the
+  // score, so once it is below the best score, no candidate can beat it.
+  for (Candidate& candidate : *candidates) {
+    candidate.score = ComputeCandidateWeight(candidate);
+  }
+  std::stable_sort(candidates->begin(), candidates->end(),
+                   std::greater<Candidate>());
+  const Candidate* best_candidate = nullptr;
+  float best_score = -std::numeric_limits<float>::infinity();
+  for (Candidate& candidate : *candidates) {
+    const float weight = candidate.score;
+    if (weight * mapping::kMaxProbability <= best_score) {
+      break;
+    }
+    const DiscreteScan& discrete_scan = discrete_scans[candidate.scan_index];
+    const float num_points = static_cast<float>(discrete_scan.size());
+    candidate.score =
+        ComputeProbabilitySum(probability_grid, discrete_scan,
+                              indexed_scans[candidate.scan_index], candidate,
+                              best_score / weight * num_points) /
+        num_points * weight;
+    if (candidate.score > best_score) {
+      CHECK_GT(candidate.score, 0.f);
+      best_score = candidate.score;
+      best_candidate = &candidate;
+    }
+  }
+  return *best_candidate;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_2d
 }  // namespace cartographer
@@ -66,7 +66,8 @@ class RealTimeCorrelativeScanMatcher {
 
   // Aligns 'point_cloud' within the 'probability_grid' given an
   // 'initial_pose_estimate' then updates 'pose_estimate' with the result and
-  // returns the score.
+  // returns the score. The temporaries are kept per thread and reused by the
+  // next call on the same thread.
   double Match(const transform::Rigid2d& initial_pose_estimate,
                const sensor::PointCloud& point_cloud,
                const ProbabilityGrid& probability_grid,
@@ -83,8 +84,22 @@ class RealTimeCorrelativeScanMatcher {
                        std::vector<Candidate>* candidates) const;
 
  private:
-  std::vector<Candidate> GenerateExhaustiveSearchCandidates(
-      const SearchParameters& search_parameters) const;
+  // Replaces the contents of 'candidates' by all candidates within the
+  // 'search_parameters'.
+  void GenerateExhaustiveSearchCandidates(
+      const SearchParameters& search_parameters,
+      std::vector<Candidate>* candidates) const;
+
+  // Returns the factor by which the score of 'candidate' is reduced for its
+  // distance from the initial pose estimate.
+  float ComputeCandidateWeight(const Candidate& candidate) const;
+
+  // Returns the candidate ScoreCandidates() would score best, up to rounding.
+  // Candidates which cannot beat the best one found so far are not fully
+  // scored, so the scores left in 'candidates' are meaningless.
+  Candidate FindBestCandidate(const ProbabilityGrid& probability_grid,
+                              const std::vector<DiscreteScan>& discrete_scans,
+                              std::vector<Candidate>* candidates) const;
 
   const proto::RealTimeCorrelativeScanMatcherOptions options_;
 };
@@ -16,8 +16,10 @@
 
 #include "cartographer/mapping_2d/scan_matching/real_time_correlative_scan_matcher.h"
 
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <random>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
@@ -118,6 +120,68 @@ TEST_F(RealTimeCorrelativeScanMatcherTest,
   EXPECT_GT(0.7, candidates[0].score);
 }
 
+TEST(RealTimeCorrelativeScanMatcherPruningTest, MatchFindsBestCandidate) {
+  auto parameter_dictionary = common::MakeDictionary(
+      "return {"
+      "linear_search_window = 0.3, "
+      "angular_search_window = 0.2, "
+      "translation_delta_cost_weight = 0.3, "
+      "rotation_delta_cost_weight = 0.5, "
+      "}");
+  const RealTimeCorrelativeScanMatcher real_time_correlative_scan_matcher(
+      CreateRealTimeCorrelativeScanMatcherOptions(parameter_dictionary.get()));
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  std::uniform_real_distribution<float> point_distribution(-2.f, 2.f);
+  for (const bool tiled : {false, true}) {
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(3., 3.), CellLimits(120, 120)), tiled);
+    for (const Eigen::Array2i& xy_index :
+         XYIndexRangeIterator(Eigen::Array2i(10, 10), Eigen::Array2i(99, 99))) {
+      probability_grid.SetProbability(xy_index,
+                                      probability_distribution(prng));
+    }
+    sensor::PointCloud point_cloud;
+    for (int i = 0; i != 300; ++i) {
+      point_cloud.emplace_back(point_distribution(prng),
+                               point_distribution(prng), 0.f);
+    }
+    const transform::Rigid2d initial_pose_estimate({0.1, -0.2}, 0.);
+
+    // Score all candidates for the expected result.
+    const SearchParameters search_parameters(
+        0.3, 0.2, point_cloud, probability_grid.limits().resolution());
+    const std::vector<DiscreteScan> discrete_scans = DiscretizeScans(
+        probability_grid.limits(),
+        GenerateRotatedScans(point_cloud, search_parameters),
+        Eigen::Translation2f(0.1f, -0.2f));
+    std::vector<Candidate> candidates;
+    for (int scan_index = 0; scan_index != search_parameters.num_scans;
+         ++scan_index) {
+      const SearchParameters::LinearBounds& linear_bounds =
+          search_parameters.linear_bounds[scan_index];
+      for (int x = linear_bounds.min_x; x <= linear_bounds.max_x; ++x) {
+        for (int y = linear_bounds.min_y; y <= linear_bounds.max_y; ++y) {
+          candidates.emplace_back(scan_index, x, y, search_parameters);
+        }
+      }
+    }
+    real_time_correlative_scan_matcher.ScoreCandidates(
+        probability_grid, discrete_scans, search_parameters, &candidates);
+    const Candidate& expected =
+        *std::max_element(candidates.begin(), candidates.end());
+
+    transform::Rigid2d pose_estimate;
+    const double score = real_time_correlative_scan_matcher.Match(
+        initial_pose_estimate, point_cloud, probability_grid, &pose_estimate);
+    EXPECT_NEAR(expected.score, score, 1e-6);
+    EXPECT_NEAR(0.1 + expected.x, pose_estimate.translation().x(), 1e-9);
+    EXPECT_NEAR(-0.2 + expected.y, pose_estimate.translation().y(), 1e-9);
+    EXPECT_NEAR(expected.orientation, pose_estimate.rotation().angle(), 1e-9);
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
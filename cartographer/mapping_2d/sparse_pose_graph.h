@@ -17,7 +17,7 @@
 #ifndef CARTOGRAPHER_MAPPING_2D_SPARSE_POSE_GRAPH_H_
 #define CARTOGRAPHER_MAPPING_2D_SPARSE_POSE_GRAPH_H_
 
-#include <deque>
+#include <atomic>
 #include <functional>
 #include <limits>
 #include <map>
@@ -34,10 +34,20 @@
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/pose_graph_trimmer.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
+#include "cartographer/mapping/sparse_pose_graph/change_log.h"
+#include "cartographer/mapping/sparse_pose_graph/constraint_store.h"
+#include "cartographer/mapping/sparse_pose_graph/cost_attribution.h"
+#include "cartographer/mapping/sparse_pose_graph/cross_trajectory_search_budget.h"
+#include "cartographer/mapping/sparse_pose_graph/load_shedding_controller.h"
+#include "cartographer/mapping/sparse_pose_graph/node_time_index.h"
+#include "cartographer/mapping/sparse_pose_graph/place_recognition_index.h"
+#include "cartographer/mapping/sparse_pose_graph/spatial_index.h"
+#include "cartographer/mapping/sparse_pose_graph/work_queue.h"
 #include "cartographer/mapping/trajectory_connectivity_state.h"
 #include "cartographer/mapping_2d/sparse_pose_graph/constraint_builder.h"
 #include "cartographer/mapping_2d/sparse_pose_graph/optimization_problem.h"
 #include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/sensor/fixed_frame_pose_data.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -59,12 +69,21 @@ namespace mapping_2d {
 class SparsePoseGraph : public mapping::SparsePoseGraph {
  public:
   SparsePoseGraph(const mapping::proto::SparsePoseGraphOptions& options,
-                  common::ThreadPool* thread_pool);
+                  common::ThreadPoolInterface* thread_pool);
+  // Same as above, but each class of background work is scheduled on its pool
+  // in 'thread_pools'.
+  SparsePoseGraph(const mapping::proto::SparsePoseGraphOptions& options,
+                  const common::WorkloadThreadPools& thread_pools);
   ~SparsePoseGraph() override;
 
   SparsePoseGraph(const SparsePoseGraph&) = delete;
   SparsePoseGraph& operator=(const SparsePoseGraph&) = delete;
 
+  // Exports the length of the work queue, the optimization time and the
+  // metrics of the constraint builder to 'registry'. Must be called before the
+  // first scan is added.
+  void RegisterMetrics(metrics::Registry* registry) EXCLUDES(mutex_);
+
   // Adds a new node with 'constant_data' and a 'pose' that will later be
   // optimized. The 'pose' was determined by scan matching against
   // 'insertion_submaps.front()' and the scan was inserted into the
@@ -79,18 +98,51 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   void AddImuData(int trajectory_id, const sensor::ImuData& imu_data);
   void AddOdometerData(int trajectory_id,
                        const sensor::OdometryData& odometry_data);
+  // Same as above for time-sorted samples, which are added with a single work
+  // item. At high sensor rates, this avoids locking and queueing per sample.
+  void AddImuData(int trajectory_id, std::vector<sensor::ImuData> imu_data);
+  void AddOdometerData(int trajectory_id,
+                       std::vector<sensor::OdometryData> odometry_data);
   void AddFixedFramePoseData(
       int trajectory_id,
       const sensor::FixedFramePoseData& fixed_frame_pose_data);
 
   void FreezeTrajectory(int trajectory_id) override;
+  void SetMergedTrajectory(int trajectory_id) override;
+  void SetLocalizationTrajectory(int trajectory_id) override;
+  void LinkOverlappingTrajectories(int trajectory_id,
+                                   int other_trajectory_id) override;
   void AddSubmapFromProto(int trajectory_id,
                           const transform::Rigid3d& initial_pose,
                           const mapping::proto::Submap& submap) override;
+  void SetPrecomputedGrids(
+      int trajectory_id,
+      std::shared_ptr<const io::MappedBlobFile> mapped_blob_file) override;
+  void WarmUpScanMatchers(const transform::Rigid3d& global_pose) override;
+  // Submaps of 'trajectory_id' are used for scan matching after loading them
+  // with the 'submap_loader', see ConstraintBuilder::SetSubmapLoader().
+  void SetSubmapLoader(
+      int trajectory_id,
+      sparse_pose_graph::ConstraintBuilder::SubmapLoader submap_loader);
   void AddNodeFromProto(int trajectory_id, const transform::Rigid3d& pose,
                         const mapping::proto::Node& node) override;
+  // Same as AddSubmapFromProto() and AddNodeFromProto() for data already
+  // deserialized, e.g. on another thread.
+  void AddDeserializedSubmap(int trajectory_id,
+                             const transform::Rigid3d& initial_pose,
+                             std::shared_ptr<const Submap> submap)
+      EXCLUDES(mutex_);
+  void AddDeserializedNode(
+      int trajectory_id, const transform::Rigid3d& pose,
+      std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data)
+      EXCLUDES(mutex_);
   void AddTrimmer(std::unique_ptr<mapping::PoseGraphTrimmer> trimmer) override;
   void RunFinalOptimization() override;
+  void UpdateRuntimeOptions(
+      const mapping::proto::SparsePoseGraphRuntimeOptions& runtime_options)
+      override EXCLUDES(mutex_);
+  void SetComputationProgressCallback(
+      ComputationProgressCallback callback) override EXCLUDES(mutex_);
   std::vector<std::vector<int>> GetConnectedTrajectories() override;
   int num_submaps(int trajectory_id) EXCLUDES(mutex_) override;
   mapping::SparsePoseGraph::SubmapData GetSubmapData(
@@ -101,7 +153,23 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
       EXCLUDES(mutex_) override;
   std::vector<std::vector<mapping::TrajectoryNode>> GetTrajectoryNodes()
       override EXCLUDES(mutex_);
+  std::map<mapping::SubmapId, mapping::SparsePoseGraph::SubmapData>
+  GetSubmapDataInRegion(const Eigen::AlignedBox2d& region) override
+      EXCLUDES(mutex_);
+  std::map<mapping::NodeId, mapping::TrajectoryNode>
+  GetTrajectoryNodesInRegion(const Eigen::AlignedBox2d& region) override
+      EXCLUDES(mutex_);
+  bool LookupGlobalPose(int trajectory_id, common::Time time,
+                        transform::Rigid3d* pose) override EXCLUDES(mutex_);
+  bool LookupGlobalPoses(int trajectory_id,
+                         const std::vector<common::Time>& times,
+                         std::vector<transform::Rigid3d>* poses) override
+      EXCLUDES(mutex_);
+  std::shared_ptr<const Snapshot> GetSnapshot() override;
   std::vector<Constraint> constraints() override EXCLUDES(mutex_);
+  State GetState() override EXCLUDES(mutex_);
+  Changes GetChangesSince(int64 version) override EXCLUDES(mutex_);
+  mapping::MemoryUsage GetMemoryUsage() override EXCLUDES(mutex_);
 
  private:
   // The current state of the submap in the background threads. When this
@@ -119,9 +187,38 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
     SubmapState state = SubmapState::kActive;
   };
 
-  // Handles a new work item.
+  // Starts constructing the scan matcher of the front of the
+  // 'insertion_submaps' if it is about to be finished, see
+  // 'speculative_precomputation_num_range_data'.
+  void MaybePrecomputeScanMatcherSpeculatively(
+      int trajectory_id,
+      const std::vector<std::shared_ptr<const Submap>>& insertion_submaps)
+      REQUIRES(mutex_);
+
+  // Adds a work item to the 'work_queue_'.
   void AddWorkItem(const std::function<void()>& work_item) REQUIRES(mutex_);
 
+  // Returns the 'work_queue_'. If the queue did not exist, it is created and
+  // drained on the 'thread_pool_', so that the thread adding data never
+  // processes it.
+  mapping::sparse_pose_graph::WorkQueue* GetWorkQueue() REQUIRES(mutex_);
+
+  // Schedules a task on the 'thread_pool_' which calls DrainWorkQueue().
+  void ScheduleDrainWorkQueue() REQUIRES(mutex_);
+
+  // Blocks while the 'work_queue_' has 'max_work_queue_size' items.
+  void WaitForWorkQueueCapacity(common::MutexLocker* locker) REQUIRES(mutex_);
+
+  void UpdateWorkQueueSizeMetric() REQUIRES(mutex_);
+
+  // Runs some items of the 'work_queue_'. If it becomes empty, the queue is
+  // removed. If an optimization has to run first, it is started. Otherwise,
+  // the remaining items are drained by another task.
+  void DrainWorkQueue() REQUIRES(mutex_);
+
+  void RunWorkItem(const mapping::sparse_pose_graph::WorkItem& work_item)
+      REQUIRES(mutex_);
+
   // Adds connectivity and sampler for a trajectory if it does not exist.
   void AddTrajectoryIfNeeded(int trajectory_id) REQUIRES(mutex_);
 
@@ -138,16 +235,73 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
       std::vector<std::shared_ptr<const Submap>> insertion_submaps,
       bool newly_finished_submap) REQUIRES(mutex_);
 
+  // Starts constructing the scan matchers for the finished submaps of frozen
+  // trajectories by distance from 'position' in the global frame.
+  void WarmUpScanMatchersNear(const Eigen::Vector2d& position)
+      REQUIRES(mutex_);
+
+  // Warms up the scan matchers around the first node of a localization
+  // trajectory matched against a frozen trajectory by 'result', unless this
+  // already happened.
+  void MaybeWarmUpScanMatchersAfterFirstMatch(
+      const sparse_pose_graph::ConstraintBuilder::Result& result)
+      REQUIRES(mutex_);
+
+  // Returns whether nodes of 'node_trajectory_id' are matched against submaps
+  // of 'submap_trajectory_id' at all, see SetLocalizationTrajectory().
+  bool IsMatchingAllowed(int node_trajectory_id, int submap_trajectory_id)
+      REQUIRES(mutex_);
+
+  // Returns whether matching 'node_id' against 'submap_id' is restricted to a
+  // local search window around their current relative pose.
+  bool IsLocalConstraintSearch(const mapping::NodeId& node_id,
+                               const mapping::SubmapId& submap_id)
+      REQUIRES(mutex_);
+
   // Computes constraints for a scan and submap pair.
   void ComputeConstraint(const mapping::NodeId& node_id,
                          const mapping::SubmapId& submap_id) REQUIRES(mutex_);
 
+  // Returns false if a search between a node and a submap of different
+  // trajectories exceeds the 'cross_trajectory_search_budget_'.
+  bool AcquireCrossTrajectorySearch(const mapping::NodeId& node_id,
+                                    const mapping::SubmapId& submap_id)
+      REQUIRES(mutex_);
+
   // Adds constraints for older scans whenever a new submap is finished.
+  // Nodes are matched in order of their distance to the submap, skipping
+  // those too far away for a local search.
   void ComputeConstraintsForOldScans(const mapping::SubmapId& submap_id)
       REQUIRES(mutex_);
 
+  // Inserts the finished submap with 'submap_id' or the node with 'node_id'
+  // into the spatial indices at its pose in the 'optimization_problem_'.
+  void AddToSpatialIndex(const mapping::SubmapId& submap_id) REQUIRES(mutex_);
+  void AddToSpatialIndex(const mapping::NodeId& node_id) REQUIRES(mutex_);
+
+  // Moves all entries of the spatial indices to their optimized poses.
+  void UpdateSpatialIndices() REQUIRES(mutex_);
+
+  // Inserts the place descriptor of the node with 'node_id' into the
+  // 'place_recognition_index_', if place recognition is enabled.
+  void AddToPlaceRecognitionIndex(const mapping::NodeId& node_id)
+      REQUIRES(mutex_);
+
+  // Returns the finished submaps of other trajectories near the nodes with the
+  // place descriptors most similar to the one of 'node_id'.
+  std::set<mapping::SubmapId> GetPlaceRecognitionCandidates(
+      const mapping::NodeId& node_id) REQUIRES(mutex_);
+
+  // Returns those of 'node_ids' with the place descriptors most similar to the
+  // nodes of the submap with 'submap_id', most similar first.
+  std::vector<mapping::NodeId> GetPlaceRecognitionCandidates(
+      const mapping::SubmapId& submap_id,
+      const std::vector<mapping::NodeId>& node_ids) REQUIRES(mutex_);
+
   // Registers the callback to run the optimization once all constraints have
   // been computed, that will also do all work that queue up in 'work_queue_'.
+  // With 'optimize_with_finished_constraints', the optimization runs right
+  // away with the constraints of all finished scans instead.
   void HandleWorkQueue() REQUIRES(mutex_);
 
   // Waits until we caught up (i.e. nothing is waiting to be scheduled), and
@@ -155,35 +309,67 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   void WaitForAllComputations() EXCLUDES(mutex_);
 
   // Runs the optimization. Callers have to make sure, that there is only one
-  // optimization being run at a time.
-  void RunOptimization() EXCLUDES(mutex_);
+  // optimization being run at a time. If 'interruptible' is true, it ends
+  // early once urgent work arrives or RunFinalOptimization() supersedes it.
+  void RunOptimization(bool interruptible) EXCLUDES(mutex_);
+
+  // Requests the running optimization to end early once
+  // 'interrupt_optimization_work_queue_size' work items wait for it.
+  void InterruptOptimizationIfNeeded() REQUIRES(mutex_);
 
   // Computes the local to global frame transform based on the given optimized
   // 'submap_transforms'.
   transform::Rigid3d ComputeLocalToGlobalTransform(
-      const std::vector<std::map<int, sparse_pose_graph::SubmapData>>&
+      const std::vector<mapping::DenseMapByIndex<sparse_pose_graph::SubmapData>>&
           submap_transforms,
       int trajectory_id) const REQUIRES(mutex_);
 
   mapping::SparsePoseGraph::SubmapData GetSubmapDataUnderLock(
       const mapping::SubmapId& submap_id) REQUIRES(mutex_);
 
+  std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
+  GetAllSubmapDataUnderLock() REQUIRES(mutex_);
+
+  // Replaces 'snapshot_' with the current state.
+  void PublishSnapshot() REQUIRES(mutex_);
+
+  // Returns the 'constraint' relative to the tracking frame of its node
+  // instead of the gravity-aligned frame used by the optimization.
+  Constraint ToTrackingFrame(const Constraint& constraint) REQUIRES(mutex_);
+
   common::Time GetLatestScanTime(const mapping::NodeId& node_id,
                                  const mapping::SubmapId& submap_id) const
       REQUIRES(mutex_);
 
+  // Sheds loop closure work depending on how many added scans still wait for
+  // their constraint search.
+  void UpdateLoadShedding() REQUIRES(mutex_);
+
+  // Adds the constraints of LinkOverlappingTrajectories().
+  void AddOverlapConstraints(int trajectory_id, int other_trajectory_id)
+      REQUIRES(mutex_);
+
   // Updates the trajectory connectivity structure with the new constraints.
   void UpdateTrajectoryConnectivity(
       const sparse_pose_graph::ConstraintBuilder::Result& result)
       REQUIRES(mutex_);
 
   const mapping::proto::SparsePoseGraphOptions options_;
+  common::ThreadPoolInterface* const thread_pool_;
   common::Mutex mutex_;
 
   // If it exists, further work items must be added to this queue, and will be
   // considered later.
-  std::unique_ptr<std::deque<std::function<void()>>> work_queue_
+  std::unique_ptr<mapping::sparse_pose_graph::WorkQueue> work_queue_
       GUARDED_BY(mutex_);
+  // Signaled whenever an item is removed from the 'work_queue_', so that only
+  // threads blocked in WaitForWorkQueueCapacity() are woken up.
+  common::Mutex::Condition work_queue_capacity_available_;
+
+  // Set by RegisterMetrics().
+  metrics::Gauge* work_queue_size_metric_ = nullptr;
+  metrics::Histogram* optimization_time_metric_ = nullptr;
+  metrics::Counter* interrupted_optimizations_metric_ = nullptr;
 
   // How our various trajectories are related.
   mapping::TrajectoryConnectivityState trajectory_connectivity_state_;
@@ -192,31 +378,89 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   std::unordered_map<int, std::unique_ptr<common::FixedRatioSampler>>
       global_localization_samplers_ GUARDED_BY(mutex_);
 
+  // Limits redundant searches where several trajectories overlap.
+  mapping::sparse_pose_graph::CrossTrajectorySearchBudget
+      cross_trajectory_search_budget_ GUARDED_BY(mutex_);
+
   // Number of scans added since last loop closure.
   int num_scans_since_last_loop_closure_ GUARDED_BY(mutex_) = 0;
 
+  // The options which can be changed by UpdateRuntimeOptions().
+  int optimize_every_n_scans_ GUARDED_BY(mutex_);
+  double global_sampling_ratio_ GUARDED_BY(mutex_);
+
+  // Number of scans added by AddScan(), to compute the backlog of the
+  // 'constraint_builder_'.
+  int num_added_scans_ GUARDED_BY(mutex_) = 0;
+  mapping::sparse_pose_graph::LoadSheddingController load_shedding_controller_
+      GUARDED_BY(mutex_);
+
   // Whether the optimization has to be run before more data is added.
   bool run_loop_closure_ GUARDED_BY(mutex_) = false;
 
+  // Whether the scan matchers were warmed up, see WarmUpScanMatchers().
+  bool scan_matchers_warmed_up_ GUARDED_BY(mutex_) = false;
+
+  // Read by the running optimization after every iteration, so that it does
+  // not have to take 'mutex_'. See RunOptimization().
+  std::atomic<bool> interrupt_optimization_{false};
+  // Number of RunFinalOptimization() calls waiting for pending work, which
+  // supersede the optimizations run meanwhile.
+  std::atomic<int> num_pending_final_optimizations_{0};
+
+  // Only set if 'cost_attribution_num_top_submaps' is positive. Declared
+  // before the 'constraint_builder_', which reports to it.
+  std::unique_ptr<mapping::sparse_pose_graph::CostAttribution>
+      cost_attribution_;
+
   // Current optimization problem.
   sparse_pose_graph::OptimizationProblem optimization_problem_;
   sparse_pose_graph::ConstraintBuilder constraint_builder_ GUARDED_BY(mutex_);
-  std::vector<Constraint> constraints_ GUARDED_BY(mutex_);
+  // Records the changes for GetChangesSince(), including those of
+  // 'constraints_'.
+  mapping::sparse_pose_graph::ChangeLog change_log_ GUARDED_BY(mutex_);
+  mapping::sparse_pose_graph::ConstraintStore constraints_ GUARDED_BY(mutex_);
 
   // Submaps get assigned an ID and state as soon as they are seen, even
   // before they take part in the background computations.
   mapping::NestedVectorsById<SubmapData, mapping::SubmapId> submap_data_
       GUARDED_BY(mutex_);
 
+  // Finished submaps and nodes of each trajectory hashed by their global
+  // position, so that a node is only matched against the submaps of its own
+  // trajectory within 'max_constraint_distance' and vice versa.
+  std::map<int, mapping::sparse_pose_graph::SpatialIndex<mapping::SubmapId>>
+      finished_submap_indices_ GUARDED_BY(mutex_);
+  std::map<int, mapping::sparse_pose_graph::SpatialIndex<mapping::NodeId>>
+      node_indices_ GUARDED_BY(mutex_);
+
+  // Place descriptors of all nodes if 'place_recognition_num_candidates' is
+  // positive, to only match against full submaps of other trajectories at
+  // similar places.
+  mapping::sparse_pose_graph::PlaceRecognitionIndex<mapping::NodeId>
+      place_recognition_index_ GUARDED_BY(mutex_);
+
   // Data that are currently being shown.
   mapping::NestedVectorsById<mapping::TrajectoryNode, mapping::NodeId>
       trajectory_nodes_ GUARDED_BY(mutex_);
   int num_trajectory_nodes_ GUARDED_BY(mutex_) = 0;
 
+  // Nodes which still have their data sorted by time, for pose lookups.
+  mapping::sparse_pose_graph::NodeTimeIndex node_time_index_
+      GUARDED_BY(mutex_);
+
   // Current submap transforms used for displaying data.
-  std::vector<std::map<int, sparse_pose_graph::SubmapData>>
+  std::vector<mapping::DenseMapByIndex<sparse_pose_graph::SubmapData>>
       optimized_submap_transforms_ GUARDED_BY(mutex_);
 
+  // Only accessed through std::atomic_load() and std::atomic_store(), so that
+  // readers do not have to take 'mutex_'.
+  std::shared_ptr<const Snapshot> snapshot_;
+
+  // Set by SetComputationProgressCallback().
+  ComputationProgressCallback computation_progress_callback_
+      GUARDED_BY(mutex_);
+
   // List of all trimmers to consult when optimizations finish.
   std::vector<std::unique_ptr<mapping::PoseGraphTrimmer>> trimmers_
       GUARDED_BY(mutex_);
@@ -224,6 +468,18 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   // Set of all frozen trajectories not being optimized.
   std::set<int> frozen_trajectories_ GUARDED_BY(mutex_);
 
+  // Frozen trajectories sharing the frame of the other trajectories.
+  std::set<int> merged_trajectories_ GUARDED_BY(mutex_);
+
+  // Trajectories localizing against the frozen trajectories, see
+  // SetLocalizationTrajectory().
+  std::set<int> localization_trajectories_ GUARDED_BY(mutex_);
+
+  // Runs the optimizations, so that a long solve does not occupy a thread of
+  // the 'thread_pool_'. Declared last so that it is joined before the other
+  // members are destroyed.
+  std::unique_ptr<common::ThreadPool> optimization_thread_;
+
   // Allows querying and manipulating the pose graph by the 'trimmers_'. The
   // 'mutex_' of the pose graph is held while this class is used.
   class TrimmingHandle : public mapping::Trimmable {
@@ -232,6 +488,12 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
     ~TrimmingHandle() override {}
 
     int num_submaps(int trajectory_id) const override;
+    std::vector<mapping::SubmapId> GetFinishedSubmapIds() const override;
+    transform::Rigid3d GetSubmapPose(
+        const mapping::SubmapId& submap_id) const override;
+    Eigen::AlignedBox3d GetSubmapBoundingBox(
+        const mapping::SubmapId& submap_id) const override;
+    std::vector<std::vector<int>> GetConnectedTrajectories() const override;
     void MarkSubmapAsTrimmed(const mapping::SubmapId& submap_id) override;
 
    private:
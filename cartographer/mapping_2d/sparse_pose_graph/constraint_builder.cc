@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping_2d/sparse_pose_graph/constraint_builder.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iomanip>
@@ -26,9 +28,11 @@
 #include <string>
 
 #include "Eigen/Eigenvalues"
+#include "cartographer/common/deadline.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/mapping_2d/scan_matching/proto/ceres_scan_matcher_options.pb.h"
 #include "cartographer/mapping_2d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
 #include "cartographer/transform/transform.h"
@@ -44,20 +48,63 @@ transform::Rigid2d ComputeSubmapPose(const Submap& submap) {
 
 ConstraintBuilder::ConstraintBuilder(
     const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions& options,
-    common::ThreadPool* const thread_pool)
+    common::ThreadPoolInterface* const thread_pool)
+    : ConstraintBuilder(options, common::WorkloadThreadPools(thread_pool)) {}
+
+ConstraintBuilder::ConstraintBuilder(
+    const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions& options,
+    const common::WorkloadThreadPools& thread_pools)
     : options_(options),
-      thread_pool_(thread_pool),
+      thread_pool_(thread_pools.constraints),
+      matcher_construction_thread_pool_(thread_pools.matcher_construction),
+      submap_scan_matchers_(
+          int64{options.scan_matcher_cache_size_mb()} * 1024 * 1024),
+      decompressed_nodes_(
+          int64{options.decompressed_node_cache_size_mb()} * 1024 * 1024),
+      sampling_ratio_(options.sampling_ratio()),
       sampler_(options.sampling_ratio()),
       ceres_scan_matcher_(options.ceres_scan_matcher_options()) {}
 
 ConstraintBuilder::~ConstraintBuilder() {
+  {
+    common::MutexLocker locker(&warm_up_state_->mutex);
+    warm_up_state_->cancelled = true;
+    locker.Await([this]() REQUIRES(warm_up_state_->mutex) {
+      return warm_up_state_->num_running == 0;
+    });
+  }
   common::MutexLocker locker(&mutex_);
   CHECK_EQ(constraints_.size(), 0) << "WhenDone() was not called";
   CHECK_EQ(pending_computations_.size(), 0);
   CHECK_EQ(submap_queued_work_items_.size(), 0);
+  CHECK_EQ(refinement_batches_.size(), 0);
   CHECK(when_done_ == nullptr);
 }
 
+void ConstraintBuilder::RegisterMetrics(metrics::Registry* const registry) {
+  for (const bool match_full_submap : {false, true}) {
+    const metrics::Labels labels = {
+        {"search", match_full_submap ? "global" : "local"}};
+    num_searches_metrics_[match_full_submap] = registry->GetCounter(
+        "cartographer_constraint_builder_searches_total",
+        "Number of constraint searches.", labels);
+    num_constraints_metrics_[match_full_submap] = registry->GetCounter(
+        "cartographer_constraint_builder_constraints_total",
+        "Number of constraints found.", labels);
+    num_precheck_rejections_metrics_[match_full_submap] = registry->GetCounter(
+        "cartographer_constraint_builder_precheck_rejections_total",
+        "Number of constraint searches skipped by the coarse pre-check.",
+        labels);
+  }
+  num_truncated_searches_metric_ = registry->GetCounter(
+      "cartographer_constraint_builder_truncated_searches_total",
+      "Number of global constraint searches stopped by the time limit.");
+  const auto score_bucket_boundaries = metrics::Histogram::FixedWidth(0.05, 20);
+  score_metric_ = registry->GetHistogram(
+      "cartographer_constraint_builder_scores", "Scores of found constraints.",
+      {{"kind", "score"}}, score_bucket_boundaries);
+}
+
 void ConstraintBuilder::MaybeAddConstraint(
     const mapping::SubmapId& submap_id, const Submap* const submap,
     const mapping::NodeId& node_id,
@@ -69,16 +116,51 @@ void ConstraintBuilder::MaybeAddConstraint(
   }
   if (sampler_.Pulse()) {
     common::MutexLocker locker(&mutex_);
-    constraints_.emplace_back();
-    auto* const constraint = &constraints_.back();
+    const std::shared_ptr<const mapping::TrajectoryNode::Data>
+        decompressed_data = decompressed_nodes_.Get(node_id, constant_data);
+    if (options_.use_coarse_precheck() &&
+        !PassesCoarsePrecheck(
+            submap_id, *submap, false /* match_full_submap */,
+            ComputeSubmapPose(*submap) * initial_relative_pose,
+            decompressed_data->filtered_gravity_aligned_point_cloud)) {
+      return;
+    }
+    constraints_.emplace_back(current_computation_, nullptr);
+    auto* const constraint = &constraints_.back().second;
     ++pending_computations_[current_computation_];
     const int current_computation = current_computation_;
+    const std::shared_ptr<scan_matching::RotatedScanCache> rotated_scan_cache =
+        GetRotatedScanCache(node_id, decompressed_data.get(), submap);
+    const std::shared_ptr<RefinementBatch> refinement_batch =
+        GetRefinementBatch(submap_id, submap);
+    const SearchCost search_cost = AddPendingSearch(
+        *submap, false /* match_full_submap */,
+        decompressed_data->filtered_gravity_aligned_point_cloud.size());
     ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
-        submap_id, &submap->probability_grid(), [=]() EXCLUDES(mutex_) {
-          ComputeConstraint(submap_id, submap, node_id,
-                            false, /* match_full_submap */
-                            constant_data, initial_relative_pose, constraint);
-          FinishComputation(current_computation);
+        submap_id, &submap->probability_grid(),
+        common::WorkItemPriority::kNormal, "local_constraint_search_2d",
+        search_cost.value_per_second,
+        [=](const SubmapScanMatcher& submap_scan_matcher) EXCLUDES(mutex_) {
+          const auto start_time = std::chrono::steady_clock::now();
+          const bool found_match = ComputeConstraint(
+              submap_id, submap, node_id, false, /* match_full_submap */
+              decompressed_data, initial_relative_pose,
+              rotated_scan_cache.get(), submap_scan_matcher,
+              refinement_batch.get(), constraint);
+          const double seconds =
+              std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start_time)
+                  .count();
+          FinishPendingSearch(search_cost, seconds, found_match);
+          if (cost_attribution_ != nullptr) {
+            cost_attribution_->AddConstraintSearch(
+                submap_id, node_id.trajectory_id, seconds, found_match);
+          }
+          if (refinement_batch == nullptr) {
+            FinishComputation(current_computation);
+          } else {
+            FinishBatchedSearch(refinement_batch, submap_scan_matcher);
+          }
         });
   }
 }
@@ -88,22 +170,64 @@ void ConstraintBuilder::MaybeAddGlobalConstraint(
     const mapping::NodeId& node_id,
     const mapping::TrajectoryNode::Data* const constant_data) {
   common::MutexLocker locker(&mutex_);
-  constraints_.emplace_back();
-  auto* const constraint = &constraints_.back();
+  const std::shared_ptr<const mapping::TrajectoryNode::Data> decompressed_data =
+      decompressed_nodes_.Get(node_id, constant_data);
+  if (options_.use_coarse_precheck() &&
+      !PassesCoarsePrecheck(
+          submap_id, *submap, true /* match_full_submap */,
+          transform::Rigid2d::Identity(),
+          decompressed_data->filtered_gravity_aligned_point_cloud)) {
+    return;
+  }
+  constraints_.emplace_back(current_computation_, nullptr);
+  auto* const constraint = &constraints_.back().second;
   ++pending_computations_[current_computation_];
   const int current_computation = current_computation_;
+  const std::shared_ptr<scan_matching::RotatedScanCache> rotated_scan_cache =
+      GetRotatedScanCache(node_id, decompressed_data.get(), submap);
+  const SearchCost search_cost = AddPendingSearch(
+      *submap, true /* match_full_submap */,
+      decompressed_data->filtered_gravity_aligned_point_cloud.size());
   ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
-      submap_id, &submap->probability_grid(), [=]() EXCLUDES(mutex_) {
-        ComputeConstraint(
+      submap_id, &submap->probability_grid(), common::WorkItemPriority::kLow,
+      "global_constraint_search_2d", search_cost.value_per_second,
+      [=](const SubmapScanMatcher& submap_scan_matcher) EXCLUDES(mutex_) {
+        const auto start_time = std::chrono::steady_clock::now();
+        const bool found_match = ComputeConstraint(
             submap_id, submap, node_id, true, /* match_full_submap */
-            constant_data, transform::Rigid2d::Identity(), constraint);
+            decompressed_data, transform::Rigid2d::Identity(),
+            rotated_scan_cache.get(), submap_scan_matcher,
+            nullptr /* refinement_batch */, constraint);
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start_time)
+                .count();
+        FinishPendingSearch(search_cost, seconds, found_match);
+        if (cost_attribution_ != nullptr) {
+          cost_attribution_->AddConstraintSearch(
+              submap_id, node_id.trajectory_id, seconds, found_match);
+        }
         FinishComputation(current_computation);
       });
 }
 
+void ConstraintBuilder::SetSamplingRatioFactor(const double factor) {
+  sampling_ratio_factor_ = factor;
+  sampler_.SetRatio(sampling_ratio_ * sampling_ratio_factor_);
+}
+
+void ConstraintBuilder::SetSamplingRatio(const double sampling_ratio) {
+  CHECK_GT(sampling_ratio, 0.);
+  CHECK_LE(sampling_ratio, 1.);
+  sampling_ratio_ = sampling_ratio;
+  sampler_.SetRatio(sampling_ratio_ * sampling_ratio_factor_);
+}
+
 void ConstraintBuilder::NotifyEndOfScan() {
   common::MutexLocker locker(&mutex_);
   ++current_computation_;
+  rotated_scan_caches_.clear();
+  SealRefinementBatches();
 }
 
 void ConstraintBuilder::WhenDone(
@@ -112,60 +236,353 @@ void ConstraintBuilder::WhenDone(
   CHECK(when_done_ == nullptr);
   when_done_ =
       common::make_unique<std::function<void(const Result&)>>(callback);
+  SealRefinementBatches();
   ++pending_computations_[current_computation_];
   const int current_computation = current_computation_;
   thread_pool_->Schedule(
-      [this, current_computation] { FinishComputation(current_computation); });
+      [this, current_computation] { FinishComputation(current_computation); },
+      common::WorkItemPriority::kHigh, "finish_computation_2d");
 }
 
 void ConstraintBuilder::ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
     const mapping::SubmapId& submap_id, const ProbabilityGrid* const submap,
-    const std::function<void()>& work_item) {
-  if (submap_scan_matchers_[submap_id].fast_correlative_scan_matcher !=
-      nullptr) {
-    thread_pool_->Schedule(work_item);
-  } else {
-    submap_queued_work_items_[submap_id].push_back(work_item);
-    if (submap_queued_work_items_[submap_id].size() == 1) {
-      thread_pool_->Schedule(
-          [=]() { ConstructSubmapScanMatcher(submap_id, submap); });
+    const common::WorkItemPriority priority, const string& label,
+    const double value_per_second, const SubmapScanMatcherWorkItem& work_item) {
+  if (submap_queued_work_items_.count(submap_id) == 0) {
+    std::shared_ptr<const SubmapScanMatcher> submap_scan_matcher =
+        submap_scan_matchers_.Get(submap_id);
+    if (submap_scan_matcher != nullptr) {
+      ScheduleWithSubmapScanMatcher(std::move(submap_scan_matcher), priority,
+                                    label, value_per_second, work_item);
+      return;
     }
+    // The scan matcher has not been constructed yet, or has been evicted.
+    matcher_construction_thread_pool_->Schedule(
+        [=]() {
+          ConstructSubmapScanMatcher(submap_id, submap,
+                                     nullptr /* shared_submap */);
+        },
+        common::WorkItemPriority::kLowest, "precompute_scan_matcher_2d");
+  }
+  submap_queued_work_items_[submap_id].push_back(
+      {priority, label, value_per_second, work_item});
+}
+
+void ConstraintBuilder::ScheduleWithSubmapScanMatcher(
+    std::shared_ptr<const SubmapScanMatcher> submap_scan_matcher,
+    const common::WorkItemPriority priority, const string& label,
+    const double value_per_second, const SubmapScanMatcherWorkItem& work_item) {
+  if (options_.order_searches_by_value()) {
+    ordered_searches_.emplace(value_per_second, [submap_scan_matcher,
+                                                 work_item]() {
+      work_item(*submap_scan_matcher);
+    });
+    // Which search runs is only decided when the work item starts, so the
+    // statistics of all searches share one label.
+    thread_pool_->Schedule([this]() { RunMostValuableSearch(); }, priority,
+                           "constraint_search_2d");
+    return;
+  }
+  thread_pool_->Schedule(
+      [submap_scan_matcher, work_item]() { work_item(*submap_scan_matcher); },
+      priority, label);
+}
+
+void ConstraintBuilder::RunMostValuableSearch() {
+  std::function<void()> search;
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK(!ordered_searches_.empty());
+    search = std::move(ordered_searches_.begin()->second);
+    ordered_searches_.erase(ordered_searches_.begin());
+  }
+  search();
+}
+
+ConstraintBuilder::SearchCost ConstraintBuilder::AddPendingSearch(
+    const Submap& submap, const bool match_full_submap, const int num_points) {
+  SearchCost search_cost;
+  search_cost.search_type = {match_full_submap,
+                             submap.probability_grid().limits().resolution()};
+  search_cost.num_points = num_points;
+  common::MutexLocker locker(&statistics_mutex_);
+  search_cost.predicted_seconds =
+      cost_model_.PredictSeconds(search_cost.search_type, num_points);
+  search_cost.value_per_second =
+      cost_model_.PredictValuePerSecond(search_cost.search_type, num_points);
+  pending_search_seconds_ += search_cost.predicted_seconds;
+  return search_cost;
+}
+
+void ConstraintBuilder::FinishPendingSearch(const SearchCost& search_cost,
+                                            const double seconds,
+                                            const bool found_match) {
+  common::MutexLocker locker(&statistics_mutex_);
+  cost_model_.AddSearch(search_cost.search_type, search_cost.num_points,
+                        seconds, found_match);
+  pending_search_seconds_ =
+      std::max(0., pending_search_seconds_ - search_cost.predicted_seconds);
+}
+
+double ConstraintBuilder::GetPendingSearchSeconds() {
+  common::MutexLocker locker(&statistics_mutex_);
+  return pending_search_seconds_;
+}
+
+void ConstraintBuilder::WarmUpScanMatchers(
+    const std::vector<std::pair<mapping::SubmapId,
+                                std::shared_ptr<const Submap>>>& submaps,
+    const int num_urgent_submaps) {
+  const std::shared_ptr<WarmUpState> warm_up_state = warm_up_state_;
+  for (size_t i = 0; i != submaps.size(); ++i) {
+    const mapping::SubmapId submap_id = submaps[i].first;
+    const std::shared_ptr<const Submap> submap = submaps[i].second;
+    const bool urgent = static_cast<int>(i) < num_urgent_submaps;
+    // Constructions of the same priority run in the order they are scheduled.
+    matcher_construction_thread_pool_->Schedule(
+        [this, warm_up_state, submap_id, submap, urgent]() {
+          {
+            common::MutexLocker locker(&warm_up_state->mutex);
+            if (warm_up_state->cancelled) {
+              return;
+            }
+            ++warm_up_state->num_running;
+          }
+          bool construct = true;
+          if (!urgent) {
+            // Scan matchers constructed further away would evict the ones
+            // closer by.
+            common::MutexLocker locker(&mutex_);
+            construct = !submap_scan_matchers_.full() ||
+                        submap_queued_work_items_.count(submap_id) != 0;
+          }
+          if (construct) {
+            ConstructSubmapScanMatcher(submap_id, &submap->probability_grid(),
+                                       submap);
+          }
+          common::MutexLocker locker(&warm_up_state->mutex);
+          --warm_up_state->num_running;
+        },
+        urgent ? common::WorkItemPriority::kHigh
+               : common::WorkItemPriority::kLowest,
+        "warm_up_scan_matcher_2d");
   }
 }
 
 void ConstraintBuilder::ConstructSubmapScanMatcher(
-    const mapping::SubmapId& submap_id, const ProbabilityGrid* const submap) {
-  auto submap_scan_matcher =
-      common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
-          *submap, options_.fast_correlative_scan_matcher_options());
+    const mapping::SubmapId& submap_id, const ProbabilityGrid* submap,
+    std::shared_ptr<const Submap> shared_submap) {
+  {
+    common::MutexLocker locker(&mutex_);
+    if (constructing_scan_matchers_.count(submap_id) != 0 ||
+        (submap_queued_work_items_.count(submap_id) == 0 &&
+         submap_scan_matchers_.Contains(submap_id))) {
+      return;
+    }
+    constructing_scan_matchers_.insert(submap_id);
+  }
+  const auto start_time = std::chrono::steady_clock::now();
+  const std::shared_ptr<const io::MappedBlobFile> precomputed_grids =
+      GetPrecomputedGrids(submap_id);
+  auto submap_scan_matcher = std::make_shared<SubmapScanMatcher>();
+  int64 memory_usage_in_bytes = 0;
+  const SubmapLoader submap_loader = GetSubmapLoader(submap_id);
+  if (submap_loader != nullptr) {
+    submap_scan_matcher->loaded_submap = submap_loader(submap_id);
+    CHECK(submap_scan_matcher->loaded_submap != nullptr) << submap_id;
+    submap = &submap_scan_matcher->loaded_submap->probability_grid();
+    memory_usage_in_bytes += submap->GetMemoryUsageInBytes();
+  } else {
+    submap_scan_matcher->loaded_submap = std::move(shared_submap);
+  }
+  submap_scan_matcher->probability_grid = submap;
+  std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+      speculative_scan_matcher = TakeSpeculativeScanMatcher(submap_id);
+  if (precomputed_grids != nullptr) {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            *submap, options_.fast_correlative_scan_matcher_options(),
+            precomputed_grids, submap_id.submap_index);
+  } else if (speculative_scan_matcher != nullptr) {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            *submap, options_.fast_correlative_scan_matcher_options(),
+            std::move(speculative_scan_matcher));
+  } else {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            *submap, options_.fast_correlative_scan_matcher_options());
+  }
+  memory_usage_in_bytes += submap_scan_matcher->fast_correlative_scan_matcher
+                               ->GetMemoryUsageInBytes();
+  if (cost_attribution_ != nullptr) {
+    cost_attribution_->AddScanMatcherConstruction(
+        submap_id, std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count());
+  }
   common::MutexLocker locker(&mutex_);
-  submap_scan_matchers_[submap_id] = {submap, std::move(submap_scan_matcher)};
-  for (const std::function<void()>& work_item :
+  submap_scan_matchers_.Insert(submap_id, submap_scan_matcher,
+                               memory_usage_in_bytes);
+  for (const QueuedWorkItem& queued_work_item :
        submap_queued_work_items_[submap_id]) {
-    thread_pool_->Schedule(work_item);
+    ScheduleWithSubmapScanMatcher(
+        submap_scan_matcher, queued_work_item.priority, queued_work_item.label,
+        queued_work_item.value_per_second, queued_work_item.work_item);
   }
   submap_queued_work_items_.erase(submap_id);
+  constructing_scan_matchers_.erase(submap_id);
+}
+
+std::shared_ptr<const io::MappedBlobFile>
+ConstraintBuilder::GetPrecomputedGrids(const mapping::SubmapId& submap_id) {
+  common::MutexLocker locker(&mutex_);
+  const auto it = precomputed_grids_.find(submap_id.trajectory_id);
+  if (it == precomputed_grids_.end() ||
+      submap_id.submap_index >= it->second->num_blobs()) {
+    return nullptr;
+  }
+  return it->second;
 }
 
-const ConstraintBuilder::SubmapScanMatcher*
-ConstraintBuilder::GetSubmapScanMatcher(const mapping::SubmapId& submap_id) {
+ConstraintBuilder::SubmapLoader ConstraintBuilder::GetSubmapLoader(
+    const mapping::SubmapId& submap_id) {
   common::MutexLocker locker(&mutex_);
-  const SubmapScanMatcher* submap_scan_matcher =
-      &submap_scan_matchers_[submap_id];
-  CHECK(submap_scan_matcher->fast_correlative_scan_matcher != nullptr);
-  return submap_scan_matcher;
+  const auto it = submap_loaders_.find(submap_id.trajectory_id);
+  if (it == submap_loaders_.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+ConstraintBuilder::TakeSpeculativeScanMatcher(
+    const mapping::SubmapId& submap_id) {
+  common::MutexLocker locker(&speculative_scan_matchers_->mutex);
+  auto& scan_matchers = speculative_scan_matchers_->scan_matchers;
+  const auto it = scan_matchers.find(submap_id);
+  if (it == scan_matchers.end()) {
+    return nullptr;
+  }
+  // If the construction is still running, its result is discarded.
+  std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+      speculative_scan_matcher = std::move(it->second);
+  scan_matchers.erase(it);
+  return speculative_scan_matcher;
+}
+
+bool ConstraintBuilder::PassesCoarsePrecheck(
+    const mapping::SubmapId& submap_id, const Submap& submap,
+    const bool match_full_submap, const transform::Rigid2d& initial_pose,
+    const sensor::PointCloud& point_cloud) {
+  const CoarseProbabilityGrid* const coarse_probability_grid =
+      submap.coarse_probability_grid();
+  if (coarse_probability_grid == nullptr) {
+    return true;
+  }
+  float score_bound;
+  float min_score;
+  if (match_full_submap) {
+    // The full submap search may place the points anywhere.
+    score_bound = coarse_probability_grid->GetMaxProbability();
+    min_score = options_.global_localization_min_score();
+  } else {
+    const auto& fast_correlative_scan_matcher_options =
+        options_.fast_correlative_scan_matcher_options();
+    auto& dilated_coarse_probability_grid =
+        dilated_coarse_probability_grids_[submap_id];
+    if (dilated_coarse_probability_grid == nullptr) {
+      // Points move by up to the linear search window, by half a cell more
+      // between the orientations sampled by ComputeMaxScoreOverRotations(),
+      // and by less than another cell since the search window is rounded to
+      // whole cells of the submap.
+      const int radius =
+          std::ceil(fast_correlative_scan_matcher_options
+                        .linear_search_window() /
+                    coarse_probability_grid->limits().resolution()) +
+          2;
+      dilated_coarse_probability_grid =
+          common::make_unique<const CoarseProbabilityGrid>(
+              coarse_probability_grid->Dilate(radius));
+    }
+    score_bound = dilated_coarse_probability_grid->ComputeMaxScoreOverRotations(
+        point_cloud, initial_pose,
+        fast_correlative_scan_matcher_options.angular_search_window());
+    min_score = options_.min_score();
+  }
+  if (score_bound > min_score) {
+    return true;
+  }
+  ++num_precheck_rejections_;
+  if (num_precheck_rejections_metrics_[match_full_submap] != nullptr) {
+    num_precheck_rejections_metrics_[match_full_submap]->Increment();
+  }
+  return false;
+}
+
+std::shared_ptr<scan_matching::RotatedScanCache>
+ConstraintBuilder::GetRotatedScanCache(
+    const mapping::NodeId& node_id,
+    const mapping::TrajectoryNode::Data* const constant_data,
+    const Submap* const submap) {
+  const double resolution = submap->probability_grid().limits().resolution();
+  auto& rotated_scan_cache =
+      rotated_scan_caches_[std::make_pair(node_id, resolution)];
+  if (rotated_scan_cache == nullptr) {
+    rotated_scan_cache = std::make_shared<scan_matching::RotatedScanCache>(
+        constant_data->filtered_gravity_aligned_point_cloud, resolution);
+  }
+  return rotated_scan_cache;
 }
 
-void ConstraintBuilder::ComputeConstraint(
+std::shared_ptr<ConstraintBuilder::RefinementBatch>
+ConstraintBuilder::GetRefinementBatch(const mapping::SubmapId& submap_id,
+                                      const Submap* const submap) {
+  if (options_.refinement_batch_num_threads() == 0) {
+    return nullptr;
+  }
+  auto& refinement_batch = refinement_batches_[submap_id];
+  if (refinement_batch == nullptr) {
+    refinement_batch = std::make_shared<RefinementBatch>();
+    refinement_batch->submap_id = submap_id;
+    refinement_batch->submap = submap;
+    refinement_batch->computation_index = current_computation_;
+  }
+  common::MutexLocker locker(&refinement_batch->mutex);
+  ++refinement_batch->num_searches;
+  ++refinement_batch->num_pending_searches;
+  return refinement_batch;
+}
+
+void ConstraintBuilder::SealRefinementBatches() {
+  for (const auto& entry : refinement_batches_) {
+    const std::shared_ptr<RefinementBatch> refinement_batch = entry.second;
+    common::MutexLocker locker(&refinement_batch->mutex);
+    refinement_batch->sealed = true;
+    if (refinement_batch->num_pending_searches == 0) {
+      thread_pool_->Schedule(
+          [this, refinement_batch]() { RefineBatch(refinement_batch.get()); },
+          common::WorkItemPriority::kNormal, "refine_constraints_2d");
+    }
+  }
+  refinement_batches_.clear();
+}
+
+bool ConstraintBuilder::ComputeConstraint(
     const mapping::SubmapId& submap_id, const Submap* const submap,
     const mapping::NodeId& node_id, bool match_full_submap,
-    const mapping::TrajectoryNode::Data* const constant_data,
+    const std::shared_ptr<const mapping::TrajectoryNode::Data>& constant_data,
     const transform::Rigid2d& initial_relative_pose,
+    scan_matching::RotatedScanCache* const rotated_scan_cache,
+    const SubmapScanMatcher& submap_scan_matcher,
+    RefinementBatch* const refinement_batch,
     std::unique_ptr<ConstraintBuilder::Constraint>* constraint) {
+  CARTOGRAPHER_TRACE_SPAN("ConstraintBuilder::ComputeConstraint");
+  if (num_searches_metrics_[match_full_submap] != nullptr) {
+    num_searches_metrics_[match_full_submap]->Increment();
+  }
   const transform::Rigid2d initial_pose =
       ComputeSubmapPose(*submap) * initial_relative_pose;
-  const SubmapScanMatcher* const submap_scan_matcher =
-      GetSubmapScanMatcher(submap_id);
 
   // The 'constraint_transform' (submap i <- scan j) is computed from:
   // - a 'filtered_gravity_aligned_point_cloud' in scan j,
@@ -180,99 +597,216 @@ void ConstraintBuilder::ComputeConstraint(
   // 2. Prune if the score is too low.
   // 3. Refine.
   if (match_full_submap) {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->MatchFullSubmap(
-            constant_data->filtered_gravity_aligned_point_cloud,
-            options_.global_localization_min_score(), &score, &pose_estimate)) {
+    std::unique_ptr<common::Deadline> deadline;
+    if (options_.global_localization_time_limit_seconds() > 0.) {
+      deadline = common::make_unique<common::Deadline>(common::FromSeconds(
+          options_.global_localization_time_limit_seconds()));
+    }
+    const bool success =
+        submap_scan_matcher.fast_correlative_scan_matcher->MatchFullSubmap(
+            rotated_scan_cache, options_.global_localization_min_score(),
+            thread_pool_, options_.global_localization_num_tasks(),
+            deadline.get(), &score, &pose_estimate);
+    if (deadline != nullptr && deadline->expired() &&
+        num_truncated_searches_metric_ != nullptr) {
+      num_truncated_searches_metric_->Increment();
+    }
+    if (success) {
       CHECK_GT(score, options_.global_localization_min_score());
       CHECK_GE(node_id.trajectory_id, 0);
       CHECK_GE(submap_id.trajectory_id, 0);
     } else {
-      return;
+      return false;
     }
   } else {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->Match(
-            initial_pose, constant_data->filtered_gravity_aligned_point_cloud,
-            options_.min_score(), &score, &pose_estimate)) {
+    if (submap_scan_matcher.fast_correlative_scan_matcher->Match(
+            initial_pose, rotated_scan_cache, options_.min_score(), &score,
+            &pose_estimate)) {
       // We've reported a successful local match.
       CHECK_GT(score, options_.min_score());
     } else {
-      return;
+      return false;
     }
   }
   {
-    common::MutexLocker locker(&mutex_);
+    common::MutexLocker locker(&statistics_mutex_);
     score_histogram_.Add(score);
   }
+  if (score_metric_ != nullptr) {
+    num_constraints_metrics_[match_full_submap]->Increment();
+    score_metric_->Observe(score);
+  }
+
+  const PendingRefinement refinement{
+      node_id, constant_data,     initial_pose, pose_estimate,
+      score,   match_full_submap, constraint};
+  if (refinement_batch != nullptr) {
+    common::MutexLocker locker(&refinement_batch->mutex);
+    refinement_batch->refinements.push_back(refinement);
+    return true;
+  }
+  RefineConstraints(submap_id, *submap, *submap_scan_matcher.probability_grid,
+                    {refinement});
+  return true;
+}
 
+void ConstraintBuilder::RefineConstraints(
+    const mapping::SubmapId& submap_id, const Submap& submap,
+    const ProbabilityGrid& probability_grid,
+    const std::vector<PendingRefinement>& refinements) {
+  if (refinements.empty()) {
+    return;
+  }
   // Use the CSM estimate as both the initial and previous pose. This has the
   // effect that, in the absence of better information, we prefer the original
   // CSM estimate.
+  std::vector<transform::Rigid2d> pose_estimates;
   ceres::Solver::Summary unused_summary;
-  ceres_scan_matcher_.Match(pose_estimate, pose_estimate,
-                            constant_data->filtered_gravity_aligned_point_cloud,
-                            *submap_scan_matcher->probability_grid,
-                            &pose_estimate, &unused_summary);
-
-  const transform::Rigid2d constraint_transform =
-      ComputeSubmapPose(*submap).inverse() * pose_estimate;
-  constraint->reset(new Constraint{submap_id,
-                                   node_id,
-                                   {transform::Embed3D(constraint_transform),
-                                    options_.loop_closure_translation_weight(),
-                                    options_.loop_closure_rotation_weight()},
-                                   Constraint::INTER_SUBMAP});
-
-  if (options_.log_matches()) {
-    std::ostringstream info;
-    info << "Node " << node_id << " with "
-         << constant_data->filtered_gravity_aligned_point_cloud.size()
-         << " points on submap " << submap_id << std::fixed;
-    if (match_full_submap) {
-      info << " matches";
-    } else {
-      const transform::Rigid2d difference =
-          initial_pose.inverse() * pose_estimate;
-      info << " differs by translation " << std::setprecision(2)
-           << difference.translation().norm() << " rotation "
-           << std::setprecision(3) << std::abs(difference.normalized_angle());
+  if (refinements.size() == 1) {
+    const PendingRefinement& refinement = refinements.front();
+    pose_estimates.push_back(refinement.pose_estimate);
+    ceres_scan_matcher_.Match(
+        refinement.pose_estimate, refinement.pose_estimate,
+        refinement.constant_data->filtered_gravity_aligned_point_cloud,
+        probability_grid, &pose_estimates.front(), &unused_summary);
+  } else {
+    std::vector<const sensor::PointCloud*> point_clouds;
+    for (const PendingRefinement& refinement : refinements) {
+      point_clouds.push_back(
+          &refinement.constant_data->filtered_gravity_aligned_point_cloud);
+      pose_estimates.push_back(refinement.pose_estimate);
+    }
+    ceres_scan_matcher_.MatchBatch(point_clouds, probability_grid,
+                                   options_.refinement_batch_num_threads(),
+                                   &pose_estimates, &unused_summary);
+  }
+
+  const transform::Rigid2d submap_pose_inverse =
+      ComputeSubmapPose(submap).inverse();
+  for (size_t i = 0; i != refinements.size(); ++i) {
+    const PendingRefinement& refinement = refinements[i];
+    const transform::Rigid2d& pose_estimate = pose_estimates[i];
+    const transform::Rigid2d constraint_transform =
+        submap_pose_inverse * pose_estimate;
+    refinement.constraint->reset(
+        new Constraint{submap_id,
+                       refinement.node_id,
+                       {transform::Embed3D(constraint_transform),
+                        options_.loop_closure_translation_weight(),
+                        options_.loop_closure_rotation_weight()},
+                       Constraint::INTER_SUBMAP});
+
+    if (options_.log_matches()) {
+      std::ostringstream info;
+      info << "Node " << refinement.node_id << " with "
+           << refinement.constant_data->filtered_gravity_aligned_point_cloud
+                  .size()
+           << " points on submap " << submap_id << std::fixed;
+      if (refinement.match_full_submap) {
+        info << " matches";
+      } else {
+        const transform::Rigid2d difference =
+            refinement.initial_pose.inverse() * pose_estimate;
+        info << " differs by translation " << std::setprecision(2)
+             << difference.translation().norm() << " rotation "
+             << std::setprecision(3)
+             << std::abs(difference.normalized_angle());
+      }
+      info << " with score " << std::setprecision(1)
+           << 100. * refinement.score << "%.";
+      LOG(INFO) << info.str();
     }
-    info << " with score " << std::setprecision(1) << 100. * score << "%.";
-    LOG(INFO) << info.str();
+  }
+}
+
+void ConstraintBuilder::FinishBatchedSearch(
+    const std::shared_ptr<RefinementBatch>& refinement_batch,
+    const SubmapScanMatcher& submap_scan_matcher) {
+  {
+    common::MutexLocker locker(&refinement_batch->mutex);
+    refinement_batch->loaded_submap = submap_scan_matcher.loaded_submap;
+    refinement_batch->probability_grid = submap_scan_matcher.probability_grid;
+    if (--refinement_batch->num_pending_searches != 0 ||
+        !refinement_batch->sealed) {
+      return;
+    }
+  }
+  RefineBatch(refinement_batch.get());
+}
+
+void ConstraintBuilder::RefineBatch(RefinementBatch* const refinement_batch) {
+  int num_searches;
+  {
+    common::MutexLocker locker(&refinement_batch->mutex);
+    CHECK(refinement_batch->probability_grid != nullptr);
+    RefineConstraints(refinement_batch->submap_id, *refinement_batch->submap,
+                      *refinement_batch->probability_grid,
+                      refinement_batch->refinements);
+    num_searches = refinement_batch->num_searches;
+  }
+  for (int i = 0; i != num_searches; ++i) {
+    FinishComputation(refinement_batch->computation_index);
   }
 }
 
 void ConstraintBuilder::FinishComputation(const int computation_index) {
   Result result;
   std::unique_ptr<std::function<void(const Result&)>> callback;
+  bool scan_finished = false;
   {
     common::MutexLocker locker(&mutex_);
     if (--pending_computations_[computation_index] == 0) {
+      scan_finished =
+          pending_computations_.begin()->first == computation_index;
       pending_computations_.erase(computation_index);
     }
     if (pending_computations_.empty()) {
       CHECK_EQ(submap_queued_work_items_.size(), 0);
       if (when_done_ != nullptr) {
-        for (const std::unique_ptr<Constraint>& constraint : constraints_) {
-          if (constraint != nullptr) {
-            result.push_back(*constraint);
+        for (const auto& entry : constraints_) {
+          if (entry.second != nullptr) {
+            result.push_back(*entry.second);
           }
         }
         if (options_.log_matches()) {
           LOG(INFO) << constraints_.size() << " computations resulted in "
-                    << result.size() << " additional constraints.";
+                    << result.size() << " additional constraints, "
+                    << num_precheck_rejections_
+                    << " were skipped by the coarse pre-check.";
+          common::MutexLocker statistics_locker(&statistics_mutex_);
           LOG(INFO) << "Score histogram:\n" << score_histogram_.ToString(10);
+          LOG(INFO) << "Search costs:\n" << cost_model_.ToString();
+          LOG(INFO) << "Scan matcher cache: " << submap_scan_matchers_.size()
+                    << " scan matchers using "
+                    << submap_scan_matchers_.size_in_bytes() / (1024 * 1024)
+                    << " MiB, "
+                    << submap_scan_matchers_.statistics().ToString() << ".";
         }
         constraints_.clear();
+        num_precheck_rejections_ = 0;
         callback = std::move(when_done_);
         when_done_.reset();
       }
     }
   }
+  if (scan_finished && scan_finished_callback_ != nullptr) {
+    scan_finished_callback_();
+  }
   if (callback != nullptr) {
     (*callback)(result);
   }
 }
 
+void ConstraintBuilder::SetScanFinishedCallback(
+    std::function<void()> callback) {
+  scan_finished_callback_ = std::move(callback);
+}
+
+void ConstraintBuilder::SetCostAttribution(
+    mapping::sparse_pose_graph::CostAttribution* const cost_attribution) {
+  cost_attribution_ = cost_attribution;
+}
+
 int ConstraintBuilder::GetNumFinishedScans() {
   common::MutexLocker locker(&mutex_);
   if (pending_computations_.empty()) {
@@ -281,10 +815,110 @@ int ConstraintBuilder::GetNumFinishedScans() {
   return pending_computations_.begin()->first;
 }
 
+int64 ConstraintBuilder::GetMemoryUsageInBytes() {
+  common::MutexLocker locker(&mutex_);
+  int64 memory_usage_in_bytes = submap_scan_matchers_.size_in_bytes();
+  for (const auto& entry : dilated_coarse_probability_grids_) {
+    memory_usage_in_bytes += entry.second->GetMemoryUsageInBytes();
+  }
+  common::MutexLocker speculative_locker(&speculative_scan_matchers_->mutex);
+  for (const auto& entry : speculative_scan_matchers_->scan_matchers) {
+    // Scan matchers still being constructed are nullptr.
+    if (entry.second != nullptr) {
+      memory_usage_in_bytes += entry.second->GetMemoryUsageInBytes();
+    }
+  }
+  return memory_usage_in_bytes;
+}
+
+ConstraintBuilder::Result ConstraintBuilder::TakeFinishedConstraints() {
+  common::MutexLocker locker(&mutex_);
+  const int num_finished_scans = pending_computations_.empty()
+                                     ? current_computation_
+                                     : pending_computations_.begin()->first;
+  Result result;
+  while (!constraints_.empty() &&
+         constraints_.front().first < num_finished_scans) {
+    if (constraints_.front().second != nullptr) {
+      result.push_back(*constraints_.front().second);
+    }
+    constraints_.pop_front();
+  }
+  return result;
+}
+
 void ConstraintBuilder::DeleteScanMatcher(const mapping::SubmapId& submap_id) {
   common::MutexLocker locker(&mutex_);
   CHECK(pending_computations_.empty());
-  submap_scan_matchers_.erase(submap_id);
+  submap_scan_matchers_.Erase(submap_id);
+  dilated_coarse_probability_grids_.erase(submap_id);
+  common::MutexLocker speculative_locker(&speculative_scan_matchers_->mutex);
+  speculative_scan_matchers_->scan_matchers.erase(submap_id);
+}
+
+void ConstraintBuilder::PrecomputeScanMatcherSpeculatively(
+    const mapping::SubmapId& submap_id,
+    const ProbabilityGrid& probability_grid) {
+  {
+    common::MutexLocker locker(&mutex_);
+    if (precomputed_grids_.count(submap_id.trajectory_id) != 0 ||
+        submap_loaders_.count(submap_id.trajectory_id) != 0) {
+      return;
+    }
+  }
+  {
+    common::MutexLocker locker(&speculative_scan_matchers_->mutex);
+    if (!speculative_scan_matchers_->scan_matchers
+             .emplace(submap_id, nullptr)
+             .second) {
+      return;
+    }
+  }
+  // The copy is taken now, since the submap keeps changing until finished.
+  const auto probability_grid_copy =
+      std::make_shared<const ProbabilityGrid>(probability_grid);
+  const std::shared_ptr<SpeculativeScanMatchers> speculative_scan_matchers =
+      speculative_scan_matchers_;
+  const auto& options = options_.fast_correlative_scan_matcher_options();
+  mapping::sparse_pose_graph::CostAttribution* const cost_attribution =
+      cost_attribution_;
+  matcher_construction_thread_pool_->Schedule(
+      [speculative_scan_matchers, submap_id, probability_grid_copy, options,
+       cost_attribution]() {
+        const auto start_time = std::chrono::steady_clock::now();
+        auto fast_correlative_scan_matcher =
+            common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+                *probability_grid_copy, options);
+        if (cost_attribution != nullptr) {
+          cost_attribution->AddScanMatcherConstruction(
+              submap_id, std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start_time)
+                             .count());
+        }
+        common::MutexLocker locker(&speculative_scan_matchers->mutex);
+        const auto it =
+            speculative_scan_matchers->scan_matchers.find(submap_id);
+        if (it != speculative_scan_matchers->scan_matchers.end()) {
+          it->second = std::move(fast_correlative_scan_matcher);
+        }
+      },
+      common::WorkItemPriority::kLowest,
+      "speculative_precompute_scan_matcher_2d");
+}
+
+void ConstraintBuilder::SetPrecomputedGrids(
+    const int trajectory_id,
+    std::shared_ptr<const io::MappedBlobFile> mapped_blob_file) {
+  CHECK(mapped_blob_file != nullptr);
+  common::MutexLocker locker(&mutex_);
+  precomputed_grids_[trajectory_id] = std::move(mapped_blob_file);
+}
+
+void ConstraintBuilder::SetSubmapLoader(const int trajectory_id,
+                                        SubmapLoader submap_loader) {
+  CHECK(submap_loader != nullptr);
+  common::MutexLocker locker(&mutex_);
+  submap_loaders_[trajectory_id] = std::move(submap_loader);
 }
 
 }  // namespace sparse_pose_graph
@@ -21,17 +21,28 @@
 #include <deque>
 #include <functional>
 #include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "cartographer/common/fixed_ratio_sampler.h"
 #include "cartographer/common/histogram.h"
+#include "cartographer/common/lru_cache.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/mutex.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/io/mapped_blob_file.h"
+#include "cartographer/mapping/decompressed_node_cache.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
+#include "cartographer/mapping/sparse_pose_graph/constraint_cost_model.h"
+#include "cartographer/mapping/sparse_pose_graph/cost_attribution.h"
 #include "cartographer/mapping/sparse_pose_graph/proto/constraint_builder_options.pb.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
 #include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
 #include "cartographer/mapping_2d/submaps.h"
@@ -53,23 +64,54 @@ transform::Rigid2d ComputeSubmapPose(const Submap& submap);
 // Intermingle an arbitrary number of calls to MaybeAddConstraint() or
 // MaybeAddGlobalConstraint, then call WhenDone(). After all computations are
 // done the 'callback' will be called with the result and another
-// MaybeAdd(Global)Constraint()/WhenDone() cycle can follow.
+// MaybeAdd(Global)Constraint()/WhenDone() cycle can follow. Alternatively,
+// TakeFinishedConstraints() hands out the results of the scans whose
+// computations have all finished, without waiting for the others.
+//
+// With 'use_coarse_precheck', searches whose score is bounded by the threshold
+// according to the coarse probability grid of the submap are skipped.
+//
+// All computations for the same node added before the next call to
+// NotifyEndOfScan() form a batch: its point cloud is only rotated once per
+// angle for all submaps of the same resolution. Compressed point clouds are
+// decompressed as needed. With 'refinement_batch_num_threads', the matches of
+// the local searches of such a batch against the same submap are refined by
+// the Ceres scan matcher in one problem once all of these searches finished.
+//
+// The run time of each search is recorded in a ConstraintCostModel, which
+// predicts the run time of the pending searches, see GetPendingSearchSeconds(),
+// and with 'order_searches_by_value' decides which search to start next.
 //
 // This class is thread-safe.
 class ConstraintBuilder {
  public:
   using Constraint = mapping::SparsePoseGraph::Constraint;
   using Result = std::vector<Constraint>;
+  // Returns the submap with 'submap_id' including its probability grid. It is
+  // called from background threads.
+  using SubmapLoader =
+      std::function<std::shared_ptr<const Submap>(const mapping::SubmapId&)>;
 
   ConstraintBuilder(
       const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions&
           options,
-      common::ThreadPool* thread_pool);
+      common::ThreadPoolInterface* thread_pool);
+  // Same as above, but scan matchers are constructed on the
+  // 'matcher_construction' pool and constraints are computed on the
+  // 'constraints' pool of 'thread_pools'.
+  ConstraintBuilder(
+      const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions&
+          options,
+      const common::WorkloadThreadPools& thread_pools);
   ~ConstraintBuilder();
 
   ConstraintBuilder(const ConstraintBuilder&) = delete;
   ConstraintBuilder& operator=(const ConstraintBuilder&) = delete;
 
+  // Exports the number of searches, skipped searches and found constraints and
+  // the scan matcher scores to 'registry'. Must be called before the first constraint search.
+  void RegisterMetrics(metrics::Registry* registry);
+
   // Schedules exploring a new constraint between 'submap' identified by
   // 'submap_id', and the 'compressed_point_cloud' for 'node_id'. The
   // 'initial_relative_pose' is relative to the 'submap'.
@@ -93,6 +135,16 @@ class ConstraintBuilder {
       const mapping::NodeId& node_id,
       const mapping::TrajectoryNode::Data* const constant_data);
 
+  // Scales the 'sampling_ratio' of MaybeAddConstraint() by 'factor' in
+  // (0, 1], e.g. to shed load. Like MaybeAddConstraint(), this must not be
+  // called concurrently with it.
+  void SetSamplingRatioFactor(double factor);
+
+  // Replaces the 'sampling_ratio' of the options, keeping the factor set by
+  // SetSamplingRatioFactor(). Must not be called concurrently with
+  // MaybeAddConstraint().
+  void SetSamplingRatio(double sampling_ratio);
+
   // Must be called after all computations related to one node have been added.
   void NotifyEndOfScan();
 
@@ -103,49 +155,269 @@ class ConstraintBuilder {
   // Returns the number of consecutive finished scans.
   int GetNumFinishedScans();
 
+  // Returns the predicted run time in seconds of the searches which were added
+  // and did not finish yet.
+  double GetPendingSearchSeconds() EXCLUDES(statistics_mutex_);
+
+  // Sets the 'callback' called whenever GetNumFinishedScans() increased
+  // because computations finished. It is called from background threads, but
+  // not while any locks of this class are held. Must be called before any
+  // computations are added.
+  void SetScanFinishedCallback(std::function<void()> callback);
+
+  // Sets where the time of constraint searches and scan matcher construction
+  // is accumulated, or null. Must be called before any computations are added.
+  void SetCostAttribution(
+      mapping::sparse_pose_graph::CostAttribution* cost_attribution);
+
+  // Returns the number of bytes used by the cached scan matchers, including
+  // the ones constructed speculatively, and the dilated coarse grids.
+  int64 GetMemoryUsageInBytes() EXCLUDES(mutex_);
+
+  // Returns and removes the constraints found for the first
+  // GetNumFinishedScans() scans, i.e. a consistent subset of the results which
+  // does not depend on the computations still running for later scans.
+  Result TakeFinishedConstraints();
+
   // Delete data related to 'submap_id'.
   void DeleteScanMatcher(const mapping::SubmapId& submap_id);
 
+  // Starts constructing the scan matcher for the unfinished submap with
+  // 'submap_id' in the background from a copy of its current
+  // 'probability_grid'. Once the submap is finished, its scan matcher is
+  // constructed from that one by updating only the cells which changed since.
+  // Does nothing if this was already started for 'submap_id'. Must be called
+  // while the 'probability_grid' is not modified concurrently.
+  void PrecomputeScanMatcherSpeculatively(
+      const mapping::SubmapId& submap_id,
+      const ProbabilityGrid& probability_grid);
+
+  // Scan matchers for submaps of 'trajectory_id' are constructed from the
+  // precomputed grids in the 'mapped_blob_file' instead of computing them. The
+  // blob with index 'submap_index' belongs to the submap of that index.
+  void SetPrecomputedGrids(
+      int trajectory_id,
+      std::shared_ptr<const io::MappedBlobFile> mapped_blob_file);
+
+  // Constructs the scan matchers of the 'submaps' in the background in the
+  // given order, e.g. by distance from where a trajectory starts localizing,
+  // so that they are ready before searches need them. The first
+  // 'num_urgent_submaps' are constructed with high priority, the others at the
+  // lowest priority while they fit into the scan matcher cache. Scan matchers
+  // already waited for by searches are constructed in this order as well.
+  void WarmUpScanMatchers(
+      const std::vector<std::pair<mapping::SubmapId,
+                                  std::shared_ptr<const Submap>>>& submaps,
+      int num_urgent_submaps);
+
+  // Submaps of 'trajectory_id' are loaded by the 'submap_loader' when their
+  // scan matcher is constructed, instead of using the probability grid of the
+  // submaps passed in. They are evicted together with the scan matcher, so
+  // only a bounded number of them is kept in memory.
+  void SetSubmapLoader(int trajectory_id, SubmapLoader submap_loader);
+
  private:
   struct SubmapScanMatcher {
+    // Keeps the 'probability_grid' alive if it was loaded on demand or passed
+    // to WarmUpScanMatchers().
+    std::shared_ptr<const Submap> loaded_submap;
     const ProbabilityGrid* probability_grid;
     std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
         fast_correlative_scan_matcher;
   };
 
-  // Either schedules the 'work_item', or if needed, schedules the scan matcher
-  // construction and queues the 'work_item'.
+  // Work to do with the scan matcher of a submap.
+  using SubmapScanMatcherWorkItem =
+      std::function<void(const SubmapScanMatcher&)>;
+
+  // Scan matchers for unfinished submaps, which are nullptr while they are
+  // being constructed.
+  struct SpeculativeScanMatchers {
+    common::Mutex mutex;
+    std::map<mapping::SubmapId,
+             std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>>
+        scan_matchers GUARDED_BY(mutex);
+  };
+
+  // A match found by a search which still has to be refined.
+  struct PendingRefinement {
+    mapping::NodeId node_id;
+    std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data;
+    transform::Rigid2d initial_pose;
+    transform::Rigid2d pose_estimate;
+    float score;
+    bool match_full_submap;
+    std::unique_ptr<Constraint>* constraint;
+  };
+
+  // The local searches against one submap added for the same scan, whose
+  // matches are refined together.
+  struct RefinementBatch {
+    mapping::SubmapId submap_id;
+    const Submap* submap;
+    int computation_index;
+    common::Mutex mutex;
+    int num_searches GUARDED_BY(mutex) = 0;
+    int num_pending_searches GUARDED_BY(mutex) = 0;
+    // Set once no more searches are added to the batch.
+    bool sealed GUARDED_BY(mutex) = false;
+    // Keeps the 'probability_grid' alive if it was loaded on demand.
+    std::shared_ptr<const Submap> loaded_submap GUARDED_BY(mutex);
+    const ProbabilityGrid* probability_grid GUARDED_BY(mutex) = nullptr;
+    std::vector<PendingRefinement> refinements GUARDED_BY(mutex);
+  };
+
+  // State shared with the constructions started by WarmUpScanMatchers(), so
+  // that those not yet running are dropped on destruction.
+  struct WarmUpState {
+    common::Mutex mutex;
+    bool cancelled GUARDED_BY(mutex) = false;
+    int num_running GUARDED_BY(mutex) = 0;
+  };
+
+  struct QueuedWorkItem {
+    common::WorkItemPriority priority;
+    string label;
+    double value_per_second;
+    SubmapScanMatcherWorkItem work_item;
+  };
+
+  // The prediction of the 'cost_model_' for a search.
+  struct SearchCost {
+    mapping::sparse_pose_graph::ConstraintCostModel::SearchType search_type;
+    int num_points;
+    double predicted_seconds;
+    double value_per_second;
+  };
+
+  // Either schedules the 'work_item' with 'priority' and 'label', or if needed,
+  // schedules the scan matcher construction and queues the 'work_item'.
   void ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
       const mapping::SubmapId& submap_id, const ProbabilityGrid* submap,
-      const std::function<void()>& work_item) REQUIRES(mutex_);
+      common::WorkItemPriority priority, const string& label,
+      double value_per_second, const SubmapScanMatcherWorkItem& work_item)
+      REQUIRES(mutex_);
+
+  // Schedules the 'work_item' to run with the 'submap_scan_matcher', which is
+  // kept alive until then even if it is evicted from the cache. With
+  // 'order_searches_by_value', it is added to the 'ordered_searches_' instead
+  // and a work item running the most valuable of them is scheduled.
+  void ScheduleWithSubmapScanMatcher(
+      std::shared_ptr<const SubmapScanMatcher> submap_scan_matcher,
+      common::WorkItemPriority priority, const string& label,
+      double value_per_second, const SubmapScanMatcherWorkItem& work_item)
+      REQUIRES(mutex_);
+
+  // Removes the search with the highest value per second from the
+  // 'ordered_searches_' and runs it.
+  void RunMostValuableSearch() EXCLUDES(mutex_);
+
+  // Predicts the cost of a search against 'submap' for 'num_points' points and
+  // adds its run time to the 'pending_search_seconds_'.
+  SearchCost AddPendingSearch(const Submap& submap, bool match_full_submap,
+                              int num_points) EXCLUDES(statistics_mutex_);
+
+  // Records that the search of 'search_cost' took 'seconds' and whether it
+  // found a match, and removes it from the 'pending_search_seconds_'.
+  void FinishPendingSearch(const SearchCost& search_cost, double seconds,
+                           bool found_match) EXCLUDES(statistics_mutex_);
 
   // Constructs the scan matcher for a 'submap', then schedules its work items.
+  // Does nothing if another construction for 'submap_id' already started or
+  // finished. The 'shared_submap' is kept alive with the scan matcher unless
+  // it is nullptr.
   void ConstructSubmapScanMatcher(const mapping::SubmapId& submap_id,
-                                  const ProbabilityGrid* submap)
+                                  const ProbabilityGrid* submap,
+                                  std::shared_ptr<const Submap> shared_submap)
       EXCLUDES(mutex_);
 
-  // Returns the scan matcher for a submap, which has to exist.
-  const SubmapScanMatcher* GetSubmapScanMatcher(
+  // Returns the precomputed grids to construct the scan matcher for
+  // 'submap_id' from, or nullptr if there are none.
+  std::shared_ptr<const io::MappedBlobFile> GetPrecomputedGrids(
       const mapping::SubmapId& submap_id) EXCLUDES(mutex_);
 
+  // Returns the loader set by SetSubmapLoader() for 'submap_id', or nullptr.
+  SubmapLoader GetSubmapLoader(const mapping::SubmapId& submap_id)
+      EXCLUDES(mutex_);
+
+  // Removes and returns the scan matcher speculatively constructed for
+  // 'submap_id', or nullptr if there is none or it is not ready yet.
+  std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+  TakeSpeculativeScanMatcher(const mapping::SubmapId& submap_id);
+
+  // Returns false if the search for a constraint between the 'point_cloud' at
+  // 'initial_pose' and 'submap' cannot find a score above its threshold
+  // according to the coarse probability grid of the 'submap', and counts it.
+  // The 'initial_pose' is ignored if 'match_full_submap' is true.
+  bool PassesCoarsePrecheck(const mapping::SubmapId& submap_id,
+                            const Submap& submap, bool match_full_submap,
+                            const transform::Rigid2d& initial_pose,
+                            const sensor::PointCloud& point_cloud)
+      REQUIRES(mutex_);
+
+  // Returns the rotations of the point cloud of 'node_id' for the resolution
+  // of the 'submap', shared by all computations of the current batch.
+  std::shared_ptr<scan_matching::RotatedScanCache> GetRotatedScanCache(
+      const mapping::NodeId& node_id,
+      const mapping::TrajectoryNode::Data* constant_data, const Submap* submap)
+      REQUIRES(mutex_);
+
+  // Returns the batch the local search for 'submap_id' which is about to be
+  // added belongs to, or nullptr if matches are refined one by one.
+  std::shared_ptr<RefinementBatch> GetRefinementBatch(
+      const mapping::SubmapId& submap_id, const Submap* submap)
+      REQUIRES(mutex_);
+
+  // Seals the batches of the current scan and schedules the refinement of
+  // those whose searches have all finished.
+  void SealRefinementBatches() REQUIRES(mutex_);
+
   // Runs in a background thread and does computations for an additional
   // constraint, assuming 'submap' and 'compressed_point_cloud' do not change
-  // anymore. As output, it may create a new Constraint in 'constraint'.
-  void ComputeConstraint(
+  // anymore. As output, it may create a new Constraint in 'constraint'. If a
+  // 'refinement_batch' is given, a match is only added to it, to be refined
+  // later. Returns whether the search found a match.
+  bool ComputeConstraint(
       const mapping::SubmapId& submap_id, const Submap* submap,
       const mapping::NodeId& node_id, bool match_full_submap,
-      const mapping::TrajectoryNode::Data* const constant_data,
+      const std::shared_ptr<const mapping::TrajectoryNode::Data>& constant_data,
       const transform::Rigid2d& initial_relative_pose,
+      scan_matching::RotatedScanCache* rotated_scan_cache,
+      const SubmapScanMatcher& submap_scan_matcher,
+      RefinementBatch* refinement_batch,
       std::unique_ptr<Constraint>* constraint) EXCLUDES(mutex_);
 
+  // Refines the 'refinements' found against 'submap' with the Ceres scan
+  // matcher and creates their constraints.
+  void RefineConstraints(const mapping::SubmapId& submap_id,
+                         const Submap& submap,
+                         const ProbabilityGrid& probability_grid,
+                         const std::vector<PendingRefinement>& refinements);
+
+  // Called after a search of the 'refinement_batch' finished. Refines the
+  // batch if it was the last one.
+  void FinishBatchedSearch(
+      const std::shared_ptr<RefinementBatch>& refinement_batch,
+      const SubmapScanMatcher& submap_scan_matcher) EXCLUDES(mutex_);
+
+  // Refines the matches of the 'refinement_batch' and finishes the
+  // computations of its searches.
+  void RefineBatch(RefinementBatch* refinement_batch) EXCLUDES(mutex_);
+
   // Decrements the 'pending_computations_' count. If all computations are done,
   // runs the 'when_done_' callback and resets the state.
   void FinishComputation(int computation_index) EXCLUDES(mutex_);
 
   const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions options_;
-  common::ThreadPool* thread_pool_;
+  common::ThreadPoolInterface* thread_pool_;
+  common::ThreadPoolInterface* matcher_construction_thread_pool_;
   common::Mutex mutex_;
 
+  // Set by SetScanFinishedCallback().
+  std::function<void()> scan_finished_callback_;
+  // Set by SetCostAttribution().
+  mapping::sparse_pose_graph::CostAttribution* cost_attribution_ = nullptr;
+
   // 'callback' set by WhenDone().
   std::unique_ptr<std::function<void(const Result&)>> when_done_
       GUARDED_BY(mutex_);
@@ -159,24 +431,98 @@ class ConstraintBuilder {
   // added for it.
   std::map<int, int> pending_computations_ GUARDED_BY(mutex_);
 
-  // Constraints currently being computed in the background. A deque is used to
-  // keep pointers valid when adding more entries.
-  std::deque<std::unique_ptr<Constraint>> constraints_ GUARDED_BY(mutex_);
+  // Constraints currently being computed in the background, together with the
+  // index of the scan they were added for, in increasing order of that index.
+  // A deque is used to keep pointers valid when adding or removing entries at
+  // either end.
+  std::deque<std::pair<int, std::unique_ptr<Constraint>>> constraints_
+      GUARDED_BY(mutex_);
+
+  // Cache of already constructed scan matchers by 'submap_id'. Evicted scan
+  // matchers are constructed again when needed.
+  common::LruCache<mapping::SubmapId, SubmapScanMatcher> submap_scan_matchers_
+      GUARDED_BY(mutex_);
+
+  // Coarse probability grids of submaps dilated by the linear search window
+  // for the pre-check of MaybeAddConstraint(), by 'submap_id'.
+  std::map<mapping::SubmapId, std::unique_ptr<const CoarseProbabilityGrid>>
+      dilated_coarse_probability_grids_ GUARDED_BY(mutex_);
 
-  // Map of already constructed scan matchers by 'submap_id'.
-  std::map<mapping::SubmapId, SubmapScanMatcher> submap_scan_matchers_
+  // Number of searches skipped by the pre-check since the last 'when_done_'
+  // callback.
+  int num_precheck_rejections_ GUARDED_BY(mutex_) = 0;
+
+  // Decompressed point clouds of the nodes most recently matched against.
+  mapping::DecompressedNodeCache decompressed_nodes_;
+
+  // Precomputed grids set by SetPrecomputedGrids(), by trajectory ID.
+  std::map<int, std::shared_ptr<const io::MappedBlobFile>> precomputed_grids_
       GUARDED_BY(mutex_);
 
+  // Loaders set by SetSubmapLoader(), by trajectory ID.
+  std::map<int, SubmapLoader> submap_loaders_ GUARDED_BY(mutex_);
+
+  // Scan matchers started by PrecomputeScanMatcherSpeculatively(). Shared
+  // with their constructions, which may still run when this is destroyed.
+  const std::shared_ptr<SpeculativeScanMatchers> speculative_scan_matchers_ =
+      std::make_shared<SpeculativeScanMatchers>();
+
+  // Rotations of the point clouds of the current batch by node and resolution.
+  // Cleared by NotifyEndOfScan(), the computations keep them alive as long as
+  // needed.
+  std::map<std::pair<mapping::NodeId, double>,
+           std::shared_ptr<scan_matching::RotatedScanCache>>
+      rotated_scan_caches_ GUARDED_BY(mutex_);
+
+  // Refinement batches of the current scan by 'submap_id'. Cleared by
+  // NotifyEndOfScan() and WhenDone(), which seal them.
+  std::map<mapping::SubmapId, std::shared_ptr<RefinementBatch>>
+      refinement_batches_ GUARDED_BY(mutex_);
+
   // Map by 'submap_id' of scan matchers under construction, and the work
   // to do once construction is done.
-  std::map<mapping::SubmapId, std::vector<std::function<void()>>>
+  std::map<mapping::SubmapId, std::vector<QueuedWorkItem>>
       submap_queued_work_items_ GUARDED_BY(mutex_);
 
+  // Scan matchers whose construction is running. Scheduling a construction
+  // more than once, e.g. for a search and by WarmUpScanMatchers(), constructs
+  // it only once.
+  std::set<mapping::SubmapId> constructing_scan_matchers_ GUARDED_BY(mutex_);
+
+  // Searches ready to run by decreasing value per second, if
+  // 'order_searches_by_value' is enabled. Each is run by whichever work item
+  // scheduled for them starts next.
+  std::multimap<double, std::function<void()>, std::greater<double>>
+      ordered_searches_ GUARDED_BY(mutex_);
+
+  const std::shared_ptr<WarmUpState> warm_up_state_ =
+      std::make_shared<WarmUpState>();
+
+  double sampling_ratio_;
+  double sampling_ratio_factor_ = 1.;
   common::FixedRatioSampler sampler_;
   scan_matching::CeresScanMatcher ceres_scan_matcher_;
 
+  // Guards the statistics updated by every search, so that searches running
+  // concurrently only contend on 'mutex_' once, when they finish. Acquired
+  // after 'mutex_' if both are needed.
+  common::Mutex statistics_mutex_;
+
   // Histogram of scan matcher scores.
-  common::Histogram score_histogram_ GUARDED_BY(mutex_);
+  common::Histogram score_histogram_ GUARDED_BY(statistics_mutex_);
+
+  mapping::sparse_pose_graph::ConstraintCostModel cost_model_
+      GUARDED_BY(statistics_mutex_);
+  // Sum of the predicted run times of the searches which did not finish yet.
+  double pending_search_seconds_ GUARDED_BY(statistics_mutex_) = 0.;
+
+  // Set by RegisterMetrics(). The arrays are indexed by whether the search
+  // covered the full submap.
+  std::array<metrics::Counter*, 2> num_searches_metrics_ = {};
+  std::array<metrics::Counter*, 2> num_constraints_metrics_ = {};
+  std::array<metrics::Counter*, 2> num_precheck_rejections_metrics_ = {};
+  metrics::Counter* num_truncated_searches_metric_ = nullptr;
+  metrics::Histogram* score_metric_ = nullptr;
 };
 
 }  // namespace sparse_pose_graph
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
@@ -26,7 +27,9 @@
 
 #include "cartographer/common/ceres_solver_options.h"
 #include "cartographer/common/histogram.h"
+#include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/mapping_2d/sparse_pose_graph/spa_cost_function.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/transform/transform.h"
@@ -58,7 +61,12 @@ transform::Rigid2d ToPose(const std::array<double, 3>& values) {
 OptimizationProblem::OptimizationProblem(
     const mapping::sparse_pose_graph::proto::OptimizationProblemOptions&
         options)
-    : options_(options) {}
+    : options_(options) {
+  ceres::Problem::Options problem_options;
+  // Parameter blocks of trimmed nodes and submaps are removed.
+  problem_options.enable_fast_removal = true;
+  problem_ = common::make_unique<ceres::Problem>(problem_options);
+}
 
 OptimizationProblem::~OptimizationProblem() {}
 
@@ -78,6 +86,26 @@ void OptimizationProblem::AddOdometerData(
   odometry_data_[trajectory_id].Push(odometry_data.time, odometry_data.pose);
 }
 
+void OptimizationProblem::AddImuData(
+    const int trajectory_id, const std::vector<sensor::ImuData>& imu_data) {
+  CHECK_GE(trajectory_id, 0);
+  imu_data_.resize(
+      std::max(imu_data_.size(), static_cast<size_t>(trajectory_id) + 1));
+  imu_data_[trajectory_id].insert(imu_data_[trajectory_id].end(),
+                                  imu_data.begin(), imu_data.end());
+}
+
+void OptimizationProblem::AddOdometerData(
+    const int trajectory_id,
+    const std::vector<sensor::OdometryData>& odometry_data) {
+  CHECK_GE(trajectory_id, 0);
+  odometry_data_.resize(
+      std::max(odometry_data_.size(), static_cast<size_t>(trajectory_id) + 1));
+  for (const sensor::OdometryData& data : odometry_data) {
+    odometry_data_[trajectory_id].Push(data.time, data.pose);
+  }
+}
+
 void OptimizationProblem::AddTrajectoryNode(
     const int trajectory_id, const common::Time time,
     const transform::Rigid2d& initial_pose, const transform::Rigid2d& pose,
@@ -85,17 +113,31 @@ void OptimizationProblem::AddTrajectoryNode(
   CHECK_GE(trajectory_id, 0);
   node_data_.resize(
       std::max(node_data_.size(), static_cast<size_t>(trajectory_id) + 1));
-  trajectory_data_.resize(std::max(trajectory_data_.size(), node_data_.size()));
-  auto& trajectory_data = trajectory_data_[trajectory_id];
-  node_data_[trajectory_id].emplace(
-      trajectory_data.next_node_index,
+  C_nodes_.resize(node_data_.size());
+  const int node_index = node_data_[trajectory_id].Append(
       NodeData{time, initial_pose, pose, gravity_alignment});
-  ++trajectory_data.next_node_index;
+  CHECK_EQ(node_index, C_nodes_[trajectory_id].Append(FromPose(pose)));
+  problem_->AddParameterBlock(C_nodes_[trajectory_id].at(node_index).data(),
+                              3);
 }
 
 void OptimizationProblem::TrimTrajectoryNode(const mapping::NodeId& node_id) {
   auto& node_data = node_data_.at(node_id.trajectory_id);
-  CHECK(node_data.erase(node_id.node_index));
+  node_data.Trim(node_id.node_index);
+  // Removing the parameter block also removes all residual blocks using it.
+  auto& C_nodes = C_nodes_.at(node_id.trajectory_id);
+  problem_->RemoveParameterBlock(C_nodes.at(node_id.node_index).data());
+  C_nodes.Trim(node_id.node_index);
+  const auto constrained_submaps = constrained_submaps_by_node_.find(node_id);
+  if (constrained_submaps != constrained_submaps_by_node_.end()) {
+    for (const mapping::SubmapId& submap_id : constrained_submaps->second) {
+      constraint_residual_blocks_.erase(ConstraintId(submap_id, node_id));
+    }
+    constrained_submaps_by_node_.erase(constrained_submaps);
+  }
+  consecutive_node_residual_blocks_.erase(node_id);
+  consecutive_node_residual_blocks_.erase(
+      mapping::NodeId{node_id.trajectory_id, node_id.node_index - 1});
 
   if (!node_data.empty() &&
       node_id.trajectory_id < static_cast<int>(imu_data_.size())) {
@@ -109,11 +151,46 @@ void OptimizationProblem::TrimTrajectoryNode(const mapping::NodeId& node_id) {
 
 void OptimizationProblem::AddSubmap(const int trajectory_id,
                                     const transform::Rigid2d& submap_pose) {
-  submap_data_.Append(trajectory_id, SubmapData{submap_pose});
+  CHECK_GE(trajectory_id, 0);
+  submap_data_.resize(
+      std::max(submap_data_.size(), static_cast<size_t>(trajectory_id) + 1));
+  C_submaps_.resize(submap_data_.size());
+  const int submap_index =
+      submap_data_[trajectory_id].Append(SubmapData{submap_pose});
+  CHECK_EQ(submap_index,
+           C_submaps_[trajectory_id].Append(FromPose(submap_pose)));
+  problem_->AddParameterBlock(
+      C_submaps_[trajectory_id].at(submap_index).data(), 3);
 }
 
 void OptimizationProblem::TrimSubmap(const mapping::SubmapId& submap_id) {
-  submap_data_.Trim(submap_id);
+  submap_data_.at(submap_id.trajectory_id).Trim(submap_id.submap_index);
+  // Removing the parameter block also removes all residual blocks using it.
+  auto& C_submaps = C_submaps_.at(submap_id.trajectory_id);
+  problem_->RemoveParameterBlock(C_submaps.at(submap_id.submap_index).data());
+  C_submaps.Trim(submap_id.submap_index);
+  // Constraint IDs are ordered by submap first, so the ones of 'submap_id'
+  // form a contiguous range.
+  auto it = constraint_residual_blocks_.lower_bound(ConstraintId(
+      submap_id, mapping::NodeId{std::numeric_limits<int>::min(),
+                                 std::numeric_limits<int>::min()}));
+  while (it != constraint_residual_blocks_.end() &&
+         it->first.first == submap_id) {
+    EraseConstrainedSubmap(it->first);
+    it = constraint_residual_blocks_.erase(it);
+  }
+}
+
+void OptimizationProblem::EraseConstrainedSubmap(
+    const ConstraintId& constraint_id) {
+  const auto it = constrained_submaps_by_node_.find(constraint_id.second);
+  if (it == constrained_submaps_by_node_.end()) {
+    return;
+  }
+  it->second.erase(constraint_id.first);
+  if (it->second.empty()) {
+    constrained_submaps_by_node_.erase(it);
+  }
 }
 
 void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
@@ -121,61 +198,127 @@ void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
       max_num_iterations);
 }
 
-void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
-                                const std::set<int>& frozen_trajectories) {
+void OptimizationProblem::SetSlidingWindowNumNodes(
+    const int32 sliding_window_num_nodes) {
+  options_.set_sliding_window_num_nodes(sliding_window_num_nodes);
+}
+
+void OptimizationProblem::Solve(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories,
+    const std::function<bool()>& should_terminate) {
+  CARTOGRAPHER_TRACE_SPAN("OptimizationProblem::Solve");
   if (node_data_.empty()) {
     // Nothing to optimize.
     return;
   }
 
-  ceres::Problem::Options problem_options;
-  ceres::Problem problem(problem_options);
-
-  // Set the starting point.
-  // TODO(hrapp): Move ceres data into SubmapData.
-  mapping::MapById<mapping::SubmapId, std::array<double, 3>> C_submaps;
-  std::vector<std::map<int, std::array<double, 3>>> C_nodes(node_data_.size());
-  bool first_submap = true;
-  for (const auto& submap_id_data : submap_data_) {
-    const bool frozen =
-        frozen_trajectories.count(submap_id_data.id.trajectory_id) != 0;
-    C_submaps.Insert(submap_id_data.id, FromPose(submap_id_data.data.pose));
-    problem.AddParameterBlock(C_submaps.at(submap_id_data.id).data(), 3);
-    if (first_submap || frozen) {
-      first_submap = false;
-      // Fix the pose of the first submap or all submaps of a frozen
-      // trajectory.
-      problem.SetParameterBlockConstant(C_submaps.at(submap_id_data.id).data());
+  // Nodes of a trajectory with at least this index are optimized, older ones
+  // are outside the sliding window and kept constant.
+  std::vector<int> first_optimized_node_indices(node_data_.size(), 0);
+  if (options_.sliding_window_num_nodes() > 0) {
+    for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
+         ++trajectory_id) {
+      if (!node_data_[trajectory_id].empty()) {
+        first_optimized_node_indices[trajectory_id] =
+            node_data_[trajectory_id].last_index() -
+            options_.sliding_window_num_nodes() + 1;
+      }
     }
   }
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
+  const auto is_optimized_node = [&](const mapping::NodeId& node_id) {
+    return frozen_trajectories.count(node_id.trajectory_id) == 0 &&
+           node_id.node_index >=
+               first_optimized_node_indices.at(node_id.trajectory_id);
+  };
+  // Submaps are optimized if an optimized node was inserted into them.
+  std::set<mapping::SubmapId> optimized_submap_ids;
+  for (const Constraint& constraint : constraints) {
+    if (constraint.tag == Constraint::INTRA_SUBMAP &&
+        is_optimized_node(constraint.node_id)) {
+      optimized_submap_ids.insert(constraint.submap_id);
+    }
+  }
+  // The pose of the first submap is fixed.
+  mapping::SubmapId first_submap_id{-1, -1};
+  for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
        ++trajectory_id) {
-    const bool frozen = frozen_trajectories.count(trajectory_id) != 0;
-    for (const auto& index_node_data : node_data_[trajectory_id]) {
-      const int node_index = index_node_data.first;
-      const NodeData& node_data = index_node_data.second;
-      C_nodes[trajectory_id].emplace(node_index, FromPose(node_data.pose));
-      problem.AddParameterBlock(C_nodes[trajectory_id].at(node_index).data(),
-                                3);
-      if (frozen) {
-        problem.SetParameterBlockConstant(
-            C_nodes[trajectory_id].at(node_index).data());
+    if (!submap_data_[trajectory_id].empty()) {
+      first_submap_id = mapping::SubmapId{
+          static_cast<int>(trajectory_id),
+          submap_data_[trajectory_id].begin()->first};
+      break;
+    }
+  }
+  const auto is_optimized_submap = [&](const mapping::SubmapId& submap_id) {
+    if (submap_id == first_submap_id ||
+        frozen_trajectories.count(submap_id.trajectory_id) != 0) {
+      return false;
+    }
+    return options_.sliding_window_num_nodes() == 0 ||
+           optimized_submap_ids.count(submap_id) != 0;
+  };
+
+  // The parameter blocks are kept between solves, so the optimization starts
+  // from the previous solution. Only which of them are constant is updated.
+  for (size_t trajectory_id = 0; trajectory_id != C_submaps_.size();
+       ++trajectory_id) {
+    for (const auto& index_C_submap : C_submaps_[trajectory_id]) {
+      if (is_optimized_submap(mapping::SubmapId{
+              static_cast<int>(trajectory_id), index_C_submap.first})) {
+        problem_->SetParameterBlockVariable(index_C_submap.second.data());
+      } else {
+        problem_->SetParameterBlockConstant(index_C_submap.second.data());
+      }
+    }
+  }
+  for (size_t trajectory_id = 0; trajectory_id != C_nodes_.size();
+       ++trajectory_id) {
+    for (const auto& index_C_node : C_nodes_[trajectory_id]) {
+      if (is_optimized_node(mapping::NodeId{static_cast<int>(trajectory_id),
+                                            index_C_node.first})) {
+        problem_->SetParameterBlockVariable(index_C_node.second.data());
+      } else {
+        problem_->SetParameterBlockConstant(index_C_node.second.data());
       }
     }
   }
-  // Add cost functions for intra- and inter-submap constraints.
+
+  // Add cost functions for new intra- and inter-submap constraints, and remove
+  // the ones for constraints which are gone.
+  std::set<ConstraintId> constraint_ids;
   for (const Constraint& constraint : constraints) {
-    problem.AddResidualBlock(
-        new ceres::AutoDiffCostFunction<SpaCostFunction, 3, 3, 3>(
-            new SpaCostFunction(constraint.pose)),
-        // Only loop closure constraints should have a loss function.
-        constraint.tag == Constraint::INTER_SUBMAP
-            ? new ceres::HuberLoss(options_.huber_scale())
-            : nullptr,
-        C_submaps.at(constraint.submap_id).data(),
-        C_nodes.at(constraint.node_id.trajectory_id)
-            .at(constraint.node_id.node_index)
-            .data());
+    const ConstraintId constraint_id(constraint.submap_id, constraint.node_id);
+    constraint_ids.insert(constraint_id);
+    if (constraint_residual_blocks_.count(constraint_id) != 0) {
+      continue;
+    }
+    constrained_submaps_by_node_[constraint.node_id].insert(
+        constraint.submap_id);
+    constraint_residual_blocks_.emplace(
+        constraint_id,
+        problem_->AddResidualBlock(
+            new AnalyticalSpaCostFunction(constraint.pose),
+            // Only loop closure constraints should have a loss function.
+            constraint.tag == Constraint::INTER_SUBMAP
+                ? new ceres::HuberLoss(options_.huber_scale())
+                : nullptr,
+            C_submaps_.at(constraint.submap_id.trajectory_id)
+                .at(constraint.submap_id.submap_index)
+                .data(),
+            C_nodes_.at(constraint.node_id.trajectory_id)
+                .at(constraint.node_id.node_index)
+                .data()));
+  }
+  for (auto it = constraint_residual_blocks_.begin();
+       it != constraint_residual_blocks_.end();) {
+    if (constraint_ids.count(it->first) == 0) {
+      problem_->RemoveResidualBlock(it->second);
+      EraseConstrainedSubmap(it->first);
+      it = constraint_residual_blocks_.erase(it);
+    } else {
+      ++it;
+    }
   }
 
   // Add penalties for violating odometry or changes between consecutive scans
@@ -197,7 +340,10 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
       const int next_node_index = node_it->first;
       const NodeData& next_node_data = node_it->second;
 
-      if (next_node_index != node_index + 1) {
+      const mapping::NodeId node_id{static_cast<int>(trajectory_id),
+                                    node_index};
+      if (next_node_index != node_index + 1 ||
+          consecutive_node_residual_blocks_.count(node_id) != 0) {
         continue;
       }
 
@@ -216,54 +362,106 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
                         next_node_data.gravity_alignment.inverse())
               : transform::Embed3D(node_data.initial_pose.inverse() *
                                    next_node_data.initial_pose);
-      problem.AddResidualBlock(
-          new ceres::AutoDiffCostFunction<SpaCostFunction, 3, 3, 3>(
-              new SpaCostFunction(Constraint::Pose{
+      consecutive_node_residual_blocks_.emplace(
+          node_id,
+          problem_->AddResidualBlock(
+              new AnalyticalSpaCostFunction(Constraint::Pose{
                   relative_pose,
                   options_.consecutive_scan_translation_penalty_factor(),
-                  options_.consecutive_scan_rotation_penalty_factor()})),
-          nullptr /* loss function */,
-          C_nodes[trajectory_id].at(node_index).data(),
-          C_nodes[trajectory_id].at(next_node_index).data());
+                  options_.consecutive_scan_rotation_penalty_factor()}),
+              nullptr /* loss function */,
+              C_nodes_[trajectory_id].at(node_index).data(),
+              C_nodes_[trajectory_id].at(next_node_index).data()));
     }
   }
 
   // Solve.
+  ceres::Solver::Options solver_options =
+      common::CreateCeresSolverOptions(options_.ceres_solver_options());
+  common::TerminationCallback termination_callback(
+      options_.min_num_iterations_before_interrupt(), should_terminate);
+  if (should_terminate != nullptr) {
+    solver_options.callbacks.push_back(&termination_callback);
+  }
   ceres::Solver::Summary summary;
-  ceres::Solve(
-      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
-      &problem, &summary);
+  ceres::Solve(solver_options, problem_.get(), &summary);
   if (options_.log_solver_summary()) {
     LOG(INFO) << summary.FullReport();
   }
 
   // Store the result.
-  for (const auto& C_submap_id_data : C_submaps) {
-    submap_data_.at(C_submap_id_data.id).pose = ToPose(C_submap_id_data.data);
+  for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
+       ++trajectory_id) {
+    for (const auto& index_submap_data : submap_data_[trajectory_id]) {
+      index_submap_data.second.pose =
+          ToPose(C_submaps_[trajectory_id].at(index_submap_data.first));
+    }
   }
   for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
        ++trajectory_id) {
-    for (auto& index_node_data : node_data_[trajectory_id]) {
+    for (const auto& index_node_data : node_data_[trajectory_id]) {
       index_node_data.second.pose =
-          ToPose(C_nodes[trajectory_id].at(index_node_data.first));
+          ToPose(C_nodes_[trajectory_id].at(index_node_data.first));
     }
   }
 }
 
-const std::vector<std::map<int, NodeData>>& OptimizationProblem::node_data()
-    const {
+const std::vector<mapping::DenseMapByIndex<NodeData>>&
+OptimizationProblem::node_data() const {
   return node_data_;
 }
 
-std::vector<std::map<int, SubmapData>> OptimizationProblem::submap_data()
-    const {
-  std::vector<std::map<int, SubmapData>> result;
-  for (const auto& submap_id_data : submap_data_) {
-    result.resize(submap_id_data.id.trajectory_id + 1);
-    result[submap_id_data.id.trajectory_id].emplace(
-        submap_id_data.id.submap_index, submap_id_data.data);
+int64 OptimizationProblem::GetMemoryUsageInBytes() const {
+  constexpr int64 kTransformSizeInBytes =
+      sizeof(common::Time) + sizeof(transform::Rigid3d);
+  int64 memory_usage_in_bytes = 0;
+  for (const auto& trajectory_imu_data : imu_data_) {
+    memory_usage_in_bytes +=
+        trajectory_imu_data.size() * sizeof(sensor::ImuData);
+  }
+  for (const auto& trajectory_odometry_data : odometry_data_) {
+    memory_usage_in_bytes +=
+        trajectory_odometry_data.size() * kTransformSizeInBytes;
+  }
+  for (const auto& trajectory_node_data : node_data_) {
+    // Trimmed nodes keep their storage until their whole chunk is trimmed.
+    memory_usage_in_bytes += trajectory_node_data.size() * sizeof(NodeData);
+  }
+  return memory_usage_in_bytes;
+}
+
+std::vector<int64> OptimizationProblem::GetNumDataPerTrajectory() const {
+  std::vector<int64> num_data;
+  const auto add = [&num_data](const size_t trajectory_id, const size_t size) {
+    if (num_data.size() <= trajectory_id) {
+      num_data.resize(trajectory_id + 1, 0);
+    }
+    num_data[trajectory_id] += size;
+  };
+  for (size_t i = 0; i != imu_data_.size(); ++i) {
+    add(i, imu_data_[i].size());
   }
-  return result;
+  for (size_t i = 0; i != node_data_.size(); ++i) {
+    add(i, node_data_[i].size());
+  }
+  for (size_t i = 0; i != odometry_data_.size(); ++i) {
+    add(i, odometry_data_[i].size());
+  }
+  for (size_t i = 0; i != submap_data_.size(); ++i) {
+    add(i, submap_data_[i].size());
+  }
+  return num_data;
+}
+
+const std::vector<mapping::DenseMapByIndex<SubmapData>>&
+OptimizationProblem::submap_data() const {
+  return submap_data_;
+}
+
+int OptimizationProblem::num_submaps(const int trajectory_id) const {
+  return trajectory_id < static_cast<int>(submap_data_.size())
+             ? submap_data_[trajectory_id].size()
+             : 0;
 }
 
 }  // namespace sparse_pose_graph
@@ -19,20 +19,25 @@
 
 #include <array>
 #include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
+#include "cartographer/mapping/dense_map_by_index.h"
 #include "cartographer/mapping/id.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
 #include "cartographer/mapping/sparse_pose_graph/proto/optimization_problem_options.pb.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/transform/transform_interpolation_buffer.h"
+#include "ceres/ceres.h"
 
 namespace cartographer {
 namespace mapping_2d {
@@ -65,6 +70,11 @@ class OptimizationProblem {
   void AddImuData(int trajectory_id, const sensor::ImuData& imu_data);
   void AddOdometerData(int trajectory_id,
                        const sensor::OdometryData& odometry_data);
+  // Same as above for time-sorted samples, appended in bulk.
+  void AddImuData(int trajectory_id,
+                  const std::vector<sensor::ImuData>& imu_data);
+  void AddOdometerData(int trajectory_id,
+                       const std::vector<sensor::OdometryData>& odometry_data);
   void AddTrajectoryNode(int trajectory_id, common::Time time,
                          const transform::Rigid2d& initial_pose,
                          const transform::Rigid2d& pose,
@@ -74,25 +84,56 @@ class OptimizationProblem {
   void TrimSubmap(const mapping::SubmapId& submap_id);
 
   void SetMaxNumIterations(int32 max_num_iterations);
+  void SetSlidingWindowNumNodes(int32 sliding_window_num_nodes);
 
-  // Computes the optimized poses.
+  // Computes the optimized poses. Unless 'should_terminate' is null, the solve
+  // ends early once it returns true, and the poses of the last iteration are
+  // kept.
   void Solve(const std::vector<Constraint>& constraints,
-             const std::set<int>& frozen_trajectories);
-
-  const std::vector<std::map<int, NodeData>>& node_data() const;
-  std::vector<std::map<int, SubmapData>> submap_data() const;
+             const std::set<int>& frozen_trajectories,
+             const std::function<bool()>& should_terminate);
+
+  const std::vector<mapping::DenseMapByIndex<NodeData>>& node_data() const;
+  // Returns an estimate of the number of bytes used by the buffered sensor
+  // data and the node data, not including the Ceres problem.
+  int64 GetMemoryUsageInBytes() const;
+  // Returns the number of nodes, submaps and buffered sensor data per
+  // trajectory, which approximates each trajectory's share of a Solve().
+  std::vector<int64> GetNumDataPerTrajectory() const;
+  const std::vector<mapping::DenseMapByIndex<SubmapData>>& submap_data() const;
+  // Returns the number of submaps of 'trajectory_id' that were not trimmed.
+  int num_submaps(int trajectory_id) const;
 
  private:
-  struct TrajectoryData {
-    // TODO(hrapp): Remove, once we can relabel constraints.
-    int next_node_index = 0;
-  };
+  using ConstraintId = std::pair<mapping::SubmapId, mapping::NodeId>;
+
+  // Removes 'constraint_id' from 'constrained_submaps_by_node_'.
+  void EraseConstrainedSubmap(const ConstraintId& constraint_id);
+
   mapping::sparse_pose_graph::proto::OptimizationProblemOptions options_;
   std::vector<std::deque<sensor::ImuData>> imu_data_;
-  std::vector<std::map<int, NodeData>> node_data_;
+  // Node and submap data is stored densely, indexed by trajectory ID, then
+  // by node or submap index.
+  std::vector<mapping::DenseMapByIndex<NodeData>> node_data_;
   std::vector<transform::TransformInterpolationBuffer> odometry_data_;
-  mapping::MapById<mapping::SubmapId, SubmapData> submap_data_;
-  std::vector<TrajectoryData> trajectory_data_;
+  std::vector<mapping::DenseMapByIndex<SubmapData>> submap_data_;
+
+  // The Ceres problem is kept between calls to Solve(), so that only residual
+  // blocks for new constraints and nodes have to be added. Its parameter
+  // blocks point into the dense storage below, which is indexed like the node
+  // and submap data.
+  // TODO(hrapp): Move ceres data into SubmapData.
+  std::unique_ptr<ceres::Problem> problem_;
+  std::vector<mapping::DenseMapByIndex<std::array<double, 3>>> C_submaps_;
+  std::vector<mapping::DenseMapByIndex<std::array<double, 3>>> C_nodes_;
+  std::map<ConstraintId, ceres::ResidualBlockId> constraint_residual_blocks_;
+  // The submaps each node has a constraint residual block with, so that
+  // trimming a node does not have to look at all constraints.
+  std::map<mapping::NodeId, std::set<mapping::SubmapId>>
+      constrained_submaps_by_node_;
+  // Residual blocks between a node and the next one, keyed by the former.
+  std::map<mapping::NodeId, ceres::ResidualBlockId>
+      consecutive_node_residual_blocks_;
 };
 
 }  // namespace sparse_pose_graph
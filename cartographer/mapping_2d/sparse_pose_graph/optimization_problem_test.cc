@@ -0,0 +1,259 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/sparse_pose_graph/optimization_problem.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/sparse_pose_graph/optimization_problem_options.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "cartographer/transform/transform.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace sparse_pose_graph {
+namespace {
+
+constexpr int kTrajectoryId = 0;
+constexpr int kNumSubmaps = 3;
+constexpr int kNumNodesPerSubmap = 10;
+
+using Constraint = OptimizationProblem::Constraint;
+
+class OptimizationProblemTest : public ::testing::Test {
+ protected:
+  OptimizationProblemTest() : rng_(45387) {
+    for (int i = 0; i != kNumSubmaps; ++i) {
+      submap_poses_.push_back(transform::Rigid2d({4. * i, 0.}, 0.1 * i));
+      for (int j = 0; j != kNumNodesPerSubmap; ++j) {
+        const transform::Rigid2d ground_truth_pose =
+            submap_poses_.back() * RandomTransform(2., 0.5);
+        ground_truth_node_poses_.push_back(ground_truth_pose);
+        initial_node_poses_.push_back(ground_truth_pose *
+                                      RandomTransform(0.2, 0.1));
+      }
+    }
+  }
+
+  static mapping::sparse_pose_graph::proto::OptimizationProblemOptions
+  CreateOptions() {
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          acceleration_weight = 1.,
+          rotation_weight = 1.,
+          huber_scale = 1.,
+          consecutive_scan_translation_penalty_factor = 1e-1,
+          consecutive_scan_rotation_penalty_factor = 1e-1,
+          fixed_frame_pose_translation_weight = 1e1,
+          fixed_frame_pose_rotation_weight = 1e2,
+          sliding_window_num_nodes = 0,
+          solve_connected_components_in_parallel = false,
+          min_num_iterations_before_interrupt = 0,
+          log_solver_summary = false,
+          ceres_solver_options = {
+            use_nonmonotonic_steps = false,
+            max_num_iterations = 200,
+            num_threads = 1,
+          },
+        })text");
+    return mapping::sparse_pose_graph::CreateOptimizationProblemOptions(
+        parameter_dictionary.get());
+  }
+
+  transform::Rigid2d RandomTransform(const double translation_size,
+                                     const double rotation_size) {
+    std::uniform_real_distribution<double> translation_distribution(
+        -translation_size, translation_size);
+    std::uniform_real_distribution<double> rotation_distribution(-rotation_size,
+                                                                 rotation_size);
+    const double x = translation_distribution(rng_);
+    const double y = translation_distribution(rng_);
+    return transform::Rigid2d({x, y}, rotation_distribution(rng_));
+  }
+
+  // Adds the submaps with indices in ['begin', 'end') at their true poses.
+  void AddSubmaps(OptimizationProblem* const problem, const int begin,
+                  const int end) {
+    for (int i = begin; i != end; ++i) {
+      problem->AddSubmap(kTrajectoryId, submap_poses_[i]);
+    }
+  }
+
+  // Adds the nodes with indices in ['begin', 'end') at their noisy poses.
+  void AddNodes(OptimizationProblem* const problem, const int begin,
+                const int end) {
+    for (int j = begin; j != end; ++j) {
+      const common::Time time =
+          common::FromUniversal(0) + common::FromSeconds(0.1 * j);
+      problem->AddTrajectoryNode(kTrajectoryId, time, initial_node_poses_[j],
+                                 initial_node_poses_[j],
+                                 Eigen::Quaterniond::Identity());
+    }
+  }
+
+  Constraint CreateConstraint(const int submap_index, const int node_index,
+                              const Constraint::Tag tag) {
+    return Constraint{
+        mapping::SubmapId{kTrajectoryId, submap_index},
+        mapping::NodeId{kTrajectoryId, node_index},
+        Constraint::Pose{
+            transform::Embed3D(submap_poses_[submap_index].inverse() *
+                               ground_truth_node_poses_[node_index] *
+                               RandomTransform(0.05, 0.02)),
+            1., 1.},
+        tag};
+  }
+
+  // Solves a newly built problem with the first 'num_submaps' submaps and
+  // 'num_nodes' nodes less the trimmed ones, and expects the same poses as in
+  // 'problem'.
+  void ExpectMatchesRebuiltProblem(
+      const OptimizationProblem& problem, const int num_submaps,
+      const int num_nodes, const std::vector<Constraint>& constraints,
+      const std::vector<mapping::SubmapId>& trimmed_submap_ids,
+      const std::vector<mapping::NodeId>& trimmed_node_ids) {
+    OptimizationProblem rebuilt_problem(CreateOptions());
+    AddSubmaps(&rebuilt_problem, 0, num_submaps);
+    AddNodes(&rebuilt_problem, 0, num_nodes);
+    for (const mapping::SubmapId& submap_id : trimmed_submap_ids) {
+      rebuilt_problem.TrimSubmap(submap_id);
+    }
+    for (const mapping::NodeId& node_id : trimmed_node_ids) {
+      rebuilt_problem.TrimTrajectoryNode(node_id);
+    }
+    rebuilt_problem.Solve(constraints, std::set<int>(),
+                          nullptr /* should_terminate */);
+
+    const auto& node_data = problem.node_data().at(kTrajectoryId);
+    const auto& rebuilt_node_data =
+        rebuilt_problem.node_data().at(kTrajectoryId);
+    ASSERT_EQ(rebuilt_node_data.size(), node_data.size());
+    for (const auto& index_node_data : rebuilt_node_data) {
+      EXPECT_THAT(node_data.at(index_node_data.first).pose,
+                  transform::IsNearly(index_node_data.second.pose, 1e-3));
+    }
+    const auto& submap_data = problem.submap_data().at(kTrajectoryId);
+    const auto& rebuilt_submap_data =
+        rebuilt_problem.submap_data().at(kTrajectoryId);
+    ASSERT_EQ(rebuilt_submap_data.size(), submap_data.size());
+    for (const auto& index_submap_data : rebuilt_submap_data) {
+      EXPECT_THAT(submap_data.at(index_submap_data.first).pose,
+                  transform::IsNearly(index_submap_data.second.pose, 1e-3));
+    }
+  }
+
+  std::vector<transform::Rigid2d> submap_poses_;
+  std::vector<transform::Rigid2d> ground_truth_node_poses_;
+  std::vector<transform::Rigid2d> initial_node_poses_;
+  std::mt19937 rng_;
+};
+
+TEST_F(OptimizationProblemTest, PersistentProblemMatchesRebuiltProblem) {
+  const std::set<int> kFrozen;
+  OptimizationProblem problem(CreateOptions());
+  std::vector<Constraint> constraints;
+  AddSubmaps(&problem, 0, 2);
+  AddNodes(&problem, 0, 2 * kNumNodesPerSubmap);
+  for (int j = 0; j != 2 * kNumNodesPerSubmap; ++j) {
+    constraints.push_back(CreateConstraint(j / kNumNodesPerSubmap, j,
+                                           Constraint::INTRA_SUBMAP));
+  }
+  problem.Solve(constraints, kFrozen, nullptr /* should_terminate */);
+
+  // New nodes, and constraints of new and old nodes are added to the kept
+  // problem.
+  AddSubmaps(&problem, 2, kNumSubmaps);
+  AddNodes(&problem, 2 * kNumNodesPerSubmap, kNumSubmaps * kNumNodesPerSubmap);
+  for (int j = kNumNodesPerSubmap; j != kNumSubmaps * kNumNodesPerSubmap;
+       ++j) {
+    if (j >= 2 * kNumNodesPerSubmap) {
+      constraints.push_back(CreateConstraint(2, j, Constraint::INTRA_SUBMAP));
+    }
+    constraints.push_back(CreateConstraint(0, j, Constraint::INTER_SUBMAP));
+  }
+  problem.Solve(constraints, kFrozen, nullptr /* should_terminate */);
+  ExpectMatchesRebuiltProblem(problem, kNumSubmaps,
+                              kNumSubmaps * kNumNodesPerSubmap, constraints,
+                              {}, {});
+
+  // Trimming removes the constraints of the submap and the node, and a loop
+  // closure constraint is dropped.
+  const mapping::SubmapId trimmed_submap_id{kTrajectoryId, 1};
+  const mapping::NodeId trimmed_node_id{kTrajectoryId, 15};
+  const mapping::NodeId dropped_constraint_node_id{kTrajectoryId, 25};
+  problem.TrimSubmap(trimmed_submap_id);
+  problem.TrimTrajectoryNode(trimmed_node_id);
+  constraints.erase(
+      std::remove_if(constraints.begin(), constraints.end(),
+                     [&](const Constraint& constraint) {
+                       return constraint.submap_id == trimmed_submap_id ||
+                              constraint.node_id == trimmed_node_id ||
+                              (constraint.node_id ==
+                                   dropped_constraint_node_id &&
+                               constraint.tag == Constraint::INTER_SUBMAP);
+                     }),
+      constraints.end());
+  problem.Solve(constraints, kFrozen, nullptr /* should_terminate */);
+  ExpectMatchesRebuiltProblem(problem, kNumSubmaps,
+                              kNumSubmaps * kNumNodesPerSubmap, constraints,
+                              {trimmed_submap_id}, {trimmed_node_id});
+}
+
+TEST_F(OptimizationProblemTest, SlidingWindowKeepsOlderNodesFixed) {
+  constexpr int kNumNodes = kNumSubmaps * kNumNodesPerSubmap;
+  auto options = CreateOptions();
+  options.set_sliding_window_num_nodes(kNumNodesPerSubmap);
+  OptimizationProblem problem(options);
+  AddSubmaps(&problem, 0, kNumSubmaps);
+  AddNodes(&problem, 0, kNumNodes);
+  std::vector<Constraint> constraints;
+  for (int j = 0; j != kNumNodes; ++j) {
+    constraints.push_back(CreateConstraint(j / kNumNodesPerSubmap, j,
+                                           Constraint::INTRA_SUBMAP));
+    constraints.push_back(CreateConstraint(0, j, Constraint::INTER_SUBMAP));
+  }
+  problem.Solve(constraints, std::set<int>(), nullptr /* should_terminate */);
+
+  // Only the newest nodes and the last submap they were inserted into are
+  // optimized.
+  const auto& node_data = problem.node_data().at(kTrajectoryId);
+  for (int j = 0; j != kNumNodes; ++j) {
+    if (j < kNumNodes - kNumNodesPerSubmap) {
+      EXPECT_THAT(node_data.at(j).pose,
+                  transform::IsNearly(initial_node_poses_[j], 1e-9));
+    } else {
+      EXPECT_THAT(node_data.at(j).pose,
+                  ::testing::Not(
+                      transform::IsNearly(initial_node_poses_[j], 1e-6)));
+    }
+  }
+  const auto& submap_data = problem.submap_data().at(kTrajectoryId);
+  for (int i = 0; i != kNumSubmaps - 1; ++i) {
+    EXPECT_THAT(submap_data.at(i).pose,
+                transform::IsNearly(submap_poses_[i], 1e-9));
+  }
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping_2d
+}  // namespace cartographer
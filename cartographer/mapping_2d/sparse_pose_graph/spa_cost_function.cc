@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/sparse_pose_graph/spa_cost_function.h"
+
+#include <cmath>
+
+namespace cartographer {
+namespace mapping_2d {
+namespace sparse_pose_graph {
+
+AnalyticalSpaCostFunction::AnalyticalSpaCostFunction(
+    const Constraint::Pose& pose)
+    : zbar_ij_(transform::Project2D(pose.zbar_ij)),
+      translation_weight_(pose.translation_weight),
+      rotation_weight_(pose.rotation_weight) {}
+
+bool AnalyticalSpaCostFunction::Evaluate(double const* const* parameters,
+                                         double* residuals,
+                                         double** jacobians) const {
+  const double* const c_i = parameters[0];
+  const double* const c_j = parameters[1];
+  const double cos_theta_i = std::cos(c_i[2]);
+  const double sin_theta_i = std::sin(c_i[2]);
+  const double delta_x = c_j[0] - c_i[0];
+  const double delta_y = c_j[1] - c_i[1];
+  const double h[3] = {cos_theta_i * delta_x + sin_theta_i * delta_y,
+                       -sin_theta_i * delta_x + cos_theta_i * delta_y,
+                       c_j[2] - c_i[2]};
+  residuals[0] = (zbar_ij_.translation().x() - h[0]) * translation_weight_;
+  residuals[1] = (zbar_ij_.translation().y() - h[1]) * translation_weight_;
+  residuals[2] = common::NormalizeAngleDifference(zbar_ij_.rotation().angle() -
+                                                  h[2]) *
+                 rotation_weight_;
+  if (jacobians == nullptr) {
+    return true;
+  }
+  // The Jacobians are row-major, with one row per residual.
+  const double weighted_cos = translation_weight_ * cos_theta_i;
+  const double weighted_sin = translation_weight_ * sin_theta_i;
+  if (jacobians[0] != nullptr) {
+    double* const jacobian = jacobians[0];
+    jacobian[0] = weighted_cos;
+    jacobian[1] = weighted_sin;
+    jacobian[2] = -translation_weight_ * h[1];
+    jacobian[3] = -weighted_sin;
+    jacobian[4] = weighted_cos;
+    jacobian[5] = translation_weight_ * h[0];
+    jacobian[6] = 0.;
+    jacobian[7] = 0.;
+    jacobian[8] = rotation_weight_;
+  }
+  if (jacobians[1] != nullptr) {
+    double* const jacobian = jacobians[1];
+    jacobian[0] = -weighted_cos;
+    jacobian[1] = -weighted_sin;
+    jacobian[2] = 0.;
+    jacobian[3] = weighted_sin;
+    jacobian[4] = -weighted_cos;
+    jacobian[5] = 0.;
+    jacobian[6] = 0.;
+    jacobian[7] = 0.;
+    jacobian[8] = -rotation_weight_;
+  }
+  return true;
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -81,6 +81,23 @@ class SpaCostFunction {
   const Constraint::Pose pose_;
 };
 
+// Same residuals as SpaCostFunction, but the Jacobians are computed
+// analytically instead of by evaluating with ceres::Jet, which is faster.
+class AnalyticalSpaCostFunction : public ceres::SizedCostFunction<3, 3, 3> {
+ public:
+  using Constraint = mapping::SparsePoseGraph::Constraint;
+
+  explicit AnalyticalSpaCostFunction(const Constraint::Pose& pose);
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override;
+
+ private:
+  const transform::Rigid2d zbar_ij_;
+  const double translation_weight_;
+  const double rotation_weight_;
+};
+
 }  // namespace sparse_pose_graph
 }  // namespace mapping_2d
 }  // namespace cartographer
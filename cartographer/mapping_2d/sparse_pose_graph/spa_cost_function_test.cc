@@ -0,0 +1,73 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/sparse_pose_graph/spa_cost_function.h"
+
+#include <array>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace sparse_pose_graph {
+namespace {
+
+TEST(SpaCostFunctionTest, AnalyticalMatchesAutoDiff) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(-3., 3.);
+  for (int i = 0; i != 100; ++i) {
+    const SpaCostFunction::Constraint::Pose pose{
+        transform::Embed3D(transform::Rigid2d(
+            {distribution(prng), distribution(prng)}, distribution(prng))),
+        distribution(prng), distribution(prng)};
+    const ceres::AutoDiffCostFunction<SpaCostFunction, 3, 3, 3>
+        auto_diff_cost_function(new SpaCostFunction(pose));
+    const AnalyticalSpaCostFunction analytical_cost_function(pose);
+
+    std::array<double, 3> c_i;
+    std::array<double, 3> c_j;
+    for (int k = 0; k != 3; ++k) {
+      c_i[k] = distribution(prng);
+      c_j[k] = distribution(prng);
+    }
+    const double* const parameters[] = {c_i.data(), c_j.data()};
+    std::array<double, 3> expected_residuals;
+    std::array<std::array<double, 9>, 2> expected_jacobians;
+    double* expected_jacobian_pointers[] = {expected_jacobians[0].data(),
+                                            expected_jacobians[1].data()};
+    ASSERT_TRUE(auto_diff_cost_function.Evaluate(
+        parameters, expected_residuals.data(), expected_jacobian_pointers));
+    std::array<double, 3> residuals;
+    std::array<std::array<double, 9>, 2> jacobians;
+    double* jacobian_pointers[] = {jacobians[0].data(), jacobians[1].data()};
+    ASSERT_TRUE(analytical_cost_function.Evaluate(parameters, residuals.data(),
+                                                  jacobian_pointers));
+    for (int k = 0; k != 3; ++k) {
+      EXPECT_NEAR(expected_residuals[k], residuals[k], 1e-9);
+    }
+    for (int block = 0; block != 2; ++block) {
+      for (int k = 0; k != 9; ++k) {
+        EXPECT_NEAR(expected_jacobians[block][k], jacobians[block][k], 1e-9);
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -19,6 +19,7 @@
 #include <cmath>
 #include <memory>
 #include <random>
+#include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/make_unique.h"
@@ -26,6 +27,7 @@
 #include "cartographer/common/time.h"
 #include "cartographer/mapping_2d/range_data_inserter.h"
 #include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/transform/rigid_transform.h"
 #include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
@@ -52,6 +54,11 @@ class SparsePoseGraphTest : public ::testing::Test {
           return {
             resolution = 0.05,
             num_range_data = 1,
+            use_tiled_probability_grid = false,
+            use_background_insertion = false,
+            low_resolution = 0.,
+            use_probability_mirror = false,
+            use_adaptive_resolution = false,
             range_data_inserter = {
               insert_free_space = true,
               hit_probability = 0.53,
@@ -71,13 +78,24 @@ class SparsePoseGraphTest : public ::testing::Test {
               max_constraint_distance = 6.,
               min_score = 0.5,
               global_localization_min_score = 0.6,
+              global_localization_num_tasks = 1,
+              global_localization_time_limit_seconds = 0.,
               loop_closure_translation_weight = 1.,
               loop_closure_rotation_weight = 1.,
+              scan_matcher_cache_size_mb = 0,
+              scan_matcher_precomputation_num_tasks = 1,
+              decompressed_node_cache_size_mb = 0,
+              speculative_precomputation_num_range_data = 0,
+              use_coarse_precheck = true,
+              refinement_batch_num_threads = 2,
+              order_searches_by_value = false,
               log_matches = true,
               fast_correlative_scan_matcher = {
                 linear_search_window = 3.,
                 angular_search_window = 0.1,
                 branch_and_bound_depth = 3,
+                coarse_bits_per_cell = 8,
+                sort_points_by_cell = false,
               },
               ceres_scan_matcher = {
                 occupied_space_weight = 20.,
@@ -103,6 +121,7 @@ class SparsePoseGraphTest : public ::testing::Test {
                 translation_weight = 10.,
                 rotation_weight = 1.,
                 only_optimize_yaw = true,
+                use_single_precision_evaluation = false,
                 ceres_solver_options = {
                   use_nonmonotonic_steps = true,
                   max_num_iterations = 50,
@@ -120,6 +139,9 @@ class SparsePoseGraphTest : public ::testing::Test {
               consecutive_scan_rotation_penalty_factor = 0.,
               fixed_frame_pose_translation_weight = 1e1,
               fixed_frame_pose_rotation_weight = 1e2,
+              sliding_window_num_nodes = 0,
+              solve_connected_components_in_parallel = false,
+              min_num_iterations_before_interrupt = 0,
               log_solver_summary = true,
               ceres_solver_options = {
                 use_nonmonotonic_steps = false,
@@ -131,10 +153,38 @@ class SparsePoseGraphTest : public ::testing::Test {
             global_sampling_ratio = 0.01,
             log_residual_histograms = true,
             global_constraint_search_after_n_seconds = 10.0,
+            load_shedding = {
+              min_backlog_scans = 0,
+              max_backlog_scans = 0,
+              min_backlog_seconds = 0.,
+              max_backlog_seconds = 0.,
+              min_sampling_ratio_factor = 1.,
+              skip_global_localization_at_max_load = false,
+              max_optimize_every_n_scans_factor = 1.,
+            },
+            final_constraint_search_time_limit_seconds = 0.,
+            compress_node_point_clouds = false,
+            optimize_with_finished_constraints = false,
+            max_num_constraints_per_submap_pair = 0,
+            max_work_queue_size = 0,
+            place_recognition_num_candidates = 0,
+            max_num_change_log_entries = 1000,
+            interrupt_optimization_work_queue_size = 0,
+            overlapping_submaps_trimmer = {
+              fresh_submaps_count = 0,
+              min_covered_area = 20.,
+              min_added_submaps_count = 5,
+              coverage_cell_size = 1.,
+            },
+            deterministic = false,
+            cross_trajectory_search_area_size = 0.,
+            max_cross_trajectory_searches_per_area = 20,
+            cost_attribution_num_top_submaps = 0,
           })text");
+      sparse_pose_graph_options_ =
+          mapping::CreateSparsePoseGraphOptions(parameter_dictionary.get());
       sparse_pose_graph_ = common::make_unique<SparsePoseGraph>(
-          mapping::CreateSparsePoseGraphOptions(parameter_dictionary.get()),
-          &thread_pool_);
+          sparse_pose_graph_options_, &thread_pool_);
     }
 
     current_pose_ = transform::Rigid2d::Identity();
@@ -176,6 +226,7 @@ class SparsePoseGraphTest : public ::testing::Test {
   sensor::PointCloud point_cloud_;
   std::unique_ptr<ActiveSubmaps> active_submaps_;
   common::ThreadPool thread_pool_;
+  mapping::proto::SparsePoseGraphOptions sparse_pose_graph_options_;
   std::unique_ptr<SparsePoseGraph> sparse_pose_graph_;
   transform::Rigid2d current_pose_;
 };
@@ -202,6 +253,94 @@ TEST_F(SparsePoseGraphTest, NoMovement) {
               transform::IsNearly(transform::Rigid3d::Identity(), 1e-2));
 }
 
+TEST_F(SparsePoseGraphTest, PublishesSnapshotAfterOptimization) {
+  EXPECT_EQ(0, sparse_pose_graph_->GetSnapshot()->version);
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d::Identity());
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto snapshot = sparse_pose_graph_->GetSnapshot();
+  EXPECT_LT(0, snapshot->version);
+  ASSERT_THAT(snapshot->trajectory_nodes.size(), ::testing::Eq(1u));
+  EXPECT_THAT(snapshot->trajectory_nodes[0].size(), ::testing::Eq(2u));
+  ASSERT_THAT(snapshot->submap_data.size(), ::testing::Eq(1u));
+  EXPECT_THAT(snapshot->local_to_global_transforms.size(), ::testing::Eq(1u));
+}
+
+TEST_F(SparsePoseGraphTest, QueriesRegion) {
+  for (int i = 0; i != 20; ++i) {
+    MoveRelative(transform::Rigid2d::Translation({0.1, 0.}));
+  }
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto all_nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(all_nodes.size(), ::testing::Eq(1u));
+  const Eigen::AlignedBox2d region(Eigen::Vector2d(0.45, -1.),
+                                   Eigen::Vector2d(1.05, 1.));
+  size_t num_nodes_in_region = 0;
+  for (const mapping::TrajectoryNode& node : all_nodes[0]) {
+    if (region.contains(node.pose.translation().head<2>())) {
+      ++num_nodes_in_region;
+    }
+  }
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodesInRegion(region);
+  EXPECT_LT(0u, nodes.size());
+  EXPECT_EQ(num_nodes_in_region, nodes.size());
+  for (const auto& node_id_and_node : nodes) {
+    EXPECT_TRUE(
+        region.contains(node_id_and_node.second.pose.translation().head<2>()));
+  }
+  const auto all_submap_data = sparse_pose_graph_->GetAllSubmapData();
+  ASSERT_THAT(all_submap_data.size(), ::testing::Eq(1u));
+  const auto submap_data =
+      sparse_pose_graph_->GetSubmapDataInRegion(Eigen::AlignedBox2d(
+          Eigen::Vector2d(-1e3, -1e3), Eigen::Vector2d(1e3, 1e3)));
+  EXPECT_EQ(all_submap_data[0].size(), submap_data.size());
+  EXPECT_TRUE(sparse_pose_graph_
+                  ->GetSubmapDataInRegion(Eigen::AlignedBox2d(
+                      Eigen::Vector2d(1e3, 1e3), Eigen::Vector2d(2e3, 2e3)))
+                  .empty());
+}
+
+TEST_F(SparsePoseGraphTest, ReportsComputationProgress) {
+  std::vector<mapping::SparsePoseGraph::ComputationProgress> progresses;
+  sparse_pose_graph_->SetComputationProgressCallback(
+      [&progresses](
+          const mapping::SparsePoseGraph::ComputationProgress& progress) {
+        progresses.push_back(progress);
+      });
+  for (int i = 0; i != 10; ++i) {
+    MoveRelative(transform::Rigid2d::Translation({0.1, 0.}));
+  }
+  sparse_pose_graph_->RunFinalOptimization();
+  // Depending on timing, the computations may have finished before waiting.
+  for (size_t i = 0; i != progresses.size(); ++i) {
+    EXPECT_LE(0, progresses[i].num_remaining_scans);
+    if (i != 0) {
+      EXPECT_LE(progresses[i - 1].num_finished_scans,
+                progresses[i].num_finished_scans);
+    }
+  }
+  if (!progresses.empty()) {
+    EXPECT_EQ(0, progresses.back().num_remaining_scans);
+  }
+}
+
+TEST_F(SparsePoseGraphTest, LocalizationTrajectoryIsNotMatchedAgainst) {
+  sparse_pose_graph_->SetLocalizationTrajectory(0);
+  for (int i = 0; i != 10; ++i) {
+    MoveRelative(transform::Rigid2d::Translation({0.1, 0.}));
+  }
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  EXPECT_THAT(nodes[0].size(), ::testing::Eq(10u));
+  // Without frozen trajectories, only the constraints of the insertions into
+  // the submaps exist.
+  for (const auto& constraint : sparse_pose_graph_->constraints()) {
+    EXPECT_EQ(mapping::SparsePoseGraph::Constraint::INTRA_SUBMAP,
+              constraint.tag);
+  }
+}
+
 TEST_F(SparsePoseGraphTest, NoOverlappingScans) {
   std::mt19937 rng(0);
   std::uniform_real_distribution<double> distribution(-1., 1.);
@@ -270,6 +409,55 @@ TEST_F(SparsePoseGraphTest, OverlappingScans) {
               ::testing::Lt(error_before.translation().norm()));
 }
 
+TEST_F(SparsePoseGraphTest, BacklogInterruptsOptimization) {
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(2);
+  options.set_interrupt_optimization_work_queue_size(1);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  metrics::Registry registry;
+  sparse_pose_graph_->RegisterMetrics(&registry);
+  const metrics::Counter* const num_interrupted_optimizations =
+      registry.GetCounter(
+          "cartographer_sparse_pose_graph_interrupted_optimizations_total",
+          "");
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  std::vector<transform::Rigid2d> ground_truth;
+  std::vector<transform::Rigid2d> poses;
+  // The scans are added much faster than the constraints of the first ones
+  // are computed, so the rest of them wait for the first optimization.
+  for (int i = 0; i != 20; ++i) {
+    const transform::Rigid2d noise(
+        {0.05 * distribution(rng), 0.05 * distribution(rng)},
+        0.05 * distribution(rng));
+    MoveRelativeWithNoise(transform::Rigid2d::Translation({0.1, 0.}), noise);
+    ground_truth.emplace_back(current_pose_);
+    poses.emplace_back(noise * current_pose_);
+  }
+  // The metrics are recorded after the solve returns.
+  while (num_interrupted_optimizations->Value() == 0.) {
+  }
+
+  // The final optimization cannot be interrupted and corrects the noise.
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  ASSERT_THAT(nodes[0].size(), ::testing::Eq(20u));
+  const transform::Rigid2d true_movement =
+      ground_truth.front().inverse() * ground_truth.back();
+  const transform::Rigid2d error_before =
+      (poses.front().inverse() * poses.back()).inverse() * true_movement;
+  const transform::Rigid2d optimized_error =
+      transform::Project2D(nodes[0].front().pose.inverse() *
+                           nodes[0].back().pose)
+          .inverse() *
+      true_movement;
+  EXPECT_THAT(optimized_error.translation().norm(),
+              ::testing::Lt(error_before.translation().norm()));
+}
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
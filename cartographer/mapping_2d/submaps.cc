@@ -21,6 +21,9 @@
 #include <cstdlib>
 #include <fstream>
 #include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/make_unique.h"
@@ -30,23 +33,44 @@
 namespace cartographer {
 namespace mapping_2d {
 
+namespace {
+
+// Writes the two bytes of the texture of a cell with 'value', which has been
+// converted to 'log_odds_integer', to 'pixel'.
+void ComputeTexturePixel(const uint16 value, const uint8 log_odds_integer,
+                         char* const pixel) {
+  if (value != mapping::kUnknownProbabilityValue) {
+    // We would like to add 'delta' but this is not possible using a value and
+    // alpha. We use premultiplied alpha, so when 'delta' is positive we can
+    // add it by setting 'alpha' to zero. If it is negative, we set 'value' to
+    // zero, and use 'alpha' to subtract. This is only correct when the pixel
+    // is currently white, so walls will look too gray. This should be hard to
+    // detect visually for the user, though.
+    const int delta = 128 - log_odds_integer;
+    const uint8 alpha = delta > 0 ? 0 : -delta;
+    const uint8 pixel_value = delta > 0 ? delta : 0;
+    pixel[0] = pixel_value;
+    pixel[1] = (pixel_value || alpha) ? alpha : 1;
+  } else {
+    constexpr uint8 kUnknownLogOdds = 0;
+    pixel[0] = static_cast<uint8>(kUnknownLogOdds);  // value
+    pixel[1] = 0;                                    // alpha
+  }
+}
+
+bool HaveEqualCellIndices(const MapLimits& lhs, const MapLimits& rhs) {
+  return lhs.resolution() == rhs.resolution() && lhs.max() == rhs.max() &&
+         lhs.cell_limits().num_x_cells == rhs.cell_limits().num_x_cells &&
+         lhs.cell_limits().num_y_cells == rhs.cell_limits().num_y_cells;
+}
+
+}  // namespace
+
+constexpr int Submap::kCoarseGridDownsamplingFactor;
+
 ProbabilityGrid ComputeCroppedProbabilityGrid(
     const ProbabilityGrid& probability_grid) {
-  Eigen::Array2i offset;
-  CellLimits limits;
-  probability_grid.ComputeCroppedLimits(&offset, &limits);
-  const double resolution = probability_grid.limits().resolution();
-  const Eigen::Vector2d max =
-      probability_grid.limits().max() -
-      resolution * Eigen::Vector2d(offset.y(), offset.x());
-  ProbabilityGrid cropped_grid(MapLimits(resolution, max, limits));
-  for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(limits)) {
-    if (probability_grid.IsKnown(xy_index + offset)) {
-      cropped_grid.SetProbability(
-          xy_index, probability_grid.GetProbability(xy_index + offset));
-    }
-  }
-  return cropped_grid;
+  return probability_grid.ComputeCroppedGrid();
 }
 
 proto::SubmapsOptions CreateSubmapsOptions(
@@ -55,26 +79,79 @@ proto::SubmapsOptions CreateSubmapsOptions(
   options.set_resolution(parameter_dictionary->GetDouble("resolution"));
   options.set_num_range_data(
       parameter_dictionary->GetNonNegativeInt("num_range_data"));
+  options.set_use_tiled_probability_grid(
+      parameter_dictionary->GetBool("use_tiled_probability_grid"));
+  options.set_use_background_insertion(
+      parameter_dictionary->GetBool("use_background_insertion"));
+  options.set_low_resolution(parameter_dictionary->GetDouble("low_resolution"));
+  options.set_use_probability_mirror(
+      parameter_dictionary->GetBool("use_probability_mirror"));
+  options.set_use_adaptive_resolution(
+      parameter_dictionary->GetBool("use_adaptive_resolution"));
   *options.mutable_range_data_inserter_options() =
       CreateRangeDataInserterOptions(
           parameter_dictionary->GetDictionary("range_data_inserter").get());
   CHECK_GT(options.num_range_data(), 0);
+  CHECK(!options.use_adaptive_resolution() ||
+        options.use_tiled_probability_grid())
+      << "'use_adaptive_resolution' requires 'use_tiled_probability_grid'.";
   return options;
 }
 
-Submap::Submap(const MapLimits& limits, const Eigen::Vector2f& origin)
+Submap::Submap(const MapLimits& limits, const Eigen::Vector2f& origin,
+               const bool use_tiled_probability_grid,
+               const double low_resolution, const bool use_probability_mirror,
+               const bool use_adaptive_resolution)
     : mapping::Submap(transform::Rigid3d::Translation(
           Eigen::Vector3d(origin.x(), origin.y(), 0.))),
-      probability_grid_(limits) {}
+      probability_grid_(limits, use_tiled_probability_grid,
+                        use_adaptive_resolution) {
+  if (use_probability_mirror) {
+    probability_grid_.EnableProbabilityMirror();
+  }
+  if (low_resolution > 0.) {
+    CHECK_GE(low_resolution, limits.resolution());
+    // The low resolution grid covers the same area and grows with the
+    // insertions like the full resolution grid. Its cell boundaries are at
+    // integer multiples of its resolution, see ActiveSubmaps.
+    const double scale = limits.resolution() / low_resolution;
+    const CellLimits low_resolution_cell_limits(
+        std::ceil(limits.cell_limits().num_x_cells * scale) + 1,
+        std::ceil(limits.cell_limits().num_y_cells * scale) + 1);
+    const Eigen::Vector2d low_resolution_max =
+        low_resolution *
+        (limits.max().array() / low_resolution).ceil().matrix();
+    low_resolution_probability_grid_ = common::make_unique<ProbabilityGrid>(
+        MapLimits(low_resolution, low_resolution_max,
+                  low_resolution_cell_limits),
+        use_tiled_probability_grid);
+    if (use_probability_mirror) {
+      low_resolution_probability_grid_->EnableProbabilityMirror();
+    }
+  }
+}
 
 Submap::Submap(const mapping::proto::Submap2D& proto)
+    : Submap(proto, true /* load_probability_grid */) {}
+
+Submap::Submap(const mapping::proto::Submap2D& proto,
+               const bool load_probability_grid)
     : mapping::Submap(transform::ToRigid3(proto.local_pose())),
-      probability_grid_(ProbabilityGrid(proto.probability_grid())) {
+      probability_grid_(
+          load_probability_grid
+              ? ProbabilityGrid(proto.probability_grid())
+              : ProbabilityGrid(MapLimits(proto.probability_grid().limits()),
+                                true /* tiled */)) {
   SetNumRangeData(proto.num_range_data());
   finished_ = proto.finished();
+  if (finished_ && load_probability_grid) {
+    coarse_probability_grid_ = common::make_unique<CoarseProbabilityGrid>(
+        probability_grid_, kCoarseGridDownsamplingFactor);
+  }
 }
 
 void Submap::ToProto(mapping::proto::Submap* const proto) const {
+  common::MutexLocker locker(&mutex_);
   auto* const submap_2d = proto->mutable_submap_2d();
   *submap_2d->mutable_local_pose() = transform::ToProto(local_pose());
   submap_2d->set_num_range_data(num_range_data());
@@ -82,41 +159,108 @@ void Submap::ToProto(mapping::proto::Submap* const proto) const {
   *submap_2d->mutable_probability_grid() = probability_grid_.ToProto();
 }
 
+void Submap::UpdateFromProto(const mapping::proto::Submap& proto) {
+  CHECK(proto.has_submap_2d());
+  const auto& submap_2d = proto.submap_2d();
+  common::MutexLocker locker(&mutex_);
+  SetNumRangeData(submap_2d.num_range_data());
+  finished_ = submap_2d.finished();
+  if (submap_2d.probability_grid().has_known_cells() ||
+      submap_2d.probability_grid().cells_size() > 0) {
+    probability_grid_ = ProbabilityGrid(submap_2d.probability_grid());
+    if (finished_) {
+      coarse_probability_grid_ = common::make_unique<CoarseProbabilityGrid>(
+          probability_grid_, kCoarseGridDownsamplingFactor);
+    }
+  }
+  texture_cache_.reset();
+  texture_cache_outdated_ = true;
+}
+
+int64 Submap::GetMemoryUsageInBytes() const {
+  common::MutexLocker locker(&mutex_);
+  int64 memory_usage_in_bytes = probability_grid_.GetMemoryUsageInBytes();
+  if (low_resolution_probability_grid_ != nullptr) {
+    memory_usage_in_bytes +=
+        low_resolution_probability_grid_->GetMemoryUsageInBytes();
+  }
+  if (coarse_probability_grid_ != nullptr) {
+    memory_usage_in_bytes += coarse_probability_grid_->GetMemoryUsageInBytes();
+  }
+  return memory_usage_in_bytes;
+}
+
 void Submap::ToResponseProto(
     const transform::Rigid3d&,
     mapping::proto::SubmapQuery::Response* const response) const {
+  common::MutexLocker locker(&mutex_);
   response->set_submap_version(num_range_data());
+  UpdateTextureCache();
+  *response->add_textures() = texture_cache_->texture;
+}
 
-  Eigen::Array2i offset;
-  CellLimits limits;
-  probability_grid_.ComputeCroppedLimits(&offset, &limits);
-
-  string cells;
-  for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(limits)) {
-    if (probability_grid_.IsKnown(xy_index + offset)) {
-      // We would like to add 'delta' but this is not possible using a value and
-      // alpha. We use premultiplied alpha, so when 'delta' is positive we can
-      // add it by setting 'alpha' to zero. If it is negative, we set 'value' to
-      // zero, and use 'alpha' to subtract. This is only correct when the pixel
-      // is currently white, so walls will look too gray. This should be hard to
-      // detect visually for the user, though.
-      const int delta =
-          128 - mapping::ProbabilityToLogOddsInteger(
-                    probability_grid_.GetProbability(xy_index + offset));
-      const uint8 alpha = delta > 0 ? 0 : -delta;
-      const uint8 value = delta > 0 ? delta : 0;
-      cells.push_back(value);
-      cells.push_back((value || alpha) ? alpha : 1);
-    } else {
-      constexpr uint8 kUnknownLogOdds = 0;
-      cells.push_back(static_cast<uint8>(kUnknownLogOdds));  // value
-      cells.push_back(0);                                    // alpha
+void Submap::UpdateTextureCache() const {
+  if (!texture_cache_outdated_) {
+    return;
+  }
+  auto texture_cache = common::make_unique<TextureCache>(
+      TextureCache{probability_grid_.limits(), Eigen::Array2i(), CellLimits(),
+                   string(), {}});
+  probability_grid_.ComputeCroppedLimits(&texture_cache->offset,
+                                         &texture_cache->limits);
+  const Eigen::Array2i& offset = texture_cache->offset;
+  const CellLimits& limits = texture_cache->limits;
+
+  // Cells outside 'changed_cells_' are copied from the previous texture if it
+  // covers them and the cell indices of the grid did not change.
+  const TextureCache* const previous =
+      texture_cache_ != nullptr && !texture_cache_->cells.empty() &&
+              HaveEqualCellIndices(texture_cache_->grid_limits,
+                                   probability_grid_.limits())
+          ? texture_cache_.get()
+          : nullptr;
+  const Eigen::AlignedBox2i previous_cells =
+      previous == nullptr
+          ? Eigen::AlignedBox2i()
+          : Eigen::AlignedBox2i(
+                previous->offset.matrix(),
+                (previous->offset + Eigen::Array2i(
+                                        previous->limits.num_x_cells - 1,
+                                        previous->limits.num_y_cells - 1))
+                    .matrix());
+
+  string& cells = texture_cache->cells;
+  cells.resize(2 * limits.num_x_cells * limits.num_y_cells);
+  // Cells are converted a row at a time.
+  std::vector<uint16> values(limits.num_x_cells);
+  std::vector<uint8> log_odds_integers(limits.num_x_cells);
+  int pixel_index = 0;
+  for (int y = 0; y != limits.num_y_cells; ++y) {
+    probability_grid_.GetCellValues(offset + Eigen::Array2i(0, y),
+                                    limits.num_x_cells, values.data());
+    mapping::ValuesToLogOddsIntegers(values.data(), limits.num_x_cells,
+                                     log_odds_integers.data());
+    for (int x = 0; x != limits.num_x_cells; ++x, ++pixel_index) {
+      const Eigen::Array2i cell_index = offset + Eigen::Array2i(x, y);
+      if (previous_cells.contains(cell_index.matrix()) &&
+          !changed_cells_.contains(cell_index.matrix())) {
+        const Eigen::Array2i previous_xy_index = cell_index - previous->offset;
+        const int previous_pixel_index =
+            previous_xy_index.y() * previous->limits.num_x_cells +
+            previous_xy_index.x();
+        cells[2 * pixel_index] = previous->cells[2 * previous_pixel_index];
+        cells[2 * pixel_index + 1] =
+            previous->cells[2 * previous_pixel_index + 1];
+      } else {
+        ComputeTexturePixel(values[x], log_odds_integers[x],
+                            &cells[2 * pixel_index]);
+      }
     }
   }
+
   mapping::proto::SubmapQuery::Response::SubmapTexture* const texture =
-      response->add_textures();
+      &texture_cache->texture;
   common::FastGzipString(cells, texture->mutable_cells());
-
   texture->set_width(limits.num_x_cells);
   texture->set_height(limits.num_y_cells);
   const double resolution = probability_grid_.limits().resolution();
@@ -128,36 +272,154 @@ void Submap::ToResponseProto(
   *texture->mutable_slice_pose() = transform::ToProto(
       local_pose().inverse() *
       transform::Rigid3d::Translation(Eigen::Vector3d(max_x, max_y, 0.)));
+
+  if (finished_) {
+    // The texture cannot change anymore.
+    string().swap(cells);
+  }
+  texture_cache_ = std::move(texture_cache);
+  texture_cache_outdated_ = false;
+  changed_cells_.setEmpty();
 }
 
 void Submap::InsertRangeData(const sensor::RangeData& range_data,
                              const RangeDataInserter& range_data_inserter) {
+  common::MutexLocker locker(&mutex_);
   CHECK(!finished_);
   range_data_inserter.Insert(range_data, &probability_grid_);
+  if (low_resolution_probability_grid_ != nullptr) {
+    range_data_inserter.Insert(range_data,
+                               low_resolution_probability_grid_.get());
+  }
+  FinishInsertion(range_data);
+}
+
+void Submap::InsertRangeData(
+    const sensor::RangeData& range_data,
+    const RasterizedRangeData& rasterized_range_data,
+    const RasterizedRangeData* const low_resolution_rasterized_range_data,
+    const RangeDataInserter& range_data_inserter) {
+  common::MutexLocker locker(&mutex_);
+  CHECK(!finished_);
+  range_data_inserter.Insert(range_data, rasterized_range_data,
+                             &probability_grid_);
+  if (low_resolution_probability_grid_ != nullptr) {
+    if (low_resolution_rasterized_range_data != nullptr) {
+      range_data_inserter.Insert(range_data,
+                                 *low_resolution_rasterized_range_data,
+                                 low_resolution_probability_grid_.get());
+    } else {
+      range_data_inserter.Insert(range_data,
+                                 low_resolution_probability_grid_.get());
+    }
+  }
+  FinishInsertion(range_data);
+}
+
+void Submap::FinishInsertion(const sensor::RangeData& range_data) {
   SetNumRangeData(num_range_data() + 1);
+
+  // All updated cells are on rays from the origin to the returns and misses,
+  // so they are within the bounding box of these points, up to one cell.
+  Eigen::AlignedBox2f bounding_box(range_data.origin.head<2>());
+  for (const Eigen::Vector3f& hit : range_data.returns) {
+    bounding_box.extend(hit.head<2>());
+  }
+  for (const Eigen::Vector3f& miss : range_data.misses) {
+    bounding_box.extend(miss.head<2>());
+  }
+  const MapLimits& limits = probability_grid_.limits();
+  changed_cells_.extend(
+      (limits.GetCellIndex(bounding_box.min()) + 1).matrix());
+  changed_cells_.extend(
+      (limits.GetCellIndex(bounding_box.max()) - 1).matrix());
+  texture_cache_outdated_ = true;
 }
 
 void Submap::Finish() {
+  common::MutexLocker locker(&mutex_);
   CHECK(!finished_);
   probability_grid_ = ComputeCroppedProbabilityGrid(probability_grid_);
+  // Finished submaps are no longer matched against by local SLAM.
+  low_resolution_probability_grid_.reset();
+  coarse_probability_grid_ = common::make_unique<CoarseProbabilityGrid>(
+      probability_grid_, kCoarseGridDownsamplingFactor);
   finished_ = true;
+  texture_cache_outdated_ = true;
 }
 
 ActiveSubmaps::ActiveSubmaps(const proto::SubmapsOptions& options)
     : options_(options),
       range_data_inserter_(options.range_data_inserter_options()) {
+  if (options_.use_background_insertion()) {
+    insertion_thread_ = common::make_unique<common::ThreadPool>(1);
+  }
   // We always want to have at least one likelihood field which we can return,
   // and will create it at the origin in absence of a better choice.
   AddSubmap(Eigen::Vector2f::Zero());
 }
 
-void ActiveSubmaps::InsertRangeData(const sensor::RangeData& range_data) {
+ActiveSubmaps::~ActiveSubmaps() { WaitForPendingInsertions(); }
+
+void ActiveSubmaps::InsertRangeData(sensor::RangeData range_data) {
+  const Eigen::Vector2f origin = range_data.origin.head<2>();
+  // The rays are cast once per resolution, and the result is shared by all
+  // submaps including those inserted into in the background.
+  auto insertion = std::make_shared<RasterizedInsertion>(RasterizedInsertion{
+      sensor::RangeData(),
+      range_data_inserter_.Rasterize(range_data, options_.resolution()),
+      nullptr});
+  if (options_.low_resolution() > 0.) {
+    insertion->low_resolution_rasterized_range_data =
+        common::make_unique<const RasterizedRangeData>(
+            range_data_inserter_.Rasterize(range_data,
+                                           options_.low_resolution()));
+  }
+  insertion->range_data = std::move(range_data);
   for (auto& submap : submaps_) {
-    submap->InsertRangeData(range_data, range_data_inserter_);
+    if (insertion_thread_ != nullptr && submap != submaps_.front()) {
+      InsertRangeDataInBackground(submap, insertion);
+    } else {
+      InsertRangeData(submap, *insertion);
+    }
+  }
+  if (++num_range_data_in_newest_submap_ == options_.num_range_data()) {
+    // The newest submap will be used for matching from now on.
+    WaitForPendingInsertions();
+    AddSubmap(origin);
   }
-  if (submaps_.back()->num_range_data() == options_.num_range_data()) {
-    AddSubmap(range_data.origin.head<2>());
+}
+
+void ActiveSubmaps::WaitForPendingInsertions() {
+  common::MutexLocker locker(&mutex_);
+  locker.Await([this]() REQUIRES(mutex_) {
+    return num_pending_insertions_ == 0;
+  });
+}
+
+void ActiveSubmaps::InsertRangeData(
+    const std::shared_ptr<Submap>& submap,
+    const RasterizedInsertion& insertion) const {
+  submap->InsertRangeData(insertion.range_data,
+                          insertion.rasterized_range_data,
+                          insertion.low_resolution_rasterized_range_data.get(),
+                          range_data_inserter_);
+}
+
+void ActiveSubmaps::InsertRangeDataInBackground(
+    const std::shared_ptr<Submap>& submap,
+    const std::shared_ptr<const RasterizedInsertion>& insertion) {
+  {
+    common::MutexLocker locker(&mutex_);
+    ++num_pending_insertions_;
   }
+  insertion_thread_->Schedule(
+      [this, submap, insertion]() EXCLUDES(mutex_) {
+        InsertRangeData(submap, *insertion);
+        common::MutexLocker locker(&mutex_);
+        --num_pending_insertions_;
+      },
+      common::WorkItemPriority::kNormal, "insert_range_data_in_background");
 }
 
 std::vector<std::shared_ptr<Submap>> ActiveSubmaps::submaps() const {
@@ -179,14 +441,22 @@ void ActiveSubmaps::AddSubmap(const Eigen::Vector2f& origin) {
     // reduce peak memory usage a bit.
     FinishSubmap();
   }
+  num_range_data_in_newest_submap_ = 0;
   constexpr int kInitialSubmapSize = 100;
+  // Rounding keeps the cell boundaries at integer multiples of the resolution
+  // for all submaps, so that rasterized range data can be shared.
+  const double resolution = options_.resolution();
+  const Eigen::Vector2d max =
+      resolution *
+      ((origin.cast<double>() / resolution).array() + 0.5 * kInitialSubmapSize)
+          .round()
+          .matrix();
   submaps_.push_back(common::make_unique<Submap>(
-      MapLimits(options_.resolution(),
-                origin.cast<double>() + 0.5 * kInitialSubmapSize *
-                                            options_.resolution() *
-                                            Eigen::Vector2d::Ones(),
+      MapLimits(resolution, max,
                 CellLimits(kInitialSubmapSize, kInitialSubmapSize)),
-      origin));
+      origin, options_.use_tiled_probability_grid(),
+      options_.low_resolution(), options_.use_probability_mirror(),
+      options_.use_adaptive_resolution()));
   LOG(INFO) << "Added submap " << matching_submap_index_ + submaps_.size();
 }
 
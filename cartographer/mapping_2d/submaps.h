@@ -21,11 +21,16 @@
 #include <vector>
 
 #include "Eigen/Core"
+#include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/proto/serialization.pb.h"
 #include "cartographer/mapping/proto/submap_visualization.pb.h"
 #include "cartographer/mapping/submaps.h"
 #include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/mapping_2d/coarse_probability_grid.h"
 #include "cartographer/mapping_2d/map_limits.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/mapping_2d/proto/submaps_options.pb.h"
@@ -44,14 +49,49 @@ proto::SubmapsOptions CreateSubmapsOptions(
 
 class Submap : public mapping::Submap {
  public:
-  Submap(const MapLimits& limits, const Eigen::Vector2f& origin);
+  static constexpr int kCoarseGridDownsamplingFactor = 8;
+
+  // If 'low_resolution' is positive, a probability grid of this resolution is
+  // maintained as well until the submap is finished. If
+  // 'use_probability_mirror' is true, the grids keep a probability mirror
+  // until the submap is finished. If 'use_adaptive_resolution' is true, the
+  // tiled probability grid is adaptive until the submap is finished.
+  Submap(const MapLimits& limits, const Eigen::Vector2f& origin,
+         bool use_tiled_probability_grid = false, double low_resolution = 0.,
+         bool use_probability_mirror = false,
+         bool use_adaptive_resolution = false);
   explicit Submap(const mapping::proto::Submap2D& proto);
+  // Unless 'load_probability_grid' is true, the probability grid only has the
+  // limits of the one in 'proto' and all its cells are unknown, so that it
+  // uses almost no memory. This is meant for submaps which are loaded again
+  // when their grid is needed.
+  Submap(const mapping::proto::Submap2D& proto, bool load_probability_grid);
 
   void ToProto(mapping::proto::Submap* proto) const override;
+  // Updates the number of range data and whether it is finished from 'proto',
+  // and the probability grid if 'proto' contains cells.
+  void UpdateFromProto(const mapping::proto::Submap& proto);
 
+  // Does not synchronize with insertion on another thread, so it must only be
+  // used while no range data is inserted in the background, e.g. for the
+  // matching submap or finished submaps.
   const ProbabilityGrid& probability_grid() const { return probability_grid_; }
+  // Same as above for the low resolution grid, or nullptr if there is none.
+  const ProbabilityGrid* low_resolution_probability_grid() const {
+    return low_resolution_probability_grid_.get();
+  }
+  // A summary of the probability grid at a resolution
+  // 'kCoarseGridDownsamplingFactor' times lower, which is only kept for
+  // finished submaps whose probability grid was loaded, or nullptr.
+  const CoarseProbabilityGrid* coarse_probability_grid() const {
+    return coarse_probability_grid_.get();
+  }
   bool finished() const { return finished_; }
 
+  // Returns the number of bytes used by the probability grids. Synchronizes
+  // with insertion on another thread.
+  int64 GetMemoryUsageInBytes() const EXCLUDES(mutex_);
+
   void ToResponseProto(
       const transform::Rigid3d& global_submap_pose,
       mapping::proto::SubmapQuery::Response* response) const override;
@@ -60,11 +100,48 @@ class Submap : public mapping::Submap {
   // submap must not be finished yet.
   void InsertRangeData(const sensor::RangeData& range_data,
                        const RangeDataInserter& range_data_inserter);
+  // Same as above, but reuses the rays of 'range_data' which the
+  // 'range_data_inserter' cast for the resolution of the probability grid and,
+  // unless it is nullptr, for the resolution of the low resolution grid.
+  void InsertRangeData(
+      const sensor::RangeData& range_data,
+      const RasterizedRangeData& rasterized_range_data,
+      const RasterizedRangeData* low_resolution_rasterized_range_data,
+      const RangeDataInserter& range_data_inserter);
   void Finish();
 
  private:
+  // The texture returned by ToResponseProto() and its uncompressed cells,
+  // which are kept to update only the changed cells on the next query.
+  struct TextureCache {
+    MapLimits grid_limits;
+    Eigen::Array2i offset;
+    CellLimits limits;
+    // Two bytes per cell of 'limits' in 'XYIndexRangeIterator' order. Cleared
+    // once the submap is finished and cannot change anymore.
+    string cells;
+    mapping::proto::SubmapQuery::Response::SubmapTexture texture;
+  };
+
+  // Recomputes 'texture_cache_' if the submap changed since it was computed.
+  void UpdateTextureCache() const REQUIRES(mutex_);
+  // Counts the inserted 'range_data' and marks the cells it changed.
+  void FinishInsertion(const sensor::RangeData& range_data) REQUIRES(mutex_);
+
+  // Serializing and finishing the submap synchronize with insertion on
+  // another thread.
+  mutable common::Mutex mutex_;
   ProbabilityGrid probability_grid_;
+  std::unique_ptr<ProbabilityGrid> low_resolution_probability_grid_;
+  std::unique_ptr<const CoarseProbabilityGrid> coarse_probability_grid_;
   bool finished_ = false;
+
+  mutable std::unique_ptr<TextureCache> texture_cache_ GUARDED_BY(mutex_);
+  // Whether 'texture_cache_' is outdated, and the cells of
+  // 'probability_grid_' changed since it was computed. Other cells are only
+  // reused while the limits of 'probability_grid_' are unchanged.
+  mutable bool texture_cache_outdated_ GUARDED_BY(mutex_) = true;
+  mutable Eigen::AlignedBox2i changed_cells_ GUARDED_BY(mutex_);
 };
 
 // Except during initialization when only a single submap exists, there are
@@ -76,9 +153,19 @@ class Submap : public mapping::Submap {
 // considered initialized: the old submap is no longer changed, the "new" submap
 // is now the "old" submap and is used for scan-to-map matching. Moreover, a
 // "new" submap gets created. The "old" submap is forgotten by this object.
+//
+// With 'use_background_insertion', the "new" submap is updated on a dedicated
+// thread while the "old" one is updated by the caller. The "new" submap only
+// becomes the "old" one after all its pending insertions are done, so scan
+// matching always sees a complete submap.
+//
+// All submaps have their cell boundaries at integer multiples of the
+// resolution, so the rays of each range data are cast only once per
+// resolution and the resulting cells are applied to all submaps.
 class ActiveSubmaps {
  public:
   explicit ActiveSubmaps(const proto::SubmapsOptions& options);
+  ~ActiveSubmaps();
 
   ActiveSubmaps(const ActiveSubmaps&) = delete;
   ActiveSubmaps& operator=(const ActiveSubmaps&) = delete;
@@ -87,19 +174,48 @@ class ActiveSubmaps {
   // used for scan-to-map matching.
   int matching_index() const;
 
-  // Inserts 'range_data' into the Submap collection.
-  void InsertRangeData(const sensor::RangeData& range_data);
+  // Inserts 'range_data' into the Submap collection. With background
+  // insertion, this returns once the matching submap has been updated. The
+  // background insertions share 'range_data' without copying it.
+  void InsertRangeData(sensor::RangeData range_data);
+
+  // Blocks until all range data queued for insertion in the background has
+  // been inserted.
+  void WaitForPendingInsertions() EXCLUDES(mutex_);
 
   std::vector<std::shared_ptr<Submap>> submaps() const;
 
  private:
+  // Range data and its rays cast for the resolutions of the submaps.
+  struct RasterizedInsertion {
+    sensor::RangeData range_data;
+    RasterizedRangeData rasterized_range_data;
+    std::unique_ptr<const RasterizedRangeData>
+        low_resolution_rasterized_range_data;
+  };
+
+  void InsertRangeData(const std::shared_ptr<Submap>& submap,
+                       const RasterizedInsertion& insertion) const;
+  void InsertRangeDataInBackground(
+      const std::shared_ptr<Submap>& submap,
+      const std::shared_ptr<const RasterizedInsertion>& insertion)
+      EXCLUDES(mutex_);
   void FinishSubmap();
   void AddSubmap(const Eigen::Vector2f& origin);
 
   const proto::SubmapsOptions options_;
   int matching_submap_index_ = 0;
   std::vector<std::shared_ptr<Submap>> submaps_;
+  // Number of range data inserted or queued for insertion into the newest
+  // submap.
+  int num_range_data_in_newest_submap_ = 0;
   RangeDataInserter range_data_inserter_;
+
+  common::Mutex mutex_;
+  int num_pending_insertions_ GUARDED_BY(mutex_) = 0;
+  // Only set with background insertion. Declared last so that its thread is
+  // joined before anything it uses is destroyed.
+  std::unique_ptr<common::ThreadPool> insertion_thread_;
 };
 
 }  // namespace mapping_2d
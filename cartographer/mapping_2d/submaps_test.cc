@@ -18,6 +18,7 @@
 
 #include <map>
 #include <memory>
+#include <random>
 #include <set>
 #include <string>
 
@@ -39,6 +40,11 @@ TEST(SubmapsTest, TheRightNumberOfScansAreInserted) {
       "num_range_data = " +
       std::to_string(kNumRangeData) +
       ", "
+      "use_tiled_probability_grid = false, "
+      "use_background_insertion = false, "
+      "low_resolution = 0., "
+      "use_probability_mirror = false, "
+      "use_adaptive_resolution = false, "
       "range_data_inserter = {"
       "insert_free_space = true, "
       "hit_probability = 0.53, "
@@ -67,6 +73,101 @@ TEST(SubmapsTest, TheRightNumberOfScansAreInserted) {
   EXPECT_EQ(correct_num_scans, all_submaps.size() - 2);
 }
 
+proto::SubmapsOptions CreateSubmapsOptionsWithBackgroundInsertion(
+    const bool use_background_insertion) {
+  auto parameter_dictionary = common::MakeDictionary(
+      "return {"
+      "resolution = 0.05, "
+      "num_range_data = 5, "
+      "use_tiled_probability_grid = false, "
+      "use_background_insertion = " +
+      string(use_background_insertion ? "true" : "false") +
+      ", "
+      "low_resolution = 0., "
+      "use_probability_mirror = false, "
+      "use_adaptive_resolution = false, "
+      "range_data_inserter = {"
+      "insert_free_space = true, "
+      "hit_probability = 0.53, "
+      "miss_probability = 0.495, "
+      "},"
+      "}");
+  return CreateSubmapsOptions(parameter_dictionary.get());
+}
+
+void ExpectEqualGrids(const ProbabilityGrid& expected,
+                      const ProbabilityGrid& actual) {
+  ASSERT_EQ(expected.limits().cell_limits().num_x_cells,
+            actual.limits().cell_limits().num_x_cells);
+  ASSERT_EQ(expected.limits().cell_limits().num_y_cells,
+            actual.limits().cell_limits().num_y_cells);
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(expected.limits().cell_limits())) {
+    ASSERT_EQ(expected.IsKnown(xy_index), actual.IsKnown(xy_index));
+    EXPECT_EQ(expected.GetProbability(xy_index),
+              actual.GetProbability(xy_index));
+  }
+}
+
+TEST(SubmapsTest, BackgroundInsertionMatchesSynchronousInsertion) {
+  ActiveSubmaps expected_submaps(
+      CreateSubmapsOptionsWithBackgroundInsertion(false));
+  ActiveSubmaps actual_submaps(
+      CreateSubmapsOptionsWithBackgroundInsertion(true));
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-4.f, 4.f);
+  for (int i = 0; i != 23; ++i) {
+    const Eigen::Vector3f origin(0.1f * i, 0.f, 0.f);
+    sensor::RangeData range_data{origin, {}, {}};
+    for (int j = 0; j != 100; ++j) {
+      range_data.returns.emplace_back(distribution(prng),
+                                      distribution(prng), 0.f);
+    }
+    expected_submaps.InsertRangeData(range_data);
+    actual_submaps.InsertRangeData(range_data);
+    ASSERT_EQ(expected_submaps.matching_index(),
+              actual_submaps.matching_index());
+    ASSERT_EQ(expected_submaps.submaps().size(),
+              actual_submaps.submaps().size());
+    // The matching submap is never updated in the background.
+    ExpectEqualGrids(expected_submaps.submaps().front()->probability_grid(),
+                     actual_submaps.submaps().front()->probability_grid());
+  }
+  actual_submaps.WaitForPendingInsertions();
+  for (size_t i = 0; i != expected_submaps.submaps().size(); ++i) {
+    EXPECT_EQ(expected_submaps.submaps()[i]->num_range_data(),
+              actual_submaps.submaps()[i]->num_range_data());
+    ExpectEqualGrids(expected_submaps.submaps()[i]->probability_grid(),
+                     actual_submaps.submaps()[i]->probability_grid());
+  }
+}
+
+TEST(SubmapsTest, LowResolutionProbabilityGrid) {
+  proto::RangeDataInserterOptions options;
+  options.set_insert_free_space(true);
+  options.set_hit_probability(0.53);
+  options.set_miss_probability(0.495);
+  const RangeDataInserter range_data_inserter(options);
+  Submap submap(MapLimits(0.05, Eigen::Vector2d(1., 1.), CellLimits(40, 40)),
+                Eigen::Vector2f::Zero(), false /* use_tiled_probability_grid */,
+                0.2 /* low_resolution */);
+  ASSERT_NE(nullptr, submap.low_resolution_probability_grid());
+  EXPECT_NEAR(
+      0.2, submap.low_resolution_probability_grid()->limits().resolution(),
+      1e-9);
+  submap.InsertRangeData(
+      {Eigen::Vector3f::Zero(), {Eigen::Vector3f(0.5f, 0.3f, 0.f)}, {}},
+      range_data_inserter);
+  const ProbabilityGrid& low_resolution_grid =
+      *submap.low_resolution_probability_grid();
+  const Eigen::Array2i hit_index =
+      low_resolution_grid.limits().GetCellIndex(Eigen::Vector2f(0.5f, 0.3f));
+  EXPECT_TRUE(low_resolution_grid.IsKnown(hit_index));
+  EXPECT_LT(0.5f, low_resolution_grid.GetProbability(hit_index));
+  submap.Finish();
+  EXPECT_EQ(nullptr, submap.low_resolution_probability_grid());
+}
+
 TEST(SubmapsTest, ToFromProto) {
   Submap expected(MapLimits(1., Eigen::Vector2d(2., 3.), CellLimits(100, 110)),
                   Eigen::Vector2f(4.f, 5.f));
@@ -74,7 +175,7 @@ TEST(SubmapsTest, ToFromProto) {
   expected.ToProto(&proto);
   EXPECT_TRUE(proto.has_submap_2d());
   EXPECT_FALSE(proto.has_submap_3d());
-  const auto actual = Submap(proto.submap_2d());
+  const Submap actual(proto.submap_2d());
   EXPECT_TRUE(expected.local_pose().translation().isApprox(
       actual.local_pose().translation(), 1e-6));
   EXPECT_TRUE(expected.local_pose().rotation().isApprox(
@@ -89,6 +190,60 @@ TEST(SubmapsTest, ToFromProto) {
             actual.probability_grid().limits().cell_limits().num_x_cells);
 }
 
+TEST(SubmapsTest, FromProtoWithoutProbabilityGrid) {
+  Submap expected(MapLimits(1., Eigen::Vector2d(2., 3.), CellLimits(100, 110)),
+                  Eigen::Vector2f(4.f, 5.f));
+  mapping::proto::Submap proto;
+  expected.ToProto(&proto);
+  const Submap actual(proto.submap_2d(), false /* load_probability_grid */);
+  EXPECT_TRUE(expected.local_pose().translation().isApprox(
+      actual.local_pose().translation(), 1e-6));
+  EXPECT_EQ(expected.num_range_data(), actual.num_range_data());
+  EXPECT_TRUE(expected.probability_grid().limits().max().isApprox(
+      actual.probability_grid().limits().max(), 1e-6));
+  EXPECT_FALSE(actual.probability_grid().IsKnown(Eigen::Array2i(10, 20)));
+  EXPECT_LT(actual.probability_grid().GetMemoryUsageInBytes(),
+            expected.probability_grid().GetMemoryUsageInBytes() / 10);
+}
+
+TEST(SubmapsTest, UpdatedTextureMatchesRecomputedTexture) {
+  proto::RangeDataInserterOptions options;
+  options.set_insert_free_space(true);
+  options.set_hit_probability(0.53);
+  options.set_miss_probability(0.495);
+  const RangeDataInserter range_data_inserter(options);
+  Submap submap(MapLimits(0.05, Eigen::Vector2d(1., 1.), CellLimits(40, 40)),
+                Eigen::Vector2f::Zero());
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-3.f, 3.f);
+  for (int i = 0; i != 20; ++i) {
+    const Eigen::Vector3f origin(0.1f * i, 0.f, 0.f);
+    sensor::RangeData range_data{origin, {}, {}};
+    // Few returns near the origin, so that most cells are not changed.
+    for (int j = 0; j != 5; ++j) {
+      range_data.returns.emplace_back(origin.x() + 0.2f * distribution(prng),
+                                      0.2f * distribution(prng), 0.f);
+    }
+    if (i % 7 == 6) {
+      // Grows the probability grid.
+      range_data.returns.emplace_back(distribution(prng), distribution(prng),
+                                      0.f);
+    }
+    submap.InsertRangeData(range_data, range_data_inserter);
+    if (i == 19) {
+      submap.Finish();
+    }
+    mapping::proto::SubmapQuery::Response actual;
+    submap.ToResponseProto(transform::Rigid3d::Identity(), &actual);
+    mapping::proto::Submap proto;
+    submap.ToProto(&proto);
+    mapping::proto::SubmapQuery::Response expected;
+    Submap(proto.submap_2d())
+        .ToResponseProto(transform::Rigid3d::Identity(), &expected);
+    EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+  }
+}
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
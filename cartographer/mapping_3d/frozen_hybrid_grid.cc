@@ -0,0 +1,117 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/frozen_hybrid_grid.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace cartographer {
+namespace mapping_3d {
+
+FrozenHybridGrid::FrozenHybridGrid(const HybridGrid& hybrid_grid)
+    : resolution_(hybrid_grid.resolution()),
+      grid_size_(hybrid_grid.grid_size()) {
+  // Sorting the known cells by block key and position in the block yields the
+  // order in which the blocks and values are stored.
+  std::vector<std::tuple<int64, int, uint16>> cells;
+  for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
+    const Eigen::Array3i index = it.GetCellIndex();
+    const int64 key = GetBlockKey(index);
+    CHECK_NE(key, -1) << "Index out of range: " << index;
+    CHECK_LT(it.GetValue(), mapping::kUpdateMarker)
+        << "Freezing a grid during an update is not supported.";
+    cells.emplace_back(key, GetBit(index), it.GetValue());
+  }
+  std::sort(cells.begin(), cells.end());
+  values_.reserve(cells.size());
+  for (const auto& cell : cells) {
+    const int64 key = std::get<0>(cell);
+    const int bit = std::get<1>(cell);
+    if (keys_.empty() || keys_.back() != key) {
+      keys_.push_back(key);
+      blocks_.emplace_back();
+      blocks_.back().mask.fill(0);
+      blocks_.back().value_offsets.fill(values_.size());
+    }
+    Block& block = blocks_.back();
+    block.mask[bit / 64] |= uint64{1} << (bit % 64);
+    // Words after the one of this bit start one value later.
+    for (int i = bit / 64 + 1; i != kNumMaskWords; ++i) {
+      ++block.value_offsets[i];
+    }
+    values_.push_back(std::get<2>(cell));
+  }
+  keys_.shrink_to_fit();
+  blocks_.shrink_to_fit();
+}
+
+int FrozenHybridGrid::FindBlock(const Eigen::Array3i& index) const {
+  const int64 key = GetBlockKey(index);
+  if (key == -1) {
+    return kNoBlock;
+  }
+  const auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+  if (it == keys_.end() || *it != key) {
+    return kNoBlock;
+  }
+  return it - keys_.begin();
+}
+
+FrozenHybridGrid::Iterator::Iterator(const FrozenHybridGrid& grid)
+    : grid_(&grid),
+      block_index_(0),
+      end_block_index_(grid.blocks_.size()),
+      mask_index_(0),
+      mask_(grid.blocks_.empty() ? 0 : grid.blocks_[0].mask[0]),
+      value_(grid.values_.data()) {
+  AdvanceToSetBit();
+}
+
+void FrozenHybridGrid::Iterator::Next() {
+  DCHECK(!Done());
+  mask_ &= mask_ - 1;
+  ++value_;
+  AdvanceToSetBit();
+}
+
+Eigen::Array3i FrozenHybridGrid::Iterator::GetCellIndex() const {
+  DCHECK(!Done());
+  const int64 key = grid_->keys_[block_index_];
+  const int64 component_mask = (int64{1} << kKeyBits) - 1;
+  const int offset = 1 << (kKeyBits - 1);
+  const Eigen::Array3i block_index(
+      static_cast<int>((key >> (2 * kKeyBits)) & component_mask) - offset,
+      static_cast<int>((key >> kKeyBits) & component_mask) - offset,
+      static_cast<int>(key & component_mask) - offset);
+  return block_index * int{kBlockSize} +
+         To3DIndex(mask_index_ * 64 + __builtin_ctzll(mask_), kBlockBits);
+}
+
+void FrozenHybridGrid::Iterator::AdvanceToSetBit() {
+  while (mask_ == 0 && !Done()) {
+    if (++mask_index_ == kNumMaskWords) {
+      mask_index_ = 0;
+      if (++block_index_ == end_block_index_) {
+        return;
+      }
+    }
+    mask_ = grid_->blocks_[block_index_].mask[mask_index_];
+  }
+}
+
+}  // namespace mapping_3d
+}  // namespace cartographer
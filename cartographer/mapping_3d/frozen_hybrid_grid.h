@@ -0,0 +1,178 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_3D_FROZEN_HYBRID_GRID_H_
+#define CARTOGRAPHER_MAPPING_3D_FROZEN_HYBRID_GRID_H_
+
+#include <array>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/math.h"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping_3d {
+
+// A read-only copy of a HybridGrid which no longer changes, e.g. of a finished
+// submap. Only the 8x8x8 blocks containing known cells are kept, sorted by
+// their index, together with a bitmask of their known cells. The values of
+// the known cells of all blocks are stored contiguously in the same order, so
+// that the memory used is proportional to the number of known cells, and
+// iterating visits cells in the order they are stored.
+class FrozenHybridGrid {
+ public:
+  explicit FrozenHybridGrid(const HybridGrid& hybrid_grid);
+
+  FrozenHybridGrid(const FrozenHybridGrid&) = delete;
+  FrozenHybridGrid& operator=(const FrozenHybridGrid&) = delete;
+
+  float resolution() const { return resolution_; }
+
+  // Returns the 'grid_size()' of the HybridGrid this was copied from.
+  int grid_size() const { return grid_size_; }
+
+  // Same as HybridGrid::GetCellIndex().
+  Eigen::Array3i GetCellIndex(const Eigen::Vector3f& point) const {
+    const Eigen::Array3f index = point.array() / resolution_;
+    return Eigen::Array3i(common::RoundToInt(index.x()),
+                          common::RoundToInt(index.y()),
+                          common::RoundToInt(index.z()));
+  }
+
+  // Same as HybridGrid::GetCenterOfCell().
+  Eigen::Vector3f GetCenterOfCell(const Eigen::Array3i& index) const {
+    return index.matrix().cast<float>() * resolution_;
+  }
+
+  // Returns the same value as 'value()' of the HybridGrid this was copied
+  // from.
+  uint16 value(const Eigen::Array3i& index) const {
+    const int block_index = FindBlock(index);
+    if (block_index == kNoBlock) {
+      return 0;
+    }
+    const Block& block = blocks_[block_index];
+    const int bit = GetBit(index);
+    const uint64 mask = block.mask[bit / 64];
+    const uint64 bit_mask = uint64{1} << (bit % 64);
+    if ((mask & bit_mask) == 0) {
+      return 0;
+    }
+    return values_[block.value_offsets[bit / 64] +
+                   __builtin_popcountll(mask & (bit_mask - 1))];
+  }
+
+  // Returns the probability of the cell with 'index'.
+  float GetProbability(const Eigen::Array3i& index) const {
+    return mapping::ValueToProbability(value(index));
+  }
+
+  // Returns true if the probability at the specified 'index' is known.
+  bool IsKnown(const Eigen::Array3i& index) const { return value(index) != 0; }
+
+  // Returns the number of bytes used.
+  int64 GetMemoryUsageInBytes() const {
+    return sizeof(*this) + keys_.capacity() * sizeof(int64) +
+           blocks_.capacity() * sizeof(Block) +
+           values_.capacity() * sizeof(uint16);
+  }
+
+  // An iterator for iterating over all known cells, block by block in the
+  // order of their indices.
+  class Iterator {
+   public:
+    explicit Iterator(const FrozenHybridGrid& grid);
+
+    void Next();
+    bool Done() const { return block_index_ == end_block_index_; }
+
+    Eigen::Array3i GetCellIndex() const;
+    uint16 GetValue() const {
+      DCHECK(!Done());
+      return *value_;
+    }
+
+   private:
+    // Skips empty mask words, and blocks once all their words are visited.
+    void AdvanceToSetBit();
+
+    const FrozenHybridGrid* grid_;
+    int block_index_;
+    int end_block_index_;
+    int mask_index_;
+    uint64 mask_;
+    const uint16* value_;
+  };
+
+ private:
+  static constexpr int kBlockBits = 3;
+  static constexpr int kBlockSize = 1 << kBlockBits;
+  static constexpr int kNumMaskWords = (1 << (3 * kBlockBits)) / 64;
+  // Each component of a block index is stored in 'kKeyBits' bits of the key.
+  static constexpr int kKeyBits = 21;
+  static constexpr int kNoBlock = -1;
+
+  struct Block {
+    std::array<uint64, kNumMaskWords> mask;
+    // Index into 'values_' of the value of the lowest bit set in each word of
+    // 'mask'.
+    std::array<int32, kNumMaskWords> value_offsets;
+  };
+
+  // Returns the key of the block containing 'index', or -1 if the block index
+  // cannot be represented, in which case the block is unknown.
+  static int64 GetBlockKey(const Eigen::Array3i& index) {
+    int64 key = 0;
+    for (int i = 0; i != 3; ++i) {
+      const uint32 component =
+          static_cast<uint32>((index[i] >> kBlockBits) + (1 << (kKeyBits - 1)));
+      if (component >= (uint32{1} << kKeyBits)) {
+        return -1;
+      }
+      key = (key << kKeyBits) | component;
+    }
+    return key;
+  }
+
+  // Returns the position of the cell at 'index' in the bitmask of its block.
+  static int GetBit(const Eigen::Array3i& index) {
+    return ToFlatIndex(Eigen::Array3i(index.x() & (kBlockSize - 1),
+                                      index.y() & (kBlockSize - 1),
+                                      index.z() & (kBlockSize - 1)),
+                       kBlockBits);
+  }
+
+  // Returns the position in 'blocks_' of the block containing 'index', or
+  // 'kNoBlock' if it has no known cells.
+  int FindBlock(const Eigen::Array3i& index) const;
+
+  float resolution_;
+  int grid_size_;
+  // Sorted keys of the blocks with at least one known cell, and the blocks in
+  // the same order.
+  std::vector<int64> keys_;
+  std::vector<Block> blocks_;
+  std::vector<uint16> values_;
+};
+
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_3D_FROZEN_HYBRID_GRID_H_
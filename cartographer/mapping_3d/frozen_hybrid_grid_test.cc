@@ -0,0 +1,82 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/frozen_hybrid_grid.h"
+
+#include <map>
+#include <random>
+#include <tuple>
+
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+TEST(FrozenHybridGridTest, EmptyGrid) {
+  const HybridGrid hybrid_grid(0.5f);
+  const FrozenHybridGrid frozen_grid(hybrid_grid);
+  EXPECT_EQ(0.5f, frozen_grid.resolution());
+  EXPECT_FALSE(frozen_grid.IsKnown(Eigen::Array3i(0, 0, 0)));
+  EXPECT_TRUE(FrozenHybridGrid::Iterator(frozen_grid).Done());
+}
+
+TEST(FrozenHybridGridTest, MatchesHybridGrid) {
+  HybridGrid hybrid_grid(2.f);
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> index_distribution(-30, 30);
+  std::uniform_real_distribution<float> value_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  std::map<std::tuple<int, int, int>, uint16> values;
+  for (int i = 0; i < 2000; ++i) {
+    const Eigen::Array3i index(index_distribution(prng),
+                               index_distribution(prng),
+                               index_distribution(prng));
+    hybrid_grid.SetProbability(index, value_distribution(prng));
+    values[std::make_tuple(index.x(), index.y(), index.z())] =
+        hybrid_grid.value(index);
+  }
+
+  const FrozenHybridGrid frozen_grid(hybrid_grid);
+  EXPECT_EQ(hybrid_grid.resolution(), frozen_grid.resolution());
+  EXPECT_EQ(hybrid_grid.grid_size(), frozen_grid.grid_size());
+  for (int z = -32; z <= 32; ++z) {
+    for (int y = -32; y <= 32; ++y) {
+      for (int x = -32; x <= 32; ++x) {
+        const Eigen::Array3i index(x, y, z);
+        EXPECT_EQ(hybrid_grid.value(index), frozen_grid.value(index)) << index;
+      }
+    }
+  }
+  EXPECT_FALSE(frozen_grid.IsKnown(Eigen::Array3i(1 << 24, 0, -(1 << 24))));
+
+  std::map<std::tuple<int, int, int>, uint16> frozen_values;
+  for (auto it = FrozenHybridGrid::Iterator(frozen_grid); !it.Done();
+       it.Next()) {
+    const Eigen::Array3i index = it.GetCellIndex();
+    EXPECT_TRUE(frozen_values
+                    .emplace(std::make_tuple(index.x(), index.y(), index.z()),
+                             it.GetValue())
+                    .second);
+  }
+  EXPECT_EQ(values, frozen_values);
+  EXPECT_LT(frozen_grid.GetMemoryUsageInBytes(),
+            hybrid_grid.GetMemoryUsageInBytes());
+}
+
+}  // namespace
+}  // namespace mapping_3d
+}  // namespace cartographer
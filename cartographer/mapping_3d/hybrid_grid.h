@@ -17,13 +17,18 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_HYBRID_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_HYBRID_GRID_H_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <limits>
+#include <map>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/common/block_allocator.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/port.h"
@@ -51,6 +56,57 @@ inline Eigen::Array3i To3DIndex(const int index, const int bits) {
                         (index >> bits) >> bits);
 }
 
+// Memory layout of the cells of a FlatGrid which stores cells in z-major
+// order, i.e. neighbors in x are adjacent in memory.
+struct ZMajorLayout {
+  static int ToFlatIndex(const Eigen::Array3i& index, const int bits) {
+    return mapping_3d::ToFlatIndex(index, bits);
+  }
+
+  static Eigen::Array3i To3DIndex(const int index, const int bits) {
+    return mapping_3d::To3DIndex(index, bits);
+  }
+};
+
+// Memory layout of the cells of a FlatGrid which stores cells in Morton
+// order, also known as Z-order, which interleaves the bits of the x, y, and z
+// components. Cells close to each other in all 3 dimensions, e.g. the 2x2x2
+// cells used for interpolation, are close in memory. Supports up to 10 bits.
+struct MortonLayout {
+  static int ToFlatIndex(const Eigen::Array3i& index, const int bits) {
+    DCHECK((index >= 0).all() && (index < (1 << bits)).all()) << index;
+    DCHECK_LE(bits, 10);
+    return SpreadBits(index.x()) | (SpreadBits(index.y()) << 1) |
+           (SpreadBits(index.z()) << 2);
+  }
+
+  static Eigen::Array3i To3DIndex(const int index, const int bits) {
+    DCHECK_LT(index, 1 << (3 * bits));
+    return Eigen::Array3i(CompactBits(index), CompactBits(index >> 1),
+                          CompactBits(index >> 2));
+  }
+
+ private:
+  // Moves bit i of the 10-bit 'value' to bit 3 * i.
+  static int SpreadBits(uint32 value) {
+    value = (value | (value << 16)) & 0x030000ff;
+    value = (value | (value << 8)) & 0x0300f00f;
+    value = (value | (value << 4)) & 0x030c30c3;
+    value = (value | (value << 2)) & 0x09249249;
+    return value;
+  }
+
+  // Inverse of SpreadBits(), ignoring all bits not at multiples of 3.
+  static int CompactBits(uint32 value) {
+    value &= 0x09249249;
+    value = (value | (value >> 2)) & 0x030c30c3;
+    value = (value | (value >> 4)) & 0x0300f00f;
+    value = (value | (value >> 8)) & 0x030000ff;
+    value = (value | (value >> 16)) & 0x000003ff;
+    return value;
+  }
+};
+
 // A function to compare value to the default value. (Allows specializations).
 template <typename TValueType>
 bool IsDefaultValue(const TValueType& v) {
@@ -64,17 +120,23 @@ bool IsDefaultValue(const std::vector<TElementType>& v) {
 }
 
 // A flat grid of '2^kBits' x '2^kBits' x '2^kBits' voxels storing values of
-// type 'ValueType' in contiguous memory. Indices in each dimension are 0-based.
-template <typename TValueType, int kBits>
+// type 'ValueType' in contiguous memory in the order given by 'Layout'.
+// Indices in each dimension are 0-based.
+//
+// A bitmask marks the cells handed out by 'mutable_value()', so that iterating
+// only touches those instead of all cells.
+template <typename TValueType, int kBits, typename Layout = ZMajorLayout>
 class FlatGrid {
  public:
   using ValueType = TValueType;
+  using LeafGrid = FlatGrid;
 
   // Creates a new flat grid with all values being default constructed.
   FlatGrid() {
     for (ValueType& value : cells_) {
       value = ValueType();
     }
+    occupied_mask_.fill(0);
   }
 
   FlatGrid(const FlatGrid&) = delete;
@@ -86,64 +148,112 @@ class FlatGrid {
   // Returns the value stored at 'index', each dimension of 'index' being
   // between 0 and grid_size() - 1.
   ValueType value(const Eigen::Array3i& index) const {
-    return cells_[ToFlatIndex(index, kBits)];
+    return cells_[Layout::ToFlatIndex(index, kBits)];
   }
 
   // Returns a pointer to a value to allow changing it.
   ValueType* mutable_value(const Eigen::Array3i& index) {
-    return &cells_[ToFlatIndex(index, kBits)];
+    const int flat_index = Layout::ToFlatIndex(index, kBits);
+    occupied_mask_[flat_index / kBitsPerMaskWord] |=
+        uint64{1} << (flat_index % kBitsPerMaskWord);
+    return &cells_[flat_index];
   }
 
+  // A flat grid is its own leaf.
+  LeafGrid* mutable_leaf(const Eigen::Array3i& index) { return this; }
+
+  // Returns the number of bytes used, excluding memory owned by the values.
+  int64 GetMemoryUsageInBytes() const { return sizeof(*this); }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
    public:
-    Iterator() : current_(nullptr), end_(nullptr) {}
+    Iterator() : flat_grid_(nullptr), mask_index_(kNumMaskWords), mask_(0) {}
 
     explicit Iterator(const FlatGrid& flat_grid)
-        : current_(flat_grid.cells_.data()),
-          end_(flat_grid.cells_.data() + flat_grid.cells_.size()) {
-      while (!Done() && IsDefaultValue(*current_)) {
-        ++current_;
-      }
+        : flat_grid_(&flat_grid),
+          mask_index_(0),
+          mask_(flat_grid.occupied_mask_[0]) {
+      AdvanceToNonDefaultValue();
     }
 
     void Next() {
       DCHECK(!Done());
-      do {
-        ++current_;
-      } while (!Done() && IsDefaultValue(*current_));
+      mask_ &= mask_ - 1;
+      AdvanceToNonDefaultValue();
     }
 
-    bool Done() const { return current_ == end_; }
+    bool Done() const { return mask_index_ == kNumMaskWords; }
 
     Eigen::Array3i GetCellIndex() const {
       DCHECK(!Done());
-      const int index = (1 << (3 * kBits)) - (end_ - current_);
-      return To3DIndex(index, kBits);
+      return Layout::To3DIndex(GetFlatIndex(), kBits);
     }
 
     const ValueType& GetValue() const {
       DCHECK(!Done());
-      return *current_;
+      return flat_grid_->cells_[GetFlatIndex()];
     }
 
    private:
-    const ValueType* current_;
-    const ValueType* end_;
+    // Returns the flat index of the lowest bit set in 'mask_'.
+    int GetFlatIndex() const {
+      return mask_index_ * kBitsPerMaskWord + __builtin_ctzll(mask_);
+    }
+
+    // Skips to the next set bit in the occupied mask whose cell does not hold
+    // the default value. Cells might have been reset to the default value
+    // after 'mutable_value()' was called.
+    void AdvanceToNonDefaultValue() {
+      for (;;) {
+        while (mask_ == 0) {
+          if (++mask_index_ == kNumMaskWords) {
+            return;
+          }
+          mask_ = flat_grid_->occupied_mask_[mask_index_];
+        }
+        if (!IsDefaultValue(flat_grid_->cells_[GetFlatIndex()])) {
+          return;
+        }
+        mask_ &= mask_ - 1;
+      }
+    }
+
+    const FlatGrid* flat_grid_;
+    int mask_index_;
+    uint64 mask_;
   };
 
  private:
-  std::array<ValueType, 1 << (3 * kBits)> cells_;
+  static constexpr int kNumCells = 1 << (3 * kBits);
+  static constexpr int kBitsPerMaskWord = 64;
+  static_assert(kNumCells % kBitsPerMaskWord == 0,
+                "FlatGrid needs at least 2 bits.");
+  static constexpr int kNumMaskWords = kNumCells / kBitsPerMaskWord;
+
+  std::array<ValueType, kNumCells> cells_;
+  std::array<uint64, kNumMaskWords> occupied_mask_;
 };
 
 // A grid consisting of '2^kBits' x '2^kBits' x '2^kBits' grids of type
 // 'WrappedGrid'. Wrapped grids are constructed on first access via
-// 'mutable_value()'.
+// 'mutable_value()' using an allocator which is usually shared by all
+// NestedGrids of a DynamicGrid.
 template <typename WrappedGrid, int kBits>
 class NestedGrid {
  public:
   using ValueType = typename WrappedGrid::ValueType;
+  using LeafGrid = typename WrappedGrid::LeafGrid;
+  using Allocator = common::BlockAllocator<WrappedGrid>;
+
+  // The 'allocator' owns the wrapped grids and has to outlive this grid.
+  explicit NestedGrid(Allocator* const allocator) : allocator_(allocator) {
+    meta_cells_.fill(nullptr);
+  }
+
+  NestedGrid(const NestedGrid&) = delete;
+  NestedGrid& operator=(const NestedGrid&) = delete;
 
   // Returns the number of voxels per dimension.
   static int grid_size() { return WrappedGrid::grid_size() << kBits; }
@@ -153,7 +263,7 @@ class NestedGrid {
   ValueType value(const Eigen::Array3i& index) const {
     const Eigen::Array3i meta_index = GetMetaIndex(index);
     const WrappedGrid* const meta_cell =
-        meta_cells_[ToFlatIndex(meta_index, kBits)].get();
+        meta_cells_[ToFlatIndex(meta_index, kBits)];
     if (meta_cell == nullptr) {
       return ValueType();
     }
@@ -166,16 +276,38 @@ class NestedGrid {
   // necessary a new wrapped grid is constructed to contain that value.
   ValueType* mutable_value(const Eigen::Array3i& index) {
     const Eigen::Array3i meta_index = GetMetaIndex(index);
-    std::unique_ptr<WrappedGrid>& meta_cell =
-        meta_cells_[ToFlatIndex(meta_index, kBits)];
+    WrappedGrid*& meta_cell = meta_cells_[ToFlatIndex(meta_index, kBits)];
     if (meta_cell == nullptr) {
-      meta_cell = common::make_unique<WrappedGrid>();
+      meta_cell = allocator_->New();
     }
     const Eigen::Array3i inner_index =
         index - meta_index * WrappedGrid::grid_size();
     return meta_cell->mutable_value(inner_index);
   }
 
+  // Returns the leaf grid containing 'index', constructing it if necessary.
+  LeafGrid* mutable_leaf(const Eigen::Array3i& index) {
+    const Eigen::Array3i meta_index = GetMetaIndex(index);
+    WrappedGrid*& meta_cell = meta_cells_[ToFlatIndex(meta_index, kBits)];
+    if (meta_cell == nullptr) {
+      meta_cell = allocator_->New();
+    }
+    return meta_cell->mutable_leaf(index -
+                                   meta_index * WrappedGrid::grid_size());
+  }
+
+  // Returns the number of bytes used, excluding memory owned by the values and
+  // unused memory of the allocator.
+  int64 GetMemoryUsageInBytes() const {
+    int64 memory_usage_in_bytes = sizeof(*this);
+    for (const WrappedGrid* const meta_cell : meta_cells_) {
+      if (meta_cell != nullptr) {
+        memory_usage_in_bytes += meta_cell->GetMemoryUsageInBytes();
+      }
+    }
+    return memory_usage_in_bytes;
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -225,8 +357,8 @@ class NestedGrid {
       }
     }
 
-    const std::unique_ptr<WrappedGrid>* current_;
-    const std::unique_ptr<WrappedGrid>* end_;
+    const WrappedGrid* const* current_;
+    const WrappedGrid* const* end_;
     typename WrappedGrid::Iterator nested_iterator_;
   };
 
@@ -240,19 +372,27 @@ class NestedGrid {
     return meta_index;
   }
 
-  std::array<std::unique_ptr<WrappedGrid>, 1 << (3 * kBits)> meta_cells_;
+  Allocator* const allocator_;
+  std::array<WrappedGrid*, 1 << (3 * kBits)> meta_cells_;
 };
 
 // A grid consisting of 2x2x2 grids of type 'WrappedGrid' initially. Wrapped
 // grids are constructed on first access via 'mutable_value()'. If necessary,
 // the grid grows to twice the size in each dimension. The range of indices is
 // (almost) symmetric around the origin, i.e. negative indices are allowed.
+//
+// The wrapped grids and the grids nested in them are block-allocated, and all
+// of them are freed at once together with this grid.
 template <typename WrappedGrid>
 class DynamicGrid {
  public:
   using ValueType = typename WrappedGrid::ValueType;
+  using LeafGrid = typename WrappedGrid::LeafGrid;
 
-  DynamicGrid() : bits_(1), meta_cells_(8) {}
+  DynamicGrid()
+      : bits_(1),
+        meta_cells_(8, nullptr),
+        allocators_(common::make_unique<Allocators>()) {}
   DynamicGrid(DynamicGrid&&) = default;
   DynamicGrid& operator=(DynamicGrid&&) = default;
 
@@ -269,7 +409,7 @@ class DynamicGrid {
     }
     const Eigen::Array3i meta_index = GetMetaIndex(shifted_index);
     const WrappedGrid* const meta_cell =
-        meta_cells_[ToFlatIndex(meta_index, bits_)].get();
+        meta_cells_[ToFlatIndex(meta_index, bits_)];
     if (meta_cell == nullptr) {
       return ValueType();
     }
@@ -289,16 +429,45 @@ class DynamicGrid {
       return mutable_value(index);
     }
     const Eigen::Array3i meta_index = GetMetaIndex(shifted_index);
-    std::unique_ptr<WrappedGrid>& meta_cell =
-        meta_cells_[ToFlatIndex(meta_index, bits_)];
+    WrappedGrid*& meta_cell = meta_cells_[ToFlatIndex(meta_index, bits_)];
     if (meta_cell == nullptr) {
-      meta_cell = common::make_unique<WrappedGrid>();
+      meta_cell = allocators_->wrapped_grid_allocator.New(
+          &allocators_->nested_grid_allocator);
     }
     const Eigen::Array3i inner_index =
         shifted_index - meta_index * WrappedGrid::grid_size();
     return meta_cell->mutable_value(inner_index);
   }
 
+  // Returns the leaf grid containing 'index', growing the DynamicGrid and
+  // constructing grids as needed. Within the leaf, 'index' is at 'index' modulo
+  // 'LeafGrid::grid_size()'.
+  LeafGrid* mutable_leaf(const Eigen::Array3i& index) {
+    const Eigen::Array3i shifted_index = index + (grid_size() >> 1);
+    if ((shifted_index.cast<unsigned int>() >= grid_size()).any()) {
+      Grow();
+      return mutable_leaf(index);
+    }
+    const Eigen::Array3i meta_index = GetMetaIndex(shifted_index);
+    WrappedGrid*& meta_cell = meta_cells_[ToFlatIndex(meta_index, bits_)];
+    if (meta_cell == nullptr) {
+      meta_cell = allocators_->wrapped_grid_allocator.New(
+          &allocators_->nested_grid_allocator);
+    }
+    return meta_cell->mutable_leaf(shifted_index -
+                                   meta_index * WrappedGrid::grid_size());
+  }
+
+  // Returns the number of bytes used, excluding memory owned by the values.
+  // This includes the memory allocated for, but not yet used by, wrapped
+  // grids.
+  int64 GetMemoryUsageInBytes() const {
+    return sizeof(*this) + meta_cells_.capacity() * sizeof(meta_cells_[0]) +
+           sizeof(Allocators) +
+           allocators_->wrapped_grid_allocator.GetMemoryUsageInBytes() +
+           allocators_->nested_grid_allocator.GetMemoryUsageInBytes();
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -366,8 +535,8 @@ class DynamicGrid {
     }
 
     int bits_;
-    const std::unique_ptr<WrappedGrid>* current_;
-    const std::unique_ptr<WrappedGrid>* const end_;
+    const WrappedGrid* const* current_;
+    const WrappedGrid* const* const end_;
     typename WrappedGrid::Iterator nested_iterator_;
   };
 
@@ -385,8 +554,8 @@ class DynamicGrid {
   void Grow() {
     const int new_bits = bits_ + 1;
     CHECK_LE(new_bits, 8);
-    std::vector<std::unique_ptr<WrappedGrid>> new_meta_cells_(
-        8 * meta_cells_.size());
+    std::vector<WrappedGrid*> new_meta_cells_(8 * meta_cells_.size(),
+                                              nullptr);
     for (int z = 0; z != (1 << bits_); ++z) {
       for (int y = 0; y != (1 << bits_); ++y) {
         for (int x = 0; x != (1 << bits_); ++x) {
@@ -394,7 +563,7 @@ class DynamicGrid {
           const Eigen::Array3i new_meta_index =
               original_meta_index + (1 << (bits_ - 1));
           new_meta_cells_[ToFlatIndex(new_meta_index, new_bits)] =
-              std::move(meta_cells_[ToFlatIndex(original_meta_index, bits_)]);
+              meta_cells_[ToFlatIndex(original_meta_index, bits_)];
         }
       }
     }
@@ -402,18 +571,244 @@ class DynamicGrid {
     bits_ = new_bits;
   }
 
+  // Own the wrapped grids and the grids nested in them. They are on the heap,
+  // so that the pointers into them stay valid when this grid is moved.
+  struct Allocators {
+    common::BlockAllocator<WrappedGrid> wrapped_grid_allocator;
+    typename WrappedGrid::Allocator nested_grid_allocator;
+  };
+
   int bits_;
-  std::vector<std::unique_ptr<WrappedGrid>> meta_cells_;
+  std::vector<WrappedGrid*> meta_cells_;
+  std::unique_ptr<Allocators> allocators_;
 };
 
-template <typename ValueType>
-using Grid = DynamicGrid<NestedGrid<FlatGrid<ValueType, 3>, 3>>;
+// A grid of 'WrappedGrid's stored in an open-addressing hash table keyed by
+// their (meta) index. Wrapped grids are constructed on first access via
+// 'mutable_value()'. Unlike for the DynamicGrid, the range of indices is not
+// limited and memory use is proportional to the number of wrapped grids, not
+// to the extent of the grid. This suits sparse grids spanning large areas,
+// e.g. outdoors, at the cost of slower lookups.
+template <typename WrappedGrid>
+class HashedGrid {
+ public:
+  using ValueType = typename WrappedGrid::ValueType;
+  using LeafGrid = typename WrappedGrid::LeafGrid;
+
+  HashedGrid()
+      : slots_(kInitialNumSlots),
+        allocator_(common::make_unique<common::BlockAllocator<WrappedGrid>>()) {
+  }
+  HashedGrid(HashedGrid&&) = default;
+  HashedGrid& operator=(HashedGrid&&) = default;
+
+  // Returns a number of voxels per dimension such that all indices of values
+  // that have been accessed via 'mutable_value()' are in
+  // [-grid_size() / 2, grid_size() / 2), like for the DynamicGrid.
+  int grid_size() const {
+    return 2 * max_abs_meta_index_ * WrappedGrid::grid_size();
+  }
+
+  // Returns the value stored at 'index'.
+  ValueType value(const Eigen::Array3i& index) const {
+    const Eigen::Array3i meta_index = GetMetaIndex(index);
+    const WrappedGrid* const meta_cell =
+        slots_[FindSlot(meta_index)].wrapped_grid;
+    if (meta_cell == nullptr) {
+      return ValueType();
+    }
+    return meta_cell->value(index - meta_index * WrappedGrid::grid_size());
+  }
+
+  // Returns a pointer to the value at 'index' to allow changing it,
+  // constructing a new WrappedGrid if needed.
+  ValueType* mutable_value(const Eigen::Array3i& index) {
+    const Eigen::Array3i meta_index = GetMetaIndex(index);
+    return GetOrCreateWrappedGrid(meta_index)
+        ->mutable_value(index - meta_index * WrappedGrid::grid_size());
+  }
+
+  // Returns the leaf grid containing 'index', constructing it if necessary.
+  // Within the leaf, 'index' is at 'index' modulo 'LeafGrid::grid_size()'.
+  LeafGrid* mutable_leaf(const Eigen::Array3i& index) {
+    const Eigen::Array3i meta_index = GetMetaIndex(index);
+    return GetOrCreateWrappedGrid(meta_index)
+        ->mutable_leaf(index - meta_index * WrappedGrid::grid_size());
+  }
+
+  // Returns the number of bytes used, excluding memory owned by the values.
+  int64 GetMemoryUsageInBytes() const {
+    return sizeof(*this) + slots_.capacity() * sizeof(Slot) +
+           allocator_->GetMemoryUsageInBytes();
+  }
+
+ private:
+  struct Slot {
+    Eigen::Array3i meta_index = Eigen::Array3i::Zero();
+    // Empty slots have no wrapped grid.
+    WrappedGrid* wrapped_grid = nullptr;
+  };
+
+  // Returns the wrapped grid at 'meta_index', constructing it if needed.
+  WrappedGrid* GetOrCreateWrappedGrid(const Eigen::Array3i& meta_index) {
+    int slot_index = FindSlot(meta_index);
+    if (slots_[slot_index].wrapped_grid == nullptr) {
+      // Keeps the load factor at most 1/2, so that probe sequences are short.
+      if (2 * (num_wrapped_grids_ + 1) > static_cast<int>(slots_.size())) {
+        Grow();
+        slot_index = FindSlot(meta_index);
+      }
+      slots_[slot_index].meta_index = meta_index;
+      slots_[slot_index].wrapped_grid = allocator_->New();
+      ++num_wrapped_grids_;
+      max_abs_meta_index_ = std::max(
+          max_abs_meta_index_,
+          std::max(meta_index.maxCoeff() + 1, -meta_index.minCoeff()));
+    }
+    return slots_[slot_index].wrapped_grid;
+  }
+
+ public:
+  // An iterator for iterating over all values not comparing equal to the
+  // default constructed value. The order of iteration is unspecified.
+  class Iterator {
+   public:
+    explicit Iterator(const HashedGrid& hashed_grid)
+        : current_(hashed_grid.slots_.data()),
+          end_(hashed_grid.slots_.data() + hashed_grid.slots_.size()),
+          nested_iterator_() {
+      AdvanceToValidNestedIterator();
+    }
+
+    void Next() {
+      DCHECK(!Done());
+      nested_iterator_.Next();
+      if (!nested_iterator_.Done()) {
+        return;
+      }
+      ++current_;
+      AdvanceToValidNestedIterator();
+    }
+
+    bool Done() const { return current_ == end_; }
+
+    Eigen::Array3i GetCellIndex() const {
+      DCHECK(!Done());
+      return current_->meta_index * WrappedGrid::grid_size() +
+             nested_iterator_.GetCellIndex();
+    }
+
+    const ValueType& GetValue() const {
+      DCHECK(!Done());
+      return nested_iterator_.GetValue();
+    }
+
+    void AdvanceToEnd() { current_ = end_; }
+
+    const std::pair<Eigen::Array3i, ValueType> operator*() const {
+      return std::pair<Eigen::Array3i, ValueType>(GetCellIndex(), GetValue());
+    }
+
+    Iterator& operator++() {
+      Next();
+      return *this;
+    }
+
+    bool operator!=(const Iterator& it) const {
+      return it.current_ != current_;
+    }
+
+   private:
+    void AdvanceToValidNestedIterator() {
+      for (; !Done(); ++current_) {
+        if (current_->wrapped_grid != nullptr) {
+          nested_iterator_ =
+              typename WrappedGrid::Iterator(*current_->wrapped_grid);
+          if (!nested_iterator_.Done()) {
+            break;
+          }
+        }
+      }
+    }
+
+    const Slot* current_;
+    const Slot* end_;
+    typename WrappedGrid::Iterator nested_iterator_;
+  };
+
+ private:
+  // Number of slots of an empty grid. This has to be a power of 2.
+  static constexpr int kInitialNumSlots = 64;
+
+  // Returns the (meta) index of the wrapped grid containing 'index'.
+  static Eigen::Array3i GetMetaIndex(const Eigen::Array3i& index) {
+    const int size = WrappedGrid::grid_size();
+    // Rounds towards negative infinity.
+    return (index - (index < 0).select(size - 1, Eigen::Array3i::Zero())) /
+           size;
+  }
+
+  static uint32 Hash(const Eigen::Array3i& meta_index) {
+    const uint32 hash = (static_cast<uint32>(meta_index.x()) * 73856093u) ^
+                        (static_cast<uint32>(meta_index.y()) * 19349669u) ^
+                        (static_cast<uint32>(meta_index.z()) * 83492791u);
+    return hash ^ (hash >> 16);
+  }
+
+  // Returns the index of the slot for 'meta_index', which is empty if there is
+  // no wrapped grid for it yet. Uses linear probing.
+  int FindSlot(const Eigen::Array3i& meta_index) const {
+    const uint32 mask = slots_.size() - 1;
+    uint32 slot_index = Hash(meta_index) & mask;
+    while (slots_[slot_index].wrapped_grid != nullptr &&
+           (slots_[slot_index].meta_index != meta_index).any()) {
+      slot_index = (slot_index + 1) & mask;
+    }
+    return slot_index;
+  }
+
+  // Doubles the number of slots and reinserts all wrapped grids.
+  void Grow() {
+    std::vector<Slot> old_slots(2 * slots_.size());
+    old_slots.swap(slots_);
+    for (const Slot& slot : old_slots) {
+      if (slot.wrapped_grid != nullptr) {
+        slots_[FindSlot(slot.meta_index)] = slot;
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  int num_wrapped_grids_ = 0;
+  // Maximum of the absolute values of the indices of the wrapped grids, where
+  // the non-negative ones are increased by one to get a symmetric range.
+  int max_abs_meta_index_ = 1;
+  // Owns the wrapped grids. It is on the heap, so that the pointers to the
+  // wrapped grids stay valid when moving this grid.
+  std::unique_ptr<common::BlockAllocator<WrappedGrid>> allocator_;
+};
 
-// Represents a 3D grid as a wide, shallow tree.
-template <typename ValueType>
-class HybridGridBase : public Grid<ValueType> {
+// The block geometry of a 'Grid' is fixed at compile time: leaves of
+// 2^'kLeafBits' cells per dimension are nested in blocks of 2^'kNestedBits'
+// leaves per dimension. Larger leaves make lookups cheaper but waste memory on
+// unknown cells around sparse surfaces. 'kLeafBits' has to be at least 2.
+template <typename ValueType, typename Layout = ZMajorLayout, int kLeafBits = 3,
+          int kNestedBits = 3>
+using Grid = DynamicGrid<
+    NestedGrid<FlatGrid<ValueType, kLeafBits, Layout>, kNestedBits>>;
+
+// Sparse alternative to 'Grid' without limits on the extent of the grid.
+template <typename ValueType, typename Layout = ZMajorLayout>
+using HashedBlockGrid = HashedGrid<FlatGrid<ValueType, 3, Layout>>;
+
+// Represents a 3D grid as a wide, shallow tree by default, or as a hash table
+// of blocks if 'GridType' is a 'HashedBlockGrid'. The 'Layout' of the cells in
+// the leaves affects only performance.
+template <typename ValueType, typename Layout = ZMajorLayout,
+          typename GridType = Grid<ValueType, Layout>>
+class HybridGridBase : public GridType {
  public:
-  using Iterator = typename Grid<ValueType>::Iterator;
+  using Iterator = typename GridType::Iterator;
 
   // Creates a new tree-based probability grid with voxels having edge length
   // 'resolution' around the origin which becomes the center of the cell at
@@ -460,28 +855,26 @@ class HybridGridBase : public Grid<ValueType> {
 };
 
 // A grid containing probability values stored using 15 bits, and an update
-// marker per voxel.
-class HybridGrid : public HybridGridBase<uint16> {
+// marker per voxel. The 'GridType' is the storage of the HybridGridBase.
+template <typename GridType>
+class ProbabilityHybridGrid
+    : public HybridGridBase<uint16, ZMajorLayout, GridType> {
  public:
-  explicit HybridGrid(const float resolution)
-      : HybridGridBase<uint16>(resolution) {}
-
-  explicit HybridGrid(const proto::HybridGrid& proto)
-      : HybridGrid(proto.resolution()) {
-    CHECK_EQ(proto.values_size(), proto.x_indices_size());
-    CHECK_EQ(proto.values_size(), proto.y_indices_size());
-    CHECK_EQ(proto.values_size(), proto.z_indices_size());
-    for (int i = 0; i < proto.values_size(); ++i) {
-      // SetProbability does some error checking for us.
-      SetProbability(Eigen::Vector3i(proto.x_indices(i), proto.y_indices(i),
-                                     proto.z_indices(i)),
-                     mapping::ValueToProbability(proto.values(i)));
+  explicit ProbabilityHybridGrid(const float resolution)
+      : HybridGridBase<uint16, ZMajorLayout, GridType>(resolution) {}
+
+  explicit ProbabilityHybridGrid(const proto::HybridGrid& proto)
+      : ProbabilityHybridGrid(proto.resolution()) {
+    if (proto.has_blocks()) {
+      ReadCompactBlocks(proto);
+      return;
     }
+    ReadCells(proto);
   }
 
   // Sets the probability of the cell at 'index' to the given 'probability'.
   void SetProbability(const Eigen::Array3i& index, const float probability) {
-    *mutable_value(index) = mapping::ProbabilityToValue(probability);
+    *this->mutable_value(index) = mapping::ProbabilityToValue(probability);
   }
 
   // Finishes the update sequence.
@@ -503,7 +896,7 @@ class HybridGrid : public HybridGridBase<uint16> {
   bool ApplyLookupTable(const Eigen::Array3i& index,
                         const std::vector<uint16>& table) {
     DCHECK_EQ(table.size(), mapping::kUpdateMarker);
-    uint16* const cell = mutable_value(index);
+    uint16* const cell = this->mutable_value(index);
     if (*cell >= mapping::kUpdateMarker) {
       return false;
     }
@@ -515,31 +908,170 @@ class HybridGrid : public HybridGridBase<uint16> {
 
   // Returns the probability of the cell with 'index'.
   float GetProbability(const Eigen::Array3i& index) const {
-    return mapping::ValueToProbability(value(index));
+    return mapping::ValueToProbability(this->value(index));
   }
 
   // Returns true if the probability at the specified 'index' is known.
-  bool IsKnown(const Eigen::Array3i& index) const { return value(index) != 0; }
+  bool IsKnown(const Eigen::Array3i& index) const {
+    return this->value(index) != 0;
+  }
 
+  // Writes the compact 'blocks' encoding.
   proto::HybridGrid ToProto() const {
     CHECK(update_indices_.empty()) << "Serializing a grid during an update is "
                                       "not supported. Finish the update first.";
     proto::HybridGrid result;
-    result.set_resolution(resolution());
+    result.set_resolution(this->resolution());
+    std::map<std::array<int, 3>, CompactBlock> blocks;
     for (const auto it : *this) {
-      result.add_x_indices(it.first.x());
-      result.add_y_indices(it.first.y());
-      result.add_z_indices(it.first.z());
-      result.add_values(it.second);
+      CompactBlock& block = blocks[{{it.first.x() >> kCompactBlockBits,
+                                     it.first.y() >> kCompactBlockBits,
+                                     it.first.z() >> kCompactBlockBits}}];
+      const int bit = mapping_3d::ToFlatIndex(
+          Eigen::Array3i(it.first.x() & (kCompactBlockSize - 1),
+                         it.first.y() & (kCompactBlockSize - 1),
+                         it.first.z() & (kCompactBlockSize - 1)),
+          kCompactBlockBits);
+      block.mask[bit / 64] |= uint64{1} << (bit % 64);
+      block.values[bit] = it.second;
+    }
+    string* const data = result.mutable_blocks();
+    for (const auto& entry : blocks) {
+      for (const int index : entry.first) {
+        result.add_block_indices(index);
+      }
+      const CompactBlock& block = entry.second;
+      data->append(reinterpret_cast<const char*>(block.mask.data()),
+                   sizeof(block.mask));
+      for (int i = 0; i != kCompactBlockNumMaskWords; ++i) {
+        for (uint64 mask = block.mask[i]; mask != 0; mask &= mask - 1) {
+          const uint16 value = block.values[i * 64 + __builtin_ctzll(mask)];
+          data->append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+      }
     }
     return result;
   }
 
  private:
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+                "The compact proto encoding copies values as little-endian.");
+  static constexpr int kCompactBlockBits = 3;
+  static constexpr int kCompactBlockSize = 1 << kCompactBlockBits;
+  static constexpr int kCompactBlockNumCells = 1 << (3 * kCompactBlockBits);
+  static constexpr int kCompactBlockNumMaskWords = kCompactBlockNumCells / 64;
+
+  struct CompactBlock {
+    std::array<uint64, kCompactBlockNumMaskWords> mask{};
+    std::array<uint16, kCompactBlockNumCells> values;
+  };
+
+  // Reads the cells from the legacy 'x_indices', 'y_indices', 'z_indices' and
+  // 'values' fields. The cells are sorted by leaf grid, so that each leaf is
+  // looked up once and filled with all its values.
+  void ReadCells(const proto::HybridGrid& proto) {
+    const int num_cells = proto.values_size();
+    CHECK_EQ(num_cells, proto.x_indices_size());
+    CHECK_EQ(num_cells, proto.y_indices_size());
+    CHECK_EQ(num_cells, proto.z_indices_size());
+    const int32* const x_indices = proto.x_indices().data();
+    const int32* const y_indices = proto.y_indices().data();
+    const int32* const z_indices = proto.z_indices().data();
+    const int32* const values = proto.values().data();
+    using LeafGrid = typename GridType::LeafGrid;
+    const int leaf_mask = LeafGrid::grid_size() - 1;
+    const auto get_leaf_key = [&](const int i) {
+      return std::array<int, 3>{{x_indices[i] & ~leaf_mask,
+                                 y_indices[i] & ~leaf_mask,
+                                 z_indices[i] & ~leaf_mask}};
+    };
+    std::vector<int> order(num_cells);
+    for (int i = 0; i != num_cells; ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](const int lhs, const int rhs) {
+      return get_leaf_key(lhs) < get_leaf_key(rhs);
+    });
+    LeafGrid* leaf = nullptr;
+    std::array<int, 3> leaf_key;
+    for (const int i : order) {
+      // Only known cells are serialized, so values are in [1, 32767].
+      CHECK_GT(values[i], mapping::kUnknownProbabilityValue);
+      CHECK_LT(values[i], mapping::kUpdateMarker);
+      if (leaf == nullptr || get_leaf_key(i) != leaf_key) {
+        leaf_key = get_leaf_key(i);
+        leaf = this->mutable_leaf(
+            Eigen::Array3i(leaf_key[0], leaf_key[1], leaf_key[2]));
+      }
+      *leaf->mutable_value(Eigen::Array3i(x_indices[i] & leaf_mask,
+                                          y_indices[i] & leaf_mask,
+                                          z_indices[i] & leaf_mask)) =
+          values[i];
+    }
+  }
+
+  void ReadCompactBlocks(const proto::HybridGrid& proto) {
+    CHECK_EQ(proto.block_indices_size() % 3, 0);
+    const char* data = proto.blocks().data();
+    const char* const end = data + proto.blocks().size();
+    std::array<uint64, kCompactBlockNumMaskWords> mask;
+    std::array<uint16, kCompactBlockNumCells> values;
+    // Unless leaves are smaller than compact blocks, each compact block lies
+    // within a single leaf grid, which is looked up once per block.
+    using LeafGrid = typename GridType::LeafGrid;
+    const int leaf_mask = LeafGrid::grid_size() - 1;
+    const bool block_within_leaf = LeafGrid::grid_size() >= kCompactBlockSize;
+    for (int i = 0; i != proto.block_indices_size(); i += 3) {
+      const Eigen::Array3i block_origin =
+          Eigen::Array3i(proto.block_indices(i), proto.block_indices(i + 1),
+                         proto.block_indices(i + 2)) *
+          int{kCompactBlockSize};
+      CHECK_LE(data + sizeof(mask), end);
+      std::memcpy(mask.data(), data, sizeof(mask));
+      data += sizeof(mask);
+      int num_values = 0;
+      for (const uint64 mask_word : mask) {
+        num_values += __builtin_popcountll(mask_word);
+      }
+      CHECK_LE(data + sizeof(uint16) * num_values, end);
+      std::memcpy(values.data(), data, sizeof(uint16) * num_values);
+      data += sizeof(uint16) * num_values;
+      if (num_values == 0) {
+        continue;
+      }
+      LeafGrid* const leaf =
+          block_within_leaf ? this->mutable_leaf(block_origin) : nullptr;
+      const Eigen::Array3i origin_in_leaf = block_origin.unaryExpr(
+          [leaf_mask](const int value) { return value & leaf_mask; });
+      const uint16* value = values.data();
+      for (int j = 0; j != kCompactBlockNumMaskWords; ++j) {
+        for (uint64 mask_word = mask[j]; mask_word != 0;
+             mask_word &= mask_word - 1) {
+          const int bit = j * 64 + __builtin_ctzll(mask_word);
+          CHECK_LT(*value, mapping::kUpdateMarker);
+          const Eigen::Array3i index_in_block =
+              mapping_3d::To3DIndex(bit, kCompactBlockBits);
+          if (leaf != nullptr) {
+            *leaf->mutable_value(origin_in_leaf + index_in_block) = *value++;
+          } else {
+            *this->mutable_value(block_origin + index_in_block) = *value++;
+          }
+        }
+      }
+    }
+    CHECK(data == end) << "Unexpected data after the last block.";
+  }
+
   // Markers at changed cells.
-  std::vector<ValueType*> update_indices_;
+  std::vector<uint16*> update_indices_;
 };
 
+using HybridGrid = ProbabilityHybridGrid<Grid<uint16>>;
+
+// Same as the HybridGrid, but without limits on the extent and using memory
+// proportional to the number of occupied 8x8x8 blocks.
+using HashedHybridGrid = ProbabilityHybridGrid<HashedBlockGrid<uint16>>;
+
 }  // namespace mapping_3d
 }  // namespace cartographer
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures inserting synthetic 3D range data into a HybridGrid and looking up
+// probabilities in it, as done by the 3D scan matchers. The memory use and
+// lookup speed are also compared for other block geometries of the grid.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/proto/range_data_inserter_options.pb.h"
+#include "cartographer/mapping_3d/range_data_inserter.h"
+#include "cartographer/sensor/range_data.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_scans, 200, "Number of range data to insert.");
+DEFINE_int32(num_points, 20000, "Number of points per range data.");
+DEFINE_int32(num_lookups, 10000000, "Number of probabilities to look up.");
+DEFINE_double(resolution, 0.1, "Resolution of the hybrid grid.");
+DEFINE_int32(num_free_space_voxels, 2,
+             "Number of free space voxels updated per ray.");
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+constexpr float kMaxRange = 30.f;
+
+// Generates range data of a 3D lidar moving along the x axis through a box
+// shaped hall. The same seed always yields the same data.
+std::vector<sensor::RangeData> GenerateRangeData(const int num_scans,
+                                                 const int num_points) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> angle_distribution(-M_PI, M_PI);
+  std::uniform_real_distribution<float> elevation_distribution(-0.3f, 0.3f);
+  std::uniform_real_distribution<float> noise_distribution(-0.05f, 0.05f);
+  std::vector<sensor::RangeData> range_data;
+  for (int i = 0; i != num_scans; ++i) {
+    const Eigen::Vector3f origin(0.2f * i, 0.f, 0.f);
+    sensor::RangeData scan{origin, {}, {}};
+    for (int j = 0; j != num_points; ++j) {
+      const float angle = angle_distribution(rng);
+      const Eigen::Vector3f direction(std::cos(angle), std::sin(angle),
+                                      elevation_distribution(rng));
+      // Walls are at y = -10 and y = 10, floor and ceiling 2 m away.
+      const float range =
+          std::min(10.f / std::max(std::abs(direction.y()), 1e-3f),
+                   2.f / std::max(std::abs(direction.z()), 1e-3f)) +
+          noise_distribution(rng);
+      // There are no returns beyond the range of the lidar.
+      if (range < kMaxRange) {
+        scan.returns.push_back(origin + range * direction);
+      }
+    }
+    range_data.push_back(scan);
+  }
+  return range_data;
+}
+
+// Looks up the probabilities at 'cell_indices' 'FLAGS_num_lookups' times in
+// total and logs the rate with the memory use of the 'grid'.
+template <typename GridType>
+void BenchmarkLookups(const string& name, const GridType& grid,
+                      const std::vector<Eigen::Array3i>& cell_indices) {
+  const size_t index_mask = cell_indices.size() - 1;
+  CHECK_EQ(cell_indices.size() & index_mask, 0);
+  float checksum = 0.f;
+  const auto lookup_start = std::chrono::steady_clock::now();
+  for (int i = 0; i != FLAGS_num_lookups; ++i) {
+    checksum += grid.GetProbability(cell_indices[i & index_mask]);
+  }
+  const double lookup_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    lookup_start)
+          .count();
+  // Logging the checksum keeps the compiler from dropping the work.
+  VLOG(1) << "Checksum: " << checksum;
+  LOG(INFO) << name << ": looked up " << FLAGS_num_lookups
+            << " probabilities in " << lookup_seconds
+            << " s: " << FLAGS_num_lookups / lookup_seconds
+            << " lookups per second, " << grid.GetMemoryUsageInBytes() / 1024
+            << " KiB.";
+}
+
+// Copies the 'hybrid_grid' into a grid with the given block geometry and
+// benchmarks lookups in it.
+template <int kLeafBits, int kNestedBits>
+void BenchmarkBlockGeometry(const HybridGrid& hybrid_grid,
+                            const std::vector<Eigen::Array3i>& cell_indices) {
+  ProbabilityHybridGrid<Grid<uint16, ZMajorLayout, kLeafBits, kNestedBits>>
+      grid(hybrid_grid.resolution());
+  for (const auto it : hybrid_grid) {
+    *grid.mutable_value(it.first) = it.second;
+  }
+  BenchmarkLookups("Leaf bits " + std::to_string(kLeafBits) +
+                       ", nested bits " + std::to_string(kNestedBits),
+                   grid, cell_indices);
+}
+
+void Run() {
+  const std::vector<sensor::RangeData> range_data =
+      GenerateRangeData(FLAGS_num_scans, FLAGS_num_points);
+  proto::RangeDataInserterOptions options;
+  options.set_hit_probability(0.55);
+  options.set_miss_probability(0.49);
+  options.set_num_free_space_voxels(FLAGS_num_free_space_voxels);
+  options.set_num_threads(1);
+  const RangeDataInserter range_data_inserter(options);
+  HybridGrid hybrid_grid(FLAGS_resolution);
+
+  size_t num_points = 0;
+  for (const sensor::RangeData& scan : range_data) {
+    num_points += scan.returns.size();
+  }
+  const auto insertion_start = std::chrono::steady_clock::now();
+  for (const sensor::RangeData& scan : range_data) {
+    range_data_inserter.Insert(scan, &hybrid_grid);
+  }
+  const double insertion_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    insertion_start)
+          .count();
+  LOG(INFO) << "Inserted " << range_data.size() << " range data with "
+            << num_points << " points in total in " << insertion_seconds
+            << " s: " << range_data.size() / insertion_seconds
+            << " range data per second, " << num_points / insertion_seconds
+            << " points per second, "
+            << hybrid_grid.GetMemoryUsageInBytes() / (1024 * 1024)
+            << " MiB.";
+
+  // Looks up points near the walls, so that most cells are known.
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> offset_distribution(-0.2f, 0.2f);
+  std::vector<Eigen::Array3i> cell_indices;
+  constexpr int kNumDistinctLookups = 1 << 16;
+  for (int i = 0; i != kNumDistinctLookups; ++i) {
+    const sensor::RangeData& scan = range_data[i % range_data.size()];
+    // Returns beyond the maximum range were dropped, so scans have fewer than
+    // 'num_points' returns.
+    std::uniform_int_distribution<size_t> point_distribution(
+        0, scan.returns.size() - 1);
+    cell_indices.push_back(hybrid_grid.GetCellIndex(
+        scan.returns[point_distribution(rng)] +
+        Eigen::Vector3f(offset_distribution(rng), offset_distribution(rng),
+                        offset_distribution(rng))));
+  }
+  BenchmarkLookups("HybridGrid", hybrid_grid, cell_indices);
+  BenchmarkBlockGeometry<2, 3>(hybrid_grid, cell_indices);
+  BenchmarkBlockGeometry<2, 4>(hybrid_grid, cell_indices);
+  BenchmarkBlockGeometry<3, 2>(hybrid_grid, cell_indices);
+  BenchmarkBlockGeometry<4, 2>(hybrid_grid, cell_indices);
+  BenchmarkBlockGeometry<4, 3>(hybrid_grid, cell_indices);
+}
+
+}  // namespace
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks inserting synthetic range data into a 3D hybrid grid and "
+      "looking up probabilities in it.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_3d::Run();
+  return EXIT_SUCCESS;
+}
@@ -16,9 +16,13 @@
 
 #include "cartographer/mapping_3d/hybrid_grid.h"
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <random>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 
@@ -114,6 +118,19 @@ TEST(HybridGridTest, GetCellIndex) {
               AllCwiseEqual(Eigen::Array3i(3, 7, 2)));
 }
 
+TEST(HybridGridTest, GetMemoryUsageInBytes) {
+  HybridGrid hybrid_grid(1.f);
+  const int64 initial_memory_usage_in_bytes =
+      hybrid_grid.GetMemoryUsageInBytes();
+  hybrid_grid.SetProbability(Eigen::Array3i(1, 2, 3), 0.5f);
+  const int64 memory_usage_in_bytes = hybrid_grid.GetMemoryUsageInBytes();
+  // Setting a cell allocates one nested and one flat grid of 8x8x8 uint16.
+  EXPECT_LT(initial_memory_usage_in_bytes + 8 * 8 * 8 * 2,
+            memory_usage_in_bytes);
+  hybrid_grid.SetProbability(Eigen::Array3i(1, 2, 4), 0.5f);
+  EXPECT_EQ(memory_usage_in_bytes, hybrid_grid.GetMemoryUsageInBytes());
+}
+
 TEST(HybridGridTest, GetCenterOfCell) {
   HybridGrid hybrid_grid(2.f);
 
@@ -125,6 +142,81 @@ TEST(HybridGridTest, GetCenterOfCell) {
   EXPECT_THAT(hybrid_grid.GetCellIndex(center), AllCwiseEqual(index));
 }
 
+TEST(HybridGridTest, MortonLayout) {
+  for (int bits = 1; bits <= 4; ++bits) {
+    std::vector<bool> seen(1 << (3 * bits), false);
+    for (int z = 0; z != (1 << bits); ++z) {
+      for (int y = 0; y != (1 << bits); ++y) {
+        for (int x = 0; x != (1 << bits); ++x) {
+          const Eigen::Array3i index(x, y, z);
+          const int flat_index = MortonLayout::ToFlatIndex(index, bits);
+          ASSERT_GE(flat_index, 0);
+          ASSERT_LT(flat_index, 1 << (3 * bits));
+          EXPECT_FALSE(seen[flat_index]);
+          seen[flat_index] = true;
+          EXPECT_THAT(MortonLayout::To3DIndex(flat_index, bits),
+                      AllCwiseEqual(index));
+        }
+      }
+    }
+  }
+  // The 2x2x2 cells at an even index are consecutive.
+  for (int i = 0; i != 8; ++i) {
+    const Eigen::Array3i index =
+        Eigen::Array3i(2, 0, 0) + HybridGrid::GetOctant(i);
+    EXPECT_EQ(8 + i, MortonLayout::ToFlatIndex(index, 3));
+  }
+}
+
+TEST(HybridGridTest, MortonLayoutGrid) {
+  HybridGridBase<uint16> z_major_grid(1.f);
+  HybridGridBase<uint16, MortonLayout> morton_grid(1.f);
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> xyz_distribution(-50, 49);
+  for (int i = 0; i != 1000; ++i) {
+    const Eigen::Array3i index(xyz_distribution(rng), xyz_distribution(rng),
+                               xyz_distribution(rng));
+    *z_major_grid.mutable_value(index) = i + 1;
+    *morton_grid.mutable_value(index) = i + 1;
+  }
+  int num_cells = 0;
+  for (auto it = HybridGridBase<uint16, MortonLayout>::Iterator(morton_grid);
+       !it.Done(); it.Next()) {
+    EXPECT_EQ(z_major_grid.value(it.GetCellIndex()), it.GetValue());
+    ++num_cells;
+  }
+  int num_z_major_cells = 0;
+  for (auto it = HybridGridBase<uint16>::Iterator(z_major_grid); !it.Done();
+       it.Next()) {
+    EXPECT_EQ(morton_grid.value(it.GetCellIndex()), it.GetValue());
+    ++num_z_major_cells;
+  }
+  EXPECT_EQ(num_z_major_cells, num_cells);
+}
+
+TEST(HybridGridTest, FlatGridIteratorSkipsResetCells) {
+  FlatGrid<uint16, 3> flat_grid;
+  EXPECT_TRUE((FlatGrid<uint16, 3>::Iterator(flat_grid).Done()));
+  *flat_grid.mutable_value(Eigen::Array3i(7, 7, 7)) = 3;
+  *flat_grid.mutable_value(Eigen::Array3i(0, 0, 0)) = 1;
+  *flat_grid.mutable_value(Eigen::Array3i(1, 0, 0)) = 5;
+  *flat_grid.mutable_value(Eigen::Array3i(0, 3, 2)) = 2;
+  // Cells reset to the default value are not visited.
+  *flat_grid.mutable_value(Eigen::Array3i(1, 0, 0)) = 0;
+  // Neither are cells which were accessed but kept the default value.
+  EXPECT_EQ(0, *flat_grid.mutable_value(Eigen::Array3i(4, 4, 4)));
+
+  std::vector<std::pair<int, uint16>> cells;
+  for (FlatGrid<uint16, 3>::Iterator it(flat_grid); !it.Done(); it.Next()) {
+    cells.emplace_back(ToFlatIndex(it.GetCellIndex(), 3), it.GetValue());
+  }
+  const std::vector<std::pair<int, uint16>> expected_cells = {
+      {ToFlatIndex(Eigen::Array3i(0, 0, 0), 3), 1},
+      {ToFlatIndex(Eigen::Array3i(0, 3, 2), 3), 2},
+      {ToFlatIndex(Eigen::Array3i(7, 7, 7), 3), 3}};
+  EXPECT_EQ(expected_cells, cells);
+}
+
 class RandomHybridGridTest : public ::testing::Test {
  public:
   RandomHybridGridTest() : hybrid_grid_(2.f), values_() {
@@ -187,15 +279,33 @@ TEST_F(RandomHybridGridTest, TestIteration) {
 TEST_F(RandomHybridGridTest, ToProto) {
   const auto proto = hybrid_grid_.ToProto();
   EXPECT_EQ(hybrid_grid_.resolution(), proto.resolution());
-  ASSERT_EQ(proto.x_indices_size(), proto.y_indices_size());
-  ASSERT_EQ(proto.x_indices_size(), proto.z_indices_size());
-  ASSERT_EQ(proto.x_indices_size(), proto.values_size());
+  EXPECT_EQ(0, proto.x_indices_size());
+  EXPECT_EQ(0, proto.values_size());
+  ASSERT_EQ(0, proto.block_indices_size() % 3);
 
+  // Decodes the blocks by hand.
   ValueMap proto_map;
-  for (int i = 0; i < proto.x_indices_size(); ++i) {
-    proto_map[std::make_tuple(proto.x_indices(i), proto.y_indices(i),
-                              proto.z_indices(i))] = proto.values(i);
+  size_t offset = 0;
+  for (int i = 0; i < proto.block_indices_size(); i += 3) {
+    uint64 mask[8];
+    ASSERT_LE(offset + sizeof(mask), proto.blocks().size());
+    std::memcpy(mask, proto.blocks().data() + offset, sizeof(mask));
+    offset += sizeof(mask);
+    for (int bit = 0; bit != 512; ++bit) {
+      if ((mask[bit / 64] & (uint64{1} << (bit % 64))) == 0) {
+        continue;
+      }
+      uint16 value;
+      ASSERT_LE(offset + sizeof(value), proto.blocks().size());
+      std::memcpy(&value, proto.blocks().data() + offset, sizeof(value));
+      offset += sizeof(value);
+      proto_map[std::make_tuple(8 * proto.block_indices(i) + bit % 8,
+                                8 * proto.block_indices(i + 1) + bit / 8 % 8,
+                                8 * proto.block_indices(i + 2) + bit / 64)] =
+          value;
+    }
   }
+  EXPECT_EQ(proto.blocks().size(), offset);
 
   // Get hybrid_grid_ into the same format.
   ValueMap hybrid_grid_map;
@@ -226,6 +336,131 @@ TEST_F(RandomHybridGridTest, FromProto) {
   EXPECT_EQ(member_map, constructed_map);
 }
 
+TEST_F(RandomHybridGridTest, FromLegacyProto) {
+  proto::HybridGrid proto;
+  proto.set_resolution(hybrid_grid_.resolution());
+  for (const auto& cell : hybrid_grid_) {
+    proto.add_x_indices(cell.first.x());
+    proto.add_y_indices(cell.first.y());
+    proto.add_z_indices(cell.first.z());
+    proto.add_values(cell.second);
+  }
+  const HybridGrid constructed_grid(proto);
+  for (const auto& cell : hybrid_grid_) {
+    EXPECT_NEAR(hybrid_grid_.GetProbability(cell.first),
+                constructed_grid.GetProbability(cell.first), 1e-4);
+  }
+}
+
+TEST_F(RandomHybridGridTest, FromShuffledLegacyProto) {
+  std::vector<std::pair<Eigen::Array3i, uint16>> cells;
+  for (const auto& cell : hybrid_grid_) {
+    cells.emplace_back(cell.first, cell.second);
+  }
+  std::mt19937 prng(7);
+  std::shuffle(cells.begin(), cells.end(), prng);
+  proto::HybridGrid proto;
+  proto.set_resolution(hybrid_grid_.resolution());
+  for (const auto& cell : cells) {
+    proto.add_x_indices(cell.first.x());
+    proto.add_y_indices(cell.first.y());
+    proto.add_z_indices(cell.first.z());
+    proto.add_values(cell.second);
+  }
+  const HybridGrid constructed_grid(proto);
+  const HashedHybridGrid constructed_hashed_grid(proto);
+  const HashedHybridGrid hashed_grid_from_blocks(hybrid_grid_.ToProto());
+  for (const auto& cell : cells) {
+    EXPECT_EQ(cell.second, constructed_grid.value(cell.first));
+    EXPECT_EQ(cell.second, constructed_hashed_grid.value(cell.first));
+    EXPECT_EQ(cell.second, hashed_grid_from_blocks.value(cell.first));
+  }
+  size_t num_cells = 0;
+  for (auto it = HybridGrid::Iterator(constructed_grid); !it.Done();
+       it.Next()) {
+    ++num_cells;
+  }
+  EXPECT_EQ(cells.size(), num_cells);
+}
+
+TEST_F(RandomHybridGridTest, HashedHybridGrid) {
+  HashedHybridGrid hashed_hybrid_grid(2.f);
+  for (const auto& pair : values_) {
+    const Eigen::Array3i cell_index(std::get<0>(pair.first),
+                                    std::get<1>(pair.first),
+                                    std::get<2>(pair.first));
+    hashed_hybrid_grid.SetProbability(cell_index, pair.second);
+  }
+  EXPECT_LT(hashed_hybrid_grid.GetMemoryUsageInBytes(),
+            hybrid_grid_.GetMemoryUsageInBytes());
+
+  ValueMap hashed_hybrid_grid_map;
+  for (const auto i : hashed_hybrid_grid) {
+    const Eigen::Array3i& cell_index = i.first;
+    EXPECT_EQ(hybrid_grid_.value(cell_index), i.second);
+    EXPECT_EQ(hybrid_grid_.value(cell_index + Eigen::Array3i(1, -1, 1)),
+              hashed_hybrid_grid.value(cell_index + Eigen::Array3i(1, -1, 1)));
+    EXPECT_LE(-hashed_hybrid_grid.grid_size() / 2, cell_index.minCoeff());
+    EXPECT_GT(hashed_hybrid_grid.grid_size() / 2, cell_index.maxCoeff());
+    hashed_hybrid_grid_map[std::make_tuple(cell_index.x(), cell_index.y(),
+                                           cell_index.z())] = i.second;
+  }
+  ValueMap hybrid_grid_map;
+  for (const auto i : hybrid_grid_) {
+    hybrid_grid_map[std::make_tuple(i.first.x(), i.first.y(), i.first.z())] =
+        i.second;
+  }
+  EXPECT_EQ(hybrid_grid_map, hashed_hybrid_grid_map);
+
+  const HashedHybridGrid constructed_grid(hashed_hybrid_grid.ToProto());
+  for (const auto i : hybrid_grid_) {
+    EXPECT_EQ(i.second, constructed_grid.value(i.first));
+  }
+}
+
+TEST_F(RandomHybridGridTest, BlockGeometries) {
+  // Leaves smaller and larger than the blocks of the proto encoding.
+  const ProbabilityHybridGrid<Grid<uint16, ZMajorLayout, 2, 4>> small_leaves(
+      hybrid_grid_.ToProto());
+  const ProbabilityHybridGrid<Grid<uint16, ZMajorLayout, 4, 2>> large_leaves(
+      hybrid_grid_.ToProto());
+  size_t num_cells = 0;
+  for (const auto cell : hybrid_grid_) {
+    EXPECT_EQ(cell.second, small_leaves.value(cell.first));
+    EXPECT_EQ(cell.second, large_leaves.value(cell.first));
+    ++num_cells;
+  }
+  size_t num_small_leaves_cells = 0;
+  for (const auto cell : small_leaves) {
+    EXPECT_EQ(hybrid_grid_.value(cell.first), cell.second);
+    ++num_small_leaves_cells;
+  }
+  EXPECT_EQ(num_cells, num_small_leaves_cells);
+  EXPECT_EQ(hybrid_grid_.ToProto().SerializeAsString(),
+            large_leaves.ToProto().SerializeAsString());
+}
+
+TEST(HashedHybridGridTest, UnlimitedExtent) {
+  HashedHybridGrid hashed_hybrid_grid(0.05f);
+  const Eigen::Array3i far_index(1000000, -2000000, 30000);
+  hashed_hybrid_grid.SetProbability(far_index, 0.7f);
+  hashed_hybrid_grid.SetProbability(Eigen::Array3i(-1, -1, -1), 0.3f);
+  EXPECT_NEAR(0.7f, hashed_hybrid_grid.GetProbability(far_index), 1e-4);
+  EXPECT_NEAR(0.3f,
+              hashed_hybrid_grid.GetProbability(Eigen::Array3i(-1, -1, -1)),
+              1e-4);
+  EXPECT_FALSE(hashed_hybrid_grid.IsKnown(Eigen::Array3i(0, 0, 0)));
+  EXPECT_FALSE(hashed_hybrid_grid.IsKnown(-far_index));
+  EXPECT_LE(2 * 2000000, hashed_hybrid_grid.grid_size());
+  int num_cells = 0;
+  for (auto it = HashedHybridGrid::Iterator(hashed_hybrid_grid); !it.Done();
+       it.Next()) {
+    ++num_cells;
+  }
+  EXPECT_EQ(2, num_cells);
+  EXPECT_GT(1024 * 1024, hashed_hybrid_grid.GetMemoryUsageInBytes());
+}
+
 }  // namespace
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -16,10 +16,13 @@
 
 #include "cartographer/mapping_3d/local_trajectory_builder.h"
 
+#include <chrono>
 #include <memory>
+#include <utility>
 
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/time.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/mapping_2d/scan_matching/proto/real_time_correlative_scan_matcher_options.pb.h"
 #include "cartographer/mapping_3d/proto/local_trajectory_builder_options.pb.h"
 #include "cartographer/mapping_3d/proto/submaps_options.pb.h"
@@ -40,11 +43,44 @@ LocalTrajectoryBuilder::LocalTrajectoryBuilder(
               options_.real_time_correlative_scan_matcher_options())),
       ceres_scan_matcher_(common::make_unique<scan_matching::CeresScanMatcher>(
           options_.ceres_scan_matcher_options())),
-      accumulated_range_data_{Eigen::Vector3f::Zero(), {}, {}} {}
+      degradation_controller_(options_.degradation_options()),
+      accumulated_range_data_{Eigen::Vector3f::Zero(), {}, {}} {
+  if (options_.sliding_window_optimizer_options().num_scans() > 0) {
+    sliding_window_optimizer_ = common::make_unique<SlidingWindowOptimizer>(
+        options_.sliding_window_optimizer_options());
+  }
+}
 
 LocalTrajectoryBuilder::~LocalTrajectoryBuilder() {}
 
+void LocalTrajectoryBuilder::UpdateRuntimeOptions(
+    const mapping::proto::TrajectoryBuilderRuntimeOptions& runtime_options) {
+  pending_runtime_options_.Add(runtime_options);
+}
+
+void LocalTrajectoryBuilder::ApplyPendingRuntimeOptions() {
+  mapping::proto::TrajectoryBuilderRuntimeOptions runtime_options;
+  if (!pending_runtime_options_.Take(&runtime_options)) {
+    return;
+  }
+  mapping::ApplyRuntimeOptions(runtime_options, &options_);
+  if (runtime_options.has_real_time_linear_search_window() ||
+      runtime_options.has_real_time_angular_search_window()) {
+    real_time_correlative_scan_matcher_ =
+        common::make_unique<scan_matching::RealTimeCorrelativeScanMatcher>(
+            options_.real_time_correlative_scan_matcher_options());
+  }
+}
+
+void LocalTrajectoryBuilder::RegisterMetrics(
+    const int trajectory_id, metrics::Registry* const registry) {
+  degradation_controller_.RegisterMetrics(trajectory_id, registry);
+}
+
 void LocalTrajectoryBuilder::AddImuData(const sensor::ImuData& imu_data) {
+  if (sliding_window_optimizer_ != nullptr) {
+    sliding_window_optimizer_->AddImuData(imu_data);
+  }
   if (extrapolator_ != nullptr) {
     extrapolator_->AddImuData(imu_data);
     return;
@@ -61,25 +97,45 @@ void LocalTrajectoryBuilder::AddImuData(const sensor::ImuData& imu_data) {
 std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
 LocalTrajectoryBuilder::AddRangeData(const common::Time time,
                                      const sensor::RangeData& range_data) {
+  return AddRangeData(time, range_data.origin, range_data.returns);
+}
+
+std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
+LocalTrajectoryBuilder::AddRangeData(const common::Time time,
+                                     const Eigen::Vector3f& origin,
+                                     const sensor::PointCloudView returns) {
+  CARTOGRAPHER_TRACE_SPAN("LocalTrajectoryBuilder::AddRangeData");
+  ApplyPendingRuntimeOptions();
   if (extrapolator_ == nullptr) {
     // Until we've initialized the extrapolator with our first IMU message, we
     // cannot compute the orientation of the rangefinder.
     LOG(INFO) << "IMU not yet initialized.";
     return nullptr;
   }
-  if (num_accumulated_ == 0) {
+  if (options_.match_rolling_window()) {
+    return AddRangeDataToRollingWindow(time, origin, returns);
+  }
+  // The first range data of an accumulation defines its frame, so it does not
+  // need to be transformed.
+  transform::Rigid3f tracking_delta = transform::Rigid3f::Identity();
+  const bool is_first_of_accumulation = num_accumulated_ == 0;
+  if (is_first_of_accumulation) {
+    accumulation_start_time_ = time;
     first_pose_estimate_ = extrapolator_->ExtrapolatePose(time).cast<float>();
-    accumulated_range_data_ =
-        sensor::RangeData{Eigen::Vector3f::Zero(), {}, {}};
+    // Clearing keeps the storage of the point clouds for the next
+    // accumulation.
+    accumulated_range_data_.origin = Eigen::Vector3f::Zero();
+    accumulated_range_data_.returns.clear();
+    accumulated_range_data_.misses.clear();
+  } else {
+    tracking_delta = first_pose_estimate_.inverse() *
+                     extrapolator_->ExtrapolatePose(time).cast<float>();
   }
-
-  const transform::Rigid3f tracking_delta =
-      first_pose_estimate_.inverse() *
-      extrapolator_->ExtrapolatePose(time).cast<float>();
-  const sensor::RangeData range_data_in_first_tracking =
-      sensor::TransformRangeData(range_data, tracking_delta);
-  for (const Eigen::Vector3f& hit : range_data_in_first_tracking.returns) {
-    const Eigen::Vector3f delta = hit - range_data_in_first_tracking.origin;
+  const Eigen::Vector3f origin_in_first_tracking =
+      tracking_delta * origin;
+  for (const Eigen::Vector3f& point : returns) {
+    const Eigen::Vector3f hit = tracking_delta * point;
+    const Eigen::Vector3f delta = hit - origin_in_first_tracking;
     const float range = delta.norm();
     if (range >= options_.min_range()) {
       if (range <= options_.max_range()) {
@@ -89,26 +145,116 @@ LocalTrajectoryBuilder::AddRangeData(const common::Time time,
         // maximum range. This way the free space up to the maximum range will
         // be updated.
         accumulated_range_data_.misses.push_back(
-            range_data_in_first_tracking.origin +
-            options_.max_range() / range * delta);
+            origin_in_first_tracking + options_.max_range() / range * delta);
       }
     }
   }
   ++num_accumulated_;
 
-  if (num_accumulated_ >= options_.scans_per_accumulation()) {
+  if (IsAccumulationComplete(time)) {
     num_accumulated_ = 0;
-    return AddAccumulatedRangeData(
-        time, sensor::TransformRangeData(accumulated_range_data_,
-                                         tracking_delta.inverse()));
+    if (!is_first_of_accumulation) {
+      sensor::TransformRangeDataInPlace(tracking_delta.inverse(),
+                                        &accumulated_range_data_);
+    }
+    return TimedAddAccumulatedRangeData(time, accumulated_range_data_,
+                                        true /* insert_into_submap */);
   }
   return nullptr;
 }
 
+bool LocalTrajectoryBuilder::IsAccumulationComplete(
+    const common::Time time) const {
+  if (options_.accumulation_duration_seconds() > 0.) {
+    return common::ToSeconds(time - accumulation_start_time_) >=
+           options_.accumulation_duration_seconds();
+  }
+  return num_accumulated_ >= options_.scans_per_accumulation();
+}
+
+std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
+LocalTrajectoryBuilder::AddRangeDataToRollingWindow(
+    const common::Time time, const Eigen::Vector3f& origin,
+    const sensor::PointCloudView returns) {
+  const transform::Rigid3f pose_estimate =
+      extrapolator_->ExtrapolatePose(time).cast<float>();
+  sensor::RangeData range_data_in_local{pose_estimate * origin, {}, {}};
+  for (const Eigen::Vector3f& point : returns) {
+    const Eigen::Vector3f delta = point - origin;
+    const float range = delta.norm();
+    if (range >= options_.min_range()) {
+      if (range <= options_.max_range()) {
+        range_data_in_local.returns.push_back(pose_estimate * point);
+      } else {
+        range_data_in_local.misses.push_back(
+            pose_estimate *
+            (origin + options_.max_range() / range * delta));
+      }
+    }
+  }
+  rolling_window_.push_back(std::move(range_data_in_local));
+  if (static_cast<int>(rolling_window_.size()) >
+      options_.scans_per_accumulation()) {
+    rolling_window_.pop_front();
+  }
+  ++num_accumulated_;
+  const bool insert_into_submap =
+      num_accumulated_ >= options_.scans_per_accumulation();
+  if (!insert_into_submap && static_cast<int>(rolling_window_.size()) <
+                                 options_.scans_per_accumulation()) {
+    return nullptr;
+  }
+  if (insert_into_submap) {
+    num_accumulated_ = 0;
+  }
+
+  // Each scan was unwarped with the pose extrapolated for its own time, so
+  // transforming them back with the latest pose yields the window as seen from
+  // the tracking frame at 'time'.
+  const transform::Rigid3f local_to_tracking = pose_estimate.inverse();
+  accumulated_range_data_.origin =
+      local_to_tracking * rolling_window_.back().origin;
+  accumulated_range_data_.returns.clear();
+  accumulated_range_data_.misses.clear();
+  for (const sensor::RangeData& window_range_data : rolling_window_) {
+    for (const Eigen::Vector3f& hit : window_range_data.returns) {
+      accumulated_range_data_.returns.push_back(local_to_tracking * hit);
+    }
+    for (const Eigen::Vector3f& miss : window_range_data.misses) {
+      accumulated_range_data_.misses.push_back(local_to_tracking * miss);
+    }
+  }
+  return TimedAddAccumulatedRangeData(time, accumulated_range_data_,
+                                      insert_into_submap);
+}
+
+std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
+LocalTrajectoryBuilder::TimedAddAccumulatedRangeData(
+    const common::Time time, const sensor::RangeData& range_data_in_tracking,
+    const bool insert_into_submap) {
+  const auto start_time = std::chrono::steady_clock::now();
+  std::unique_ptr<InsertionResult> insertion_result = AddAccumulatedRangeData(
+      time, range_data_in_tracking, insert_into_submap);
+  degradation_controller_.Update(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time)
+          .count());
+  return insertion_result;
+}
+
 std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
 LocalTrajectoryBuilder::AddAccumulatedRangeData(
-    const common::Time time, const sensor::RangeData& range_data_in_tracking) {
-  const sensor::RangeData filtered_range_data = {
+    const common::Time time, const sensor::RangeData& range_data_in_tracking,
+    const bool insert_into_submap) {
+  if (insert_into_submap &&
+      motion_filter_.IsStationary(time, extrapolator_->ExtrapolatePose(time))) {
+    // The scan is neither matched nor inserted, the last pose is kept.
+    extrapolator_->AddPose(time, last_pose_estimate_.pose);
+    last_pose_estimate_.time = time;
+    return nullptr;
+  }
+
+  sensor::RangeData filtered_range_data = {
       range_data_in_tracking.origin,
       sensor::VoxelFiltered(range_data_in_tracking.returns,
                             options_.voxel_filter_size()),
@@ -128,10 +274,12 @@ LocalTrajectoryBuilder::AddAccumulatedRangeData(
   transform::Rigid3d initial_ceres_pose =
       matching_submap->local_pose().inverse() * pose_prediction;
   sensor::AdaptiveVoxelFilter adaptive_voxel_filter(
-      options_.high_resolution_adaptive_voxel_filter_options());
-  const sensor::PointCloud filtered_point_cloud_in_tracking =
+      degradation_controller_.AdjustAdaptiveVoxelFilterOptions(
+          options_.high_resolution_adaptive_voxel_filter_options()));
+  sensor::PointCloud filtered_point_cloud_in_tracking =
       adaptive_voxel_filter.Filter(filtered_range_data.returns);
-  if (options_.use_online_correlative_scan_matching()) {
+  if (options_.use_online_correlative_scan_matching() &&
+      !degradation_controller_.skip_online_correlative_scan_matching()) {
     // We take a copy since we use 'initial_ceres_pose' as an output argument.
     const transform::Rigid3d initial_pose = initial_ceres_pose;
     real_time_correlative_scan_matcher_->Match(
@@ -143,9 +291,15 @@ LocalTrajectoryBuilder::AddAccumulatedRangeData(
   ceres::Solver::Summary summary;
 
   sensor::AdaptiveVoxelFilter low_resolution_adaptive_voxel_filter(
-      options_.low_resolution_adaptive_voxel_filter_options());
-  const sensor::PointCloud low_resolution_point_cloud_in_tracking =
+      degradation_controller_.AdjustAdaptiveVoxelFilterOptions(
+          options_.low_resolution_adaptive_voxel_filter_options()));
+  sensor::PointCloud low_resolution_point_cloud_in_tracking =
       low_resolution_adaptive_voxel_filter.Filter(filtered_range_data.returns);
+  ceres_scan_matcher_->SetMaxNumIterations(
+      degradation_controller_.AdjustMaxNumCeresIterations(
+          options_.ceres_scan_matcher_options()
+              .ceres_solver_options()
+              .max_num_iterations()));
   ceres_scan_matcher_->Match(
       matching_submap->local_pose().inverse() * pose_prediction,
       initial_ceres_pose,
@@ -153,13 +307,28 @@ LocalTrajectoryBuilder::AddAccumulatedRangeData(
         &matching_submap->high_resolution_hybrid_grid()},
        {&low_resolution_point_cloud_in_tracking,
         &matching_submap->low_resolution_hybrid_grid()}},
-      &pose_observation_in_submap, &summary);
-  const transform::Rigid3d pose_estimate =
+      &ceres_scan_matcher_context_, &pose_observation_in_submap, &summary);
+  transform::Rigid3d pose_estimate =
       matching_submap->local_pose() * pose_observation_in_submap;
+  if (!insert_into_submap) {
+    extrapolator_->AddPose(time, pose_estimate);
+    last_pose_estimate_ = {
+        time, pose_estimate,
+        sensor::TransformPointCloud(filtered_range_data.returns,
+                                    pose_estimate.cast<float>())};
+    return nullptr;
+  }
+  if (sliding_window_optimizer_ != nullptr) {
+    pose_estimate = sliding_window_optimizer_->AddScan(
+        time, pose_estimate, matching_submap,
+        filtered_point_cloud_in_tracking,
+        low_resolution_point_cloud_in_tracking);
+  }
   extrapolator_->AddPose(time, pose_estimate);
+  motion_filter_.AddMatchedPose(time, pose_estimate);
   const Eigen::Quaterniond gravity_alignment =
       extrapolator_->EstimateGravityOrientation(time);
-  const auto rotational_scan_matcher_histogram =
+  Eigen::VectorXf rotational_scan_matcher_histogram =
       scan_matching::RotationalScanMatcher::ComputeHistogram(
           sensor::TransformPointCloud(
               filtered_range_data.returns,
@@ -171,10 +340,12 @@ LocalTrajectoryBuilder::AddAccumulatedRangeData(
       sensor::TransformPointCloud(filtered_range_data.returns,
                                   pose_estimate.cast<float>())};
 
-  return InsertIntoSubmap(time, filtered_range_data, gravity_alignment,
-                          filtered_point_cloud_in_tracking,
-                          low_resolution_point_cloud_in_tracking,
-                          rotational_scan_matcher_histogram, pose_estimate);
+  return InsertIntoSubmap(time, std::move(filtered_range_data),
+                          gravity_alignment,
+                          std::move(filtered_point_cloud_in_tracking),
+                          std::move(low_resolution_point_cloud_in_tracking),
+                          std::move(rotational_scan_matcher_histogram),
+                          pose_estimate);
 }
 
 void LocalTrajectoryBuilder::AddOdometerData(
@@ -191,15 +362,25 @@ const mapping::PoseEstimate& LocalTrajectoryBuilder::pose_estimate() const {
   return last_pose_estimate_;
 }
 
+bool LocalTrajectoryBuilder::GetExtrapolationState(
+    mapping::PoseExtrapolator::ExtrapolationState* const extrapolation_state) {
+  if (extrapolator_ == nullptr) {
+    return false;
+  }
+  *extrapolation_state = extrapolator_->GetExtrapolationState();
+  return true;
+}
+
 std::unique_ptr<LocalTrajectoryBuilder::InsertionResult>
 LocalTrajectoryBuilder::InsertIntoSubmap(
-    const common::Time time, const sensor::RangeData& range_data_in_tracking,
+    const common::Time time, sensor::RangeData range_data_in_tracking,
     const Eigen::Quaterniond& gravity_alignment,
-    const sensor::PointCloud& high_resolution_point_cloud,
-    const sensor::PointCloud& low_resolution_point_cloud,
-    const Eigen::VectorXf& rotational_scan_matcher_histogram,
+    sensor::PointCloud high_resolution_point_cloud,
+    sensor::PointCloud low_resolution_point_cloud,
+    Eigen::VectorXf rotational_scan_matcher_histogram,
     const transform::Rigid3d& pose_observation) {
-  if (motion_filter_.IsSimilar(time, pose_observation)) {
+  if (motion_filter_.IsSimilar(time, pose_observation) ||
+      !degradation_controller_.ShouldInsert()) {
     return nullptr;
   }
   // Querying the active submaps must be done here before calling
@@ -208,20 +389,19 @@ LocalTrajectoryBuilder::InsertIntoSubmap(
   for (const std::shared_ptr<Submap>& submap : active_submaps_.submaps()) {
     insertion_submaps.push_back(submap);
   }
-  active_submaps_.InsertRangeData(
-      sensor::TransformRangeData(range_data_in_tracking,
-                                 pose_observation.cast<float>()),
-      gravity_alignment);
+  sensor::TransformRangeDataInPlace(pose_observation.cast<float>(),
+                                    &range_data_in_tracking);
+  active_submaps_.InsertRangeData(std::move(range_data_in_tracking),
+                                  gravity_alignment);
   return std::unique_ptr<InsertionResult>(new InsertionResult{
-
       std::make_shared<const mapping::TrajectoryNode::Data>(
           mapping::TrajectoryNode::Data{
               time,
               gravity_alignment,
               {},  // 'filtered_point_cloud' is only used in 2D.
-              high_resolution_point_cloud,
-              low_resolution_point_cloud,
-              rotational_scan_matcher_histogram,
+              std::move(high_resolution_point_cloud),
+              std::move(low_resolution_point_cloud),
+              std::move(rotational_scan_matcher_histogram),
               pose_observation}),
       std::move(insertion_submaps)});
 }
@@ -17,16 +17,22 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_LOCAL_TRAJECTORY_BUILDER_H_
 #define CARTOGRAPHER_MAPPING_3D_LOCAL_TRAJECTORY_BUILDER_H_
 
+#include <deque>
 #include <memory>
 
 #include "cartographer/common/time.h"
+#include "cartographer/mapping/local_slam_degradation_controller.h"
 #include "cartographer/mapping/pose_estimate.h"
 #include "cartographer/mapping/pose_extrapolator.h"
+#include "cartographer/mapping/proto/runtime_options.pb.h"
+#include "cartographer/mapping/runtime_options.h"
 #include "cartographer/mapping_3d/motion_filter.h"
 #include "cartographer/mapping_3d/proto/local_trajectory_builder_options.pb.h"
 #include "cartographer/mapping_3d/scan_matching/ceres_scan_matcher.h"
 #include "cartographer/mapping_3d/scan_matching/real_time_correlative_scan_matcher.h"
+#include "cartographer/mapping_3d/sliding_window_optimizer.h"
 #include "cartographer/mapping_3d/submaps.h"
+#include "cartographer/metrics/metrics.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/sensor/range_data.h"
@@ -52,25 +58,69 @@ class LocalTrajectoryBuilder {
   LocalTrajectoryBuilder(const LocalTrajectoryBuilder&) = delete;
   LocalTrajectoryBuilder& operator=(const LocalTrajectoryBuilder&) = delete;
 
+  // Exports the metrics of the trajectory with 'trajectory_id' to 'registry'.
+  void RegisterMetrics(int trajectory_id, metrics::Registry* registry);
+
   void AddImuData(const sensor::ImuData& imu_data);
   std::unique_ptr<InsertionResult> AddRangeData(
       common::Time time, const sensor::RangeData& range_data);
+  // Same as above for the 'returns' seen from 'origin', which are only read
+  // during the call and need not be copied into a RangeData.
+  std::unique_ptr<InsertionResult> AddRangeData(
+      common::Time time, const Eigen::Vector3f& origin,
+      sensor::PointCloudView returns);
   void AddOdometerData(const sensor::OdometryData& odometry_data);
   const mapping::PoseEstimate& pose_estimate() const;
 
+  // Returns false until the pose extrapolator has been initialized.
+  bool GetExtrapolationState(
+      mapping::PoseExtrapolator::ExtrapolationState* extrapolation_state);
+
+  // Changes the fields set in 'runtime_options'. Thread-safe, the change is
+  // applied when the next range data is added.
+  void UpdateRuntimeOptions(
+      const mapping::proto::TrajectoryBuilderRuntimeOptions& runtime_options);
+
  private:
+  // Returns true if the accumulation is complete after adding the range data
+  // at 'time', see 'accumulation_duration_seconds'.
+  bool IsAccumulationComplete(common::Time time) const;
+
+  // Used instead of accumulating if 'match_rolling_window' is enabled.
+  std::unique_ptr<InsertionResult> AddRangeDataToRollingWindow(
+      common::Time time, const Eigen::Vector3f& origin,
+      sensor::PointCloudView returns);
+
+  // Calls AddAccumulatedRangeData() and reports the time it took to the
+  // 'degradation_controller_'.
+  std::unique_ptr<InsertionResult> TimedAddAccumulatedRangeData(
+      common::Time time, const sensor::RangeData& range_data_in_tracking,
+      bool insert_into_submap);
+
+  // Matches the 'range_data_in_tracking'. If 'insert_into_submap' is false,
+  // only the pose estimate is updated.
   std::unique_ptr<InsertionResult> AddAccumulatedRangeData(
-      common::Time time, const sensor::RangeData& range_data_in_tracking);
+      common::Time time, const sensor::RangeData& range_data_in_tracking,
+      bool insert_into_submap);
 
+  // Takes ownership of the range data and point clouds, which are moved into
+  // the submaps and the node data without copying them.
   std::unique_ptr<InsertionResult> InsertIntoSubmap(
-      common::Time time, const sensor::RangeData& range_data_in_tracking,
+      common::Time time, sensor::RangeData range_data_in_tracking,
       const Eigen::Quaterniond& gravity_alignment,
-      const sensor::PointCloud& high_resolution_point_cloud,
-      const sensor::PointCloud& low_resolution_point_cloud,
-      const Eigen::VectorXf& rotational_scan_matcher_histogram,
+      sensor::PointCloud high_resolution_point_cloud,
+      sensor::PointCloud low_resolution_point_cloud,
+      Eigen::VectorXf rotational_scan_matcher_histogram,
       const transform::Rigid3d& pose_observation);
 
-  const proto::LocalTrajectoryBuilderOptions options_;
+  // Applies the runtime options added by UpdateRuntimeOptions() since the
+  // last call.
+  void ApplyPendingRuntimeOptions();
+
+  proto::LocalTrajectoryBuilderOptions options_;
+  mapping::PendingRuntimeOptions<
+      mapping::proto::TrajectoryBuilderRuntimeOptions>
+      pending_runtime_options_;
   ActiveSubmaps active_submaps_;
 
   mapping::PoseEstimate last_pose_estimate_;
@@ -79,12 +129,20 @@ class LocalTrajectoryBuilder {
   std::unique_ptr<scan_matching::RealTimeCorrelativeScanMatcher>
       real_time_correlative_scan_matcher_;
   std::unique_ptr<scan_matching::CeresScanMatcher> ceres_scan_matcher_;
+  scan_matching::CeresScanMatcher::Context ceres_scan_matcher_context_;
+  mapping::LocalSlamDegradationController degradation_controller_;
+  // Only set if the 'sliding_window_optimizer_options' enable it.
+  std::unique_ptr<SlidingWindowOptimizer> sliding_window_optimizer_;
 
   std::unique_ptr<mapping::PoseExtrapolator> extrapolator_;
 
   int num_accumulated_ = 0;
+  common::Time accumulation_start_time_;
   transform::Rigid3f first_pose_estimate_ = transform::Rigid3f::Identity();
   sensor::RangeData accumulated_range_data_;
+  // The last 'scans_per_accumulation' range data in the local frame, cropped
+  // to the range limits. Only used if 'match_rolling_window' is enabled.
+  std::deque<sensor::RangeData> rolling_window_;
 };
 
 }  // namespace mapping_3d
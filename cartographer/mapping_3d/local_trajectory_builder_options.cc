@@ -16,9 +16,11 @@
 
 #include "cartographer/mapping_3d/local_trajectory_builder_options.h"
 
+#include "cartographer/mapping/local_slam_degradation_controller.h"
 #include "cartographer/mapping_2d/scan_matching/real_time_correlative_scan_matcher.h"
 #include "cartographer/mapping_3d/motion_filter.h"
 #include "cartographer/mapping_3d/scan_matching/ceres_scan_matcher.h"
+#include "cartographer/mapping_3d/sliding_window_optimizer.h"
 #include "cartographer/mapping_3d/submaps.h"
 #include "cartographer/sensor/voxel_filter.h"
 #include "glog/logging.h"
@@ -33,6 +35,14 @@ proto::LocalTrajectoryBuilderOptions CreateLocalTrajectoryBuilderOptions(
   options.set_max_range(parameter_dictionary->GetDouble("max_range"));
   options.set_scans_per_accumulation(
       parameter_dictionary->GetInt("scans_per_accumulation"));
+  options.set_accumulation_duration_seconds(
+      parameter_dictionary->GetDouble("accumulation_duration_seconds"));
+  options.set_match_rolling_window(
+      parameter_dictionary->GetBool("match_rolling_window"));
+  CHECK(!options.match_rolling_window() ||
+        options.accumulation_duration_seconds() <= 0.)
+      << "'accumulation_duration_seconds' cannot be used with "
+         "'match_rolling_window'.";
   options.set_voxel_filter_size(
       parameter_dictionary->GetDouble("voxel_filter_size"));
   *options.mutable_high_resolution_adaptive_voxel_filter_options() =
@@ -57,6 +67,13 @@ proto::LocalTrajectoryBuilderOptions CreateLocalTrajectoryBuilderOptions(
           parameter_dictionary->GetDictionary("ceres_scan_matcher").get());
   *options.mutable_motion_filter_options() = CreateMotionFilterOptions(
       parameter_dictionary->GetDictionary("motion_filter").get());
+  *options.mutable_sliding_window_optimizer_options() =
+      CreateSlidingWindowOptimizerOptions(
+          parameter_dictionary->GetDictionary("sliding_window_optimizer")
+              .get());
+  *options.mutable_degradation_options() =
+      mapping::CreateLocalSlamDegradationOptions(
+          parameter_dictionary->GetDictionary("degradation").get());
   options.set_imu_gravity_time_constant(
       parameter_dictionary->GetDouble("imu_gravity_time_constant"));
   options.set_rotational_histogram_size(
@@ -50,18 +50,22 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
           min_range = 0.5,
           max_range = 50.,
           scans_per_accumulation = 1,
+          accumulation_duration_seconds = 0.,
+          match_rolling_window = false,
           voxel_filter_size = 0.05,
 
           high_resolution_adaptive_voxel_filter = {
             max_length = 0.7,
             min_num_points = 200,
             max_range = 50.,
+            use_voxel_count_pyramid = false,
           },
 
           low_resolution_adaptive_voxel_filter = {
             max_length = 0.7,
             min_num_points = 200,
             max_range = 50.,
+            use_voxel_count_pyramid = false,
           },
 
           use_online_correlative_scan_matching = false,
@@ -78,6 +82,7 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
             translation_weight = 0.1,
             rotation_weight = 0.3,
             only_optimize_yaw = false,
+            use_single_precision_evaluation = false,
             ceres_solver_options = {
               use_nonmonotonic_steps = true,
               max_num_iterations = 20,
@@ -89,6 +94,30 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
             max_time_seconds = 0.2,
             max_distance_meters = 0.02,
             max_angle_radians = 0.001,
+            stationary_scan_matching_period_seconds = 0.,
+          },
+
+          sliding_window_optimizer = {
+            num_scans = 0,
+            high_resolution_occupied_space_weight = 5.,
+            low_resolution_occupied_space_weight = 20.,
+            rotation_weight = 1e2,
+            acceleration_weight = 1.,
+            ceres_solver_options = {
+              use_nonmonotonic_steps = true,
+              max_num_iterations = 20,
+              num_threads = 1,
+            },
+            max_solver_time_seconds = 1.,
+          },
+
+          degradation = {
+            time_budget_seconds = 0.,
+            step_up_budget_fraction = 0.5,
+            num_range_data_to_step_up = 20,
+            max_level = 4,
+            min_num_points_factor = 0.5,
+            max_num_ceres_iterations = 5,
           },
 
           imu_gravity_time_constant = 1.,
@@ -99,10 +128,12 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
             high_resolution_max_range = 50.,
             low_resolution = 0.5,
             num_range_data = 45000,
+            use_background_insertion = false,
             range_data_inserter = {
               hit_probability = 0.7,
               miss_probability = 0.4,
               num_free_space_voxels = 0,
+              num_threads = 1,
             },
           },
         }
@@ -262,6 +293,24 @@ TEST_F(LocalTrajectoryBuilderTest, MoveInsideCubeUsingOnlyCeresScanMatcher) {
   VerifyAccuracy(GenerateCorkscrewTrajectory(), 1e-1);
 }
 
+TEST_F(LocalTrajectoryBuilderTest, MoveInsideCubeAccumulatingByDuration) {
+  proto::LocalTrajectoryBuilderOptions options =
+      CreateTrajectoryBuilderOptions();
+  // Scans are 0.3 s apart, so each accumulation has 2 of them.
+  options.set_accumulation_duration_seconds(0.25);
+  local_trajectory_builder_.reset(new LocalTrajectoryBuilder(options));
+  VerifyAccuracy(GenerateCorkscrewTrajectory(), 1e-1);
+}
+
+TEST_F(LocalTrajectoryBuilderTest, MoveInsideCubeMatchingRollingWindow) {
+  proto::LocalTrajectoryBuilderOptions options =
+      CreateTrajectoryBuilderOptions();
+  options.set_scans_per_accumulation(2);
+  options.set_match_rolling_window(true);
+  local_trajectory_builder_.reset(new LocalTrajectoryBuilder(options));
+  VerifyAccuracy(GenerateCorkscrewTrajectory(), 1e-1);
+}
+
 }  // namespace
 }  // namespace mapping_3d
 }  // namespace cartographer
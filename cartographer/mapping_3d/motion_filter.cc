@@ -31,6 +31,9 @@ proto::MotionFilterOptions CreateMotionFilterOptions(
       parameter_dictionary->GetDouble("max_distance_meters"));
   options.set_max_angle_radians(
       parameter_dictionary->GetDouble("max_angle_radians"));
+  options.set_stationary_scan_matching_period_seconds(
+      parameter_dictionary->GetDouble(
+          "stationary_scan_matching_period_seconds"));
   return options;
 }
 
@@ -45,10 +48,7 @@ bool MotionFilter::IsSimilar(const common::Time time,
   ++num_total_;
   if (num_total_ > 1 &&
       time - last_time_ <= common::FromSeconds(options_.max_time_seconds()) &&
-      (pose.translation() - last_pose_.translation()).norm() <=
-          options_.max_distance_meters() &&
-      transform::GetAngle(pose.inverse() * last_pose_) <=
-          options_.max_angle_radians()) {
+      IsWithinThresholds(pose, last_pose_)) {
     return true;
   }
   last_time_ = time;
@@ -57,5 +57,37 @@ bool MotionFilter::IsSimilar(const common::Time time,
   return false;
 }
 
+bool MotionFilter::IsStationary(const common::Time time,
+                                const transform::Rigid3d& pose_prediction) {
+  if (options_.stationary_scan_matching_period_seconds() <= 0. ||
+      !has_matched_pose_ ||
+      time - last_matched_time_ >=
+          common::FromSeconds(
+              options_.stationary_scan_matching_period_seconds()) ||
+      !IsWithinThresholds(pose_prediction, last_matched_pose_)) {
+    return false;
+  }
+  ++num_stationary_;
+  LOG_EVERY_N(INFO, 500) << "Skipped scan matching of " << num_stationary_
+                         << " stationary scans.";
+  return true;
+}
+
+void MotionFilter::AddMatchedPose(const common::Time time,
+                                  const transform::Rigid3d& pose) {
+  has_matched_pose_ = true;
+  last_matched_time_ = time;
+  last_matched_pose_ = pose;
+}
+
+bool MotionFilter::IsWithinThresholds(
+    const transform::Rigid3d& pose,
+    const transform::Rigid3d& other_pose) const {
+  return (pose.translation() - other_pose.translation()).norm() <=
+             options_.max_distance_meters() &&
+         transform::GetAngle(pose.inverse() * other_pose) <=
+             options_.max_angle_radians();
+}
+
 }  // namespace mapping_3d
 }  // namespace cartographer
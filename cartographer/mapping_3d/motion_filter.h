@@ -40,12 +40,30 @@ class MotionFilter {
   // true is returned.
   bool IsSimilar(common::Time time, const transform::Rigid3d& pose);
 
+  // Returns true if scan matching of the scan at 'time' can be skipped: the
+  // 'pose_prediction' is within the distance and angle thresholds of the pose
+  // last passed to AddMatchedPose(), which is less than the stationary scan
+  // matching period old. The caller then reuses the last matched pose.
+  bool IsStationary(common::Time time,
+                    const transform::Rigid3d& pose_prediction);
+
+  // Records the 'pose' found by scan matching the scan at 'time'.
+  void AddMatchedPose(common::Time time, const transform::Rigid3d& pose);
+
  private:
+  bool IsWithinThresholds(const transform::Rigid3d& pose,
+                          const transform::Rigid3d& other_pose) const;
+
   const proto::MotionFilterOptions options_;
   int num_total_ = 0;
   int num_different_ = 0;
   common::Time last_time_;
   transform::Rigid3d last_pose_;
+
+  int num_stationary_ = 0;
+  bool has_matched_pose_ = false;
+  common::Time last_matched_time_;
+  transform::Rigid3d last_matched_pose_;
 };
 
 }  // namespace mapping_3d
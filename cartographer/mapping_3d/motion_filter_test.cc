@@ -31,6 +31,7 @@ class MotionFilterTest : public ::testing::Test {
         "max_time_seconds = 0.5, "
         "max_distance_meters = 0.2, "
         "max_angle_radians = 2., "
+        "stationary_scan_matching_period_seconds = 0., "
         "}");
     options_ = CreateMotionFilterOptions(parameter_dictionary.get());
   }
@@ -104,6 +105,41 @@ TEST_F(MotionFilterTest, RotationalMotion) {
                                       transform::Rigid3d::Identity()));
 }
 
+TEST_F(MotionFilterTest, NotStationaryByDefault) {
+  MotionFilter motion_filter(options_);
+  EXPECT_FALSE(motion_filter.IsStationary(SecondsSinceEpoch(42),
+                                          transform::Rigid3d::Identity()));
+  motion_filter.AddMatchedPose(SecondsSinceEpoch(42),
+                               transform::Rigid3d::Identity());
+  EXPECT_FALSE(motion_filter.IsStationary(SecondsSinceEpoch(42),
+                                          transform::Rigid3d::Identity()));
+}
+
+TEST_F(MotionFilterTest, Stationary) {
+  options_.set_stationary_scan_matching_period_seconds(2.);
+  MotionFilter motion_filter(options_);
+  EXPECT_FALSE(motion_filter.IsStationary(SecondsSinceEpoch(42),
+                                          transform::Rigid3d::Identity()));
+  motion_filter.AddMatchedPose(SecondsSinceEpoch(42),
+                               transform::Rigid3d::Identity());
+  EXPECT_TRUE(motion_filter.IsStationary(
+      SecondsSinceEpoch(43),
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.1, 0., 0.))));
+  EXPECT_FALSE(motion_filter.IsStationary(
+      SecondsSinceEpoch(43),
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.3, 0., 0.))));
+  EXPECT_FALSE(motion_filter.IsStationary(
+      SecondsSinceEpoch(43), transform::Rigid3d::Rotation(Eigen::AngleAxisd(
+                                 2.1, Eigen::Vector3d::UnitY()))));
+  // Scans are matched again once the period passed.
+  EXPECT_FALSE(motion_filter.IsStationary(SecondsSinceEpoch(44),
+                                          transform::Rigid3d::Identity()));
+  motion_filter.AddMatchedPose(SecondsSinceEpoch(44),
+                               transform::Rigid3d::Identity());
+  EXPECT_TRUE(motion_filter.IsStationary(SecondsSinceEpoch(45),
+                                         transform::Rigid3d::Identity()));
+}
+
 }  // namespace
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -16,7 +16,15 @@
 
 #include "cartographer/mapping_3d/range_data_inserter.h"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+
 #include "Eigen/Core"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/mapping/probability_values.h"
 #include "glog/logging.h"
 
@@ -25,31 +33,193 @@ namespace mapping_3d {
 
 namespace {
 
+// Cells are assigned to tasks in blocks of 2^kBlockBits cells per dimension,
+// matching the FlatGrids of the HybridGrid. Different tasks therefore never
+// change the same FlatGrid.
+constexpr int kBlockBits = 3;
+
+// Calls 'visit' for each cell the ray from 'hit' to 'origin' passes through,
+// using the voxel traversal of J. Amanatides and A. Woo, "A Fast Voxel
+// Traversal Algorithm for Ray Tracing", Eurographics 1987. Each cell is
+// visited exactly once, starting next to the cell of 'hit', which is not
+// visited, and ending with 'origin_cell'. Only cells within
+// 'num_free_space_voxels' of the cell of 'hit' in each dimension are visited.
+template <typename VisitFunction>
+void TraverseMissedCells(const HybridGrid& hybrid_grid,
+                         const Eigen::Vector3f& origin,
+                         const Eigen::Array3i& origin_cell,
+                         const Eigen::Vector3f& hit,
+                         const int num_free_space_voxels,
+                         const VisitFunction& visit) {
+  const Eigen::Array3i hit_cell = hybrid_grid.GetCellIndex(hit);
+  CHECK_LT((origin_cell - hit_cell).abs().maxCoeff(), 1 << 15);
+  // In units of cells, cell 'i' covers [i - 0.5, i + 0.5) in each dimension.
+  const Eigen::Array3f start = hit.array() / hybrid_grid.resolution();
+  const Eigen::Array3f direction =
+      origin.array() / hybrid_grid.resolution() - start;
+  Eigen::Array3i step;
+  Eigen::Array3i num_remaining_steps;
+  // Parameter along the ray at which the next cell boundary in each dimension
+  // is crossed, and the increment of it between boundaries.
+  Eigen::Array3f next_crossing;
+  Eigen::Array3f crossing_delta;
+  for (int i = 0; i != 3; ++i) {
+    step[i] = origin_cell[i] >= hit_cell[i] ? 1 : -1;
+    num_remaining_steps[i] = std::abs(origin_cell[i] - hit_cell[i]);
+    if (num_remaining_steps[i] == 0) {
+      next_crossing[i] = std::numeric_limits<float>::infinity();
+      crossing_delta[i] = 0.f;
+      continue;
+    }
+    crossing_delta[i] = 1.f / std::abs(direction[i]);
+    const float boundary = hit_cell[i] + 0.5f * step[i];
+    next_crossing[i] =
+        std::max(0.f, (boundary - start[i]) * step[i] * crossing_delta[i]);
+  }
+  Eigen::Array3i cell = hit_cell;
+  while ((num_remaining_steps > 0).any()) {
+    int dimension;
+    next_crossing.minCoeff(&dimension);
+    cell[dimension] += step[dimension];
+    if (std::abs(cell[dimension] - hit_cell[dimension]) >
+        num_free_space_voxels) {
+      return;
+    }
+    if (--num_remaining_steps[dimension] == 0) {
+      next_crossing[dimension] = std::numeric_limits<float>::infinity();
+    } else {
+      next_crossing[dimension] += crossing_delta[dimension];
+    }
+    visit(cell);
+  }
+}
+
 void InsertMissesIntoGrid(const std::vector<uint16>& miss_table,
                           const Eigen::Vector3f& origin,
                           const sensor::PointCloud& returns,
                           HybridGrid* hybrid_grid,
                           const int num_free_space_voxels) {
   const Eigen::Array3i origin_cell = hybrid_grid->GetCellIndex(origin);
+  // Rays do not visit a cell twice, and cells already missed by another ray
+  // are skipped by the update marker.
   for (const Eigen::Vector3f& hit : returns) {
-    const Eigen::Array3i hit_cell = hybrid_grid->GetCellIndex(hit);
+    TraverseMissedCells(*hybrid_grid, origin, origin_cell, hit,
+                        num_free_space_voxels,
+                        [hybrid_grid, &miss_table](const Eigen::Array3i& cell) {
+                          hybrid_grid->ApplyLookupTable(cell, miss_table);
+                        });
+  }
+}
 
-    const Eigen::Array3i delta = hit_cell - origin_cell;
-    const int num_samples = delta.cwiseAbs().maxCoeff();
-    CHECK_LT(num_samples, 1 << 15);
-    // 'num_samples' is the number of samples we equi-distantly place on the
-    // line between 'origin' and 'hit'. (including a fractional part for sub-
-    // voxels) It is chosen so that between two samples we change from one voxel
-    // to the next on the fastest changing dimension.
-    //
-    // Only the last 'num_free_space_voxels' are updated for performance.
-    for (int position = std::max(0, num_samples - num_free_space_voxels);
-         position < num_samples; ++position) {
-      const Eigen::Array3i miss_cell =
-          origin_cell + delta * position / num_samples;
-      hybrid_grid->ApplyLookupTable(miss_cell, miss_table);
+// Runs 'task' for all task indices from 0 to 'num_tasks' - 1, using the
+// 'thread_pool' and the calling thread, and returns when all have finished.
+void RunTasks(const int num_tasks, common::ThreadPoolInterface* thread_pool,
+              const std::function<void(int)>& task) {
+  struct State {
+    common::Mutex mutex;
+    int num_tasks_finished GUARDED_BY(mutex) = 0;
+  };
+  // Shared, since a background thread might still be notifying waiters after
+  // this function returned.
+  const auto state = std::make_shared<State>();
+  const auto run_task = [state, &task](const int index) {
+    task(index);
+    common::MutexLocker locker(&state->mutex);
+    ++state->num_tasks_finished;
+  };
+  for (int i = 1; i < num_tasks; ++i) {
+    thread_pool->Schedule([run_task, i]() { run_task(i); },
+                          common::WorkItemPriority::kHigh,
+                          "insert_misses_into_grid");
+  }
+  run_task(0);
+  common::MutexLocker locker(&state->mutex);
+  locker.Await([&state, num_tasks]() REQUIRES(state->mutex) {
+    return state->num_tasks_finished == num_tasks;
+  });
+}
+
+// Returns the task which updates the block containing 'cell'.
+int GetTaskIndex(const Eigen::Array3i& cell, const int num_tasks) {
+  // Arithmetic shifts round down, so negative cells are assigned consistently.
+  const Eigen::Array3i block = cell.unaryExpr(
+      [](const int value) { return value >> kBlockBits; });
+  const uint32 hash = (static_cast<uint32>(block.x()) * 73856093u) ^
+                      (static_cast<uint32>(block.y()) * 19349669u) ^
+                      (static_cast<uint32>(block.z()) * 83492791u);
+  return hash % num_tasks;
+}
+
+// Same as InsertMissesIntoGrid(), but using 'num_tasks' tasks. The misses are
+// computed and sorted by the blocks they fall into in parallel, then all
+// missing blocks are allocated by the calling thread. Finally, each task
+// updates only the blocks assigned to it, so no locking is needed. Since each
+// cell is updated at most once, the result does not depend on the order.
+void InsertMissesIntoGridInParallel(const std::vector<uint16>& miss_table,
+                                    const Eigen::Vector3f& origin,
+                                    const sensor::PointCloud& returns,
+                                    HybridGrid* hybrid_grid,
+                                    const int num_free_space_voxels,
+                                    const int num_tasks,
+                                    common::ThreadPoolInterface* thread_pool) {
+  const Eigen::Array3i origin_cell = hybrid_grid->GetCellIndex(origin);
+  // Computed by task 'i' for the returns it is responsible for: the misses
+  // to be updated by task 'j' at index 'i * num_tasks + j', and a miss in each
+  // block the rays pass through.
+  std::vector<std::vector<Eigen::Array3i>> misses_by_task(num_tasks *
+                                                          num_tasks);
+  std::vector<std::vector<Eigen::Array3i>> misses_in_new_blocks(num_tasks);
+  RunTasks(num_tasks, thread_pool, [&](const int task_index) {
+    const size_t begin = returns.size() * task_index / num_tasks;
+    const size_t end = returns.size() * (task_index + 1) / num_tasks;
+    for (size_t i = begin; i != end; ++i) {
+      bool first_miss = true;
+      Eigen::Array3i previous_block;
+      TraverseMissedCells(
+          *hybrid_grid, origin, origin_cell, returns[i], num_free_space_voxels,
+          [&](const Eigen::Array3i& miss_cell) {
+            misses_by_task[task_index * num_tasks +
+                           GetTaskIndex(miss_cell, num_tasks)]
+                .push_back(miss_cell);
+            const Eigen::Array3i block = miss_cell.unaryExpr(
+                [](const int value) { return value >> kBlockBits; });
+            if (first_miss || (block != previous_block).any()) {
+              misses_in_new_blocks[task_index].push_back(miss_cell);
+              previous_block = block;
+              first_miss = false;
+            }
+          });
+    }
+  });
+
+  // Growing the grid and allocating blocks is not thread-safe. Accessing each
+  // block once here means no allocations are needed while updating below. The
+  // cells accessed here are updated anyway.
+  for (const std::vector<Eigen::Array3i>& misses : misses_in_new_blocks) {
+    for (const Eigen::Array3i& miss_cell : misses) {
+      hybrid_grid->mutable_value(miss_cell);
     }
   }
+
+  RunTasks(num_tasks, thread_pool, [&](const int task_index) {
+    std::vector<uint16*> updated_cells;
+    for (int i = 0; i != num_tasks; ++i) {
+      for (const Eigen::Array3i& miss_cell :
+           misses_by_task[i * num_tasks + task_index]) {
+        uint16* const cell = hybrid_grid->mutable_value(miss_cell);
+        // Skips cells which were hit or already missed by another ray.
+        if (*cell >= mapping::kUpdateMarker) {
+          continue;
+        }
+        *cell = miss_table[*cell];
+        DCHECK_GE(*cell, mapping::kUpdateMarker);
+        updated_cells.push_back(cell);
+      }
+    }
+    for (uint16* const cell : updated_cells) {
+      *cell -= mapping::kUpdateMarker;
+    }
+  });
 }
 
 }  // namespace
@@ -63,8 +233,11 @@ proto::RangeDataInserterOptions CreateRangeDataInserterOptions(
       parameter_dictionary->GetDouble("miss_probability"));
   options.set_num_free_space_voxels(
       parameter_dictionary->GetInt("num_free_space_voxels"));
+  options.set_num_threads(
+      parameter_dictionary->GetNonNegativeInt("num_threads"));
   CHECK_GT(options.hit_probability(), 0.5);
   CHECK_LT(options.miss_probability(), 0.5);
+  CHECK_GE(options.num_threads(), 1);
   return options;
 }
 
@@ -74,7 +247,15 @@ RangeDataInserter::RangeDataInserter(
       hit_table_(mapping::ComputeLookupTableToApplyOdds(
           mapping::Odds(options_.hit_probability()))),
       miss_table_(mapping::ComputeLookupTableToApplyOdds(
-          mapping::Odds(options_.miss_probability()))) {}
+          mapping::Odds(options_.miss_probability()))) {
+  if (options_.num_threads() > 1) {
+    // The calling thread takes part in inserting.
+    thread_pool_ =
+        common::make_unique<common::ThreadPool>(options_.num_threads() - 1);
+  }
+}
+
+RangeDataInserter::~RangeDataInserter() {}
 
 void RangeDataInserter::Insert(const sensor::RangeData& range_data,
                                HybridGrid* hybrid_grid) const {
@@ -87,8 +268,15 @@ void RangeDataInserter::Insert(const sensor::RangeData& range_data,
 
   // By not starting a new update after hits are inserted, we give hits priority
   // (i.e. no hits will be ignored because of a miss in the same cell).
-  InsertMissesIntoGrid(miss_table_, range_data.origin, range_data.returns,
-                       hybrid_grid, options_.num_free_space_voxels());
+  if (thread_pool_ != nullptr) {
+    InsertMissesIntoGridInParallel(
+        miss_table_, range_data.origin, range_data.returns, hybrid_grid,
+        options_.num_free_space_voxels(), options_.num_threads(),
+        thread_pool_.get());
+  } else {
+    InsertMissesIntoGrid(miss_table_, range_data.origin, range_data.returns,
+                         hybrid_grid, options_.num_free_space_voxels());
+  }
   hybrid_grid->FinishUpdate();
 }
 
@@ -17,6 +17,10 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_RANGE_DATA_INSERTER_H_
 #define CARTOGRAPHER_MAPPING_3D_RANGE_DATA_INSERTER_H_
 
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 #include "cartographer/mapping_3d/proto/range_data_inserter_options.pb.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -31,6 +35,7 @@ proto::RangeDataInserterOptions CreateRangeDataInserterOptions(
 class RangeDataInserter {
  public:
   explicit RangeDataInserter(const proto::RangeDataInserterOptions& options);
+  ~RangeDataInserter();
 
   RangeDataInserter(const RangeDataInserter&) = delete;
   RangeDataInserter& operator=(const RangeDataInserter&) = delete;
@@ -43,6 +48,8 @@ class RangeDataInserter {
   const proto::RangeDataInserterOptions options_;
   const std::vector<uint16> hit_table_;
   const std::vector<uint16> miss_table_;
+  // Only used if more than one thread inserts misses.
+  std::unique_ptr<common::ThreadPoolInterface> thread_pool_;
 };
 
 }  // namespace mapping_3d
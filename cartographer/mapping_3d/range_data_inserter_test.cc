@@ -17,6 +17,8 @@
 #include "cartographer/mapping_3d/range_data_inserter.h"
 
 #include <memory>
+#include <random>
+#include <string>
 #include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
@@ -34,6 +36,7 @@ class RangeDataInserterTest : public ::testing::Test {
         "hit_probability = 0.7, "
         "miss_probability = 0.4, "
         "num_free_space_voxels = 1000, "
+        "num_threads = 1, "
         "}");
     options_ = CreateRangeDataInserterOptions(parameter_dictionary.get());
     range_data_inserter_.reset(new RangeDataInserter(options_));
@@ -102,6 +105,70 @@ TEST_F(RangeDataInserterTest, ProbabilityProgression) {
   EXPECT_NEAR(mapping::kMinProbability, GetProbability(0.f, 0.f, -3.f), 1e-3);
 }
 
+TEST_F(RangeDataInserterTest, MissesEveryCellAlongTheRay) {
+  HybridGrid hybrid_grid(1.f);
+  RangeDataInserter range_data_inserter(options());
+  const Eigen::Vector3f origin(0.f, 0.f, 0.f);
+  const Eigen::Vector3f hit(5.f, 3.f, -2.f);
+  range_data_inserter.Insert(sensor::RangeData{origin, {hit}, {}},
+                             &hybrid_grid);
+  // Consecutive cells of the traversal share a face, so all cells from the
+  // origin to the hit are known and none are skipped.
+  int num_known_cells = 0;
+  for (HybridGrid::Iterator it(hybrid_grid); !it.Done(); it.Next()) {
+    ++num_known_cells;
+  }
+  EXPECT_EQ(5 + 3 + 2 + 1, num_known_cells);
+  EXPECT_NEAR(options().miss_probability(),
+              hybrid_grid.GetProbability(Eigen::Array3i(0, 0, 0)), 1e-4);
+  EXPECT_NEAR(options().hit_probability(),
+              hybrid_grid.GetProbability(Eigen::Array3i(5, 3, -2)), 1e-4);
+}
+
+proto::RangeDataInserterOptions CreateOptionsWithNumThreads(
+    const int num_threads) {
+  auto parameter_dictionary = common::MakeDictionary(
+      "return { "
+      "hit_probability = 0.7, "
+      "miss_probability = 0.4, "
+      "num_free_space_voxels = 50, "
+      "num_threads = " +
+      std::to_string(num_threads) + ", }");
+  return CreateRangeDataInserterOptions(parameter_dictionary.get());
+}
+
+TEST(RangeDataInserterParallelTest, SameResultForAnyNumberOfThreads) {
+  const RangeDataInserter sequential_inserter(CreateOptionsWithNumThreads(1));
+  const RangeDataInserter parallel_inserter(CreateOptionsWithNumThreads(4));
+  HybridGrid sequential_grid(0.1f);
+  HybridGrid parallel_grid(0.1f);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> distribution(-10.f, 10.f);
+  for (int i = 0; i != 20; ++i) {
+    const Eigen::Vector3f origin(0.1f * i, 0.f, 0.f);
+    sensor::PointCloud returns;
+    for (int j = 0; j != 500; ++j) {
+      returns.emplace_back(distribution(rng), distribution(rng),
+                           distribution(rng) / 5.f);
+    }
+    sequential_inserter.Insert(sensor::RangeData{origin, returns, {}},
+                               &sequential_grid);
+    parallel_inserter.Insert(sensor::RangeData{origin, returns, {}},
+                             &parallel_grid);
+  }
+  auto parallel_it = HybridGrid::Iterator(parallel_grid);
+  int num_cells = 0;
+  for (auto it = HybridGrid::Iterator(sequential_grid); !it.Done();
+       it.Next(), parallel_it.Next()) {
+    ASSERT_FALSE(parallel_it.Done());
+    EXPECT_TRUE((it.GetCellIndex() == parallel_it.GetCellIndex()).all());
+    EXPECT_EQ(it.GetValue(), parallel_it.GetValue());
+    ++num_cells;
+  }
+  EXPECT_TRUE(parallel_it.Done());
+  EXPECT_LT(20 * 500, num_cells);
+}
+
 }  // namespace
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -18,6 +18,7 @@
 #define CARTOGRAPHER_MAPPING_3D_ROTATION_PARAMETERIZATION_H_
 
 #include "cartographer/common/math.h"
+#include "ceres/ceres.h"
 #include "ceres/jet.h"
 #include "ceres/rotation.h"
 
@@ -61,6 +62,56 @@ struct ConstantYawQuaternionPlus {
   }
 };
 
+// Same as ceres::AutoDiffLocalParameterization<YawOnlyQuaternionPlus, 4, 1>,
+// but the Jacobian is computed analytically.
+class YawOnlyQuaternionParameterization : public ceres::LocalParameterization {
+ public:
+  bool Plus(const double* x, const double* delta,
+            double* x_plus_delta) const override {
+    return YawOnlyQuaternionPlus()(x, delta, x_plus_delta);
+  }
+
+  // The derivative of the product of (1, 0, 0, delta) and 'x'.
+  bool ComputeJacobian(const double* x, double* jacobian) const override {
+    jacobian[0] = -x[3];
+    jacobian[1] = -x[2];
+    jacobian[2] = x[1];
+    jacobian[3] = x[0];
+    return true;
+  }
+
+  int GlobalSize() const override { return 4; }
+  int LocalSize() const override { return 1; }
+};
+
+// Same as ceres::AutoDiffLocalParameterization<ConstantYawQuaternionPlus, 4,
+// 2>, but the Jacobian is computed analytically.
+class ConstantYawQuaternionParameterization
+    : public ceres::LocalParameterization {
+ public:
+  bool Plus(const double* x, const double* delta,
+            double* x_plus_delta) const override {
+    return ConstantYawQuaternionPlus()(x, delta, x_plus_delta);
+  }
+
+  // The derivative of the product of 'x' and (1, delta[0], delta[1], 0). The
+  // Jacobian is row-major.
+  bool ComputeJacobian(const double* x, double* jacobian) const override {
+    jacobian[0] = -x[1];
+    jacobian[1] = -x[2];
+    jacobian[2] = x[0];
+    jacobian[3] = -x[3];
+    jacobian[4] = x[3];
+    jacobian[5] = x[0];
+    jacobian[6] = -x[2];
+    jacobian[7] = x[1];
+    return true;
+  }
+
+  int GlobalSize() const override { return 4; }
+  int LocalSize() const override { return 2; }
+};
+
 }  // namespace mapping_3d
 }  // namespace cartographer
 
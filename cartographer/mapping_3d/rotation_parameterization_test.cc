@@ -0,0 +1,67 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/rotation_parameterization.h"
+
+#include <array>
+#include <random>
+
+#include "Eigen/Geometry"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+// Compares the Jacobian of 'local_parameterization' with the one of the
+// 'auto_diff_local_parameterization' at a random unit quaternion.
+void ExpectSameJacobian(
+    const ceres::LocalParameterization& auto_diff_local_parameterization,
+    const ceres::LocalParameterization& local_parameterization,
+    std::mt19937* prng) {
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  const Eigen::Quaterniond quaternion =
+      Eigen::Quaterniond(distribution(*prng), distribution(*prng),
+                         distribution(*prng), distribution(*prng))
+          .normalized();
+  const double x[] = {quaternion.w(), quaternion.x(), quaternion.y(),
+                      quaternion.z()};
+  std::array<double, 8> expected_jacobian;
+  std::array<double, 8> jacobian;
+  ASSERT_TRUE(auto_diff_local_parameterization.ComputeJacobian(
+      x, expected_jacobian.data()));
+  ASSERT_TRUE(local_parameterization.ComputeJacobian(x, jacobian.data()));
+  for (int k = 0; k != 4 * local_parameterization.LocalSize(); ++k) {
+    EXPECT_NEAR(expected_jacobian[k], jacobian[k], 1e-12);
+  }
+}
+
+TEST(RotationParameterizationTest, AnalyticalMatchesAutoDiff) {
+  std::mt19937 prng(42);
+  for (int i = 0; i != 10; ++i) {
+    ExpectSameJacobian(
+        ceres::AutoDiffLocalParameterization<YawOnlyQuaternionPlus, 4, 1>(),
+        YawOnlyQuaternionParameterization(), &prng);
+    ExpectSameJacobian(
+        ceres::AutoDiffLocalParameterization<ConstantYawQuaternionPlus, 4,
+                                             2>(),
+        ConstantYawQuaternionParameterization(), &prng);
+  }
+}
+
+}  // namespace
+}  // namespace mapping_3d
+}  // namespace cartographer
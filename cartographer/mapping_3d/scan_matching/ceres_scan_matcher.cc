@@ -24,7 +24,7 @@
 #include "cartographer/common/make_unique.h"
 #include "cartographer/mapping_3d/ceres_pose.h"
 #include "cartographer/mapping_3d/rotation_parameterization.h"
-#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_functor.h"
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
 #include "cartographer/mapping_3d/scan_matching/rotation_delta_cost_functor.h"
 #include "cartographer/mapping_3d/scan_matching/translation_delta_cost_functor.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -53,6 +53,8 @@ proto::CeresScanMatcherOptions CreateCeresScanMatcherOptions(
       parameter_dictionary->GetDouble("rotation_weight"));
   options.set_only_optimize_yaw(
       parameter_dictionary->GetBool("only_optimize_yaw"));
+  options.set_use_single_precision_evaluation(
+      parameter_dictionary->GetBool("use_single_precision_evaluation"));
   *options.mutable_ceres_solver_options() =
       common::CreateCeresSolverOptionsProto(
           parameter_dictionary->GetDictionary("ceres_solver_options").get());
@@ -67,13 +69,44 @@ CeresScanMatcher::CeresScanMatcher(
   ceres_solver_options_.linear_solver_type = ceres::DENSE_QR;
 }
 
+void CeresScanMatcher::SetMaxNumIterations(const int max_num_iterations) {
+  ceres_solver_options_.max_num_iterations = max_num_iterations;
+}
+
+void CeresScanMatcher::Match(const transform::Rigid3d& previous_pose,
+                             const transform::Rigid3d& initial_pose_estimate,
+                             const std::vector<PointCloudAndHybridGridPointers>&
+                                 point_clouds_and_hybrid_grids,
+                             transform::Rigid3d* const pose_estimate,
+                             ceres::Solver::Summary* const summary) {
+  Context context;
+  Match(previous_pose, initial_pose_estimate, point_clouds_and_hybrid_grids,
+        &context, pose_estimate, summary);
+}
+
 void CeresScanMatcher::Match(const transform::Rigid3d& previous_pose,
                              const transform::Rigid3d& initial_pose_estimate,
                              const std::vector<PointCloudAndHybridGridPointers>&
                                  point_clouds_and_hybrid_grids,
+                             Context* const context,
                              transform::Rigid3d* const pose_estimate,
                              ceres::Solver::Summary* const summary) {
-  ceres::Problem problem;
+  CHECK_GT(options_.translation_weight(), 0.);
+  const auto translation_delta_cost_function = common::make_unique<
+      ceres::AutoDiffCostFunction<TranslationDeltaCostFunctor, 3, 3>>(
+      new TranslationDeltaCostFunctor(options_.translation_weight(),
+                                      previous_pose));
+  CHECK_GT(options_.rotation_weight(), 0.);
+  const auto rotation_delta_cost_function = common::make_unique<
+      ceres::AutoDiffCostFunction<RotationDeltaCostFunctor, 3, 4>>(
+      new RotationDeltaCostFunctor(options_.rotation_weight(),
+                                   initial_pose_estimate.rotation()));
+
+  // The problem does not own the cost functions, so that the occupied space
+  // cost functions stay in the 'context' for the next call.
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
   CeresPose ceres_pose(
       initial_pose_estimate, nullptr /* translation_parameterization */,
       options_.only_optimize_yaw()
@@ -86,33 +119,32 @@ void CeresScanMatcher::Match(const transform::Rigid3d& previous_pose,
 
   CHECK_EQ(options_.occupied_space_weight_size(),
            point_clouds_and_hybrid_grids.size());
+  auto& occupied_space_cost_functions = context->occupied_space_cost_functions_;
   for (size_t i = 0; i != point_clouds_and_hybrid_grids.size(); ++i) {
     CHECK_GT(options_.occupied_space_weight(i), 0.);
     const sensor::PointCloud& point_cloud =
         *point_clouds_and_hybrid_grids[i].first;
     const HybridGrid& hybrid_grid = *point_clouds_and_hybrid_grids[i].second;
-    problem.AddResidualBlock(
-        new ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor,
-                                        ceres::DYNAMIC, 3, 4>(
-            new OccupiedSpaceCostFunctor(
-                options_.occupied_space_weight(i) /
-                    std::sqrt(static_cast<double>(point_cloud.size())),
-                point_cloud, hybrid_grid),
-            point_cloud.size()),
-        nullptr, ceres_pose.translation(), ceres_pose.rotation());
+    const double scaling_factor =
+        options_.occupied_space_weight(i) /
+        std::sqrt(static_cast<double>(point_cloud.size()));
+    if (i == occupied_space_cost_functions.size()) {
+      occupied_space_cost_functions.push_back(
+          common::make_unique<OccupiedSpaceCostFunction>(
+              scaling_factor, point_cloud, hybrid_grid,
+              options_.use_single_precision_evaluation()));
+    } else {
+      occupied_space_cost_functions[i]->Reset(
+          scaling_factor, point_cloud, hybrid_grid,
+          options_.use_single_precision_evaluation());
+    }
+    problem.AddResidualBlock(occupied_space_cost_functions[i].get(), nullptr,
+                             ceres_pose.translation(), ceres_pose.rotation());
   }
-  CHECK_GT(options_.translation_weight(), 0.);
-  problem.AddResidualBlock(
-      new ceres::AutoDiffCostFunction<TranslationDeltaCostFunctor, 3, 3>(
-          new TranslationDeltaCostFunctor(options_.translation_weight(),
-                                          previous_pose)),
-      nullptr, ceres_pose.translation());
-  CHECK_GT(options_.rotation_weight(), 0.);
-  problem.AddResidualBlock(
-      new ceres::AutoDiffCostFunction<RotationDeltaCostFunctor, 3, 4>(
-          new RotationDeltaCostFunctor(options_.rotation_weight(),
-                                       initial_pose_estimate.rotation())),
-      nullptr, ceres_pose.rotation());
+  problem.AddResidualBlock(translation_delta_cost_function.get(), nullptr,
+                           ceres_pose.translation());
+  problem.AddResidualBlock(rotation_delta_cost_function.get(), nullptr,
+                           ceres_pose.rotation());
 
   ceres::Solve(ceres_solver_options_, &problem, summary);
 
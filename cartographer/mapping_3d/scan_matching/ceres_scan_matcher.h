@@ -17,12 +17,14 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_CERES_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_CERES_SCAN_MATCHER_H_
 
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
 #include "cartographer/mapping_3d/scan_matching/proto/ceres_scan_matcher_options.pb.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -40,11 +42,24 @@ using PointCloudAndHybridGridPointers =
 // This scan matcher uses Ceres to align scans with an existing map.
 class CeresScanMatcher {
  public:
+  // Keeps the occupied space cost functions between calls to Match(), so that
+  // matching one scan after another does not set up the interpolation of the
+  // grids again. A context must not be used by concurrent calls to Match().
+  class Context {
+   private:
+    friend class CeresScanMatcher;
+    std::vector<std::unique_ptr<OccupiedSpaceCostFunction>>
+        occupied_space_cost_functions_;
+  };
+
   explicit CeresScanMatcher(const proto::CeresScanMatcherOptions& options);
 
   CeresScanMatcher(const CeresScanMatcher&) = delete;
   CeresScanMatcher& operator=(const CeresScanMatcher&) = delete;
 
+  // Overrides the maximum number of solver iterations of the options.
+  void SetMaxNumIterations(int max_num_iterations);
+
   // Aligns 'point_clouds' within the 'hybrid_grids' given an
   // 'initial_pose_estimate' and returns a 'pose_estimate' and the solver
   // 'summary'.
@@ -55,6 +70,14 @@ class CeresScanMatcher {
              transform::Rigid3d* pose_estimate,
              ceres::Solver::Summary* summary);
 
+  // Same as above, but reuses the cost functions kept in 'context'.
+  void Match(const transform::Rigid3d& previous_pose,
+             const transform::Rigid3d& initial_pose_estimate,
+             const std::vector<PointCloudAndHybridGridPointers>&
+                 point_clouds_and_hybrid_grids,
+             Context* context, transform::Rigid3d* pose_estimate,
+             ceres::Solver::Summary* summary);
+
  private:
   const proto::CeresScanMatcherOptions options_;
   ceres::Solver::Options ceres_solver_options_;
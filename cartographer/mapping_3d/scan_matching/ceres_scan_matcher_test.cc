@@ -53,6 +53,7 @@ class CeresScanMatcherTest : public ::testing::Test {
           translation_weight = 0.01,
           rotation_weight = 0.1,
           only_optimize_yaw = false,
+          use_single_precision_evaluation = false,
           ceres_solver_options = {
             use_nonmonotonic_steps = true,
             max_num_iterations = 10,
@@ -115,6 +116,44 @@ TEST_F(CeresScanMatcherTest, FullPoseCorrection) {
                          Eigen::AngleAxisd(0.05, Eigen::Vector3d(1., 0., 0.))));
 }
 
+TEST_F(CeresScanMatcherTest, ReusesContext) {
+  CeresScanMatcher::Context context;
+  const transform::Rigid3d initial_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(-0.9, -0.2, 0.2));
+  transform::Rigid3d expected_pose;
+  ceres::Solver::Summary summary;
+  ceres_scan_matcher_->Match(initial_pose, initial_pose,
+                             {{&point_cloud_, &hybrid_grid_}}, &expected_pose,
+                             &summary);
+  for (int i = 0; i != 3; ++i) {
+    // The grid may change between calls.
+    hybrid_grid_.SetProbability(Eigen::Array3i(10, 10, i), 0.9f);
+    transform::Rigid3d pose;
+    ceres_scan_matcher_->Match(initial_pose, initial_pose,
+                               {{&point_cloud_, &hybrid_grid_}}, &context,
+                               &pose, &summary);
+    EXPECT_THAT(pose, transform::IsNearly(expected_pose, 1e-9));
+    EXPECT_THAT(pose, transform::IsNearly(expected_pose_, 3e-2));
+  }
+}
+
+TEST_F(CeresScanMatcherTest, SinglePrecisionMatchesDoublePrecision) {
+  const transform::Rigid3d initial_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(-0.9, -0.2, 0.2));
+  transform::Rigid3d expected_pose;
+  ceres::Solver::Summary summary;
+  ceres_scan_matcher_->Match(initial_pose, initial_pose,
+                             {{&point_cloud_, &hybrid_grid_}}, &expected_pose,
+                             &summary);
+  options_.set_use_single_precision_evaluation(true);
+  ceres_scan_matcher_.reset(new CeresScanMatcher(options_));
+  transform::Rigid3d pose;
+  ceres_scan_matcher_->Match(initial_pose, initial_pose,
+                             {{&point_cloud_, &hybrid_grid_}}, &pose, &summary);
+  EXPECT_THAT(pose, transform::IsNearly(expected_pose, 1e-4));
+  EXPECT_THAT(pose, transform::IsNearly(expected_pose_, 3e-2));
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
@@ -20,11 +20,13 @@
 #include <cmath>
 #include <functional>
 #include <limits>
+#include <memory>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
-#include "cartographer/mapping_3d/scan_matching/low_resolution_matcher.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/mapping_3d/scan_matching/precomputation_grid.h"
 #include "cartographer/mapping_3d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
 #include "cartographer/transform/transform.h"
@@ -57,9 +59,13 @@ CreateFastCorrelativeScanMatcherOptions(
 
 class PrecomputationGridStack {
  public:
+  // The 'GridType' is either a HybridGrid or a FrozenHybridGrid.
+  template <typename GridType>
   PrecomputationGridStack(
-      const HybridGrid& hybrid_grid,
-      const proto::FastCorrelativeScanMatcherOptions& options) {
+      const GridType& hybrid_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPoolInterface* const thread_pool, const int num_tasks) {
+    CARTOGRAPHER_TRACE_SPAN("PrecomputationGridStack");
     CHECK_GE(options.branch_and_bound_depth(), 1);
     CHECK_GE(options.full_resolution_depth(), 1);
     precomputation_grids_.reserve(options.branch_and_bound_depth());
@@ -74,26 +80,99 @@ class PrecomputationGridStack {
           (next_width - last_width +
            (full_voxels_per_high_resolution_voxel - 1)) /
           full_voxels_per_high_resolution_voxel;
+      // Each grid is computed from the previous one, so only the work within
+      // one grid can be distributed.
       precomputation_grids_.push_back(
-          PrecomputeGrid(precomputation_grids_.back(), half_resolution, shift));
+          PrecomputeGrid(precomputation_grids_.back(), half_resolution, shift,
+                         thread_pool, num_tasks));
       last_width = next_width;
     }
   }
 
+  // Rebuilds the grids serialized by 'Serialize()' from the blob at
+  // 'blob_index', which avoids recomputing them from the hybrid grid of the
+  // given 'resolution'.
+  PrecomputationGridStack(
+      const float resolution,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      const io::MappedBlobFile& mapped_blob_file, const int blob_index) {
+    io::BlobReader reader(mapped_blob_file.blob(blob_index));
+    const int num_grids = reader.Read<int32>();
+    CHECK_EQ(num_grids, options.branch_and_bound_depth());
+    precomputation_grids_.reserve(num_grids);
+    for (int depth = 0; depth != num_grids; ++depth) {
+      precomputation_grids_.emplace_back(resolution);
+      PrecomputationGrid& precomputation_grid = precomputation_grids_.back();
+      const int num_cells = reader.Read<int32>();
+      for (int i = 0; i != num_cells; ++i) {
+        const int32 x = reader.Read<int32>();
+        const int32 y = reader.Read<int32>();
+        const int32 z = reader.Read<int32>();
+        *precomputation_grid.mutable_value(Eigen::Array3i(x, y, z)) =
+            reader.Read<uint8>();
+      }
+    }
+    CHECK(reader.Done());
+  }
+
   const PrecomputationGrid& Get(int depth) const {
     return precomputation_grids_.at(depth);
   }
 
   int max_depth() const { return precomputation_grids_.size() - 1; }
 
+  int64 GetMemoryUsageInBytes() const {
+    int64 memory_usage_in_bytes = 0;
+    for (const PrecomputationGrid& precomputation_grid :
+         precomputation_grids_) {
+      memory_usage_in_bytes += precomputation_grid.GetMemoryUsageInBytes();
+    }
+    return memory_usage_in_bytes;
+  }
+
+  // Serializes the number of grids followed by the number of non-default
+  // cells of each grid and these cells as index and value.
+  string Serialize() const {
+    string serialized;
+    io::AppendToBlob(static_cast<int32>(precomputation_grids_.size()),
+                     &serialized);
+    for (const PrecomputationGrid& precomputation_grid :
+         precomputation_grids_) {
+      int32 num_cells = 0;
+      for (auto it = PrecomputationGrid::Iterator(precomputation_grid);
+           !it.Done(); it.Next()) {
+        ++num_cells;
+      }
+      io::AppendToBlob(num_cells, &serialized);
+      for (auto it = PrecomputationGrid::Iterator(precomputation_grid);
+           !it.Done(); it.Next()) {
+        const Eigen::Array3i cell_index = it.GetCellIndex();
+        io::AppendToBlob(int32{cell_index.x()}, &serialized);
+        io::AppendToBlob(int32{cell_index.y()}, &serialized);
+        io::AppendToBlob(int32{cell_index.z()}, &serialized);
+        io::AppendToBlob(it.GetValue(), &serialized);
+      }
+    }
+    return serialized;
+  }
+
  private:
   std::vector<PrecomputationGrid> precomputation_grids_;
 };
 
+// Cell indices of a discretized scan, stored as 16-bit offsets from the cell
+// index 'origin' to halve the memory read when scoring candidates.
+struct PackedCellIndices {
+  Eigen::Array3i origin;
+  std::vector<Eigen::Array<int16, 3, 1>> relative_cell_indices;
+};
+
 struct DiscreteScan {
   transform::Rigid3f pose;
-  // Contains a vector of discretized scans for each 'depth'.
-  std::vector<std::vector<Eigen::Array3i>> cell_indices_per_depth;
+  // Contains the discretized scan for each reduction exponent, i.e. the full
+  // resolution scan shared by all full resolution depths, followed by one for
+  // each low resolution depth.
+  std::vector<PackedCellIndices> cell_indices_per_reduction_exponent;
   float rotational_score;
 };
 
@@ -125,6 +204,46 @@ struct Candidate {
 
 namespace {
 
+// State of a parallel branch-and-bound search. It is shared with the tasks, so
+// that tasks starting only after the search has finished can safely see that
+// nothing is left to do.
+struct ParallelSearchState {
+  ParallelSearchState(const int num_candidates,
+                      const Candidate& initial_best_candidate)
+      : num_candidates(num_candidates),
+        next_candidate_index(0),
+        best_score(initial_best_candidate.score),
+        best_candidate(initial_best_candidate) {}
+
+  const int num_candidates;
+  // Index of the next candidate whose subtree has to be searched.
+  std::atomic<int> next_candidate_index;
+  // Score of 'best_candidate', read by the tasks without taking 'mutex'.
+  std::atomic<float> best_score;
+
+  common::Mutex mutex;
+  Candidate best_candidate GUARDED_BY(mutex);
+  int num_candidates_searched GUARDED_BY(mutex) = 0;
+};
+
+// Packs 'cell_indices' relative to 'origin', which has to be close enough to
+// all of them, e.g. the cell of the scan origin.
+PackedCellIndices PackCellIndices(
+    const Eigen::Array3i& origin,
+    const std::vector<Eigen::Array3i>& cell_indices) {
+  PackedCellIndices packed_cell_indices{origin, {}};
+  packed_cell_indices.relative_cell_indices.reserve(cell_indices.size());
+  for (const Eigen::Array3i& cell_index : cell_indices) {
+    const Eigen::Array3i relative_cell_index = cell_index - origin;
+    CHECK_LE(relative_cell_index.abs().maxCoeff(),
+             std::numeric_limits<int16>::max())
+        << "Point too far from the scan origin to be packed.";
+    packed_cell_indices.relative_cell_indices.push_back(
+        relative_cell_index.cast<int16>());
+  }
+  return packed_cell_indices;
+}
+
 std::vector<std::pair<Eigen::VectorXf, float>> HistogramsAtAnglesFromNodes(
     const std::vector<mapping::TrajectoryNode>& nodes) {
   std::vector<std::pair<Eigen::VectorXf, float>> histograms_at_angles;
@@ -140,45 +259,142 @@ std::vector<std::pair<Eigen::VectorXf, float>> HistogramsAtAnglesFromNodes(
 
 }  // namespace
 
+string SerializePrecomputationGrids(
+    const HybridGrid& hybrid_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options) {
+  return PrecomputationGridStack(hybrid_grid, options,
+                                 nullptr /* thread_pool */, 1 /* num_tasks */)
+      .Serialize();
+}
+
 FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
     const HybridGrid& hybrid_grid,
     const HybridGrid* const low_resolution_hybrid_grid,
     const std::vector<mapping::TrajectoryNode>& nodes,
     const proto::FastCorrelativeScanMatcherOptions& options)
+    : FastCorrelativeScanMatcher(hybrid_grid, low_resolution_hybrid_grid,
+                                 nodes, options, nullptr /* thread_pool */,
+                                 1 /* num_tasks */) {}
+
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const HybridGrid& hybrid_grid,
+    const HybridGrid* const low_resolution_hybrid_grid,
+    const std::vector<mapping::TrajectoryNode>& nodes,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks)
     : options_(options),
       resolution_(hybrid_grid.resolution()),
       width_in_voxels_(hybrid_grid.grid_size()),
-      precomputation_grid_stack_(
-          common::make_unique<PrecomputationGridStack>(hybrid_grid, options)),
+      precomputation_grid_stack_(common::make_unique<PrecomputationGridStack>(
+          hybrid_grid, options, thread_pool, num_tasks)),
       low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
+      frozen_low_resolution_hybrid_grid_(nullptr),
+      rotational_scan_matcher_(HistogramsAtAnglesFromNodes(nodes)) {}
+
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const HybridGrid& hybrid_grid,
+    const HybridGrid* const low_resolution_hybrid_grid,
+    const std::vector<mapping::TrajectoryNode>& nodes,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    const std::shared_ptr<const io::MappedBlobFile>& mapped_blob_file,
+    const int blob_index)
+    : options_(options),
+      resolution_(hybrid_grid.resolution()),
+      width_in_voxels_(hybrid_grid.grid_size()),
+      precomputation_grid_stack_(common::make_unique<PrecomputationGridStack>(
+          hybrid_grid.resolution(), options, *mapped_blob_file, blob_index)),
+      low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
+      frozen_low_resolution_hybrid_grid_(nullptr),
+      rotational_scan_matcher_(HistogramsAtAnglesFromNodes(nodes)) {}
+
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const FrozenHybridGrid& hybrid_grid,
+    const FrozenHybridGrid* const low_resolution_hybrid_grid,
+    const std::vector<mapping::TrajectoryNode>& nodes,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks)
+    : options_(options),
+      resolution_(hybrid_grid.resolution()),
+      width_in_voxels_(hybrid_grid.grid_size()),
+      precomputation_grid_stack_(common::make_unique<PrecomputationGridStack>(
+          hybrid_grid, options, thread_pool, num_tasks)),
+      low_resolution_hybrid_grid_(nullptr),
+      frozen_low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
+      rotational_scan_matcher_(HistogramsAtAnglesFromNodes(nodes)) {}
+
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const FrozenHybridGrid& hybrid_grid,
+    const FrozenHybridGrid* const low_resolution_hybrid_grid,
+    const std::vector<mapping::TrajectoryNode>& nodes,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    const std::shared_ptr<const io::MappedBlobFile>& mapped_blob_file,
+    const int blob_index)
+    : options_(options),
+      resolution_(hybrid_grid.resolution()),
+      width_in_voxels_(hybrid_grid.grid_size()),
+      precomputation_grid_stack_(common::make_unique<PrecomputationGridStack>(
+          hybrid_grid.resolution(), options, *mapped_blob_file, blob_index)),
+      low_resolution_hybrid_grid_(nullptr),
+      frozen_low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
       rotational_scan_matcher_(HistogramsAtAnglesFromNodes(nodes)) {}
 
 FastCorrelativeScanMatcher::~FastCorrelativeScanMatcher() {}
 
+int64 FastCorrelativeScanMatcher::GetMemoryUsageInBytes() const {
+  return precomputation_grid_stack_->GetMemoryUsageInBytes();
+}
+
+LowResolutionMatcher FastCorrelativeScanMatcher::CreateLowResolutionMatcher(
+    const sensor::PointCloud* const points) const {
+  if (frozen_low_resolution_hybrid_grid_ != nullptr) {
+    return LowResolutionMatcher(frozen_low_resolution_hybrid_grid_, points);
+  }
+  return LowResolutionMatcher(low_resolution_hybrid_grid_, points);
+}
+
+
 bool FastCorrelativeScanMatcher::Match(
     const transform::Rigid3d& initial_pose_estimate,
     const mapping::TrajectoryNode::Data& constant_data, const float min_score,
     float* const score, transform::Rigid3d* const pose_estimate,
-    float* const rotational_score, float* const low_resolution_score) const {
-  const auto low_resolution_matcher = scan_matching::CreateLowResolutionMatcher(
-      low_resolution_hybrid_grid_, &constant_data.low_resolution_point_cloud);
+    float* const rotational_score, float* const low_resolution_score,
+    Stage* const rejecting_stage) const {
+  const LowResolutionMatcher low_resolution_matcher =
+      CreateLowResolutionMatcher(&constant_data.low_resolution_point_cloud);
   const SearchParameters search_parameters{
       common::RoundToInt(options_.linear_xy_search_window() / resolution_),
       common::RoundToInt(options_.linear_z_search_window() / resolution_),
-      options_.angular_search_window(), &low_resolution_matcher};
+      options_.angular_search_window(), &low_resolution_matcher,
+      nullptr /* deadline */};
   return MatchWithSearchParameters(
       search_parameters, initial_pose_estimate,
       constant_data.high_resolution_point_cloud,
       constant_data.rotational_scan_matcher_histogram,
-      constant_data.gravity_alignment, min_score, score, pose_estimate,
-      rotational_score, low_resolution_score);
+      constant_data.gravity_alignment, min_score, nullptr /* thread_pool */,
+      1 /* num_tasks */, score, pose_estimate, rotational_score,
+      low_resolution_score, rejecting_stage);
 }
 
 bool FastCorrelativeScanMatcher::MatchFullSubmap(
     const Eigen::Quaterniond& gravity_alignment,
     const mapping::TrajectoryNode::Data& constant_data, const float min_score,
     float* const score, transform::Rigid3d* const pose_estimate,
-    float* const rotational_score, float* const low_resolution_score) const {
+    float* const rotational_score, float* const low_resolution_score,
+    Stage* const rejecting_stage) const {
+  return MatchFullSubmap(gravity_alignment, constant_data, min_score,
+                         nullptr /* thread_pool */, 1 /* num_tasks */,
+                         nullptr /* deadline */, score, pose_estimate,
+                         rotational_score, low_resolution_score,
+                         rejecting_stage);
+}
+
+bool FastCorrelativeScanMatcher::MatchFullSubmap(
+    const Eigen::Quaterniond& gravity_alignment,
+    const mapping::TrajectoryNode::Data& constant_data, const float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
+    common::Deadline* const deadline, float* const score,
+    transform::Rigid3d* const pose_estimate, float* const rotational_score,
+    float* const low_resolution_score, Stage* const rejecting_stage) const {
   const transform::Rigid3d initial_pose_estimate(Eigen::Vector3d::Zero(),
                                                  gravity_alignment);
   float max_point_distance = 0.f;
@@ -189,16 +405,17 @@ bool FastCorrelativeScanMatcher::MatchFullSubmap(
   const int linear_window_size =
       (width_in_voxels_ + 1) / 2 +
       common::RoundToInt(max_point_distance / resolution_ + 0.5f);
-  const auto low_resolution_matcher = scan_matching::CreateLowResolutionMatcher(
-      low_resolution_hybrid_grid_, &constant_data.low_resolution_point_cloud);
-  const SearchParameters search_parameters{
-      linear_window_size, linear_window_size, M_PI, &low_resolution_matcher};
+  const LowResolutionMatcher low_resolution_matcher =
+      CreateLowResolutionMatcher(&constant_data.low_resolution_point_cloud);
+  const SearchParameters search_parameters{linear_window_size,
+                                           linear_window_size, M_PI,
+                                           &low_resolution_matcher, deadline};
   return MatchWithSearchParameters(
       search_parameters, initial_pose_estimate,
       constant_data.high_resolution_point_cloud,
       constant_data.rotational_scan_matcher_histogram,
-      constant_data.gravity_alignment, min_score, score, pose_estimate,
-      rotational_score, low_resolution_score);
+      constant_data.gravity_alignment, min_score, thread_pool, num_tasks, score,
+      pose_estimate, rotational_score, low_resolution_score, rejecting_stage);
 }
 
 bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
@@ -207,21 +424,49 @@ bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
     const sensor::PointCloud& point_cloud,
     const Eigen::VectorXf& rotational_scan_matcher_histogram,
     const Eigen::Quaterniond& gravity_alignment, const float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
     float* const score, transform::Rigid3d* const pose_estimate,
-    float* const rotational_score, float* const low_resolution_score) const {
+    float* const rotational_score, float* const low_resolution_score,
+    Stage* const rejecting_stage) const {
+  CARTOGRAPHER_TRACE_SPAN("FastCorrelativeScanMatcher::Match");
   CHECK_NOTNULL(score);
   CHECK_NOTNULL(pose_estimate);
+  CHECK_GE(num_tasks, 1);
+
+  const auto reject = [rejecting_stage](const Stage stage) {
+    if (rejecting_stage != nullptr) {
+      *rejecting_stage = stage;
+    }
+    return false;
+  };
 
   const std::vector<DiscreteScan> discrete_scans = GenerateDiscreteScans(
       search_parameters, point_cloud, rotational_scan_matcher_histogram,
       gravity_alignment, initial_pose_estimate.cast<float>());
+  if (discrete_scans.empty()) {
+    return reject(Stage::kRotationalScore);
+  }
 
   const std::vector<Candidate> lowest_resolution_candidates =
       ComputeLowestResolutionCandidates(search_parameters, discrete_scans);
+  // Candidates are sorted, and the score of a lowest resolution candidate is
+  // an upper bound for all its descendants.
+  if (lowest_resolution_candidates.front().score <= min_score) {
+    return reject(Stage::kLowestResolutionBound);
+  }
 
-  const Candidate best_candidate = BranchAndBound(
-      search_parameters, discrete_scans, lowest_resolution_candidates,
-      precomputation_grid_stack_->max_depth(), min_score);
+  std::atomic<bool> low_resolution_rejection(false);
+  const Candidate best_candidate =
+      thread_pool != nullptr && num_tasks > 1
+          ? ParallelBranchAndBound(search_parameters, discrete_scans,
+                                   lowest_resolution_candidates, min_score,
+                                   thread_pool, num_tasks,
+                                   &low_resolution_rejection)
+          : BranchAndBound(search_parameters, discrete_scans,
+                           lowest_resolution_candidates,
+                           precomputation_grid_stack_->max_depth(), min_score,
+                           nullptr /* shared_min_score */,
+                           &low_resolution_rejection);
   if (best_candidate.score > min_score) {
     *score = best_candidate.score;
     *pose_estimate =
@@ -231,15 +476,18 @@ bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
     *low_resolution_score = best_candidate.low_resolution_score;
     return true;
   }
-  return false;
+  return reject(low_resolution_rejection.load() ? Stage::kLowResolutionScore
+                                                : Stage::kBranchAndBound);
 }
 
 DiscreteScan FastCorrelativeScanMatcher::DiscretizeScan(
     const FastCorrelativeScanMatcher::SearchParameters& search_parameters,
     const sensor::PointCloud& point_cloud, const transform::Rigid3f& pose,
     const float rotational_score) const {
-  std::vector<std::vector<Eigen::Array3i>> cell_indices_per_depth;
+  std::vector<PackedCellIndices> cell_indices_per_reduction_exponent;
   const PrecomputationGrid& original_grid = precomputation_grid_stack_->Get(0);
+  const Eigen::Array3i origin =
+      original_grid.GetCellIndex(pose.translation());
   std::vector<Eigen::Array3i> full_resolution_cell_indices;
   for (const Eigen::Vector3f& point :
        sensor::TransformPointCloud(point_cloud, pose)) {
@@ -248,9 +496,8 @@ DiscreteScan FastCorrelativeScanMatcher::DiscretizeScan(
   const int full_resolution_depth = std::min(options_.full_resolution_depth(),
                                              options_.branch_and_bound_depth());
   CHECK_GE(full_resolution_depth, 1);
-  for (int i = 0; i != full_resolution_depth; ++i) {
-    cell_indices_per_depth.push_back(full_resolution_cell_indices);
-  }
+  cell_indices_per_reduction_exponent.push_back(
+      PackCellIndices(origin, full_resolution_cell_indices));
   const int low_resolution_depth =
       options_.branch_and_bound_depth() - full_resolution_depth;
   CHECK_GE(low_resolution_depth, 0);
@@ -258,24 +505,30 @@ DiscreteScan FastCorrelativeScanMatcher::DiscretizeScan(
       -search_parameters.linear_xy_window_size,
       -search_parameters.linear_xy_window_size,
       -search_parameters.linear_z_window_size);
+  std::vector<Eigen::Array3i> low_resolution_cell_indices;
   for (int i = 0; i != low_resolution_depth; ++i) {
     const int reduction_exponent = i + 1;
     const Eigen::Array3i low_resolution_search_window_start(
         search_window_start[0] >> reduction_exponent,
         search_window_start[1] >> reduction_exponent,
         search_window_start[2] >> reduction_exponent);
-    cell_indices_per_depth.emplace_back();
-    for (const Eigen::Array3i& cell_index : full_resolution_cell_indices) {
+    const auto to_low_resolution =
+        [&](const Eigen::Array3i& cell_index) -> Eigen::Array3i {
       const Eigen::Array3i cell_at_start = cell_index + search_window_start;
-      const Eigen::Array3i low_resolution_cell_at_start(
-          cell_at_start[0] >> reduction_exponent,
-          cell_at_start[1] >> reduction_exponent,
-          cell_at_start[2] >> reduction_exponent);
-      cell_indices_per_depth.back().push_back(
-          low_resolution_cell_at_start - low_resolution_search_window_start);
+      return Eigen::Array3i(cell_at_start[0] >> reduction_exponent,
+                            cell_at_start[1] >> reduction_exponent,
+                            cell_at_start[2] >> reduction_exponent) -
+             low_resolution_search_window_start;
+    };
+    low_resolution_cell_indices.clear();
+    for (const Eigen::Array3i& cell_index : full_resolution_cell_indices) {
+      low_resolution_cell_indices.push_back(to_low_resolution(cell_index));
     }
+    cell_indices_per_reduction_exponent.push_back(PackCellIndices(
+        to_low_resolution(origin), low_resolution_cell_indices));
   }
-  return DiscreteScan{pose, cell_indices_per_depth, rotational_score};
+  return DiscreteScan{pose, std::move(cell_indices_per_reduction_exponent),
+                      rotational_score};
 }
 
 std::vector<DiscreteScan> FastCorrelativeScanMatcher::GenerateDiscreteScans(
@@ -367,21 +620,29 @@ void FastCorrelativeScanMatcher::ScoreCandidates(
     std::vector<Candidate>* const candidates) const {
   const int reduction_exponent =
       std::max(0, depth - options_.full_resolution_depth() + 1);
+  const PrecomputationGrid& precomputation_grid =
+      precomputation_grid_stack_->Get(depth);
   for (Candidate& candidate : *candidates) {
     int sum = 0;
     const DiscreteScan& discrete_scan = discrete_scans[candidate.scan_index];
-    const Eigen::Array3i offset(candidate.offset[0] >> reduction_exponent,
-                                candidate.offset[1] >> reduction_exponent,
-                                candidate.offset[2] >> reduction_exponent);
-    CHECK_LT(depth, discrete_scan.cell_indices_per_depth.size());
-    for (const Eigen::Array3i& cell_index :
-         discrete_scan.cell_indices_per_depth[depth]) {
-      const Eigen::Array3i proposed_cell_index = cell_index + offset;
-      sum += precomputation_grid_stack_->Get(depth).value(proposed_cell_index);
+    CHECK_LT(reduction_exponent,
+             discrete_scan.cell_indices_per_reduction_exponent.size());
+    const PackedCellIndices& cell_indices =
+        discrete_scan.cell_indices_per_reduction_exponent[reduction_exponent];
+    const Eigen::Array3i offset =
+        cell_indices.origin +
+        Eigen::Array3i(candidate.offset[0] >> reduction_exponent,
+                       candidate.offset[1] >> reduction_exponent,
+                       candidate.offset[2] >> reduction_exponent);
+    for (const Eigen::Array<int16, 3, 1>& relative_cell_index :
+         cell_indices.relative_cell_indices) {
+      const Eigen::Array3i proposed_cell_index =
+          relative_cell_index.cast<int>() + offset;
+      sum += precomputation_grid.value(proposed_cell_index);
     }
     candidate.score = PrecomputationGrid::ToProbability(
         sum /
-        static_cast<float>(discrete_scan.cell_indices_per_depth[depth].size()));
+        static_cast<float>(cell_indices.relative_cell_indices.size()));
   }
   std::sort(candidates->begin(), candidates->end(), std::greater<Candidate>());
 }
@@ -410,16 +671,20 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
     const FastCorrelativeScanMatcher::SearchParameters& search_parameters,
     const std::vector<DiscreteScan>& discrete_scans,
     const std::vector<Candidate>& candidates, const int candidate_depth,
-    float min_score) const {
+    float min_score, const std::atomic<float>* const shared_min_score,
+    std::atomic<bool>* const low_resolution_rejection) const {
   if (candidate_depth == 0) {
     for (const Candidate& candidate : candidates) {
+      if (shared_min_score != nullptr) {
+        min_score = std::max(min_score, shared_min_score->load());
+      }
       if (candidate.score <= min_score) {
         // Return if the candidate is bad because the following candidate will
         // not have better score.
         return Candidate::Unsuccessful();
       }
       const float low_resolution_score =
-          (*search_parameters.low_resolution_matcher)(
+          search_parameters.low_resolution_matcher->Score(
               GetPoseFromCandidate(discrete_scans, candidate));
       if (low_resolution_score >= options_.min_low_resolution_score()) {
         // We found the best candidate that passes the matching function.
@@ -427,6 +692,7 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
         best_candidate.low_resolution_score = low_resolution_score;
         return best_candidate;
       }
+      *low_resolution_rejection = true;
     }
 
     // All candidates have good scores but none passes the matching function.
@@ -436,6 +702,15 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
   Candidate best_high_resolution_candidate = Candidate::Unsuccessful();
   best_high_resolution_candidate.score = min_score;
   for (const Candidate& candidate : candidates) {
+    // Candidates are searched best first, so stopping here keeps the best
+    // match found so far.
+    if (search_parameters.deadline != nullptr &&
+        search_parameters.deadline->CheckExpired()) {
+      break;
+    }
+    if (shared_min_score != nullptr) {
+      min_score = std::max(min_score, shared_min_score->load());
+    }
     if (candidate.score <= min_score) {
       break;
     }
@@ -464,13 +739,69 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
                     &higher_resolution_candidates);
     best_high_resolution_candidate = std::max(
         best_high_resolution_candidate,
-        BranchAndBound(search_parameters, discrete_scans,
-                       higher_resolution_candidates, candidate_depth - 1,
-                       best_high_resolution_candidate.score));
+        BranchAndBound(
+            search_parameters, discrete_scans, higher_resolution_candidates,
+            candidate_depth - 1,
+            std::max(best_high_resolution_candidate.score, min_score),
+            shared_min_score, low_resolution_rejection));
   }
   return best_high_resolution_candidate;
 }
 
+Candidate FastCorrelativeScanMatcher::ParallelBranchAndBound(
+    const FastCorrelativeScanMatcher::SearchParameters& search_parameters,
+    const std::vector<DiscreteScan>& discrete_scans,
+    const std::vector<Candidate>& candidates, const float min_score,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks,
+    std::atomic<bool>* const low_resolution_rejection) const {
+  Candidate initial_best_candidate = Candidate::Unsuccessful();
+  initial_best_candidate.score = min_score;
+  const auto state = std::make_shared<ParallelSearchState>(
+      candidates.size(), initial_best_candidate);
+  // Candidates are claimed one at a time, and everything but 'state' is only
+  // accessed once a candidate has been claimed. The search does not finish
+  // before all claimed candidates have been searched.
+  const std::function<void()> search = [this, state, &search_parameters,
+                                        &discrete_scans, &candidates,
+                                        low_resolution_rejection]() {
+    for (;;) {
+      const int index = state->next_candidate_index++;
+      if (index >= state->num_candidates) {
+        return;
+      }
+      const Candidate& candidate = candidates[index];
+      const float current_min_score = state->best_score.load();
+      Candidate best_candidate = Candidate::Unsuccessful();
+      // Candidates are sorted by score, so once this is false, the
+      // remaining candidates are only counted.
+      if (candidate.score > current_min_score) {
+        best_candidate = BranchAndBound(
+            search_parameters, discrete_scans, {candidate},
+            precomputation_grid_stack_->max_depth(), current_min_score,
+            &state->best_score, low_resolution_rejection);
+      }
+      common::MutexLocker locker(&state->mutex);
+      // Cut off branches return placeholders scoring at most 'best_score',
+      // which are rejected here.
+      if (best_candidate.score > state->best_candidate.score) {
+        state->best_candidate = best_candidate;
+        state->best_score = best_candidate.score;
+      }
+      ++state->num_candidates_searched;
+    }
+  };
+  for (int i = 1; i < num_tasks; ++i) {
+    thread_pool->Schedule(search, common::WorkItemPriority::kHigh,
+                          "parallel_branch_and_bound_3d");
+  }
+  search();
+  common::MutexLocker locker(&state->mutex);
+  locker.Await([&state]() REQUIRES(state->mutex) {
+    return state->num_candidates_searched == state->num_candidates;
+  });
+  return state->best_candidate;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -20,14 +20,20 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/common/deadline.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/io/mapped_blob_file.h"
 #include "cartographer/mapping/trajectory_node.h"
 #include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/mapping_3d/frozen_hybrid_grid.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/low_resolution_matcher.h"
 #include "cartographer/mapping_3d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
 #include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -40,20 +46,81 @@ proto::FastCorrelativeScanMatcherOptions
 CreateFastCorrelativeScanMatcherOptions(
     common::LuaParameterDictionary* parameter_dictionary);
 
+// Returns the grids precomputed by the FastCorrelativeScanMatcher for the
+// 'hybrid_grid' as a blob to be written to a 'io::MappedBlobFileWriter'.
+string SerializePrecomputationGrids(
+    const HybridGrid& hybrid_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options);
+
 class PrecomputationGridStack;
 struct DiscreteScan;
 struct Candidate;
 
-// Used to compute scores between 0 and 1 how well the given pose matches.
-using MatchingFunction = std::function<float(const transform::Rigid3f&)>;
-
 class FastCorrelativeScanMatcher {
  public:
+  // Stages of the search in the order they are run, from cheapest to most
+  // expensive per candidate. Each stage discards the candidates failing its
+  // threshold, and a match is rejected by the first stage leaving none.
+  enum class Stage {
+    // Rotations scoring below 'min_rotational_score' in the rotational scan
+    // matcher. Rejected rotations are never discretized.
+    kRotationalScore = 0,
+    // Translations for which the lowest resolution precomputation grid, an
+    // upper bound of the score, is not above 'min_score'.
+    kLowestResolutionBound,
+    // Candidates not scoring above 'min_score' at full resolution in the
+    // branch-and-bound search.
+    kBranchAndBound,
+    // Candidates scoring below 'min_low_resolution_score' in the low
+    // resolution hybrid grid.
+    kLowResolutionScore,
+  };
+  static constexpr int kNumStages = 4;
+
   FastCorrelativeScanMatcher(
       const HybridGrid& hybrid_grid,
       const HybridGrid* low_resolution_hybrid_grid,
       const std::vector<mapping::TrajectoryNode>& nodes,
       const proto::FastCorrelativeScanMatcherOptions& options);
+
+  // Same as above, but building the precomputed grids is distributed among
+  // 'num_tasks' tasks, all but one running on 'thread_pool'.
+  FastCorrelativeScanMatcher(
+      const HybridGrid& hybrid_grid,
+      const HybridGrid* low_resolution_hybrid_grid,
+      const std::vector<mapping::TrajectoryNode>& nodes,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPoolInterface* thread_pool, int num_tasks);
+
+  // Same as the first constructor, but the precomputed grids are read from the blob at
+  // 'blob_index' of the 'mapped_blob_file', which has to be the result of
+  // SerializePrecomputationGrids() with the same 'hybrid_grid' and 'options'.
+  // Unlike in 2D, the sparse grids are rebuilt from the blob, which is still
+  // much faster than recomputing them.
+  FastCorrelativeScanMatcher(
+      const HybridGrid& hybrid_grid,
+      const HybridGrid* low_resolution_hybrid_grid,
+      const std::vector<mapping::TrajectoryNode>& nodes,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      const std::shared_ptr<const io::MappedBlobFile>& mapped_blob_file,
+      int blob_index);
+
+  // Same as the second and third constructor, but for the compact copies of
+  // the grids of a finished submap.
+  FastCorrelativeScanMatcher(
+      const FrozenHybridGrid& hybrid_grid,
+      const FrozenHybridGrid* low_resolution_hybrid_grid,
+      const std::vector<mapping::TrajectoryNode>& nodes,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPoolInterface* thread_pool, int num_tasks);
+  FastCorrelativeScanMatcher(
+      const FrozenHybridGrid& hybrid_grid,
+      const FrozenHybridGrid* low_resolution_hybrid_grid,
+      const std::vector<mapping::TrajectoryNode>& nodes,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      const std::shared_ptr<const io::MappedBlobFile>& mapped_blob_file,
+      int blob_index);
+
   ~FastCorrelativeScanMatcher();
 
   FastCorrelativeScanMatcher(const FastCorrelativeScanMatcher&) = delete;
@@ -64,39 +131,69 @@ class FastCorrelativeScanMatcher {
   // given an 'initial_pose_estimate'. If a score above 'min_score' (excluding
   // equality) is possible, true is returned, and 'score', 'pose_estimate',
   // 'rotational_score', and 'low_resolution_score' are updated with the result.
+  // Otherwise, the stage which rejected the match is stored in
+  // 'rejecting_stage' unless it is nullptr.
   bool Match(const transform::Rigid3d& initial_pose_estimate,
              const mapping::TrajectoryNode::Data& constant_data,
              float min_score, float* score, transform::Rigid3d* pose_estimate,
-             float* rotational_score, float* low_resolution_score) const;
+             float* rotational_score, float* low_resolution_score,
+             Stage* rejecting_stage) const;
 
   // Aligns the node with the given 'constant_data' within the 'hybrid_grid'
   // given a rotation which is expected to be approximately gravity aligned.
   // If a score above 'min_score' (excluding equality) is possible, true is
   // returned, and 'score', 'pose_estimate', 'rotational_score', and
-  // 'low_resolution_score' are updated with the result.
+  // 'low_resolution_score' are updated with the result. Otherwise, the stage
+  // which rejected the match is stored in 'rejecting_stage' unless it is
+  // nullptr.
   bool MatchFullSubmap(const Eigen::Quaterniond& gravity_alignment,
                        const mapping::TrajectoryNode::Data& constant_data,
                        float min_score, float* score,
                        transform::Rigid3d* pose_estimate,
-                       float* rotational_score,
-                       float* low_resolution_score) const;
+                       float* rotational_score, float* low_resolution_score,
+                       Stage* rejecting_stage) const;
+
+  // Same as above, but the subtrees of the lowest resolution candidates are
+  // searched by 'num_tasks' tasks, 'num_tasks' - 1 of which are scheduled on
+  // the 'thread_pool'. The calling thread takes part in the search, so this
+  // may be called from a work item of the same 'thread_pool'.
+  //
+  // If 'deadline' is not nullptr, no more candidates are expanded once it
+  // expired, and the best match found until then is returned. In this case,
+  // 'deadline->expired()' is true and the result may not be optimal.
+  bool MatchFullSubmap(const Eigen::Quaterniond& gravity_alignment,
+                       const mapping::TrajectoryNode::Data& constant_data,
+                       float min_score,
+                       common::ThreadPoolInterface* thread_pool, int num_tasks,
+                       common::Deadline* deadline, float* score,
+                       transform::Rigid3d* pose_estimate,
+                       float* rotational_score, float* low_resolution_score,
+                       Stage* rejecting_stage) const;
+
+  // Returns the number of bytes used by the precomputed grids.
+  int64 GetMemoryUsageInBytes() const;
 
  private:
   struct SearchParameters {
     const int linear_xy_window_size;     // voxels
     const int linear_z_window_size;      // voxels
     const double angular_search_window;  // radians
-    const MatchingFunction* const low_resolution_matcher;
+    const LowResolutionMatcher* const low_resolution_matcher;
+    // If not nullptr, the search stops expanding candidates once it expired.
+    common::Deadline* const deadline;
   };
 
+  // The search is parallelized if a 'thread_pool' is given and 'num_tasks' is
+  // greater than 1.
   bool MatchWithSearchParameters(
       const SearchParameters& search_parameters,
       const transform::Rigid3d& initial_pose_estimate,
       const sensor::PointCloud& point_cloud,
       const Eigen::VectorXf& rotational_scan_matcher_histogram,
       const Eigen::Quaterniond& gravity_alignment, float min_score,
-      float* score, transform::Rigid3d* pose_estimate, float* rotational_score,
-      float* low_resolution_score) const;
+      common::ThreadPoolInterface* thread_pool, int num_tasks, float* score,
+      transform::Rigid3d* pose_estimate, float* rotational_score,
+      float* low_resolution_score, Stage* rejecting_stage) const;
   DiscreteScan DiscretizeScan(const SearchParameters& search_parameters,
                               const sensor::PointCloud& point_cloud,
                               const transform::Rigid3f& pose,
@@ -115,10 +212,28 @@ class FastCorrelativeScanMatcher {
   std::vector<Candidate> ComputeLowestResolutionCandidates(
       const SearchParameters& search_parameters,
       const std::vector<DiscreteScan>& discrete_scans) const;
+  // If 'shared_min_score' is not nullptr, branches scoring not above it are
+  // cut off as well. It is raised concurrently by other searches. Sets
+  // 'low_resolution_rejection' if a candidate scoring above the minimum was
+  // rejected by the low resolution matcher.
   Candidate BranchAndBound(const SearchParameters& search_parameters,
                            const std::vector<DiscreteScan>& discrete_scans,
                            const std::vector<Candidate>& candidates,
-                           int candidate_depth, float min_score) const;
+                           int candidate_depth, float min_score,
+                           const std::atomic<float>* shared_min_score,
+                           std::atomic<bool>* low_resolution_rejection) const;
+  // Runs BranchAndBound() on the subtree of each of the 'candidates' in
+  // 'num_tasks' tasks, which share the best score found so far.
+  Candidate ParallelBranchAndBound(
+      const SearchParameters& search_parameters,
+      const std::vector<DiscreteScan>& discrete_scans,
+      const std::vector<Candidate>& candidates, float min_score,
+      common::ThreadPoolInterface* thread_pool, int num_tasks,
+      std::atomic<bool>* low_resolution_rejection) const;
+  // Returns a matcher of the 'points' against whichever low resolution grid
+  // this was constructed with.
+  LowResolutionMatcher CreateLowResolutionMatcher(
+      const sensor::PointCloud* points) const;
   transform::Rigid3f GetPoseFromCandidate(
       const std::vector<DiscreteScan>& discrete_scans,
       const Candidate& candidate) const;
@@ -127,7 +242,9 @@ class FastCorrelativeScanMatcher {
   const float resolution_;
   const int width_in_voxels_;
   std::unique_ptr<PrecomputationGridStack> precomputation_grid_stack_;
+  // Only one of the low resolution grids is set.
   const HybridGrid* const low_resolution_hybrid_grid_;
+  const FrozenHybridGrid* const frozen_low_resolution_hybrid_grid_;
   RotationalScanMatcher rotational_scan_matcher_;
 };
 
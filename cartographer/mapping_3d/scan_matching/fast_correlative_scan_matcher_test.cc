@@ -16,13 +16,19 @@
 
 #include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cmath>
+#include <memory>
 #include <random>
 #include <string>
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/make_unique.h"
+#include "cartographer/io/mapped_blob_file.h"
 #include "cartographer/mapping_3d/range_data_inserter.h"
 #include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
@@ -88,6 +94,7 @@ class FastCorrelativeScanMatcherTest : public ::testing::Test {
         "hit_probability = 0.7, "
         "miss_probability = 0.4, "
         "num_free_space_voxels = 5, "
+        "num_threads = 1, "
         "}");
     return CreateRangeDataInserterOptions(parameter_dictionary.get());
   }
@@ -147,7 +154,7 @@ TEST_F(FastCorrelativeScanMatcherTest, CorrectPoseForMatch) {
     EXPECT_TRUE(fast_correlative_scan_matcher->Match(
         transform::Rigid3d::Identity(), CreateConstantData(point_cloud_),
         kMinScore, &score, &pose_estimate, &rotational_score,
-        &low_resolution_score));
+        &low_resolution_score, nullptr /* rejecting_stage */));
     EXPECT_LT(kMinScore, score);
     EXPECT_LT(0.09f, rotational_score);
     EXPECT_LT(0.14f, low_resolution_score);
@@ -155,11 +162,15 @@ TEST_F(FastCorrelativeScanMatcherTest, CorrectPoseForMatch) {
                 transform::IsNearly(pose_estimate.cast<float>(), 0.05f))
         << "Actual: " << transform::ToProto(pose_estimate).DebugString()
         << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+    FastCorrelativeScanMatcher::Stage rejecting_stage;
     EXPECT_FALSE(fast_correlative_scan_matcher->Match(
         transform::Rigid3d::Identity(),
         CreateConstantData({Eigen::Vector3f(42.f, 42.f, 42.f)}), kMinScore,
-        &score, &pose_estimate, &rotational_score, &low_resolution_score))
+        &score, &pose_estimate, &rotational_score, &low_resolution_score,
+        &rejecting_stage))
         << low_resolution_score;
+    EXPECT_EQ(FastCorrelativeScanMatcher::Stage::kLowResolutionScore,
+              rejecting_stage);
   }
 }
 
@@ -176,7 +187,7 @@ TEST_F(FastCorrelativeScanMatcherTest, CorrectPoseForMatchFullSubmap) {
   EXPECT_TRUE(fast_correlative_scan_matcher->MatchFullSubmap(
       Eigen::Quaterniond::Identity(), CreateConstantData(point_cloud_),
       kMinScore, &score, &pose_estimate, &rotational_score,
-      &low_resolution_score));
+      &low_resolution_score, nullptr /* rejecting_stage */));
   EXPECT_LT(kMinScore, score);
   EXPECT_LT(0.09f, rotational_score);
   EXPECT_LT(0.14f, low_resolution_score);
@@ -184,11 +195,148 @@ TEST_F(FastCorrelativeScanMatcherTest, CorrectPoseForMatchFullSubmap) {
               transform::IsNearly(pose_estimate.cast<float>(), 0.05f))
       << "Actual: " << transform::ToProto(pose_estimate).DebugString()
       << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  FastCorrelativeScanMatcher::Stage rejecting_stage;
   EXPECT_FALSE(fast_correlative_scan_matcher->MatchFullSubmap(
       Eigen::Quaterniond::Identity(),
       CreateConstantData({Eigen::Vector3f(42.f, 42.f, 42.f)}), kMinScore,
-      &score, &pose_estimate, &rotational_score, &low_resolution_score))
+      &score, &pose_estimate, &rotational_score, &low_resolution_score,
+      &rejecting_stage))
       << low_resolution_score;
+  EXPECT_EQ(FastCorrelativeScanMatcher::Stage::kLowResolutionScore,
+            rejecting_stage);
+}
+
+TEST_F(FastCorrelativeScanMatcherTest, CorrectPoseWithLowResolutionDepths) {
+  // The scans of the depths above the 'full_resolution_depth' are discretized
+  // with reduced resolution.
+  auto options = options_;
+  options.set_full_resolution_depth(2);
+  for (int i = 0; i != 10; ++i) {
+    const auto expected_pose = GetRandomPose();
+    float score = 0.f;
+    transform::Rigid3d pose_estimate;
+    float rotational_score = 0.f;
+    float low_resolution_score = 0.f;
+    EXPECT_TRUE(GetFastCorrelativeScanMatcher(options, expected_pose)
+                    ->Match(transform::Rigid3d::Identity(),
+                            CreateConstantData(point_cloud_), kMinScore,
+                            &score, &pose_estimate, &rotational_score,
+                            &low_resolution_score,
+                            nullptr /* rejecting_stage */));
+    EXPECT_LT(kMinScore, score);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(pose_estimate.cast<float>(), 0.05f))
+        << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+}
+
+TEST_F(FastCorrelativeScanMatcherTest, RejectingStage) {
+  const auto expected_pose = GetRandomPose();
+  float score = 0.f;
+  transform::Rigid3d pose_estimate;
+  float rotational_score = 0.f;
+  float low_resolution_score = 0.f;
+  FastCorrelativeScanMatcher::Stage rejecting_stage;
+
+  // Scores of the rotational scan matcher are at most 1.
+  auto options = options_;
+  options.set_min_rotational_score(1.1);
+  EXPECT_FALSE(GetFastCorrelativeScanMatcher(options, expected_pose)
+                   ->Match(transform::Rigid3d::Identity(),
+                           CreateConstantData(point_cloud_), kMinScore, &score,
+                           &pose_estimate, &rotational_score,
+                           &low_resolution_score, &rejecting_stage));
+  EXPECT_EQ(FastCorrelativeScanMatcher::Stage::kRotationalScore,
+            rejecting_stage);
+
+  // Probabilities are at most 'kMaxProbability', so is the bound.
+  EXPECT_FALSE(GetFastCorrelativeScanMatcher(options_, expected_pose)
+                   ->Match(transform::Rigid3d::Identity(),
+                           CreateConstantData(point_cloud_), 1.f, &score,
+                           &pose_estimate, &rotational_score,
+                           &low_resolution_score, &rejecting_stage));
+  EXPECT_EQ(FastCorrelativeScanMatcher::Stage::kLowestResolutionBound,
+            rejecting_stage);
+}
+
+TEST_F(FastCorrelativeScanMatcherTest, MappedPrecomputationGrids) {
+  const auto expected_pose = GetRandomPose();
+
+  std::unique_ptr<FastCorrelativeScanMatcher> fast_correlative_scan_matcher(
+      GetFastCorrelativeScanMatcher(options_, expected_pose));
+  char filename[] = P_tmpdir "/fast_correlative_scan_matcher_test_XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  {
+    io::MappedBlobFileWriter writer(filename);
+    writer.Write(SerializePrecomputationGrids(*hybrid_grid_, options_));
+    ASSERT_TRUE(writer.Close());
+  }
+  const FastCorrelativeScanMatcher mapped_fast_correlative_scan_matcher(
+      *hybrid_grid_, hybrid_grid_.get(),
+      std::vector<mapping::TrajectoryNode>(
+          {{std::make_shared<const mapping::TrajectoryNode::Data>(
+                CreateConstantData(point_cloud_)),
+            expected_pose.cast<double>()}}),
+      options_, std::make_shared<const io::MappedBlobFile>(filename), 0);
+  remove(filename);
+  EXPECT_EQ(fast_correlative_scan_matcher->GetMemoryUsageInBytes(),
+            mapped_fast_correlative_scan_matcher.GetMemoryUsageInBytes());
+
+  float score = 0.f;
+  transform::Rigid3d pose_estimate;
+  float rotational_score = 0.f;
+  float low_resolution_score = 0.f;
+  EXPECT_TRUE(fast_correlative_scan_matcher->MatchFullSubmap(
+      Eigen::Quaterniond::Identity(), CreateConstantData(point_cloud_),
+      kMinScore, &score, &pose_estimate, &rotational_score,
+      &low_resolution_score, nullptr /* rejecting_stage */));
+  float mapped_score = 0.f;
+  transform::Rigid3d mapped_pose_estimate;
+  EXPECT_TRUE(mapped_fast_correlative_scan_matcher.MatchFullSubmap(
+      Eigen::Quaterniond::Identity(), CreateConstantData(point_cloud_),
+      kMinScore, &mapped_score, &mapped_pose_estimate, &rotational_score,
+      &low_resolution_score, nullptr /* rejecting_stage */));
+  EXPECT_EQ(score, mapped_score);
+  EXPECT_THAT(pose_estimate, transform::IsNearly(mapped_pose_estimate, 1e-9));
+}
+
+TEST_F(FastCorrelativeScanMatcherTest, FrozenHybridGrids) {
+  const auto expected_pose = GetRandomPose();
+
+  std::unique_ptr<FastCorrelativeScanMatcher> fast_correlative_scan_matcher(
+      GetFastCorrelativeScanMatcher(options_, expected_pose));
+  const FrozenHybridGrid frozen_hybrid_grid(*hybrid_grid_);
+  const FastCorrelativeScanMatcher frozen_fast_correlative_scan_matcher(
+      frozen_hybrid_grid, &frozen_hybrid_grid,
+      std::vector<mapping::TrajectoryNode>(
+          {{std::make_shared<const mapping::TrajectoryNode::Data>(
+                CreateConstantData(point_cloud_)),
+            expected_pose.cast<double>()}}),
+      options_, nullptr /* thread_pool */, 1 /* num_tasks */);
+  EXPECT_EQ(fast_correlative_scan_matcher->GetMemoryUsageInBytes(),
+            frozen_fast_correlative_scan_matcher.GetMemoryUsageInBytes());
+
+  float score = 0.f;
+  transform::Rigid3d pose_estimate;
+  float rotational_score = 0.f;
+  float low_resolution_score = 0.f;
+  EXPECT_TRUE(fast_correlative_scan_matcher->MatchFullSubmap(
+      Eigen::Quaterniond::Identity(), CreateConstantData(point_cloud_),
+      kMinScore, &score, &pose_estimate, &rotational_score,
+      &low_resolution_score, nullptr /* rejecting_stage */));
+  float frozen_score = 0.f;
+  transform::Rigid3d frozen_pose_estimate;
+  float frozen_low_resolution_score = 0.f;
+  EXPECT_TRUE(frozen_fast_correlative_scan_matcher.MatchFullSubmap(
+      Eigen::Quaterniond::Identity(), CreateConstantData(point_cloud_),
+      kMinScore, &frozen_score, &frozen_pose_estimate, &rotational_score,
+      &frozen_low_resolution_score, nullptr /* rejecting_stage */));
+  EXPECT_EQ(score, frozen_score);
+  EXPECT_EQ(low_resolution_score, frozen_low_resolution_score);
+  EXPECT_THAT(pose_estimate, transform::IsNearly(frozen_pose_estimate, 1e-9));
 }
 
 }  // namespace
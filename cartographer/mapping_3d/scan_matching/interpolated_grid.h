@@ -17,8 +17,13 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_INTERPOLATED_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_INTERPOLATED_GRID_H_
 
+#include <array>
 #include <cmath>
+#include <limits>
+#include <vector>
 
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 
 namespace cartographer {
@@ -32,14 +37,28 @@ namespace scan_matching {
 // This class is templated to work with the autodiff that Ceres provides.
 // For this reason, it is also important that the interpolation scheme be
 // continuously differentiable.
+//
+// The probabilities of the 2x2x2 voxels used for interpolation are cached, so
+// that evaluating points in the same voxels again, e.g. in the next iteration
+// of the solver, does not access the HybridGrid. Hence, the HybridGrid must not
+// change while this is used, and this class is not thread-safe.
 class InterpolatedGrid {
  public:
   explicit InterpolatedGrid(const HybridGrid& hybrid_grid)
-      : hybrid_grid_(hybrid_grid) {}
+      : hybrid_grid_(&hybrid_grid), cache_(kNumCacheEntries) {}
 
   InterpolatedGrid(const InterpolatedGrid&) = delete;
   InterpolatedGrid& operator=(const InterpolatedGrid&) = delete;
 
+  // Interpolates 'hybrid_grid' from now on, which may also be the previous
+  // grid after it changed. Clears the cache but keeps its memory.
+  void Reset(const HybridGrid& hybrid_grid) {
+    hybrid_grid_ = &hybrid_grid;
+    for (CacheEntry& entry : cache_) {
+      entry.index = InvalidIndex();
+    }
+  }
+
   // Returns the interpolated probability at (x, y, z) of the HybridGrid
   // used to perform the interpolation.
   //
@@ -52,23 +71,16 @@ class InterpolatedGrid {
     double x1, y1, z1, x2, y2, z2;
     ComputeInterpolationDataPoints(x, y, z, &x1, &y1, &z1, &x2, &y2, &z2);
 
-    const Eigen::Array3i index1 =
-        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x1, y1, z1));
-    const double q111 = hybrid_grid_.GetProbability(index1);
-    const double q112 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 0, 1));
-    const double q121 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 1, 0));
-    const double q122 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 1, 1));
-    const double q211 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 0, 0));
-    const double q212 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 0, 1));
-    const double q221 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 1, 0));
-    const double q222 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 1, 1));
+    const std::array<float, 8>& q = GetCornerProbabilities(
+        hybrid_grid_->GetCellIndex(Eigen::Vector3f(x1, y1, z1)));
+    const double q111 = q[0];
+    const double q112 = q[1];
+    const double q121 = q[2];
+    const double q122 = q[3];
+    const double q211 = q[4];
+    const double q212 = q[5];
+    const double q221 = q[6];
+    const double q222 = q[7];
 
     const T normalized_x = (x - x1) / (x2 - x1);
     const T normalized_y = (y - y1) / (y2 - y1);
@@ -102,7 +114,104 @@ class InterpolatedGrid {
            q1;
   }
 
+  // Same as GetProbability(), but also returns the gradient of the
+  // interpolated probability with respect to (x, y, z) in 'gradient' unless it
+  // is null. This avoids the cost of evaluating with Jets when the derivatives
+  // are computed analytically. 'T' is double or float, and all arithmetic is
+  // done in 'T'.
+  template <typename T>
+  T GetProbabilityAndGradient(const T x, const T y, const T z,
+                              Eigen::Matrix<T, 3, 1>* const gradient) const {
+    double x1, y1, z1, x2, y2, z2;
+    ComputeInterpolationDataPoints(x, y, z, &x1, &y1, &z1, &x2, &y2, &z2);
+
+    const std::array<float, 8>& q = GetCornerProbabilities(
+        hybrid_grid_->GetCellIndex(Eigen::Vector3f(x1, y1, z1)));
+
+    const T normalized_x = (x - T(x1)) / T(x2 - x1);
+    const T normalized_y = (y - T(y1)) / T(y2 - y1);
+    const T normalized_z = (z - T(z1)) / T(z2 - z1);
+
+    // The same scheme as in GetProbability() written as A + (B - A) * s(t) with
+    // s(t) = 3t^2 - 2t^3 and its derivative s'(t) = 6t - 6t^2.
+    const T sx = normalized_x * normalized_x * (T(3.) - T(2.) * normalized_x);
+    const T sy = normalized_y * normalized_y * (T(3.) - T(2.) * normalized_y);
+    const T sz = normalized_z * normalized_z * (T(3.) - T(2.) * normalized_z);
+
+    const T q11 = T(q[0]) + T(q[1] - q[0]) * sz;
+    const T q12 = T(q[2]) + T(q[3] - q[2]) * sz;
+    const T q21 = T(q[4]) + T(q[5] - q[4]) * sz;
+    const T q22 = T(q[6]) + T(q[7] - q[6]) * sz;
+    const T q1 = q11 + (q12 - q11) * sy;
+    const T q2 = q21 + (q22 - q21) * sy;
+    if (gradient == nullptr) {
+      return q1 + (q2 - q1) * sx;
+    }
+
+    const T dsx = T(6.) * normalized_x * (T(1.) - normalized_x);
+    const T dsy = T(6.) * normalized_y * (T(1.) - normalized_y);
+    const T dsz = T(6.) * normalized_z * (T(1.) - normalized_z);
+    const T dq11_dz = T(q[1] - q[0]) * dsz;
+    const T dq12_dz = T(q[3] - q[2]) * dsz;
+    const T dq21_dz = T(q[5] - q[4]) * dsz;
+    const T dq22_dz = T(q[7] - q[6]) * dsz;
+    const T dq1_dy = (q12 - q11) * dsy;
+    const T dq2_dy = (q22 - q21) * dsy;
+    const T dq1_dz = dq11_dz + (dq12_dz - dq11_dz) * sy;
+    const T dq2_dz = dq21_dz + (dq22_dz - dq21_dz) * sy;
+
+    *gradient << (q2 - q1) * dsx / T(x2 - x1),
+        (dq1_dy + (dq2_dy - dq1_dy) * sx) / T(y2 - y1),
+        (dq1_dz + (dq2_dz - dq1_dz) * sx) / T(z2 - z1);
+    return q1 + (q2 - q1) * sx;
+  }
+
+  // Same as GetProbability() for each column of 'points', writing the results
+  // to 'probabilities' which must have space for 'points.cols()' values.
+  template <typename T>
+  void GetProbabilities(const Eigen::Matrix<T, 3, Eigen::Dynamic>& points,
+                        T* const probabilities) const {
+    for (int i = 0; i != points.cols(); ++i) {
+      probabilities[i] =
+          GetProbability(points(0, i), points(1, i), points(2, i));
+    }
+  }
+
  private:
+  // Number of entries of the direct-mapped cache. This has to be a power of 2.
+  static constexpr int kNumCacheEntries = 4096;
+
+  // Index of unused cache entries which no voxel has.
+  static Eigen::Array3i InvalidIndex() {
+    return Eigen::Array3i::Constant(std::numeric_limits<int>::min());
+  }
+
+  struct CacheEntry {
+    // Index of the lowest of the cached voxels.
+    Eigen::Array3i index = InvalidIndex();
+    // Probabilities of the voxels at 'index' + (0, 0, 0), (0, 0, 1),
+    // (0, 1, 0), ..., (1, 1, 1), in this order.
+    std::array<float, 8> probabilities;
+  };
+
+  // Returns the probabilities of the 2x2x2 voxels starting at 'index', see
+  // 'CacheEntry'.
+  const std::array<float, 8>& GetCornerProbabilities(
+      const Eigen::Array3i& index) const {
+    const uint32 hash = (static_cast<uint32>(index.x()) * 73856093u) ^
+                        (static_cast<uint32>(index.y()) * 19349669u) ^
+                        (static_cast<uint32>(index.z()) * 83492791u);
+    CacheEntry& entry = cache_[(hash ^ (hash >> 16)) & (kNumCacheEntries - 1)];
+    if ((entry.index != index).any()) {
+      entry.index = index;
+      for (int i = 0; i != 8; ++i) {
+        entry.probabilities[i] = hybrid_grid_->GetProbability(
+            index + Eigen::Array3i(i >> 2, (i >> 1) & 1, i & 1));
+      }
+    }
+    return entry.probabilities;
+  }
+
   template <typename T>
   void ComputeInterpolationDataPoints(const T& x, const T& y, const T& z,
                                       double* x1, double* y1, double* z1,
@@ -112,9 +221,9 @@ class InterpolatedGrid {
     *x1 = lower.x();
     *y1 = lower.y();
     *z1 = lower.z();
-    *x2 = lower.x() + hybrid_grid_.resolution();
-    *y2 = lower.y() + hybrid_grid_.resolution();
-    *z2 = lower.z() + hybrid_grid_.resolution();
+    *x2 = lower.x() + hybrid_grid_->resolution();
+    *y2 = lower.y() + hybrid_grid_->resolution();
+    *z2 = lower.z() + hybrid_grid_->resolution();
   }
 
   // Center of the next lower voxel, i.e., not necessarily the voxel containing
@@ -123,21 +232,27 @@ class InterpolatedGrid {
   Eigen::Vector3f CenterOfLowerVoxel(const double x, const double y,
                                      const double z) const {
     // Center of the cell containing (x, y, z).
-    Eigen::Vector3f center = hybrid_grid_.GetCenterOfCell(
-        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x, y, z)));
+    Eigen::Vector3f center = hybrid_grid_->GetCenterOfCell(
+        hybrid_grid_->GetCellIndex(Eigen::Vector3f(x, y, z)));
     // Move to the next lower voxel center.
     if (center.x() > x) {
-      center.x() -= hybrid_grid_.resolution();
+      center.x() -= hybrid_grid_->resolution();
     }
     if (center.y() > y) {
-      center.y() -= hybrid_grid_.resolution();
+      center.y() -= hybrid_grid_->resolution();
     }
     if (center.z() > z) {
-      center.z() -= hybrid_grid_.resolution();
+      center.z() -= hybrid_grid_->resolution();
     }
     return center;
   }
 
+  Eigen::Vector3f CenterOfLowerVoxel(const float x, const float y,
+                                     const float z) const {
+    return CenterOfLowerVoxel(static_cast<double>(x), static_cast<double>(y),
+                              static_cast<double>(z));
+  }
+
   // Uses the scalar part of a Ceres Jet.
   template <typename T>
   Eigen::Vector3f CenterOfLowerVoxel(const T& jet_x, const T& jet_y,
@@ -145,7 +260,8 @@ class InterpolatedGrid {
     return CenterOfLowerVoxel(jet_x.a, jet_y.a, jet_z.a);
   }
 
-  const HybridGrid& hybrid_grid_;
+  const HybridGrid* hybrid_grid_;
+  mutable std::vector<CacheEntry> cache_;
 };
 
 }  // namespace scan_matching
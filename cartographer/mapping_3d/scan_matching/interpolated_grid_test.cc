@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping_3d/scan_matching/interpolated_grid.h"
 
+#include <vector>
+
 #include "Eigen/Core"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 #include "gtest/gtest.h"
@@ -83,6 +85,25 @@ TEST_F(InterpolatedGridTest, MonotonicBehaviorBetweenGridPointsInX) {
   }
 }
 
+TEST_F(InterpolatedGridTest, GetProbabilitiesMatchesGetProbability) {
+  const InterpolatedGrid other_interpolated_grid(hybrid_grid_);
+  Eigen::Matrix3Xd points(3, 200);
+  for (int i = 0; i != points.cols(); ++i) {
+    points.col(i) << -8. + 0.031 * i, 2. + 0.013 * i, 0.0071 * i;
+  }
+  // Evaluating twice uses the cached voxels the second time.
+  for (int pass = 0; pass != 2; ++pass) {
+    std::vector<double> probabilities(points.cols());
+    interpolated_grid_.GetProbabilities(points, probabilities.data());
+    for (int i = 0; i != points.cols(); ++i) {
+      EXPECT_EQ(other_interpolated_grid.GetProbability(points(0, i),
+                                                       points(1, i),
+                                                       points(2, i)),
+                probabilities[i]);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
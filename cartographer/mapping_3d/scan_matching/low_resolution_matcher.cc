@@ -16,21 +16,26 @@
 
 #include "cartographer/mapping_3d/scan_matching/low_resolution_matcher.h"
 
+#include "cartographer/mapping/bounded_probability_sum.h"
+
 namespace cartographer {
 namespace mapping_3d {
 namespace scan_matching {
 
-std::function<float(const transform::Rigid3f&)> CreateLowResolutionMatcher(
-    const HybridGrid* low_resolution_grid, const sensor::PointCloud* points) {
-  return [=](const transform::Rigid3f& pose) {
-    float score = 0.f;
-    for (const auto& point : sensor::TransformPointCloud(*points, pose)) {
-      // TODO(zhengj, whess): Interpolate the Grid to get better score.
-      score += low_resolution_grid->GetProbability(
-          low_resolution_grid->GetCellIndex(point));
-    }
-    return score / points->size();
-  };
+float LowResolutionMatcher::Score(const transform::Rigid3f& pose) const {
+  // TODO(zhengj, whess): Interpolate the Grid to get better score.
+  if (frozen_low_resolution_grid_ != nullptr) {
+    return mapping::ComputeBoundedProbabilitySum(
+               mapping::TransformedPointCloudAccessor<FrozenHybridGrid>(
+                   *frozen_low_resolution_grid_, *points_, pose),
+               points_->size(), 0.f /* min_probability_sum */) /
+           points_->size();
+  }
+  return mapping::ComputeBoundedProbabilitySum(
+             mapping::TransformedPointCloudAccessor<HybridGrid>(
+                 *low_resolution_grid_, *points_, pose),
+             points_->size(), 0.f /* min_probability_sum */) /
+         points_->size();
 }
 
 }  // namespace scan_matching
@@ -17,8 +17,7 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_LOW_RESOLUTION_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_LOW_RESOLUTION_MATCHER_H_
 
-#include <functional>
-
+#include "cartographer/mapping_3d/frozen_hybrid_grid.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -27,8 +26,29 @@ namespace cartographer {
 namespace mapping_3d {
 namespace scan_matching {
 
-std::function<float(const transform::Rigid3f&)> CreateLowResolutionMatcher(
-    const HybridGrid* low_resolution_grid, const sensor::PointCloud* points);
+// Computes scores between 0 and 1 of how well the 'points' match the
+// 'low_resolution_grid' at a given pose. Both have to outlive this object.
+class LowResolutionMatcher {
+ public:
+  LowResolutionMatcher(const HybridGrid* low_resolution_grid,
+                       const sensor::PointCloud* points)
+      : low_resolution_grid_(low_resolution_grid),
+        frozen_low_resolution_grid_(nullptr),
+        points_(points) {}
+  LowResolutionMatcher(const FrozenHybridGrid* low_resolution_grid,
+                       const sensor::PointCloud* points)
+      : low_resolution_grid_(nullptr),
+        frozen_low_resolution_grid_(low_resolution_grid),
+        points_(points) {}
+
+  float Score(const transform::Rigid3f& pose) const;
+
+ private:
+  // Exactly one of the grids is not nullptr.
+  const HybridGrid* const low_resolution_grid_;
+  const FrozenHybridGrid* const frozen_low_resolution_grid_;
+  const sensor::PointCloud* const points_;
+};
 
 }  // namespace scan_matching
 }  // namespace mapping_3d
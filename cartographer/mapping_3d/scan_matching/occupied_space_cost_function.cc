@@ -0,0 +1,136 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
+
+#include <array>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+
+OccupiedSpaceCostFunction::OccupiedSpaceCostFunction(
+    const double scaling_factor, const sensor::PointCloud& point_cloud,
+    const HybridGrid& hybrid_grid, const bool use_single_precision)
+    : scaling_factor_(scaling_factor),
+      use_single_precision_(use_single_precision),
+      point_cloud_(&point_cloud),
+      interpolated_grid_(hybrid_grid) {
+  set_num_residuals(point_cloud.size());
+  mutable_parameter_block_sizes()->push_back(3);
+  mutable_parameter_block_sizes()->push_back(4);
+}
+
+void OccupiedSpaceCostFunction::Reset(const double scaling_factor,
+                                      const sensor::PointCloud& point_cloud,
+                                      const HybridGrid& hybrid_grid,
+                                      const bool use_single_precision) {
+  scaling_factor_ = scaling_factor;
+  use_single_precision_ = use_single_precision;
+  point_cloud_ = &point_cloud;
+  interpolated_grid_.Reset(hybrid_grid);
+  set_num_residuals(point_cloud.size());
+}
+
+bool OccupiedSpaceCostFunction::Evaluate(double const* const* parameters,
+                                         double* const residuals,
+                                         double** const jacobians) const {
+  double* const translation_jacobian =
+      jacobians == nullptr ? nullptr : jacobians[0];
+  double* const rotation_jacobian =
+      jacobians == nullptr ? nullptr : jacobians[1];
+  if (use_single_precision_) {
+    EvaluateWithScalar<float>(parameters, residuals, translation_jacobian,
+                              rotation_jacobian);
+  } else {
+    EvaluateWithScalar<double>(parameters, residuals, translation_jacobian,
+                               rotation_jacobian);
+  }
+  return true;
+}
+
+template <typename T>
+void OccupiedSpaceCostFunction::EvaluateWithScalar(
+    double const* const* parameters, double* const residuals,
+    double* const translation_jacobian, double* const rotation_jacobian) const {
+  using Vector3T = Eigen::Matrix<T, 3, 1>;
+  using Matrix3T = Eigen::Matrix<T, 3, 3>;
+  const Vector3T translation = Eigen::Vector3d(parameters[0]).cast<T>();
+  const T w = T(parameters[1][0]);
+  const T x = T(parameters[1][1]);
+  const T y = T(parameters[1][2]);
+  const T z = T(parameters[1][3]);
+  // Like Eigen's Quaternion::toRotationMatrix() which the Jet based
+  // OccupiedSpaceCostFunctor uses.
+  Matrix3T rotation;
+  rotation << T(1.) - T(2.) * (y * y + z * z), T(2.) * (x * y - z * w),
+      T(2.) * (x * z + y * w), T(2.) * (x * y + z * w),
+      T(1.) - T(2.) * (x * x + z * z), T(2.) * (y * z - x * w),
+      T(2.) * (x * z - y * w), T(2.) * (y * z + x * w),
+      T(1.) - T(2.) * (x * x + y * y);
+
+  if (translation_jacobian == nullptr && rotation_jacobian == nullptr) {
+    for (size_t i = 0; i < point_cloud_->size(); ++i) {
+      const Vector3T world =
+          rotation * (*point_cloud_)[i].cast<T>() + translation;
+      residuals[i] =
+          scaling_factor_ *
+          (1. - interpolated_grid_.GetProbabilityAndGradient(
+                    world.x(), world.y(), world.z(),
+                    static_cast<Vector3T*>(nullptr)));
+    }
+    return;
+  }
+
+  // Derivatives of 'rotation' with respect to w, x, y, and z.
+  std::array<Matrix3T, 4> rotation_derivatives;
+  rotation_derivatives[0] << T(0.), T(-2.) * z, T(2.) * y, T(2.) * z, T(0.),
+      T(-2.) * x, T(-2.) * y, T(2.) * x, T(0.);
+  rotation_derivatives[1] << T(0.), T(2.) * y, T(2.) * z, T(2.) * y,
+      T(-4.) * x, T(-2.) * w, T(2.) * z, T(2.) * w, T(-4.) * x;
+  rotation_derivatives[2] << T(-4.) * y, T(2.) * x, T(2.) * w, T(2.) * x,
+      T(0.), T(2.) * z, T(-2.) * w, T(2.) * z, T(-4.) * y;
+  rotation_derivatives[3] << T(-4.) * z, T(-2.) * w, T(2.) * x, T(2.) * w,
+      T(-4.) * z, T(2.) * y, T(2.) * x, T(2.) * y, T(0.);
+
+  const T scaling_factor = T(scaling_factor_);
+  for (size_t i = 0; i < point_cloud_->size(); ++i) {
+    const Vector3T point = (*point_cloud_)[i].cast<T>();
+    const Vector3T world = rotation * point + translation;
+    Vector3T gradient;
+    const T probability = interpolated_grid_.GetProbabilityAndGradient(
+        world.x(), world.y(), world.z(), &gradient);
+    residuals[i] = scaling_factor_ * (1. - probability);
+    const Vector3T residual_gradient = -scaling_factor * gradient;
+    if (translation_jacobian != nullptr) {
+      Eigen::Map<Eigen::RowVector3d>(translation_jacobian + 3 * i) =
+          residual_gradient.transpose().template cast<double>();
+    }
+    if (rotation_jacobian != nullptr) {
+      for (int j = 0; j != 4; ++j) {
+        rotation_jacobian[4 * i + j] =
+            residual_gradient.dot(rotation_derivatives[j] * point);
+      }
+    }
+  }
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
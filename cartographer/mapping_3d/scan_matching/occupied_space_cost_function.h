@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
+#define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
+
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/interpolated_grid.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "ceres/ceres.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+
+// Computes the same residuals as the OccupiedSpaceCostFunctor, but with
+// analytic Jacobians: the whole point cloud is evaluated in one pass which
+// shares the rotation matrix and its derivatives with respect to the
+// quaternion between all points, instead of propagating Jets through the
+// tricubic interpolation of each point.
+//
+// The parameter blocks are the translation and the rotation quaternion as
+// (w, x, y, z). If 'use_single_precision' is true, the points are transformed
+// and interpolated in floats. Only the residuals and Jacobians handed to the
+// solver are doubles then.
+class OccupiedSpaceCostFunction : public ceres::CostFunction {
+ public:
+  OccupiedSpaceCostFunction(double scaling_factor,
+                            const sensor::PointCloud& point_cloud,
+                            const HybridGrid& hybrid_grid,
+                            bool use_single_precision = false);
+
+  OccupiedSpaceCostFunction(const OccupiedSpaceCostFunction&) = delete;
+  OccupiedSpaceCostFunction& operator=(const OccupiedSpaceCostFunction&) =
+      delete;
+
+  // Evaluates 'point_cloud' in 'hybrid_grid' from now on, keeping the memory
+  // allocated for the interpolation. This must not be called while the cost
+  // function is part of a ceres::Problem.
+  void Reset(double scaling_factor, const sensor::PointCloud& point_cloud,
+             const HybridGrid& hybrid_grid, bool use_single_precision = false);
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override;
+
+ private:
+  // Implements Evaluate() with 'T' being double or float.
+  template <typename T>
+  void EvaluateWithScalar(double const* const* parameters, double* residuals,
+                          double* translation_jacobian,
+                          double* rotation_jacobian) const;
+
+  double scaling_factor_;
+  bool use_single_precision_;
+  const sensor::PointCloud* point_cloud_;
+  InterpolatedGrid interpolated_grid_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
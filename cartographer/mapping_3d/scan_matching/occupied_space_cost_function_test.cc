@@ -0,0 +1,158 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
+
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_functor.h"
+#include "ceres/ceres.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+namespace {
+
+TEST(OccupiedSpaceCostFunctionTest, MatchesAutoDiff) {
+  HybridGrid hybrid_grid(0.1f);
+  for (int i = 0; i != 200; ++i) {
+    hybrid_grid.SetProbability(
+        Eigen::Array3i((7 * i) % 20 - 10, (11 * i) % 20 - 10, i % 5 - 2),
+        0.1f + 0.004f * i);
+  }
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 50; ++i) {
+    point_cloud.emplace_back(-0.9f + 0.037f * i, 0.8f - 0.031f * i,
+                             -0.2f + 0.009f * i);
+  }
+  constexpr double kScalingFactor = 0.7;
+  const OccupiedSpaceCostFunction cost_function(kScalingFactor, point_cloud,
+                                                hybrid_grid);
+  const ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor, ceres::DYNAMIC,
+                                    3, 4>
+      auto_diff_cost_function(
+          new OccupiedSpaceCostFunctor(kScalingFactor, point_cloud,
+                                       hybrid_grid),
+          point_cloud.size());
+
+  const Eigen::Quaterniond rotation(
+      Eigen::AngleAxisd(0.3, Eigen::Vector3d(1., 2., 3.).normalized()));
+  const double translation[3] = {0.03, -0.02, 0.01};
+  const double quaternion[4] = {rotation.w(), rotation.x(), rotation.y(),
+                                rotation.z()};
+  const double* const parameters[2] = {translation, quaternion};
+  std::vector<double> residuals(point_cloud.size());
+  std::vector<double> translation_jacobian(3 * point_cloud.size());
+  std::vector<double> rotation_jacobian(4 * point_cloud.size());
+  double* jacobians[2] = {translation_jacobian.data(),
+                          rotation_jacobian.data()};
+  ASSERT_TRUE(
+      cost_function.Evaluate(parameters, residuals.data(), jacobians));
+  std::vector<double> expected_residuals(point_cloud.size());
+  std::vector<double> expected_translation_jacobian(3 * point_cloud.size());
+  std::vector<double> expected_rotation_jacobian(4 * point_cloud.size());
+  double* expected_jacobians[2] = {expected_translation_jacobian.data(),
+                                   expected_rotation_jacobian.data()};
+  ASSERT_TRUE(auto_diff_cost_function.Evaluate(
+      parameters, expected_residuals.data(), expected_jacobians));
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    EXPECT_NEAR(expected_residuals[i], residuals[i], 1e-9);
+  }
+  for (size_t i = 0; i != translation_jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_translation_jacobian[i], translation_jacobian[i],
+                1e-6);
+  }
+  for (size_t i = 0; i != rotation_jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_rotation_jacobian[i], rotation_jacobian[i], 1e-6);
+  }
+
+  // Jacobians can be requested for only some of the parameter blocks.
+  double* translation_only_jacobians[2] = {translation_jacobian.data(),
+                                           nullptr};
+  ASSERT_TRUE(cost_function.Evaluate(parameters, residuals.data(),
+                                     translation_only_jacobians));
+  for (size_t i = 0; i != translation_jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_translation_jacobian[i], translation_jacobian[i],
+                1e-6);
+  }
+}
+
+TEST(OccupiedSpaceCostFunctionTest, SinglePrecisionMatchesDoublePrecision) {
+  HybridGrid hybrid_grid(0.1f);
+  for (int i = 0; i != 200; ++i) {
+    hybrid_grid.SetProbability(
+        Eigen::Array3i((7 * i) % 20 - 10, (11 * i) % 20 - 10, i % 5 - 2),
+        0.1f + 0.004f * i);
+  }
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 50; ++i) {
+    point_cloud.emplace_back(-0.9f + 0.037f * i, 0.8f - 0.031f * i,
+                             -0.2f + 0.009f * i);
+  }
+  constexpr double kScalingFactor = 0.7;
+  const OccupiedSpaceCostFunction double_cost_function(
+      kScalingFactor, point_cloud, hybrid_grid, false);
+  const OccupiedSpaceCostFunction single_cost_function(
+      kScalingFactor, point_cloud, hybrid_grid, true);
+
+  const Eigen::Quaterniond rotation(
+      Eigen::AngleAxisd(0.3, Eigen::Vector3d(1., 2., 3.).normalized()));
+  const double translation[3] = {0.03, -0.02, 0.01};
+  const double quaternion[4] = {rotation.w(), rotation.x(), rotation.y(),
+                                rotation.z()};
+  const double* const parameters[2] = {translation, quaternion};
+  std::vector<double> residuals(point_cloud.size());
+  std::vector<double> translation_jacobian(3 * point_cloud.size());
+  std::vector<double> rotation_jacobian(4 * point_cloud.size());
+  double* jacobians[2] = {translation_jacobian.data(),
+                          rotation_jacobian.data()};
+  ASSERT_TRUE(
+      single_cost_function.Evaluate(parameters, residuals.data(), jacobians));
+  std::vector<double> expected_residuals(point_cloud.size());
+  std::vector<double> expected_translation_jacobian(3 * point_cloud.size());
+  std::vector<double> expected_rotation_jacobian(4 * point_cloud.size());
+  double* expected_jacobians[2] = {expected_translation_jacobian.data(),
+                                   expected_rotation_jacobian.data()};
+  ASSERT_TRUE(double_cost_function.Evaluate(
+      parameters, expected_residuals.data(), expected_jacobians));
+  // The residuals are within a few float ULPs of the double ones, the
+  // Jacobians differ by less than 1e-5 relative to the largest entry.
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    EXPECT_NEAR(expected_residuals[i], residuals[i], 1e-6);
+  }
+  for (size_t i = 0; i != translation_jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_translation_jacobian[i], translation_jacobian[i],
+                1e-4);
+  }
+  for (size_t i = 0; i != rotation_jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_rotation_jacobian[i], rotation_jacobian[i], 1e-4);
+  }
+
+  // Without Jacobians, the same residuals are computed.
+  std::vector<double> residuals_only(point_cloud.size());
+  ASSERT_TRUE(single_cost_function.Evaluate(parameters, residuals_only.data(),
+                                            nullptr));
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    EXPECT_NEAR(expected_residuals[i], residuals_only[i], 1e-6);
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -58,12 +58,19 @@ class OccupiedSpaceCostFunctor {
   template <typename T>
   bool Evaluate(const transform::Rigid3<T>& transform,
                 T* const residual) const {
+    // Rotating by a matrix is cheaper than by a quaternion once there is more
+    // than a handful of points. All points are transformed first, so that the
+    // grid is only accessed in a single pass.
+    const Eigen::Matrix<T, 3, 3> rotation =
+        transform.rotation().toRotationMatrix();
+    Eigen::Matrix<T, 3, Eigen::Dynamic> world(3, point_cloud_.size());
     for (size_t i = 0; i < point_cloud_.size(); ++i) {
-      const Eigen::Matrix<T, 3, 1> world =
-          transform * point_cloud_[i].cast<T>();
-      const T probability =
-          interpolated_grid_.GetProbability(world[0], world[1], world[2]);
-      residual[i] = scaling_factor_ * (1. - probability);
+      world.col(i) =
+          rotation * point_cloud_[i].cast<T>() + transform.translation();
+    }
+    interpolated_grid_.GetProbabilities(world, residual);
+    for (size_t i = 0; i < point_cloud_.size(); ++i) {
+      residual[i] = scaling_factor_ * (1. - residual[i]);
     }
     return true;
   }
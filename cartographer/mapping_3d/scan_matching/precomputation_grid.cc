@@ -17,9 +17,16 @@
 #include "cartographer/mapping_3d/scan_matching/precomputation_grid.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/math.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/mapping/probability_values.h"
 #include "glog/logging.h"
 
@@ -45,36 +52,150 @@ Eigen::Array3i CellIndexAtHalfResolution(const Eigen::Array3i& cell_index) {
       DivideByTwoRoundingTowardsNegativeInfinity(cell_index[2]));
 }
 
-}  // namespace
+// Updates the 8 values in 'result' depending on the voxel at 'cell_index'
+// with 'value'.
+void PrecomputeCell(const Eigen::Array3i& cell_index, const uint8 value,
+                    const bool half_resolution, const Eigen::Array3i& shift,
+                    PrecomputationGrid* const result) {
+  for (int i = 0; i != 8; ++i) {
+    // We use this value to update 8 values in the resulting grid, at
+    // position (x - {0, 'shift'}, y - {0, 'shift'}, z - {0, 'shift'}).
+    // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid,
+    // this results in precomputation grids analogous to the 2D case.
+    const Eigen::Array3i shifted_cell_index =
+        cell_index - shift * PrecomputationGrid::GetOctant(i);
+    auto* const cell_value =
+        result->mutable_value(half_resolution
+                                  ? CellIndexAtHalfResolution(shifted_cell_index)
+                                  : shifted_cell_index);
+    *cell_value = std::max(value, *cell_value);
+  }
+}
 
-PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid) {
+// State of a parallel precomputation. It is shared with the tasks, so that
+// tasks starting only after the precomputation has finished can safely see
+// that nothing is left to do.
+struct ParallelPrecomputationState {
+  ParallelPrecomputationState(const int num_ranges)
+      : num_ranges(num_ranges), next_range_index(0) {}
+
+  const int num_ranges;
+  // Index of the next range of 'cells' to precompute.
+  std::atomic<int> next_range_index;
+  std::vector<std::pair<Eigen::Array3i, uint8>> cells;
+  // The result of each range, only written by the task which claimed it.
+  std::vector<PrecomputationGrid> results;
+
+  common::Mutex mutex;
+  int num_ranges_precomputed GUARDED_BY(mutex) = 0;
+};
+
+// Implements ConvertToPrecomputationGrid() for the HybridGrid and the
+// FrozenHybridGrid, which have iterators with the same interface.
+template <typename GridType>
+PrecomputationGrid ConvertGridToPrecomputationGrid(
+    const GridType& hybrid_grid) {
   PrecomputationGrid result(hybrid_grid.resolution());
-  for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
-    const int cell_value = common::RoundToInt(
-        (mapping::ValueToProbability(it.GetValue()) -
-         mapping::kMinProbability) *
-        (255.f / (mapping::kMaxProbability - mapping::kMinProbability)));
-    CHECK_GE(cell_value, 0);
-    CHECK_LE(cell_value, 255);
-    *result.mutable_value(it.GetCellIndex()) = cell_value;
+  // Values are converted in batches of up to 'kBatchSize' cells.
+  constexpr int kBatchSize = 256;
+  std::array<Eigen::Array3i, kBatchSize> cell_indices;
+  std::array<uint16, kBatchSize> values;
+  std::array<uint8, kBatchSize> cell_values;
+  int num_cells = 0;
+  const auto convert_batch = [&]() {
+    mapping::ValuesToUint8Probabilities(values.data(), num_cells,
+                                        cell_values.data());
+    for (int i = 0; i != num_cells; ++i) {
+      *result.mutable_value(cell_indices[i]) = cell_values[i];
+    }
+    num_cells = 0;
+  };
+  for (auto it = typename GridType::Iterator(hybrid_grid); !it.Done();
+       it.Next()) {
+    cell_indices[num_cells] = it.GetCellIndex();
+    values[num_cells] = it.GetValue();
+    if (++num_cells == kBatchSize) {
+      convert_batch();
+    }
   }
+  convert_batch();
   return result;
 }
 
+}  // namespace
+
+PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid) {
+  return ConvertGridToPrecomputationGrid(hybrid_grid);
+}
+
+PrecomputationGrid ConvertToPrecomputationGrid(
+    const FrozenHybridGrid& hybrid_grid) {
+  return ConvertGridToPrecomputationGrid(hybrid_grid);
+}
+
 PrecomputationGrid PrecomputeGrid(const PrecomputationGrid& grid,
                                   const bool half_resolution,
                                   const Eigen::Array3i& shift) {
   PrecomputationGrid result(grid.resolution());
   for (auto it = PrecomputationGrid::Iterator(grid); !it.Done(); it.Next()) {
-    for (int i = 0; i != 8; ++i) {
-      // We use this value to update 8 values in the resulting grid, at
-      // position (x - {0, 'shift'}, y - {0, 'shift'}, z - {0, 'shift'}).
-      // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid,
-      // this results in precomputation grids analogous to the 2D case.
-      const Eigen::Array3i cell_index =
-          it.GetCellIndex() - shift * PrecomputationGrid::GetOctant(i);
-      auto* const cell_value = result.mutable_value(
-          half_resolution ? CellIndexAtHalfResolution(cell_index) : cell_index);
+    PrecomputeCell(it.GetCellIndex(), it.GetValue(), half_resolution, shift,
+                   &result);
+  }
+  return result;
+}
+
+PrecomputationGrid PrecomputeGrid(
+    const PrecomputationGrid& grid, const bool half_resolution,
+    const Eigen::Array3i& shift,
+    common::ThreadPoolInterface* const thread_pool, const int num_tasks) {
+  CHECK_GE(num_tasks, 1);
+  if (thread_pool == nullptr || num_tasks == 1) {
+    return PrecomputeGrid(grid, half_resolution, shift);
+  }
+  const auto state = std::make_shared<ParallelPrecomputationState>(num_tasks);
+  // The iterator visits the voxels block by block, so consecutive ranges of
+  // 'cells' cover mostly disjoint regions and the results overlap little.
+  for (auto it = PrecomputationGrid::Iterator(grid); !it.Done(); it.Next()) {
+    state->cells.emplace_back(it.GetCellIndex(), it.GetValue());
+  }
+  state->results.reserve(num_tasks);
+  for (int i = 0; i != num_tasks; ++i) {
+    state->results.emplace_back(grid.resolution());
+  }
+  // Ranges are claimed one at a time, and everything but 'state' is copied,
+  // so that tasks may outlive this function.
+  const std::function<void()> precompute = [state, half_resolution, shift]() {
+    for (;;) {
+      const int index = state->next_range_index++;
+      if (index >= state->num_ranges) {
+        return;
+      }
+      const size_t begin = state->cells.size() * index / state->num_ranges;
+      const size_t end = state->cells.size() * (index + 1) / state->num_ranges;
+      for (size_t i = begin; i != end; ++i) {
+        PrecomputeCell(state->cells[i].first, state->cells[i].second,
+                       half_resolution, shift, &state->results[index]);
+      }
+      common::MutexLocker locker(&state->mutex);
+      ++state->num_ranges_precomputed;
+    }
+  };
+  for (int i = 1; i < num_tasks; ++i) {
+    thread_pool->Schedule(precompute, common::WorkItemPriority::kHigh,
+                          "precompute_grid_3d");
+  }
+  precompute();
+  {
+    common::MutexLocker locker(&state->mutex);
+    locker.Await([&state]() REQUIRES(state->mutex) {
+      return state->num_ranges_precomputed == state->num_ranges;
+    });
+  }
+  PrecomputationGrid result(std::move(state->results.front()));
+  for (int i = 1; i != num_tasks; ++i) {
+    for (auto it = PrecomputationGrid::Iterator(state->results[i]); !it.Done();
+         it.Next()) {
+      auto* const cell_value = result.mutable_value(it.GetCellIndex());
       *cell_value = std::max(it.GetValue(), *cell_value);
     }
   }
@@ -17,6 +17,8 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_PRECOMPUTATION_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_PRECOMPUTATION_GRID_H_
 
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/mapping_3d/frozen_hybrid_grid.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 
 namespace cartographer {
@@ -40,6 +42,10 @@ class PrecomputationGrid : public HybridGridBase<uint8> {
 // but only using 8 bit instead of 2 x 16 bit.
 PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid);
 
+// Same as above, but for the compact copy of a finished HybridGrid.
+PrecomputationGrid ConvertToPrecomputationGrid(
+    const FrozenHybridGrid& hybrid_grid);
+
 // Returns a grid of the same resolution containing the maximum value of
 // original voxels in 'grid'. This maximum is over the 8 voxels that have
 // any combination of index components optionally increased by 'shift'.
@@ -50,6 +56,15 @@ PrecomputationGrid PrecomputeGrid(const PrecomputationGrid& grid,
                                   bool half_resolution,
                                   const Eigen::Array3i& shift);
 
+// Same as above, but the voxels of 'grid' are split into 'num_tasks' ranges
+// which are precomputed into separate grids concurrently, all but one task
+// running on 'thread_pool'. The separate grids are merged at the end.
+PrecomputationGrid PrecomputeGrid(const PrecomputationGrid& grid,
+                                  bool half_resolution,
+                                  const Eigen::Array3i& shift,
+                                  common::ThreadPoolInterface* thread_pool,
+                                  int num_tasks);
+
 }  // namespace scan_matching
 }  // namespace mapping_3d
 }  // namespace cartographer
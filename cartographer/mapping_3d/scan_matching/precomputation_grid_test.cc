@@ -20,6 +20,7 @@
 #include <tuple>
 #include <vector>
 
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 #include "gmock/gmock.h"
 
@@ -76,6 +77,43 @@ TEST(PrecomputedGridGeneratorTest, TestAgainstNaiveAlgorithm) {
   }
 }
 
+TEST(PrecomputedGridGeneratorTest, ParallelMatchesSerial) {
+  HybridGrid hybrid_grid(2.f);
+
+  std::mt19937 rng(23847);
+  std::uniform_int_distribution<int> coordinate_distribution(-50, 49);
+  std::uniform_real_distribution<float> value_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  for (int i = 0; i < 1000; ++i) {
+    const auto x = coordinate_distribution(rng);
+    const auto y = coordinate_distribution(rng);
+    const auto z = coordinate_distribution(rng);
+    hybrid_grid.SetProbability(Eigen::Array3i(x, y, z),
+                               value_distribution(rng));
+  }
+  const PrecomputationGrid grid = ConvertToPrecomputationGrid(hybrid_grid);
+
+  common::ThreadPool thread_pool(3);
+  for (const bool half_resolution : {false, true}) {
+    const Eigen::Array3i shift(1, 2, 3);
+    const PrecomputationGrid expected =
+        PrecomputeGrid(grid, half_resolution, shift);
+    const PrecomputationGrid actual =
+        PrecomputeGrid(grid, half_resolution, shift, &thread_pool, 4);
+    int num_cells = 0;
+    for (auto it = PrecomputationGrid::Iterator(expected); !it.Done();
+         it.Next()) {
+      EXPECT_EQ(it.GetValue(), actual.value(it.GetCellIndex()));
+      ++num_cells;
+    }
+    for (auto it = PrecomputationGrid::Iterator(actual); !it.Done();
+         it.Next()) {
+      --num_cells;
+    }
+    EXPECT_EQ(0, num_cells);
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
@@ -16,10 +16,14 @@
 
 #include "cartographer/mapping_3d/scan_matching/real_time_correlative_scan_matcher.h"
 
+#include <algorithm>
 #include <cmath>
+#include <numeric>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/math.h"
+#include "cartographer/mapping/bounded_probability_sum.h"
+#include "cartographer/mapping/probability_values.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 
@@ -37,15 +41,34 @@ float RealTimeCorrelativeScanMatcher::Match(
     const sensor::PointCloud& point_cloud, const HybridGrid& hybrid_grid,
     transform::Rigid3d* pose_estimate) const {
   CHECK_NOTNULL(pose_estimate);
+  const std::vector<transform::Rigid3f> transforms =
+      GenerateExhaustiveSearchTransforms(hybrid_grid.resolution(), point_cloud);
+  std::vector<float> weights;
+  weights.reserve(transforms.size());
+  for (const transform::Rigid3f& transform : transforms) {
+    weights.push_back(ComputeCandidateWeight(transform));
+  }
+  // Candidates are visited by decreasing weight. The weight times
+  // 'kMaxProbability' bounds the score, so once it is below the best score, no
+  // candidate can beat it.
+  std::vector<int> candidate_indices(transforms.size());
+  std::iota(candidate_indices.begin(), candidate_indices.end(), 0);
+  std::stable_sort(candidate_indices.begin(), candidate_indices.end(),
+                   [&weights](const int lhs, const int rhs) {
+                     return weights[lhs] > weights[rhs];
+                   });
   float best_score = -1.f;
-  for (const transform::Rigid3f& transform : GenerateExhaustiveSearchTransforms(
-           hybrid_grid.resolution(), point_cloud)) {
+  for (const int candidate_index : candidate_indices) {
+    const float weight = weights[candidate_index];
+    if (weight * mapping::kMaxProbability <= best_score) {
+      break;
+    }
     const transform::Rigid3f candidate =
-        initial_pose_estimate.cast<float>() * transform;
-    const float score = ScoreCandidate(
-        hybrid_grid, sensor::TransformPointCloud(point_cloud, candidate),
-        transform);
+        initial_pose_estimate.cast<float>() * transforms[candidate_index];
+    const float score =
+        ScoreCandidate(hybrid_grid, point_cloud, candidate, weight, best_score);
     if (score > best_score) {
+      CHECK_GT(score, 0.f);
       best_score = score;
       *pose_estimate = candidate.cast<double>();
     }
@@ -95,22 +118,25 @@ RealTimeCorrelativeScanMatcher::GenerateExhaustiveSearchTransforms(
   return result;
 }
 
-float RealTimeCorrelativeScanMatcher::ScoreCandidate(
-    const HybridGrid& hybrid_grid,
-    const sensor::PointCloud& transformed_point_cloud,
+float RealTimeCorrelativeScanMatcher::ComputeCandidateWeight(
     const transform::Rigid3f& transform) const {
-  float score = 0.f;
-  for (const Eigen::Vector3f& point : transformed_point_cloud) {
-    score += hybrid_grid.GetProbability(hybrid_grid.GetCellIndex(point));
-  }
-  score /= static_cast<float>(transformed_point_cloud.size());
   const float angle = transform::GetAngle(transform);
-  score *=
-      std::exp(-common::Pow2(transform.translation().norm() *
-                                 options_.translation_delta_cost_weight() +
-                             angle * options_.rotation_delta_cost_weight()));
-  CHECK_GT(score, 0.f);
-  return score;
+  return std::exp(
+      -common::Pow2(transform.translation().norm() *
+                        options_.translation_delta_cost_weight() +
+                    angle * options_.rotation_delta_cost_weight()));
+}
+
+float RealTimeCorrelativeScanMatcher::ScoreCandidate(
+    const HybridGrid& hybrid_grid, const sensor::PointCloud& point_cloud,
+    const transform::Rigid3f& candidate, const float weight,
+    const float min_score) const {
+  const int num_points = point_cloud.size();
+  const mapping::TransformedPointCloudAccessor<HybridGrid> grid_accessor(
+      hybrid_grid, point_cloud, candidate);
+  const float probability_sum = mapping::ComputeBoundedProbabilitySum(
+      grid_accessor, num_points, min_score / weight * num_points);
+  return probability_sum / static_cast<float>(num_points) * weight;
 }
 
 }  // namespace scan_matching
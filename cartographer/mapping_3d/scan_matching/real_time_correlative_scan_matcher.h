@@ -15,7 +15,8 @@
  */
 
 // A voxel accurate scan matcher, exhaustively evaluating the scan matching
-// search space.
+// search space. Candidates which provably cannot beat the best one found so far
+// are skipped.
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_REAL_TIME_CORRELATIVE_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_REAL_TIME_CORRELATIVE_SCAN_MATCHER_H_
 
@@ -52,9 +53,16 @@ class RealTimeCorrelativeScanMatcher {
  private:
   std::vector<transform::Rigid3f> GenerateExhaustiveSearchTransforms(
       float resolution, const sensor::PointCloud& point_cloud) const;
+  // Returns the factor by which the score of a candidate is reduced for the
+  // 'transform' from the initial pose estimate.
+  float ComputeCandidateWeight(const transform::Rigid3f& transform) const;
+  // Returns the score of 'point_cloud' at 'candidate' with the given 'weight'.
+  // Returns early with a lower score once the score is known not to exceed
+  // 'min_score'.
   float ScoreCandidate(const HybridGrid& hybrid_grid,
-                       const sensor::PointCloud& transformed_point_cloud,
-                       const transform::Rigid3f& transform) const;
+                       const sensor::PointCloud& point_cloud,
+                       const transform::Rigid3f& candidate, float weight,
+                       float min_score) const;
 
   const mapping_2d::scan_matching::proto::RealTimeCorrelativeScanMatcherOptions
       options_;
@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <vector>
 
@@ -138,17 +140,20 @@ Eigen::VectorXf RotateHistogram(const Eigen::VectorXf& histogram,
          (1.f - fraction) * rotated_histogram_0;
 }
 
-float MatchHistograms(const Eigen::VectorXf& submap_histogram,
-                      const Eigen::VectorXf& scan_histogram) {
-  // We compute the dot product of normalized histograms as a measure of
-  // similarity.
-  const float scan_histogram_norm = scan_histogram.norm();
-  const float submap_histogram_norm = submap_histogram.norm();
-  const float normalization = scan_histogram_norm * submap_histogram_norm;
-  if (normalization < 1e-3f) {
-    return 1.f;
+// Returns the circular cross-correlation of 'histogram' with 'scan_histogram',
+// i.e. the dot product of 'histogram' with 'scan_histogram' rotated by each
+// number of full buckets. Each entry is computed as a dot product over a
+// contiguous segment of the doubled 'scan_histogram' which Eigen vectorizes.
+Eigen::VectorXf CrossCorrelate(const Eigen::VectorXf& histogram,
+                               const Eigen::VectorXf& scan_histogram) {
+  const int size = scan_histogram.size();
+  Eigen::VectorXf doubled_scan_histogram(2 * size);
+  doubled_scan_histogram << scan_histogram, scan_histogram;
+  Eigen::VectorXf result(size);
+  for (int i = 0; i != size; ++i) {
+    result[i] = histogram.dot(doubled_scan_histogram.segment(i, size));
   }
-  return submap_histogram.dot(scan_histogram) / normalization;
+  return result;
 }
 
 }  // namespace
@@ -174,17 +179,48 @@ RotationalScanMatcher::RotationalScanMatcher(
     histogram_ +=
         RotateHistogram(histogram_at_angle.first, histogram_at_angle.second);
   }
+  histogram_norm_ = histogram_.norm();
 }
 
 std::vector<float> RotationalScanMatcher::Match(
     const Eigen::VectorXf& histogram, const float initial_angle,
     const std::vector<float>& angles) const {
+  // Rotating by a fractional bucket linearly interpolates between the two
+  // neighboring rotations by full buckets, see RotateHistogram(). Hence, the
+  // dot product with 'histogram_' interpolates the cross-correlation, and the
+  // squared norm of the rotated histogram only depends on the norm of
+  // 'histogram' and its correlation with itself rotated by a single bucket.
+  // This scores all 'angles' from two passes over the histograms instead of
+  // rotating 'histogram' for every angle.
+  const int size = histogram.size();
+  const Eigen::VectorXf cross_correlation =
+      CrossCorrelate(histogram_, histogram);
+  const float squared_norm = histogram.squaredNorm();
+  float shifted_dot = 0.f;
+  for (int i = 0; i != size; ++i) {
+    shifted_dot += histogram[i] * histogram[(i + 1) % size];
+  }
   std::vector<float> result;
   result.reserve(angles.size());
   for (const float angle : angles) {
-    const Eigen::VectorXf scan_histogram =
-        RotateHistogram(histogram, initial_angle + angle);
-    result.push_back(MatchHistograms(histogram_, scan_histogram));
+    const float rotate_by_buckets = -(initial_angle + angle) * size / M_PI;
+    int full_buckets = common::RoundToInt(rotate_by_buckets - 0.5f);
+    const float fraction = rotate_by_buckets - full_buckets;
+    full_buckets %= size;
+    if (full_buckets < 0) {
+      full_buckets += size;
+    }
+    const float dot = (1.f - fraction) * cross_correlation[full_buckets] +
+                      fraction * cross_correlation[(full_buckets + 1) % size];
+    const float rotated_squared_norm =
+        ((1.f - fraction) * (1.f - fraction) + fraction * fraction) *
+            squared_norm +
+        2.f * fraction * (1.f - fraction) * shifted_dot;
+    // We compute the dot product of normalized histograms as a measure of
+    // similarity.
+    const float normalization =
+        std::sqrt(std::max(0.f, rotated_squared_norm)) * histogram_norm_;
+    result.push_back(normalization < 1e-3f ? 1.f : dot / normalization);
   }
   return result;
 }
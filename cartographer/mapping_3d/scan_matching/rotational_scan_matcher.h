@@ -48,6 +48,7 @@ class RotationalScanMatcher {
 
  private:
   Eigen::VectorXf histogram_;
+  float histogram_norm_;
 };
 
 }  // namespace scan_matching
@@ -65,6 +65,22 @@ TEST(RotationalScanMatcherTest, InterpolatesAsExpected) {
   }
 }
 
+TEST(RotationalScanMatcherTest, MatchesRotatedHistograms) {
+  constexpr int kNumBuckets = 120;
+  Eigen::VectorXf histogram(kNumBuckets);
+  for (int i = 0; i != kNumBuckets; ++i) {
+    histogram[i] = std::abs(std::sin(0.37f * i * i + 1.f));
+  }
+  for (float angle = -7.f; angle < 7.f; angle += 0.173f) {
+    RotationalScanMatcher matcher({{histogram, angle}});
+    const auto scores =
+        matcher.Match(histogram, 0.5f * angle, {0.5f * angle, 0.3f});
+    ASSERT_EQ(2, scores.size());
+    EXPECT_NEAR(1.f, scores[0], 1e-5);
+    EXPECT_GT(1.f, scores[1]);
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
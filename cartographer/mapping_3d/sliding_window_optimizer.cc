@@ -0,0 +1,313 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/sliding_window_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <tuple>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/ceres_solver_options.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/trace.h"
+#include "cartographer/mapping_3d/acceleration_cost_function.h"
+#include "cartographer/mapping_3d/imu_integration.h"
+#include "cartographer/mapping_3d/rotation_cost_function.h"
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+// Returns the last IMU data not after 'time'.
+std::deque<sensor::ImuData>::const_iterator FindImuData(
+    const std::deque<sensor::ImuData>& imu_data, const common::Time time) {
+  const auto it = std::upper_bound(
+      imu_data.cbegin(), imu_data.cend(), time,
+      [](const common::Time time, const sensor::ImuData& imu) {
+        return time < imu.time;
+      });
+  CHECK(it != imu_data.cbegin()) << "No IMU data before " << time;
+  return std::prev(it);
+}
+
+}  // namespace
+
+proto::SlidingWindowOptimizerOptions CreateSlidingWindowOptimizerOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::SlidingWindowOptimizerOptions options;
+  options.set_num_scans(parameter_dictionary->GetNonNegativeInt("num_scans"));
+  options.set_high_resolution_occupied_space_weight(
+      parameter_dictionary->GetDouble("high_resolution_occupied_space_weight"));
+  options.set_low_resolution_occupied_space_weight(
+      parameter_dictionary->GetDouble("low_resolution_occupied_space_weight"));
+  options.set_rotation_weight(
+      parameter_dictionary->GetDouble("rotation_weight"));
+  options.set_acceleration_weight(
+      parameter_dictionary->GetDouble("acceleration_weight"));
+  *options.mutable_ceres_solver_options() =
+      common::CreateCeresSolverOptionsProto(
+          parameter_dictionary->GetDictionary("ceres_solver_options").get());
+  options.set_max_solver_time_seconds(
+      parameter_dictionary->GetDouble("max_solver_time_seconds"));
+  CHECK_GT(options.max_solver_time_seconds(), 0.);
+  return options;
+}
+
+// Evaluates the occupied space cost of a point cloud in a submap for a pose in
+// the local frame. The pose in the submap frame is a linear function of the
+// local translation and rotation quaternion, so the Jacobians of the
+// OccupiedSpaceCostFunction only need to be multiplied by constant matrices.
+class SlidingWindowOptimizer::LocalOccupiedSpaceCostFunction
+    : public ceres::CostFunction {
+ public:
+  LocalOccupiedSpaceCostFunction(const double scaling_factor,
+                                 const sensor::PointCloud& point_cloud,
+                                 const Submap& submap,
+                                 const HybridGrid& hybrid_grid)
+      : scaling_factor_(scaling_factor),
+        point_cloud_(point_cloud),
+        hybrid_grid_(hybrid_grid),
+        inverse_submap_pose_(submap.local_pose().inverse()),
+        cost_function_(scaling_factor, point_cloud, hybrid_grid) {
+    set_num_residuals(point_cloud.size());
+    mutable_parameter_block_sizes()->push_back(3);
+    mutable_parameter_block_sizes()->push_back(4);
+    const Eigen::Quaterniond& q = inverse_submap_pose_.rotation();
+    // Matrix of the quaternion product with 'q' from the left.
+    left_product_matrix_ << q.w(), -q.x(), -q.y(), -q.z(), q.x(), q.w(), -q.z(),
+        q.y(), q.y(), q.z(), q.w(), -q.x(), q.z(), -q.y(), q.x(), q.w();
+  }
+
+  // Forgets the cached probabilities, since the submap may have changed. The
+  // number of residuals stays the same, so this is fine while the cost function
+  // is part of a ceres::Problem.
+  void UpdateGrid() {
+    cost_function_.Reset(scaling_factor_, point_cloud_, hybrid_grid_);
+  }
+
+  bool Evaluate(double const* const* parameters, double* const residuals,
+                double** const jacobians) const override {
+    const Eigen::Vector3d translation_in_submap =
+        inverse_submap_pose_ * Eigen::Vector3d(parameters[0]);
+    const Eigen::Vector4d rotation_in_submap =
+        left_product_matrix_ * Eigen::Vector4d(parameters[1]);
+    const double* const parameters_in_submap[] = {translation_in_submap.data(),
+                                                  rotation_in_submap.data()};
+    if (jacobians == nullptr) {
+      return cost_function_.Evaluate(parameters_in_submap, residuals, nullptr);
+    }
+    using TranslationJacobian =
+        Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>;
+    using RotationJacobian =
+        Eigen::Matrix<double, Eigen::Dynamic, 4, Eigen::RowMajor>;
+    translation_jacobian_.resize(num_residuals(), 3);
+    rotation_jacobian_.resize(num_residuals(), 4);
+    double* jacobians_in_submap[] = {
+        jacobians[0] == nullptr ? nullptr : translation_jacobian_.data(),
+        jacobians[1] == nullptr ? nullptr : rotation_jacobian_.data()};
+    if (!cost_function_.Evaluate(parameters_in_submap, residuals,
+                                 jacobians_in_submap)) {
+      return false;
+    }
+    if (jacobians[0] != nullptr) {
+      Eigen::Map<TranslationJacobian>(jacobians[0], num_residuals(), 3) =
+          translation_jacobian_ *
+          inverse_submap_pose_.rotation().toRotationMatrix();
+    }
+    if (jacobians[1] != nullptr) {
+      Eigen::Map<RotationJacobian>(jacobians[1], num_residuals(), 4) =
+          rotation_jacobian_ * left_product_matrix_;
+    }
+    return true;
+  }
+
+ private:
+  const double scaling_factor_;
+  const sensor::PointCloud& point_cloud_;
+  const HybridGrid& hybrid_grid_;
+  const transform::Rigid3d inverse_submap_pose_;
+  Eigen::Matrix4d left_product_matrix_;
+  scan_matching::OccupiedSpaceCostFunction cost_function_;
+  // Jacobians with respect to the pose in the submap frame.
+  mutable Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>
+      translation_jacobian_;
+  mutable Eigen::Matrix<double, Eigen::Dynamic, 4, Eigen::RowMajor>
+      rotation_jacobian_;
+};
+
+SlidingWindowOptimizer::SlidingWindowOptimizer(
+    const proto::SlidingWindowOptimizerOptions& options)
+    : options_(options),
+      ceres_solver_options_([&options] {
+        ceres::Solver::Options ceres_solver_options =
+            common::CreateCeresSolverOptions(options.ceres_solver_options());
+        ceres_solver_options.max_solver_time_in_seconds =
+            options.max_solver_time_seconds();
+        return ceres_solver_options;
+      }()) {
+  CHECK_GT(options_.num_scans(), 0);
+  ceres::Problem::Options problem_options;
+  // Every scan leaving the window removes its parameter blocks.
+  problem_options.enable_fast_removal = true;
+  problem_ = common::make_unique<ceres::Problem>(problem_options);
+  problem_->AddParameterBlock(&gravity_constant_, 1);
+  problem_->SetParameterBlockConstant(&gravity_constant_);
+  problem_->AddParameterBlock(imu_calibration_.data(), 4);
+  problem_->SetParameterBlockConstant(imu_calibration_.data());
+}
+
+SlidingWindowOptimizer::~SlidingWindowOptimizer() {}
+
+void SlidingWindowOptimizer::AddImuData(const sensor::ImuData& imu_data) {
+  CHECK(imu_data_.empty() || imu_data_.back().time <= imu_data.time);
+  imu_data_.push_back(imu_data);
+}
+
+transform::Rigid3d SlidingWindowOptimizer::AddScan(
+    const common::Time time, const transform::Rigid3d& pose_estimate,
+    std::shared_ptr<const Submap> submap,
+    const sensor::PointCloud& high_resolution_point_cloud,
+    const sensor::PointCloud& low_resolution_point_cloud) {
+  CARTOGRAPHER_TRACE_SPAN("SlidingWindowOptimizer::AddScan");
+  CHECK(scans_.empty() || scans_.back()->time < time);
+  scans_.push_back(common::make_unique<Scan>(
+      Scan{time,
+           std::move(submap),
+           high_resolution_point_cloud,
+           low_resolution_point_cloud,
+           {{pose_estimate.translation().x(), pose_estimate.translation().y(),
+             pose_estimate.translation().z()}},
+           {{pose_estimate.rotation().w(), pose_estimate.rotation().x(),
+             pose_estimate.rotation().y(), pose_estimate.rotation().z()}},
+           {}}));
+  Scan& scan = *scans_.back();
+  problem_->AddParameterBlock(scan.translation.data(), 3);
+  problem_->AddParameterBlock(scan.rotation.data(), 4,
+                              new ceres::QuaternionParameterization());
+  for (const auto& point_cloud_and_grid :
+       {std::make_tuple(&scan.high_resolution_point_cloud,
+                        &scan.submap->high_resolution_hybrid_grid(),
+                        options_.high_resolution_occupied_space_weight()),
+        std::make_tuple(&scan.low_resolution_point_cloud,
+                        &scan.submap->low_resolution_hybrid_grid(),
+                        options_.low_resolution_occupied_space_weight())}) {
+    const sensor::PointCloud& point_cloud = *std::get<0>(point_cloud_and_grid);
+    if (point_cloud.empty()) {
+      continue;
+    }
+    scan.occupied_space_cost_functions.push_back(
+        new LocalOccupiedSpaceCostFunction(
+            std::get<2>(point_cloud_and_grid) /
+                std::sqrt(static_cast<double>(point_cloud.size())),
+            point_cloud, *scan.submap, *std::get<1>(point_cloud_and_grid)));
+    problem_->AddResidualBlock(scan.occupied_space_cost_functions.back(),
+                               nullptr, scan.translation.data(),
+                               scan.rotation.data());
+  }
+  if (scans_.size() > 1) {
+    AddImuResiduals();
+  }
+  while (static_cast<int>(scans_.size()) > options_.num_scans()) {
+    RemoveOldestScan();
+  }
+  // The oldest scan in the window anchors the others.
+  problem_->SetParameterBlockConstant(scans_.front()->translation.data());
+  problem_->SetParameterBlockConstant(scans_.front()->rotation.data());
+  if (scans_.size() == 1) {
+    return pose_estimate;
+  }
+
+  // Insertions since the last scan changed the submaps.
+  for (const auto& window_scan : scans_) {
+    for (LocalOccupiedSpaceCostFunction* const cost_function :
+         window_scan->occupied_space_cost_functions) {
+      cost_function->UpdateGrid();
+    }
+  }
+  ceres::Solver::Summary summary;
+  ceres::Solve(ceres_solver_options_, problem_.get(), &summary);
+  return transform::Rigid3d(
+      Eigen::Vector3d(scan.translation[0], scan.translation[1],
+                      scan.translation[2]),
+      Eigen::Quaterniond(scan.rotation[0], scan.rotation[1], scan.rotation[2],
+                         scan.rotation[3]));
+}
+
+void SlidingWindowOptimizer::AddImuResiduals() {
+  const auto last = std::prev(scans_.end());
+  Scan& first_scan = **std::prev(last);
+  Scan& second_scan = **last;
+  auto imu_it = FindImuData(imu_data_, first_scan.time);
+  const IntegrateImuResult<double> result =
+      IntegrateImu(imu_data_, first_scan.time, second_scan.time, &imu_it);
+  problem_->AddResidualBlock(
+      new ceres::AutoDiffCostFunction<RotationCostFunction, 3, 4, 4, 4>(
+          new RotationCostFunction(options_.rotation_weight(),
+                                   result.delta_rotation)),
+      nullptr, first_scan.rotation.data(), second_scan.rotation.data(),
+      imu_calibration_.data());
+  if (scans_.size() < 3) {
+    return;
+  }
+
+  // As in the 3D optimization problem, the velocity delta is integrated
+  // between the centers of the two intervals around 'first_scan'.
+  Scan& zeroth_scan = **std::prev(last, 2);
+  const common::Duration first_duration = first_scan.time - zeroth_scan.time;
+  const common::Duration second_duration = second_scan.time - first_scan.time;
+  const common::Time first_center = zeroth_scan.time + first_duration / 2;
+  const common::Time second_center = first_scan.time + second_duration / 2;
+  imu_it = FindImuData(imu_data_, first_center);
+  const IntegrateImuResult<double> result_center_to_first =
+      IntegrateImu(imu_data_, first_center, first_scan.time, &imu_it);
+  imu_it = FindImuData(imu_data_, first_center);
+  const IntegrateImuResult<double> result_center_to_center =
+      IntegrateImu(imu_data_, first_center, second_center, &imu_it);
+  // The velocity delta in the IMU frame at 'first_scan'.
+  const Eigen::Vector3d delta_velocity =
+      result_center_to_first.delta_rotation.inverse() *
+      result_center_to_center.delta_velocity;
+  problem_->AddResidualBlock(
+      new ceres::AutoDiffCostFunction<AccelerationCostFunction, 3, 4, 3, 3, 3,
+                                      1, 4>(new AccelerationCostFunction(
+          options_.acceleration_weight(), delta_velocity,
+          common::ToSeconds(first_duration),
+          common::ToSeconds(second_duration))),
+      nullptr, first_scan.rotation.data(), zeroth_scan.translation.data(),
+      first_scan.translation.data(), second_scan.translation.data(),
+      &gravity_constant_, imu_calibration_.data());
+}
+
+void SlidingWindowOptimizer::RemoveOldestScan() {
+  // Removing the parameter blocks also removes all residual blocks using them,
+  // which deletes the occupied space cost functions.
+  problem_->RemoveParameterBlock(scans_.front()->translation.data());
+  problem_->RemoveParameterBlock(scans_.front()->rotation.data());
+  scans_.pop_front();
+  // Keep the last IMU data not after the oldest scan.
+  const common::Time oldest_time = scans_.front()->time;
+  while (imu_data_.size() > 1 && imu_data_[1].time <= oldest_time) {
+    imu_data_.pop_front();
+  }
+}
+
+}  // namespace mapping_3d
+}  // namespace cartographer
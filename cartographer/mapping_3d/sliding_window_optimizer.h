@@ -0,0 +1,100 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_3D_SLIDING_WINDOW_OPTIMIZER_H_
+#define CARTOGRAPHER_MAPPING_3D_SLIDING_WINDOW_OPTIMIZER_H_
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping_3d/proto/sliding_window_optimizer_options.pb.h"
+#include "cartographer/mapping_3d/submaps.h"
+#include "cartographer/sensor/imu_data.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "ceres/ceres.h"
+
+namespace cartographer {
+namespace mapping_3d {
+
+proto::SlidingWindowOptimizerOptions CreateSlidingWindowOptimizerOptions(
+    common::LuaParameterDictionary* parameter_dictionary);
+
+// Refines the poses of the most recent scans jointly after each of them was
+// matched on its own. The residuals are those of the point clouds in the
+// submaps each scan was matched against and IMU residuals between consecutive
+// scans. The ceres::Problem is kept between scans: a new scan adds its pose
+// and residuals, and the scan leaving the window is removed together with its
+// residuals.
+//
+// Poses are in the local frame, in which gravity is along the z-axis.
+class SlidingWindowOptimizer {
+ public:
+  explicit SlidingWindowOptimizer(
+      const proto::SlidingWindowOptimizerOptions& options);
+  ~SlidingWindowOptimizer();
+
+  SlidingWindowOptimizer(const SlidingWindowOptimizer&) = delete;
+  SlidingWindowOptimizer& operator=(const SlidingWindowOptimizer&) = delete;
+
+  // IMU data must be added in time order and start before the first scan.
+  void AddImuData(const sensor::ImuData& imu_data);
+
+  // Adds the scan at 'time' which was matched against 'submap' at
+  // 'pose_estimate', and returns its refined pose. The point clouds are in the
+  // tracking frame and are copied.
+  transform::Rigid3d AddScan(
+      common::Time time, const transform::Rigid3d& pose_estimate,
+      std::shared_ptr<const Submap> submap,
+      const sensor::PointCloud& high_resolution_point_cloud,
+      const sensor::PointCloud& low_resolution_point_cloud);
+
+ private:
+  class LocalOccupiedSpaceCostFunction;
+
+  struct Scan {
+    common::Time time;
+    std::shared_ptr<const Submap> submap;
+    sensor::PointCloud high_resolution_point_cloud;
+    sensor::PointCloud low_resolution_point_cloud;
+    std::array<double, 3> translation;
+    std::array<double, 4> rotation;
+    // Owned by the 'problem_', which deletes them with the pose of the scan.
+    std::vector<LocalOccupiedSpaceCostFunction*> occupied_space_cost_functions;
+  };
+
+  void AddImuResiduals();
+  void RemoveOldestScan();
+
+  const proto::SlidingWindowOptimizerOptions options_;
+  const ceres::Solver::Options ceres_solver_options_;
+  std::unique_ptr<ceres::Problem> problem_;
+  // Scans are kept in unique_ptrs, so that the parameter blocks do not move.
+  std::deque<std::unique_ptr<Scan>> scans_;
+  std::deque<sensor::ImuData> imu_data_;
+  // Constant in the problem, but parameter blocks of the IMU residuals.
+  double gravity_constant_ = 9.8;
+  std::array<double, 4> imu_calibration_{{1., 0., 0., 0.}};
+};
+
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_3D_SLIDING_WINDOW_OPTIMIZER_H_
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/sliding_window_optimizer.h"
+
+#include <memory>
+
+#include "Eigen/Core"
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping_3d/range_data_inserter.h"
+#include "cartographer/sensor/range_data.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+class SlidingWindowOptimizerTest : public ::testing::Test {
+ protected:
+  SlidingWindowOptimizerTest()
+      : submap_(std::make_shared<Submap>(0.2f, 0.5f,
+                                         transform::Rigid3d::Identity())) {
+    // Points on the walls, floor and ceiling of a box around the origin.
+    for (float a = -2.f; a <= 2.f; a += 0.1f) {
+      for (float b = -2.f; b <= 2.f; b += 0.1f) {
+        point_cloud_.push_back(Eigen::Vector3f(3.f, a, 0.5f * b));
+        point_cloud_.push_back(Eigen::Vector3f(-3.f, a, 0.5f * b));
+        point_cloud_.push_back(Eigen::Vector3f(a, 2.5f, 0.5f * b));
+        point_cloud_.push_back(Eigen::Vector3f(a, -2.5f, 0.5f * b));
+        point_cloud_.push_back(Eigen::Vector3f(a, b, -1.f));
+        point_cloud_.push_back(Eigen::Vector3f(a, b, 1.5f));
+      }
+    }
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          hit_probability = 0.7,
+          miss_probability = 0.4,
+          num_free_space_voxels = 0,
+          num_threads = 1,
+        })text");
+    const RangeDataInserter range_data_inserter(
+        CreateRangeDataInserterOptions(parameter_dictionary.get()));
+    for (int i = 0; i != 3; ++i) {
+      submap_->InsertRangeData(
+          sensor::RangeData{Eigen::Vector3f::Zero(), point_cloud_, {}},
+          range_data_inserter, 50 /* high_resolution_max_range */);
+    }
+  }
+
+  proto::SlidingWindowOptimizerOptions CreateOptions() {
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          num_scans = 4,
+          high_resolution_occupied_space_weight = 5.,
+          low_resolution_occupied_space_weight = 5.,
+          rotation_weight = 1e2,
+          acceleration_weight = 1.,
+          ceres_solver_options = {
+            use_nonmonotonic_steps = false,
+            max_num_iterations = 20,
+            num_threads = 1,
+          },
+          max_solver_time_seconds = 1.,
+        })text");
+    return CreateSlidingWindowOptimizerOptions(parameter_dictionary.get());
+  }
+
+  // Adds IMU data of a tracking frame at rest between 'start' and 'end'.
+  void AddStationaryImuData(const common::Time start, const common::Time end,
+                            SlidingWindowOptimizer* const optimizer) {
+    for (common::Time time = start; time <= end;
+         time += common::FromSeconds(0.01)) {
+      optimizer->AddImuData(sensor::ImuData{
+          time, Eigen::Vector3d(0., 0., 9.8), Eigen::Vector3d::Zero()});
+    }
+  }
+
+  std::shared_ptr<Submap> submap_;
+  sensor::PointCloud point_cloud_;
+};
+
+TEST_F(SlidingWindowOptimizerTest, KeepsFirstPose) {
+  SlidingWindowOptimizer optimizer(CreateOptions());
+  const common::Time time = common::FromUniversal(1000000);
+  AddStationaryImuData(time - common::FromSeconds(1.), time, &optimizer);
+  const transform::Rigid3d pose_estimate =
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.1, 0., 0.));
+  EXPECT_THAT(optimizer.AddScan(time, pose_estimate, submap_, point_cloud_,
+                                point_cloud_),
+              transform::IsNearly(pose_estimate, 1e-9));
+}
+
+TEST_F(SlidingWindowOptimizerTest, RefinesPoseEstimates) {
+  SlidingWindowOptimizer optimizer(CreateOptions());
+  const common::Time start_time = common::FromUniversal(1000000);
+  AddStationaryImuData(start_time - common::FromSeconds(1.),
+                       start_time + common::FromSeconds(2.), &optimizer);
+  optimizer.AddScan(start_time, transform::Rigid3d::Identity(), submap_,
+                    point_cloud_, point_cloud_);
+  // More scans than fit into the window, all estimated with the same error.
+  const transform::Rigid3d pose_estimate =
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.1, -0.05, 0.05));
+  for (int i = 1; i != 8; ++i) {
+    const transform::Rigid3d pose = optimizer.AddScan(
+        start_time + common::FromSeconds(0.1 * i), pose_estimate, submap_,
+        point_cloud_, point_cloud_);
+    EXPECT_LT(pose.translation().norm(),
+              0.5 * pose_estimate.translation().norm());
+    EXPECT_THAT(pose, transform::IsNearly(transform::Rigid3d::Identity(), 0.1));
+  }
+}
+
+}  // namespace
+}  // namespace mapping_3d
+}  // namespace cartographer
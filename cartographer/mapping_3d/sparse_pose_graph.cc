@@ -17,19 +17,25 @@
 #include "cartographer/mapping_3d/sparse_pose_graph.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "Eigen/Eigenvalues"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
+#include "cartographer/common/trace.h"
+#include "cartographer/mapping/sparse_pose_graph/place_descriptor.h"
 #include "cartographer/mapping/sparse_pose_graph/proto/constraint_builder_options.pb.h"
 #include "cartographer/sensor/compressed_point_cloud.h"
 #include "cartographer/sensor/voxel_filter.h"
@@ -38,13 +44,65 @@
 namespace cartographer {
 namespace mapping_3d {
 
+namespace {
+
+// Work items run per task draining the 'work_queue_', before 'mutex_' is
+// released.
+constexpr int kMaxNumWorkItemsPerDrain = 16;
+
+template <typename IdType>
+mapping::sparse_pose_graph::SpatialIndex<IdType>* GetOrCreateSpatialIndex(
+    const int trajectory_id, const double cell_size,
+    std::map<int, mapping::sparse_pose_graph::SpatialIndex<IdType>>*
+        spatial_indices) {
+  auto it = spatial_indices->find(trajectory_id);
+  if (it == spatial_indices->end()) {
+    it = spatial_indices
+             ->emplace(trajectory_id,
+                       mapping::sparse_pose_graph::SpatialIndex<IdType>(
+                           cell_size))
+             .first;
+  }
+  return &it->second;
+}
+
+}  // namespace
+
 SparsePoseGraph::SparsePoseGraph(
     const mapping::proto::SparsePoseGraphOptions& options,
-    common::ThreadPool* thread_pool)
-    : options_(options),
+    common::ThreadPoolInterface* thread_pool)
+    : SparsePoseGraph(options, common::WorkloadThreadPools(thread_pool)) {}
+
+SparsePoseGraph::SparsePoseGraph(
+    const mapping::proto::SparsePoseGraphOptions& options,
+    const common::WorkloadThreadPools& thread_pools)
+    : options_(mapping::ApplyDeterministicMode(options)),
+      thread_pool_(thread_pools.constraints),
+      cross_trajectory_search_budget_(
+          options_.cross_trajectory_search_area_size(),
+          options_.max_cross_trajectory_searches_per_area()),
+      load_shedding_controller_(options_.load_shedding_options()),
       optimization_problem_(options_.optimization_problem_options(),
                             sparse_pose_graph::OptimizationProblem::FixZ::kNo),
-      constraint_builder_(options_.constraint_builder_options(), thread_pool) {}
+      constraint_builder_(options_.constraint_builder_options(), thread_pools),
+      change_log_(options_.max_num_change_log_entries()),
+      constraints_(&change_log_),
+      snapshot_(std::make_shared<Snapshot>(Snapshot{0, {}, {}, {}})),
+      optimization_thread_(common::make_unique<common::ThreadPool>(
+          1, std::vector<int>(), thread_pools.optimization_nice_level)) {
+  optimize_every_n_scans_ = options_.optimize_every_n_scans();
+  global_sampling_ratio_ = options_.global_sampling_ratio();
+  // Releasing the 'mutex_' wakes up WaitForAllComputations() to check the
+  // number of finished scans again.
+  constraint_builder_.SetScanFinishedCallback(
+      [this]() { common::MutexLocker locker(&mutex_); });
+  if (options_.cost_attribution_num_top_submaps() > 0) {
+    cost_attribution_ =
+        common::make_unique<mapping::sparse_pose_graph::CostAttribution>(
+            options_.cost_attribution_num_top_submaps());
+    constraint_builder_.SetCostAttribution(cost_attribution_.get());
+  }
+}
 
 SparsePoseGraph::~SparsePoseGraph() {
   WaitForAllComputations();
@@ -52,6 +110,28 @@ SparsePoseGraph::~SparsePoseGraph() {
   CHECK(work_queue_ == nullptr);
 }
 
+void SparsePoseGraph::RegisterMetrics(metrics::Registry* const registry) {
+  common::MutexLocker locker(&mutex_);
+  work_queue_size_metric_ = registry->GetGauge(
+      "cartographer_sparse_pose_graph_work_queue_size",
+      "Number of work items waiting for the optimization to finish.");
+  optimization_time_metric_ = registry->GetHistogram(
+      "cartographer_sparse_pose_graph_optimization_seconds",
+      "Time it took to solve the optimization problem.", {},
+      metrics::Histogram::ScaledPowersOf(2., 1e-3, 100.));
+  interrupted_optimizations_metric_ = registry->GetCounter(
+      "cartographer_sparse_pose_graph_interrupted_optimizations_total",
+      "Number of optimizations ended early because of new work.");
+  final_constraint_searches_metric_ = registry->GetCounter(
+      "cartographer_sparse_pose_graph_final_constraint_searches_total",
+      "Number of constraint searches scheduled before the final "
+      "optimization.");
+  constraint_builder_.RegisterMetrics(registry);
+  if (cost_attribution_ != nullptr) {
+    cost_attribution_->RegisterMetrics(registry);
+  }
+}
+
 std::vector<mapping::SubmapId> SparsePoseGraph::GrowSubmapTransformsAsNeeded(
     const int trajectory_id,
     const std::vector<std::shared_ptr<const Submap>>& insertion_submaps) {
@@ -72,7 +152,7 @@ std::vector<mapping::SubmapId> SparsePoseGraph::GrowSubmapTransformsAsNeeded(
   CHECK_EQ(2, insertion_submaps.size());
   CHECK(!submap_data.at(trajectory_id).empty());
   const mapping::SubmapId last_submap_id{
-      trajectory_id, submap_data.at(trajectory_id).rbegin()->first};
+      trajectory_id, submap_data.at(trajectory_id).last_index()};
   if (submap_data_.at(last_submap_id).submap == insertion_submaps.front()) {
     // In this case, 'last_submap_id' is the ID of 'insertions_submaps.front()'
     // and 'insertions_submaps.back()' is new.
@@ -96,14 +176,27 @@ void SparsePoseGraph::AddScan(
     std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data,
     const int trajectory_id,
     const std::vector<std::shared_ptr<const Submap>>& insertion_submaps) {
-  const transform::Rigid3d optimized_pose(
-      GetLocalToGlobalTransform(trajectory_id) * constant_data->initial_pose);
-
+  CARTOGRAPHER_TRACE_SPAN("SparsePoseGraph::AddScan");
+  if (options_.compress_node_point_clouds()) {
+    constant_data = std::make_shared<const mapping::TrajectoryNode::Data>(
+        mapping::CompressPointClouds(*constant_data));
+  }
   common::MutexLocker locker(&mutex_);
+  WaitForWorkQueueCapacity(&locker);
+  const transform::Rigid3d optimized_pose(
+      ComputeLocalToGlobalTransform(optimized_submap_transforms_,
+                                    trajectory_id) *
+      constant_data->initial_pose);
   AddTrajectoryIfNeeded(trajectory_id);
-  trajectory_nodes_.Append(
-      trajectory_id, mapping::TrajectoryNode{constant_data, optimized_pose});
+  const mapping::NodeId node_id = trajectory_nodes_.Append(
+      trajectory_id,
+      mapping::TrajectoryNode{std::move(constant_data), optimized_pose});
+  node_time_index_.Insert(node_id,
+                          trajectory_nodes_.at(node_id).constant_data->time);
+  change_log_.ChangeNode(node_id);
   ++num_trajectory_nodes_;
+  ++num_added_scans_;
+  UpdateLoadShedding();
 
   // Test if the 'insertion_submap.back()' is one we never saw before.
   if (trajectory_id >= submap_data_.num_trajectories() ||
@@ -129,10 +222,56 @@ void SparsePoseGraph::AddScan(
 }
 
 void SparsePoseGraph::AddWorkItem(const std::function<void()>& work_item) {
+  GetWorkQueue()->AddTask(work_item);
+  UpdateWorkQueueSizeMetric();
+  InterruptOptimizationIfNeeded();
+}
+
+mapping::sparse_pose_graph::WorkQueue* SparsePoseGraph::GetWorkQueue() {
   if (work_queue_ == nullptr) {
-    work_item();
-  } else {
-    work_queue_->push_back(work_item);
+    // Nobody is working on the queue, so we schedule a task to drain it. The
+    // calling thread only has to hold 'mutex_' to enqueue.
+    work_queue_ = common::make_unique<mapping::sparse_pose_graph::WorkQueue>();
+    ScheduleDrainWorkQueue();
+  }
+  return work_queue_.get();
+}
+
+void SparsePoseGraph::ScheduleDrainWorkQueue() {
+  thread_pool_->Schedule(
+      [this]() {
+        common::MutexLocker locker(&mutex_);
+        DrainWorkQueue();
+      },
+      common::WorkItemPriority::kHigh, "sparse_pose_graph_work_queue");
+}
+
+void SparsePoseGraph::WaitForWorkQueueCapacity(common::MutexLocker* locker) {
+  const int max_work_queue_size = options_.max_work_queue_size();
+  if (max_work_queue_size == 0) {
+    return;
+  }
+  locker->Await(&work_queue_capacity_available_,
+                [this, max_work_queue_size]() REQUIRES(mutex_) {
+                  return work_queue_ == nullptr ||
+                         work_queue_->size() < max_work_queue_size;
+                });
+}
+
+void SparsePoseGraph::UpdateWorkQueueSizeMetric() {
+  if (work_queue_size_metric_ != nullptr) {
+    work_queue_size_metric_->Set(
+        work_queue_ == nullptr ? 0 : work_queue_->size());
+  }
+}
+
+void SparsePoseGraph::InterruptOptimizationIfNeeded() {
+  const int interrupt_optimization_work_queue_size =
+      options_.interrupt_optimization_work_queue_size();
+  if (interrupt_optimization_work_queue_size > 0 && run_loop_closure_ &&
+      work_queue_ != nullptr &&
+      work_queue_->size() >= interrupt_optimization_work_queue_size) {
+    interrupt_optimization_ = true;
   }
 }
 
@@ -142,24 +281,56 @@ void SparsePoseGraph::AddTrajectoryIfNeeded(const int trajectory_id) {
   if (!global_localization_samplers_[trajectory_id]) {
     global_localization_samplers_[trajectory_id] =
         common::make_unique<common::FixedRatioSampler>(
-            options_.global_sampling_ratio());
+            global_sampling_ratio_);
+  }
+}
+
+void SparsePoseGraph::UpdateLoadShedding() {
+  load_shedding_controller_.Update(
+      num_added_scans_ - constraint_builder_.GetNumFinishedScans(),
+      constraint_builder_.GetPendingSearchSeconds());
+  const double factor = load_shedding_controller_.sampling_ratio_factor();
+  constraint_builder_.SetSamplingRatioFactor(factor);
+  for (const auto& entry : global_localization_samplers_) {
+    entry.second->SetRatio(global_sampling_ratio_ * factor);
   }
 }
 
 void SparsePoseGraph::AddImuData(const int trajectory_id,
                                  const sensor::ImuData& imu_data) {
-  common::MutexLocker locker(&mutex_);
-  AddWorkItem([=]() REQUIRES(mutex_) {
-    optimization_problem_.AddImuData(trajectory_id, imu_data);
-  });
+  AddImuData(trajectory_id, std::vector<sensor::ImuData>{imu_data});
 }
 
 void SparsePoseGraph::AddOdometerData(
     const int trajectory_id, const sensor::OdometryData& odometry_data) {
+  AddOdometerData(trajectory_id,
+                  std::vector<sensor::OdometryData>{odometry_data});
+}
+
+void SparsePoseGraph::AddImuData(const int trajectory_id,
+                                 std::vector<sensor::ImuData> imu_data) {
+  if (imu_data.empty()) {
+    return;
+  }
   common::MutexLocker locker(&mutex_);
-  AddWorkItem([=]() REQUIRES(mutex_) {
-    optimization_problem_.AddOdometerData(trajectory_id, odometry_data);
-  });
+  WaitForWorkQueueCapacity(&locker);
+  // Samples following other samples of this trajectory are appended to the
+  // same work item.
+  GetWorkQueue()->AddImuData(trajectory_id, imu_data);
+  UpdateWorkQueueSizeMetric();
+  InterruptOptimizationIfNeeded();
+}
+
+void SparsePoseGraph::AddOdometerData(
+    const int trajectory_id, std::vector<sensor::OdometryData> odometry_data) {
+  if (odometry_data.empty()) {
+    return;
+  }
+  common::MutexLocker locker(&mutex_);
+  WaitForWorkQueueCapacity(&locker);
+  GetWorkQueue()->AddOdometryData(trajectory_id, odometry_data);
+  UpdateWorkQueueSizeMetric();
+  InterruptOptimizationIfNeeded();
 }
 
 void SparsePoseGraph::AddFixedFramePoseData(
@@ -172,10 +343,53 @@ void SparsePoseGraph::AddFixedFramePoseData(
   });
 }
 
+bool SparsePoseGraph::IsMatchingAllowed(const int node_trajectory_id,
+                                        const int submap_trajectory_id) {
+  // Submaps of localization trajectories are trimmed soon, so building scan
+  // matchers for them does not pay off. Nodes of localization trajectories
+  // are only constrained to the frozen map they localize against.
+  if (localization_trajectories_.count(submap_trajectory_id) != 0) {
+    return false;
+  }
+  return localization_trajectories_.count(node_trajectory_id) == 0 ||
+         frozen_trajectories_.count(submap_trajectory_id) != 0;
+}
+
+bool SparsePoseGraph::IsLocalConstraintSearch(
+    const mapping::NodeId& node_id, const mapping::SubmapId& submap_id) {
+  // If the scan and the submap belong to the same trajectory, if the submap
+  // belongs to a merged piece of the map in the same frame, or if there has
+  // been a recent global constraint that ties that scan's trajectory to the
+  // submap's trajectory, it suffices to do a match constrained to a local
+  // search window.
+  if (node_id.trajectory_id == submap_id.trajectory_id ||
+      merged_trajectories_.count(submap_id.trajectory_id) != 0) {
+    return true;
+  }
+  const common::Time scan_time = GetLatestScanTime(node_id, submap_id);
+  const common::Time last_connection_time =
+      trajectory_connectivity_state_.LastConnectionTime(
+          node_id.trajectory_id, submap_id.trajectory_id);
+  return scan_time <
+         last_connection_time +
+             common::FromSeconds(
+                 options_.global_constraint_search_after_n_seconds());
+}
+
 void SparsePoseGraph::ComputeConstraint(const mapping::NodeId& node_id,
                                         const mapping::SubmapId& submap_id) {
   CHECK(submap_data_.at(submap_id).state == SubmapState::kFinished);
 
+  const bool local_search = IsLocalConstraintSearch(node_id, submap_id);
+  if (!local_search &&
+      (load_shedding_controller_.skip_global_localization() ||
+       !global_localization_samplers_[node_id.trajectory_id]->Pulse())) {
+    return;
+  }
+  if (!AcquireCrossTrajectorySearch(node_id, submap_id)) {
+    return;
+  }
+
   const transform::Rigid3d inverse_submap_pose =
       optimization_problem_.submap_data()
           .at(submap_id.trajectory_id)
@@ -196,24 +410,12 @@ void SparsePoseGraph::ComputeConstraint(const mapping::NodeId& node_id,
         inverse_submap_pose * trajectory_nodes_.at(submap_node_id).pose});
   }
 
-  const common::Time scan_time = GetLatestScanTime(node_id, submap_id);
-  const common::Time last_connection_time =
-      trajectory_connectivity_state_.LastConnectionTime(
-          node_id.trajectory_id, submap_id.trajectory_id);
-  if (node_id.trajectory_id == submap_id.trajectory_id ||
-      scan_time <
-          last_connection_time +
-              common::FromSeconds(
-                  options_.global_constraint_search_after_n_seconds())) {
-    // If the scan and the submap belong to the same trajectory or if there has
-    // been a recent global constraint that ties that scan's trajectory to the
-    // submap's trajectory, it suffices to do a match constrained to a local
-    // search window.
+  if (local_search) {
     constraint_builder_.MaybeAddConstraint(
         submap_id, submap_data_.at(submap_id).submap.get(), node_id,
         trajectory_nodes_.at(node_id).constant_data.get(), submap_nodes,
         initial_relative_pose);
-  } else if (global_localization_samplers_[node_id.trajectory_id]->Pulse()) {
+  } else {
     // In this situation, 'initial_relative_pose' is:
     //
     // submap <- global map 2 <- global map 1 <- tracking
@@ -233,27 +435,294 @@ void SparsePoseGraph::ComputeConstraint(const mapping::NodeId& node_id,
   }
 }
 
+bool SparsePoseGraph::AcquireCrossTrajectorySearch(
+    const mapping::NodeId& node_id, const mapping::SubmapId& submap_id) {
+  if (node_id.trajectory_id == submap_id.trajectory_id) {
+    return true;
+  }
+  return cross_trajectory_search_budget_.TryAcquire(
+      node_id.trajectory_id,
+      optimization_problem_.node_data()
+          .at(node_id.trajectory_id)
+          .at(node_id.node_index)
+          .pose.translation()
+          .head<2>(),
+      submap_id.trajectory_id,
+      optimization_problem_.submap_data()
+          .at(submap_id.trajectory_id)
+          .at(submap_id.submap_index)
+          .pose.translation()
+          .head<2>());
+}
+
 void SparsePoseGraph::ComputeConstraintsForOldScans(
     const mapping::SubmapId& submap_id) {
   const auto& submap_data = submap_data_.at(submap_id);
   const auto& node_data = optimization_problem_.node_data();
+  const auto submap_translation = optimization_problem_.submap_data()
+                                      .at(submap_id.trajectory_id)
+                                      .at(submap_id.submap_index)
+                                      .pose.translation();
+  const double max_constraint_distance =
+      options_.constraint_builder_options().max_constraint_distance();
+  // Nodes to match in a local search window by their distance to the submap,
+  // and nodes to match against the full submap. Local searches beyond the
+  // 'max_constraint_distance' are rejected by the constraint builder anyway,
+  // so they are not scheduled at all.
+  std::vector<std::pair<double, mapping::NodeId>> local_search_node_ids;
+  std::vector<mapping::NodeId> global_search_node_ids;
   for (size_t trajectory_id = 0; trajectory_id != node_data.size();
        ++trajectory_id) {
-    for (const auto& index_node_data : node_data[trajectory_id]) {
-      const mapping::NodeId node_id{static_cast<int>(trajectory_id),
-                                    index_node_data.first};
+    if (!IsMatchingAllowed(trajectory_id, submap_id.trajectory_id)) {
+      continue;
+    }
+    std::vector<mapping::NodeId> node_ids;
+    if (static_cast<int>(trajectory_id) == submap_id.trajectory_id) {
+      // Nodes of the submap's own trajectory are only matched in a local
+      // search window, so only nodes near the submap need to be considered.
+      const auto it = node_indices_.find(trajectory_id);
+      if (it != node_indices_.end()) {
+        node_ids = it->second.GetCandidates(
+            optimization_problem_.submap_data()
+                .at(submap_id.trajectory_id)
+                .at(submap_id.submap_index)
+                .pose.translation().head<2>());
+      }
+    } else {
+      for (const auto& index_node_data : node_data[trajectory_id]) {
+        node_ids.push_back(mapping::NodeId{static_cast<int>(trajectory_id),
+                                           index_node_data.first});
+      }
+    }
+    for (const mapping::NodeId& node_id : node_ids) {
       CHECK(!trajectory_nodes_.at(node_id).trimmed());
-      if (submap_data.node_ids.count(node_id) == 0) {
-        ComputeConstraint(node_id, submap_id);
+      // The submap was just finished, so no search against it can be pending
+      // and the nodes inserted into it are the only ones constrained to it.
+      if (submap_data.node_ids.count(node_id) != 0) {
+        continue;
+      }
+      if (!IsLocalConstraintSearch(node_id, submap_id)) {
+        global_search_node_ids.push_back(node_id);
+        continue;
+      }
+      const double distance = (node_data.at(node_id.trajectory_id)
+                                   .at(node_id.node_index)
+                                   .pose.translation() -
+                               submap_translation)
+                                  .norm();
+      if (distance <= max_constraint_distance) {
+        local_search_node_ids.emplace_back(distance, node_id);
+      }
+    }
+  }
+  // Nearby nodes are the most likely to yield constraints, so their searches
+  // are scheduled first.
+  std::sort(local_search_node_ids.begin(), local_search_node_ids.end());
+  for (const auto& distance_and_node_id : local_search_node_ids) {
+    ComputeConstraint(distance_and_node_id.second, submap_id);
+  }
+  if (options_.place_recognition_num_candidates() > 0 &&
+      !global_search_node_ids.empty()) {
+    global_search_node_ids =
+        GetPlaceRecognitionCandidates(submap_id, global_search_node_ids);
+  }
+  for (const mapping::NodeId& node_id : global_search_node_ids) {
+    ComputeConstraint(node_id, submap_id);
+  }
+}
+
+void SparsePoseGraph::ComputeFinalConstraints() {
+  CARTOGRAPHER_TRACE_SPAN("SparsePoseGraph::ComputeFinalConstraints");
+  const auto deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          common::FromSeconds(
+              options_.final_constraint_search_time_limit_seconds()));
+  // Nodes of each submap relative to it, computed once per submap.
+  std::map<mapping::SubmapId, std::vector<mapping::TrajectoryNode>>
+      submap_nodes_by_submap_id;
+  int num_searches = 0;
+  const auto& node_data = optimization_problem_.node_data();
+  for (int trajectory_id = 0;
+       trajectory_id != static_cast<int>(node_data.size()); ++trajectory_id) {
+    for (const auto& index_node_data : node_data[trajectory_id]) {
+      const mapping::NodeId node_id{trajectory_id, index_node_data.first};
+      std::set<mapping::SubmapId> constrained_submap_ids;
+      for (const Constraint& constraint : constraints_.GetForNode(node_id)) {
+        constrained_submap_ids.insert(constraint.submap_id);
+      }
+      const transform::Rigid3d& node_pose = index_node_data.second.pose;
+      for (const auto& entry : finished_submap_indices_) {
+        if (!IsMatchingAllowed(trajectory_id, entry.first) ||
+            (entry.first != trajectory_id &&
+             !trajectory_connectivity_state_.TransitivelyConnected(
+                 trajectory_id, entry.first))) {
+          continue;
+        }
+        for (const mapping::SubmapId& submap_id :
+             entry.second.GetCandidates(node_pose.translation().head<2>())) {
+          if (constrained_submap_ids.count(submap_id) != 0) {
+            continue;
+          }
+          const transform::Rigid3d inverse_submap_pose =
+              optimization_problem_.submap_data()
+                  .at(submap_id.trajectory_id)
+                  .at(submap_id.submap_index)
+                  .pose.inverse();
+          auto it = submap_nodes_by_submap_id.find(submap_id);
+          if (it == submap_nodes_by_submap_id.end()) {
+            std::vector<mapping::TrajectoryNode> submap_nodes;
+            for (const mapping::NodeId& submap_node_id :
+                 submap_data_.at(submap_id).node_ids) {
+              submap_nodes.push_back(mapping::TrajectoryNode{
+                  trajectory_nodes_.at(submap_node_id).constant_data,
+                  inverse_submap_pose *
+                      trajectory_nodes_.at(submap_node_id).pose});
+            }
+            it = submap_nodes_by_submap_id
+                     .emplace(submap_id, std::move(submap_nodes))
+                     .first;
+          }
+          constraint_builder_.AddConstraintBeforeDeadline(
+              submap_id, submap_data_.at(submap_id).submap.get(), node_id,
+              trajectory_nodes_.at(node_id).constant_data.get(), it->second,
+              inverse_submap_pose * node_pose, deadline);
+          ++num_searches;
+        }
       }
     }
   }
+  if (final_constraint_searches_metric_ != nullptr) {
+    final_constraint_searches_metric_->Increment(num_searches);
+  }
+  LOG(INFO) << "Scheduled " << num_searches
+            << " constraint searches before the final optimization.";
+}
+
+void SparsePoseGraph::AddToSpatialIndex(const mapping::SubmapId& submap_id) {
+  CHECK(submap_data_.at(submap_id).state == SubmapState::kFinished);
+  GetOrCreateSpatialIndex(
+      submap_id.trajectory_id,
+      options_.constraint_builder_options().max_constraint_distance(),
+      &finished_submap_indices_)
+      ->Insert(submap_id, optimization_problem_.submap_data()
+                              .at(submap_id.trajectory_id)
+                              .at(submap_id.submap_index)
+                              .pose.translation().head<2>());
+}
+
+void SparsePoseGraph::AddToSpatialIndex(const mapping::NodeId& node_id) {
+  GetOrCreateSpatialIndex(
+      node_id.trajectory_id,
+      options_.constraint_builder_options().max_constraint_distance(),
+      &node_indices_)
+      ->Insert(node_id, optimization_problem_.node_data()
+                            .at(node_id.trajectory_id)
+                            .at(node_id.node_index)
+                            .pose.translation().head<2>());
+}
+
+void SparsePoseGraph::UpdateSpatialIndices() {
+  const auto& submap_data = optimization_problem_.submap_data();
+  for (int trajectory_id = 0;
+       trajectory_id != static_cast<int>(submap_data.size()); ++trajectory_id) {
+    for (const auto& index_submap_data : submap_data[trajectory_id]) {
+      const mapping::SubmapId submap_id{trajectory_id,
+                                        index_submap_data.first};
+      if (submap_data_.at(submap_id).state == SubmapState::kFinished &&
+          localization_trajectories_.count(trajectory_id) == 0) {
+        AddToSpatialIndex(submap_id);
+      }
+    }
+  }
+  const auto& node_data = optimization_problem_.node_data();
+  for (int trajectory_id = 0;
+       trajectory_id != static_cast<int>(node_data.size()); ++trajectory_id) {
+    for (const auto& index_node_data : node_data[trajectory_id]) {
+      AddToSpatialIndex(mapping::NodeId{trajectory_id, index_node_data.first});
+    }
+  }
+}
+
+void SparsePoseGraph::AddToPlaceRecognitionIndex(
+    const mapping::NodeId& node_id) {
+  if (options_.place_recognition_num_candidates() > 0) {
+    place_recognition_index_.Insert(
+        node_id, mapping::sparse_pose_graph::ComputePlaceDescriptor(
+                     *trajectory_nodes_.at(node_id).constant_data));
+  }
+}
+
+std::set<mapping::SubmapId> SparsePoseGraph::GetPlaceRecognitionCandidates(
+    const mapping::NodeId& node_id) {
+  std::set<mapping::SubmapId> candidates;
+  const Eigen::VectorXf* const descriptor =
+      place_recognition_index_.Find(node_id);
+  if (descriptor == nullptr) {
+    return candidates;
+  }
+  for (const mapping::NodeId& similar_node_id :
+       place_recognition_index_.GetMostSimilar(
+           *descriptor, options_.place_recognition_num_candidates(),
+           [this, &node_id](const mapping::NodeId& other_node_id)
+               REQUIRES(mutex_) {
+                 return other_node_id.trajectory_id != node_id.trajectory_id &&
+                        merged_trajectories_.count(
+                            other_node_id.trajectory_id) == 0;
+               })) {
+    const auto it =
+        finished_submap_indices_.find(similar_node_id.trajectory_id);
+    if (it == finished_submap_indices_.end()) {
+      continue;
+    }
+    for (const mapping::SubmapId& submap_id : it->second.GetCandidates(
+             optimization_problem_.node_data()
+                 .at(similar_node_id.trajectory_id)
+                 .at(similar_node_id.node_index)
+                 .pose.translation().head<2>())) {
+      candidates.insert(submap_id);
+    }
+  }
+  return candidates;
+}
+
+std::vector<mapping::NodeId> SparsePoseGraph::GetPlaceRecognitionCandidates(
+    const mapping::SubmapId& submap_id,
+    const std::vector<mapping::NodeId>& node_ids) {
+  // The descriptors of all nodes of the submap are summed up, so that nodes
+  // similar to any part of the submap are found.
+  Eigen::VectorXf submap_descriptor;
+  for (const mapping::NodeId& submap_node_id :
+       submap_data_.at(submap_id).node_ids) {
+    const Eigen::VectorXf* const descriptor =
+        place_recognition_index_.Find(submap_node_id);
+    if (descriptor == nullptr) {
+      continue;
+    }
+    if (submap_descriptor.size() == 0) {
+      submap_descriptor = *descriptor;
+    } else if (submap_descriptor.size() == descriptor->size()) {
+      submap_descriptor += *descriptor;
+    }
+  }
+  const std::set<mapping::NodeId> node_id_set(node_ids.begin(),
+                                              node_ids.end());
+  return place_recognition_index_.GetMostSimilar(
+      submap_descriptor, options_.place_recognition_num_candidates(),
+      [&node_id_set](const mapping::NodeId& node_id) {
+        return node_id_set.count(node_id) != 0;
+      });
 }
 
 void SparsePoseGraph::ComputeConstraintsForScan(
     const int trajectory_id,
     std::vector<std::shared_ptr<const Submap>> insertion_submaps,
     const bool newly_finished_submap) {
+  CARTOGRAPHER_TRACE_SPAN("SparsePoseGraph::ComputeConstraintsForScan");
+  if (cross_trajectory_search_budget_.enabled()) {
+    cross_trajectory_search_budget_.SetComponents(
+        trajectory_connectivity_state_.Components());
+  }
   const std::vector<mapping::SubmapId> submap_ids =
       GrowSubmapTransformsAsNeeded(trajectory_id, insertion_submaps);
   CHECK_EQ(submap_ids.size(), insertion_submaps.size());
@@ -264,11 +733,10 @@ void SparsePoseGraph::ComputeConstraintsForScan(
                   optimization_problem_.node_data().size() &&
               !optimization_problem_.node_data()[matching_id.trajectory_id]
                    .empty()
-          ? static_cast<int>(optimization_problem_.node_data()
-                                 .at(matching_id.trajectory_id)
-                                 .rbegin()
-                                 ->first +
-                             1)
+          ? optimization_problem_.node_data()
+                    .at(matching_id.trajectory_id)
+                    .last_index() +
+                1
           : 0};
   const auto& constant_data = trajectory_nodes_.at(node_id).constant_data;
   const transform::Rigid3d& pose = constant_data->initial_pose;
@@ -280,6 +748,8 @@ void SparsePoseGraph::ComputeConstraintsForScan(
       insertion_submaps.front()->local_pose().inverse() * pose;
   optimization_problem_.AddTrajectoryNode(
       matching_id.trajectory_id, constant_data->time, pose, optimized_pose);
+  AddToSpatialIndex(node_id);
+  AddToPlaceRecognitionIndex(node_id);
   for (size_t i = 0; i < insertion_submaps.size(); ++i) {
     const mapping::SubmapId submap_id = submap_ids[i];
     // Even if this was the last scan added to 'submap_id', the submap will only
@@ -288,7 +758,7 @@ void SparsePoseGraph::ComputeConstraintsForScan(
     submap_data_.at(submap_id).node_ids.emplace(node_id);
     const transform::Rigid3d constraint_transform =
         insertion_submaps[i]->local_pose().inverse() * pose;
-    constraints_.push_back(
+    constraints_.Add(
         Constraint{submap_id,
                    node_id,
                    {constraint_transform, options_.matcher_translation_weight(),
@@ -296,14 +766,47 @@ void SparsePoseGraph::ComputeConstraintsForScan(
                    Constraint::INTRA_SUBMAP});
   }
 
+  // With place recognition, the full submaps of other trajectories are only
+  // matched against if they are near places similar to the node.
+  const bool use_place_recognition =
+      options_.place_recognition_num_candidates() > 0 &&
+      submap_data_.num_trajectories() > 1;
+  const std::set<mapping::SubmapId> place_recognition_candidates =
+      use_place_recognition ? GetPlaceRecognitionCandidates(node_id)
+                            : std::set<mapping::SubmapId>();
   for (int trajectory_id = 0; trajectory_id < submap_data_.num_trajectories();
        ++trajectory_id) {
+    if (!IsMatchingAllowed(node_id.trajectory_id, trajectory_id)) {
+      continue;
+    }
+    if (trajectory_id == node_id.trajectory_id ||
+        merged_trajectories_.count(trajectory_id) != 0) {
+      // Submaps of the node's own trajectory and of merged pieces of the map
+      // are only matched in a local search window, so only submaps near the
+      // node need to be considered.
+      const auto it = finished_submap_indices_.find(trajectory_id);
+      if (it == finished_submap_indices_.end()) {
+        continue;
+      }
+      for (const mapping::SubmapId& submap_id :
+           it->second.GetCandidates(optimized_pose.translation().head<2>())) {
+        CHECK(submap_data_.at(submap_id).state == SubmapState::kFinished);
+        CHECK_EQ(submap_data_.at(submap_id).node_ids.count(node_id), 0);
+        ComputeConstraint(node_id, submap_id);
+      }
+      continue;
+    }
     for (int submap_index = 0;
          submap_index < submap_data_.num_indices(trajectory_id);
          ++submap_index) {
       const mapping::SubmapId submap_id{trajectory_id, submap_index};
       if (submap_data_.at(submap_id).state == SubmapState::kFinished) {
         CHECK_EQ(submap_data_.at(submap_id).node_ids.count(node_id), 0);
+        if (use_place_recognition &&
+            place_recognition_candidates.count(submap_id) == 0 &&
+            !IsLocalConstraintSearch(node_id, submap_id)) {
+          continue;
+        }
         ComputeConstraint(node_id, submap_id);
       }
     }
@@ -314,21 +817,23 @@ void SparsePoseGraph::ComputeConstraintsForScan(
     SubmapData& finished_submap_data = submap_data_.at(finished_submap_id);
     CHECK(finished_submap_data.state == SubmapState::kActive);
     finished_submap_data.state = SubmapState::kFinished;
-    // We have a new completed submap, so we look into adding constraints for
-    // old scans.
-    ComputeConstraintsForOldScans(finished_submap_id);
+    if (localization_trajectories_.count(finished_submap_id.trajectory_id) ==
+        0) {
+      AddToSpatialIndex(finished_submap_id);
+      // We have a new completed submap, so we look into adding constraints
+      // for old scans.
+      ComputeConstraintsForOldScans(finished_submap_id);
+    }
   }
   constraint_builder_.NotifyEndOfScan();
   ++num_scans_since_last_loop_closure_;
-  if (options_.optimize_every_n_scans() > 0 &&
-      num_scans_since_last_loop_closure_ > options_.optimize_every_n_scans()) {
+  if (optimize_every_n_scans_ > 0 &&
+      num_scans_since_last_loop_closure_ >
+          load_shedding_controller_.ScaleOptimizeEveryNScans(
+              optimize_every_n_scans_)) {
     CHECK(!run_loop_closure_);
+    // The thread draining the 'work_queue_' will run the optimization.
     run_loop_closure_ = true;
-    // If there is a 'work_queue_' already, some other thread will take care.
-    if (work_queue_ == nullptr) {
-      work_queue_ = common::make_unique<std::deque<std::function<void()>>>();
-      HandleWorkQueue();
-    }
   }
 }
 
@@ -358,17 +863,70 @@ void SparsePoseGraph::UpdateTrajectoryConnectivity(
   }
 }
 
+void SparsePoseGraph::AddOverlapConstraints(const int trajectory_id,
+                                            const int other_trajectory_id) {
+  if (std::max(trajectory_id, other_trajectory_id) >=
+      trajectory_nodes_.num_trajectories()) {
+    return;
+  }
+  std::map<common::Time, mapping::NodeId> node_ids_by_time;
+  for (int node_index = 0;
+       node_index != trajectory_nodes_.num_indices(trajectory_id);
+       ++node_index) {
+    const mapping::NodeId node_id{trajectory_id, node_index};
+    const auto& constant_data = trajectory_nodes_.at(node_id).constant_data;
+    if (constant_data != nullptr) {
+      node_ids_by_time.emplace(constant_data->time, node_id);
+    }
+  }
+  // Nodes with the same time were built from the same range data, so they
+  // have the same pose relative to the submaps either was inserted into.
+  sparse_pose_graph::ConstraintBuilder::Result result;
+  for (int node_index = 0;
+       node_index != trajectory_nodes_.num_indices(other_trajectory_id);
+       ++node_index) {
+    const mapping::NodeId other_node_id{other_trajectory_id, node_index};
+    const auto& constant_data =
+        trajectory_nodes_.at(other_node_id).constant_data;
+    if (constant_data == nullptr) {
+      continue;
+    }
+    const auto it = node_ids_by_time.find(constant_data->time);
+    if (it == node_ids_by_time.end()) {
+      continue;
+    }
+    for (const Constraint& constraint :
+         constraints_.GetForNode(other_node_id)) {
+      if (constraint.tag == Constraint::INTRA_SUBMAP) {
+        result.push_back(Constraint{constraint.submap_id, it->second,
+                                    constraint.pose,
+                                    Constraint::INTER_SUBMAP});
+      }
+    }
+  }
+  LOG(INFO) << "Linked trajectories " << trajectory_id << " and "
+            << other_trajectory_id << " with " << result.size()
+            << " constraints.";
+  constraints_.Add(result);
+  UpdateTrajectoryConnectivity(result);
+}
+
 void SparsePoseGraph::HandleWorkQueue() {
-  constraint_builder_.WhenDone(
+  const auto optimize =
       [this](const sparse_pose_graph::ConstraintBuilder::Result& result) {
         {
           common::MutexLocker locker(&mutex_);
-          constraints_.insert(constraints_.end(), result.begin(), result.end());
+          constraints_.Add(result);
+          if (options_.max_num_constraints_per_submap_pair() > 0) {
+            constraints_.RemoveRedundantInterSubmapConstraints(
+                options_.max_num_constraints_per_submap_pair());
+          }
         }
-        RunOptimization();
+        RunOptimization(true /* interruptible */);
 
         common::MutexLocker locker(&mutex_);
         UpdateTrajectoryConnectivity(result);
+        MaybeWarmUpScanMatchersAfterFirstMatch(result);
         TrimmingHandle trimming_handle(this);
         for (auto& trimmer : trimmers_) {
           trimmer->Trim(&trimming_handle);
@@ -376,46 +934,125 @@ void SparsePoseGraph::HandleWorkQueue() {
 
         num_scans_since_last_loop_closure_ = 0;
         run_loop_closure_ = false;
-        while (!run_loop_closure_) {
-          if (work_queue_->empty()) {
-            work_queue_.reset();
-            return;
-          }
-          work_queue_->front()();
-          work_queue_->pop_front();
-        }
-        LOG(INFO) << "Remaining work items in queue: " << work_queue_->size();
-        // We have to optimize again.
-        HandleWorkQueue();
+        DrainWorkQueue();
+      };
+  // Trimming deletes submaps which pending computations may still use, so it
+  // has to wait for all of them.
+  if (options_.optimize_with_finished_constraints() && trimmers_.empty()) {
+    // Constraints of scans which are still being matched are added by a later
+    // optimization.
+    optimization_thread_->Schedule(
+        [this, optimize]() {
+          optimize(constraint_builder_.TakeFinishedConstraints());
+        },
+        common::WorkItemPriority::kHigh, "sparse_pose_graph_optimization_3d");
+    return;
+  }
+  constraint_builder_.WhenDone(
+      [this,
+       optimize](const sparse_pose_graph::ConstraintBuilder::Result& result) {
+        optimization_thread_->Schedule(
+            [optimize, result]() { optimize(result); },
+            common::WorkItemPriority::kHigh,
+            "sparse_pose_graph_optimization_3d");
       });
 }
 
+void SparsePoseGraph::DrainWorkQueue() {
+  for (int i = 0; i != kMaxNumWorkItemsPerDrain; ++i) {
+    if (run_loop_closure_) {
+      LOG(INFO) << "Remaining work items in queue: " << work_queue_->size();
+      // We have to optimize first.
+      HandleWorkQueue();
+      return;
+    }
+    if (work_queue_->empty()) {
+      work_queue_.reset();
+      UpdateWorkQueueSizeMetric();
+      work_queue_capacity_available_.SignalAll();
+      return;
+    }
+    RunWorkItem(work_queue_->Pop());
+    UpdateWorkQueueSizeMetric();
+    work_queue_capacity_available_.Signal();
+  }
+  // Release 'mutex_' so that threads adding data are not held up until the
+  // whole backlog is worked off. The queue is kept, so that they append to it.
+  ScheduleDrainWorkQueue();
+}
+
+void SparsePoseGraph::RunWorkItem(
+    const mapping::sparse_pose_graph::WorkItem& work_item) {
+  switch (work_item.type) {
+    case mapping::sparse_pose_graph::WorkItem::Type::kTask:
+      work_item.task();
+      return;
+    case mapping::sparse_pose_graph::WorkItem::Type::kImuData:
+      optimization_problem_.AddImuData(work_item.trajectory_id,
+                                       work_item.imu_data);
+      return;
+    case mapping::sparse_pose_graph::WorkItem::Type::kOdometryData:
+      optimization_problem_.AddOdometerData(work_item.trajectory_id,
+                                            work_item.odometry_data);
+      return;
+  }
+  LOG(FATAL) << "Unknown work item type.";
+}
+
 void SparsePoseGraph::WaitForAllComputations() {
   bool notification = false;
   common::MutexLocker locker(&mutex_);
   const int num_finished_scans_at_start =
       constraint_builder_.GetNumFinishedScans();
-  while (!locker.AwaitWithTimeout(
-      [this]() REQUIRES(mutex_) {
-        return constraint_builder_.GetNumFinishedScans() ==
-               num_trajectory_nodes_;
-      },
-      common::FromSeconds(1.))) {
-    std::ostringstream progress_info;
-    progress_info << "Optimizing: " << std::fixed << std::setprecision(1)
-                  << 100. *
-                         (constraint_builder_.GetNumFinishedScans() -
-                          num_finished_scans_at_start) /
-                         (num_trajectory_nodes_ - num_finished_scans_at_start)
-                  << "%...";
-    std::cout << "\r\x1b[K" << progress_info.str() << std::flush;
-  }
-  std::cout << "\r\x1b[KOptimizing: Done.     " << std::endl;
+  const auto start_time = std::chrono::steady_clock::now();
+  auto last_print_time = start_time;
+  const auto all_computations_done = [this]() REQUIRES(mutex_) {
+    return work_queue_ == nullptr &&
+           constraint_builder_.GetNumFinishedScans() == num_trajectory_nodes_;
+  };
+  int num_finished_scans = num_finished_scans_at_start;
+  while (!all_computations_done()) {
+    // The constraint builder wakes us up whenever scans finished, see the
+    // constructor.
+    locker.Await([this, &all_computations_done,
+                  num_finished_scans]() REQUIRES(mutex_) {
+      return all_computations_done() ||
+             constraint_builder_.GetNumFinishedScans() != num_finished_scans;
+    });
+    num_finished_scans = constraint_builder_.GetNumFinishedScans();
+    const auto now = std::chrono::steady_clock::now();
+    ComputationProgress progress;
+    progress.num_finished_scans =
+        num_finished_scans - num_finished_scans_at_start;
+    progress.num_remaining_scans = num_trajectory_nodes_ - num_finished_scans;
+    progress.estimated_remaining_seconds =
+        progress.num_finished_scans == 0
+            ? -1.
+            : std::chrono::duration<double>(now - start_time).count() *
+                  progress.num_remaining_scans / progress.num_finished_scans;
+    if (computation_progress_callback_ != nullptr) {
+      computation_progress_callback_(progress);
+    } else if (now - last_print_time >= std::chrono::seconds(1) &&
+               progress.num_remaining_scans > 0) {
+      last_print_time = now;
+      std::ostringstream progress_info;
+      progress_info << "Optimizing: " << std::fixed << std::setprecision(1)
+                    << 100. * progress.num_finished_scans /
+                           (progress.num_finished_scans +
+                            progress.num_remaining_scans)
+                    << "%, about " << std::setprecision(0)
+                    << progress.estimated_remaining_seconds << " s left...";
+      std::cout << "\r\x1b[K" << progress_info.str() << std::flush;
+    }
+  }
+  if (computation_progress_callback_ == nullptr) {
+    std::cout << "\r\x1b[KOptimizing: Done.     " << std::endl;
+  }
   constraint_builder_.WhenDone(
       [this, &notification](
           const sparse_pose_graph::ConstraintBuilder::Result& result) {
         common::MutexLocker locker(&mutex_);
-        constraints_.insert(constraints_.end(), result.begin(), result.end());
+        constraints_.Add(result);
         notification = true;
       });
   locker.Await([&notification]() { return notification; });
@@ -430,16 +1067,42 @@ void SparsePoseGraph::FreezeTrajectory(const int trajectory_id) {
   });
 }
 
+void SparsePoseGraph::SetMergedTrajectory(const int trajectory_id) {
+  common::MutexLocker locker(&mutex_);
+  AddWorkItem([this, trajectory_id]() REQUIRES(mutex_) {
+    CHECK_EQ(frozen_trajectories_.count(trajectory_id), 1);
+    merged_trajectories_.insert(trajectory_id);
+  });
+}
+
+void SparsePoseGraph::SetLocalizationTrajectory(const int trajectory_id) {
+  common::MutexLocker locker(&mutex_);
+  // Not deferred to a work item, so that no scan matcher is precomputed
+  // speculatively for the first submap of the trajectory.
+  localization_trajectories_.insert(trajectory_id);
+}
+
+void SparsePoseGraph::LinkOverlappingTrajectories(
+    const int trajectory_id, const int other_trajectory_id) {
+  common::MutexLocker locker(&mutex_);
+  AddWorkItem([this, trajectory_id, other_trajectory_id]() REQUIRES(mutex_) {
+    AddOverlapConstraints(trajectory_id, other_trajectory_id);
+  });
+}
+
 void SparsePoseGraph::AddSubmapFromProto(const int trajectory_id,
                                          const transform::Rigid3d& initial_pose,
                                          const mapping::proto::Submap& submap) {
   if (!submap.has_submap_3d()) {
     return;
   }
+  AddDeserializedSubmap(trajectory_id, initial_pose,
+                        std::make_shared<const Submap>(submap.submap_3d()));
+}
 
-  std::shared_ptr<const Submap> submap_ptr =
-      std::make_shared<const Submap>(submap.submap_3d());
-
+void SparsePoseGraph::AddDeserializedSubmap(
+    const int trajectory_id, const transform::Rigid3d& initial_pose,
+    std::shared_ptr<const Submap> submap_ptr) {
   common::MutexLocker locker(&mutex_);
   AddTrajectoryIfNeeded(trajectory_id);
   const mapping::SubmapId submap_id =
@@ -449,29 +1112,131 @@ void SparsePoseGraph::AddSubmapFromProto(const int trajectory_id,
   CHECK_GE(static_cast<size_t>(submap_data_.num_trajectories()),
            optimized_submap_transforms_.size());
   optimized_submap_transforms_.resize(submap_data_.num_trajectories());
-  CHECK_EQ(optimized_submap_transforms_.at(trajectory_id).size(),
+  CHECK_EQ(optimized_submap_transforms_.at(trajectory_id).num_indices(),
            submap_id.submap_index);
   optimized_submap_transforms_.at(trajectory_id)
-      .emplace(submap_id.submap_index,
-               sparse_pose_graph::SubmapData{initial_pose});
+      .Append(sparse_pose_graph::SubmapData{initial_pose});
   AddWorkItem([this, submap_id, initial_pose]() REQUIRES(mutex_) {
     CHECK_EQ(frozen_trajectories_.count(submap_id.trajectory_id), 1);
     submap_data_.at(submap_id).state = SubmapState::kFinished;
     optimization_problem_.AddSubmap(submap_id.trajectory_id, initial_pose);
+    AddToSpatialIndex(submap_id);
+  });
+}
+
+void SparsePoseGraph::SetPrecomputedGrids(
+    const int trajectory_id,
+    std::shared_ptr<const io::MappedBlobFile> mapped_blob_file) {
+  constraint_builder_.SetPrecomputedGrids(trajectory_id,
+                                          std::move(mapped_blob_file));
+}
+
+void SparsePoseGraph::WarmUpScanMatchers(
+    const transform::Rigid3d& global_pose) {
+  common::MutexLocker locker(&mutex_);
+  // Deferred, so that the submaps of a map which is still being loaded are
+  // included.
+  AddWorkItem([this, global_pose]() REQUIRES(mutex_) {
+    WarmUpScanMatchersNear(global_pose.translation());
   });
 }
 
+void SparsePoseGraph::WarmUpScanMatchersNear(const Eigen::Vector3d& position) {
+  scan_matchers_warmed_up_ = true;
+  const double max_constraint_distance =
+      options_.constraint_builder_options().max_constraint_distance();
+  std::vector<std::pair<double, mapping::SubmapId>> submap_ids_by_distance;
+  for (const int trajectory_id : frozen_trajectories_) {
+    if (trajectory_id >= submap_data_.num_trajectories()) {
+      continue;
+    }
+    for (int submap_index = 0;
+         submap_index != submap_data_.num_indices(trajectory_id);
+         ++submap_index) {
+      const mapping::SubmapId submap_id{trajectory_id, submap_index};
+      if (submap_data_.at(submap_id).state != SubmapState::kFinished) {
+        continue;
+      }
+      const double distance = (optimization_problem_.submap_data()
+                                   .at(trajectory_id)
+                                   .at(submap_index)
+                                   .pose.translation() -
+                               position)
+                                  .norm();
+      submap_ids_by_distance.emplace_back(distance, submap_id);
+    }
+  }
+  std::sort(submap_ids_by_distance.begin(), submap_ids_by_distance.end());
+  std::vector<sparse_pose_graph::ConstraintBuilder::WarmUpSubmap> submaps;
+  int num_urgent_submaps = 0;
+  for (const auto& distance_and_submap_id : submap_ids_by_distance) {
+    const mapping::SubmapId& submap_id = distance_and_submap_id.second;
+    const transform::Rigid3d inverse_submap_pose =
+        optimization_problem_.submap_data()
+            .at(submap_id.trajectory_id)
+            .at(submap_id.submap_index)
+            .pose.inverse();
+    std::vector<mapping::TrajectoryNode> submap_nodes;
+    for (const mapping::NodeId& submap_node_id :
+         submap_data_.at(submap_id).node_ids) {
+      submap_nodes.push_back(mapping::TrajectoryNode{
+          trajectory_nodes_.at(submap_node_id).constant_data,
+          inverse_submap_pose * trajectory_nodes_.at(submap_node_id).pose});
+    }
+    submaps.push_back({submap_id, submap_data_.at(submap_id).submap,
+                       std::move(submap_nodes)});
+    if (distance_and_submap_id.first <= max_constraint_distance) {
+      ++num_urgent_submaps;
+    }
+  }
+  LOG(INFO) << "Warming up " << submaps.size() << " scan matchers, "
+            << num_urgent_submaps << " of them urgently.";
+  constraint_builder_.WarmUpScanMatchers(std::move(submaps),
+                                         num_urgent_submaps);
+}
+
+void SparsePoseGraph::MaybeWarmUpScanMatchersAfterFirstMatch(
+    const sparse_pose_graph::ConstraintBuilder::Result& result) {
+  if (scan_matchers_warmed_up_) {
+    return;
+  }
+  const auto& node_data = optimization_problem_.node_data();
+  for (const Constraint& constraint : result) {
+    const mapping::NodeId& node_id = constraint.node_id;
+    if (localization_trajectories_.count(node_id.trajectory_id) != 0 &&
+        frozen_trajectories_.count(constraint.submap_id.trajectory_id) != 0 &&
+        node_id.trajectory_id < static_cast<int>(node_data.size()) &&
+        node_data[node_id.trajectory_id].Contains(node_id.node_index)) {
+      WarmUpScanMatchersNear(node_data[node_id.trajectory_id]
+                                 .at(node_id.node_index)
+                                 .pose.translation());
+      return;
+    }
+  }
+}
+
 void SparsePoseGraph::AddNodeFromProto(const int trajectory_id,
                                        const transform::Rigid3d& pose,
                                        const mapping::proto::Node& node) {
-  std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data =
-      std::make_shared<const mapping::TrajectoryNode::Data>(
-          mapping::FromProto(node.node_data()));
+  AddDeserializedNode(trajectory_id, pose,
+                      std::make_shared<const mapping::TrajectoryNode::Data>(
+                          mapping::FromProto(node.node_data())));
+}
 
+void SparsePoseGraph::AddDeserializedNode(
+    const int trajectory_id, const transform::Rigid3d& pose,
+    std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data) {
+  if (options_.compress_node_point_clouds() &&
+      constant_data->compressed_point_clouds == nullptr) {
+    constant_data = std::make_shared<const mapping::TrajectoryNode::Data>(
+        mapping::CompressPointClouds(*constant_data));
+  }
   common::MutexLocker locker(&mutex_);
   AddTrajectoryIfNeeded(trajectory_id);
   const mapping::NodeId node_id = trajectory_nodes_.Append(
       trajectory_id, mapping::TrajectoryNode{constant_data, pose});
+  node_time_index_.Insert(node_id, constant_data->time);
+  change_log_.ChangeNode(node_id);
 
   AddWorkItem([this, node_id, pose]() REQUIRES(mutex_) {
     CHECK_EQ(frozen_trajectories_.count(node_id.trajectory_id), 1);
@@ -479,6 +1244,8 @@ void SparsePoseGraph::AddNodeFromProto(const int trajectory_id,
     optimization_problem_.AddTrajectoryNode(node_id.trajectory_id,
                                             constant_data->time,
                                             constant_data->initial_pose, pose);
+    AddToSpatialIndex(node_id);
+    AddToPlaceRecognitionIndex(node_id);
   });
 }
 
@@ -491,21 +1258,58 @@ void SparsePoseGraph::AddTrimmer(
                   REQUIRES(mutex_) { trimmers_.emplace_back(trimmer_ptr); });
 }
 
+void SparsePoseGraph::SetComputationProgressCallback(
+    ComputationProgressCallback callback) {
+  common::MutexLocker locker(&mutex_);
+  computation_progress_callback_ = std::move(callback);
+}
+
+void SparsePoseGraph::UpdateRuntimeOptions(
+    const mapping::proto::SparsePoseGraphRuntimeOptions& runtime_options) {
+  common::MutexLocker locker(&mutex_);
+  if (runtime_options.has_optimize_every_n_scans()) {
+    optimize_every_n_scans_ = runtime_options.optimize_every_n_scans();
+  }
+  if (runtime_options.has_global_sampling_ratio()) {
+    CHECK_GT(runtime_options.global_sampling_ratio(), 0.);
+    CHECK_LE(runtime_options.global_sampling_ratio(), 1.);
+    global_sampling_ratio_ = runtime_options.global_sampling_ratio();
+  }
+  if (runtime_options.has_sampling_ratio()) {
+    constraint_builder_.SetSamplingRatio(runtime_options.sampling_ratio());
+  }
+  // Applies the new sampling ratios scaled by the current load shedding factor.
+  UpdateLoadShedding();
+}
+
 void SparsePoseGraph::RunFinalOptimization() {
+  // Optimizations run while waiting end early, since this one supersedes them.
+  ++num_pending_final_optimizations_;
   WaitForAllComputations();
+  if (options_.final_constraint_search_time_limit_seconds() > 0.) {
+    {
+      common::MutexLocker locker(&mutex_);
+      ComputeFinalConstraints();
+    }
+    WaitForAllComputations();
+  }
+  --num_pending_final_optimizations_;
   optimization_problem_.SetMaxNumIterations(
       options_.max_num_final_iterations());
-  RunOptimization();
+  optimization_problem_.SetSlidingWindowNumNodes(0);
+  RunOptimization(false /* interruptible */);
   optimization_problem_.SetMaxNumIterations(
       options_.optimization_problem_options()
           .ceres_solver_options()
           .max_num_iterations());
+  optimization_problem_.SetSlidingWindowNumNodes(
+      options_.optimization_problem_options().sliding_window_num_nodes());
 }
 
 void SparsePoseGraph::LogResidualHistograms() {
   common::Histogram rotational_residual;
   common::Histogram translational_residual;
-  for (const Constraint& constraint : constraints_) {
+  for (const Constraint& constraint : constraints_.GetAll()) {
     if (constraint.tag == Constraint::Tag::INTRA_SUBMAP) {
       const cartographer::transform::Rigid3d optimized_node_to_map =
           trajectory_nodes_.at(constraint.node_id).pose;
@@ -530,7 +1334,7 @@ void SparsePoseGraph::LogResidualHistograms() {
             << rotational_residual.ToString(10);
 }
 
-void SparsePoseGraph::RunOptimization() {
+void SparsePoseGraph::RunOptimization(const bool interruptible) {
   if (optimization_problem_.submap_data().empty()) {
     return;
   }
@@ -538,8 +1342,45 @@ void SparsePoseGraph::RunOptimization() {
   // No other thread is accessing the optimization_problem_, constraints_ and
   // frozen_trajectories_ when executing the Solve. Solve is time consuming, so
   // not taking the mutex before Solve to avoid blocking foreground processing.
-  optimization_problem_.Solve(constraints_, frozen_trajectories_);
+  const auto start_time = std::chrono::steady_clock::now();
+  std::function<bool()> should_terminate;
+  // Written by the threads solving connected components in parallel.
+  std::atomic<bool> interrupted{false};
+  if (interruptible) {
+    {
+      common::MutexLocker locker(&mutex_);
+      interrupt_optimization_ = false;
+      // Work queued while waiting for the constraints counts as well.
+      InterruptOptimizationIfNeeded();
+    }
+    should_terminate = [this, &interrupted]() {
+      if (interrupt_optimization_ || num_pending_final_optimizations_ > 0) {
+        interrupted = true;
+        return true;
+      }
+      return false;
+    };
+  }
+  optimization_problem_.Solve(constraints_.GetAll(), frozen_trajectories_,
+                              should_terminate);
+  if (interrupted && interrupted_optimizations_metric_ != nullptr) {
+    interrupted_optimizations_metric_->Increment();
+  }
+  const double optimization_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time)
+          .count();
+  if (optimization_time_metric_ != nullptr) {
+    optimization_time_metric_->Observe(optimization_seconds);
+  }
+  if (cost_attribution_ != nullptr) {
+    cost_attribution_->AddOptimization(
+        optimization_seconds, optimization_problem_.GetNumDataPerTrajectory());
+    cost_attribution_->PublishTopSubmaps();
+  }
   common::MutexLocker locker(&mutex_);
+  UpdateSpatialIndices();
+  cross_trajectory_search_budget_.Refill();
 
   const auto& submap_data = optimization_problem_.submap_data();
   const auto& node_data = optimization_problem_.node_data();
@@ -560,7 +1401,7 @@ void SparsePoseGraph::RunOptimization() {
     int last_optimized_node_index =
         node_data.at(trajectory_id).empty()
             ? 0
-            : node_data.at(trajectory_id).rbegin()->first;
+            : node_data.at(trajectory_id).last_index();
     for (int node_index = last_optimized_node_index + 1; node_index < num_nodes;
          ++node_index) {
       const mapping::NodeId node_id{trajectory_id, node_index};
@@ -569,6 +1410,8 @@ void SparsePoseGraph::RunOptimization() {
     }
   }
   optimized_submap_transforms_ = submap_data;
+  change_log_.ChangeAllNodePoses();
+  PublishSnapshot();
 
   // Log the histograms for the pose residuals.
   if (options_.log_residual_histograms()) {
@@ -582,9 +1425,122 @@ SparsePoseGraph::GetTrajectoryNodes() {
   return trajectory_nodes_.data();
 }
 
+std::map<mapping::SubmapId, mapping::SparsePoseGraph::SubmapData>
+SparsePoseGraph::GetSubmapDataInRegion(const Eigen::AlignedBox2d& region) {
+  common::MutexLocker locker(&mutex_);
+  std::map<mapping::SubmapId, mapping::SparsePoseGraph::SubmapData> result;
+  const auto add_if_in_region = [this, &region,
+                                 &result](const mapping::SubmapId& submap_id)
+                                    REQUIRES(mutex_) {
+    const mapping::SparsePoseGraph::SubmapData submap_data =
+        GetSubmapDataUnderLock(submap_id);
+    if (submap_data.submap != nullptr &&
+        region.contains(submap_data.pose.translation().head<2>())) {
+      result.emplace(submap_id, submap_data);
+    }
+  };
+  for (const auto& trajectory_id_and_index : finished_submap_indices_) {
+    for (const mapping::SubmapId& submap_id :
+         trajectory_id_and_index.second.GetCandidatesInRegion(region)) {
+      add_if_in_region(submap_id);
+    }
+  }
+  // Active submaps and the submaps of localization trajectories are not in the
+  // spatial indices, but they are only the last few submaps of a trajectory.
+  for (int trajectory_id = 0; trajectory_id != submap_data_.num_trajectories();
+       ++trajectory_id) {
+    const bool is_localization_trajectory =
+        localization_trajectories_.count(trajectory_id) != 0;
+    for (int submap_index = submap_data_.num_indices(trajectory_id) - 1;
+         submap_index >= 0; --submap_index) {
+      const mapping::SubmapId submap_id{trajectory_id, submap_index};
+      const SubmapState state = submap_data_.at(submap_id).state;
+      if (state == SubmapState::kTrimmed ||
+          (state == SubmapState::kFinished && !is_localization_trajectory)) {
+        break;
+      }
+      add_if_in_region(submap_id);
+    }
+  }
+  return result;
+}
+
+std::map<mapping::NodeId, mapping::TrajectoryNode>
+SparsePoseGraph::GetTrajectoryNodesInRegion(const Eigen::AlignedBox2d& region) {
+  common::MutexLocker locker(&mutex_);
+  std::map<mapping::NodeId, mapping::TrajectoryNode> result;
+  for (const auto& trajectory_id_and_index : node_indices_) {
+    for (const mapping::NodeId& node_id :
+         trajectory_id_and_index.second.GetCandidatesInRegion(region)) {
+      const mapping::TrajectoryNode& node = trajectory_nodes_.at(node_id);
+      if (!node.trimmed() &&
+          region.contains(node.pose.translation().head<2>())) {
+        result.emplace(node_id, node);
+      }
+    }
+  }
+  return result;
+}
+
+bool SparsePoseGraph::LookupGlobalPose(const int trajectory_id,
+                                       const common::Time time,
+                                       transform::Rigid3d* const pose) {
+  std::vector<transform::Rigid3d> poses;
+  if (!LookupGlobalPoses(trajectory_id, {time}, &poses)) {
+    return false;
+  }
+  *pose = poses.front();
+  return true;
+}
+
+bool SparsePoseGraph::LookupGlobalPoses(
+    const int trajectory_id, const std::vector<common::Time>& times,
+    std::vector<transform::Rigid3d>* const poses) {
+  common::MutexLocker locker(&mutex_);
+  return node_time_index_.LookupPoses(
+      trajectory_id, times,
+      [this](const mapping::NodeId& node_id) REQUIRES(mutex_) {
+        return trajectory_nodes_.at(node_id).pose;
+      },
+      poses);
+}
+
 std::vector<SparsePoseGraph::Constraint> SparsePoseGraph::constraints() {
   common::MutexLocker locker(&mutex_);
-  return constraints_;
+  return constraints_.GetAll();
+}
+
+mapping::SparsePoseGraph::Changes SparsePoseGraph::GetChangesSince(
+    const int64 version) {
+  Changes changes;
+  bool all_node_poses_changed = true;
+  std::set<mapping::NodeId> changed_node_ids;
+  common::MutexLocker locker(&mutex_);
+  changes.version = change_log_.version();
+  changes.full_state = !change_log_.GetChangesSince(
+      version, &all_node_poses_changed, &changed_node_ids,
+      &changes.added_constraints, &changes.removed_constraints);
+  if (changes.full_state) {
+    all_node_poses_changed = true;
+    changes.added_constraints = constraints_.GetAll();
+  }
+  if (all_node_poses_changed) {
+    for (int trajectory_id = 0;
+         trajectory_id != trajectory_nodes_.num_trajectories();
+         ++trajectory_id) {
+      for (int node_index = 0;
+           node_index != trajectory_nodes_.num_indices(trajectory_id);
+           ++node_index) {
+        const mapping::NodeId node_id{trajectory_id, node_index};
+        changes.nodes.emplace_back(node_id, trajectory_nodes_.at(node_id));
+      }
+    }
+  } else {
+    for (const mapping::NodeId& node_id : changed_node_ids) {
+      changes.nodes.emplace_back(node_id, trajectory_nodes_.at(node_id));
+    }
+  }
+  return changes;
 }
 
 transform::Rigid3d SparsePoseGraph::GetLocalToGlobalTransform(
@@ -615,6 +1571,56 @@ mapping::SparsePoseGraph::SubmapData SparsePoseGraph::GetSubmapData(
 std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
 SparsePoseGraph::GetAllSubmapData() {
   common::MutexLocker locker(&mutex_);
+  return GetAllSubmapDataUnderLock();
+}
+
+mapping::SparsePoseGraph::State SparsePoseGraph::GetState() {
+  State state;
+  common::MutexLocker locker(&mutex_);
+  state.trajectory_nodes = trajectory_nodes_.data();
+  state.submap_data = GetAllSubmapDataUnderLock();
+  state.constraints = constraints_.GetAll();
+  return state;
+}
+
+std::shared_ptr<const mapping::SparsePoseGraph::Snapshot>
+SparsePoseGraph::GetSnapshot() {
+  return std::atomic_load(&snapshot_);
+}
+
+mapping::MemoryUsage SparsePoseGraph::GetMemoryUsage() {
+  mapping::MemoryUsage memory_usage;
+  common::MutexLocker locker(&mutex_);
+  memory_usage.precomputation_grids_in_bytes =
+      constraint_builder_.GetMemoryUsageInBytes();
+  for (const auto& trajectory_submap_data : submap_data_.data()) {
+    for (const SubmapData& submap_data : trajectory_submap_data) {
+      if (submap_data.submap != nullptr) {
+        memory_usage.submap_grids_in_bytes +=
+            submap_data.submap->GetMemoryUsageInBytes();
+      }
+    }
+  }
+  for (const auto& trajectory_nodes : trajectory_nodes_.data()) {
+    for (const mapping::TrajectoryNode& node : trajectory_nodes) {
+      if (!node.trimmed()) {
+        memory_usage.node_point_clouds_in_bytes +=
+            mapping::GetMemoryUsageInBytes(*node.constant_data);
+      }
+    }
+  }
+  // A running optimization only reads the optimization problem, all changes
+  // to it are deferred into the 'work_queue_'.
+  memory_usage.optimization_problem_in_bytes =
+      optimization_problem_.GetMemoryUsageInBytes();
+  if (work_queue_ != nullptr) {
+    memory_usage.work_queues_in_bytes = work_queue_->GetMemoryUsageInBytes();
+  }
+  return memory_usage;
+}
+
+std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
+SparsePoseGraph::GetAllSubmapDataUnderLock() {
   std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
       all_submap_data(submap_data_.num_trajectories());
   for (int trajectory_id = 0; trajectory_id < submap_data_.num_trajectories();
@@ -631,8 +1637,24 @@ SparsePoseGraph::GetAllSubmapData() {
   return all_submap_data;
 }
 
+void SparsePoseGraph::PublishSnapshot() {
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->version = std::atomic_load(&snapshot_)->version + 1;
+  snapshot->trajectory_nodes = trajectory_nodes_.data();
+  snapshot->submap_data = GetAllSubmapDataUnderLock();
+  for (int trajectory_id = 0;
+       trajectory_id != static_cast<int>(snapshot->submap_data.size());
+       ++trajectory_id) {
+    snapshot->local_to_global_transforms.push_back(
+        ComputeLocalToGlobalTransform(optimized_submap_transforms_,
+                                      trajectory_id));
+  }
+  std::atomic_store(&snapshot_,
+                    std::shared_ptr<const Snapshot>(std::move(snapshot)));
+}
+
 transform::Rigid3d SparsePoseGraph::ComputeLocalToGlobalTransform(
-    const std::vector<std::map<int, sparse_pose_graph::SubmapData>>&
+    const std::vector<mapping::DenseMapByIndex<sparse_pose_graph::SubmapData>>&
         submap_transforms,
     const int trajectory_id) const {
   if (trajectory_id >= static_cast<int>(submap_transforms.size()) ||
@@ -640,7 +1662,7 @@ transform::Rigid3d SparsePoseGraph::ComputeLocalToGlobalTransform(
     return transform::Rigid3d::Identity();
   }
 
-  const int submap_index = submap_transforms.at(trajectory_id).rbegin()->first;
+  const int submap_index = submap_transforms.at(trajectory_id).last_index();
   const mapping::SubmapId last_optimized_submap_id{trajectory_id, submap_index};
   // Accessing 'local_pose' in Submap is okay, since the member is const.
   return submap_transforms.at(trajectory_id).at(submap_index).pose *
@@ -657,9 +1679,8 @@ mapping::SparsePoseGraph::SubmapData SparsePoseGraph::GetSubmapDataUnderLock(
   auto submap = submap_data_.at(submap_id).submap;
   if (submap_id.trajectory_id <
           static_cast<int>(optimized_submap_transforms_.size()) &&
-      submap_id.submap_index < static_cast<int>(optimized_submap_transforms_
-                                                    .at(submap_id.trajectory_id)
-                                                    .size())) {
+      optimized_submap_transforms_.at(submap_id.trajectory_id)
+          .Contains(submap_id.submap_index)) {
     // We already have an optimized pose.
     return {submap, optimized_submap_transforms_.at(submap_id.trajectory_id)
                         .at(submap_id.submap_index)
@@ -679,48 +1700,88 @@ int SparsePoseGraph::TrimmingHandle::num_submaps(
   return parent_->optimization_problem_.submap_data().at(trajectory_id).size();
 }
 
+std::vector<mapping::SubmapId>
+SparsePoseGraph::TrimmingHandle::GetFinishedSubmapIds() const {
+  std::vector<mapping::SubmapId> submap_ids;
+  const auto& submap_data = parent_->submap_data_;
+  for (int trajectory_id = 0; trajectory_id != submap_data.num_trajectories();
+       ++trajectory_id) {
+    if (parent_->localization_trajectories_.count(trajectory_id) != 0) {
+      continue;
+    }
+    for (int submap_index = 0;
+         submap_index != submap_data.num_indices(trajectory_id);
+         ++submap_index) {
+      const mapping::SubmapId submap_id{trajectory_id, submap_index};
+      if (submap_data.at(submap_id).state == SubmapState::kFinished) {
+        submap_ids.push_back(submap_id);
+      }
+    }
+  }
+  return submap_ids;
+}
+
+transform::Rigid3d SparsePoseGraph::TrimmingHandle::GetSubmapPose(
+    const mapping::SubmapId& submap_id) const {
+  return parent_->optimization_problem_.submap_data()
+      .at(submap_id.trajectory_id)
+      .at(submap_id.submap_index)
+      .pose;
+}
+
+Eigen::AlignedBox3d SparsePoseGraph::TrimmingHandle::GetSubmapBoundingBox(
+    const mapping::SubmapId& submap_id) const {
+  // The hybrid grids are in the submap frame, and only contain known cells.
+  const HybridGrid& hybrid_grid =
+      parent_->submap_data_.at(submap_id).submap->low_resolution_hybrid_grid();
+  const Eigen::Vector3d half_cell =
+      Eigen::Vector3d::Constant(0.5 * hybrid_grid.resolution());
+  Eigen::AlignedBox3d bounding_box;
+  for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
+    const Eigen::Vector3d center =
+        hybrid_grid.GetCenterOfCell(it.GetCellIndex()).cast<double>();
+    bounding_box.extend(center - half_cell);
+    bounding_box.extend(center + half_cell);
+  }
+  return bounding_box;
+}
+
+std::vector<std::vector<int>>
+SparsePoseGraph::TrimmingHandle::GetConnectedTrajectories() const {
+  return parent_->trajectory_connectivity_state_.Components();
+}
+
 void SparsePoseGraph::TrimmingHandle::MarkSubmapAsTrimmed(
     const mapping::SubmapId& submap_id) {
   // TODO(hrapp): We have to make sure that the trajectory has been finished
   // if we want to delete the last submaps.
   CHECK(parent_->submap_data_.at(submap_id).state == SubmapState::kFinished);
 
-  // Compile all nodes that are still INTRA_SUBMAP constrained once the submap
-  // with 'submap_id' is gone.
-  std::set<mapping::NodeId> nodes_to_retain;
-  for (const Constraint& constraint : parent_->constraints_) {
-    if (constraint.tag == Constraint::Tag::INTRA_SUBMAP &&
-        constraint.submap_id != submap_id) {
-      nodes_to_retain.insert(constraint.node_id);
-    }
-  }
-  // Remove all 'constraints_' related to 'submap_id'.
+  // Compile all nodes that are no longer INTRA_SUBMAP constrained once the
+  // submap with 'submap_id' is gone. They have to be removed.
   std::set<mapping::NodeId> nodes_to_remove;
-  {
-    std::vector<Constraint> constraints;
-    for (const Constraint& constraint : parent_->constraints_) {
-      if (constraint.submap_id == submap_id) {
-        if (constraint.tag == Constraint::Tag::INTRA_SUBMAP &&
-            nodes_to_retain.count(constraint.node_id) == 0) {
-          // This node will no longer be INTRA_SUBMAP contrained and has to be
-          // removed.
-          nodes_to_remove.insert(constraint.node_id);
-        }
-      } else {
-        constraints.push_back(constraint);
-      }
+  for (const Constraint& submap_constraint :
+       parent_->constraints_.GetForSubmap(submap_id)) {
+    if (submap_constraint.tag != Constraint::Tag::INTRA_SUBMAP) {
+      continue;
     }
-    parent_->constraints_ = std::move(constraints);
-  }
-  // Remove all 'constraints_' related to 'nodes_to_remove'.
-  {
-    std::vector<Constraint> constraints;
-    for (const Constraint& constraint : parent_->constraints_) {
-      if (nodes_to_remove.count(constraint.node_id) == 0) {
-        constraints.push_back(constraint);
+    bool retain_node = false;
+    for (const Constraint& node_constraint :
+         parent_->constraints_.GetForNode(submap_constraint.node_id)) {
+      if (node_constraint.tag == Constraint::Tag::INTRA_SUBMAP &&
+          node_constraint.submap_id != submap_id) {
+        retain_node = true;
+        break;
       }
     }
-    parent_->constraints_ = std::move(constraints);
+    if (!retain_node) {
+      nodes_to_remove.insert(submap_constraint.node_id);
+    }
+  }
+  // Remove all 'constraints_' related to 'submap_id' and 'nodes_to_remove'.
+  parent_->constraints_.RemoveSubmap(submap_id);
+  for (const mapping::NodeId& node_id : nodes_to_remove) {
+    parent_->constraints_.RemoveNode(node_id);
   }
 
   // Mark the submap with 'submap_id' as trimmed and remove its data.
@@ -729,14 +1790,35 @@ void SparsePoseGraph::TrimmingHandle::MarkSubmapAsTrimmed(
   submap_data.state = SubmapState::kTrimmed;
   CHECK(submap_data.submap != nullptr);
   submap_data.submap.reset();
+  submap_data.node_ids.clear();
   parent_->constraint_builder_.DeleteScanMatcher(submap_id);
   parent_->optimization_problem_.TrimSubmap(submap_id);
+  if (parent_->cost_attribution_ != nullptr) {
+    parent_->cost_attribution_->RemoveSubmap(submap_id);
+    // Trimming the last submap of a trajectory also trims all its nodes.
+    if (parent_->optimization_problem_.submap_data()
+            .at(submap_id.trajectory_id)
+            .empty()) {
+      parent_->cost_attribution_->RemoveTrajectory(submap_id.trajectory_id);
+    }
+  }
+  // Submaps of localization trajectories are never added to the indices.
+  const auto submap_index_it =
+      parent_->finished_submap_indices_.find(submap_id.trajectory_id);
+  if (submap_index_it != parent_->finished_submap_indices_.end()) {
+    submap_index_it->second.Remove(submap_id);
+  }
 
   // Mark the 'nodes_to_remove' as trimmed and remove their data.
   for (const mapping::NodeId& node_id : nodes_to_remove) {
     CHECK(!parent_->trajectory_nodes_.at(node_id).trimmed());
+    parent_->node_time_index_.Remove(
+        node_id, parent_->trajectory_nodes_.at(node_id).constant_data->time);
     parent_->trajectory_nodes_.at(node_id).constant_data.reset();
+    parent_->change_log_.ChangeNode(node_id);
     parent_->optimization_problem_.TrimTrajectoryNode(node_id);
+    parent_->node_indices_.at(node_id.trajectory_id).Remove(node_id);
+    parent_->place_recognition_index_.Remove(node_id);
   }
 }
 
@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping_3d/sparse_pose_graph/constraint_builder.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iomanip>
@@ -26,9 +28,11 @@
 #include <string>
 
 #include "Eigen/Eigenvalues"
+#include "cartographer/common/deadline.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/common/trace.h"
 #include "cartographer/mapping_3d/scan_matching/proto/ceres_scan_matcher_options.pb.h"
 #include "cartographer/mapping_3d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
 #include "cartographer/transform/transform.h"
@@ -38,15 +42,63 @@ namespace cartographer {
 namespace mapping_3d {
 namespace sparse_pose_graph {
 
+namespace {
+
+using Stage = scan_matching::FastCorrelativeScanMatcher::Stage;
+
+string GetStageName(const Stage stage) {
+  switch (stage) {
+    case Stage::kRotationalScore:
+      return "rotational score";
+    case Stage::kLowestResolutionBound:
+      return "lowest resolution bound";
+    case Stage::kBranchAndBound:
+      return "branch and bound";
+    case Stage::kLowResolutionScore:
+      return "low resolution score";
+  }
+  LOG(FATAL) << "Unknown stage " << static_cast<int>(stage);
+}
+
+// Returns the number of points matched by a search for 'node_data', whose
+// point clouds may be compressed.
+int GetNumHighResolutionPoints(const mapping::TrajectoryNode::Data& node_data) {
+  if (node_data.compressed_point_clouds != nullptr) {
+    return node_data.compressed_point_clouds->high_resolution_point_cloud
+        .size();
+  }
+  return node_data.high_resolution_point_cloud.size();
+}
+
+}  // namespace
+
+ConstraintBuilder::ConstraintBuilder(
+    const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions& options,
+    common::ThreadPoolInterface* const thread_pool)
+    : ConstraintBuilder(options, common::WorkloadThreadPools(thread_pool)) {}
+
 ConstraintBuilder::ConstraintBuilder(
     const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions& options,
-    common::ThreadPool* const thread_pool)
+    const common::WorkloadThreadPools& thread_pools)
     : options_(options),
-      thread_pool_(thread_pool),
+      thread_pool_(thread_pools.constraints),
+      matcher_construction_thread_pool_(thread_pools.matcher_construction),
+      submap_scan_matchers_(
+          int64{options.scan_matcher_cache_size_mb()} * 1024 * 1024),
+      decompressed_nodes_(
+          int64{options.decompressed_node_cache_size_mb()} * 1024 * 1024),
+      sampling_ratio_(options.sampling_ratio()),
       sampler_(options.sampling_ratio()),
       ceres_scan_matcher_(options.ceres_scan_matcher_options_3d()) {}
 
 ConstraintBuilder::~ConstraintBuilder() {
+  {
+    common::MutexLocker locker(&warm_up_state_->mutex);
+    warm_up_state_->cancelled = true;
+    locker.Await([this]() REQUIRES(warm_up_state_->mutex) {
+      return warm_up_state_->num_running == 0;
+    });
+  }
   common::MutexLocker locker(&mutex_);
   CHECK_EQ(constraints_.size(), 0) << "WhenDone() was not called";
   CHECK_EQ(pending_computations_.size(), 0);
@@ -54,6 +106,35 @@ ConstraintBuilder::~ConstraintBuilder() {
   CHECK(when_done_ == nullptr);
 }
 
+void ConstraintBuilder::RegisterMetrics(metrics::Registry* const registry) {
+  for (const bool match_full_submap : {false, true}) {
+    const metrics::Labels labels = {
+        {"search", match_full_submap ? "global" : "local"}};
+    num_searches_metrics_[match_full_submap] = registry->GetCounter(
+        "cartographer_constraint_builder_searches_total",
+        "Number of constraint searches.", labels);
+    num_constraints_metrics_[match_full_submap] = registry->GetCounter(
+        "cartographer_constraint_builder_constraints_total",
+        "Number of constraints found.", labels);
+  }
+  num_skipped_searches_metric_ = registry->GetCounter(
+      "cartographer_constraint_builder_skipped_searches_total",
+      "Number of constraint searches skipped because of their deadline.");
+  num_truncated_searches_metric_ = registry->GetCounter(
+      "cartographer_constraint_builder_truncated_searches_total",
+      "Number of global constraint searches stopped by the time limit.");
+  const auto score_bucket_boundaries = metrics::Histogram::FixedWidth(0.05, 20);
+  score_metric_ = registry->GetHistogram(
+      "cartographer_constraint_builder_scores", "Scores of found constraints.",
+      {{"kind", "score"}}, score_bucket_boundaries);
+  rotational_score_metric_ = registry->GetHistogram(
+      "cartographer_constraint_builder_scores", "Scores of found constraints.",
+      {{"kind", "rotational_score"}}, score_bucket_boundaries);
+  low_resolution_score_metric_ = registry->GetHistogram(
+      "cartographer_constraint_builder_scores", "Scores of found constraints.",
+      {{"kind", "low_resolution_score"}}, score_bucket_boundaries);
+}
+
 void ConstraintBuilder::MaybeAddConstraint(
     const mapping::SubmapId& submap_id, const Submap* const submap,
     const mapping::NodeId& node_id,
@@ -65,14 +146,29 @@ void ConstraintBuilder::MaybeAddConstraint(
   }
   if (sampler_.Pulse()) {
     common::MutexLocker locker(&mutex_);
-    constraints_.emplace_back();
-    auto* const constraint = &constraints_.back();
+    constraints_.emplace_back(current_computation_, nullptr);
+    auto* const constraint = &constraints_.back().second;
     ++pending_computations_[current_computation_];
     const int current_computation = current_computation_;
+    const SearchCost search_cost = AddPendingSearch(
+        *submap, false /* match_full_submap */, *constant_data);
     ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
-        submap_id, submap_nodes, submap, [=]() EXCLUDES(mutex_) {
-          ComputeConstraint(submap_id, node_id, false, /* match_full_submap */
-                            constant_data, initial_pose, constraint);
+        submap_id, submap_nodes, submap, common::WorkItemPriority::kNormal,
+        "local_constraint_search_3d", search_cost.value_per_second,
+        [=](const SubmapScanMatcher& submap_scan_matcher) EXCLUDES(mutex_) {
+          const auto start_time = std::chrono::steady_clock::now();
+          const bool found_match = ComputeConstraint(
+              submap_id, node_id, false, /* match_full_submap */
+              constant_data, initial_pose, submap_scan_matcher, constraint);
+          const double seconds =
+              std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start_time)
+                  .count();
+          FinishPendingSearch(search_cost, seconds, found_match);
+          if (cost_attribution_ != nullptr) {
+            cost_attribution_->AddConstraintSearch(
+                submap_id, node_id.trajectory_id, seconds, found_match);
+          }
           FinishComputation(current_computation);
         });
   }
@@ -85,20 +181,85 @@ void ConstraintBuilder::MaybeAddGlobalConstraint(
     const std::vector<mapping::TrajectoryNode>& submap_nodes,
     const Eigen::Quaterniond& gravity_alignment) {
   common::MutexLocker locker(&mutex_);
-  constraints_.emplace_back();
-  auto* const constraint = &constraints_.back();
+  constraints_.emplace_back(current_computation_, nullptr);
+  auto* const constraint = &constraints_.back().second;
   ++pending_computations_[current_computation_];
   const int current_computation = current_computation_;
+  const SearchCost search_cost = AddPendingSearch(
+      *submap, true /* match_full_submap */, *constant_data);
   ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
-      submap_id, submap_nodes, submap, [=]() EXCLUDES(mutex_) {
-        ComputeConstraint(submap_id, node_id, true, /* match_full_submap */
-                          constant_data,
-                          transform::Rigid3d::Rotation(gravity_alignment),
-                          constraint);
+      submap_id, submap_nodes, submap, common::WorkItemPriority::kLow,
+      "global_constraint_search_3d", search_cost.value_per_second,
+      [=](const SubmapScanMatcher& submap_scan_matcher) EXCLUDES(mutex_) {
+        const auto start_time = std::chrono::steady_clock::now();
+        const bool found_match = ComputeConstraint(
+            submap_id, node_id, true, /* match_full_submap */
+            constant_data, transform::Rigid3d::Rotation(gravity_alignment),
+            submap_scan_matcher, constraint);
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start_time)
+                .count();
+        FinishPendingSearch(search_cost, seconds, found_match);
+        if (cost_attribution_ != nullptr) {
+          cost_attribution_->AddConstraintSearch(
+              submap_id, node_id.trajectory_id, seconds, found_match);
+        }
         FinishComputation(current_computation);
       });
 }
 
+void ConstraintBuilder::AddConstraintBeforeDeadline(
+    const mapping::SubmapId& submap_id, const Submap* const submap,
+    const mapping::NodeId& node_id,
+    const mapping::TrajectoryNode::Data* const constant_data,
+    const std::vector<mapping::TrajectoryNode>& submap_nodes,
+    const transform::Rigid3d& initial_pose,
+    const std::chrono::steady_clock::time_point deadline) {
+  if (initial_pose.translation().norm() > options_.max_constraint_distance()) {
+    return;
+  }
+  common::MutexLocker locker(&mutex_);
+  constraints_.emplace_back(current_computation_, nullptr);
+  auto* const constraint = &constraints_.back().second;
+  ++pending_computations_[current_computation_];
+  const int current_computation = current_computation_;
+  ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
+      submap_id, submap_nodes, submap, common::WorkItemPriority::kHigh,
+      "final_constraint_search_3d", 0. /* value_per_second */,
+      [=](const SubmapScanMatcher& submap_scan_matcher) EXCLUDES(mutex_) {
+        const auto start_time = std::chrono::steady_clock::now();
+        if (start_time < deadline) {
+          const bool found_match = ComputeConstraint(
+              submap_id, node_id, false, /* match_full_submap */
+              constant_data, initial_pose, submap_scan_matcher, constraint);
+          if (cost_attribution_ != nullptr) {
+            cost_attribution_->AddConstraintSearch(
+                submap_id, node_id.trajectory_id,
+                std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start_time)
+                    .count(),
+                found_match);
+          }
+        } else if (num_skipped_searches_metric_ != nullptr) {
+          num_skipped_searches_metric_->Increment();
+        }
+        FinishComputation(current_computation);
+      });
+}
+
+void ConstraintBuilder::SetSamplingRatioFactor(const double factor) {
+  sampling_ratio_factor_ = factor;
+  sampler_.SetRatio(sampling_ratio_ * sampling_ratio_factor_);
+}
+
+void ConstraintBuilder::SetSamplingRatio(const double sampling_ratio) {
+  CHECK_GT(sampling_ratio, 0.);
+  CHECK_LE(sampling_ratio, 1.);
+  sampling_ratio_ = sampling_ratio;
+  sampler_.SetRatio(sampling_ratio_ * sampling_ratio_factor_);
+}
+
 void ConstraintBuilder::NotifyEndOfScan() {
   common::MutexLocker locker(&mutex_);
   ++current_computation_;
@@ -113,64 +274,240 @@ void ConstraintBuilder::WhenDone(
   ++pending_computations_[current_computation_];
   const int current_computation = current_computation_;
   thread_pool_->Schedule(
-      [this, current_computation] { FinishComputation(current_computation); });
+      [this, current_computation] { FinishComputation(current_computation); },
+      common::WorkItemPriority::kHigh, "finish_computation_3d");
 }
 
 void ConstraintBuilder::ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
     const mapping::SubmapId& submap_id,
     const std::vector<mapping::TrajectoryNode>& submap_nodes,
-    const Submap* const submap, const std::function<void()>& work_item) {
-  if (submap_scan_matchers_[submap_id].fast_correlative_scan_matcher !=
-      nullptr) {
-    thread_pool_->Schedule(work_item);
-  } else {
-    submap_queued_work_items_[submap_id].push_back(work_item);
-    if (submap_queued_work_items_[submap_id].size() == 1) {
-      thread_pool_->Schedule([=]() {
-        ConstructSubmapScanMatcher(submap_id, submap_nodes, submap);
-      });
+    const Submap* const submap, const common::WorkItemPriority priority,
+    const string& label, const double value_per_second,
+    const SubmapScanMatcherWorkItem& work_item) {
+  if (submap_queued_work_items_.count(submap_id) == 0) {
+    std::shared_ptr<const SubmapScanMatcher> submap_scan_matcher =
+        submap_scan_matchers_.Get(submap_id);
+    if (submap_scan_matcher != nullptr) {
+      ScheduleWithSubmapScanMatcher(std::move(submap_scan_matcher), priority,
+                                    label, value_per_second, work_item);
+      return;
     }
+    // The scan matcher has not been constructed yet, or has been evicted.
+    matcher_construction_thread_pool_->Schedule(
+        [=]() {
+          ConstructSubmapScanMatcher(submap_id, submap_nodes, submap,
+                                     nullptr /* shared_submap */);
+        },
+        common::WorkItemPriority::kLowest, "precompute_scan_matcher_3d");
+  }
+  submap_queued_work_items_[submap_id].push_back(
+      {priority, label, value_per_second, work_item});
+}
+
+void ConstraintBuilder::ScheduleWithSubmapScanMatcher(
+    std::shared_ptr<const SubmapScanMatcher> submap_scan_matcher,
+    const common::WorkItemPriority priority, const string& label,
+    const double value_per_second, const SubmapScanMatcherWorkItem& work_item) {
+  if (options_.order_searches_by_value() && value_per_second > 0.) {
+    ordered_searches_.emplace(value_per_second, [submap_scan_matcher,
+                                                 work_item]() {
+      work_item(*submap_scan_matcher);
+    });
+    // Which search runs is only decided when the work item starts, so the
+    // statistics of all searches share one label.
+    thread_pool_->Schedule([this]() { RunMostValuableSearch(); }, priority,
+                           "constraint_search_3d");
+    return;
+  }
+  thread_pool_->Schedule(
+      [submap_scan_matcher, work_item]() { work_item(*submap_scan_matcher); },
+      priority, label);
+}
+
+void ConstraintBuilder::RunMostValuableSearch() {
+  std::function<void()> search;
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK(!ordered_searches_.empty());
+    search = std::move(ordered_searches_.begin()->second);
+    ordered_searches_.erase(ordered_searches_.begin());
+  }
+  search();
+}
+
+ConstraintBuilder::SearchCost ConstraintBuilder::AddPendingSearch(
+    const Submap& submap, const bool match_full_submap,
+    const mapping::TrajectoryNode::Data& node_data) {
+  SearchCost search_cost;
+  search_cost.search_type = {match_full_submap,
+                             submap.high_resolution_hybrid_grid().resolution()};
+  search_cost.num_points = GetNumHighResolutionPoints(node_data);
+  common::MutexLocker locker(&statistics_mutex_);
+  search_cost.predicted_seconds = cost_model_.PredictSeconds(
+      search_cost.search_type, search_cost.num_points);
+  search_cost.value_per_second = cost_model_.PredictValuePerSecond(
+      search_cost.search_type, search_cost.num_points);
+  pending_search_seconds_ += search_cost.predicted_seconds;
+  return search_cost;
+}
+
+void ConstraintBuilder::FinishPendingSearch(const SearchCost& search_cost,
+                                            const double seconds,
+                                            const bool found_match) {
+  common::MutexLocker locker(&statistics_mutex_);
+  cost_model_.AddSearch(search_cost.search_type, search_cost.num_points,
+                        seconds, found_match);
+  pending_search_seconds_ =
+      std::max(0., pending_search_seconds_ - search_cost.predicted_seconds);
+}
+
+double ConstraintBuilder::GetPendingSearchSeconds() {
+  common::MutexLocker locker(&statistics_mutex_);
+  return pending_search_seconds_;
+}
+
+void ConstraintBuilder::WarmUpScanMatchers(std::vector<WarmUpSubmap> submaps,
+                                           const int num_urgent_submaps) {
+  const std::shared_ptr<WarmUpState> warm_up_state = warm_up_state_;
+  for (size_t i = 0; i != submaps.size(); ++i) {
+    const auto warm_up_submap =
+        std::make_shared<const WarmUpSubmap>(std::move(submaps[i]));
+    const bool urgent = static_cast<int>(i) < num_urgent_submaps;
+    // Constructions of the same priority run in the order they are scheduled.
+    matcher_construction_thread_pool_->Schedule(
+        [this, warm_up_state, warm_up_submap, urgent]() {
+          {
+            common::MutexLocker locker(&warm_up_state->mutex);
+            if (warm_up_state->cancelled) {
+              return;
+            }
+            ++warm_up_state->num_running;
+          }
+          const mapping::SubmapId& submap_id = warm_up_submap->submap_id;
+          bool construct = true;
+          if (!urgent) {
+            // Scan matchers constructed further away would evict the ones
+            // closer by.
+            common::MutexLocker locker(&mutex_);
+            construct = !submap_scan_matchers_.full() ||
+                        submap_queued_work_items_.count(submap_id) != 0;
+          }
+          if (construct) {
+            ConstructSubmapScanMatcher(
+                submap_id, warm_up_submap->submap_nodes,
+                warm_up_submap->submap.get(), warm_up_submap->submap);
+          }
+          common::MutexLocker locker(&warm_up_state->mutex);
+          --warm_up_state->num_running;
+        },
+        urgent ? common::WorkItemPriority::kHigh
+               : common::WorkItemPriority::kLowest,
+        "warm_up_scan_matcher_3d");
   }
 }
 
 void ConstraintBuilder::ConstructSubmapScanMatcher(
     const mapping::SubmapId& submap_id,
     const std::vector<mapping::TrajectoryNode>& submap_nodes,
-    const Submap* const submap) {
-  auto submap_scan_matcher =
-      common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
-          submap->high_resolution_hybrid_grid(),
-          &submap->low_resolution_hybrid_grid(), submap_nodes,
-          options_.fast_correlative_scan_matcher_options_3d());
+    const Submap* const submap, std::shared_ptr<const Submap> shared_submap) {
+  {
+    common::MutexLocker locker(&mutex_);
+    if (constructing_scan_matchers_.count(submap_id) != 0 ||
+        (submap_queued_work_items_.count(submap_id) == 0 &&
+         submap_scan_matchers_.Contains(submap_id))) {
+      return;
+    }
+    constructing_scan_matchers_.insert(submap_id);
+  }
+  const auto start_time = std::chrono::steady_clock::now();
+  auto submap_scan_matcher = std::make_shared<SubmapScanMatcher>();
+  submap_scan_matcher->shared_submap = std::move(shared_submap);
+  submap_scan_matcher->high_resolution_hybrid_grid =
+      &submap->high_resolution_hybrid_grid();
+  submap_scan_matcher->low_resolution_hybrid_grid =
+      &submap->low_resolution_hybrid_grid();
+  const std::shared_ptr<const io::MappedBlobFile> precomputed_grids =
+      GetPrecomputedGrids(submap_id);
+  // Finished submaps provide compact copies of their grids which are faster to
+  // precompute from and to score against. Submaps of loaded trajectories might
+  // not be finished, and are matched against their hybrid grids instead.
+  if (submap->finished() && precomputed_grids != nullptr) {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            submap->frozen_high_resolution_hybrid_grid(),
+            &submap->frozen_low_resolution_hybrid_grid(), submap_nodes,
+            options_.fast_correlative_scan_matcher_options_3d(),
+            precomputed_grids, submap_id.submap_index);
+  } else if (submap->finished()) {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            submap->frozen_high_resolution_hybrid_grid(),
+            &submap->frozen_low_resolution_hybrid_grid(), submap_nodes,
+            options_.fast_correlative_scan_matcher_options_3d(),
+            matcher_construction_thread_pool_,
+            options_.scan_matcher_precomputation_num_tasks());
+  } else if (precomputed_grids != nullptr) {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            submap->high_resolution_hybrid_grid(),
+            &submap->low_resolution_hybrid_grid(), submap_nodes,
+            options_.fast_correlative_scan_matcher_options_3d(),
+            precomputed_grids, submap_id.submap_index);
+  } else {
+    submap_scan_matcher->fast_correlative_scan_matcher =
+        common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+            submap->high_resolution_hybrid_grid(),
+            &submap->low_resolution_hybrid_grid(), submap_nodes,
+            options_.fast_correlative_scan_matcher_options_3d(),
+            matcher_construction_thread_pool_,
+            options_.scan_matcher_precomputation_num_tasks());
+  }
+  const int64 memory_usage_in_bytes =
+      submap_scan_matcher->fast_correlative_scan_matcher
+          ->GetMemoryUsageInBytes();
+  if (cost_attribution_ != nullptr) {
+    cost_attribution_->AddScanMatcherConstruction(
+        submap_id, std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count());
+  }
   common::MutexLocker locker(&mutex_);
-  submap_scan_matchers_[submap_id] = {&submap->high_resolution_hybrid_grid(),
-                                      &submap->low_resolution_hybrid_grid(),
-                                      std::move(submap_scan_matcher)};
-  for (const std::function<void()>& work_item :
+  submap_scan_matchers_.Insert(submap_id, submap_scan_matcher,
+                               memory_usage_in_bytes);
+  for (const QueuedWorkItem& queued_work_item :
        submap_queued_work_items_[submap_id]) {
-    thread_pool_->Schedule(work_item);
+    ScheduleWithSubmapScanMatcher(
+        submap_scan_matcher, queued_work_item.priority, queued_work_item.label,
+        queued_work_item.value_per_second, queued_work_item.work_item);
   }
   submap_queued_work_items_.erase(submap_id);
+  constructing_scan_matchers_.erase(submap_id);
 }
 
-const ConstraintBuilder::SubmapScanMatcher*
-ConstraintBuilder::GetSubmapScanMatcher(const mapping::SubmapId& submap_id) {
+std::shared_ptr<const io::MappedBlobFile>
+ConstraintBuilder::GetPrecomputedGrids(const mapping::SubmapId& submap_id) {
   common::MutexLocker locker(&mutex_);
-  const SubmapScanMatcher* submap_scan_matcher =
-      &submap_scan_matchers_[submap_id];
-  CHECK(submap_scan_matcher->fast_correlative_scan_matcher != nullptr);
-  return submap_scan_matcher;
+  const auto it = precomputed_grids_.find(submap_id.trajectory_id);
+  if (it == precomputed_grids_.end() ||
+      submap_id.submap_index >= it->second->num_blobs()) {
+    return nullptr;
+  }
+  return it->second;
 }
 
-void ConstraintBuilder::ComputeConstraint(
+bool ConstraintBuilder::ComputeConstraint(
     const mapping::SubmapId& submap_id, const mapping::NodeId& node_id,
     bool match_full_submap,
-    const mapping::TrajectoryNode::Data* const constant_data,
+    const mapping::TrajectoryNode::Data* const node_data,
     const transform::Rigid3d& initial_pose,
+    const SubmapScanMatcher& submap_scan_matcher,
     std::unique_ptr<OptimizationProblem::Constraint>* constraint) {
-  const SubmapScanMatcher* const submap_scan_matcher =
-      GetSubmapScanMatcher(submap_id);
-
+  CARTOGRAPHER_TRACE_SPAN("ConstraintBuilder::ComputeConstraint");
+  if (num_searches_metrics_[match_full_submap] != nullptr) {
+    num_searches_metrics_[match_full_submap]->Increment();
+  }
+  const std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data =
+      decompressed_nodes_.Get(node_id, node_data);
   // The 'constraint_transform' (submap i <- scan j) is computed from:
   // - a 'high_resolution_point_cloud' in scan j and
   // - the initial guess 'initial_pose' (submap i <- scan j).
@@ -178,38 +515,63 @@ void ConstraintBuilder::ComputeConstraint(
   transform::Rigid3d pose_estimate;
   float rotational_score = 0.f;
   float low_resolution_score = 0.f;
+  Stage rejecting_stage;
 
   // Compute 'pose_estimate' in three stages:
   // 1. Fast estimate using the fast correlative scan matcher.
   // 2. Prune if the score is too low.
   // 3. Refine.
   if (match_full_submap) {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->MatchFullSubmap(
+    std::unique_ptr<common::Deadline> deadline;
+    if (options_.global_localization_time_limit_seconds() > 0.) {
+      deadline = common::make_unique<common::Deadline>(common::FromSeconds(
+          options_.global_localization_time_limit_seconds()));
+    }
+    const bool success =
+        submap_scan_matcher.fast_correlative_scan_matcher->MatchFullSubmap(
             initial_pose.rotation(), *constant_data,
-            options_.global_localization_min_score(), &score, &pose_estimate,
-            &rotational_score, &low_resolution_score)) {
+            options_.global_localization_min_score(), thread_pool_,
+            options_.global_localization_num_tasks(), deadline.get(), &score,
+            &pose_estimate, &rotational_score, &low_resolution_score,
+            &rejecting_stage);
+    if (deadline != nullptr && deadline->expired() &&
+        num_truncated_searches_metric_ != nullptr) {
+      num_truncated_searches_metric_->Increment();
+    }
+    if (success) {
       CHECK_GT(score, options_.global_localization_min_score());
       CHECK_GE(node_id.trajectory_id, 0);
       CHECK_GE(submap_id.trajectory_id, 0);
     } else {
-      return;
+      common::MutexLocker locker(&statistics_mutex_);
+      ++num_rejected_matches_by_stage_[static_cast<int>(rejecting_stage)];
+      return false;
     }
   } else {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->Match(
+    if (submap_scan_matcher.fast_correlative_scan_matcher->Match(
             initial_pose, *constant_data, options_.min_score(), &score,
-            &pose_estimate, &rotational_score, &low_resolution_score)) {
+            &pose_estimate, &rotational_score, &low_resolution_score,
+            &rejecting_stage)) {
       // We've reported a successful local match.
       CHECK_GT(score, options_.min_score());
     } else {
-      return;
+      common::MutexLocker locker(&statistics_mutex_);
+      ++num_rejected_matches_by_stage_[static_cast<int>(rejecting_stage)];
+      return false;
     }
   }
   {
-    common::MutexLocker locker(&mutex_);
+    common::MutexLocker locker(&statistics_mutex_);
     score_histogram_.Add(score);
     rotational_score_histogram_.Add(rotational_score);
     low_resolution_score_histogram_.Add(low_resolution_score);
   }
+  if (score_metric_ != nullptr) {
+    num_constraints_metrics_[match_full_submap]->Increment();
+    score_metric_->Observe(score);
+    rotational_score_metric_->Observe(rotational_score);
+    low_resolution_score_metric_->Observe(low_resolution_score);
+  }
 
   // Use the CSM estimate as both the initial and previous pose. This has the
   // effect that, in the absence of better information, we prefer the original
@@ -218,9 +580,9 @@ void ConstraintBuilder::ComputeConstraint(
   transform::Rigid3d constraint_transform;
   ceres_scan_matcher_.Match(pose_estimate, pose_estimate,
                             {{&constant_data->high_resolution_point_cloud,
-                              submap_scan_matcher->high_resolution_hybrid_grid},
+                              submap_scan_matcher.high_resolution_hybrid_grid},
                              {&constant_data->low_resolution_point_cloud,
-                              submap_scan_matcher->low_resolution_hybrid_grid}},
+                              submap_scan_matcher.low_resolution_hybrid_grid}},
                             &constraint_transform, &unused_summary);
 
   constraint->reset(new OptimizationProblem::Constraint{
@@ -247,33 +609,51 @@ void ConstraintBuilder::ComputeConstraint(
     info << " with score " << std::setprecision(1) << 100. * score << "%.";
     LOG(INFO) << info.str();
   }
+  return true;
 }
 
 void ConstraintBuilder::FinishComputation(const int computation_index) {
   Result result;
   std::unique_ptr<std::function<void(const Result&)>> callback;
+  bool scan_finished = false;
   {
     common::MutexLocker locker(&mutex_);
     if (--pending_computations_[computation_index] == 0) {
+      scan_finished =
+          pending_computations_.begin()->first == computation_index;
       pending_computations_.erase(computation_index);
     }
     if (pending_computations_.empty()) {
       CHECK_EQ(submap_queued_work_items_.size(), 0);
       if (when_done_ != nullptr) {
-        for (const std::unique_ptr<OptimizationProblem::Constraint>&
-                 constraint : constraints_) {
-          if (constraint != nullptr) {
-            result.push_back(*constraint);
+        for (const auto& entry : constraints_) {
+          if (entry.second != nullptr) {
+            result.push_back(*entry.second);
           }
         }
         if (options_.log_matches()) {
           LOG(INFO) << constraints_.size() << " computations resulted in "
                     << result.size() << " additional constraints.";
+          common::MutexLocker statistics_locker(&statistics_mutex_);
           LOG(INFO) << "Score histogram:\n" << score_histogram_.ToString(10);
+          LOG(INFO) << "Search costs:\n" << cost_model_.ToString();
           LOG(INFO) << "Rotational score histogram:\n"
                     << rotational_score_histogram_.ToString(10);
           LOG(INFO) << "Low resolution score histogram:\n"
                     << low_resolution_score_histogram_.ToString(10);
+          std::ostringstream rejections;
+          rejections << "Rejected matches by stage:";
+          for (size_t i = 0; i != num_rejected_matches_by_stage_.size(); ++i) {
+            rejections << (i == 0 ? " " : ", ")
+                       << num_rejected_matches_by_stage_[i] << " by "
+                       << GetStageName(static_cast<Stage>(i));
+          }
+          LOG(INFO) << rejections.str() << ".";
+          LOG(INFO) << "Scan matcher cache: " << submap_scan_matchers_.size()
+                    << " scan matchers using "
+                    << submap_scan_matchers_.size_in_bytes() / (1024 * 1024)
+                    << " MiB, "
+                    << submap_scan_matchers_.statistics().ToString() << ".";
         }
         constraints_.clear();
         callback = std::move(when_done_);
@@ -281,11 +661,24 @@ void ConstraintBuilder::FinishComputation(const int computation_index) {
       }
     }
   }
+  if (scan_finished && scan_finished_callback_ != nullptr) {
+    scan_finished_callback_();
+  }
   if (callback != nullptr) {
     (*callback)(result);
   }
 }
 
+void ConstraintBuilder::SetScanFinishedCallback(
+    std::function<void()> callback) {
+  scan_finished_callback_ = std::move(callback);
+}
+
+void ConstraintBuilder::SetCostAttribution(
+    mapping::sparse_pose_graph::CostAttribution* const cost_attribution) {
+  cost_attribution_ = cost_attribution;
+}
+
 int ConstraintBuilder::GetNumFinishedScans() {
   common::MutexLocker locker(&mutex_);
   if (pending_computations_.empty()) {
@@ -294,10 +687,39 @@ int ConstraintBuilder::GetNumFinishedScans() {
   return pending_computations_.begin()->first;
 }
 
+int64 ConstraintBuilder::GetMemoryUsageInBytes() {
+  common::MutexLocker locker(&mutex_);
+  return submap_scan_matchers_.size_in_bytes();
+}
+
+ConstraintBuilder::Result ConstraintBuilder::TakeFinishedConstraints() {
+  common::MutexLocker locker(&mutex_);
+  const int num_finished_scans = pending_computations_.empty()
+                                     ? current_computation_
+                                     : pending_computations_.begin()->first;
+  Result result;
+  while (!constraints_.empty() &&
+         constraints_.front().first < num_finished_scans) {
+    if (constraints_.front().second != nullptr) {
+      result.push_back(*constraints_.front().second);
+    }
+    constraints_.pop_front();
+  }
+  return result;
+}
+
 void ConstraintBuilder::DeleteScanMatcher(const mapping::SubmapId& submap_id) {
   common::MutexLocker locker(&mutex_);
   CHECK(pending_computations_.empty());
-  submap_scan_matchers_.erase(submap_id);
+  submap_scan_matchers_.Erase(submap_id);
+}
+
+void ConstraintBuilder::SetPrecomputedGrids(
+    const int trajectory_id,
+    std::shared_ptr<const io::MappedBlobFile> mapped_blob_file) {
+  CHECK(mapped_blob_file != nullptr);
+  common::MutexLocker locker(&mutex_);
+  precomputed_grids_[trajectory_id] = std::move(mapped_blob_file);
 }
 
 }  // namespace sparse_pose_graph
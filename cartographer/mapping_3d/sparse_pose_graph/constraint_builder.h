@@ -18,19 +18,30 @@
 #define CARTOGRAPHER_MAPPING_3D_SPARSE_POSE_GRAPH_CONSTRAINT_BUILDER_H_
 
 #include <array>
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "cartographer/common/fixed_ratio_sampler.h"
 #include "cartographer/common/histogram.h"
+#include "cartographer/common/lru_cache.h"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/mutex.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/io/mapped_blob_file.h"
+#include "cartographer/mapping/decompressed_node_cache.h"
+#include "cartographer/mapping/sparse_pose_graph/constraint_cost_model.h"
+#include "cartographer/mapping/sparse_pose_graph/cost_attribution.h"
 #include "cartographer/mapping/trajectory_node.h"
 #include "cartographer/mapping_3d/scan_matching/ceres_scan_matcher.h"
 #include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
@@ -49,7 +60,13 @@ namespace sparse_pose_graph {
 // Intermingle an arbitrary number of calls to MaybeAddConstraint() or
 // MaybeAddGlobalConstraint, then call WhenDone(). After all computations are
 // done the 'callback' will be called with the result and another
-// MaybeAdd(Global)Constraint()/WhenDone() cycle can follow.
+// MaybeAdd(Global)Constraint()/WhenDone() cycle can follow. Alternatively,
+// TakeFinishedConstraints() hands out the results of the scans whose
+// computations have all finished, without waiting for the others.
+//
+// The run time of each search is recorded in a ConstraintCostModel, which
+// predicts the run time of the pending searches, see GetPendingSearchSeconds(),
+// and with 'order_searches_by_value' decides which search to start next.
 //
 // This class is thread-safe.
 class ConstraintBuilder {
@@ -60,12 +77,23 @@ class ConstraintBuilder {
   ConstraintBuilder(
       const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions&
           options,
-      common::ThreadPool* thread_pool);
+      common::ThreadPoolInterface* thread_pool);
+  // Same as above, but scan matchers are constructed on the
+  // 'matcher_construction' pool and constraints are computed on the
+  // 'constraints' pool of 'thread_pools'.
+  ConstraintBuilder(
+      const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions&
+          options,
+      const common::WorkloadThreadPools& thread_pools);
   ~ConstraintBuilder();
 
   ConstraintBuilder(const ConstraintBuilder&) = delete;
   ConstraintBuilder& operator=(const ConstraintBuilder&) = delete;
 
+  // Exports the number of searches and found constraints and the scan matcher
+  // scores to 'registry'. Must be called before the first constraint search.
+  void RegisterMetrics(metrics::Registry* registry);
+
   // Schedules exploring a new constraint between 'submap' identified by
   // 'submap_id', and the 'compressed_point_cloud' for 'node_id'.
   // The 'initial_pose' is relative to the 'submap'.
@@ -95,6 +123,27 @@ class ConstraintBuilder {
       const std::vector<mapping::TrajectoryNode>& submap_nodes,
       const Eigen::Quaterniond& gravity_alignment);
 
+  // Like MaybeAddConstraint(), but without sampling and at high priority. The
+  // search is skipped if it has not started before 'deadline'. Used to search
+  // exhaustively before the final optimization.
+  void AddConstraintBeforeDeadline(
+      const mapping::SubmapId& submap_id, const Submap* submap,
+      const mapping::NodeId& node_id,
+      const mapping::TrajectoryNode::Data* const constant_data,
+      const std::vector<mapping::TrajectoryNode>& submap_nodes,
+      const transform::Rigid3d& initial_pose,
+      std::chrono::steady_clock::time_point deadline);
+
+  // Scales the 'sampling_ratio' of MaybeAddConstraint() by 'factor' in
+  // (0, 1], e.g. to shed load. Like MaybeAddConstraint(), this must not be
+  // called concurrently with it.
+  void SetSamplingRatioFactor(double factor);
+
+  // Replaces the 'sampling_ratio' of the options, keeping the factor set by
+  // SetSamplingRatioFactor(). Must not be called concurrently with
+  // MaybeAddConstraint().
+  void SetSamplingRatio(double sampling_ratio);
+
   // Must be called after all computations related to one node have been added.
   void NotifyEndOfScan();
 
@@ -105,43 +154,152 @@ class ConstraintBuilder {
   // Returns the number of consecutive finished scans.
   int GetNumFinishedScans();
 
+  // Returns the predicted run time in seconds of the searches which were added
+  // and did not finish yet.
+  double GetPendingSearchSeconds() EXCLUDES(statistics_mutex_);
+
+  // Sets the 'callback' called whenever GetNumFinishedScans() increased
+  // because computations finished. It is called from background threads, but
+  // not while any locks of this class are held. Must be called before any
+  // computations are added.
+  void SetScanFinishedCallback(std::function<void()> callback);
+
+  // Sets where the time of constraint searches and scan matcher construction
+  // is accumulated, or null. Must be called before any computations are added.
+  void SetCostAttribution(
+      mapping::sparse_pose_graph::CostAttribution* cost_attribution);
+
+  // Returns the number of bytes used by the cached scan matchers.
+  int64 GetMemoryUsageInBytes() EXCLUDES(mutex_);
+
+  // Returns and removes the constraints found for the first
+  // GetNumFinishedScans() scans, i.e. a consistent subset of the results which
+  // does not depend on the computations still running for later scans.
+  Result TakeFinishedConstraints();
+
   // Delete data related to 'submap_id'.
   void DeleteScanMatcher(const mapping::SubmapId& submap_id);
 
+  // Scan matchers for submaps of 'trajectory_id' are constructed from the
+  // precomputed grids in the 'mapped_blob_file' instead of computing them. The
+  // blob with index 'submap_index' belongs to the submap of that index.
+  void SetPrecomputedGrids(
+      int trajectory_id,
+      std::shared_ptr<const io::MappedBlobFile> mapped_blob_file);
+
+  // A submap to construct the scan matcher for in WarmUpScanMatchers().
+  struct WarmUpSubmap {
+    mapping::SubmapId submap_id;
+    std::shared_ptr<const Submap> submap;
+    std::vector<mapping::TrajectoryNode> submap_nodes;
+  };
+
+  // Constructs the scan matchers of the 'submaps' in the background in the
+  // given order, e.g. by distance from where a trajectory starts localizing,
+  // so that they are ready before searches need them. The first
+  // 'num_urgent_submaps' are constructed with high priority, the others at the
+  // lowest priority while they fit into the scan matcher cache. Scan matchers
+  // already waited for by searches are constructed in this order as well.
+  void WarmUpScanMatchers(std::vector<WarmUpSubmap> submaps,
+                          int num_urgent_submaps);
+
  private:
   struct SubmapScanMatcher {
+    // Keeps the hybrid grids alive if the submap was passed to
+    // WarmUpScanMatchers().
+    std::shared_ptr<const Submap> shared_submap;
     const HybridGrid* high_resolution_hybrid_grid;
     const HybridGrid* low_resolution_hybrid_grid;
     std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
         fast_correlative_scan_matcher;
   };
 
-  // Either schedules the 'work_item', or if needed, schedules the scan matcher
-  // construction and queues the 'work_item'.
+  // Work to do with the scan matcher of a submap.
+  using SubmapScanMatcherWorkItem =
+      std::function<void(const SubmapScanMatcher&)>;
+
+  // State shared with the constructions started by WarmUpScanMatchers(), so
+  // that those not yet running are dropped on destruction.
+  struct WarmUpState {
+    common::Mutex mutex;
+    bool cancelled GUARDED_BY(mutex) = false;
+    int num_running GUARDED_BY(mutex) = 0;
+  };
+
+  struct QueuedWorkItem {
+    common::WorkItemPriority priority;
+    string label;
+    double value_per_second;
+    SubmapScanMatcherWorkItem work_item;
+  };
+
+  // The prediction of the 'cost_model_' for a search.
+  struct SearchCost {
+    mapping::sparse_pose_graph::ConstraintCostModel::SearchType search_type;
+    int num_points;
+    double predicted_seconds;
+    double value_per_second;
+  };
+
+  // Either schedules the 'work_item' with 'priority' and 'label', or if needed,
+  // schedules the scan matcher construction and queues the 'work_item'.
   void ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
       const mapping::SubmapId& submap_id,
       const std::vector<mapping::TrajectoryNode>& submap_nodes,
-      const Submap* submap, const std::function<void()>& work_item)
+      const Submap* submap, common::WorkItemPriority priority,
+      const string& label, double value_per_second,
+      const SubmapScanMatcherWorkItem& work_item) REQUIRES(mutex_);
+
+  // Schedules the 'work_item' to run with the 'submap_scan_matcher', which is
+  // kept alive until then even if it is evicted from the cache. With
+  // 'order_searches_by_value', it is added to the 'ordered_searches_' instead
+  // and a work item running the most valuable of them is scheduled, unless its
+  // 'value_per_second' is 0.
+  void ScheduleWithSubmapScanMatcher(
+      std::shared_ptr<const SubmapScanMatcher> submap_scan_matcher,
+      common::WorkItemPriority priority, const string& label,
+      double value_per_second, const SubmapScanMatcherWorkItem& work_item)
       REQUIRES(mutex_);
 
+  // Removes the search with the highest value per second from the
+  // 'ordered_searches_' and runs it.
+  void RunMostValuableSearch() EXCLUDES(mutex_);
+
+  // Predicts the cost of a search against 'submap' for the point cloud of
+  // 'node_data' and adds its run time to the 'pending_search_seconds_'.
+  SearchCost AddPendingSearch(const Submap& submap, bool match_full_submap,
+                              const mapping::TrajectoryNode::Data& node_data)
+      EXCLUDES(statistics_mutex_);
+
+  // Records that the search of 'search_cost' took 'seconds' and whether it
+  // found a match, and removes it from the 'pending_search_seconds_'.
+  void FinishPendingSearch(const SearchCost& search_cost, double seconds,
+                           bool found_match) EXCLUDES(statistics_mutex_);
+
   // Constructs the scan matcher for a 'submap', then schedules its work items.
+  // Does nothing if another construction for 'submap_id' already started or
+  // finished. The 'shared_submap' is kept alive with the scan matcher unless
+  // it is nullptr.
   void ConstructSubmapScanMatcher(
       const mapping::SubmapId& submap_id,
       const std::vector<mapping::TrajectoryNode>& submap_nodes,
-      const Submap* submap) EXCLUDES(mutex_);
+      const Submap* submap, std::shared_ptr<const Submap> shared_submap)
+      EXCLUDES(mutex_);
 
-  // Returns the scan matcher for a submap, which has to exist.
-  const SubmapScanMatcher* GetSubmapScanMatcher(
+  // Returns the precomputed grids to construct the scan matcher for
+  // 'submap_id' from, or nullptr if there are none.
+  std::shared_ptr<const io::MappedBlobFile> GetPrecomputedGrids(
       const mapping::SubmapId& submap_id) EXCLUDES(mutex_);
 
   // Runs in a background thread and does computations for an additional
-  // constraint.
-  // As output, it may create a new Constraint in 'constraint'.
-  void ComputeConstraint(
+  // constraint. The point clouds of 'node_data' are decompressed if needed.
+  // As output, it may create a new Constraint in 'constraint'. Returns whether
+  // the search found a match.
+  bool ComputeConstraint(
       const mapping::SubmapId& submap_id, const mapping::NodeId& node_id,
-      bool match_full_submap,
-      const mapping::TrajectoryNode::Data* const constant_data,
+      bool match_full_submap, const mapping::TrajectoryNode::Data* node_data,
       const transform::Rigid3d& initial_pose,
+      const SubmapScanMatcher& submap_scan_matcher,
       std::unique_ptr<Constraint>* constraint) EXCLUDES(mutex_);
 
   // Decrements the 'pending_computations_' count. If all computations are done,
@@ -149,9 +307,15 @@ class ConstraintBuilder {
   void FinishComputation(int computation_index) EXCLUDES(mutex_);
 
   const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions options_;
-  common::ThreadPool* thread_pool_;
+  common::ThreadPoolInterface* thread_pool_;
+  common::ThreadPoolInterface* matcher_construction_thread_pool_;
   common::Mutex mutex_;
 
+  // Set by SetScanFinishedCallback().
+  std::function<void()> scan_finished_callback_;
+  // Set by SetCostAttribution().
+  mapping::sparse_pose_graph::CostAttribution* cost_attribution_ = nullptr;
+
   // 'callback' set by WhenDone().
   std::unique_ptr<std::function<void(const Result&)>> when_done_
       GUARDED_BY(mutex_);
@@ -165,26 +329,79 @@ class ConstraintBuilder {
   // added for it.
   std::map<int, int> pending_computations_ GUARDED_BY(mutex_);
 
-  // Constraints currently being computed in the background. A deque is used to
-  // keep pointers valid when adding more entries.
-  std::deque<std::unique_ptr<Constraint>> constraints_ GUARDED_BY(mutex_);
+  // Constraints currently being computed in the background, together with the
+  // index of the scan they were added for, in increasing order of that index.
+  // A deque is used to keep pointers valid when adding or removing entries at
+  // either end.
+  std::deque<std::pair<int, std::unique_ptr<Constraint>>> constraints_
+      GUARDED_BY(mutex_);
+
+  // Cache of already constructed scan matchers by 'submap_id'. Evicted scan
+  // matchers are constructed again when needed.
+  common::LruCache<mapping::SubmapId, SubmapScanMatcher> submap_scan_matchers_
+      GUARDED_BY(mutex_);
 
-  // Map of already constructed scan matchers by 'submap_id'.
-  std::map<mapping::SubmapId, SubmapScanMatcher> submap_scan_matchers_
+  // Decompressed point clouds of the nodes most recently matched against.
+  mapping::DecompressedNodeCache decompressed_nodes_;
+
+  // Precomputed grids set by SetPrecomputedGrids(), by trajectory ID.
+  std::map<int, std::shared_ptr<const io::MappedBlobFile>> precomputed_grids_
       GUARDED_BY(mutex_);
 
   // Map by 'submap_id' of scan matchers under construction, and the work
   // to do once construction is done.
-  std::map<mapping::SubmapId, std::vector<std::function<void()>>>
+  std::map<mapping::SubmapId, std::vector<QueuedWorkItem>>
       submap_queued_work_items_ GUARDED_BY(mutex_);
 
+  // Scan matchers whose construction is running. Scheduling a construction
+  // more than once, e.g. for a search and by WarmUpScanMatchers(), constructs
+  // it only once.
+  std::set<mapping::SubmapId> constructing_scan_matchers_ GUARDED_BY(mutex_);
+
+  // Searches ready to run by decreasing value per second, if
+  // 'order_searches_by_value' is enabled. Each is run by whichever work item
+  // scheduled for them starts next.
+  std::multimap<double, std::function<void()>, std::greater<double>>
+      ordered_searches_ GUARDED_BY(mutex_);
+
+  const std::shared_ptr<WarmUpState> warm_up_state_ =
+      std::make_shared<WarmUpState>();
+
+  double sampling_ratio_;
+  double sampling_ratio_factor_ = 1.;
   common::FixedRatioSampler sampler_;
   scan_matching::CeresScanMatcher ceres_scan_matcher_;
 
+  // Guards the statistics updated by every search, so that searches running
+  // concurrently only contend on 'mutex_' once, when they finish. Acquired
+  // after 'mutex_' if both are needed.
+  common::Mutex statistics_mutex_;
+
   // Histograms of scan matcher scores.
-  common::Histogram score_histogram_ GUARDED_BY(mutex_);
-  common::Histogram rotational_score_histogram_ GUARDED_BY(mutex_);
-  common::Histogram low_resolution_score_histogram_ GUARDED_BY(mutex_);
+  common::Histogram score_histogram_ GUARDED_BY(statistics_mutex_);
+  common::Histogram rotational_score_histogram_ GUARDED_BY(statistics_mutex_);
+  common::Histogram low_resolution_score_histogram_
+      GUARDED_BY(statistics_mutex_);
+
+  mapping::sparse_pose_graph::ConstraintCostModel cost_model_
+      GUARDED_BY(statistics_mutex_);
+  // Sum of the predicted run times of the searches which did not finish yet.
+  double pending_search_seconds_ GUARDED_BY(statistics_mutex_) = 0.;
+
+  // Set by RegisterMetrics(). The arrays are indexed by whether the search
+  // covered the full submap.
+  std::array<metrics::Counter*, 2> num_searches_metrics_ = {};
+  std::array<metrics::Counter*, 2> num_constraints_metrics_ = {};
+  metrics::Histogram* score_metric_ = nullptr;
+  metrics::Histogram* rotational_score_metric_ = nullptr;
+  metrics::Histogram* low_resolution_score_metric_ = nullptr;
+  metrics::Counter* num_skipped_searches_metric_ = nullptr;
+  metrics::Counter* num_truncated_searches_metric_ = nullptr;
+
+  // Number of matches rejected by each stage of the fast correlative scan
+  // matcher, indexed by 'FastCorrelativeScanMatcher::Stage'.
+  std::array<int, scan_matching::FastCorrelativeScanMatcher::kNumStages>
+      num_rejected_matches_by_stage_ GUARDED_BY(statistics_mutex_) = {};
 };
 
 }  // namespace sparse_pose_graph
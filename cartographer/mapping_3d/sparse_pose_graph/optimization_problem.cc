@@ -18,11 +18,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <iterator>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "Eigen/Core"
@@ -30,6 +32,8 @@
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/time.h"
+#include "cartographer/common/trace.h"
+#include "cartographer/mapping/connected_components.h"
 #include "cartographer/mapping_3d/acceleration_cost_function.h"
 #include "cartographer/mapping_3d/ceres_pose.h"
 #include "cartographer/mapping_3d/imu_integration.h"
@@ -70,6 +74,26 @@ void OptimizationProblem::AddOdometerData(
   odometry_data_[trajectory_id].Push(odometry_data.time, odometry_data.pose);
 }
 
+void OptimizationProblem::AddImuData(
+    const int trajectory_id, const std::vector<sensor::ImuData>& imu_data) {
+  CHECK_GE(trajectory_id, 0);
+  imu_data_.resize(
+      std::max(imu_data_.size(), static_cast<size_t>(trajectory_id) + 1));
+  imu_data_[trajectory_id].insert(imu_data_[trajectory_id].end(),
+                                  imu_data.begin(), imu_data.end());
+}
+
+void OptimizationProblem::AddOdometerData(
+    const int trajectory_id,
+    const std::vector<sensor::OdometryData>& odometry_data) {
+  CHECK_GE(trajectory_id, 0);
+  odometry_data_.resize(
+      std::max(odometry_data_.size(), static_cast<size_t>(trajectory_id) + 1));
+  for (const sensor::OdometryData& data : odometry_data) {
+    odometry_data_[trajectory_id].Push(data.time, data.pose);
+  }
+}
+
 void OptimizationProblem::AddFixedFramePoseData(
     const int trajectory_id,
     const sensor::FixedFramePoseData& fixed_frame_pose_data) {
@@ -87,15 +111,19 @@ void OptimizationProblem::AddTrajectoryNode(
   node_data_.resize(
       std::max(node_data_.size(), static_cast<size_t>(trajectory_id) + 1));
   trajectory_data_.resize(std::max(trajectory_data_.size(), node_data_.size()));
-  auto& trajectory_data = trajectory_data_[trajectory_id];
-  node_data_[trajectory_id].emplace(trajectory_data.next_node_index,
-                                    NodeData{time, initial_pose, pose});
-  ++trajectory_data.next_node_index;
+  node_data_[trajectory_id].Append(NodeData{time, initial_pose, pose});
 }
 
 void OptimizationProblem::TrimTrajectoryNode(const mapping::NodeId& node_id) {
   auto& node_data = node_data_.at(node_id.trajectory_id);
-  CHECK(node_data.erase(node_id.node_index));
+  node_data.Trim(node_id.node_index);
+  if (node_id.trajectory_id < static_cast<int>(trajectory_data_.size())) {
+    auto& trajectory_data = trajectory_data_[node_id.trajectory_id];
+    for (const int node_index : {node_id.node_index - 1, node_id.node_index}) {
+      trajectory_data.imu_factors.erase(node_index);
+      trajectory_data.odometry_relative_poses.erase(node_index);
+    }
+  }
 
   if (!node_data.empty() &&
       node_id.trajectory_id < static_cast<int>(imu_data_.size())) {
@@ -114,15 +142,11 @@ void OptimizationProblem::AddSubmap(const int trajectory_id,
       std::max(submap_data_.size(), static_cast<size_t>(trajectory_id) + 1));
   trajectory_data_.resize(
       std::max(trajectory_data_.size(), submap_data_.size()));
-  auto& trajectory_data = trajectory_data_[trajectory_id];
-  submap_data_[trajectory_id].emplace(trajectory_data.next_submap_index,
-                                      SubmapData{submap_pose});
-  ++trajectory_data.next_submap_index;
+  submap_data_[trajectory_id].Append(SubmapData{submap_pose});
 }
 
 void OptimizationProblem::TrimSubmap(const mapping::SubmapId& submap_id) {
-  auto& submap_data = submap_data_.at(submap_id.trajectory_id);
-  CHECK(submap_data.erase(submap_id.submap_index));
+  submap_data_.at(submap_id.trajectory_id).Trim(submap_id.submap_index);
 }
 
 void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
@@ -130,13 +154,202 @@ void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
       max_num_iterations);
 }
 
-void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
-                                const std::set<int>& frozen_trajectories) {
+void OptimizationProblem::SetSlidingWindowNumNodes(
+    const int32 sliding_window_num_nodes) {
+  options_.set_sliding_window_num_nodes(sliding_window_num_nodes);
+}
+
+void OptimizationProblem::Solve(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories,
+    const std::function<bool()>& should_terminate) {
+  CARTOGRAPHER_TRACE_SPAN("OptimizationProblem::Solve");
   if (node_data_.empty()) {
     // Nothing to optimize.
     return;
   }
+  // The first submap of the first trajectory which has any is fixed. Earlier
+  // trajectories may have been deleted.
+  int first_trajectory_id = 0;
+  while (first_trajectory_id != static_cast<int>(submap_data_.size()) &&
+         submap_data_[first_trajectory_id].empty()) {
+    ++first_trajectory_id;
+  }
+  if (first_trajectory_id == static_cast<int>(submap_data_.size())) {
+    return;
+  }
+  if (fix_z_ == FixZ::kNo) {
+    trajectory_data_.resize(imu_data_.size());
+    CHECK_GE(trajectory_data_.size(), node_data_.size());
+  }
+
+  // Trajectories which share no constraint have no influence on each other,
+  // so each group of connected trajectories is solved as its own problem.
+  const int num_trajectories =
+      std::max(node_data_.size(), submap_data_.size());
+  mapping::ConnectedComponents connected_components;
+  for (int trajectory_id = 0; trajectory_id != num_trajectories;
+       ++trajectory_id) {
+    connected_components.Add(trajectory_id);
+  }
+  for (const Constraint& constraint : constraints) {
+    const int submap_trajectory_id = constraint.submap_id.trajectory_id;
+    const int node_trajectory_id = constraint.node_id.trajectory_id;
+    if (submap_trajectory_id != node_trajectory_id) {
+      connected_components.Connect(submap_trajectory_id, node_trajectory_id);
+    }
+  }
+  const std::vector<std::vector<int>> components =
+      connected_components.Components();
+  if (!options_.solve_connected_components_in_parallel() ||
+      components.size() == 1) {
+    std::set<int> trajectory_ids;
+    for (int trajectory_id = 0; trajectory_id != num_trajectories;
+         ++trajectory_id) {
+      trajectory_ids.insert(trajectory_id);
+    }
+    SolveTrajectories(constraints, trajectory_ids, frozen_trajectories,
+                      true /* fix_first_submap */, should_terminate);
+  } else {
+    std::vector<std::set<int>> component_trajectory_ids;
+    std::vector<int> component_indices(num_trajectories);
+    for (const std::vector<int>& component : components) {
+      for (const int trajectory_id : component) {
+        component_indices.at(trajectory_id) = component_trajectory_ids.size();
+      }
+      component_trajectory_ids.emplace_back(component.begin(),
+                                            component.end());
+    }
+    std::vector<std::vector<Constraint>> component_constraints(
+        component_trajectory_ids.size());
+    for (const Constraint& constraint : constraints) {
+      component_constraints
+          .at(component_indices.at(constraint.node_id.trajectory_id))
+          .push_back(constraint);
+    }
+    // Only the component containing the first submap has it fixed, exactly as
+    // if all trajectories were solved together. The other components are free
+    // to move as a whole like before.
+    const int first_component_index = component_indices.at(first_trajectory_id);
+    // Each component is solved by Ceres with 'num_threads', so only as many
+    // components are solved at a time as there are CPUs for.
+    const int num_threads_per_solve =
+        std::max(1, options_.ceres_solver_options().num_threads());
+    const int num_threads = std::max(
+        1, std::min(static_cast<int>(component_trajectory_ids.size()),
+                    static_cast<int>(std::thread::hardware_concurrency()) /
+                        num_threads_per_solve));
+    std::atomic<int> next_component_index(0);
+    const auto solve_components = [this, &next_component_index,
+                                   first_component_index,
+                                   &component_constraints,
+                                   &component_trajectory_ids,
+                                   &frozen_trajectories, &should_terminate]() {
+      for (;;) {
+        const int i = next_component_index++;
+        if (i >= static_cast<int>(component_trajectory_ids.size())) {
+          return;
+        }
+        SolveTrajectories(component_constraints[i], component_trajectory_ids[i],
+                          frozen_trajectories,
+                          i == first_component_index /* fix_first_submap */,
+                          should_terminate);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+      threads.emplace_back(solve_components);
+    }
+    solve_components();
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  if (options_.log_solver_summary()) {
+    for (size_t trajectory_id = 0; trajectory_id != trajectory_data_.size();
+         ++trajectory_id) {
+      if (trajectory_id != 0) {
+        LOG(INFO) << "Trajectory " << trajectory_id << ":";
+      }
+      LOG(INFO) << "Gravity was: "
+                << trajectory_data_[trajectory_id].gravity_constant;
+      const auto& imu_calibration =
+          trajectory_data_[trajectory_id].imu_calibration;
+      LOG(INFO) << "IMU correction was: "
+                << common::RadToDeg(2. * std::acos(imu_calibration[0]))
+                << " deg (" << imu_calibration[0] << ", " << imu_calibration[1]
+                << ", " << imu_calibration[2] << ", " << imu_calibration[3]
+                << ")";
+    }
+  }
+}
+
+OptimizationProblem::ImuFactors OptimizationProblem::GetImuFactors(
+    const int trajectory_id, const int first_node_index,
+    const NodeData& first_node_data, const NodeData& second_node_data,
+    const NodeData* const third_node_data) {
+  auto& cached_imu_factors = trajectory_data_.at(trajectory_id).imu_factors;
+  const auto cached_it = cached_imu_factors.find(first_node_index);
+  if (cached_it != cached_imu_factors.end() &&
+      (third_node_data == nullptr || cached_it->second.has_delta_velocity)) {
+    return cached_it->second;
+  }
+
+  const std::deque<sensor::ImuData>& imu_data = imu_data_.at(trajectory_id);
+  // Start at the last IMU data not after the first node.
+  auto imu_it = std::upper_bound(
+      imu_data.cbegin(), imu_data.cend(), first_node_data.time,
+      [](const common::Time time, const sensor::ImuData& imu) {
+        return time < imu.time;
+      });
+  if (imu_it != imu_data.cbegin()) {
+    --imu_it;
+  }
+  auto imu_it2 = imu_it;
+  const IntegrateImuResult<double> result = IntegrateImu(
+      imu_data, first_node_data.time, second_node_data.time, &imu_it);
+  ImuFactors imu_factors{result.delta_rotation, third_node_data != nullptr,
+                         Eigen::Vector3d::Zero()};
+  common::Time end_time = second_node_data.time;
+  if (third_node_data != nullptr) {
+    const common::Time first_time = first_node_data.time;
+    const common::Time second_time = second_node_data.time;
+    const common::Time third_time = third_node_data->time;
+    const common::Time first_center =
+        first_time + (second_time - first_time) / 2;
+    const common::Time second_center =
+        second_time + (third_time - second_time) / 2;
+    const IntegrateImuResult<double> result_to_first_center =
+        IntegrateImu(imu_data, first_time, first_center, &imu_it2);
+    const IntegrateImuResult<double> result_center_to_center =
+        IntegrateImu(imu_data, first_center, second_center, &imu_it2);
+    // 'delta_velocity' is the change in velocity from the point in time
+    // halfway between the first and second poses to halfway between second and
+    // third pose. It is computed from IMU data and still contains a delta due
+    // to gravity. The orientation of this vector is in the IMU frame at the
+    // second pose.
+    imu_factors.delta_velocity = (result.delta_rotation.inverse() *
+                                  result_to_first_center.delta_rotation) *
+                                 result_center_to_center.delta_velocity;
+    end_time = second_center;
+  }
+  // The last IMU data is extrapolated, so the integration is final only once
+  // IMU data at or after its end was added.
+  if (imu_data.back().time >= end_time) {
+    cached_imu_factors[first_node_index] = imu_factors;
+  }
+  return imu_factors;
+}
 
+void OptimizationProblem::SolveTrajectories(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& trajectory_ids,
+    const std::set<int>& frozen_trajectories, const bool fix_first_submap,
+    const std::function<bool()>& should_terminate) {
+  const auto is_in_problem = [&trajectory_ids](const size_t trajectory_id) {
+    return trajectory_ids.count(trajectory_id) != 0;
+  };
   ceres::Problem::Options problem_options;
   ceres::Problem problem(problem_options);
 
@@ -149,31 +362,98 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
   };
 
   // Set the starting point.
-  CHECK(!submap_data_.empty());
-  CHECK(!submap_data_[0].empty());
+  // Nodes of a trajectory with at least this index are optimized, older ones
+  // are outside the sliding window and kept constant.
+  std::vector<int> first_optimized_node_indices(node_data_.size(), 0);
+  if (options_.sliding_window_num_nodes() > 0) {
+    for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
+         ++trajectory_id) {
+      if (!node_data_[trajectory_id].empty()) {
+        first_optimized_node_indices[trajectory_id] =
+            node_data_[trajectory_id].last_index() -
+            options_.sliding_window_num_nodes() + 1;
+      }
+    }
+  }
+  const auto is_optimized_node = [&](const int trajectory_id,
+                                     const int node_index) {
+    return frozen_trajectories.count(trajectory_id) == 0 &&
+           node_index >= first_optimized_node_indices.at(trajectory_id);
+  };
+  // Submaps are optimized if an optimized node was inserted into them.
+  std::set<mapping::SubmapId> optimized_submap_ids;
+  for (const Constraint& constraint : constraints) {
+    if (constraint.tag == Constraint::INTRA_SUBMAP &&
+        is_optimized_node(constraint.node_id.trajectory_id,
+                          constraint.node_id.node_index)) {
+      optimized_submap_ids.insert(constraint.submap_id);
+    }
+  }
+  const auto is_optimized_submap = [&](const int trajectory_id,
+                                       const int submap_index) {
+    return frozen_trajectories.count(trajectory_id) == 0 &&
+           (options_.sliding_window_num_nodes() == 0 ||
+            optimized_submap_ids.count(
+                mapping::SubmapId{trajectory_id, submap_index}) != 0);
+  };
+
+  // Only optimized poses are added now, constant ones are added on demand by
+  // the residuals referring to them.
   // TODO(hrapp): Move ceres data into SubmapData.
   std::vector<std::map<int, CeresPose>> C_submaps(submap_data_.size());
   std::vector<std::map<int, CeresPose>> C_nodes(node_data_.size());
-  bool first_submap = true;
+  const auto add_constant_pose = [&problem](const transform::Rigid3d& pose,
+                                            std::map<int, CeresPose>* C_poses,
+                                            const int index) -> CeresPose& {
+    CeresPose& C_pose =
+        C_poses
+            ->emplace(std::piecewise_construct, std::forward_as_tuple(index),
+                      std::forward_as_tuple(pose, nullptr, nullptr, &problem))
+            .first->second;
+    problem.SetParameterBlockConstant(C_pose.rotation());
+    problem.SetParameterBlockConstant(C_pose.translation());
+    return C_pose;
+  };
+  const auto C_submap = [&](const int trajectory_id,
+                            const int submap_index) -> CeresPose& {
+    auto it = C_submaps.at(trajectory_id).find(submap_index);
+    if (it != C_submaps.at(trajectory_id).end()) {
+      return it->second;
+    }
+    return add_constant_pose(
+        submap_data_.at(trajectory_id).at(submap_index).pose,
+        &C_submaps.at(trajectory_id), submap_index);
+  };
+  const auto C_node = [&](const int trajectory_id,
+                          const int node_index) -> CeresPose& {
+    auto it = C_nodes.at(trajectory_id).find(node_index);
+    if (it != C_nodes.at(trajectory_id).end()) {
+      return it->second;
+    }
+    return add_constant_pose(node_data_.at(trajectory_id).at(node_index).pose,
+                             &C_nodes.at(trajectory_id), node_index);
+  };
+  bool first_submap = fix_first_submap;
   for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
        ++trajectory_id) {
-    const bool frozen = frozen_trajectories.count(trajectory_id) != 0;
+    if (!is_in_problem(trajectory_id)) {
+      continue;
+    }
     for (const auto& index_submap_data : submap_data_[trajectory_id]) {
       const int submap_index = index_submap_data.first;
-      if (first_submap) {
-        first_submap = false;
+      const bool optimized = is_optimized_submap(trajectory_id, submap_index);
+      if (first_submap && optimized) {
         // Fix the first submap of the first trajectory except for allowing
         // gravity alignment.
         C_submaps[trajectory_id].emplace(
             std::piecewise_construct, std::forward_as_tuple(submap_index),
             std::forward_as_tuple(
                 index_submap_data.second.pose, translation_parameterization(),
-                common::make_unique<ceres::AutoDiffLocalParameterization<
-                    ConstantYawQuaternionPlus, 4, 2>>(),
+                common::make_unique<ConstantYawQuaternionParameterization>(),
                 &problem));
         problem.SetParameterBlockConstant(
             C_submaps[trajectory_id].at(submap_index).translation());
-      } else {
+      } else if (optimized) {
         C_submaps[trajectory_id].emplace(
             std::piecewise_construct, std::forward_as_tuple(submap_index),
             std::forward_as_tuple(
@@ -181,74 +461,64 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
                 common::make_unique<ceres::QuaternionParameterization>(),
                 &problem));
       }
-      if (frozen) {
-        problem.SetParameterBlockConstant(
-            C_submaps[trajectory_id].at(submap_index).rotation());
-        problem.SetParameterBlockConstant(
-            C_submaps[trajectory_id].at(submap_index).translation());
-      }
+      first_submap = false;
     }
   }
   for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
        ++trajectory_id) {
-    const bool frozen = frozen_trajectories.count(trajectory_id) != 0;
+    if (!is_in_problem(trajectory_id)) {
+      continue;
+    }
     for (const auto& index_node_data : node_data_[trajectory_id]) {
       const int node_index = index_node_data.first;
+      if (!is_optimized_node(trajectory_id, node_index)) {
+        continue;
+      }
       C_nodes[trajectory_id].emplace(
           std::piecewise_construct, std::forward_as_tuple(node_index),
           std::forward_as_tuple(
               index_node_data.second.pose, translation_parameterization(),
               common::make_unique<ceres::QuaternionParameterization>(),
               &problem));
-      if (frozen) {
-        problem.SetParameterBlockConstant(
-            C_nodes[trajectory_id].at(node_index).rotation());
-        problem.SetParameterBlockConstant(
-            C_nodes[trajectory_id].at(node_index).translation());
-      }
     }
   }
   // Add cost functions for intra- and inter-submap constraints.
   for (const Constraint& constraint : constraints) {
+    if (!is_optimized_submap(constraint.submap_id.trajectory_id,
+                             constraint.submap_id.submap_index) &&
+        !is_optimized_node(constraint.node_id.trajectory_id,
+                           constraint.node_id.node_index)) {
+      // Both poses are constant.
+      continue;
+    }
+    CeresPose& C_constraint_submap = C_submap(
+        constraint.submap_id.trajectory_id, constraint.submap_id.submap_index);
+    CeresPose& C_constraint_node =
+        C_node(constraint.node_id.trajectory_id, constraint.node_id.node_index);
     problem.AddResidualBlock(
-        new ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>(
-            new SpaCostFunction(constraint.pose)),
+        new AnalyticalSpaCostFunction(constraint.pose),
         // Only loop closure constraints should have a loss function.
         constraint.tag == Constraint::INTER_SUBMAP
             ? new ceres::HuberLoss(options_.huber_scale())
             : nullptr,
-        C_submaps.at(constraint.submap_id.trajectory_id)
-            .at(constraint.submap_id.submap_index)
-            .rotation(),
-        C_submaps.at(constraint.submap_id.trajectory_id)
-            .at(constraint.submap_id.submap_index)
-            .translation(),
-        C_nodes.at(constraint.node_id.trajectory_id)
-            .at(constraint.node_id.node_index)
-            .rotation(),
-        C_nodes.at(constraint.node_id.trajectory_id)
-            .at(constraint.node_id.node_index)
-            .translation());
+        C_constraint_submap.rotation(), C_constraint_submap.translation(),
+        C_constraint_node.rotation(), C_constraint_node.translation());
   }
 
   // Add constraints based on IMU observations of angular velocities and
   // linear acceleration.
   if (fix_z_ == FixZ::kNo) {
-    trajectory_data_.resize(imu_data_.size());
-    CHECK_GE(trajectory_data_.size(), node_data_.size());
     for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
          ++trajectory_id) {
-      if (node_data_[trajectory_id].empty()) {
+      if (!is_in_problem(trajectory_id) || node_data_[trajectory_id].empty()) {
         // We skip empty trajectories which might not have any IMU data.
         continue;
       }
       TrajectoryData& trajectory_data = trajectory_data_.at(trajectory_id);
       problem.AddParameterBlock(trajectory_data.imu_calibration.data(), 4,
                                 new ceres::QuaternionParameterization());
-      const std::deque<sensor::ImuData>& imu_data = imu_data_.at(trajectory_id);
-      CHECK(!imu_data.empty());
+      CHECK(!imu_data_.at(trajectory_id).empty());
 
-      auto imu_it = imu_data.cbegin();
       for (auto node_it = node_data_[trajectory_id].begin();;) {
         const int first_node_index = node_it->first;
         const NodeData& first_node_data = node_it->second;
@@ -263,61 +533,46 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
         if (second_node_index != first_node_index + 1) {
           continue;
         }
-
-        // Skip IMU data before the node.
-        while ((imu_it + 1) != imu_data.cend() &&
-               (imu_it + 1)->time <= first_node_data.time) {
-          ++imu_it;
+        if (!is_optimized_node(trajectory_id, second_node_index) &&
+            !is_optimized_node(trajectory_id, second_node_index + 1)) {
+          // All nodes of the residuals below are constant.
+          continue;
         }
 
-        auto imu_it2 = imu_it;
-        const IntegrateImuResult<double> result = IntegrateImu(
-            imu_data, first_node_data.time, second_node_data.time, &imu_it);
         const auto next_node_it = std::next(node_it);
-        if (next_node_it != node_data_[trajectory_id].end() &&
-            next_node_it->first == second_node_index + 1) {
+        const bool has_third_node =
+            next_node_it != node_data_[trajectory_id].end() &&
+            next_node_it->first == second_node_index + 1;
+        const ImuFactors imu_factors = GetImuFactors(
+            trajectory_id, first_node_index, first_node_data, second_node_data,
+            has_third_node ? &next_node_it->second : nullptr);
+        if (has_third_node) {
           const int third_node_index = next_node_it->first;
-          const NodeData& third_node_data = next_node_it->second;
-          const common::Time first_time = first_node_data.time;
-          const common::Time second_time = second_node_data.time;
-          const common::Time third_time = third_node_data.time;
-          const common::Duration first_duration = second_time - first_time;
-          const common::Duration second_duration = third_time - second_time;
-          const common::Time first_center = first_time + first_duration / 2;
-          const common::Time second_center = second_time + second_duration / 2;
-          const IntegrateImuResult<double> result_to_first_center =
-              IntegrateImu(imu_data, first_time, first_center, &imu_it2);
-          const IntegrateImuResult<double> result_center_to_center =
-              IntegrateImu(imu_data, first_center, second_center, &imu_it2);
-          // 'delta_velocity' is the change in velocity from the point in time
-          // halfway between the first and second poses to halfway between
-          // second and third pose. It is computed from IMU data and still
-          // contains a delta due to gravity. The orientation of this vector is
-          // in the IMU frame at the second pose.
-          const Eigen::Vector3d delta_velocity =
-              (result.delta_rotation.inverse() *
-               result_to_first_center.delta_rotation) *
-              result_center_to_center.delta_velocity;
+          const common::Duration first_duration =
+              second_node_data.time - first_node_data.time;
+          const common::Duration second_duration =
+              next_node_it->second.time - second_node_data.time;
           problem.AddResidualBlock(
               new ceres::AutoDiffCostFunction<AccelerationCostFunction, 3, 4, 3,
                                               3, 3, 1, 4>(
                   new AccelerationCostFunction(
-                      options_.acceleration_weight(), delta_velocity,
+                      options_.acceleration_weight(),
+                      imu_factors.delta_velocity,
                       common::ToSeconds(first_duration),
                       common::ToSeconds(second_duration))),
-              nullptr, C_nodes[trajectory_id].at(second_node_index).rotation(),
-              C_nodes[trajectory_id].at(first_node_index).translation(),
-              C_nodes[trajectory_id].at(second_node_index).translation(),
-              C_nodes[trajectory_id].at(third_node_index).translation(),
+              nullptr, C_node(trajectory_id, second_node_index).rotation(),
+              C_node(trajectory_id, first_node_index).translation(),
+              C_node(trajectory_id, second_node_index).translation(),
+              C_node(trajectory_id, third_node_index).translation(),
               &trajectory_data.gravity_constant,
               trajectory_data.imu_calibration.data());
         }
         problem.AddResidualBlock(
             new ceres::AutoDiffCostFunction<RotationCostFunction, 3, 4, 4, 4>(
                 new RotationCostFunction(options_.rotation_weight(),
-                                         result.delta_rotation)),
-            nullptr, C_nodes[trajectory_id].at(first_node_index).rotation(),
-            C_nodes[trajectory_id].at(second_node_index).rotation(),
+                                         imu_factors.delta_rotation)),
+            nullptr, C_node(trajectory_id, first_node_index).rotation(),
+            C_node(trajectory_id, second_node_index).rotation(),
             trajectory_data.imu_calibration.data());
       }
     }
@@ -328,7 +583,7 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
     // if odometry is not available.
     for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
          ++trajectory_id) {
-      if (node_data_[trajectory_id].empty()) {
+      if (!is_in_problem(trajectory_id) || node_data_[trajectory_id].empty()) {
         continue;
       }
       for (auto node_it = node_data_[trajectory_id].begin();;) {
@@ -342,33 +597,43 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
         const int next_node_index = node_it->first;
         const NodeData& next_node_data = node_it->second;
 
-        if (next_node_index != node_index + 1) {
+        if (next_node_index != node_index + 1 ||
+            !is_optimized_node(trajectory_id, next_node_index)) {
           continue;
         }
 
-        const bool odometry_available =
+        auto& odometry_relative_poses =
+            trajectory_data_.at(trajectory_id).odometry_relative_poses;
+        auto odometry_it = odometry_relative_poses.find(node_index);
+        if (odometry_it == odometry_relative_poses.end() &&
             trajectory_id < odometry_data_.size() &&
             odometry_data_[trajectory_id].Has(next_node_data.time) &&
-            odometry_data_[trajectory_id].Has(node_data.time);
+            odometry_data_[trajectory_id].Has(node_data.time)) {
+          const transform::TransformInterpolationBuffer& odometry_data =
+              odometry_data_[trajectory_id];
+          odometry_it = odometry_relative_poses
+                            .emplace(node_index,
+                                     odometry_data.Lookup(node_data.time)
+                                             .inverse() *
+                                         odometry_data.Lookup(
+                                             next_node_data.time))
+                            .first;
+        }
         const transform::Rigid3d relative_pose =
-            odometry_available
-                ? odometry_data_[trajectory_id]
-                          .Lookup(node_data.time)
-                          .inverse() *
-                      odometry_data_[trajectory_id].Lookup(next_node_data.time)
+            odometry_it != odometry_relative_poses.end()
+                ? odometry_it->second
                 : node_data.initial_pose.inverse() *
                       next_node_data.initial_pose;
         problem.AddResidualBlock(
-            new ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>(
-                new SpaCostFunction(Constraint::Pose{
-                    relative_pose,
-                    options_.consecutive_scan_translation_penalty_factor(),
-                    options_.consecutive_scan_rotation_penalty_factor()})),
+            new AnalyticalSpaCostFunction(Constraint::Pose{
+                relative_pose,
+                options_.consecutive_scan_translation_penalty_factor(),
+                options_.consecutive_scan_rotation_penalty_factor()}),
             nullptr /* loss function */,
-            C_nodes[trajectory_id].at(node_index).rotation(),
-            C_nodes[trajectory_id].at(node_index).translation(),
-            C_nodes[trajectory_id].at(next_node_index).rotation(),
-            C_nodes[trajectory_id].at(next_node_index).translation());
+            C_node(trajectory_id, node_index).rotation(),
+            C_node(trajectory_id, node_index).translation(),
+            C_node(trajectory_id, next_node_index).rotation(),
+            C_node(trajectory_id, next_node_index).translation());
       }
     }
   }
@@ -380,13 +645,17 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
     if (trajectory_id >= fixed_frame_pose_data_.size()) {
       break;
     }
+    if (!is_in_problem(trajectory_id)) {
+      continue;
+    }
 
     bool fixed_frame_pose_initialized = false;
 
-    for (auto& index_node_data : node_data_[trajectory_id]) {
+    for (const auto& index_node_data : node_data_[trajectory_id]) {
       const int node_index = index_node_data.first;
       const NodeData& node_data = index_node_data.second;
-      if (!fixed_frame_pose_data_.at(trajectory_id).Has(node_data.time)) {
+      if (!is_optimized_node(trajectory_id, node_index) ||
+          !fixed_frame_pose_data_.at(trajectory_id).Has(node_data.time)) {
         continue;
       }
 
@@ -405,70 +674,104 @@ void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
                     transform::GetYaw(fixed_frame_pose_in_map.rotation()),
                     Eigen::Vector3d::UnitZ())),
             nullptr,
-            common::make_unique<ceres::AutoDiffLocalParameterization<
-                YawOnlyQuaternionPlus, 4, 1>>(),
+            common::make_unique<YawOnlyQuaternionParameterization>(),
             &problem);
         fixed_frame_pose_initialized = true;
       }
 
       problem.AddResidualBlock(
-          new ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>(
-              new SpaCostFunction(constraint_pose)),
+          new AnalyticalSpaCostFunction(constraint_pose),
           nullptr, C_fixed_frames.back().rotation(),
           C_fixed_frames.back().translation(),
-          C_nodes.at(trajectory_id).at(node_index).rotation(),
-          C_nodes.at(trajectory_id).at(node_index).translation());
+          C_node(trajectory_id, node_index).rotation(),
+          C_node(trajectory_id, node_index).translation());
     }
   }
 
   // Solve.
+  ceres::Solver::Options solver_options =
+      common::CreateCeresSolverOptions(options_.ceres_solver_options());
+  common::TerminationCallback termination_callback(
+      options_.min_num_iterations_before_interrupt(), should_terminate);
+  if (should_terminate != nullptr) {
+    solver_options.callbacks.push_back(&termination_callback);
+  }
   ceres::Solver::Summary summary;
-  ceres::Solve(
-      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
-      &problem, &summary);
+  ceres::Solve(solver_options, &problem, &summary);
   if (options_.log_solver_summary()) {
     LOG(INFO) << summary.FullReport();
-    for (size_t trajectory_id = 0; trajectory_id != trajectory_data_.size();
-         ++trajectory_id) {
-      if (trajectory_id != 0) {
-        LOG(INFO) << "Trajectory " << trajectory_id << ":";
-      }
-      LOG(INFO) << "Gravity was: "
-                << trajectory_data_[trajectory_id].gravity_constant;
-      const auto& imu_calibration =
-          trajectory_data_[trajectory_id].imu_calibration;
-      LOG(INFO) << "IMU correction was: "
-                << common::RadToDeg(2. * std::acos(imu_calibration[0]))
-                << " deg (" << imu_calibration[0] << ", " << imu_calibration[1]
-                << ", " << imu_calibration[2] << ", " << imu_calibration[3]
-                << ")";
-    }
   }
 
-  // Store the result.
+  // Store the result. Poses which were not added are unchanged.
   for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
        ++trajectory_id) {
-    for (auto& index_submap_data : submap_data_[trajectory_id]) {
-      index_submap_data.second.pose =
-          C_submaps[trajectory_id].at(index_submap_data.first).ToRigid();
+    for (auto& index_C_submap : C_submaps[trajectory_id]) {
+      submap_data_[trajectory_id].at(index_C_submap.first).pose =
+          index_C_submap.second.ToRigid();
     }
   }
   for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
        ++trajectory_id) {
-    for (auto& index_node_data : node_data_[trajectory_id]) {
-      index_node_data.second.pose =
-          C_nodes[trajectory_id].at(index_node_data.first).ToRigid();
+    for (auto& index_C_node : C_nodes[trajectory_id]) {
+      node_data_[trajectory_id].at(index_C_node.first).pose =
+          index_C_node.second.ToRigid();
     }
   }
 }
 
-const std::vector<std::map<int, NodeData>>& OptimizationProblem::node_data()
-    const {
+const std::vector<mapping::DenseMapByIndex<NodeData>>&
+OptimizationProblem::node_data() const {
   return node_data_;
 }
 
-const std::vector<std::map<int, SubmapData>>& OptimizationProblem::submap_data()
-    const {
+int64 OptimizationProblem::GetMemoryUsageInBytes() const {
+  constexpr int64 kTransformSizeInBytes =
+      sizeof(common::Time) + sizeof(transform::Rigid3d);
+  int64 memory_usage_in_bytes = 0;
+  for (const auto& trajectory_imu_data : imu_data_) {
+    memory_usage_in_bytes +=
+        trajectory_imu_data.size() * sizeof(sensor::ImuData);
+  }
+  for (const auto& trajectory_odometry_data : odometry_data_) {
+    memory_usage_in_bytes +=
+        trajectory_odometry_data.size() * kTransformSizeInBytes;
+  }
+  for (const auto& trajectory_fixed_frame_pose_data : fixed_frame_pose_data_) {
+    memory_usage_in_bytes +=
+        trajectory_fixed_frame_pose_data.size() * kTransformSizeInBytes;
+  }
+  for (const auto& trajectory_node_data : node_data_) {
+    // Trimmed nodes keep their storage until their whole chunk is trimmed.
+    memory_usage_in_bytes += trajectory_node_data.size() * sizeof(NodeData);
+  }
+  return memory_usage_in_bytes;
+}
+
+std::vector<int64> OptimizationProblem::GetNumDataPerTrajectory() const {
+  std::vector<int64> num_data;
+  const auto add = [&num_data](const size_t trajectory_id, const size_t size) {
+    if (num_data.size() <= trajectory_id) {
+      num_data.resize(trajectory_id + 1, 0);
+    }
+    num_data[trajectory_id] += size;
+  };
+  for (size_t i = 0; i != imu_data_.size(); ++i) {
+    add(i, imu_data_[i].size());
+  }
+  for (size_t i = 0; i != node_data_.size(); ++i) {
+    add(i, node_data_[i].size());
+  }
+  for (size_t i = 0; i != odometry_data_.size(); ++i) {
+    add(i, odometry_data_[i].size());
+  }
+  for (size_t i = 0; i != submap_data_.size(); ++i) {
+    add(i, submap_data_[i].size());
+  }
+  return num_data;
+}
+
+const std::vector<mapping::DenseMapByIndex<SubmapData>>&
+OptimizationProblem::submap_data() const {
   return submap_data_;
 }
 
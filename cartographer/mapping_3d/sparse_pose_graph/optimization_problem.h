@@ -19,6 +19,7 @@
 
 #include <array>
 #include <deque>
+#include <functional>
 #include <map>
 #include <set>
 #include <vector>
@@ -27,6 +28,7 @@
 #include "Eigen/Geometry"
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
+#include "cartographer/mapping/dense_map_by_index.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
 #include "cartographer/mapping/sparse_pose_graph/proto/optimization_problem_options.pb.h"
 #include "cartographer/sensor/fixed_frame_pose_data.h"
@@ -67,6 +69,11 @@ class OptimizationProblem {
   void AddImuData(int trajectory_id, const sensor::ImuData& imu_data);
   void AddOdometerData(int trajectory_id,
                        const sensor::OdometryData& odometry_data);
+  // Same as above for time-sorted samples, appended in bulk.
+  void AddImuData(int trajectory_id,
+                  const std::vector<sensor::ImuData>& imu_data);
+  void AddOdometerData(int trajectory_id,
+                       const std::vector<sensor::OdometryData>& odometry_data);
   void AddFixedFramePoseData(
       int trajectory_id,
       const sensor::FixedFramePoseData& fixed_frame_pose_data);
@@ -78,28 +85,69 @@ class OptimizationProblem {
   void TrimSubmap(const mapping::SubmapId& submap_id);
 
   void SetMaxNumIterations(int32 max_num_iterations);
+  void SetSlidingWindowNumNodes(int32 sliding_window_num_nodes);
 
-  // Computes the optimized poses.
+  // Computes the optimized poses. Unless 'should_terminate' is null, the solve
+  // ends early once it returns true, and the poses of the last iteration are
+  // kept. It may be called concurrently when solving connected components in
+  // parallel.
   void Solve(const std::vector<Constraint>& constraints,
-             const std::set<int>& frozen_trajectories);
-
-  const std::vector<std::map<int, NodeData>>& node_data() const;
-  const std::vector<std::map<int, SubmapData>>& submap_data() const;
+             const std::set<int>& frozen_trajectories,
+             const std::function<bool()>& should_terminate);
+
+  const std::vector<mapping::DenseMapByIndex<NodeData>>& node_data() const;
+  // Returns an estimate of the number of bytes used by the buffered sensor
+  // data and the node data, not including the Ceres problem.
+  int64 GetMemoryUsageInBytes() const;
+  // Returns the number of nodes, submaps and buffered sensor data per
+  // trajectory, which approximates each trajectory's share of a Solve().
+  std::vector<int64> GetNumDataPerTrajectory() const;
+  const std::vector<mapping::DenseMapByIndex<SubmapData>>& submap_data() const;
 
  private:
+  // IMU data integrated between a node and the next one.
+  struct ImuFactors {
+    Eigen::Quaterniond delta_rotation;
+    // Whether 'delta_velocity' is valid, which requires the node after next.
+    bool has_delta_velocity;
+    Eigen::Vector3d delta_velocity;
+  };
+
   struct TrajectoryData {
     double gravity_constant = 9.8;
     std::array<double, 4> imu_calibration{{1., 0., 0., 0.}};
-    int next_submap_index = 0;
-    int next_node_index = 0;
+    // Factors between a node and the next one, keyed by the former. They are
+    // kept once no later sensor data can change them, so that building the
+    // problem does not integrate or look up all data again for every solve.
+    std::map<int, ImuFactors> imu_factors;
+    std::map<int, transform::Rigid3d> odometry_relative_poses;
   };
 
+  // Returns the IMU factors between 'first_node_data' with index
+  // 'first_node_index' and 'second_node_data', including the velocity delta if
+  // 'third_node_data' is not nullptr.
+  ImuFactors GetImuFactors(int trajectory_id, int first_node_index,
+                           const NodeData& first_node_data,
+                           const NodeData& second_node_data,
+                           const NodeData* third_node_data);
+
+  // Builds and solves the problem restricted to 'trajectory_ids', which must
+  // not share constraints with other trajectories. May be called concurrently
+  // for disjoint sets of trajectories.
+  void SolveTrajectories(const std::vector<Constraint>& constraints,
+                         const std::set<int>& trajectory_ids,
+                         const std::set<int>& frozen_trajectories,
+                         bool fix_first_submap,
+                         const std::function<bool()>& should_terminate);
+
   mapping::sparse_pose_graph::proto::OptimizationProblemOptions options_;
   FixZ fix_z_;
   std::vector<std::deque<sensor::ImuData>> imu_data_;
-  std::vector<std::map<int, NodeData>> node_data_;
+  // Node and submap data is stored densely, indexed by trajectory ID, then
+  // by node or submap index.
+  std::vector<mapping::DenseMapByIndex<NodeData>> node_data_;
   std::vector<transform::TransformInterpolationBuffer> odometry_data_;
-  std::vector<std::map<int, SubmapData>> submap_data_;
+  std::vector<mapping::DenseMapByIndex<SubmapData>> submap_data_;
   std::vector<TrajectoryData> trajectory_data_;
   std::vector<transform::TransformInterpolationBuffer> fixed_frame_pose_data_;
 };
@@ -22,6 +22,7 @@
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/sparse_pose_graph/optimization_problem_options.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
@@ -34,11 +35,13 @@ namespace {
 class OptimizationProblemTest : public ::testing::Test {
  protected:
   OptimizationProblemTest()
-      : optimization_problem_(CreateOptions(), OptimizationProblem::FixZ::kNo),
+      : optimization_problem_(
+            CreateOptions(true /* solve_connected_components_in_parallel */),
+            OptimizationProblem::FixZ::kNo),
         rng_(45387) {}
 
-  mapping::sparse_pose_graph::proto::OptimizationProblemOptions
-  CreateOptions() {
+  static mapping::sparse_pose_graph::proto::OptimizationProblemOptions
+  CreateOptions(const bool solve_connected_components_in_parallel) {
     auto parameter_dictionary = common::MakeDictionary(R"text(
         return {
           acceleration_weight = 1e-4,
@@ -48,6 +51,9 @@ class OptimizationProblemTest : public ::testing::Test {
           consecutive_scan_rotation_penalty_factor = 1e-2,
           fixed_frame_pose_translation_weight = 1e1,
           fixed_frame_pose_rotation_weight = 1e2,
+          sliding_window_num_nodes = 0,
+          solve_connected_components_in_parallel = false,
+          min_num_iterations_before_interrupt = 0,
           log_solver_summary = true,
           ceres_solver_options = {
             use_nonmonotonic_steps = false,
@@ -55,8 +61,11 @@ class OptimizationProblemTest : public ::testing::Test {
             num_threads = 4,
           },
         })text");
-    return mapping::sparse_pose_graph::CreateOptimizationProblemOptions(
+    auto options = mapping::sparse_pose_graph::CreateOptimizationProblemOptions(
         parameter_dictionary.get());
+    options.set_solve_connected_components_in_parallel(
+        solve_connected_components_in_parallel);
+    return options;
   }
 
   transform::Rigid3d RandomTransform(double translation_size,
@@ -169,7 +178,8 @@ TEST_F(OptimizationProblemTest, ReducesNoise) {
   optimization_problem_.AddSubmap(kTrajectoryId, kSubmap0Transform);
   optimization_problem_.AddSubmap(kTrajectoryId, kSubmap2Transform);
   const std::set<int> kFrozen;
-  optimization_problem_.Solve(constraints, kFrozen);
+  optimization_problem_.Solve(constraints, kFrozen,
+                              nullptr /* should_terminate */);
 
   double translation_error_after = 0.;
   double rotation_error_after = 0.;
@@ -185,6 +195,131 @@ TEST_F(OptimizationProblemTest, ReducesNoise) {
   EXPECT_GT(0.8 * rotation_error_before, rotation_error_after);
 }
 
+TEST_F(OptimizationProblemTest, SlidingWindowKeepsOlderNodesFixed) {
+  constexpr int kNumSubmaps = 3;
+  constexpr int kSlidingWindowNumNodes = 10;
+  constexpr int kNumNodes = kNumSubmaps * kSlidingWindowNumNodes;
+  const int kTrajectoryId = 0;
+  auto options =
+      CreateOptions(false /* solve_connected_components_in_parallel */);
+  options.set_sliding_window_num_nodes(kSlidingWindowNumNodes);
+  OptimizationProblem problem(options, OptimizationProblem::FixZ::kNo);
+
+  std::vector<transform::Rigid3d> submap_poses;
+  for (int i = 0; i != kNumSubmaps; ++i) {
+    submap_poses.push_back(RandomYawOnlyTransform(10., 3.));
+    problem.AddSubmap(kTrajectoryId, submap_poses.back());
+  }
+  std::vector<transform::Rigid3d> initial_poses;
+  std::vector<OptimizationProblem::Constraint> constraints;
+  common::Time time = common::FromUniversal(0);
+  for (int j = 0; j != kNumNodes; ++j) {
+    const int submap_index = j / kSlidingWindowNumNodes;
+    const transform::Rigid3d ground_truth_pose =
+        submap_poses[submap_index] * RandomYawOnlyTransform(5., 3.);
+    initial_poses.push_back(
+        AddNoise(ground_truth_pose, RandomYawOnlyTransform(0.2, 0.3)));
+    problem.AddImuData(
+        kTrajectoryId, sensor::ImuData{time, Eigen::Vector3d::UnitZ() * 9.81,
+                                       Eigen::Vector3d::Zero()});
+    problem.AddTrajectoryNode(kTrajectoryId, time, initial_poses.back(),
+                              initial_poses.back());
+    constraints.push_back(OptimizationProblem::Constraint{
+        mapping::SubmapId{kTrajectoryId, submap_index},
+        mapping::NodeId{kTrajectoryId, j},
+        OptimizationProblem::Constraint::Pose{
+            submap_poses[submap_index].inverse() * ground_truth_pose, 1., 1.},
+        OptimizationProblem::Constraint::INTRA_SUBMAP});
+    time += common::FromSeconds(0.01);
+  }
+  problem.Solve(constraints, std::set<int>(), nullptr /* should_terminate */);
+
+  // Only the newest nodes and the last submap they were inserted into are
+  // optimized.
+  const auto& node_data = problem.node_data().at(kTrajectoryId);
+  for (int j = 0; j != kNumNodes; ++j) {
+    if (j < kNumNodes - kSlidingWindowNumNodes) {
+      EXPECT_THAT(node_data.at(j).pose,
+                  transform::IsNearly(initial_poses[j], 1e-9));
+    } else {
+      EXPECT_THAT(node_data.at(j).pose,
+                  ::testing::Not(transform::IsNearly(initial_poses[j], 1e-6)));
+    }
+  }
+  for (int i = 0; i != kNumSubmaps - 1; ++i) {
+    EXPECT_THAT(problem.submap_data().at(kTrajectoryId).at(i).pose,
+                transform::IsNearly(submap_poses[i], 1e-9));
+  }
+}
+
+TEST_F(OptimizationProblemTest, SolvingComponentsSeparatelyMatchesJointSolve) {
+  constexpr int kNumNodes = 30;
+  // Trajectory 0 has no data, as if it was deleted, so the first submap of
+  // trajectory 1 is fixed.
+  const std::vector<int> kTrajectoryIds = {1, 2};
+  OptimizationProblem joint_problem(
+      CreateOptions(false /* solve_connected_components_in_parallel */),
+      OptimizationProblem::FixZ::kNo);
+  OptimizationProblem split_problem(
+      CreateOptions(true /* solve_connected_components_in_parallel */),
+      OptimizationProblem::FixZ::kNo);
+  std::vector<OptimizationProblem::Constraint> constraints;
+  for (const int trajectory_id : kTrajectoryIds) {
+    const transform::Rigid3d submap_pose = RandomYawOnlyTransform(10., 3.);
+    common::Time time = common::FromUniversal(0);
+    for (int j = 0; j != kNumNodes; ++j) {
+      const transform::Rigid3d ground_truth_pose =
+          submap_pose * RandomYawOnlyTransform(5., 3.);
+      const transform::Rigid3d pose =
+          AddNoise(ground_truth_pose, RandomYawOnlyTransform(0.2, 0.3));
+      for (OptimizationProblem* const problem :
+           {&joint_problem, &split_problem}) {
+        problem->AddImuData(trajectory_id,
+                            sensor::ImuData{time,
+                                            Eigen::Vector3d::UnitZ() * 9.81,
+                                            Eigen::Vector3d::Zero()});
+        problem->AddTrajectoryNode(trajectory_id, time, pose, pose);
+      }
+      for (const int submap_index : {0, 1}) {
+        constraints.push_back(OptimizationProblem::Constraint{
+            mapping::SubmapId{trajectory_id, submap_index},
+            mapping::NodeId{trajectory_id, j},
+            OptimizationProblem::Constraint::Pose{
+                AddNoise(submap_pose.inverse() * ground_truth_pose,
+                         RandomYawOnlyTransform(0.2, 0.3)),
+                1., 1.}});
+      }
+      time += common::FromSeconds(0.01);
+    }
+    for (OptimizationProblem* const problem :
+         {&joint_problem, &split_problem}) {
+      problem->AddSubmap(trajectory_id, submap_pose);
+      problem->AddSubmap(trajectory_id, submap_pose);
+    }
+  }
+
+  const std::set<int> kFrozen;
+  joint_problem.Solve(constraints, kFrozen, nullptr /* should_terminate */);
+  split_problem.Solve(constraints, kFrozen, nullptr /* should_terminate */);
+  for (const int trajectory_id : kTrajectoryIds) {
+    for (int j = 0; j != kNumNodes; ++j) {
+      EXPECT_THAT(
+          split_problem.node_data().at(trajectory_id).at(j).pose,
+          transform::IsNearly(
+              joint_problem.node_data().at(trajectory_id).at(j).pose, 1e-3));
+    }
+    for (const int submap_index : {0, 1}) {
+      EXPECT_THAT(
+          split_problem.submap_data().at(trajectory_id).at(submap_index).pose,
+          transform::IsNearly(joint_problem.submap_data()
+                                  .at(trajectory_id)
+                                  .at(submap_index)
+                                  .pose,
+                              1e-3));
+    }
+  }
+}
+
 }  // namespace
 }  // namespace sparse_pose_graph
 }  // namespace mapping_3d
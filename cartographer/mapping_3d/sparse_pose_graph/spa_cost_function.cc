@@ -0,0 +1,169 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/sparse_pose_graph/spa_cost_function.h"
+
+#include <cmath>
+
+namespace cartographer {
+namespace mapping_3d {
+namespace sparse_pose_graph {
+
+namespace {
+
+using RowMajorMatrix64d = Eigen::Matrix<double, 6, 4, Eigen::RowMajor>;
+using RowMajorMatrix63d = Eigen::Matrix<double, 6, 3, Eigen::RowMajor>;
+
+// Returns the matrix 'M' with 'M * v' equal to 'a.cross(v)'.
+Eigen::Matrix3d CrossProductMatrix(const Eigen::Vector3d& a) {
+  Eigen::Matrix3d result;
+  result << 0., -a.z(), a.y(), a.z(), 0., -a.x(), -a.y(), a.x(), 0.;
+  return result;
+}
+
+// Returns the matrix 'M' with 'M * b' equal to the coefficients of 'a * b' in
+// (w, x, y, z) order.
+Eigen::Matrix4d LeftProductMatrix(const Eigen::Quaterniond& a) {
+  Eigen::Matrix4d result;
+  result << a.w(), -a.x(), -a.y(), -a.z(), a.x(), a.w(), -a.z(), a.y(), a.y(),
+      a.z(), a.w(), -a.x(), a.z(), -a.y(), a.x(), a.w();
+  return result;
+}
+
+// Returns the matrix 'M' with 'M * a' equal to the coefficients of 'a * b' in
+// (w, x, y, z) order.
+Eigen::Matrix4d RightProductMatrix(const Eigen::Quaterniond& b) {
+  Eigen::Matrix4d result;
+  result << b.w(), -b.x(), -b.y(), -b.z(), b.x(), b.w(), b.z(), -b.y(), b.y(),
+      -b.z(), b.w(), b.x(), b.z(), b.y(), -b.x(), b.w();
+  return result;
+}
+
+// Returns the Jacobian of transform::RotationQuaternionToAngleAxisVector() with
+// respect to the coefficients of 'quaternion' in (w, x, y, z) order.
+Eigen::Matrix<double, 3, 4> ComputeAngleAxisVectorJacobian(
+    const Eigen::Quaterniond& quaternion) {
+  const double norm = quaternion.norm();
+  Eigen::Vector4d normalized(quaternion.w(), quaternion.x(), quaternion.y(),
+                             quaternion.z());
+  normalized /= norm;
+  const double sign = normalized[0] < 0. ? -1. : 1.;
+  normalized *= sign;
+  const double w = normalized[0];
+  const Eigen::Vector3d v = normalized.tail<3>();
+  const double v_norm = v.norm();
+  const double half_angle = std::atan2(v_norm, w);
+  Eigen::Matrix<double, 3, 4> jacobian;
+  if (2. * half_angle < 1e-7) {
+    // Matches the linearization of RotationQuaternionToAngleAxisVector().
+    jacobian.col(0).setZero();
+    jacobian.rightCols<3>() = 2. * Eigen::Matrix3d::Identity();
+  } else {
+    // With 'scale' being 2 * half_angle / sin(half_angle), its derivatives
+    // with respect to 'v_norm' and 'w' follow from the ones of 'half_angle',
+    // which are 'w' and -'v_norm' on the unit sphere.
+    const double scale = 2. * half_angle / v_norm;
+    const double dscale_dhalf_angle =
+        2. * (v_norm - half_angle * w) / (v_norm * v_norm);
+    jacobian.col(0) = -dscale_dhalf_angle * v_norm * v;
+    jacobian.rightCols<3>() =
+        scale * Eigen::Matrix3d::Identity() +
+        (dscale_dhalf_angle * w / v_norm) * v * v.transpose();
+  }
+  // Chain with the normalization and the choice of sign.
+  return (sign / norm) * jacobian *
+         (Eigen::Matrix4d::Identity() - normalized * normalized.transpose());
+}
+
+}  // namespace
+
+bool AnalyticalSpaCostFunction::Evaluate(double const* const* parameters,
+                                         double* residuals,
+                                         double** jacobians) const {
+  const double* const c_i_rotation = parameters[0];
+  const double* const c_i_translation = parameters[1];
+  const double* const c_j_rotation = parameters[2];
+  const double* const c_j_translation = parameters[3];
+  SpaCostFunction::ComputeScaledError(pose_, c_i_rotation, c_i_translation,
+                                      c_j_rotation, c_j_translation,
+                                      residuals);
+  if (jacobians == nullptr) {
+    return true;
+  }
+  const double translation_weight = pose_.translation_weight;
+  const double rotation_weight = pose_.rotation_weight;
+
+  // The translation error is 'zbar_ij' minus the rotation by the inverse of
+  // 'c_i_rotation' of 'delta' as computed by Eigen, which for a quaternion
+  // (w, u) is delta - 2 * w * u x delta + 2 * u x (u x delta).
+  const double w_i = c_i_rotation[0];
+  const Eigen::Vector3d u_i(c_i_rotation[1], c_i_rotation[2], c_i_rotation[3]);
+  const Eigen::Vector3d delta(c_j_translation[0] - c_i_translation[0],
+                              c_j_translation[1] - c_i_translation[1],
+                              c_j_translation[2] - c_i_translation[2]);
+  const Eigen::Matrix3d u_i_cross = CrossProductMatrix(u_i);
+  const Eigen::Matrix3d dh_translation_ddelta =
+      Eigen::Matrix3d::Identity() - 2. * w_i * u_i_cross +
+      2. * u_i_cross * u_i_cross;
+
+  // The rotation error is the angle-axis vector of the product of the inverse
+  // of 'c_j_rotation', 'c_i_rotation' and the rotation of 'zbar_ij'.
+  const Eigen::Quaterniond c_i_quaternion(c_i_rotation[0], c_i_rotation[1],
+                                          c_i_rotation[2], c_i_rotation[3]);
+  const Eigen::Quaterniond c_j_inverse_quaternion(
+      c_j_rotation[0], -c_j_rotation[1], -c_j_rotation[2], -c_j_rotation[3]);
+  const Eigen::Quaterniond c_i_times_zbar_ij =
+      c_i_quaternion * pose_.zbar_ij.rotation();
+  const Eigen::Matrix<double, 3, 4> weighted_dangle_axis_dproduct =
+      rotation_weight * ComputeAngleAxisVectorJacobian(c_j_inverse_quaternion *
+                                                       c_i_times_zbar_ij);
+
+  if (jacobians[0] != nullptr) {
+    Eigen::Map<RowMajorMatrix64d> jacobian(jacobians[0]);
+    jacobian.topLeftCorner<3, 1>() = 2. * translation_weight * u_i.cross(delta);
+    jacobian.topRightCorner<3, 3>() =
+        -2. * translation_weight *
+        (w_i * CrossProductMatrix(delta) + u_i.dot(delta) *
+                                               Eigen::Matrix3d::Identity() +
+         u_i * delta.transpose() - 2. * delta * u_i.transpose());
+    jacobian.bottomRows<3>() =
+        weighted_dangle_axis_dproduct *
+        LeftProductMatrix(c_j_inverse_quaternion) *
+        RightProductMatrix(pose_.zbar_ij.rotation());
+  }
+  if (jacobians[1] != nullptr) {
+    Eigen::Map<RowMajorMatrix63d> jacobian(jacobians[1]);
+    jacobian.topRows<3>() = translation_weight * dh_translation_ddelta;
+    jacobian.bottomRows<3>().setZero();
+  }
+  if (jacobians[2] != nullptr) {
+    Eigen::Map<RowMajorMatrix64d> jacobian(jacobians[2]);
+    jacobian.topRows<3>().setZero();
+    jacobian.bottomRows<3>() =
+        weighted_dangle_axis_dproduct * RightProductMatrix(c_i_times_zbar_ij) *
+        Eigen::Vector4d(1., -1., -1., -1.).asDiagonal();
+  }
+  if (jacobians[3] != nullptr) {
+    Eigen::Map<RowMajorMatrix63d> jacobian(jacobians[3]);
+    jacobian.topRows<3>() = -translation_weight * dh_translation_ddelta;
+    jacobian.bottomRows<3>().setZero();
+  }
+  return true;
+}
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping_3d
+}  // namespace cartographer
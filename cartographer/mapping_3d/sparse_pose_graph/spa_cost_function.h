@@ -103,6 +103,24 @@ class SpaCostFunction {
   const Constraint::Pose pose_;
 };
 
+// Same residuals as SpaCostFunction, but the Jacobians are computed
+// analytically instead of by evaluating with ceres::Jet, which is faster.
+// They are exact for any quaternion parameters, not only for unit ones.
+class AnalyticalSpaCostFunction
+    : public ceres::SizedCostFunction<6, 4, 3, 4, 3> {
+ public:
+  using Constraint = mapping::SparsePoseGraph::Constraint;
+
+  explicit AnalyticalSpaCostFunction(const Constraint::Pose& pose)
+      : pose_(pose) {}
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override;
+
+ private:
+  const Constraint::Pose pose_;
+};
+
 }  // namespace sparse_pose_graph
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/sparse_pose_graph/spa_cost_function.h"
+
+#include <array>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace sparse_pose_graph {
+namespace {
+
+constexpr int kParameterBlockSizes[] = {4, 3, 4, 3};
+
+Eigen::Quaterniond RandomQuaternion(std::mt19937* prng) {
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  return Eigen::Quaterniond(distribution(*prng), distribution(*prng),
+                            distribution(*prng), distribution(*prng))
+      .normalized();
+}
+
+// Compares the residuals and Jacobians of AnalyticalSpaCostFunction with the
+// ones of SpaCostFunction with automatic differentiation for the given
+// parameters.
+void ExpectAnalyticalMatchesAutoDiff(
+    const SpaCostFunction::Constraint::Pose& pose,
+    const double* const* parameters) {
+  const ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>
+      auto_diff_cost_function(new SpaCostFunction(pose));
+  const AnalyticalSpaCostFunction analytical_cost_function(pose);
+  std::array<double, 6> expected_residuals;
+  std::array<std::array<double, 24>, 4> expected_jacobians;
+  double* expected_jacobian_pointers[4];
+  std::array<double, 6> residuals;
+  std::array<std::array<double, 24>, 4> jacobians;
+  double* jacobian_pointers[4];
+  for (int block = 0; block != 4; ++block) {
+    expected_jacobian_pointers[block] = expected_jacobians[block].data();
+    jacobian_pointers[block] = jacobians[block].data();
+  }
+  ASSERT_TRUE(auto_diff_cost_function.Evaluate(
+      parameters, expected_residuals.data(), expected_jacobian_pointers));
+  ASSERT_TRUE(analytical_cost_function.Evaluate(parameters, residuals.data(),
+                                                jacobian_pointers));
+  for (int k = 0; k != 6; ++k) {
+    EXPECT_NEAR(expected_residuals[k], residuals[k], 1e-9);
+  }
+  for (int block = 0; block != 4; ++block) {
+    for (int k = 0; k != 6 * kParameterBlockSizes[block]; ++k) {
+      EXPECT_NEAR(expected_jacobians[block][k], jacobians[block][k], 1e-7)
+          << "block " << block << ", entry " << k;
+    }
+  }
+}
+
+TEST(SpaCostFunctionTest, AnalyticalMatchesAutoDiff) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(-3., 3.);
+  for (int i = 0; i != 100; ++i) {
+    const SpaCostFunction::Constraint::Pose pose{
+        transform::Rigid3d(
+            {distribution(prng), distribution(prng), distribution(prng)},
+            RandomQuaternion(&prng)),
+        distribution(prng), distribution(prng)};
+    const Eigen::Quaterniond c_i_quaternion = RandomQuaternion(&prng);
+    // Every other pose is consistent with the constraint, so that the rotation
+    // error is small, and quaternions are not always normalized.
+    const Eigen::Quaterniond c_j_quaternion =
+        i % 2 == 0 ? c_i_quaternion * pose.zbar_ij.rotation()
+                   : RandomQuaternion(&prng);
+    const double scale = i % 3 == 0 ? 1.1 : 1.;
+    std::array<double, 4> c_i_rotation = {
+        {scale * c_i_quaternion.w(), scale * c_i_quaternion.x(),
+         scale * c_i_quaternion.y(), scale * c_i_quaternion.z()}};
+    std::array<double, 3> c_i_translation = {
+        {distribution(prng), distribution(prng), distribution(prng)}};
+    std::array<double, 4> c_j_rotation = {{c_j_quaternion.w(),
+                                           c_j_quaternion.x(),
+                                           c_j_quaternion.y(),
+                                           c_j_quaternion.z()}};
+    std::array<double, 3> c_j_translation = {
+        {distribution(prng), distribution(prng), distribution(prng)}};
+    const double* const parameters[] = {
+        c_i_rotation.data(), c_i_translation.data(), c_j_rotation.data(),
+        c_j_translation.data()};
+    ExpectAnalyticalMatchesAutoDiff(pose, parameters);
+  }
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -18,7 +18,10 @@
 
 #include <cmath>
 #include <limits>
+#include <memory>
+#include <utility>
 
+#include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/sensor/range_data.h"
 #include "glog/logging.h"
@@ -83,7 +86,12 @@ std::vector<Eigen::Array4i> ExtractVoxelData(
     const HybridGrid& hybrid_grid, const transform::Rigid3f& transform,
     Eigen::Array2i* min_index, Eigen::Array2i* max_index) {
   std::vector<Eigen::Array4i> voxel_indices_and_probabilities;
-  const float resolution_inverse = 1.f / hybrid_grid.resolution();
+  // Cell centers are transformed in units of cells using a rotation matrix,
+  // which is cheaper per cell than rotating by the quaternion and scaling by
+  // the resolution.
+  const Eigen::Matrix3f rotation = transform.rotation().toRotationMatrix();
+  const Eigen::Vector3f translation_in_cells =
+      transform.translation() / hybrid_grid.resolution();
 
   constexpr float kXrayObstructedCellProbabilityLimit = 0.501f;
   for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
@@ -94,14 +102,13 @@ std::vector<Eigen::Array4i> ExtractVoxelData(
       continue;
     }
 
-    const Eigen::Vector3f cell_center_submap =
-        hybrid_grid.GetCenterOfCell(it.GetCellIndex());
-    const Eigen::Vector3f cell_center_global = transform * cell_center_submap;
+    const Eigen::Vector3f cell_center_global =
+        rotation * it.GetCellIndex().matrix().cast<float>() +
+        translation_in_cells;
     const Eigen::Array4i voxel_index_and_probability(
-        common::RoundToInt(cell_center_global.x() * resolution_inverse),
-        common::RoundToInt(cell_center_global.y() * resolution_inverse),
-        common::RoundToInt(cell_center_global.z() * resolution_inverse),
-        probability_value);
+        common::RoundToInt(cell_center_global.x()),
+        common::RoundToInt(cell_center_global.y()),
+        common::RoundToInt(cell_center_global.z()), probability_value);
 
     voxel_indices_and_probabilities.push_back(voxel_index_and_probability);
     const Eigen::Array2i pixel_index = voxel_index_and_probability.head<2>();
@@ -178,6 +185,18 @@ void AddToTextureProto(
           global_submap_pose.translation().z())));
 }
 
+// Copies the cells in 'proto' into 'hybrid_grid', which has to be empty.
+// Hybrid grids cannot be assigned to, since their resolution is constant.
+void CopyCells(const proto::HybridGrid& proto, HybridGrid* const hybrid_grid) {
+  if (!proto.has_blocks() && proto.values_size() == 0) {
+    return;
+  }
+  CHECK_EQ(proto.resolution(), hybrid_grid->resolution());
+  for (const auto it : HybridGrid(proto)) {
+    *hybrid_grid->mutable_value(it.first) = it.second;
+  }
+}
+
 }  // namespace
 
 proto::SubmapsOptions CreateSubmapsOptions(
@@ -190,6 +209,8 @@ proto::SubmapsOptions CreateSubmapsOptions(
   options.set_low_resolution(parameter_dictionary->GetDouble("low_resolution"));
   options.set_num_range_data(
       parameter_dictionary->GetNonNegativeInt("num_range_data"));
+  options.set_use_background_insertion(
+      parameter_dictionary->GetBool("use_background_insertion"));
   *options.mutable_range_data_inserter_options() =
       CreateRangeDataInserterOptions(
           parameter_dictionary->GetDictionary("range_data_inserter").get());
@@ -209,9 +230,11 @@ Submap::Submap(const mapping::proto::Submap3D& proto)
       low_resolution_hybrid_grid_(proto.low_resolution_hybrid_grid()) {
   SetNumRangeData(proto.num_range_data());
   finished_ = proto.finished();
+  UpdateFrozenHybridGrids();
 }
 
 void Submap::ToProto(mapping::proto::Submap* const proto) const {
+  common::MutexLocker locker(&mutex_);
   auto* const submap_3d = proto->mutable_submap_3d();
   *submap_3d->mutable_local_pose() = transform::ToProto(local_pose());
   submap_3d->set_num_range_data(num_range_data());
@@ -222,20 +245,59 @@ void Submap::ToProto(mapping::proto::Submap* const proto) const {
       low_resolution_hybrid_grid().ToProto();
 }
 
+void Submap::UpdateFromProto(const mapping::proto::Submap& proto) {
+  CHECK(proto.has_submap_3d());
+  const auto& submap_3d = proto.submap_3d();
+  common::MutexLocker locker(&mutex_);
+  SetNumRangeData(submap_3d.num_range_data());
+  finished_ = submap_3d.finished();
+  CopyCells(submap_3d.high_resolution_hybrid_grid(),
+            &high_resolution_hybrid_grid_);
+  CopyCells(submap_3d.low_resolution_hybrid_grid(),
+            &low_resolution_hybrid_grid_);
+  UpdateFrozenHybridGrids();
+  cached_response_.reset();
+}
+
+int64 Submap::GetMemoryUsageInBytes() const {
+  common::MutexLocker locker(&mutex_);
+  int64 memory_usage_in_bytes =
+      high_resolution_hybrid_grid_.GetMemoryUsageInBytes() +
+      low_resolution_hybrid_grid_.GetMemoryUsageInBytes();
+  if (frozen_high_resolution_hybrid_grid_ != nullptr) {
+    memory_usage_in_bytes +=
+        frozen_high_resolution_hybrid_grid_->GetMemoryUsageInBytes() +
+        frozen_low_resolution_hybrid_grid_->GetMemoryUsageInBytes();
+  }
+  return memory_usage_in_bytes;
+}
+
 void Submap::ToResponseProto(
     const transform::Rigid3d& global_submap_pose,
     mapping::proto::SubmapQuery::Response* const response) const {
-  response->set_submap_version(num_range_data());
-
-  AddToTextureProto(high_resolution_hybrid_grid_, global_submap_pose,
-                    response->add_textures());
-  AddToTextureProto(low_resolution_hybrid_grid_, global_submap_pose,
-                    response->add_textures());
+  common::MutexLocker locker(&mutex_);
+  // The textures are projected along the z-axis of the global map frame, so
+  // they are only reused for the same 'global_submap_pose'.
+  if (cached_response_ == nullptr ||
+      cached_response_pose_.translation() != global_submap_pose.translation() ||
+      cached_response_pose_.rotation().coeffs() !=
+          global_submap_pose.rotation().coeffs()) {
+    cached_response_ =
+        common::make_unique<mapping::proto::SubmapQuery::Response>();
+    cached_response_->set_submap_version(num_range_data());
+    AddToTextureProto(high_resolution_hybrid_grid_, global_submap_pose,
+                      cached_response_->add_textures());
+    AddToTextureProto(low_resolution_hybrid_grid_, global_submap_pose,
+                      cached_response_->add_textures());
+    cached_response_pose_ = global_submap_pose;
+  }
+  response->MergeFrom(*cached_response_);
 }
 
 void Submap::InsertRangeData(const sensor::RangeData& range_data,
                              const RangeDataInserter& range_data_inserter,
                              const int high_resolution_max_range) {
+  common::MutexLocker locker(&mutex_);
   CHECK(!finished_);
   const sensor::RangeData transformed_range_data = sensor::TransformRangeData(
       range_data, local_pose().inverse().cast<float>());
@@ -246,16 +308,34 @@ void Submap::InsertRangeData(const sensor::RangeData& range_data,
   range_data_inserter.Insert(transformed_range_data,
                              &low_resolution_hybrid_grid_);
   SetNumRangeData(num_range_data() + 1);
+  cached_response_.reset();
 }
 
 void Submap::Finish() {
+  common::MutexLocker locker(&mutex_);
   CHECK(!finished_);
   finished_ = true;
+  UpdateFrozenHybridGrids();
+}
+
+void Submap::UpdateFrozenHybridGrids() {
+  if (!finished_) {
+    frozen_high_resolution_hybrid_grid_.reset();
+    frozen_low_resolution_hybrid_grid_.reset();
+    return;
+  }
+  frozen_high_resolution_hybrid_grid_ =
+      common::make_unique<FrozenHybridGrid>(high_resolution_hybrid_grid_);
+  frozen_low_resolution_hybrid_grid_ =
+      common::make_unique<FrozenHybridGrid>(low_resolution_hybrid_grid_);
 }
 
 ActiveSubmaps::ActiveSubmaps(const proto::SubmapsOptions& options)
     : options_(options),
       range_data_inserter_(options.range_data_inserter_options()) {
+  if (options_.use_background_insertion()) {
+    insertion_thread_ = common::make_unique<common::ThreadPool>(1);
+  }
   // We always want to have at least one submap which we can return and will
   // create it at the origin in absence of a better choice.
   //
@@ -264,6 +344,8 @@ ActiveSubmaps::ActiveSubmaps(const proto::SubmapsOptions& options)
   AddSubmap(transform::Rigid3d::Identity());
 }
 
+ActiveSubmaps::~ActiveSubmaps() { WaitForPendingInsertions(); }
+
 std::vector<std::shared_ptr<Submap>> ActiveSubmaps::submaps() const {
   return submaps_;
 }
@@ -271,16 +353,52 @@ std::vector<std::shared_ptr<Submap>> ActiveSubmaps::submaps() const {
 int ActiveSubmaps::matching_index() const { return matching_submap_index_; }
 
 void ActiveSubmaps::InsertRangeData(
-    const sensor::RangeData& range_data,
-    const Eigen::Quaterniond& gravity_alignment) {
+    sensor::RangeData range_data, const Eigen::Quaterniond& gravity_alignment) {
+  const Eigen::Vector3d origin = range_data.origin.cast<double>();
+  // The front submap is inserted into first, after which 'range_data' is moved
+  // into the data shared by the background insertions.
+  std::shared_ptr<const sensor::RangeData> shared_range_data;
   for (auto& submap : submaps_) {
-    submap->InsertRangeData(range_data, range_data_inserter_,
-                            options_.high_resolution_max_range());
+    if (insertion_thread_ != nullptr && submap != submaps_.front()) {
+      if (shared_range_data == nullptr) {
+        shared_range_data =
+            std::make_shared<const sensor::RangeData>(std::move(range_data));
+      }
+      InsertRangeDataInBackground(submap, shared_range_data);
+    } else {
+      submap->InsertRangeData(range_data, range_data_inserter_,
+                              options_.high_resolution_max_range());
+    }
   }
-  if (submaps_.back()->num_range_data() == options_.num_range_data()) {
-    AddSubmap(transform::Rigid3d(range_data.origin.cast<double>(),
-                                 gravity_alignment));
+  if (++num_range_data_in_newest_submap_ == options_.num_range_data()) {
+    // The newest submap will be used for matching from now on.
+    WaitForPendingInsertions();
+    AddSubmap(transform::Rigid3d(origin, gravity_alignment));
+  }
+}
+
+void ActiveSubmaps::WaitForPendingInsertions() {
+  common::MutexLocker locker(&mutex_);
+  locker.Await([this]() REQUIRES(mutex_) {
+    return num_pending_insertions_ == 0;
+  });
+}
+
+void ActiveSubmaps::InsertRangeDataInBackground(
+    const std::shared_ptr<Submap>& submap,
+    const std::shared_ptr<const sensor::RangeData>& range_data) {
+  {
+    common::MutexLocker locker(&mutex_);
+    ++num_pending_insertions_;
   }
+  insertion_thread_->Schedule(
+      [this, submap, range_data]() EXCLUDES(mutex_) {
+        submap->InsertRangeData(*range_data, range_data_inserter_,
+                                options_.high_resolution_max_range());
+        common::MutexLocker locker(&mutex_);
+        --num_pending_insertions_;
+      },
+      common::WorkItemPriority::kNormal, "insert_range_data_in_background");
 }
 
 void ActiveSubmaps::AddSubmap(const transform::Rigid3d& local_pose) {
@@ -289,6 +407,7 @@ void ActiveSubmaps::AddSubmap(const transform::Rigid3d& local_pose) {
     ++matching_submap_index_;
     submaps_.erase(submaps_.begin());
   }
+  num_range_data_in_newest_submap_ = 0;
   submaps_.emplace_back(new Submap(options_.high_resolution(),
                                    options_.low_resolution(), local_pose));
   LOG(INFO) << "Added submap " << matching_submap_index_ + submaps_.size();
@@ -22,12 +22,15 @@
 #include <vector>
 
 #include "Eigen/Geometry"
+#include "cartographer/common/mutex.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/id.h"
 #include "cartographer/mapping/proto/serialization.pb.h"
 #include "cartographer/mapping/proto/submap_visualization.pb.h"
 #include "cartographer/mapping/submaps.h"
 #include "cartographer/mapping_2d/range_data_inserter.h"
+#include "cartographer/mapping_3d/frozen_hybrid_grid.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 #include "cartographer/mapping_3d/proto/submaps_options.pb.h"
 #include "cartographer/mapping_3d/range_data_inserter.h"
@@ -48,15 +51,35 @@ class Submap : public mapping::Submap {
   explicit Submap(const mapping::proto::Submap3D& proto);
 
   void ToProto(mapping::proto::Submap* proto) const override;
+  // Updates the number of range data and whether it is finished from 'proto',
+  // and the hybrid grids if 'proto' contains cells.
+  void UpdateFromProto(const mapping::proto::Submap& proto);
 
+  // The grid accessors do not synchronize with insertion on another thread, so
+  // they must only be used while no range data is inserted in the background,
+  // e.g. for the matching submap or finished submaps.
   const HybridGrid& high_resolution_hybrid_grid() const {
     return high_resolution_hybrid_grid_;
   }
   const HybridGrid& low_resolution_hybrid_grid() const {
     return low_resolution_hybrid_grid_;
   }
+  // Compact read-only copies of the hybrid grids, which are only available
+  // once the submap is finished.
+  const FrozenHybridGrid& frozen_high_resolution_hybrid_grid() const {
+    CHECK(frozen_high_resolution_hybrid_grid_ != nullptr);
+    return *frozen_high_resolution_hybrid_grid_;
+  }
+  const FrozenHybridGrid& frozen_low_resolution_hybrid_grid() const {
+    CHECK(frozen_low_resolution_hybrid_grid_ != nullptr);
+    return *frozen_low_resolution_hybrid_grid_;
+  }
   bool finished() const { return finished_; }
 
+  // Returns the number of bytes used by the hybrid grids and their frozen
+  // copies. Synchronizes with insertion on another thread.
+  int64 GetMemoryUsageInBytes() const EXCLUDES(mutex_);
+
   void ToResponseProto(
       const transform::Rigid3d& global_submap_pose,
       mapping::proto::SubmapQuery::Response* response) const override;
@@ -69,9 +92,25 @@ class Submap : public mapping::Submap {
   void Finish();
 
  private:
+  // Builds the frozen copies of the hybrid grids, or resets them if the submap
+  // is not finished.
+  void UpdateFrozenHybridGrids();
+
+  // Serializing and finishing the submap synchronize with insertion on
+  // another thread.
+  mutable common::Mutex mutex_;
   HybridGrid high_resolution_hybrid_grid_;
   HybridGrid low_resolution_hybrid_grid_;
   bool finished_ = false;
+  // Set from the hybrid grids whenever 'finished_' becomes true.
+  std::unique_ptr<const FrozenHybridGrid> frozen_high_resolution_hybrid_grid_;
+  std::unique_ptr<const FrozenHybridGrid> frozen_low_resolution_hybrid_grid_;
+
+  // The textures last returned by ToResponseProto() and the global submap pose
+  // they were projected with. Reset whenever the hybrid grids change.
+  mutable std::unique_ptr<mapping::proto::SubmapQuery::Response>
+      cached_response_ GUARDED_BY(mutex_);
+  mutable transform::Rigid3d cached_response_pose_ GUARDED_BY(mutex_);
 };
 
 // Except during initialization when only a single submap exists, there are
@@ -83,9 +122,15 @@ class Submap : public mapping::Submap {
 // considered initialized: the old submap is no longer changed, the "new" submap
 // is now the "old" submap and is used for scan-to-map matching. Moreover, a
 // "new" submap gets created. The "old" submap is forgotten by this object.
+//
+// With 'use_background_insertion', the "new" submap is updated on a dedicated
+// thread while the "old" one is updated by the caller. The "new" submap only
+// becomes the "old" one after all its pending insertions are done, so scan
+// matching always sees a complete submap.
 class ActiveSubmaps {
  public:
   explicit ActiveSubmaps(const proto::SubmapsOptions& options);
+  ~ActiveSubmaps();
 
   ActiveSubmaps(const ActiveSubmaps&) = delete;
   ActiveSubmaps& operator=(const ActiveSubmaps&) = delete;
@@ -96,19 +141,38 @@ class ActiveSubmaps {
 
   // Inserts 'range_data' into the Submap collection. 'gravity_alignment' is
   // used for the orientation of new submaps so that the z axis approximately
-  // aligns with gravity.
-  void InsertRangeData(const sensor::RangeData& range_data,
+  // aligns with gravity. With background insertion, this returns once the
+  // matching submap has been updated. The background insertions share
+  // 'range_data' without copying it.
+  void InsertRangeData(sensor::RangeData range_data,
                        const Eigen::Quaterniond& gravity_alignment);
 
+  // Blocks until all range data queued for insertion in the background has
+  // been inserted.
+  void WaitForPendingInsertions() EXCLUDES(mutex_);
+
   std::vector<std::shared_ptr<Submap>> submaps() const;
 
  private:
+  void InsertRangeDataInBackground(
+      const std::shared_ptr<Submap>& submap,
+      const std::shared_ptr<const sensor::RangeData>& range_data)
+      EXCLUDES(mutex_);
   void AddSubmap(const transform::Rigid3d& local_pose);
 
   const proto::SubmapsOptions options_;
   int matching_submap_index_ = 0;
   std::vector<std::shared_ptr<Submap>> submaps_;
+  // Number of range data inserted or queued for insertion into the newest
+  // submap.
+  int num_range_data_in_newest_submap_ = 0;
   RangeDataInserter range_data_inserter_;
+
+  common::Mutex mutex_;
+  int num_pending_insertions_ GUARDED_BY(mutex_) = 0;
+  // Only set with background insertion. Declared last so that its thread is
+  // joined before anything it uses is destroyed.
+  std::unique_ptr<common::ThreadPool> insertion_thread_;
 };
 
 }  // namespace mapping_3d
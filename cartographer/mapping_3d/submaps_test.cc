@@ -31,7 +31,7 @@ TEST(SubmapsTest, ToFromProto) {
   expected.ToProto(&proto);
   EXPECT_FALSE(proto.has_submap_2d());
   EXPECT_TRUE(proto.has_submap_3d());
-  const auto actual = Submap(proto.submap_3d());
+  const Submap actual(proto.submap_3d());
   EXPECT_TRUE(expected.local_pose().translation().isApprox(
       actual.local_pose().translation(), 1e-6));
   EXPECT_TRUE(expected.local_pose().rotation().isApprox(
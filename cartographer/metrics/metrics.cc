@@ -0,0 +1,257 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/metrics/metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "cartographer/common/make_unique.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace metrics {
+namespace {
+
+void AtomicAdd(const double value, std::atomic<double>* const target) {
+  double expected = target->load(std::memory_order_relaxed);
+  while (!target->compare_exchange_weak(expected, expected + value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+string EscapeLabelValue(const string& value) {
+  string result;
+  for (const char c : value) {
+    if (c == '\\' || c == '"') {
+      result += '\\';
+      result += c;
+    } else if (c == '\n') {
+      result += "\\n";
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+// Writes the 'labels', and 'extra_label' if not empty, in braces.
+void WriteLabels(const Labels& labels, const string& extra_label,
+                 std::ostream* const out) {
+  if (labels.empty() && extra_label.empty()) {
+    return;
+  }
+  *out << "{";
+  bool first = true;
+  for (const auto& label : labels) {
+    *out << (first ? "" : ",") << label.first << "=\""
+         << EscapeLabelValue(label.second) << "\"";
+    first = false;
+  }
+  if (!extra_label.empty()) {
+    *out << (first ? "" : ",") << extra_label;
+  }
+  *out << "}";
+}
+
+string ToString(const double value) {
+  std::ostringstream out;
+  out << std::setprecision(15) << value;
+  return out.str();
+}
+
+}  // namespace
+
+void Counter::Increment(const double value) {
+  DCHECK_GE(value, 0.);
+  AtomicAdd(value, &value_);
+}
+
+void Gauge::Increment(const double value) { AtomicAdd(value, &value_); }
+
+Histogram::BucketBoundaries Histogram::FixedWidth(
+    const double width, const int num_finite_buckets) {
+  CHECK_GT(width, 0.);
+  BucketBoundaries result;
+  for (int i = 1; i <= num_finite_buckets; ++i) {
+    result.push_back(i * width);
+  }
+  return result;
+}
+
+Histogram::BucketBoundaries Histogram::ScaledPowersOf(
+    const double base, const double scale_factor, const double max_value) {
+  CHECK_GT(base, 1.);
+  CHECK_GT(scale_factor, 0.);
+  BucketBoundaries result;
+  double boundary = scale_factor;
+  for (;;) {
+    result.push_back(boundary);
+    if (boundary >= max_value) {
+      return result;
+    }
+    boundary *= base;
+  }
+}
+
+Histogram::Histogram(const BucketBoundaries& bucket_boundaries)
+    : bucket_boundaries_(bucket_boundaries),
+      bucket_counts_(new std::atomic<int64>[bucket_boundaries.size() + 1]) {
+  CHECK(std::is_sorted(bucket_boundaries_.begin(), bucket_boundaries_.end()));
+  for (size_t i = 0; i != bucket_boundaries_.size() + 1; ++i) {
+    bucket_counts_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Observe(const double value) {
+  // A value equal to a boundary belongs to the bucket it bounds.
+  const size_t bucket =
+      std::lower_bound(bucket_boundaries_.begin(), bucket_boundaries_.end(),
+                       value) -
+      bucket_boundaries_.begin();
+  bucket_counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+  AtomicAdd(value, &sum_);
+}
+
+std::vector<int64> Histogram::BucketCounts() const {
+  std::vector<int64> result;
+  for (size_t i = 0; i != bucket_boundaries_.size() + 1; ++i) {
+    result.push_back(bucket_counts_[i].load(std::memory_order_relaxed));
+  }
+  return result;
+}
+
+int64 Histogram::Count() const {
+  int64 count = 0;
+  for (size_t i = 0; i != bucket_boundaries_.size() + 1; ++i) {
+    count += bucket_counts_[i].load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+Counter* Registry::GetCounter(const string& name, const string& description,
+                              const Labels& labels) {
+  common::MutexLocker locker(&mutex_);
+  auto& counter =
+      GetFamily(name, description, Kind::kCounter)->counters[labels];
+  if (counter == nullptr) {
+    counter = common::make_unique<Counter>();
+  }
+  return counter.get();
+}
+
+Gauge* Registry::GetGauge(const string& name, const string& description,
+                          const Labels& labels) {
+  common::MutexLocker locker(&mutex_);
+  auto& gauge = GetFamily(name, description, Kind::kGauge)->gauges[labels];
+  if (gauge == nullptr) {
+    gauge = common::make_unique<Gauge>();
+  }
+  return gauge.get();
+}
+
+Histogram* Registry::GetHistogram(
+    const string& name, const string& description, const Labels& labels,
+    const Histogram::BucketBoundaries& bucket_boundaries) {
+  common::MutexLocker locker(&mutex_);
+  Family* const family = GetFamily(name, description, Kind::kHistogram);
+  if (!family->histograms.empty()) {
+    CHECK(family->histograms.begin()->second->bucket_boundaries() ==
+          bucket_boundaries)
+        << "Histograms named '" << name << "' differ in their buckets.";
+  }
+  auto& histogram = family->histograms[labels];
+  if (histogram == nullptr) {
+    histogram = common::make_unique<Histogram>(bucket_boundaries);
+  }
+  return histogram.get();
+}
+
+Registry::Family* Registry::GetFamily(const string& name,
+                                      const string& description,
+                                      const Kind kind) {
+  const auto it = families_.find(name);
+  if (it != families_.end()) {
+    CHECK(it->second.kind == kind)
+        << "Metric '" << name << "' was registered as a different kind.";
+    return &it->second;
+  }
+  Family& family = families_[name];
+  family.kind = kind;
+  family.description = description;
+  return &family;
+}
+
+string Registry::ToPrometheusText() const {
+  common::MutexLocker locker(&mutex_);
+  std::ostringstream out;
+  for (const auto& entry : families_) {
+    const string& name = entry.first;
+    const Family& family = entry.second;
+    out << "# HELP " << name << " " << family.description << "\n";
+    switch (family.kind) {
+      case Kind::kCounter:
+        out << "# TYPE " << name << " counter\n";
+        for (const auto& counter : family.counters) {
+          out << name;
+          WriteLabels(counter.first, "", &out);
+          out << " " << ToString(counter.second->Value()) << "\n";
+        }
+        break;
+      case Kind::kGauge:
+        out << "# TYPE " << name << " gauge\n";
+        for (const auto& gauge : family.gauges) {
+          out << name;
+          WriteLabels(gauge.first, "", &out);
+          out << " " << ToString(gauge.second->Value()) << "\n";
+        }
+        break;
+      case Kind::kHistogram:
+        out << "# TYPE " << name << " histogram\n";
+        for (const auto& histogram : family.histograms) {
+          const Histogram::BucketBoundaries& boundaries =
+              histogram.second->bucket_boundaries();
+          const std::vector<int64> bucket_counts =
+              histogram.second->BucketCounts();
+          // Buckets are cumulative in this format.
+          int64 count = 0;
+          for (size_t i = 0; i != bucket_counts.size(); ++i) {
+            count += bucket_counts[i];
+            out << name << "_bucket";
+            WriteLabels(histogram.first,
+                        "le=\"" +
+                            (i == boundaries.size() ? string("+Inf")
+                                                    : ToString(boundaries[i])) +
+                            "\"",
+                        &out);
+            out << " " << count << "\n";
+          }
+          out << name << "_sum";
+          WriteLabels(histogram.first, "", &out);
+          out << " " << ToString(histogram.second->Sum()) << "\n";
+          out << name << "_count";
+          WriteLabels(histogram.first, "", &out);
+          out << " " << count << "\n";
+        }
+        break;
+    }
+  }
+  return out.str();
+}
+
+}  // namespace metrics
+}  // namespace cartographer
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_METRICS_METRICS_H_
+#define CARTOGRAPHER_METRICS_METRICS_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace metrics {
+
+// Distinguish metrics of the same name, e.g. by sensor ID.
+using Labels = std::map<string, string>;
+
+// A value which only ever increases, e.g. the number of inserted scans.
+//
+// This class is thread-safe and updating it does not lock.
+class Counter {
+ public:
+  Counter() = default;
+
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  // 'value' must not be negative.
+  void Increment(double value = 1.);
+  double Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_{0.};
+};
+
+// A value which can go up and down, e.g. the length of a queue.
+//
+// This class is thread-safe and updating it does not lock.
+class Gauge {
+ public:
+  Gauge() = default;
+
+  Gauge(const Gauge&) = delete;
+  Gauge& operator=(const Gauge&) = delete;
+
+  void Set(double value) { value_.store(value, std::memory_order_relaxed); }
+  void Increment(double value = 1.);
+  void Decrement(double value = 1.) { Increment(-value); }
+  double Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_{0.};
+};
+
+// Counts observed values, e.g. latencies, in buckets with fixed boundaries.
+//
+// This class is thread-safe and updating it does not lock.
+class Histogram {
+ public:
+  // Sorted upper bounds of the buckets. Values larger than the last boundary
+  // fall into an additional bucket.
+  using BucketBoundaries = std::vector<double>;
+
+  // Returns the boundaries 'width', 2 * 'width', ... of
+  // 'num_finite_buckets' buckets.
+  static BucketBoundaries FixedWidth(double width, int num_finite_buckets);
+
+  // Returns the boundaries 'scale_factor', 'scale_factor' * 'base', ... up to
+  // and including the first one not less than 'max_value'.
+  static BucketBoundaries ScaledPowersOf(double base, double scale_factor,
+                                         double max_value);
+
+  explicit Histogram(const BucketBoundaries& bucket_boundaries);
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void Observe(double value);
+
+  const BucketBoundaries& bucket_boundaries() const {
+    return bucket_boundaries_;
+  }
+
+  // Returns the number of values in each bucket, including the one for values
+  // larger than the last boundary.
+  std::vector<int64> BucketCounts() const;
+  int64 Count() const;
+  double Sum() const { return sum_.load(std::memory_order_relaxed); }
+
+ private:
+  const BucketBoundaries bucket_boundaries_;
+  std::unique_ptr<std::atomic<int64>[]> bucket_counts_;
+  std::atomic<double> sum_{0.};
+};
+
+// Owns the metrics of a process, so that they can be exported together.
+// Metrics are identified by their name and labels. Metrics of the same name
+// must be of the same kind.
+//
+// Metrics should be looked up once and then kept, since the lookup locks.
+// The metrics themselves stay valid for the lifetime of the registry.
+//
+// This class is thread-safe.
+class Registry {
+ public:
+  Registry() = default;
+
+  Registry(const Registry&) = delete;
+  Registry& operator=(const Registry&) = delete;
+
+  // Each of these returns the metric with 'name' and 'labels', which is
+  // created on first use. 'description' is exported as help text.
+  Counter* GetCounter(const string& name, const string& description,
+                      const Labels& labels = Labels());
+  Gauge* GetGauge(const string& name, const string& description,
+                  const Labels& labels = Labels());
+  // All histograms of the same name must have the same 'bucket_boundaries'.
+  Histogram* GetHistogram(const string& name, const string& description,
+                          const Labels& labels,
+                          const Histogram::BucketBoundaries& bucket_boundaries);
+
+  // Returns the current values of all metrics in the Prometheus text
+  // exposition format, to be served to a scraper or written to a file.
+  string ToPrometheusText() const;
+
+ private:
+  enum class Kind { kCounter, kGauge, kHistogram };
+
+  struct Family {
+    Kind kind;
+    string description;
+    // Only the map matching 'kind' is used.
+    std::map<Labels, std::unique_ptr<Counter>> counters;
+    std::map<Labels, std::unique_ptr<Gauge>> gauges;
+    std::map<Labels, std::unique_ptr<Histogram>> histograms;
+  };
+
+  Family* GetFamily(const string& name, const string& description, Kind kind)
+      REQUIRES(mutex_);
+
+  mutable common::Mutex mutex_;
+  std::map<string, Family> families_ GUARDED_BY(mutex_);
+};
+
+}  // namespace metrics
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_METRICS_METRICS_H_
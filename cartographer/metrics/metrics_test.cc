@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/metrics/metrics.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace metrics {
+namespace {
+
+TEST(MetricsTest, CounterAndGauge) {
+  Counter counter;
+  counter.Increment();
+  counter.Increment(2.5);
+  EXPECT_EQ(3.5, counter.Value());
+  Gauge gauge;
+  gauge.Set(4.);
+  gauge.Increment();
+  gauge.Decrement(2.);
+  EXPECT_EQ(3., gauge.Value());
+}
+
+TEST(MetricsTest, HistogramBuckets) {
+  Histogram histogram(Histogram::FixedWidth(1., 3));
+  EXPECT_EQ((Histogram::BucketBoundaries{1., 2., 3.}),
+            histogram.bucket_boundaries());
+  for (const double value : {0.5, 1., 1.5, 2.5, 3.5, 10.}) {
+    histogram.Observe(value);
+  }
+  EXPECT_EQ((std::vector<int64>{2, 1, 1, 2}), histogram.BucketCounts());
+  EXPECT_EQ(6, histogram.Count());
+  EXPECT_EQ(19., histogram.Sum());
+}
+
+TEST(MetricsTest, ScaledPowersOf) {
+  EXPECT_EQ((Histogram::BucketBoundaries{0.5, 1., 2., 4.}),
+            Histogram::ScaledPowersOf(2., 0.5, 3.));
+}
+
+TEST(MetricsTest, ConcurrentUpdates) {
+  Counter counter;
+  Histogram histogram(Histogram::FixedWidth(1., 1));
+  std::vector<std::thread> threads;
+  for (int i = 0; i != 4; ++i) {
+    threads.emplace_back([&counter, &histogram]() {
+      for (int j = 0; j != 10000; ++j) {
+        counter.Increment();
+        histogram.Observe(0.5);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(40000., counter.Value());
+  EXPECT_EQ(40000, histogram.Count());
+  EXPECT_EQ(20000., histogram.Sum());
+}
+
+TEST(MetricsTest, RegistryReturnsSameMetric) {
+  Registry registry;
+  Counter* const counter = registry.GetCounter("a", "A.", {{"x", "1"}});
+  EXPECT_EQ(counter, registry.GetCounter("a", "A.", {{"x", "1"}}));
+  EXPECT_NE(counter, registry.GetCounter("a", "A.", {{"x", "2"}}));
+  EXPECT_DEATH(registry.GetGauge("a", "A."), "different kind");
+}
+
+TEST(MetricsTest, ToPrometheusText) {
+  Registry registry;
+  registry.GetCounter("scans_total", "Scans.", {{"sensor", "a\"b"}})
+      ->Increment(3.);
+  registry.GetGauge("queue_length", "Queue.")->Set(0.25);
+  Histogram* const histogram = registry.GetHistogram(
+      "latency_seconds", "Latency.", {{"kind", "x"}}, {0.1, 1.});
+  histogram->Observe(0.05);
+  histogram->Observe(2.);
+  EXPECT_EQ(
+      "# HELP latency_seconds Latency.\n"
+      "# TYPE latency_seconds histogram\n"
+      "latency_seconds_bucket{kind=\"x\",le=\"0.1\"} 1\n"
+      "latency_seconds_bucket{kind=\"x\",le=\"1\"} 1\n"
+      "latency_seconds_bucket{kind=\"x\",le=\"+Inf\"} 2\n"
+      "latency_seconds_sum{kind=\"x\"} 2.05\n"
+      "latency_seconds_count{kind=\"x\"} 2\n"
+      "# HELP queue_length Queue.\n"
+      "# TYPE queue_length gauge\n"
+      "queue_length 0.25\n"
+      "# HELP scans_total Scans.\n"
+      "# TYPE scans_total counter\n"
+      "scans_total{sensor=\"a\\\"b\"} 3\n",
+      registry.ToPrometheusText());
+}
+
+}  // namespace
+}  // namespace metrics
+}  // namespace cartographer
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/borrowed_point_cloud.h"
+
+#include <utility>
+
+namespace cartographer {
+namespace sensor {
+
+static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float) &&
+                  alignof(Eigen::Vector3f) == alignof(float),
+              "Points have to be readable as consecutive floats.");
+
+BorrowedPointCloud::BorrowedPointCloud(const float* const data,
+                                       const size_t num_points,
+                                       std::function<void()> release)
+    : begin_(reinterpret_cast<const Eigen::Vector3f*>(data)),
+      end_(begin_ + num_points),
+      release_(std::move(release)) {}
+
+BorrowedPointCloud::~BorrowedPointCloud() { Release(); }
+
+BorrowedPointCloud::BorrowedPointCloud(BorrowedPointCloud&& other)
+    : begin_(other.begin_),
+      end_(other.end_),
+      release_(std::move(other.release_)) {
+  other.release_ = nullptr;
+  other.end_ = other.begin_;
+}
+
+BorrowedPointCloud& BorrowedPointCloud::operator=(BorrowedPointCloud&& other) {
+  if (this != &other) {
+    Release();
+    begin_ = other.begin_;
+    end_ = other.end_;
+    release_ = std::move(other.release_);
+    other.release_ = nullptr;
+    other.end_ = other.begin_;
+  }
+  return *this;
+}
+
+void BorrowedPointCloud::Release() {
+  if (release_ != nullptr) {
+    std::function<void()> release = std::move(release_);
+    release_ = nullptr;
+    release();
+  }
+}
+
+}  // namespace sensor
+}  // namespace cartographer
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_SENSOR_BORROWED_POINT_CLOUD_H_
+#define CARTOGRAPHER_SENSOR_BORROWED_POINT_CLOUD_H_
+
+#include <cstddef>
+#include <functional>
+
+#include "Eigen/Core"
+#include "cartographer/sensor/point_cloud.h"
+
+namespace cartographer {
+namespace sensor {
+
+// Points in a buffer allocated by the caller, e.g. by a driver, which are
+// passed to a trajectory builder without copying them. The buffer holds the
+// x, y and z coordinates of each point as consecutive floats and is only read.
+// 'release' is called once the points are no longer needed, which may be
+// after the call which added them returned and on another thread.
+class BorrowedPointCloud {
+ public:
+  BorrowedPointCloud(const float* data, size_t num_points,
+                     std::function<void()> release);
+  ~BorrowedPointCloud();
+
+  BorrowedPointCloud(BorrowedPointCloud&& other);
+  BorrowedPointCloud& operator=(BorrowedPointCloud&& other);
+  BorrowedPointCloud(const BorrowedPointCloud&) = delete;
+  BorrowedPointCloud& operator=(const BorrowedPointCloud&) = delete;
+
+  PointCloudView view() const { return PointCloudView(begin_, end_); }
+  size_t size() const { return end_ - begin_; }
+
+ private:
+  // Calls 'release_' unless it was already called or moved away.
+  void Release();
+
+  const Eigen::Vector3f* begin_;
+  const Eigen::Vector3f* end_;
+  std::function<void()> release_;
+};
+
+}  // namespace sensor
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_SENSOR_BORROWED_POINT_CLOUD_H_
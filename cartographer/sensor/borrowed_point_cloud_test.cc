@@ -0,0 +1,72 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/borrowed_point_cloud.h"
+
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+TEST(BorrowedPointCloudTest, ViewsTheBuffer) {
+  const std::vector<float> buffer = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f};
+  const BorrowedPointCloud point_cloud(buffer.data(), 2, nullptr);
+  const PointCloudView view = point_cloud.view();
+  ASSERT_EQ(2, view.size());
+  EXPECT_EQ(buffer.data(), view.begin()->data());
+  EXPECT_EQ(Eigen::Vector3f(1.f, 2.f, 3.f), *view.begin());
+  EXPECT_EQ(Eigen::Vector3f(4.f, 5.f, 6.f), *(view.begin() + 1));
+}
+
+TEST(BorrowedPointCloudTest, ReleasesOnceWhenDestroyed) {
+  const std::vector<float> buffer = {1.f, 2.f, 3.f};
+  int num_releases = 0;
+  {
+    BorrowedPointCloud point_cloud(buffer.data(), 1,
+                                   [&num_releases]() { ++num_releases; });
+    BorrowedPointCloud moved_point_cloud(std::move(point_cloud));
+    EXPECT_EQ(0, point_cloud.size());
+    EXPECT_EQ(1, moved_point_cloud.size());
+    EXPECT_EQ(0, num_releases);
+  }
+  EXPECT_EQ(1, num_releases);
+}
+
+TEST(BorrowedPointCloudTest, MoveAssignmentReleasesPreviousBuffer) {
+  const std::vector<float> buffer = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f};
+  int num_first_releases = 0;
+  int num_second_releases = 0;
+  {
+    BorrowedPointCloud point_cloud(
+        buffer.data(), 1, [&num_first_releases]() { ++num_first_releases; });
+    point_cloud = BorrowedPointCloud(
+        buffer.data() + 3, 1,
+        [&num_second_releases]() { ++num_second_releases; });
+    EXPECT_EQ(1, num_first_releases);
+    EXPECT_EQ(0, num_second_releases);
+    EXPECT_EQ(Eigen::Vector3f(4.f, 5.f, 6.f), *point_cloud.view().begin());
+  }
+  EXPECT_EQ(1, num_first_releases);
+  EXPECT_EQ(1, num_second_releases);
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
@@ -16,38 +16,273 @@
 
 #include "cartographer/sensor/collator.h"
 
+#include <algorithm>
+
+#include "cartographer/common/trace.h"
+#include "glog/logging.h"
+
 namespace cartographer {
 namespace sensor {
 
+Collator::Collator(const QueueCapacity& queue_capacity,
+                   common::ThreadPoolInterface* const dispatch_thread_pool)
+    : queue_capacity_(queue_capacity),
+      dispatch_thread_pool_(dispatch_thread_pool) {}
+
+Collator::~Collator() { WaitUntilDispatched(); }
+
 void Collator::AddTrajectory(
     const int trajectory_id,
     const std::unordered_set<string>& expected_sensor_ids,
     const Callback& callback) {
-  for (const auto& sensor_id : expected_sensor_ids) {
-    const auto queue_key = QueueKey{trajectory_id, sensor_id};
-    queue_.AddQueue(queue_key,
-                    [callback, sensor_id](std::unique_ptr<Data> data) {
-                      callback(sensor_id, std::move(data));
-                    });
-    queue_keys_[trajectory_id].push_back(queue_key);
+  AddTrajectory(trajectory_id, expected_sensor_ids, callback,
+                false /* presorted */);
+}
+
+void Collator::AddPresortedTrajectory(
+    const int trajectory_id,
+    const std::unordered_set<string>& expected_sensor_ids,
+    const Callback& callback) {
+  AddTrajectory(trajectory_id, expected_sensor_ids, callback,
+                true /* presorted */);
+}
+
+void Collator::AddTrajectory(
+    const int trajectory_id,
+    const std::unordered_set<string>& expected_sensor_ids,
+    const Callback& callback, const bool presorted) {
+  common::MutexLocker locker(&mutex_);
+  CHECK_EQ(trajectories_.count(trajectory_id), 0);
+  auto trajectory = std::make_shared<Trajectory>();
+  trajectory->callback = callback;
+  trajectory->presorted = presorted;
+  trajectory->sensor_ids.assign(expected_sensor_ids.begin(),
+                                expected_sensor_ids.end());
+  for (size_t i = 0; i != trajectory->sensor_ids.size(); ++i) {
+    const auto queue_key = QueueKey{trajectory_id, trajectory->sensor_ids[i]};
+    const int sensor_index = i;
+    if (presorted) {
+      sensor_handles_by_key_[queue_key] = sensor_handles_.size();
+      sensor_handles_.push_back(SensorHandle{trajectory.get(), sensor_index});
+      continue;
+    }
+    Trajectory* const trajectory_ptr = trajectory.get();
+    const int queue_index = trajectory->queue.AddQueue(
+        queue_key,
+        [this, trajectory_ptr, sensor_index](std::unique_ptr<Data> data) {
+          HandleCollatedData(trajectory_ptr, sensor_index, std::move(data));
+        },
+        queue_capacity_);
+    sensor_handles_by_key_[queue_key] = sensor_handles_.size();
+    sensor_handles_.push_back(SensorHandle{trajectory.get(), queue_index});
   }
+  trajectories_[trajectory_id] = std::move(trajectory);
 }
 
 void Collator::FinishTrajectory(const int trajectory_id) {
-  for (const auto& queue_key : queue_keys_[trajectory_id]) {
-    queue_.MarkQueueAsFinished(queue_key);
+  Trajectory* const trajectory = GetTrajectory(trajectory_id);
+  if (!trajectory->presorted) {
+    for (const string& sensor_id : trajectory->sensor_ids) {
+      trajectory->queue.MarkQueueAsFinished(
+          QueueKey{trajectory_id, sensor_id});
+    }
+  }
+  {
+    common::MutexLocker locker(&mutex_);
+    trajectory->finished = true;
   }
+  WaitUntilDispatched(trajectory);
 }
 
 void Collator::AddSensorData(const int trajectory_id, const string& sensor_id,
                              std::unique_ptr<Data> data) {
-  queue_.Add(QueueKey{trajectory_id, sensor_id}, std::move(data));
+  Trajectory* trajectory;
+  {
+    common::MutexLocker locker(&mutex_);
+    const auto it = trajectories_.find(trajectory_id);
+    if (it == trajectories_.end()) {
+      LOG_EVERY_N(WARNING, 1000)
+          << "Ignored data for unknown trajectory " << trajectory_id << ".";
+      return;
+    }
+    trajectory = it->second.get();
+  }
+  if (trajectory->presorted) {
+    const auto it = std::find(trajectory->sensor_ids.begin(),
+                              trajectory->sensor_ids.end(), sensor_id);
+    if (it == trajectory->sensor_ids.end()) {
+      LOG_EVERY_N(WARNING, 1000) << "Ignored data for unexpected sensor '"
+                                 << sensor_id << "' of trajectory "
+                                 << trajectory_id << ".";
+      return;
+    }
+    HandleCollatedData(trajectory, it - trajectory->sensor_ids.begin(),
+                       std::move(data));
+    return;
+  }
+  trajectory->queue.Add(QueueKey{trajectory_id, sensor_id}, std::move(data));
+}
+
+int Collator::GetSensorHandle(const int trajectory_id,
+                              const string& sensor_id) const {
+  common::MutexLocker locker(&mutex_);
+  const auto it =
+      sensor_handles_by_key_.find(QueueKey{trajectory_id, sensor_id});
+  CHECK(it != sensor_handles_by_key_.end())
+      << "Unknown sensor '" << sensor_id << "' of trajectory " << trajectory_id
+      << ".";
+  return it->second;
+}
+
+void Collator::AddSensorData(const int sensor_handle,
+                             std::unique_ptr<Data> data) {
+  SensorHandle handle;
+  {
+    common::MutexLocker locker(&mutex_);
+    handle = sensor_handles_.at(sensor_handle);
+  }
+  if (handle.trajectory->presorted) {
+    HandleCollatedData(handle.trajectory, handle.queue_index,
+                       std::move(data));
+    return;
+  }
+  handle.trajectory->queue.Add(handle.queue_index, std::move(data));
 }
 
-void Collator::Flush() { queue_.Flush(); }
+void Collator::Flush() {
+  std::vector<Trajectory*> trajectories;
+  {
+    common::MutexLocker locker(&mutex_);
+    for (auto& entry : trajectories_) {
+      trajectories.push_back(entry.second.get());
+    }
+  }
+  for (Trajectory* const trajectory : trajectories) {
+    trajectory->queue.Flush();
+  }
+  WaitUntilDispatched();
+}
+
+void Collator::WaitUntilDispatched() {
+  std::vector<Trajectory*> trajectories;
+  {
+    common::MutexLocker locker(&mutex_);
+    for (auto& entry : trajectories_) {
+      trajectories.push_back(entry.second.get());
+    }
+  }
+  for (Trajectory* const trajectory : trajectories) {
+    WaitUntilDispatched(trajectory);
+  }
+}
+
+void Collator::WaitUntilDispatched(Trajectory* const trajectory) {
+  common::MutexLocker locker(&trajectory->mutex);
+  locker.Await([trajectory]() REQUIRES(trajectory->mutex) {
+    return !trajectory->dispatch_scheduled;
+  });
+}
 
 int Collator::GetBlockingTrajectoryId() const {
-  return queue_.GetBlocker().trajectory_id;
+  common::MutexLocker locker(&mutex_);
+  int blocking_trajectory_id = -1;
+  common::Time blocking_time = common::Time::max();
+  for (const auto& entry : trajectories_) {
+    Trajectory* const trajectory = entry.second.get();
+    if (trajectory->finished) {
+      continue;
+    }
+    common::MutexLocker trajectory_locker(&trajectory->mutex);
+    if (blocking_trajectory_id == -1 ||
+        trajectory->last_dispatched_time < blocking_time) {
+      blocking_trajectory_id = entry.first;
+      blocking_time = trajectory->last_dispatched_time;
+    }
+  }
+  CHECK_NE(blocking_trajectory_id, -1);
+  return blocking_trajectory_id;
+}
+
+std::map<QueueKey, QueueStatistics> Collator::GetQueueStatistics() const {
+  common::MutexLocker locker(&mutex_);
+  std::map<QueueKey, QueueStatistics> statistics;
+  for (const auto& entry : trajectories_) {
+    const auto trajectory_statistics =
+        entry.second->queue.GetQueueStatistics();
+    statistics.insert(trajectory_statistics.begin(),
+                      trajectory_statistics.end());
+  }
+  return statistics;
+}
+
+int64 Collator::GetMemoryUsageInBytes() const {
+  common::MutexLocker locker(&mutex_);
+  int64 memory_usage_in_bytes = 0;
+  for (const auto& entry : trajectories_) {
+    Trajectory* const trajectory = entry.second.get();
+    memory_usage_in_bytes += trajectory->queue.GetMemoryUsageInBytes();
+    common::MutexLocker trajectory_locker(&trajectory->mutex);
+    for (const auto& pending_data : trajectory->pending_data) {
+      memory_usage_in_bytes += pending_data.second->GetMemoryUsageInBytes();
+    }
+  }
+  return memory_usage_in_bytes;
+}
+
+void Collator::HandleCollatedData(Trajectory* const trajectory,
+                                  const int sensor_index,
+                                  std::unique_ptr<Data> data) {
+  CARTOGRAPHER_TRACE_SPAN("Collator::HandleCollatedData");
+  {
+    common::MutexLocker locker(&trajectory->mutex);
+    // The queue guarantees the order, presorted data is only checked.
+    CHECK(!trajectory->presorted ||
+          trajectory->last_dispatched_time <= data->GetTime())
+        << "Data of sensor '" << trajectory->sensor_ids[sensor_index]
+        << "' at " << data->GetTime() << " is older than data at "
+        << trajectory->last_dispatched_time << " added before.";
+    trajectory->last_dispatched_time = data->GetTime();
+    if (dispatch_thread_pool_ != nullptr) {
+      trajectory->pending_data.emplace_back(sensor_index, std::move(data));
+      if (!trajectory->dispatch_scheduled) {
+        trajectory->dispatch_scheduled = true;
+        const std::shared_ptr<Trajectory> shared_trajectory =
+            trajectory->shared_from_this();
+        dispatch_thread_pool_->Schedule(
+            [shared_trajectory]() {
+              DispatchPendingData(shared_trajectory.get());
+            },
+            common::WorkItemPriority::kHigh, "collator_dispatch");
+      }
+      return;
+    }
+  }
+  trajectory->callback(trajectory->sensor_ids[sensor_index], std::move(data));
+}
+
+void Collator::DispatchPendingData(Trajectory* const trajectory) {
+  CARTOGRAPHER_TRACE_SPAN("Collator::DispatchPendingData");
+  for (;;) {
+    std::pair<int, std::unique_ptr<Data>> pending;
+    {
+      common::MutexLocker locker(&trajectory->mutex);
+      if (trajectory->pending_data.empty()) {
+        trajectory->dispatch_scheduled = false;
+        return;
+      }
+      pending = std::move(trajectory->pending_data.front());
+      trajectory->pending_data.pop_front();
+    }
+    trajectory->callback(trajectory->sensor_ids[pending.first],
+                         std::move(pending.second));
+  }
+}
+
+Collator::Trajectory* Collator::GetTrajectory(const int trajectory_id) const {
+  common::MutexLocker locker(&mutex_);
+  const auto it = trajectories_.find(trajectory_id);
+  CHECK(it != trajectories_.end()) << "Unknown trajectory " << trajectory_id;
+  return it->second.get();
 }
 
 }  // namespace sensor
@@ -17,23 +17,47 @@
 #ifndef CARTOGRAPHER_SENSOR_COLLATOR_H_
 #define CARTOGRAPHER_SENSOR_COLLATOR_H_
 
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
-#include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
 #include "cartographer/sensor/data.h"
 #include "cartographer/sensor/ordered_multi_queue.h"
 
 namespace cartographer {
 namespace sensor {
 
+// Collates the sensor data of each trajectory into time order. Trajectories
+// are independent of each other: data of one trajectory never waits for data
+// of another.
+//
+// This class is thread-safe.
 class Collator {
  public:
   using Callback = std::function<void(const string&, std::unique_ptr<Data>)>;
 
-  Collator() {}
+  Collator() : Collator(QueueCapacity()) {}
+
+  // The queue of each sensor is limited by 'queue_capacity'.
+  explicit Collator(const QueueCapacity& queue_capacity)
+      : Collator(queue_capacity, nullptr /* dispatch_thread_pool */) {}
+
+  // Same as above, but if 'dispatch_thread_pool' is not nullptr, callbacks are
+  // called on it instead of in the thread adding the data. The callbacks of
+  // one trajectory are called one at a time and in order, while different
+  // trajectories are dispatched concurrently.
+  Collator(const QueueCapacity& queue_capacity,
+           common::ThreadPoolInterface* dispatch_thread_pool);
+
+  ~Collator();
 
   Collator(const Collator&) = delete;
   Collator& operator=(const Collator&) = delete;
@@ -44,7 +68,16 @@ class Collator {
                      const std::unordered_set<string>& expected_sensor_ids,
                      const Callback& callback);
 
-  // Marks 'trajectory_id' as finished.
+  // Same as AddTrajectory(), but the data of all sensors of 'trajectory_id'
+  // has to be added in time order, e.g. when mapping offline from a recording
+  // merged beforehand. Instead of being queued until every sensor has data, it
+  // is passed on right away.
+  void AddPresortedTrajectory(
+      int trajectory_id, const std::unordered_set<string>& expected_sensor_ids,
+      const Callback& callback);
+
+  // Marks 'trajectory_id' as finished. Returns once all its data has been
+  // passed to its callback.
   void FinishTrajectory(int trajectory_id);
 
   // Adds 'data' for 'trajectory_id' to be collated. 'data' must contain valid
@@ -53,21 +86,83 @@ class Collator {
   void AddSensorData(int trajectory_id, const string& sensor_id,
                      std::unique_ptr<Data> data);
 
+  // Returns a handle for the sensor 'sensor_id' of 'trajectory_id', which has
+  // to be one of its expected sensors.
+  int GetSensorHandle(int trajectory_id, const string& sensor_id) const;
+
+  // Same as AddSensorData() above for the sensor with 'sensor_handle', but
+  // without looking up the sensor ID.
+  void AddSensorData(int sensor_handle, std::unique_ptr<Data> data);
+
   // Dispatches all queued sensor packets. May only be called once.
   // AddSensorData may not be called after Flush.
   void Flush();
 
+  // Blocks until all sensor data collated so far has been passed to the
+  // callbacks. Returns immediately if there is no 'dispatch_thread_pool'.
+  void WaitUntilDispatched();
+
   // Must only be called if at least one unfinished trajectory exists. Returns
-  // the ID of the trajectory that needs more data before the Collator is
-  // unblocked.
+  // the ID of the unfinished trajectory with the least recent dispatched data,
+  // which needs more data the most.
   int GetBlockingTrajectoryId() const;
 
- private:
-  // Queue keys are a pair of trajectory ID and sensor identifier.
-  OrderedMultiQueue queue_;
+  // Returns the depth and blocked time of the queue of each sensor.
+  std::map<QueueKey, QueueStatistics> GetQueueStatistics() const;
+
+  // Returns the number of bytes used by the sensor data which is queued or
+  // waiting for dispatch.
+  int64 GetMemoryUsageInBytes() const;
 
-  // Map of trajectory ID to all associated QueueKeys.
-  std::unordered_map<int, std::vector<QueueKey>> queue_keys_;
+ private:
+  // Shared with scheduled dispatches, which may still release 'mutex' after
+  // 'WaitUntilDispatched()' returned.
+  struct Trajectory : std::enable_shared_from_this<Trajectory> {
+    std::vector<string> sensor_ids;
+    Callback callback;
+    bool finished = false;
+    // Whether the data bypasses the 'queue', see AddPresortedTrajectory().
+    bool presorted = false;
+    // Queue keys are a pair of trajectory ID and sensor identifier.
+    OrderedMultiQueue queue;
+
+    common::Mutex mutex;
+    common::Time last_dispatched_time GUARDED_BY(mutex) = common::Time::min();
+    // Collated data of the sensors with the given index into 'sensor_ids'
+    // waiting for 'DispatchPendingData()'. Only used with a thread pool.
+    std::deque<std::pair<int, std::unique_ptr<Data>>> pending_data
+        GUARDED_BY(mutex);
+    bool dispatch_scheduled GUARDED_BY(mutex) = false;
+  };
+
+  struct SensorHandle {
+    Trajectory* trajectory;
+    // Index into the 'sensor_ids' of presorted trajectories.
+    int queue_index;
+  };
+
+  // Adds a trajectory, which is presorted if 'presorted' is true.
+  void AddTrajectory(int trajectory_id,
+                     const std::unordered_set<string>& expected_sensor_ids,
+                     const Callback& callback, bool presorted);
+
+  // Called by the 'queue' of 'trajectory' in time order.
+  void HandleCollatedData(Trajectory* trajectory, int sensor_index,
+                          std::unique_ptr<Data> data);
+  // Passes the 'pending_data' of 'trajectory' to its callback until none is
+  // left. Runs on the 'dispatch_thread_pool_'.
+  static void DispatchPendingData(Trajectory* trajectory);
+  void WaitUntilDispatched(Trajectory* trajectory);
+  Trajectory* GetTrajectory(int trajectory_id) const EXCLUDES(mutex_);
+
+  const QueueCapacity queue_capacity_;
+  common::ThreadPoolInterface* const dispatch_thread_pool_;
+
+  mutable common::Mutex mutex_;
+  std::map<int, std::shared_ptr<Trajectory>> trajectories_ GUARDED_BY(mutex_);
+  // Indexed by sensor handle.
+  std::vector<SensorHandle> sensor_handles_ GUARDED_BY(mutex_);
+  std::map<QueueKey, int> sensor_handles_by_key_ GUARDED_BY(mutex_);
 };
 
 }  // namespace sensor
@@ -21,6 +21,8 @@
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/common/time.h"
 #include "cartographer/sensor/proto/sensor.pb.h"
 #include "gtest/gtest.h"
@@ -103,6 +105,123 @@ TEST(Collator, Ordering) {
   EXPECT_EQ(kSensorId[3], received[9].first);
 }
 
+TEST(Collator, SensorHandles) {
+  const std::array<string, 2> kSensorId = {{"imu", "odometry"}};
+  constexpr int kTrajectoryId = 0;
+  std::vector<std::pair<string, common::Time>> received;
+  Collator collator;
+  collator.AddTrajectory(
+      kTrajectoryId,
+      std::unordered_set<string>(kSensorId.begin(), kSensorId.end()),
+      [&received](const string& sensor_id, std::unique_ptr<Data> data) {
+        received.push_back(std::make_pair(sensor_id, data->GetTime()));
+      });
+  const int imu_handle = collator.GetSensorHandle(kTrajectoryId, kSensorId[0]);
+  const int odometry_handle =
+      collator.GetSensorHandle(kTrajectoryId, kSensorId[1]);
+  EXPECT_NE(imu_handle, odometry_handle);
+
+  for (int i = 0; i != 3; ++i) {
+    collator.AddSensorData(
+        imu_handle, MakeDispatchable(ImuData{common::FromUniversal(2 * i)}));
+    collator.AddSensorData(
+        odometry_handle,
+        MakeDispatchable(OdometryData{common::FromUniversal(2 * i + 1),
+                                      transform::Rigid3d::Identity()}));
+  }
+  collator.Flush();
+
+  ASSERT_EQ(6, received.size());
+  for (int i = 0; i != 6; ++i) {
+    EXPECT_EQ(i, common::ToUniversal(received[i].second));
+    EXPECT_EQ(kSensorId[i % 2], received[i].first);
+  }
+}
+
+TEST(Collator, PresortedTrajectory) {
+  const std::array<string, 2> kSensorId = {{"imu", "odometry"}};
+  constexpr int kTrajectoryId = 0;
+  std::vector<std::pair<string, common::Time>> received;
+  Collator collator;
+  collator.AddPresortedTrajectory(
+      kTrajectoryId,
+      std::unordered_set<string>(kSensorId.begin(), kSensorId.end()),
+      [&received](const string& sensor_id, std::unique_ptr<Data> data) {
+        received.push_back(std::make_pair(sensor_id, data->GetTime()));
+      });
+  const int imu_handle = collator.GetSensorHandle(kTrajectoryId, kSensorId[0]);
+
+  // Data is passed on right away, even though odometry has not been seen yet.
+  collator.AddSensorData(imu_handle,
+                         MakeDispatchable(ImuData{common::FromUniversal(0)}));
+  ASSERT_EQ(1, received.size());
+  EXPECT_EQ(kSensorId[0], received[0].first);
+  collator.AddSensorData(
+      kTrajectoryId, kSensorId[1],
+      MakeDispatchable(OdometryData{common::FromUniversal(1),
+                                    transform::Rigid3d::Identity()}));
+  ASSERT_EQ(2, received.size());
+  EXPECT_EQ(kSensorId[1], received[1].first);
+  EXPECT_EQ(1, common::ToUniversal(received[1].second));
+  collator.AddSensorData(kTrajectoryId, "unexpected",
+                         MakeDispatchable(ImuData{common::FromUniversal(2)}));
+  EXPECT_EQ(2, received.size());
+
+  EXPECT_EQ(kTrajectoryId, collator.GetBlockingTrajectoryId());
+  collator.FinishTrajectory(kTrajectoryId);
+  collator.Flush();
+  EXPECT_EQ(2, received.size());
+}
+
+TEST(Collator, ConcurrentTrajectories) {
+  constexpr int kNumTrajectories = 4;
+  constexpr int kNumValues = 100;
+  const std::array<string, 2> kSensorId = {{"imu", "odometry"}};
+  common::ThreadPool thread_pool(2);
+  common::Mutex mutex;
+  std::vector<std::vector<common::Time>> received(kNumTrajectories);
+  Collator collator(QueueCapacity(), &thread_pool);
+  for (int trajectory_id = 0; trajectory_id != kNumTrajectories;
+       ++trajectory_id) {
+    collator.AddTrajectory(
+        trajectory_id,
+        std::unordered_set<string>(kSensorId.begin(), kSensorId.end()),
+        [&mutex, &received, trajectory_id](const string& sensor_id,
+                                           std::unique_ptr<Data> data) {
+          common::MutexLocker locker(&mutex);
+          received[trajectory_id].push_back(data->GetTime());
+        });
+  }
+  for (int i = 0; i != kNumValues; ++i) {
+    for (int trajectory_id = 0; trajectory_id != kNumTrajectories;
+         ++trajectory_id) {
+      collator.AddSensorData(
+          trajectory_id, kSensorId[0],
+          MakeDispatchable(ImuData{common::FromUniversal(2 * i)}));
+      collator.AddSensorData(
+          trajectory_id, kSensorId[1],
+          MakeDispatchable(OdometryData{common::FromUniversal(2 * i + 1),
+                                        transform::Rigid3d::Identity()}));
+    }
+  }
+  collator.FinishTrajectory(0);
+  {
+    common::MutexLocker locker(&mutex);
+    EXPECT_EQ(2 * kNumValues, received[0].size());
+  }
+  EXPECT_NE(0, collator.GetBlockingTrajectoryId());
+  collator.Flush();
+
+  common::MutexLocker locker(&mutex);
+  for (int trajectory_id = 0; trajectory_id != kNumTrajectories;
+       ++trajectory_id) {
+    ASSERT_EQ(2 * kNumValues, received[trajectory_id].size());
+    for (int i = 0; i != 2 * kNumValues; ++i) {
+      EXPECT_EQ(i, common::ToUniversal(received[trajectory_id][i]));
+    }
+  }
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
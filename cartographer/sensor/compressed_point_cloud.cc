@@ -16,10 +16,11 @@
 
 #include "cartographer/sensor/compressed_point_cloud.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "cartographer/common/math.h"
-#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/common/radix_sort.h"
 
 namespace cartographer {
 namespace sensor {
@@ -35,6 +36,27 @@ constexpr int kBitsPerCoordinate = 10;
 constexpr int kCoordinateMask = (1 << kBitsPerCoordinate) - 1;
 constexpr int kMaxBitsPerDirection = 23;
 
+// Decodes the 'num_points' points of a block, following its header at
+// 'input', to 'output'. The loop has no branches so that it can be
+// vectorized.
+void DecodeBlock(const int32* const input, const int num_points,
+                 Eigen::Vector3f* const output) {
+  const Eigen::Array3i block_coordinates(input[0] << kBitsPerCoordinate,
+                                         input[1] << kBitsPerCoordinate,
+                                         input[2] << kBitsPerCoordinate);
+  const int32* const points = input + 3;
+  for (int i = 0; i < num_points; ++i) {
+    const int32 point = points[i];
+    output[i] = Eigen::Vector3f(
+        (block_coordinates[0] + (point & kCoordinateMask)) * kPrecision,
+        (block_coordinates[1] +
+         ((point >> kBitsPerCoordinate) & kCoordinateMask)) *
+            kPrecision,
+        (block_coordinates[2] + (point >> (2 * kBitsPerCoordinate))) *
+            kPrecision);
+  }
+}
+
 }  // namespace
 
 CompressedPointCloud::ConstIterator::ConstIterator(
@@ -99,17 +121,16 @@ void CompressedPointCloud::ConstIterator::ReadNextPoint() {
 CompressedPointCloud::CompressedPointCloud(const PointCloud& point_cloud)
     : num_points_(point_cloud.size()) {
   // Distribute points into blocks.
-  struct RasterPoint {
-    Eigen::Array3i point;
-    int index;
-  };
-  using Blocks = mapping_3d::HybridGridBase<std::vector<RasterPoint>>;
-  Blocks blocks(kPrecision);
-  int num_blocks = 0;
+  std::vector<Eigen::Array3i> block_coordinates;
+  block_coordinates.reserve(point_cloud.size());
+  std::vector<int32> encoded_points;
+  encoded_points.reserve(point_cloud.size());
+  Eigen::Array3i min_block_coordinate =
+      Eigen::Array3i::Constant(std::numeric_limits<int>::max());
+  Eigen::Array3i max_block_coordinate =
+      Eigen::Array3i::Constant(std::numeric_limits<int>::min());
   CHECK_LE(point_cloud.size(), std::numeric_limits<int>::max());
-  for (int point_index = 0; point_index < static_cast<int>(point_cloud.size());
-       ++point_index) {
-    const Eigen::Vector3f& point = point_cloud[point_index];
+  for (const Eigen::Vector3f& point : point_cloud) {
     CHECK_LT(point.cwiseAbs().maxCoeff() / kPrecision,
              1 << kMaxBitsPerDirection)
         << "Point out of bounds: " << point;
@@ -120,29 +141,69 @@ CompressedPointCloud::CompressedPointCloud(const PointCloud& point_cloud)
       block_coordinate[i] = raster_point[i] >> kBitsPerCoordinate;
       raster_point[i] &= kCoordinateMask;
     }
-    auto* const block = blocks.mutable_value(block_coordinate);
-    num_blocks += block->empty();
-    block->push_back({raster_point, point_index});
+    block_coordinates.push_back(block_coordinate);
+    min_block_coordinate = min_block_coordinate.min(block_coordinate);
+    max_block_coordinate = max_block_coordinate.max(block_coordinate);
+    encoded_points.push_back(
+        (((raster_point.z() << kBitsPerCoordinate) + raster_point.y())
+         << kBitsPerCoordinate) +
+        raster_point.x());
+  }
+
+  // Sort the points by block. The sort is stable, so points within a block
+  // keep their order.
+  int bits[3];
+  for (int i = 0; i < 3; ++i) {
+    bits[i] = 0;
+    while ((max_block_coordinate[i] - min_block_coordinate[i]) >> bits[i]) {
+      ++bits[i];
+    }
   }
+  struct BlockKeyAndPoint {
+    uint64 block_key;
+    int32 encoded_point;
+  };
+  std::vector<BlockKeyAndPoint> entries;
+  entries.reserve(point_cloud.size());
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    const Eigen::Array3i offset = block_coordinates[i] - min_block_coordinate;
+    entries.push_back(BlockKeyAndPoint{
+        (static_cast<uint64>(offset.z()) << (bits[0] + bits[1])) |
+            (static_cast<uint64>(offset.y()) << bits[0]) |
+            static_cast<uint64>(offset.x()),
+        encoded_points[i]});
+  }
+  std::vector<BlockKeyAndPoint> scratch;
+  common::RadixSort(
+      0, bits[0] + bits[1] + bits[2],
+      [](const BlockKeyAndPoint& entry) { return entry.block_key; }, &entries,
+      &scratch);
 
   // Encode blocks.
+  int num_blocks = 0;
+  for (size_t i = 0; i != entries.size(); ++i) {
+    num_blocks += i == 0 || entries[i - 1].block_key != entries[i].block_key;
+  }
   point_data_.reserve(4 * num_blocks + point_cloud.size());
-  for (Blocks::Iterator it(blocks); !it.Done(); it.Next(), --num_blocks) {
-    const auto& raster_points = it.GetValue();
-    CHECK_LE(raster_points.size(), std::numeric_limits<int32>::max());
-    point_data_.push_back(raster_points.size());
-    const Eigen::Array3i block_coordinate = it.GetCellIndex();
-    point_data_.push_back(block_coordinate.x());
-    point_data_.push_back(block_coordinate.y());
-    point_data_.push_back(block_coordinate.z());
-    for (const RasterPoint& raster_point : raster_points) {
-      point_data_.push_back((((raster_point.point.z() << kBitsPerCoordinate) +
-                              raster_point.point.y())
-                             << kBitsPerCoordinate) +
-                            raster_point.point.x());
+  for (size_t begin = 0; begin != entries.size();) {
+    const uint64 block_key = entries[begin].block_key;
+    size_t end = begin + 1;
+    while (end != entries.size() && entries[end].block_key == block_key) {
+      ++end;
     }
+    point_data_.push_back(end - begin);
+    point_data_.push_back(min_block_coordinate.x() +
+                          (block_key & ((uint64{1} << bits[0]) - 1)));
+    point_data_.push_back(
+        min_block_coordinate.y() +
+        ((block_key >> bits[0]) & ((uint64{1} << bits[1]) - 1)));
+    point_data_.push_back(min_block_coordinate.z() +
+                          (block_key >> (bits[0] + bits[1])));
+    for (size_t i = begin; i != end; ++i) {
+      point_data_.push_back(entries[i].encoded_point);
+    }
+    begin = end;
   }
-  CHECK_EQ(num_blocks, 0);
 }
 
 CompressedPointCloud::CompressedPointCloud(
@@ -169,13 +230,34 @@ CompressedPointCloud::ConstIterator CompressedPointCloud::end() const {
 }
 
 PointCloud CompressedPointCloud::Decompress() const {
-  PointCloud decompressed;
-  for (const Eigen::Vector3f& point : *this) {
-    decompressed.push_back(point);
+  PointCloud decompressed(num_points_);
+  size_t num_decompressed = 0;
+  for (size_t offset = 0; offset != point_data_.size();) {
+    const int num_points_in_block = point_data_[offset];
+    CHECK_LE(num_decompressed + num_points_in_block, num_points_);
+    DecodeBlock(&point_data_[offset + 1], num_points_in_block,
+                &decompressed[num_decompressed]);
+    num_decompressed += num_points_in_block;
+    offset += 4 + num_points_in_block;
   }
+  CHECK_EQ(num_decompressed, num_points_);
   return decompressed;
 }
 
+void CompressedPointCloud::ForEachBlock(
+    const std::function<void(const PointCloud& block_points)>& callback)
+    const {
+  PointCloud block_points;
+  for (size_t offset = 0; offset != point_data_.size();) {
+    const int num_points_in_block = point_data_[offset];
+    block_points.resize(num_points_in_block);
+    DecodeBlock(&point_data_[offset + 1], num_points_in_block,
+                block_points.data());
+    callback(block_points);
+    offset += 4 + num_points_in_block;
+  }
+}
+
 bool sensor::CompressedPointCloud::operator==(
     const sensor::CompressedPointCloud& right_hand_container) const {
   return point_data_ == right_hand_container.point_data_ &&
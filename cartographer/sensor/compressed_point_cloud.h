@@ -17,6 +17,7 @@
 #ifndef CARTOGRAPHER_SENSOR_COMPRESSED_POINT_CLOUD_H_
 #define CARTOGRAPHER_SENSOR_COMPRESSED_POINT_CLOUD_H_
 
+#include <functional>
 #include <iterator>
 #include <vector>
 
@@ -44,6 +45,14 @@ class CompressedPointCloud {
   // Returns decompressed point cloud.
   PointCloud Decompress() const;
 
+  // Calls 'callback' with the decompressed points of each block in turn, so
+  // that points can be processed without decompressing the whole point cloud.
+  // The points are decoded into a buffer which is reused for the next block.
+  // Points are visited in the same order as by iterating.
+  void ForEachBlock(
+      const std::function<void(const PointCloud& block_points)>& callback)
+      const;
+
   bool empty() const;
   size_t size() const;
   ConstIterator begin() const;
@@ -52,6 +61,11 @@ class CompressedPointCloud {
   bool operator==(const CompressedPointCloud& right_hand_container) const;
   proto::CompressedPointCloud ToProto() const;
 
+  // Returns the number of bytes used.
+  int64 GetMemoryUsageInBytes() const {
+    return sizeof(*this) + point_data_.capacity() * sizeof(int32);
+  }
+
  private:
   std::vector<int32> point_data_;
   size_t num_points_;
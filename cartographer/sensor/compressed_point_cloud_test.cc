@@ -16,6 +16,8 @@
 
 #include "cartographer/sensor/compressed_point_cloud.h"
 
+#include <cmath>
+
 #include "gmock/gmock.h"
 
 namespace Eigen {
@@ -116,6 +118,33 @@ TEST(CompressPointCloudTest, CompressesNoGaps) {
   }
 }
 
+TEST(CompressPointCloudTest, DecompressesBlockwise) {
+  PointCloud point_cloud;
+  for (int i = 0; i < 300; ++i) {
+    point_cloud.push_back(
+        Eigen::Vector3f(0.01f * i - 1.5f, std::sin(0.01f * i), -0.002f * i));
+  }
+  const CompressedPointCloud compressed(point_cloud);
+  const PointCloud decompressed = compressed.Decompress();
+  PointCloud iterated;
+  for (const Eigen::Vector3f& point : compressed) {
+    iterated.push_back(point);
+  }
+  PointCloud blockwise;
+  int num_blocks = 0;
+  compressed.ForEachBlock([&blockwise, &num_blocks](const PointCloud& block) {
+    blockwise.insert(blockwise.end(), block.begin(), block.end());
+    ++num_blocks;
+  });
+  EXPECT_GT(num_blocks, 1);
+  EXPECT_EQ(iterated, decompressed);
+  EXPECT_EQ(iterated, blockwise);
+  ASSERT_EQ(point_cloud.size(), decompressed.size());
+  for (const Eigen::Vector3f& point : point_cloud) {
+    EXPECT_THAT(decompressed, Contains(ApproximatelyEquals(point)));
+  }
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -17,11 +17,17 @@
 #ifndef CARTOGRAPHER_MAPPING_DATA_H_
 #define CARTOGRAPHER_MAPPING_DATA_H_
 
+#include <utility>
+
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/pool_allocated.h"
+#include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/global_trajectory_builder_interface.h"
+#include "cartographer/sensor/borrowed_point_cloud.h"
 #include "cartographer/sensor/fixed_frame_pose_data.h"
 #include "cartographer/sensor/imu_data.h"
+#include "cartographer/sensor/odometry_data.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/range_data.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -34,18 +40,26 @@ class Data {
   virtual ~Data() {}
 
   virtual common::Time GetTime() const = 0;
+  // Returns the number of bytes used by this value.
+  virtual int64 GetMemoryUsageInBytes() const = 0;
   virtual void AddToTrajectoryBuilder(
       mapping::GlobalTrajectoryBuilderInterface* trajectory_builder) = 0;
+  // Called before collating. Only IMU and odometry data is passed on, see
+  // GlobalTrajectoryBuilderInterface::AddUncollatedSensorData().
+  virtual void AddUncollatedToTrajectoryBuilder(
+      mapping::GlobalTrajectoryBuilderInterface* trajectory_builder) const {}
 };
 
 class DispatchableRangefinderData : public Data {
  public:
   DispatchableRangefinderData(const common::Time time,
-                              const Eigen::Vector3f& origin,
-                              const PointCloud& ranges)
-      : time_(time), origin_(origin), ranges_(ranges) {}
+                              const Eigen::Vector3f& origin, PointCloud ranges)
+      : time_(time), origin_(origin), ranges_(std::move(ranges)) {}
 
   common::Time GetTime() const override { return time_; }
+  int64 GetMemoryUsageInBytes() const override {
+    return sizeof(*this) + ranges_.capacity() * sizeof(Eigen::Vector3f);
+  }
   void AddToTrajectoryBuilder(mapping::GlobalTrajectoryBuilderInterface* const
                                   trajectory_builder) override {
     trajectory_builder->AddRangefinderData(time_, origin_, ranges_);
@@ -57,21 +71,70 @@ class DispatchableRangefinderData : public Data {
   const PointCloud ranges_;
 };
 
+// Like DispatchableRangefinderData, but the points stay in the buffer of the
+// caller, which is released when this is destroyed after dispatching.
+class DispatchableBorrowedRangefinderData : public Data {
+ public:
+  DispatchableBorrowedRangefinderData(const common::Time time,
+                                      const Eigen::Vector3f& origin,
+                                      BorrowedPointCloud ranges)
+      : time_(time), origin_(origin), ranges_(std::move(ranges)) {}
+
+  common::Time GetTime() const override { return time_; }
+  // Includes the borrowed buffer, which is held until dispatching.
+  int64 GetMemoryUsageInBytes() const override {
+    return sizeof(*this) + ranges_.size() * sizeof(Eigen::Vector3f);
+  }
+  void AddToTrajectoryBuilder(mapping::GlobalTrajectoryBuilderInterface* const
+                                  trajectory_builder) override {
+    trajectory_builder->AddRangefinderData(time_, origin_, ranges_.view());
+  }
+
+ private:
+  const common::Time time_;
+  const Eigen::Vector3f origin_;
+  const BorrowedPointCloud ranges_;
+};
+
+// Small sensor data like IMU data arrives at high rates, so the memory of
+// dispatched values is reused.
 template <typename DataType>
-class Dispatchable : public Data {
+class Dispatchable : public Data,
+                     public common::PoolAllocated<Dispatchable<DataType>> {
  public:
   Dispatchable(const DataType& data) : data_(data) {}
 
   common::Time GetTime() const override { return data_.time; }
+  int64 GetMemoryUsageInBytes() const override { return sizeof(*this); }
   void AddToTrajectoryBuilder(mapping::GlobalTrajectoryBuilderInterface* const
                                   trajectory_builder) override {
     trajectory_builder->AddSensorData(data_);
   }
+  void AddUncollatedToTrajectoryBuilder(
+      mapping::GlobalTrajectoryBuilderInterface* trajectory_builder)
+      const override;
 
  private:
   const DataType data_;
 };
 
+template <typename DataType>
+void Dispatchable<DataType>::AddUncollatedToTrajectoryBuilder(
+    mapping::GlobalTrajectoryBuilderInterface* const trajectory_builder) const {
+}
+
+template <>
+inline void Dispatchable<ImuData>::AddUncollatedToTrajectoryBuilder(
+    mapping::GlobalTrajectoryBuilderInterface* const trajectory_builder) const {
+  trajectory_builder->AddUncollatedSensorData(data_);
+}
+
+template <>
+inline void Dispatchable<OdometryData>::AddUncollatedToTrajectoryBuilder(
+    mapping::GlobalTrajectoryBuilderInterface* const trajectory_builder) const {
+  trajectory_builder->AddUncollatedSensorData(data_);
+}
+
 template <typename DataType>
 std::unique_ptr<Dispatchable<DataType>> MakeDispatchable(const DataType& data) {
   return common::make_unique<Dispatchable<DataType>>(data);
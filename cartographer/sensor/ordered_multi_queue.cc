@@ -17,6 +17,7 @@
 #include "cartographer/sensor/ordered_multi_queue.h"
 
 #include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <vector>
 
@@ -38,109 +39,272 @@ inline std::ostream& operator<<(std::ostream& out, const QueueKey& key) {
   return out << '(' << key.trajectory_id << ", " << key.sensor_id << ')';
 }
 
+void OrderedMultiQueue::Queue::Push(std::unique_ptr<Data> data) {
+  data_memory_usage_in_bytes += data->GetMemoryUsageInBytes();
+  values.push_back(std::move(data));
+}
+
+std::unique_ptr<Data> OrderedMultiQueue::Queue::Pop() {
+  CHECK(!values.empty());
+  std::unique_ptr<Data> data = std::move(values.front());
+  values.pop_front();
+  data_memory_usage_in_bytes -= data->GetMemoryUsageInBytes();
+  return data;
+}
+
 OrderedMultiQueue::OrderedMultiQueue() {}
 
 OrderedMultiQueue::~OrderedMultiQueue() {
-  for (auto& entry : queues_) {
-    CHECK(entry.second.finished);
+  for (const int queue_index : sorted_queue_indices_) {
+    CHECK(queues_[queue_index]->finished);
   }
 }
 
-void OrderedMultiQueue::AddQueue(const QueueKey& queue_key, Callback callback) {
-  CHECK_EQ(queues_.count(queue_key), 0);
-  queues_[queue_key].callback = std::move(callback);
+int OrderedMultiQueue::AddQueue(const QueueKey& queue_key, Callback callback) {
+  return AddQueue(queue_key, std::move(callback), QueueCapacity());
+}
+
+int OrderedMultiQueue::AddQueue(const QueueKey& queue_key, Callback callback,
+                                const QueueCapacity& capacity) {
+  CHECK(capacity.max_size == 0 || capacity.max_size >= 2);
+  common::MutexLocker locker(&mutex_);
+  CHECK_EQ(queue_indices_.count(queue_key), 0);
+  const int queue_index = queues_.size();
+  queues_.push_back(common::make_unique<Queue>());
+  Queue& queue = *queues_.back();
+  queue.key = queue_key;
+  queue.callback = std::move(callback);
+  queue.capacity = capacity;
+  queue_indices_[queue_key] = queue_index;
+  const auto position = std::upper_bound(
+      sorted_queue_indices_.begin(), sorted_queue_indices_.end(), queue_key,
+      [this](const QueueKey& lhs, const int rhs) REQUIRES(mutex_) {
+        return lhs < queues_[rhs]->key;
+      });
+  sorted_queue_indices_.insert(position, queue_index);
+  return queue_index;
 }
 
 void OrderedMultiQueue::MarkQueueAsFinished(const QueueKey& queue_key) {
-  auto it = queues_.find(queue_key);
-  CHECK(it != queues_.end()) << "Did not find '" << queue_key << "'.";
-  auto& queue = it->second;
-  CHECK(!queue.finished);
-  queue.finished = true;
+  common::MutexLocker locker(&mutex_);
+  if (timed_out_queues_.count(queue_key) != 0) {
+    return;
+  }
+  auto it = queue_indices_.find(queue_key);
+  CHECK(it != queue_indices_.end()) << "Did not find '" << queue_key << "'.";
+  MarkQueueAsFinishedLocked(it->second);
+}
+
+void OrderedMultiQueue::MarkQueueAsFinishedLocked(const int queue_index) {
+  Queue* const queue = GetQueue(queue_index);
+  CHECK(queue != nullptr);
+  CHECK(!queue->finished);
+  queue->finished = true;
   Dispatch();
 }
 
 void OrderedMultiQueue::Add(const QueueKey& queue_key,
                             std::unique_ptr<Data> data) {
-  auto it = queues_.find(queue_key);
-  if (it == queues_.end()) {
+  common::MutexLocker locker(&mutex_);
+  auto it = queue_indices_.find(queue_key);
+  if (it == queue_indices_.end()) {
     LOG_EVERY_N(WARNING, 1000)
         << "Ignored data for queue: '" << queue_key << "'";
     return;
   }
-  it->second.queue.Push(std::move(data));
+  AddLocked(it->second, std::move(data), &locker);
+}
+
+void OrderedMultiQueue::Add(const int queue_index, std::unique_ptr<Data> data) {
+  common::MutexLocker locker(&mutex_);
+  AddLocked(queue_index, std::move(data), &locker);
+}
+
+OrderedMultiQueue::Queue* OrderedMultiQueue::GetQueue(const int queue_index) {
+  CHECK_GE(queue_index, 0);
+  CHECK_LT(queue_index, static_cast<int>(queues_.size()));
+  return queues_[queue_index].get();
+}
+
+void OrderedMultiQueue::AddLocked(const int queue_index,
+                                  std::unique_ptr<Data> data,
+                                  common::MutexLocker* const locker) {
+  Queue* queue = GetQueue(queue_index);
+  if (queue == nullptr || queue->finished) {
+    LOG_EVERY_N(WARNING, 1000)
+        << "Ignored data for queue with index " << queue_index << ".";
+    return;
+  }
+  if (!HasRoom(queue_index)) {
+    if (!MakeRoom(queue_index, locker)) {
+      LOG_EVERY_N(WARNING, 1000)
+          << "Ignored data for queue with index " << queue_index << ".";
+      return;
+    }
+    queue = GetQueue(queue_index);
+  }
+  queue->Push(std::move(data));
+  queue->statistics.max_size =
+      std::max(queue->statistics.max_size, queue->Size());
   Dispatch();
 }
 
+bool OrderedMultiQueue::HasRoom(const int queue_index) {
+  Queue* const queue = GetQueue(queue_index);
+  return queue == nullptr || queue->capacity.max_size == 0 ||
+         queue->Size() < queue->capacity.max_size;
+}
+
+bool OrderedMultiQueue::MakeRoom(const int queue_index,
+                                 common::MutexLocker* const locker) {
+  const QueueCapacity capacity = GetQueue(queue_index)->capacity;
+  const auto has_room = [this, queue_index]() REQUIRES(mutex_) {
+    return HasRoom(queue_index);
+  };
+  const auto start_time = std::chrono::steady_clock::now();
+  switch (capacity.overflow_policy) {
+    case QueueOverflowPolicy::kDropOldest: {
+      Queue* const queue = GetQueue(queue_index);
+      while (!HasRoom(queue_index)) {
+        queue->Pop();
+        ++queue->statistics.num_dropped;
+      }
+      LOG_EVERY_N(WARNING, 1000)
+          << "Dropping data of full queue '" << queue->key
+          << "', waiting for data: " << blocker_;
+      return true;
+    }
+    case QueueOverflowPolicy::kBlockProducer:
+      locker->Await(has_room);
+      break;
+    case QueueOverflowPolicy::kFinishBlockerAfterTimeout:
+      while (!locker->AwaitWithTimeout(has_room, capacity.timeout)) {
+        // 'blocker_index_' is up to date, since Dispatch() ran after every
+        // change.
+        const Queue* const blocker =
+            blocker_index_ < 0 ? nullptr : GetQueue(blocker_index_);
+        if (blocker == nullptr || blocker->finished) {
+          break;
+        }
+        LOG(WARNING) << "Queue " << blocker->key
+                     << " did not receive data for "
+                     << common::ToSeconds(capacity.timeout)
+                     << " s, marking it as finished.";
+        timed_out_queues_.insert(blocker->key);
+        MarkQueueAsFinishedLocked(blocker_index_);
+      }
+      break;
+  }
+  Queue* const queue = GetQueue(queue_index);
+  if (queue == nullptr || queue->finished) {
+    return false;
+  }
+  queue->statistics.blocked_time +=
+      std::chrono::duration_cast<common::Duration>(
+          std::chrono::steady_clock::now() - start_time);
+  return true;
+}
+
 void OrderedMultiQueue::Flush() {
-  std::vector<QueueKey> unfinished_queues;
-  for (auto& entry : queues_) {
-    if (!entry.second.finished) {
-      unfinished_queues.push_back(entry.first);
+  common::MutexLocker locker(&mutex_);
+  std::vector<int> unfinished_queue_indices;
+  for (const int queue_index : sorted_queue_indices_) {
+    if (!queues_[queue_index]->finished) {
+      unfinished_queue_indices.push_back(queue_index);
     }
   }
-  for (auto& unfinished_queue : unfinished_queues) {
-    MarkQueueAsFinished(unfinished_queue);
+  for (const int queue_index : unfinished_queue_indices) {
+    MarkQueueAsFinishedLocked(queue_index);
   }
 }
 
 QueueKey OrderedMultiQueue::GetBlocker() const {
-  CHECK(!queues_.empty());
+  common::MutexLocker locker(&mutex_);
+  CHECK(!sorted_queue_indices_.empty());
   return blocker_;
 }
 
+std::map<QueueKey, QueueStatistics> OrderedMultiQueue::GetQueueStatistics()
+    const {
+  common::MutexLocker locker(&mutex_);
+  std::map<QueueKey, QueueStatistics> statistics;
+  for (const int queue_index : sorted_queue_indices_) {
+    Queue& queue = *queues_[queue_index];
+    QueueStatistics& queue_statistics = statistics[queue.key];
+    queue_statistics = queue.statistics;
+    queue_statistics.size = queue.Size();
+  }
+  return statistics;
+}
+
+int64 OrderedMultiQueue::GetMemoryUsageInBytes() const {
+  common::MutexLocker locker(&mutex_);
+  int64 memory_usage_in_bytes = sizeof(*this);
+  for (const int queue_index : sorted_queue_indices_) {
+    const Queue& queue = *queues_[queue_index];
+    memory_usage_in_bytes +=
+        sizeof(queue) + queue.Size() * sizeof(std::unique_ptr<Data>) +
+        queue.data_memory_usage_in_bytes;
+  }
+  return memory_usage_in_bytes;
+}
+
 void OrderedMultiQueue::Dispatch() {
   while (true) {
     const Data* next_data = nullptr;
     Queue* next_queue = nullptr;
-    QueueKey next_queue_key;
-    for (auto it = queues_.begin(); it != queues_.end();) {
-      const auto* data = it->second.queue.Peek<Data>();
+    int next_queue_index = -1;
+    for (auto it = sorted_queue_indices_.begin();
+         it != sorted_queue_indices_.end();) {
+      Queue* const queue = queues_[*it].get();
+      const auto* data = queue->Peek();
       if (data == nullptr) {
-        if (it->second.finished) {
-          queues_.erase(it++);
+        if (queue->finished) {
+          queue_indices_.erase(queue->key);
+          queues_[*it].reset();
+          it = sorted_queue_indices_.erase(it);
           continue;
         }
-        CannotMakeProgress(it->first);
+        CannotMakeProgress(*it);
         return;
       }
       if (next_data == nullptr || data->GetTime() < next_data->GetTime()) {
         next_data = data;
-        next_queue = &it->second;
-        next_queue_key = it->first;
+        next_queue = queue;
+        next_queue_index = *it;
       }
       CHECK_LE(last_dispatched_time_, next_data->GetTime())
-          << "Non-sorted data added to queue: '" << it->first << "'";
+          << "Non-sorted data added to queue: '" << queue->key << "'";
       ++it;
     }
     if (next_data == nullptr) {
-      CHECK(queues_.empty());
+      CHECK(queue_indices_.empty());
       return;
     }
 
     // If we haven't dispatched any data for this trajectory yet, fast forward
     // all queues of this trajectory until a common start time has been reached.
     const common::Time common_start_time =
-        GetCommonStartTime(next_queue_key.trajectory_id);
+        GetCommonStartTime(next_queue->key.trajectory_id);
 
     if (next_data->GetTime() >= common_start_time) {
       // Happy case, we are beyond the 'common_start_time' already.
       last_dispatched_time_ = next_data->GetTime();
-      next_queue->callback(next_queue->queue.Pop());
-    } else if (next_queue->queue.Size() < 2) {
+      next_queue->callback(next_queue->Pop());
+    } else if (next_queue->Size() < 2) {
       if (!next_queue->finished) {
         // We cannot decide whether to drop or dispatch this yet.
-        CannotMakeProgress(next_queue_key);
+        CannotMakeProgress(next_queue_index);
         return;
       }
       last_dispatched_time_ = next_data->GetTime();
-      next_queue->callback(next_queue->queue.Pop());
+      next_queue->callback(next_queue->Pop());
     } else {
       // We take a peek at the time after next data. If it also is not beyond
       // 'common_start_time' we drop 'next_data', otherwise we just found the
       // first packet to dispatch from this queue.
-      std::unique_ptr<Data> next_data_owner = next_queue->queue.Pop();
-      if (next_queue->queue.Peek<Data>()->GetTime() > common_start_time) {
+      std::unique_ptr<Data> next_data_owner = next_queue->Pop();
+      if (next_queue->Peek()->GetTime() > common_start_time) {
         last_dispatched_time_ = next_data->GetTime();
         next_queue->callback(std::move(next_data_owner));
       }
@@ -148,11 +312,12 @@ void OrderedMultiQueue::Dispatch() {
   }
 }
 
-void OrderedMultiQueue::CannotMakeProgress(const QueueKey& queue_key) {
-  blocker_ = queue_key;
-  for (auto& entry : queues_) {
-    if (entry.second.queue.Size() > kMaxQueueSize) {
-      LOG_EVERY_N(WARNING, 60) << "Queue waiting for data: " << queue_key;
+void OrderedMultiQueue::CannotMakeProgress(const int queue_index) {
+  blocker_index_ = queue_index;
+  blocker_ = queues_[queue_index]->key;
+  for (const int other_queue_index : sorted_queue_indices_) {
+    if (queues_[other_queue_index]->Size() > kMaxQueueSize) {
+      LOG_EVERY_N(WARNING, 60) << "Queue waiting for data: " << blocker_;
       return;
     }
   }
@@ -163,10 +328,11 @@ common::Time OrderedMultiQueue::GetCommonStartTime(const int trajectory_id) {
       trajectory_id, common::Time::min());
   common::Time& common_start_time = emplace_result.first->second;
   if (emplace_result.second) {
-    for (auto& entry : queues_) {
-      if (entry.first.trajectory_id == trajectory_id) {
-        common_start_time = std::max(
-            common_start_time, entry.second.queue.Peek<Data>()->GetTime());
+    for (const int queue_index : sorted_queue_indices_) {
+      Queue& queue = *queues_[queue_index];
+      if (queue.key.trajectory_id == trajectory_id) {
+        common_start_time =
+            std::max(common_start_time, queue.Peek()->GetTime());
       }
     }
     LOG(INFO) << "All sensor data for trajectory " << trajectory_id
@@ -17,13 +17,16 @@
 #ifndef CARTOGRAPHER_SENSOR_ORDERED_MULTI_QUEUE_H_
 #define CARTOGRAPHER_SENSOR_ORDERED_MULTI_QUEUE_H_
 
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <tuple>
+#include <vector>
 
-#include "cartographer/common/blocking_queue.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/sensor/data.h"
@@ -41,11 +44,45 @@ struct QueueKey {
   }
 };
 
+// What happens when data is added to a queue which is full.
+enum class QueueOverflowPolicy {
+  // The producer waits until data from the queue has been dispatched. This
+  // needs data for the other queues to be added from other threads.
+  kBlockProducer,
+  // The oldest data of the queue is dropped.
+  kDropOldest,
+  // Like 'kBlockProducer', but if the queue is still full after 'timeout', the
+  // queue blocking the dispatch is marked as finished.
+  kFinishBlockerAfterTimeout,
+};
+
+struct QueueCapacity {
+  // Maximum number of values in the queue, 0 if it is unbounded. Otherwise it
+  // has to be at least 2, so that the start of the trajectory can be found.
+  size_t max_size = 0;
+  QueueOverflowPolicy overflow_policy = QueueOverflowPolicy::kBlockProducer;
+  // Only used for 'kFinishBlockerAfterTimeout'.
+  common::Duration timeout = common::FromSeconds(1.);
+};
+
+struct QueueStatistics {
+  size_t size = 0;
+  // Largest size the queue had so far.
+  size_t max_size = 0;
+  int64 num_dropped = 0;
+  // Total time producers were blocked adding data to the queue.
+  common::Duration blocked_time = common::Duration::zero();
+};
+
 // Maintains multiple queues of sorted sensor data and dispatches it in merge
 // sorted order. It will wait to see at least one value for each unfinished
 // queue before dispatching the next time ordered value across all queues.
 //
-// This class is thread-compatible.
+// Queues can be referred to by key or by the index returned when adding them.
+// Using the index avoids looking up the key.
+//
+// This class is thread-safe. Callbacks are called with an internal lock held
+// and must not call back into the OrderedMultiQueue.
 class OrderedMultiQueue {
  public:
   using Callback = std::function<void(std::unique_ptr<Data>)>;
@@ -55,16 +92,25 @@ class OrderedMultiQueue {
 
   // Adds a new queue with key 'queue_key' which must not already exist.
   // 'callback' will be called whenever data from this queue can be dispatched.
-  void AddQueue(const QueueKey& queue_key, Callback callback);
+  // The queue is unbounded. Returns the index of the queue.
+  int AddQueue(const QueueKey& queue_key, Callback callback);
+
+  // Same as above, but the size of the queue is limited by 'capacity'.
+  int AddQueue(const QueueKey& queue_key, Callback callback,
+               const QueueCapacity& capacity);
 
   // Marks a queue as finished, i.e. no further data can be added. The queue
   // will be removed once the last piece of data from it has been dispatched.
+  // Does nothing for queues which have already been finished after a timeout.
   void MarkQueueAsFinished(const QueueKey& queue_key);
 
   // Adds 'data' to a queue with the given 'queue_key'. Data must be added
-  // sorted per queue.
+  // sorted per queue. If the queue is full, its overflow policy is applied.
   void Add(const QueueKey& queue_key, std::unique_ptr<Data> data);
 
+  // Same as above for the queue with 'queue_index'.
+  void Add(int queue_index, std::unique_ptr<Data> data);
+
   // Dispatches all remaining values in sorted order and removes the underlying
   // queues.
   void Flush();
@@ -74,23 +120,68 @@ class OrderedMultiQueue {
   // dispatch data.
   QueueKey GetBlocker() const;
 
+  // Returns the statistics of all queues which have not been removed.
+  std::map<QueueKey, QueueStatistics> GetQueueStatistics() const;
+
+  // Returns the number of bytes used by the queues and the data in them.
+  int64 GetMemoryUsageInBytes() const;
+
  private:
+  // Queues have no lock of their own, all access is serialized by 'mutex_'.
   struct Queue {
-    common::BlockingQueue<std::unique_ptr<Data>> queue;
+    void Push(std::unique_ptr<Data> data);
+    // Removes and returns the oldest value, which has to exist.
+    std::unique_ptr<Data> Pop();
+    // Returns the oldest value, or nullptr if the queue is empty.
+    const Data* Peek() const {
+      return values.empty() ? nullptr : values.front().get();
+    }
+    size_t Size() const { return values.size(); }
+
+    QueueKey key;
+    std::deque<std::unique_ptr<Data>> values;
     Callback callback;
     bool finished = false;
+    QueueCapacity capacity;
+    QueueStatistics statistics;
+    // Sum of GetMemoryUsageInBytes() of the data in 'values'.
+    int64 data_memory_usage_in_bytes = 0;
   };
 
-  void Dispatch();
-  void CannotMakeProgress(const QueueKey& queue_key);
-  common::Time GetCommonStartTime(int trajectory_id);
+  // Returns the queue with 'queue_index', nullptr if it has been removed.
+  Queue* GetQueue(int queue_index) REQUIRES(mutex_);
+  void AddLocked(int queue_index, std::unique_ptr<Data> data,
+                 common::MutexLocker* locker) REQUIRES(mutex_);
+  void MarkQueueAsFinishedLocked(int queue_index) REQUIRES(mutex_);
+  // Applies the overflow policy of the queue with 'queue_index' until it has
+  // room for another value. Returns false if the queue has been finished or
+  // removed in the meantime.
+  bool MakeRoom(int queue_index, common::MutexLocker* locker) REQUIRES(mutex_);
+  // Returns true if the queue with 'queue_index' has been removed or has room
+  // for another value.
+  bool HasRoom(int queue_index) REQUIRES(mutex_);
+  void Dispatch() REQUIRES(mutex_);
+  void CannotMakeProgress(int queue_index) REQUIRES(mutex_);
+  common::Time GetCommonStartTime(int trajectory_id) REQUIRES(mutex_);
+
+  mutable common::Mutex mutex_;
 
   // Used to verify that values are dispatched in sorted order.
-  common::Time last_dispatched_time_ = common::Time::min();
-
-  std::map<int, common::Time> common_start_time_per_trajectory_;
-  std::map<QueueKey, Queue> queues_;
-  QueueKey blocker_;
+  common::Time last_dispatched_time_ GUARDED_BY(mutex_) = common::Time::min();
+
+  std::map<int, common::Time> common_start_time_per_trajectory_
+      GUARDED_BY(mutex_);
+  // All queues ever added by index. Removed queues are nullptr.
+  std::vector<std::unique_ptr<Queue>> queues_ GUARDED_BY(mutex_);
+  // Indices of the queues which have not been removed, sorted by key.
+  std::vector<int> sorted_queue_indices_ GUARDED_BY(mutex_);
+  // Indices of the queues which have not been removed by key.
+  std::map<QueueKey, int> queue_indices_ GUARDED_BY(mutex_);
+  // Queues which were marked as finished because they blocked others for too
+  // long.
+  std::set<QueueKey> timed_out_queues_ GUARDED_BY(mutex_);
+  int blocker_index_ GUARDED_BY(mutex_) = -1;
+  QueueKey blocker_ GUARDED_BY(mutex_);
 };
 
 }  // namespace sensor
@@ -77,6 +77,23 @@ TEST_F(OrderedMultiQueueTest, Ordering) {
   }
 }
 
+TEST_F(OrderedMultiQueueTest, MemoryUsage) {
+  const int64 empty_memory_usage_in_bytes = queue_.GetMemoryUsageInBytes();
+  queue_.Add(kFirst, MakeImu(0));
+  queue_.Add(kFirst, MakeImu(1));
+  EXPECT_TRUE(values_.empty());
+  EXPECT_EQ(empty_memory_usage_in_bytes +
+                2 * (sizeof(std::unique_ptr<Data>) +
+                     MakeImu(0)->GetMemoryUsageInBytes()),
+            queue_.GetMemoryUsageInBytes());
+  queue_.Add(kSecond, MakeImu(0));
+  queue_.Add(kThird, MakeImu(0));
+  EXPECT_FALSE(values_.empty());
+  queue_.Flush();
+  EXPECT_EQ(4, values_.size());
+  EXPECT_LT(queue_.GetMemoryUsageInBytes(), empty_memory_usage_in_bytes);
+}
+
 TEST_F(OrderedMultiQueueTest, MarkQueueAsFinished) {
   queue_.Add(kFirst, MakeImu(1));
   queue_.Add(kFirst, MakeImu(2));
@@ -111,6 +128,67 @@ TEST_F(OrderedMultiQueueTest, CommonStartTimePerTrajectory) {
   EXPECT_EQ(values_.size(), 4);
 }
 
+TEST_F(OrderedMultiQueueTest, DropOldestOfFullQueue) {
+  // The queues of the fixture are unbounded and not used.
+  queue_.Flush();
+  OrderedMultiQueue queue;
+  QueueCapacity capacity;
+  capacity.max_size = 3;
+  capacity.overflow_policy = QueueOverflowPolicy::kDropOldest;
+  for (const auto& queue_key : {kFirst, kSecond}) {
+    queue.AddQueue(queue_key,
+                   [this](std::unique_ptr<Data> data) {
+                     values_.push_back(std::move(data));
+                   },
+                   capacity);
+  }
+  for (int i = 0; i != 5; ++i) {
+    queue.Add(kFirst, MakeImu(i));
+  }
+  EXPECT_TRUE(values_.empty());
+  const auto statistics = queue.GetQueueStatistics();
+  EXPECT_EQ(3, statistics.at(kFirst).size);
+  EXPECT_EQ(3, statistics.at(kFirst).max_size);
+  EXPECT_EQ(2, statistics.at(kFirst).num_dropped);
+  EXPECT_EQ(0, statistics.at(kSecond).size);
+  queue.Flush();
+  ASSERT_EQ(3, values_.size());
+  EXPECT_EQ(2, common::ToUniversal(values_.front()->GetTime()));
+}
+
+TEST_F(OrderedMultiQueueTest, FinishBlockerAfterTimeout) {
+  // The queues of the fixture are unbounded and not used.
+  queue_.Flush();
+  OrderedMultiQueue queue;
+  QueueCapacity capacity;
+  capacity.max_size = 2;
+  capacity.overflow_policy = QueueOverflowPolicy::kFinishBlockerAfterTimeout;
+  capacity.timeout = common::FromMilliseconds(10);
+  for (const auto& queue_key : {kFirst, kSecond}) {
+    queue.AddQueue(queue_key,
+                   [this](std::unique_ptr<Data> data) {
+                     values_.push_back(std::move(data));
+                   },
+                   capacity);
+  }
+  queue.Add(kFirst, MakeImu(0));
+  queue.Add(kFirst, MakeImu(1));
+  EXPECT_TRUE(values_.empty());
+  EXPECT_EQ(kSecond.sensor_id, queue.GetBlocker().sensor_id);
+  // The queue is full, so after the timeout 'kSecond' is marked as finished
+  // and the data of 'kFirst' is dispatched.
+  queue.Add(kFirst, MakeImu(2));
+  EXPECT_EQ(3, values_.size());
+  EXPECT_LE(capacity.timeout,
+            queue.GetQueueStatistics().at(kFirst).blocked_time);
+  // Data for the finished queue is ignored, and finishing it again does
+  // nothing.
+  queue.Add(kSecond, MakeImu(3));
+  queue.MarkQueueAsFinished(kSecond);
+  queue.MarkQueueAsFinished(kFirst);
+  EXPECT_EQ(3, values_.size());
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -29,6 +29,28 @@ namespace sensor {
 
 typedef std::vector<Eigen::Vector3f> PointCloud;
 
+// Refers to consecutive points owned by someone else, e.g. a PointCloud or a
+// BorrowedPointCloud, which have to outlive the view.
+class PointCloudView {
+ public:
+  // Implicit, so that a PointCloud can be passed where a view is expected.
+  PointCloudView(const PointCloud& point_cloud)
+      : begin_(point_cloud.data()),
+        end_(point_cloud.data() + point_cloud.size()) {}
+  PointCloudView(const Eigen::Vector3f* const begin,
+                 const Eigen::Vector3f* const end)
+      : begin_(begin), end_(end) {}
+
+  const Eigen::Vector3f* begin() const { return begin_; }
+  const Eigen::Vector3f* end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+
+ private:
+  const Eigen::Vector3f* begin_;
+  const Eigen::Vector3f* end_;
+};
+
 struct PointCloudWithIntensities {
   PointCloud points;
   std::vector<float> intensities;
@@ -43,6 +65,10 @@ struct PointCloudWithIntensities {
 PointCloud TransformPointCloud(const PointCloud& point_cloud,
                                const transform::Rigid3f& transform);
 
+// Same as above, but transforms 'point_cloud' in place.
+void TransformPointCloudInPlace(const transform::Rigid3f& transform,
+                                PointCloud* point_cloud);
+
 // Returns a new point cloud without points that fall outside the region defined
 // by 'min_z' and 'max_z'.
 PointCloud Crop(const PointCloud& point_cloud, float min_z, float max_z);
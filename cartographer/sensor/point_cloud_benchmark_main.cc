@@ -0,0 +1,139 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of voxel filtering, adaptive voxel filtering and
+// compressing point clouds, as done for each range data in 3D SLAM.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/sensor/compressed_point_cloud.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/sensor/proto/adaptive_voxel_filter_options.pb.h"
+#include "cartographer/sensor/voxel_filter.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 100000, "Number of points per point cloud.");
+DEFINE_int32(num_iterations, 100, "Number of times each step is measured.");
+DEFINE_double(voxel_size, 0.05, "Edge length of the voxel filter voxels.");
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+// Generates the returns of a spinning 3D lidar in a box shaped room with some
+// noise. The same seed always yields the same points.
+PointCloud GeneratePointCloud(const int num_points) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> angle_distribution(-M_PI, M_PI);
+  std::uniform_real_distribution<float> elevation_distribution(-0.3f, 0.3f);
+  std::uniform_real_distribution<float> noise_distribution(-0.02f, 0.02f);
+  PointCloud point_cloud;
+  for (int i = 0; i != num_points; ++i) {
+    const float angle = angle_distribution(rng);
+    const Eigen::Vector3f direction(std::cos(angle), std::sin(angle),
+                                    elevation_distribution(rng));
+    // Walls are 20 m away along x and 8 m along y.
+    const float range =
+        std::min(20.f / std::max(std::abs(direction.x()), 1e-3f),
+                 8.f / std::max(std::abs(direction.y()), 1e-3f)) +
+        noise_distribution(rng);
+    point_cloud.push_back(range * direction);
+  }
+  return point_cloud;
+}
+
+// Returns the seconds it takes to call 'function' 'FLAGS_num_iterations'
+// times. 'function' returns a value which is summed up and logged, which
+// keeps the compiler from dropping the work.
+double Measure(const std::function<size_t()>& function) {
+  size_t checksum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != FLAGS_num_iterations; ++i) {
+    checksum += function();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  VLOG(1) << "Checksum: " << checksum;
+  return seconds;
+}
+
+void Report(const string& name, const double seconds) {
+  LOG(INFO) << name << ": " << 1e3 * seconds / FLAGS_num_iterations
+            << " ms per point cloud, "
+            << FLAGS_num_points * FLAGS_num_iterations / seconds
+            << " points per second.";
+}
+
+void Run() {
+  const PointCloud point_cloud = GeneratePointCloud(FLAGS_num_points);
+  const float voxel_size = static_cast<float>(FLAGS_voxel_size);
+
+  Report("VoxelFiltered()", Measure([&point_cloud, voxel_size]() {
+           return VoxelFiltered(point_cloud, voxel_size).size();
+         }));
+
+  proto::AdaptiveVoxelFilterOptions adaptive_voxel_filter_options;
+  adaptive_voxel_filter_options.set_max_length(2.);
+  adaptive_voxel_filter_options.set_min_num_points(150);
+  adaptive_voxel_filter_options.set_max_range(15.);
+  const AdaptiveVoxelFilter adaptive_voxel_filter(
+      adaptive_voxel_filter_options);
+  Report("AdaptiveVoxelFilter::Filter()",
+         Measure([&point_cloud, &adaptive_voxel_filter]() {
+           return adaptive_voxel_filter.Filter(point_cloud).size();
+         }));
+
+  Report("CompressedPointCloud()", Measure([&point_cloud]() {
+           return CompressedPointCloud(point_cloud).size();
+         }));
+
+  const CompressedPointCloud compressed_point_cloud(point_cloud);
+  Report("CompressedPointCloud::Decompress()",
+         Measure([&compressed_point_cloud]() {
+           return compressed_point_cloud.Decompress().size();
+         }));
+
+  Report("CompressedPointCloud proto round trip",
+         Measure([&compressed_point_cloud]() {
+           return CompressedPointCloud(compressed_point_cloud.ToProto())
+               .size();
+         }));
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks voxel filtering and compressing point clouds.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::sensor::Run();
+  return EXIT_SUCCESS;
+}
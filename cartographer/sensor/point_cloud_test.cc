@@ -19,6 +19,7 @@
 
 #include <cmath>
 
+#include "cartographer/common/allocation_counter_test_helpers.h"
 #include "gtest/gtest.h"
 
 namespace cartographer {
@@ -37,6 +38,36 @@ TEST(PointCloudTest, TransformPointCloud) {
   EXPECT_NEAR(3.5f, transformed_point_cloud[1].y(), 1e-6);
 }
 
+TEST(PointCloudTest, TransformManyPoints) {
+  PointCloud point_cloud;
+  for (int i = 0; i != 1000; ++i) {
+    point_cloud.emplace_back(0.01f * i, std::sin(0.1f * i), -0.5f * i);
+  }
+  const transform::Rigid3f transform(
+      Eigen::Vector3f(1.f, -2.f, 3.f),
+      Eigen::Quaternionf(Eigen::AngleAxisf(0.7f, Eigen::Vector3f::UnitY())));
+  const PointCloud transformed_point_cloud =
+      TransformPointCloud(point_cloud, transform);
+  PointCloud transformed_in_place = point_cloud;
+  TransformPointCloudInPlace(transform, &transformed_in_place);
+  ASSERT_EQ(point_cloud.size(), transformed_point_cloud.size());
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    const Eigen::Vector3f expected = transform * point_cloud[i];
+    EXPECT_TRUE(expected.isApprox(transformed_point_cloud[i], 1e-5f));
+    EXPECT_EQ(transformed_point_cloud[i], transformed_in_place[i]);
+  }
+}
+
+TEST(PointCloudTest, TransformPointCloudInPlaceDoesNotAllocate) {
+  PointCloud point_cloud(100, Eigen::Vector3f(1.f, 2.f, 3.f));
+  const transform::Rigid3f transform(
+      Eigen::Vector3f(1.f, -2.f, 3.f),
+      Eigen::Quaternionf(Eigen::AngleAxisf(0.7f, Eigen::Vector3f::UnitY())));
+  common::ExpectNoAllocationsInSteadyState([&point_cloud, &transform]() {
+    TransformPointCloudInPlace(transform, &point_cloud);
+  });
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -16,6 +16,9 @@
 
 #include "cartographer/sensor/range_data.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "cartographer/sensor/proto/sensor.pb.h"
 #include "cartographer/transform/transform.h"
 
@@ -31,12 +34,33 @@ RangeData TransformRangeData(const RangeData& range_data,
   };
 }
 
+void TransformRangeDataInPlace(const transform::Rigid3f& transform,
+                               RangeData* const range_data) {
+  range_data->origin = transform * range_data->origin;
+  TransformPointCloudInPlace(transform, &range_data->returns);
+  TransformPointCloudInPlace(transform, &range_data->misses);
+}
+
 RangeData CropRangeData(const RangeData& range_data, const float min_z,
                         const float max_z) {
   return RangeData{range_data.origin, Crop(range_data.returns, min_z, max_z),
                    Crop(range_data.misses, min_z, max_z)};
 }
 
+RangeData CropRangeData(RangeData&& range_data, const float min_z,
+                        const float max_z) {
+  const auto outside = [min_z, max_z](const Eigen::Vector3f& point) {
+    return point.z() < min_z || max_z < point.z();
+  };
+  for (PointCloud* const point_cloud :
+       {&range_data.returns, &range_data.misses}) {
+    point_cloud->erase(
+        std::remove_if(point_cloud->begin(), point_cloud->end(), outside),
+        point_cloud->end());
+  }
+  return std::move(range_data);
+}
+
 proto::CompressedRangeData ToProto(
     const CompressedRangeData& compressed_range_data) {
   proto::CompressedRangeData proto;
@@ -38,9 +38,18 @@ struct RangeData {
 RangeData TransformRangeData(const RangeData& range_data,
                              const transform::Rigid3f& transform);
 
+// Same as above, but transforms 'range_data' in place and keeps the storage of
+// its point clouds.
+void TransformRangeDataInPlace(const transform::Rigid3f& transform,
+                               RangeData* range_data);
+
 // Crops 'range_data' according to the region defined by 'min_z' and 'max_z'.
 RangeData CropRangeData(const RangeData& range_data, float min_z, float max_z);
 
+// Same as above, but crops the point clouds of 'range_data' in place instead
+// of copying them.
+RangeData CropRangeData(RangeData&& range_data, float min_z, float max_z);
+
 // Like RangeData but with compressed point clouds. The point order changes
 // when converting from RangeData.
 struct CompressedRangeData {
@@ -26,6 +26,7 @@ namespace sensor {
 namespace {
 
 using ::testing::Contains;
+using ::testing::Pointwise;
 
 MATCHER(NearPointwise, std::string(negation ? "Doesn't" : "Does") + " match.") {
   return std::get<0>(arg).isApprox(std::get<1>(arg), 0.001f);
@@ -73,6 +74,30 @@ TEST_F(RangeDataTest, CompressedRangeDataToAndFromProto) {
   EXPECT_EQ(expected.misses, actual.misses);
 }
 
+TEST_F(RangeDataTest, TransformRangeDataInPlace) {
+  const RangeData range_data = {origin_, returns_, misses_};
+  const transform::Rigid3f transform(
+      Eigen::Vector3f(1.f, -2.f, 3.f),
+      Eigen::Quaternionf(Eigen::AngleAxisf(0.5f, Eigen::Vector3f::UnitZ())));
+  const RangeData expected = TransformRangeData(range_data, transform);
+  RangeData actual = range_data;
+  TransformRangeDataInPlace(transform, &actual);
+  EXPECT_THAT(expected.origin, Near(actual.origin));
+  EXPECT_THAT(expected.returns, Pointwise(NearPointwise(), actual.returns));
+  EXPECT_THAT(expected.misses, Pointwise(NearPointwise(), actual.misses));
+}
+
+TEST_F(RangeDataTest, CropRangeDataInPlace) {
+  const RangeData range_data = {origin_, returns_, misses_};
+  const RangeData expected = CropRangeData(range_data, 1.5f, 7.f);
+  EXPECT_EQ(3, expected.returns.size());
+  EXPECT_EQ(0, expected.misses.size());
+  const RangeData actual = CropRangeData(RangeData(range_data), 1.5f, 7.f);
+  EXPECT_THAT(expected.origin, Near(actual.origin));
+  EXPECT_THAT(expected.returns, Pointwise(NearPointwise(), actual.returns));
+  EXPECT_THAT(expected.misses, Pointwise(NearPointwise(), actual.misses));
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/soa_point_cloud.h"
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace sensor {
+
+SoaPointCloud::SoaPointCloud(const PointCloud& point_cloud) {
+  reserve(point_cloud.size());
+  for (const Eigen::Vector3f& point : point_cloud) {
+    push_back(point);
+  }
+}
+
+SoaPointCloud::SoaPointCloud(
+    const PointCloudWithIntensities& point_cloud_with_intensities)
+    : has_intensities_(true),
+      intensities_(point_cloud_with_intensities.intensities.begin(),
+                   point_cloud_with_intensities.intensities.end()),
+      offset_seconds_(point_cloud_with_intensities.offset_seconds.begin(),
+                      point_cloud_with_intensities.offset_seconds.end()) {
+  const PointCloud& points = point_cloud_with_intensities.points;
+  CHECK_EQ(points.size(), intensities_.size());
+  CHECK_EQ(points.size(), offset_seconds_.size());
+  x_.reserve(points.size());
+  y_.reserve(points.size());
+  z_.reserve(points.size());
+  for (const Eigen::Vector3f& point : points) {
+    x_.push_back(point.x());
+    y_.push_back(point.y());
+    z_.push_back(point.z());
+  }
+}
+
+PointCloud SoaPointCloud::ToPointCloud() const {
+  PointCloud point_cloud;
+  point_cloud.reserve(size());
+  for (size_t i = 0; i != size(); ++i) {
+    point_cloud.push_back(point(i));
+  }
+  return point_cloud;
+}
+
+PointCloudWithIntensities SoaPointCloud::ToPointCloudWithIntensities() const {
+  CHECK(has_intensities_);
+  return PointCloudWithIntensities{
+      ToPointCloud(),
+      std::vector<float>(intensities_.begin(), intensities_.end()),
+      std::vector<float>(offset_seconds_.begin(), offset_seconds_.end())};
+}
+
+void SoaPointCloud::reserve(const size_t size) {
+  x_.reserve(size);
+  y_.reserve(size);
+  z_.reserve(size);
+  if (has_intensities_) {
+    intensities_.reserve(size);
+    offset_seconds_.reserve(size);
+  }
+}
+
+void SoaPointCloud::clear() {
+  x_.clear();
+  y_.clear();
+  z_.clear();
+  intensities_.clear();
+  offset_seconds_.clear();
+}
+
+void SoaPointCloud::push_back(const Eigen::Vector3f& point) {
+  DCHECK(!has_intensities_);
+  x_.push_back(point.x());
+  y_.push_back(point.y());
+  z_.push_back(point.z());
+}
+
+void SoaPointCloud::push_back(const Eigen::Vector3f& point,
+                              const float intensity,
+                              const float offset_seconds) {
+  DCHECK(has_intensities_ || empty());
+  has_intensities_ = true;
+  x_.push_back(point.x());
+  y_.push_back(point.y());
+  z_.push_back(point.z());
+  intensities_.push_back(intensity);
+  offset_seconds_.push_back(offset_seconds);
+}
+
+SoaPointCloud TransformPointCloud(const SoaPointCloud& point_cloud,
+                                  const transform::Rigid3f& transform) {
+  const Eigen::Matrix3f rotation = transform.rotation().toRotationMatrix();
+  const Eigen::Vector3f& translation = transform.translation();
+  const size_t size = point_cloud.size();
+  SoaPointCloud result;
+  result.x_.resize(size);
+  result.y_.resize(size);
+  result.z_.resize(size);
+  const float* const x = point_cloud.x_.data();
+  const float* const y = point_cloud.y_.data();
+  const float* const z = point_cloud.z_.data();
+  float* const outputs[] = {result.x_.data(), result.y_.data(),
+                             result.z_.data()};
+  // Each output channel is computed in its own loop over contiguous arrays,
+  // which the compiler can vectorize.
+  for (int row = 0; row != 3; ++row) {
+    float* const out = outputs[row];
+    const float r0 = rotation(row, 0);
+    const float r1 = rotation(row, 1);
+    const float r2 = rotation(row, 2);
+    const float t = translation[row];
+    for (size_t i = 0; i < size; ++i) {
+      out[i] = r0 * x[i] + r1 * y[i] + r2 * z[i] + t;
+    }
+  }
+  result.has_intensities_ = point_cloud.has_intensities_;
+  result.intensities_ = point_cloud.intensities_;
+  result.offset_seconds_ = point_cloud.offset_seconds_;
+  return result;
+}
+
+SoaPointCloud Crop(const SoaPointCloud& point_cloud, const float min_z,
+                   const float max_z) {
+  SoaPointCloud result;
+  result.has_intensities_ = point_cloud.has_intensities_;
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    const float z = point_cloud.z_[i];
+    if (min_z <= z && z <= max_z) {
+      result.x_.push_back(point_cloud.x_[i]);
+      result.y_.push_back(point_cloud.y_[i]);
+      result.z_.push_back(z);
+      if (point_cloud.has_intensities_) {
+        result.intensities_.push_back(point_cloud.intensities_[i]);
+        result.offset_seconds_.push_back(point_cloud.offset_seconds_[i]);
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace sensor
+}  // namespace cartographer
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_SENSOR_SOA_POINT_CLOUD_H_
+#define CARTOGRAPHER_SENSOR_SOA_POINT_CLOUD_H_
+
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/StdVector"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace sensor {
+
+// A point cloud stored as a structure of arrays: the x, y and z coordinates
+// each live in their own contiguous, aligned array, so that per-point loops
+// can be vectorized. Optionally, each point also has an intensity and a time
+// offset as in 'PointCloudWithIntensities'.
+//
+// Use the conversions to and from 'PointCloud' to move code over to this
+// representation one step at a time.
+class SoaPointCloud {
+ public:
+  using Channel = std::vector<float, Eigen::aligned_allocator<float>>;
+
+  SoaPointCloud() = default;
+  explicit SoaPointCloud(const PointCloud& point_cloud);
+  explicit SoaPointCloud(
+      const PointCloudWithIntensities& point_cloud_with_intensities);
+
+  PointCloud ToPointCloud() const;
+  // Must only be called if 'has_intensities()'.
+  PointCloudWithIntensities ToPointCloudWithIntensities() const;
+
+  bool empty() const { return x_.empty(); }
+  size_t size() const { return x_.size(); }
+  void reserve(size_t size);
+  // Removes all points but keeps the storage and the optional channels.
+  void clear();
+
+  // Appends 'point'. Must not be called if 'has_intensities()'.
+  void push_back(const Eigen::Vector3f& point);
+  // Appends 'point' with its 'intensity' and 'offset_seconds'. Must only be
+  // called if 'has_intensities()' or if this point cloud is empty.
+  void push_back(const Eigen::Vector3f& point, float intensity,
+                 float offset_seconds);
+
+  Eigen::Vector3f point(const size_t index) const {
+    return Eigen::Vector3f(x_[index], y_[index], z_[index]);
+  }
+
+  const Channel& x() const { return x_; }
+  const Channel& y() const { return y_; }
+  const Channel& z() const { return z_; }
+
+  // True if the 'intensities()' and 'offset_seconds()' channels are present.
+  bool has_intensities() const { return has_intensities_; }
+  const Channel& intensities() const { return intensities_; }
+  const Channel& offset_seconds() const { return offset_seconds_; }
+
+ private:
+  friend SoaPointCloud TransformPointCloud(const SoaPointCloud& point_cloud,
+                                           const transform::Rigid3f& transform);
+  friend SoaPointCloud Crop(const SoaPointCloud& point_cloud, float min_z,
+                            float max_z);
+
+  Channel x_;
+  Channel y_;
+  Channel z_;
+  bool has_intensities_ = false;
+  Channel intensities_;
+  Channel offset_seconds_;
+};
+
+// Transforms 'point_cloud' according to 'transform'.
+SoaPointCloud TransformPointCloud(const SoaPointCloud& point_cloud,
+                                  const transform::Rigid3f& transform);
+
+// Returns a new point cloud without points that fall outside the region defined
+// by 'min_z' and 'max_z'.
+SoaPointCloud Crop(const SoaPointCloud& point_cloud, float min_z, float max_z);
+
+}  // namespace sensor
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_SENSOR_SOA_POINT_CLOUD_H_
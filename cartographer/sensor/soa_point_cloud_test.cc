@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/soa_point_cloud.h"
+
+#include <cmath>
+#include <cstdint>
+
+#include "cartographer/transform/transform.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+PointCloud CreateTestPointCloud() {
+  PointCloud point_cloud;
+  for (int i = 0; i != 37; ++i) {
+    point_cloud.emplace_back(0.5f * i, 1.f - i, std::sin(0.1f * i));
+  }
+  return point_cloud;
+}
+
+TEST(SoaPointCloudTest, ConvertsToAndFromPointCloud) {
+  const PointCloud point_cloud = CreateTestPointCloud();
+  const SoaPointCloud soa_point_cloud(point_cloud);
+  EXPECT_EQ(point_cloud.size(), soa_point_cloud.size());
+  EXPECT_FALSE(soa_point_cloud.has_intensities());
+  EXPECT_EQ(point_cloud, soa_point_cloud.ToPointCloud());
+  for (const SoaPointCloud::Channel* channel :
+       {&soa_point_cloud.x(), &soa_point_cloud.y(), &soa_point_cloud.z()}) {
+    EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(channel->data()) % 16);
+  }
+}
+
+TEST(SoaPointCloudTest, ConvertsToAndFromPointCloudWithIntensities) {
+  PointCloudWithIntensities point_cloud_with_intensities;
+  point_cloud_with_intensities.points = CreateTestPointCloud();
+  for (size_t i = 0; i != point_cloud_with_intensities.points.size(); ++i) {
+    point_cloud_with_intensities.intensities.push_back(2.f * i);
+    point_cloud_with_intensities.offset_seconds.push_back(0.01f * i);
+  }
+  const SoaPointCloud soa_point_cloud(point_cloud_with_intensities);
+  ASSERT_TRUE(soa_point_cloud.has_intensities());
+  const PointCloudWithIntensities actual =
+      soa_point_cloud.ToPointCloudWithIntensities();
+  EXPECT_EQ(point_cloud_with_intensities.points, actual.points);
+  EXPECT_EQ(point_cloud_with_intensities.intensities, actual.intensities);
+  EXPECT_EQ(point_cloud_with_intensities.offset_seconds,
+            actual.offset_seconds);
+}
+
+TEST(SoaPointCloudTest, TransformPointCloud) {
+  const PointCloud point_cloud = CreateTestPointCloud();
+  const transform::Rigid3f transform(
+      Eigen::Vector3f(1.f, -2.f, 3.f),
+      Eigen::Quaternionf(Eigen::AngleAxisf(0.7f, Eigen::Vector3f::UnitY())));
+  const PointCloud expected = TransformPointCloud(point_cloud, transform);
+  const SoaPointCloud actual =
+      TransformPointCloud(SoaPointCloud(point_cloud), transform);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i != expected.size(); ++i) {
+    EXPECT_TRUE(expected[i].isApprox(actual.point(i), 1e-5f));
+  }
+}
+
+TEST(SoaPointCloudTest, Crop) {
+  const PointCloud point_cloud = CreateTestPointCloud();
+  const PointCloud expected = Crop(point_cloud, -0.5f, 0.5f);
+  const SoaPointCloud actual = Crop(SoaPointCloud(point_cloud), -0.5f, 0.5f);
+  EXPECT_LT(expected.size(), point_cloud.size());
+  EXPECT_EQ(expected, actual.ToPointCloud());
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
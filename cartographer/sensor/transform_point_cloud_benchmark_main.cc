@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of TransformPointCloud() compared to transforming
+// one point at a time through the quaternion of the transform.
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 20000, "Number of points per point cloud.");
+DEFINE_int32(num_iterations, 2000, "Number of point clouds to transform.");
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+PointCloud GeneratePointCloud(const int num_points) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> distribution(-30.f, 30.f);
+  PointCloud point_cloud;
+  for (int i = 0; i != num_points; ++i) {
+    point_cloud.emplace_back(distribution(rng), distribution(rng),
+                             distribution(rng));
+  }
+  return point_cloud;
+}
+
+// The implementation TransformPointCloud() had before it was batched.
+PointCloud TransformPointCloudPerPoint(const PointCloud& point_cloud,
+                                       const transform::Rigid3f& transform) {
+  PointCloud result;
+  result.reserve(point_cloud.size());
+  for (const Eigen::Vector3f& point : point_cloud) {
+    result.emplace_back(transform * point);
+  }
+  return result;
+}
+
+// Returns the number of seconds it takes to call 'transform_point_cloud' for
+// 'FLAGS_num_iterations' slightly different transforms.
+double Measure(const PointCloud& point_cloud,
+               const std::function<PointCloud(const PointCloud&,
+                                              const transform::Rigid3f&)>&
+                   transform_point_cloud) {
+  float checksum = 0.f;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != FLAGS_num_iterations; ++i) {
+    const transform::Rigid3f transform(
+        Eigen::Vector3f(0.01f * i, 0.f, 0.f),
+        Eigen::Quaternionf(
+            Eigen::AngleAxisf(0.001f * i, Eigen::Vector3f::UnitZ())));
+    checksum += transform_point_cloud(point_cloud, transform).back().x();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  // Logging the checksum keeps the compiler from dropping the work.
+  VLOG(1) << "Checksum: " << checksum;
+  return seconds;
+}
+
+void Run() {
+  const PointCloud point_cloud = GeneratePointCloud(FLAGS_num_points);
+  const double num_points =
+      static_cast<double>(FLAGS_num_points) * FLAGS_num_iterations;
+  const double per_point_seconds =
+      Measure(point_cloud, TransformPointCloudPerPoint);
+  const double batched_seconds = Measure(point_cloud, TransformPointCloud);
+  LOG(INFO) << "Per point: " << num_points / per_point_seconds
+            << " points per second.";
+  LOG(INFO) << "Batched: " << num_points / batched_seconds
+            << " points per second, " << per_point_seconds / batched_seconds
+            << "x speedup.";
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage("\n\nBenchmarks transforming point clouds.");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::sensor::Run();
+  return EXIT_SUCCESS;
+}
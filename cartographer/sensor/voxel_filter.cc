@@ -16,9 +16,14 @@
 
 #include "cartographer/sensor/voxel_filter.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <limits>
+#include <vector>
 
 #include "cartographer/common/math.h"
+#include "cartographer/common/radix_sort.h"
 
 namespace cartographer {
 namespace sensor {
@@ -36,6 +41,140 @@ PointCloud FilterByMaxRange(const PointCloud& point_cloud,
   return result;
 }
 
+// Returns the number of bits needed to represent 'value'.
+int BitWidth(uint64 value) {
+  int bits = 0;
+  while (value != 0) {
+    ++bits;
+    value >>= 1;
+  }
+  return bits;
+}
+
+// Finds the first point of each voxel by sorting the points by voxel, instead
+// of looking up every point in a grid. The buffers are reused when the same
+// point cloud is filtered with several voxel sizes.
+class SortingVoxelFilter {
+ public:
+  explicit SortingVoxelFilter(const PointCloud& point_cloud)
+      : point_cloud_(point_cloud) {}
+
+  SortingVoxelFilter(const SortingVoxelFilter&) = delete;
+  SortingVoxelFilter& operator=(const SortingVoxelFilter&) = delete;
+
+  // Returns the number of voxels with edge length 'size' that contain points.
+  size_t CountVoxels(const float size) {
+    FindFirstPointInEachVoxel(size);
+    return num_voxels_;
+  }
+
+  // Returns the first point in each voxel with edge length 'size', in the
+  // order of the point cloud.
+  PointCloud Filter(const float size) {
+    FindFirstPointInEachVoxel(size);
+    PointCloud result;
+    result.reserve(num_voxels_);
+    for (size_t i = 0; i != point_cloud_.size(); ++i) {
+      if (is_first_in_voxel_[i]) {
+        result.push_back(point_cloud_[i]);
+      }
+    }
+    return result;
+  }
+
+ private:
+  static constexpr int kMaxKeyBits = 32;
+
+  void FindFirstPointInEachVoxel(const float size) {
+    if (has_size_ && size == size_) {
+      return;
+    }
+    has_size_ = true;
+    size_ = size;
+    is_first_in_voxel_.assign(point_cloud_.size(), 0);
+    num_voxels_ = 0;
+    if (point_cloud_.empty()) {
+      return;
+    }
+
+    // Uses the same cell indices as 'VoxelFilter' to get identical results.
+    cell_indices_.clear();
+    cell_indices_.reserve(point_cloud_.size());
+    Eigen::Array3i min_index =
+        Eigen::Array3i::Constant(std::numeric_limits<int>::max());
+    Eigen::Array3i max_index =
+        Eigen::Array3i::Constant(std::numeric_limits<int>::min());
+    for (const Eigen::Vector3f& point : point_cloud_) {
+      const Eigen::Array3f index = point.array() / size;
+      cell_indices_.emplace_back(common::RoundToInt(index.x()),
+                                 common::RoundToInt(index.y()),
+                                 common::RoundToInt(index.z()));
+      min_index = min_index.min(cell_indices_.back());
+      max_index = max_index.max(cell_indices_.back());
+    }
+    int bits[3];
+    for (int i = 0; i != 3; ++i) {
+      bits[i] = BitWidth(static_cast<int64>(max_index[i]) - min_index[i]);
+    }
+    const int key_bits = bits[0] + bits[1] + bits[2];
+    if (key_bits > kMaxKeyBits ||
+        point_cloud_.size() > std::numeric_limits<uint32>::max()) {
+      FindFirstPointInEachVoxelUsingGrid();
+      return;
+    }
+
+    // Each entry holds the voxel key in the high and the point index in the
+    // low 32 bits. Sorting only the key bits keeps points of the same voxel
+    // in their original order.
+    entries_.clear();
+    entries_.reserve(point_cloud_.size());
+    for (size_t i = 0; i != cell_indices_.size(); ++i) {
+      const Eigen::Array3i offset = cell_indices_[i] - min_index;
+      const uint64 key =
+          (static_cast<uint64>(offset.x()) << (bits[1] + bits[2])) |
+          (static_cast<uint64>(offset.y()) << bits[2]) |
+          static_cast<uint64>(offset.z());
+      entries_.push_back((key << 32) | i);
+    }
+    common::RadixSort(32, 32 + key_bits,
+                      [](const uint64 entry) { return entry; }, &entries_,
+                      &scratch_);
+
+    uint64 last_key = std::numeric_limits<uint64>::max();
+    for (const uint64 entry : entries_) {
+      const uint64 key = entry >> 32;
+      if (key != last_key) {
+        last_key = key;
+        is_first_in_voxel_[entry & 0xffffffff] = 1;
+        ++num_voxels_;
+      }
+    }
+  }
+
+  // Fallback for point clouds spanning too many voxels to sort by a 32-bit
+  // key.
+  void FindFirstPointInEachVoxelUsingGrid() {
+    mapping_3d::HybridGridBase<uint8> voxels(size_);
+    for (size_t i = 0; i != cell_indices_.size(); ++i) {
+      auto* const value = voxels.mutable_value(cell_indices_[i]);
+      if (*value == 0) {
+        *value = 1;
+        is_first_in_voxel_[i] = 1;
+        ++num_voxels_;
+      }
+    }
+  }
+
+  const PointCloud& point_cloud_;
+  bool has_size_ = false;
+  float size_ = 0.f;
+  size_t num_voxels_ = 0;
+  std::vector<uint8> is_first_in_voxel_;
+  std::vector<Eigen::Array3i> cell_indices_;
+  std::vector<uint64> entries_;
+  std::vector<uint64> scratch_;
+};
+
 PointCloud AdaptivelyVoxelFiltered(
     const proto::AdaptiveVoxelFilterOptions& options,
     const PointCloud& point_cloud) {
@@ -43,33 +182,162 @@ PointCloud AdaptivelyVoxelFiltered(
     // 'point_cloud' is already sparse enough.
     return point_cloud;
   }
-  PointCloud result = VoxelFiltered(point_cloud, options.max_length());
-  if (result.size() >= options.min_num_points()) {
+  SortingVoxelFilter voxel_filter(point_cloud);
+  if (voxel_filter.CountVoxels(options.max_length()) >=
+      options.min_num_points()) {
     // Filtering with 'max_length' resulted in a sufficiently dense point cloud.
-    return result;
+    return voxel_filter.Filter(options.max_length());
   }
   // Search for a 'low_length' that is known to result in a sufficiently
   // dense point cloud. We give up and use the full 'point_cloud' if reducing
   // the edge length by a factor of 1e-2 is not enough.
+  float low_length = options.max_length();
   for (float high_length = options.max_length();
        high_length > 1e-2f * options.max_length(); high_length /= 2.f) {
-    float low_length = high_length / 2.f;
-    result = VoxelFiltered(point_cloud, low_length);
-    if (result.size() >= options.min_num_points()) {
+    low_length = high_length / 2.f;
+    if (voxel_filter.CountVoxels(low_length) >= options.min_num_points()) {
       // Binary search to find the right amount of filtering. 'low_length' gave
-      // a sufficiently dense 'result', 'high_length' did not. We stop when the
-      // edge length is at most 10% off.
+      // a sufficiently dense result, 'high_length' did not. We stop when the
+      // edge length is at most 10% off. Only the voxels are counted until the
+      // final 'low_length' is known.
       while ((high_length - low_length) / low_length > 1e-1f) {
         const float mid_length = (low_length + high_length) / 2.f;
-        const PointCloud candidate = VoxelFiltered(point_cloud, mid_length);
-        if (candidate.size() >= options.min_num_points()) {
+        if (voxel_filter.CountVoxels(mid_length) >= options.min_num_points()) {
           low_length = mid_length;
-          result = candidate;
         } else {
           high_length = mid_length;
         }
       }
-      return result;
+      return voxel_filter.Filter(low_length);
+    }
+  }
+  return voxel_filter.Filter(low_length);
+}
+
+// Spreads the lowest 21 bits of 'value' so that there are two zero bits
+// between each of them.
+uint64 SpreadBits(uint64 value) {
+  value &= 0x1fffff;
+  value = (value | value << 32) & 0x1f00000000ffff;
+  value = (value | value << 16) & 0x1f0000ff0000ff;
+  value = (value | value << 8) & 0x100f00f00f00f00f;
+  value = (value | value << 4) & 0x10c30c30c30c30c3;
+  value = (value | value << 2) & 0x1249249249249249;
+  return value;
+}
+
+// Returns the octree key of 'cell_index' by interleaving the bits of its
+// coordinates, so that the key of the enclosing voxel one level up is the key
+// shifted right by 3 bits.
+uint64 ToMortonKey(const Eigen::Array3i& cell_index) {
+  return SpreadBits(cell_index.x()) | SpreadBits(cell_index.y()) << 1 |
+         SpreadBits(cell_index.z()) << 2;
+}
+
+// Like 'AdaptivelyVoxelFiltered', but only considers the edge lengths
+// 'max_length' / 2^level. The points are sorted once by their octree key at
+// the finest level, after which the occupied voxels of all levels are counted
+// in a single pass.
+PointCloud PyramidVoxelFiltered(
+    const proto::AdaptiveVoxelFilterOptions& options,
+    const PointCloud& point_cloud) {
+  if (point_cloud.size() <= options.min_num_points()) {
+    // 'point_cloud' is already sparse enough.
+    return point_cloud;
+  }
+  // The finest edge length is about what the binary search gives up at.
+  constexpr int kNumLevels = 8;
+  constexpr int kMaxBitsPerCoordinate = 21;
+  constexpr int kCoarsestCellSize = 1 << (kNumLevels - 1);
+  const float finest_length = options.max_length() / kCoarsestCellSize;
+
+  // Voxels are aligned to the coarsest level, so that each voxel contains
+  // exactly 8 voxels of the level below.
+  std::vector<Eigen::Array3i> cell_indices;
+  cell_indices.reserve(point_cloud.size());
+  Eigen::Array3i min_index =
+      Eigen::Array3i::Constant(std::numeric_limits<int>::max());
+  Eigen::Array3i max_index =
+      Eigen::Array3i::Constant(std::numeric_limits<int>::min());
+  for (const Eigen::Vector3f& point : point_cloud) {
+    const Eigen::Array3f index = point.array() / finest_length;
+    cell_indices.emplace_back(static_cast<int>(std::floor(index.x())),
+                              static_cast<int>(std::floor(index.y())),
+                              static_cast<int>(std::floor(index.z())));
+    min_index = min_index.min(cell_indices.back());
+    max_index = max_index.max(cell_indices.back());
+  }
+  int bits_per_coordinate = 0;
+  for (int i = 0; i != 3; ++i) {
+    min_index[i] = static_cast<int>(std::floor(
+                       min_index[i] / static_cast<double>(kCoarsestCellSize))) *
+                   kCoarsestCellSize;
+    bits_per_coordinate =
+        std::max(bits_per_coordinate,
+                 BitWidth(static_cast<int64>(max_index[i]) - min_index[i]));
+  }
+  if (bits_per_coordinate > kMaxBitsPerCoordinate) {
+    return AdaptivelyVoxelFiltered(options, point_cloud);
+  }
+
+  // Each entry holds the octree key in the high and the point index in the
+  // low 'index_bits' bits.
+  const int index_bits = BitWidth(point_cloud.size() - 1);
+  const int key_bits = 3 * bits_per_coordinate;
+  if (key_bits + index_bits > 64) {
+    return AdaptivelyVoxelFiltered(options, point_cloud);
+  }
+  const uint64 index_mask = (uint64{1} << index_bits) - 1;
+  std::vector<uint64> entries;
+  entries.reserve(point_cloud.size());
+  for (size_t i = 0; i != cell_indices.size(); ++i) {
+    entries.push_back(ToMortonKey(cell_indices[i] - min_index) << index_bits |
+                      i);
+  }
+  std::vector<uint64> scratch;
+  common::RadixSort(index_bits, index_bits + key_bits,
+                    [](const uint64 entry) { return entry; }, &entries,
+                    &scratch);
+
+  // Level 0 has the edge length 'max_length'.
+  const auto level_shift = [index_bits](const int level) {
+    return index_bits + 3 * (kNumLevels - 1 - level);
+  };
+  std::array<size_t, kNumLevels> num_voxels;
+  num_voxels.fill(1);
+  for (size_t i = 1; i < entries.size(); ++i) {
+    const uint64 difference = entries[i - 1] ^ entries[i];
+    for (int level = 0; level != kNumLevels; ++level) {
+      if (difference >> level_shift(level) != 0) {
+        ++num_voxels[level];
+      }
+    }
+  }
+  int level = 0;
+  while (level != kNumLevels - 1 &&
+         num_voxels[level] < options.min_num_points()) {
+    ++level;
+  }
+
+  // Keeps the first point of each voxel in the order of 'point_cloud'.
+  const int shift = level_shift(level);
+  std::vector<uint8> is_first_in_voxel(point_cloud.size(), 0);
+  uint64 first_index = entries.front() & index_mask;
+  for (size_t i = 1; i != entries.size(); ++i) {
+    const uint64 index = entries[i] & index_mask;
+    if (entries[i - 1] >> shift != entries[i] >> shift) {
+      is_first_in_voxel[first_index] = 1;
+      first_index = index;
+    } else {
+      first_index = std::min(first_index, index);
+    }
+  }
+  is_first_in_voxel[first_index] = 1;
+  PointCloud result;
+  result.reserve(num_voxels[level]);
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    if (is_first_in_voxel[i]) {
+      result.push_back(point_cloud[i]);
     }
   }
   return result;
@@ -78,9 +346,7 @@ PointCloud AdaptivelyVoxelFiltered(
 }  // namespace
 
 PointCloud VoxelFiltered(const PointCloud& point_cloud, const float size) {
-  VoxelFilter voxel_filter(size);
-  voxel_filter.InsertPointCloud(point_cloud);
-  return voxel_filter.point_cloud();
+  return SortingVoxelFilter(point_cloud).Filter(size);
 }
 
 VoxelFilter::VoxelFilter(const float size) : voxels_(size) {}
@@ -104,6 +370,8 @@ proto::AdaptiveVoxelFilterOptions CreateAdaptiveVoxelFilterOptions(
   options.set_min_num_points(
       parameter_dictionary->GetNonNegativeInt("min_num_points"));
   options.set_max_range(parameter_dictionary->GetDouble("max_range"));
+  options.set_use_voxel_count_pyramid(
+      parameter_dictionary->GetBool("use_voxel_count_pyramid"));
   return options;
 }
 
@@ -112,8 +380,12 @@ AdaptiveVoxelFilter::AdaptiveVoxelFilter(
     : options_(options) {}
 
 PointCloud AdaptiveVoxelFilter::Filter(const PointCloud& point_cloud) const {
-  return AdaptivelyVoxelFiltered(
-      options_, FilterByMaxRange(point_cloud, options_.max_range()));
+  const PointCloud point_cloud_in_range =
+      FilterByMaxRange(point_cloud, options_.max_range());
+  if (options_.use_voxel_count_pyramid()) {
+    return PyramidVoxelFiltered(options_, point_cloud_in_range);
+  }
+  return AdaptivelyVoxelFiltered(options_, point_cloud_in_range);
 }
 
 }  // namespace sensor
@@ -17,6 +17,9 @@
 #include "cartographer/sensor/voxel_filter.h"
 
 #include <cmath>
+#include <random>
+#include <set>
+#include <tuple>
 
 #include "gmock/gmock.h"
 
@@ -35,6 +38,64 @@ TEST(VoxelFilterTest, ReturnsTheFirstPointInEachVoxel) {
               ContainerEq(PointCloud{point_cloud[0], point_cloud[2]}));
 }
 
+TEST(VoxelFilterTest, MatchesIncrementalVoxelFilter) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-20.f, 20.f);
+  PointCloud point_cloud;
+  for (int i = 0; i != 10000; ++i) {
+    point_cloud.emplace_back(distribution(prng), distribution(prng),
+                             0.1f * distribution(prng));
+  }
+  // With the smallest size, there are too many voxels to sort them by a
+  // 32-bit key.
+  for (const float size : {0.005f, 0.1f, 0.5f, 3.f, 100.f}) {
+    VoxelFilter voxel_filter(size);
+    voxel_filter.InsertPointCloud(point_cloud);
+    EXPECT_THAT(VoxelFiltered(point_cloud, size),
+                ContainerEq(voxel_filter.point_cloud()));
+  }
+  EXPECT_TRUE(VoxelFiltered(PointCloud(), 0.1f).empty());
+}
+
+TEST(AdaptiveVoxelFilterTest, VoxelCountPyramid) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-5.f, 5.f);
+  PointCloud point_cloud;
+  for (int i = 0; i != 5000; ++i) {
+    point_cloud.emplace_back(distribution(prng), distribution(prng),
+                             0.1f * distribution(prng));
+  }
+  proto::AdaptiveVoxelFilterOptions options;
+  options.set_max_length(4.f);
+  options.set_max_range(100.f);
+  options.set_use_voxel_count_pyramid(true);
+  for (const int min_num_points : {1, 50, 300, 2000, 4999, 5000}) {
+    options.set_min_num_points(min_num_points);
+    // Filters with the largest length 'max_length' / 2^k which keeps enough
+    // points, using voxels aligned to the origin.
+    PointCloud expected;
+    for (int k = 0; k != 8; ++k) {
+      const float length = options.max_length() / (1 << k);
+      std::set<std::tuple<int, int, int>> voxels;
+      expected.clear();
+      for (const Eigen::Vector3f& point : point_cloud) {
+        const Eigen::Array3f index = (point / length).array().floor();
+        if (voxels.emplace(index.x(), index.y(), index.z()).second) {
+          expected.push_back(point);
+        }
+      }
+      if (expected.size() >= static_cast<size_t>(min_num_points)) {
+        break;
+      }
+    }
+    if (point_cloud.size() <= static_cast<size_t>(min_num_points)) {
+      expected = point_cloud;
+    }
+    EXPECT_THAT(AdaptiveVoxelFilter(options).Filter(point_cloud),
+                ContainerEq(expected));
+  }
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
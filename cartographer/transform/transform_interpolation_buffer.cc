@@ -17,6 +17,7 @@
 #include "cartographer/transform/transform_interpolation_buffer.h"
 
 #include <algorithm>
+#include <iterator>
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
@@ -26,6 +27,21 @@
 namespace cartographer {
 namespace transform {
 
+transform::Rigid3d InterpolateTransform(const common::Time start_time,
+                                        const transform::Rigid3d& start,
+                                        const common::Time end_time,
+                                        const transform::Rigid3d& end,
+                                        const common::Time time) {
+  const double duration = common::ToSeconds(end_time - start_time);
+  const double factor = common::ToSeconds(time - start_time) / duration;
+  const Eigen::Vector3d origin =
+      start.translation() + (end.translation() - start.translation()) * factor;
+  const Eigen::Quaterniond rotation =
+      Eigen::Quaterniond(start.rotation())
+          .slerp(factor, Eigen::Quaterniond(end.rotation()));
+  return transform::Rigid3d(origin, rotation);
+}
+
 TransformInterpolationBuffer::TransformInterpolationBuffer(
     const mapping::proto::Trajectory& trajectory) {
   for (const mapping::proto::Trajectory::Node& node : trajectory.node()) {
@@ -34,12 +50,27 @@ TransformInterpolationBuffer::TransformInterpolationBuffer(
   }
 }
 
+TransformInterpolationBuffer::TransformInterpolationBuffer(
+    const common::Duration max_age)
+    : max_age_(max_age) {
+  CHECK_GE(max_age_, common::Duration(0));
+}
+
 void TransformInterpolationBuffer::Push(const common::Time time,
                                         const transform::Rigid3d& transform) {
   if (!timestamped_transforms_.empty()) {
     CHECK_GE(time, latest_time()) << "New transform is older than latest.";
   }
   timestamped_transforms_.push_back(TimestampedTransform{time, transform});
+  if (max_age_ == common::Duration::max()) {
+    return;
+  }
+  // Keeps the newest transform at or before 'time - max_age_', so that lookups
+  // in the whole 'max_age_' can still be interpolated.
+  while (timestamped_transforms_.size() > 1 &&
+         timestamped_transforms_[1].time <= time - max_age_) {
+    timestamped_transforms_.pop_front();
+  }
 }
 
 bool TransformInterpolationBuffer::Has(const common::Time time) const {
@@ -52,30 +83,47 @@ bool TransformInterpolationBuffer::Has(const common::Time time) const {
 transform::Rigid3d TransformInterpolationBuffer::Lookup(
     const common::Time time) const {
   CHECK(Has(time)) << "Missing transform for: " << time;
-  auto start = std::lower_bound(
+  const auto end = std::lower_bound(
       timestamped_transforms_.begin(), timestamped_transforms_.end(), time,
       [](const TimestampedTransform& timestamped_transform,
          const common::Time time) {
         return timestamped_transform.time < time;
       });
-  const auto end = start;
   if (end->time == time) {
     return end->transform;
   }
-  --start;
-  if (start->time == time) {
-    return start->transform;
+  return Interpolate(*std::prev(end), *end, time);
+}
+
+std::vector<transform::Rigid3d> TransformInterpolationBuffer::Lookup(
+    const std::vector<common::Time>& times) const {
+  std::vector<transform::Rigid3d> transforms;
+  transforms.reserve(times.size());
+  auto end = timestamped_transforms_.begin();
+  for (size_t i = 0; i != times.size(); ++i) {
+    const common::Time time = times[i];
+    CHECK(Has(time)) << "Missing transform for: " << time;
+    if (i != 0) {
+      CHECK_LE(times[i - 1], time) << "Lookup times are not sorted.";
+    }
+    // Same as the std::lower_bound() above, continuing from the previous time.
+    while (end->time < time) {
+      ++end;
+    }
+    if (end->time == time) {
+      transforms.push_back(end->transform);
+    } else {
+      transforms.push_back(Interpolate(*std::prev(end), *end, time));
+    }
   }
+  return transforms;
+}
 
-  const double duration = common::ToSeconds(end->time - start->time);
-  const double factor = common::ToSeconds(time - start->time) / duration;
-  const Eigen::Vector3d origin =
-      start->transform.translation() +
-      (end->transform.translation() - start->transform.translation()) * factor;
-  const Eigen::Quaterniond rotation =
-      Eigen::Quaterniond(start->transform.rotation())
-          .slerp(factor, Eigen::Quaterniond(end->transform.rotation()));
-  return transform::Rigid3d(origin, rotation);
+transform::Rigid3d TransformInterpolationBuffer::Interpolate(
+    const TimestampedTransform& start, const TimestampedTransform& end,
+    const common::Time time) {
+  return InterpolateTransform(start.time, start.transform, end.time,
+                              end.transform, time);
 }
 
 common::Time TransformInterpolationBuffer::earliest_time() const {
@@ -92,5 +140,9 @@ bool TransformInterpolationBuffer::empty() const {
   return timestamped_transforms_.empty();
 }
 
+size_t TransformInterpolationBuffer::size() const {
+  return timestamped_transforms_.size();
+}
+
 }  // namespace transform
 }  // namespace cartographer
@@ -17,6 +17,7 @@
 #ifndef CARTOGRAPHER_TRANSFORM_TRANSFORM_INTERPOLATION_BUFFER_H_
 #define CARTOGRAPHER_TRANSFORM_TRANSFORM_INTERPOLATION_BUFFER_H_
 
+#include <deque>
 #include <vector>
 
 #include "cartographer/common/time.h"
@@ -26,6 +27,14 @@
 namespace cartographer {
 namespace transform {
 
+// Interpolates between 'start' at 'start_time' and 'end' at 'end_time' at
+// 'time' in between, linearly in translation and by slerp in rotation.
+transform::Rigid3d InterpolateTransform(common::Time start_time,
+                                        const transform::Rigid3d& start,
+                                        common::Time end_time,
+                                        const transform::Rigid3d& end,
+                                        common::Time time);
+
 // A time-ordered buffer of transforms that supports interpolated lookups.
 class TransformInterpolationBuffer {
  public:
@@ -33,8 +42,13 @@ class TransformInterpolationBuffer {
   explicit TransformInterpolationBuffer(
       const mapping::proto::Trajectory& trajectory);
 
-  // Adds a new transform to the buffer and removes the oldest transform if the
-  // buffer size limit is exceeded.
+  // Creates a buffer which only covers the 'max_age' before its latest
+  // transform. Older transforms are removed as new ones are pushed, so that
+  // the buffer does not grow over long trajectories.
+  explicit TransformInterpolationBuffer(common::Duration max_age);
+
+  // Adds a new transform to the buffer and removes transforms no longer needed
+  // to cover the 'max_age' before it.
   void Push(common::Time time, const transform::Rigid3d& transform);
 
   // Returns true if an interpolated transfrom can be computed at 'time'.
@@ -44,6 +58,12 @@ class TransformInterpolationBuffer {
   // 'time' is available.
   transform::Rigid3d Lookup(common::Time time) const;
 
+  // Returns interpolated transforms at each of 'times', which must be sorted in
+  // ascending order. Walks the buffer once instead of searching it for each
+  // time. CHECK()s that transforms at all 'times' are available.
+  std::vector<transform::Rigid3d> Lookup(
+      const std::vector<common::Time>& times) const;
+
   // Returns the timestamp of the earliest transform in the buffer or 0 if the
   // buffer is empty.
   common::Time earliest_time() const;
@@ -55,13 +75,22 @@ class TransformInterpolationBuffer {
   // Returns true if the buffer is empty.
   bool empty() const;
 
+  // Returns the number of transforms in the buffer.
+  size_t size() const;
+
  private:
   struct TimestampedTransform {
     common::Time time;
     transform::Rigid3d transform;
   };
 
-  std::vector<TimestampedTransform> timestamped_transforms_;
+  // Interpolates between 'start' and 'end' at 'time' in between.
+  static transform::Rigid3d Interpolate(const TimestampedTransform& start,
+                                        const TimestampedTransform& end,
+                                        common::Time time);
+
+  common::Duration max_age_ = common::Duration::max();
+  std::deque<TimestampedTransform> timestamped_transforms_;
 };
 
 }  // namespace transform
@@ -16,6 +16,8 @@
 
 #include "cartographer/transform/transform_interpolation_buffer.h"
 
+#include <vector>
+
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "cartographer/transform/rigid_transform.h"
@@ -62,6 +64,43 @@ TEST(TransformInterpolationBufferTest, testLookup) {
                1e-6));
 }
 
+TEST(TransformInterpolationBufferTest, testBatchLookup) {
+  TransformInterpolationBuffer buffer;
+  for (int i = 0; i != 5; ++i) {
+    buffer.Push(
+        common::FromUniversal(100 * i),
+        transform::Rigid3d::Translation(Eigen::Vector3d(i, 2. * i, 0.)) *
+            transform::Rigid3d::Rotation(
+                Eigen::AngleAxisd(0.1 * i, Eigen::Vector3d::UnitZ())));
+  }
+  const std::vector<common::Time> times = {
+      common::FromUniversal(0),   common::FromUniversal(25),
+      common::FromUniversal(25),  common::FromUniversal(100),
+      common::FromUniversal(330), common::FromUniversal(400)};
+  const std::vector<transform::Rigid3d> transforms = buffer.Lookup(times);
+  ASSERT_EQ(times.size(), transforms.size());
+  for (size_t i = 0; i != times.size(); ++i) {
+    EXPECT_THAT(transforms[i], IsNearly(buffer.Lookup(times[i]), 1e-9));
+  }
+}
+
+TEST(TransformInterpolationBufferTest, testMaxAge) {
+  TransformInterpolationBuffer buffer(common::FromSeconds(1.));
+  const common::Time start_time = common::FromUniversal(0);
+  for (int i = 0; i <= 100; ++i) {
+    buffer.Push(start_time + common::FromSeconds(0.1 * i),
+                transform::Rigid3d::Translation(Eigen::Vector3d(i, 0., 0.)));
+  }
+  EXPECT_EQ(start_time + common::FromSeconds(9.), buffer.earliest_time());
+  EXPECT_EQ(start_time + common::FromSeconds(10.), buffer.latest_time());
+  EXPECT_FALSE(buffer.Has(start_time + common::FromSeconds(8.95)));
+  EXPECT_TRUE(buffer.Has(start_time + common::FromSeconds(9.)));
+  EXPECT_THAT(buffer.Lookup(start_time + common::FromSeconds(9.05)),
+              IsNearly(transform::Rigid3d::Translation(
+                           Eigen::Vector3d(90.5, 0., 0.)),
+                       1e-9));
+}
+
 }  // namespace
 }  // namespace transform
 }  // namespace cartographer
@@ -18,5 +18,10 @@ MAP_BUILDER = {
   use_trajectory_builder_2d = false,
   use_trajectory_builder_3d = false,
   num_background_threads = 4,
+  use_work_stealing_thread_pool = false,
+  dispatch_trajectories_concurrently = false,
+  background_thread_cpus = {},
+  thread_pools = {},
+  serialize_precomputed_grids = false,
   sparse_pose_graph = SPARSE_POSE_GRAPH,
 }
@@ -19,13 +19,24 @@ SPARSE_POSE_GRAPH = {
     max_constraint_distance = 15.,
     min_score = 0.55,
     global_localization_min_score = 0.6,
+    global_localization_num_tasks = 1,
+    global_localization_time_limit_seconds = 0.,
     loop_closure_translation_weight = 1.1e4,
     loop_closure_rotation_weight = 1e5,
+    scan_matcher_cache_size_mb = 0,
+    scan_matcher_precomputation_num_tasks = 1,
+    decompressed_node_cache_size_mb = 64,
+    speculative_precomputation_num_range_data = 0,
+    use_coarse_precheck = true,
+    refinement_batch_num_threads = 4,
+    order_searches_by_value = false,
     log_matches = true,
     fast_correlative_scan_matcher = {
       linear_search_window = 7.,
       angular_search_window = math.rad(30.),
       branch_and_bound_depth = 7,
+      coarse_bits_per_cell = 8,
+      sort_points_by_cell = false,
     },
     ceres_scan_matcher = {
       occupied_space_weight = 20.,
@@ -52,6 +63,7 @@ SPARSE_POSE_GRAPH = {
       translation_weight = 10.,
       rotation_weight = 1.,
       only_optimize_yaw = false,
+      use_single_precision_evaluation = false,
       ceres_solver_options = {
         use_nonmonotonic_steps = false,
         max_num_iterations = 10,
@@ -69,6 +81,9 @@ SPARSE_POSE_GRAPH = {
     consecutive_scan_rotation_penalty_factor = 1e5,
     fixed_frame_pose_translation_weight = 1e1,
     fixed_frame_pose_rotation_weight = 1e2,
+    sliding_window_num_nodes = 0,
+    solve_connected_components_in_parallel = false,
+    min_num_iterations_before_interrupt = 5,
     log_solver_summary = false,
     ceres_solver_options = {
       use_nonmonotonic_steps = false,
@@ -80,4 +95,31 @@ SPARSE_POSE_GRAPH = {
   global_sampling_ratio = 0.003,
   log_residual_histograms = true,
   global_constraint_search_after_n_seconds = 10.,
+  load_shedding = {
+    min_backlog_scans = 30,
+    max_backlog_scans = 150,
+    min_backlog_seconds = 0.,
+    max_backlog_seconds = 0.,
+    min_sampling_ratio_factor = 0.1,
+    skip_global_localization_at_max_load = true,
+    max_optimize_every_n_scans_factor = 4.,
+  },
+  final_constraint_search_time_limit_seconds = 0.,
+  compress_node_point_clouds = false,
+  optimize_with_finished_constraints = false,
+  max_num_constraints_per_submap_pair = 0,
+  max_work_queue_size = 0,
+  place_recognition_num_candidates = 0,
+  max_num_change_log_entries = 100000,
+  interrupt_optimization_work_queue_size = 0,
+  overlapping_submaps_trimmer = {
+    fresh_submaps_count = 0,
+    min_covered_area = 20.,
+    min_added_submaps_count = 5,
+    coverage_cell_size = 1.,
+  },
+  deterministic = false,
+  cross_trajectory_search_area_size = 0.,
+  max_cross_trajectory_searches_per_area = 20,
+  cost_attribution_num_top_submaps = 0,
 }
@@ -20,18 +20,21 @@ TRAJECTORY_BUILDER_2D = {
   max_z = 2.,
   missing_data_ray_length = 5.,
   scans_per_accumulation = 1,
+  accumulation_duration_seconds = 0.,
   voxel_filter_size = 0.025,
 
   adaptive_voxel_filter = {
     max_length = 0.5,
     min_num_points = 200,
     max_range = 50.,
+    use_voxel_count_pyramid = false,
   },
 
   loop_closure_adaptive_voxel_filter = {
     max_length = 0.9,
     min_num_points = 100,
     max_range = 50.,
+    use_voxel_count_pyramid = false,
   },
 
   use_online_correlative_scan_matching = false,
@@ -53,10 +56,29 @@ TRAJECTORY_BUILDER_2D = {
     },
   },
 
+  use_gauss_newton_scan_matcher = false,
+  gauss_newton_scan_matcher = {
+    occupied_space_weight = 1.,
+    translation_weight = 10.,
+    rotation_weight = 40.,
+    max_num_iterations = 20,
+    min_step = 1e-4,
+  },
+
   motion_filter = {
     max_time_seconds = 5.,
     max_distance_meters = 0.2,
     max_angle_radians = math.rad(1.),
+    stationary_scan_matching_period_seconds = 0.,
+  },
+
+  degradation = {
+    time_budget_seconds = 0.,
+    step_up_budget_fraction = 0.5,
+    num_range_data_to_step_up = 20,
+    max_level = 4,
+    min_num_points_factor = 0.5,
+    max_num_ceres_iterations = 5,
   },
 
   imu_gravity_time_constant = 10.,
@@ -64,6 +86,11 @@ TRAJECTORY_BUILDER_2D = {
   submaps = {
     resolution = 0.05,
     num_range_data = 90,
+    use_tiled_probability_grid = false,
+    use_background_insertion = false,
+    low_resolution = 0.,
+    use_probability_mirror = false,
+    use_adaptive_resolution = false,
     range_data_inserter = {
       insert_free_space = true,
       hit_probability = 0.55,
@@ -18,18 +18,22 @@ TRAJECTORY_BUILDER_3D = {
   min_range = 1.,
   max_range = MAX_3D_RANGE,
   scans_per_accumulation = 1,
+  accumulation_duration_seconds = 0.,
+  match_rolling_window = false,
   voxel_filter_size = 0.15,
 
   high_resolution_adaptive_voxel_filter = {
     max_length = 2.,
     min_num_points = 150,
     max_range = 15.,
+    use_voxel_count_pyramid = false,
   },
 
   low_resolution_adaptive_voxel_filter = {
     max_length = 4.,
     min_num_points = 200,
     max_range = MAX_3D_RANGE,
+    use_voxel_count_pyramid = false,
   },
 
   use_online_correlative_scan_matching = false,
@@ -46,6 +50,7 @@ TRAJECTORY_BUILDER_3D = {
     translation_weight = 5.,
     rotation_weight = 4e2,
     only_optimize_yaw = false,
+    use_single_precision_evaluation = false,
     ceres_solver_options = {
       use_nonmonotonic_steps = false,
       max_num_iterations = 12,
@@ -57,6 +62,30 @@ TRAJECTORY_BUILDER_3D = {
     max_time_seconds = 0.5,
     max_distance_meters = 0.1,
     max_angle_radians = 0.004,
+    stationary_scan_matching_period_seconds = 0.,
+  },
+
+  sliding_window_optimizer = {
+    num_scans = 0,
+    high_resolution_occupied_space_weight = 1.,
+    low_resolution_occupied_space_weight = 6.,
+    rotation_weight = 1e2,
+    acceleration_weight = 1.,
+    ceres_solver_options = {
+      use_nonmonotonic_steps = false,
+      max_num_iterations = 10,
+      num_threads = 1,
+    },
+    max_solver_time_seconds = 0.02,
+  },
+
+  degradation = {
+    time_budget_seconds = 0.,
+    step_up_budget_fraction = 0.5,
+    num_range_data_to_step_up = 20,
+    max_level = 4,
+    min_num_points_factor = 0.5,
+    max_num_ceres_iterations = 5,
   },
 
   imu_gravity_time_constant = 10.,
@@ -67,10 +96,12 @@ TRAJECTORY_BUILDER_3D = {
     high_resolution_max_range = 20.,
     low_resolution = 0.45,
     num_range_data = 160,
+    use_background_insertion = false,
     range_data_inserter = {
       hit_probability = 0.55,
       miss_probability = 0.49,
       num_free_space_voxels = 2,
+      num_threads = 1,
     },
   },
 }